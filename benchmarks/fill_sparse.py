@@ -40,3 +40,37 @@ def benchmark_nested_struct_fill_and_clear():
         clear()
 
     return ti.benchmark(task, repeat=30)
+
+
+def fill_pointer_concurrently():
+    a = ti.field(dtype=ti.f32)
+    N = 256
+
+    ti.root.pointer(ti.ij, [N, N]).dense(ti.ij, [8, 8]).place(a)
+
+    @ti.kernel
+    def fill():
+        # 8 threads activate each child concurrently
+        for i, j in ti.ndrange(N * 8, N * 64):
+            a[i, j // 8] += 1.0
+
+    @ti.kernel
+    def clear():
+        for i, j in a.parent():
+            ti.deactivate(a.parent().parent(), [i, j])
+
+    def task():
+        fill()
+        clear()
+
+    return ti.benchmark(task, repeat=30)
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def benchmark_fill_pointer_lock_free():
+    return fill_pointer_concurrently()
+
+
+@ti.archs_with([ti.cpu, ti.cuda], lock_free_activation=False)
+def benchmark_fill_pointer_locked():
+    return fill_pointer_concurrently()
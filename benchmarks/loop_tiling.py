@@ -0,0 +1,31 @@
+import taichi as ti
+
+N = 512  # 512 MB per buffer
+
+
+def stencil_3d():
+    a = ti.field(dtype=ti.f32, shape=(N, N, N))
+    b = ti.field(dtype=ti.f32, shape=(N, N, N))
+
+    @ti.kernel
+    def laplace():
+        for i, j, k in b:
+            if 0 < i < N - 1 and 0 < j < N - 1 and 0 < k < N - 1:
+                b[i, j, k] = (a[i - 1, j, k] + a[i + 1, j, k] +
+                              a[i, j - 1, k] + a[i, j + 1, k] +
+                              a[i, j, k - 1] + a[i, j, k + 1] -
+                              6 * a[i, j, k])
+
+    return ti.benchmark(laplace, repeat=10)
+
+
+# 8 B/it when the neighbors hit the cache
+@ti.archs_with([ti.cpu])
+def benchmark_stencil_3d_rows():
+    return stencil_3d()
+
+
+# 8 B/it when the neighbors hit the cache
+@ti.archs_with([ti.cpu], cpu_tile_shape=(4, 8, 64))
+def benchmark_stencil_3d_tiled():
+    return stencil_3d()
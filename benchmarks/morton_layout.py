@@ -0,0 +1,36 @@
+import taichi as ti
+
+N = 256  # 64 MB per buffer
+
+
+def stencil_3d(morton):
+    a = ti.field(dtype=ti.f32)
+    b = ti.field(dtype=ti.f32)
+    for x in [a, b]:
+        block = ti.root.dense(ti.ijk, N)
+        if morton:
+            block.morton()
+        block.place(x)
+
+    @ti.kernel
+    def laplace():
+        for i, j, k in b:
+            if 0 < i < N - 1 and 0 < j < N - 1 and 0 < k < N - 1:
+                b[i, j, k] = (a[i - 1, j, k] + a[i + 1, j, k] +
+                              a[i, j - 1, k] + a[i, j + 1, k] +
+                              a[i, j, k - 1] + a[i, j, k + 1] -
+                              6 * a[i, j, k])
+
+    return ti.benchmark(laplace, repeat=10)
+
+
+# The neighbors along i and j are N and N * N elements away
+@ti.archs_with([ti.cpu, ti.cuda])
+def benchmark_stencil_3d_row_major():
+    return stencil_3d(morton=False)
+
+
+# Most neighbors share a Z-order tile of the same few cache lines
+@ti.archs_with([ti.cpu, ti.cuda])
+def benchmark_stencil_3d_morton():
+    return stencil_3d(morton=True)
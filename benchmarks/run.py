@@ -1,5 +1,17 @@
+import argparse
+import json
 import os
+import sys
 import taichi as ti
+import yaml
+
+# Bump when the layout of the results file changes.
+RESULTS_VERSION = 1
+
+# The metrics compared against the baseline. Larger is worse for all of them.
+TRACKED_METRICS = [
+    'wall_clk_t', 'exec_t', 'compilation_time', 'memory_peak_mb'
+]
 
 
 def get_benchmark_dir():
@@ -61,7 +73,132 @@ class TaichiBenchmark:
         print("Running...")
         for s in self.suites:
             s.run()
+        with open(filename, 'r') as f:
+            return yaml.load(f, Loader=yaml.SafeLoader) or {}
+
+
+def save_results(data, filename):
+    """Saves the records of a run, which are laid out as
+    data[case][metric][arch][mode], together with the version they came from.
+    """
+    results = {
+        'version': RESULTS_VERSION,
+        'taichi_version': '.'.join(map(str, ti.__version__)),
+        'commit': ti.core.get_commit_hash(),
+        'records': data,
+    }
+    with open(filename, 'w') as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    print(f'Results saved to {filename}')
+
+
+def load_results(filename):
+    with open(filename, 'r') as f:
+        results = json.load(f)
+    if results.get('version') != RESULTS_VERSION:
+        raise RuntimeError(
+            f'{filename} has results version {results.get("version")}, '
+            f'expected {RESULTS_VERSION}')
+    return results
+
+
+def compare(baseline, current, threshold, sigma):
+    """Finds the tracked metrics that changed by more than |threshold| (a
+    ratio) of the baseline. Wall clock times must also change by more than
+    |sigma| times the standard error of the difference, so that noisy cases
+    are not reported.
+    """
+    regressions, improvements = [], []
+    for case, metrics in current['records'].items():
+        base_metrics = baseline['records'].get(case, {})
+        for metric in TRACKED_METRICS:
+            for arch, modes in metrics.get(metric, {}).items():
+                for mode, value in modes.items():
+                    try:
+                        base = base_metrics[metric][arch][mode]
+                    except KeyError:
+                        continue
+                    delta = value - base
+                    bound = threshold * abs(base)
+                    errors = [
+                        r.get(f'{metric}_stderr', {}).get(arch, {}).get(mode)
+                        for r in [base_metrics, metrics]
+                    ]
+                    if None not in errors:
+                        noise = sigma * (errors[0]**2 + errors[1]**2)**0.5
+                        bound = max(bound, noise)
+                    if abs(delta) <= bound:
+                        continue
+                    entry = {
+                        'case': case,
+                        'metric': metric,
+                        'arch': arch,
+                        'mode': mode,
+                        'baseline': base,
+                        'current': value,
+                        'change': delta / base if base else float('inf'),
+                    }
+                    (regressions if delta > 0 else improvements).append(entry)
+    return {
+        'version': RESULTS_VERSION,
+        'baseline_commit': baseline['commit'],
+        'current_commit': current['commit'],
+        'threshold': threshold,
+        'sigma': sigma,
+        'regressions': regressions,
+        'improvements': improvements,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run the benchmarks, and optionally compare them against '
+        'a baseline')
+    parser.add_argument('-o',
+                        '--results',
+                        default=None,
+                        help='Results file to write, defaults to '
+                        'results-<commit>.json in TI_BENCHMARK_OUTPUT_DIR')
+    parser.add_argument('-b',
+                        '--baseline',
+                        default=None,
+                        help='Results file of an earlier run to compare with')
+    parser.add_argument('-r',
+                        '--report',
+                        default=None,
+                        help='Where to write the JSON regression report')
+    parser.add_argument('--threshold',
+                        type=float,
+                        default=0.05,
+                        help='Smallest relative change to report')
+    parser.add_argument('--sigma',
+                        type=float,
+                        default=3.0,
+                        help='Smallest change to report in wall clock times, '
+                        'in standard errors')
+    args = parser.parse_args()
+
+    data = TaichiBenchmark().run()
+    output_dir = os.environ.get('TI_BENCHMARK_OUTPUT_DIR', '.')
+    results_file = args.results or os.path.join(
+        output_dir, f'results-{ti.core.get_commit_hash()[:8]}.json')
+    save_results(data, results_file)
+    if args.baseline is None:
+        return 0
+
+    report = compare(load_results(args.baseline), load_results(results_file),
+                     args.threshold, args.sigma)
+    for kind in ['regressions', 'improvements']:
+        print(f'{len(report[kind])} {kind}:')
+        for e in report[kind]:
+            print(f'  {e["case"]:<32} {e["metric"]:<18} {e["arch"]:<6} '
+                  f'{e["mode"]:<6} {e["baseline"]:.4g} -> {e["current"]:.4g} '
+                  f'({e["change"]:+.1%})')
+    if args.report:
+        with open(args.report, 'w') as f:
+            json.dump(report, f, indent=2)
+    return 1 if report['regressions'] else 0
 
 
-b = TaichiBenchmark()
-b.run()
+if __name__ == '__main__':
+    sys.exit(main())
@@ -4,6 +4,7 @@ option(USE_STDCPP "Use -stdlib=libc++" OFF)
 option(TI_WITH_CUDA "Build with the CUDA backend" ON)
 option(TI_WITH_OPENGL "Build with the OpenGL backend" ON)
 option(TI_WITH_CC "Build with the C backend" ON)
+option(TI_WITH_VULKAN "Build with the Vulkan backend" OFF)
 
 if (APPLE)
     if (TI_WITH_CUDA)
@@ -43,6 +44,7 @@ file(GLOB TAICHI_CUDA_SOURCE "taichi/backends/cuda/*.cpp" "taichi/backends/cuda/
 file(GLOB TAICHI_METAL_SOURCE "taichi/backends/metal/*.h" "taichi/backends/metal/*.cpp" "taichi/backends/metal/shaders/*")
 file(GLOB TAICHI_OPENGL_SOURCE "taichi/backends/opengl/*.h" "taichi/backends/opengl/*.cpp" "taichi/backends/opengl/shaders/*")
 file(GLOB TAICHI_CC_SOURCE "taichi/backends/cc/*.h" "taichi/backends/cc/*.cpp")
+file(GLOB TAICHI_VULKAN_SOURCE "taichi/backends/vulkan/*.h" "taichi/backends/vulkan/*.cpp")
 
 list(REMOVE_ITEM TAICHI_CORE_SOURCE ${TAICHI_BACKEND_SOURCE})
 
@@ -60,6 +62,7 @@ endif()
 # TODO(#529) include Metal source only on Apple MacOS, and OpenGL only when TI_WITH_OPENGL is ON
 list(APPEND TAICHI_CORE_SOURCE ${TAICHI_METAL_SOURCE})
 list(APPEND TAICHI_CORE_SOURCE ${TAICHI_OPENGL_SOURCE})
+list(APPEND TAICHI_CORE_SOURCE ${TAICHI_VULKAN_SOURCE})
 
 if (TI_WITH_OPENGL)
   set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DTI_WITH_OPENGL")
@@ -69,6 +72,15 @@ if (TI_WITH_OPENGL)
   list(APPEND TAICHI_CORE_SOURCE ${TAICHI_GLAD_SOURCE})
 endif()
 
+if (TI_WITH_VULKAN)
+  find_package(Vulkan REQUIRED)
+  # shaderc compiles the GLSL of the OpenGL codegen to SPIR-V, and comes with
+  # the Vulkan SDK.
+  find_library(SHADERC_LIBRARY NAMES shaderc_combined shaderc_shared
+               HINTS $ENV{VULKAN_SDK}/lib REQUIRED)
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DTI_WITH_VULKAN")
+endif()
+
 if (TI_WITH_CC)
   set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DTI_WITH_CC")
   list(APPEND TAICHI_CORE_SOURCE ${TAICHI_CC_SOURCE})
@@ -100,6 +112,11 @@ if (TI_WITH_OPENGL)
   target_link_libraries(${LIBRARY_NAME} glfw)
 endif()
 
+if (TI_WITH_VULKAN)
+  include_directories(${Vulkan_INCLUDE_DIRS})
+  target_link_libraries(${LIBRARY_NAME} ${Vulkan_LIBRARIES} ${SHADERC_LIBRARY})
+endif()
+
 # http://llvm.org/docs/CMake.html#embedding-llvm-in-your-project
 find_package(LLVM REQUIRED CONFIG)
 message(STATUS "Found LLVM ${LLVM_PACKAGE_VERSION}")
@@ -0,0 +1,51 @@
+# Compares the compile time of the kernels in tests/python with and without
+# verifying the IR after each compilation pass.
+#
+# Usage: python3 misc/benchmark_ir_verification.py [test files or directories]
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+
+def run_tests(paths, verify_each_pass):
+    with tempfile.TemporaryDirectory() as tmp:
+        env = dict(os.environ)
+        env['TI_ARCH'] = 'x64'
+        env['TI_COMPILE_PROFILER'] = '1'
+        env['TI_VERIFY_EACH_PASS'] = '1' if verify_each_pass else '0'
+        env['TI_COMPILE_PROFILE_DIR'] = tmp
+        subprocess.run([
+            sys.executable, '-m', 'pytest', '-q', '-p',
+            'misc.benchmark_ir_verification', *paths
+        ],
+                       env=env,
+                       stdout=subprocess.DEVNULL)
+        total, verify = 0.0, 0.0
+        for fn in os.listdir(tmp):
+            with open(os.path.join(tmp, fn)) as f:
+                for r in json.load(f):
+                    total += r['time']
+                    if r['pass'] == 'Verify':
+                        verify += r['time']
+        return total, verify
+
+
+# Used as a pytest plugin by run_tests(): dumps the compile profile of each
+# test before the next ti.init() discards it.
+def pytest_runtest_teardown(item):
+    import taichi as ti
+    out_dir = os.environ.get('TI_COMPILE_PROFILE_DIR')
+    if out_dir and ti.get_runtime().prog is not None:
+        name = item.nodeid.replace('/', '_').replace(':', '_')
+        ti.compile_profiler_dump_json(os.path.join(out_dir, name + '.json'))
+
+
+if __name__ == '__main__':
+    paths = sys.argv[1:] or ['tests/python']
+    for verify_each_pass in [True, False]:
+        total, verify = run_tests(paths, verify_each_pass)
+        print(f'verify_each_pass={verify_each_pass}: '
+              f'IR passes {total:.3f} s, of which verification {verify:.3f} s')
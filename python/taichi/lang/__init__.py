@@ -3,6 +3,13 @@ from .util import deprecated
 from .matrix import Matrix, Vector
 from .transformer import TaichiSyntaxError
 from .ndrange import ndrange, GroupedNDRange
+from .external_array import zero_copy_array, prefetch, mem_advise
+from .cuda_graph import cuda_graph
+from .distributed import DistributedDomain, GhostExchange
+from .parallel_primitives import exclusive_scan, sort_by_key, compact
+from .sparse_matrix import SparseMatrix
+from .device_array import DeviceArray
+from .fields_builder import FieldsBuilder
 from copy import deepcopy as _deepcopy
 import functools
 import os
@@ -39,13 +46,51 @@ arm64 = core.arm64
 cuda = core.cuda
 metal = core.metal
 opengl = core.opengl
+vulkan = core.vulkan
 cc = core.cc
-gpu = [cuda, metal, opengl]
+gpu = [cuda, metal, opengl, vulkan]
 cpu = core.host_arch()
 kernel_profiler_print = lambda: get_runtime().prog.kernel_profiler_print()
 kernel_profiler_clear = lambda: get_runtime().prog.kernel_profiler_clear()
 kernel_profiler_total_time = lambda: get_runtime(
 ).prog.kernel_profiler_total_time()
+kernel_profiler_gc_time = lambda: get_runtime().prog.kernel_profiler_gc_time()
+kernel_profiler_dump_trace = lambda file_name: get_runtime(
+).prog.kernel_profiler_dump_trace(file_name)
+compile_profiler_print = lambda: get_runtime().prog.compile_profiler_print()
+compile_profiler_dump_json = lambda filename: get_runtime(
+).prog.compile_profiler_dump_json(filename)
+compile_profiler_clear = lambda: get_runtime().prog.compile_profiler_clear()
+
+
+def trace_start():
+    """Starts recording the kernel calls, compilation stages, async engine
+    tasks, memory pool allocations and, with ``kernel_profiler=True``, the
+    device tasks on one timeline."""
+    from . import kernel
+    core.tracer_enable()
+    kernel.trace_kernel_calls = True
+
+
+def trace_stop():
+    from . import kernel
+    kernel.trace_kernel_calls = False
+    core.tracer_disable()
+
+
+def trace_clear():
+    core.tracer_clear()
+
+
+def trace_dump(file_name):
+    """Writes the events recorded since ``ti.trace_start()`` in the Chrome
+    trace event format, for chrome://tracing or Perfetto."""
+    prog = get_runtime().prog
+    if prog is not None:
+        # Collect the device tasks still in flight.
+        prog.synchronize()
+        prog.kernel_profiler_sync()
+    core.tracer_dump(file_name)
 
 # Unstable API
 type_factory_ = core.get_type_factory_instance()
@@ -56,6 +101,123 @@ def memory_profiler_print():
     get_runtime().prog.print_memory_profiler_info()
 
 
+def memory_stats():
+    """The memory usage of every SNode, gathered in a single runtime call
+    (CPU and CUDA only).
+
+    Returns:
+        Dict[int, dict]: The stats by SNode id, see ``SNode.memory_stats``.
+    """
+    get_runtime().materialize()
+    prog = get_runtime().prog
+    return {
+        snode_id: _memory_stats_to_dict(s)
+        for snode_id, s in enumerate(prog.get_memory_stats())
+    }
+
+
+def _memory_stats_to_dict(s):
+    reserved = s.num_chunks * s.chunk_size
+    live = s.num_live_nodes * s.node_size
+    return {
+        'element_list_size': s.element_list_size,
+        'element_list_chunks': s.element_list_num_chunks,
+        'element_list_bytes':
+        s.element_list_num_chunks * s.element_list_chunk_size,
+        'allocated_nodes': s.num_allocated_nodes,
+        'live_nodes': s.num_live_nodes,
+        'peak_live_nodes': s.peak_num_live_nodes,
+        'num_chunks': s.num_chunks,
+        'peak_num_chunks': s.peak_num_chunks,
+        'live_bytes': live,
+        'reserved_bytes': reserved,
+        'peak_reserved_bytes': s.peak_num_chunks * s.chunk_size,
+        # The share of the reserved memory not holding live nodes.
+        'fragmentation': 1 - live / reserved if reserved > 0 else 0.0,
+    }
+
+
+def trim_memory():
+    """Returns the memory that no field or list is using to the OS, or to the
+    CUDA driver, so that other processes can use it.
+
+    Returns:
+        int: The number of bytes released.
+    """
+    return get_runtime().prog.trim_memory()
+
+
+def save_checkpoint(path, delta=False, compress=False, error_bound=None):
+    """Saves all the fields to a binary file, which ``ti.load_checkpoint``
+    restores in a later run with the same layout (CPU and CUDA only).
+
+    Dense fields are saved as the bytes of the root buffer, and sparse ones as
+    the indices and values of their active cells.
+
+    Args:
+        path (str): The file to write.
+        delta (bool): Only saves what changed since the checkpoint saved last
+            by this program, which restoring this one also reads: the
+            children of ``ti.root`` that kernels wrote since, and of those,
+            the 64 KB chunks of dense fields and the blocks of sparse fields
+            that differ.
+        compress (Union[bool, int]): Compresses the file with deflate, in
+            parallel, at a zlib level from 1 (fastest) to 9, or 6 if True.
+        error_bound (Union[float, Dict[Field, float]]): The largest error the
+            values of floating-point fields may be saved with, for all of
+            them or by field. Their values are then saved as 8, 16 or 32-bit
+            integers quantized to a grid of twice this step, when that is
+            smaller.
+    """
+    get_runtime().materialize()
+    if compress is True:
+        level = 6
+    else:
+        level = int(compress)
+    error_bounds = {}
+    if isinstance(error_bound, dict):
+        for field, bound in error_bound.items():
+            for member in field.get_field_members():
+                error_bounds[member.snode.ptr.id] = float(bound)
+    elif error_bound is not None:
+        error_bounds[-1] = float(error_bound)
+    for bound in error_bounds.values():
+        assert bound > 0, 'Error bounds must be positive'
+    get_runtime().prog.save_checkpoint(path, delta, level, error_bounds)
+
+
+def load_checkpoint(path, copy_on_write=False):
+    """Restores all the fields from a file written by ``ti.save_checkpoint``,
+    after the checkpoints it is a delta of. The sparse fields are deactivated
+    first.
+
+    Args:
+        path (str): The file to read.
+        copy_on_write (bool): On CPU, maps the dense fields from the file
+            copy-on-write instead of copying them, so that only the pages
+            accessed afterwards are read from disk.
+    """
+    get_runtime().materialize()
+    root.deactivate_all()
+    get_runtime().prog.load_checkpoint(path, copy_on_write)
+
+
+def layout_advice():
+    """Reports how the fields placed in the dense children of ``ti.root``
+    would better be grouped, i.e. which fields to place together (AoS) or
+    apart (SoA), for the kernels launched so far, and the bytes moved
+    either way.
+
+    Requires ``ti.init(layout_advisor=True)``.
+
+    Returns:
+        str: The report.
+    """
+    get_runtime().materialize()
+    get_runtime().sync()
+    return get_runtime().prog.get_layout_advice()
+
+
 extension = core.Extension
 is_extension_supported = core.is_extension_supported
 
@@ -175,6 +337,8 @@ def init(arch=None,
     env_spec.add('excepthook')
 
     # compiler configurations (ti.cfg):
+    if isinstance(kwargs.get('cpu_tile_shape'), (tuple, list)):
+        kwargs['cpu_tile_shape'] = ','.join(map(str, kwargs['cpu_tile_shape']))
     for key in dir(ti.cfg):
         if key in ['arch', 'default_fp', 'default_ip']:
             continue
@@ -251,6 +415,7 @@ parallelize = core.parallelize
 serialize = lambda: parallelize(1)
 vectorize = core.vectorize
 block_dim = core.block_dim
+unroll = core.unroll
 
 inversed = deprecated('ti.inversed(a)', 'a.inverse()')(Matrix.inversed)
 transposed = deprecated('ti.transposed(a)', 'a.transpose()')(Matrix.transposed)
@@ -310,20 +475,146 @@ def clear_all_gradients():
 
         places = tuple(places)
         if places:
-            from .meta import clear_gradients
-            clear_gradients(places)
+            parent = node.ptr.parent
+            if (parent.type == ti.core.SNodeType.pointer
+                    and all(not node.ptr.get_ch(i).is_primal()
+                            for i in range(node.ptr.get_num_ch()))):
+                # Sparse gradients (see SNode.lazy_grad) go back to inactive.
+                SNode(parent).deactivate_all()
+            else:
+                from .meta import clear_gradients
+                clear_gradients(places)
 
     visit(ti.root)
 
 
+def checkpointed_rollout(step,
+                         num_steps,
+                         states,
+                         loss,
+                         compute_loss,
+                         buffers=(),
+                         clear_gradients=True):
+    """Runs ``num_steps`` steps of a simulation, and back-propagates ``loss``
+    through them while storing only every k-th state.
+
+    The first axis of each field in ``states`` holds the states of one segment
+    of k steps, so that it has k + 1 entries: ``step(t)`` reads entry ``t`` and
+    writes entry ``t + 1``. Before each segment, entry k is moved to entry 0,
+    and a copy of entry 0 (the checkpoint) is kept on the host. The backward
+    pass goes over the segments in reverse, recomputing the states of each
+    segment from its checkpoint before calling ``step.grad``. Choosing k close
+    to ``sqrt(num_steps)`` minimizes the memory used.
+
+    Args:
+        step (Kernel): Advances the states by one step.
+        num_steps (int): The number of steps.
+        states (List[Field]): The fields carried from step to step.
+        loss (Field): The 0-D loss field.
+        compute_loss (Kernel): ``compute_loss(t)`` accumulates ``loss`` from
+            entry ``t`` of the states after the last step.
+        buffers (List[Field]): Other fields that ``step(t)`` writes at entry
+            ``t`` of their first axis. Their gradients are cleared before each
+            segment.
+        clear_gradients (bool): Whether to clear all gradients first.
+    """
+    get_runtime().materialize()
+    import numpy as np
+    states = list(states)
+    if not states:
+        raise RuntimeError('Checkpointed rollouts need at least one state')
+    k = states[0].shape[0] - 1
+    for f in states + list(buffers):
+        if f.shape[0] != k + 1:
+            raise RuntimeError(
+                'The first axes of the state and buffer fields must have the '
+                f'same size, got {f.shape[0]} and {k + 1}')
+    if k < 1:
+        raise RuntimeError(
+            'The first axes of the state fields must have at least 2 entries')
+    if num_steps < 1:
+        raise RuntimeError('Checkpointed rollouts need at least one step')
+    if clear_gradients:
+        clear_all_gradients()
+
+    from .meta import clear_loss
+    clear_loss(loss)
+
+    def restore(f, entry):
+        arr = f.to_numpy()
+        arr[0] = entry
+        f.from_numpy(arr)
+
+    num_segments = (num_steps + k - 1) // k
+    segment_lengths = [min(k, num_steps - s * k) for s in range(num_segments)]
+    checkpoints = []
+    for s in range(num_segments):
+        if s > 0:
+            for f in states:
+                restore(f, f.to_numpy()[k])
+        checkpoints.append([f.to_numpy()[0] for f in states])
+        for t in range(segment_lengths[s]):
+            step(t)
+    compute_loss(segment_lengths[-1])
+
+    carried = None
+    for s in reversed(range(num_segments)):
+        length = segment_lengths[s]
+        for f, entry in zip(states, checkpoints[s]):
+            restore(f, entry)
+        checkpoints[s] = None
+        for t in range(length):
+            step(t)
+        for f in buffers:
+            f.grad.fill(0)
+        for i, f in enumerate(states):
+            grad = np.zeros_like(f.grad.to_numpy())
+            if carried is not None:
+                grad[length] = carried[i]
+            f.grad.from_numpy(grad)
+        if s == num_segments - 1:
+            compute_loss.grad(length)
+        for t in reversed(range(length)):
+            step.grad(t)
+        carried = [f.grad.to_numpy()[0] for f in states]
+
+
 lang_core = core
 
 
+def _reset_peak_memory():
+    # Writing 5 to clear_refs resets VmHWM on Linux 4.0+.
+    try:
+        with open('/proc/self/clear_refs', 'w') as f:
+            f.write('5')
+    except OSError:
+        pass
+
+
+def _peak_memory_mb():
+    try:
+        with open('/proc/self/status') as f:
+            for line in f:
+                if line.startswith('VmHWM:'):
+                    return int(line.split()[1]) / 1024
+    except OSError:
+        pass
+    try:
+        import resource
+        import sys
+        peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+        # Bytes on macOS, kilobytes elsewhere.
+        return peak / 1024**2 if sys.platform == 'darwin' else peak / 1024
+    except ImportError:
+        return 0
+
+
 def benchmark(func, repeat=300, args=()):
     import taichi as ti
     import time
 
     def run_benchmark():
+        _reset_peak_memory()
         compile_time = time.time()
         func(*args)  # compile the kernel first
         ti.sync()
@@ -351,15 +642,21 @@ def benchmark(func, repeat=300, args=()):
             func(*args)
             ti.sync()
         ti.kernel_profiler_clear()
-        t = time.time()
+        samples = []
         for n in range(repeat):
+            t = time.perf_counter()
             func(*args)
             ti.sync()
-        elapsed = time.time() - t
-        avg = elapsed / repeat
+            samples.append(time.perf_counter() - t)
+        avg = sum(samples) / repeat
         ti.stat_write('wall_clk_t', avg)
+        # The standard error of the mean, for telling regressions from noise
+        if repeat > 1:
+            var = sum((s - avg)**2 for s in samples) / (repeat - 1)
+            ti.stat_write('wall_clk_t_stderr', (var / repeat)**0.5)
         device_time = ti.kernel_profiler_total_time()
         ti.stat_write('exec_t', device_time)
+        ti.stat_write('memory_peak_mb', _peak_memory_mb())
 
     run_benchmark()
 
@@ -519,6 +816,7 @@ def is_arch_supported(arch):
         cuda: core.with_cuda,
         metal: core.with_metal,
         opengl: core.with_opengl,
+        vulkan: core.with_vulkan,
         cc: core.with_cc,
         cpu: lambda: True
     }
@@ -535,7 +833,7 @@ def is_arch_supported(arch):
 
 
 def supported_archs():
-    archs = [cpu, cuda, metal, opengl, cc]
+    archs = [cpu, cuda, metal, opengl, vulkan, cc]
 
     wanted_archs = os.environ.get('TI_WANTED_ARCHS', '')
     want_exclude = wanted_archs.startswith('^')
@@ -649,6 +947,9 @@ def archs_excluding(*excluded_archs, **kwargs):
     # |kwargs| will be passed to all_archs_with(**kwargs)
     assert all([isinstance(a, core.Arch) for a in excluded_archs])
     excluded_archs = set(excluded_archs)
+    if opengl in excluded_archs:
+        # Vulkan runs the same GLSL.
+        excluded_archs.add(vulkan)
 
     def decorator(test):
         @functools.wraps(test)
@@ -793,4 +1094,46 @@ def sync():
     get_runtime().sync()
 
 
+def export_cc(source_path, header_path):
+    """On the C backend, writes the kernels compiled so far, their runtime and
+    the layout of the fields to a standalone C source and header.
+
+    Args:
+        source_path (str): The path of the C source.
+        header_path (str): The path of the C header, which the source includes
+            by its file name.
+    """
+    get_runtime().materialize()
+    get_runtime().prog.export_cc_library(source_path, header_path)
+
+
+def export_aot(path):
+    """On CPU and CUDA, writes the kernels compiled so far to an AOT module,
+    which :func:`load_aot_module` launches without recompiling them.
+
+    Requires ``ti.init(aot_record=True)``.
+
+    Args:
+        path (str): The path of the AOT module.
+    """
+    get_runtime().materialize()
+    get_runtime().prog.export_llvm_aot_module(path)
+
+
+def load_aot_module(path):
+    """Loads the kernels of an AOT module written by :func:`export_aot`.
+
+    The fields must be defined exactly as when the module was exported, under
+    the same arch and options.
+
+    Args:
+        path (str): The path of the AOT module.
+
+    Returns:
+        :class:`AotModule`: The loaded kernels, by name.
+    """
+    get_runtime().materialize()
+    return AotModule(get_runtime().prog.load_llvm_aot_module(path))
+
+
 __all__ = [s for s in dir() if not s.startswith('_')]
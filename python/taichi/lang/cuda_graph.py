@@ -0,0 +1,37 @@
+import functools
+
+from .impl import get_runtime
+from .util import python_scope
+
+
+def cuda_graph(func):
+    '''Decorates a Python function launching a fixed sequence of kernels, so
+    that on ``ti.cuda`` the sequence is captured into a CUDA graph at the first
+    call, and replayed with a single launch at the following calls.
+
+    Only the scalar arguments of the kernels may change between calls. On
+    other archs, this decorator has no effect.
+    '''
+    handle = None
+    prog = None
+
+    @functools.wraps(func)
+    @python_scope
+    def wrapped(*args, **kwargs):
+        nonlocal handle, prog
+        runtime = get_runtime()
+        runtime.materialize()
+        # The graph belongs to the program, and is recaptured after ti.reset().
+        if prog is not runtime.prog:
+            prog = runtime.prog
+            handle = prog.create_cuda_graph()
+        if handle < 0:
+            return func(*args, **kwargs)
+        prog.begin_cuda_graph(handle)
+        try:
+            ret = func(*args, **kwargs)
+        finally:
+            prog.end_cuda_graph(handle)
+        return ret
+
+    return wrapped
@@ -0,0 +1,67 @@
+import numpy as np
+
+from .impl import get_runtime
+from .util import cook_dtype, python_scope, to_numpy_type
+
+
+class DeviceArray:
+    '''An array in the memory of the current program (CPU or CUDA), which
+    kernels take as ``ti.ext_arr()`` arguments in place.
+
+    Unlike fields, device arrays are not part of the layout, so they can be
+    created and freed between any launches. Unlike numpy arrays, they stay on
+    the device across launches, which neither copy nor synchronize them.
+
+    Args:
+        dtype: The type of the elements.
+        shape: An int or a tuple of ints.
+    '''
+    @python_scope
+    def __init__(self, dtype, shape):
+        if isinstance(shape, int):
+            shape = (shape, )
+        get_runtime().create_program()
+        self.prog = get_runtime().prog
+        self.dtype = cook_dtype(dtype)
+        self.shape = tuple(shape)
+        self.np_dtype = to_numpy_type(self.dtype)
+        self.nbytes = int(np.prod(self.shape, dtype=np.int64)) * \
+            self.np_dtype(0).itemsize
+        self.ptr = self.prog.allocate_device_array(self.nbytes)
+
+    @python_scope
+    def free(self):
+        '''Frees the memory, which later device arrays may reuse.'''
+        # The array has already been freed if the program was finalized.
+        if self.ptr is not None and get_runtime().prog is self.prog:
+            self.prog.free_device_array(self.ptr)
+        self.ptr = None
+
+    def __del__(self):
+        if getattr(self, 'ptr', None) is not None:
+            self.free()
+
+    def _check(self):
+        assert self.ptr is not None, 'The device array has been freed'
+
+    @python_scope
+    def to_numpy(self):
+        self._check()
+        arr = np.empty(self.shape, dtype=self.np_dtype)
+        self.prog.copy_device_array(arr.ctypes.data, self.ptr, self.nbytes)
+        return arr
+
+    @python_scope
+    def from_numpy(self, arr):
+        self._check()
+        arr = np.ascontiguousarray(arr, dtype=self.np_dtype)
+        assert arr.shape == self.shape, \
+            f'Expected an array of shape {self.shape}, got {arr.shape}'
+        self.prog.copy_device_array(self.ptr, arr.ctypes.data, self.nbytes)
+
+    @python_scope
+    def fill(self, value):
+        self.from_numpy(np.full(self.shape, value, dtype=self.np_dtype))
+
+
+__all__ = ['DeviceArray']
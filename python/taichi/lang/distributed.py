@@ -0,0 +1,163 @@
+import numpy as np
+
+from . import impl
+from .matrix import Matrix
+from .util import python_scope, to_numpy_type
+
+
+class GhostExchange:
+    '''The ghost layer exchange started by
+    :meth:`DistributedDomain.start_ghost_exchange`. The messages are in
+    flight until :meth:`wait`, which writes the received layers into the
+    ghost layers of the fields.'''
+    def __init__(self):
+        self.requests = []
+        # The received layers, and where they go.
+        self.receives = []
+        # Kept alive until the sends complete.
+        self.send_buffers = []
+
+    @python_scope
+    def wait(self):
+        from .meta import ext_arr_to_slab
+        for request in self.requests:
+            request.Wait()
+        for buffer, field, begin in self.receives:
+            ext_arr_to_slab(buffer, field, begin, begin + buffer.shape[0])
+        self.requests = []
+        self.receives = []
+        self.send_buffers = []
+
+
+class DistributedDomain:
+    '''A dense domain of ``shape`` whose axis 0 is partitioned across the
+    ranks of an MPI communicator, ``mpi4py.MPI.COMM_WORLD`` by default.
+
+    Each rank owns the contiguous part ``[begin, end)`` of axis 0, and
+    allocates the fields of its part with :meth:`field`, padded with
+    ``ghost`` layers of the neighboring parts on each side. They are indexed
+    with global indices, so that the kernels loop over the part of the rank
+    with ``ti.ndrange(*domain.owned())``, and read the ghost layers of their
+    stencils as the neighbors of the cells at the edges of the part.
+
+    Between kernels, :meth:`start_ghost_exchange` sends the edge layers to the
+    neighboring ranks with non-blocking MPI, and returns a
+    :class:`GhostExchange` to wait for. The cells of :meth:`interior`, whose
+    stencils stay within the part, can be updated in the meantime. With
+    ``periodic``, the first and the last ranks are neighbors.
+    '''
+    def __init__(self, shape, ghost=1, periodic=False, comm=None):
+        if isinstance(shape, int):
+            shape = (shape, )
+        if comm is None:
+            try:
+                from mpi4py import MPI
+            except ImportError:
+                raise ImportError(
+                    'DistributedDomain requires mpi4py, or an explicit comm')
+            comm = MPI.COMM_WORLD
+        self.comm = comm
+        self.shape = tuple(shape)
+        self.ghost = ghost
+        self.rank = comm.Get_rank()
+        self.num_ranks = comm.Get_size()
+        n = self.shape[0]
+        self.begin = n * self.rank // self.num_ranks
+        self.end = n * (self.rank + 1) // self.num_ranks
+        if self.end - self.begin < ghost:
+            raise ValueError(
+                f'The part [{self.begin}, {self.end}) of rank {self.rank} is '
+                f'thinner than the {ghost} ghost layers')
+
+        def neighbor(rank):
+            if 0 <= rank < self.num_ranks:
+                return rank
+            return rank % self.num_ranks if periodic else None
+
+        self.lower = neighbor(self.rank - 1)
+        self.upper = neighbor(self.rank + 1)
+        self.fields = []
+
+    @property
+    def local_shape(self):
+        return (self.end - self.begin + 2 * self.ghost, ) + self.shape[1:]
+
+    @property
+    def local_offset(self):
+        return (self.begin - self.ghost, ) + (0, ) * (len(self.shape) - 1)
+
+    @python_scope
+    def field(self, dtype, n=None, m=None, needs_grad=False):
+        '''Allocates a scalar field of the part of the rank, or a vector field
+        with ``n`` components, or a matrix field with ``n`` x ``m`` ones.'''
+        if n is None:
+            f = impl.field(dtype,
+                           shape=self.local_shape,
+                           offset=self.local_offset,
+                           needs_grad=needs_grad)
+        else:
+            f = Matrix.field(n,
+                             1 if m is None else m,
+                             dtype,
+                             shape=self.local_shape,
+                             offset=self.local_offset,
+                             needs_grad=needs_grad)
+        self.fields.append(f)
+        return f
+
+    def owned(self):
+        '''The ranges of the indices of the cells that the rank owns, along
+        each axis.'''
+        return ((self.begin, self.end), ) + tuple(
+            (0, s) for s in self.shape[1:])
+
+    def interior(self):
+        '''The ranges of the cells that the rank owns whose stencils, up to
+        ``ghost`` cells wide, do not read the ghost layers.'''
+        return ((self.begin + self.ghost, self.end - self.ghost), ) + tuple(
+            (0, s) for s in self.shape[1:])
+
+    @python_scope
+    def start_ghost_exchange(self, *fields):
+        '''Starts sending the edge layers of ``fields`` (all the fields
+        allocated by :meth:`field` by default) to the neighboring ranks, and
+        receiving their ghost layers.'''
+        from .meta import slab_to_ext_arr
+        if not fields:
+            fields = self.fields
+        exchange = GhostExchange()
+        g = self.ghost
+        for i, f in enumerate(fields):
+            layer_shape = (g, ) + self.shape[1:]
+            if isinstance(f, Matrix):
+                layer_shape += (f.n, f.m)
+            dtype = to_numpy_type(f.dtype)
+            # Tag 2i goes down to the lower neighbor, 2i + 1 up to the upper.
+            for neighbor, tag, recv_begin in [
+                (self.upper, 2 * i, self.end),
+                (self.lower, 2 * i + 1, self.begin - g),
+            ]:
+                if neighbor is None:
+                    continue
+                buffer = np.empty(layer_shape, dtype=dtype)
+                exchange.requests.append(
+                    self.comm.Irecv(buffer, source=neighbor, tag=tag))
+                exchange.receives.append((buffer, f, recv_begin))
+            for neighbor, tag, send_begin in [
+                (self.lower, 2 * i, self.begin),
+                (self.upper, 2 * i + 1, self.end - g),
+            ]:
+                if neighbor is None:
+                    continue
+                buffer = np.empty(layer_shape, dtype=dtype)
+                slab_to_ext_arr(f, buffer, send_begin, send_begin + g)
+                exchange.send_buffers.append(buffer)
+                exchange.requests.append(
+                    self.comm.Isend(buffer, dest=neighbor, tag=tag))
+        return exchange
+
+    @python_scope
+    def exchange_ghosts(self, *fields):
+        '''Exchanges the ghost layers of ``fields``, see
+        :meth:`start_ghost_exchange`.'''
+        self.start_ghost_exchange(*fields).wait()
@@ -36,8 +36,31 @@ class Expr(TaichiOperations):
         if self.tb:
             self.ptr.set_tb(self.tb)
         self.grad = None
+        self.dual = None
         self.val = self
 
+    @staticmethod
+    def deferred(opcode, operands, tb=None):
+        # An op expression whose ptr is built when first needed, together with
+        # the deferred operands it depends on, by one build_expression_batch.
+        expr = Expr.__new__(Expr)
+        expr.getter = None
+        expr.setter = None
+        expr.tb = tb
+        expr.grad = None
+        expr.dual = None
+        expr.val = expr
+        expr._batch = (opcode, operands)
+        return expr
+
+    def __getattr__(self, name):
+        # Only called for the attributes not set, i.e. ptr of a deferred one.
+        if name == 'ptr' and '_batch' in self.__dict__:
+            _build_batch(self)
+            return self.ptr
+        raise AttributeError(
+            f"'{type(self).__name__}' object has no attribute '{name}'")
+
     @python_scope
     def __setitem__(self, key, value):
         impl.get_runtime().materialize()
@@ -112,6 +135,11 @@ class Expr(TaichiOperations):
         self.grad = grad
         self.ptr.set_grad(grad.ptr)
 
+    @python_scope
+    def set_dual(self, dual):
+        self.dual = dual
+        self.ptr.set_dual(dual.ptr)
+
     @python_scope
     def clear(self, deactivate=False):
         assert not deactivate
@@ -121,10 +149,24 @@ class Expr(TaichiOperations):
 
     @python_scope
     def fill(self, val):
+        if self._fill_memory(val):
+            return
         # TODO: avoid too many template instantiations
         from .meta import fill_tensor
         fill_tensor(self, val)
 
+    def _fill_memory(self, val):
+        # Sets the bytes of the field directly if it can, see
+        # Program::fill_snode.
+        import numbers
+        if isinstance(val, bool) or not isinstance(val, numbers.Real):
+            return False
+        if isinstance(val, numbers.Integral) and abs(val) > 2**53:
+            return False
+        impl.get_runtime().materialize()
+        return impl.get_runtime().prog.fill_snode(self.ptr.snode(),
+                                                  float(val))
+
     #@deprecated('tensor.parent()', 'tensor.snode.parent()')
     def parent(self, n=1):
         import taichi as ti
@@ -168,12 +210,11 @@ class Expr(TaichiOperations):
 
     @python_scope
     def to_numpy(self):
-        from .meta import tensor_to_ext_arr
         import numpy as np
         arr = np.zeros(shape=self.shape, dtype=to_numpy_type(self.dtype))
-        tensor_to_ext_arr(self, arr)
-        import taichi as ti
-        ti.sync()
+        impl.get_runtime().materialize()
+        self.ptr.snode().to_buffer(arr.ctypes.data,
+                                   [s // arr.itemsize for s in arr.strides])
         return arr
 
     @python_scope
@@ -194,6 +235,15 @@ class Expr(TaichiOperations):
         s = self.shape
         for i in range(len(self.shape)):
             assert s[i] == arr.shape[i]
+        import numpy as np
+        if isinstance(arr, np.ndarray):
+            arr = np.asarray(arr, dtype=to_numpy_type(self.dtype))
+            if any(s < 0 or s % arr.itemsize != 0 for s in arr.strides):
+                arr = np.ascontiguousarray(arr)
+            impl.get_runtime().materialize()
+            self.ptr.snode().from_buffer(
+                arr.ctypes.data, [s // arr.itemsize for s in arr.strides])
+            return
         from .meta import ext_arr_to_tensor
         if hasattr(arr, 'contiguous'):
             arr = arr.contiguous()
@@ -210,6 +260,10 @@ class Expr(TaichiOperations):
         assert isinstance(other, Expr)
         from .meta import tensor_to_tensor
         assert len(self.shape) == len(other.shape)
+        impl.get_runtime().materialize()
+        if impl.get_runtime().prog.copy_snode(self.ptr.snode(),
+                                              other.ptr.snode()):
+            return
         tensor_to_tensor(self, other)
 
     def __str__(self):
@@ -228,6 +282,39 @@ class Expr(TaichiOperations):
             return '<ti.Expr>'
 
 
+def _build_batch(root):
+    # Encodes the deferred expressions |root| depends on in post-order, see
+    # build_expression_batch.
+    code, leaves, tbs, built = [], [], [], []
+    operand_codes = {}
+    stack = [(root, False)]
+    while stack:
+        expr, expanded = stack.pop()
+        if id(expr) in operand_codes:
+            continue
+        opcode, operands = expr._batch
+        if not expanded:
+            stack.append((expr, True))
+            for operand in operands:
+                if '_batch' in operand.__dict__ and \
+                        id(operand) not in operand_codes:
+                    stack.append((operand, False))
+            continue
+        code.append(opcode)
+        for operand in operands:
+            if id(operand) not in operand_codes:
+                leaves.append(operand.ptr)
+                operand_codes[id(operand)] = ~(len(leaves) - 1)
+            code.append(operand_codes[id(operand)])
+        operand_codes[id(expr)] = len(built)
+        tbs.append(expr.tb or '')
+        built.append(expr)
+    ptrs = taichi_lang_core.build_expression_batch(code, leaves, tbs)
+    for expr, ptr in zip(built, ptrs):
+        expr.ptr = ptr
+        del expr._batch
+
+
 def make_var_vector(size):
     import taichi as ti
     exprs = []
@@ -0,0 +1,55 @@
+import numpy as np
+
+from .impl import get_runtime
+from .util import python_scope
+
+
+class _ExternalArrayBuffer:
+    # Owns a zero-copy external array allocated by the current Program. numpy
+    # keeps this object alive as the base of the arrays viewing it.
+    def __init__(self, shape, dtype):
+        self.prog = get_runtime().prog
+        nbytes = int(np.prod(shape, dtype=np.int64)) * dtype.itemsize
+        self.ptr = self.prog.allocate_external_array(nbytes)
+        self.__array_interface__ = {
+            'shape': tuple(shape),
+            'typestr': dtype.str,
+            'data': (self.ptr, False),
+            'version': 3,
+        }
+
+    def __del__(self):
+        # The array has already been freed if the program was finalized.
+        if get_runtime().prog is self.prog:
+            self.prog.free_external_array(self.ptr)
+
+
+@python_scope
+def zero_copy_array(shape, dtype=np.float32):
+    '''Allocates a numpy array that kernels access in place through
+    ``ti.ext_arr()``, without staging copies on CUDA.
+
+    The memory is CUDA managed memory on ``ti.cuda``, a persistently mapped
+    buffer on ``ti.opengl`` (page-aligned host memory on CPU), and is freed
+    together with the array, or at ``ti.reset()``.
+    '''
+    get_runtime().create_program()
+    if isinstance(shape, int):
+        shape = (shape, )
+    return np.asarray(_ExternalArrayBuffer(shape, np.dtype(dtype)))
+
+
+@python_scope
+def prefetch(arr, to_device=True):
+    '''Migrates a zero-copy array to the device (or back to the host) ahead of
+    its use. A no-op on CPU.'''
+    get_runtime().prog.prefetch_external_array(arr.ctypes.data, arr.nbytes,
+                                               to_device)
+
+
+@python_scope
+def mem_advise(arr, read_mostly=False, prefer_device=True):
+    '''Sets the CUDA unified memory hints of a zero-copy array. A no-op on
+    CPU.'''
+    get_runtime().prog.advise_external_array(arr.ctypes.data, arr.nbytes,
+                                             read_mostly, prefer_device)
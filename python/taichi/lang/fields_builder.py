@@ -0,0 +1,78 @@
+from .impl import get_runtime
+from .snode import SNode
+from .util import python_scope
+
+
+class FieldsBuilder:
+    '''Builds an SNode tree of its own, like ``ti.root``, which ``finalize()``
+    materializes after the layout of ``ti.root``. This adds fields after
+    kernels have run, and the kernels compiled before keep their code.
+
+    Example::
+
+        x = ti.field(ti.f32, shape=16)
+        ...  # Launch kernels using x
+        fb = ti.FieldsBuilder()
+        y = ti.field(ti.f32)
+        fb.dense(ti.i, 16).place(y)
+        fb.finalize()
+        ...  # Launch kernels using x and y
+
+    Only supported on CPU and CUDA.
+    '''
+    @python_scope
+    def __init__(self):
+        # The trees are materialized after ti.root, in their own root buffers.
+        get_runtime().materialize()
+        self.prog = get_runtime().prog
+        self.root = SNode(self.prog.create_snode_tree())
+        self.finalized = False
+
+    def _check(self):
+        if self.finalized:
+            raise RuntimeError(
+                'No SNodes can be added to a finalized FieldsBuilder')
+        assert get_runtime().prog is self.prog, \
+            'The program of the FieldsBuilder has been reset'
+
+    def dense(self, indices, dimensions):
+        self._check()
+        return self.root.dense(indices, dimensions)
+
+    def pointer(self, indices, dimensions):
+        self._check()
+        return self.root.pointer(indices, dimensions)
+
+    def hash(self, indices, dimensions, capacity=None):
+        self._check()
+        return self.root.hash(indices, dimensions, capacity)
+
+    def dynamic(self, index, dimension, chunk_size=None,
+                chunk_directory=False):
+        self._check()
+        return self.root.dynamic(index, dimension, chunk_size,
+                                 chunk_directory)
+
+    def bitmasked(self, indices, dimensions):
+        self._check()
+        return self.root.bitmasked(indices, dimensions)
+
+    def place(self, *args, offset=None):
+        self._check()
+        return self.root.place(*args, offset=offset)
+
+    def lazy_grad(self, sparse=False):
+        self._check()
+        self.root.lazy_grad(sparse)
+
+    @python_scope
+    def finalize(self):
+        '''Materializes the tree. The kernels compiled afterwards can access
+        its fields.'''
+        self._check()
+        with get_runtime().definition_lock:
+            self.prog.materialize_snode_tree(self.root.ptr)
+        self.finalized = True
+
+
+__all__ = ['FieldsBuilder']
@@ -1,4 +1,5 @@
 import inspect
+import threading
 from .core import taichi_lang_core
 from .expr import Expr
 from .snode import SNode
@@ -185,6 +186,8 @@ class PyTaichi:
         self.materialize_callbacks = []
         self.compiled_functions = {}
         self.compiled_grad_functions = {}
+        self.compiled_jvp_functions = {}
+        self.compiled_fused_grad_functions = {}
         self.scope_stack = []
         self.inside_kernel = False
         self.global_vars = []
@@ -194,9 +197,17 @@ class PyTaichi:
         self.target_tape = None
         self.inside_complex_kernel = False
         self.kernels = kernels or []
+        # Kernels may be launched from several host threads. They are defined
+        # one at a time, and the launches of the kernels returning values
+        # hold the result lock until they have read them.
+        self.definition_lock = threading.RLock()
+        self.result_lock = threading.Lock()
 
     def get_num_compiled_functions(self):
-        return len(self.compiled_functions) + len(self.compiled_grad_functions)
+        return len(self.compiled_functions) + len(
+            self.compiled_grad_functions) + len(
+                self.compiled_jvp_functions) + len(
+                    self.compiled_fused_grad_functions)
 
     def set_default_fp(self, fp):
         assert fp in [f32, f64]
@@ -213,6 +224,12 @@ class PyTaichi:
             self.prog = taichi_lang_core.Program()
 
     def materialize(self):
+        if self.materialized:
+            return
+        with self.definition_lock:
+            self.materialize_layout()
+
+    def materialize_layout(self):
         if self.materialized:
             return
 
@@ -351,8 +368,24 @@ def var(dt, shape=None, offset=None, needs_grad=False):
     return field(dt, shape, offset, needs_grad)
 
 
+def check_root_not_materialized():
+    if get_runtime().materialized:
+        raise RuntimeError(
+            "No new variables can be declared after materialization, i.e. kernel invocations "
+            "or Python-scope field accesses. I.e., data layouts must be specified before "
+            "any computation. To add fields afterwards, declare them without a shape and "
+            "place them with a ti.FieldsBuilder. Try appending ti.init() or ti.reset() "
+            "right after 'import taichi as ti' if you are using Jupyter notebook or Blender."
+        )
+
+
 @python_scope
-def field(dtype, shape=None, offset=None, needs_grad=False):
+def field(dtype,
+          shape=None,
+          offset=None,
+          needs_grad=False,
+          needs_dual=False,
+          sparse_grad=False):
     _taichi_skip_traceback = 1
 
     dtype = cook_dtype(dtype)
@@ -371,13 +404,9 @@ def field(dtype, shape=None, offset=None, needs_grad=False):
     assert (offset is not None and shape is None
             ) == False, f'The shape cannot be None when offset is being set'
 
-    if get_runtime().materialized:
-        raise RuntimeError(
-            "No new variables can be declared after materialization, i.e. kernel invocations "
-            "or Python-scope field accesses. I.e., data layouts must be specified before "
-            "any computation. Try appending ti.init() or ti.reset() "
-            "right after 'import taichi as ti' if you are using Jupyter notebook or Blender."
-        )
+    # The fields without a shape can still be placed by a ti.FieldsBuilder.
+    if shape is not None:
+        check_root_not_materialized()
 
     del _taichi_skip_traceback
 
@@ -395,11 +424,22 @@ def field(dtype, shape=None, offset=None, needs_grad=False):
         x_grad.ptr.set_is_primal(False)
         x.set_grad(x_grad)
 
+        # dual, for forward-mode AutoDiff
+        x_dual = Expr(taichi_lang_core.make_id_expr(""))
+        x_dual.ptr = taichi_lang_core.global_new(x_dual.ptr, dtype)
+        x_dual.ptr.set_is_primal(False)
+        x.set_dual(x_dual)
+
     if shape is not None:
         dim = len(shape)
-        root.dense(index_nd(dim), shape).place(x, offset=offset)
-        if needs_grad:
+        node = root.dense(index_nd(dim), shape)
+        node.place(x, offset=offset)
+        if needs_grad and sparse_grad:
+            node.lazy_grad(sparse=True)
+        elif needs_grad:
             root.dense(index_nd(dim), shape).place(x.grad)
+        if needs_dual:
+            root.dense(index_nd(dim), shape).place(x.dual)
     return x
 
 
@@ -7,8 +7,12 @@ from .util import *
 from .shell import oinspect, _shell_pop_print
 from .exception import TaichiSyntaxError
 from . import impl
+from .device_array import DeviceArray
 import functools
 
+# Set by ti.trace_start(); adds the kernel calls from Python to the trace.
+trace_kernel_calls = False
+
 
 def remove_indent(lines):
     lines = lines.split('\n')
@@ -212,18 +216,36 @@ def _get_global_vars(func):
     return global_vars
 
 
+# The transformed code of the kernels, see Kernel.transform.
+_transformed_kernels = {}
+
+
 class Kernel:
     counter = 0
 
-    def __init__(self, func, is_grad, classkernel=False):
+    def __init__(self,
+                 func,
+                 is_grad,
+                 classkernel=False,
+                 float_options=None,
+                 is_jvp=False,
+                 keep_primal=False):
         self.func = func
+        # fast_math, fp_contract and approx_math, see ti.kernel.
+        self.float_options = float_options or {}
         self.kernel_counter = Kernel.counter
         Kernel.counter += 1
         self.is_grad = is_grad
+        # Forward-mode AutoDiff, see kernel.jvp.
+        self.is_jvp = is_jvp
+        # With is_grad, also compute the primal, see kernel.fused_grad.
+        self.keep_primal = keep_primal
         self.arguments = []
         self.argument_names = []
         self.return_type = None
         self.classkernel = classkernel
+        # Set by launch_async().
+        self.returns_future = False
         _taichi_skip_traceback = 1
         self.extract_arguments()
         del _taichi_skip_traceback
@@ -238,8 +260,12 @@ class Kernel:
 
     def reset(self):
         self.runtime = impl.get_runtime()
-        if self.is_grad:
+        if self.keep_primal:
+            self.compiled_functions = self.runtime.compiled_fused_grad_functions
+        elif self.is_grad:
             self.compiled_functions = self.runtime.compiled_functions
+        elif self.is_jvp:
+            self.compiled_functions = self.runtime.compiled_jvp_functions
         else:
             self.compiled_functions = self.runtime.compiled_grad_functions
 
@@ -281,6 +307,9 @@ class Kernel:
             else:
                 if isinstance(annotation, (template, ext_arr)):
                     pass
+                elif isinstance(annotation, specialize) and id(
+                        annotation.dtype) in type_ids:
+                    pass
                 elif id(annotation) in type_ids:
                     pass
                 else:
@@ -295,62 +324,52 @@ class Kernel:
         _taichi_skip_traceback = 1
         if key is None:
             key = (self.func, 0)
+        if key in self.compiled_functions:
+            return
+        # The host threads define the kernels one at a time.
+        with self.runtime.definition_lock:
+            self.define(key, args, arg_features)
+
+    def define(self, key, args, arg_features):
+        _taichi_skip_traceback = 1
         if not self.runtime.materialized:
             self.runtime.materialize()
         if key in self.compiled_functions:
             return
         grad_suffix = ""
-        if self.is_grad:
+        if self.keep_primal:
+            grad_suffix = "_fused_grad"
+        elif self.is_grad:
             grad_suffix = "_grad"
+        elif self.is_jvp:
+            grad_suffix = "_jvp"
         kernel_name = "{}_c{}_{}{}".format(self.func.__name__,
                                            self.kernel_counter, key[1],
                                            grad_suffix)
         import taichi as ti
         ti.trace("Compiling kernel {}...".format(kernel_name))
 
-        src = remove_indent(oinspect.getsource(self.func))
-        tree = ast.parse(src)
-
-        func_body = tree.body[0]
-        func_body.decorator_list = []
-
         local_vars = {}
         global_vars = _get_global_vars(self.func)
 
-        for i, arg in enumerate(func_body.args.args):
-            anno = arg.annotation
-            if isinstance(anno, ast.Name):
-                global_vars[anno.id] = self.arguments[i]
-
-        if isinstance(func_body.returns, ast.Name):
-            global_vars[func_body.returns.id] = self.return_type
-
-        if self.is_grad:
-            from .ast_checker import KernelSimplicityASTChecker
-            KernelSimplicityASTChecker(self.func).visit(tree)
-
-        visitor = ASTTransformer(
-            excluded_paremeters=self.template_slot_locations,
-            func=self,
-            arg_features=arg_features)
-
-        visitor.visit(tree)
-
-        ast.increment_lineno(tree, oinspect.getsourcelines(self.func)[1] - 1)
+        code, annotations, returns = self.transform(arg_features)
+        for i, name in annotations:
+            global_vars[name] = self.arguments[i]
+        if returns is not None:
+            global_vars[returns] = self.return_type
 
         # inject template parameters into globals
         for i in self.template_slot_locations:
             template_var_name = self.argument_names[i]
             global_vars[template_var_name] = args[i]
 
-        exec(
-            compile(tree,
-                    filename=oinspect.getsourcefile(self.func),
-                    mode='exec'), global_vars, local_vars)
+        exec(code, global_vars, local_vars)
         compiled = local_vars[self.func.__name__]
 
         taichi_kernel = taichi_lang_core.create_kernel(kernel_name,
-                                                       self.is_grad)
+                                                       self.is_grad,
+                                                       self.is_jvp,
+                                                       self.keep_primal)
 
         # Do not change the name of 'taichi_ast_generator'
         # The warning system needs this identifier to remove unnecessary messages
@@ -362,15 +381,105 @@ class Kernel:
                     "Kernels cannot call other kernels. I.e., nested kernels are not allowed. Please check if you have direct/indirect invocation of kernels within kernels. Note that some methods provided by the Taichi standard library may invoke kernels, and please move their invocations to Python-scope."
                 )
             self.runtime.inside_kernel = True
+            fast_math = self.float_options.get('fast_math')
+            if fast_math is None:
+                fast_math = impl.current_cfg().fast_math
+            taichi_lang_core.set_kernel_float_options(
+                fast_math, self.float_options.get('fp_contract', False),
+                self.float_options.get('approx_math', False))
             compiled()
             self.runtime.inside_kernel = False
 
         taichi_kernel = taichi_kernel.define(taichi_ast_generator)
 
+        actual_argument_slot = 0
+        for i, needed in enumerate(self.arguments):
+            if isinstance(needed, template):
+                continue
+            if isinstance(needed, specialize):
+                if id(needed.dtype) in real_type_ids:
+                    taichi_kernel.specialize_arg_float(actual_argument_slot,
+                                                       float(args[i]))
+                else:
+                    taichi_kernel.specialize_arg_int(actual_argument_slot,
+                                                     int(args[i]))
+            actual_argument_slot += 1
+
         assert key not in self.compiled_functions
         self.compiled_functions[key] = self.get_function_body(taichi_kernel)
 
+    def transform(self, arg_features):
+        # Returns the code of the transformed kernel, with the annotations
+        # naming the types of the arguments and of the return value. The
+        # template arguments are globals of the code, so the kernels of the
+        # same source share it across instantiations and programs, as long as
+        # the arguments other than templates have the same features.
+        src = remove_indent(oinspect.getsource(self.func))
+        filename = oinspect.getsourcefile(self.func)
+        lineno = oinspect.getsourcelines(self.func)[1]
+        features = []
+        for i, needed in enumerate(self.arguments):
+            if isinstance(needed, template):
+                features.append(None)
+            elif isinstance(needed, ext_arr):
+                features.append((ext_arr, arg_features[i]))
+            else:
+                features.append(type(needed))
+        key = (src, filename, lineno, self.is_grad, tuple(features))
+        if key in _transformed_kernels and \
+                not impl.get_runtime().print_preprocessed:
+            return _transformed_kernels[key]
+
+        tree = ast.parse(src)
+
+        func_body = tree.body[0]
+        func_body.decorator_list = []
+
+        annotations = []
+        for i, arg in enumerate(func_body.args.args):
+            anno = arg.annotation
+            if isinstance(anno, ast.Name):
+                annotations.append((i, anno.id))
+        returns = None
+        if isinstance(func_body.returns, ast.Name):
+            returns = func_body.returns.id
+
+        if self.is_grad:
+            from .ast_checker import KernelSimplicityASTChecker
+            KernelSimplicityASTChecker(self.func).visit(tree)
+
+        visitor = ASTTransformer(
+            excluded_paremeters=self.template_slot_locations,
+            func=self,
+            arg_features=arg_features)
+
+        visitor.visit(tree)
+
+        ast.increment_lineno(tree, lineno - 1)
+
+        code = compile(tree, filename=filename, mode='exec')
+        _transformed_kernels[key] = code, annotations, returns
+        return _transformed_kernels[key]
+
     def get_function_body(self, t_kernel):
+        # Kernels with only scalar arguments reuse one launch context, and
+        # set all the arguments in one call.
+        scalar_args = []
+        for i, needed in enumerate(self.arguments):
+            if isinstance(needed, template):
+                continue
+            if isinstance(needed, specialize):
+                needed = needed.dtype
+            if id(needed) in real_type_ids:
+                scalar_args.append((i, needed, True))
+            elif id(needed) in integer_type_ids:
+                scalar_args.append((i, needed, False))
+            else:
+                scalar_args = None
+                break
+        if scalar_args is not None:
+            return self.get_prepared_function_body(t_kernel, scalar_args)
+
         # The actual function body
         def func__(*args):
             assert len(args) == len(
@@ -387,6 +496,8 @@ class Kernel:
                 needed = self.arguments[i]
                 if isinstance(needed, template):
                     continue
+                if isinstance(needed, specialize):
+                    needed = needed.dtype
                 provided = type(v)
                 # Note: do not use sth like "needed == f32". That would be slow.
                 if id(needed) in real_type_ids:
@@ -398,16 +509,22 @@ class Kernel:
                         raise KernelArgError(i, needed.to_string(), provided)
                     launch_ctx.set_arg_int(actual_argument_slot, int(v))
                 elif self.match_ext_arr(v, needed):
-                    has_external_arrays = True
                     has_torch = has_pytorch()
                     is_numpy = isinstance(v, np.ndarray)
-                    if is_numpy:
+                    if isinstance(v, DeviceArray):
+                        # Accessed in place, without a sync after the launch.
+                        v._check()
+                        launch_ctx.set_arg_nparray(actual_argument_slot,
+                                                   v.ptr, v.nbytes)
+                    elif is_numpy:
+                        has_external_arrays = True
                         tmp = np.ascontiguousarray(v)
                         tmps.append(tmp)  # Purpose: do not GC tmp!
                         launch_ctx.set_arg_nparray(actual_argument_slot,
                                                    int(tmp.ctypes.data),
                                                    tmp.nbytes)
                     else:
+                        has_external_arrays = True
 
                         def get_call_back(u, v):
                             def call_back():
@@ -452,25 +569,22 @@ class Kernel:
             # Both the class kernels and the plain-function kernels are unified now.
             # In both cases, |self.grad| is another Kernel instance that computes the
             # gradient. For class kernels, args[0] is always the kernel owner.
-            if not self.is_grad and self.runtime.target_tape and not self.runtime.inside_complex_kernel:
+            if not self.is_grad and not self.is_jvp and self.runtime.target_tape and not self.runtime.inside_complex_kernel:
                 self.runtime.target_tape.insert(self, args)
 
-            t_kernel(launch_ctx)
-
             ret = None
-            ret_dt = self.return_type
-            has_ret = ret_dt is not None
+            if self.return_type is not None:
+                # The kernels returning values share the result buffer.
+                with self.runtime.result_lock:
+                    t_kernel(launch_ctx)
+                    ret = self.fetch_ret(t_kernel)
+            else:
+                t_kernel(launch_ctx)
 
-            if has_external_arrays or has_ret:
+            if has_external_arrays:
                 import taichi as ti
                 ti.sync()
 
-            if has_ret:
-                if id(ret_dt) in integer_type_ids:
-                    ret = t_kernel.get_ret_int(0)
-                else:
-                    ret = t_kernel.get_ret_float(0)
-
             if callbacks:
                 for c in callbacks:
                     c()
@@ -479,11 +593,61 @@ class Kernel:
 
         return func__
 
+    def fetch_ret(self, t_kernel):
+        # Called with the result lock of the runtime held, right after the
+        # launch.
+        ret_dt = self.return_type
+        if self.returns_future:
+            return ResultFuture(self.runtime.prog, t_kernel, ret_dt)
+        import taichi as ti
+        ti.sync()
+        if id(ret_dt) in integer_type_ids:
+            return t_kernel.get_ret_int(0)
+        return t_kernel.get_ret_float(0)
+
+    def get_prepared_function_body(self, t_kernel, scalar_args):
+        prepared_launch = t_kernel.prepare_launch()
+        ret_dt = self.return_type
+
+        # Returns the arguments of the prepared launch.
+        def pack_args(*args):
+            assert len(args) == len(
+                self.arguments), '{} arguments needed but {} provided'.format(
+                    len(self.arguments), len(args))
+
+            launch_args = []
+            for i, needed, is_real in scalar_args:
+                v = args[i]
+                if is_real:
+                    if not isinstance(v, (float, int)):
+                        raise KernelArgError(i, needed.to_string(), type(v))
+                    launch_args.append(float(v))
+                else:
+                    if not isinstance(v, int):
+                        raise KernelArgError(i, needed.to_string(), type(v))
+                    launch_args.append(int(v))
+            if not self.is_grad and not self.is_jvp and self.runtime.target_tape and not self.runtime.inside_complex_kernel:
+                self.runtime.target_tape.insert(self, args)
+            return launch_args
+
+        def func__(*args):
+            launch_args = pack_args(*args)
+            if ret_dt is None:
+                prepared_launch(*launch_args)
+                return None
+            with self.runtime.result_lock:
+                prepared_launch(*launch_args)
+                return self.fetch_ret(t_kernel)
+
+        func__.prepared_launch = prepared_launch
+        func__.pack_args = pack_args
+        return func__
+
     def match_ext_arr(self, v, needed):
         needs_array = isinstance(
             needed, np.ndarray) or needed == np.ndarray or isinstance(
                 needed, ext_arr)
-        has_array = isinstance(v, np.ndarray)
+        has_array = isinstance(v, (np.ndarray, DeviceArray))
         if not has_array and has_pytorch():
             has_array = isinstance(v, torch.Tensor)
         return has_array and needs_array
@@ -497,7 +661,28 @@ class Kernel:
         instance_id, arg_features = self.mapper.lookup(args)
         key = (self.func, instance_id)
         self.materialize(key=key, args=args, arg_features=arg_features)
-        return self.compiled_functions[key](*args)
+        if not trace_kernel_calls:
+            return self.compiled_functions[key](*args)
+        begin = taichi_lang_core.tracer_now_us()
+        try:
+            return self.compiled_functions[key](*args)
+        finally:
+            taichi_lang_core.tracer_add_complete_event(
+                'python', self.func.__name__, begin,
+                taichi_lang_core.tracer_now_us() - begin)
+
+    def prepare(self, *args):
+        """Returns the prepared launch of the kernel for ``args`` and its
+        arguments, or None if the kernel takes external arrays or returns a
+        value."""
+        instance_id, arg_features = self.mapper.lookup(args)
+        key = (self.func, instance_id)
+        self.materialize(key=key, args=args, arg_features=arg_features)
+        func = self.compiled_functions[key]
+        if self.return_type is not None or not hasattr(
+                func, 'prepared_launch'):
+            return None
+        return func.prepared_launch, tuple(func.pack_args(*args))
 
 
 # For a Taichi class definition like below:
@@ -533,7 +718,10 @@ def _inside_class(level_of_class_stackframe):
     return False
 
 
-def _kernel_impl(func, level_of_class_stackframe, verbose=False):
+def _kernel_impl(func,
+                 level_of_class_stackframe,
+                 verbose=False,
+                 float_options=None):
     # Can decorators determine if a function is being defined inside a class?
     # https://stackoverflow.com/a/8793684/12003165
     is_classkernel = _inside_class(level_of_class_stackframe + 1)
@@ -541,8 +729,26 @@ def _kernel_impl(func, level_of_class_stackframe, verbose=False):
 
     if verbose:
         print(f'kernel={func.__name__} is_classkernel={is_classkernel}')
-    primal = Kernel(func, is_grad=False, classkernel=is_classkernel)
-    adjoint = Kernel(func, is_grad=True, classkernel=is_classkernel)
+    primal = Kernel(func,
+                    is_grad=False,
+                    classkernel=is_classkernel,
+                    float_options=float_options)
+    adjoint = Kernel(func,
+                     is_grad=True,
+                     classkernel=is_classkernel,
+                     float_options=float_options)
+    # Computes the primal outputs and their duals in one pass.
+    forward = Kernel(func,
+                     is_grad=False,
+                     classkernel=is_classkernel,
+                     float_options=float_options,
+                     is_jvp=True)
+    # Computes the primal and the gradients in one launch.
+    fused = Kernel(func,
+                   is_grad=True,
+                   classkernel=is_classkernel,
+                   float_options=float_options,
+                   keep_primal=True)
     # Having |primal| contains |grad| makes the tape work.
     primal.grad = adjoint
 
@@ -571,22 +777,187 @@ def _kernel_impl(func, level_of_class_stackframe, verbose=False):
             return primal(*args, **kwargs)
 
         wrapped.grad = adjoint
+        wrapped.jvp = forward
+        wrapped.fused_grad = fused
 
     wrapped._is_wrapped_kernel = True
     wrapped._is_classkernel = is_classkernel
     wrapped._primal = primal
     wrapped._adjoint = adjoint
+    wrapped._forward = forward
+    wrapped._fused = fused
     return wrapped
 
 
-def kernel(func):
+def kernel(func=None, *, fast_math=None, fp_contract=False, approx_math=False):
+    """Defines a Taichi kernel.
+
+    Used as ``@ti.kernel``, or as ``@ti.kernel(fast_math=False)`` to override
+    the floating-point options of ``ti.init`` for this kernel.
+
+    Args:
+        fast_math (bool): Whether to allow unsafe floating-point optimizations,
+            e.g. reassociation. Defaults to ``ti.init(fast_math=...)``.
+        fp_contract (bool): Whether to fuse multiplies and adds into FMAs even
+            without ``fast_math`` (CPU and CUDA only).
+        approx_math (bool): Whether to use the approximate ``f32`` ``exp``,
+            ``log``, ``sin``, ``cos``, ``tan`` and ``rsqrt`` of the GPU (CUDA
+            and Metal only).
+    """
     _taichi_skip_traceback = 1
-    return _kernel_impl(func, level_of_class_stackframe=3)
+    float_options = {
+        'fast_math': fast_math,
+        'fp_contract': fp_contract,
+        'approx_math': approx_math
+    }
+    if func is None:
+        return functools.partial(kernel, **float_options)
+    return _kernel_impl(func,
+                        level_of_class_stackframe=3,
+                        float_options=float_options)
 
 
 classkernel = obsolete('@ti.classkernel', '@ti.kernel directly')
 
 
+def launch_kernels(launches):
+    """Launches a sequence of kernels.
+
+    Args:
+        launches: A list of ``(kernel, args)`` pairs, where ``args`` is the
+            tuple of the arguments of ``kernel``.
+
+    The kernels taking only scalar arguments and returning nothing are
+    launched back to back in one call into the runtime. The other kernels are
+    launched as if they were called, in order.
+    """
+    batch = []
+    for kernel, args in launches:
+        primal = kernel._primal
+        args = tuple(args)
+        if isinstance(kernel, BoundedDifferentiableMethod):
+            args = (kernel._kernel_owner, ) + args
+        prepared = primal.prepare(*args)
+        if prepared is None:
+            if batch:
+                taichi_lang_core.launch_kernels(batch)
+                batch = []
+            primal(*args)
+        else:
+            batch.append(prepared)
+    if batch:
+        taichi_lang_core.launch_kernels(batch)
+
+
+class ResultFuture:
+    """The return value of a kernel launched with :func:`launch_async`."""
+    def __init__(self, prog, t_kernel, ret_dt):
+        self._prog = prog
+        self._t_kernel = t_kernel
+        self._ret_dt = ret_dt
+        self._future = prog.create_result_future()
+        self._value = None
+
+    def result(self):
+        """Waits for the kernel and returns its return value."""
+        if self._future is not None:
+            if id(self._ret_dt) in integer_type_ids:
+                self._value = self._t_kernel.get_future_ret_int(
+                    self._future, 0)
+            else:
+                self._value = self._t_kernel.get_future_ret_float(
+                    self._future, 0)
+            self._prog.release_result_future(self._future)
+            self._future = None
+        return self._value
+
+
+def launch_async(kernel, *args):
+    """Launches ``kernel`` with ``args`` without waiting for its return value.
+
+    Returns a :class:`ResultFuture` if ``kernel`` returns a value, or None.
+    """
+    primal = kernel._primal
+    if isinstance(kernel, BoundedDifferentiableMethod):
+        args = (kernel._kernel_owner, ) + args
+    primal.returns_future = True
+    try:
+        return primal(*args)
+    finally:
+        primal.returns_future = False
+
+
+class AotKernel:
+    """A kernel loaded from an AOT module, see :func:`load_aot_module`.
+
+    Takes scalars and numpy arrays, in the order of the args of the exported
+    kernel.
+    """
+    def __init__(self, t_kernel):
+        self._t_kernel = t_kernel
+        self.name = t_kernel.name
+
+    def __call__(self, *args):
+        t_kernel = self._t_kernel
+        num_args = t_kernel.get_num_args()
+        assert len(args) == num_args, '{} arguments needed but {} provided'.format(
+            num_args, len(args))
+        launch_ctx = t_kernel.make_launch_context()
+        tmps = []
+        for i, v in enumerate(args):
+            if t_kernel.is_arg_nparray(i):
+                tmp = np.ascontiguousarray(v)
+                tmps.append(tmp)  # Purpose: do not GC tmp!
+                launch_ctx.set_arg_nparray(i, int(tmp.ctypes.data),
+                                           tmp.nbytes)
+                for j, s in enumerate(tmp.shape):
+                    launch_ctx.set_extra_arg_int(i, j, s)
+            elif t_kernel.is_arg_real(i):
+                launch_ctx.set_arg_float(i, float(v))
+            else:
+                launch_ctx.set_arg_int(i, int(v))
+        t_kernel(launch_ctx)
+
+        has_ret = t_kernel.get_num_rets() > 0
+        if tmps or has_ret:
+            impl.get_runtime().sync()
+        if not has_ret:
+            return None
+        if t_kernel.is_ret_real(0):
+            return t_kernel.get_ret_float(0)
+        return t_kernel.get_ret_int(0)
+
+
+class AotModule:
+    """The kernels loaded from an AOT module, see :func:`load_aot_module`.
+
+    A kernel is looked up by its full compiled name (e.g. ``saxpy_c4_0``), or
+    by the name of its Python function if that has a single instantiation.
+    """
+    def __init__(self, t_kernels):
+        self.kernels = {}
+        by_func_name = {}
+        for t_kernel in t_kernels:
+            kernel = AotKernel(t_kernel)
+            self.kernels[kernel.name] = kernel
+            m = re.match(r'^(.*)_c\d+_\d+(_grad|_jvp|_fused_grad)?$', kernel.name)
+            if m:
+                by_func_name.setdefault(m.group(1) + (m.group(2) or ''),
+                                        []).append(kernel)
+        for name, kernels in by_func_name.items():
+            if len(kernels) == 1:
+                self.kernels.setdefault(name, kernels[0])
+
+    def __getitem__(self, name):
+        return self.kernels[name]
+
+    def __getattr__(self, name):
+        try:
+            return self.__dict__['kernels'][name]
+        except KeyError:
+            raise AttributeError(f'No kernel named {name} in the AOT module')
+
+
 class BoundedDifferentiableMethod:
     def __init__(self, kernel_owner, wrapped_kernel_func):
         clsobj = type(kernel_owner)
@@ -597,6 +968,8 @@ class BoundedDifferentiableMethod:
         self._kernel_owner = kernel_owner
         self._primal = wrapped_kernel_func._primal
         self._adjoint = wrapped_kernel_func._adjoint
+        self._forward = wrapped_kernel_func._forward
+        self._fused = wrapped_kernel_func._fused
 
     def __call__(self, *args, **kwargs):
         _taichi_skip_traceback = 1
@@ -606,6 +979,14 @@ class BoundedDifferentiableMethod:
         _taichi_skip_traceback = 1
         return self._adjoint(self._kernel_owner, *args, **kwargs)
 
+    def jvp(self, *args, **kwargs):
+        _taichi_skip_traceback = 1
+        return self._forward(self._kernel_owner, *args, **kwargs)
+
+    def fused_grad(self, *args, **kwargs):
+        _taichi_skip_traceback = 1
+        return self._fused(self._kernel_owner, *args, **kwargs)
+
 
 def data_oriented(cls):
     def getattr(self, item):
@@ -32,7 +32,27 @@ class Template:
 template = Template
 
 
+class SpecializedArg:
+    '''Annotates a scalar kernel argument that is constant for many launches,
+    e.g. ``def substep(dt: ti.specialize(ti.f32))``.
+
+    The kernel is compiled separately for each distinct value of the
+    argument, with the value folded into the IR as a constant. Launches with
+    a value seen before reuse its compiled kernel.
+    '''
+    def __init__(self, dtype):
+        self.dtype = dtype
+
+    def extract(self, x):
+        return x
+
+
+specialize = SpecializedArg
+
+
 def decl_scalar_arg(dtype):
+    if isinstance(dtype, SpecializedArg):
+        dtype = dtype.dtype
     dtype = cook_dtype(dtype)
     id = taichi_lang_core.decl_arg(dtype, False)
     return Expr(taichi_lang_core.make_arg_load_expr(id, dtype))
@@ -59,7 +59,12 @@ def svd3d(A, dt, iters=None):
             iters = 5
         else:
             iters = 8
-    if dt == ti.f32:
+    if ti.core.can_call_runtime_svd():
+        if dt == ti.f32:
+            rets = ti.core.sifakis_svd_runtime_f32(*inputs, iters)
+        else:
+            rets = ti.core.sifakis_svd_runtime_f64(*inputs, iters)
+    elif dt == ti.f32:
         rets = ti.core.sifakis_svd_f32(*inputs, iters)
     else:
         rets = ti.core.sifakis_svd_f64(*inputs, iters)
@@ -27,6 +27,7 @@ class Matrix(TaichiOperations):
                  rows=None,
                  cols=None):
         self.grad = None
+        self.dual = None
 
         # construct from rows or cols (deprecated)
         if rows is not None or cols is not None:
@@ -100,6 +101,7 @@ class Matrix(TaichiOperations):
                 self.m = mat.m
                 self.entries = mat.entries
                 self.grad = mat.grad
+                self.dual = mat.dual
 
         if self.n * self.m > 32:
             warning(
@@ -600,6 +602,12 @@ class Matrix(TaichiOperations):
             ret.entries[i] = self.entries[i].grad
         return ret
 
+    def make_dual(self):
+        ret = self.empty_copy()
+        for i in range(len(ret.entries)):
+            ret.entries[i] = self.entries[i].dual
+        return ret
+
     def sum(self):
         ret = self.entries[0]
         for i in range(1, len(self.entries)):
@@ -650,6 +658,8 @@ class Matrix(TaichiOperations):
             return self.element_wise_writeback_binary(assign_renamed, val)
 
         if isinstance(val, numbers.Number):
+            if all(e._fill_memory(val) for e in self.entries):
+                return
             val = tuple(
                 [tuple([val for _ in range(self.m)]) for _ in range(self.n)])
         elif isinstance(val,
@@ -728,6 +738,12 @@ class Matrix(TaichiOperations):
         assert isinstance(other, Matrix)
         from .meta import tensor_to_tensor
         assert len(self.shape) == len(other.shape)
+        impl.get_runtime().materialize()
+        if len(self.entries) == len(other.entries) and all(
+                impl.get_runtime().prog.copy_snode(a.ptr.snode(),
+                                                   b.ptr.snode())
+                for a, b in zip(self.entries, other.entries)):
+            return
         tensor_to_tensor(self, other)
 
     @taichi_scope
@@ -814,8 +830,12 @@ class Matrix(TaichiOperations):
               shape=None,
               offset=None,
               needs_grad=False,
+              needs_dual=False,
+              sparse_grad=False,
               layout=None):  # TODO(archibate): deprecate layout
         '''ti.Matrix.field'''
+        if shape is not None:
+            impl.check_root_not_materialized()
         self = cls.empty(n, m)
         self.entries = []
         self.n = n
@@ -824,6 +844,7 @@ class Matrix(TaichiOperations):
         for i in range(n * m):
             self.entries.append(impl.field(dtype))
         self.grad = self.make_grad()
+        self.dual = self.make_dual()
 
         if layout is not None:
             assert shape is not None, 'layout is useless without shape'
@@ -848,20 +869,30 @@ class Matrix(TaichiOperations):
             dim = len(shape)
             if layout.soa:
                 for i, e in enumerate(self.entries):
-                    ti.root.dense(ti.index_nd(dim), shape).place(e,
-                                                                 offset=offset)
-                    if needs_grad:
+                    node = ti.root.dense(ti.index_nd(dim), shape)
+                    node.place(e, offset=offset)
+                    if needs_grad and sparse_grad:
+                        node.lazy_grad(sparse=True)
+                    elif needs_grad:
                         ti.root.dense(ti.index_nd(dim),
                                       shape).place(e.grad, offset=offset)
+                    if needs_dual:
+                        ti.root.dense(ti.index_nd(dim),
+                                      shape).place(e.dual, offset=offset)
             else:
                 var_list = []
                 for i, e in enumerate(self.entries):
                     var_list.append(e)
-                if needs_grad:
+                if needs_grad and not sparse_grad:
                     for i, e in enumerate(self.entries):
                         var_list.append(e.grad)
-                ti.root.dense(ti.index_nd(dim), shape).place(*tuple(var_list),
-                                                             offset=offset)
+                if needs_dual:
+                    for i, e in enumerate(self.entries):
+                        var_list.append(e.dual)
+                node = ti.root.dense(ti.index_nd(dim), shape)
+                node.place(*tuple(var_list), offset=offset)
+                if needs_grad and sparse_grad:
+                    node.lazy_grad(sparse=True)
         return self
 
     @classmethod
@@ -118,7 +118,42 @@ def snode_deactivate(b: ti.template()):
         ti.deactivate(b, I)
 
 
+@ti.kernel
+def snode_listgen(b: ti.template()):
+    # Generates the element list of |b|, i.e. the list of its containers.
+    for I in ti.grouped(b):
+        ti.call_internal("do_nothing")
+
+
 @ti.kernel
 def snode_deactivate_dynamic(b: ti.template()):
     for I in ti.grouped(b.parent()):
         ti.deactivate(b, I)
+
+
+@ti.kernel
+def slab_to_ext_arr(tensor: ti.template(), arr: ti.ext_arr(), begin: ti.i32,
+                    end: ti.i32):
+    # Copies the indices [begin, end) along axis 0 of |tensor| to |arr|,
+    # indexed from 0 along that axis.
+    for I in ti.grouped(ti.ndrange((begin, end), *tensor.shape[1:])):
+        J = I - ti.Vector.unit(len(tensor.shape), 0, ti.i32) * begin
+        if ti.static(isinstance(tensor, ti.Matrix)):
+            for p in ti.static(range(tensor.n)):
+                for q in ti.static(range(tensor.m)):
+                    arr[J, p, q] = tensor[I][p, q]
+        else:
+            arr[J] = tensor[I]
+
+
+@ti.kernel
+def ext_arr_to_slab(arr: ti.ext_arr(), tensor: ti.template(), begin: ti.i32,
+                    end: ti.i32):
+    for I in ti.grouped(ti.ndrange((begin, end), *tensor.shape[1:])):
+        J = I - ti.Vector.unit(len(tensor.shape), 0, ti.i32) * begin
+        if ti.static(isinstance(tensor, ti.Matrix)):
+            for p in ti.static(range(tensor.n)):
+                for q in ti.static(range(tensor.m)):
+                    tensor[I][p, q] = arr[J, p, q]
+        else:
+            tensor[I] = arr[J]
@@ -163,10 +163,29 @@ def bit_cast(obj, dtype):
         return Expr(ti_core.bits_cast(Expr(obj).ptr, dtype))
 
 
+_batch_opcodes = None
+
+
+def _make_op_expr(taichi_op, operands, tb):
+    # The ops build_expression_batch knows are deferred, so that a whole
+    # expression is built by one call instead of one per op.
+    global _batch_opcodes
+    if _batch_opcodes is None:
+        _batch_opcodes = {
+            getattr(ti_core, name): opcode
+            for opcode, name in enumerate(
+                ti_core.get_expression_batch_op_names())
+        }
+    opcode = _batch_opcodes.get(taichi_op)
+    if opcode is None:
+        return Expr(taichi_op(*[operand.ptr for operand in operands]), tb=tb)
+    return Expr.deferred(opcode, operands, tb=tb)
+
+
 def _unary_operation(taichi_op, python_op, a):
     _taichi_skip_traceback = 1
     if is_taichi_expr(a):
-        return Expr(taichi_op(a.ptr), tb=stack_info())
+        return _make_op_expr(taichi_op, (a, ), stack_info())
     else:
         return python_op(a)
 
@@ -175,7 +194,7 @@ def _binary_operation(taichi_op, python_op, a, b):
     _taichi_skip_traceback = 1
     if is_taichi_expr(a) or is_taichi_expr(b):
         a, b = wrap_if_not_expr(a), wrap_if_not_expr(b)
-        return Expr(taichi_op(a.ptr, b.ptr), tb=stack_info())
+        return _make_op_expr(taichi_op, (a, b), stack_info())
     else:
         return python_op(a, b)
 
@@ -184,7 +203,7 @@ def _ternary_operation(taichi_op, python_op, a, b, c):
     _taichi_skip_traceback = 1
     if is_taichi_expr(a) or is_taichi_expr(b) or is_taichi_expr(c):
         a, b, c = wrap_if_not_expr(a), wrap_if_not_expr(b), wrap_if_not_expr(c)
-        return Expr(taichi_op(a.ptr, b.ptr, c.ptr), tb=stack_info())
+        return _make_op_expr(taichi_op, (a, b, c), stack_info())
     else:
         return python_op(a, b, c)
 
@@ -539,6 +558,22 @@ def external_func_call(func, args=[], outputs=[]):
                                       make_expr_group(outputs))
 
 
+def bitcode_func_call(path, func_name, args=[], outputs=[]):
+    '''Calls ``func_name(*args, *outputs)``, defined in the file at
+    ``path``, on CPU and CUDA.
+
+    The file holds LLVM bitcode (``.bc``) or IR (``.ll``) for the arch, or C
+    or C++ source (``.c``, ``.cpp``) compiled to it with clang. It is linked
+    into the kernel before it is optimized, so that the function is inlined
+    like a Taichi function. The function returns ``void``, and takes the
+    outputs as pointers, e.g. ``void f(float x, float *y)``.
+    '''
+    import os
+    ti_core.insert_bitcode_func_call(os.path.abspath(path), func_name,
+                                     make_expr_group(args),
+                                     make_expr_group(outputs))
+
+
 def asm(source, inputs=[], outputs=[]):
     import taichi as ti
     import ctypes
@@ -0,0 +1,154 @@
+import numpy as np
+
+from .core import taichi_lang_core
+from .expr import Expr
+from .external_array import zero_copy_array
+from .impl import get_runtime
+from .util import has_pytorch, python_scope, to_numpy_type
+
+if has_pytorch():
+    import torch
+
+
+class _Array:
+    # Gives the primitives the address of a 1-D array of |bits|-bit elements.
+    # Fields and strided numpy arrays are staged through zero-copy arrays,
+    # and written back when done.
+    def __init__(self, arr, name, bits=32):
+        self.arr = arr
+        self.field = None
+        self.on_device = False
+        if isinstance(arr, Expr):
+            assert len(arr.shape) == 1, f'{name} must be a 1-D field'
+            from .meta import tensor_to_ext_arr
+            self.field = arr
+            self.data = zero_copy_array(arr.shape,
+                                        dtype=to_numpy_type(arr.dtype))
+            tensor_to_ext_arr(arr, self.data)
+            get_runtime().sync()
+        elif isinstance(arr, np.ndarray):
+            assert arr.ndim == 1, f'{name} must be 1-D'
+            self.data = arr
+            if not arr.flags.c_contiguous:
+                self.data = np.ascontiguousarray(arr)
+        elif has_pytorch() and isinstance(arr, torch.Tensor):
+            assert arr.dim() == 1, f'{name} must be 1-D'
+            assert arr.is_contiguous(), f'{name} must be contiguous'
+            self.data = arr
+            self.on_device = arr.is_cuda
+            if self.on_device and get_runtime().prog.config.arch != \
+                    taichi_lang_core.Arch.cuda:
+                raise ValueError(f'{name} is on CUDA, but Taichi is not')
+        else:
+            raise TypeError(f'{name} must be a field, a numpy array or a '
+                            f'torch tensor, not {type(arr)}')
+        assert self.itemsize * 8 == bits, \
+            f'{name} must have {bits}-bit elements'
+
+    def __len__(self):
+        return self.data.shape[0]
+
+    @property
+    def itemsize(self):
+        if isinstance(self.data, np.ndarray):
+            return self.data.itemsize
+        return self.data.element_size()
+
+    @property
+    def is_signed_int(self):
+        if isinstance(self.data, np.ndarray):
+            return self.data.dtype.kind == 'i'
+        return not self.data.dtype.is_floating_point
+
+    @property
+    def ptr(self):
+        if isinstance(self.data, np.ndarray):
+            return self.data.ctypes.data
+        return self.data.data_ptr()
+
+    def write_back(self):
+        if self.field is not None:
+            from .meta import ext_arr_to_tensor
+            ext_arr_to_tensor(self.data, self.field)
+            get_runtime().sync()
+        elif self.data is not self.arr:
+            self.arr[...] = self.data
+
+
+def _prepare(*arrays):
+    get_runtime().materialize()
+    prog = get_runtime().prog
+    Arch = taichi_lang_core.Arch
+    assert prog.config.arch in (Arch.x64, Arch.arm64, Arch.cuda), \
+        'Parallel primitives are only available on CPU and CUDA'
+    on_device = [a.on_device for a in arrays if a is not None]
+    # Host and device arrays cannot be mixed, since they are all staged or
+    # all accessed in place.
+    assert all(on_device) or not any(on_device), \
+        'The arrays must be all on CUDA, or all on the host'
+    return prog, any(on_device)
+
+
+@python_scope
+def exclusive_scan(arr):
+    '''Replaces each element of a 1-D ``int32`` array with the sum of the
+    elements before it, in parallel.
+
+    Args:
+        arr: A 1-D field, numpy array or torch tensor of ``int32``.
+    '''
+    a = _Array(arr, 'arr')
+    assert a.is_signed_int, 'arr must be of int32'
+    prog, on_device = _prepare(a)
+    prog.exclusive_scan_i32(a.ptr, len(a), on_device)
+    a.write_back()
+
+
+@python_scope
+def sort_by_key(keys, values=None):
+    '''Sorts 32-bit integer keys in ascending order with a parallel radix sort,
+    permuting the values along. The sort is stable.
+
+    Args:
+        keys: A 1-D field, numpy array or torch tensor of ``int32`` or
+            ``uint32``.
+        values: ``None``, or an array of the same kind and length as
+            ``keys``, of any 32-bit type.
+    '''
+    k = _Array(keys, 'keys')
+    v = _Array(values, 'values') if values is not None else None
+    if v is not None:
+        assert len(k) == len(v), 'keys and values must have the same length'
+    prog, on_device = _prepare(k, v)
+    prog.sort_pairs_32(k.ptr, v.ptr if v is not None else 0, len(k),
+                       k.is_signed_int, on_device)
+    k.write_back()
+    if v is not None:
+        v.write_back()
+
+
+@python_scope
+def compact(src, flags, dst):
+    '''Copies the elements of ``src`` whose flag is non-zero to the front of
+    ``dst``, in order, in parallel.
+
+    Args:
+        src: A 1-D field, numpy array or torch tensor of any 32-bit type.
+        flags: An ``int32`` array of the same kind and length as ``src``.
+        dst: An array of the same kind, type and length as ``src``.
+
+    Returns:
+        The number of elements copied.
+    '''
+    s = _Array(src, 'src')
+    f = _Array(flags, 'flags')
+    d = _Array(dst, 'dst')
+    assert len(s) == len(f) == len(d), \
+        'src, flags and dst must have the same length'
+    prog, on_device = _prepare(s, f, d)
+    count = prog.compact_32(s.ptr, f.ptr, d.ptr, len(s), on_device)
+    d.write_back()
+    return count
+
+
+__all__ = ['exclusive_scan', 'sort_by_key', 'compact']
@@ -17,16 +17,21 @@ class SNode:
             dimensions = [dimensions] * len(indices)
         return SNode(self.ptr.pointer(indices, dimensions))
 
-    def hash(self, indices, dimensions):
+    def hash(self, indices, dimensions, capacity=None):
         if isinstance(dimensions, int):
             dimensions = [dimensions] * len(indices)
-        return SNode(self.ptr.hash(indices, dimensions))
+        if capacity is None:
+            capacity = 0
+        return SNode(self.ptr.hash(indices, dimensions, capacity))
 
-    def dynamic(self, index, dimension, chunk_size=None):
+    def dynamic(self, index, dimension, chunk_size=None,
+                chunk_directory=False):
         assert len(index) == 1
         if chunk_size is None:
             chunk_size = dimension
-        return SNode(self.ptr.dynamic(index[0], dimension, chunk_size))
+        return SNode(
+            self.ptr.dynamic(index[0], dimension, chunk_size,
+                             chunk_directory))
 
     def bitmasked(self, indices, dimensions):
         if isinstance(dimensions, int):
@@ -61,8 +66,127 @@ class SNode:
                 raise ValueError(f'{arg} cannot be placed')
         return self
 
-    def lazy_grad(self):
-        self.ptr.lazy_grad()
+    def lazy_grad(self, sparse=False):
+        """Places the gradients of the fields placed under this SNode.
+
+        With ``sparse=True``, the gradients of the fields of dense SNodes
+        go into a pointer SNode of blocks under ``ti.root`` instead. A block is
+        allocated on the first accumulation into it, so that struct-fors over
+        the gradients only visit the blocks the backward pass touched.
+        """
+        self.ptr.lazy_grad(sparse)
+
+    def lazy_dual(self):
+        """Places the duals of the fields placed under this SNode, for
+        forward-mode AutoDiff (see ``kernel.jvp``)."""
+        self.ptr.lazy_dual()
+
+    def gc_policy(self, threshold=0.0, period=0):
+        """Defers garbage collection of this (pointer or dynamic) SNode.
+
+        Deactivated nodes are only recycled for reuse once they amount to at
+        least ``threshold`` of the allocated nodes, or after ``period``
+        skipped garbage collections (``0`` means never forced).
+        ``threshold=0`` recycles them after every deactivation, which is the
+        default.
+        """
+        if impl.get_runtime().materialized:
+            raise RuntimeError(
+                'GC policies must be set before materialization')
+        assert threshold >= 0 and period >= 0
+        self.ptr.gc_threshold = threshold
+        self.ptr.gc_period = period
+        return self
+
+    def numa_policy(self, policy):
+        """Places the memory of this child of ``ti.root`` on the NUMA nodes
+        of the CPU.
+
+        ``'interleave'`` spreads its pages over the nodes round-robin, and
+        ``'partition'`` gives each node one contiguous part, which suits
+        loops over the field with ``cpu_thread_affinity='compact'``.
+        Only takes effect on CPU, on Linux.
+        """
+        if impl.get_runtime().materialized:
+            raise RuntimeError(
+                'NUMA policies must be set before materialization')
+        if policy not in ['interleave', 'partition']:
+            raise ValueError(
+                f"NUMA policy must be 'interleave' or 'partition', got {policy}"
+            )
+        if self.ptr.parent is None or \
+                self.ptr.parent.type != impl.taichi_lang_core.SNodeType.root:
+            raise RuntimeError(
+                'NUMA policies can only be set on the children of ti.root')
+        self.ptr.numa_policy = policy
+        return self
+
+    def mmap_file(self, path, writable=False, advice='normal'):
+        """Backs this child of ``ti.root`` with the file at ``path``, mapped
+        in place of its memory, so that its pages load on demand instead of
+        upfront. The file holds the raw bytes of the node, e.g. as written by
+        a previous run with ``writable=True``.
+
+        With ``writable=True``, the writes to the fields go to the file,
+        which is created or grown to the size of the node if needed.
+        Otherwise the file must hold the whole node, and the writes stay in
+        memory. ``advice`` is the access pattern hinted to the OS:
+        ``'normal'``, ``'sequential'``, ``'random'`` or ``'willneed'``.
+        Only dense subtrees can be mapped. Only takes effect on CPU, on
+        Linux and macOS.
+        """
+        if impl.get_runtime().materialized:
+            raise RuntimeError(
+                'File mappings must be set before materialization')
+        if advice not in ['normal', 'sequential', 'random', 'willneed']:
+            raise ValueError(
+                "mmap advice must be 'normal', 'sequential', 'random' or "
+                f"'willneed', got {advice}")
+        if self.ptr.parent is None or \
+                self.ptr.parent.type != impl.taichi_lang_core.SNodeType.root:
+            raise RuntimeError(
+                'Only the children of ti.root can be mapped to files')
+        self.ptr.mmap_path = str(path)
+        self.ptr.mmap_writable = writable
+        self.ptr.mmap_advice = advice
+        return self
+
+    def morton(self):
+        """Lays the children of this dense SNode out along a Z-order (Morton)
+        curve, with the bits of their indices interleaved, instead of row by
+        row. Neighbors along any axis then tend to share cache lines and
+        pages, which suits stencils over 2D and 3D fields. Loops over the
+        field also visit the cells in this order.
+
+        Only takes effect on CPU and CUDA.
+        """
+        if impl.get_runtime().materialized:
+            raise RuntimeError('Layouts must be set before materialization')
+        if self.ptr.type != impl.taichi_lang_core.SNodeType.dense:
+            raise RuntimeError('Only dense SNodes can have a Z-order layout')
+        self.ptr.morton(True)
+        return self
+
+    def align(self, alignment):
+        """Starts the cells of this dense SNode at multiples of ``alignment``
+        bytes, a power of two, padding them if needed.
+
+        E.g. ``ti.root.dense(ti.i, n).align(16).place(x, y, z)`` pads the
+        cells of three ``ti.f32`` to 16 bytes, which lets the accesses to
+        ``x[i]``, ``y[i]`` and ``z[i]`` combine into one vector access, and
+        ``align(64)`` starts the blocks at cache line boundaries.
+
+        Only takes effect on CPU and CUDA.
+        """
+        if impl.get_runtime().materialized:
+            raise RuntimeError('Layouts must be set before materialization')
+        if self.ptr.type != impl.taichi_lang_core.SNodeType.dense:
+            raise RuntimeError('Only dense SNodes can have a cell alignment')
+        if alignment <= 0 or alignment & (alignment - 1) != 0:
+            raise ValueError(
+                f'The cell alignment must be a power of two, got {alignment}')
+        self.ptr.cell_alignment = alignment
+        return self
 
     def parent(self, n=1):
         impl.get_runtime().materialize()
@@ -130,12 +254,38 @@ class SNode:
         runtime.materialize()
         return runtime.prog.get_snode_num_dynamically_allocated(self.ptr)
 
+    @property
+    def memory_stats(self):
+        """The memory usage of this SNode, see ``ti.memory_stats()``."""
+        from . import memory_stats
+        return memory_stats()[self.ptr.id]
+
+    def compact(self):
+        """Relocates the active children of this ``pointer`` or ``hash`` SNode
+        into the fewest memory chunks, and releases the chunks left empty for
+        reuse by other allocations.
+
+        Returns:
+            int: The number of bytes released.
+        """
+        from .meta import snode_listgen
+        snode_listgen(self)
+        return impl.get_runtime().prog.compact_snode(self.ptr)
+
     def deactivate_all(self):
+        import taichi as ti
+        if self.ptr.type in [
+                ti.core.SNodeType.pointer, ti.core.SNodeType.bitmasked
+        ] and self._clear():
+            return
         ch = self.get_children()
         for c in ch:
             c.deactivate_all()
         import taichi as ti
-        if self.ptr.type == ti.core.SNodeType.pointer or self.ptr.type == ti.core.SNodeType.bitmasked:
+        if self.ptr.type in [
+                ti.core.SNodeType.pointer, ti.core.SNodeType.hash,
+                ti.core.SNodeType.bitmasked
+        ]:
             from .meta import snode_deactivate
             snode_deactivate(self)
         if self.ptr.type == ti.core.SNodeType.dynamic:
@@ -145,6 +295,16 @@ class SNode:
             # its parent, whose linked list of chunks of elements will be deleted.
             snode_deactivate_dynamic(self)
 
+    def _clear(self):
+        # Deactivates the subtree in bulk if it can, see Program::clear_snode.
+        from .meta import snode_listgen
+        prog = impl.get_runtime().prog
+        if not prog.can_clear_snode(self.ptr):
+            return False
+        snode_listgen(self)
+        prog.clear_snode(self.ptr)
+        return True
+
     def __repr__(self):
         type_ = str(self.ptr.type)[len('SNodeType.'):]
         return f'<ti.SNode of type {type_}>'
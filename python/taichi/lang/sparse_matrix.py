@@ -0,0 +1,113 @@
+import numpy as np
+
+from .impl import get_runtime
+from .parallel_primitives import _Array, _prepare
+from .util import cook_dtype, python_scope, to_numpy_type
+
+
+class SparseMatrix:
+    '''A sparse matrix of ``f32`` or ``f64`` in the compressed sparse row
+    format, stored on the device of the current program (CPU or CUDA).
+
+    Args:
+        n: The number of rows.
+        m: The number of columns, ``n`` by default.
+        dtype: ``ti.f32`` or ``ti.f64``.
+    '''
+    @python_scope
+    def __init__(self, n, m=None, dtype=float):
+        if m is None:
+            m = n
+        get_runtime().materialize()
+        self.prog = get_runtime().prog
+        self.dtype = cook_dtype(dtype)
+        self.np_dtype = to_numpy_type(self.dtype)
+        assert self.np_dtype in (np.float32, np.float64), \
+            'dtype must be ti.f32 or ti.f64'
+        self.matrix = self.prog.create_sparse_matrix(n, m, self.dtype)
+
+    def __del__(self):
+        # The matrix has already been freed if the program was finalized.
+        if getattr(self, 'matrix', None) is not None and \
+                get_runtime().prog is self.prog:
+            self.prog.destroy_sparse_matrix(self.matrix)
+
+    @property
+    def shape(self):
+        return self.matrix.get_num_rows(), self.matrix.get_num_cols()
+
+    @property
+    def num_nonzeros(self):
+        return self.matrix.get_num_nonzeros()
+
+    def _values(self, arr, name):
+        return _Array(arr, name, bits=self.np_dtype(0).itemsize * 8)
+
+    @python_scope
+    def build_from_triplets(self, rows, cols, values):
+        '''Replaces the entries with the triplets ``(rows[i], cols[i],
+        values[i])``, summing those at the same position.
+
+        Args:
+            rows: A 1-D field, numpy array or torch tensor of ``int32``.
+            cols: An ``int32`` array of the same kind and length as ``rows``.
+            values: An array of the same kind and length as ``rows``, of the
+                type of the matrix.
+        '''
+        r = _Array(rows, 'rows')
+        c = _Array(cols, 'cols')
+        v = self._values(values, 'values')
+        assert len(r) == len(c) == len(v), \
+            'rows, cols and values must have the same length'
+        _, on_device = _prepare(r, c, v)
+        self.matrix.build_from_triplets(r.ptr, c.ptr, v.ptr, len(r), on_device)
+
+    @python_scope
+    def matvec(self, x, y):
+        '''Computes ``y = A x``.
+
+        Args:
+            x: A 1-D array of the type of the matrix, with one element per
+                column.
+            y: An array of the same kind and type, with one element per row.
+        '''
+        a = self._values(x, 'x')
+        b = self._values(y, 'y')
+        num_rows, num_cols = self.shape
+        assert len(a) == num_cols, f'x must have {num_cols} elements'
+        assert len(b) == num_rows, f'y must have {num_rows} elements'
+        _, on_device = _prepare(a, b)
+        self.matrix.spmv(a.ptr, b.ptr, on_device)
+        b.write_back()
+
+    @python_scope
+    def solve_cg(self, b, x, tol=1e-6, max_iterations=1000):
+        '''Solves ``A x = b`` for a symmetric positive-definite matrix with
+        the Jacobi-preconditioned conjugate gradient method, starting from
+        the given ``x``.
+
+        Args:
+            b: A 1-D array of the type of the matrix, with one element per
+                row.
+            x: An array of the same kind, type and length as ``b``.
+            tol: The norm of the residual relative to that of ``b`` to stop
+                at.
+            max_iterations: The most iterations to run.
+
+        Returns:
+            The number of iterations run.
+        '''
+        p = self._values(b, 'b')
+        q = self._values(x, 'x')
+        num_rows, num_cols = self.shape
+        assert num_rows == num_cols, 'The matrix must be square'
+        assert len(p) == len(q) == num_rows, \
+            f'b and x must have {num_rows} elements'
+        _, on_device = _prepare(p, q)
+        iterations = self.matrix.solve_cg(p.ptr, q.ptr, tol, max_iterations,
+                                          on_device)
+        q.write_back()
+        return iterations
+
+
+__all__ = ['SparseMatrix']
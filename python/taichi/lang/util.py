@@ -30,12 +30,15 @@ def is_taichi_class(rhs):
 
 # Real types
 
+# Stored in half precision, computed in f32
+float16 = taichi_lang_core.DataType_f16
+f16 = float16
 float32 = taichi_lang_core.DataType_f32
 f32 = float32
 float64 = taichi_lang_core.DataType_f64
 f64 = float64
 
-real_types = [f32, f64, float]
+real_types = [f16, f32, f64, float]
 real_type_ids = [id(t) for t in real_types]
 
 # Integer types
@@ -65,7 +68,16 @@ types = real_types + integer_types
 type_ids = [id(t) for t in types]
 
 
+def to_compute_type(dt):
+    # Quantized fields are copied from and to external arrays of their compute
+    # types
+    if isinstance(dt, taichi_lang_core.DataType):
+        return dt.get_compute_type()
+    return dt
+
+
 def to_numpy_type(dt):
+    dt = to_compute_type(dt)
     if dt == f32:
         return np.float32
     elif dt == f64:
@@ -92,6 +104,7 @@ def to_numpy_type(dt):
 
 def to_pytorch_type(dt):
     import torch
+    dt = to_compute_type(dt)
     if dt == f32:
         return torch.float32
     elif dt == f64:
@@ -120,7 +133,9 @@ def to_taichi_type(dt):
     if type(dt) == taichi_lang_core.DataType:
         return dt
 
-    if dt == np.float32:
+    if dt == np.float16:
+        return f16
+    elif dt == np.float32:
         return f32
     elif dt == np.float64:
         return f64
@@ -142,7 +157,9 @@ def to_taichi_type(dt):
         return u64
 
     if has_pytorch():
-        if dt == torch.float32:
+        if dt == torch.float16:
+            return f16
+        elif dt == torch.float32:
             return f32
         elif dt == torch.float64:
             return f64
@@ -41,7 +41,8 @@ class GUI:
                  background_color=0x0,
                  show_gui=True,
                  fullscreen=False,
-                 fast_gui=False):
+                 fast_gui=False,
+                 canvas_format='rgba32f'):
         if 'TI_GUI_SHOW' in os.environ:
             show_gui = bool(int(os.environ['TI_GUI_SHOW']))
         if 'TI_GUI_FULLSCREEN' in os.environ:
@@ -54,6 +55,10 @@ class GUI:
             res = (res, res)
         self.res = res
         self.fast_gui = fast_gui
+        # The zero-copy array the window presents in fast_gui mode on CUDA and
+        # OpenGL, see _fast_image().
+        self.device_img = None
+        self.device_img_prog = None
         if fast_gui:
             self.img = np.ascontiguousarray(
                 np.zeros(self.res[0] * self.res[1], dtype=np.uint32))
@@ -63,8 +68,13 @@ class GUI:
             self.img = np.ascontiguousarray(
                 np.zeros(self.res + (4, ), np.float32))
             fast_buf = 0
+        if canvas_format not in ['rgba32f', 'rgba8']:
+            raise ValueError(
+                f"canvas_format must be 'rgba32f' or 'rgba8', not '{canvas_format}'"
+            )
         self.core = ti_core.GUI(name, core_veci(*res), show_gui, fullscreen,
-                                fast_gui, fast_buf)
+                                fast_gui, fast_buf, True,
+                                getattr(ti_core.CanvasFormat, canvas_format))
         self.canvas = self.core.get_canvas()
         self.background_color = background_color
         self.key_pressed = set()
@@ -146,6 +156,32 @@ class GUI:
         assert res == self.res, "Image resolution does not match GUI resolution"
         return np.ascontiguousarray(img)
 
+    def _fast_image(self):
+        # On CUDA and OpenGL, the pixels are converted into a zero-copy array
+        # which the window presents, instead of into a numpy array that is
+        # copied to the device and back on every frame.
+        import taichi as ti
+        self._check_device_image()
+        if ti.cfg.arch not in [ti.cuda, ti.opengl]:
+            return self.img
+        if self.device_img is None:
+            self.device_img = ti.zero_copy_array(self.img.shape, np.uint32)
+            self.device_img[:] = 0
+            self.device_img_prog = ti.get_runtime().prog
+            self.core.set_fast_buffer(self.device_img.ctypes.data)
+        return self.device_img
+
+    def _check_device_image(self):
+        # The zero-copy array is freed together with its program, e.g. at
+        # ti.reset(), after which the window presents the numpy array again.
+        if self.device_img is None:
+            return
+        import taichi as ti
+        if ti.get_runtime().prog is not self.device_img_prog:
+            self.core.set_fast_buffer(self.img.ctypes.data)
+            self.device_img = None
+            self.device_img_prog = None
+
     def get_image(self):
         self.img = np.ascontiguousarray(self.img)
         self.core.get_img(self.img.ctypes.data)
@@ -164,7 +200,11 @@ class GUI:
                     "Only RGB images are supported in GUI.set_image when fast_gui=True"
 
             from taichi.lang.meta import vector_to_fast_image
-            vector_to_fast_image(img, self.img)
+            out = self._fast_image()
+            vector_to_fast_image(img, out)
+            if out is self.device_img:
+                # The window reads the array once the kernel is done.
+                ti.sync()
             return
 
         if isinstance(img, ti.Expr):
@@ -398,6 +438,7 @@ class GUI:
         self.arrows(base, dir, radius=radius, color=color, **kwargs)
 
     def show(self, file=None):
+        self._check_device_image()
         self.core.update()
         if file:
             self.core.screenshot(file)
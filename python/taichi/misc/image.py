@@ -77,6 +77,78 @@ def imwrite(img, filename):
     ti.core.imwrite(filename, ptr, resx, resy, comp)
 
 
+class FrameWriter:
+    """
+    Save images on background threads, so that the caller only pays for a
+    copy of each frame.
+
+    By default, each frame is encoded into its own file, as ``ti.imwrite``
+    does, on ``num_threads`` threads (all the hardware threads if 0). With
+    ``video``, the frames are piped to ``ffmpeg`` instead, which encodes them
+    into that video file at ``framerate``. At most ``max_queued_frames`` frames
+    wait to be written, beyond which ``write`` blocks.
+    """
+    def __init__(self,
+                 num_threads=0,
+                 max_queued_frames=8,
+                 video=None,
+                 framerate=24):
+        self.video = video
+        self.framerate = framerate
+        self.max_queued_frames = max_queued_frames
+        self.core = None
+        if video is None:
+            self.core = ti.core.FrameWriter(num_threads, max_queued_frames)
+        self.video_shape = None
+
+    def _start_video(self, shape):
+        from taichi.tools.video import get_ffmpeg_path
+        resy, resx, comp = shape
+        pix_fmt = {1: 'gray', 3: 'rgb24', 4: 'rgba'}[comp]
+        command = (
+            f'{get_ffmpeg_path()} -loglevel panic -y -f rawvideo'
+            f' -pix_fmt {pix_fmt} -s {resx}x{resy} -r {self.framerate} -i -'
+            f' -c:v libx264 -pix_fmt yuv420p "{self.video}"')
+        self.core = ti.core.FrameWriter(command, self.max_queued_frames)
+        self.video_shape = shape
+
+    def write(self, img, filename=''):
+        """
+        Queue an image, which is saved to ``filename``, or appended to the
+        video.
+        """
+        img = np.ascontiguousarray(cook_image_to_bytes(img))
+        if self.video is not None:
+            if self.core is None:
+                self._start_video(img.shape)
+            if img.shape != self.video_shape:
+                raise ValueError(
+                    f'The frames of a video must all have the shape {self.video_shape}, not {img.shape}'
+                )
+        resy, resx, comp = img.shape
+        self.core.write(filename, img.ctypes.data, resx, resy, comp)
+
+    def flush(self):
+        """
+        Wait until the images queued so far are saved.
+        """
+        if self.core is not None:
+            self.core.flush()
+
+    def close(self):
+        """
+        Save the remaining images, and finish the video.
+        """
+        self.flush()
+        self.core = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, val, tb):
+        self.close()
+
+
 def imread(filename, channels=0):
     """
     Load image from a specific file.
@@ -90,6 +162,32 @@ def imread(filename, channels=0):
     return img.swapaxes(0, 1)[:, ::-1, :]
 
 
+def imread_batch(filenames, channels=0, out=None, num_threads=0):
+    """
+    Load many images of the same size in parallel.
+
+    Returns a contiguous ``np.uint8`` array of shape ``(len(filenames), resx,
+    resy, channels)``, in which ``[k]`` equals ``ti.imread(filenames[k])``.
+    ``channels`` is taken from the first file if 0. The images are decoded
+    directly into ``out`` if given, e.g. the slices of a larger stack loaded a
+    batch at a time.
+    """
+    if len(filenames) == 0:
+        raise ValueError('No image files to read')
+    resx, resy, comp = ti.core.imread_info(filenames[0])
+    if channels != 0:
+        comp = channels
+    shape = (len(filenames), resx, resy, comp)
+    if out is None:
+        out = np.empty(shape, dtype=np.uint8)
+    if out.shape != shape or out.dtype != np.uint8 or not out.flags.c_contiguous:
+        raise ValueError(
+            f'out must be a contiguous np.uint8 array of shape {shape}')
+    ti.core.imread_batch(list(filenames), out.ctypes.data, resx, resy, comp,
+                         num_threads)
+    return out
+
+
 def imshow(img, window_name='imshow'):
     """
     Show image in a Taichi GUI.
@@ -112,7 +210,9 @@ def imshow(img, window_name='imshow'):
 __all__ = [
     'imshow',
     'imread',
+    'imread_batch',
     'imwrite',
+    'FrameWriter',
     'imresize',
     'imdisplay',
 ]
@@ -4,7 +4,7 @@ import taichi as ti
 # Helper functions
 def get_rel_eps():
     arch = ti.cfg.arch
-    if arch == ti.opengl:
+    if arch in [ti.opengl, ti.vulkan]:
         return 1e-3
     elif arch == ti.metal:
         # Debatable, different hardware could yield different precisions
@@ -74,6 +74,9 @@ def _get_taichi_archs_fixture():
                 require = [require]
             if len(arch) == 0:
                 arch = ti.supported_archs()
+            if ti.opengl in exclude:
+                # Vulkan runs the same GLSL.
+                exclude = list(exclude) + [ti.vulkan]
 
             if (req_arch not in arch) or (req_arch in exclude):
                 raise pytest.skip(f'Arch={req_arch} not included in this test')
@@ -1,5 +1,5 @@
 from taichi.core.settings import get_os_name
-from taichi.misc.image import imwrite
+from taichi.misc.image import FrameWriter
 
 import os
 
@@ -76,6 +76,8 @@ class VideoManager:
         self.frame_counter = 0
         self.frame_fns = []
         self.automatic_build = automatic_build
+        # Encodes the frames on background threads.
+        self.frame_writer = FrameWriter()
 
     def get_output_filename(self, suffix):
         return os.path.join(self.directory, 'video' + suffix)
@@ -95,7 +97,7 @@ class VideoManager:
         assert os.path.exists(self.directory)
         fn = FRAME_FN_TEMPLATE % self.frame_counter
         self.frame_fns.append(fn)
-        imwrite(img, os.path.join(self.frame_directory, fn))
+        self.frame_writer.write(img, os.path.join(self.frame_directory, fn))
         self.frame_counter += 1
         if self.frame_counter % self.next_video_checkpoint == 0:
             if self.automatic_build:
@@ -103,6 +105,7 @@ class VideoManager:
                 self.next_video_checkpoint *= 2
 
     def get_frame_directory(self):
+        self.frame_writer.flush()
         return self.frame_directory
 
     def write_frames(self, images):
@@ -110,11 +113,13 @@ class VideoManager:
             self.write_frame(img)
 
     def clean_frames(self):
+        self.frame_writer.flush()
         for fn in os.listdir(self.frame_directory):
             if fn.endswith('.png') and fn in self.frame_fns:
                 os.remove(fn)
 
     def make_video(self, mp4=True, gif=True):
+        self.frame_writer.flush()
         fn = self.get_output_filename('.mp4')
         command = (get_ffmpeg_path() + " -loglevel panic -framerate %d -i " % self.framerate) + os.path.join(self.frame_directory, FRAME_FN_TEMPLATE) + \
                   " -s:v " + str(self.width) + 'x' + str(self.height) + \
@@ -0,0 +1,53 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/snode.h"
+#include "taichi/ir/statements.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace irpass::analysis {
+
+int64 estimate_bytes_per_launch(OffloadedStmt *stmt) {
+  if (stmt->task_type != OffloadedStmt::TaskType::range_for ||
+      !stmt->const_begin || !stmt->const_end)
+    return 0;
+  const int64 trip_count =
+      std::max((int64)stmt->end_value - stmt->begin_value, (int64)0);
+  // Including the TLS prologue and epilogue of reductions.
+  auto [reads, writes] = gather_snode_read_writes(stmt);
+
+  // The members of a bit_struct are moved together as its physical type.
+  std::unordered_map<SNode *, int> num_accesses;
+  auto add = [&](SNode *snode) {
+    if (snode->type != SNodeType::place)
+      return;
+    if (!snode->dt->is<PrimitiveType>()) {
+      if (!snode->parent || !snode->parent->physical_type)
+        return;
+      snode = snode->parent;
+    }
+    num_accesses[snode]++;
+  };
+  for (auto *snode : reads)
+    add(snode);
+  for (auto *snode : writes)
+    add(snode);
+
+  int64 bytes = 0;
+  for (auto &[snode, n] : num_accesses) {
+    int64 num_elements = 1;
+    for (int i = 0; i < snode->num_active_indices; i++) {
+      num_elements *= snode->shape_along_axis(i);
+    }
+    const auto element_size = data_type_size(
+        snode->physical_type ? DataType(snode->physical_type) : snode->dt);
+    // A smaller field, e.g. a 0-D reduction target, is accessed by all the
+    // iterations but moved once.
+    bytes += std::min(trip_count, num_elements) * element_size * n;
+  }
+  return bytes;
+}
+
+}  // namespace irpass::analysis
+
+TLANG_NAMESPACE_END
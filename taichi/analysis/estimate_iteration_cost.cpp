@@ -0,0 +1,84 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+
+#include <algorithm>
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// Roughly the cost of a simple statement, e.g. an add.
+constexpr int64 kSimpleCost = 1;
+// Memory accesses, which may miss the caches.
+constexpr int64 kMemoryCost = 4;
+// Read-modify-writes on shared data, SNode activation, random numbers, ...
+constexpr int64 kAtomicCost = 16;
+// The assumed trip count of loops without constant bounds.
+constexpr int64 kDynamicTripCount = 16;
+// Larger costs are clamped, so that they do not overflow.
+constexpr int64 kMaxCost = 1LL << 40;
+
+int64 estimate_cost(Block *block);
+
+int64 multiply_clamped(int64 a, int64 b) {
+  if (b != 0 && a > kMaxCost / b)
+    return kMaxCost;
+  return a * b;
+}
+
+int64 get_trip_count(RangeForStmt *stmt) {
+  auto begin = stmt->begin->cast<ConstStmt>();
+  auto end = stmt->end->cast<ConstStmt>();
+  if (!begin || !end)
+    return kDynamicTripCount;
+  return std::max(int64(0), end->val[0].val_int() - begin->val[0].val_int());
+}
+
+int64 estimate_cost(Stmt *s) {
+  if (auto if_stmt = s->cast<IfStmt>()) {
+    // Only one of the branches is taken.
+    int64 t = 0, f = 0;
+    if (if_stmt->true_statements)
+      t = estimate_cost(if_stmt->true_statements.get());
+    if (if_stmt->false_statements)
+      f = estimate_cost(if_stmt->false_statements.get());
+    return kSimpleCost + std::max(t, f);
+  } else if (auto range_for = s->cast<RangeForStmt>()) {
+    return kSimpleCost + multiply_clamped(estimate_cost(range_for->body.get()),
+                                          get_trip_count(range_for));
+  } else if (auto while_stmt = s->cast<WhileStmt>()) {
+    return kSimpleCost + multiply_clamped(estimate_cost(while_stmt->body.get()),
+                                          kDynamicTripCount);
+  } else if (s->is_container_statement()) {
+    return irpass::analysis::count_statements(s) * kSimpleCost *
+           kDynamicTripCount;
+  } else if (s->is<AtomicOpStmt>() || s->is<SNodeOpStmt>() ||
+             s->is<RandStmt>() || s->is<ExternalFuncCallStmt>()) {
+    return kAtomicCost;
+  } else if (s->is<GlobalLoadStmt>() || s->is<GlobalStoreStmt>()) {
+    return kMemoryCost;
+  }
+  return kSimpleCost;
+}
+
+int64 estimate_cost(Block *block) {
+  int64 cost = 0;
+  for (auto &s : block->statements) {
+    cost = std::min(cost + estimate_cost(s.get()), kMaxCost);
+  }
+  return cost;
+}
+
+}  // namespace
+
+namespace irpass::analysis {
+
+int64 estimate_iteration_cost(OffloadedStmt *stmt) {
+  TI_ASSERT(stmt->task_type == OffloadedStmt::TaskType::range_for);
+  return std::max(estimate_cost(stmt->body.get()), kSimpleCost);
+}
+
+}  // namespace irpass::analysis
+
+TLANG_NAMESPACE_END
@@ -8,7 +8,8 @@ TLANG_NAMESPACE_BEGIN
 
 namespace irpass::analysis {
 
-// Returns the set of SNodes that are read or written
+// Returns the set of SNodes that are read or written, before or after
+// lower_access
 std::pair<std::unordered_set<SNode *>, std::unordered_set<SNode *>>
 gather_snode_read_writes(IRNode *root) {
   std::pair<std::unordered_set<SNode *>, std::unordered_set<SNode *>> accessed;
@@ -34,6 +35,11 @@ gather_snode_read_writes(IRNode *root) {
           if (write)
             accessed.second.emplace(snode);
         }
+      } else if (auto get_ch = ptr->cast<GetChStmt>()) {
+        if (read)
+          accessed.first.emplace(get_ch->output_snode);
+        if (write)
+          accessed.second.emplace(get_ch->output_snode);
       }
     }
     return false;
@@ -0,0 +1,137 @@
+#include <typeindex>
+#include <unordered_map>
+
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/ir.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/visitors.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Hashes the IR the way IRNodeComparator compares it: by the class, the
+// fields and the operands of each statement, and the blocks of the container
+// statements. Operands are numbered in the order their statements are
+// visited, so that the ids do not matter.
+class StructuralHasher : public IRVisitor {
+ public:
+  uint64 hash{0};
+
+  StructuralHasher() {
+    allow_undefined_visitor = true;
+    invoke_default_visitor = true;
+  }
+
+  void visit(Block *block) override {
+    hash = hash_combine(hash, block->size());
+    for (auto &stmt : block->statements) {
+      stmt->accept(this);
+    }
+  }
+
+  void visit(Stmt *stmt) override {
+    basic_hash(stmt);
+  }
+
+  void visit(IfStmt *stmt) override {
+    basic_hash(stmt);
+    hash_block(stmt->true_statements.get());
+    hash_block(stmt->false_statements.get());
+  }
+
+  void visit(FuncBodyStmt *stmt) override {
+    basic_hash(stmt);
+    hash_block(stmt->body.get());
+  }
+
+  void visit(WhileStmt *stmt) override {
+    basic_hash(stmt);
+    hash_block(stmt->body.get());
+  }
+
+  void visit(RangeForStmt *stmt) override {
+    basic_hash(stmt);
+    hash_block(stmt->body.get());
+  }
+
+  void visit(StructForStmt *stmt) override {
+    basic_hash(stmt);
+    hash_block(stmt->block_initialization.get());
+    hash_block(stmt->body.get());
+    hash_block(stmt->block_finalization.get());
+  }
+
+  void visit(OffloadedStmt *stmt) override {
+    basic_hash(stmt);
+    hash_block(stmt->tls_prologue.get());
+    hash_block(stmt->bls_prologue.get());
+    hash_block(stmt->body.get());
+    hash_block(stmt->bls_epilogue.get());
+    hash_block(stmt->tls_epilogue.get());
+  }
+
+  static uint64 run(IRNode *root) {
+    StructuralHasher hasher;
+    root->accept(&hasher);
+    return hasher.hash;
+  }
+
+ private:
+  // The blocks of a container statement can be missing, e.g. the false
+  // branch of an IfStmt, which is different from an empty block.
+  void hash_block(Block *block) {
+    if (block) {
+      block->accept(this);
+    } else {
+      hash = hash_combine(hash, ~uint64(0));
+    }
+  }
+
+  void basic_hash(Stmt *stmt) {
+    TI_ASSERT(stmt->fields_registered);
+    hash = hash_combine(hash, get_class_hash(stmt));
+    hash = hash_combine(hash, stmt->field_manager.hash());
+    hash = hash_combine(hash, stmt->num_operands());
+    for (int i = 0; i < stmt->num_operands(); i++) {
+      hash = hash_combine(hash, get_operand_hash(stmt->operand(i)));
+    }
+    stmt_numbers_[stmt] = (int)stmt_numbers_.size();
+  }
+
+  uint64 get_operand_hash(Stmt *operand) {
+    if (operand == nullptr) {
+      return ~uint64(0);
+    }
+    auto it = stmt_numbers_.find(operand);
+    if (it != stmt_numbers_.end()) {
+      return it->second;
+    }
+    // Defined outside of the root, e.g. the statements of the kernel that a
+    // task refers to. Only its class and id then tell it apart.
+    return hash_combine(get_class_hash(operand), (uint64)operand->id) |
+           (uint64(1) << 63);
+  }
+
+  // The hash of the mangled name of the class.
+  static uint64 get_class_hash(Stmt *stmt) {
+    thread_local std::unordered_map<std::type_index, uint64> class_hashes;
+    std::type_index type(typeid(*stmt));
+    auto it = class_hashes.find(type);
+    if (it == class_hashes.end()) {
+      it = class_hashes.emplace(type, hash_string(type.name())).first;
+    }
+    return it->second;
+  }
+
+  std::unordered_map<Stmt *, int> stmt_numbers_;
+};
+
+namespace irpass::analysis {
+
+uint64 structural_hash(IRNode *root) {
+  TI_ASSERT(root);
+  return StructuralHasher::run(root);
+}
+
+}  // namespace irpass::analysis
+
+TLANG_NAMESPACE_END
@@ -20,10 +20,17 @@ class CCKernel {
       : program(program), kernel(kernel), name(name), source(source) {
   }
 
+  // The kernel is actually compiled by CCProgram::relink(), along with the
+  // other kernels added since the last launch.
   void compile();
   void launch(Context *ctx);
-  std::string get_object() {
-    return obj_path;
+
+  std::string const &get_name() const {
+    return name;
+  }
+
+  std::string const &get_source() const {
+    return source;
   }
 
  private:
@@ -32,9 +39,6 @@ class CCKernel {
 
   std::string name;
   std::string source;
-
-  std::string src_path;
-  std::string obj_path;
 };
 
 }  // namespace cccp
@@ -8,9 +8,12 @@
 #include "cc_runtime.h"
 #include "cc_kernel.h"
 #include "cc_layout.h"
+#include "cc_tcc.h"
 #include "cc_utils.h"
 #include "context.h"
 
+#include <cctype>
+
 TLANG_NAMESPACE_BEGIN
 namespace cccp {
 
@@ -21,15 +24,6 @@ void CCKernel::compile() {
                               ActionArg("kernel_name", name),
                               ActionArg("kernel_source", source),
                           });
-
-  obj_path = fmt::format("{}/{}.o", runtime_tmp_dir, name);
-  src_path = fmt::format("{}/{}.c", runtime_tmp_dir, name);
-
-  std::ofstream(src_path) << program->get_runtime()->header << "\n"
-                          << program->get_layout()->source << "\n"
-                          << source;
-  TI_DEBUG("[cc] compiling [{}] -> [{}]:\n{}\n", name, obj_path, source);
-  execute(program->program->config.cc_compile_cmd, obj_path, src_path);
 }
 
 void CCKernel::launch(Context *ctx) {
@@ -55,15 +49,25 @@ size_t CCLayout::compile() {
                                             ActionArg("layout_source", source),
                                         });
 
+  using FuncGetRootSizeType = size_t();
+  auto full_source = fmt::format(
+      "{}\n{}\n"
+      "void *Ti_get_root_size(void) {{ \n"
+      "  return (void *) sizeof(struct Ti_S0root);\n"
+      "}}\n",
+      program->get_runtime()->header, source);
+  if (auto *tcc = program->get_tcc()) {
+    TI_DEBUG("[cc] compiling root struct in memory:\n{}\n", source);
+    auto get_root_size = reinterpret_cast<FuncGetRootSizeType *>(
+        tcc->compile(full_source, {"Ti_get_root_size"})[0]);
+    return (*get_root_size)();
+  }
+
   obj_path = fmt::format("{}/_rti_root.o", runtime_tmp_dir);
   src_path = fmt::format("{}/_rti_root.c", runtime_tmp_dir);
   auto dll_path = fmt::format("{}/libti_roottest.so", runtime_tmp_dir);
 
-  std::ofstream(src_path) << program->get_runtime()->header << "\n"
-                          << source << "\n"
-                          << "void *Ti_get_root_size(void) { \n"
-                          << "  return (void *) sizeof(struct Ti_S0root);\n"
-                          << "}\n";
+  std::ofstream(src_path) << full_source;
 
   TI_DEBUG("[cc] compiling root struct -> [{}]:\n{}\n", obj_path, source);
   execute(program->program->config.cc_compile_cmd, obj_path, src_path);
@@ -76,7 +80,6 @@ size_t CCLayout::compile() {
   TI_ASSERT_INFO(dll.loaded(), "[cc] could not load shared object: {}",
                  dll_path);
 
-  using FuncGetRootSizeType = size_t();
   auto get_root_size = reinterpret_cast<FuncGetRootSizeType *>(
       dll.load_function("Ti_get_root_size"));
   TI_ASSERT(get_root_size);
@@ -89,6 +92,9 @@ void CCRuntime::compile() {
                                             ActionArg("runtime_header", header),
                                             ActionArg("runtime_source", source),
                                         });
+  // Compiled along with each unit of kernels instead.
+  if (program->get_tcc())
+    return;
 
   obj_path = fmt::format("{}/_rti_runtime.o", runtime_tmp_dir);
   src_path = fmt::format("{}/_rti_runtime.c", runtime_tmp_dir);
@@ -101,26 +107,126 @@ void CCRuntime::compile() {
 void CCProgram::relink() {
   if (!need_relink)
     return;
+  need_relink = false;
+  if (pending_kernels.empty())
+    return;
+
+  std::vector<std::string> names;
+  std::string source =
+      fmt::format("{}\n{}\n", runtime->header, layout->source);
+  for (auto *ker : pending_kernels) {
+    names.push_back(ker->get_name());
+    source += ker->get_source() + "\n";
+  }
+  pending_kernels.clear();
+
+  if (tcc) {
+    TI_DEBUG("[cc] compiling [{}] in memory:\n{}\n", fmt::join(names, "] ["),
+             source);
+    std::vector<std::string> symbols;
+    for (auto const &name : names) {
+      symbols.push_back("Tk_" + name);
+    }
+    auto entries = tcc->compile(source + runtime->source, symbols);
+    for (int i = 0; i < (int)names.size(); i++) {
+      kernel_entries[names[i]] =
+          reinterpret_cast<CCFuncEntryType *>(entries[i]);
+    }
+    return;
+  }
+
+  auto obj_path = fmt::format("{}/_rti_kernels{}.o", runtime_tmp_dir,
+                              kernel_objects.size());
+  auto src_path = fmt::format("{}/_rti_kernels{}.c", runtime_tmp_dir,
+                              kernel_objects.size());
+  std::ofstream(src_path) << source;
+  TI_DEBUG("[cc] compiling [{}] -> [{}]:\n{}\n", fmt::join(names, "] ["),
+           obj_path, source);
+  const std::string openmp_flag = program->config.cc_openmp ? " -fopenmp" : "";
+  execute(program->config.cc_compile_cmd + openmp_flag, obj_path, src_path);
+  kernel_objects.push_back(obj_path);
 
   dll_path = fmt::format("{}/libti_program.so", runtime_tmp_dir);
 
   std::vector<std::string> objects;
   objects.push_back(runtime->get_object());
-  for (auto const &ker : kernels) {
-    objects.push_back(ker->get_object());
-  }
+  objects.insert(objects.end(), kernel_objects.begin(), kernel_objects.end());
 
   TI_DEBUG("[cc] linking shared object [{}] with [{}]", dll_path,
            fmt::join(objects, "] ["));
-  execute(program->config.cc_link_cmd, dll_path, fmt::join(objects, "' '"));
+  execute(program->config.cc_link_cmd + openmp_flag, dll_path,
+          fmt::join(objects, "' '"));
 
   dll = nullptr;
   TI_DEBUG("[cc] loading shared object: {}", dll_path);
   dll = std::make_unique<DynamicLoader>(dll_path);
   TI_ASSERT_INFO(dll->loaded(), "[cc] could not load shared object: {}",
                  dll_path);
+}
 
-  need_relink = false;
+void CCProgram::export_library(std::string const &source_path,
+                               std::string const &header_path) {
+  TI_ERROR_IF(!layout, "[cc] the layout must be materialized before export");
+  auto header_name = header_path.substr(header_path.find_last_of('/') + 1);
+  std::string guard = "TI_";
+  for (char c : header_name) {
+    guard += std::isalnum(c) ? (char)std::toupper(c) : '_';
+  }
+
+  std::ofstream hdr(header_path);
+  TI_ERROR_IF(!hdr, "[cc] cannot open {}", header_path);
+  hdr << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+      << runtime->header << "\n"
+      << layout->source << "\n"
+      << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n"
+      << fmt::format("#define Ti_GTMP_SIZE {}\n", taichi_global_tmp_buffer_size)
+      << fmt::format("#define Ti_NUM_ARGS {}\n", taichi_max_num_args)
+      << fmt::format("#define Ti_NUM_EARGS {}\n\n",
+                     taichi_max_num_args * taichi_max_num_indices)
+      << "/* Points |ctx| to the buffers of the caller. |root| must be zeroed\n"
+      << "   and hold sizeof(struct Ti_S0root) bytes, |gtmp| Ti_GTMP_SIZE\n"
+      << "   bytes, |args| Ti_NUM_ARGS entries and |earg| Ti_NUM_EARGS. */\n"
+      << "void Ti_init_context(struct Ti_Context *ctx, struct Ti_S0root *root,\n"
+      << "                     Ti_i8 *gtmp, union Ti_BitCast *args, int *earg);\n"
+      << "\n";
+  for (auto const &ker : kernels) {
+    hdr << fmt::format("void Tk_{}(struct Ti_Context *ti_ctx);\n",
+                       ker->get_name());
+  }
+  hdr << "\n/* The kernels above, by name. */\n"
+      << "extern const int Ti_num_kernels;\n"
+      << "extern const char *const Ti_kernel_names[];\n"
+      << "extern void (*const Ti_kernels[])(struct Ti_Context *);\n"
+      << "\n#ifdef __cplusplus\n}\n#endif\n\n#endif\n";
+
+  std::ofstream src(source_path);
+  TI_ERROR_IF(!src, "[cc] cannot open {}", source_path);
+  src << fmt::format("#include \"{}\"\n\n", header_name) << runtime->source
+      << "\n"
+      << "void Ti_init_context(struct Ti_Context *ctx, struct Ti_S0root *root,\n"
+      << "                     Ti_i8 *gtmp, union Ti_BitCast *args, int *earg) {\n"
+      << "  ctx->root = root;\n"
+      << "  ctx->gtmp = gtmp;\n"
+      << "  ctx->args = args;\n"
+      << "  ctx->earg = earg;\n"
+      << "}\n\n";
+  for (auto const &ker : kernels) {
+    src << ker->get_source() << "\n";
+  }
+  // A zero-length array is not valid C.
+  src << fmt::format("const int Ti_num_kernels = {};\n", kernels.size())
+      << "const char *const Ti_kernel_names[] = {\n";
+  for (auto const &ker : kernels) {
+    src << fmt::format("  \"{}\",\n", ker->get_name());
+  }
+  src << "  0,\n};\n"
+      << "void (*const Ti_kernels[])(struct Ti_Context *) = {\n";
+  for (auto const &ker : kernels) {
+    src << fmt::format("  Tk_{},\n", ker->get_name());
+  }
+  src << "  0,\n};\n";
+  TI_INFO("[cc] exported {} kernels to {} and {}", kernels.size(),
+          source_path, header_path);
 }
 
 void CCProgram::compile_layout(SNode *root) {
@@ -149,6 +255,7 @@ void CCProgram::compile_layout(SNode *root) {
 }
 
 void CCProgram::add_kernel(std::unique_ptr<CCKernel> kernel) {
+  pending_kernels.push_back(kernel.get());
   kernels.push_back(std::move(kernel));
   need_relink = true;
 }
@@ -163,10 +270,23 @@ void CCProgram::init_runtime() {
 }
 
 CCFuncEntryType *CCProgram::load_kernel(std::string const &name) {
+  if (tcc) {
+    auto iter = kernel_entries.find(name);
+    return iter == kernel_entries.end() ? nullptr : iter->second;
+  }
   return reinterpret_cast<CCFuncEntryType *>(dll->load_function("Tk_" + name));
 }
 
 CCProgram::CCProgram(Program *program) : program(program) {
+  if (!program->config.cc_libtcc.empty()) {
+    tcc = std::make_unique<TCCCompiler>(program->config.cc_libtcc);
+    if (!tcc->loaded()) {
+      TI_WARN("[cc] falling back to cc_compile_cmd");
+      tcc = nullptr;
+    } else if (program->config.cc_openmp) {
+      TI_WARN("[cc] libtcc does not support OpenMP, range-fors run serially");
+    }
+  }
   init_runtime();
 
   context = std::make_unique<CCContext>();
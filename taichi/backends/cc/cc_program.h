@@ -3,6 +3,7 @@
 #include "taichi/lang_util.h"
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 TI_NAMESPACE_BEGIN
 class DynamicLoader;
@@ -18,6 +19,7 @@ namespace cccp {
 class CCKernel;
 class CCLayout;
 class CCRuntime;
+class TCCCompiler;
 struct CCContext;
 
 using CCFuncEntryType = void(CCContext *);
@@ -34,6 +36,12 @@ class CCProgram {
   void init_runtime();
   void relink();
 
+  // Writes the runtime, the layout and all the kernels compiled so far as a
+  // self-contained C library, with a plain C launch API. The caller of the
+  // library allocates the root buffer. See docs/export_kernels.rst.
+  void export_library(std::string const &source_path,
+                      std::string const &header_path);
+
   CCLayout *get_layout() {
     return layout.get();
   }
@@ -42,6 +50,12 @@ class CCProgram {
     return runtime.get();
   }
 
+  // Returns the in-process compiler, or nullptr if the C compiler is run as a
+  // command. See |CompileConfig::cc_libtcc|.
+  TCCCompiler *get_tcc() {
+    return tcc.get();
+  }
+
   CCContext *update_context(Context *ctx);
   void context_to_result_buffer();
 
@@ -52,6 +66,13 @@ class CCProgram {
   std::vector<char> root_buf;
   std::vector<char> gtmp_buf;
   std::vector<std::unique_ptr<CCKernel>> kernels;
+  // The kernels not compiled yet, which relink() compiles in one unit.
+  std::vector<CCKernel *> pending_kernels;
+  // The objects of the compiled units of kernels.
+  std::vector<std::string> kernel_objects;
+  // Only with |tcc|.
+  std::unordered_map<std::string, CCFuncEntryType *> kernel_entries;
+  std::unique_ptr<TCCCompiler> tcc;
   std::unique_ptr<CCContext> context;
   std::unique_ptr<CCRuntime> runtime;
   std::unique_ptr<CCLayout> layout;
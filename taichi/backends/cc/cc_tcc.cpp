@@ -0,0 +1,71 @@
+#include "taichi/common/core.h"
+#include "taichi/system/dynamic_loader.h"
+#include "cc_tcc.h"
+
+TLANG_NAMESPACE_BEGIN
+namespace cccp {
+
+namespace {
+// From libtcc.h
+constexpr int TCC_OUTPUT_MEMORY = 1;
+void *const TCC_RELOCATE_AUTO = (void *)1;
+}  // namespace
+
+TCCCompiler::TCCCompiler(std::string const &libtcc_path) {
+  dll = std::make_unique<DynamicLoader>(libtcc_path);
+  if (!dll->loaded()) {
+    TI_WARN("[cc] could not load libtcc: {}", libtcc_path);
+    return;
+  }
+  dll->load_function("tcc_new", tcc_new);
+  dll->load_function("tcc_delete", tcc_delete);
+  dll->load_function("tcc_set_error_func", tcc_set_error_func);
+  dll->load_function("tcc_set_output_type", tcc_set_output_type);
+  dll->load_function("tcc_add_library", tcc_add_library);
+  dll->load_function("tcc_compile_string", tcc_compile_string);
+  dll->load_function("tcc_relocate", tcc_relocate);
+  dll->load_function("tcc_get_symbol", tcc_get_symbol);
+}
+
+bool TCCCompiler::loaded() const {
+  return dll->loaded();
+}
+
+std::vector<void *> TCCCompiler::compile(
+    std::string const &source,
+    std::vector<std::string> const &symbols) {
+  TI_ASSERT(loaded());
+  auto *state = tcc_new();
+  TI_ASSERT(state);
+  states.push_back(state);
+
+  std::string errors;
+  tcc_set_error_func(state, &errors, [](void *opaque, const char *msg) {
+    *(std::string *)opaque += fmt::format("{}\n", msg);
+  });
+  // Must be set before compiling.
+  tcc_set_output_type(state, TCC_OUTPUT_MEMORY);
+  TI_ERROR_IF(tcc_compile_string(state, source.c_str()) != 0,
+              "[cc] libtcc failed to compile:\n{}", errors);
+  tcc_add_library(state, "m");
+  // libtcc 0.9.28 dropped the second argument, which is then ignored.
+  TI_ERROR_IF(tcc_relocate(state, TCC_RELOCATE_AUTO) < 0,
+              "[cc] libtcc failed to relocate:\n{}", errors);
+
+  std::vector<void *> addresses;
+  for (auto const &symbol : symbols) {
+    auto *address = tcc_get_symbol(state, symbol.c_str());
+    TI_ERROR_IF(!address, "[cc] symbol {} not found", symbol);
+    addresses.push_back(address);
+  }
+  return addresses;
+}
+
+TCCCompiler::~TCCCompiler() {
+  for (auto *state : states) {
+    tcc_delete(state);
+  }
+}
+
+}  // namespace cccp
+TLANG_NAMESPACE_END
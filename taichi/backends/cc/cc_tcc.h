@@ -0,0 +1,46 @@
+#pragma once
+
+#include "taichi/lang_util.h"
+#include <vector>
+#include <memory>
+
+TI_NAMESPACE_BEGIN
+class DynamicLoader;
+TI_NAMESPACE_END
+
+TLANG_NAMESPACE_BEGIN
+namespace cccp {
+
+class TCCCompiler {
+  // Compiles C source code to memory with libtcc, without touching the disk.
+  // libtcc is loaded at runtime, so that it is not needed to build Taichi.
+ public:
+  explicit TCCCompiler(std::string const &libtcc_path);
+  ~TCCCompiler();
+
+  bool loaded() const;
+
+  // Compiles |source|, and returns the addresses of |symbols| in it. The code
+  // stays loaded until the compiler is destroyed.
+  std::vector<void *> compile(std::string const &source,
+                              std::vector<std::string> const &symbols);
+
+ private:
+  struct TCCState;
+  using ErrorFuncType = void(void *, const char *);
+
+  std::unique_ptr<DynamicLoader> dll;
+  std::vector<TCCState *> states;
+
+  TCCState *(*tcc_new)(){nullptr};
+  void (*tcc_delete)(TCCState *){nullptr};
+  void (*tcc_set_error_func)(TCCState *, void *, ErrorFuncType *){nullptr};
+  int (*tcc_set_output_type)(TCCState *, int){nullptr};
+  int (*tcc_add_library)(TCCState *, const char *){nullptr};
+  int (*tcc_compile_string)(TCCState *, const char *){nullptr};
+  int (*tcc_relocate)(TCCState *, void *){nullptr};
+  void *(*tcc_get_symbol)(TCCState *, const char *){nullptr};
+};
+
+}  // namespace cccp
+TLANG_NAMESPACE_END
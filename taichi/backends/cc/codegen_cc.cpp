@@ -2,6 +2,7 @@
 #include "cc_kernel.h"
 #include "cc_layout.h"
 #include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/util/line_appender.h"
@@ -21,12 +22,15 @@ std::string get_node_ptr_name(SNode *snode) {
 
 class CCTransformer : public IRVisitor {
  private:
-  [[maybe_unused]] Kernel *kernel;
+  Kernel *kernel;
   [[maybe_unused]] CCLayout *layout;
 
   LineAppender line_appender;
   LineAppender line_appender_header;
   bool is_top_level{true};
+  // Whether the offload being generated is an OpenMP parallel loop, whose
+  // atomics must be atomic.
+  bool is_parallel_for{false};
   GetRootStmt *root_stmt;
 
  public:
@@ -220,7 +224,7 @@ class CCTransformer : public IRVisitor {
   }
 
   void visit(ExternalFuncCallStmt *stmt) override {
-    TI_ASSERT(!stmt->func);
+    TI_ASSERT(!stmt->func && stmt->runtime_func.empty());
     auto format = stmt->source;
     std::string source;
 
@@ -382,6 +386,21 @@ class CCTransformer : public IRVisitor {
     const auto op = cc_atomic_op_type_symbol(stmt->op_type);
     const auto type = stmt->dest->element_type().ptr_removed();
     auto var = define_var(cc_data_type_name(type), stmt->raw_name());
+    if (is_parallel_for) {
+      emit("{};", var);
+      // OpenMP has no atomic max and min (before 5.1).
+      if (stmt->op_type == AtomicOpType::max ||
+          stmt->op_type == AtomicOpType::min) {
+        emit("#pragma omp critical(Ti_atomic)");
+        emit("{{ {} = *{}; *{} = {}; }}", stmt->raw_name(), dest_ptr, dest_ptr,
+             invoke_libc(op, type, "*{}, {}", dest_ptr, src_name));
+      } else {
+        emit("#pragma omp atomic capture");
+        emit("{{ {} = *{}; *{} {}= {}; }}", stmt->raw_name(), dest_ptr,
+             dest_ptr, op, src_name);
+      }
+      return;
+    }
     emit("{} = *{};", var, dest_ptr);
     if (stmt->op_type == AtomicOpType::max ||
         stmt->op_type == AtomicOpType::min) {
@@ -419,12 +438,32 @@ class CCTransformer : public IRVisitor {
     stmt->body->accept(this);
   }
 
+  // Whether to run the iterations of range-for |stmt| on OpenMP threads. The
+  // variables defined in the loop body are then private to each thread.
+  bool is_parallelizable(OffloadedStmt *stmt) {
+    if (!kernel->program.config.cc_openmp || C90_COMPAT ||
+        stmt->num_cpu_threads <= 1)
+      return false;
+    // Ti_rand_*() share the state of the generator.
+    return irpass::analysis::gather_statements(stmt->body.get(), [](Stmt *s) {
+             return s->is<RandStmt>();
+           }).empty();
+  }
+
+  void emit_parallel_for_pragma(OffloadedStmt *stmt) {
+    emit("#pragma omp parallel for schedule(static) num_threads({})",
+         stmt->num_cpu_threads);
+  }
+
   void generate_range_for_kernel(OffloadedStmt *stmt) {
+    is_parallel_for = is_parallelizable(stmt);
     if (stmt->const_begin && stmt->const_end) {
       ScopedIndent _s(line_appender);
       auto begin_value = stmt->begin_value;
       auto end_value = stmt->end_value;
       auto var = define_var("Ti_i32", stmt->raw_name());
+      if (is_parallel_for)
+        emit_parallel_for_pragma(stmt);
       emit("for ({} = {}; {} < {}; {} += {}) {{", var, begin_value,
            stmt->raw_name(), end_value, stmt->raw_name(), 1 /* stmt->step? */);
       stmt->body->accept(this);
@@ -447,11 +486,14 @@ class CCTransformer : public IRVisitor {
       } else {
         emit("{} = {};", end_var, stmt->end_value);
       }
+      if (is_parallel_for)
+        emit_parallel_for_pragma(stmt);
       emit("for ({} = {}; {} < {}; {} += {}) {{", var, begin_expr,
            stmt->raw_name(), end_expr, stmt->raw_name(), 1 /* stmt->step? */);
       stmt->body->accept(this);
       emit("}}");
     }
+    is_parallel_for = false;
   }
 
   void visit(OffloadedStmt *stmt) override {
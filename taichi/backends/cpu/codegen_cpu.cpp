@@ -1,13 +1,17 @@
 #include "taichi/backends/cpu/codegen_cpu.h"
 
+#include <algorithm>
+
 #include "taichi/codegen/codegen_llvm.h"
 #include "taichi/common/core.h"
 #include "taichi/util/io.h"
 #include "taichi/lang_util.h"
 #include "taichi/program/program.h"
 #include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
 #include "taichi/ir/statements.h"
 #include "taichi/util/statistics.h"
+#include "taichi/math/arithmetic.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -50,11 +54,126 @@ class CodeGenLLVMCPU : public CodeGenLLVM {
     llvm::Value *epilogue = create_xlogue(stmt->tls_epilogue);
 
     auto [begin, end] = get_range_for_bounds(stmt);
+    auto [block_dim, min_block_dim] = get_block_dims(stmt);
+    auto max_num_partials = tlctx->get_constant(get_max_num_partials(stmt));
+    if (step == 1 && prog->config.cpu_vectorize) {
+      // Iterations only depend on each other through the thread-local storage.
+      auto *block_body =
+          create_block_loop(body, /*parallel=*/stmt->tls_prologue == nullptr);
+      create_call(
+          "cpu_parallel_range_for_blocks",
+          {get_arg(0), tlctx->get_constant(stmt->num_cpu_threads), begin, end,
+           tlctx->get_constant(block_dim), tlctx->get_constant(min_block_dim),
+           max_num_partials, tls_prologue, block_body, epilogue,
+           tlctx->get_constant(stmt->tls_size)});
+      return;
+    }
     create_call(
         "cpu_parallel_range_for",
         {get_arg(0), tlctx->get_constant(stmt->num_cpu_threads), begin, end,
-         tlctx->get_constant(step), tlctx->get_constant(stmt->block_dim),
-         tls_prologue, body, epilogue, tlctx->get_constant(stmt->tls_size)});
+         tlctx->get_constant(step), tlctx->get_constant(block_dim),
+         tlctx->get_constant(min_block_dim), max_num_partials, tls_prologue,
+         body, epilogue,
+         tlctx->get_constant(stmt->tls_size)});
+  }
+
+  // Returns the max_num_partials of cpu_parallel_range_for(): 0 unless the
+  // reductions in the TLS epilogue are to be deterministic. The TLS buffers of
+  // all the blocks are then kept on the stack of the launching thread.
+  int get_max_num_partials(OffloadedStmt *stmt) {
+    if (!prog->config.deterministic_reduction || !stmt->tls_epilogue)
+      return 0;
+    constexpr int kMaxNumPartials = 1024;
+    constexpr std::size_t kMaxPartialsBytes = 256 * 1024;
+    const auto tls_stride = iroundup(stmt->tls_size, (std::size_t)8);
+    return (int)std::clamp(kMaxPartialsBytes / tls_stride, (std::size_t)1,
+                           (std::size_t)kMaxNumPartials);
+  }
+
+  // Returns the block_dim and min_block_dim of cpu_parallel_range_for(). With
+  // |cpu_block_dim_by_cost|, the loops without a block_dim hint get the
+  // adaptive block_dim, with blocks large enough to amortize scheduling them.
+  std::pair<int, int> get_block_dims(OffloadedStmt *stmt) {
+    const auto &config = prog->config;
+    if (!config.cpu_block_dim_by_cost ||
+        stmt->block_dim != config.default_cpu_block_dim) {
+      return {stmt->block_dim, 1};
+    }
+    // The estimated cost of a block, compared to the overhead of scheduling
+    // it on the thread pool.
+    constexpr int64 kMinBlockCost = 4096;
+    const auto cost = irpass::analysis::estimate_iteration_cost(stmt);
+    const int min_block_dim =
+        (int)std::clamp((kMinBlockCost + cost - 1) / cost, (int64)1,
+                        (int64)kMinBlockCost);
+    TI_TRACE("Range-for {}: {} per iteration, at least {} iterations per block",
+             stmt->id, cost, min_block_dim);
+    return {0, min_block_dim};
+  }
+
+  // Creates a function that calls |body| on the iterations [begin, end). The
+  // loop is marked for the LLVM loop vectorizer, with masked tail iterations.
+  // If |parallel|, the memory accesses of different iterations are independent.
+  llvm::Function *create_block_loop(llvm::Function *body, bool parallel) {
+    auto *i32 = tlctx->get_data_type<int>();
+    auto *function_type = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(*llvm_context),
+        {llvm::PointerType::get(get_runtime_type("Context"), 0),
+         llvm::Type::getInt8PtrTy(*llvm_context), i32, i32},
+        false);
+    auto *block_loop = llvm::Function::Create(
+        function_type, llvm::Function::InternalLinkage,
+        func->getName() + "_block", module.get());
+    body->addFnAttr(llvm::Attribute::AlwaysInline);
+    // Only the iterations access the TLS buffer, so that LLVM can keep TLS
+    // reductions in registers and vectorize them with horizontal adds.
+    block_loop->addParamAttr(1, llvm::Attribute::NoAlias);
+
+    auto args = block_loop->arg_begin();
+    llvm::Value *context = args++, *tls = args++, *begin = args++,
+                *end = args++;
+    auto *entry_bb =
+        llvm::BasicBlock::Create(*llvm_context, "entry", block_loop);
+    auto *loop_bb = llvm::BasicBlock::Create(*llvm_context, "loop", block_loop);
+    auto *exit_bb = llvm::BasicBlock::Create(*llvm_context, "exit", block_loop);
+
+    llvm::IRBuilder<> loop_builder(entry_bb);
+    loop_builder.CreateCondBr(loop_builder.CreateICmpSLT(begin, end), loop_bb,
+                              exit_bb);
+    loop_builder.SetInsertPoint(loop_bb);
+    auto *i = loop_builder.CreatePHI(i32, 2);
+    i->addIncoming(begin, entry_bb);
+    auto *call = loop_builder.CreateCall(body, {context, tls, i});
+    auto *next = loop_builder.CreateNSWAdd(i, tlctx->get_constant(1));
+    i->addIncoming(next, loop_bb);
+    auto *latch = loop_builder.CreateCondBr(
+        loop_builder.CreateICmpSLT(next, end), loop_bb, exit_bb);
+    loop_builder.SetInsertPoint(exit_bb);
+    loop_builder.CreateRetVoid();
+
+    auto get_property = [&](const char *name, llvm::Metadata *value) {
+      return llvm::MDNode::get(
+          *llvm_context, {llvm::MDString::get(*llvm_context, name), value});
+    };
+    auto *md_true = llvm::ConstantAsMetadata::get(
+        llvm::ConstantInt::getTrue(*llvm_context));
+    auto placeholder = llvm::MDNode::getTemporary(*llvm_context, llvm::None);
+    std::vector<llvm::Metadata *> loop_properties = {
+        placeholder.get(),
+        get_property("llvm.loop.vectorize.enable", md_true),
+        get_property("llvm.loop.vectorize.predicate.enable", md_true)};
+    if (parallel) {
+      // The inliner propagates the access group to the memory accesses of
+      // |body|.
+      auto *access_group = llvm::MDNode::getDistinct(*llvm_context, {});
+      call->setMetadata(llvm::LLVMContext::MD_access_group, access_group);
+      loop_properties.push_back(
+          get_property("llvm.loop.parallel_accesses", access_group));
+    }
+    auto *loop_id = llvm::MDNode::getDistinct(*llvm_context, loop_properties);
+    loop_id->replaceOperandWith(0, loop_id);
+    latch->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+    return block_loop;
   }
 
   void visit(OffloadedStmt *stmt) override {
@@ -93,6 +212,10 @@ class CodeGenLLVMCPU : public CodeGenLLVM {
   }
 
   void visit(ExternalFuncCallStmt *stmt) override {
+    if (!stmt->runtime_func.empty()) {
+      CodeGenLLVM::visit(stmt);
+      return;
+    }
     std::vector<llvm::Type *> arg_types;
     std::vector<llvm::Value *> arg_values;
 
@@ -122,7 +245,28 @@ class CodeGenLLVMCPU : public CodeGenLLVM {
 
 FunctionType CodeGenCPU::codegen() {
   TI_AUTO_PROF
-  return CodeGenLLVMCPU(kernel, ir).gen();
+  std::string cache_key, task_key;
+  std::vector<OffloadedTask> cached_tasks;
+  JITModule *cached_module = nullptr;
+  if (CodeGenLLVM::load_from_offline_cache(kernel, ir, &cache_key, &task_key,
+                                           &cached_tasks, &cached_module)) {
+    return CodeGenLLVM::make_executable(kernel->name + "_kernel",
+                                        std::move(cached_tasks), cached_module);
+  }
+  CodeGenLLVMCPU gen(kernel, ir);
+  gen.offline_cache_key = cache_key;
+  gen.task_cache_key = task_key;
+  return gen.gen();
+}
+
+FunctionType CodeGenCPU::load_executable(
+    Kernel *kernel,
+    const LlvmOfflineCache::KernelCacheData &data) {
+  std::vector<OffloadedTask> tasks;
+  JITModule *jit_module = nullptr;
+  CodeGenLLVM::load_compiled(kernel, data, &tasks, &jit_module);
+  return CodeGenLLVM::make_executable(kernel->name + "_kernel",
+                                      std::move(tasks), jit_module);
 }
 
 TLANG_NAMESPACE_END
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "taichi/codegen/codegen.h"
+#include "taichi/llvm/llvm_offline_cache.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -12,6 +13,11 @@ class CodeGenCPU : public KernelCodeGen {
   }
 
   virtual FunctionType codegen() override;
+
+  // Wraps a kernel compiled earlier, e.g. loaded from an AOT module.
+  static FunctionType load_executable(
+      Kernel *kernel,
+      const LlvmOfflineCache::KernelCacheData &data);
 };
 
 TLANG_NAMESPACE_END
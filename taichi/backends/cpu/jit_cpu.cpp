@@ -19,9 +19,15 @@
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/raw_ostream.h"
@@ -45,6 +51,56 @@ using namespace llvm::orc;
 
 class JITSessionCPU;
 
+namespace {
+
+// The ISA extensions (e.g. AVX2, AVX-512 or NEON) of the host CPU, so that the
+// loop vectorizer targets the widest vectors available.
+std::string get_host_cpu_features() {
+  SubtargetFeatures features;
+  StringMap<bool> host_features;
+  if (sys::getHostCPUFeatures(host_features)) {
+    for (auto &feature : host_features) {
+      features.AddFeature(feature.first(), feature.second);
+    }
+  }
+  return features.getString();
+}
+
+// Collects the remarks of the loop vectorizer on a module.
+class VectorizationReport : public DiagnosticHandler {
+ public:
+  bool isAnalysisRemarkEnabled(StringRef pass_name) const override {
+    return pass_name == kPassName;
+  }
+
+  bool isMissedOptRemarkEnabled(StringRef pass_name) const override {
+    return pass_name == kPassName;
+  }
+
+  bool isPassedOptRemarkEnabled(StringRef pass_name) const override {
+    return pass_name == kPassName;
+  }
+
+  bool handleDiagnostics(const DiagnosticInfo &info) override {
+    auto remark = dyn_cast<DiagnosticInfoOptimizationBase>(&info);
+    if (!remark || remark->getPassName() != kPassName)
+      return false;
+    auto message = remark->getMsg();
+    if (!message.empty()) {
+      auto function = remark->getFunction().getName().str();
+      lines.push_back(fmt::format("{}: {}", function, message));
+    }
+    return true;
+  }
+
+  std::vector<std::string> lines;
+
+ private:
+  static constexpr const char *kPassName = "loop-vectorize";
+};
+
+}  // namespace
+
 class JITModuleCPU : public JITModule {
  private:
   JITSessionCPU *session;
@@ -106,24 +162,40 @@ class JITSessionCPU : public JITSession {
   }
 
   JITModule *add_module(std::unique_ptr<llvm::Module> M) override {
+    return add_module_at_opt_level(std::move(M), /*opt_level=*/3);
+  }
+
+  JITModule *add_module_at_opt_level(std::unique_ptr<llvm::Module> M,
+                                     int opt_level) override {
+    TI_ASSERT(M);
+    global_optimize_module_cpu(M, opt_level);
+    return add_optimized_module(std::move(M));
+  }
+
+  std::string compile_module_to_binary(
+      std::unique_ptr<llvm::Module> M) override {
     TI_ASSERT(M);
     global_optimize_module_cpu(M);
-    std::lock_guard<std::mutex> _(mut);
-    auto &dylib = ES.createJITDylib(fmt::format("{}", module_counter));
-    dylib.addGenerator(
-        cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
-            DL.getGlobalPrefix())));
-    auto *thread_safe_context = get_current_program()
-                                    .get_llvm_context(host_arch())
-                                    ->get_this_thread_thread_safe_context();
-    cantFail(compile_layer.add(dylib, llvm::orc::ThreadSafeModule(
-                                          std::move(M), *thread_safe_context)));
-    all_libs.push_back(&dylib);
-    auto new_module = std::make_unique<JITModuleCPU>(this, &dylib);
-    auto new_module_raw_ptr = new_module.get();
-    modules.push_back(std::move(new_module));
-    module_counter++;
-    return new_module_raw_ptr;
+    std::string bitcode;
+    {
+      // Use a scope to make sure sos flushes on destruction
+      llvm::raw_string_ostream sos(bitcode);
+      llvm::WriteBitcodeToFile(*M, sos);
+    }
+    return bitcode;
+  }
+
+  JITModule *add_module_from_binary(const std::string &binary) override {
+    auto *ctx = get_current_program()
+                    .get_llvm_context(host_arch())
+                    ->get_this_thread_context();
+    auto M = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(binary, "offline_cache_bitcode"), *ctx);
+    if (!M) {
+      TI_ERROR("Failed to parse cached kernel bitcode: {}",
+               llvm::toString(M.takeError()));
+    }
+    return add_optimized_module(std::move(M.get()));
   }
 
   void *lookup(const std::string Name) override {
@@ -151,7 +223,27 @@ class JITSessionCPU : public JITSession {
   }
 
  private:
-  static void global_optimize_module_cpu(std::unique_ptr<llvm::Module> &module);
+  static void global_optimize_module_cpu(std::unique_ptr<llvm::Module> &module,
+                                         int opt_level = 3);
+
+  JITModule *add_optimized_module(std::unique_ptr<llvm::Module> M) {
+    std::lock_guard<std::mutex> _(mut);
+    auto &dylib = ES.createJITDylib(fmt::format("{}", module_counter));
+    dylib.addGenerator(
+        cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            DL.getGlobalPrefix())));
+    auto *thread_safe_context = get_current_program()
+                                    .get_llvm_context(host_arch())
+                                    ->get_this_thread_thread_safe_context();
+    cantFail(compile_layer.add(dylib, llvm::orc::ThreadSafeModule(
+                                          std::move(M), *thread_safe_context)));
+    all_libs.push_back(&dylib);
+    auto new_module = std::make_unique<JITModuleCPU>(this, &dylib);
+    auto new_module_raw_ptr = new_module.get();
+    modules.push_back(std::move(new_module));
+    module_counter++;
+    return new_module_raw_ptr;
+  }
 };
 
 void *JITModuleCPU::lookup_function(const std::string &name) {
@@ -159,8 +251,10 @@ void *JITModuleCPU::lookup_function(const std::string &name) {
 }
 
 void JITSessionCPU::global_optimize_module_cpu(
-    std::unique_ptr<llvm::Module> &module) {
+    std::unique_ptr<llvm::Module> &module,
+    int opt_level) {
   TI_AUTO_PROF
+  TI_ASSERT(1 <= opt_level && opt_level <= 3);
   if (llvm::verifyModule(*module, &llvm::errs())) {
     module->print(llvm::errs(), nullptr);
     TI_ERROR("Module broken");
@@ -179,18 +273,7 @@ void JITSessionCPU::global_optimize_module_cpu(
 
   TargetOptions options;
   options.PrintMachineCode = false;
-  bool fast_math = get_current_program().config.fast_math;
-  if (fast_math) {
-    options.AllowFPOpFusion = FPOpFusion::Fast;
-    options.UnsafeFPMath = 1;
-    options.NoInfsFPMath = 1;
-    options.NoNaNsFPMath = 1;
-  } else {
-    options.AllowFPOpFusion = FPOpFusion::Strict;
-    options.UnsafeFPMath = 0;
-    options.NoInfsFPMath = 0;
-    options.NoNaNsFPMath = 0;
-  }
+  set_float_options(module.get(), options);
   options.HonorSignDependentRoundingFPMathOption = false;
   options.NoZerosInBSS = false;
   options.GuaranteedTailCallOpt = false;
@@ -201,8 +284,9 @@ void JITSessionCPU::global_optimize_module_cpu(
 
   llvm::StringRef mcpu = llvm::sys::getHostCPUName();
   std::unique_ptr<TargetMachine> target_machine(target->createTargetMachine(
-      triple.str(), mcpu.str(), "", options, llvm::Reloc::PIC_,
-      llvm::CodeModel::Small, CodeGenOpt::Aggressive));
+      triple.str(), mcpu.str(), get_host_cpu_features(), options,
+      llvm::Reloc::PIC_, llvm::CodeModel::Small,
+      opt_level == 3 ? CodeGenOpt::Aggressive : CodeGenOpt::Less));
 
   TI_ERROR_UNLESS(target_machine.get(), "Could not allocate target machine!");
 
@@ -214,13 +298,23 @@ void JITSessionCPU::global_optimize_module_cpu(
       target_machine->getTargetIRAnalysis()));
 
   PassManagerBuilder b;
-  b.OptLevel = 3;
+  b.OptLevel = opt_level;
   b.Inliner = createFunctionInliningPass(b.OptLevel, 0, false);
-  b.LoopVectorize = true;
-  b.SLPVectorize = true;
+  b.LoopVectorize = opt_level >= 2;
+  b.SLPVectorize = opt_level >= 2;
 
   target_machine->adjustPassManager(b);
 
+  VectorizationReport *report = nullptr;
+  std::unique_ptr<DiagnosticHandler> diagnostic_handler;
+  if (get_current_program().config.print_vectorization_report) {
+    auto &context = module->getContext();
+    diagnostic_handler = context.getDiagnosticHandler();
+    auto new_handler = std::make_unique<VectorizationReport>();
+    report = new_handler.get();
+    context.setDiagnosticHandler(std::move(new_handler));
+  }
+
   b.populateFunctionPassManager(function_pass_manager);
   b.populateModulePassManager(module_pass_manager);
 
@@ -238,6 +332,14 @@ void JITSessionCPU::global_optimize_module_cpu(
     module_pass_manager.run(*module);
   }
 
+  if (report) {
+    TI_INFO("Vectorization report:");
+    for (auto &line : report->lines) {
+      TI_INFO("  {}", line);
+    }
+    module->getContext().setDiagnosticHandler(std::move(diagnostic_handler));
+  }
+
   if (get_current_program().config.print_kernel_llvm_ir_optimized) {
     if (false) {
       TI_INFO("Functions with > 100 instructions in optimized LLVM IR:");
@@ -1,17 +1,24 @@
 #include "codegen_cuda.h"
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <set>
+#include <unordered_map>
 
 #include "taichi/common/core.h"
 #include "taichi/util/io.h"
 #include "taichi/util/statistics.h"
+#include "taichi/math/arithmetic.h"
+#include "taichi/ir/analysis.h"
 #include "taichi/ir/ir.h"
 #include "taichi/ir/statements.h"
 #include "taichi/program/program.h"
 #include "taichi/lang_util.h"
 #include "taichi/backends/cuda/cuda_driver.h"
 #include "taichi/backends/cuda/cuda_context.h"
+#include "taichi/backends/cuda/cuda_graph.h"
+#include "taichi/backends/cuda/cuda_block_dim_tuner.h"
 #include "taichi/codegen/codegen_llvm.h"
 
 TLANG_NAMESPACE_BEGIN
@@ -25,26 +32,150 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
  public:
   using IRVisitor::visit;
 
+  // Set while emitting the TLS epilogue of a range-for, see
+  // emit_warp_reduce_add().
+  bool in_range_for_tls_epilogue{false};
+  // Whether the current offloaded task writes any external array.
+  bool offload_writes_ext_arrays{false};
+  // The tasks that can run in a persistent kernel, and whether they are
+  // serial, see fuse_persistent_tasks().
+  std::unordered_map<std::string, bool> persistent_candidates;
+
   CodeGenLLVMCUDA(Kernel *kernel, IRNode *ir = nullptr)
       : CodeGenLLVM(kernel, ir) {
   }
 
   FunctionType compile_module_to_executable() override {
 #ifdef TI_WITH_CUDA
+    fuse_persistent_tasks();
     eliminate_unused_functions();
 
-    auto offloaded_local = offloaded_tasks;
-    for (auto &task : offloaded_local) {
+    for (auto &task : offloaded_tasks) {
       llvm::Function *func = module->getFunction(task.name);
       TI_ASSERT(func);
-      tlctx->mark_function_as_cuda_kernel(func, task.block_dim);
+      // No launch bounds for the tasks to tune, so that all the candidates
+      // can be launched.
+      tlctx->mark_function_as_cuda_kernel(
+          func, task.tune_block_dim ? 0 : task.block_dim,
+          prog->config.cuda_min_blocks_per_sm,
+          prog->config.cuda_max_registers);
+    }
+
+    auto cuda_module = add_module_to_jit();
+    return make_cuda_executable(kernel, offloaded_tasks, cuda_module,
+                                offline_cache_key);
+#else
+    TI_ERROR("No CUDA");
+    return nullptr;
+#endif  // TI_WITH_CUDA
+  }
+
+  // Replaces each run of consecutive candidate tasks with a persistent kernel,
+  // which calls them one after another with a grid barrier in between. Only
+  // thread 0 runs the serial tasks, and the range-fors iterate with a
+  // grid-stride loop, so they are correct under the launch dimensions of the
+  // persistent kernel.
+  void fuse_persistent_tasks() {
+#ifdef TI_WITH_CUDA
+    if (persistent_candidates.empty() ||
+        !CUDAContext::get_instance().supports_cooperative_launch()) {
+      return;
     }
+    std::vector<OffloadedTask> tasks;
+    for (int i = 0; i < (int)offloaded_tasks.size();) {
+      int j = i;
+      while (j < (int)offloaded_tasks.size() &&
+             persistent_candidates.count(offloaded_tasks[j].name)) {
+        j++;
+      }
+      if (j - i < 2) {
+        tasks.push_back(offloaded_tasks[i]);
+        i++;
+        continue;
+      }
+      tasks.push_back(create_persistent_task(i, j));
+      i = j;
+    }
+    offloaded_tasks = std::move(tasks);
+#endif
+  }
 
-    auto jit = kernel->program.llvm_context_device->jit.get();
-    auto cuda_module = jit->add_module(std::move(module));
+  // Returns the persistent kernel running offloaded_tasks[begin, end).
+  OffloadedTask create_persistent_task(int begin, int end) {
+    OffloadedTask task(this);
+    task.begin(fmt::format("{}_{}_persistent", kernel_name, task_counter++));
+    task.persistent = true;
+    task.grid_dim = 1;
+    task.block_dim = 1;
+    func = llvm::Function::Create(task_function_type,
+                                  llvm::Function::ExternalLinkage, task.name,
+                                  module.get());
+    func->addParamAttr(0, llvm::Attribute::ByVal);
+    builder->SetInsertPoint(
+        llvm::BasicBlock::Create(*llvm_context, "entry", func));
+    auto context = get_context();
+    for (int i = begin; i < end; i++) {
+      const auto &stage = offloaded_tasks[i];
+      task.grid_dim = std::max(task.grid_dim, stage.grid_dim);
+      task.block_dim = std::max(task.block_dim, stage.block_dim);
+      task.shmem_bytes = std::max(task.shmem_bytes, stage.shmem_bytes);
+      task.root_children.insert(task.root_children.end(),
+                                stage.root_children.begin(),
+                                stage.root_children.end());
+      if (i > begin) {
+        create_call("grid_barrier", {get_runtime()});
+      }
+      auto stage_func = module->getFunction(stage.name);
+      TI_ASSERT(stage_func);
+      stage_func->addFnAttr(llvm::Attribute::AlwaysInline);
+      llvm::BasicBlock *after_stage = nullptr;
+      if (persistent_candidates[stage.name]) {
+        auto run_stage =
+            llvm::BasicBlock::Create(*llvm_context, "serial_stage", func);
+        after_stage =
+            llvm::BasicBlock::Create(*llvm_context, "after_serial_stage", func);
+        auto is_first_thread = builder->CreateICmpEQ(
+            create_call("linear_thread_idx"), tlctx->get_constant(0));
+        builder->CreateCondBr(is_first_thread, run_stage, after_stage);
+        builder->SetInsertPoint(run_stage);
+      }
+      auto call = builder->CreateCall(stage_func, {context});
+      call->addParamAttr(0, llvm::Attribute::ByVal);
+      if (after_stage) {
+        builder->CreateBr(after_stage);
+        builder->SetInsertPoint(after_stage);
+      }
+    }
+    builder->CreateRetVoid();
+    std::sort(task.root_children.begin(), task.root_children.end());
+    task.root_children.erase(
+        std::unique(task.root_children.begin(), task.root_children.end()),
+        task.root_children.end());
+    return task;
+  }
 
-    return [offloaded_local, cuda_module,
-            kernel = this->kernel](Context &context) {
+  // |cache_key| is the offline cache entry of the kernel, if any, which the
+  // tuned launch dimensions are stored into.
+  static FunctionType make_cuda_executable(
+      Kernel *kernel,
+      std::vector<OffloadedTask> offloaded_local,
+      JITModule *cuda_module,
+      const std::string &cache_key = "") {
+#ifdef TI_WITH_CUDA
+    std::shared_ptr<CUDABlockDimTuner> tuner;
+    if (std::any_of(offloaded_local.begin(), offloaded_local.end(),
+                    [](const OffloadedTask &t) { return t.tune_block_dim; })) {
+      std::vector<LlvmOfflineCache::TaskInfo> tasks;
+      for (const auto &task : offloaded_local) {
+        tasks.push_back(LlvmOfflineCache::TaskInfo{
+            task.name, task.block_dim, task.grid_dim, task.shmem_bytes,
+            task.root_children, task.tune_block_dim, task.streamed,
+            task.range_begin, task.range_end, task.persistent});
+      }
+      tuner = std::make_shared<CUDABlockDimTuner>(&kernel->program, tasks,
+                                                  cache_key);
+    }
+    return [offloaded_local, cuda_module, kernel, tuner](Context &context) {
       // copy data to GRAM
       CUDAContext::get_instance().make_current();
       auto args = kernel->args;
@@ -57,11 +188,39 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
       // sake of decoupling, let's not do that and explicitly set the context we
       // want to modify.
       Kernel::LaunchContextBuilder ctx_builder(kernel, &context);
+      // When recording into a CUDA graph, the tasks do not run until the graph
+      // is launched.
+      const bool in_graph = (CUDAGraph::get_active() != nullptr);
+      TI_ERROR_IF(in_graph && !kernel->rets.empty(),
+                  "Kernel {} returns a value and cannot be recorded into a "
+                  "CUDA graph",
+                  kernel->name);
+      TI_ERROR_IF(in_graph && std::any_of(offloaded_local.begin(),
+                                          offloaded_local.end(),
+                                          [](const OffloadedTask &t) {
+                                            return t.persistent;
+                                          }),
+                  "Kernel {} runs a persistent kernel and cannot be recorded "
+                  "into a CUDA graph. Consider "
+                  "ti.init(cuda_persistent_kernels=False).",
+                  kernel->name);
       for (int i = 0; i < (int)args.size(); i++) {
         if (args[i].is_nparray) {
-          has_buffer = true;
           // replace host buffer with device buffer
           host_buffers[i] = context.get_arg<void *>(i);
+          if (kernel->program.is_external_array(host_buffers[i],
+                                                args[i].size) ||
+              kernel->program.is_device_array(host_buffers[i],
+                                              args[i].size)) {
+            // Managed memory, which is directly accessible on the device.
+            continue;
+          }
+          TI_ERROR_IF(in_graph,
+                      "Kernel {} copies external arrays and cannot be "
+                      "recorded into a CUDA graph. Consider "
+                      "ti.zero_copy_array().",
+                      kernel->name);
+          has_buffer = true;
           if (args[i].size > 0) {
             // Note: both numpy and PyTorch support arrays/tensors with zeros
             // in shapes, e.g., shape=(0) or shape=(100, 0, 200). This makes
@@ -78,18 +237,87 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
         CUDADriver::get_instance().stream_synchronize(nullptr);
       }
 
-      for (auto task : offloaded_local) {
-        TI_TRACE("Launching kernel {}<<<{}, {}>>>", task.name, task.grid_dim,
-                 task.block_dim);
-        cuda_module->launch(task.name, task.grid_dim, task.block_dim,
-                            task.shmem_bytes, {&context});
+      // Tasks recorded into a CUDA graph are not timed.
+      const bool tuning = tuner && tuner->active() && !in_graph;
+      // The fields of the later tasks migrate while the first one runs.
+      bool early_prefetches = false;
+      if (!in_graph && offloaded_local.size() > 1) {
+        kernel->program.prefetch_root_children(
+            offloaded_local[0].root_children);
+        std::vector<int> later_root_children;
+        for (int i = 1; i < (int)offloaded_local.size(); i++) {
+          const auto &children = offloaded_local[i].root_children;
+          later_root_children.insert(later_root_children.end(),
+                                     children.begin(), children.end());
+        }
+        early_prefetches =
+            kernel->program.prefetch_root_children_early(later_root_children);
+      }
+      for (int i = 0; i < (int)offloaded_local.size(); i++) {
+        const auto &task = offloaded_local[i];
+        kernel->program.commit_device_memory_if_needed();
+        kernel->program.prefetch_root_children(task.root_children);
+        if (i == 1 && early_prefetches) {
+          kernel->program.wait_for_early_prefetches();
+        }
+        int grid_dim = task.grid_dim, block_dim = task.block_dim;
+        if (tuning) {
+          tuner->begin_launch(i, &grid_dim, &block_dim);
+        } else if (tuner) {
+          tuner->get_launch_dims(i, &grid_dim, &block_dim);
+        }
+        TI_TRACE("Launching kernel {}<<<{}, {}>>>", task.name, grid_dim,
+                 block_dim);
+        if (task.persistent) {
+          cuda_module->launch_cooperative(task.name, grid_dim, block_dim,
+                                          task.shmem_bytes, {&context});
+        } else if (!task.streamed) {
+          cuda_module->launch(task.name, grid_dim, block_dim,
+                              task.shmem_bytes, {&context});
+        } else {
+          // Each tile runs while the next one is prefetched, and is migrated
+          // back to the host after it. Launches recorded into a CUDA graph
+          // run in a single tile, without prefetches.
+          auto &program = kernel->program;
+          const int64 num_iterations =
+              std::max(task.range_end - task.range_begin, 0);
+          const bool streaming = !in_graph;
+          int num_tiles = 1;
+          if (streaming) {
+            num_tiles = (int)std::clamp(
+                (int64)program.get_num_stream_tiles(task.root_children),
+                (int64)1, std::max(num_iterations, (int64)1));
+            program.prefetch_stream_tile(task.root_children, 0, num_tiles);
+          }
+          for (int t = 0; t < num_tiles; t++) {
+            if (streaming && t + 1 < num_tiles) {
+              program.prefetch_stream_tile(task.root_children, t + 1,
+                                           num_tiles);
+            }
+            if (streaming) {
+              program.wait_for_stream_tile(t);
+            }
+            context.range_for_begin =
+                task.range_begin + (int)(num_iterations * t / num_tiles);
+            context.range_for_end =
+                task.range_begin + (int)(num_iterations * (t + 1) / num_tiles);
+            cuda_module->launch(task.name, grid_dim, block_dim,
+                                task.shmem_bytes, {&context});
+            if (streaming) {
+              program.evict_stream_tile(task.root_children, t, num_tiles);
+            }
+          }
+        }
+        if (tuning) {
+          tuner->end_launch(i);
+        }
       }
       // copy data back to host
       if (has_buffer) {
         CUDADriver::get_instance().stream_synchronize(nullptr);
       }
       for (int i = 0; i < (int)args.size(); i++) {
-        if (args[i].is_nparray && args[i].size > 0) {
+        if (device_buffers[i] != nullptr) {
           CUDADriver::get_instance().memcpy_device_to_host(
               host_buffers[i], (void *)device_buffers[i], args[i].size);
           CUDADriver::get_instance().mem_free((void *)device_buffers[i]);
@@ -155,6 +383,28 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
                                llvm::Type::getInt8PtrTy(*llvm_context)));
   }
 
+  void visit(UnaryOpStmt *stmt) override {
+    // The approximate versions in libdevice, see Kernel::approx_math.
+    static const std::unordered_map<UnaryOpType, std::string> approx_funcs = {
+        {UnaryOpType::exp, "__nv_fast_expf"},
+        {UnaryOpType::log, "__nv_fast_logf"},
+        {UnaryOpType::sin, "__nv_fast_sinf"},
+        {UnaryOpType::cos, "__nv_fast_cosf"},
+        {UnaryOpType::tan, "__nv_fast_tanf"},
+        {UnaryOpType::rsqrt, "__nv_rsqrtf"},
+    };
+    if (kernel->approx_math &&
+        stmt->operand->ret_type->is_primitive(PrimitiveTypeID::f32)) {
+      auto it = approx_funcs.find(stmt->op_type);
+      if (it != approx_funcs.end()) {
+        llvm_val[stmt] = builder->CreateCall(get_runtime_function(it->second),
+                                             llvm_val[stmt->operand]);
+        return;
+      }
+    }
+    CodeGenLLVM::visit(stmt);
+  }
+
   void emit_extra_unary(UnaryOpStmt *stmt) override {
     // functions from libdevice
     auto input = llvm_val[stmt->operand];
@@ -222,6 +472,32 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
 #undef UNARY_STD
   }
 
+  // Reduces the contributions of the lanes of a warp to the same address
+  // before the atomic add. Only valid where all the threads of the block add
+  // to the same address. Returns false if the type is not supported.
+  bool emit_warp_reduce_add(AtomicOpStmt *stmt) {
+    auto dst_type = stmt->dest->ret_type->as<PointerType>()->get_pointee_type();
+    if (!dst_type->is<PrimitiveType>())
+      return false;
+    std::string suffix;
+    if (dst_type->is_primitive(PrimitiveTypeID::f32)) {
+      suffix = "f32";
+    } else if (dst_type->is_primitive(PrimitiveTypeID::f64)) {
+      suffix = "f64";
+    } else if (is_integral(dst_type) && data_type_size(dst_type) == 4) {
+      suffix = "i32";
+    } else if (is_integral(dst_type) && data_type_size(dst_type) == 8) {
+      suffix = "i64";
+    } else {
+      return false;
+    }
+    create_call("warp_reduce_add_" + suffix,
+                {llvm_val[stmt->dest], llvm_val[stmt->val]});
+    // The old value is not available, and unused in the TLS epilogue.
+    llvm_val[stmt] = llvm::UndefValue::get(tlctx->get_data_type(dst_type));
+    return true;
+  }
+
   void visit(AtomicOpStmt *stmt) override {
     // https://llvm.org/docs/NVPTXUsage.html#address-spaces
     bool is_local = stmt->dest->is<AllocaStmt>();
@@ -229,6 +505,10 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
       TI_ERROR("Local atomics should have been demoted.");
     }
     TI_ASSERT(stmt->width() == 1);
+    if (in_range_for_tls_epilogue && stmt->op_type == AtomicOpType::add &&
+        emit_warp_reduce_add(stmt)) {
+      return;
+    }
     for (int l = 0; l < stmt->width(); l++) {
       llvm::Value *old_value;
       auto dst_type =
@@ -239,6 +519,8 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
               llvm::AtomicRMWInst::BinOp::Add, llvm_val[stmt->dest],
               llvm_val[stmt->val],
               llvm::AtomicOrdering::SequentiallyConsistent);
+        } else if (dst_type->is_primitive(PrimitiveTypeID::f16)) {
+          old_value = atomic_add_f16(stmt);
         } else if (stmt->val->ret_type->is_primitive(PrimitiveTypeID::f32)) {
           old_value = builder->CreateAtomicRMW(
               llvm::AtomicRMWInst::FAdd, llvm_val[stmt->dest],
@@ -321,8 +603,10 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
   }
 
   void visit(RandStmt *stmt) override {
+    auto generator =
+        prog->config.cuda_philox_rand ? "cuda_philox_rand" : "cuda_rand";
     llvm_val[stmt] = create_call(
-        fmt::format("cuda_rand_{}", data_type_short_name(stmt->ret_type)),
+        fmt::format("{}_{}", generator, data_type_short_name(stmt->ret_type)),
         {get_context()});
   }
 
@@ -347,10 +631,44 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
       body = guard.body;
     }
 
+    // Every thread of the block runs the epilogue, adding its TLS
+    // contribution to the same global address as the others. Deterministic
+    // epilogues run one after the other instead.
+    const bool deterministic =
+        prog->config.deterministic_reduction && stmt->tls_epilogue;
+    in_range_for_tls_epilogue = !deterministic;
     auto epilogue = create_xlogue(stmt->tls_epilogue);
+    in_range_for_tls_epilogue = false;
 
     auto [begin, end] = get_range_for_bounds(stmt);
-    create_call("gpu_parallel_range_for",
+    // The host launches a streamed range-for in tiles of its iterations,
+    // passing each tile in the Context. Deterministic range-fors would not
+    // split their iterations the same way.
+    current_task->streamed =
+        prog->config.use_unified_memory &&
+        prog->config.unified_memory_stream_tile_MB > 0 && stmt->const_begin &&
+        stmt->const_end && !deterministic && !kernel->is_accessor &&
+        !kernel->is_evaluator;
+    if (current_task->streamed) {
+      current_task->range_begin = stmt->begin_value;
+      current_task->range_end = stmt->end_value;
+      begin = create_call("Context_get_range_for_begin", {get_arg(0)});
+      end = create_call("Context_get_range_for_end", {get_arg(0)});
+    }
+    if (!(stmt->const_begin && stmt->const_end)) {
+      // Counts the launches and their iterations.
+      add_profile_count(stmt, 0, tlctx->get_constant((int64)1),
+                        /*once=*/true);
+      auto *num_iterations = builder->CreateSelect(
+          builder->CreateICmpSGT(end, begin), builder->CreateSub(end, begin),
+          tlctx->get_constant(0));
+      add_profile_count(
+          stmt, 1,
+          builder->CreateSExt(num_iterations, tlctx->get_data_type<int64>()),
+          /*once=*/true);
+    }
+    create_call(deterministic ? "gpu_parallel_range_for_deterministic"
+                              : "gpu_parallel_range_for",
                 {get_arg(0), begin, end, tls_prologue, body, epilogue,
                  tlctx->get_constant(stmt->tls_size)});
   }
@@ -391,7 +709,8 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
   }
 
   llvm::Value *create_intrinsic_load(const DataType &dtype,
-                                     llvm::Value *data_ptr) {
+                                     llvm::Value *data_ptr,
+                                     int alignment = 0) {
     auto llvm_dtype = llvm_type(dtype);
     auto llvm_dtype_ptr = llvm::PointerType::get(llvm_type(dtype), 0);
     llvm::Intrinsic::ID intrin;
@@ -402,49 +721,65 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
     }
     return builder->CreateIntrinsic(
         intrin, {llvm_dtype, llvm_dtype_ptr},
-        {data_ptr, tlctx->get_constant(data_type_size(dtype))});
+        {data_ptr, tlctx->get_constant(
+                       std::max(alignment, data_type_size(dtype)))});
+  }
+
+  // Whether the load can go through the read-only data cache, i.e. nothing
+  // writes its address in the current offloaded task: the fields detected
+  // by irpass::detect_read_only() or marked by ti.cache_read_only(), and the
+  // external arrays when no external array is written by the task, since
+  // they may alias.
+  bool is_read_only_load(GlobalLoadStmt *stmt) const {
+    if (auto get_ch = stmt->ptr->cast<GetChStmt>()) {
+      return current_offload->mem_access_opt.has_flag(
+          get_ch->output_snode, SNodeAccessFlag::read_only);
+    }
+    if (stmt->ptr->is<ExternalPtrStmt>()) {
+      return prog->config.detect_read_only && !offload_writes_ext_arrays;
+    }
+    return false;
   }
 
   void visit(GlobalLoadStmt *stmt) override {
-    if (auto get_ch = stmt->ptr->cast<GetChStmt>(); get_ch) {
-      bool should_cache_as_read_only = false;
-      if (current_offload->mem_access_opt.has_flag(
-              get_ch->output_snode, SNodeAccessFlag::read_only)) {
-        should_cache_as_read_only = true;
-      }
-      if (should_cache_as_read_only) {
-        // Issue an CUDA "__ldg" instruction so that data are cached in
-        // the CUDA read-only data cache.
-        auto dtype = stmt->ret_type;
-        if (auto ptr_type = stmt->ptr->ret_type->as<PointerType>();
-            ptr_type->is_bit_pointer()) {
-          auto val_type = ptr_type->get_pointee_type();
-          llvm::Value *data_ptr = nullptr;
-          llvm::Value *bit_offset = nullptr;
-          if (auto cit = val_type->cast<CustomIntType>()) {
-            dtype = cit->get_physical_type();
-          } else if (auto cft = val_type->cast<CustomFloatType>()) {
-            dtype = cft->get_compute_type()
-                        ->as<CustomIntType>()
-                        ->get_physical_type();
-          } else {
-            TI_NOT_IMPLEMENTED;
-          }
-          read_bit_pointer(llvm_val[stmt->ptr], data_ptr, bit_offset);
-          data_ptr = builder->CreateBitCast(data_ptr, llvm_ptr_type(dtype));
-          auto data = create_intrinsic_load(dtype, data_ptr);
-          llvm_val[stmt] = extract_custom_int(data, bit_offset, val_type);
-          if (val_type->is<CustomFloatType>()) {
-            llvm_val[stmt] = reconstruct_custom_float(llvm_val[stmt], val_type);
-          }
-        } else {
-          llvm_val[stmt] = create_intrinsic_load(dtype, llvm_val[stmt->ptr]);
-        }
+    if (!is_read_only_load(stmt)) {
+      CodeGenLLVM::visit(stmt);
+      return;
+    }
+    // Issue an CUDA "__ldg" instruction, i.e. ld.global.nc, so that data are
+    // cached in the CUDA read-only data cache.
+    auto dtype = stmt->ret_type;
+    if (auto ptr_type = stmt->ptr->ret_type->as<PointerType>();
+        ptr_type->is_bit_pointer()) {
+      auto val_type = ptr_type->get_pointee_type();
+      llvm::Value *data_ptr = nullptr;
+      llvm::Value *bit_offset = nullptr;
+      if (auto cit = val_type->cast<CustomIntType>()) {
+        dtype = cit->get_physical_type();
+      } else if (auto cft = val_type->cast<CustomFloatType>()) {
+        dtype =
+            cft->get_compute_type()->as<CustomIntType>()->get_physical_type();
       } else {
-        CodeGenLLVM::visit(stmt);
+        TI_NOT_IMPLEMENTED;
+      }
+      read_bit_pointer(llvm_val[stmt->ptr], data_ptr, bit_offset);
+      data_ptr = builder->CreateBitCast(data_ptr, llvm_ptr_type(dtype));
+      auto data = create_intrinsic_load(dtype, data_ptr);
+      llvm_val[stmt] = extract_custom_int(data, bit_offset, val_type);
+      if (val_type->is<CustomFloatType>()) {
+        llvm_val[stmt] = reconstruct_custom_float(llvm_val[stmt], val_type);
       }
+    } else if (ptr_type->get_pointee_type()->is_primitive(
+                   PrimitiveTypeID::f16)) {
+      // Loads the bits of the half, which __ldg has no variant for.
+      auto bits_ptr = builder->CreateBitCast(llvm_val[stmt->ptr],
+                                             llvm_ptr_type(PrimitiveType::u16));
+      auto bits = create_intrinsic_load(PrimitiveType::u16, bits_ptr);
+      llvm_val[stmt] = f16_to_f32(
+          builder->CreateBitCast(bits, llvm_type(PrimitiveType::f16)));
     } else {
-      CodeGenLLVM::visit(stmt);
+      llvm_val[stmt] = create_intrinsic_load(dtype, llvm_val[stmt->ptr],
+                                             get_access_alignment(stmt->ptr));
     }
   }
 
@@ -465,6 +800,19 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
 #if defined(TI_WITH_CUDA)
     TI_ASSERT(current_offload == nullptr);
     current_offload = stmt;
+    offload_writes_ext_arrays = false;
+    irpass::analysis::gather_statements(stmt, [&](Stmt *s) {
+      Stmt *dest = nullptr;
+      if (auto store = s->cast<GlobalStoreStmt>()) {
+        dest = store->ptr;
+      } else if (auto atomic = s->cast<AtomicOpStmt>()) {
+        dest = atomic->dest;
+      }
+      if (dest && dest->is<ExternalPtrStmt>()) {
+        offload_writes_ext_arrays = true;
+      }
+      return false;
+    });
     using Type = OffloadedStmt::TaskType;
     if (stmt->task_type == Type::gc) {
       // gc has 3 kernels, so we treat it specially
@@ -485,9 +833,51 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
       finalize_offloaded_task_function();
       current_task->grid_dim = stmt->grid_dim;
       current_task->block_dim = stmt->block_dim;
+      const bool deterministic = prog->config.deterministic_reduction &&
+                                 stmt->task_type == Type::range_for &&
+                                 stmt->tls_epilogue;
+      if (auto counts = get_profile_counts(stmt);
+          counts && counts->first > 0 && !deterministic) {
+        // Threads beyond the iterations of a typical launch would idle.
+        const auto average_iterations = counts->second / counts->first;
+        current_task->grid_dim = (int)std::clamp(
+            (int64)((average_iterations + stmt->block_dim - 1) /
+                    stmt->block_dim),
+            (int64)1, (int64)current_task->grid_dim);
+      }
+      if (deterministic) {
+        // One TLS buffer per thread in |reduction_partials|. The last block
+        // runs the epilogues of all the threads serially, so fewer threads
+        // keep that short.
+        constexpr std::size_t kMaxNumPartials = 1 << 16;
+        const auto tls_stride = iroundup(stmt->tls_size, (std::size_t)8);
+        const auto max_num_threads =
+            std::min(kMaxNumPartials,
+                     taichi_deterministic_reduction_buffer_size / tls_stride);
+        current_task->grid_dim = (int)std::clamp(
+            max_num_threads / stmt->block_dim, (std::size_t)1,
+            (std::size_t)current_task->grid_dim);
+      }
       TI_ASSERT(current_task->grid_dim != 0);
       TI_ASSERT(current_task->block_dim != 0);
       current_task->shmem_bytes = stmt->bls_size;
+      // Range-fors iterate with a grid-stride loop, so any launch dimensions
+      // are correct. Those with a block_dim hint are left alone.
+      // Deterministic range-fors keep their launch dimensions, which decide
+      // how the iterations are split into partial sums.
+      current_task->tune_block_dim =
+          prog->config.cuda_auto_tune_block_dim && !deterministic &&
+          stmt->task_type == Type::range_for && stmt->bls_size == 0 &&
+          stmt->block_dim == prog->default_block_dim() &&
+          !kernel->is_accessor && !kernel->is_evaluator;
+      if (prog->config.cuda_persistent_kernels && !deterministic &&
+          (stmt->task_type == Type::range_for ||
+           stmt->task_type == Type::serial) &&
+          stmt->bls_size == 0 && !current_task->streamed &&
+          !kernel->is_accessor && !kernel->is_evaluator) {
+        persistent_candidates[current_task->name] =
+            (stmt->task_type == Type::serial);
+      }
       current_task->end();
       current_task = nullptr;
     }
@@ -497,19 +887,59 @@ class CodeGenLLVMCUDA : public CodeGenLLVM {
 #endif
   }
 
-  void visit(ExternalTensorShapeAlongAxisStmt *stmt) override {
-    const auto arg_id = stmt->arg_id;
-    const auto axis = stmt->axis;
-    llvm_val[stmt] =
-        builder->CreateCall(get_runtime_function("Context_get_extra_args"),
-                            {get_context(), tlctx->get_constant(arg_id),
-                             tlctx->get_constant(axis)});
+  // The context is a by-value kernel parameter, which no thread writes to.
+  // Loading the arguments from it as invariant lets them be hoisted out of
+  // the loops and CSE'd across the stores of the task, so that they stay in
+  // registers read once from the parameter space (ld.param, which is
+  // broadcast to the warp) instead of being reloaded from a local copy.
+  llvm::Value *load_invariant_context_field(
+      const std::vector<llvm::Value *> &indices) {
+    auto ptr = builder->CreateInBoundsGEP(context_ty, get_context(), indices);
+    auto load = builder->CreateLoad(ptr);
+    load->setMetadata(llvm::LLVMContext::MD_invariant_load,
+                      llvm::MDNode::get(*llvm_context, llvm::None));
+    return load;
+  }
+
+  llvm::Value *load_context_arg(int arg_id) override {
+    // Context::args
+    return load_invariant_context_field({tlctx->get_constant(0),
+                                         tlctx->get_constant(1),
+                                         tlctx->get_constant(arg_id)});
+  }
+
+  llvm::Value *load_context_extra_arg(int arg_id, int axis) override {
+    // Context::extra_args
+    return load_invariant_context_field(
+        {tlctx->get_constant(0), tlctx->get_constant(2),
+         tlctx->get_constant(arg_id), tlctx->get_constant(axis)});
   }
 };
 
 FunctionType CodeGenCUDA::codegen() {
   TI_AUTO_PROF
-  return CodeGenLLVMCUDA(kernel, ir).gen();
+  std::string cache_key, task_key;
+  std::vector<OffloadedTask> cached_tasks;
+  JITModule *cached_module = nullptr;
+  if (CodeGenLLVM::load_from_offline_cache(kernel, ir, &cache_key, &task_key,
+                                           &cached_tasks, &cached_module)) {
+    return CodeGenLLVMCUDA::make_cuda_executable(
+        kernel, std::move(cached_tasks), cached_module, cache_key);
+  }
+  CodeGenLLVMCUDA gen(kernel, ir);
+  gen.offline_cache_key = cache_key;
+  gen.task_cache_key = task_key;
+  return gen.gen();
+}
+
+FunctionType CodeGenCUDA::load_executable(
+    Kernel *kernel,
+    const LlvmOfflineCache::KernelCacheData &data) {
+  std::vector<OffloadedTask> tasks;
+  JITModule *jit_module = nullptr;
+  CodeGenLLVM::load_compiled(kernel, data, &tasks, &jit_module);
+  return CodeGenLLVMCUDA::make_cuda_executable(kernel, std::move(tasks),
+                                               jit_module);
 }
 
 TLANG_NAMESPACE_END
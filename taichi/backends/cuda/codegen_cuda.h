@@ -3,6 +3,7 @@
 #pragma once
 
 #include "taichi/codegen/codegen.h"
+#include "taichi/llvm/llvm_offline_cache.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -13,6 +14,11 @@ class CodeGenCUDA : public KernelCodeGen {
   }
 
   virtual FunctionType codegen() override;
+
+  // Wraps a kernel compiled earlier, e.g. loaded from an AOT module.
+  static FunctionType load_executable(
+      Kernel *kernel,
+      const LlvmOfflineCache::KernelCacheData &data);
 };
 
 TLANG_NAMESPACE_END
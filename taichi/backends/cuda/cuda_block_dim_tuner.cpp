@@ -0,0 +1,113 @@
+#include "taichi/backends/cuda/cuda_block_dim_tuner.h"
+
+#include <algorithm>
+
+#include "taichi/backends/cuda/cuda_context.h"
+#include "taichi/backends/cuda/cuda_driver.h"
+#include "taichi/program/program.h"
+
+TLANG_NAMESPACE_BEGIN
+
+CUDABlockDimTuner::CUDABlockDimTuner(
+    Program *program,
+    const std::vector<LlvmOfflineCache::TaskInfo> &tasks,
+    const std::string &cache_key)
+    : program_(program),
+      tasks_(tasks),
+      states_(tasks.size()),
+      cache_key_(cache_key),
+      num_launches_per_candidate_(
+          std::max(program->config.cuda_auto_tune_num_launches, 1)) {
+  const auto &config = program->config;
+  for (int i = 0; i < (int)tasks_.size(); i++) {
+    const auto &task = tasks_[i];
+    if (!task.tune_block_dim)
+      continue;
+    auto &candidates = states_[i].candidates;
+    auto add = [&](int grid_dim, int block_dim) {
+      for (const auto &c : candidates) {
+        if (c.grid_dim == grid_dim && c.block_dim == block_dim)
+          return;
+      }
+      candidates.push_back(Candidate{grid_dim, block_dim});
+    };
+    // The default first, so that it wins ties.
+    add(task.grid_dim, task.block_dim);
+    for (int block_dim = 32; block_dim <= config.max_block_dim;
+         block_dim *= 2) {
+      add(config.saturating_grid_dim, block_dim);
+      // The same number of threads as the default.
+      add(std::clamp((int)((int64)task.grid_dim * task.block_dim / block_dim),
+                     1, config.saturating_grid_dim),
+          block_dim);
+    }
+    num_tuning_++;
+  }
+  if (active()) {
+    auto &driver = CUDADriver::get_instance();
+    driver.event_create(&start_event_, CU_EVENT_DEFAULT);
+    driver.event_create(&stop_event_, CU_EVENT_DEFAULT);
+  }
+}
+
+CUDABlockDimTuner::~CUDABlockDimTuner() {
+  auto &driver = CUDADriver::get_instance();
+  if (start_event_)
+    driver.event_destroy(start_event_);
+  if (stop_event_)
+    driver.event_destroy(stop_event_);
+}
+
+void CUDABlockDimTuner::begin_launch(int i, int *grid_dim, int *block_dim) {
+  const auto &state = states_[i];
+  if (!tasks_[i].tune_block_dim) {
+    get_launch_dims(i, grid_dim, block_dim);
+    return;
+  }
+  const auto &candidate = state.candidates[state.current];
+  *grid_dim = candidate.grid_dim;
+  *block_dim = candidate.block_dim;
+  CUDADriver::get_instance().event_record(start_event_,
+                                          CUDAContext::get_current_stream());
+}
+
+void CUDABlockDimTuner::end_launch(int i) {
+  if (!tasks_[i].tune_block_dim)
+    return;
+  auto &driver = CUDADriver::get_instance();
+  driver.event_record(stop_event_, CUDAContext::get_current_stream());
+  driver.event_synchronize(stop_event_);
+  float ms = 0;
+  driver.event_elapsed_time(&ms, start_event_, stop_event_);
+  auto &state = states_[i];
+  state.candidates[state.current].total_ms += ms;
+  if (++state.num_launches < num_launches_per_candidate_)
+    return;
+  state.num_launches = 0;
+  if (++state.current == (int)state.candidates.size())
+    finish(i);
+}
+
+void CUDABlockDimTuner::finish(int i) {
+  auto &task = tasks_[i];
+  const auto &candidates = states_[i].candidates;
+  auto best = std::min_element(candidates.begin(), candidates.end(),
+                               [](const Candidate &a, const Candidate &b) {
+                                 return a.total_ms < b.total_ms;
+                               });
+  TI_TRACE("Tuned {}: <<<{}, {}>>> ({:.3f} ms), default <<<{}, {}>>> ({:.3f} ms)",
+           task.name, best->grid_dim, best->block_dim,
+           best->total_ms / num_launches_per_candidate_, task.grid_dim,
+           task.block_dim,
+           candidates[0].total_ms / num_launches_per_candidate_);
+  task.grid_dim = best->grid_dim;
+  task.block_dim = best->block_dim;
+  task.tune_block_dim = false;
+  states_[i] = TaskState();
+  if (--num_tuning_ == 0 && !cache_key_.empty()) {
+    if (auto *cache = program_->llvm_offline_cache.get())
+      cache->update_tasks(cache_key_, tasks_);
+  }
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "taichi/llvm/llvm_offline_cache.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Program;
+
+// Tunes the launch dimensions of the offloaded tasks of a CUDA kernel, see
+// CompileConfig::cuda_auto_tune_block_dim.
+//
+// Each task with TaskInfo::tune_block_dim cycles through a few (grid_dim,
+// block_dim) candidates on its first launches, timed with CUDA events, and
+// then keeps the fastest one. With the offline cache, the choices are written
+// back to the cached kernel under |cache_key|, which is then loaded tuned.
+// The launches of a kernel are serialized, so this is not thread-safe.
+class CUDABlockDimTuner {
+ public:
+  CUDABlockDimTuner(Program *program,
+                    const std::vector<LlvmOfflineCache::TaskInfo> &tasks,
+                    const std::string &cache_key);
+  CUDABlockDimTuner(const CUDABlockDimTuner &) = delete;
+  CUDABlockDimTuner &operator=(const CUDABlockDimTuner &) = delete;
+  ~CUDABlockDimTuner();
+
+  // Whether any task is still being tuned.
+  bool active() const {
+    return num_tuning_ > 0;
+  }
+
+  // Returns the launch dimensions of the next launch of the |i|-th task, and
+  // starts timing it if it is being tuned. Must be followed by end_launch(i)
+  // after the launch.
+  void begin_launch(int i, int *grid_dim, int *block_dim);
+
+  void end_launch(int i);
+
+  // Returns the launch dimensions of the |i|-th task without timing it, e.g.
+  // when recording into a CUDA graph. These are the defaults until the task
+  // is tuned.
+  void get_launch_dims(int i, int *grid_dim, int *block_dim) const {
+    *grid_dim = tasks_[i].grid_dim;
+    *block_dim = tasks_[i].block_dim;
+  }
+
+ private:
+  struct Candidate {
+    int grid_dim;
+    int block_dim;
+    float total_ms{0};
+  };
+
+  struct TaskState {
+    std::vector<Candidate> candidates;
+    int current{0};
+    int num_launches{0};
+  };
+
+  void finish(int i);
+
+  Program *program_;
+  std::vector<LlvmOfflineCache::TaskInfo> tasks_;
+  std::vector<TaskState> states_;
+  std::string cache_key_;
+  int num_launches_per_candidate_;
+  int num_tuning_{0};
+  void *start_event_{nullptr};
+  void *stop_event_{nullptr};
+};
+
+TLANG_NAMESPACE_END
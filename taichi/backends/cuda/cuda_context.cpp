@@ -11,6 +11,10 @@
 
 TLANG_NAMESPACE_BEGIN
 
+namespace {
+thread_local void *current_stream = nullptr;
+}  // namespace
+
 CUDAContext::CUDAContext()
     : profiler(nullptr), driver(CUDADriver::get_instance_without_context()) {
   // CUDA initialization
@@ -31,6 +35,31 @@ CUDAContext::CUDAContext()
       &cc_minor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, device);
 
   TI_TRACE("CUDA Device Compute Capability: {}.{}", cc_major, cc_minor);
+  int vmm_supported = 0;
+  // Drivers older than CUDA 10.2 do not know this attribute.
+  if (driver.device_get_attribute.call(
+          &vmm_supported,
+          CU_DEVICE_ATTRIBUTE_VIRTUAL_ADDRESS_MANAGEMENT_SUPPORTED,
+          device) != 0) {
+    vmm_supported = 0;
+  }
+  virtual_memory_supported = (vmm_supported != 0);
+  int cooperative_launch = 0;
+  driver.device_get_attribute(&cooperative_launch,
+                              CU_DEVICE_ATTRIBUTE_COOPERATIVE_LAUNCH, device);
+  cooperative_launch_supported = (cooperative_launch != 0);
+  driver.device_get_attribute(&num_multiprocessors,
+                              CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, device);
+  driver.device_get_attribute(&default_shared_memory_bytes,
+                              CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK,
+                              device);
+  // Only devices of compute capability 7.0 and later know this attribute.
+  if (driver.device_get_attribute.call(
+          &max_shared_memory_bytes,
+          CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN, device) != 0 ||
+      max_shared_memory_bytes < default_shared_memory_bytes) {
+    max_shared_memory_bytes = default_shared_memory_bytes;
+  }
   driver.context_create(&context, 0, device);
 
   const auto GB = std::pow(1024.0, 3.0);
@@ -63,6 +92,75 @@ std::size_t CUDAContext::get_free_memory() {
   return ret;
 }
 
+std::vector<int> CUDAContext::get_peer_devices() {
+  std::vector<int> peers;
+  for (int i = 1; i < dev_count; i++) {
+    void *peer = nullptr;
+    driver.device_get(&peer, (void *)(std::size_t)i);
+    int can_access = 0, vmm_supported = 0;
+    driver.device_can_access_peer(&can_access, device, peer);
+    if (driver.device_get_attribute.call(
+            &vmm_supported,
+            CU_DEVICE_ATTRIBUTE_VIRTUAL_ADDRESS_MANAGEMENT_SUPPORTED,
+            peer) != 0) {
+      vmm_supported = 0;
+    }
+    if (can_access && vmm_supported) {
+      peers.push_back(i);
+    } else {
+      TI_TRACE("CUDA device {} is not accessible as a peer", i);
+    }
+  }
+  return peers;
+}
+
+std::size_t CUDAContext::get_total_memory(int ordinal) {
+  void *dev = nullptr;
+  driver.device_get(&dev, (void *)(std::size_t)ordinal);
+  std::size_t ret = 0;
+  driver.device_total_mem(&ret, dev);
+  return ret;
+}
+
+void *CUDAContext::get_stream(int i) {
+  std::lock_guard<std::mutex> _(lock);
+  while ((int)streams.size() <= i) {
+    void *stream = nullptr;
+    driver.stream_create(&stream, CU_STREAM_DEFAULT);
+    streams.push_back(stream);
+  }
+  return streams[i];
+}
+
+void *CUDAContext::get_event(int i) {
+  std::lock_guard<std::mutex> _(lock);
+  while ((int)events.size() <= i) {
+    void *event = nullptr;
+    driver.event_create(&event, CU_EVENT_DISABLE_TIMING);
+    events.push_back(event);
+  }
+  return events[i];
+}
+
+void CUDAContext::set_current_stream(void *stream) {
+  current_stream = stream;
+}
+
+void *CUDAContext::get_current_stream() {
+  return current_stream;
+}
+
+void CUDAContext::synchronize_streams() {
+  std::vector<void *> streams_copy;
+  {
+    std::lock_guard<std::mutex> _(lock);
+    streams_copy = streams;
+  }
+  for (auto *stream : streams_copy) {
+    driver.stream_synchronize(stream);
+  }
+}
+
 void CUDAContext::launch(void *func,
                          const std::string &task_name,
                          std::vector<void *> arg_pointers,
@@ -89,14 +187,68 @@ void CUDAContext::launch(void *func,
   if (grid_dim > 0) {
     std::lock_guard<std::mutex> _(lock);
     driver.launch_kernel(func, grid_dim, 1, 1, block_dim, 1, 1,
-                         shared_mem_bytes, nullptr, arg_pointers.data(),
+                         shared_mem_bytes, current_stream, arg_pointers.data(),
                          nullptr);
   }
   if (profiler)
     profiler->stop(task_handle);
 
   if (get_current_program().config.debug) {
-    driver.stream_synchronize(nullptr);
+    driver.stream_synchronize(current_stream);
+  }
+}
+
+void CUDAContext::opt_in_shared_memory(void *func, std::size_t bytes) {
+  if (bytes <= (std::size_t)default_shared_memory_bytes)
+    return;
+  TI_ERROR_IF(bytes > (std::size_t)max_shared_memory_bytes,
+              "{} bytes of shared memory per block exceed the {} bytes of the "
+              "device",
+              bytes, max_shared_memory_bytes);
+  std::lock_guard<std::mutex> _(lock);
+  auto &opted_in = shared_memory_opt_ins[func];
+  if (opted_in < bytes) {
+    driver.function_set_attribute(
+        func, CU_FUNC_ATTRIBUTE_MAX_DYNAMIC_SHARED_SIZE_BYTES, (int)bytes);
+    opted_in = bytes;
+  }
+}
+
+void CUDAContext::launch_cooperative(void *func,
+                                     const std::string &task_name,
+                                     std::vector<void *> arg_pointers,
+                                     unsigned grid_dim,
+                                     unsigned block_dim,
+                                     std::size_t shared_mem_bytes) {
+  TI_ASSERT(cooperative_launch_supported);
+  KernelProfilerBase::TaskHandle task_handle;
+  if (profiler)
+    task_handle = profiler->start_with_handle(task_name);
+  auto context_guard = CUDAContext::get_instance().get_guard();
+
+  TI_ASSERT(block_dim <= get_current_program().config.max_block_dim);
+  int blocks_per_multiprocessor = 0;
+  driver.occupancy_max_active_blocks_per_multiprocessor(
+      &blocks_per_multiprocessor, func, block_dim, shared_mem_bytes);
+  TI_ERROR_IF(blocks_per_multiprocessor == 0,
+              "Persistent kernel {} with {} threads per block does not fit on "
+              "the device",
+              task_name, block_dim);
+  const auto max_grid_dim =
+      (unsigned)(blocks_per_multiprocessor * num_multiprocessors);
+  grid_dim = std::min(grid_dim, max_grid_dim);
+
+  if (grid_dim > 0) {
+    std::lock_guard<std::mutex> _(lock);
+    driver.launch_cooperative_kernel(func, grid_dim, 1, 1, block_dim, 1, 1,
+                                     shared_mem_bytes, current_stream,
+                                     arg_pointers.data());
+  }
+  if (profiler)
+    profiler->stop(task_handle);
+
+  if (get_current_program().config.debug) {
+    driver.stream_synchronize(current_stream);
   }
 }
 
@@ -3,6 +3,7 @@
 #include <mutex>
 #include <unordered_map>
 #include <thread>
+#include <vector>
 
 #include "taichi/program/kernel_profiler.h"
 #include "taichi/backends/cuda/cuda_driver.h"
@@ -22,10 +23,22 @@ class CUDAContext {
   void *context;
   int dev_count;
   int compute_capability;
+  bool virtual_memory_supported;
+  bool cooperative_launch_supported;
+  int num_multiprocessors;
+  // The dynamic shared memory per block available without opting in, and
+  // with it (Volta and later).
+  int default_shared_memory_bytes;
+  int max_shared_memory_bytes;
+  // The functions that opted into more than |default_shared_memory_bytes|,
+  // and how much.
+  std::unordered_map<void *, std::size_t> shared_memory_opt_ins;
   std::string mcpu;
   std::mutex lock;
   KernelProfilerBase *profiler;
   CUDADriver &driver;
+  std::vector<void *> streams;
+  std::vector<void *> events;
 
  public:
   CUDAContext();
@@ -44,6 +57,35 @@ class CUDAContext {
               unsigned block_dim,
               std::size_t shared_mem_bytes);
 
+  // Same as launch(), but with all the blocks resident on the device at once,
+  // so that they can wait for each other. The grid is shrunk to the blocks
+  // that fit.
+  void launch_cooperative(void *func,
+                          const std::string &task_name,
+                          std::vector<void *> arg_pointers,
+                          unsigned grid_dim,
+                          unsigned block_dim,
+                          std::size_t shared_mem_bytes);
+
+  // Returns the |i|-th stream of a pool used to launch independent tasks
+  // concurrently, creating it if needed. These are blocking streams, so that
+  // work on the default stream (e.g. synchronous memcpy) stays ordered against
+  // them.
+  void *get_stream(int i);
+
+  // Returns the |i|-th event of a pool, creating it if needed. These events do
+  // not record timing.
+  void *get_event(int i);
+
+  // Sets the stream that launch() uses on the calling thread. nullptr is the
+  // default stream.
+  static void set_current_stream(void *stream);
+
+  static void *get_current_stream();
+
+  // Waits for all the work on the streams returned by get_stream().
+  void synchronize_streams();
+
   void set_profiler(KernelProfilerBase *profiler) {
     this->profiler = profiler;
   }
@@ -60,6 +102,34 @@ class CUDAContext {
     return compute_capability;
   }
 
+  // Whether the device supports the virtual memory management APIs
+  // (cuMemAddressReserve() and friends).
+  bool supports_virtual_memory() const {
+    return virtual_memory_supported;
+  }
+
+  // The dynamic shared memory per block that kernels can launch with, see
+  // opt_in_shared_memory().
+  int get_max_shared_memory_bytes() const {
+    return max_shared_memory_bytes;
+  }
+
+  // Lets |func| launch with |bytes| of dynamic shared memory, which needs an
+  // opt-in beyond the default 48 KB.
+  void opt_in_shared_memory(void *func, std::size_t bytes);
+
+  bool supports_cooperative_launch() const {
+    return cooperative_launch_supported;
+  }
+
+  // Returns the ordinals of the other devices whose memory this context's
+  // device (ordinal 0) can access, and which support virtual memory
+  // management.
+  std::vector<int> get_peer_devices();
+
+  // Returns the total memory of device |ordinal|.
+  std::size_t get_total_memory(int ordinal);
+
   ~CUDAContext();
 
   class ContextGuard {
@@ -0,0 +1,164 @@
+#include "taichi/backends/cuda/cuda_device_memory_pool.h"
+
+#include "taichi/backends/cuda/cuda_driver.h"
+#include "taichi/math/arithmetic.h"
+
+TLANG_NAMESPACE_BEGIN
+
+CUDADeviceMemoryPool::CUDADeviceMemoryPool(std::size_t reserved_size,
+                                           std::size_t initial_size,
+                                           const std::vector<int> &devices)
+    : devices_(devices) {
+  TI_ASSERT(!devices_.empty());
+  auto &driver = CUDADriver::get_instance();
+  for (int device : devices_) {
+    CUDAMemAllocationProp prop;
+    prop.location_id = device;
+    std::size_t granularity = 0;
+    driver.mem_get_allocation_granularity(&granularity, &prop,
+                                          CU_MEM_ALLOC_GRANULARITY_RECOMMENDED);
+    granularity_ = std::max(granularity_, granularity);
+  }
+  reserved_size_ = iroundup(reserved_size, granularity_);
+  driver.mem_address_reserve((void **)&ptr_, reserved_size_, 0, nullptr, 0);
+  TI_TRACE("Reserved {:.2f} GB of device address space (granularity {} KB)",
+           1.0 * reserved_size_ / (1UL << 30), granularity_ / 1024);
+  init_bounds();
+  commit(initial_size);
+}
+
+std::unique_ptr<CUDADeviceMemoryPool>
+CUDADeviceMemoryPool::create_preallocated(std::size_t size,
+                                          std::size_t initial_size) {
+  std::unique_ptr<CUDADeviceMemoryPool> pool(new CUDADeviceMemoryPool());
+  pool->preallocated_ = true;
+  // Only bounds the memset()s in commit().
+  pool->granularity_ = 2 << 20;
+  pool->reserved_size_ = size;
+  CUDADriver::get_instance().malloc((void **)&pool->ptr_, size);
+  TI_TRACE("Allocated {:.2f} GB of device memory",
+           1.0 * size / (1UL << 30));
+  pool->init_bounds();
+  pool->commit(initial_size);
+  return pool;
+}
+
+void CUDADeviceMemoryPool::init_bounds() {
+  auto &driver = CUDADriver::get_instance();
+  void *bounds = nullptr;
+  driver.mem_host_alloc(&bounds, sizeof(PreallocatedBufferBounds),
+                        CU_MEMHOSTALLOC_DEVICEMAP);
+  driver.mem_host_get_device_pointer((void **)&device_bounds_, bounds, 0);
+  bounds_ = (PreallocatedBufferBounds *)bounds;
+  bounds_->head = ptr_;
+  bounds_->tail = ptr_;
+}
+
+CUDADeviceMemoryPool::~CUDADeviceMemoryPool() {
+  auto &driver = CUDADriver::get_instance();
+  if (preallocated_) {
+    driver.mem_free(ptr_);
+    driver.mem_free_host((void *)bounds_);
+    return;
+  }
+  std::size_t offset = 0;
+  for (auto &[handle, size] : allocations_) {
+    driver.mem_unmap(ptr_ + offset, size);
+    driver.mem_release(handle);
+    offset += size;
+  }
+  driver.mem_address_free(ptr_, reserved_size_);
+  driver.mem_free_host((void *)bounds_);
+}
+
+void CUDADeviceMemoryPool::commit_if_needed() {
+  const std::size_t allocated = bounds_->head - ptr_;
+  if (committed_size_ - allocated < kMinHeadroom &&
+      committed_size_ < reserved_size_) {
+    const std::size_t required = allocated + std::max(allocated, kMinHeadroom);
+    commit(required - committed_size_);
+  }
+}
+
+std::size_t CUDADeviceMemoryPool::trim() {
+  if (preallocated_) {
+    return 0;
+  }
+  auto &driver = CUDADriver::get_instance();
+  const std::size_t keep = (bounds_->head - ptr_) + kMinHeadroom;
+  std::size_t released = 0;
+  while (!allocations_.empty()) {
+    auto [handle, size] = allocations_.back();
+    if (committed_size_ - size < keep) {
+      break;
+    }
+    committed_size_ -= size;
+    bounds_->tail = ptr_ + committed_size_;
+    driver.mem_unmap(ptr_ + committed_size_, size);
+    driver.mem_release(handle);
+    allocations_.pop_back();
+    released += size;
+  }
+  if (released) {
+    // Memory may have become available on the devices tried before.
+    current_device_ = 0;
+    TI_TRACE("Released {} MB of device memory ({} MB in total)", released >> 20,
+             committed_size_ >> 20);
+  }
+  return released;
+}
+
+void CUDADeviceMemoryPool::commit(std::size_t size) {
+  size = std::min(iroundup(size, granularity_),
+                  reserved_size_ - committed_size_);
+  if (size == 0) {
+    return;
+  }
+  auto &driver = CUDADriver::get_instance();
+  auto begin = ptr_ + committed_size_;
+  if (preallocated_) {
+    // Zero-filling all the memory up front takes seconds on large GPUs.
+    driver.memset(begin, 0, size);
+    driver.stream_synchronize(nullptr);
+    committed_size_ += size;
+    bounds_->tail = ptr_ + committed_size_;
+    TI_TRACE("Cleared {} MB of device memory ({} MB in total)", size >> 20,
+             committed_size_ >> 20);
+    return;
+  }
+  CUDAMemAllocationProp prop;
+  uint64 handle = 0;
+  while (true) {
+    prop.location_id = devices_[current_device_];
+    auto err = driver.mem_create.call(&handle, size, &prop, 0);
+    if (err == CUDA_ERROR_OUT_OF_MEMORY &&
+        current_device_ + 1 < (int)devices_.size()) {
+      current_device_++;
+      TI_TRACE("Committing device memory on peer device {}",
+               devices_[current_device_]);
+      continue;
+    }
+    TI_ERROR_IF(err,
+                "Failed to commit {} MB of device memory ({} MB in use): {}",
+                size >> 20, committed_size_ >> 20,
+                driver.mem_create.get_error_message(err));
+    break;
+  }
+  driver.mem_map(begin, size, 0, handle, 0);
+  // Only the device running the kernels accesses the memory, wherever it is
+  // located.
+  CUDAMemAccessDesc access;
+  access.location_id = devices_[0];
+  driver.mem_set_access(begin, size, &access, 1);
+  // The runtime expects zero-initialized memory. Tasks that are still running
+  // must not allocate from the new memory before it is cleared.
+  driver.memset(begin, 0, size);
+  driver.stream_synchronize(nullptr);
+  allocations_.emplace_back(handle, size);
+  committed_size_ += size;
+  bounds_->tail = ptr_ + committed_size_;
+  TI_TRACE("Committed {} MB of device memory ({} MB in total)", size >> 20,
+           committed_size_ >> 20);
+}
+
+TLANG_NAMESPACE_END
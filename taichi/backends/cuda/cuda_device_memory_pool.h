@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+#define TI_RUNTIME_HOST
+#include "taichi/runtime/llvm/mem_request.h"
+#undef TI_RUNTIME_HOST
+
+TLANG_NAMESPACE_BEGIN
+
+// Device memory for the LLVM runtime on CUDA, reserved as a virtual address
+// range and backed by physical memory lazily.
+//
+// The runtime bump-allocates from this range on the device, so that device
+// allocations never wait for the host. The allocator bounds live in
+// host-mapped memory: before tasks are launched, the host checks how much
+// memory has been allocated, and maps more physical memory behind the tail
+// when the headroom runs low.
+//
+// The physical memory is located on |devices[0]|, which runs the kernels, and
+// once it runs out, on the following (peer) devices in turn.
+//
+// Without virtual memory support, the whole range is allocated up front, and
+// only zero-filled as it gets committed.
+class CUDADeviceMemoryPool {
+ public:
+  // |initial_size| bytes are committed right away.
+  CUDADeviceMemoryPool(std::size_t reserved_size,
+                       std::size_t initial_size,
+                       const std::vector<int> &devices = {0});
+  // Allocates |size| bytes up front instead of reserving them.
+  static std::unique_ptr<CUDADeviceMemoryPool> create_preallocated(
+      std::size_t size,
+      std::size_t initial_size);
+  CUDADeviceMemoryPool(const CUDADeviceMemoryPool &) = delete;
+  CUDADeviceMemoryPool &operator=(const CUDADeviceMemoryPool &) = delete;
+  ~CUDADeviceMemoryPool();
+
+  uint8 *get_ptr() const {
+    return ptr_;
+  }
+
+  std::size_t get_reserved_size() const {
+    return reserved_size_;
+  }
+
+  std::size_t get_committed_size() const {
+    return committed_size_;
+  }
+
+  // The allocator bounds, as seen from the device.
+  PreallocatedBufferBounds *get_device_bounds() const {
+    return device_bounds_;
+  }
+
+  // Commits more physical memory if less than kMinHeadroom bytes remain. The
+  // committed size then grows to twice the allocated size, or more.
+  void commit_if_needed();
+
+  // Releases the trailing commits that lie entirely kMinHeadroom bytes or
+  // more above the allocated memory. No tasks may run meanwhile. Returns the
+  // number of bytes released, always 0 for preallocated memory.
+  std::size_t trim();
+
+  // Tasks allocating more than this in one launch may run out of memory.
+  static constexpr std::size_t kMinHeadroom = 256 << 20;
+
+ private:
+  CUDADeviceMemoryPool() = default;
+
+  void init_bounds();
+  void commit(std::size_t size);
+
+  bool preallocated_{false};
+  std::vector<int> devices_;
+  // Index into |devices_| of the device memory is committed on
+  int current_device_{0};
+  std::size_t granularity_{0};
+  std::size_t reserved_size_{0};
+  std::size_t committed_size_{0};
+  uint8 *ptr_{nullptr};
+  // One per commit() call
+  std::vector<std::pair<uint64, std::size_t>> allocations_;
+  volatile PreallocatedBufferBounds *bounds_{nullptr};
+  PreallocatedBufferBounds *device_bounds_{nullptr};
+};
+
+TLANG_NAMESPACE_END
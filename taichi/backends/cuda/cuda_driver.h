@@ -24,16 +24,65 @@ TLANG_NAMESPACE_BEGIN
 // Driver constants from cuda.h
 
 constexpr uint32 CU_EVENT_DEFAULT = 0x0;
+constexpr uint32 CU_EVENT_DISABLE_TIMING = 0x2;
 constexpr uint32 CU_STREAM_DEFAULT = 0x0;
 constexpr uint32 CU_STREAM_NON_BLOCKING = 0x1;
 constexpr uint32 CU_MEM_ATTACH_GLOBAL = 0x1;
+constexpr uint32 CU_MEM_ADVISE_SET_READ_MOSTLY = 1;
+constexpr uint32 CU_MEM_ADVISE_UNSET_READ_MOSTLY = 2;
 constexpr uint32 CU_MEM_ADVISE_SET_PREFERRED_LOCATION = 3;
+constexpr uint32 CU_MEM_ADVISE_UNSET_PREFERRED_LOCATION = 4;
+constexpr uint32 CU_MEM_ADVISE_SET_ACCESSED_BY = 5;
+constexpr uint32 CU_MEM_ADVISE_UNSET_ACCESSED_BY = 6;
+constexpr uint32 CU_DEVICE_CPU = (uint32)-1;
 constexpr uint32 CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X = 2;
+constexpr uint32 CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK = 8;
 constexpr uint32 CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT = 16;
 constexpr uint32 CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR = 75;
 constexpr uint32 CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR = 76;
+constexpr uint32 CU_DEVICE_ATTRIBUTE_COOPERATIVE_LAUNCH = 95;
+constexpr uint32 CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN = 97;
+constexpr uint32 CU_FUNC_ATTRIBUTE_MAX_DYNAMIC_SHARED_SIZE_BYTES = 8;
+constexpr uint32 CU_DEVICE_ATTRIBUTE_VIRTUAL_ADDRESS_MANAGEMENT_SUPPORTED = 102;
+constexpr uint32 CU_JIT_INFO_LOG_BUFFER = 3;
+constexpr uint32 CU_JIT_INFO_LOG_BUFFER_SIZE_BYTES = 4;
+constexpr uint32 CU_JIT_LOG_VERBOSE = 12;
+constexpr uint32 CU_JIT_INPUT_PTX = 1;
+constexpr uint32 CU_MEMHOSTALLOC_DEVICEMAP = 0x2;
+constexpr uint32 CU_MEM_ALLOCATION_TYPE_PINNED = 0x1;
+constexpr uint32 CU_MEM_LOCATION_TYPE_DEVICE = 0x1;
+constexpr uint32 CU_MEM_ACCESS_FLAGS_PROT_READWRITE = 0x3;
+constexpr uint32 CU_MEM_ALLOC_GRANULARITY_RECOMMENDED = 0x1;
+constexpr uint32 CUDA_ERROR_OUT_OF_MEMORY = 2;
 constexpr uint32 CUDA_ERROR_ASSERT = 710;
 
+// Mirrors CUDA_KERNEL_NODE_PARAMS
+struct CUDAKernelNodeParams {
+  void *func{nullptr};
+  uint32 grid_dim_x{1}, grid_dim_y{1}, grid_dim_z{1};
+  uint32 block_dim_x{1}, block_dim_y{1}, block_dim_z{1};
+  uint32 shared_mem_bytes{0};
+  void **kernel_params{nullptr};
+  void **extra{nullptr};
+};
+
+// Mirrors CUmemAllocationProp
+struct CUDAMemAllocationProp {
+  uint32 type{CU_MEM_ALLOCATION_TYPE_PINNED};
+  uint32 requested_handle_types{0};
+  uint32 location_type{CU_MEM_LOCATION_TYPE_DEVICE};
+  int location_id{0};
+  void *win32_handle_meta_data{nullptr};
+  uint64 alloc_flags{0};
+};
+
+// Mirrors CUmemAccessDesc
+struct CUDAMemAccessDesc {
+  uint32 location_type{CU_MEM_LOCATION_TYPE_DEVICE};
+  int location_id{0};
+  uint32 flags{CU_MEM_ACCESS_FLAGS_PROT_READWRITE};
+};
+
 std::string get_cuda_error_message(uint32 err);
 
 template <typename... Args>
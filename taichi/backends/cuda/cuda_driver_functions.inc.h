@@ -9,6 +9,8 @@ PER_CUDA_FUNCTION(device_get_count, cuDeviceGetCount, int *);
 PER_CUDA_FUNCTION(device_get, cuDeviceGet, void *, void *);
 PER_CUDA_FUNCTION(device_get_name, cuDeviceGetName, char *, int, void *);
 PER_CUDA_FUNCTION(device_get_attribute, cuDeviceGetAttribute, int *, uint32, void *);
+PER_CUDA_FUNCTION(device_total_mem, cuDeviceTotalMem_v2, std::size_t *, void *);
+PER_CUDA_FUNCTION(device_can_access_peer, cuDeviceCanAccessPeer, int *, void *, void *);
 
 
 // Context management
@@ -22,28 +24,69 @@ PER_CUDA_FUNCTION(stream_create, cuStreamCreate, void **, uint32);
 // Memory management
 PER_CUDA_FUNCTION(memcpy_host_to_device, cuMemcpyHtoD_v2, void *, void *, std::size_t);
 PER_CUDA_FUNCTION(memcpy_device_to_host, cuMemcpyDtoH_v2, void *, void *, std::size_t);
+PER_CUDA_FUNCTION(memcpy, cuMemcpy, void *, void *, std::size_t);
 PER_CUDA_FUNCTION(memcpy_host_to_device_async, cuMemcpyHtoDAsync_v2, void *, void *, std::size_t, void *);
 PER_CUDA_FUNCTION(memcpy_device_to_host_async, cuMemcpyDtoHAsync_v2, void *, void *, std::size_t, void*);
 PER_CUDA_FUNCTION(malloc, cuMemAlloc_v2, void **, std::size_t);
 PER_CUDA_FUNCTION(malloc_managed, cuMemAllocManaged, void **, std::size_t, uint32);
 PER_CUDA_FUNCTION(memset, cuMemsetD8_v2, void *, uint8, std::size_t);
+PER_CUDA_FUNCTION(memset_d8_async, cuMemsetD8Async, void *, uint8, std::size_t, void *);
+PER_CUDA_FUNCTION(memset_d16_async, cuMemsetD16Async, void *, uint16, std::size_t, void *);
+PER_CUDA_FUNCTION(memset_d32_async, cuMemsetD32Async, void *, uint32, std::size_t, void *);
+PER_CUDA_FUNCTION(memcpy_device_to_device_async, cuMemcpyDtoDAsync_v2, void *, void *, std::size_t, void *);
 PER_CUDA_FUNCTION(mem_free, cuMemFree_v2, void *);
 PER_CUDA_FUNCTION(mem_advise, cuMemAdvise, void *, std::size_t, uint32, uint32);
+PER_CUDA_FUNCTION(mem_prefetch_async, cuMemPrefetchAsync, void *, std::size_t, uint32, void *);
 PER_CUDA_FUNCTION(mem_get_info, cuMemGetInfo_v2, std::size_t *, std::size_t *);
+PER_CUDA_FUNCTION(mem_host_alloc, cuMemHostAlloc, void **, std::size_t, uint32);
+PER_CUDA_FUNCTION(mem_host_get_device_pointer, cuMemHostGetDevicePointer_v2, void **, void *, uint32);
+PER_CUDA_FUNCTION(mem_free_host, cuMemFreeHost, void *);
+
+// Virtual memory management
+PER_CUDA_FUNCTION(mem_address_reserve, cuMemAddressReserve, void **, std::size_t, std::size_t, void *, uint64);
+PER_CUDA_FUNCTION(mem_address_free, cuMemAddressFree, void *, std::size_t);
+PER_CUDA_FUNCTION(mem_get_allocation_granularity, cuMemGetAllocationGranularity, std::size_t *, const CUDAMemAllocationProp *, uint32);
+PER_CUDA_FUNCTION(mem_create, cuMemCreate, uint64 *, std::size_t, const CUDAMemAllocationProp *, uint64);
+PER_CUDA_FUNCTION(mem_release, cuMemRelease, uint64);
+PER_CUDA_FUNCTION(mem_map, cuMemMap, void *, std::size_t, std::size_t, uint64, uint64);
+PER_CUDA_FUNCTION(mem_unmap, cuMemUnmap, void *, std::size_t);
+PER_CUDA_FUNCTION(mem_set_access, cuMemSetAccess, void *, std::size_t, const CUDAMemAccessDesc *, std::size_t);
 
 // Module and kernels
 PER_CUDA_FUNCTION(module_get_function, cuModuleGetFunction, void **, void *, const char *);
 PER_CUDA_FUNCTION(module_load_data_ex, cuModuleLoadDataEx, void **, const char *,
                   uint32, uint32 *, void **)
+PER_CUDA_FUNCTION(link_create, cuLinkCreate_v2, uint32, uint32 *, void **, void **);
+PER_CUDA_FUNCTION(link_add_data, cuLinkAddData_v2, void *, uint32, void *, std::size_t,
+                  const char *, uint32, uint32 *, void **);
+PER_CUDA_FUNCTION(link_complete, cuLinkComplete, void *, void **, std::size_t *);
+PER_CUDA_FUNCTION(link_destroy, cuLinkDestroy, void *);
+PER_CUDA_FUNCTION(function_set_attribute, cuFuncSetAttribute, void *, uint32, int);
 PER_CUDA_FUNCTION(launch_kernel, cuLaunchKernel, void *, uint32, uint32, uint32,
                   uint32, uint32, uint32, uint32, void *, void **, void **);
+PER_CUDA_FUNCTION(launch_cooperative_kernel, cuLaunchCooperativeKernel, void *, uint32, uint32, uint32,
+                  uint32, uint32, uint32, uint32, void *, void **);
+PER_CUDA_FUNCTION(occupancy_max_active_blocks_per_multiprocessor, cuOccupancyMaxActiveBlocksPerMultiprocessor,
+                  int *, void *, int, std::size_t);
 
 // Stream management
 PER_CUDA_FUNCTION(stream_synchronize, cuStreamSynchronize, void *);
+PER_CUDA_FUNCTION(stream_wait_event, cuStreamWaitEvent, void *, void *, uint32);
 
 // Event management
 PER_CUDA_FUNCTION(event_create, cuEventCreate, void **, uint32)
 PER_CUDA_FUNCTION(event_record, cuEventRecord, void *, void *)
 PER_CUDA_FUNCTION(event_elapsed_time, cuEventElapsedTime, float *, void *, void *);
+PER_CUDA_FUNCTION(event_destroy, cuEventDestroy_v2, void *);
+PER_CUDA_FUNCTION(event_synchronize, cuEventSynchronize, void *);
+
+// Graph management
+PER_CUDA_FUNCTION(graph_create, cuGraphCreate, void **, uint32);
+PER_CUDA_FUNCTION(graph_add_kernel_node, cuGraphAddKernelNode, void **, void *, void **, std::size_t, const CUDAKernelNodeParams *);
+PER_CUDA_FUNCTION(graph_instantiate, cuGraphInstantiate, void **, void *, void **, char *, std::size_t);
+PER_CUDA_FUNCTION(graph_exec_kernel_node_set_params, cuGraphExecKernelNodeSetParams, void *, void *, const CUDAKernelNodeParams *);
+PER_CUDA_FUNCTION(graph_launch, cuGraphLaunch, void *, void *);
+PER_CUDA_FUNCTION(graph_exec_destroy, cuGraphExecDestroy, void *);
+PER_CUDA_FUNCTION(graph_destroy, cuGraphDestroy, void *);
 
 // clang-format on
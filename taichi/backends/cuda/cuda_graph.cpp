@@ -0,0 +1,98 @@
+#include "taichi/backends/cuda/cuda_graph.h"
+
+#include <cstring>
+
+#include "taichi/backends/cuda/cuda_context.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+CUDAGraph *active_graph = nullptr;
+}  // namespace
+
+CUDAGraph::~CUDAGraph() {
+  if (active_graph == this) {
+    active_graph = nullptr;
+  }
+  auto &driver = CUDADriver::get_instance();
+  if (graph_exec_) {
+    driver.graph_exec_destroy(graph_exec_);
+  }
+  if (graph_) {
+    driver.graph_destroy(graph_);
+  }
+}
+
+CUDAGraph *CUDAGraph::get_active() {
+  return active_graph;
+}
+
+void CUDAGraph::begin() {
+  TI_ERROR_IF(active_graph != nullptr, "CUDA graphs cannot be nested");
+  active_graph = this;
+  num_replayed_ = 0;
+}
+
+void CUDAGraph::end() {
+  TI_ASSERT(active_graph == this);
+  active_graph = nullptr;
+  if (!captured()) {
+    instantiate();
+  } else {
+    TI_ERROR_IF(num_replayed_ != (int)nodes_.size(),
+                "{} offloaded tasks were launched, but the CUDA graph has {}",
+                num_replayed_, nodes_.size());
+  }
+  CUDADriver::get_instance().graph_launch(graph_exec_, nullptr);
+}
+
+void CUDAGraph::on_launch(void *func,
+                          uint32 grid_dim,
+                          uint32 block_dim,
+                          std::size_t shared_mem_bytes,
+                          const Context &ctx) {
+  if (!captured()) {
+    auto node = std::make_unique<Node>();
+    node->params.func = func;
+    node->params.grid_dim_x = grid_dim;
+    node->params.block_dim_x = block_dim;
+    node->params.shared_mem_bytes = (uint32)shared_mem_bytes;
+    node->ctx = std::make_unique<Context>(ctx);
+    node->kernel_params[0] = node->ctx.get();
+    node->params.kernel_params = node->kernel_params;
+    nodes_.push_back(std::move(node));
+    return;
+  }
+  TI_ERROR_IF(num_replayed_ >= (int)nodes_.size(),
+              "More offloaded tasks were launched than captured in the CUDA "
+              "graph");
+  auto &node = *nodes_[num_replayed_++];
+  const auto &params = node.params;
+  TI_ERROR_IF(params.func != func || params.grid_dim_x != grid_dim ||
+                  params.block_dim_x != block_dim ||
+                  params.shared_mem_bytes != shared_mem_bytes,
+              "The offloaded tasks launched differ from those captured in the "
+              "CUDA graph");
+  if (std::memcmp(node.ctx.get(), &ctx, sizeof(Context)) != 0) {
+    // cuGraphExecKernelNodeSetParams() copies the arguments.
+    *node.ctx = ctx;
+    CUDADriver::get_instance().graph_exec_kernel_node_set_params(
+        graph_exec_, node.graph_node, &node.params);
+  }
+}
+
+void CUDAGraph::instantiate() {
+  auto &driver = CUDADriver::get_instance();
+  driver.graph_create(&graph_, 0);
+  void *prev = nullptr;
+  for (auto &node : nodes_) {
+    // Each task depends on the previous one, as on a stream.
+    driver.graph_add_kernel_node(&node->graph_node, graph_, &prev,
+                                 prev ? 1 : 0, &node->params);
+    prev = node->graph_node;
+  }
+  driver.graph_instantiate(&graph_exec_, graph_, nullptr, nullptr, 0);
+  TI_TRACE("Instantiated a CUDA graph of {} nodes", nodes_.size());
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "taichi/backends/cuda/cuda_driver.h"
+#include "taichi/lang_util.h"
+
+#define TI_RUNTIME_HOST
+#include "taichi/program/context.h"
+#undef TI_RUNTIME_HOST
+
+TLANG_NAMESPACE_BEGIN
+
+// A sequence of Taichi kernel launches recorded into a CUDA graph.
+//
+// The first begin()/end() pair captures the kernels launched in between: they
+// are recorded instead of being launched, and end() launches the whole graph.
+// Later pairs replay the graph. The kernels launched in between are checked
+// against the captured ones, and only their changed scalar arguments are
+// updated in the graph, before end() launches it again.
+class CUDAGraph {
+ public:
+  CUDAGraph() = default;
+  CUDAGraph(const CUDAGraph &) = delete;
+  CUDAGraph &operator=(const CUDAGraph &) = delete;
+  ~CUDAGraph();
+
+  void begin();
+
+  void end();
+
+  // Returns the graph between begin() and end(), or nullptr.
+  static CUDAGraph *get_active();
+
+  // Records (or replays) the launch of an offloaded task taking |ctx| as its
+  // only argument.
+  void on_launch(void *func,
+                 uint32 grid_dim,
+                 uint32 block_dim,
+                 std::size_t shared_mem_bytes,
+                 const Context &ctx);
+
+ private:
+  struct Node {
+    CUDAKernelNodeParams params;
+    std::unique_ptr<Context> ctx;
+    // |params.kernel_params| points to this
+    void *kernel_params[1];
+    void *graph_node{nullptr};
+  };
+
+  bool captured() const {
+    return graph_exec_ != nullptr;
+  }
+
+  void instantiate();
+
+  std::vector<std::unique_ptr<Node>> nodes_;
+  // Number of launches since begin() when replaying
+  int num_replayed_{0};
+  void *graph_{nullptr};
+  void *graph_exec_{nullptr};
+};
+
+TLANG_NAMESPACE_END
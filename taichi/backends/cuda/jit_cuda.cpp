@@ -1,4 +1,7 @@
+#include <cstdio>
 #include <memory>
+#include <sstream>
+#include <unordered_map>
 
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/DynamicLibrary.h"
@@ -20,8 +23,10 @@
 
 #include "taichi/backends/cuda/cuda_context.h"
 #include "taichi/backends/cuda/cuda_driver.h"
+#include "taichi/backends/cuda/cuda_graph.h"
 #include "taichi/jit/jit_session.h"
 #include "taichi/lang_util.h"
+#include "taichi/program/kernel_profiler.h"
 #include "taichi/program/program.h"
 #include "taichi/system/timer.h"
 #include "taichi/util/file_sequence_writer.h"
@@ -33,6 +38,79 @@
 TLANG_NAMESPACE_BEGIN
 
 #if defined(TI_WITH_CUDA)
+namespace {
+
+// Reads the registers and spills of each function from the verbose info log
+// of the PTX assembler, e.g.
+//   ptxas info    : Function properties for foo
+//       0 bytes stack frame, 8 bytes spill stores, 8 bytes spill loads
+//   ptxas info    : Used 32 registers, 348 bytes cmem[0]
+std::unordered_map<std::string, KernelResourceUsage> parse_ptxas_info_log(
+    const std::string &log) {
+  std::unordered_map<std::string, KernelResourceUsage> usages;
+  std::istringstream lines(log);
+  std::string line, function;
+  const std::string properties = "Function properties for ";
+  while (std::getline(lines, line)) {
+    int stack = 0, stores = 0, loads = 0, registers = 0;
+    if (auto pos = line.find(properties); pos != std::string::npos) {
+      function = line.substr(pos + properties.size());
+    } else if (function.empty()) {
+      continue;
+    } else if (std::sscanf(line.c_str(),
+                           " %d bytes stack frame, %d bytes spill stores, "
+                           "%d bytes spill loads",
+                           &stack, &stores, &loads) == 3) {
+      usages[function].spill_store_bytes = stores;
+      usages[function].spill_load_bytes = loads;
+    } else if (std::sscanf(line.c_str(), "ptxas info : Used %d registers",
+                           &registers) == 1) {
+      usages[function].registers = registers;
+    }
+  }
+  return usages;
+}
+
+// Assembles the null-terminated |ptx| into a cubin for the device of the
+// current context, without loading it.
+std::string assemble_ptx(const std::string &ptx) {
+  TI_AUTO_PROF
+  auto &driver = CUDADriver::get_instance();
+  void *state = nullptr;
+  driver.link_create(0, nullptr, nullptr, &state);
+  driver.link_add_data(state, CU_JIT_INPUT_PTX, (void *)ptx.data(),
+                       ptx.size(), "taichi_kernel", 0, nullptr, nullptr);
+  void *cubin = nullptr;
+  std::size_t size = 0;
+  driver.link_complete(state, &cubin, &size);
+  // The cubin is freed with the link state.
+  std::string ret((const char *)cubin, size);
+  driver.link_destroy(state);
+  return ret;
+}
+
+// Returns the cubin of |ptx| from |cache|, assembling and storing it on a
+// miss.
+std::string get_cubin(LlvmOfflineCache *cache, const std::string &ptx) {
+  static const int driver_version = []() {
+    int version = 0;
+    CUDADriver::get_instance().driver_get_version(&version);
+    return version;
+  }();
+  LlvmOfflineCache::KernelCacheData data;
+  data.key = fmt::format("{}_{}_{}", LlvmOfflineCache::hash(ptx),
+                         driver_version,
+                         CUDAContext::get_instance().get_compute_capability());
+  if (cache->load(data.key, &data)) {
+    return data.binary;
+  }
+  data.binary = assemble_ptx(ptx);
+  cache->store(data);
+  return data.binary;
+}
+
+}  // namespace
+
 class JITModuleCUDA : public JITModule {
  private:
   void *module;
@@ -60,7 +138,9 @@ class JITModuleCUDA : public JITModule {
 
   void call(const std::string &name,
             const std::vector<void *> &arg_pointers) override {
-    launch(name, 1, 1, 0, arg_pointers);
+    // Runtime function calls are never recorded into CUDA graphs.
+    auto func = lookup_function(name);
+    CUDAContext::get_instance().launch(func, name, arg_pointers, 1, 1, 0);
   }
 
   virtual void launch(const std::string &name,
@@ -69,10 +149,32 @@ class JITModuleCUDA : public JITModule {
                       std::size_t shared_mem_bytes,
                       const std::vector<void *> &arg_pointers) override {
     auto func = lookup_function(name);
+    CUDAContext::get_instance().opt_in_shared_memory(func, shared_mem_bytes);
+    if (auto *graph = CUDAGraph::get_active()) {
+      if (grid_dim > 0) {
+        TI_ASSERT(arg_pointers.size() == 1);
+        graph->on_launch(func, grid_dim, block_dim, shared_mem_bytes,
+                         *(Context *)arg_pointers[0]);
+      }
+      return;
+    }
     CUDAContext::get_instance().launch(func, name, arg_pointers, grid_dim,
                                        block_dim, shared_mem_bytes);
   }
 
+  void launch_cooperative(const std::string &name,
+                          std::size_t grid_dim,
+                          std::size_t block_dim,
+                          std::size_t shared_mem_bytes,
+                          const std::vector<void *> &arg_pointers) override {
+    // Cooperative launches are never recorded into CUDA graphs.
+    TI_ASSERT(CUDAGraph::get_active() == nullptr);
+    auto func = lookup_function(name);
+    CUDAContext::get_instance().opt_in_shared_memory(func, shared_mem_bytes);
+    CUDAContext::get_instance().launch_cooperative(
+        func, name, arg_pointers, grid_dim, block_dim, shared_mem_bytes);
+  }
+
   bool direct_dispatch() const override {
     return false;
   }
@@ -87,12 +189,21 @@ class JITSessionCUDA : public JITSession {
   }
 
   virtual JITModule *add_module(std::unique_ptr<llvm::Module> M) override {
+    return add_module_from_binary(compile_module_to_binary(std::move(M)));
+  }
+
+  std::string compile_module_to_binary(
+      std::unique_ptr<llvm::Module> M) override {
     auto ptx = compile_module_to_ptx(M);
     if (get_current_program().config.print_kernel_nvptx) {
       static FileSequenceWriter writer("taichi_kernel_nvptx_{:04d}.ptx",
                                        "module NVPTX");
       writer.write(ptx);
     }
+    return ptx;
+  }
+
+  JITModule *add_module_from_binary(const std::string &ptx) override {
     // TODO: figure out why using the guard leads to wrong tests results
     // auto context_guard = CUDAContext::get_instance().get_guard();
     CUDAContext::get_instance().make_current();
@@ -101,10 +212,35 @@ class JITSessionCUDA : public JITSession {
     TI_TRACE("PTX size: {:.2f}KB", ptx.size() / 1024.0);
     auto t = Time::get_time();
     TI_TRACE("Loading module...");
-    [[maybe_unused]] auto &&_ =
-        std::move(CUDAContext::get_instance().get_lock_guard());
-    CUDADriver::get_instance().module_load_data_ex(&cuda_module, ptx.c_str(), 0,
-                                                   nullptr, nullptr);
+    auto &program = get_current_program();
+    if (program.config.kernel_profiler) {
+      [[maybe_unused]] auto &&_ =
+          std::move(CUDAContext::get_instance().get_lock_guard());
+      // The assembler reports the registers and spills of the kernels in
+      // its info log.
+      std::vector<char> log(1 << 16, '\0');
+      uint32 options[] = {CU_JIT_INFO_LOG_BUFFER,
+                          CU_JIT_INFO_LOG_BUFFER_SIZE_BYTES,
+                          CU_JIT_LOG_VERBOSE};
+      void *values[] = {log.data(), (void *)(std::size_t)log.size(),
+                        (void *)(std::size_t)1};
+      CUDADriver::get_instance().module_load_data_ex(
+          &cuda_module, ptx.c_str(), 3, options, values);
+      for (auto &[name, usage] : parse_ptxas_info_log(log.data())) {
+        program.profiler->set_resource_usage(name, usage);
+      }
+    } else {
+      // Assembled before taking the lock of the context, so that the
+      // compilation workers assemble the tasks of a kernel concurrently, see
+      // CompileConfig::num_compile_threads.
+      auto cubin = program.cubin_cache
+                       ? get_cubin(program.cubin_cache.get(), ptx)
+                       : assemble_ptx(ptx);
+      [[maybe_unused]] auto &&_ =
+          std::move(CUDAContext::get_instance().get_lock_guard());
+      CUDADriver::get_instance().module_load_data_ex(
+          &cuda_module, cubin.data(), 0, nullptr, nullptr);
+    }
     TI_TRACE("CUDA module load time : {}ms", (Time::get_time() - t) * 1000);
     // cudaModules.push_back(cudaModule);
     modules.push_back(std::make_unique<JITModuleCUDA>(cuda_module));
@@ -176,24 +312,12 @@ std::string JITSessionCUDA::compile_module_to_ptx(
       TargetRegistry::lookupTarget(triple.str(), err_str);
   TI_ERROR_UNLESS(target, err_str);
 
-  bool fast_math = get_current_program().config.fast_math;
-
   TargetOptions options;
   options.PrintMachineCode = 0;
-  if (fast_math) {
-    options.AllowFPOpFusion = FPOpFusion::Fast;
-    // See NVPTXISelLowering.cpp
-    // Setting UnsafeFPMath true will result in approximations such as
-    // sqrt.approx in PTX for both f32 and f64
-    options.UnsafeFPMath = 1;
-    options.NoInfsFPMath = 1;
-    options.NoNaNsFPMath = 1;
-  } else {
-    options.AllowFPOpFusion = FPOpFusion::Strict;
-    options.UnsafeFPMath = 0;
-    options.NoInfsFPMath = 0;
-    options.NoNaNsFPMath = 0;
-  }
+  // See NVPTXISelLowering.cpp
+  // Setting UnsafeFPMath true will result in approximations such as
+  // sqrt.approx in PTX for both f32 and f64
+  set_float_options(module.get(), options);
   options.HonorSignDependentRoundingFPMathOption = 0;
   options.NoZerosInBSS = 0;
   options.GuaranteedTailCallOpt = 0;
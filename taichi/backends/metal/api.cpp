@@ -87,6 +87,18 @@ nsobj_unique_ptr<MTLLibrary> new_library_with_source(MTLDevice *device,
   return wrap_as_nsobj_unique_ptr(lib);
 }
 
+nsobj_unique_ptr<MTLLibrary> new_library_with_file(MTLDevice *device,
+                                                   const std::string &path) {
+  auto path_str = mac::wrap_string_as_ns_string(path);
+  id error_return = nullptr;
+  auto *lib = cast_call<MTLLibrary *>(device, "newLibraryWithFile:error:",
+                                      path_str.get(), &error_return);
+  if (lib == nullptr) {
+    mac::ns_log_object(error_return);
+  }
+  return wrap_as_nsobj_unique_ptr(lib);
+}
+
 nsobj_unique_ptr<MTLFunction> new_function_with_name(MTLLibrary *library,
                                                      const std::string &name) {
   auto name_str = mac::wrap_string_as_ns_string(name);
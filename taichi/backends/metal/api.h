@@ -53,6 +53,11 @@ nsobj_unique_ptr<MTLLibrary> new_library_with_source(MTLDevice *device,
                                                      bool fast_math,
                                                      int msl_version);
 
+// Loads a library precompiled into a .metallib file by the offline Metal
+// compiler. Returns nullptr if the file cannot be loaded.
+nsobj_unique_ptr<MTLLibrary> new_library_with_file(MTLDevice *device,
+                                                   const std::string &path);
+
 nsobj_unique_ptr<MTLFunction> new_function_with_name(MTLLibrary *library,
                                                      const std::string &name);
 
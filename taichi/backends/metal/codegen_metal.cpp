@@ -35,6 +35,10 @@ using BuffersEnum = KernelAttributes::Buffers;
 constexpr char kKernelThreadIdName[] = "utid_";        // 'u' for unsigned
 constexpr char kKernelGridSizeName[] = "ugrid_size_";  // 'u' for unsigned
 constexpr char kKernelTidInSimdgroupName[] = "utid_in_simdg_";
+constexpr char kKernelTidInThreadgroupName[] = "utid_in_tg_";
+constexpr char kKernelThreadgroupSizeName[] = "utg_size_";
+constexpr char kKernelThreadgroupIdName[] = "utg_id_";
+constexpr char kKernelNumThreadgroupsName[] = "unum_tgs_";
 constexpr char kRootBufferName[] = "root_addr";
 constexpr char kGlobalTmpsBufferName[] = "global_tmps_addr";
 constexpr char kContextBufferName[] = "ctx_addr";
@@ -49,6 +53,9 @@ constexpr char kElementCoordsVarName[] = "elem_coords_";
 constexpr char kRandStateVarName[] = "rand_state_";
 constexpr char kMemAllocVarName[] = "mem_alloc_";
 constexpr char kTlsBufferName[] = "tls_buffer_";
+constexpr char kBlsBufferName[] = "bls_buffer_";
+constexpr char kBlsThreadIdName[] = "bls_tid_";
+constexpr char kBlockCornerCoordsVarName[] = "block_corner_coords_";
 
 std::string buffer_to_name(BuffersEnum b) {
   switch (b) {
@@ -69,6 +76,14 @@ std::string buffer_to_name(BuffersEnum b) {
   return {};
 }
 
+// Whether the metal::fast namespace has an approximate version of |op|.
+bool is_approximable(UnaryOpType op) {
+  return op == UnaryOpType::exp || op == UnaryOpType::log ||
+         op == UnaryOpType::sin || op == UnaryOpType::cos ||
+         op == UnaryOpType::tan || op == UnaryOpType::tanh ||
+         op == UnaryOpType::rsqrt;
+}
+
 class KernelCodegen : public IRVisitor {
  private:
   enum class Section {
@@ -108,6 +123,7 @@ class KernelCodegen : public IRVisitor {
         offloaded_(offloaded) {
     ti_kernel_attribus_.name = taichi_kernel_name;
     ti_kernel_attribus_.is_jit_evaluator = kernel->is_evaluator;
+    ti_kernel_attribus_.fast_math = kernel->fast_math;
     // allow_undefined_visitor = true;
     for (const auto s : kAllSections) {
       section_appenders_[s] = LineAppender();
@@ -140,6 +156,9 @@ class KernelCodegen : public IRVisitor {
       current_appender().push_indent();
     }
     for (auto &s : stmt->statements) {
+      if (s->element_type().ptr_removed()->is_primitive(PrimitiveTypeID::f64)) {
+        used_features()->f64 = true;
+      }
       s->accept(this);
     }
     if (!is_top_level_) {
@@ -154,6 +173,18 @@ class KernelCodegen : public IRVisitor {
 
   void visit(ConstStmt *const_stmt) override {
     TI_ASSERT(const_stmt->width() == 1);
+    if (const_stmt->element_type()->is_primitive(PrimitiveTypeID::f64)) {
+      // Split into the two halves of df64 on the host, bit-exactly.
+      const float64 val = const_stmt->val[0].val_f64;
+      const float32 hi = (float32)val;
+      const float32 lo = (float32)(val - (float64)hi);
+      emit("const df64 {}(as_type<float>(0x{:08x}u), "
+           "as_type<float>(0x{:08x}u));",
+           const_stmt->raw_name(),
+           taichi_union_cast_with_different_sizes<uint32>(hi),
+           taichi_union_cast_with_different_sizes<uint32>(lo));
+      return;
+    }
     emit("constexpr {} {} = {};",
          metal_data_type_name(const_stmt->element_type()),
          const_stmt->raw_name(), const_stmt->val[0].stringify());
@@ -364,6 +395,28 @@ class KernelCodegen : public IRVisitor {
          kTlsBufferName, stmt->offset);
   }
 
+  void visit(BlockLocalPtrStmt *stmt) override {
+    TI_ASSERT(stmt->width() == 1);
+    emit("threadgroup auto* {} = reinterpret_cast<threadgroup {}*>({} + {});",
+         stmt->raw_name(),
+         metal_data_type_name(stmt->element_type().ptr_removed()),
+         kBlsBufferName, stmt->offset->raw_name());
+  }
+
+  void visit(LoopLinearIndexStmt *stmt) override {
+    // Only the BLS xlogues of struct-fors use it, see make_block_local().
+    TI_ASSERT(inside_bls_xlogue_);
+    emit("const int {} = {};", stmt->raw_name(), kBlsThreadIdName);
+  }
+
+  void visit(BlockCornerIndexStmt *stmt) override {
+    TI_ASSERT(stmt->loop->is<OffloadedStmt>() &&
+              stmt->loop->as<OffloadedStmt>()->task_type ==
+                  OffloadedStmt::TaskType::struct_for);
+    emit("const int {} = {}.at[{}];", stmt->raw_name(),
+         kBlockCornerCoordsVarName, stmt->index);
+  }
+
   void visit(LoopIndexStmt *stmt) override {
     const auto stmt_name = stmt->raw_name();
     if (stmt->loop->is<OffloadedStmt>()) {
@@ -401,8 +454,15 @@ class KernelCodegen : public IRVisitor {
       emit("const {} {} = union_cast<{}>({});", to_type_name, stmt->raw_name(),
            to_type_name, stmt->operand->raw_name());
     } else {
-      emit("const {} {} = {}({});", metal_data_type_name(stmt->element_type()),
-           stmt->raw_name(), metal_unary_op_type_symbol(stmt->op_type),
+      // The fast:: versions are the approximate ones, see
+      // Kernel::approx_math.
+      const bool approx =
+          kernel_->approx_math &&
+          stmt->operand->element_type()->is_primitive(PrimitiveTypeID::f32) &&
+          is_approximable(stmt->op_type);
+      emit("const {} {} = {}{}({});",
+           metal_data_type_name(stmt->element_type()), stmt->raw_name(),
+           approx ? "fast::" : "", metal_unary_op_type_symbol(stmt->op_type),
            stmt->operand->raw_name());
     }
   }
@@ -489,18 +549,28 @@ class KernelCodegen : public IRVisitor {
       current_appender().push_indent();
     }
 
+    // The BLS buffers are in the threadgroup memory.
+    const std::string addr_space =
+        stmt->dest->is<BlockLocalPtrStmt>() ? "threadgroup" : "device";
     if (dt->is_primitive(PrimitiveTypeID::i32)) {
       emit(
-          "const auto {} = atomic_fetch_{}_explicit((device atomic_int*){}, "
+          "const auto {} = atomic_fetch_{}_explicit(({} atomic_int*){}, "
           "{}, "
           "metal::memory_order_relaxed);",
-          stmt->raw_name(), op_name, stmt->dest->raw_name(), val_var);
+          stmt->raw_name(), op_name, addr_space, stmt->dest->raw_name(),
+          val_var);
     } else if (dt->is_primitive(PrimitiveTypeID::u32)) {
       emit(
-          "const auto {} = atomic_fetch_{}_explicit((device atomic_uint*){}, "
+          "const auto {} = atomic_fetch_{}_explicit(({} atomic_uint*){}, "
           "{}, "
           "metal::memory_order_relaxed);",
-          stmt->raw_name(), op_name, stmt->dest->raw_name(), val_var);
+          stmt->raw_name(), op_name, addr_space, stmt->dest->raw_name(),
+          val_var);
+    } else if (stmt->dest->ret_type.ptr_removed()->is_primitive(
+                   PrimitiveTypeID::f16)) {
+      // There are no 16-bit atomics, and the addresses of the half values
+      // cannot be aligned to the 32-bit words holding them.
+      TI_ERROR("Metal does not support atomic {} on f16", op_name);
     } else if (dt->is_primitive(PrimitiveTypeID::f32)) {
       if (handle_float) {
         emit("const float {} = fatomic_fetch_{}({}, {});", stmt->raw_name(),
@@ -567,7 +637,7 @@ class KernelCodegen : public IRVisitor {
     } else if (stmt->task_type == Type::listgen) {
       add_runtime_list_op_kernel(stmt);
     } else if (stmt->task_type == Type::gc) {
-      // Ignored
+      add_gc_kernels(stmt);
     } else {
       TI_ERROR("Unsupported offload type={} on Metal arch", stmt->task_name());
     }
@@ -825,6 +895,11 @@ class KernelCodegen : public IRVisitor {
     if (used_features()->sparse) {
       emit("");
       current_appender().append_raw(shaders::kMetalRuntimeKernelsSourceCode);
+      if (uses_simdgroup_runtime_kernels_) {
+        emit("");
+        current_appender().append_raw(
+            shaders::kMetalRuntimeSimdgroupKernelsSourceCode);
+      }
     }
   }
 
@@ -976,8 +1051,10 @@ class KernelCodegen : public IRVisitor {
     ka.buffers = get_common_buffers();
 
     const bool used_tls = (stmt->tls_prologue != nullptr);
+    const bool used_bls = (stmt->bls_prologue != nullptr);
     KernelSigExtensions kernel_exts;
     kernel_exts.use_simdgroup = (used_tls && cgen_config_.allow_simdgroup);
+    kernel_exts.use_threadgroup = used_bls;
     used_features()->simdgroup =
         used_features()->simdgroup || kernel_exts.use_simdgroup;
     emit_mtl_kernel_sig(mtl_kernel_name, ka.buffers, kernel_exts);
@@ -1007,15 +1084,107 @@ class KernelCodegen : public IRVisitor {
          sn_id);
     emit("const int child_stride = parent_meta.element_stride;");
     emit("const int child_num_slots = parent_meta.num_slots;");
-    // Grid-stride loops:
-    // Each thread begins at thread_index, and incremets by grid_size
-    emit("for (int ii = {}; ii < {}; ii += {}) {{", kKernelThreadIdName,
-         total_num_elems_from_root, kKernelGridSizeName);
+    if (used_bls) {
+      generate_bls_struct_for_loop(stmt, &ka, mtl_kernel_name);
+    } else {
+      // Grid-stride loops:
+      // Each thread begins at thread_index, and incremets by grid_size
+      emit("for (int ii = {}; ii < {}; ii += {}) {{", kKernelThreadIdName,
+           total_num_elems_from_root, kKernelGridSizeName);
+      {
+        ScopedIndent s2(current_appender());
+        emit("const int parent_idx_ = (ii / child_num_slots);");
+        emit("if (parent_idx_ >= parent_list.num_active()) break;");
+        emit("const int child_idx_ = (ii % child_num_slots);");
+        emit(
+            "const auto parent_elem_ = "
+            "parent_list.get<ListgenElement>(parent_idx_);");
+        emit(
+            "device auto *parent_addr_ = mtl_lgen_snode_addr(parent_elem_, "
+            "{}, {}, {});",
+            kRootBufferName, kRuntimeVarName, kMemAllocVarName);
+        emit_struct_for_cell(stmt, &ka, mtl_kernel_name,
+                             /*loop_index_expr=*/"ii");
+      }
+      emit("}}");  // closes for loop
+    }
+    if (used_tls) {
+      generate_tls_epilogue(stmt);
+    }
+
+    current_appender().pop_indent();
+    emit("}}\n");  // closes kernel
+
+    mtl_kernels_attribs()->push_back(ka);
+  }
+
+  // Runs the body of the struct-for |stmt| on the |child_idx_|-th cell of
+  // |parent_elem_| if it is active.
+  void emit_struct_for_cell(OffloadedStmt *stmt,
+                            KernelAttributes *ka,
+                            const std::string &mtl_kernel_name,
+                            const std::string &loop_index_expr) {
+    emit("if (!is_active(parent_addr_, parent_meta, child_idx_)) continue;");
+    emit("ElementCoords {};", kElementCoordsVarName);
+    emit(
+        "refine_coordinates(parent_elem_.coords, {}->snode_extractors[{}], "
+        "child_idx_, &{});",
+        kRuntimeVarName, stmt->snode->id, kElementCoordsVarName);
+
+    current_kernel_attribs_ = ka;
+    const auto mtl_func_name = mtl_kernel_func_name(mtl_kernel_name);
+    std::vector<FuncParamLiteral> extra_func_params = {
+        {"thread const ElementCoords &", kElementCoordsVarName},
+    };
+    std::vector<std::string> extra_args = {
+        kElementCoordsVarName,
+    };
+    if (stmt->tls_prologue) {
+      extra_func_params.push_back({"thread char*", kTlsBufferName});
+      extra_args.push_back(kTlsBufferName);
+    }
+    if (stmt->bls_prologue) {
+      extra_func_params.push_back(
+          {"thread const ElementCoords &", kBlockCornerCoordsVarName});
+      extra_func_params.push_back({"threadgroup char*", kBlsBufferName});
+      extra_args.push_back(kBlockCornerCoordsVarName);
+      extra_args.push_back(kBlsBufferName);
+    }
+    emit_mtl_kernel_func_def(mtl_func_name, ka->buffers, extra_func_params,
+                             stmt->body.get());
+    emit_call_mtl_kernel_func(mtl_func_name, ka->buffers, extra_args,
+                              loop_index_expr);
+    current_kernel_attribs_ = nullptr;
+  }
+
+  // With BLS, each threadgroup runs all the cells of a block at a time, after
+  // the BLS prologue has fetched the block to the threadgroup memory:
+  //
+  // for (each block (parent element) of the threadgroup) {
+  //   BLS prologue
+  //   for (each cell of the block of the thread) {
+  //     body
+  //   }
+  //   BLS epilogue
+  // }
+  //
+  // The trip counts of the outer loop are the same in all the threads of a
+  // threadgroup, so that they all reach the barriers around the xlogues.
+  void generate_bls_struct_for_loop(OffloadedStmt *stmt,
+                                    KernelAttributes *ka,
+                                    const std::string &mtl_kernel_name) {
+    // Using |int32_t| because it aligns to 4bytes.
+    const std::string bls_bufi32_name = "bls_bufi32_";
+    emit("threadgroup int32_t {}[{}];", bls_bufi32_name,
+         (stmt->bls_size + 3) / 4);
+    emit("threadgroup char* {} = reinterpret_cast<threadgroup char*>({});",
+         kBlsBufferName, bls_bufi32_name);
+    emit(
+        "for (int parent_idx_ = {}; parent_idx_ < parent_list.num_active(); "
+        "parent_idx_ += {}) {{",
+        kKernelThreadgroupIdName, kKernelNumThreadgroupsName);
     {
       ScopedIndent s2(current_appender());
-      emit("const int parent_idx_ = (ii / child_num_slots);");
-      emit("if (parent_idx_ >= parent_list.num_active()) break;");
-      emit("const int child_idx_ = (ii % child_num_slots);");
       emit(
           "const auto parent_elem_ = "
           "parent_list.get<ListgenElement>(parent_idx_);");
@@ -1023,40 +1192,43 @@ class KernelCodegen : public IRVisitor {
           "device auto *parent_addr_ = mtl_lgen_snode_addr(parent_elem_, {}, "
           "{}, {});",
           kRootBufferName, kRuntimeVarName, kMemAllocVarName);
-      emit("if (!is_active(parent_addr_, parent_meta, child_idx_)) continue;");
-      emit("ElementCoords {};", kElementCoordsVarName);
+      emit("thread const ElementCoords &{} = parent_elem_.coords;",
+           kBlockCornerCoordsVarName);
+      // The previous block may still be in use by the other threads.
+      emit("threadgroup_barrier(mem_flags::mem_threadgroup);");
+      generate_bls_xlogue(stmt, stmt->bls_prologue.get());
+      emit("threadgroup_barrier(mem_flags::mem_threadgroup);");
       emit(
-          "refine_coordinates(parent_elem_.coords, {}->snode_extractors[{}], "
-          "child_idx_, &{});",
-          kRuntimeVarName, sn_id, kElementCoordsVarName);
-
-      current_kernel_attribs_ = &ka;
-      const auto mtl_func_name = mtl_kernel_func_name(mtl_kernel_name);
-      std::vector<FuncParamLiteral> extra_func_params = {
-          {"thread const ElementCoords &", kElementCoordsVarName},
-      };
-      std::vector<std::string> extra_args = {
-          kElementCoordsVarName,
-      };
-      if (used_tls) {
-        extra_func_params.push_back({"thread char*", kTlsBufferName});
-        extra_args.push_back(kTlsBufferName);
+          "for (int child_idx_ = {}; child_idx_ < child_num_slots; "
+          "child_idx_ += {}) {{",
+          kKernelTidInThreadgroupName, kKernelThreadgroupSizeName);
+      {
+        ScopedIndent s3(current_appender());
+        emit_struct_for_cell(
+            stmt, ka, mtl_kernel_name,
+            /*loop_index_expr=*/"parent_idx_ * child_num_slots + child_idx_");
+      }
+      emit("}}");
+      if (stmt->bls_epilogue) {
+        emit("threadgroup_barrier(mem_flags::mem_threadgroup);");
+        generate_bls_xlogue(stmt, stmt->bls_epilogue.get());
       }
-      emit_mtl_kernel_func_def(mtl_func_name, ka.buffers, extra_func_params,
-                               stmt->body.get());
-      emit_call_mtl_kernel_func(mtl_func_name, ka.buffers, extra_args,
-                                /*loop_index_expr=*/"ii");
-      current_kernel_attribs_ = nullptr;
-    }
-    emit("}}");  // closes for loop
-    if (used_tls) {
-      generate_tls_epilogue(stmt);
     }
+    emit("}}");
+  }
 
-    current_appender().pop_indent();
-    emit("}}\n");  // closes kernel
-
-    mtl_kernels_attribs()->push_back(ka);
+  // make_block_local() generates the BLS xlogues for |stmt->block_dim|
+  // threads, which LoopLinearIndexStmt indexes. The threadgroup may be
+  // smaller, see get_thread_grid_settings(), so that each thread runs them
+  // for one or more of these indices.
+  void generate_bls_xlogue(OffloadedStmt *stmt, Block *xlogue) {
+    emit("for (int {0} = {1}; {0} < {2}; {0} += {3}) {{", kBlsThreadIdName,
+         kKernelTidInThreadgroupName, stmt->block_dim,
+         kKernelThreadgroupSizeName);
+    inside_bls_xlogue_ = true;
+    xlogue->accept(this);
+    inside_bls_xlogue_ = false;
+    emit("}}");
   }
 
   void generate_tls_prologue(OffloadedStmt *stmt) {
@@ -1084,6 +1256,13 @@ class KernelCodegen : public IRVisitor {
     auto *const sn = stmt->snode;
     KernelAttributes ka;
     ka.name = "element_listgen";
+    if (cgen_config_.allow_simdgroup) {
+      // One atomic on the child list per SIMD group, see
+      // shaders/runtime_kernels.metal.h
+      ka.name = "element_listgen_simd";
+      uses_simdgroup_runtime_kernels_ = true;
+      used_features()->simdgroup = true;
+    }
     ka.task_type = stmt->task_type;
     // listgen kernels use grid-stride loops
     const auto &sn_descs = compiled_structs_->snode_descriptors;
@@ -1102,6 +1281,39 @@ class KernelCodegen : public IRVisitor {
     used_features()->sparse = true;
   }
 
+  void add_gc_kernels(OffloadedStmt *stmt) {
+    TI_ASSERT(stmt->task_type == OffloadedTaskType::gc);
+    auto *const sn = stmt->snode;
+    // `dynamic` SNodes do not allocate memory dynamically on Metal.
+    if (sn->type != SNodeType::pointer) {
+      return;
+    }
+    // See shaders/runtime_kernels.metal.h for the three GC stages
+    const auto &sn_descs = compiled_structs_->snode_descriptors;
+    const int max_num_threads =
+        std::min(sn_descs.at(sn->id).total_num_elems_from_root,
+                 kMaxNumThreadsGridStrideLoop);
+    const std::vector<std::pair<std::string, int>> stages = {
+        {"gc_compact_free_list", max_num_threads},
+        {"gc_reset_free_list", 1},
+        {"gc_zero_fill", max_num_threads},
+    };
+    for (const auto &[name, num_threads] : stages) {
+      KernelAttributes ka;
+      ka.name = name;
+      ka.task_type = stmt->task_type;
+      ka.advisory_total_num_threads = num_threads;
+      ka.advisory_num_threads_per_group = stmt->block_dim;
+      ka.buffers = {BuffersEnum::Runtime, BuffersEnum::Context};
+
+      ka.runtime_list_op_attribs = KernelAttributes::RuntimeListOpAttributes();
+      ka.runtime_list_op_attribs->snode = sn;
+      mtl_kernels_attribs()->push_back(ka);
+    }
+    current_kernel_attribs_ = nullptr;
+    used_features()->sparse = true;
+  }
+
   std::string inject_load_global_tmp(int offset,
                                      DataType dt = PrimitiveType::i32) {
     const auto vt = TypeFactory::create_vector_or_scalar_type(1, dt);
@@ -1207,6 +1419,8 @@ class KernelCodegen : public IRVisitor {
     }
 
     bool use_simdgroup = false;
+    // Whether the threadgroup attributes are used, e.g. by BLS.
+    bool use_threadgroup = false;
   };
 
   void emit_mtl_kernel_sig(
@@ -1223,6 +1437,16 @@ class KernelCodegen : public IRVisitor {
       emit("    const uint {} [[thread_index_in_simdgroup]],",
            kKernelTidInSimdgroupName);
     }
+    if (exts.use_threadgroup) {
+      emit("    const uint {} [[thread_index_in_threadgroup]],",
+           kKernelTidInThreadgroupName);
+      emit("    const uint {} [[threads_per_threadgroup]],",
+           kKernelThreadgroupSizeName);
+      emit("    const uint {} [[threadgroup_position_in_grid]],",
+           kKernelThreadgroupIdName);
+      emit("    const uint {} [[threadgroups_per_grid]],",
+           kKernelNumThreadgroupsName);
+    }
     emit("    const uint {} [[thread_position_in_grid]]) {{",
          kKernelThreadIdName);
   }
@@ -1302,6 +1526,8 @@ class KernelCodegen : public IRVisitor {
   GetRootStmt *root_stmt_{nullptr};
   KernelAttributes *current_kernel_attribs_{nullptr};
   bool inside_tls_epilogue_{false};
+  bool inside_bls_xlogue_{false};
+  bool uses_simdgroup_runtime_kernels_{false};
   Section code_section_{Section::Structs};
   std::unordered_map<Section, LineAppender> section_appenders_;
 };
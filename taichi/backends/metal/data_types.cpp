@@ -9,6 +9,7 @@ MetalDataType to_metal_type(DataType dt) {
   else if (dt->is_primitive(PrimitiveTypeID::x)) return MetalDataType::x
   if (false) {
   }
+  METAL_CASE(f16);
   METAL_CASE(f32);
   METAL_CASE(f64);
   METAL_CASE(i8);
@@ -29,10 +30,13 @@ MetalDataType to_metal_type(DataType dt) {
 
 std::string metal_data_type_name(MetalDataType dt) {
   switch (dt) {
+    case MetalDataType::f16:
+      return "half";
     case MetalDataType::f32:
       return "float";
     case MetalDataType::f64:
-      return "double";
+      // Metal has no double, see shaders/helpers.metal.h
+      return "df64";
     case MetalDataType::i8:
       return "int8_t";
     case MetalDataType::i16:
@@ -60,6 +64,8 @@ std::string metal_data_type_name(MetalDataType dt) {
 
 size_t metal_data_type_bytes(MetalDataType dt) {
   switch (dt) {
+    case MetalDataType::f16:
+      return 2;
     case MetalDataType::f32:
       return 4;
     case MetalDataType::f64:
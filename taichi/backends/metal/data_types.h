@@ -18,6 +18,7 @@ enum class MetalDataType : int {
   u16,
   u32,
   u64,
+  f16,
   // ptr,
   // none,  // "void"
   unknown
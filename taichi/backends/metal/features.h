@@ -8,7 +8,8 @@ TLANG_NAMESPACE_BEGIN
 namespace metal {
 
 inline bool is_supported_sparse_type(SNodeType t) {
-  return t == SNodeType::bitmasked || t == SNodeType::dynamic;
+  return t == SNodeType::bitmasked || t == SNodeType::dynamic ||
+         t == SNodeType::pointer;
 }
 
 }  // namespace metal
@@ -19,6 +19,11 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <thread>
 
 #include "taichi/backends/metal/api.h"
 #include "taichi/program/program.h"
@@ -46,6 +51,147 @@ inline int infer_msl_version(const TaichiKernelAttributes::UsedFeatures &f) {
   return kMslVersionNone;
 }
 
+// The libraries compiled from the generated MSL, stored across runs as
+// .metallib files so that later runs skip the front end of the Metal compiler.
+// The Metal framework cannot serialize the libraries it compiles from source,
+// so a miss compiles the library from source as before, and builds the
+// .metallib in the background with the offline compiler of the Xcode command
+// line tools, if they are installed. The source is kept next to the library,
+// and compared on load to rule out the collisions of the hashes.
+class LibraryCache {
+ public:
+  explicit LibraryCache(const std::string &path) : path_(path) {
+    if (path_.empty()) {
+      return;
+    }
+    has_offline_compiler_ =
+        std::system("xcrun -sdk macosx -f metal > /dev/null 2>&1") == 0;
+    if (!has_offline_compiler_) {
+      TI_TRACE("[metal] No offline Metal compiler, libraries are not cached");
+    }
+  }
+
+  ~LibraryCache() {
+    for (auto &builder : builders_) {
+      builder.join();
+    }
+  }
+
+  nsobj_unique_ptr<MTLLibrary> load_or_compile(MTLDevice *device,
+                                               const std::string &source,
+                                               bool fast_math,
+                                               int msl_version) {
+    if (!has_offline_compiler_) {
+      return new_library_with_source(device, source, fast_math, msl_version);
+    }
+    const auto key = fmt::format("{} {}\n{}", fast_math, msl_version, source);
+    const auto base =
+        fmt::format("{}/library_{:016x}", path_, hash_string(key));
+    std::error_code ec;
+    if (std::filesystem::exists(base + ".metallib", ec) &&
+        read_file(base + ".metal") == source) {
+      auto lib = new_library_with_file(device, base + ".metallib");
+      if (lib != nullptr) {
+        TI_TRACE("[metal] Library loaded from cache [{}.metallib]", base);
+        return lib;
+      }
+      TI_TRACE("[metal] Stale library in cache [{}.metallib]", base);
+    }
+    auto lib = new_library_with_source(device, source, fast_math, msl_version);
+    if (lib != nullptr) {
+      std::lock_guard<std::mutex> _(builders_mut_);
+      builders_.emplace_back([this, source, fast_math, msl_version, base]() {
+        build(source, fast_math, msl_version, base);
+      });
+    }
+    return lib;
+  }
+
+ private:
+  static std::string read_file(const std::string &fn) {
+    std::ifstream ifs(fn, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
+  }
+
+  void build(const std::string &source,
+             bool fast_math,
+             int msl_version,
+             const std::string &base) {
+    std::error_code ec;
+    std::filesystem::create_directories(path_, ec);
+    {
+      std::ofstream ofs(base + ".metal", std::ios::binary);
+      ofs << source;
+    }
+    std::string options = fast_math ? "" : " -fno-fast-math";
+    if (msl_version != kMslVersionNone) {
+      // MTLLanguageVersion is (major << 16) + minor.
+      options += fmt::format(" -std=macos-metal{}.{}", msl_version >> 16,
+                             msl_version & 0xffff);
+    }
+    // The library is stored under a temporary name first, so that the other
+    // processes never load a partially written one.
+    const auto cmd = fmt::format(
+        "xcrun -sdk macosx metal -c{0} \"{1}.metal\" -o \"{1}.air\" && "
+        "xcrun -sdk macosx metallib \"{1}.air\" -o \"{1}.metallib.tmp\" "
+        "> /dev/null 2>&1",
+        options, base);
+    if (std::system(cmd.c_str()) == 0) {
+      std::filesystem::rename(base + ".metallib.tmp", base + ".metallib", ec);
+      TI_TRACE("[metal] Library stored in cache [{}.metallib]", base);
+    } else {
+      TI_TRACE("[metal] Failed to build [{}.metallib]", base);
+    }
+    std::filesystem::remove(base + ".air", ec);
+  }
+
+  const std::string path_;
+  bool has_offline_compiler_{false};
+  std::mutex builders_mut_;
+  std::vector<std::thread> builders_;
+};
+
+using PipelineStates = std::vector<nsobj_unique_ptr<MTLComputePipelineState>>;
+
+// Compiles |source| into a library, and creates the pipeline states of its
+// Metal kernels |names|. Creating a pipeline state lowers the kernel to the
+// machine code of the GPU, which is most of the compilation time of the large
+// kernels, so they are created concurrently under |parallel|.
+PipelineStates compile_pipeline_states(MTLDevice *device,
+                                       LibraryCache *cache,
+                                       const std::string &source,
+                                       bool fast_math,
+                                       int msl_version,
+                                       const std::vector<std::string> &names,
+                                       bool parallel) {
+  mac::ScopedAutoreleasePool pool;
+  auto kernel_lib =
+      cache->load_or_compile(device, source, fast_math, msl_version);
+  if (kernel_lib == nullptr) {
+    TI_ERROR("Failed to compile Metal kernel! Generated code:\n\n{}", source);
+  }
+  std::vector<std::future<nsobj_unique_ptr<MTLComputePipelineState>>> futures;
+  for (const auto &name : names) {
+    futures.push_back(std::async(
+        parallel ? std::launch::async : std::launch::deferred,
+        [device, &kernel_lib, name]() {
+          mac::ScopedAutoreleasePool pool;
+          auto mtl_func = new_function_with_name(kernel_lib.get(), name);
+          TI_ASSERT(mtl_func != nullptr);
+          auto pipeline_state =
+              new_compute_pipeline_state_with_function(device, mtl_func.get());
+          TI_ASSERT(pipeline_state != nullptr);
+          return pipeline_state;
+        }));
+  }
+  PipelineStates pipeline_states;
+  for (auto &f : futures) {
+    pipeline_states.push_back(f.get());
+  }
+  return pipeline_states;
+}
+
 // This class requests the Metal buffer memory of |size| bytes from |mem_pool|.
 // Once allocated, it does not own the memory (hence the name "view"). Instead,
 // GC is deferred to the memory pool.
@@ -90,16 +236,14 @@ class CompiledMtlKernelBase {
     const CompileConfig *config;
     const KernelAttributes *kernel_attribs;
     MTLDevice *device;
-    MTLFunction *mtl_func;
+    nsobj_unique_ptr<MTLComputePipelineState> pipeline_state;
   };
 
   explicit CompiledMtlKernelBase(Params &params)
       : kernel_attribs_(*params.kernel_attribs),
         config_(params.config),
         is_jit_evalutor_(params.is_jit_evaluator),
-        pipeline_state_(
-            new_compute_pipeline_state_with_function(params.device,
-                                                     params.mtl_func)) {
+        pipeline_state_(std::move(params.pipeline_state)) {
     TI_ASSERT(pipeline_state_ != nullptr);
   }
 
@@ -283,19 +427,32 @@ class CompiledTaichiKernel {
     MemoryPool *mem_pool;
     KernelProfilerBase *profiler;
     const CompileConfig *compile_config;
+    LibraryCache *library_cache;
   };
 
   CompiledTaichiKernel(Params params)
       : ti_kernel_attribs(*params.ti_kernel_attribs),
-        ctx_attribs(*params.ctx_attribs) {
+        ctx_attribs(*params.ctx_attribs),
+        snode_descriptors_(params.snode_descriptors),
+        device_(params.device),
+        mem_pool_(params.mem_pool),
+        compile_config_(params.compile_config) {
     auto *const device = params.device;
-    auto kernel_lib = new_library_with_source(
-        device, params.mtl_source_code, params.compile_config->fast_math,
-        infer_msl_version(params.ti_kernel_attribs->used_features));
-    if (kernel_lib == nullptr) {
-      TI_ERROR("Failed to compile Metal kernel! Generated code:\n\n{}",
-               params.mtl_source_code);
+    const auto &used = params.ti_kernel_attribs->used_features;
+    std::vector<std::string> names;
+    for (const auto &ka : ti_kernel_attribs.mtl_kernels_attribs) {
+      names.push_back(ka.name);
     }
+    // The library is compiled in the background, until the first launch
+    // waits for it in wait_for_compilation(). Fast math would reassociate
+    // away the rounding errors that df64 arithmetic relies on.
+    const bool parallel = params.compile_config->num_compile_threads != 1;
+    pending_pipeline_states_ = std::async(
+        parallel ? std::launch::async : std::launch::deferred,
+        compile_pipeline_states, device, params.library_cache,
+        params.mtl_source_code,
+        params.ti_kernel_attribs->fast_math && !used.f64,
+        infer_msl_version(used), std::move(names), parallel);
     if (!ti_kernel_attribs.is_jit_evaluator &&
         ActionRecorder::get_instance().is_recording()) {
       static FileSequenceWriter writer("shader{:04d}.mtl", "Metal shader");
@@ -305,29 +462,48 @@ class CompiledTaichiKernel {
           {ActionArg("kernel_name", std::string(ti_kernel_attribs.name)),
            ActionArg("filename", fn)});
     }
-    for (const auto &ka : ti_kernel_attribs.mtl_kernels_attribs) {
-      auto mtl_func = new_function_with_name(kernel_lib.get(), ka.name);
-      TI_ASSERT(mtl_func != nullptr);
-      // Note that CompiledMtlKernel doesn't own |kernel_func|.
+    if (!ctx_attribs.empty()) {
+      ctx_mem = std::make_unique<BufferMemoryView>(ctx_attribs.total_bytes(),
+                                                   params.mem_pool);
+      if (!ti_kernel_attribs.is_jit_evaluator) {
+        ActionRecorder::get_instance().record(
+            "allocate_context_buffer",
+            {ActionArg("kernel_name", std::string(ti_kernel_attribs.name)),
+             ActionArg("size_in_bytes", (int64)ctx_attribs.total_bytes())});
+      }
+      ctx_buffer =
+          new_mtl_buffer_no_copy(device, ctx_mem->ptr(), ctx_mem->size());
+    }
+  }
+
+  // Creates |compiled_mtl_kernels| once their pipeline states are ready.
+  void wait_for_compilation() {
+    if (!pending_pipeline_states_.valid()) {
+      return;
+    }
+    auto pipeline_states = pending_pipeline_states_.get();
+    const auto &mtl_kernels_attribs = ti_kernel_attribs.mtl_kernels_attribs;
+    for (int i = 0; i < (int)mtl_kernels_attribs.size(); i++) {
+      const auto &ka = mtl_kernels_attribs[i];
       std::unique_ptr<CompiledMtlKernelBase> kernel = nullptr;
       const auto ktype = ka.task_type;
-      if (ktype == KernelTaskType::listgen) {
+      if (ktype == KernelTaskType::listgen || ktype == KernelTaskType::gc) {
         RuntimeListOpsMtlKernel::Params kparams;
         kparams.kernel_attribs = &ka;
         kparams.is_jit_evaluator = false;
-        kparams.config = params.compile_config;
-        kparams.device = device;
-        kparams.mtl_func = mtl_func.get();
-        kparams.mem_pool = params.mem_pool;
-        kparams.snode_descriptors = params.snode_descriptors;
+        kparams.config = compile_config_;
+        kparams.device = device_;
+        kparams.pipeline_state = std::move(pipeline_states[i]);
+        kparams.mem_pool = mem_pool_;
+        kparams.snode_descriptors = snode_descriptors_;
         kernel = std::make_unique<RuntimeListOpsMtlKernel>(kparams);
       } else {
         UserMtlKernel::Params kparams;
         kparams.kernel_attribs = &ka;
         kparams.is_jit_evaluator = ti_kernel_attribs.is_jit_evaluator;
-        kparams.config = params.compile_config;
-        kparams.device = device;
-        kparams.mtl_func = mtl_func.get();
+        kparams.config = compile_config_;
+        kparams.device = device_;
+        kparams.pipeline_state = std::move(pipeline_states[i]);
         kernel = std::make_unique<UserMtlKernel>(kparams);
       }
 
@@ -336,18 +512,6 @@ class CompiledTaichiKernel {
       TI_DEBUG("Added {} for Taichi kernel {}", ka.debug_string(),
                ti_kernel_attribs.name);
     }
-    if (!ctx_attribs.empty()) {
-      ctx_mem = std::make_unique<BufferMemoryView>(ctx_attribs.total_bytes(),
-                                                   params.mem_pool);
-      if (!ti_kernel_attribs.is_jit_evaluator) {
-        ActionRecorder::get_instance().record(
-            "allocate_context_buffer",
-            {ActionArg("kernel_name", std::string(ti_kernel_attribs.name)),
-             ActionArg("size_in_bytes", (int64)ctx_attribs.total_bytes())});
-      }
-      ctx_buffer =
-          new_mtl_buffer_no_copy(device, ctx_mem->ptr(), ctx_mem->size());
-    }
   }
 
   // Have to be exposed as public for Impl to use. We cannot friend the Impl
@@ -357,8 +521,33 @@ class CompiledTaichiKernel {
   KernelContextAttributes ctx_attribs;
   std::unique_ptr<BufferMemoryView> ctx_mem;
   nsobj_unique_ptr<MTLBuffer> ctx_buffer;
+  // Whether |ctx_mem| has been written by any launch yet.
+  bool ctx_initialized{false};
+  // The command buffer (see KernelManager::Impl::command_buffer_id_) that the
+  // last launch was encoded into. While it is not committed, |ctx_mem| must
+  // not be overwritten.
+  std::size_t last_command_buffer_id{0};
+
+ private:
+  const SNodeDescriptorsMap *const snode_descriptors_;
+  MTLDevice *const device_;
+  MemoryPool *const mem_pool_;
+  const CompileConfig *const compile_config_;
+  std::future<PipelineStates> pending_pipeline_states_;
 };
 
+// f64 is stored as df64 on Metal, see shaders/helpers.metal.h
+inline void f64_to_df64(float64 x, char *device_ptr) {
+  const float32 d[2] = {(float32)x, (float32)(x - (float32)x)};
+  std::memcpy(device_ptr, d, sizeof(d));
+}
+
+inline float64 df64_to_f64(const char *device_ptr) {
+  float32 d[2];
+  std::memcpy(d, device_ptr, sizeof(d));
+  return (float64)d[0] + (float64)d[1];
+}
+
 class HostMetalCtxBlitter {
  public:
   HostMetalCtxBlitter(const CompiledTaichiKernel &kernel,
@@ -379,17 +568,12 @@ class HostMetalCtxBlitter {
   }
 
   void host_to_metal() {
-#define TO_METAL(type)                  \
-  auto d = host_ctx_->get_arg<type>(i); \
-  std::memcpy(device_ptr, &d, sizeof(d))
-
     if (ctx_attribs_->empty()) {
       return;
     }
     char *const base = (char *)kernel_ctx_mem_->ptr();
     for (int i = 0; i < ctx_attribs_->args().size(); ++i) {
       const auto &arg = ctx_attribs_->args()[i];
-      const auto dt = arg.dt;
       char *device_ptr = base + arg.offset_in_mem;
       if (!ti_kernel_attribs_->is_jit_evaluator) {
         ActionRecorder::get_instance().record(
@@ -397,36 +581,56 @@ class HostMetalCtxBlitter {
             {ActionArg("kernel_name", kernel_name_), ActionArg("arg_id", i),
              ActionArg("offset_in_bytes", (int64)arg.offset_in_mem)});
       }
-      if (arg.is_array) {
+      if (arg.is_array && arg.dt == MetalDataType::f64) {
+        const auto *host_ptr = host_ctx_->get_arg<float64 *>(i);
+        for (int j = 0; j < arg.stride / sizeof(float64); ++j) {
+          f64_to_df64(host_ptr[j], device_ptr + j * sizeof(float64));
+        }
+      } else if (arg.is_array) {
         const void *host_ptr = host_ctx_->get_arg<void *>(i);
         std::memcpy(device_ptr, host_ptr, arg.stride);
-      } else if (dt == MetalDataType::i32) {
-        TO_METAL(int32);
-      } else if (dt == MetalDataType::u32) {
-        TO_METAL(uint32);
-      } else if (dt == MetalDataType::f32) {
-        TO_METAL(float32);
-      } else if (dt == MetalDataType::i8) {
-        TO_METAL(int8);
-      } else if (dt == MetalDataType::i16) {
-        TO_METAL(int16);
-      } else if (dt == MetalDataType::u8) {
-        TO_METAL(uint8);
-      } else if (dt == MetalDataType::u16) {
-        TO_METAL(uint16);
       } else {
-        TI_ERROR("Metal does not support arg type={}",
-                 metal_data_type_name(arg.dt));
+        scalar_arg_to_metal(i, arg.dt, device_ptr);
       }
     }
     char *device_ptr = base + ctx_attribs_->ctx_bytes();
     std::memcpy(device_ptr, host_ctx_->extra_args,
                 ctx_attribs_->extra_args_bytes());
-#undef TO_METAL
     did_modify_range(kernel_ctx_buffer_, /*location=*/0,
                      kernel_ctx_mem_->size());
   }
 
+  // Whether the kernel passes any data back to the host, through array args
+  // or return values. If not, its launch doesn't have to wait for the GPU.
+  bool needs_metal_to_host() const {
+    if (!ctx_attribs_->rets().empty()) {
+      return true;
+    }
+    for (const auto &arg : ctx_attribs_->args()) {
+      if (arg.is_array) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether the context buffer already holds the args of |host_ctx_|. Only
+  // meaningful if !needs_metal_to_host(), so that the GPU never writes to the
+  // context buffer.
+  bool is_up_to_date() const {
+    const char *const base = (const char *)kernel_ctx_mem_->ptr();
+    for (int i = 0; i < ctx_attribs_->args().size(); ++i) {
+      const auto &arg = ctx_attribs_->args()[i];
+      char d[sizeof(uint64)];
+      scalar_arg_to_metal(i, arg.dt, d);
+      if (std::memcmp(d, base + arg.offset_in_mem, arg.stride) != 0) {
+        return false;
+      }
+    }
+    return std::memcmp(base + ctx_attribs_->ctx_bytes(), host_ctx_->extra_args,
+                       ctx_attribs_->extra_args_bytes()) == 0;
+  }
+
   void metal_to_host() {
 #define TO_HOST(type)                                   \
   const type d = *reinterpret_cast<type *>(device_ptr); \
@@ -441,7 +645,14 @@ class HostMetalCtxBlitter {
       char *device_ptr = base + arg.offset_in_mem;
       if (arg.is_array) {
         void *host_ptr = host_ctx_->get_arg<void *>(i);
-        std::memcpy(host_ptr, device_ptr, arg.stride);
+        if (arg.dt == MetalDataType::f64) {
+          for (int j = 0; j < arg.stride / sizeof(float64); ++j) {
+            ((float64 *)host_ptr)[j] =
+                df64_to_f64(device_ptr + j * sizeof(float64));
+          }
+        } else {
+          std::memcpy(host_ptr, device_ptr, arg.stride);
+        }
 
         if (!ti_kernel_attribs_->is_jit_evaluator) {
           ActionRecorder::get_instance().record(
@@ -470,6 +681,14 @@ class HostMetalCtxBlitter {
         const auto dt = ret.dt;
         if (dt == MetalDataType::i32) {
           TO_HOST(int32);
+        } else if (dt == MetalDataType::f64) {
+          host_result_buffer_[i] =
+              taichi_union_cast_with_different_sizes<uint64>(
+                  df64_to_f64(device_ptr));
+        } else if (dt == MetalDataType::i64) {
+          TO_HOST(int64);
+        } else if (dt == MetalDataType::u64) {
+          TO_HOST(uint64);
         } else if (dt == MetalDataType::u32) {
           TO_HOST(uint32);
         } else if (dt == MetalDataType::f32) {
@@ -491,6 +710,37 @@ class HostMetalCtxBlitter {
 #undef TO_HOST
   }
 
+  void scalar_arg_to_metal(int i, MetalDataType dt, char *device_ptr) const {
+#define TO_METAL(type)                  \
+  auto d = host_ctx_->get_arg<type>(i); \
+  std::memcpy(device_ptr, &d, sizeof(d))
+
+    if (dt == MetalDataType::i32) {
+      TO_METAL(int32);
+    } else if (dt == MetalDataType::f64) {
+      f64_to_df64(host_ctx_->get_arg<float64>(i), device_ptr);
+    } else if (dt == MetalDataType::i64) {
+      TO_METAL(int64);
+    } else if (dt == MetalDataType::u64) {
+      TO_METAL(uint64);
+    } else if (dt == MetalDataType::u32) {
+      TO_METAL(uint32);
+    } else if (dt == MetalDataType::f32) {
+      TO_METAL(float32);
+    } else if (dt == MetalDataType::i8) {
+      TO_METAL(int8);
+    } else if (dt == MetalDataType::i16) {
+      TO_METAL(int16);
+    } else if (dt == MetalDataType::u8) {
+      TO_METAL(uint8);
+    } else if (dt == MetalDataType::u16) {
+      TO_METAL(uint16);
+    } else {
+      TI_ERROR("Metal does not support arg type={}", metal_data_type_name(dt));
+    }
+#undef TO_METAL
+  }
+
   static std::unique_ptr<HostMetalCtxBlitter> maybe_make(
       const CompiledTaichiKernel &kernel,
       Context *ctx,
@@ -532,6 +782,14 @@ class KernelManager::Impl {
     command_queue_ = new_command_queue(device_.get());
     TI_ASSERT(command_queue_ != nullptr);
     create_new_command_buffer();
+    // Next to the LLVM kernels of the offline cache.
+    std::string cache_path;
+    if (config_->offline_cache) {
+      cache_path = config_->offline_cache_file_path.empty()
+                       ? get_repo_dir() + "/.cache/metal"
+                       : config_->offline_cache_file_path + "/metal";
+    }
+    library_cache_ = std::make_unique<LibraryCache>(cache_path);
 
     if (compiled_structs_.root_size > 0) {
       root_mem_ = std::make_unique<BufferMemoryView>(
@@ -612,8 +870,9 @@ class KernelManager::Impl {
     params.mem_pool = mem_pool_;
     params.profiler = profiler_;
     params.compile_config = config_;
+    params.library_cache = library_cache_.get();
     compiled_taichi_kernels_[taichi_kernel_name] =
-        std::make_unique<CompiledTaichiKernel>(params);
+        std::make_unique<CompiledTaichiKernel>(std::move(params));
     TI_DEBUG("Registered Taichi kernel <{}>", taichi_kernel_name);
   }
 
@@ -621,6 +880,7 @@ class KernelManager::Impl {
                             Context *ctx) {
     mac::ScopedAutoreleasePool pool;
     auto &ctk = *compiled_taichi_kernels_.find(taichi_kernel_name)->second;
+    ctk.wait_for_compilation();
     auto ctx_blitter = HostMetalCtxBlitter::maybe_make(
         ctk, ctx, host_result_buffer_, taichi_kernel_name);
     if (config_->verbose_kernel_launches) {
@@ -633,23 +893,32 @@ class KernelManager::Impl {
         {BufferEnum::Runtime, runtime_buffer_.get()},
         {BufferEnum::Print, print_buffer_.get()},
     };
+    // Kernels that don't pass data back to the host keep being encoded into
+    // the current command buffer, until the next sync point.
+    const bool ctx_to_host = ctx_blitter && ctx_blitter->needs_metal_to_host();
     if (ctx_blitter) {
-      ctx_blitter->host_to_metal();
+      if (ctx_to_host || !ctk.ctx_initialized ||
+          !ctx_blitter->is_up_to_date()) {
+        if (ctk.last_command_buffer_id == command_buffer_id_) {
+          // The pending launch still needs the old args.
+          blit_buffers_and_sync();
+        }
+        ctx_blitter->host_to_metal();
+        ctk.ctx_initialized = true;
+      }
       input_buffers[BufferEnum::Context] = ctk.ctx_buffer.get();
     }
 
     for (const auto &mk : ctk.compiled_mtl_kernels) {
       mk->launch(input_buffers, cur_command_buffer_.get());
     }
+    ctk.last_command_buffer_id = command_buffer_id_;
 
     const auto &used = ctk.ti_kernel_attribs.used_features;
     const bool used_print_assert = (used.print || used.assertion);
-    if (ctx_blitter || used_print_assert) {
-      // TODO(k-ye): One optimization is to synchronize only when we absolutely
-      // need to transfer the data back to host. This includes the cases where
-      // an arg is 1) an array, or 2) used as return value.
+    if (ctx_to_host || used_print_assert) {
       std::vector<MTLBuffer *> buffers_to_blit;
-      if (ctx_blitter) {
+      if (ctx_to_host) {
         buffers_to_blit.push_back(ctx_blitter->ctx_buffer());
       }
       if (used_print_assert) {
@@ -658,7 +927,7 @@ class KernelManager::Impl {
       }
       blit_buffers_and_sync(buffers_to_blit);
 
-      if (ctx_blitter) {
+      if (ctx_to_host) {
         ctx_blitter->metal_to_host();
       }
       if (used.assertion) {
@@ -679,6 +948,18 @@ class KernelManager::Impl {
     return &print_strtable_;
   }
 
+  std::size_t get_snode_num_dynamically_allocated(SNode *snode) {
+    if (snode->type != SNodeType::pointer) {
+      // `dynamic` SNodes live in the root buffer on Metal.
+      return 0;
+    }
+    mac::ScopedAutoreleasePool pool;
+    blit_buffers_and_sync({runtime_buffer_.get()});
+    const auto *nm_data = rtm_nodemgr_begin_ + snode->id;
+    // Excludes the ambient element
+    return (std::size_t)(nm_data->data_list.next - 1);
+  }
+
  private:
   void init_runtime(int root_id) {
     using namespace shaders;
@@ -775,9 +1056,48 @@ class KernelManager::Impl {
     addr += addr_offset;
     TI_DEBUG("Initialized ListManagerData, size={} accumulated={}", addr_offset,
              (addr - addr_begin));
-    // TODO(k-ye): Initialize these
+    // init snode_allocators
+    NodeManagerData *const rtm_nodemgr_begin =
+        reinterpret_cast<NodeManagerData *>(addr);
+    rtm_nodemgr_begin_ = rtm_nodemgr_begin;
+    for (int i = 0; i < max_snodes; ++i) {
+      auto iter = snode_descriptors.find(i);
+      if (iter == snode_descriptors.end() ||
+          iter->second.snode->type != SNodeType::pointer) {
+        continue;
+      }
+      const SNodeDescriptor &sn_desc = iter->second;
+      NodeManagerData *nm_data = rtm_nodemgr_begin + i;
+      // +1 for the ambient element
+      const int max_num_cells = sn_desc.total_num_elems_from_root + 1;
+      const int log2_num_elems_per_chunk =
+          log2int(compute_num_elems_per_chunk(max_num_cells));
+      // Each data element is a cell of the `pointer` SNode, which gets
+      // allocated from the memory pool and must respect its alignment.
+      nm_data->data_list.element_stride =
+          iroundup(sn_desc.element_stride, shaders::kAlignment);
+      nm_data->data_list.log2_num_elems_per_chunk = log2_num_elems_per_chunk;
+      nm_data->data_list.next = 0;
+      for (auto *lm_data : {&(nm_data->free_list), &(nm_data->recycled_list)}) {
+        lm_data->element_stride = sizeof(NodeManagerData::ElemIndex);
+        lm_data->log2_num_elems_per_chunk = log2_num_elems_per_chunk;
+        lm_data->next = 0;
+      }
+      nm_data->free_list_used = 0;
+      nm_data->recycled_list_size_backup = 0;
+      nm_data->gc_threshold = sn_desc.snode->gc_threshold;
+      nm_data->gc_period = sn_desc.snode->gc_period;
+      nm_data->num_skipped_gcs = 0;
+      TI_DEBUG("NodeManagerData\n  id={}\n  elem_stride={}\n", i,
+               nm_data->data_list.element_stride);
+    }
     addr_offset = sizeof(NodeManagerData) * max_snodes;
     addr += addr_offset;
+    TI_DEBUG("Initialized NodeManagerData, size={} accumulated={}", addr_offset,
+             (addr - addr_begin));
+    // ambient_indices are allocated below, once the memory allocator is ready
+    auto *const rtm_ambient_begin =
+        reinterpret_cast<NodeManagerData::ElemIndex *>(addr);
     addr_offset = sizeof(NodeManagerData::ElemIndex) * max_snodes;
     addr += addr_offset;
     // init rand_seeds
@@ -810,6 +1130,22 @@ class KernelManager::Impl {
       root_lm.lm_data = rtm_list_begin + root_id;
       root_lm.mem_alloc = mem_alloc;
       root_lm.append(root_elem);
+      // Every `pointer` SNode has an ambient element, which is read from when
+      // accessing an inactive cell. It lives in the zero-initialized memory
+      // pool and is never written.
+      for (int i = 0; i < max_snodes; ++i) {
+        auto iter = snode_descriptors.find(i);
+        if (iter == snode_descriptors.end() ||
+            iter->second.snode->type != SNodeType::pointer) {
+          continue;
+        }
+        ListManager data_lm;
+        data_lm.lm_data = &(rtm_nodemgr_begin[i].data_list);
+        data_lm.mem_alloc = mem_alloc;
+        rtm_ambient_begin[i] = data_lm.reserve_new_elem();
+        TI_DEBUG("Allocated ambient element for SNode={} offset={}", i,
+                 rtm_ambient_begin[i].value());
+      }
     }
 
     did_modify_range(runtime_buffer_.get(), /*location=*/0,
@@ -962,9 +1298,13 @@ class KernelManager::Impl {
   nsobj_unique_ptr<MTLBuffer> global_tmps_buffer_;
   std::unique_ptr<BufferMemoryView> runtime_mem_;
   nsobj_unique_ptr<MTLBuffer> runtime_buffer_;
+  // Points into |runtime_mem_|
+  shaders::NodeManagerData *rtm_nodemgr_begin_{nullptr};
   // TODO: Rename these to 'print_assert_{mem|buffer}_'
   std::unique_ptr<BufferMemoryView> print_mem_;
   nsobj_unique_ptr<MTLBuffer> print_buffer_;
+  // Outlives |compiled_taichi_kernels_|, whose compilation may still use it.
+  std::unique_ptr<LibraryCache> library_cache_;
   std::unordered_map<std::string, std::unique_ptr<CompiledTaichiKernel>>
       compiled_taichi_kernels_;
   PrintStringTable print_strtable_;
@@ -998,6 +1338,11 @@ class KernelManager::Impl {
     TI_ERROR("Metal not supported on the current OS");
     return nullptr;
   }
+
+  std::size_t get_snode_num_dynamically_allocated(SNode *) {
+    TI_ERROR("Metal not supported on the current OS");
+    return 0;
+  }
 };
 
 #endif  // TI_PLATFORM_OSX
@@ -1031,5 +1376,9 @@ PrintStringTable *KernelManager::print_strtable() {
   return impl_->print_strtable();
 }
 
+std::size_t KernelManager::get_snode_num_dynamically_allocated(SNode *snode) {
+  return impl_->get_snode_num_dynamically_allocated(snode);
+}
+
 }  // namespace metal
 TLANG_NAMESPACE_END
@@ -41,6 +41,8 @@ class KernelManager {
   // * |mtl_kernel_source_code| is the complete source code compiled from a
   // Taichi kernel. It may include one or more Metal compute kernels. Each
   // Metal kernel is identified by one item in |kernels_attribs|.
+  // * The source is compiled in the background, unless
+  // |config.num_compile_threads| is 1, and the first launch waits for it.
   //
   // TODO(k-ye): Remove |taichi_kernel_name| now that it's part of
   // |ti_kernel_attribs|. Return a handle that will be passed to
@@ -61,6 +63,9 @@ class KernelManager {
 
   PrintStringTable *print_strtable();
 
+  // Returns the number of cells ever allocated for the `pointer` |snode|.
+  std::size_t get_snode_num_dynamically_allocated(SNode *snode);
+
  private:
   // Use Pimpl so that we can expose this interface without conditionally
   // compiling on TI_PLATFORM_OSX
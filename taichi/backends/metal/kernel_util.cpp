@@ -50,7 +50,8 @@ std::string KernelAttributes::debug_string() const {
   }
   result += "]";  // closes |buffers|
   // TODO(k-ye): show range_for
-  if (task_type == OffloadedTaskType::listgen) {
+  if (task_type == OffloadedTaskType::listgen ||
+      task_type == OffloadedTaskType::gc) {
     result += fmt::format(" snode={}", runtime_list_op_attribs->snode->id);
   }
   result += ">";
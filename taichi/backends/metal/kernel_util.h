@@ -73,7 +73,7 @@ struct KernelAttributes {
   std::vector<Buffers> buffers;
   // Only valid when |task_type| is range_for.
   std::optional<RangeForAttributes> range_for_attribs;
-  // Only valid when |task_type| is {clear_list, listgen}.
+  // Only valid when |task_type| is {clear_list, listgen, gc}.
   std::optional<RuntimeListOpAttributes> runtime_list_op_attribs;
 
   static std::string buffers_name(Buffers b);
@@ -92,10 +92,15 @@ struct TaichiKernelAttributes {
     // Whether [[thread_index_in_simdgroup]] is used. This is only supported
     // since MSL 2.1
     bool simdgroup = false;
+    // Whether f64 (emulated with df64, see shaders/helpers.metal.h) is used.
+    bool f64 = false;
   };
   std::string name;
   // Is this kernel for evaluating the constant fold result?
   bool is_jit_evaluator = false;
+  // Whether to compile the Metal library with fast math, see
+  // Kernel::fast_math.
+  bool fast_math = true;
   // Attributes of all the Metal kernels produced from this Taichi kernel.
   std::vector<KernelAttributes> mtl_kernels_attribs;
   UsedFeatures used_features;
@@ -94,6 +94,242 @@ STR(
       return old_val;
     }
 
+    // The same for the BLS buffers in the threadgroup memory.
+    float fatomic_fetch_add(threadgroup float *dest, const float operand) {
+      bool ok = false;
+      float old_val = 0.0f;
+      while (!ok) {
+        old_val = *dest;
+        float new_val = (old_val + operand);
+        ok = atomic_compare_exchange_weak_explicit(
+            (threadgroup atomic_int *)dest, (thread int *)(&old_val),
+            *((thread int *)(&new_val)), metal::memory_order_relaxed,
+            metal::memory_order_relaxed);
+      }
+      return old_val;
+    }
+
+    float fatomic_fetch_min(threadgroup float *dest, const float operand) {
+      bool ok = false;
+      float old_val = 0.0f;
+      while (!ok) {
+        old_val = *dest;
+        float new_val = (old_val < operand) ? old_val : operand;
+        ok = atomic_compare_exchange_weak_explicit(
+            (threadgroup atomic_int *)dest, (thread int *)(&old_val),
+            *((thread int *)(&new_val)), metal::memory_order_relaxed,
+            metal::memory_order_relaxed);
+      }
+      return old_val;
+    }
+
+    float fatomic_fetch_max(threadgroup float *dest, const float operand) {
+      bool ok = false;
+      float old_val = 0.0f;
+      while (!ok) {
+        old_val = *dest;
+        float new_val = (old_val > operand) ? old_val : operand;
+        ok = atomic_compare_exchange_weak_explicit(
+            (threadgroup atomic_int *)dest, (thread int *)(&old_val),
+            *((thread int *)(&new_val)), metal::memory_order_relaxed,
+            metal::memory_order_relaxed);
+      }
+      return old_val;
+    }
+
+    // Metal has no double. f64 is emulated with an unevaluated sum of two
+    // floats (hi + lo, |lo| <= ulp(hi) / 2), which gives ~48 bits of mantissa
+    // but only the exponent range of float. See "Extended-Precision
+    // Floating-Point Numbers for GPU Computation" by Andrew Thall.
+    // Transcendental functions are only evaluated in float precision.
+    struct df64 {
+      float hi;
+      float lo;
+
+      df64() = default;
+      constexpr df64(float h, float l) : hi(h), lo(l) {
+      }
+      constexpr df64(float x) : hi(x), lo(0.0f) {
+      }
+      df64(int32_t x) : hi(float(x)), lo(float(int64_t(x) - int64_t(hi))) {
+      }
+      df64(uint32_t x) : hi(float(x)), lo(float(int64_t(x) - int64_t(hi))) {
+      }
+      df64(int64_t x) : hi(float(x)), lo(float(x - int64_t(hi))) {
+      }
+      df64(uint64_t x)
+          : hi(float(x)), lo(float(int64_t(x - uint64_t(hi)))) {
+      }
+
+      explicit operator float() const {
+        return hi + lo;
+      }
+      template <typename T>
+      explicit operator T() const {
+        // Truncates towards zero
+        const float t = trunc(hi);
+        const float r = (hi - t) + lo;
+        return T(int64_t(t) + int64_t(hi >= 0.0f ? floor(r) : ceil(r)));
+      }
+    };
+
+    inline df64 df64_quick_two_sum(float a, float b) {
+      const float s = a + b;
+      return df64(s, b - (s - a));
+    }
+
+    inline df64 df64_two_sum(float a, float b) {
+      const float s = a + b;
+      const float v = s - a;
+      return df64(s, (a - (s - v)) + (b - v));
+    }
+
+    inline df64 df64_two_prod(float a, float b) {
+      const float p = a * b;
+      return df64(p, fma(a, b, -p));
+    }
+
+    inline df64 operator-(df64 a) {
+      return df64(-a.hi, -a.lo);
+    }
+
+    inline df64 operator+(df64 a, df64 b) {
+      df64 s = df64_two_sum(a.hi, b.hi);
+      const df64 t = df64_two_sum(a.lo, b.lo);
+      s.lo += t.hi;
+      s = df64_quick_two_sum(s.hi, s.lo);
+      s.lo += t.lo;
+      return df64_quick_two_sum(s.hi, s.lo);
+    }
+
+    inline df64 operator-(df64 a, df64 b) {
+      return a + (-b);
+    }
+
+    inline df64 operator*(df64 a, df64 b) {
+      df64 p = df64_two_prod(a.hi, b.hi);
+      p.lo += a.hi * b.lo + a.lo * b.hi;
+      return df64_quick_two_sum(p.hi, p.lo);
+    }
+
+    inline df64 operator/(df64 a, df64 b) {
+      // Long division, one float of quotient at a time
+      const float q1 = a.hi / b.hi;
+      df64 r = a - b * df64(q1);
+      const float q2 = r.hi / b.hi;
+      r = r - b * df64(q2);
+      const float q3 = r.hi / b.hi;
+      return df64_quick_two_sum(q1, q2) + df64(q3);
+    }
+
+    inline bool operator==(df64 a, df64 b) {
+      return a.hi == b.hi && a.lo == b.lo;
+    }
+
+    inline bool operator!=(df64 a, df64 b) {
+      return !(a == b);
+    }
+
+    inline bool operator<(df64 a, df64 b) {
+      return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+    }
+
+    inline bool operator>(df64 a, df64 b) {
+      return b < a;
+    }
+
+    inline bool operator<=(df64 a, df64 b) {
+      return !(b < a);
+    }
+
+    inline bool operator>=(df64 a, df64 b) {
+      return !(a < b);
+    }
+
+    inline df64 min(df64 a, df64 b) {
+      return (b < a) ? b : a;
+    }
+
+    inline df64 max(df64 a, df64 b) {
+      return (a < b) ? b : a;
+    }
+
+    inline df64 abs(df64 a) {
+      return (a.hi < 0.0f) ? -a : a;
+    }
+
+    inline df64 sign(df64 a) {
+      return df64(sign(a.hi));
+    }
+
+    inline df64 floor(df64 a) {
+      const float hi = floor(a.hi);
+      if (hi != a.hi) {
+        return df64(hi);
+      }
+      return df64_quick_two_sum(hi, floor(a.lo));
+    }
+
+    inline df64 ceil(df64 a) {
+      return -floor(-a);
+    }
+
+    inline df64 sqrt(df64 a) {
+      if (a.hi <= 0.0f) {
+        return df64(sqrt(a.hi));
+      }
+      // One Newton step from the float estimate (Karp's trick)
+      const float x = rsqrt(a.hi);
+      const float y = a.hi * x;
+      const df64 y2 = df64_two_prod(y, y);
+      const float d = float(a - y2) * (x * 0.5f);
+      return df64_two_sum(y, d);
+    }
+
+    inline df64 rsqrt(df64 a) {
+      return df64(1.0f) / sqrt(a);
+    }
+
+    inline df64 pow(df64 a, df64 b) {
+      return df64(pow(float(a), float(b)));
+    }
+
+    inline df64 atan2(df64 a, df64 b) {
+      return df64(atan2(float(a), float(b)));
+    }
+
+    inline df64 sin(df64 a) {
+      return df64(sin(float(a)));
+    }
+
+    inline df64 asin(df64 a) {
+      return df64(asin(float(a)));
+    }
+
+    inline df64 cos(df64 a) {
+      return df64(cos(float(a)));
+    }
+
+    inline df64 acos(df64 a) {
+      return df64(acos(float(a)));
+    }
+
+    inline df64 tan(df64 a) {
+      return df64(tan(float(a)));
+    }
+
+    inline df64 tanh(df64 a) {
+      return df64(tanh(float(a)));
+    }
+
+    inline df64 exp(df64 a) {
+      return df64(exp(float(a)));
+    }
+
+    inline df64 log(df64 a) {
+      return df64(log(float(a)));
+    }
+
     struct RandState { uint32_t seed; };
 
     uint32_t metal_rand_u32(device RandState * state) {
@@ -118,6 +354,13 @@ STR(
     float metal_rand_f32(device RandState *state) {
       return metal_rand_u32(state) * (1.0f / 4294967296.0f);
     }
+
+    df64 metal_rand_f64(device RandState *state) {
+      // 48 random bits, 24 for each half
+      const float hi = (metal_rand_u32(state) >> 8) * (1.0f / 16777216.0f);
+      const float lo = (metal_rand_u32(state) >> 8) * (1.0f / 16777216.0f);
+      return df64_quick_two_sum(hi, lo * (1.0f / 16777216.0f));
+    }
     // clang-format off
 )
 METAL_END_HELPERS_DEF
@@ -16,9 +16,14 @@
 #define METAL_BEGIN_RUNTIME_KERNELS_DEF \
   constexpr auto kMetalRuntimeKernelsSourceCode =
 #define METAL_END_RUNTIME_KERNELS_DEF ;
+#define METAL_BEGIN_RUNTIME_SIMDGROUP_KERNELS_DEF \
+  constexpr auto kMetalRuntimeSimdgroupKernelsSourceCode =
+#define METAL_END_RUNTIME_SIMDGROUP_KERNELS_DEF ;
 #else
 #define METAL_BEGIN_RUNTIME_KERNELS_DEF
 #define METAL_END_RUNTIME_KERNELS_DEF
+#define METAL_BEGIN_RUNTIME_SIMDGROUP_KERNELS_DEF
+#define METAL_END_RUNTIME_SIMDGROUP_KERNELS_DEF
 #endif  // TI_METAL_NESTED_INCLUDE
 
 #else
@@ -27,12 +32,60 @@ static_assert(false, "Do not include");
 
 #define METAL_BEGIN_RUNTIME_KERNELS_DEF
 #define METAL_END_RUNTIME_KERNELS_DEF
+#define METAL_BEGIN_RUNTIME_SIMDGROUP_KERNELS_DEF
+#define METAL_END_RUNTIME_SIMDGROUP_KERNELS_DEF
 
 #endif  // TI_INSIDE_METAL_CODEGEN
 
 // clang-format off
 METAL_BEGIN_RUNTIME_KERNELS_DEF
 STR(
+    // The element of the |child_idx|-th cell of |parent_elem| in the list of
+    // the child SNode.
+    ListgenElement make_listgen_child_elem(
+        thread const ListgenElement &parent_elem, device byte *parent_addr,
+        thread const SNodeMeta &parent_meta,
+        thread const SNodeMeta &child_meta,
+        device const SNodeExtractors &parent_extractors, int parent_snode_id,
+        int child_idx) {
+      ListgenElement child_elem;
+      if (parent_meta.type != SNodeMeta::Pointer) {
+        // Need to inherit |parent_elem|'s NodeManager settings. This means
+        // that the memory of the child cell will be part of that of the
+        // parent container.
+        //
+        // For example, denoting parent as Y, and child as Z:
+        //
+        // * Both Y and Z are `dense`: belonged_nodemgr.id = -1. This is the
+        //   simplest case, both Y and Z's memory location are known at
+        //   compile time. ==> Both live in the `root` buffer.
+        // * Y's parent (X) is a `pointer`: Y's NodeManager ID >= 0 (i.e.
+        //   |parent_elem.belonged_nodemgr| >= 0), Z inherits Y's
+        //   NodeManager settings. ==> Both Y and Z are in the memory
+        //   dynamically allocated for X.
+        // * Y is `dense`, but Z is a `pointer`: Z's memory location is
+        //   known at compile time! So Z itself still lives in the `root`
+        //   buffer! However, each Z cell stores the pointer allocated from
+        //   the runtime memory pool.
+        child_elem.belonged_nodemgr = parent_elem.belonged_nodemgr;
+        child_elem.mem_offset =
+            parent_elem.mem_offset + child_idx * parent_meta.element_stride;
+      } else {
+        child_elem.belonged_nodemgr.id = parent_snode_id;
+        child_elem.belonged_nodemgr.elem_idx =
+            SNodeRep_pointer::to_nodemgr_idx(parent_addr, child_idx);
+        // For `pointer` parent, |child_elem.belonged_nodemgr.elem_idx|
+        // has already encoded the memory offset for which this child cell
+        // belongs to. Therefore |mem_offset| is just 0.
+        child_elem.mem_offset = 0;
+      }
+      child_elem.mem_offset += child_meta.mem_offset_in_parent;
+
+      refine_coordinates(parent_elem.coords, parent_extractors, child_idx,
+                         &(child_elem.coords));
+      return child_elem;
+    }
+
     kernel void element_listgen(device byte *runtime_addr[[buffer(0)]],
                                 device byte *root_addr[[buffer(1)]],
                                 device int *args[[buffer(2)]],
@@ -52,7 +105,6 @@ STR(
       child_list.lm_data = (runtime->snode_lists + child_snode_id);
       child_list.mem_alloc = mem_alloc;
       const SNodeMeta parent_meta = runtime->snode_metas[parent_snode_id];
-      const int child_stride = parent_meta.element_stride;
       const int num_slots = parent_meta.num_slots;
       const SNodeMeta child_meta = runtime->snode_metas[child_snode_id];
       // |max_num_elems| is NOT padded to power-of-two, while |num_slots| is.
@@ -70,50 +122,208 @@ STR(
         device byte *parent_addr =
             mtl_lgen_snode_addr(parent_elem, root_addr, runtime, mem_alloc);
         if (is_active(parent_addr, parent_meta, child_idx)) {
-          ListgenElement child_elem;
-          if (parent_meta.type != SNodeMeta::Pointer) {
-            // Need to inherit |parent_elem|'s NodeManager settings. This means
-            // that the memory of the child cell will be part of that of the
-            // parent container.
-            //
-            // For example, denoting parent as Y, and child as Z:
-            //
-            // * Both Y and Z are `dense`: belonged_nodemgr.id = -1. This is the
-            //   simplest case, both Y and Z's memory location are known at
-            //   compile time. ==> Both live in the `root` buffer.
-            // * Y's parent (X) is a `pointer`: Y's NodeManager ID >= 0 (i.e.
-            //   |parent_elem.belonged_nodemgr| >= 0), Z inherits Y's
-            //   NodeManager settings. ==> Both Y and Z are in the memory
-            //   dynamically allocated for X.
-            // * Y is `dense`, but Z is a `pointer`: Z's memory location is
-            //   known at compile time! So Z itself still lives in the `root`
-            //   buffer! However, each Z cell stores the pointer allocated from
-            //   the runtime memory pool.
-            child_elem.belonged_nodemgr = parent_elem.belonged_nodemgr;
-            child_elem.mem_offset =
-                parent_elem.mem_offset + child_idx * child_stride;
-          } else {
-            child_elem.belonged_nodemgr.id = parent_snode_id;
-            child_elem.belonged_nodemgr.elem_idx =
-                SNodeRep_pointer::to_nodemgr_idx(parent_addr, child_idx);
-            // For `pointer` parent, |child_elem.belonged_nodemgr.elem_idx|
-            // has already encoded the memory offset for which this child cell
-            // belongs to. Therefore |mem_offset| is just 0.
-            child_elem.mem_offset = 0;
-          }
-          child_elem.mem_offset += child_meta.mem_offset_in_parent;
-
-          refine_coordinates(parent_elem.coords,
-                             runtime->snode_extractors[parent_snode_id],
-                             child_idx, &(child_elem.coords));
+          const auto child_elem = make_listgen_child_elem(
+              parent_elem, parent_addr, parent_meta, child_meta,
+              runtime->snode_extractors[parent_snode_id], parent_snode_id,
+              child_idx);
           child_list.append(child_elem);
         }
       }
+    }
+
+    // GC of a `pointer` SNode's NodeManager runs in three stages, each as a
+    // separate Metal kernel. For all of them, args[1] is the SNode ID.
+    //
+    // Stage 0: Moves the unused part of the free list to its front.
+    kernel void gc_compact_free_list(
+        device byte *runtime_addr[[buffer(0)]],
+        device int *args[[buffer(1)]],
+        const uint utid_[[thread_position_in_grid]],
+        const uint grid_size[[threads_per_grid]]) {
+      device Runtime *runtime =
+          reinterpret_cast<device Runtime *>(runtime_addr);
+      device MemoryAllocator *mem_alloc =
+          reinterpret_cast<device MemoryAllocator *>(runtime + 1);
+      device NodeManagerData *nm_data = (runtime->snode_allocators + args[1]);
+      NodeManager nm;
+      nm.nm_data = nm_data;
+      nm.mem_alloc = mem_alloc;
+      if (!nm.should_gc()) {
+        return;
+      }
+      ListManager free_list;
+      free_list.lm_data = &(nm_data->free_list);
+      free_list.mem_alloc = mem_alloc;
+      // |free_list_used| can go beyond the list size when the NodeManager falls
+      // back to allocating from |data_list|.
+      const int free_size = free_list.num_active();
+      const int used = min(atomic_load_explicit(&(nm_data->free_list_used),
+                                                metal::memory_order_relaxed),
+                           free_size);
+      const int num_to_move = free_size - used;
+      if (num_to_move <= used) {
+        // The source and destination regions do not overlap
+        for (int ii = utid_; ii < num_to_move; ii += grid_size) {
+          *reinterpret_cast<device int32_t *>(free_list.get_ptr(ii)) =
+              free_list.get<int32_t>(used + ii);
+        }
+      } else if (utid_ == 0) {
+        for (int ii = 0; ii < num_to_move; ++ii) {
+          *reinterpret_cast<device int32_t *>(free_list.get_ptr(ii)) =
+              free_list.get<int32_t>(used + ii);
+        }
+      }
+    }
+
+    // Stage 1 (serial): Shrinks the free list and empties the recycled list,
+    // remembering its size for stage 2.
+    kernel void gc_reset_free_list(
+        device byte *runtime_addr[[buffer(0)]],
+        device int *args[[buffer(1)]],
+        const uint utid_[[thread_position_in_grid]]) {
+      if (utid_ > 0) {
+        return;
+      }
+      device Runtime *runtime =
+          reinterpret_cast<device Runtime *>(runtime_addr);
+      device MemoryAllocator *mem_alloc =
+          reinterpret_cast<device MemoryAllocator *>(runtime + 1);
+      device NodeManagerData *nm_data = (runtime->snode_allocators + args[1]);
+      NodeManager nm;
+      nm.nm_data = nm_data;
+      nm.mem_alloc = mem_alloc;
+      if (!nm.should_gc()) {
+        ++(nm_data->num_skipped_gcs);
+        // Makes gc_zero_fill() a no-op
+        nm_data->recycled_list_size_backup = 0;
+        return;
+      }
+      nm_data->num_skipped_gcs = 0;
+      ListManager free_list;
+      free_list.lm_data = &(nm_data->free_list);
+      free_list.mem_alloc = mem_alloc;
+      ListManager recycled_list;
+      recycled_list.lm_data = &(nm_data->recycled_list);
+      recycled_list.mem_alloc = mem_alloc;
+      const int free_size = free_list.num_active();
+      const int used = min(atomic_load_explicit(&(nm_data->free_list_used),
+                                                metal::memory_order_relaxed),
+                           free_size);
+      free_list.resize(free_size - used);
+      atomic_store_explicit(&(nm_data->free_list_used), 0,
+                            metal::memory_order_relaxed);
+      nm_data->recycled_list_size_backup = recycled_list.num_active();
+      recycled_list.clear();
+    }
+
+    // Stage 2: Zero-fills the recycled elements and moves them to the free
+    // list. The recycled list has been cleared, but its data is still there.
+    kernel void gc_zero_fill(device byte *runtime_addr[[buffer(0)]],
+                             device int *args[[buffer(1)]],
+                             const uint utid_[[thread_position_in_grid]],
+                             const uint grid_size[[threads_per_grid]]) {
+      device Runtime *runtime =
+          reinterpret_cast<device Runtime *>(runtime_addr);
+      device MemoryAllocator *mem_alloc =
+          reinterpret_cast<device MemoryAllocator *>(runtime + 1);
+      device NodeManagerData *nm_data = (runtime->snode_allocators + args[1]);
+      NodeManager nm;
+      nm.nm_data = nm_data;
+      nm.mem_alloc = mem_alloc;
+      ListManager free_list;
+      free_list.lm_data = &(nm_data->free_list);
+      free_list.mem_alloc = mem_alloc;
+      ListManager recycled_list;
+      recycled_list.lm_data = &(nm_data->recycled_list);
+      recycled_list.mem_alloc = mem_alloc;
+      // Elements are aligned to 8 bytes, see KernelManager::init_runtime().
+      const int num_words = nm_data->data_list.element_stride / sizeof(int32_t);
+      const int num_recycled = nm_data->recycled_list_size_backup;
+      using ElemIndex = NodeManagerData::ElemIndex;
+      for (int ii = utid_; ii < num_recycled; ii += grid_size) {
+        const auto elem_idx = recycled_list.get<ElemIndex>(ii);
+        device int32_t *ptr =
+            reinterpret_cast<device int32_t *>(nm.get(elem_idx));
+        for (int j = 0; j < num_words; ++j) {
+          ptr[j] = 0;
+        }
+        free_list.append(elem_idx);
+      }
     })
 METAL_END_RUNTIME_KERNELS_DEF
 // clang-format on
 
+// The kernels using the SIMD-group functions, which need MSL 2.1. They are
+// emitted after the ones above, and only when they are used.
+// clang-format off
+METAL_BEGIN_RUNTIME_SIMDGROUP_KERNELS_DEF
+STR(
+    // The same as element_listgen(), except that the threads of a SIMD group
+    // append their active cells together, with a single atomic on the counter
+    // of |child_list| instead of one per cell. Each thread finds the position
+    // of its cell in the reserved range with a prefix sum over the SIMD group.
+    kernel void element_listgen_simd(
+        device byte *runtime_addr[[buffer(0)]],
+        device byte *root_addr[[buffer(1)]],
+        device int *args[[buffer(2)]],
+        const uint utid_[[thread_position_in_grid]],
+        const uint grid_size[[threads_per_grid]]) {
+      device Runtime *runtime =
+          reinterpret_cast<device Runtime *>(runtime_addr);
+      device MemoryAllocator *mem_alloc =
+          reinterpret_cast<device MemoryAllocator *>(runtime + 1);
+
+      const int parent_snode_id = args[0];
+      const int child_snode_id = args[1];
+      ListManager parent_list;
+      parent_list.lm_data = (runtime->snode_lists + parent_snode_id);
+      parent_list.mem_alloc = mem_alloc;
+      ListManager child_list;
+      child_list.lm_data = (runtime->snode_lists + child_snode_id);
+      child_list.mem_alloc = mem_alloc;
+      const SNodeMeta parent_meta = runtime->snode_metas[parent_snode_id];
+      const int num_slots = parent_meta.num_slots;
+      const SNodeMeta child_meta = runtime->snode_metas[child_snode_id];
+      const int max_num_elems = args[2];
+      // The parent list does not change during this kernel.
+      const int num_parents = parent_list.num_active();
+      for (int ii = utid_; ii < max_num_elems; ii += grid_size) {
+        const int parent_idx = (ii / num_slots);
+        if (parent_idx >= num_parents) {
+          // The SIMD-group functions below only involve the active threads.
+          return;
+        }
+        const int child_idx = (ii % num_slots);
+        const auto parent_elem = parent_list.get<ListgenElement>(parent_idx);
+        device byte *parent_addr =
+            mtl_lgen_snode_addr(parent_elem, root_addr, runtime, mem_alloc);
+        const int active =
+            (is_active(parent_addr, parent_meta, child_idx) ? 1 : 0);
+        const int num_appended = simd_sum(active);
+        if (num_appended == 0) {
+          continue;
+        }
+        const int rank = simd_prefix_exclusive_sum(active);
+        int begin = 0;
+        if (simd_is_first()) {
+          begin = child_list.reserve_new_elems(num_appended);
+        }
+        begin = simd_broadcast_first(begin);
+        if (active) {
+          const auto child_elem = make_listgen_child_elem(
+              parent_elem, parent_addr, parent_meta, child_meta,
+              runtime->snode_extractors[parent_snode_id], parent_snode_id,
+              child_idx);
+          child_list.set_reserved(begin + rank, child_elem);
+        }
+      }
+    })
+METAL_END_RUNTIME_SIMDGROUP_KERNELS_DEF
+// clang-format on
+
 #undef METAL_BEGIN_RUNTIME_KERNELS_DEF
 #undef METAL_END_RUNTIME_KERNELS_DEF
+#undef METAL_BEGIN_RUNTIME_SIMDGROUP_KERNELS_DEF
+#undef METAL_END_RUNTIME_SIMDGROUP_KERNELS_DEF
 
 #include "taichi/backends/metal/shaders/epilog.h"
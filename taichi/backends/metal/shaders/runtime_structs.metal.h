@@ -95,6 +95,10 @@ STR(
       atomic_int free_list_used;
       // Need this field to bookkeep some data during GC
       int recycled_list_size_backup;
+      // See SNode::gc_threshold
+      float gc_threshold;
+      int32_t gc_period;
+      int32_t num_skipped_gcs;
     };
 
     // This class is very similar to metal::SNodeDescriptor
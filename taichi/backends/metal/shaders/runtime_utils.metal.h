@@ -101,6 +101,31 @@ STR(
         }
       }
 
+      // Reserves |n| elements at once, and returns the index of the first one.
+      // Their chunks are allocated by get_reserved_ptr().
+      int reserve_new_elems(int n) {
+        return atomic_fetch_add_explicit(&lm_data->next, n,
+                                         metal::memory_order_relaxed);
+      }
+
+      device char *get_reserved_ptr(int elem_idx) {
+        const int chunk_idx = get_chunk_index(elem_idx);
+        const PtrOffset chunk_ptr_offs = ensure_chunk(chunk_idx);
+        return get_elem_from_chunk(elem_idx, chunk_ptr_offs);
+      }
+
+      template <typename T>
+      void set_reserved(int elem_idx, thread const T &elem) {
+        device char *ptr = get_reserved_ptr(elem_idx);
+        thread char *elem_ptr = (thread char *)(&elem);
+
+        for (int i = 0; i < lm_data->element_stride; ++i) {
+          *ptr = *elem_ptr;
+          ++ptr;
+          ++elem_ptr;
+        }
+      }
+
       device char *get_ptr(ReservedElemPtrOffset offs) {
         return mtl_memalloc_to_ptr(mem_alloc, offs.value());
       }
@@ -199,6 +224,32 @@ STR(
         recycled_list.mem_alloc = mem_alloc;
         recycled_list.append(i);
       }
+
+      // Whether a requested GC should run now. Does not modify any state, so
+      // that all the GC stages reach the same decision.
+      bool should_gc() {
+        if (nm_data->gc_threshold <= 0) {
+          return true;
+        }
+        ListManager recycled_list;
+        recycled_list.lm_data = &(nm_data->recycled_list);
+        recycled_list.mem_alloc = mem_alloc;
+        const int num_recycled = recycled_list.num_active();
+        if (num_recycled == 0) {
+          return false;
+        }
+        ListManager data_list;
+        data_list.lm_data = &(nm_data->data_list);
+        data_list.mem_alloc = mem_alloc;
+        // Excludes the ambient element
+        const int num_allocated = data_list.num_active() - 1;
+        if ((float)num_recycled >=
+            nm_data->gc_threshold * (float)num_allocated) {
+          return true;
+        }
+        return nm_data->gc_period > 0 &&
+               nm_data->num_skipped_gcs + 1 >= nm_data->gc_period;
+      }
     };
 
     // To make codegen implementation easier, I've made these exceptions:
@@ -6,6 +6,8 @@
 #include "taichi/backends/opengl/opengl_api.h"
 #include "taichi/backends/opengl/opengl_data_types.h"
 #include "taichi/backends/opengl/opengl_kernel_util.h"
+#include "taichi/backends/vulkan/vulkan_runtime.h"
+#include "taichi/ir/analysis.h"
 #include "taichi/ir/ir.h"
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
@@ -44,18 +46,27 @@ std::string opengl_atomic_op_type_cap_name(AtomicOpType type) {
   return type_names[type];
 }
 
+// Generates the GLSL of |kernel| into a CompiledProgramT, which is either
+// opengl::CompiledProgram or vulkan::CompiledProgram. The shaders only use
+// the extensions in |supported| of the device they are compiled for.
+template <typename CompiledProgramT>
 class KernelGen : public IRVisitor {
   Kernel *kernel;
 
  public:
   KernelGen(Kernel *kernel,
             std::string kernel_name,
-            StructCompiledResult *struct_compiled)
+            StructCompiledResult *struct_compiled,
+            std::unique_ptr<CompiledProgramT> compiled_program,
+            const SupportedExtensions &supported,
+            std::string glsl_version)
       : kernel(kernel),
         struct_compiled_(struct_compiled),
         kernel_name_(kernel_name),
         glsl_kernel_prefix_(kernel_name),
-        compiled_program_(std::make_unique<CompiledProgram>(kernel)),
+        supported_(supported),
+        glsl_version_(std::move(glsl_version)),
+        compiled_program_(std::move(compiled_program)),
         ps(std::make_unique<ParallelSize>()) {
     allow_undefined_visitor = true;
     invoke_default_visitor = true;
@@ -69,11 +80,14 @@ class KernelGen : public IRVisitor {
   std::string kernel_name_;
   std::string root_snode_type_name_;
   std::string glsl_kernel_prefix_;
+  const SupportedExtensions supported_;
+  // e.g. "#version 430 core\n".
+  const std::string glsl_version_;
 
   // throughout variables:
   int glsl_kernel_count_{0};
   bool is_top_level_{true};
-  std::unique_ptr<CompiledProgram> compiled_program_;
+  std::unique_ptr<CompiledProgramT> compiled_program_;
   UsedFeature used;  // TODO: is this actually per-offload?
 
   // per-offload variables:
@@ -82,6 +96,11 @@ class KernelGen : public IRVisitor {
   std::string glsl_kernel_name_;
   std::unique_ptr<ParallelSize> ps;
   bool used_tls;  // TODO: move into UsedFeature?
+  // The f32 fields whose atomic adds are summed in shared memory, see
+  // find_aggregated_snodes().
+  std::unordered_set<const SNode *> aggregated_snodes_;
+  // The atomics combined within subgroups, see find_subgroup_reductions().
+  std::unordered_set<Stmt *> subgroup_reductions_;
 
   template <typename... Args>
   void emit(std::string f, Args &&... args) {
@@ -96,7 +115,7 @@ class KernelGen : public IRVisitor {
   std::string opengl_data_type_short_name(DataType dt) {
     if (dt->is_primitive(PrimitiveTypeID::i64) ||
         dt->is_primitive(PrimitiveTypeID::u64)) {
-      if (!TI_OPENGL_REQUIRE(used, GL_ARB_gpu_shader_int64)) {
+      if (!TI_OPENGL_REQUIRE(supported_, used, GL_ARB_gpu_shader_int64)) {
         TI_ERROR(
             "Extension GL_ARB_gpu_shader_int64 not supported on your OpenGL");
       }
@@ -184,6 +203,16 @@ class KernelGen : public IRVisitor {
       }
     }
 
+    if (!aggregated_snodes_.empty()) {
+      kernel_header += fmt::format(
+          "const int _agg_size_ = {};\n",
+          kernel->program.config.opengl_atomic_aggregation_slots);
+      kernel_header += (
+#include "taichi/backends/opengl/shaders/atomics_agg_f32.glsl.h"
+      );
+      aggregated_snodes_.clear();
+    }
+
     if (used.random) {
       kernel_header += (
 #include "taichi/backends/opengl/shaders/random.glsl.h"
@@ -209,8 +238,14 @@ class KernelGen : public IRVisitor {
     extensions += "#extension " #x ": enable\n";
 #include "taichi/inc/opengl_extension.inc.h"
 #undef PER_OPENGL_EXTENSION
+    if (used.subgroup) {
+      extensions +=
+          "#extension GL_KHR_shader_subgroup_basic: enable\n"
+          "#extension GL_KHR_shader_subgroup_vote: enable\n"
+          "#extension GL_KHR_shader_subgroup_arithmetic: enable\n";
+    }
     auto kernel_src_code =
-        "#version 430 core\n" + extensions + "precision highp float;\n" +
+        glsl_version_ + extensions + "precision highp float;\n" +
         line_appender_header_.lines() + line_appender_.lines();
     compiled_program_->add(std::move(glsl_kernel_name_), kernel_src_code,
                            std::move(ps));
@@ -403,9 +438,15 @@ class KernelGen : public IRVisitor {
       ptr_signats[stmt->id] = "data";
   }
 
+  void mark_written(Stmt *ptr) {
+    if (ptr_signats.at(ptr->id) == "extr")
+      used.buf_extr_written = true;
+  }
+
   void visit(GlobalStoreStmt *stmt) override {
     TI_ASSERT(stmt->width() == 1);
     auto dt = stmt->data->element_type();
+    mark_written(stmt->ptr);
     emit("_{}_{}_[{} >> {}] = {};",
          ptr_signats.at(stmt->ptr->id),  // throw out_of_range if not a pointer
          opengl_data_type_short_name(dt), stmt->ptr->short_name(),
@@ -603,22 +644,116 @@ class KernelGen : public IRVisitor {
 
   void visit(AtomicOpStmt *stmt) override {
     TI_ASSERT(stmt->width() == 1);
+    mark_written(stmt->dest);
+    if (is_aggregated(stmt)) {
+      used.simulated_atomic_float = true;
+      used.int32 = true;
+      emit("atomicAdd_agg_f32({} >> 2, {});", stmt->dest->short_name(),
+           stmt->val->short_name());
+      return;
+    }
+    const auto subgroup_op = get_subgroup_reduction_op(stmt);
+    if (subgroup_op.empty()) {
+      emit_atomic(stmt, stmt->val->short_name());
+      return;
+    }
+    // When all the active threads of the subgroup add to the same address,
+    // e.g. in the reductions to a scalar field, one of them adds their sum.
+    used.subgroup = true;
+    const auto reduced = fmt::format("{}_sg", stmt->short_name());
+    emit("if (subgroupAllEqual({})) {{", stmt->dest->short_name());
+    {
+      ScopedIndent _s(line_appender_);
+      emit("{} {} = {}({});",
+           opengl_data_type_name(stmt->val->element_type()), reduced,
+           subgroup_op, stmt->val->short_name());
+      emit("if (subgroupElect()) {{");
+      {
+        ScopedIndent _s2(line_appender_);
+        emit_atomic(stmt, reduced);
+      }
+      emit("}}");
+    }
+    emit("}} else {{");
+    {
+      ScopedIndent _s(line_appender_);
+      emit_atomic(stmt, stmt->val->short_name());
+    }
+    emit("}}");
+  }
+
+  // The subgroup operation combining the values of |stmt| if it is one of
+  // |subgroup_reductions_|, or an empty string.
+  std::string get_subgroup_reduction_op(AtomicOpStmt *stmt) {
+    if (!subgroup_reductions_.count(stmt) ||
+        ptr_signats.at(stmt->dest->id) == "tls")
+      return "";
+    auto dt = stmt->dest->element_type().ptr_removed();
+    const bool is_i32 = dt->is_primitive(PrimitiveTypeID::i32);
+    if (!is_i32 && !dt->is_primitive(PrimitiveTypeID::f32))
+      return "";
+    switch (stmt->op_type) {
+      case AtomicOpType::add:
+      case AtomicOpType::sub:
+        return "subgroupAdd";
+      case AtomicOpType::min:
+        return "subgroupMin";
+      case AtomicOpType::max:
+        return "subgroupMax";
+      case AtomicOpType::bit_and:
+        return is_i32 ? "subgroupAnd" : "";
+      case AtomicOpType::bit_or:
+        return is_i32 ? "subgroupOr" : "";
+      case AtomicOpType::bit_xor:
+        return is_i32 ? "subgroupXor" : "";
+      default:
+        return "";
+    }
+  }
+
+  // The atomics of the parallel loop |offload| whose results are unused, so
+  // that the threads of a subgroup can combine them into one.
+  std::unordered_set<Stmt *> find_subgroup_reductions(OffloadedStmt *offload) {
+    std::unordered_set<Stmt *> result;
+    if (!supported_.subgroup_reductions ||
+        !kernel->program.config.opengl_subgroup_reductions)
+      return result;
+    auto stmts = irpass::analysis::gather_statements(
+        offload, [](Stmt *) { return true; });
+    std::unordered_set<Stmt *> operands;
+    for (Stmt *s : stmts) {
+      for (int i = 0; i < s->num_operands(); i++) {
+        operands.insert(s->operand(i));
+      }
+    }
+    for (Stmt *s : stmts) {
+      if (s->is<AtomicOpStmt>() && !operands.count(s))
+        result.insert(s);
+    }
+    return result;
+  }
+
+  void emit_atomic(AtomicOpStmt *stmt, const std::string &val) {
     auto dt = stmt->dest->element_type().ptr_removed();
     if (dt->is_primitive(PrimitiveTypeID::i32) ||
-        (TI_OPENGL_REQUIRE(used, GL_NV_shader_atomic_int64) &&
+        (TI_OPENGL_REQUIRE(supported_, used, GL_NV_shader_atomic_int64) &&
          dt->is_primitive(PrimitiveTypeID::i64)) ||
         ((stmt->op_type == AtomicOpType::add ||
           stmt->op_type == AtomicOpType::sub) &&
-         ((TI_OPENGL_REQUIRE(used, GL_NV_shader_atomic_float) &&
+         (((TI_OPENGL_REQUIRE(supported_, used,
+                              GL_NV_shader_atomic_float) ||
+            TI_OPENGL_REQUIRE(supported_, used,
+                              GL_EXT_shader_atomic_float)) &&
            dt->is_primitive(PrimitiveTypeID::f32)) ||
-          (TI_OPENGL_REQUIRE(used, GL_NV_shader_atomic_float64) &&
+          (TI_OPENGL_REQUIRE(supported_, used,
+                             GL_NV_shader_atomic_float64) &&
            dt->is_primitive(PrimitiveTypeID::f64))))) {
       emit("{} {} = {}(_{}_{}_[{} >> {}], {});",
            opengl_data_type_name(stmt->val->element_type()), stmt->short_name(),
            opengl_atomic_op_type_cap_name(stmt->op_type),
            ptr_signats.at(stmt->dest->id), opengl_data_type_short_name(dt),
            stmt->dest->short_name(), opengl_data_address_shifter(dt),
-           stmt->val->short_name());
+           val);
     } else {
       if (dt != PrimitiveType::f32) {
         TI_ERROR(
@@ -634,8 +769,75 @@ class KernelGen : public IRVisitor {
            opengl_atomic_op_type_cap_name(stmt->op_type),
            ptr_signats.at(stmt->dest->id), opengl_data_type_short_name(dt),
            stmt->dest->short_name(), opengl_data_address_shifter(dt),
-           stmt->val->short_name());
+           val);
+    }
+  }
+
+  // The place SNode written by the atomic adds to |ptr|, if it is an f32
+  // field of the root buffer.
+  static const SNode *get_f32_place(Stmt *ptr) {
+    auto getch = ptr->cast<GetChStmt>();
+    if (!getch || !getch->output_snode->is_place() ||
+        !getch->output_snode->dt->is_primitive(PrimitiveTypeID::f32))
+      return nullptr;
+    return getch->output_snode;
+  }
+
+  bool is_aggregated(AtomicOpStmt *stmt) {
+    auto snode = get_f32_place(stmt->dest);
+    return snode && aggregated_snodes_.count(snode) &&
+           ptr_signats.at(stmt->dest->id) == "data";
+  }
+
+  // Without native f32 atomics, an atomic add retries its CAS on the same
+  // word as long as other threads keep adding to it, e.g. in the scatters of
+  // particles to grids. The threads of a workgroup sum their adds to the same
+  // cell in a table in shared memory instead, which the workgroup adds to the
+  // fields once at the end of the task. That only holds for the fields the
+  // task does nothing else with: no loads, no stores, and no atomics whose
+  // results are used, since those would miss the sums not yet added.
+  std::unordered_set<const SNode *> find_aggregated_snodes(
+      OffloadedStmt *offload) {
+    std::unordered_set<const SNode *> result;
+    const int slots = kernel->program.config.opengl_atomic_aggregation_slots;
+    if (slots <= 0 || supported_.extension_GL_NV_shader_atomic_float ||
+        supported_.extension_GL_EXT_shader_atomic_float)
+      return result;
+    TI_ERROR_IF((slots & (slots - 1)) != 0,
+                "opengl_atomic_aggregation_slots must be a power of two, "
+                "got {}",
+                slots);
+    auto stmts = irpass::analysis::gather_statements(
+        offload, [](Stmt *) { return true; });
+    std::unordered_set<Stmt *> operands;
+    for (Stmt *s : stmts) {
+      for (int i = 0; i < s->num_operands(); i++) {
+        operands.insert(s->operand(i));
+      }
+    }
+    std::unordered_set<const SNode *> excluded;
+    for (Stmt *s : stmts) {
+      if (auto atomic = s->cast<AtomicOpStmt>()) {
+        auto snode = get_f32_place(atomic->dest);
+        if (!snode)
+          continue;
+        if (atomic->op_type == AtomicOpType::add && atomic->width() == 1 &&
+            !operands.count(atomic))
+          result.insert(snode);
+        else
+          excluded.insert(snode);
+      } else if (auto load = s->cast<GlobalLoadStmt>()) {
+        if (auto snode = get_f32_place(load->ptr))
+          excluded.insert(snode);
+      } else if (auto store = s->cast<GlobalStoreStmt>()) {
+        if (auto snode = get_f32_place(store->ptr))
+          excluded.insert(snode);
+      }
+    }
+    for (auto snode : excluded) {
+      result.erase(snode);
     }
+    return result;
   }
 
   void visit(TernaryOpStmt *tri) override {
@@ -703,7 +905,7 @@ class KernelGen : public IRVisitor {
   }
 
   void visit(ExternalFuncCallStmt *stmt) override {
-    TI_ASSERT(!stmt->func);
+    TI_ASSERT(!stmt->func && stmt->runtime_func.empty());
     auto format = stmt->source;
     std::string source;
 
@@ -820,6 +1022,10 @@ class KernelGen : public IRVisitor {
     emit("void {}()", glsl_kernel_name);
     this->glsl_kernel_name_ = glsl_kernel_name;
     emit("{{ // range for");
+    aggregated_snodes_ = find_aggregated_snodes(stmt);
+    subgroup_reductions_ = find_subgroup_reductions(stmt);
+    if (!aggregated_snodes_.empty())
+      emit("_agg_clear_();");
 
     used_tls = (stmt->tls_prologue != nullptr);
     if (used_tls) {
@@ -861,6 +1067,15 @@ class KernelGen : public IRVisitor {
                                       : fmt::format("_gtmp_i32_[{} >> 2]",
                                                     stmt->end_offset);
       ps = std::make_unique<ParallelSize>(stmt->block_dim, stmt->grid_dim);
+      // Sizes the grid on the device, as the host never knows the range.
+      ParallelSize::IndirectRange range;
+      range.const_begin = stmt->const_begin;
+      range.const_end = stmt->const_end;
+      range.begin = stmt->const_begin ? stmt->begin_value : stmt->begin_offset;
+      range.end = stmt->const_end ? stmt->end_value : stmt->end_offset;
+      range.strides_per_thread = used_tls ? 32 : 1;
+      range.max_num_groups = stmt->grid_dim;
+      ps->indirect = range;
       emit("int _beg = {}, _end = {};", begin_expr, end_expr);
       ScopedGridStrideLoop _gsl(this, "_end - _beg");
       emit("int _itv = _beg + _sid;");
@@ -874,6 +1089,9 @@ class KernelGen : public IRVisitor {
       emit("}}");
     }
     used_tls = false;
+    if (!aggregated_snodes_.empty())
+      emit("_agg_flush_();");
+    subgroup_reductions_.clear();
 
     emit("}}\n");
   }
@@ -885,13 +1103,26 @@ class KernelGen : public IRVisitor {
     emit("void {}()", glsl_kernel_name);
     this->glsl_kernel_name_ = glsl_kernel_name;
     emit("{{ // struct for {}", stmt->snode->node_type_name);
+    aggregated_snodes_ = find_aggregated_snodes(stmt);
+    subgroup_reductions_ = find_subgroup_reductions(stmt);
     {
       ScopedIndent _s(line_appender_);
+      if (!aggregated_snodes_.empty())
+        emit("_agg_clear_();");
       ps = std::make_unique<ParallelSize>(stmt->block_dim, stmt->grid_dim);
-      ScopedGridStrideLoop _gsl(this, "_list_len_");
-      emit("int _itv = _list_[_sid];");
-      stmt->body->accept(this);
+      ParallelSize::IndirectRange range;
+      range.struct_for = true;
+      range.max_num_groups = stmt->grid_dim;
+      ps->indirect = range;
+      {
+        ScopedGridStrideLoop _gsl(this, "_list_len_");
+        emit("int _itv = _list_[_sid];");
+        stmt->body->accept(this);
+      }
+      if (!aggregated_snodes_.empty())
+        emit("_agg_flush_();");
     }
+    subgroup_reductions_.clear();
     emit("}}\n");
   }
 
@@ -920,27 +1151,28 @@ class KernelGen : public IRVisitor {
                    "Non-top-level dynamic not supported yet on OpenGL");
     size_t addr = get_snode_meta_address(snode);
     used.int32 = true;
-    emit("_list_len_ = _data_i32_[{} >> 2];", addr);
-    emit("for (int i = 0; i < _list_len_; i++) {{");
-    {
-      ScopedIndent _s(line_appender_);
-      emit("_list_[i] = i;");
-    }
-    emit("}}");
+    emit("int _len = _data_i32_[{} >> 2];", addr);
+    generate_listgen_loop("_len");
   }
 
   void generate_listgen_for_dense(const SNode *snode) {
     TI_ASSERT(snode->type == SNodeType::dense);
     // the `length` field of a dynamic SNode is at it's end:
     // | x[0] | x[1] | x[2] | x[3] | ... | len |
-    emit("_list_len_ = {};",
-         struct_compiled_->snode_map[snode->node_type_name].length);
-    emit("for (int i = 0; i < _list_len_; i++) {{");
-    {
-      ScopedIndent _s(line_appender_);
-      emit("_list_[i] = i;");
-    }
-    emit("}}");
+    const int length =
+        struct_compiled_->snode_map[snode->node_type_name].length;
+    emit("int _len = {};", length);
+    generate_listgen_loop("_len", length);
+  }
+
+  // All the cells of the dense and dynamic SNodes up to their length are
+  // active, so that their lists are the indices themselves, written on all
+  // the threads of the task.
+  void generate_listgen_loop(const std::string &length,
+                             int const_length = -1) {
+    emit("if (gl_GlobalInvocationID.x == 0) _list_len_ = {};", length);
+    ScopedGridStrideLoop _gsl(this, length, const_length);
+    emit("_list_[_sid] = _sid;");
   }
 
   void generate_listgen_kernel(OffloadedStmt *stmt) {
@@ -950,6 +1182,7 @@ class KernelGen : public IRVisitor {
     this->glsl_kernel_name_ = glsl_kernel_name;
     used.listman = true;
     emit("{{ // listgen {}", stmt->snode->node_type_name);
+    ps = std::make_unique<ParallelSize>(stmt->block_dim, stmt->grid_dim);
     {
       ScopedIndent _s(line_appender_);
       if (stmt->snode->type == SNodeType::dense) {
@@ -1078,7 +1311,7 @@ class KernelGen : public IRVisitor {
     return kernel;
   }
 
-  std::unique_ptr<CompiledProgram> get_compiled_program() {
+  std::unique_ptr<CompiledProgramT> get_compiled_program() {
     // We have to set it at the last moment, to get all used feature.
     compiled_program_->set_used(used);
     return std::move(compiled_program_);
@@ -1094,8 +1327,24 @@ class KernelGen : public IRVisitor {
 }  // namespace
 
 FunctionType OpenglCodeGen::gen(void) {
+  if (vulkan_runtime_) {
+    KernelGen<vulkan::CompiledProgram> codegen(
+        kernel_, kernel_name_, struct_compiled_,
+        std::make_unique<vulkan::CompiledProgram>(kernel_, vulkan_runtime_),
+        vulkan_runtime_->supported_extensions(), "#version 450\n");
+    codegen.run(*prog_->snode_root);
+    auto compiled = codegen.get_compiled_program();
+    auto *ptr = compiled.get();
+    vulkan_runtime_->keep(std::move(compiled));
+    return [ptr, runtime = vulkan_runtime_](Context &ctx) {
+      ptr->launch(ctx, runtime);
+    };
+  }
 #if defined(TI_WITH_OPENGL)
-  KernelGen codegen(kernel_, kernel_name_, struct_compiled_);
+  KernelGen<CompiledProgram> codegen(
+      kernel_, kernel_name_, struct_compiled_,
+      std::make_unique<CompiledProgram>(kernel_),
+      opengl_supported_extensions(), "#version 430 core\n");
   codegen.run(*prog_->snode_root);
   auto compiled = codegen.get_compiled_program();
   auto *ptr = compiled.get();
@@ -11,6 +11,11 @@
 #include "taichi/codegen/codegen.h"
 
 TLANG_NAMESPACE_BEGIN
+
+namespace vulkan {
+class VulkanRuntime;
+}  // namespace vulkan
+
 namespace opengl {
 
 class OpenglCodeGen {
@@ -23,6 +28,15 @@ class OpenglCodeGen {
         kernel_launcher_(launcher) {
   }
 
+  // Generates the same GLSL for Vulkan, compiled to SPIR-V.
+  OpenglCodeGen(const std::string &kernel_name,
+                StructCompiledResult *struct_compiled,
+                vulkan::VulkanRuntime *runtime)
+      : kernel_name_(kernel_name),
+        struct_compiled_(struct_compiled),
+        vulkan_runtime_(runtime) {
+  }
+
   FunctionType compile(Program &program, Kernel &kernel);
 
  private:
@@ -34,7 +48,8 @@ class OpenglCodeGen {
   Program *prog_;
   Kernel *kernel_;
   [[maybe_unused]] StructCompiledResult *struct_compiled_;
-  [[maybe_unused]] GLSLLauncher *kernel_launcher_;
+  [[maybe_unused]] GLSLLauncher *kernel_launcher_{nullptr};
+  vulkan::VulkanRuntime *vulkan_runtime_{nullptr};
 };
 
 }  // namespace opengl
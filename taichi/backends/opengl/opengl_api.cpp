@@ -1,6 +1,9 @@
 //#define _GLSL_DEBUG 1
 #include "opengl_api.h"
 
+#include <filesystem>
+#include <thread>
+
 #include "taichi/backends/opengl/opengl_kernel_util.h"
 #include "taichi/program/kernel.h"
 #include "taichi/program/program.h"
@@ -25,9 +28,41 @@ namespace opengl {
 // value according to OpenGL spec in case glGetIntegerv didn't work properly
 int opengl_max_block_dim = 1024;
 int opengl_max_grid_dim = 1024;
+// The minimum of GL_MAX_COMPUTE_WORK_GROUP_COUNT guaranteed by the spec.
+int opengl_max_num_work_groups = 65535;
+// 0 if the driver cannot save the programs it builds, see ProgramCache.
+int opengl_num_program_binary_formats = 0;
+bool opengl_has_subgroup_reductions = false;
 
 #ifdef TI_WITH_OPENGL
 
+// GL_KHR_shader_subgroup
+#ifndef GL_SUBGROUP_SUPPORTED_STAGES_KHR
+#define GL_SUBGROUP_SUPPORTED_STAGES_KHR 0x9533
+#define GL_SUBGROUP_SUPPORTED_FEATURES_KHR 0x9534
+#define GL_SUBGROUP_FEATURE_BASIC_BIT_KHR 0x00000001
+#define GL_SUBGROUP_FEATURE_VOTE_BIT_KHR 0x00000002
+#define GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR 0x00000004
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT
+#define GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT 0x00004000
+#endif
+
+// glBufferStorage is only core since OpenGL 4.4 while we create a 4.3 context,
+// so it's loaded from GL_ARB_buffer_storage in initialize_opengl, if present.
+typedef void(APIENTRYP PFNTIGLBUFFERSTORAGEPROC)(GLenum target,
+                                                 GLsizeiptr size,
+                                                 const void *data,
+                                                 GLbitfield flags);
+static PFNTIGLBUFFERSTORAGEPROC ti_glBufferStorage = nullptr;
+
 std::string get_opengl_error_string(GLenum err) {
   switch (err) {
 #define PER_GL_ERR(x) \
@@ -147,6 +182,122 @@ struct GLProgram {
   void use() const {
     glUseProgram(id_);
   }
+
+  // Instead of link(). Returns false if the driver rejects the binary, e.g.
+  // one saved by an older version.
+  bool load_binary(uint32 format, const std::vector<uint8> &binary) const {
+    glProgramBinary(id_, format, binary.data(), (GLsizei)binary.size());
+    int status = GL_FALSE;
+    glGetProgramiv(id_, GL_LINK_STATUS, &status);
+    // The unknown formats raise GL_INVALID_ENUM.
+    glGetError();
+    return status == GL_TRUE;
+  }
+
+  // Requires GL_PROGRAM_BINARY_RETRIEVABLE_HINT to be set before link().
+  bool get_binary(uint32 &format, std::vector<uint8> &binary) const {
+    GLint length = 0;
+    glGetProgramiv(id_, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+      return false;
+    binary.resize(length);
+    GLenum binary_format = 0;
+    glGetProgramBinary(id_, length, &length, &binary_format, binary.data());
+    if (glGetError() != GL_NO_ERROR || length <= 0)
+      return false;
+    binary.resize(length);
+    format = binary_format;
+    return true;
+  }
+};
+
+// The binaries of the programs built from the generated GLSL, stored across
+// runs so that the drivers need not compile and link them again, which takes
+// hundreds of milliseconds per kernel on some of them. The entries are keyed
+// by the source and by the driver, since the binaries are only valid for the
+// exact driver that built them. When the driver rejects one anyway, the
+// program is built from the source and the entry replaced.
+class ProgramCache {
+ public:
+  explicit ProgramCache(const std::string &path) : path_(path) {
+  }
+
+  std::unique_ptr<GLProgram> load_or_build(const std::string &source) {
+    if (path_.empty() || opengl_num_program_binary_formats == 0) {
+      return build(source, false);
+    }
+    Entry entry;
+    entry.key = get_driver_string() + "\n" + source;
+    const auto fn =
+        fmt::format("{}/program_{:016x}.bin", path_, hash_string(entry.key));
+    std::error_code ec;
+    if (std::filesystem::exists(fn, ec)) {
+      Entry cached;
+      read_from_binary_file(cached, fn);
+      if (cached.key == entry.key) {
+        auto program = std::make_unique<GLProgram>();
+        if (program->load_binary(cached.format, cached.binary)) {
+          TI_TRACE("[glsl] Program loaded from cache [{}]", fn);
+          return program;
+        }
+      }
+      TI_TRACE("[glsl] Stale program in cache [{}]", fn);
+    }
+    auto program = build(source, true);
+    if (program->get_binary(entry.format, entry.binary)) {
+      store(entry, fn);
+    }
+    return program;
+  }
+
+ private:
+  struct Entry {
+    // The driver and the source the binary was built from.
+    std::string key;
+    uint32 format{0};
+    std::vector<uint8> binary;
+
+    TI_IO_DEF(key, format, binary);
+  };
+
+  static std::unique_ptr<GLProgram> build(const std::string &source,
+                                          bool retrievable) {
+    auto program = std::make_unique<GLProgram>(GLShader(source));
+    if (retrievable) {
+      glProgramParameteri(program->id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                          GL_TRUE);
+    }
+    program->link();
+    return program;
+  }
+
+  static std::string get_driver_string() {
+    static const std::string driver = fmt::format(
+        "{}|{}|{}", (const char *)glGetString(GL_VENDOR),
+        (const char *)glGetString(GL_RENDERER),
+        (const char *)glGetString(GL_VERSION));
+    return driver;
+  }
+
+  void store(const Entry &entry, const std::string &fn) {
+    std::error_code ec;
+    std::filesystem::create_directories(path_, ec);
+    // As in LlvmOfflineCache::store(), so that concurrent processes never
+    // read a partially written entry.
+    auto tmp_fn = fmt::format(
+        "{}.tmp_{:x}", fn,
+        std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    write_to_binary_file(entry, tmp_fn);
+    std::filesystem::rename(tmp_fn, fn, ec);
+    if (ec) {
+      TI_WARN("Failed to store program into cache [{}]: {}", fn, ec.message());
+      std::filesystem::remove(tmp_fn, ec);
+      return;
+    }
+    TI_TRACE("[glsl] Program stored into cache [{}]", fn);
+  }
+
+  std::string path_;
 };
 
 // https://blog.csdn.net/ylbs110/article/details/52074826
@@ -244,6 +395,18 @@ struct GLSSBO {
     glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
     check_opengl_error("glUnmapBuffer");
   }
+
+  // Allocates an immutable data store that stays mapped (coherently) into the
+  // host address space until the SSBO is deleted.
+  void *allocate_persistent(size_t size) const {
+    constexpr GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT |
+                                 GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id_);
+    check_opengl_error("glBindBuffer");
+    ti_glBufferStorage(GL_SHADER_STORAGE_BUFFER, size, nullptr, flags);
+    check_opengl_error("glBufferStorage");
+    return map(0, size, flags);
+  }
 };
 
 struct GLBuffer : GLSSBO {
@@ -301,6 +464,36 @@ struct GLBufferTable {
   }
 };
 
+// An external array living in device memory across launches. |base| is where
+// the buffer is persistently mapped, and is handed out as the host pointer of
+// the array, so that neither side ever needs to copy it.
+struct GLPersistentBuffer : GLSSBO {
+  void *base;
+  size_t size;
+
+  GLPersistentBuffer(size_t size) : size(size) {
+    base = allocate_persistent(size);
+  }
+};
+
+struct GLPersistentBufferTable {
+  // Keyed by |base|
+  std::map<uint64, std::unique_ptr<GLPersistentBuffer>> bufs;
+
+  GLPersistentBuffer *lookup(void *ptr, size_t size) const {
+    auto it = bufs.upper_bound((uint64)ptr);
+    if (it == bufs.begin())
+      return nullptr;
+    --it;
+    auto *buf = it->second.get();
+    if ((char *)ptr + size > (char *)buf->base + buf->size)
+      return nullptr;
+    return buf;
+  }
+};
+
+static GLPersistentBufferTable persistent_bufs;
+
 struct GLSLLauncherImpl {
   GLBufferTable core_bufs;
   GLBufferTable user_bufs;
@@ -362,11 +555,18 @@ bool initialize_opengl(bool error_tolerance) {
     }
     TI_ERROR("[glsl] cannot initialize GLAD");
   }
-#define PER_OPENGL_EXTENSION(x)          \
-  if ((opengl_extension_##x = GLAD_##x)) \
+  // Not through GLAD, whose loader predates some of the extensions.
+#define PER_OPENGL_EXTENSION(x)                                 \
+  if ((opengl_extension_##x = glfwExtensionSupported(#x) != 0)) \
     TI_TRACE("[glsl] Found " #x);
 #include "taichi/inc/opengl_extension.inc.h"
 #undef PER_OPENGL_EXTENSION
+  if (glfwExtensionSupported("GL_ARB_buffer_storage")) {
+    ti_glBufferStorage =
+        (PFNTIGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    if (ti_glBufferStorage)
+      TI_TRACE("[glsl] Found GL_ARB_buffer_storage");
+  }
   if (!opengl_extension_GL_ARB_compute_shader) {
     if (error_tolerance) {
       TI_INFO("Your OpenGL does not support GL_ARB_compute_shader extension");
@@ -382,6 +582,30 @@ bool initialize_opengl(bool error_tolerance) {
   glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &opengl_max_grid_dim);
   check_opengl_error("glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_SIZE)");
   TI_TRACE("GL_MAX_COMPUTE_WORK_GROUP_SIZE: {}", opengl_max_grid_dim);
+  glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0,
+                  &opengl_max_num_work_groups);
+  check_opengl_error("glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_COUNT)");
+  TI_TRACE("GL_MAX_COMPUTE_WORK_GROUP_COUNT: {}", opengl_max_num_work_groups);
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,
+                &opengl_num_program_binary_formats);
+  if (glGetError() != GL_NO_ERROR)
+    opengl_num_program_binary_formats = 0;
+  TI_TRACE("GL_NUM_PROGRAM_BINARY_FORMATS: {}",
+           opengl_num_program_binary_formats);
+  if (glfwExtensionSupported("GL_KHR_shader_subgroup")) {
+    GLint stages = 0, features = 0;
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features);
+    constexpr GLint required = GL_SUBGROUP_FEATURE_BASIC_BIT_KHR |
+                               GL_SUBGROUP_FEATURE_VOTE_BIT_KHR |
+                               GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR;
+    opengl_has_subgroup_reductions = glGetError() == GL_NO_ERROR &&
+                                     (stages & GL_COMPUTE_SHADER_BIT) &&
+                                     (features & required) == required;
+    TI_TRACE("[glsl] Found GL_KHR_shader_subgroup: features={:#x}, {}",
+             features, opengl_has_subgroup_reductions ? "reductions"
+                                                      : "no reductions");
+  }
 
   supported = std::make_optional<bool>(true);
   return true;
@@ -408,12 +632,15 @@ void show_kernel_info(std::string const &kernel_name,
 struct CompiledKernel::Impl {
   std::string kernel_name;
   std::unique_ptr<GLProgram> glsl;
+  // Writes the number of work groups of |glsl|, if |ps->indirect|.
+  std::unique_ptr<GLProgram> indirect_evaluator;
   std::unique_ptr<ParallelSize> ps;
   std::string source;
 
   Impl(const std::string &kernel_name_,
        const std::string &kernel_source_code,
-       std::unique_ptr<ParallelSize> ps_)
+       std::unique_ptr<ParallelSize> ps_,
+       ProgramCache *cache)
       : kernel_name(kernel_name_), ps(std::move(ps_)) {
     if (ps->grid_dim > opengl_max_grid_dim)
       ps->grid_dim = opengl_max_grid_dim;
@@ -429,8 +656,36 @@ struct CompiledKernel::Impl {
                  ps->block_dim) +
              kernel_source_code.substr(layout_pos);
     show_kernel_info(kernel_name_, source, ps.get());
-    glsl = std::make_unique<GLProgram>(GLShader(source));
-    glsl->link();
+    glsl = cache->load_or_build(source);
+    if (ps->indirect)
+      build_indirect_evaluator(cache);
+  }
+
+  void build_indirect_evaluator(ProgramCache *cache) {
+    const auto &range = ps->indirect.value();
+    int max_groups = opengl_max_num_work_groups;
+    if (range.max_num_groups > 0)
+      max_groups = std::min(max_groups, range.max_num_groups);
+    std::string args;
+    if (range.struct_for) {
+      args = "1, 1, 0, _list_len_";
+    } else {
+      args = fmt::format("{}, {}, {}, {}", (int)range.const_begin,
+                         (int)range.const_end, range.begin, range.end);
+    }
+    const std::string evaluator_source =
+        std::string(
+#include "taichi/backends/opengl/shaders/indirect.glsl.h"
+            ) +
+        fmt::format("void main() {{\n"
+                    "  _compute_indirect({}, {}, {}, {});\n"
+                    "}}\n",
+                    args, range.strides_per_thread,
+                    std::max(ps->block_dim, (size_t)1), max_groups);
+    ParallelSize evaluator_ps;
+    show_kernel_info("indirect_evaluator_" + kernel_name, evaluator_source,
+                     &evaluator_ps);
+    indirect_evaluator = cache->load_or_build(evaluator_source);
   }
 
   void dispatch_compute(GLSLLauncher *launcher) const {
@@ -441,9 +696,24 @@ struct CompiledKernel::Impl {
     // `glDispatchCompute(X, Y, Z)`   - the X*Y*Z  == `Blocks`   in CUDA
     // `layout(local_size_x = X) in;` - the X      == `Threads`  in CUDA
     //
-    glsl->use();
-    glDispatchCompute(ps->grid_dim, 1, 1);
-    check_opengl_error("glDispatchCompute");
+    if (indirect_evaluator) {
+      // The range only lives on the device, so is the number of work groups
+      // computed there, without the host waiting for anything.
+      indirect_evaluator->use();
+      glDispatchCompute(1, 1, 1);
+      check_opengl_error("glDispatchCompute");
+      glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+      check_opengl_error("glMemoryBarrier");
+
+      glsl->use();
+      launcher->impl->core_bufs.get(GLBufId::Indirect)->as_indirect_buffer();
+      glDispatchComputeIndirect(0);
+      check_opengl_error("glDispatchComputeIndirect");
+    } else {
+      glsl->use();
+      glDispatchCompute(ps->grid_dim, 1, 1);
+      check_opengl_error("glDispatchCompute");
+    }
 
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
     check_opengl_error("glMemoryBarrier");
@@ -456,8 +726,18 @@ struct CompiledProgram::Impl {
   std::map<int, size_t> ext_arr_map;
   std::vector<std::string> str_table;
   UsedFeature used;
+  std::unique_ptr<ProgramCache> cache;
 
   Impl(Kernel *kernel) {
+    // Next to the LLVM kernels of the offline cache.
+    const auto &config = kernel->program.config;
+    std::string cache_path;
+    if (config.offline_cache) {
+      cache_path = config.offline_cache_file_path.empty()
+                       ? get_repo_dir() + "/.cache/opengl"
+                       : config.offline_cache_file_path + "/opengl";
+    }
+    cache = std::make_unique<ProgramCache>(cache_path);
     arg_count = kernel->args.size();
     ret_count = kernel->rets.size();
     for (int i = 0; i < arg_count; i++) {
@@ -471,7 +751,7 @@ struct CompiledProgram::Impl {
            const std::string &kernel_source_code,
            std::unique_ptr<ParallelSize> ps) {
     kernels.push_back(std::make_unique<CompiledKernel>(
-        kernel_name, kernel_source_code, std::move(ps)));
+        kernel_name, kernel_source_code, std::move(ps), cache.get()));
   }
 
   int lookup_or_add_string(const std::string &str) {
@@ -488,46 +768,28 @@ struct CompiledProgram::Impl {
   void dump_message_buffer(GLSLLauncher *launcher) const {
     auto runtime = launcher->impl->core_bufs.get(GLBufId::Runtime);
     auto rt_buf = (GLSLRuntime *)runtime->map();
+    dump_messages(rt_buf, str_table);
+    runtime->unmap();
+  }
 
-    auto msg_count = rt_buf->msg_count;
-    if (msg_count > MAX_MESSAGES) {
-      TI_WARN("[glsl] Too much print within one kernel: {} > {}, clipping",
-              msg_count, MAX_MESSAGES);
-      msg_count = MAX_MESSAGES;
-    }
-
-    for (int i = 0; i < msg_count; i++) {
-      auto const &msg = rt_buf->msg_buf[i];
-      for (int j = 0; j < msg.num_contents; j++) {
-        int type = msg.get_type_of(j);
-        auto value = msg.contents[j];
-
-        std::string str;
-        switch (type) {
-          case 1:
-            str = fmt::format("{}", value.val_i32);
-            break;
-          case 2:
-            str = fmt::format("{}", value.val_f32);
-            break;
-          case 3:
-            str = str_table.at(value.val_i32);
-            break;
-          default:
-            TI_WARN("[glsl] Unexpected serialization type: {}, ignoring", type);
-            break;
-        };
-        py_cout << str;
-      }
+  // Returns the persistent buffer holding all the external arrays of |ctx|,
+  // or nullptr if any of them lives elsewhere.
+  GLPersistentBuffer *lookup_persistent_extr(const Context &ctx) const {
+    GLPersistentBuffer *ret = nullptr;
+    for (const auto &[i, size] : ext_arr_map) {
+      auto *buf = persistent_bufs.lookup((void *)ctx.args[i], size);
+      if (!buf || (ret && buf != ret))
+        return nullptr;
+      ret = buf;
     }
-    rt_buf->msg_count = 0;
-    runtime->unmap();
+    return ret;
   }
 
   void launch(Context &ctx, GLSLLauncher *launcher) const {
     GLBufferTable &bufs = launcher->impl->user_bufs;
     std::vector<char> base_arr;
     std::vector<void *> saved_ctx_ptrs;
+    GLPersistentBuffer *persistent_extr = nullptr;
     std::vector<char> args;
     args.resize(std::max(arg_count, ret_count) * sizeof(uint64_t));
     // NOTE: these dirty codes are introduced by #694, TODO: RAII
@@ -537,7 +799,16 @@ struct CompiledProgram::Impl {
                   arg_count * taichi_max_num_indices * sizeof(int));
       std::memcpy(args.data() + taichi_opengl_earg_base, ctx.extra_args,
                   arg_count * taichi_max_num_indices * sizeof(int));
-      if (ext_arr_map.size() == 1) {  // zero-copy for only one ext_arr
+      if (used.buf_extr)
+        persistent_extr = lookup_persistent_extr(ctx);
+      if (!used.buf_extr) {
+        // Only the shapes are accessed, no need to upload the arrays at all
+      } else if (persistent_extr) {  // zero-copy, already resident on device
+        for (const auto &[i, size] : ext_arr_map) {
+          ctx.args[i] -= (uint64)persistent_extr->base;
+        }
+        persistent_extr->bind_index((int)GLBufId::Extr);
+      } else if (ext_arr_map.size() == 1) {  // zero-copy for only one ext_arr
         auto it = ext_arr_map.begin();
         auto extptr = (void *)ctx.args[it->first];
         ctx.args[it->first] = 0;
@@ -574,19 +845,31 @@ struct CompiledProgram::Impl {
     for (const auto &ker : kernels) {
       ker->dispatch_compute(launcher);
     }
+    // Mapping a buffer waits for the kernels to finish, so only read back
+    // what they may have written. Without any return value nor written
+    // external array, the launch doesn't block the host at all.
     for (auto &[idx, buf] : launcher->impl->user_bufs.bufs) {
       if (buf->index == GLBufId::Args) {
         buf->copy_back(launcher->result_buffer, ret_count * sizeof(uint64_t));
-      } else {
+      } else if (buf->index != GLBufId::Extr || used.buf_extr_written) {
         buf->copy_back();
       }
     }
     launcher->impl->user_bufs.clear();
+    if (persistent_extr && used.buf_extr_written) {
+      // Make the results visible through the persistent mapping before the
+      // host reads the arrays.
+      glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+      check_opengl_error("glMemoryBarrier");
+      GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      glDeleteSync(fence);
+    }
     if (used.print) {
       dump_message_buffer(launcher);
     }
     /// DIRTY_BEGIN {{{
-    if (ext_arr_map.size() > 1) {
+    if (!saved_ctx_ptrs.empty() && used.buf_extr_written) {
       void *baseptr = base_arr.data();
       auto cpit = saved_ctx_ptrs.begin();
       size_t accum_size = 0;
@@ -619,12 +902,38 @@ GLSLLauncher::GLSLLauncher(size_t root_size) {
   impl->gtmp_buffer.resize(taichi_global_tmp_buffer_size, 0);
   impl->core_bufs.add_buffer(GLBufId::Gtmp, impl->gtmp_buffer.data(),
                              taichi_global_tmp_buffer_size);
+
+  // Only ever written by the indirect evaluators, see CompiledKernel.
+  impl->core_bufs.add_buffer(GLBufId::Indirect, nullptr, 3 * sizeof(uint32));
 }
 
 void GLSLLauncher::keep(std::unique_ptr<CompiledProgram> program) {
   impl->programs.push_back(std::move(program));
 }
 
+void *allocate_persistent_buffer(size_t size) {
+  if (!ti_glBufferStorage)
+    return nullptr;
+  auto buf = std::make_unique<GLPersistentBuffer>(size);
+  auto base = buf->base;
+  persistent_bufs.bufs[(uint64)base] = std::move(buf);
+  return base;
+}
+
+bool free_persistent_buffer(void *ptr) {
+  return persistent_bufs.bufs.erase((uint64)ptr) != 0;
+}
+
+SupportedExtensions opengl_supported_extensions() {
+  SupportedExtensions supported;
+#define PER_OPENGL_EXTENSION(x) \
+  supported.extension_##x = opengl_extension_##x;
+#include "taichi/inc/opengl_extension.inc.h"
+#undef PER_OPENGL_EXTENSION
+  supported.subgroup_reductions = opengl_has_subgroup_reductions;
+  return supported;
+}
+
 bool is_opengl_api_available() {
   if (get_environ_config("TI_ENABLE_OPENGL", 1) == 0)
     return false;
@@ -634,11 +943,13 @@ bool is_opengl_api_available() {
 #else
 struct GLProgram {};
 struct GLSLLauncherImpl {};
+class ProgramCache {};
 
 struct CompiledKernel::Impl {
   Impl(const std::string &kernel_name_,
        const std::string &kernel_source_code,
-       std::unique_ptr<ParallelSize> ps_) {
+       std::unique_ptr<ParallelSize> ps_,
+       ProgramCache *cache) {
     TI_NOT_IMPLEMENTED;
   }
 
@@ -677,6 +988,18 @@ void GLSLLauncher::keep(std::unique_ptr<CompiledProgram>) {
   TI_NOT_IMPLEMENTED;
 }
 
+void *allocate_persistent_buffer(size_t size) {
+  return nullptr;
+}
+
+bool free_persistent_buffer(void *ptr) {
+  return false;
+}
+
+SupportedExtensions opengl_supported_extensions() {
+  return {};
+}
+
 bool is_opengl_api_available() {
   return false;
 }
@@ -687,6 +1010,42 @@ bool initialize_opengl(bool error_tolerance) {
 
 #endif  // TI_WITH_OPENGL
 
+void dump_messages(GLSLRuntime *runtime,
+                   const std::vector<std::string> &str_table) {
+  auto msg_count = runtime->msg_count;
+  if (msg_count > MAX_MESSAGES) {
+    TI_WARN("[glsl] Too much print within one kernel: {} > {}, clipping",
+            msg_count, MAX_MESSAGES);
+    msg_count = MAX_MESSAGES;
+  }
+
+  for (int i = 0; i < msg_count; i++) {
+    auto const &msg = runtime->msg_buf[i];
+    for (int j = 0; j < msg.num_contents; j++) {
+      int type = msg.get_type_of(j);
+      auto value = msg.contents[j];
+
+      std::string str;
+      switch (type) {
+        case 1:
+          str = fmt::format("{}", value.val_i32);
+          break;
+        case 2:
+          str = fmt::format("{}", value.val_f32);
+          break;
+        case 3:
+          str = str_table.at(value.val_i32);
+          break;
+        default:
+          TI_WARN("[glsl] Unexpected serialization type: {}, ignoring", type);
+          break;
+      };
+      py_cout << str;
+    }
+  }
+  runtime->msg_count = 0;
+}
+
 CompiledProgram::CompiledProgram(Kernel *kernel)
     : impl(std::make_unique<Impl>(kernel)) {
 }
@@ -713,10 +1072,12 @@ void CompiledProgram::launch(Context &ctx, GLSLLauncher *launcher) const {
 
 CompiledKernel::CompiledKernel(const std::string &kernel_name_,
                                const std::string &kernel_source_code,
-                               std::unique_ptr<ParallelSize> ps_)
+                               std::unique_ptr<ParallelSize> ps_,
+                               ProgramCache *cache)
     : impl(std::make_unique<Impl>(kernel_name_,
                                   kernel_source_code,
-                                  std::move(ps_))) {
+                                  std::move(ps_),
+                                  cache)) {
 }
 
 void CompiledKernel::dispatch_compute(GLSLLauncher *launcher) const {
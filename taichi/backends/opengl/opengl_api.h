@@ -16,33 +16,73 @@ TLANG_NAMESPACE_BEGIN
 
 class Kernel;
 class OffloadedStmt;
+struct GLSLRuntime;
 
 namespace opengl {
 
 bool initialize_opengl(bool error_tolerance = false);
 bool is_opengl_api_available();
 
+// Allocates an external array that stays resident in a persistently mapped
+// SSBO across launches. Returns nullptr without GL_ARB_buffer_storage.
+void *allocate_persistent_buffer(size_t size);
+// Returns false if |ptr| was not allocated by allocate_persistent_buffer().
+bool free_persistent_buffer(void *ptr);
+
 #define PER_OPENGL_EXTENSION(x) extern bool opengl_extension_##x;
 #include "taichi/inc/opengl_extension.inc.h"
 #undef PER_OPENGL_EXTENSION
 
 extern int opengl_threads_per_block;
-
-#define TI_OPENGL_REQUIRE(used, x) \
-  ([&]() {                         \
-    if (opengl_extension_##x) {    \
-      used.extension_##x = true;   \
-      return true;                 \
-    }                              \
-    return false;                  \
+// Whether the compute shaders support subgroupElect(), subgroupAllEqual() and
+// the subgroup arithmetic of GL_KHR_shader_subgroup.
+extern bool opengl_has_subgroup_reductions;
+
+// The extensions of the OpenGL context, see initialize_opengl().
+SupportedExtensions opengl_supported_extensions();
+
+#define TI_OPENGL_REQUIRE(supported, used, x) \
+  ([&]() {                                    \
+    if (supported.extension_##x) {            \
+      used.extension_##x = true;              \
+      return true;                            \
+    }                                         \
+    return false;                             \
   })()
 
+// Prints the messages of the print statements in |runtime|, with the strings
+// of |str_table|, and clears them.
+void dump_messages(GLSLRuntime *runtime,
+                   const std::vector<std::string> &str_table);
+
 struct CompiledKernel;
+class ProgramCache;
 
 class ParallelSize {
  public:
   size_t block_dim;
   size_t grid_dim;
+
+  // The range of a task whose number of iterations is only known on the
+  // device. Such a task is launched by glDispatchComputeIndirect(), with the
+  // number of work groups written by an evaluator shader just before, see
+  // shaders/indirect.glsl.h. |grid_dim| is then only used as a fallback.
+  struct IndirectRange {
+    // If not |const_begin|, |begin| is the offset of the begin in the global
+    // temporary buffer. The same goes for |end|.
+    bool const_begin{true};
+    bool const_end{true};
+    int begin{0};
+    int end{0};
+    // Struct-fors run over the |_list_len_| elements of the list instead.
+    bool struct_for{false};
+    // The iterations run by each thread of the grid-stride loop.
+    int strides_per_thread{1};
+    // The max number of work groups, or 0 for the device limit.
+    int max_num_groups{0};
+  };
+  std::optional<IndirectRange> indirect;
+
   ParallelSize(size_t block_dim = 1, size_t grid_dim = 1)
       : block_dim(block_dim), grid_dim(grid_dim) {
   }
@@ -57,9 +97,11 @@ struct CompiledKernel {
   CompiledKernel(CompiledKernel &&) = default;
   CompiledKernel &operator=(CompiledKernel &&) = default;
 
+  // |cache| stores the built programs across runs, see ProgramCache.
   CompiledKernel(const std::string &kernel_name_,
                  const std::string &kernel_source_code,
-                 std::unique_ptr<ParallelSize> ps_);
+                 std::unique_ptr<ParallelSize> ps_,
+                 ProgramCache *cache);
   ~CompiledKernel();
 
   void dispatch_compute(GLSLLauncher *launcher) const;
@@ -29,12 +29,17 @@ struct UsedFeature {
   bool buf_earg{false};
   bool buf_extr{false};
   bool buf_gtmp{false};
+  // Whether any kernel stores into the external arrays. If not, copying them
+  // back to the host after the launch can be skipped.
+  bool buf_extr_written{false};
 
   // utilties:
   bool fast_pow{false};
   bool listman{false};
   bool random{false};
   bool print{false};
+  // The subgroup reductions, see GL_KHR_shader_subgroup.
+  bool subgroup{false};
 
   // extensions:
 #define PER_OPENGL_EXTENSION(x) bool extension_##x{false};
@@ -42,12 +47,24 @@ struct UsedFeature {
 #undef PER_OPENGL_EXTENSION
 };
 
+// The extensions that the shaders may use on the device they are generated
+// for, queried from OpenGL or Vulkan.
+struct SupportedExtensions {
+#define PER_OPENGL_EXTENSION(x) bool extension_##x{false};
+#include "taichi/inc/opengl_extension.inc.h"
+#undef PER_OPENGL_EXTENSION
+  // subgroupElect(), subgroupAllEqual() and the subgroup arithmetic of
+  // GL_KHR_shader_subgroup.
+  bool subgroup_reductions{false};
+};
+
 enum class GLBufId {
   Root = 0,
   Runtime = 6,
   Listman = 7,
   Gtmp = 1,
   Args = 2,
+  Indirect = 3,
   Extr = 4,
 };
 
@@ -0,0 +1,43 @@
+// vim: ft=glsl
+// clang-format off
+#include "taichi/util/macros.h"
+STR(
+shared int _agg_keys_[_agg_size_];
+shared int _agg_vals_[_agg_size_];
+void _agg_clear_() {
+  for (int i = int(gl_LocalInvocationIndex); i < _agg_size_;
+       i += int(gl_WorkGroupSize.x)) {
+    _agg_keys_[i] = 0;
+    _agg_vals_[i] = 0;
+  }
+  memoryBarrierShared();
+  barrier();
+}
+void atomicAdd_agg_f32(int addr, float rhs) {
+  int slot = addr & (_agg_size_ - 1);
+  for (int probe = 0; probe < 8; probe++) {
+    int key = atomicCompSwap(_agg_keys_[slot], 0, addr + 1);
+    if (key == 0 || key == addr + 1) {
+      int old, new;
+      do {
+        old = _agg_vals_[slot];
+        new = floatBitsToInt(intBitsToFloat(old) + rhs);
+      } while (old != atomicCompSwap(_agg_vals_[slot], old, new));
+      return;
+    }
+    slot = (slot + 1) & (_agg_size_ - 1);
+  }
+  atomicAdd_data_f32(addr, rhs);
+}
+void _agg_flush_() {
+  memoryBarrierShared();
+  barrier();
+  for (int i = int(gl_LocalInvocationIndex); i < _agg_size_;
+       i += int(gl_WorkGroupSize.x)) {
+    int key = _agg_keys_[i];
+    if (key != 0) {
+      atomicAdd_data_f32(key - 1, intBitsToFloat(_agg_vals_[i]));
+    }
+  }
+}
+)
@@ -2,18 +2,26 @@
 // clang-format off
 #include "taichi/util/macros.h"
 "#version 430 core\nprecision highp float;\n"
+"layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;\n"
 #define __GLSL__
-#include "taichi/backends/opengl/shaders/runtime.h"
+#include "taichi/backends/opengl/shaders/listman.h"
 #undef __GLSL__
 STR(
 // taichi uses gtmp for storing dynamic range endpoints
 layout(std430, binding = 1) buffer gtmp_i32 { int _gtmp_i32_[]; };
 
+// glDispatchComputeIndirect() reads its arguments from here
+layout(std430, binding = 3) buffer indirect {
+  uint _indirect_x_;
+  uint _indirect_y_;
+  uint _indirect_z_;
+};
+
 // indirect work group size evaluator kernel template
 void _compute_indirect(
   int const_begin, int const_end,
   int range_begin, int range_end,
-  int SPT, int TPG) {
+  int SPT, int TPG, int max_groups) {
 
   // dynamic range for
   if (const_begin == 0) {
@@ -28,12 +36,12 @@ void _compute_indirect(
   }
 
   int nthreads = max((nstrides + SPT - 1) / SPT, 1);
-  int nblocks = max((nthreads + TPG - 1) / TPG, 1);
+  int nblocks = clamp((nthreads + TPG - 1) / TPG, 1, max_groups);
 
-  _indirect_x_ = nblocks;
-  _indirect_y_ = 1;
-  _indirect_z_ = 1;
+  _indirect_x_ = uint(nblocks);
+  _indirect_y_ = 1u;
+  _indirect_z_ = 1u;
 }
 
-// get_indirect_evaluator() will prepend a main here, with template arguments
+// CompiledKernel appends a main here, with the template arguments
 )
@@ -0,0 +1,621 @@
+#include "taichi/backends/vulkan/vulkan_api.h"
+
+#ifdef TI_WITH_VULKAN
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+TLANG_NAMESPACE_BEGIN
+namespace vulkan {
+
+namespace {
+
+// Bounds the memory held by the submitted command buffers, and how far the
+// host may run ahead of the device.
+constexpr int kMaxBatchesInFlight = 4;
+
+void memory_barrier(VkCommandBuffer command_buffer,
+                    VkPipelineStageFlags src_stages,
+                    VkAccessFlags src_access,
+                    VkPipelineStageFlags dst_stages,
+                    VkAccessFlags dst_access) {
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = src_access;
+  barrier.dstAccessMask = dst_access;
+  vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 1, &barrier,
+                       0, nullptr, 0, nullptr);
+}
+
+constexpr VkPipelineStageFlags kDeviceStages =
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+constexpr VkAccessFlags kDeviceAccess =
+    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+    VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+constexpr VkAccessFlags kDeviceWrites =
+    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+}  // namespace
+
+void check_vulkan_error(VkResult result, const char *what) {
+  if (result != VK_SUCCESS) {
+    TI_ERROR("[vulkan] {} failed: VkResult {}", what, (int)result);
+  }
+}
+
+std::unique_ptr<VulkanDevice> VulkanDevice::create() {
+  std::unique_ptr<VulkanDevice> device(new VulkanDevice());
+  if (!device->init()) {
+    return nullptr;
+  }
+  return device;
+}
+
+bool VulkanDevice::init() {
+  VkApplicationInfo app_info{VK_STRUCTURE_TYPE_APPLICATION_INFO};
+  app_info.pApplicationName = "taichi";
+  app_info.pEngineName = "taichi";
+  app_info.apiVersion = VK_API_VERSION_1_1;
+  VkInstanceCreateInfo instance_info{VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
+  instance_info.pApplicationInfo = &app_info;
+  if (vkCreateInstance(&instance_info, nullptr, &instance_) != VK_SUCCESS) {
+    instance_ = VK_NULL_HANDLE;
+    return false;
+  }
+
+  uint32 num_devices = 0;
+  vkEnumeratePhysicalDevices(instance_, &num_devices, nullptr);
+  std::vector<VkPhysicalDevice> devices(num_devices);
+  vkEnumeratePhysicalDevices(instance_, &num_devices, devices.data());
+  // Prefers the discrete GPUs, then the integrated ones.
+  int best_score = -1;
+  for (auto physical_device : devices) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1)
+      continue;
+    uint32 num_families = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &num_families,
+                                             nullptr);
+    std::vector<VkQueueFamilyProperties> families(num_families);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &num_families,
+                                             families.data());
+    int family = -1;
+    for (int i = 0; i < (int)num_families; i++) {
+      if (families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+        family = i;
+        break;
+      }
+    }
+    if (family < 0)
+      continue;
+    int score = 0;
+    if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+      score = 2;
+    } else if (properties.deviceType ==
+               VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
+      score = 1;
+    }
+    if (score > best_score) {
+      best_score = score;
+      physical_device_ = physical_device;
+      queue_family_ = family;
+    }
+  }
+  if (physical_device_ == VK_NULL_HANDLE) {
+    return false;
+  }
+  vkGetPhysicalDeviceProperties(physical_device_, &properties_);
+  vkGetPhysicalDeviceMemoryProperties(physical_device_, &memory_properties_);
+  TI_TRACE("[vulkan] Using {}", properties_.deviceName);
+
+  VkPhysicalDeviceFeatures available_features;
+  vkGetPhysicalDeviceFeatures(physical_device_, &available_features);
+  VkPhysicalDeviceFeatures features{};
+  features.shaderInt64 = available_features.shaderInt64;
+  supported_.extension_GL_ARB_gpu_shader_int64 =
+      available_features.shaderInt64 == VK_TRUE;
+
+  uint32 num_extensions = 0;
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr,
+                                       &num_extensions, nullptr);
+  std::vector<VkExtensionProperties> extensions(num_extensions);
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr,
+                                       &num_extensions, extensions.data());
+  auto has_extension = [&](const char *name) {
+    for (const auto &e : extensions) {
+      if (std::strcmp(e.extensionName, name) == 0)
+        return true;
+    }
+    return false;
+  };
+  std::vector<const char *> enabled_extensions;
+  void *features_chain = nullptr;
+#ifdef VK_EXT_shader_atomic_float
+  VkPhysicalDeviceShaderAtomicFloatFeaturesEXT atomic_float{
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT};
+  if (has_extension(VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    features2.pNext = &atomic_float;
+    vkGetPhysicalDeviceFeatures2(physical_device_, &features2);
+    if (atomic_float.shaderBufferFloat32AtomicAdd) {
+      enabled_extensions.push_back(VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME);
+      features_chain = &atomic_float;
+      supported_.extension_GL_EXT_shader_atomic_float = true;
+    }
+  }
+#endif
+
+  VkPhysicalDeviceSubgroupProperties subgroup{
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES};
+  VkPhysicalDeviceProperties2 properties2{
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties2.pNext = &subgroup;
+  vkGetPhysicalDeviceProperties2(physical_device_, &properties2);
+  constexpr VkSubgroupFeatureFlags required_subgroup_features =
+      VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_VOTE_BIT |
+      VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+  supported_.subgroup_reductions =
+      (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+      (subgroup.supportedOperations & required_subgroup_features) ==
+          required_subgroup_features;
+
+  const float priority = 1.0f;
+  VkDeviceQueueCreateInfo queue_info{
+      VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+  queue_info.queueFamilyIndex = queue_family_;
+  queue_info.queueCount = 1;
+  queue_info.pQueuePriorities = &priority;
+  VkDeviceCreateInfo device_info{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+  device_info.pNext = features_chain;
+  device_info.queueCreateInfoCount = 1;
+  device_info.pQueueCreateInfos = &queue_info;
+  device_info.enabledExtensionCount = (uint32)enabled_extensions.size();
+  device_info.ppEnabledExtensionNames = enabled_extensions.data();
+  device_info.pEnabledFeatures = &features;
+  if (vkCreateDevice(physical_device_, &device_info, nullptr, &device_) !=
+      VK_SUCCESS) {
+    device_ = VK_NULL_HANDLE;
+    return false;
+  }
+  vkGetDeviceQueue(device_, queue_family_, 0, &queue_);
+
+  VkCommandPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = queue_family_;
+  check_vulkan_error(
+      vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_),
+      "vkCreateCommandPool");
+  return true;
+}
+
+VulkanDevice::~VulkanDevice() {
+  if (command_pool_ != VK_NULL_HANDLE)
+    vkDestroyCommandPool(device_, command_pool_, nullptr);
+  if (device_ != VK_NULL_HANDLE)
+    vkDestroyDevice(device_, nullptr);
+  if (instance_ != VK_NULL_HANDLE)
+    vkDestroyInstance(instance_, nullptr);
+}
+
+int VulkanDevice::find_memory_type(uint32 type_bits,
+                                   VkMemoryPropertyFlags properties) const {
+  for (int i = 0; i < (int)memory_properties_.memoryTypeCount; i++) {
+    if ((type_bits & (1u << i)) &&
+        (memory_properties_.memoryTypes[i].propertyFlags & properties) ==
+            properties)
+      return i;
+  }
+  return -1;
+}
+
+std::string VulkanDevice::driver_string() const {
+  return fmt::format("{:x}|{:x}|{:x}|{}", properties_.vendorID,
+                     properties_.deviceID, properties_.driverVersion,
+                     properties_.deviceName);
+}
+
+VulkanMemoryPool::VulkanMemoryPool(VulkanDevice *device,
+                                   VkMemoryPropertyFlags properties,
+                                   VkDeviceSize block_size)
+    : device_(device), properties_(properties), block_size_(block_size) {
+  alignment_ = std::max<VkDeviceSize>(
+      device->properties().limits.minStorageBufferOffsetAlignment, 16);
+}
+
+VulkanMemoryPool::~VulkanMemoryPool() {
+  for (auto &block : blocks_) {
+    if (block.mapped)
+      vkUnmapMemory(device_->device(), block.memory);
+    vkDestroyBuffer(device_->device(), block.buffer, nullptr);
+    vkFreeMemory(device_->device(), block.memory, nullptr);
+  }
+}
+
+void VulkanMemoryPool::add_block(VkDeviceSize size) {
+  Block block;
+  block.size = size;
+  VkBufferCreateInfo buffer_info{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+  buffer_info.size = size;
+  buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                      VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  check_vulkan_error(vkCreateBuffer(device_->device(), &buffer_info, nullptr,
+                                    &block.buffer),
+                     "vkCreateBuffer");
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device_->device(), block.buffer,
+                                &requirements);
+  const int type =
+      device_->find_memory_type(requirements.memoryTypeBits, properties_);
+  TI_ERROR_IF(type < 0, "[vulkan] No memory type with properties {:#x}",
+              properties_);
+  VkMemoryAllocateInfo allocate_info{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+  allocate_info.allocationSize = requirements.size;
+  allocate_info.memoryTypeIndex = type;
+  check_vulkan_error(vkAllocateMemory(device_->device(), &allocate_info,
+                                      nullptr, &block.memory),
+                     "vkAllocateMemory");
+  check_vulkan_error(
+      vkBindBufferMemory(device_->device(), block.buffer, block.memory, 0),
+      "vkBindBufferMemory");
+  if (properties_ & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    check_vulkan_error(vkMapMemory(device_->device(), block.memory, 0,
+                                   VK_WHOLE_SIZE, 0, &block.mapped),
+                       "vkMapMemory");
+  }
+  block.free_ranges[0] = size;
+  TI_TRACE("[vulkan] Allocated a block of {} B with properties {:#x}", size,
+           properties_);
+  blocks_.push_back(std::move(block));
+}
+
+VulkanBuffer VulkanMemoryPool::allocate(VkDeviceSize size) {
+  size = (std::max<VkDeviceSize>(size, 1) + alignment_ - 1) / alignment_ *
+         alignment_;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    for (int b = 0; b < (int)blocks_.size(); b++) {
+      auto &ranges = blocks_[b].free_ranges;
+      for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        if (it->second < size)
+          continue;
+        const auto offset = it->first;
+        const auto remaining = it->second - size;
+        ranges.erase(it);
+        if (remaining > 0)
+          ranges[offset + size] = remaining;
+        VulkanBuffer buffer;
+        buffer.buffer = blocks_[b].buffer;
+        buffer.offset = offset;
+        buffer.size = size;
+        buffer.block = b;
+        if (blocks_[b].mapped)
+          buffer.mapped = (char *)blocks_[b].mapped + offset;
+        return buffer;
+      }
+    }
+    add_block(std::max(block_size_, size));
+  }
+  TI_ERROR("[vulkan] Failed to allocate {} B", size);
+  return {};
+}
+
+void VulkanMemoryPool::free(const VulkanBuffer &buffer) {
+  TI_ASSERT(buffer.block >= 0 && buffer.block < (int)blocks_.size());
+  auto &ranges = blocks_[buffer.block].free_ranges;
+  auto it = ranges.emplace(buffer.offset, buffer.size).first;
+  auto next = std::next(it);
+  if (next != ranges.end() && it->first + it->second == next->first) {
+    it->second += next->second;
+    ranges.erase(next);
+  }
+  if (it != ranges.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second == it->first) {
+      prev->second += it->second;
+      ranges.erase(it);
+    }
+  }
+}
+
+VulkanPipelineLayout::VulkanPipelineLayout(VulkanDevice *device,
+                                           const std::string &cache_path)
+    : device_(device), cache_path_(cache_path) {
+  std::vector<VkDescriptorSetLayoutBinding> bindings(kNumBindings);
+  for (int i = 0; i < kNumBindings; i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  VkDescriptorSetLayoutCreateInfo set_layout_info{
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+  set_layout_info.bindingCount = kNumBindings;
+  set_layout_info.pBindings = bindings.data();
+  check_vulkan_error(
+      vkCreateDescriptorSetLayout(device_->device(), &set_layout_info, nullptr,
+                                  &descriptor_set_layout_),
+      "vkCreateDescriptorSetLayout");
+  VkPipelineLayoutCreateInfo layout_info{
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &descriptor_set_layout_;
+  check_vulkan_error(vkCreatePipelineLayout(device_->device(), &layout_info,
+                                            nullptr, &pipeline_layout_),
+                     "vkCreatePipelineLayout");
+
+  // The driver checks the header of the data, and ignores the data of the
+  // other devices and driver versions.
+  std::vector<char> data;
+  if (!cache_path_.empty()) {
+    std::ifstream ifs(cache_path_ + "/pipeline_cache.bin", std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(ifs),
+                std::istreambuf_iterator<char>());
+  }
+  VkPipelineCacheCreateInfo cache_info{
+      VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  cache_info.initialDataSize = data.size();
+  cache_info.pInitialData = data.empty() ? nullptr : data.data();
+  check_vulkan_error(vkCreatePipelineCache(device_->device(), &cache_info,
+                                           nullptr, &pipeline_cache_),
+                     "vkCreatePipelineCache");
+  if (!data.empty()) {
+    TI_TRACE("[vulkan] Loaded {} B of pipeline cache", data.size());
+  }
+}
+
+VulkanPipelineLayout::~VulkanPipelineLayout() {
+  if (!cache_path_.empty()) {
+    size_t size = 0;
+    vkGetPipelineCacheData(device_->device(), pipeline_cache_, &size, nullptr);
+    std::vector<char> data(size);
+    if (size > 0 &&
+        vkGetPipelineCacheData(device_->device(), pipeline_cache_, &size,
+                               data.data()) == VK_SUCCESS) {
+      std::error_code ec;
+      std::filesystem::create_directories(cache_path_, ec);
+      // As in LlvmOfflineCache::store(), so that concurrent processes never
+      // read a partially written cache.
+      const auto fn = cache_path_ + "/pipeline_cache.bin";
+      const auto tmp_fn = fmt::format(
+          "{}.tmp_{:x}", fn,
+          std::hash<std::thread::id>{}(std::this_thread::get_id()));
+      {
+        std::ofstream ofs(tmp_fn, std::ios::binary);
+        ofs.write(data.data(), size);
+      }
+      std::filesystem::rename(tmp_fn, fn, ec);
+      if (ec) {
+        std::filesystem::remove(tmp_fn, ec);
+      }
+    }
+  }
+  vkDestroyPipelineCache(device_->device(), pipeline_cache_, nullptr);
+  vkDestroyPipelineLayout(device_->device(), pipeline_layout_, nullptr);
+  vkDestroyDescriptorSetLayout(device_->device(), descriptor_set_layout_,
+                               nullptr);
+}
+
+VulkanPipeline::VulkanPipeline(VulkanDevice *device,
+                               const VulkanPipelineLayout &layout,
+                               const std::vector<uint32> &spirv)
+    : device_(device) {
+  VkShaderModuleCreateInfo module_info{
+      VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+  module_info.codeSize = spirv.size() * sizeof(uint32);
+  module_info.pCode = spirv.data();
+  check_vulkan_error(vkCreateShaderModule(device_->device(), &module_info,
+                                          nullptr, &shader_module_),
+                     "vkCreateShaderModule");
+  VkComputePipelineCreateInfo pipeline_info{
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  pipeline_info.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader_module_;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = layout.pipeline_layout();
+  check_vulkan_error(
+      vkCreateComputePipelines(device_->device(), layout.pipeline_cache(), 1,
+                               &pipeline_info, nullptr, &pipeline_),
+      "vkCreateComputePipelines");
+}
+
+VulkanPipeline::~VulkanPipeline() {
+  vkDestroyPipeline(device_->device(), pipeline_, nullptr);
+  vkDestroyShaderModule(device_->device(), shader_module_, nullptr);
+}
+
+VulkanStream::VulkanStream(VulkanDevice *device,
+                           const VulkanPipelineLayout *layout,
+                           VulkanMemoryPool *host_pool,
+                           int launches_per_submit)
+    : device_(device),
+      layout_(layout),
+      host_pool_(host_pool),
+      launches_per_submit_(std::max(launches_per_submit, 1)) {
+  dummy_ = host_pool_->allocate(16);
+}
+
+VulkanStream::~VulkanStream() {
+  synchronize();
+  for (auto &batch : idle_) {
+    vkDestroyDescriptorPool(device_->device(), batch->descriptor_pool,
+                            nullptr);
+    vkDestroyFence(device_->device(), batch->fence, nullptr);
+    vkFreeCommandBuffers(device_->device(), device_->command_pool(), 1,
+                         &batch->command_buffer);
+  }
+  host_pool_->free(dummy_);
+}
+
+VulkanStream::Batch &VulkanStream::current() {
+  if (recording_) {
+    return *recording_;
+  }
+  if (!idle_.empty()) {
+    recording_ = std::move(idle_.back());
+    idle_.pop_back();
+  } else {
+    recording_ = std::make_unique<Batch>();
+    auto &batch = *recording_;
+    VkCommandBufferAllocateInfo allocate_info{
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocate_info.commandPool = device_->command_pool();
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+    check_vulkan_error(vkAllocateCommandBuffers(device_->device(),
+                                                &allocate_info,
+                                                &batch.command_buffer),
+                       "vkAllocateCommandBuffers");
+    VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    check_vulkan_error(
+        vkCreateFence(device_->device(), &fence_info, nullptr, &batch.fence),
+        "vkCreateFence");
+    VkDescriptorPoolSize pool_size;
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = launches_per_submit_ * kNumBindings;
+    VkDescriptorPoolCreateInfo pool_info{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    pool_info.maxSets = launches_per_submit_;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    check_vulkan_error(vkCreateDescriptorPool(device_->device(), &pool_info,
+                                              nullptr, &batch.descriptor_pool),
+                       "vkCreateDescriptorPool");
+  }
+  auto &batch = *recording_;
+  VkCommandBufferBeginInfo begin_info{
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  check_vulkan_error(vkBeginCommandBuffer(batch.command_buffer, &begin_info),
+                     "vkBeginCommandBuffer");
+  // Orders the commands after those of the previous submissions. The host
+  // writes before the submission are visible without a barrier.
+  memory_barrier(batch.command_buffer, kDeviceStages, kDeviceWrites,
+                 kDeviceStages, kDeviceAccess);
+  return batch;
+}
+
+void VulkanStream::begin_launch(const std::vector<VulkanBuffer> &buffers) {
+  TI_ASSERT(buffers.size() <= kNumBindings);
+  auto &batch = current();
+  VkDescriptorSetLayout set_layout = layout_->descriptor_set_layout();
+  VkDescriptorSetAllocateInfo allocate_info{
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  allocate_info.descriptorPool = batch.descriptor_pool;
+  allocate_info.descriptorSetCount = 1;
+  allocate_info.pSetLayouts = &set_layout;
+  check_vulkan_error(vkAllocateDescriptorSets(device_->device(), &allocate_info,
+                                              &descriptor_set_),
+                     "vkAllocateDescriptorSets");
+  VkDescriptorBufferInfo infos[kNumBindings];
+  VkWriteDescriptorSet writes[kNumBindings];
+  for (int i = 0; i < kNumBindings; i++) {
+    const auto &buffer = i < (int)buffers.size() && buffers[i].buffer
+                             ? buffers[i]
+                             : dummy_;
+    infos[i].buffer = buffer.buffer;
+    infos[i].offset = buffer.offset;
+    infos[i].range = buffer.size;
+    writes[i] = VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    writes[i].dstSet = descriptor_set_;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo = &infos[i];
+  }
+  vkUpdateDescriptorSets(device_->device(), kNumBindings, writes, 0, nullptr);
+}
+
+void VulkanStream::dispatch(const VulkanPipeline &pipeline, uint32 grid_dim) {
+  auto command_buffer = current().command_buffer;
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    pipeline.pipeline());
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          layout_->pipeline_layout(), 0, 1, &descriptor_set_, 0,
+                          nullptr);
+  vkCmdDispatch(command_buffer, grid_dim, 1, 1);
+  memory_barrier(command_buffer, kDeviceStages, kDeviceWrites, kDeviceStages,
+                 kDeviceAccess);
+}
+
+void VulkanStream::end_launch() {
+  if (++current().num_launches >= launches_per_submit_) {
+    submit();
+  }
+}
+
+void VulkanStream::fill_zero(const VulkanBuffer &buffer) {
+  auto command_buffer = current().command_buffer;
+  vkCmdFillBuffer(command_buffer, buffer.buffer, buffer.offset, buffer.size,
+                  0);
+  memory_barrier(command_buffer, kDeviceStages, kDeviceWrites, kDeviceStages,
+                 kDeviceAccess);
+}
+
+void VulkanStream::release(const VulkanBuffer &buffer) {
+  current().released.push_back(buffer);
+}
+
+void VulkanStream::on_complete(std::function<void()> callback) {
+  current().callbacks.push_back(std::move(callback));
+}
+
+void VulkanStream::submit() {
+  if (!recording_) {
+    return;
+  }
+  auto &batch = *recording_;
+  memory_barrier(batch.command_buffer, kDeviceStages, kDeviceWrites,
+                 VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  check_vulkan_error(vkEndCommandBuffer(batch.command_buffer),
+                     "vkEndCommandBuffer");
+  VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &batch.command_buffer;
+  check_vulkan_error(
+      vkQueueSubmit(device_->queue(), 1, &submit_info, batch.fence),
+      "vkQueueSubmit");
+  in_flight_.push_back(std::move(recording_));
+  while (in_flight_.size() > kMaxBatchesInFlight) {
+    wait(*in_flight_.front());
+    idle_.push_back(std::move(in_flight_.front()));
+    in_flight_.pop_front();
+  }
+}
+
+void VulkanStream::wait(Batch &batch) {
+  check_vulkan_error(vkWaitForFences(device_->device(), 1, &batch.fence,
+                                     VK_TRUE, UINT64_MAX),
+                     "vkWaitForFences");
+  vkResetFences(device_->device(), 1, &batch.fence);
+  for (auto &callback : batch.callbacks) {
+    callback();
+  }
+  batch.callbacks.clear();
+  for (const auto &buffer : batch.released) {
+    host_pool_->free(buffer);
+  }
+  batch.released.clear();
+  vkResetDescriptorPool(device_->device(), batch.descriptor_pool, 0);
+  vkResetCommandBuffer(batch.command_buffer, 0);
+  batch.num_launches = 0;
+}
+
+void VulkanStream::synchronize() {
+  submit();
+  while (!in_flight_.empty()) {
+    wait(*in_flight_.front());
+    idle_.push_back(std::move(in_flight_.front()));
+    in_flight_.pop_front();
+  }
+}
+
+}  // namespace vulkan
+TLANG_NAMESPACE_END
+
+#endif  // TI_WITH_VULKAN
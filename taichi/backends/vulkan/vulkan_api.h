@@ -0,0 +1,215 @@
+#pragma once
+
+#ifdef TI_WITH_VULKAN
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "taichi/backends/opengl/opengl_kernel_util.h"
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+namespace vulkan {
+
+void check_vulkan_error(VkResult result, const char *what);
+
+// The instance, the physical device chosen for compute and the logical device
+// created on it, with one compute queue.
+class VulkanDevice {
+ public:
+  // Returns nullptr if there is no Vulkan device with a compute queue.
+  static std::unique_ptr<VulkanDevice> create();
+  ~VulkanDevice();
+
+  VkDevice device() const {
+    return device_;
+  }
+  VkQueue queue() const {
+    return queue_;
+  }
+  VkCommandPool command_pool() const {
+    return command_pool_;
+  }
+  const VkPhysicalDeviceProperties &properties() const {
+    return properties_;
+  }
+  // The GLSL extensions and subgroup operations that the shaders compiled for
+  // this device may use, see opengl::KernelGen.
+  const opengl::SupportedExtensions &supported_extensions() const {
+    return supported_;
+  }
+  // The index of a memory type with |properties| among |type_bits|, or -1.
+  int find_memory_type(uint32 type_bits,
+                       VkMemoryPropertyFlags properties) const;
+  // Vendor, device and driver, to tell apart the entries of the caches.
+  std::string driver_string() const;
+
+ private:
+  VulkanDevice() = default;
+  bool init();
+
+  VkInstance instance_{VK_NULL_HANDLE};
+  VkPhysicalDevice physical_device_{VK_NULL_HANDLE};
+  VkDevice device_{VK_NULL_HANDLE};
+  uint32 queue_family_{0};
+  VkQueue queue_{VK_NULL_HANDLE};
+  VkCommandPool command_pool_{VK_NULL_HANDLE};
+  VkPhysicalDeviceProperties properties_{};
+  VkPhysicalDeviceMemoryProperties memory_properties_{};
+  opengl::SupportedExtensions supported_;
+};
+
+// A range of one of the buffers of a VulkanMemoryPool.
+struct VulkanBuffer {
+  VkBuffer buffer{VK_NULL_HANDLE};
+  VkDeviceSize offset{0};
+  VkDeviceSize size{0};
+  // The host address of the range, for the host visible pools only.
+  void *mapped{nullptr};
+  int block{-1};
+};
+
+// Sub-allocates the buffers of one memory type from blocks of at least
+// |block_size| bytes, each bound to a single VkBuffer, so that the kernels bind
+// ranges of a few large buffers instead of allocating and binding device
+// memory per buffer. The free ranges of each block are coalesced on free().
+class VulkanMemoryPool {
+ public:
+  VulkanMemoryPool(VulkanDevice *device,
+                   VkMemoryPropertyFlags properties,
+                   VkDeviceSize block_size);
+  ~VulkanMemoryPool();
+
+  VulkanBuffer allocate(VkDeviceSize size);
+  void free(const VulkanBuffer &buffer);
+
+ private:
+  struct Block {
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    VkBuffer buffer{VK_NULL_HANDLE};
+    VkDeviceSize size{0};
+    void *mapped{nullptr};
+    // Offset to size.
+    std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+  };
+
+  void add_block(VkDeviceSize size);
+
+  VulkanDevice *const device_;
+  const VkMemoryPropertyFlags properties_;
+  const VkDeviceSize block_size_;
+  VkDeviceSize alignment_;
+  std::vector<Block> blocks_;
+};
+
+// The storage buffers bound at the bindings of the GLSL generated by
+// opengl::KernelGen, see opengl::GLBufId. All the pipelines share the same
+// layout, so that each launch binds one descriptor set for all its kernels.
+constexpr int kNumBindings = 8;
+
+// The layouts of the descriptor set and of the pipelines, and the pipeline
+// cache, which is loaded from and stored to |cache_path| when it is not empty.
+class VulkanPipelineLayout {
+ public:
+  VulkanPipelineLayout(VulkanDevice *device, const std::string &cache_path);
+  ~VulkanPipelineLayout();
+
+  VkDescriptorSetLayout descriptor_set_layout() const {
+    return descriptor_set_layout_;
+  }
+  VkPipelineLayout pipeline_layout() const {
+    return pipeline_layout_;
+  }
+  VkPipelineCache pipeline_cache() const {
+    return pipeline_cache_;
+  }
+
+ private:
+  VulkanDevice *const device_;
+  const std::string cache_path_;
+  VkDescriptorSetLayout descriptor_set_layout_{VK_NULL_HANDLE};
+  VkPipelineLayout pipeline_layout_{VK_NULL_HANDLE};
+  VkPipelineCache pipeline_cache_{VK_NULL_HANDLE};
+};
+
+class VulkanPipeline {
+ public:
+  VulkanPipeline(VulkanDevice *device,
+                 const VulkanPipelineLayout &layout,
+                 const std::vector<uint32> &spirv);
+  ~VulkanPipeline();
+
+  VkPipeline pipeline() const {
+    return pipeline_;
+  }
+
+ private:
+  VulkanDevice *const device_;
+  VkShaderModule shader_module_{VK_NULL_HANDLE};
+  VkPipeline pipeline_{VK_NULL_HANDLE};
+};
+
+// Records the launches into command buffers, which are submitted every
+// |launches_per_submit| launches, or earlier when the host waits for them in
+// synchronize(). The memory written by a dispatch is visible to the next ones,
+// including those of the later submissions.
+class VulkanStream {
+ public:
+  VulkanStream(VulkanDevice *device,
+               const VulkanPipelineLayout *layout,
+               VulkanMemoryPool *host_pool,
+               int launches_per_submit);
+  ~VulkanStream();
+
+  // Starts a launch binding |buffers| to the bindings of the same indices,
+  // the unbound ones to a dummy buffer.
+  void begin_launch(const std::vector<VulkanBuffer> &buffers);
+  void dispatch(const VulkanPipeline &pipeline, uint32 grid_dim);
+  // Submits the command buffer after |launches_per_submit| launches.
+  void end_launch();
+  // Fills |buffer| with zeros before the next dispatches.
+  void fill_zero(const VulkanBuffer &buffer);
+  // Frees the host visible |buffer| once the recorded commands using it are
+  // done.
+  void release(const VulkanBuffer &buffer);
+  // Runs |callback| once the recorded commands are done, e.g. to read back
+  // their results.
+  void on_complete(std::function<void()> callback);
+  void synchronize();
+
+ private:
+  // A command buffer, and what to do when its fence signals.
+  struct Batch {
+    VkCommandBuffer command_buffer{VK_NULL_HANDLE};
+    VkFence fence{VK_NULL_HANDLE};
+    VkDescriptorPool descriptor_pool{VK_NULL_HANDLE};
+    int num_launches{0};
+    std::vector<VulkanBuffer> released;
+    std::vector<std::function<void()>> callbacks;
+  };
+
+  Batch &current();
+  void submit();
+  void wait(Batch &batch);
+
+  VulkanDevice *const device_;
+  const VulkanPipelineLayout *const layout_;
+  VulkanMemoryPool *const host_pool_;
+  const int launches_per_submit_;
+  VulkanBuffer dummy_;
+  std::unique_ptr<Batch> recording_;
+  std::deque<std::unique_ptr<Batch>> in_flight_;
+  std::vector<std::unique_ptr<Batch>> idle_;
+  VkDescriptorSet descriptor_set_{VK_NULL_HANDLE};
+};
+
+}  // namespace vulkan
+TLANG_NAMESPACE_END
+
+#endif  // TI_WITH_VULKAN
@@ -0,0 +1,417 @@
+#include "taichi/backends/vulkan/vulkan_runtime.h"
+
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "taichi/backends/opengl/shaders/listman.h"
+#include "taichi/backends/opengl/shaders/runtime.h"
+#include "taichi/ir/ir.h"
+#include "taichi/program/kernel.h"
+#include "taichi/util/environ_config.h"
+
+#ifdef TI_WITH_VULKAN
+#include <shaderc/shaderc.hpp>
+
+#include "taichi/backends/vulkan/vulkan_api.h"
+#endif
+
+TLANG_NAMESPACE_BEGIN
+namespace vulkan {
+
+using opengl::GLBufId;
+using opengl::ParallelSize;
+using opengl::UsedFeature;
+
+#ifdef TI_WITH_VULKAN
+
+namespace {
+
+// Bytes sub-allocated at a time from the device memory.
+constexpr VkDeviceSize kDeviceBlockSize = 64 << 20;
+constexpr VkDeviceSize kHostBlockSize = 16 << 20;
+
+// Compiles the GLSL kernels to SPIR-V with shaderc, and stores the SPIR-V
+// across runs when |path| is not empty. Unlike the OpenGL program binaries,
+// SPIR-V does not depend on the driver, which compiles it again into the
+// pipeline cache of VulkanPipelineLayout.
+class SpirvCache {
+ public:
+  explicit SpirvCache(const std::string &path) : path_(path) {
+  }
+
+  std::vector<uint32> load_or_compile(const std::string &kernel_name,
+                                      const std::string &source) {
+    Entry entry;
+    entry.key = "vulkan1.1\n" + source;
+    const auto fn =
+        fmt::format("{}/spirv_{:016x}.bin", path_, hash_string(entry.key));
+    std::error_code ec;
+    if (!path_.empty() && std::filesystem::exists(fn, ec)) {
+      Entry cached;
+      read_from_binary_file(cached, fn);
+      if (cached.key == entry.key) {
+        TI_TRACE("[vulkan] SPIR-V loaded from cache [{}]", fn);
+        return std::move(cached.spirv);
+      }
+      TI_TRACE("[vulkan] Stale SPIR-V in cache [{}]", fn);
+    }
+    entry.spirv = compile(kernel_name, source);
+    if (!path_.empty()) {
+      store(entry, fn);
+    }
+    return std::move(entry.spirv);
+  }
+
+ private:
+  struct Entry {
+    // The source the SPIR-V was compiled from.
+    std::string key;
+    std::vector<uint32> spirv;
+
+    TI_IO_DEF(key, spirv);
+  };
+
+  static std::vector<uint32> compile(const std::string &kernel_name,
+                                     const std::string &source) {
+    shaderc::Compiler compiler;
+    shaderc::CompileOptions options;
+    options.SetTargetEnvironment(shaderc_target_env_vulkan,
+                                 shaderc_env_version_vulkan_1_1);
+    options.SetOptimizationLevel(shaderc_optimization_level_performance);
+    auto result = compiler.CompileGlslToSpv(source, shaderc_compute_shader,
+                                            kernel_name.c_str(), options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+      TI_ERROR("[vulkan] Failed to compile {}:\n{}\n{}", kernel_name,
+               result.GetErrorMessage(), source);
+    }
+    return std::vector<uint32>(result.cbegin(), result.cend());
+  }
+
+  void store(const Entry &entry, const std::string &fn) {
+    std::error_code ec;
+    std::filesystem::create_directories(path_, ec);
+    // As in LlvmOfflineCache::store(), so that concurrent processes never
+    // read a partially written entry.
+    auto tmp_fn = fmt::format(
+        "{}.tmp_{:x}", fn,
+        std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    write_to_binary_file(entry, tmp_fn);
+    std::filesystem::rename(tmp_fn, fn, ec);
+    if (ec) {
+      TI_WARN("Failed to store SPIR-V into cache [{}]: {}", fn, ec.message());
+      std::filesystem::remove(tmp_fn, ec);
+      return;
+    }
+    TI_TRACE("[vulkan] SPIR-V stored into cache [{}]", fn);
+  }
+
+  std::string path_;
+};
+
+}  // namespace
+
+struct VulkanRuntime::Impl {
+  // Destroyed in the reverse order: the programs before the stream, and the
+  // stream before the memory it uses.
+  std::unique_ptr<VulkanDevice> device;
+  std::unique_ptr<VulkanPipelineLayout> layout;
+  std::unique_ptr<VulkanMemoryPool> device_pool;
+  std::unique_ptr<VulkanMemoryPool> host_pool;
+  std::unique_ptr<VulkanStream> stream;
+  std::unique_ptr<SpirvCache> spirv_cache;
+  VulkanBuffer root;
+  VulkanBuffer gtmp;
+  VulkanBuffer listman;
+  // Host visible, for the print messages.
+  VulkanBuffer runtime;
+  std::vector<std::unique_ptr<CompiledProgram>> programs;
+
+  Impl(const CompileConfig &config, size_t root_size) {
+    device = VulkanDevice::create();
+    TI_ERROR_IF(!device, "[vulkan] No Vulkan device with a compute queue");
+    // Next to the LLVM kernels of the offline cache.
+    std::string cache_path;
+    if (config.offline_cache) {
+      cache_path = config.offline_cache_file_path.empty()
+                       ? get_repo_dir() + "/.cache/vulkan"
+                       : config.offline_cache_file_path + "/vulkan";
+    }
+    layout = std::make_unique<VulkanPipelineLayout>(device.get(), cache_path);
+    device_pool = std::make_unique<VulkanMemoryPool>(
+        device.get(), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, kDeviceBlockSize);
+    host_pool = std::make_unique<VulkanMemoryPool>(
+        device.get(),
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        kHostBlockSize);
+    stream = std::make_unique<VulkanStream>(device.get(), layout.get(),
+                                            host_pool.get(),
+                                            config.vulkan_launches_per_submit);
+    spirv_cache = std::make_unique<SpirvCache>(cache_path);
+
+    root = device_pool->allocate(root_size);
+    gtmp = device_pool->allocate(taichi_global_tmp_buffer_size);
+    listman = device_pool->allocate(sizeof(GLSLListman));
+    stream->fill_zero(root);
+    stream->fill_zero(gtmp);
+    stream->fill_zero(listman);
+    runtime = host_pool->allocate(sizeof(GLSLRuntime));
+    std::memset(runtime.mapped, 0, sizeof(GLSLRuntime));
+  }
+
+  ~Impl() {
+    stream->synchronize();
+    programs.clear();
+  }
+};
+
+struct CompiledProgram::Impl {
+  struct CompiledKernel {
+    std::string name;
+    std::unique_ptr<ParallelSize> ps;
+    std::unique_ptr<VulkanPipeline> pipeline;
+  };
+
+  VulkanRuntime::Impl *runtime;
+  std::vector<CompiledKernel> kernels;
+  int arg_count, ret_count;
+  std::map<int, size_t> ext_arr_map;
+  std::vector<std::string> str_table;
+  UsedFeature used;
+
+  Impl(Kernel *kernel, VulkanRuntime *runtime) : runtime(runtime->impl.get()) {
+    arg_count = kernel->args.size();
+    ret_count = kernel->rets.size();
+    for (int i = 0; i < arg_count; i++) {
+      if (kernel->args[i].is_nparray) {
+        ext_arr_map[i] = kernel->args[i].size;
+      }
+    }
+  }
+
+  void add(const std::string &kernel_name,
+           const std::string &kernel_source_code,
+           std::unique_ptr<ParallelSize> ps) {
+    const auto &limits = runtime->device->properties().limits;
+    ps->grid_dim =
+        std::min<size_t>(ps->grid_dim, limits.maxComputeWorkGroupCount[0]);
+    ps->block_dim = std::min<size_t>(
+        ps->block_dim, std::min(limits.maxComputeWorkGroupInvocations,
+                                limits.maxComputeWorkGroupSize[0]));
+
+    size_t layout_pos = kernel_source_code.find("precision highp float;\n");
+    TI_ASSERT(layout_pos != std::string::npos);
+    auto source = kernel_source_code.substr(0, layout_pos) +
+                  fmt::format("layout(local_size_x = {}, local_size_y = 1, "
+                              "local_size_z = 1) in;\n",
+                              ps->block_dim) +
+                  kernel_source_code.substr(layout_pos);
+    TI_TRACE("[vulkan]\ncompiling kernel {}<<<{}, {}>>>:\n{}", kernel_name,
+             ps->grid_dim, ps->block_dim, source);
+    auto spirv = runtime->spirv_cache->load_or_compile(kernel_name, source);
+    CompiledKernel kernel;
+    kernel.name = kernel_name;
+    kernel.ps = std::move(ps);
+    kernel.pipeline = std::make_unique<VulkanPipeline>(runtime->device.get(),
+                                                       *runtime->layout, spirv);
+    kernels.push_back(std::move(kernel));
+  }
+
+  int lookup_or_add_string(const std::string &str) {
+    int i;
+    for (i = 0; i < str_table.size(); i++) {
+      if (str_table[i] == str) {
+        return i;
+      }
+    }
+    str_table.push_back(str);
+    return i;
+  }
+
+  void launch(Context &ctx, void *result_buffer) const {
+    auto *stream = runtime->stream.get();
+    auto *host_pool = runtime->host_pool.get();
+    std::vector<char> args;
+    args.resize(std::max(arg_count, ret_count) * sizeof(uint64_t));
+    // As on OpenGL, the external arrays are concatenated into one buffer,
+    // and their arguments replaced by their offsets in it.
+    VulkanBuffer extr;
+    std::vector<void *> saved_ctx_ptrs;
+    if (ext_arr_map.size()) {
+      args.resize(taichi_opengl_earg_base +
+                  arg_count * taichi_max_num_indices * sizeof(int));
+      std::memcpy(args.data() + taichi_opengl_earg_base, ctx.extra_args,
+                  arg_count * taichi_max_num_indices * sizeof(int));
+      if (used.buf_extr) {
+        size_t accum_size = 0;
+        for (const auto &[i, size] : ext_arr_map) {
+          accum_size += size;
+        }
+        extr = host_pool->allocate(accum_size);
+        accum_size = 0;
+        for (const auto &[i, size] : ext_arr_map) {
+          auto ptr = (void *)ctx.args[i];
+          saved_ctx_ptrs.push_back(ptr);
+          std::memcpy((char *)extr.mapped + accum_size, ptr, size);
+          ctx.args[i] = accum_size;
+          accum_size += size;
+        }
+      }
+    }
+    std::memcpy(args.data(), ctx.args, arg_count * sizeof(uint64_t));
+    auto args_buf = host_pool->allocate(args.size());
+    std::memcpy(args_buf.mapped, args.data(), args.size());
+
+    std::vector<VulkanBuffer> buffers(kNumBindings);
+    buffers[(int)GLBufId::Root] = runtime->root;
+    buffers[(int)GLBufId::Gtmp] = runtime->gtmp;
+    buffers[(int)GLBufId::Args] = args_buf;
+    buffers[(int)GLBufId::Extr] = extr;
+    buffers[(int)GLBufId::Runtime] = runtime->runtime;
+    buffers[(int)GLBufId::Listman] = runtime->listman;
+    stream->begin_launch(buffers);
+    for (const auto &kernel : kernels) {
+      stream->dispatch(*kernel.pipeline, kernel.ps->grid_dim);
+    }
+    // The return values are written to the arguments buffer, and read back
+    // when the host waits for the launch.
+    if (ret_count > 0) {
+      stream->on_complete(
+          [mapped = args_buf.mapped, size = ret_count * sizeof(uint64_t),
+           result_buffer]() { std::memcpy(result_buffer, mapped, size); });
+    }
+    stream->release(args_buf);
+    const bool blocking = used.print || (extr.buffer && used.buf_extr_written);
+    if (extr.buffer && !blocking) {
+      stream->release(extr);
+    }
+    stream->end_launch();
+    if (!blocking) {
+      return;
+    }
+    // The host reads the external arrays right after the launch, and prints
+    // the messages in order with those of Python.
+    stream->synchronize();
+    if (extr.buffer) {
+      if (used.buf_extr_written) {
+        auto cpit = saved_ctx_ptrs.begin();
+        size_t accum_size = 0;
+        for (const auto &[i, size] : ext_arr_map) {
+          std::memcpy(*cpit, (char *)extr.mapped + accum_size, size);
+          accum_size += size;
+          cpit++;
+        }
+      }
+      host_pool->free(extr);
+    }
+    if (used.print) {
+      opengl::dump_messages((GLSLRuntime *)runtime->runtime.mapped,
+                            str_table);
+    }
+  }
+};
+
+VulkanRuntime::VulkanRuntime(const CompileConfig &config, size_t root_size)
+    : impl(std::make_unique<Impl>(config, root_size)) {
+}
+
+void VulkanRuntime::keep(std::unique_ptr<CompiledProgram> program) {
+  impl->programs.push_back(std::move(program));
+}
+
+void VulkanRuntime::synchronize() {
+  impl->stream->synchronize();
+}
+
+const opengl::SupportedExtensions &VulkanRuntime::supported_extensions()
+    const {
+  return impl->device->supported_extensions();
+}
+
+bool is_vulkan_api_available() {
+  if (get_environ_config("TI_ENABLE_VULKAN", 1) == 0)
+    return false;
+  static const bool available = VulkanDevice::create() != nullptr;
+  return available;
+}
+
+#else
+
+struct VulkanRuntime::Impl {};
+
+struct CompiledProgram::Impl {
+  Impl(Kernel *kernel, VulkanRuntime *runtime) {
+    TI_NOT_IMPLEMENTED;
+  }
+
+  void add(const std::string &kernel_name,
+           const std::string &kernel_source_code,
+           std::unique_ptr<ParallelSize> ps) {
+    TI_NOT_IMPLEMENTED;
+  }
+
+  int lookup_or_add_string(const std::string &str) {
+    TI_NOT_IMPLEMENTED;
+  }
+
+  void launch(Context &ctx, void *result_buffer) const {
+    TI_NOT_IMPLEMENTED;
+  }
+
+  UsedFeature used;
+};
+
+VulkanRuntime::VulkanRuntime(const CompileConfig &config, size_t root_size) {
+  TI_NOT_IMPLEMENTED;
+}
+
+void VulkanRuntime::keep(std::unique_ptr<CompiledProgram> program) {
+  TI_NOT_IMPLEMENTED;
+}
+
+void VulkanRuntime::synchronize() {
+  TI_NOT_IMPLEMENTED;
+}
+
+const opengl::SupportedExtensions &VulkanRuntime::supported_extensions()
+    const {
+  TI_NOT_IMPLEMENTED;
+}
+
+bool is_vulkan_api_available() {
+  return false;
+}
+
+#endif  // TI_WITH_VULKAN
+
+VulkanRuntime::~VulkanRuntime() = default;
+
+CompiledProgram::CompiledProgram(Kernel *kernel, VulkanRuntime *runtime)
+    : impl(std::make_unique<Impl>(kernel, runtime)) {
+}
+
+CompiledProgram::~CompiledProgram() = default;
+
+void CompiledProgram::add(const std::string &kernel_name,
+                          const std::string &kernel_source_code,
+                          std::unique_ptr<ParallelSize> ps) {
+  impl->add(kernel_name, kernel_source_code, std::move(ps));
+}
+
+void CompiledProgram::set_used(const UsedFeature &used) {
+  impl->used = used;
+}
+
+int CompiledProgram::lookup_or_add_string(const std::string &str) {
+  return impl->lookup_or_add_string(str);
+}
+
+void CompiledProgram::launch(Context &ctx, VulkanRuntime *runtime) const {
+  impl->launch(ctx, runtime->result_buffer);
+}
+
+}  // namespace vulkan
+TLANG_NAMESPACE_END
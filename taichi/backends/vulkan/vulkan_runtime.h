@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "taichi/backends/opengl/opengl_api.h"
+#include "taichi/backends/opengl/opengl_kernel_util.h"
+#include "taichi/program/compile_config.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Kernel;
+
+namespace vulkan {
+
+bool is_vulkan_api_available();
+
+class CompiledProgram;
+
+// The device, the memory and the command stream of the Vulkan backend, and
+// the buffers shared by all the kernels: the root buffer, the global
+// temporaries, the list manager and the print messages, see opengl::GLBufId.
+//
+// The kernels are launched asynchronously: the host only waits for them in
+// synchronize(), or when a kernel writes an external array.
+class VulkanRuntime {
+ public:
+  VulkanRuntime(const CompileConfig &config, size_t root_size);
+  ~VulkanRuntime();
+
+  void keep(std::unique_ptr<CompiledProgram> program);
+  // Waits for the launched kernels, and writes their return values to
+  // |result_buffer|.
+  void synchronize();
+  const opengl::SupportedExtensions &supported_extensions() const;
+
+  void *result_buffer{nullptr};
+
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+// The GLSL kernels generated by opengl::KernelGen for a Taichi kernel,
+// compiled to SPIR-V once added.
+class CompiledProgram {
+ public:
+  CompiledProgram(Kernel *kernel, VulkanRuntime *runtime);
+  ~CompiledProgram();
+
+  void add(const std::string &kernel_name,
+           const std::string &kernel_source_code,
+           std::unique_ptr<opengl::ParallelSize> ps);
+  void set_used(const opengl::UsedFeature &used);
+  int lookup_or_add_string(const std::string &str);
+  void launch(Context &ctx, VulkanRuntime *runtime) const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+}  // namespace vulkan
+TLANG_NAMESPACE_END
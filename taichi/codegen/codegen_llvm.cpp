@@ -1,9 +1,17 @@
 #include "taichi/codegen/codegen_llvm.h"
 
+#include "taichi/ir/analysis.h"
 #include "taichi/ir/statements.h"
 #include "taichi/struct/struct_llvm.h"
+#include "taichi/llvm/llvm_offline_cache.h"
+#include "taichi/program/profile_guide.h"
 #include "taichi/util/file_sequence_writer.h"
 
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/Host.h"
+
 TLANG_NAMESPACE_BEGIN
 
 // TODO: sort function definitions to match declaration order in header
@@ -27,9 +35,9 @@ void OffloadedTask::operator()(Context *context) {
   func(context);
 }
 
-void OffloadedTask::compile() {
+void OffloadedTask::compile(JITModule *jit_module) {
   TI_ASSERT(!func);
-  auto kernel_symbol = codegen->tlctx->lookup_function_pointer(name);
+  auto kernel_symbol = jit_module->lookup_function(name);
   TI_ASSERT_INFO(kernel_symbol, "Function not found");
 
   func = (task_fp_type)kernel_symbol;
@@ -120,7 +128,7 @@ CodeGenStmtGuard make_while_after_loop_guard(CodeGenLLVM *cg) {
 
 // CodeGenLLVM
 
-uint64 CodeGenLLVM::task_counter = 0;
+std::atomic<uint64> CodeGenLLVM::task_counter = 0;
 
 void CodeGenLLVM::visit(Block *stmt_list) {
   for (auto &stmt : stmt_list->statements) {
@@ -198,6 +206,10 @@ std::unique_ptr<RuntimeObject> CodeGenLLVM::emit_struct_meta_object(
   } else if (snode->type == SNodeType::pointer) {
     meta = std::make_unique<RuntimeObject>("PointerMeta", this, builder.get());
     emit_struct_meta_base("Pointer", meta->ptr, snode);
+  } else if (snode->type == SNodeType::hash) {
+    meta = std::make_unique<RuntimeObject>("HashMeta", this, builder.get());
+    emit_struct_meta_base("Hash", meta->ptr, snode);
+    meta->call("set_capacity", tlctx->get_constant(snode->hash_capacity));
   } else if (snode->type == SNodeType::root) {
     meta = std::make_unique<RuntimeObject>("RootMeta", this, builder.get());
     emit_struct_meta_base("Root", meta->ptr, snode);
@@ -205,6 +217,8 @@ std::unique_ptr<RuntimeObject> CodeGenLLVM::emit_struct_meta_object(
     meta = std::make_unique<RuntimeObject>("DynamicMeta", this, builder.get());
     emit_struct_meta_base("Dynamic", meta->ptr, snode);
     meta->call("set_chunk_size", tlctx->get_constant(snode->chunk_size));
+    meta->call("set_chunk_directory",
+               tlctx->get_constant((int)snode->chunk_directory));
   } else if (snode->type == SNodeType::bitmasked) {
     meta =
         std::make_unique<RuntimeObject>("BitmaskedMeta", this, builder.get());
@@ -226,7 +240,8 @@ void CodeGenLLVM::emit_struct_meta_base(const std::string &name,
         StructCompilerLLVM::get_llvm_body_type(module.get(), snode);
     auto element_ty = body_type->getArrayElementType();
     element_size = tlctx->get_type_size(element_ty);
-  } else if (snode->type == SNodeType::pointer) {
+  } else if (snode->type == SNodeType::pointer ||
+             snode->type == SNodeType::hash) {
     auto element_ty = StructCompilerLLVM::get_llvm_node_type(
         module.get(), snode->ch[0].get());
     element_size = tlctx->get_type_size(element_ty);
@@ -257,6 +272,23 @@ void CodeGenLLVM::emit_struct_meta_base(const std::string &name,
   for (auto const &f : functions)
     common.set(f, get_runtime_function(fmt::format("{}_{}", name, f)));
 
+  auto set_optional_function = [&](const std::string &f, bool present) {
+    if (present) {
+      common.set(f, get_runtime_function(fmt::format("{}_{}", name, f)));
+    } else {
+      auto func_ptr_type = get_runtime_function("StructMeta_set_" + f)
+                               ->getFunctionType()
+                               ->getParamType(1);
+      common.set(f, llvm::ConstantPointerNull::get(
+                        llvm::cast<llvm::PointerType>(func_ptr_type)));
+    }
+  };
+  set_optional_function("get_active_mask",
+                        snode->type == SNodeType::pointer ||
+                            snode->type == SNodeType::hash ||
+                            snode->type == SNodeType::bitmasked);
+  set_optional_function("slot_to_index", snode->type == SNodeType::hash);
+
   // "from_parent_element", "refine_coordinates" are different for different
   // snodes, even if they have the same type.
   if (snode->parent)
@@ -271,7 +303,11 @@ void CodeGenLLVM::emit_struct_meta_base(const std::string &name,
 CodeGenLLVM::CodeGenLLVM(Kernel *kernel, IRNode *ir)
     // TODO: simplify LLVMModuleBuilder ctor input
     : LLVMModuleBuilder(
-          kernel->program.get_llvm_context(kernel->arch)->clone_struct_module(),
+          kernel->program.config.lazy_runtime_linking
+              ? kernel->program.get_llvm_context(kernel->arch)
+                    ->clone_struct_module_declarations()
+              : kernel->program.get_llvm_context(kernel->arch)
+                    ->clone_struct_module(),
           kernel->program.get_llvm_context(kernel->arch)),
       kernel(kernel),
       ir(ir),
@@ -308,6 +344,41 @@ llvm::Value *CodeGenLLVM::cast_int(llvm::Value *input_val,
   }
 }
 
+namespace {
+
+// Whether the kernels of |arch| convert between f16 and f32 with native
+// instructions. On x64 this requires F16C, otherwise the conversions are
+// done by the runtime.
+bool has_native_f16_conversions(Arch arch) {
+  if (arch != Arch::x64) {
+    return true;
+  }
+  static const bool has_f16c = [] {
+    llvm::StringMap<bool> features;
+    return llvm::sys::getHostCPUFeatures(features) && features.lookup("f16c");
+  }();
+  return has_f16c;
+}
+
+}  // namespace
+
+llvm::Value *CodeGenLLVM::f16_to_f32(llvm::Value *val) {
+  if (has_native_f16_conversions(kernel->arch)) {
+    return builder->CreateFPExt(val, llvm::Type::getFloatTy(*llvm_context));
+  }
+  auto bits =
+      builder->CreateBitCast(val, llvm::Type::getInt16Ty(*llvm_context));
+  return create_call("f16_bits_to_f32", {bits});
+}
+
+llvm::Value *CodeGenLLVM::f32_to_f16(llvm::Value *val) {
+  if (has_native_f16_conversions(kernel->arch)) {
+    return builder->CreateFPTrunc(val, llvm::Type::getHalfTy(*llvm_context));
+  }
+  auto bits = create_call("f32_to_f16_bits", {val});
+  return builder->CreateBitCast(bits, llvm::Type::getHalfTy(*llvm_context));
+}
+
 void CodeGenLLVM::visit(UnaryOpStmt *stmt) {
   auto input = llvm_val[stmt->operand];
   auto input_type = input->getType();
@@ -323,7 +394,27 @@ void CodeGenLLVM::visit(UnaryOpStmt *stmt) {
     auto from = stmt->operand->ret_type;
     auto to = stmt->cast_type;
     TI_ASSERT(from != to);
-    if (is_real(from) != is_real(to)) {
+    if (from->is_primitive(PrimitiveTypeID::f16) ||
+        to->is_primitive(PrimitiveTypeID::f16)) {
+      // Goes through f32.
+      auto f32_type = tlctx->get_data_type(PrimitiveType::f32);
+      auto val = llvm_val[stmt->operand];
+      if (from->is_primitive(PrimitiveTypeID::f16)) {
+        val = f16_to_f32(val);
+      } else if (is_real(from)) {
+        val = builder->CreateFPCast(val, f32_type);
+      } else {
+        val = builder->CreateSIToFP(val, f32_type);
+      }
+      if (to->is_primitive(PrimitiveTypeID::f16)) {
+        val = f32_to_f16(val);
+      } else if (is_real(to)) {
+        val = builder->CreateFPCast(val, tlctx->get_data_type(to));
+      } else {
+        val = builder->CreateFPToSI(val, tlctx->get_data_type(to));
+      }
+      llvm_val[stmt] = val;
+    } else if (is_real(from) != is_real(to)) {
       if (is_real(from) && is_integral(to)) {
         cast_op = llvm::Instruction::CastOps::FPToSI;
       } else if (is_integral(from) && is_real(to)) {
@@ -647,15 +738,20 @@ void CodeGenLLVM::visit(IfStmt *if_stmt) {
       llvm::BasicBlock::Create(*llvm_context, "false_block", func);
   llvm::BasicBlock *after_if =
       llvm::BasicBlock::Create(*llvm_context, "after_if", func);
+  llvm::MDNode *weights = nullptr;
+  if (auto counts = get_profile_counts(if_stmt))
+    weights = create_branch_weights(counts->first, counts->second);
   builder->CreateCondBr(
       builder->CreateICmpNE(llvm_val[if_stmt->cond], tlctx->get_constant(0)),
-      true_block, false_block);
+      true_block, false_block, weights);
   builder->SetInsertPoint(true_block);
+  add_profile_count(if_stmt, 0, tlctx->get_constant((int64)1));
   if (if_stmt->true_statements) {
     if_stmt->true_statements->accept(this);
   }
   builder->CreateBr(after_if);
   builder->SetInsertPoint(false_block);
+  add_profile_count(if_stmt, 1, tlctx->get_constant((int64)1));
   if (if_stmt->false_statements) {
     if_stmt->false_statements->accept(this);
   }
@@ -688,7 +784,10 @@ void CodeGenLLVM::visit(PrintStmt *stmt) {
     if (std::holds_alternative<Stmt *>(content)) {
       auto arg_stmt = std::get<Stmt *>(content);
       auto value = llvm_val[arg_stmt];
-      if (arg_stmt->ret_type->is_primitive(PrimitiveTypeID::f32))
+      if (arg_stmt->ret_type->is_primitive(PrimitiveTypeID::f16))
+        value = f16_to_f32(value);
+      if (arg_stmt->ret_type->is_primitive(PrimitiveTypeID::f16) ||
+          arg_stmt->ret_type->is_primitive(PrimitiveTypeID::f32))
         value = builder->CreateFPExt(value,
                                      tlctx->get_data_type(PrimitiveType::f64));
       args.push_back(value);
@@ -798,13 +897,37 @@ void CodeGenLLVM::emit_list_gen(OffloadedStmt *listgen) {
     // more parallelism.
     call("element_listgen_root", get_runtime(), meta_parent, meta_child);
   } else {
-    call("element_listgen_nonroot", get_runtime(), meta_parent, meta_child);
+    auto listgen = get_runtime_function("element_listgen_nonroot");
+    auto expand_type = listgen->getFunctionType()->getParamType(4);
+    llvm::Value *expand = llvm::ConstantPointerNull::get(
+        llvm::cast<llvm::PointerType>(expand_type));
+    if (arch_is_cpu(current_arch())) {
+      // The tasks of the parallel listgen go through a function pointer, so
+      // they get their own specialization with the metas of the two SNodes,
+      // in which the calls to the node functions are direct and inlined.
+      auto guard = get_function_creation_guard(
+          {llvm::PointerType::get(context_ty, 0),
+           llvm::Type::getInt8PtrTy(*llvm_context),
+           tlctx->get_data_type<int>()});
+      auto task_meta_child =
+          cast_pointer(emit_struct_meta(snode_child), "StructMeta");
+      auto task_meta_parent =
+          cast_pointer(emit_struct_meta(snode_parent), "StructMeta");
+      call("element_listgen_expand_range", get_arg(1), task_meta_parent,
+           task_meta_child, get_arg(2));
+      expand = guard.body;
+    }
+    create_call(listgen,
+                {get_runtime(), meta_parent, meta_child,
+                 tlctx->get_constant(prog->config.cpu_max_num_threads),
+                 expand});
   }
 }
 
 void CodeGenLLVM::emit_gc(OffloadedStmt *stmt) {
   auto snode = stmt->snode->id;
-  call("node_gc", get_runtime(), tlctx->get_constant(snode));
+  call("node_gc", get_runtime(), tlctx->get_constant(snode),
+       tlctx->get_constant(prog->config.cpu_max_num_threads));
 }
 
 llvm::Value *CodeGenLLVM::create_call(llvm::Value *func,
@@ -835,6 +958,20 @@ void CodeGenLLVM::create_naive_range_for(RangeForStmt *for_stmt) {
   auto loop_var = create_entry_block_alloca(PrimitiveType::i32);
   loop_vars_llvm[for_stmt].push_back(loop_var);
 
+  // Counts the runs of the loop and their iterations.
+  if (profile_counter_begin != -1 && profile_slots.count(for_stmt)) {
+    auto *num_iterations = builder->CreateSub(llvm_val[for_stmt->end],
+                                              llvm_val[for_stmt->begin]);
+    num_iterations = builder->CreateSelect(
+        builder->CreateICmpSGT(num_iterations, tlctx->get_constant(0)),
+        num_iterations, tlctx->get_constant(0));
+    add_profile_count(for_stmt, 0, tlctx->get_constant((int64)1));
+    add_profile_count(
+        for_stmt, 1,
+        builder->CreateSExt(num_iterations, tlctx->get_data_type<int64>()));
+  }
+  const auto counts = get_profile_counts(for_stmt);
+
   if (!for_stmt->reversed) {
     builder->CreateStore(llvm_val[for_stmt->begin], loop_var);
   } else {
@@ -857,7 +994,10 @@ void CodeGenLLVM::create_naive_range_for(RangeForStmt *for_stmt) {
                                  builder->CreateLoad(loop_var),
                                  llvm_val[for_stmt->begin]);
     }
-    builder->CreateCondBr(cond, body, after_loop);
+    builder->CreateCondBr(
+        cond, body, after_loop,
+        counts ? create_branch_weights(counts->second, counts->first)
+               : nullptr);
   }
 
   {
@@ -879,7 +1019,36 @@ void CodeGenLLVM::create_naive_range_for(RangeForStmt *for_stmt) {
     } else {
       create_increment(loop_var, tlctx->get_constant(-1));
     }
-    builder->CreateBr(loop_test);
+    auto *latch = builder->CreateBr(loop_test);
+    if (counts && counts->first > 0) {
+      // Loops that rarely iterate are not worth the code of unrolling, while
+      // the long ones are unrolled even with bounds unknown until run time.
+      const auto average_iterations = counts->second / counts->first;
+      auto get_property = [&](const char *name, llvm::Metadata *value) {
+        std::vector<llvm::Metadata *> operands = {
+            llvm::MDString::get(*llvm_context, name)};
+        if (value)
+          operands.push_back(value);
+        return llvm::MDNode::get(*llvm_context, operands);
+      };
+      llvm::MDNode *property = nullptr;
+      if (average_iterations < 2) {
+        property = get_property("llvm.loop.unroll.disable", nullptr);
+      } else if (average_iterations >= 32) {
+        property = get_property(
+            "llvm.loop.unroll.count",
+            llvm::ConstantAsMetadata::get(
+                llvm::ConstantInt::get(tlctx->get_data_type<int>(), 4)));
+      }
+      if (property) {
+        auto placeholder =
+            llvm::MDNode::getTemporary(*llvm_context, llvm::None);
+        auto *loop_id = llvm::MDNode::getDistinct(
+            *llvm_context, {placeholder.get(), property});
+        loop_id->replaceOperandWith(0, loop_id);
+        latch->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+      }
+    }
   }
 
   // next cfg
@@ -891,8 +1060,7 @@ void CodeGenLLVM::visit(RangeForStmt *for_stmt) {
 }
 
 void CodeGenLLVM::visit(ArgLoadStmt *stmt) {
-  auto raw_arg = call(builder.get(), "Context_get_args", get_context(),
-                      tlctx->get_constant(stmt->arg_id));
+  auto raw_arg = load_context_arg(stmt->arg_id);
 
   llvm::Type *dest_ty = nullptr;
   if (stmt->is_ptr) {
@@ -1006,13 +1174,15 @@ void CodeGenLLVM::visit(SNodeOpStmt *stmt) {
     llvm_val[stmt] =
         call(snode, llvm_val[stmt->ptr], "is_active", {llvm_val[stmt->val]});
   } else if (stmt->op_type == SNodeOpType::activate) {
-    llvm_val[stmt] =
-        call(snode, llvm_val[stmt->ptr], "activate", {llvm_val[stmt->val]});
+    llvm_val[stmt] = call(snode, llvm_val[stmt->ptr],
+                          get_activation_method(snode, "activate"),
+                          {llvm_val[stmt->val]});
   } else if (stmt->op_type == SNodeOpType::deactivate) {
     if (snode->type == SNodeType::pointer || snode->type == SNodeType::hash ||
         snode->type == SNodeType::bitmasked) {
-      llvm_val[stmt] =
-          call(snode, llvm_val[stmt->ptr], "deactivate", {llvm_val[stmt->val]});
+      llvm_val[stmt] = call(snode, llvm_val[stmt->ptr],
+                            get_activation_method(snode, "deactivate"),
+                            {llvm_val[stmt->val]});
     } else if (snode->type == SNodeType::dynamic) {
       llvm_val[stmt] = call(snode, llvm_val[stmt->ptr], "deactivate", {});
     }
@@ -1021,17 +1191,52 @@ void CodeGenLLVM::visit(SNodeOpStmt *stmt) {
   }
 }
 
+namespace {
+
+// Whether |ptr| points to a bit_struct member occupying the highest bits of
+// the physical word, out of which carries are simply dropped.
+bool is_highest_bit_struct_member(Stmt *ptr, CustomIntType *cit) {
+  auto get_ch = ptr->cast<GetChStmt>();
+  if (!get_ch || get_ch->input_snode->type != SNodeType::bit_struct)
+    return false;
+  auto bit_struct = get_ch->input_snode->dt->as<BitStructType>();
+  auto bit_offset = bit_struct->get_member_bit_offset(
+      get_ch->input_snode->child_id(get_ch->output_snode));
+  return bit_offset + cit->get_num_bits() ==
+         data_type_bits(bit_struct->get_physical_type());
+}
+
+}  // namespace
+
 llvm::Value *CodeGenLLVM::atomic_add_custom_int(AtomicOpStmt *stmt,
                                                 CustomIntType *cit) {
   llvm::Value *byte_ptr, *bit_offset;
   read_bit_pointer(llvm_val[stmt->dest], byte_ptr, bit_offset);
   auto physical_type = cit->get_physical_type();
+  auto physical_ptr =
+      builder->CreateBitCast(byte_ptr, llvm_ptr_type(physical_type));
+  auto value = cast_int(llvm_val[stmt->val], stmt->val->ret_type.get_ptr(),
+                        physical_type);
+  if (prog->config.quant_atomic_add_allow_overflow ||
+      is_highest_bit_struct_member(stmt->dest, cit)) {
+    // No other member can be corrupted by a carry: adding the shifted value
+    // to the whole word takes a single integer atomic instead of a CAS loop.
+    auto shift = builder->CreateZExtOrTrunc(bit_offset, value->getType());
+    return builder->CreateAtomicRMW(
+        llvm::AtomicRMWInst::BinOp::Add, physical_ptr,
+        builder->CreateShl(value, shift),
+        llvm::AtomicOrdering::SequentiallyConsistent);
+  }
   return create_call(
       fmt::format("atomic_add_partial_bits_b{}", data_type_bits(physical_type)),
-      {builder->CreateBitCast(byte_ptr, llvm_ptr_type(physical_type)),
-       bit_offset, tlctx->get_constant(cit->get_num_bits()),
-       cast_int(llvm_val[stmt->val], stmt->val->ret_type.get_ptr(),
-                physical_type)});
+      {physical_ptr, bit_offset, tlctx->get_constant(cit->get_num_bits()),
+       value});
+}
+
+llvm::Value *CodeGenLLVM::atomic_add_f16(AtomicOpStmt *stmt) {
+  auto bits_ptr = builder->CreateBitCast(
+      llvm_val[stmt->dest], llvm::Type::getInt16PtrTy(*llvm_context));
+  return create_call("atomic_add_f16", {bits_ptr, llvm_val[stmt->val]});
 }
 
 void CodeGenLLVM::visit(AtomicOpStmt *stmt) {
@@ -1039,6 +1244,9 @@ void CodeGenLLVM::visit(AtomicOpStmt *stmt) {
   // TODO: deal with mask when vectorized
   // TODO(type): support all AtomicOpTypes on custom types
   TI_ASSERT(stmt->width() == 1);
+  if (uses_cached_bit_array_word(stmt->dest)) {
+    flush_cached_bit_array_word();
+  }
   for (int l = 0; l < stmt->width(); l++) {
     llvm::Value *old_value;
     if (stmt->op_type == AtomicOpType::add) {
@@ -1048,14 +1256,16 @@ void CodeGenLLVM::visit(AtomicOpStmt *stmt) {
         old_value = builder->CreateAtomicRMW(
             llvm::AtomicRMWInst::BinOp::Add, llvm_val[stmt->dest],
             llvm_val[stmt->val], llvm::AtomicOrdering::SequentiallyConsistent);
-      } else if (stmt->val->ret_type->is_primitive(PrimitiveTypeID::f32)) {
-        old_value =
-            builder->CreateCall(get_runtime_function("atomic_add_f32"),
-                                {llvm_val[stmt->dest], llvm_val[stmt->val]});
-      } else if (stmt->val->ret_type->is_primitive(PrimitiveTypeID::f64)) {
-        old_value =
-            builder->CreateCall(get_runtime_function("atomic_add_f64"),
-                                {llvm_val[stmt->dest], llvm_val[stmt->val]});
+      } else if (dst_type->is_primitive(PrimitiveTypeID::f16)) {
+        old_value = atomic_add_f16(stmt);
+      } else if (stmt->val->ret_type->is_primitive(PrimitiveTypeID::f32) ||
+                 stmt->val->ret_type->is_primitive(PrimitiveTypeID::f64)) {
+        // LLVM lowers this to a native float atomic where the target has one,
+        // and otherwise to a compare-exchange loop that retries with the
+        // value the failed exchange loaded, inlined at the call site.
+        old_value = builder->CreateAtomicRMW(
+            llvm::AtomicRMWInst::FAdd, llvm_val[stmt->dest],
+            llvm_val[stmt->val], llvm::AtomicOrdering::SequentiallyConsistent);
       } else if (auto cit = dst_type->cast<CustomIntType>()) {
         old_value = atomic_add_custom_int(stmt, cit);
       } else {
@@ -1169,6 +1379,26 @@ void CodeGenLLVM::visit(GlobalStoreStmt *stmt) {
     }
     llvm::Value *byte_ptr = nullptr, *bit_offset = nullptr;
     read_bit_pointer(llvm_val[stmt->ptr], byte_ptr, bit_offset);
+    if (uses_cached_bit_array_word(stmt->ptr)) {
+      // Only the cached word changes; see flush_cached_bit_array_word().
+      auto physical_type = llvm_type(cit->get_physical_type());
+      auto word = get_cached_bit_array_word(builder->CreateBitCast(
+          byte_ptr, llvm_ptr_type(cit->get_physical_type())));
+      const int num_bits = cit->get_num_bits();
+      auto offset = builder->CreateIntCast(bit_offset, physical_type, false);
+      auto mask = llvm::ConstantInt::get(
+          physical_type, num_bits == 64 ? ~0ULL : (1ULL << num_bits) - 1);
+      auto bits = builder->CreateAnd(
+          builder->CreateIntCast(store_value, physical_type, false), mask);
+      builder->CreateStore(
+          builder->CreateOr(
+              builder->CreateAnd(word,
+                                 builder->CreateNot(
+                                     builder->CreateShl(mask, offset))),
+              builder->CreateShl(bits, offset)),
+          cached_word);
+      return;
+    }
     // TODO(type): CUDA only supports atomicCAS on 32- and 64-bit integers.
     // Try to support CustomInt/FloatType with 8/16-bit physical
     // types.
@@ -1180,18 +1410,83 @@ void CodeGenLLVM::visit(GlobalStoreStmt *stmt) {
                  builder->CreateIntCast(
                      store_value, llvm_type(cit->get_physical_type()), false)});
   } else {
-    builder->CreateStore(llvm_val[stmt->data], llvm_val[stmt->ptr]);
+    auto store =
+        builder->CreateStore(llvm_val[stmt->data], llvm_val[stmt->ptr]);
+    if (auto alignment = get_access_alignment(stmt->ptr)) {
+      store->setAlignment(llvm::MaybeAlign(alignment));
+    }
   }
 }
 
+int CodeGenLLVM::get_access_alignment(Stmt *ptr) const {
+  auto get_ch = ptr->cast<GetChStmt>();
+  if (!get_ch || get_ch->output_snode->type != SNodeType::place)
+    return 0;
+  auto snode = get_ch->output_snode;
+  if (!snode->dt->is<PrimitiveType>() ||
+      snode->address_alignment <= data_type_size(snode->dt))
+    return 0;
+  return snode->address_alignment;
+}
+
+bool CodeGenLLVM::uses_cached_bit_array_word(Stmt *ptr) const {
+  if (!cached_bit_array)
+    return false;
+  auto get_ch = ptr->cast<GetChStmt>();
+  return get_ch && get_ch->input_snode == cached_bit_array;
+}
+
+llvm::Value *CodeGenLLVM::get_cached_bit_array_word(llvm::Value *word_ptr) {
+  auto miss = llvm::BasicBlock::Create(*llvm_context, "word_miss", func);
+  auto hit = llvm::BasicBlock::Create(*llvm_context, "word_hit", func);
+  builder->CreateCondBr(
+      builder->CreateICmpNE(builder->CreateLoad(cached_word_ptr), word_ptr),
+      miss, hit);
+  builder->SetInsertPoint(miss);
+  flush_cached_bit_array_word();
+  auto word = builder->CreateLoad(word_ptr);
+  builder->CreateStore(word_ptr, cached_word_ptr);
+  builder->CreateStore(word, cached_word);
+  builder->CreateStore(word, cached_word_loaded);
+  builder->CreateBr(hit);
+  builder->SetInsertPoint(hit);
+  return builder->CreateLoad(cached_word);
+}
+
+void CodeGenLLVM::flush_cached_bit_array_word() {
+  auto word_ptr = builder->CreateLoad(cached_word_ptr);
+  auto changed = builder->CreateXor(builder->CreateLoad(cached_word),
+                                    builder->CreateLoad(cached_word_loaded));
+  auto write = llvm::BasicBlock::Create(*llvm_context, "word_write", func);
+  auto after = llvm::BasicBlock::Create(*llvm_context, "word_written", func);
+  builder->CreateCondBr(
+      builder->CreateAnd(
+          builder->CreateIsNotNull(word_ptr),
+          builder->CreateICmpNE(
+              changed, llvm::ConstantInt::get(changed->getType(), 0))),
+      write, after);
+  builder->SetInsertPoint(write);
+  builder->CreateAtomicRMW(llvm::AtomicRMWInst::BinOp::Xor, word_ptr, changed,
+                           llvm::AtomicOrdering::SequentiallyConsistent);
+  builder->CreateBr(after);
+  builder->SetInsertPoint(after);
+  builder->CreateStore(
+      llvm::ConstantPointerNull::get(
+          llvm::cast<llvm::PointerType>(word_ptr->getType())),
+      cached_word_ptr);
+}
+
 llvm::Value *CodeGenLLVM::load_as_custom_int(Stmt *ptr, Type *load_type) {
   auto *cit = load_type->as<CustomIntType>();
   // load bit pointer
   llvm::Value *byte_ptr, *bit_offset;
   read_bit_pointer(llvm_val[ptr], byte_ptr, bit_offset);
 
-  auto bit_level_container = builder->CreateLoad(builder->CreateBitCast(
-      byte_ptr, llvm_ptr_type(cit->get_physical_type())));
+  auto word_ptr =
+      builder->CreateBitCast(byte_ptr, llvm_ptr_type(cit->get_physical_type()));
+  auto bit_level_container = uses_cached_bit_array_word(ptr)
+                                 ? get_cached_bit_array_word(word_ptr)
+                                 : builder->CreateLoad(word_ptr);
 
   return extract_custom_int(bit_level_container, bit_offset, load_type);
 }
@@ -1255,9 +1550,17 @@ void CodeGenLLVM::visit(GlobalLoadStmt *stmt) {
     } else {
       TI_NOT_IMPLEMENTED
     }
+  } else if (ptr_type->get_pointee_type()->is_primitive(
+                 PrimitiveTypeID::f16)) {
+    llvm_val[stmt] = f16_to_f32(builder->CreateLoad(
+        tlctx->get_data_type(PrimitiveType::f16), llvm_val[stmt->ptr]));
   } else {
-    llvm_val[stmt] = builder->CreateLoad(tlctx->get_data_type(stmt->ret_type),
-                                         llvm_val[stmt->ptr]);
+    auto load = builder->CreateLoad(tlctx->get_data_type(stmt->ret_type),
+                                    llvm_val[stmt->ptr]);
+    if (auto alignment = get_access_alignment(stmt->ptr)) {
+      load->setAlignment(llvm::MaybeAlign(alignment));
+    }
+    llvm_val[stmt] = load;
   }
 }
 
@@ -1302,6 +1605,13 @@ std::string CodeGenLLVM::get_runtime_snode_name(SNode *snode) {
   }
 }
 
+std::string CodeGenLLVM::get_activation_method(SNode *snode,
+                                               const std::string &method) {
+  if (snode->type == SNodeType::pointer && !prog->config.lock_free_activation)
+    return method + "_locked";
+  return method;
+}
+
 llvm::Value *CodeGenLLVM::call(SNode *snode,
                                llvm::Value *node_ptr,
                                const std::string &method,
@@ -1323,11 +1633,22 @@ llvm::Value *CodeGenLLVM::call(SNode *snode,
 }
 
 void CodeGenLLVM::visit(GetRootStmt *stmt) {
+  auto root = stmt->root ? stmt->root : prog->snode_root.get();
+  llvm::Value *root_ptr = nullptr;
+  if (root->snode_tree_id == 0) {
+    root_ptr = get_root();
+  } else {
+    const auto &trees = prog->get_materialized_snode_trees();
+    TI_ERROR_IF(std::find(trees.begin(), trees.end(), root) == trees.end(),
+                "SNode tree {} is accessed before it is materialized",
+                root->snode_tree_id);
+    root_ptr = call("LLVMRuntime_get_roots", get_runtime(),
+                    tlctx->get_constant(root->snode_tree_id));
+  }
   llvm_val[stmt] = builder->CreateBitCast(
-      get_root(),
-      llvm::PointerType::get(StructCompilerLLVM::get_llvm_node_type(
-                                 module.get(), prog->snode_root.get()),
-                             0));
+      root_ptr, llvm::PointerType::get(StructCompilerLLVM::get_llvm_node_type(
+                                           module.get(), root),
+                                       0));
 }
 
 void CodeGenLLVM::visit(BitExtractStmt *stmt) {
@@ -1384,10 +1705,12 @@ void CodeGenLLVM::visit(SNodeLookupStmt *stmt) {
     llvm_val[stmt] = builder->CreateGEP(parent, llvm_val[stmt->input_index]);
   } else if (snode->type == SNodeType::dense ||
              snode->type == SNodeType::pointer ||
+             snode->type == SNodeType::hash ||
              snode->type == SNodeType::dynamic ||
              snode->type == SNodeType::bitmasked) {
     if (stmt->activate) {
-      call(snode, llvm_val[stmt->input_snode], "activate",
+      call(snode, llvm_val[stmt->input_snode],
+           get_activation_method(snode, "activate"),
            {llvm_val[stmt->input_index]});
     }
     llvm_val[stmt] = call(snode, llvm_val[stmt->input_snode], "lookup_element",
@@ -1407,6 +1730,13 @@ void CodeGenLLVM::visit(SNodeLookupStmt *stmt) {
 }
 
 void CodeGenLLVM::visit(GetChStmt *stmt) {
+  if (stmt->input_snode->type == SNodeType::root && current_task) {
+    auto &root_children = current_task->root_children;
+    if (std::find(root_children.begin(), root_children.end(),
+                  stmt->output_snode->id) == root_children.end()) {
+      root_children.push_back(stmt->output_snode->id);
+    }
+  }
   if (stmt->input_snode->type == SNodeType::bit_array) {
     llvm_val[stmt] = llvm_val[stmt->input_ptr];
   } else if (stmt->ret_type->as<PointerType>()->is_bit_pointer()) {
@@ -1436,10 +1766,7 @@ void CodeGenLLVM::visit(ExternalPtrStmt *stmt) {
   std::vector<llvm::Value *> sizes(num_indices);
 
   for (int i = 0; i < num_indices; i++) {
-    auto raw_arg = builder->CreateCall(
-        get_runtime_function("Context_get_extra_args"),
-        {get_context(), tlctx->get_constant(arg_id), tlctx->get_constant(i)});
-    sizes[i] = raw_arg;
+    sizes[i] = load_context_extra_arg(arg_id, i);
   }
 
   auto dt = stmt->ret_type.ptr_removed();
@@ -1459,9 +1786,7 @@ void CodeGenLLVM::visit(ExternalPtrStmt *stmt) {
 void CodeGenLLVM::visit(ExternalTensorShapeAlongAxisStmt *stmt) {
   const auto arg_id = stmt->arg_id;
   const auto axis = stmt->axis;
-  llvm_val[stmt] = builder->CreateCall(
-      get_runtime_function("Context_get_extra_args"),
-      {get_context(), tlctx->get_constant(arg_id), tlctx->get_constant(axis)});
+  llvm_val[stmt] = load_context_extra_arg(arg_id, axis);
 }
 
 std::string CodeGenLLVM::init_offloaded_task_function(OffloadedStmt *stmt,
@@ -1473,15 +1798,21 @@ std::string CodeGenLLVM::init_offloaded_task_function(OffloadedStmt *stmt,
       llvm::FunctionType::get(llvm::Type::getVoidTy(*llvm_context),
                               {llvm::PointerType::get(context_ty, 0)}, false);
 
-  auto task_kernel_name = fmt::format("{}_{}_{}{}", kernel_name, task_counter,
-                                      stmt->task_name(), suffix);
-  task_counter += 1;
+  auto task_kernel_name = fmt::format("{}_{}_{}{}", kernel_name,
+                                      task_counter++, stmt->task_name(), suffix);
+  if (prog->config.kernel_profiler && suffix.empty()) {
+    if (auto bytes = irpass::analysis::estimate_bytes_per_launch(stmt)) {
+      prog->profiler->set_bytes_per_launch(task_kernel_name, bytes);
+    }
+  }
   func = llvm::Function::Create(task_function_type,
                                 llvm::Function::ExternalLinkage,
                                 task_kernel_name, module.get());
 
   current_task = std::make_unique<OffloadedTask>(this);
   current_task->begin(task_kernel_name);
+  if (suffix.empty())
+    init_task_profile(stmt);
 
   for (auto &arg : func->args()) {
     kernel_args.push_back(&arg);
@@ -1516,6 +1847,77 @@ void CodeGenLLVM::finalize_offloaded_task_function() {
   // TI_INFO("Kernel function verified.");
 }
 
+void CodeGenLLVM::init_task_profile(OffloadedStmt *stmt) {
+  profile_counter_begin = -1;
+  profile_counts = nullptr;
+  profile_slots.clear();
+  auto *guide = prog->profile_guide.get();
+  if (guide == nullptr)
+    return;
+  int num_counters = 0;
+  irpass::analysis::gather_statements(stmt, [&](Stmt *s) {
+    if (s->is<IfStmt>() || s->is<RangeForStmt>()) {
+      profile_slots[s] = num_counters;
+      num_counters += 2;
+    }
+    return false;
+  });
+  if (kernel->arch == Arch::cuda &&
+      stmt->task_type == OffloadedStmt::TaskType::range_for &&
+      !(stmt->const_begin && stmt->const_end)) {
+    profile_slots[stmt] = num_counters;
+    num_counters += 2;
+  }
+  if (num_counters == 0)
+    return;
+  const auto key = ProfileGuide::get_task_key(stmt);
+  if (prog->config.pgo_instrument) {
+    profile_counter_begin = guide->allocate_counters(key, num_counters);
+    TI_WARN_IF(profile_counter_begin == -1,
+               "Out of PGO counters, not instrumenting {}", current_task->name);
+  } else if (auto *counts = guide->find_counts(key);
+             counts && (int)counts->size() == num_counters) {
+    profile_counts = counts;
+  }
+}
+
+void CodeGenLLVM::add_profile_count(Stmt *stmt,
+                                    int i,
+                                    llvm::Value *value,
+                                    bool once) {
+  if (profile_counter_begin == -1)
+    return;
+  auto it = profile_slots.find(stmt);
+  if (it == profile_slots.end())
+    return;
+  const int counter = profile_counter_begin + it->second + i;
+  call(once ? "profile_counter_add_once" : "profile_counter_add",
+       get_runtime(), tlctx->get_constant(counter), value);
+}
+
+std::optional<std::pair<uint64, uint64>> CodeGenLLVM::get_profile_counts(
+    Stmt *stmt) {
+  if (profile_counts == nullptr)
+    return std::nullopt;
+  auto it = profile_slots.find(stmt);
+  if (it == profile_slots.end())
+    return std::nullopt;
+  return std::make_pair((*profile_counts)[it->second],
+                        (*profile_counts)[it->second + 1]);
+}
+
+llvm::MDNode *CodeGenLLVM::create_branch_weights(uint64 true_count,
+                                                 uint64 false_count) {
+  // The weights are 32-bit.
+  while (std::max(true_count, false_count) >
+         std::numeric_limits<uint32>::max()) {
+    true_count >>= 1;
+    false_count >>= 1;
+  }
+  return llvm::MDBuilder(*llvm_context)
+      .createBranchWeights((uint32)true_count, (uint32)false_count);
+}
+
 std::tuple<llvm::Value *, llvm::Value *> CodeGenLLVM::get_range_for_bounds(
     OffloadedStmt *stmt) {
   llvm::Value *begin, *end;
@@ -1548,6 +1950,19 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
 
   llvm::Function *body = nullptr;
   auto leaf_block = stmt->snode;
+  // The dense nodes from the one whose element list is iterated down to the
+  // leaf block, whose cells are enumerated here, see
+  // CompileConfig::skip_dense_listgen. Each cell of the list SNode holds
+  // |num_leaf_cells| cells of the leaf block.
+  auto list_snode = stmt->list_snode ? stmt->list_snode : leaf_block;
+  std::vector<SNode *> dense_path;
+  int num_leaf_cells = 1;
+  for (auto s = leaf_block; s != list_snode; s = s->parent) {
+    TI_ASSERT(s->type == SNodeType::dense);
+    dense_path.push_back(s->parent);
+    num_leaf_cells *= s->max_num_elements();
+  }
+  std::reverse(dense_path.begin(), dense_path.end());
   {
     // Create the loop body function
     auto guard = get_function_creation_guard({
@@ -1600,9 +2015,34 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
 
     RuntimeObject element("Element", this, builder.get(), get_arg(2));
 
+    // Consecutive iterations access the cells of the same physical word, which
+    // is then loaded once, and stored once with the changes of all of them.
+    // The threads of a warp on GPUs access different cells of a word, whose
+    // stores stay atomic.
+    if (!spmd && leaf_block->type == SNodeType::bit_array) {
+      auto word_type = llvm_type(leaf_block->physical_type);
+      cached_bit_array = leaf_block;
+      cached_word_ptr =
+          create_entry_block_alloca(llvm::PointerType::get(word_type, 0));
+      cached_word = create_entry_block_alloca(word_type);
+      cached_word_loaded = create_entry_block_alloca(word_type);
+      builder->CreateStore(
+          llvm::ConstantPointerNull::get(llvm::PointerType::get(word_type, 0)),
+          cached_word_ptr);
+      builder->CreateStore(llvm::ConstantInt::get(word_type, 0), cached_word);
+      builder->CreateStore(llvm::ConstantInt::get(word_type, 0),
+                           cached_word_loaded);
+    }
+
     // Loop ranges
     auto lower_bound = get_arg(3);
     auto upper_bound = get_arg(4);
+    if (num_leaf_cells > 1) {
+      lower_bound = builder->CreateMul(lower_bound,
+                                       tlctx->get_constant(num_leaf_cells));
+      upper_bound = builder->CreateMul(upper_bound,
+                                       tlctx->get_constant(num_leaf_cells));
+    }
 
     parent_coordinates = element.get_ptr("pcoord");
 
@@ -1618,6 +2058,18 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
 
     llvm::Value *thread_idx = nullptr, *block_dim = nullptr;
 
+    // On CPUs, the loop over the cells of a bitmasked leaf jumps from one
+    // active cell to the next with the mask words, instead of testing every
+    // cell. On GPUs, the threads of a warp test 32 consecutive cells, so
+    // that the warps over empty mask words skip the body together.
+    const bool iterate_mask_words = !spmd &&
+                                    stmt->snode->type == SNodeType::bitmasked &&
+                                    leaf_block == stmt->snode;
+    auto next_active = [&](llvm::Value *i) {
+      return call(stmt->snode, element.get("element"), "next_active",
+                  {i, upper_bound});
+    };
+
     if (spmd) {
       thread_idx =
           builder->CreateIntrinsic(Intrinsic::nvvm_read_ptx_sreg_tid_x, {}, {});
@@ -1625,6 +2077,8 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
                                            {}, {});
       builder->CreateStore(builder->CreateAdd(thread_idx, lower_bound),
                            loop_index);
+    } else if (iterate_mask_words) {
+      builder->CreateStore(next_active(lower_bound), loop_index);
     } else {
       builder->CreateStore(lower_bound, loop_index);
     }
@@ -1662,8 +2116,45 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
         get_runtime_function(leaf_block->refine_coordinates_func_name());
     auto new_coordinates = create_entry_block_alloca(physical_coordinate_ty);
 
-    create_call(refine, {parent_coordinates, new_coordinates,
-                         builder->CreateLoad(loop_index)});
+    // The loop index of a hash SNode enumerates the slots of its table
+    llvm::Value *child_index = builder->CreateLoad(loop_index);
+    if (!dense_path.empty()) {
+      // Split the index into the cells of the dense nodes, which all have a
+      // power-of-two number of cells.
+      auto leaf_parent_coordinates =
+          create_entry_block_alloca(physical_coordinate_ty);
+      auto coordinates = element.get_ptr("pcoord");
+      auto remaining_bits = bit::log2int(num_leaf_cells);
+      for (auto s : dense_path) {
+        // The cells of the list SNode come from its element.
+        auto cell = child_index;
+        if (s != list_snode) {
+          const auto bits = bit::log2int(s->max_num_elements());
+          remaining_bits -= bits;
+          cell = builder->CreateAnd(
+              builder->CreateLShr(cell, tlctx->get_constant(remaining_bits)),
+              tlctx->get_constant((1 << bits) - 1));
+        } else {
+          cell = builder->CreateLShr(cell, tlctx->get_constant(remaining_bits));
+        }
+        auto refined = s == dense_path.back()
+                           ? leaf_parent_coordinates
+                           : create_entry_block_alloca(physical_coordinate_ty);
+        create_call(get_runtime_function(s->refine_coordinates_func_name()),
+                    {coordinates, refined, cell});
+        coordinates = refined;
+      }
+      TI_ASSERT(remaining_bits == bit::log2int(leaf_block->max_num_elements()));
+      child_index = builder->CreateAnd(
+          child_index, tlctx->get_constant(leaf_block->max_num_elements() - 1));
+      parent_coordinates = leaf_parent_coordinates;
+    }
+    if (leaf_block->type == SNodeType::hash) {
+      child_index = call(leaf_block, element.get("element"), "slot_to_index",
+                         {child_index});
+    }
+
+    create_call(refine, {parent_coordinates, new_coordinates, child_index});
 
     current_coordinates = new_coordinates;
 
@@ -1688,14 +2179,20 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
       }
     }
 
-    if (snode->type == SNodeType::bitmasked ||
-        snode->type == SNodeType::pointer) {
+    if (iterate_mask_words) {
+      // The loop only visits the active cells.
+    } else if (snode->type == SNodeType::bitmasked ||
+               snode->type == SNodeType::pointer) {
       // test whether the current voxel is active or not
       auto is_active = call(snode, element.get("element"), "is_active",
                             {builder->CreateLoad(loop_index)});
       is_active =
           builder->CreateTrunc(is_active, llvm::Type::getInt1Ty(*llvm_context));
       exec_cond = builder->CreateAnd(exec_cond, is_active);
+    } else if (snode->type == SNodeType::hash) {
+      auto is_active =
+          builder->CreateICmpSGE(child_index, tlctx->get_constant(0));
+      exec_cond = builder->CreateAnd(exec_cond, is_active);
     }
 
     builder->CreateCondBr(exec_cond, struct_for_body_bb, body_tail_bb);
@@ -1715,6 +2212,11 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
 
       if (spmd) {
         create_increment(loop_index, block_dim);
+      } else if (iterate_mask_words) {
+        builder->CreateStore(
+            next_active(builder->CreateAdd(builder->CreateLoad(loop_index),
+                                           tlctx->get_constant(1))),
+            loop_index);
       } else {
         create_increment(loop_index, tlctx->get_constant(1));
       }
@@ -1723,6 +2225,11 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
       builder->SetInsertPoint(func_exit);
     }
 
+    if (cached_bit_array) {
+      flush_cached_bit_array_word();
+      cached_bit_array = nullptr;
+    }
+
     if (stmt->bls_epilogue) {
       call("block_barrier");  // "__syncthreads()"
       stmt->bls_epilogue->accept(this);
@@ -1735,8 +2242,13 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
   }
 
   int list_element_size =
-      std::min(leaf_block->max_num_elements(), taichi_listgen_max_element_size);
-  int num_splits = std::max(1, list_element_size / stmt->block_dim);
+      std::min(list_snode->type == SNodeType::hash
+                   ? list_snode->hash_capacity
+                   : list_snode->max_num_elements(),
+               taichi_listgen_max_element_size);
+  int num_splits = (int)std::clamp(
+      (int64)list_element_size * num_leaf_cells / stmt->block_dim, (int64)1,
+      (int64)list_element_size);
 
   auto struct_for_func = get_runtime_function("parallel_struct_for");
 
@@ -1778,13 +2290,19 @@ void CodeGenLLVM::create_offload_struct_for(OffloadedStmt *stmt, bool spmd) {
 
     struct_for_func = patched_struct_for_func;
   }
+  // The dense element lists come in the order of the cells.
+  const int prefetch_distance =
+      arch_is_cpu(current_arch()) && !list_snode->is_path_all_dense
+          ? prog->config.cpu_struct_for_prefetch_distance
+          : 0;
   // Loop over nodes in the element list, in parallel
   create_call(
       struct_for_func,
-      {get_context(), tlctx->get_constant(leaf_block->id),
+      {get_context(), tlctx->get_constant(list_snode->id),
        tlctx->get_constant(list_element_size), tlctx->get_constant(num_splits),
        body, tlctx->get_constant(stmt->tls_size),
-       tlctx->get_constant(stmt->num_cpu_threads)});
+       tlctx->get_constant(stmt->num_cpu_threads),
+       tlctx->get_constant(prefetch_distance)});
   // TODO: why do we need num_cpu_threads on GPUs?
 }
 
@@ -1851,11 +2369,17 @@ void CodeGenLLVM::visit(ThreadLocalPtrStmt *stmt) {
 }
 
 void CodeGenLLVM::visit(BlockLocalPtrStmt *stmt) {
-  TI_ASSERT(bls_buffer);
-  auto base = bls_buffer;
   TI_ASSERT(stmt->width() == 1);
-  auto ptr = builder->CreateGEP(
-      base, {tlctx->get_constant(0), llvm_val[stmt->offset]});
+  llvm::Value *ptr = nullptr;
+  if (arch_is_cpu(current_arch())) {
+    // make_block_local allocates the BLS buffers in the thread-local storage
+    // on CPU, and |stmt->offset| is relative to the TLS base.
+    ptr = builder->CreateGEP(get_tls_base_ptr(), llvm_val[stmt->offset]);
+  } else {
+    TI_ASSERT(bls_buffer);
+    ptr = builder->CreateGEP(bls_buffer,
+                             {tlctx->get_constant(0), llvm_val[stmt->offset]});
+  }
   auto ptr_type = llvm::PointerType::get(
       tlctx->get_data_type(stmt->ret_type.ptr_removed()), 0);
   llvm_val[stmt] = builder->CreatePointerCast(ptr, ptr_type);
@@ -1866,13 +2390,37 @@ void CodeGenLLVM::visit(ClearListStmt *stmt) {
   auto snode_parent = stmt->snode->parent;
   auto meta_child = cast_pointer(emit_struct_meta(snode_child), "StructMeta");
   auto meta_parent = cast_pointer(emit_struct_meta(snode_parent), "StructMeta");
-  call("clear_list", get_runtime(), meta_parent, meta_child);
+  // The element list of a dynamic SNode depends on its length, and that of a
+  // child of a dynamic SNode on the parent's length, neither of which is
+  // tracked by the structure versions in the runtime.
+  const bool reusable = prog->config.incremental_listgen &&
+                        snode_parent->type != SNodeType::dynamic &&
+                        snode_child->type != SNodeType::dynamic;
+  call("clear_list", get_runtime(), meta_parent, meta_child,
+       tlctx->get_constant((int)reusable));
 }
 
 void CodeGenLLVM::visit(InternalFuncStmt *stmt) {
   create_call(stmt->func_name, {get_context()});
 }
 
+void CodeGenLLVM::visit(ExternalFuncCallStmt *stmt) {
+  TI_ERROR_IF(stmt->runtime_func.empty(),
+              "External functions can only be called on CPU");
+  if (!stmt->bitcode_file.empty() &&
+      linked_bitcode_files.insert(stmt->bitcode_file).second) {
+    tlctx->link_external_bitcode(module.get(), stmt->bitcode_file);
+  }
+  std::vector<llvm::Value *> args;
+  for (auto s : stmt->arg_stmts) {
+    args.push_back(llvm_val[s]);
+  }
+  for (auto s : stmt->output_stmts) {
+    args.push_back(llvm_val[s]);
+  }
+  create_call(stmt->runtime_func, args);
+}
+
 void CodeGenLLVM::visit(StackAllocaStmt *stmt) {
   TI_ASSERT(stmt->width() == 1);
   auto type = llvm::ArrayType::get(llvm::Type::getInt8Ty(*llvm_context),
@@ -1940,6 +2488,8 @@ void CodeGenLLVM::visit(LoopUniqueStmt *stmt) {
 }
 
 void CodeGenLLVM::eliminate_unused_functions() {
+  if (prog->config.lazy_runtime_linking)
+    tlctx->link_struct_module_definitions(module.get());
   TaichiLLVMContext::eliminate_unused_functions(
       module.get(), [&](std::string func_name) {
         for (auto &task : offloaded_tasks) {
@@ -1953,22 +2503,196 @@ void CodeGenLLVM::eliminate_unused_functions() {
 FunctionType CodeGenLLVM::compile_module_to_executable() {
   TI_AUTO_PROF
   eliminate_unused_functions();
+  // The offline cache and AOT modules store the O3 binary.
+  if (prog->config.tiered_compilation && arch_is_cpu(kernel->arch) &&
+      offline_cache_key.empty() && !prog->llvm_aot_module) {
+    return compile_module_to_tiered_executable();
+  }
+  auto *jit_module = add_module_to_jit();
+  return make_executable(kernel_name, offloaded_tasks, jit_module);
+}
 
-  tlctx->add_module(std::move(module));
+namespace {
+
+// The tasks of a kernel under tiered compilation. |current| points to the
+// baseline tasks first, and to the optimized ones once they are ready.
+struct TieredTasks {
+  std::vector<OffloadedTask> baseline;
+  std::vector<OffloadedTask> optimized;
+  std::atomic<std::vector<OffloadedTask> *> current{nullptr};
+  std::atomic<int> num_launches{0};
+  // The unoptimized module, to be recompiled on another LLVM context.
+  std::string bitcode;
+};
 
-  for (auto &task : offloaded_tasks) {
-    task.compile();
+constexpr int kBaselineOptLevel = 1;
+
+}  // namespace
+
+FunctionType CodeGenLLVM::compile_module_to_tiered_executable() {
+  TI_AUTO_PROF
+  auto tiered = std::make_shared<TieredTasks>();
+  {
+    llvm::raw_string_ostream os(tiered->bitcode);
+    llvm::WriteBitcodeToFile(*module, os);
+  }
+  auto *jit_module =
+      tlctx->jit->add_module_at_opt_level(std::move(module), kBaselineOptLevel);
+  tiered->baseline = offloaded_tasks;
+  for (auto &task : tiered->baseline) {
+    task.compile(jit_module);
   }
-  auto offloaded_tasks_local = offloaded_tasks;
-  auto kernel_name_ = kernel_name;
-  return [=](Context &context) {
-    TI_TRACE("Launching kernel {}", kernel_name_);
-    for (auto task : offloaded_tasks_local) {
+  tiered->current = &tiered->baseline;
+
+  auto *tlctx = this->tlctx;
+  auto recompile = [tiered, tlctx, kernel_name = kernel_name]() {
+    try {
+      auto M = llvm::parseBitcodeFile(
+          llvm::MemoryBufferRef(tiered->bitcode, kernel_name),
+          *tlctx->get_this_thread_context());
+      if (!M) {
+        TI_ERROR("Failed to parse the bitcode of kernel {}: {}", kernel_name,
+                 llvm::toString(M.takeError()));
+      }
+      auto *jit_module = tlctx->jit->add_module(std::move(M.get()));
+      tiered->optimized = tiered->baseline;
+      for (auto &task : tiered->optimized) {
+        task.func = nullptr;
+        task.compile(jit_module);
+      }
+      tiered->current.store(&tiered->optimized, std::memory_order_release);
+      TI_TRACE("Kernel {} recompiled at O3", kernel_name);
+    } catch (const std::exception &e) {
+      TI_WARN("Failed to recompile kernel {} at O3: {}", kernel_name,
+              e.what());
+    }
+    std::string().swap(tiered->bitcode);
+  };
+  const int threshold = std::max(prog->config.tiered_compilation_threshold, 1);
+  auto *prog = this->prog;
+  return [tiered, threshold, recompile, prog](Context &context) {
+    if (tiered->num_launches.fetch_add(1) + 1 == threshold)
+      prog->enqueue_background_compilation(recompile);
+    auto *tasks = tiered->current.load(std::memory_order_acquire);
+    for (auto &task : *tasks) {
       task(&context);
     }
   };
 }
 
+JITModule *CodeGenLLVM::add_module_to_jit() {
+  auto *jit = tlctx->jit.get();
+  auto *aot_module = prog->llvm_aot_module.get();
+  LlvmOfflineCache::KernelCacheData data;
+  data.key = offline_cache_key;
+  for (const auto &task : offloaded_tasks) {
+    data.tasks.push_back(
+        LlvmOfflineCache::TaskInfo{task.name, task.block_dim, task.grid_dim,
+                                   task.shmem_bytes, task.root_children,
+                                   task.tune_block_dim, task.streamed,
+                                   task.range_begin, task.range_end,
+                                   task.persistent});
+  }
+  JITModule *jit_module;
+  if (offline_cache_key.empty() && !aot_module) {
+    jit_module = jit->add_module(std::move(module));
+  } else {
+    data.binary = jit->compile_module_to_binary(std::move(module));
+    if (!offline_cache_key.empty())
+      prog->llvm_offline_cache->store(data);
+    if (aot_module)
+      aot_module->record(kernel, ir, data);
+    jit_module = jit->add_module_from_binary(data.binary);
+  }
+  if (!task_cache_key.empty())
+    prog->add_compiled_task(task_cache_key, {data.tasks, jit_module});
+  return jit_module;
+}
+
+FunctionType CodeGenLLVM::make_executable(const std::string &kernel_name,
+                                          std::vector<OffloadedTask> tasks,
+                                          JITModule *jit_module) {
+  for (auto &task : tasks) {
+    task.compile(jit_module);
+  }
+  return [kernel_name, tasks](Context &context) {
+    TI_TRACE("Launching kernel {}", kernel_name);
+    for (auto task : tasks) {
+      task(&context);
+    }
+  };
+}
+
+bool CodeGenLLVM::load_from_offline_cache(Kernel *kernel,
+                                          IRNode *ir,
+                                          std::string *key,
+                                          std::string *task_key,
+                                          std::vector<OffloadedTask> *tasks,
+                                          JITModule **jit_module) {
+  auto &program = kernel->program;
+  // The AOT module records the binaries, which the compiled tasks lack.
+  if (ir && ir->is<OffloadedStmt>() && program.config.task_cache &&
+      !program.llvm_aot_module) {
+    *task_key = LlvmOfflineCache::make_task_key(kernel, ir);
+    Program::CompiledTask compiled;
+    if (program.find_compiled_task(*task_key, &compiled)) {
+      TI_TRACE("Reusing a compiled task in kernel {}", kernel->name);
+      task_key->clear();
+      restore_tasks(compiled.tasks, tasks);
+      *jit_module = compiled.jit_module;
+      return true;
+    }
+  }
+  auto *cache = program.llvm_offline_cache.get();
+  if (cache == nullptr) {
+    return false;
+  }
+  *key = LlvmOfflineCache::make_key(kernel, ir);
+  if (key->empty()) {
+    return false;
+  }
+  LlvmOfflineCache::KernelCacheData data;
+  if (!cache->load(*key, &data)) {
+    return false;
+  }
+  if (auto *aot_module = program.llvm_aot_module.get())
+    aot_module->record(kernel, ir, data);
+  load_compiled(kernel, data, tasks, jit_module);
+  if (!task_key->empty()) {
+    program.add_compiled_task(*task_key, {data.tasks, *jit_module});
+  }
+  return true;
+}
+
+void CodeGenLLVM::restore_tasks(
+    const std::vector<LlvmOfflineCache::TaskInfo> &infos,
+    std::vector<OffloadedTask> *tasks) {
+  for (const auto &info : infos) {
+    OffloadedTask task(/*codegen=*/nullptr);
+    task.begin(info.name);
+    task.block_dim = info.block_dim;
+    task.grid_dim = info.grid_dim;
+    task.shmem_bytes = info.shmem_bytes;
+    task.root_children = info.root_children;
+    task.tune_block_dim = info.tune_block_dim;
+    task.streamed = info.streamed;
+    task.range_begin = info.range_begin;
+    task.range_end = info.range_end;
+    task.persistent = info.persistent;
+    tasks->push_back(task);
+  }
+}
+
+void CodeGenLLVM::load_compiled(
+    Kernel *kernel,
+    const LlvmOfflineCache::KernelCacheData &data,
+    std::vector<OffloadedTask> *tasks,
+    JITModule **jit_module) {
+  restore_tasks(data.tasks, tasks);
+  auto *tlctx = kernel->program.get_llvm_context(kernel->arch);
+  *jit_module = tlctx->jit->add_module_from_binary(data.binary);
+}
+
 FunctionCreationGuard CodeGenLLVM::get_function_creation_guard(
     std::vector<llvm::Type *> argument_types) {
   return FunctionCreationGuard(this, argument_types);
@@ -1996,6 +2720,17 @@ llvm::Value *CodeGenLLVM::get_context() {
   return get_arg(0);
 }
 
+llvm::Value *CodeGenLLVM::load_context_arg(int arg_id) {
+  return call(builder.get(), "Context_get_args", get_context(),
+              tlctx->get_constant(arg_id));
+}
+
+llvm::Value *CodeGenLLVM::load_context_extra_arg(int arg_id, int axis) {
+  return builder->CreateCall(
+      get_runtime_function("Context_get_extra_args"),
+      {get_context(), tlctx->get_constant(arg_id), tlctx->get_constant(axis)});
+}
+
 llvm::Value *CodeGenLLVM::get_tls_base_ptr() {
   return get_arg(1);
 }
@@ -2035,8 +2770,26 @@ void CodeGenLLVM::emit_to_module() {
   ir->accept(this);
 }
 
+void CodeGenLLVM::set_float_options() {
+  const bool fast_math = kernel->fast_math;
+  const char *value = fast_math ? "true" : "false";
+  for (auto &f : *module) {
+    if (f.isDeclaration())
+      continue;
+    f.addFnAttr("unsafe-fp-math", value);
+    f.addFnAttr("no-infs-fp-math", value);
+    f.addFnAttr("no-nans-fp-math", value);
+    f.addFnAttr("no-signed-zeros-fp-math", value);
+  }
+  module->addModuleFlag(llvm::Module::Override, "taichi.fast_math",
+                        (uint32)fast_math);
+  module->addModuleFlag(llvm::Module::Override, "taichi.fp_contract",
+                        (uint32)kernel->fp_contract);
+}
+
 FunctionType CodeGenLLVM::gen() {
   emit_to_module();
+  set_float_options();
   return compile_module_to_executable();
 }
 
@@ -1,6 +1,8 @@
 // The LLVM backend for CPUs/NVPTX/AMDGPU
 #pragma once
 
+#include <atomic>
+#include <optional>
 #include <set>
 #include <unordered_map>
 
@@ -19,9 +21,19 @@ class OffloadedTask {
   using task_fp_type = int32 (*)(void *);
   task_fp_type func;
 
-  int block_dim;
-  int grid_dim;
+  int block_dim{0};
+  int grid_dim{0};
   std::size_t shmem_bytes{0};
+  // Ids of the children of the root SNode that the task accesses
+  std::vector<int> root_children;
+  // See LlvmOfflineCache::TaskInfo::tune_block_dim.
+  bool tune_block_dim{false};
+  // See LlvmOfflineCache::TaskInfo::streamed.
+  bool streamed{false};
+  int range_begin{0};
+  int range_end{0};
+  // See LlvmOfflineCache::TaskInfo::persistent.
+  bool persistent{false};
 
   OffloadedTask(CodeGenLLVM *codegen);
 
@@ -29,7 +41,7 @@ class OffloadedTask {
 
   void end();
 
-  void compile();
+  void compile(JITModule *jit_module);
 
   void operator()(Context *context);
 };
@@ -49,7 +61,8 @@ class FunctionCreationGuard {
 
 class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
  public:
-  static uint64 task_counter;
+  // Offloaded tasks may be compiled concurrently.
+  static std::atomic<uint64> task_counter;
 
   Kernel *kernel;
   IRNode *ir;
@@ -60,6 +73,14 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
   llvm::Type *physical_coordinate_ty;
   llvm::Value *current_coordinates;
   llvm::Value *parent_coordinates{nullptr};
+  // In the struct-fors over the cells of a bit_array on CPU, the physical
+  // word of the last cell accessed, with its value when loaded, which the
+  // accesses to the cells of the same word use instead of the memory. See
+  // get_cached_bit_array_word().
+  SNode *cached_bit_array{nullptr};
+  llvm::Value *cached_word_ptr{nullptr};
+  llvm::Value *cached_word{nullptr};
+  llvm::Value *cached_word_loaded{nullptr};
   llvm::GlobalVariable *bls_buffer{nullptr};
   // Mainly for supporting continue stmt
   llvm::BasicBlock *current_loop_reentry;
@@ -74,6 +95,21 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
   llvm::BasicBlock *func_body_bb;
 
   std::unordered_map<const Stmt *, std::vector<llvm::Value *>> loop_vars_llvm;
+  // Key of this kernel in the offline cache. Empty if the cache is disabled
+  // or the kernel cannot be cached.
+  std::string offline_cache_key;
+  // Key of this offloaded task in the tasks compiled by the program. Empty if
+  // CompileConfig::task_cache is unset or a whole kernel is compiled.
+  std::string task_cache_key;
+  // Profile-guided optimization of the current task, see ProfileGuide: its
+  // first counter when it is instrumented, or -1, and the counts recorded for
+  // it, or nullptr. The statements profiled have two consecutive counters,
+  // from their slots.
+  int profile_counter_begin{-1};
+  const std::vector<uint64> *profile_counts{nullptr};
+  std::unordered_map<Stmt *, int> profile_slots;
+  // The files of external functions linked into |module| so far.
+  std::set<std::string> linked_bitcode_files;
 
   using IRVisitor::visit;
   using LLVMModuleBuilder::call;
@@ -90,6 +126,13 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
 
   llvm::Value *get_context();
 
+  // The i-th kernel argument, as an i64.
+  virtual llvm::Value *load_context_arg(int arg_id);
+
+  // The size of the |axis|-th dimension of the external array argument
+  // |arg_id|, as an i32.
+  virtual llvm::Value *load_context_extra_arg(int arg_id, int axis);
+
   llvm::Value *get_tls_base_ptr();
 
   llvm::Type *get_tls_buffer_type();
@@ -114,8 +157,51 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
 
   void eliminate_unused_functions();
 
+  // Records the floating-point options of |kernel| into |module|, as function
+  // attributes and as module flags that the JIT reads.
+  void set_float_options();
+
   virtual FunctionType compile_module_to_executable();
 
+  // Compiles |module| at a low optimization level, and recompiles it at O3
+  // in the background once the kernel turns out to be hot. CPU only, see
+  // CompileConfig::tiered_compilation.
+  FunctionType compile_module_to_tiered_executable();
+
+  // Hands |module| over to the JIT. The optimized result is also stored into
+  // the offline cache if |offline_cache_key| is set, and the compiled task
+  // into the program if |task_cache_key| is set.
+  JITModule *add_module_to_jit();
+
+  // Wraps CPU |tasks| living in |jit_module| into a launchable kernel.
+  static FunctionType make_executable(const std::string &kernel_name,
+                                      std::vector<OffloadedTask> tasks,
+                                      JITModule *jit_module);
+
+  // Looks |ir| up in the tasks compiled by the program if it is an offloaded
+  // task, then in the offline cache. On a hit, |tasks| and |jit_module| are
+  // restored and true is returned. On a miss, |key| and |task_key| are set to
+  // the keys under which the compiled kernel should be stored (or left empty
+  // if it is not cacheable).
+  static bool load_from_offline_cache(Kernel *kernel,
+                                      IRNode *ir,
+                                      std::string *key,
+                                      std::string *task_key,
+                                      std::vector<OffloadedTask> *tasks,
+                                      JITModule **jit_module);
+
+  // Appends the tasks described by |infos| to |tasks|.
+  static void restore_tasks(
+      const std::vector<LlvmOfflineCache::TaskInfo> &infos,
+      std::vector<OffloadedTask> *tasks);
+
+  // Restores |tasks| and |jit_module| of |kernel| from the compiled |data|,
+  // e.g. of the offline cache or of an AOT module.
+  static void load_compiled(Kernel *kernel,
+                            const LlvmOfflineCache::KernelCacheData &data,
+                            std::vector<OffloadedTask> *tasks,
+                            JITModule **jit_module);
+
   virtual FunctionType gen();
 
   // only for debugging on CPU
@@ -146,6 +232,10 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
 
   static std::string get_runtime_snode_name(SNode *snode);
 
+  // The runtime method (de)activating the children of |snode|, see
+  // CompileConfig::lock_free_activation.
+  std::string get_activation_method(SNode *snode, const std::string &method);
+
   llvm::Type *llvm_type(DataType dt);
 
   llvm::Type *llvm_ptr_type(DataType dt);
@@ -158,6 +248,12 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
 
   llvm::Value *cast_int(llvm::Value *input_val, Type *from, Type *to);
 
+  // Converts between the f16 values, stored as LLVM halves, and f32, with
+  // the native instructions when the target has them.
+  llvm::Value *f16_to_f32(llvm::Value *val);
+
+  llvm::Value *f32_to_f16(llvm::Value *val);
+
   virtual void emit_extra_unary(UnaryOpStmt *stmt);
 
   void visit(UnaryOpStmt *stmt) override;
@@ -194,12 +290,32 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
 
   llvm::Value *atomic_add_custom_int(AtomicOpStmt *stmt, CustomIntType *cit);
 
+  // Adds the f32 value to the f16 destination, returning the old value in
+  // f32.
+  llvm::Value *atomic_add_f16(AtomicOpStmt *stmt);
+
   void visit(AtomicOpStmt *stmt) override;
 
   void visit(GlobalPtrStmt *stmt) override;
 
   void visit(GlobalStoreStmt *stmt) override;
 
+  // The alignment of the accesses through |ptr| when it is above the natural
+  // one, see SNode::address_alignment. 0 otherwise.
+  int get_access_alignment(Stmt *ptr) const;
+
+  // Whether the accesses through |ptr| go through the cached word.
+  bool uses_cached_bit_array_word(Stmt *ptr) const;
+
+  // The value of the physical word at |word_ptr|, which becomes the cached
+  // word if it is not yet.
+  llvm::Value *get_cached_bit_array_word(llvm::Value *word_ptr);
+
+  // Merges the bits changed in the cached word into the memory with an
+  // atomic xor, which keeps the changes of the other threads to the other
+  // bits, and drops the word.
+  void flush_cached_bit_array_word();
+
   llvm::Value *load_as_custom_int(Stmt *ptr, Type *load_type);
 
   llvm::Value *extract_custom_int(llvm::Value *physical_value,
@@ -240,6 +356,22 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
 
   void finalize_offloaded_task_function();
 
+  // Assigns the counters of the ifs and serial loops of |stmt| and, on CUDA,
+  // of its launches if it is a range-for with variable bounds.
+  void init_task_profile(OffloadedStmt *stmt);
+
+  // Adds |value| to counter |i| (0 or 1) of |stmt| if the task is
+  // instrumented, only from the first thread if |once|.
+  void add_profile_count(Stmt *stmt,
+                         int i,
+                         llvm::Value *value,
+                         bool once = false);
+
+  // The counts of |stmt| recorded in the profile, if any.
+  std::optional<std::pair<uint64, uint64>> get_profile_counts(Stmt *stmt);
+
+  llvm::MDNode *create_branch_weights(uint64 true_count, uint64 false_count);
+
   FunctionCreationGuard get_function_creation_guard(
       std::vector<llvm::Type *> argument_types);
 
@@ -268,6 +400,8 @@ class CodeGenLLVM : public IRVisitor, public LLVMModuleBuilder {
 
   void visit(InternalFuncStmt *stmt) override;
 
+  void visit(ExternalFuncCallStmt *stmt) override;
+
   // Stack statements
 
   void visit(StackAllocaStmt *stmt) override;
@@ -392,6 +392,16 @@ void write(std::string fn, const uint8 *data, std::size_t len);
 void write(const std::string &fn, const std::string &data);
 std::vector<uint8> read(const std::string fn, bool verbose = false);
 
+// Deflates |len| bytes into a zlib stream, at |level| from 1 (fastest) to 9.
+std::vector<uint8> compress(const uint8 *data, std::size_t len, int level);
+
+// Inflates a zlib stream of exactly |dest_len| bytes. Returns false if |data|
+// is not one.
+bool decompress(const uint8 *data,
+                std::size_t len,
+                uint8 *dest,
+                std::size_t dest_len);
+
 }  // namespace zip
 
 //******************************************************************************
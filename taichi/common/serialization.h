@@ -227,6 +227,68 @@ inline void write_data_to_file(const std::string &fn,
   }
 }
 
+template <bool writing>
+class BinarySerializer;
+
+// The values of an array stored in the buffer of a BinaryInputSerializer,
+// which reading leaves in place instead of copying, e.g. to read the arrays of
+// a memory-mapped file lazily. The buffer must outlive the view. Views are
+// stored the same way as std::vector<T>, so either can read what the other
+// wrote.
+template <typename T>
+class BinaryArrayView {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable");
+
+ public:
+  BinaryArrayView() = default;
+
+  // A view of |size| values at |values|, to be written.
+  BinaryArrayView(const T *values, std::size_t size)
+      : bytes_(reinterpret_cast<const uint8_t *>(values)), size_(size) {
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // The values are not aligned in the buffer in general.
+  T operator[](std::size_t i) const {
+    T value;
+    std::memcpy(&value, bytes_ + i * sizeof(T), sizeof(T));
+    return value;
+  }
+
+  bool is_aligned() const {
+    return reinterpret_cast<std::size_t>(bytes_) % alignof(T) == 0;
+  }
+
+  // Only if is_aligned().
+  const T *data() const {
+    TI_ASSERT(is_aligned());
+    return reinterpret_cast<const T *>(bytes_);
+  }
+
+  std::vector<T> to_vector() const {
+    std::vector<T> values(size_);
+    if (size_ != 0) {
+      std::memcpy(values.data(), bytes_, sizeof(T) * size_);
+    }
+    return values;
+  }
+
+ private:
+  const uint8_t *bytes_{nullptr};
+  std::size_t size_{0};
+
+  template <bool writing>
+  friend class BinarySerializer;
+};
+
 template <bool writing>
 class BinarySerializer : public Serializer {
  public:
@@ -304,37 +366,78 @@ class BinarySerializer : public Serializer {
     }
   }
 
-  // std::string
+  // Whether the values of T are stored as their bytes, so that arrays of them
+  // are copied at once rather than value by value.
+  template <typename T>
+  using is_bulk_copyable =
+      std::integral_constant<bool,
+                             std::is_trivially_copyable<T>::value &&
+                                 !has_io<T>::value &&
+                                 !std::is_pointer<T>::value>;
+
+  void write_bytes(const void *src, std::size_t size) {
+    if (size == 0) {
+      return;
+    }
+    std::size_t new_size = head + size;
+    if (c_data) {
+      if (new_size > preserved) {
+        TI_CRITICAL("Preserved Buffer (size {}) Overflow.", preserved);
+      }
+      std::memcpy(&c_data[head], src, size);
+    } else {
+      data.resize(new_size);
+      std::memcpy(&data[head], src, size);
+    }
+    head += size;
+  }
+
+  void read_bytes(void *dest, std::size_t size) {
+    if (size == 0) {
+      return;
+    }
+    std::memcpy(dest, &c_data[head], size);
+    head += size;
+  }
+
+  // std::string, stored as std::vector<char>
   void operator()(const char *, const std::string &val_) {
     auto &val = get_writable(val_);
     if (writing) {
-      std::vector<char> val_vector(val.begin(), val.end());
-      this->operator()(nullptr, val_vector);
+      this->operator()("", val.size());
+      write_bytes(val.data(), val.size());
     } else {
-      std::vector<char> val_vector;
-      this->operator()(nullptr, val_vector);
-      val = std::string(val_vector.begin(), val_vector.end());
+      std::size_t n = 0;
+      this->operator()("", n);
+      val.resize(n);
+      read_bytes(&val[0], n);
     }
   }
 
   // C-array
   template <typename T, std::size_t n>
   void operator()(const char *, const TArray<T, n> &val) {
-    if (writing) {
+    using Traw = typename type::remove_cvref_t<T>;
+    if (is_bulk_copyable<Traw>::value) {
+      if (writing) {
+        write_bytes(val, sizeof(T) * n);
+      } else {
+        read_bytes(const_cast<Traw *>(val), sizeof(T) * n);
+      }
+    } else if (writing) {
       for (std::size_t i = 0; i < n; i++) {
         this->operator()("", val[i]);
       }
     } else {
       // TODO: why do I have to let it write to tmp, otherwise I get Sig Fault?
       // Take care of std::vector<bool> ...
-      using Traw = typename type::remove_cvref_t<T>;
       std::vector<
           std::conditional_t<std::is_same<Traw, bool>::value, uint8, Traw>>
           tmp(n);
       for (std::size_t i = 0; i < n; i++) {
         this->operator()("", tmp[i]);
       }
-      std::memcpy(const_cast<typename std::remove_cv<T>::type *>(val), &tmp[0],
+      std::memcpy(const_cast<Traw *>(val), &tmp[0],
                   sizeof(tmp[0]) * tmp.size());
     }
   }
@@ -349,27 +452,10 @@ class BinarySerializer : public Serializer {
     static_assert(!std::is_volatile<T>::value, "T cannot be volatile");
     static_assert(!std::is_pointer<T>::value, "T cannot be pointer");
     if (writing) {
-      std::size_t new_size = head + sizeof(T);
-      if (c_data) {
-        if (new_size > preserved) {
-          TI_CRITICAL("Preserved Buffer (size {}) Overflow.", preserved);
-        }
-        //*reinterpret_cast<typename type::remove_cvref_t<T> *>(&c_data[head]) =
-        //    val;
-        std::memcpy(&c_data[head], &val, sizeof(T));
-      } else {
-        data.resize(new_size);
-        //*reinterpret_cast<typename type::remove_cvref_t<T> *>(&data[head]) =
-        //    val;
-        std::memcpy(&data[head], &val, sizeof(T));
-      }
+      write_bytes(&val, sizeof(T));
     } else {
-      // get_writable(val) =
-      //    *reinterpret_cast<typename std::remove_reference<T>::type *>(
-      //        &c_data[head]);
-      std::memcpy(&get_writable(val), &c_data[head], sizeof(T));
+      read_bytes(&get_writable(val), sizeof(T));
     }
-    head += sizeof(T);
   }
 
   template <typename T>
@@ -471,11 +557,42 @@ class BinarySerializer : public Serializer {
       this->operator()("", n);
       val.resize(n);
     }
+    // std::vector<bool> is packed, and has no data().
+    serialize_elements(
+        val, std::integral_constant<bool, is_bulk_copyable<T>::value &&
+                                              !std::is_same<T, bool>::value>());
+  }
+
+  template <typename T>
+  void serialize_elements(std::vector<T> &val, std::true_type) {
+    if (writing) {
+      write_bytes(val.data(), sizeof(T) * val.size());
+    } else {
+      read_bytes(val.data(), sizeof(T) * val.size());
+    }
+  }
+
+  template <typename T>
+  void serialize_elements(std::vector<T> &val, std::false_type) {
     for (std::size_t i = 0; i < val.size(); i++) {
       this->operator()("", val[i]);
     }
   }
 
+  // Views of arrays, stored as std::vector<T>
+  template <typename T>
+  void operator()(const char *, const BinaryArrayView<T> &val_) {
+    auto &val = get_writable(val_);
+    if (writing) {
+      this->operator()("", val.size_);
+      write_bytes(val.bytes_, sizeof(T) * val.size_);
+    } else {
+      this->operator()("", val.size_);
+      val.bytes_ = &c_data[head];
+      head += sizeof(T) * val.size_;
+    }
+  }
+
   // std::pair
   template <typename T, typename G>
   void operator()(const char *, const std::pair<T, G> &val) {
@@ -489,9 +606,8 @@ class BinarySerializer : public Serializer {
     auto &val = get_writable(val_);
     if (writing) {
       this->operator()(nullptr, val.size());
-      for (auto iter : val) {
-        T first = iter.first;
-        this->operator()(nullptr, first);
+      for (auto &iter : val) {
+        this->operator()(nullptr, iter.first);
         this->operator()(nullptr, iter.second);
       }
     } else {
@@ -201,14 +201,28 @@ void updateLayer(id self, SEL _) {
     auto &img = gui->canvas->img;
     auto &data = gui->img_data;
     data_ptr = data.data();
-    for (int j = 0; j < height; j++) {
-      for (int i = 0; i < width; i++) {
-        int index = 4 * (i + j * width);
-        auto pixel = img[i][height - j - 1];
-        data[index++] = uint8(clamp(int(pixel[0] * 255.0_f), 0, 255));
-        data[index++] = uint8(clamp(int(pixel[1] * 255.0_f), 0, 255));
-        data[index++] = uint8(clamp(int(pixel[2] * 255.0_f), 0, 255));
-        data[index++] = 255;  // alpha
+    if (gui->canvas->img8) {
+      auto &img8 = *gui->canvas->img8;
+      for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+          int index = 4 * (i + j * width);
+          auto pixel = img8[i][height - j - 1];
+          data[index++] = uint8(pixel);
+          data[index++] = uint8(pixel >> 8);
+          data[index++] = uint8(pixel >> 16);
+          data[index++] = 255;  // alpha
+        }
+      }
+    } else {
+      for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+          int index = 4 * (i + j * width);
+          auto pixel = img[i][height - j - 1];
+          data[index++] = uint8(clamp(int(pixel[0] * 255.0_f), 0, 255));
+          data[index++] = uint8(clamp(int(pixel[1] * 255.0_f), 0, 255));
+          data[index++] = uint8(clamp(int(pixel[2] * 255.0_f), 0, 255));
+          data[index++] = 255;  // alpha
+        }
       }
     }
   }
@@ -409,6 +423,11 @@ void GUI::process_event() {
   }
 }
 
+void GUI::set_fast_buffer(uintptr_t fast_buf) {
+  TI_ASSERT(fast_gui);
+  this->fast_buf = fast_buf;
+}
+
 void GUI::set_title(std::string title) {
   auto str = clscall("NSString", "stringWithUTF8String:", title.c_str());
   call(window, "setTitle:", str);
@@ -1,9 +1,531 @@
 #include "taichi/gui/gui.h"
 
+#include <mutex>
+
+#include "taichi/system/threading.h"
+
+#if defined(TI_ARCH_x64)
+#include <emmintrin.h>
+#endif
+
 TI_NAMESPACE_BEGIN
 
 Vector2 Canvas::Line::vertices[128];
 
+namespace {
+
+// The batched draws bin their primitives into tiles of this many pixels
+// squared, and rasterize the tiles in parallel.
+constexpr int kTileSize = 32;
+
+// Fewer primitives are drawn one by one on the calling thread, since binning
+// them would cost more than drawing the tiles in parallel saves.
+constexpr int kMinPrimitivesPerBatch = 4096;
+
+// The coverage of a circle is computed for this many pixels of a column at a
+// time.
+constexpr int kCoverageBlock = 64;
+static_assert(kCoverageBlock % 4 == 0, "The SIMD coverage is padded to 4");
+
+// Intersects [lower, upper] with [clip_lower, clip_upper], and returns false
+// if the intersection is empty.
+bool clip_pixels(Vector2i &lower,
+                 Vector2i &upper,
+                 Vector2i clip_lower,
+                 Vector2i clip_upper) {
+  lower.x = std::max(lower.x, clip_lower.x);
+  lower.y = std::max(lower.y, clip_lower.y);
+  upper.x = std::min(upper.x, clip_upper.x);
+  upper.y = std::min(upper.y, clip_upper.y);
+  return lower.x <= upper.x && lower.y <= upper.y;
+}
+
+// The pixels (inclusive) a primitive in screen space may cover.
+void circle_pixels(Vector2 center,
+                   real radius,
+                   Vector2i &lower,
+                   Vector2i &upper) {
+  lower = Vector2i((int)std::ceil(center.x - radius),
+                   (int)std::ceil(center.y - radius));
+  upper = Vector2i((int)std::floor(center.x + radius),
+                   (int)std::floor(center.y + radius));
+}
+
+void stroke_pixels(Vector2 a,
+                   Vector2 b,
+                   real radius,
+                   Vector2i &lower,
+                   Vector2i &upper) {
+  auto a_i = (a + Vector2(0.5_f)).template cast<int>();
+  auto b_i = (b + Vector2(0.5_f)).template cast<int>();
+  auto radius_i = (int)std::ceil(radius + 0.5_f);
+  lower = Vector2i(std::min(a_i.x, b_i.x) - radius_i,
+                   std::min(a_i.y, b_i.y) - radius_i);
+  upper = Vector2i(std::max(a_i.x, b_i.x) + radius_i,
+                   std::max(a_i.y, b_i.y) + radius_i);
+}
+
+void triangle_pixels(Vector2 a,
+                     Vector2 b,
+                     Vector2 c,
+                     Vector2i &lower,
+                     Vector2i &upper) {
+  lower = Vector2i((int)std::floor(min(a.x, min(b.x, c.x))),
+                   (int)std::floor(min(a.y, min(b.y, c.y))));
+  upper = Vector2i((int)std::ceil(max(a.x, max(b.x, c.x))) - 1,
+                   (int)std::ceil(max(a.y, max(b.y, c.y))) - 1);
+}
+
+// alpha[k] = w * clamp(r - |(dx, cy - (j + k))|) for k < n, where dx2 =
+// dx * dx, evaluated in the same order as the scalar distance so that the
+// results match bit for bit. |alpha| is padded to a multiple of 4.
+template <typename T>
+void circle_coverage_scalar(T cy, T dx2, T r, T w, int j, int n, T *alpha) {
+  for (int k = 0; k < n; k++) {
+    T dy = cy - T(j + k);
+    alpha[k] = w * clamp(r - std::sqrt(dx2 + dy * dy));
+  }
+}
+
+TI_FORCE_INLINE void blend_pixel(real alpha, Vector4 color, Vector4 &dest) {
+  dest = lerp(alpha, dest, color);
+}
+
+// Blends in [0, 255] and rounds to the nearest level, as pack_rgba8() does.
+TI_FORCE_INLINE void blend_pixel(real alpha, Vector4 color, uint32 &dest) {
+  uint32 ret = 0;
+  for (int k = 0; k < 4; k++) {
+    real d = real((dest >> (8 * k)) & 255);
+    real c = (1 - alpha) * d + alpha * (color[k] * 255.0_f);
+    ret |= (uint32)clamp((int)std::lrint(c), 0, 255) << (8 * k);
+  }
+  dest = ret;
+}
+
+// Blends |color| into dest[k] with alpha[k] for k < n.
+template <typename Pixel>
+void blend_scalar(const real *alpha, int n, Vector4 color, Pixel *dest) {
+  for (int k = 0; k < n; k++) {
+    // Blending with zero coverage leaves the pixel unchanged.
+    if (alpha[k] != 0) {
+      blend_pixel(alpha[k], color, dest[k]);
+    }
+  }
+}
+
+#if defined(TI_ARCH_x64)
+void circle_coverage(float32 cy,
+                     float32 dx2,
+                     float32 r,
+                     float32 w,
+                     int j,
+                     int n,
+                     float32 *alpha) {
+  const __m128 step = _mm_setr_ps(0, 1, 2, 3);
+  const __m128 cy_v = _mm_set1_ps(cy);
+  const __m128 dx2_v = _mm_set1_ps(dx2);
+  const __m128 r_v = _mm_set1_ps(r);
+  const __m128 w_v = _mm_set1_ps(w);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1);
+  for (int k = 0; k < n; k += 4) {
+    // Exact, the pixel indices are far below 2^24.
+    __m128 dy =
+        _mm_sub_ps(cy_v, _mm_add_ps(_mm_set1_ps((float32)(j + k)), step));
+    __m128 dist = _mm_sqrt_ps(_mm_add_ps(dx2_v, _mm_mul_ps(dy, dy)));
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_sub_ps(r_v, dist), zero), one);
+    _mm_storeu_ps(alpha + k, _mm_mul_ps(w_v, a));
+  }
+}
+
+void circle_coverage(float64 cy,
+                     float64 dx2,
+                     float64 r,
+                     float64 w,
+                     int j,
+                     int n,
+                     float64 *alpha) {
+  const __m128d step = _mm_setr_pd(0, 1);
+  const __m128d cy_v = _mm_set1_pd(cy);
+  const __m128d dx2_v = _mm_set1_pd(dx2);
+  const __m128d r_v = _mm_set1_pd(r);
+  const __m128d w_v = _mm_set1_pd(w);
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d one = _mm_set1_pd(1);
+  for (int k = 0; k < n; k += 2) {
+    __m128d dy =
+        _mm_sub_pd(cy_v, _mm_add_pd(_mm_set1_pd((float64)(j + k)), step));
+    __m128d dist = _mm_sqrt_pd(_mm_add_pd(dx2_v, _mm_mul_pd(dy, dy)));
+    __m128d a = _mm_min_pd(_mm_max_pd(_mm_sub_pd(r_v, dist), zero), one);
+    _mm_storeu_pd(alpha + k, _mm_mul_pd(w_v, a));
+  }
+}
+
+#else
+template <typename T>
+void circle_coverage(T cy, T dx2, T r, T w, int j, int n, T *alpha) {
+  circle_coverage_scalar(cy, dx2, r, w, j, n, alpha);
+}
+#endif
+
+#if defined(TI_ARCH_x64) && !defined(TI_USE_DOUBLE)
+// Computes (1 - a) * dest + a * color per channel, as lerp() does.
+void blend(const float32 *alpha, int n, Vector4 color, Vector4 *dest) {
+  static_assert(sizeof(Vector4) == 4 * sizeof(float32), "");
+  const __m128 color_v = _mm_loadu_ps(color.d);
+  for (int k = 0; k < n; k++) {
+    float32 a = alpha[k];
+    if (a == 0) {
+      continue;
+    }
+    auto d = (float32 *)&dest[k];
+    if (a == 1) {
+      // (1 - 1) * dest + color is color for finite pixels.
+      _mm_storeu_ps(d, color_v);
+    } else {
+      _mm_storeu_ps(d, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1 - a),
+                                             _mm_loadu_ps(d)),
+                                  _mm_mul_ps(_mm_set1_ps(a), color_v)));
+    }
+  }
+}
+
+// The same as blend_pixel() for uint32, which rounds to the nearest level
+// with the default rounding mode as std::lrint does.
+void blend(const float32 *alpha, int n, Vector4 color, uint32 *dest) {
+  const __m128 color_v =
+      _mm_mul_ps(_mm_loadu_ps(color.d), _mm_set1_ps(255.0_f));
+  const uint32 packed = pack_rgba8(color);
+  const __m128i zero = _mm_setzero_si128();
+  for (int k = 0; k < n; k++) {
+    float32 a = alpha[k];
+    if (a == 0) {
+      continue;
+    }
+    if (a == 1) {
+      dest[k] = packed;
+      continue;
+    }
+    __m128i p = _mm_cvtsi32_si128((int)dest[k]);
+    __m128 d = _mm_cvtepi32_ps(
+        _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero));
+    __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1 - a), d),
+                          _mm_mul_ps(_mm_set1_ps(a), color_v));
+    __m128i c_i = _mm_cvtps_epi32(c);
+    c_i = _mm_packs_epi32(c_i, c_i);
+    dest[k] = (uint32)_mm_cvtsi128_si32(_mm_packus_epi16(c_i, c_i));
+  }
+}
+
+#else
+template <typename Pixel>
+void blend(const real *alpha, int n, Vector4 color, Pixel *dest) {
+  blend_scalar(alpha, n, color, dest);
+}
+#endif
+
+ThreadPool &raster_thread_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+// Serializes the batched draws of the canvases on different threads, which
+// share the thread pool.
+std::mutex raster_mutex;
+
+template <typename Primitive>
+struct TileTask {
+  Canvas *canvas;
+  int num_tiles_y;
+  const int *tile_begin;
+  const Primitive *primitives;
+
+  static void run(void *context, int tile) {
+    auto task = (TileTask *)context;
+    auto res = task->canvas->get_res();
+    int tx = tile / task->num_tiles_y;
+    int ty = tile % task->num_tiles_y;
+    Vector2i lower(tx * kTileSize, ty * kTileSize);
+    Vector2i upper(std::min(lower.x + kTileSize, res.x) - 1,
+                   std::min(lower.y + kTileSize, res.y) - 1);
+    for (int k = task->tile_begin[tile]; k < task->tile_begin[tile + 1];
+         k++) {
+      task->primitives[k].draw(*task->canvas, lower, upper);
+    }
+  }
+};
+
+// Draws |primitives| in order. A primitive has |pixels(lower, upper)|, which
+// gives the pixels it may cover, and |draw(canvas, lower, upper)|, which
+// draws it into the pixels in [lower, upper].
+template <typename Primitive>
+void rasterize_batched(Canvas &canvas,
+                       const std::vector<Primitive> &primitives) {
+  const int n = (int)primitives.size();
+  const Vector2i res = canvas.get_res();
+  const Vector2i canvas_lower(0, 0);
+  const Vector2i canvas_upper = res - Vector2i(1, 1);
+  if (n < kMinPrimitivesPerBatch || std::thread::hardware_concurrency() <= 1) {
+    for (auto &p : primitives) {
+      p.draw(canvas, canvas_lower, canvas_upper);
+    }
+    return;
+  }
+
+  // Bins the primitives by a counting sort over the tiles, which keeps them
+  // in order within each tile. They are copied rather than referred to by
+  // index, so that drawing a tile reads them sequentially.
+  const int num_tiles_x = (res.x + kTileSize - 1) / kTileSize;
+  const int num_tiles_y = (res.y + kTileSize - 1) / kTileSize;
+  const int num_tiles = num_tiles_x * num_tiles_y;
+  auto for_each_tile = [&](const Primitive &p, auto &&f) {
+    Vector2i lower, upper;
+    p.pixels(lower, upper);
+    if (!clip_pixels(lower, upper, canvas_lower, canvas_upper)) {
+      return;
+    }
+    for (int tx = lower.x / kTileSize; tx <= upper.x / kTileSize; tx++) {
+      for (int ty = lower.y / kTileSize; ty <= upper.y / kTileSize; ty++) {
+        f(tx * num_tiles_y + ty);
+      }
+    }
+  };
+  std::vector<int> tile_begin(num_tiles + 1, 0);
+  for (auto &p : primitives) {
+    for_each_tile(p, [&](int tile) { tile_begin[tile + 1]++; });
+  }
+  for (int t = 0; t < num_tiles; t++) {
+    tile_begin[t + 1] += tile_begin[t];
+  }
+  std::vector<Primitive> binned(tile_begin[num_tiles]);
+  std::vector<int> tile_end(tile_begin.begin(), tile_begin.end() - 1);
+  for (auto &p : primitives) {
+    for_each_tile(p, [&](int tile) { binned[tile_end[tile]++] = p; });
+  }
+
+  TileTask<Primitive> task{&canvas, num_tiles_y, tile_begin.data(),
+                           binned.data()};
+  std::lock_guard<std::mutex> _(raster_mutex);
+  auto &pool = raster_thread_pool();
+  pool.run(num_tiles, pool.max_num_threads, &task,
+           &TileTask<Primitive>::run);
+}
+
+Vector4 color_from_int(int c) {
+  return (1.0_f / 255) * Vector4(c / 65536, c / 256 % 256, c % 256, 255);
+}
+
+struct CirclePrimitive {
+  Vector2 center;
+  real radius;
+  Vector4 color;
+
+  void pixels(Vector2i &lower, Vector2i &upper) const {
+    circle_pixels(center, radius, lower, upper);
+  }
+
+  void draw(Canvas &canvas, Vector2i lower, Vector2i upper) const {
+    canvas.rasterize_circle(center, radius, color, lower, upper);
+  }
+};
+
+struct StrokePrimitive {
+  Vector2 a, b;
+  real radius;
+  Vector4 color;
+
+  void pixels(Vector2i &lower, Vector2i &upper) const {
+    stroke_pixels(a, b, radius, lower, upper);
+  }
+
+  void draw(Canvas &canvas, Vector2i lower, Vector2i upper) const {
+    canvas.rasterize_stroke(a, b, radius, color, lower, upper);
+  }
+};
+
+struct TrianglePrimitive {
+  Vector2 a, b, c;
+  Vector4 color;
+
+  void pixels(Vector2i &lower, Vector2i &upper) const {
+    triangle_pixels(a, b, c, lower, upper);
+  }
+
+  void draw(Canvas &canvas, Vector2i lower, Vector2i upper) const {
+    canvas.rasterize_triangle(a, b, c, color, lower, upper);
+  }
+};
+
+template <typename Pixel>
+void draw_circle(Array2D<Pixel> &img,
+                 Vector2 center,
+                 real radius,
+                 Vector4 color,
+                 Vector2i lower,
+                 Vector2i upper) {
+  real alpha[kCoverageBlock];
+  for (int i = lower.x; i <= upper.x; i++) {
+    real dx = center.x - real(i);
+    auto column = img[i];
+    for (int j = lower.y; j <= upper.y; j += kCoverageBlock) {
+      int n = std::min(kCoverageBlock, upper.y + 1 - j);
+      circle_coverage(center.y, dx * dx, radius, color.w, j, n, alpha);
+      blend(alpha, n, color, column + j);
+    }
+  }
+}
+
+template <typename Pixel>
+void draw_stroke(Array2D<Pixel> &img,
+                 Vector2 a,
+                 Vector2 b,
+                 real radius,
+                 Vector4 color,
+                 Vector2i lower,
+                 Vector2i upper) {
+  auto direction = normalized(b - a);
+  auto l = length(b - a);
+  auto tangent = Vector2(-direction.y, direction.x);
+  for (int i = lower.x; i <= upper.x; i++) {
+    auto column = img[i];
+    for (int j = lower.y; j <= upper.y; j++) {
+      auto pixel_coord = Vector2(i + 0.5_f, j + 0.5_f) - a;
+      auto u = dot(tangent, pixel_coord);
+      auto v = dot(direction, pixel_coord);
+      if (v > 0) {
+        v = std::max(0.0_f, v - l);
+      }
+      real dist = length(Vector2(u, v));
+      auto alpha = color.w * clamp(radius - dist);
+      if (alpha != 0) {
+        blend_pixel(alpha, color, column[j]);
+      }
+    }
+  }
+}
+
+template <typename Pixel>
+void draw_triangle(Array2D<Pixel> &img,
+                   Vector2 a,
+                   Vector2 b,
+                   Vector2 c,
+                   Pixel value,
+                   Vector2i lower,
+                   Vector2i upper) {
+  for (int i = lower.x; i <= upper.x; i++) {
+    auto column = img[i];
+    for (int j = lower.y; j <= upper.y; j++) {
+      Vector2 pixel(i + 0.5_f, j + 0.5_f);
+      bool inside_a = cross(pixel - a, b - a) <= 0;
+      bool inside_b = cross(pixel - b, c - b) <= 0;
+      bool inside_c = cross(pixel - c, a - c) <= 0;
+
+      // cover both clockwise and counterclockwise case for vertices [a, b, c]
+      if ((inside_a == inside_b) && (inside_a == inside_c)) {
+        column[j] = value;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void Canvas::rasterize_circle(Vector2 center,
+                              real radius,
+                              Vector4 color,
+                              Vector2i lower,
+                              Vector2i upper) {
+  Vector2i pixels_lower, pixels_upper;
+  circle_pixels(center, radius, pixels_lower, pixels_upper);
+  if (!clip_pixels(pixels_lower, pixels_upper, lower, upper)) {
+    return;
+  }
+  if (img8) {
+    draw_circle(*img8, center, radius, color, pixels_lower, pixels_upper);
+  } else {
+    draw_circle(img, center, radius, color, pixels_lower, pixels_upper);
+  }
+}
+
+void Canvas::rasterize_stroke(Vector2 a,
+                              Vector2 b,
+                              real radius,
+                              Vector4 color,
+                              Vector2i lower,
+                              Vector2i upper) {
+  Vector2i pixels_lower, pixels_upper;
+  stroke_pixels(a, b, radius, pixels_lower, pixels_upper);
+  if (!clip_pixels(pixels_lower, pixels_upper, lower, upper)) {
+    return;
+  }
+  if (img8) {
+    draw_stroke(*img8, a, b, radius, color, pixels_lower, pixels_upper);
+  } else {
+    draw_stroke(img, a, b, radius, color, pixels_lower, pixels_upper);
+  }
+}
+
+void Canvas::rasterize_triangle(Vector2 a,
+                                Vector2 b,
+                                Vector2 c,
+                                Vector4 color,
+                                Vector2i lower,
+                                Vector2i upper) {
+  Vector2i pixels_lower, pixels_upper;
+  triangle_pixels(a, b, c, pixels_lower, pixels_upper);
+  if (!clip_pixels(pixels_lower, pixels_upper, lower, upper)) {
+    return;
+  }
+  if (img8) {
+    draw_triangle(*img8, a, b, c, pack_rgba8(color), pixels_lower,
+                  pixels_upper);
+  } else {
+    draw_triangle(img, a, b, c, color, pixels_lower, pixels_upper);
+  }
+}
+
+void Canvas::get_rgba32f(float32 *data) const {
+  auto res = get_res();
+  for (int i = 0; i < res[0]; i++) {
+    for (int j = 0; j < res[1]; j++) {
+      auto color = get_pixel(i, j);
+      for (int k = 0; k < 4; k++) {
+        *data++ = (float32)color[k];
+      }
+    }
+  }
+}
+
+void Canvas::set_rgba32f(const float32 *data) {
+  auto res = get_res();
+  for (int i = 0; i < res[0]; i++) {
+    for (int j = 0; j < res[1]; j++) {
+      set_pixel(i, j, Vector4(data[0], data[1], data[2], data[3]));
+      data += 4;
+    }
+  }
+}
+
+void Canvas::text_rgba8(const std::string &ttf_path,
+                        const std::string &str,
+                        real size,
+                        int dx,
+                        int dy,
+                        Vector4 color) {
+  auto res = img8->get_res();
+  auto screen_buffer = render_text(ttf_path, str, size, res);
+  for (int j = 0; j < res[1]; ++j) {
+    for (int i = 0; i < res[0]; ++i) {
+      int x = dx + i, y = dy + j - res[1];
+      auto index = ((res[1] - j - 1) * res[0] + i);
+      real alpha = screen_buffer[index] / 255.0f;
+      if (img8->inside(x, y) && alpha != 0) {
+        blend_pixel(alpha, color, (*img8)[x][y]);
+      }
+    }
+  }
+}
+
 void Canvas::triangles_batched(int n,
                                std::size_t a_,
                                std::size_t b_,
@@ -14,14 +536,18 @@ void Canvas::triangles_batched(int n,
   auto b = (real *)b_;
   auto c = (real *)c_;
   auto color_arr = (uint32 *)color_array;
+  std::vector<TrianglePrimitive> batch(n);
   for (int i = 0; i < n; i++) {
     auto clr = color_single;
     if (color_arr) {
       clr = color_arr[i];
     }
-    triangle_single(a[i * 2], a[i * 2 + 1], b[i * 2], b[i * 2 + 1], c[i * 2],
-                    c[i * 2 + 1], clr);
+    batch[i] = {transform(Vector2(a[i * 2], a[i * 2 + 1])),
+                    transform(Vector2(b[i * 2], b[i * 2 + 1])),
+                    transform(Vector2(c[i * 2], c[i * 2 + 1])),
+                    color_from_hex(clr)};
   }
+  rasterize_batched(*this, batch);
 }
 
 void Canvas::paths_batched(int n,
@@ -35,6 +561,7 @@ void Canvas::paths_batched(int n,
   auto b = (real *)b_;
   auto color_arr = (uint32 *)color_array;
   auto radius_arr = (real *)radius_array;
+  std::vector<StrokePrimitive> batch(n);
   for (int i = 0; i < n; i++) {
     auto r = radius_single;
     if (radius_arr) {
@@ -45,9 +572,11 @@ void Canvas::paths_batched(int n,
       clr = color_arr[i];
     }
     // FIXME: path_single seems not displaying correct without the 1e-6 term:
-    path_single(a[i * 2], a[i * 2 + 1], b[i * 2] + 1e-6 * (i % 18 + 6),
-                b[i * 2 + 1], clr, r);
+    auto end = Vector2(real(b[i * 2] + 1e-6 * (i % 18 + 6)), b[i * 2 + 1]);
+    batch[i] = {transform(Vector2(a[i * 2], a[i * 2 + 1])), transform(end),
+                  r, color_from_int(clr)};
   }
+  rasterize_batched(*this, batch);
 }
 
 void Canvas::circles_batched(int n,
@@ -59,6 +588,7 @@ void Canvas::circles_batched(int n,
   auto x = (real *)x_;
   auto color_arr = (uint32 *)color_array;
   auto radius_arr = (real *)radius_array;
+  std::vector<CirclePrimitive> batch(n);
   for (int i = 0; i < n; i++) {
     auto r = radius_single;
     if (radius_arr) {
@@ -68,8 +598,10 @@ void Canvas::circles_batched(int n,
     if (color_arr) {
       c = color_arr[i];
     }
-    circle(x[i * 2], x[i * 2 + 1]).radius(r).color(c).finish();
+    batch[i] = {transform(Vector2(x[i * 2], x[i * 2 + 1])), r,
+                  color_from_int(c)};
   }
+  rasterize_batched(*this, batch);
 }
 
 void Canvas::circle_single(real x, real y, uint32 color, real radius) {
@@ -86,36 +618,8 @@ void Canvas::path_single(real x0,
 }
 
 void Canvas::triangle(Vector2 a, Vector2 b, Vector2 c, Vector4 color) {
-  a = transform(a);
-  b = transform(b);
-  c = transform(c);
-
-  // real points[3] = {a, b, c};
-  // std::sort(points, points + 3, [](const Vector2 &a, const Vector2 &b) {
-  //  return a.y < b.y;
-  //});
-  Vector2 limits[2];
-  limits[0].x = min(a.x, min(b.x, c.x));
-  limits[0].y = min(a.y, min(b.y, c.y));
-  limits[1].x = max(a.x, max(b.x, c.x));
-  limits[1].y = max(a.y, max(b.y, c.y));
-  for (int i = (int)std::floor(limits[0].x); i < (int)std::ceil(limits[1].x);
-       i++) {
-    for (int j = (int)std::floor(limits[0].y); j < (int)std::ceil(limits[1].y);
-         j++) {
-      Vector2 pixel(i + 0.5_f, j + 0.5_f);
-      bool inside_a = cross(pixel - a, b - a) <= 0;
-      bool inside_b = cross(pixel - b, c - b) <= 0;
-      bool inside_c = cross(pixel - c, a - c) <= 0;
-
-      // cover both clockwise and counterclockwise case for vertices [a, b, c]
-      bool inside_triangle = (inside_a == inside_b) && (inside_a == inside_c);
-
-      if (inside_triangle && img.inside(i, j)) {
-        img[i][j] = color;
-      }
-    }
-  }
+  rasterize_triangle(transform(a), transform(b), transform(c), color,
+                     Vector2i(0, 0), img.get_res() - Vector2i(1, 1));
 }
 
 void Canvas::triangle_single(real x0,
@@ -28,6 +28,30 @@ TI_FORCE_INLINE Vector4 color_from_hex(uint32 c) {
   return Vector4(c / 65536, c / 256 % 256, c % 256, 255) * (1 / 255.0_f);
 }
 
+// How a Canvas stores its pixels.
+enum class CanvasFormat {
+  // 4 reals per pixel.
+  rgba32f,
+  // 4 bytes per pixel, with R in the lowest byte. The channels are rounded to
+  // the nearest of 256 levels whenever a pixel is written, so the displayed
+  // images differ from rgba32f by about one level.
+  rgba8,
+};
+
+TI_FORCE_INLINE uint32 pack_rgba8(Vector4 color) {
+  uint32 ret = 0;
+  for (int k = 0; k < 4; k++) {
+    ret |= (uint32)clamp((int)std::lrint(color[k] * 255.0_f), 0, 255)
+           << (8 * k);
+  }
+  return ret;
+}
+
+TI_FORCE_INLINE Vector4 unpack_rgba8(uint32 c) {
+  return Vector4(c & 255, (c >> 8) & 255, (c >> 16) & 255, c >> 24) *
+         (1 / 255.0_f);
+}
+
 #if (false)
 constexpr uint32 text_color = 0x02547D;
 constexpr uint32 widget_bg = 0x02BEC4;
@@ -179,35 +203,8 @@ class Canvas {
     // TODO: end style e.g. arrow
 
     void stroke(Vector2 a, Vector2 b) {
-      // TODO: accelerate
-      auto a_i = (a + Vector2(0.5_f)).template cast<int>();
-      auto b_i = (b + Vector2(0.5_f)).template cast<int>();
-      auto radius_i = (int)std::ceil(_radius + 0.5_f);
-      auto range_lower = Vector2i(std::min(a_i.x, b_i.x) - radius_i,
-                                  std::min(a_i.y, b_i.y) - radius_i);
-      range_lower(0) = std::max(0, range_lower(0));
-      range_lower(1) = std::max(0, range_lower(1));
-      auto range_higher = Vector2i(std::max(a_i.x, b_i.x) + radius_i,
-                                   std::max(a_i.y, b_i.y) + radius_i);
-      range_higher(0) = std::min(canvas.img.get_width() - 1, range_higher(0));
-      range_higher(1) = std::min(canvas.img.get_height() - 1, range_higher(1));
-      auto direction = normalized(b - a);
-      auto l = length(b - a);
-      auto tangent = Vector2(-direction.y, direction.x);
-      for (int i = range_lower.x; i <= range_higher.x; i++) {
-        for (int j = range_lower.y; j <= range_higher.y; j++) {
-          auto pixel_coord = Vector2(i + 0.5_f, j + 0.5_f) - a;
-          auto u = dot(tangent, pixel_coord);
-          auto v = dot(direction, pixel_coord);
-          if (v > 0) {
-            v = std::max(0.0_f, v - l);
-          }
-          real dist = length(Vector2(u, v));
-          auto alpha = _color.w * clamp(_radius - dist);
-          auto &dest = canvas.img[Vector2i(i, j)];
-          dest = lerp(alpha, dest, _color);
-        }
-      }
+      canvas.rasterize_stroke(a, b, _radius, _color, Vector2i(0, 0),
+                              canvas.get_res() - Vector2i(1, 1));
     }
 
     void finish() {
@@ -262,24 +259,8 @@ class Canvas {
     void finish() {
       TI_ASSERT(finished == false);
       finished = true;
-      auto center = canvas.transform(_center);
-      auto const canvas_width = canvas.img.get_width();
-      auto const canvas_height = canvas.img.get_height();
-      const auto r = _radius;
-      int i_lower = std::max(0, (int)std::ceil(center(0) - r));
-      int j_lower = std::max(0, (int)std::ceil(center(1) - r));
-      int i_higher = std::min((int)std::floor(center(0) + r), canvas_width - 1);
-      int j_higher =
-          std::min((int)std::floor(center(1) + r), canvas_height - 1);
-      const auto w = _color.w;
-      for (int i = i_lower; i <= i_higher; i++) {
-        for (int j = j_lower; j <= j_higher; j++) {
-          real dist = length(center - Vector2(i, j));
-          auto alpha = w * clamp(r - dist);
-          auto &dest = canvas.img[Vector2i(i, j)];
-          dest = lerp(alpha, dest, _color);
-        }
-      }
+      canvas.rasterize_circle(canvas.transform(_center), _radius, _color,
+                              Vector2i(0, 0), canvas.get_res() - Vector2i(1, 1));
     }
 
     TI_FORCE_INLINE ~Circle() {
@@ -290,12 +271,44 @@ class Canvas {
 
  public:
   Array2D<Vector4> &img;
+  // The pixels with CanvasFormat::rgba8, in which case |img| is empty.
+  Array2D<uint32> *img8;
   Matrix3 transform_matrix;
 
-  Canvas(Array2D<Vector4> &img) : img(img) {
-    transform_matrix = Matrix3(Vector3(img.get_res().cast<real>(), 1.0_f));
+  Canvas(Array2D<Vector4> &img, Array2D<uint32> *img8 = nullptr)
+      : img(img), img8(img8) {
+    transform_matrix = Matrix3(Vector3(get_res().cast<real>(), 1.0_f));
+  }
+
+  CanvasFormat get_format() const {
+    return img8 ? CanvasFormat::rgba8 : CanvasFormat::rgba32f;
+  }
+
+  Vector2i get_res() const {
+    return img8 ? img8->get_res() : img.get_res();
+  }
+
+  bool inside(Vector2i p) const {
+    return img8 ? img8->inside(p) : img.inside(p);
+  }
+
+  Vector4 get_pixel(int i, int j) const {
+    return img8 ? unpack_rgba8((*img8)[i][j]) : img[i][j];
   }
 
+  void set_pixel(int i, int j, Vector4 color) {
+    if (img8) {
+      (*img8)[i][j] = pack_rgba8(color);
+    } else {
+      img[i][j] = color;
+    }
+  }
+
+  // Reads or writes the pixels as float32 RGBA, column by column.
+  void get_rgba32f(float32 *data) const;
+
+  void set_rgba32f(const float32 *data);
+
   TI_FORCE_INLINE Vector2 transform(Vector2 x) const {
     return Vector2(transform_matrix * Vector3(x, 1.0_f));
   }
@@ -380,14 +393,38 @@ class Canvas {
     for (int i = 0; i < samples; i++) {
       real alpha = (1.0_f / (samples - 1)) * i;
       Vector2i coord = (lerp(alpha, start, end)).floor().cast<int>();
-      if (img.inside(coord)) {
-        img[coord] = color;
+      if (inside(coord)) {
+        set_pixel(coord.x, coord.y, color);
       }
     }
   }
 
   void triangle(Vector2 a, Vector2 b, Vector2 c, Vector4 color);
 
+  // Draw a primitive in screen space into the pixels in [lower, upper] only,
+  // so that the batched draws can rasterize the tiles of the canvas in
+  // parallel. Each pixel is blended with the primitives covering it in the
+  // order they are drawn, hence the result does not depend on the tiling.
+  void rasterize_circle(Vector2 center,
+                        real radius,
+                        Vector4 color,
+                        Vector2i lower,
+                        Vector2i upper);
+
+  void rasterize_stroke(Vector2 a,
+                        Vector2 b,
+                        real radius,
+                        Vector4 color,
+                        Vector2i lower,
+                        Vector2i upper);
+
+  void rasterize_triangle(Vector2 a,
+                          Vector2 b,
+                          Vector2 c,
+                          Vector4 color,
+                          Vector2i lower,
+                          Vector2i upper);
+
   void triangles_batched(int n,
                          std::size_t a_,
                          std::size_t b_,
@@ -415,13 +452,28 @@ class Canvas {
       folder = fmt::format("{}/external/assets", get_repo_dir());
     }
     auto ttf_path = fmt::format("{}/Go-Regular.ttf", folder);
-    img.write_text(ttf_path, str, size, position.x, position.y, color);
+    if (img8) {
+      text_rgba8(ttf_path, str, size, position.x, position.y, color);
+    } else {
+      img.write_text(ttf_path, str, size, position.x, position.y, color);
+    }
   }
 
+  void text_rgba8(const std::string &ttf_path,
+                  const std::string &str,
+                  real size,
+                  int dx,
+                  int dy,
+                  Vector4 color);
+
   void clear(Vector4 color) {
     circles.clear();
     lines.clear();
-    img.reset(color);
+    if (img8) {
+      img8->reset(pack_rgba8(color));
+    } else {
+      img.reset(color);
+    }
   }
 
   void clear(uint32 c) {
@@ -445,7 +497,7 @@ class GUIBaseX11 {
   void *display;
   void *visual;
   unsigned long window;
-  CXImage *img;
+  CXImage *img{nullptr};
   std::vector<char> wmDeleteMessage;
 };
 
@@ -494,6 +546,8 @@ class GUI : public GUIBase {
   real frame_delta_limit = 1.0 / 60;
   float64 start_time;
   Array2D<Vector4> buffer;
+  // The pixels of |canvas| with CanvasFormat::rgba8, instead of |buffer|.
+  Array2D<uint32> buffer8;
   std::vector<real> last_frame_interval;
   std::unique_ptr<Canvas> canvas;
   float64 last_frame_time;
@@ -570,7 +624,7 @@ class GUI : public GUIBase {
           hover ? color_from_hex(widget_bg) : color_from_hex(widget_hover);
       for (int i = 1; i < rect.size[0] - 1; i++) {
         for (int j = 1; j < rect.size[1] - 1; j++) {
-          canvas.img[rect.pos[0] + i][rect.pos[1] + j] = color;
+          canvas.set_pixel(rect.pos[0] + i, rect.pos[1] + j, color);
         }
       }
     }
@@ -669,8 +723,8 @@ class GUI : public GUIBase {
           slider_end = rect.size[0] - slider_padding;
       for (int i = slider_start; i < slider_end; i++) {
         for (int j = slider_padding; j < slider_padding + 3; j++) {
-          canvas.img[rect.pos[0] + i][rect.pos[1] + j] =
-              color_from_hex(slider_bar_color);
+          canvas.set_pixel(rect.pos[0] + i, rect.pos[1] + j,
+                           color_from_hex(slider_bar_color));
         }
       }
       auto alpha = (val - minimum) / real(maximum - minimum);
@@ -767,7 +821,8 @@ class GUI : public GUIBase {
                bool fullscreen = true,
                bool fast_gui = false,
                uintptr_t fast_buf = 0,
-               bool normalized_coord = true)
+               bool normalized_coord = true,
+               CanvasFormat canvas_format = CanvasFormat::rgba32f)
       : window_name(window_name),
         width(width),
         height(height),
@@ -778,8 +833,13 @@ class GUI : public GUIBase {
         fast_buf(fast_buf) {
     memset(button_status, 0, sizeof(button_status));
     start_time = taichi::Time::get_time();
-    buffer.initialize(Vector2i(width, height));
-    canvas = std::make_unique<Canvas>(buffer);
+    if (canvas_format == CanvasFormat::rgba8) {
+      buffer8.initialize(Vector2i(width, height));
+      canvas = std::make_unique<Canvas>(buffer, &buffer8);
+    } else {
+      buffer.initialize(Vector2i(width, height));
+      canvas = std::make_unique<Canvas>(buffer);
+    }
     last_frame_time = taichi::Time::get_time();
     if (!normalized_coord) {
       canvas->set_identity_transform_matrix();
@@ -796,7 +856,8 @@ class GUI : public GUIBase {
                bool fullscreen = true,
                bool fast_gui = false,
                uintptr_t fast_buf = 0,
-               bool normalized_coord = true)
+               bool normalized_coord = true,
+               CanvasFormat canvas_format = CanvasFormat::rgba32f)
       : GUI(window_name,
             res[0],
             res[1],
@@ -804,7 +865,8 @@ class GUI : public GUIBase {
             fullscreen,
             fast_gui,
             fast_buf,
-            normalized_coord) {
+            normalized_coord,
+            canvas_format) {
   }
 
   void create_window();
@@ -820,6 +882,10 @@ class GUI : public GUIBase {
 
   void redraw();
 
+  // Presents the packed pixels at |fast_buf| from now on in fast_gui mode,
+  // e.g. a zero-copy array written by kernels on the device.
+  void set_fast_buffer(uintptr_t fast_buf);
+
   void set_title(std::string title);
 
   void redraw_widgets() {
@@ -927,7 +993,17 @@ class GUI : public GUIBase {
                     &tstruct);
       filename = std::string(timestamp) + ".png";
     }
-    canvas->img.write_as_image(filename);
+    if (canvas->img8) {
+      Array2D<Vector4> img(canvas->get_res());
+      for (int i = 0; i < width; i++) {
+        for (int j = 0; j < height; j++) {
+          img[i][j] = canvas->get_pixel(i, j);
+        }
+      }
+      img.write_as_image(filename);
+    } else {
+      canvas->img.write_as_image(filename);
+    }
   }
 
   ~GUI();
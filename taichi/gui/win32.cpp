@@ -208,6 +208,14 @@ void GUI::redraw() {
     for (int i = 0; i < width; i++) {
       for (int j = 0; j < height; j++) {
         auto c = reinterpret_cast<unsigned char *>(data + (j * width) + i);
+        if (canvas->img8) {
+          auto d = (*canvas->img8)[i][height - j - 1];
+          c[0] = uint8(d >> 16);
+          c[1] = uint8(d >> 8);
+          c[2] = uint8(d);
+          c[3] = 0;
+          continue;
+        }
         auto d = canvas->img[i][height - j - 1];
         c[0] = uint8(clamp(int(d[2] * 255.0_f), 0, 255));
         c[1] = uint8(clamp(int(d[1] * 255.0_f), 0, 255));
@@ -223,6 +231,11 @@ void GUI::redraw() {
   DeleteObject(bitmap);
 }
 
+void GUI::set_fast_buffer(uintptr_t fast_buf) {
+  TI_ASSERT(fast_gui);
+  this->fast_buf = fast_buf;
+}
+
 void GUI::set_title(std::string title) {
   SetWindowText(hwnd, std::wstring(title.begin(), title.end()).data());
 }
@@ -5,6 +5,14 @@
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
 #include <cstdlib>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "taichi/system/dynamic_loader.h"
+
+#if defined(TI_ARCH_x64)
+#include <emmintrin.h>
+#endif
 
 // Undo terrible unprefixed macros in X.h
 #ifdef None
@@ -16,15 +24,147 @@
 
 TI_NAMESPACE_BEGIN
 
+namespace {
+
+// The MIT-SHM extension lets the X server read the image from a shared
+// memory segment, instead of receiving it through the socket. libXext is
+// loaded at runtime, so that it is not required.
+class XShm {
+ public:
+  // From X11/extensions/XShm.h
+  struct SegmentInfo {
+    unsigned long shmseg;
+    int shmid;
+    char *shmaddr;
+    Bool readOnly;
+  };
+
+  Bool (*query_extension)(Display *){nullptr};
+  XImage *(*create_image)(Display *,
+                          Visual *,
+                          unsigned int,
+                          int,
+                          char *,
+                          SegmentInfo *,
+                          unsigned int,
+                          unsigned int){nullptr};
+  Bool (*attach)(Display *, SegmentInfo *){nullptr};
+  Bool (*detach)(Display *, SegmentInfo *){nullptr};
+  Bool (*put_image)(Display *,
+                    Drawable,
+                    GC,
+                    XImage *,
+                    int,
+                    int,
+                    int,
+                    int,
+                    unsigned int,
+                    unsigned int,
+                    Bool){nullptr};
+
+  static XShm &get_instance() {
+    static XShm instance;
+    return instance;
+  }
+
+  // Whether the images can be shared with the server of |display|. A remote
+  // server has the extension, but fails to attach the segments.
+  bool available(Display *display) const {
+    auto env = std::getenv("TI_GUI_SHM");
+    return loaded_ && (!env || std::string(env) != "0") &&
+           query_extension(display);
+  }
+
+ private:
+  XShm() : loader_("libXext.so.6") {
+    if (!loader_.loaded()) {
+      return;
+    }
+    loader_.load_function("XShmQueryExtension", query_extension);
+    loader_.load_function("XShmCreateImage", create_image);
+    loader_.load_function("XShmAttach", attach);
+    loader_.load_function("XShmDetach", detach);
+    loader_.load_function("XShmPutImage", put_image);
+    loaded_ = true;
+  }
+
+  DynamicLoader loader_;
+  bool loaded_{false};
+};
+
+bool shm_attach_failed = false;
+
+int on_shm_attach_error(Display *, XErrorEvent *) {
+  shm_attach_failed = true;
+  return 0;
+}
+
+// Writes the pixels of |count| consecutive columns |color[i]| of row j of the
+// image from the top, as BGR0 bytes to |dest|.
+void convert_to_bgr0(const Array2D<Vector4> &color,
+                     int i,
+                     int count,
+                     int j,
+                     uint8 *dest) {
+  const int height = color.get_height();
+  int k = 0;
+#if defined(TI_ARCH_x64) && !defined(TI_USE_DOUBLE)
+  // Converts 4 pixels at a time. The conversion truncates like int(), and the
+  // saturating packs clamp to [0, 255].
+  const __m128 scale = _mm_setr_ps(255.0f, 255.0f, 255.0f, 0.0f);
+  auto convert = [&](int c) {
+    auto src = _mm_loadu_ps(color[i + c][height - j - 1].d);
+    auto bgra = _mm_shuffle_ps(src, src, _MM_SHUFFLE(3, 0, 1, 2));
+    return _mm_cvttps_epi32(_mm_mul_ps(bgra, scale));
+  };
+  for (; k + 4 <= count; k += 4) {
+    auto p01 = _mm_packs_epi32(convert(k), convert(k + 1));
+    auto p23 = _mm_packs_epi32(convert(k + 2), convert(k + 3));
+    _mm_storeu_si128((__m128i *)(dest + k * 4), _mm_packus_epi16(p01, p23));
+  }
+#endif
+  for (; k < count; k++) {
+    auto c = color[i + k][height - j - 1];
+    auto p = dest + k * 4;
+    p[0] = uint8(clamp(int(c[2] * 255.0_f), 0, 255));
+    p[1] = uint8(clamp(int(c[1] * 255.0_f), 0, 255));
+    p[2] = uint8(clamp(int(c[0] * 255.0_f), 0, 255));
+    p[3] = 0;
+  }
+}
+
+void convert_to_bgr0(const Array2D<uint32> &color,
+                     int i,
+                     int count,
+                     int j,
+                     uint8 *dest) {
+  const int height = color.get_height();
+  auto d = (uint32 *)dest;
+  for (int k = 0; k < count; k++) {
+    // Swaps R and B, and clears the alpha byte.
+    uint32 p = color[i + k][height - j - 1];
+    d[k] = ((p & 0xff) << 16) | (p & 0xff00) | ((p >> 16) & 0xff);
+  }
+}
+
+}  // namespace
+
 class CXImage {
  public:
   XImage *image;
   std::vector<uint8> image_data;
   void *fast_data{nullptr};
   int width, height;
+  Display *display;
+  bool shm{false};
+  XShm::SegmentInfo shm_info;
 
   CXImage(Display *display, Visual *visual, int width, int height)
-      : width(width), height(height) {
+      : width(width), height(height), display(display) {
+    if (XShm::get_instance().available(display) &&
+        create_shm_image(visual)) {
+      return;
+    }
     image_data.resize(width * height * 4);
     image = XCreateImage(display, visual, 24, ZPixmap, 0,
                          (char *)image_data.data(), width, height, 32, 0);
@@ -36,27 +176,86 @@ class CXImage {
           void *fast_data,
           int width,
           int height)
-      : width(width), height(height) {
+      : width(width), height(height), display(display) {
     image = XCreateImage(display, visual, 24, ZPixmap, 0, (char *)fast_data,
                          width, height, 32, 0);
     TI_ASSERT((void *)image->data == fast_data);
   }
 
-  void set_data(const Array2D<Vector4> &color) {
-    auto p = image_data.data();
-    for (int j = 0; j < height; j++) {
-      for (int i = 0; i < width; i++) {
-        auto c = color[i][height - j - 1];
-        *p++ = uint8(clamp(int(c[2] * 255.0_f), 0, 255));
-        *p++ = uint8(clamp(int(c[1] * 255.0_f), 0, 255));
-        *p++ = uint8(clamp(int(c[0] * 255.0_f), 0, 255));
-        *p++ = 0;
+  bool create_shm_image(Visual *visual) {
+    auto &xshm = XShm::get_instance();
+    image = xshm.create_image(display, visual, 24, ZPixmap, nullptr,
+                              &shm_info, width, height);
+    if (!image) {
+      return false;
+    }
+    shm_info.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * height,
+                            IPC_CREAT | 0600);
+    if (shm_info.shmid < 0) {
+      XFree(image);
+      return false;
+    }
+    shm_info.shmaddr = (char *)shmat(shm_info.shmid, nullptr, 0);
+    // The segment is destroyed once both the server and we detach it.
+    shmctl(shm_info.shmid, IPC_RMID, nullptr);
+    if (shm_info.shmaddr == (char *)-1) {
+      XFree(image);
+      return false;
+    }
+    image->data = shm_info.shmaddr;
+    shm_info.readOnly = False;
+
+    // Attaching fails asynchronously, e.g. on remote servers.
+    shm_attach_failed = false;
+    auto handler = XSetErrorHandler(on_shm_attach_error);
+    bool attached = xshm.attach(display, &shm_info);
+    XSync(display, False);
+    XSetErrorHandler(handler);
+    if (!attached || shm_attach_failed) {
+      shmdt(shm_info.shmaddr);
+      XFree(image);
+      return false;
+    }
+    shm = true;
+    return true;
+  }
+
+  template <typename Pixel>
+  void set_data(const Array2D<Pixel> &color) {
+    // Converts blocks of columns, so that both the columns of |color| are
+    // read and every row is written sequentially.
+    constexpr int block = 16;
+    auto data = (uint8 *)image->data;
+    for (int i = 0; i < width; i += block) {
+      int count = std::min(block, width - i);
+      for (int j = 0; j < height; j++) {
+        convert_to_bgr0(color, i, count, j,
+                        data + j * image->bytes_per_line + i * 4);
       }
     }
   }
 
+  void put(Window window) {
+    if (shm) {
+      XShm::get_instance().put_image(display, window, DefaultGC(display, 0),
+                                     image, 0, 0, 0, 0, width, height, False);
+      // The next frame must not be written before the server has read this
+      // one.
+      XSync(display, False);
+    } else {
+      XPutImage(display, window, DefaultGC(display, 0), image, 0, 0, 0, 0,
+                width, height);
+    }
+  }
+
   ~CXImage() {
-    delete image;  // image->data is automatically released in image_data
+    if (shm) {
+      XShm::get_instance().detach(display, &shm_info);
+      shmdt(shm_info.shmaddr);
+      XFree(image);
+    } else {
+      delete image;  // image->data is automatically released in image_data
+    }
   }
 };
 
@@ -185,10 +384,22 @@ void GUI::create_window() {
 }
 
 void GUI::redraw() {
-  if (!fast_gui)
-    img->set_data(buffer);
-  XPutImage((Display *)display, window, DefaultGC(display, 0), img->image, 0, 0,
-            0, 0, width, height);
+  if (!fast_gui) {
+    if (canvas->img8) {
+      img->set_data(*canvas->img8);
+    } else {
+      img->set_data(buffer);
+    }
+  }
+  img->put(window);
+}
+
+void GUI::set_fast_buffer(uintptr_t fast_buf) {
+  TI_ASSERT(fast_gui);
+  this->fast_buf = fast_buf;
+  if (img) {
+    img->image->data = (char *)fast_buf;
+  }
 }
 
 void GUI::set_title(std::string title) {
@@ -197,8 +408,9 @@ void GUI::set_title(std::string title) {
 
 GUI::~GUI() {
   if (show_gui) {
-    XCloseDisplay((Display *)display);
+    // Detaches the shared memory segment from the display first.
     delete img;
+    XCloseDisplay((Display *)display);
   }
 }
 
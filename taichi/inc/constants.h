@@ -5,8 +5,13 @@
 constexpr int taichi_max_num_indices = 8;
 constexpr int taichi_max_num_args = 8;
 constexpr int taichi_max_num_snodes = 1024;
+// ti.root and the trees built by ti.FieldsBuilder
+constexpr int taichi_max_num_snode_trees = 32;
 constexpr int taichi_max_gpu_block_dim = 1024;
 constexpr std::size_t taichi_global_tmp_buffer_size = 1024 * 1024;
+// The TLS buffers of deterministic range-fors on CUDA
+constexpr std::size_t taichi_deterministic_reduction_buffer_size =
+    4 * 1024 * 1024;
 constexpr int taichi_max_num_mem_requests = 1024 * 64;
 constexpr std::size_t taichi_page_size = 4096;
 constexpr std::size_t taichi_error_message_max_length = 2048;
@@ -19,6 +24,8 @@ constexpr std::size_t taichi_result_buffer_error_id = 1;
 constexpr std::size_t taichi_result_buffer_runtime_query_id = 2;
 
 constexpr int taichi_listgen_max_element_size = 1024;
+// The longest probe sequence of the hash SNodes
+constexpr int taichi_hash_max_num_probes = 128;
 
 template <typename T, typename G>
 T taichi_union_cast_with_different_sizes(G g) {
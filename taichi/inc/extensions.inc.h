@@ -2,7 +2,7 @@
 PER_EXTENSION(sparse)      // Sparse data structures
 PER_EXTENSION(async_mode)  // Asynchronous execution mode
 PER_EXTENSION(quant)       // Quantization
-PER_EXTENSION(data64)      // Metal doesn't support 64-bit data buffers yet...
+PER_EXTENSION(data64)      // IEEE 64-bit data (Metal only emulates f64)
 PER_EXTENSION(adstack)     // For keeping the history of mutable local variables
 PER_EXTENSION(bls)         // Block-local storage
 PER_EXTENSION(assertion)   // Run-time asserts in Taichi kernels
@@ -69,6 +69,14 @@ std::unordered_set<Stmt *> detect_loops_with_continue(IRNode *root);
 std::unordered_set<SNode *> gather_deactivations(IRNode *root);
 std::pair<std::unordered_set<SNode *>, std::unordered_set<SNode *>>
 gather_snode_read_writes(IRNode *root);
+// Estimates the bytes of global memory a range-for task reads and writes per
+// launch, assuming each iteration accesses its own elements of the fields.
+// Returns 0 for other tasks and non-constant loop bounds.
+int64 estimate_bytes_per_launch(OffloadedStmt *stmt);
+// Estimates the cost of one iteration of the range-for task |stmt|, in units of
+// about one simple statement. Inner loops without constant bounds are assumed
+// to run a few iterations.
+int64 estimate_iteration_cost(OffloadedStmt *stmt);
 std::vector<Stmt *> gather_statements(IRNode *root,
                                       const std::function<bool(Stmt *)> &test);
 std::unordered_map<SNode *, GlobalPtrStmt *> gather_uniquely_accessed_pointers(
@@ -100,6 +108,12 @@ bool same_value(
     Stmt *stmt1,
     Stmt *stmt2,
     const std::optional<std::unordered_map<int, int>> &id_map = std::nullopt);
+// A hash of what same_statements() compares, and of the prologues and
+// epilogues of offloaded tasks. It does not depend on the ids of the
+// statements, or on addresses other than those of the functions that
+// ExternalFuncCallStmt calls, so it is the same in every run of builds with
+// the same compiler.
+uint64 structural_hash(IRNode *root);
 DiffRange value_diff_loop_index(Stmt *stmt, Stmt *loop, int index_id);
 std::pair<bool, int> value_diff_ptr_index(Stmt *val1, Stmt *val2);
 std::unordered_set<Stmt *> constexpr_prop(
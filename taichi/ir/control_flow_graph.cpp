@@ -1,6 +1,7 @@
 #include "taichi/ir/control_flow_graph.h"
 #include "taichi/ir/analysis.h"
 #include "taichi/ir/statements.h"
+#include "taichi/util/bit.h"
 #include <queue>
 
 TLANG_NAMESPACE_BEGIN
@@ -507,6 +508,69 @@ bool CFGNode::dead_store_elimination(bool after_lower_access) {
   return modified;
 }
 
+namespace {
+
+using bit::Bitset;
+
+// Numbers the statements of the sets of the CFG nodes densely, so that the
+// dataflow analyses iterate on bitsets rather than on sets of pointers.
+class StmtNumbering {
+ public:
+  void add(const std::unordered_set<Stmt *> &stmts) {
+    for (auto stmt : stmts) {
+      if (ids_.emplace(stmt, (int)stmts_.size()).second) {
+        stmts_.push_back(stmt);
+      }
+    }
+  }
+
+  int size() const {
+    return (int)stmts_.size();
+  }
+
+  Stmt *get(int id) const {
+    return stmts_[id];
+  }
+
+  Bitset to_bitset(const std::unordered_set<Stmt *> &stmts) const {
+    Bitset bits(size());
+    for (auto stmt : stmts) {
+      bits[ids_.at(stmt)] = true;
+    }
+    return bits;
+  }
+
+  std::unordered_set<Stmt *> to_set(const Bitset &bits) const {
+    std::unordered_set<Stmt *> stmts;
+    for (int i = bits.find_first_one(); i != -1; i = bits.lower_bound(i + 1)) {
+      stmts.insert(stmts_[i]);
+    }
+    return stmts;
+  }
+
+ private:
+  std::vector<Stmt *> stmts_;
+  std::unordered_map<Stmt *, int> ids_;
+};
+
+// Whether the definitions or variables a node kills are decided by comparing
+// addresses, for each statement the first time it reaches the node. Nodes
+// that kill nothing have no cache.
+struct KillCache {
+  Bitset known, killed;
+
+  template <typename F>
+  bool is_killed(int id, const F &compute) {
+    if (!known[id]) {
+      known[id] = true;
+      killed[id] = compute();
+    }
+    return killed[id];
+  }
+};
+
+}  // namespace
+
 void ControlFlowGraph::erase(int node_id) {
   // Erase an empty node.
   TI_ASSERT(node_id >= 0 && node_id < (int)size());
@@ -597,8 +661,6 @@ void ControlFlowGraph::print_graph_structure() const {
 void ControlFlowGraph::reaching_definition_analysis(bool after_lower_access) {
   TI_AUTO_PROF;
   const int num_nodes = size();
-  std::queue<CFGNode *> to_visit;
-  std::unordered_map<CFGNode *, bool> in_queue;
   TI_ASSERT(nodes[start_node]->empty());
   nodes[start_node]->reach_gen.clear();
   nodes[start_node]->reach_kill.clear();
@@ -620,51 +682,78 @@ void ControlFlowGraph::reaching_definition_analysis(bool after_lower_access) {
     if (i != start_node) {
       nodes[i]->reaching_definition_analysis(after_lower_access);
     }
-    nodes[i]->reach_in.clear();
-    nodes[i]->reach_out = nodes[i]->reach_gen;
-    to_visit.push(nodes[i].get());
-    in_queue[nodes[i].get()] = true;
   }
+
+  StmtNumbering defs;
+  std::unordered_map<CFGNode *, int> node_ids;
+  for (int i = 0; i < num_nodes; i++) {
+    defs.add(nodes[i]->reach_gen);
+    node_ids[nodes[i].get()] = i;
+  }
+  const int num_defs = defs.size();
+  std::vector<Bitset> reach_gen(num_nodes), reach_out(num_nodes);
+  std::vector<std::unique_ptr<KillCache>> kill_caches(num_nodes);
+  std::queue<int> to_visit;
+  std::vector<char> in_queue(num_nodes, true);
+  for (int i = 0; i < num_nodes; i++) {
+    reach_gen[i] = defs.to_bitset(nodes[i]->reach_gen);
+    reach_out[i] = reach_gen[i];
+    if (!nodes[i]->reach_kill.empty()) {
+      kill_caches[i] = std::make_unique<KillCache>(
+          KillCache{Bitset(num_defs), Bitset(num_defs)});
+    }
+    to_visit.push(i);
+  }
+  std::vector<Bitset> reach_in(num_nodes, Bitset(num_defs));
   while (!to_visit.empty()) {
-    auto now = to_visit.front();
+    auto id = to_visit.front();
+    auto now = nodes[id].get();
     to_visit.pop();
-    in_queue[now] = false;
+    in_queue[id] = false;
 
-    now->reach_in.clear();
+    Bitset in(num_defs);
     for (auto prev_node : now->prev) {
-      now->reach_in.insert(prev_node->reach_out.begin(),
-                           prev_node->reach_out.end());
-    }
-    auto old_out = std::move(now->reach_out);
-    now->reach_out = now->reach_gen;
-    for (auto stmt : now->reach_in) {
-      auto store_ptrs = irpass::analysis::get_store_destination(stmt);
-      bool killed;
-      if (store_ptrs.empty()) {  // the case of a global pointer
-        killed = now->reach_kill_variable(stmt);
-      } else {
-        killed = true;
-        for (auto store_ptr : store_ptrs) {
-          if (!now->reach_kill_variable(store_ptr)) {
-            killed = false;
-            break;
+      in |= reach_out[node_ids[prev_node]];
+    }
+    Bitset out = in;
+    if (auto *cache = kill_caches[id].get()) {
+      for (int i = in.find_first_one(); i != -1; i = in.lower_bound(i + 1)) {
+        auto stmt = defs.get(i);
+        bool killed = cache->is_killed(i, [&] {
+          auto store_ptrs = irpass::analysis::get_store_destination(stmt);
+          if (store_ptrs.empty()) {  // the case of a global pointer
+            return now->reach_kill_variable(stmt);
           }
+          for (auto store_ptr : store_ptrs) {
+            if (!now->reach_kill_variable(store_ptr)) {
+              return false;
+            }
+          }
+          return true;
+        });
+        if (killed) {
+          out[i] = false;
         }
       }
-      if (!killed) {
-        now->reach_out.insert(stmt);
-      }
     }
-    if (now->reach_out != old_out) {
+    out |= reach_gen[id];
+    reach_in[id] = std::move(in);
+    if (out != reach_out[id]) {
       // changed
+      reach_out[id] = std::move(out);
       for (auto next_node : now->next) {
-        if (!in_queue[next_node]) {
-          to_visit.push(next_node);
-          in_queue[next_node] = true;
+        auto next_id = node_ids[next_node];
+        if (!in_queue[next_id]) {
+          to_visit.push(next_id);
+          in_queue[next_id] = true;
         }
       }
     }
   }
+  for (int i = 0; i < num_nodes; i++) {
+    nodes[i]->reach_in = defs.to_set(reach_in[i]);
+    nodes[i]->reach_out = defs.to_set(reach_out[i]);
+  }
 }
 
 void ControlFlowGraph::live_variable_analysis(
@@ -672,8 +761,6 @@ void ControlFlowGraph::live_variable_analysis(
     const std::optional<LiveVarAnalysisConfig> &config_opt) {
   TI_AUTO_PROF;
   const int num_nodes = size();
-  std::queue<CFGNode *> to_visit;
-  std::unordered_map<CFGNode *, bool> in_queue;
   TI_ASSERT(nodes[final_node]->empty());
   nodes[final_node]->live_gen.clear();
   nodes[final_node]->live_kill.clear();
@@ -704,43 +791,69 @@ void ControlFlowGraph::live_variable_analysis(
       }
     }
   }
-  for (int i = num_nodes - 1; i >= 0; i--) {
-    // push into the queue in reversed order to make it slightly faster
+  StmtNumbering vars;
+  std::unordered_map<CFGNode *, int> node_ids;
+  for (int i = 0; i < num_nodes; i++) {
     if (i != final_node) {
       nodes[i]->live_variable_analysis(after_lower_access);
     }
-    nodes[i]->live_out.clear();
-    nodes[i]->live_in = nodes[i]->live_gen;
-    to_visit.push(nodes[i].get());
-    in_queue[nodes[i].get()] = true;
+    vars.add(nodes[i]->live_gen);
+    node_ids[nodes[i].get()] = i;
+  }
+  const int num_vars = vars.size();
+  std::vector<Bitset> live_gen(num_nodes), live_in(num_nodes);
+  std::vector<std::unique_ptr<KillCache>> kill_caches(num_nodes);
+  std::queue<int> to_visit;
+  std::vector<char> in_queue(num_nodes, true);
+  for (int i = num_nodes - 1; i >= 0; i--) {
+    // push into the queue in reversed order to make it slightly faster
+    live_gen[i] = vars.to_bitset(nodes[i]->live_gen);
+    live_in[i] = live_gen[i];
+    if (!nodes[i]->live_kill.empty()) {
+      kill_caches[i] = std::make_unique<KillCache>(
+          KillCache{Bitset(num_vars), Bitset(num_vars)});
+    }
+    to_visit.push(i);
   }
+  std::vector<Bitset> live_out(num_nodes, Bitset(num_vars));
   while (!to_visit.empty()) {
-    auto now = to_visit.front();
+    auto id = to_visit.front();
+    auto now = nodes[id].get();
     to_visit.pop();
-    in_queue[now] = false;
+    in_queue[id] = false;
 
-    now->live_out.clear();
+    Bitset out(num_vars);
     for (auto next_node : now->next) {
-      now->live_out.insert(next_node->live_in.begin(),
-                           next_node->live_in.end());
-    }
-    auto old_in = std::move(now->live_in);
-    now->live_in = now->live_gen;
-    for (auto stmt : now->live_out) {
-      if (!CFGNode::contain_variable(now->live_kill, stmt)) {
-        now->live_in.insert(stmt);
+      out |= live_in[node_ids[next_node]];
+    }
+    Bitset in = out;
+    if (auto *cache = kill_caches[id].get()) {
+      for (int i = out.find_first_one(); i != -1; i = out.lower_bound(i + 1)) {
+        if (cache->is_killed(i, [&] {
+              return CFGNode::contain_variable(now->live_kill, vars.get(i));
+            })) {
+          in[i] = false;
+        }
       }
     }
-    if (now->live_in != old_in) {
+    in |= live_gen[id];
+    live_out[id] = std::move(out);
+    if (in != live_in[id]) {
       // changed
+      live_in[id] = std::move(in);
       for (auto prev_node : now->prev) {
-        if (!in_queue[prev_node]) {
-          to_visit.push(prev_node);
-          in_queue[prev_node] = true;
+        auto prev_id = node_ids[prev_node];
+        if (!in_queue[prev_id]) {
+          to_visit.push(prev_id);
+          in_queue[prev_id] = true;
         }
       }
     }
   }
+  for (int i = 0; i < num_nodes; i++) {
+    nodes[i]->live_in = vars.to_set(live_in[i]);
+    nodes[i]->live_out = vars.to_set(live_out[i]);
+  }
 }
 
 void ControlFlowGraph::simplify_graph() {
@@ -0,0 +1,68 @@
+#include "taichi/ir/def_use_chains.h"
+
+#include "taichi/ir/visitors.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+class DefUseChainsBuilder : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  explicit DefUseChainsBuilder(DefUseChains *chains) : chains_(chains) {
+    allow_undefined_visitor = true;
+    invoke_default_visitor = true;
+  }
+
+  void visit(Stmt *stmt) override {
+    chains_->add_user(stmt);
+  }
+
+  void preprocess_container_stmt(Stmt *stmt) override {
+    chains_->add_user(stmt);
+  }
+
+ private:
+  DefUseChains *chains_;
+};
+
+}  // namespace
+
+DefUseChains::DefUseChains(IRNode *root) {
+  DefUseChainsBuilder builder(this);
+  root->accept(&builder);
+}
+
+const std::vector<Stmt *> &DefUseChains::get_users(Stmt *stmt) const {
+  static const std::vector<Stmt *> no_users;
+  auto it = users_.find(stmt);
+  return it == users_.end() ? no_users : it->second;
+}
+
+void DefUseChains::replace_all_usages_with(Stmt *old_stmt, Stmt *new_stmt) {
+  if (old_stmt == new_stmt) {
+    return;
+  }
+  auto it = users_.find(old_stmt);
+  if (it == users_.end()) {
+    return;
+  }
+  auto users = std::move(it->second);
+  users_.erase(it);
+  for (auto user : users) {
+    user->replace_operand_with(old_stmt, new_stmt);
+  }
+  auto &new_users = users_[new_stmt];
+  new_users.insert(new_users.end(), users.begin(), users.end());
+}
+
+void DefUseChains::add_user(Stmt *stmt) {
+  for (auto op : stmt->get_operands()) {
+    if (op) {  // might be nullptr
+      users_[op].push_back(stmt);
+    }
+  }
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "taichi/ir/ir.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// The users of each statement in an IR tree.
+//
+// Building the chains takes one traversal of the tree. Afterwards, replacing
+// all the usages of a statement takes O(#usages) instead of a traversal of the
+// block of the statement. The chains stay valid as long as the operands in the
+// tree are only changed through replace_all_usages_with(), and new statements
+// using statements of the tree are registered with add_user().
+class DefUseChains {
+ public:
+  explicit DefUseChains(IRNode *root);
+
+  // May contain erased statements, and a user more than once.
+  const std::vector<Stmt *> &get_users(Stmt *stmt) const;
+
+  bool has_users(Stmt *stmt) const {
+    return !get_users(stmt).empty();
+  }
+
+  // Like irpass::replace_all_usages_with(nullptr, old_stmt, new_stmt).
+  void replace_all_usages_with(Stmt *old_stmt, Stmt *new_stmt);
+
+  void add_user(Stmt *stmt);
+
+ private:
+  std::unordered_map<Stmt *, std::vector<Stmt *>> users_;
+};
+
+TLANG_NAMESPACE_END
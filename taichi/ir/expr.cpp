@@ -96,6 +96,10 @@ void Expr::set_grad(const Expr &o) {
   this->cast<GlobalVariableExpression>()->adjoint.set(o);
 }
 
+void Expr::set_dual(const Expr &o) {
+  this->cast<GlobalVariableExpression>()->dual.set(o);
+}
+
 Expr::Expr(int32 x) : Expr() {
   expr = std::make_shared<ConstExpression>(x);
 }
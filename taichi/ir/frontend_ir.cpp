@@ -27,7 +27,7 @@ IRNode *FrontendContext::root() {
   return static_cast<IRNode *>(root_node.get());
 }
 
-std::unique_ptr<FrontendContext> context;
+thread_local std::unique_ptr<FrontendContext> context;
 
 FrontendForStmt::FrontendForStmt(const ExprGroup &loop_var,
                                  const Expr &global_var)
@@ -36,6 +36,7 @@ FrontendForStmt::FrontendForStmt(const ExprGroup &loop_var,
   parallelize = dec.parallelize;
   strictly_serialized = dec.strictly_serialized;
   block_dim = dec.block_dim;
+  unroll = dec.unroll;
   auto cfg = get_current_program().config;
   if (cfg.arch == Arch::cuda) {
     vectorize = 1;
@@ -72,6 +73,7 @@ FrontendForStmt::FrontendForStmt(const Expr &loop_var,
   parallelize = dec.parallelize;
   strictly_serialized = dec.strictly_serialized;
   block_dim = dec.block_dim;
+  unroll = dec.unroll;
   auto cfg = get_current_program().config;
   if (cfg.arch == Arch::cuda) {
     vectorize = 1;
@@ -157,7 +159,8 @@ void ExternalFuncCallExpression::flatten(FlattenContext *ctx) {
     output_statements.push_back(s.cast<IdExpression>()->flatten_noload(ctx));
   }
   ctx->push_back(std::make_unique<ExternalFuncCallStmt>(
-      func, source, arg_statements, output_statements));
+      func, source, arg_statements, output_statements, runtime_func,
+      bitcode_file));
   stmt = ctx->back_stmt();
 }
 
@@ -348,4 +351,90 @@ void ExternalTensorShapeAlongAxisExpression::flatten(FlattenContext *ctx) {
   stmt = ctx->back_stmt();
 }
 
+namespace {
+
+struct ExpressionBatchOp {
+  const char *name;
+  int num_operands;
+  int op_type;
+};
+
+#define UNARY_OP(x) {"expr_" #x, 1, (int)UnaryOpType::x},
+#define BINARY_OP(x) {"expr_" #x, 2, (int)BinaryOpType::x},
+#define TERNARY_OP(x) {"expr_" #x, 3, (int)TernaryOpType::x},
+
+// The ops of the expr_* functions that only make an op expression.
+const ExpressionBatchOp expression_batch_ops[] = {
+    // clang-format off
+    UNARY_OP(neg) UNARY_OP(sqrt) UNARY_OP(floor) UNARY_OP(ceil) UNARY_OP(abs)
+    UNARY_OP(sin) UNARY_OP(asin) UNARY_OP(cos) UNARY_OP(acos) UNARY_OP(tan)
+    UNARY_OP(tanh) UNARY_OP(inv) UNARY_OP(rcp) UNARY_OP(rsqrt) UNARY_OP(exp)
+    UNARY_OP(log) UNARY_OP(bit_not) UNARY_OP(logic_not)
+    BINARY_OP(add) BINARY_OP(sub) BINARY_OP(mul) BINARY_OP(div)
+    BINARY_OP(truediv) BINARY_OP(floordiv) BINARY_OP(mod) BINARY_OP(max)
+    BINARY_OP(min) BINARY_OP(atan2) BINARY_OP(pow) BINARY_OP(bit_and)
+    BINARY_OP(bit_or) BINARY_OP(bit_xor) BINARY_OP(bit_shl) BINARY_OP(bit_shr)
+    BINARY_OP(bit_sar) BINARY_OP(cmp_lt) BINARY_OP(cmp_le) BINARY_OP(cmp_gt)
+    BINARY_OP(cmp_ge) BINARY_OP(cmp_eq) BINARY_OP(cmp_ne)
+    TERNARY_OP(select)
+    // clang-format on
+};
+
+#undef UNARY_OP
+#undef BINARY_OP
+#undef TERNARY_OP
+
+}  // namespace
+
+std::vector<std::string> get_expression_batch_op_names() {
+  std::vector<std::string> names;
+  for (auto &op : expression_batch_ops) {
+    names.push_back(op.name);
+  }
+  return names;
+}
+
+std::vector<Expr> build_expression_batch(const std::vector<int32> &code,
+                                         const std::vector<Expr> &leaves,
+                                         const std::vector<std::string> &tbs) {
+  constexpr int num_ops =
+      sizeof(expression_batch_ops) / sizeof(expression_batch_ops[0]);
+  std::vector<Expr> exprs;
+  exprs.reserve(tbs.size());
+  std::size_t i = 0;
+  while (i < code.size()) {
+    const int opcode = code[i++];
+    TI_ASSERT(0 <= opcode && opcode < num_ops);
+    const auto &op = expression_batch_ops[opcode];
+    TI_ASSERT(i + op.num_operands <= code.size());
+    Expr operands[3];
+    for (int j = 0; j < op.num_operands; j++) {
+      const int32 operand = code[i++];
+      if (operand < 0) {
+        TI_ASSERT(~operand < (int32)leaves.size());
+        operands[j] = leaves[~operand];
+      } else {
+        TI_ASSERT(operand < (int32)exprs.size());
+        operands[j] = exprs[operand];
+      }
+    }
+    if (op.num_operands == 1) {
+      exprs.push_back(Expr::make<UnaryOpExpression>(UnaryOpType(op.op_type),
+                                                    operands[0]));
+    } else if (op.num_operands == 2) {
+      exprs.push_back(Expr::make<BinaryOpExpression>(
+          BinaryOpType(op.op_type), operands[0], operands[1]));
+    } else {
+      exprs.push_back(Expr::make<TernaryOpExpression>(
+          TernaryOpType(op.op_type), operands[0], operands[1], operands[2]));
+    }
+    TI_ASSERT(exprs.size() <= tbs.size());
+    if (!tbs[exprs.size() - 1].empty()) {
+      exprs.back().set_tb(tbs[exprs.size() - 1]);
+    }
+  }
+  TI_ASSERT(exprs.size() == tbs.size());
+  return exprs;
+}
+
 TLANG_NAMESPACE_END
@@ -125,6 +125,7 @@ class FrontendForStmt : public Stmt {
   bool strictly_serialized;
   MemoryAccessOptions mem_access_opt;
   int block_dim;
+  int unroll;
 
   bool is_ranged() const {
     if (global_var.expr == nullptr) {
@@ -309,12 +310,21 @@ class ExternalFuncCallExpression : public Expression {
   std::string source;
   std::vector<Expr> args;
   std::vector<Expr> outputs;
+  std::string runtime_func;
+  std::string bitcode_file;
 
   ExternalFuncCallExpression(void *func,
                              std::string const &source,
                              const std::vector<Expr> &args,
-                             const std::vector<Expr> &outputs)
-      : func(func), source(source), args(args), outputs(outputs) {
+                             const std::vector<Expr> &outputs,
+                             const std::string &runtime_func = "",
+                             const std::string &bitcode_file = "")
+      : func(func),
+        source(source),
+        args(args),
+        outputs(outputs),
+        runtime_func(runtime_func),
+        bitcode_file(bitcode_file) {
   }
 
   std::string serialize() override {
@@ -330,7 +340,12 @@ class ExternalFuncCallExpression : public Expression {
       io += s.serialize();
     }
 
-    if (func) {
+    if (!bitcode_file.empty()) {
+      return fmt::format("call \"{}\" in \"{}\" ({})", runtime_func,
+                         bitcode_file, io);
+    } else if (!runtime_func.empty()) {
+      return fmt::format("call runtime \"{}\" ({})", runtime_func, io);
+    } else if (func) {
       return fmt::format("call {:x} ({})", (uint64)func, io);
     } else {
       return fmt::format("asm \"{}\" ({})", source, io);
@@ -367,6 +382,8 @@ class GlobalVariableExpression : public Expression {
   TypedConstant ambient_value;
   bool is_primal;
   Expr adjoint;
+  // The field of the derivatives along the seeds in forward-mode AutoDiff.
+  Expr dual;
 
   GlobalVariableExpression(DataType dt, const Identifier &ident)
       : ident(ident), dt(dt) {
@@ -569,4 +586,17 @@ class ExternalTensorShapeAlongAxisExpression : public Expression {
   void flatten(FlattenContext *ctx) override;
 };
 
+// The names of the expr_* functions whose expressions the Python frontend
+// builds in batches with build_expression_batch, by opcode.
+std::vector<std::string> get_expression_batch_op_names();
+
+// Builds a batch of unary, binary and ternary op expressions in one call, for
+// the Python frontend to skip a call per expression. |code| has a record per
+// expression: its opcode, then each operand, as the index of an earlier record
+// or as ~i for leaves[i]. |tbs| has the traceback of each record, or an empty
+// string. Returns the expression of each record.
+std::vector<Expr> build_expression_batch(const std::vector<int32> &code,
+                                         const std::vector<Expr> &leaves,
+                                         const std::vector<std::string> &tbs);
+
 TLANG_NAMESPACE_END
@@ -38,6 +38,7 @@ void DecoratorRecorder::reset() {
   mem_access_opt.clear();
   block_dim = 0;
   strictly_serialized = false;
+  unroll = -1;
 }
 
 Block *IRBuilder::current_block() {
@@ -155,6 +156,23 @@ bool StmtFieldMemoryAccessOptions::equal(const StmtField *other_generic) const {
   }
 }
 
+uint64 StmtFieldSNode::hash() const {
+  return (uint64)get_snode_id(snode);
+}
+
+uint64 StmtFieldMemoryAccessOptions::hash() const {
+  // Independent of the order of the entries.
+  uint64 ret = 0;
+  for (auto &[snode, flags] : opt_.get_all()) {
+    uint64 flag_bits = 0;
+    for (auto flag : flags) {
+      flag_bits |= uint64(1) << (int)flag;
+    }
+    ret += hash_combine(StmtFieldSNode::get_snode_id(snode), flag_bits);
+  }
+  return ret;
+}
+
 bool StmtFieldManager::equal(StmtFieldManager &other) const {
   if (fields.size() != other.fields.size()) {
     return false;
@@ -168,6 +186,125 @@ bool StmtFieldManager::equal(StmtFieldManager &other) const {
   return true;
 }
 
+uint64 StmtFieldManager::hash() const {
+  uint64 ret = fields.size();
+  for (auto &field : fields) {
+    ret = hash_combine(ret, field->hash());
+  }
+  return ret;
+}
+
+uint64 hash_string(const std::string &str) {
+  // FNV-1a
+  uint64 ret = 0xcbf29ce484222325ULL;
+  for (char c : str) {
+    ret = (ret ^ (uint8)c) * 0x100000001b3ULL;
+  }
+  return ret;
+}
+
+uint64 hash_data_type(DataType dt) {
+  if (auto primitive = dt->cast<PrimitiveType>()) {
+    return hash_combine(1, (uint64)primitive->type);
+  } else if (auto pointer = dt->cast<PointerType>()) {
+    return hash_combine(2, hash_data_type(pointer->get_pointee_type()));
+  } else {
+    return hash_combine(3, hash_string(dt->to_string()));
+  }
+}
+
+uint64 hash_constant(const TypedConstant &constant) {
+  auto dt = constant.dt.ptr_removed();
+  if (!dt->is<PrimitiveType>() || dt->is_primitive(PrimitiveTypeID::unknown)) {
+    return hash_data_type(dt);
+  }
+  // Only the bytes of the type hold the value.
+  uint64 bits = 0;
+  std::memcpy(&bits, &constant.value_bits, data_type_size(dt));
+  return hash_combine(hash_data_type(dt), bits);
+}
+
+namespace {
+
+// Carves statements out of 64 KB chunks, and recycles the freed ones through
+// a free list per size class (multiples of 16 bytes), so that allocating and
+// freeing a statement is a few instructions, and statements created together
+// are close in memory.
+//
+// Each thread has its own free lists, so that compilation threads do not
+// contend. A statement may be freed on another thread than it was allocated
+// on, in which case it goes to the free lists of the freeing thread. For the
+// same reason, chunks are never returned to the system.
+class StmtAllocator {
+ public:
+  static constexpr std::size_t kAlignment = 16;
+  // Larger statements are allocated from the global heap.
+  static constexpr std::size_t kMaxSize = 1024;
+  static constexpr std::size_t kChunkSize = 64 << 10;
+
+  static StmtAllocator &get_this_thread_allocator() {
+    thread_local StmtAllocator allocator;
+    return allocator;
+  }
+
+  void *allocate(std::size_t size) {
+    auto size_class = get_size_class(size);
+    if (auto node = free_lists_[size_class]) {
+      free_lists_[size_class] = node->next;
+      return node;
+    }
+    auto bytes = (size_class + 1) * kAlignment;
+    if ((std::size_t)(chunk_end_ - chunk_ptr_) < bytes) {
+      chunk_ptr_ = (uint8 *)std::malloc(kChunkSize);
+      TI_ERROR_IF(chunk_ptr_ == nullptr, "Failed to allocate IR statements");
+      chunk_end_ = chunk_ptr_ + kChunkSize;
+    }
+    auto ret = chunk_ptr_;
+    chunk_ptr_ += bytes;
+    return ret;
+  }
+
+  void deallocate(void *ptr, std::size_t size) {
+    auto size_class = get_size_class(size);
+    auto node = (FreeNode *)ptr;
+    node->next = free_lists_[size_class];
+    free_lists_[size_class] = node;
+  }
+
+ private:
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  static std::size_t get_size_class(std::size_t size) {
+    return (size + kAlignment - 1) / kAlignment - 1;
+  }
+
+  FreeNode *free_lists_[kMaxSize / kAlignment]{};
+  uint8 *chunk_ptr_{nullptr};
+  uint8 *chunk_end_{nullptr};
+};
+
+}  // namespace
+
+void *Stmt::operator new(std::size_t size) {
+  if (size > StmtAllocator::kMaxSize) {
+    return ::operator new(size);
+  }
+  return StmtAllocator::get_this_thread_allocator().allocate(size);
+}
+
+void Stmt::operator delete(void *ptr, std::size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+  if (size > StmtAllocator::kMaxSize) {
+    ::operator delete(ptr);
+    return;
+  }
+  StmtAllocator::get_this_thread_allocator().deallocate(ptr, size);
+}
+
 std::atomic<int> Stmt::instance_id_counter(0);
 
 Stmt::Stmt() : field_manager(this), fields_registered(false) {
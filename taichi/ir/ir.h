@@ -80,6 +80,7 @@ class DecoratorRecorder {
   MemoryAccessOptions mem_access_opt;
   int block_dim;
   bool uniform;
+  int unroll;
 
   DecoratorRecorder() {
     reset();
@@ -107,7 +108,8 @@ class FrontendContext {
   }
 };
 
-extern std::unique_ptr<FrontendContext> context;
+// Per host thread, as several threads may define kernels.
+extern thread_local std::unique_ptr<FrontendContext> context;
 
 class IRBuilder {
  private:
@@ -432,12 +434,57 @@ struct LaneAttribute {
   }
 };
 
+// Hashes of the IR that are the same in every run, so that they can also key
+// caches on disk.
+inline uint64 hash_combine(uint64 seed, uint64 value) {
+  // The finalizer of SplitMix64.
+  value += 0x9e3779b97f4a7c15ULL;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 12) + (seed >> 4));
+}
+
+uint64 hash_string(const std::string &str);
+
+uint64 hash_data_type(DataType dt);
+
+uint64 hash_constant(const TypedConstant &constant);
+
+template <typename T>
+uint64 hash_field_value(const T &value) {
+  if constexpr (std::is_same<T, std::string>::value) {
+    return hash_string(value);
+  } else if constexpr (std::is_same<T, DataType>::value) {
+    return hash_data_type(value);
+  } else if constexpr (std::is_same<T, TypedConstant>::value) {
+    return hash_constant(value);
+  } else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+    return (uint64)value;
+  } else if constexpr (std::is_pointer<T>::value) {
+    // E.g. the functions that ExternalFuncCallStmt calls.
+    return (uint64)(std::size_t)value;
+  } else if constexpr (std::is_floating_point<T>::value) {
+    float64 x = value;
+    uint64 bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+  } else {
+    static_assert(!std::is_same<T, T>::value,
+                  "Statement fields of this type cannot be hashed.");
+    return 0;
+  }
+}
+
 class StmtField {
  public:
   StmtField() = default;
 
   virtual bool equal(const StmtField *other) const = 0;
 
+  // Equal fields have the same hash.
+  virtual uint64 hash() const = 0;
+
   virtual ~StmtField() = default;
 };
 
@@ -472,6 +519,12 @@ class StmtFieldNumeric final : public StmtField {
       return false;
     }
   }
+
+  uint64 hash() const override {
+    const T &v = std::holds_alternative<T *>(value) ? *std::get<T *>(value)
+                                                    : std::get<T>(value);
+    return hash_field_value<std::remove_cv_t<T>>(v);
+  }
 };
 
 class StmtFieldSNode final : public StmtField {
@@ -485,6 +538,8 @@ class StmtFieldSNode final : public StmtField {
   static int get_snode_id(SNode *snode);
 
   bool equal(const StmtField *other_generic) const override;
+
+  uint64 hash() const override;
 };
 
 class StmtFieldMemoryAccessOptions final : public StmtField {
@@ -497,6 +552,8 @@ class StmtFieldMemoryAccessOptions final : public StmtField {
   }
 
   bool equal(const StmtField *other_generic) const override;
+
+  uint64 hash() const override;
 };
 
 class StmtFieldManager {
@@ -524,6 +581,8 @@ class StmtFieldManager {
   }
 
   bool equal(StmtFieldManager &other) const;
+
+  uint64 hash() const;
 };
 
 #define TI_STMT_DEF_FIELDS(...) TI_IO_DEF(__VA_ARGS__)
@@ -549,6 +608,11 @@ class Stmt : public IRNode {
   Stmt();
   Stmt(const Stmt &stmt);
 
+  // Statements are allocated from per-thread pools of size classes, since
+  // passes create and destroy many of them. See StmtAllocator in ir.cpp.
+  static void *operator new(std::size_t size);
+  static void operator delete(void *ptr, std::size_t size);
+
   int width() const {
     return ret_type->vector_width();
   }
@@ -771,6 +835,11 @@ inline void BlockDim(int v) {
   dec.block_dim = v;
 }
 
+inline void Unroll(int v) {
+  TI_ERROR_IF(v < 0, "Invalid number of iterations to unroll {}", v);
+  dec.unroll = v;
+}
+
 class VectorElement {
  public:
   Stmt *stmt;
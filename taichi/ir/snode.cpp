@@ -9,6 +9,8 @@ TLANG_NAMESPACE_BEGIN
 
 namespace {
 
+constexpr int kDefaultHashCapacity = 1 << 16;
+
 void set_kernel_args(const std::vector<int> &I,
                      int num_active_indices,
                      Kernel::LaunchContextBuilder *launch_ctx) {
@@ -17,6 +19,38 @@ void set_kernel_args(const std::vector<int> &I,
   }
 }
 
+void set_buffer_copy_args(SNode *snode,
+                          uint64 buffer,
+                          std::vector<int> strides,
+                          Kernel::LaunchContextBuilder *launch_ctx) {
+  const int n = snode->num_active_indices;
+  if (strides.empty()) {
+    strides.resize(n);
+    int stride = 1;
+    for (int i = n - 1; i >= 0; i--) {
+      strides[i] = stride;
+      stride *= snode->shape_along_axis(i);
+    }
+  }
+  TI_ERROR_IF((int)strides.size() != n,
+              "Expected {} strides for the buffer, got {}", n, strides.size());
+  int64 max_offset = 0;
+  for (int i = 0; i < n; i++) {
+    TI_ERROR_IF(strides[i] < 0, "Negative buffer strides are not supported");
+    max_offset += (int64)(snode->shape_along_axis(i) - 1) * strides[i];
+  }
+  TI_ERROR_IF(max_offset >= std::numeric_limits<int32>::max(),
+              "Buffer too large for a bulk copy");
+  const auto num_elements = max_offset + 1;
+  launch_ctx->set_arg_nparray(
+      0, buffer,
+      num_elements * data_type_size(snode->dt->get_compute_type()));
+  launch_ctx->set_extra_arg_int(0, 0, (int32)num_elements);
+  for (int i = 0; i < n; i++) {
+    launch_ctx->set_arg_int(i + 1, strides[i]);
+  }
+}
+
 }  // namespace
 
 std::atomic<int> SNode::counter{0};
@@ -90,9 +124,32 @@ SNode &SNode::create_node(std::vector<Index> indices,
   return new_node;
 }
 
-SNode &SNode::dynamic(const Index &expr, int n, int chunk_size) {
+SNode &SNode::dynamic(const Index &expr,
+                      int n,
+                      int chunk_size,
+                      bool chunk_directory) {
   auto &snode = create_node({expr}, {n}, SNodeType::dynamic);
   snode.chunk_size = chunk_size;
+  snode.chunk_directory = chunk_directory;
+  return snode;
+}
+
+SNode &SNode::hash(const std::vector<Index> &indices,
+                   const std::vector<int> &sizes,
+                   int capacity) {
+  auto &snode = create_node(indices, sizes, SNodeType::hash);
+  int num_bits = 0;
+  for (int i = 0; i < taichi_max_num_indices; i++) {
+    num_bits += snode.extractors[i].num_bits;
+  }
+  // The keys of the table are the indices plus one.
+  TI_ERROR_IF(num_bits > 30,
+              "The index space of a hash SNode is limited to 2^30 elements");
+  if (capacity <= 0) {
+    capacity = (int)std::min(snode.n, (int64)kDefaultHashCapacity);
+  }
+  // At least one word of the occupancy mask
+  snode.hash_capacity = std::max(32, (int)bit::least_pot_bound(capacity));
   return snode;
 }
 
@@ -112,20 +169,90 @@ SNode &SNode::bit_array(const std::vector<Index> &indices,
   return snode;
 }
 
-void SNode::lazy_grad() {
+void SNode::lazy_grad(bool sparse) {
   if (this->type == SNodeType::place)
     return;
-  for (auto &c : ch) {
-    c->lazy_grad();
+  // The sparse mirrors are added to the children of the root.
+  const int num_ch = (int)ch.size();
+  for (int i = 0; i < num_ch; i++) {
+    ch[i]->lazy_grad(sparse);
   }
   std::vector<Expr> new_grads;
-  for (auto &c : ch) {
+  std::vector<std::vector<int>> offsets;
+  for (int i = 0; i < num_ch; i++) {
+    auto &c = ch[i];
     if (c->type == SNodeType::place && c->is_primal() && needs_grad(c->dt) &&
         !c->has_grad()) {
       new_grads.push_back(c->expr.cast<GlobalVariableExpression>()->adjoint);
+      offsets.push_back(c->index_offsets);
     }
   }
-  for (auto p : new_grads) {
+  if (new_grads.empty())
+    return;
+  bool path_all_dense = type == SNodeType::dense;
+  for (auto s = parent; s && s->type != SNodeType::root; s = s->parent) {
+    path_all_dense = path_all_dense && s->type == SNodeType::dense;
+  }
+  // The shape of the field along each axis, as shape_along_axis() will
+  // compute it (0 for the axes not indexed), and the root.
+  int shape[taichi_max_num_indices];
+  int below[taichi_max_num_indices];
+  std::fill(shape, shape + taichi_max_num_indices, 0);
+  std::fill(below, below + taichi_max_num_indices, 1);
+  SNode *root = this;
+  for (; root->type != SNodeType::root; root = root->parent) {
+    for (int k = 0; k < taichi_max_num_indices; k++) {
+      if (root->extractors[k].active) {
+        shape[k] = root->extractors[k].num_elements * below[k];
+        below[k] <<= root->extractors[k].num_bits;
+      }
+    }
+  }
+  std::vector<Index> indices;
+  for (int k = 0; k < taichi_max_num_indices; k++) {
+    if (shape[k] > 0)
+      indices.push_back(Index(k));
+  }
+  // The 0-D fields and the fields under sparse SNodes keep their adjoints
+  // next to them.
+  if (!sparse || !path_all_dense || indices.empty()) {
+    for (auto p : new_grads) {
+      this->place(p, {});
+    }
+    return;
+  }
+  // About 512 cells per block. The block sizes divide the shape, so that the
+  // adjoints have the shape of the primals.
+  constexpr int kBlockBits = 9;
+  std::vector<int> num_blocks, block_size;
+  for (auto &index : indices) {
+    const int extent = shape[index.value];
+    int size = 1 << (kBlockBits / (int)indices.size());
+    while (extent % size != 0)
+      size /= 2;
+    block_size.push_back(size);
+    num_blocks.push_back(extent / size);
+  }
+  auto &block = root->pointer(indices, num_blocks).dense(indices, block_size);
+  for (int i = 0; i < (int)new_grads.size(); i++) {
+    block.place(new_grads[i], offsets[i]);
+  }
+}
+
+void SNode::lazy_dual() {
+  if (this->type == SNodeType::place)
+    return;
+  for (auto &c : ch) {
+    c->lazy_dual();
+  }
+  std::vector<Expr> new_duals;
+  for (auto &c : ch) {
+    if (c->type == SNodeType::place && c->is_primal() && needs_grad(c->dt) &&
+        !c->has_dual()) {
+      new_duals.push_back(c->expr.cast<GlobalVariableExpression>()->dual);
+    }
+  }
+  for (auto p : new_duals) {
     this->place(p, {});
   }
 }
@@ -156,6 +283,19 @@ SNode *SNode::get_grad() const {
       ->snode;
 }
 
+bool SNode::has_dual() const {
+  auto dual = expr.cast<GlobalVariableExpression>()->dual;
+  return is_primal() && dual.expr != nullptr &&
+         dual.cast<GlobalVariableExpression>()->snode != nullptr;
+}
+
+SNode *SNode::get_dual() const {
+  TI_ASSERT(has_dual());
+  return expr.cast<GlobalVariableExpression>()
+      ->dual.cast<GlobalVariableExpression>()
+      ->snode;
+}
+
 SNode *SNode::get_least_sparse_ancestor() const {
   if (is_path_all_dense) {
     return nullptr;
@@ -225,6 +365,27 @@ uint64 SNode::read_uint(const std::vector<int> &I) {
   return (uint64)read_int(I);
 }
 
+void SNode::to_buffer(uint64 buffer, const std::vector<int> &strides) {
+  if (to_buffer_kernel == nullptr) {
+    to_buffer_kernel = &get_current_program().get_snode_to_buffer_kernel(this);
+  }
+  auto launch_ctx = to_buffer_kernel->make_launch_context();
+  set_buffer_copy_args(this, buffer, strides, &launch_ctx);
+  (*to_buffer_kernel)(launch_ctx);
+  get_current_program().synchronize();
+}
+
+void SNode::from_buffer(uint64 buffer, const std::vector<int> &strides) {
+  if (from_buffer_kernel == nullptr) {
+    from_buffer_kernel =
+        &get_current_program().get_snode_from_buffer_kernel(this);
+  }
+  auto launch_ctx = from_buffer_kernel->make_launch_context();
+  set_buffer_copy_args(this, buffer, strides, &launch_ctx);
+  (*from_buffer_kernel)(launch_ctx);
+  get_current_program().synchronize();
+}
+
 int SNode::shape_along_axis(int i) const {
   const auto &extractor = extractors[physical_index_position[i]];
   return extractor.num_elements * (1 << extractor.trailing_bits);
@@ -247,6 +408,10 @@ SNode::SNode(int depth, SNodeType t) : depth(depth), type(t) {
 
   reader_kernel = nullptr;
   writer_kernel = nullptr;
+  to_buffer_kernel = nullptr;
+  from_buffer_kernel = nullptr;
+  gather_kernel = nullptr;
+  scatter_kernel = nullptr;
 }
 
 SNode::SNode(const SNode &) {
@@ -278,6 +443,21 @@ int SNode::get_num_bits(int physical_index) const {
   return result;
 }
 
+int SNode::get_child_index_bit(int physical_index, int bit) const {
+  TI_ASSERT(0 <= bit && bit < extractors[physical_index].num_bits);
+  if (!_morton)
+    return extractors[physical_index].acc_offset + bit;
+  // Bit |b| of all the indices comes before bit |b| + 1 of any. Within a bit,
+  // the later physical indices take the lower positions, as in row-major.
+  int result = 0;
+  for (int i = 0; i < taichi_max_num_indices; i++) {
+    result += std::min(bit, extractors[i].num_bits);
+    if (i > physical_index && bit < extractors[i].num_bits)
+      result++;
+  }
+  return result;
+}
+
 void SNode::print() {
   for (int i = 0; i < depth; i++) {
     fmt::print("  ");
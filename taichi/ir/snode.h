@@ -76,6 +76,11 @@ class SNode {
   int64 n{};
   int total_num_bits{}, total_bit_start{};
   int chunk_size{};
+  // For dynamic SNodes: index the chunks via a directory instead of a linked
+  // list, which makes accessing and appending elements O(1).
+  bool chunk_directory{false};
+  // For hash SNodes: the number of slots of the table, a power of two.
+  int hash_capacity{0};
   PrimitiveType *physical_type;  // for bit_struct and bit_array only
   DataType dt;
   bool has_ambient{};
@@ -84,6 +89,11 @@ class SNode {
   SNode *parent{};
   Kernel *reader_kernel{};
   Kernel *writer_kernel{};
+  Kernel *to_buffer_kernel{};
+  Kernel *from_buffer_kernel{};
+  // See Program::get_snode_gather_kernel().
+  Kernel *gather_kernel{};
+  Kernel *scatter_kernel{};
   Expr expr;
 
   // is_bit_level=false: the SNode is not bitpacked
@@ -94,6 +104,31 @@ class SNode {
   // Whether the path from root to |this| contains only `dense` SNodes.
   bool is_path_all_dense{false};
 
+  // For roots: the index of the SNode tree in the LLVMRuntime, 0 for
+  // Program::snode_root, see Program::create_snode_tree().
+  int snode_tree_id{0};
+
+  // GC policy of sparse SNodes that own a node allocator (pointer, dynamic).
+  // A requested GC only runs once the recycled nodes amount to at least
+  // |gc_threshold| of the allocated ones, or after |gc_period| skipped
+  // requests. |gc_threshold| <= 0 runs every GC.
+  float32 gc_threshold{0};
+  int gc_period{0};
+
+  // NUMA placement of the part of the root buffer holding this child of the
+  // root, on CPU: "interleave" over the nodes, "partition" into one
+  // contiguous part per node, or empty for the default (first touch).
+  std::string numa_policy;
+
+  // On CPU, the file mapped in place of the part of the root buffer holding
+  // this child of the root, whose pages then load from it on demand. Empty
+  // for anonymous memory. Writes go to the file if |mmap_writable|, and stay
+  // in memory otherwise. |mmap_advice| is the madvise() hint of the mapping:
+  // "normal", "sequential", "random" or "willneed".
+  std::string mmap_path;
+  bool mmap_writable{false};
+  std::string mmap_advice{"normal"};
+
   SNode();
 
   SNode(int depth, SNodeType t);
@@ -104,7 +139,21 @@ class SNode {
 
   std::string node_type_name;
   SNodeType type;
+  // Whether the children of a dense SNode are laid out along a Z-order
+  // (Morton) curve, i.e. with the bits of their indices interleaved, instead
+  // of row by row. Only honored on CPU and CUDA.
   bool _morton{};
+  // For dense SNodes on the LLVM backends: the cells start at multiples of
+  // |cell_alignment| bytes, a power of two, with padding after the children
+  // of each cell if needed. E.g. 16 pads the cells of 3 f32 to 16 bytes,
+  // and 64 aligns them to the cache lines. 0 keeps the natural alignment.
+  int cell_alignment{0};
+  // For place SNodes, set by the LLVM struct compiler: a power of two that
+  // the addresses of all the cells are multiples of, or 0 if unknown, e.g.
+  // under a pointer SNode. The loads and stores of the field are emitted
+  // with this alignment, which lets LLVM combine the accesses to adjacent
+  // fields into vector ones.
+  int address_alignment{0};
 
   std::string get_node_type_name() const;
 
@@ -112,6 +161,10 @@ class SNode {
 
   int get_num_bits(int physical_index) const;
 
+  // The bit of the linear index of the children holding bit |bit| of
+  // physical index |physical_index|, whose extractor must have more bits.
+  int get_child_index_bit(int physical_index, int bit) const;
+
   SNode &insert_children(SNodeType t);
 
   SNode &create_node(std::vector<Index> indices,
@@ -158,17 +211,18 @@ class SNode {
     return SNode::bitmasked(std::vector<Index>{index}, size);
   }
 
+  // A hash SNode can hold up to |capacity| active children, however large its
+  // index space is. |capacity| <= 0 picks a default.
   SNode &hash(const std::vector<Index> &indices,
-              const std::vector<int> &sizes) {
-    return create_node(indices, sizes, SNodeType::hash);
-  }
+              const std::vector<int> &sizes,
+              int capacity = 0);
 
-  SNode &hash(const std::vector<Index> &indices, int sizes) {
-    return create_node(indices, std::vector<int>{sizes}, SNodeType::hash);
+  SNode &hash(const std::vector<Index> &indices, int sizes, int capacity = 0) {
+    return hash(indices, std::vector<int>{sizes}, capacity);
   }
 
-  SNode &hash(const Index &index, int size) {
-    return hash(std::vector<Index>{index}, size);
+  SNode &hash(const Index &index, int size, int capacity = 0) {
+    return hash(std::vector<Index>{index}, size, capacity);
   }
 
   std::string type_name() {
@@ -187,7 +241,10 @@ class SNode {
 
   void place(Expr &expr, const std::vector<int> &offset);
 
-  SNode &dynamic(const Index &expr, int n, int chunk_size);
+  SNode &dynamic(const Index &expr,
+                 int n,
+                 int chunk_size,
+                 bool chunk_directory = false);
 
   SNode &morton(bool val = true) {
     _morton = val;
@@ -203,6 +260,12 @@ class SNode {
   int64 read_int(const std::vector<int> &I);
   uint64 read_uint(const std::vector<int> &I);
 
+  // Bulk copies between the whole field and the host buffer at |buffer|, whose
+  // element type is the compute type of |dt|. |strides| are in elements; an
+  // empty vector means a contiguous row-major buffer of the field's shape.
+  void to_buffer(uint64 buffer, const std::vector<int> &strides);
+  void from_buffer(uint64 buffer, const std::vector<int> &strides);
+
   int child_id(SNode *c) {
     for (int i = 0; i < (int)ch.size(); i++) {
       if (ch[i].get() == c) {
@@ -223,7 +286,13 @@ class SNode {
 
   bool need_activation() const;
 
-  void lazy_grad();
+  // Places the adjoints of the fields placed under this SNode that need
+  // gradients. With |sparse|, the adjoints of the fields of dense SNodes with
+  // only dense ancestors go into a pointer-dense mirror of their index space
+  // instead, whose blocks are allocated by the first accumulation into them.
+  void lazy_grad(bool sparse = false);
+
+  void lazy_dual();
 
   bool is_primal() const;
 
@@ -239,6 +308,10 @@ class SNode {
 
   SNode *get_grad() const;
 
+  bool has_dual() const;
+
+  SNode *get_dual() const;
+
   SNode *get_least_sparse_ancestor() const;
 
   std::string get_name() const {
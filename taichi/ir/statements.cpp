@@ -218,6 +218,7 @@ std::unique_ptr<Stmt> RangeForStmt::clone() const {
       begin, end, body->clone(), vectorize, parallelize, block_dim,
       strictly_serialized);
   new_stmt->reversed = reversed;
+  new_stmt->unroll = unroll;
   return new_stmt;
 }
 
@@ -320,6 +321,7 @@ std::string OffloadedStmt::task_type_name(TaskType tt) {
 
 std::unique_ptr<Stmt> OffloadedStmt::clone() const {
   auto new_stmt = std::make_unique<OffloadedStmt>(task_type, snode);
+  new_stmt->list_snode = list_snode;
   new_stmt->begin_offset = begin_offset;
   new_stmt->end_offset = end_offset;
   new_stmt->const_begin = const_begin;
@@ -292,19 +292,34 @@ class ExternalFuncCallStmt : public Stmt {
   std::string source;
   std::vector<Stmt *> arg_stmts;
   std::vector<Stmt *> output_stmts;
+  // If not empty, the function of the LLVM runtime to call instead, with the
+  // arguments followed by pointers to the outputs.
+  std::string runtime_func;
+  // If not empty, the LLVM bitcode, LLVM IR or C/C++ source file defining
+  // |runtime_func|, which is linked into the kernel on CPU and CUDA, see
+  // TaichiLLVMContext::link_external_bitcode().
+  std::string bitcode_file;
 
   ExternalFuncCallStmt(void *func,
                        std::string const &source,
                        const std::vector<Stmt *> &arg_stmts,
-                       const std::vector<Stmt *> &output_stmts)
+                       const std::vector<Stmt *> &output_stmts,
+                       const std::string &runtime_func = "",
+                       const std::string &bitcode_file = "")
       : func(func),
         source(source),
         arg_stmts(arg_stmts),
-        output_stmts(output_stmts) {
+        output_stmts(output_stmts),
+        runtime_func(runtime_func),
+        bitcode_file(bitcode_file) {
     TI_STMT_REG_FIELDS;
   }
 
-  TI_STMT_DEF_FIELDS(func, arg_stmts, output_stmts);
+  TI_STMT_DEF_FIELDS(func,
+                     arg_stmts,
+                     output_stmts,
+                     runtime_func,
+                     bitcode_file);
   TI_DEFINE_ACCEPT_AND_CLONE
 };
 
@@ -535,6 +550,9 @@ class RangeForStmt : public Stmt {
   int parallelize;
   int block_dim;
   bool strictly_serialized;
+  // The most iterations to unroll the loop for, from ti.unroll(), or -1 to
+  // follow CompileConfig::unroll_max_statements.
+  int unroll{-1};
 
   RangeForStmt(Stmt *begin,
                Stmt *end,
@@ -560,7 +578,8 @@ class RangeForStmt : public Stmt {
                      vectorize,
                      parallelize,
                      block_dim,
-                     strictly_serialized);
+                     strictly_serialized,
+                     unroll);
   TI_DEFINE_ACCEPT
 };
 
@@ -747,7 +766,11 @@ class BitExtractStmt : public Stmt {
 
 class GetRootStmt : public Stmt {
  public:
-  GetRootStmt() {
+  // The root of the SNode tree, see Program::create_snode_tree(). nullptr
+  // means Program::snode_root.
+  SNode *root;
+
+  explicit GetRootStmt(SNode *root = nullptr) : root(root) {
     TI_STMT_REG_FIELDS;
   }
 
@@ -755,7 +778,7 @@ class GetRootStmt : public Stmt {
     return false;
   }
 
-  TI_STMT_DEF_FIELDS(ret_type);
+  TI_STMT_DEF_FIELDS(ret_type, root);
   TI_DEFINE_ACCEPT_AND_CLONE
 };
 
@@ -811,6 +834,10 @@ class OffloadedStmt : public Stmt {
 
   TaskType task_type;
   SNode *snode;
+  // For struct-fors: the SNode whose element list is iterated. This is
+  // |snode|, or with CompileConfig::skip_dense_listgen, a dense ancestor such
+  // that the nodes between them are dense.
+  SNode *list_snode{nullptr};
   std::size_t begin_offset;
   std::size_t end_offset;
   bool const_begin, const_end;
@@ -856,6 +883,7 @@ class OffloadedStmt : public Stmt {
   TI_STMT_DEF_FIELDS(ret_type,
                      task_type,
                      snode,
+                     list_snode,
                      begin_offset,
                      end_offset,
                      const_begin,
@@ -1027,7 +1055,8 @@ class InternalFuncStmt : public Stmt {
 class StackAllocaStmt : public Stmt {
  public:
   DataType dt;
-  std::size_t max_size;  // TODO: 0 = adaptive
+  // 0 = adaptive, see irpass::determine_ad_stack_size()
+  std::size_t max_size;
 
   StackAllocaStmt(DataType dt, std::size_t max_size)
       : dt(dt), max_size(max_size) {
@@ -31,12 +31,15 @@ bool alg_simp(IRNode *root);
 bool demote_operations(IRNode *root);
 bool binary_op_simplify(IRNode *root);
 bool whole_kernel_cse(IRNode *root);
+bool global_value_numbering(IRNode *root);
+bool loop_invariant_code_motion(IRNode *root, const CompileConfig &config);
+bool strength_reduce_access(IRNode *root);
 void variable_optimization(IRNode *root, bool after_lower_access);
-void extract_constant(IRNode *root);
+bool extract_constant(IRNode *root);
 bool unreachable_code_elimination(IRNode *root);
-void full_simplify(IRNode *root,
-                   bool after_lower_access,
-                   Kernel *kernel = nullptr);
+int full_simplify(IRNode *root,
+                  bool after_lower_access,
+                  Kernel *kernel = nullptr);
 void print(IRNode *root, std::string *output = nullptr);
 void lower_ast(IRNode *root);
 void type_check(IRNode *root);
@@ -51,16 +54,43 @@ void make_block_local(IRNode *root);
 bool remove_loop_unique(IRNode *root);
 bool remove_range_assumption(IRNode *root);
 bool lower_access(IRNode *root, bool lower_atomic);
-void auto_diff(IRNode *root, bool use_stack = false);
+void auto_diff(IRNode *root,
+               bool use_stack = false,
+               bool keep_primal = false);
+void forward_diff(IRNode *root);
+void determine_ad_stack_size(IRNode *root, const CompileConfig &config);
 bool constant_fold(IRNode *root);
 void offload(IRNode *root);
+// Fuses each run of adjacent range-for tasks with constant bounds that access
+// disjoint global memory into a single range-for of at most
+// |config.horizontal_fusion_max_iterations| iterations, whose body branches on
+// the loop index. Also moves the small serial tasks into the first iteration
+// of such a range-for next to them.
+bool horizontal_fusion(IRNode *root, const CompileConfig &config);
 void replace_statements_with(IRNode *root,
                              std::function<bool(Stmt *)> filter,
                              std::function<std::unique_ptr<Stmt>()> generator);
-void demote_dense_struct_fors(IRNode *root);
+// On GPUs, may also reorder the loop indices so that consecutive threads
+// access consecutive cells of the fields the body accesses most.
+void demote_dense_struct_fors(IRNode *root, const CompileConfig &config);
+bool tile_dense_loops(IRNode *root, const std::vector<int> &tile_shape);
+// Replaces the serial range-for loops with constant bounds by a copy of their
+// body per iteration, if they run at most the iterations of their ti.unroll()
+// hint, or else if the copies take at most
+// |config.unroll_max_statements| statements.
+bool unroll_loops(IRNode *root, const CompileConfig &config);
 bool demote_atomics(IRNode *root);
+// Demotes the activations in the struct-for |offload| at the indices that
+// only depend on the loop indices and constants, which are all active when
+// the task runs again on the same list. With |unconditional_only|, only the
+// ones that every iteration runs, so that the previous run surely activated
+// them.
+bool demote_struct_for_activations(OffloadedStmt *offload,
+                                   bool unconditional_only);
 void reverse_segments(IRNode *root);  // for autograd
 void detect_read_only(IRNode *root);
+bool specialize_args(IRNode *root,
+                     const std::unordered_map<int, TypedConstant> &values);
 
 // compile_to_offloads does the basic compilation to create all the offloaded
 // tasks of a Taichi kernel. It's worth pointing out that this doesn't demote
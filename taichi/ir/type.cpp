@@ -30,13 +30,8 @@ DataType PrimitiveType::get(PrimitiveTypeID t) {
 }
 
 std::size_t DataType::hash() const {
-  if (auto primitive = ptr_->cast<PrimitiveType>()) {
-    return (std::size_t)primitive->type;
-  } else if (auto pointer = ptr_->cast<PointerType>()) {
-    return 10007 + DataType(pointer->get_pointee_type()).hash();
-  } else {
-    TI_NOT_IMPLEMENTED
-  }
+  // The types are interned by TypeFactory.
+  return std::hash<Type *>()(ptr_);
 }
 
 bool DataType::is_pointer() const {
@@ -66,6 +61,13 @@ std::string PrimitiveType::to_string() const {
   return data_type_name(DataType(const_cast<PrimitiveType *>(this)));
 }
 
+Type *PrimitiveType::get_compute_type() {
+  if (type == PrimitiveTypeID::f16) {
+    return PrimitiveType::f32.get_ptr();
+  }
+  return this;
+}
+
 std::string PointerType::to_string() const {
   if (is_bit_pointer_) {
     // "^" for bit-level pointers
@@ -89,11 +91,8 @@ int Type::vector_width() const {
 }
 
 bool Type::is_primitive(PrimitiveTypeID type) const {
-  if (auto p = cast<PrimitiveType>()) {
-    return p->type == type;
-  } else {
-    return false;
-  }
+  // The primitive types are interned, no need for a dynamic_cast.
+  return this == TypeFactory::get_instance().get_primitive_type(type);
 }
 
 std::string CustomIntType::to_string() const {
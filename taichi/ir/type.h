@@ -117,9 +117,9 @@ class PrimitiveType : public Type {
 
   std::string to_string() const override;
 
-  virtual Type *get_compute_type() override {
-    return this;
-  }
+  // f16 is only a storage type: its values are loaded into, and computed in
+  // f32.
+  virtual Type *get_compute_type() override;
 
   static DataType get(PrimitiveTypeID type);
 };
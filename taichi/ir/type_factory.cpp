@@ -2,78 +2,111 @@
 
 TLANG_NAMESPACE_BEGIN
 
-TypeFactory &TypeFactory::get_instance() {
-  static TypeFactory *type_factory = new TypeFactory;
-  return *type_factory;
+namespace {
+
+template <typename T>
+void hash_into(std::size_t &seed, const T &value) {
+  seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
 }
 
-TypeFactory::TypeFactory() {
+template <typename T>
+void hash_into(std::size_t &seed, const std::vector<T> &values) {
+  for (auto &value : values) {
+    hash_into(seed, value);
+  }
+  hash_into(seed, values.size());
 }
 
-Type *TypeFactory::get_primitive_type(PrimitiveTypeID id) {
-  std::lock_guard<std::mutex> _(mut_);
+}  // namespace
+
+template <typename Key>
+std::size_t TypeFactory::KeyHasher::operator()(const Key &key) const {
+  std::size_t seed = 0;
+  std::apply([&](const auto &... values) { (hash_into(seed, values), ...); },
+             key);
+  return seed;
+}
 
-  if (primitive_types_.find(id) == primitive_types_.end()) {
-    primitive_types_[id] = std::make_unique<PrimitiveType>(id);
+template <typename Key, typename Create>
+Type *TypeFactory::intern(TypeMap<Key> &types,
+                          const Key &key,
+                          const Create &create) {
+  // The types are never freed, so the cached pointers stay valid.
+  thread_local std::unordered_map<Key, Type *, KeyHasher> cache;
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
   }
+  std::lock_guard<std::mutex> _(mut_);
+  auto &type = types[key];
+  if (!type) {
+    type = create();
+  }
+  cache.emplace(key, type.get());
+  return type.get();
+}
 
-  return primitive_types_[id].get();
+TypeFactory &TypeFactory::get_instance() {
+  static TypeFactory *type_factory = new TypeFactory;
+  return *type_factory;
 }
 
-Type *TypeFactory::get_vector_type(int num_elements, Type *element) {
-  auto key = std::make_pair(num_elements, element);
-  if (vector_types_.find(key) == vector_types_.end()) {
-    vector_types_[key] = std::make_unique<VectorType>(num_elements, element);
+TypeFactory::TypeFactory() {
+  for (int i = 0; i < (int)primitive_types_.size(); i++) {
+    primitive_types_[i] = std::make_unique<PrimitiveType>((PrimitiveTypeID)i);
   }
-  return vector_types_[key].get();
+}
+
+Type *TypeFactory::get_vector_type(int num_elements, Type *element) {
+  return intern(vector_types_, std::make_pair(num_elements, element), [&]() {
+    return std::make_unique<VectorType>(num_elements, element);
+  });
 }
 
 Type *TypeFactory::get_pointer_type(Type *element, bool is_bit_pointer) {
-  auto key = std::make_pair(element, is_bit_pointer);
-  if (pointer_types_.find(key) == pointer_types_.end()) {
-    pointer_types_[key] =
-        std::make_unique<PointerType>(element, is_bit_pointer);
-  }
-  return pointer_types_[key].get();
+  return intern(pointer_types_, std::make_pair(element, is_bit_pointer), [&]() {
+    return std::make_unique<PointerType>(element, is_bit_pointer);
+  });
 }
 
 Type *TypeFactory::get_custom_int_type(int num_bits,
                                        bool is_signed,
                                        int compute_type_bits) {
   auto key = std::make_tuple(compute_type_bits, num_bits, is_signed);
-  if (custom_int_types.find(key) == custom_int_types.end()) {
-    custom_int_types[key] = std::make_unique<CustomIntType>(
+  return intern(custom_int_types_, key, [&]() {
+    return std::make_unique<CustomIntType>(
         num_bits, is_signed,
         get_primitive_int_type(compute_type_bits, is_signed));
-  }
-  return custom_int_types[key].get();
+  });
 }
 
 Type *TypeFactory::get_custom_float_type(Type *digits_type,
                                          Type *compute_type,
                                          float64 scale) {
   auto key = std::make_tuple(digits_type, compute_type, scale);
-  if (custom_float_types.find(key) == custom_float_types.end()) {
-    custom_float_types[key] =
-        std::make_unique<CustomFloatType>(digits_type, compute_type, scale);
-  }
-  return custom_float_types[key].get();
+  return intern(custom_float_types_, key, [&]() {
+    return std::make_unique<CustomFloatType>(digits_type, compute_type, scale);
+  });
 }
 
 Type *TypeFactory::get_bit_struct_type(PrimitiveType *physical_type,
                                        std::vector<Type *> member_types,
                                        std::vector<int> member_bit_offsets) {
-  bit_struct_types_.push_back(std::make_unique<BitStructType>(
-      physical_type, member_types, member_bit_offsets));
-  return bit_struct_types_.back().get();
+  auto key = std::make_tuple(physical_type, member_types, member_bit_offsets);
+  return intern(bit_struct_types_, key, [&]() {
+    return std::make_unique<BitStructType>(physical_type, member_types,
+                                           member_bit_offsets);
+  });
 }
 
 Type *TypeFactory::get_bit_array_type(PrimitiveType *physical_type,
                                       Type *element_type,
                                       int num_elements) {
-  bit_array_types_.push_back(std::make_unique<BitArrayType>(
-      physical_type, element_type, num_elements));
-  return bit_array_types_.back().get();
+  auto key = std::make_tuple(physical_type, element_type, num_elements);
+  return intern(bit_array_types_, key, [&]() {
+    return std::make_unique<BitArrayType>(physical_type, element_type,
+                                          num_elements);
+  });
 }
 
 PrimitiveType *TypeFactory::get_primitive_int_type(int bits, bool is_signed) {
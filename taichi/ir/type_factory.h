@@ -2,10 +2,16 @@
 
 #include "taichi/lang_util.h"
 
+#include <array>
 #include <mutex>
+#include <tuple>
+#include <unordered_map>
 
 TLANG_NAMESPACE_BEGIN
 
+// Every type is created once and lives as long as the process, so that two
+// types are equal if and only if they are the same object, and DataType
+// compares and hashes them as pointers.
 class TypeFactory {
  public:
   static TypeFactory &get_instance();
@@ -13,7 +19,11 @@ class TypeFactory {
   // TODO(type): maybe it makes sense to let each get_X function return X*
   // instead of generic Type*
 
-  Type *get_primitive_type(PrimitiveTypeID id);
+  // The primitive types are all created with the factory, and looked up
+  // without locking.
+  Type *get_primitive_type(PrimitiveTypeID id) {
+    return primitive_types_[(int)id].get();
+  }
 
   PrimitiveType *get_primitive_int_type(int bits, bool is_signed = true);
 
@@ -44,26 +54,39 @@ class TypeFactory {
  private:
   TypeFactory();
 
-  std::unordered_map<PrimitiveTypeID, std::unique_ptr<Type>> primitive_types_;
+  // Hashes the keys of the compound types: tuples of integers, floats,
+  // pointers and vectors of them.
+  struct KeyHasher {
+    template <typename Key>
+    std::size_t operator()(const Key &key) const;
+  };
 
-  // TODO: use unordered map
-  std::map<std::pair<int, Type *>, std::unique_ptr<Type>> vector_types_;
+  template <typename Key>
+  using TypeMap = std::unordered_map<Key, std::unique_ptr<Type>, KeyHasher>;
+
+  // Returns the type of |key| in |types|, made by |create| the first time.
+  // Each thread also caches the types it has looked up, to find them again
+  // without locking |mut_|. The cache is per key type, so each map has its
+  // own key type.
+  template <typename Key, typename Create>
+  Type *intern(TypeMap<Key> &types, const Key &key, const Create &create);
+
+  std::array<std::unique_ptr<Type>, (int)PrimitiveTypeID::unknown + 1>
+      primitive_types_;
+
+  TypeMap<std::pair<int, Type *>> vector_types_;
 
   // TODO: is_bit_ptr?
-  std::map<std::pair<Type *, bool>, std::unique_ptr<Type>> pointer_types_;
+  TypeMap<std::pair<Type *, bool>> pointer_types_;
 
-  // TODO: use unordered map
-  std::map<std::tuple<int, int, bool>, std::unique_ptr<Type>> custom_int_types;
+  TypeMap<std::tuple<int, int, bool>> custom_int_types_;
 
-  // TODO: use unordered map
-  std::map<std::tuple<Type *, Type *, float64>, std::unique_ptr<Type>>
-      custom_float_types;
+  TypeMap<std::tuple<Type *, Type *, float64>> custom_float_types_;
 
-  // TODO: avoid duplication
-  std::vector<std::unique_ptr<Type>> bit_struct_types_;
+  TypeMap<std::tuple<PrimitiveType *, std::vector<Type *>, std::vector<int>>>
+      bit_struct_types_;
 
-  // TODO: avoid duplication
-  std::vector<std::unique_ptr<Type>> bit_array_types_;
+  TypeMap<std::tuple<PrimitiveType *, Type *, int>> bit_array_types_;
 
   std::mutex mut_;
 };
@@ -83,6 +83,16 @@ class JITModule {
     TI_NOT_IMPLEMENTED
   }
 
+  // Same as launch(), but all the blocks of the grid run concurrently, so that
+  // they can synchronize with each other.
+  virtual void launch_cooperative(const std::string &name,
+                                  std::size_t grid_dim,
+                                  std::size_t block_dim,
+                                  std::size_t shared_mem_bytes,
+                                  const std::vector<void *> &arg_pointers) {
+    TI_NOT_IMPLEMENTED
+  }
+
   // directly call the function (e.g. on CPU), or via another runtime system
   // (e.g. cudaLaunch)?
   virtual bool direct_dispatch() const = 0;
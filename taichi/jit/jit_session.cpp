@@ -1,6 +1,10 @@
 #include "taichi/jit/jit_session.h"
 
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetOptions.h"
+#include "taichi/program/program.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -26,4 +30,22 @@ std::size_t JITSession::get_type_size(llvm::Type *type) {
 
 llvm::DataLayout JITSession::get_data_layout(){TI_NOT_IMPLEMENTED}
 
+void JITSession::set_float_options(llvm::Module *M,
+                                   llvm::TargetOptions &options) {
+  auto get_flag = [&](const char *name, bool default_value) {
+    auto *flag = llvm::mdconst::extract_or_null<llvm::ConstantInt>(
+        M->getModuleFlag(name));
+    return flag ? flag->getZExtValue() != 0 : default_value;
+  };
+  const bool fast_math =
+      get_flag("taichi.fast_math", get_current_program().config.fast_math);
+  const bool fp_contract = get_flag("taichi.fp_contract", false);
+  options.AllowFPOpFusion = (fast_math || fp_contract)
+                                ? llvm::FPOpFusion::Fast
+                                : llvm::FPOpFusion::Strict;
+  options.UnsafeFPMath = fast_math;
+  options.NoInfsFPMath = fast_math;
+  options.NoNaNsFPMath = fast_math;
+}
+
 TLANG_NAMESPACE_END
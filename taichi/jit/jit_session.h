@@ -21,6 +21,26 @@ class JITSession {
 
   virtual JITModule *add_module(std::unique_ptr<llvm::Module> M) = 0;
 
+  // Like add_module(), but optimizes |M| at |opt_level| (1 to 3) instead of
+  // the default level of the backend, where supported.
+  virtual JITModule *add_module_at_opt_level(std::unique_ptr<llvm::Module> M,
+                                             int opt_level) {
+    return add_module(std::move(M));
+  }
+
+  // Runs the backend optimization pipeline on |M| and returns the result in a
+  // form that can be stored on disk: LLVM bitcode on CPU, PTX on CUDA.
+  virtual std::string compile_module_to_binary(
+      std::unique_ptr<llvm::Module> M) {
+    TI_NOT_IMPLEMENTED
+  }
+
+  // Loads a binary produced by compile_module_to_binary(), skipping codegen
+  // and optimization entirely.
+  virtual JITModule *add_module_from_binary(const std::string &binary) {
+    TI_NOT_IMPLEMENTED
+  }
+
   // virtual void remove_module(JITModule *module) = 0;
 
   virtual void *lookup(const std::string Name) {
@@ -33,6 +53,10 @@ class JITSession {
 
   static std::unique_ptr<JITSession> create(Arch arch);
 
+  // Sets the floating-point options of |options| per the kernel |M| was
+  // generated for, see CodeGenLLVM::set_float_options().
+  static void set_float_options(llvm::Module *M, llvm::TargetOptions &options);
+
   virtual ~JITSession() = default;
 };
 
@@ -80,7 +80,8 @@ std::string data_type_format(DataType dt) {
 #else
     return "%I64d";
 #endif
-  } else if (dt->is_primitive(PrimitiveTypeID::f32)) {
+  } else if (dt->is_primitive(PrimitiveTypeID::f16) ||
+             dt->is_primitive(PrimitiveTypeID::f32)) {
     return "%f";
   } else if (dt->is_primitive(PrimitiveTypeID::f64)) {
     return "%.12f";
@@ -160,7 +161,8 @@ std::string snode_type_name(SNodeType t) {
 }
 
 bool is_gc_able(SNodeType t) {
-  return (t == SNodeType::pointer || t == SNodeType::dynamic);
+  return (t == SNodeType::pointer || t == SNodeType::hash ||
+          t == SNodeType::dynamic);
 }
 
 std::string unary_op_type_name(UnaryOpType type) {
@@ -317,6 +319,21 @@ bool command_exist(const std::string &command) {
 #endif
 }
 
+std::string escape_json_string(const std::string &str) {
+  std::string ret;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+      ret += c;
+    } else if ((unsigned char)c < 0x20) {
+      ret += fmt::format("\\u{:04x}", (int)c);
+    } else {
+      ret += c;
+    }
+  }
+  return ret;
+}
+
 namespace {
 class TypePromotionMapping {
  public:
@@ -373,7 +390,8 @@ class TypePromotionMapping {
     auto primitive = d->cast<PrimitiveType>();
     TI_ASSERT_INFO(primitive, "Failed to get primitive type from {}",
                    d->to_string());
-    return primitive->type;
+    // f16 is promoted as its compute type.
+    return primitive->get_compute_type()->as<PrimitiveType>()->type;
   };
 };
 TypePromotionMapping type_promotion_mapping;
@@ -353,6 +353,9 @@ extern std::string runtime_tmp_dir;
 
 bool command_exist(const std::string &command);
 
+// Escapes |str| for use inside a JSON string literal.
+std::string escape_json_string(const std::string &str);
+
 TLANG_NAMESPACE_END
 
 TI_NAMESPACE_BEGIN
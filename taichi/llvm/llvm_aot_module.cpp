@@ -0,0 +1,111 @@
+#include "taichi/llvm/llvm_aot_module.h"
+
+#include "taichi/backends/cpu/codegen_cpu.h"
+#if defined(TI_WITH_CUDA)
+#include "taichi/backends/cuda/codegen_cuda.h"
+#endif
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/program/kernel.h"
+#include "taichi/program/program.h"
+
+TLANG_NAMESPACE_BEGIN
+
+void LlvmAotModule::record(Kernel *kernel,
+                           IRNode *ir,
+                           const LlvmOfflineCache::KernelCacheData &data) {
+  if (kernel->is_accessor || kernel->is_evaluator ||
+      ir != kernel->ir.get() || kernel->arch != kernel->program.config.arch) {
+    return;
+  }
+  // External function calls embed raw host addresses into the IR.
+  auto external_calls = irpass::analysis::gather_statements(
+      ir, [](Stmt *s) {
+        auto call = s->cast<ExternalFuncCallStmt>();
+        return call && call->runtime_func.empty();
+      });
+  if (!external_calls.empty()) {
+    TI_WARN("Kernel {} calls external functions and is not recorded into the "
+            "AOT module",
+            kernel->name);
+    return;
+  }
+  KernelData kernel_data;
+  kernel_data.name = kernel->name;
+  for (const auto &arg : kernel->args) {
+    kernel_data.arg_types.push_back(
+        (int)arg.dt->as<PrimitiveType>()->type);
+    kernel_data.arg_is_nparray.push_back(arg.is_nparray);
+  }
+  for (const auto &ret : kernel->rets) {
+    kernel_data.ret_types.push_back((int)ret.dt->as<PrimitiveType>()->type);
+  }
+  kernel_data.compiled = data;
+  std::lock_guard<std::mutex> _(mut_);
+  for (auto &k : kernels_) {
+    if (k.name == kernel_data.name) {
+      k = std::move(kernel_data);
+      return;
+    }
+  }
+  TI_TRACE("Kernel {} recorded into the AOT module", kernel->name);
+  kernels_.push_back(std::move(kernel_data));
+}
+
+void LlvmAotModule::save(Program *program, const std::string &path) {
+  std::lock_guard<std::mutex> _(mut_);
+  ModuleData data;
+  data.arch = arch_name(program->config.arch);
+  data.signature = LlvmOfflineCache::make_signature(program);
+  data.kernels = kernels_;
+  write_to_binary_file(data, path);
+  TI_TRACE("{} kernels saved into the AOT module [{}]", kernels_.size(),
+           path);
+}
+
+std::vector<Kernel *> LlvmAotModule::load(Program *program,
+                                          const std::string &path) {
+  const auto arch = program->config.arch;
+  TI_ERROR_IF(!arch_is_cpu(arch) && arch != Arch::cuda,
+              "AOT modules are only supported on CPU and CUDA, not on {}",
+              arch_name(arch));
+  TI_ERROR_IF(program->config.async_mode,
+              "AOT modules cannot be loaded in async mode");
+  ModuleData data;
+  read_from_binary_file(data, path);
+  TI_ERROR_IF(data.arch != arch_name(arch),
+              "AOT module [{}] is compiled for {}, not for {}", path,
+              data.arch, arch_name(arch));
+  TI_ERROR_IF(data.signature != LlvmOfflineCache::make_signature(program),
+              "AOT module [{}] is compiled for a different layout, config or "
+              "Taichi version",
+              path);
+  std::vector<Kernel *> kernels;
+  for (const auto &kernel_data : data.kernels) {
+    auto &kernel = program->kernel([]() {}, kernel_data.name);
+    for (int i = 0; i < (int)kernel_data.arg_types.size(); i++) {
+      kernel.insert_arg(
+          PrimitiveType::get((PrimitiveTypeID)kernel_data.arg_types[i]),
+          kernel_data.arg_is_nparray[i]);
+    }
+    for (auto ret_type : kernel_data.ret_types) {
+      kernel.insert_ret(PrimitiveType::get((PrimitiveTypeID)ret_type));
+    }
+    if (arch_is_cpu(arch)) {
+      kernel.compiled =
+          CodeGenCPU::load_executable(&kernel, kernel_data.compiled);
+    } else {
+#if defined(TI_WITH_CUDA)
+      kernel.compiled =
+          CodeGenCUDA::load_executable(&kernel, kernel_data.compiled);
+#else
+      TI_NOT_IMPLEMENTED;
+#endif
+    }
+    kernels.push_back(&kernel);
+  }
+  TI_TRACE("{} kernels loaded from the AOT module [{}]", kernels.size(), path);
+  return kernels;
+}
+
+TLANG_NAMESPACE_END
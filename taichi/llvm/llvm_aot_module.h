@@ -0,0 +1,57 @@
+// Ahead-of-time compiled kernels of the LLVM backends (CPU and CUDA)
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "taichi/llvm/llvm_offline_cache.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Program;
+
+// Records the kernels compiled by a Program, so that another process can
+// launch them without the frontend and without recompiling. The loading
+// Program must define the same layout under the same config.
+class LlvmAotModule {
+ public:
+  struct KernelData {
+    std::string name;
+    // The PrimitiveTypeID of each arg (of the elements for external arrays)
+    // and return value.
+    std::vector<int> arg_types;
+    std::vector<int> arg_is_nparray;
+    std::vector<int> ret_types;
+    LlvmOfflineCache::KernelCacheData compiled;
+
+    TI_IO_DEF(name, arg_types, arg_is_nparray, ret_types, compiled);
+  };
+
+  struct ModuleData {
+    std::string arch;
+    // See LlvmOfflineCache::make_signature().
+    std::string signature;
+    std::vector<KernelData> kernels;
+
+    TI_IO_DEF(arch, signature, kernels);
+  };
+
+  // Records |data|, the compiled |ir| of |kernel|. Only whole kernels are
+  // recorded, i.e. not the offloaded tasks compiled in async mode.
+  void record(Kernel *kernel,
+              IRNode *ir,
+              const LlvmOfflineCache::KernelCacheData &data);
+
+  void save(Program *program, const std::string &path);
+
+  // Creates a launchable Kernel in |program| for each kernel in |path|.
+  static std::vector<Kernel *> load(Program *program, const std::string &path);
+
+ private:
+  std::vector<KernelData> kernels_;
+  std::mutex mut_;
+};
+
+TLANG_NAMESPACE_END
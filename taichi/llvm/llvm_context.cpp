@@ -32,6 +32,8 @@
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
 #include "llvm/Demangle/Demangle.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 
@@ -48,6 +50,9 @@
 #include <unistd.h>
 #endif
 
+#include <map>
+#include <unordered_set>
+
 #if defined(TI_WITH_CUDA)
 #include "taichi/backends/cuda/cuda_context.h"
 #endif
@@ -97,6 +102,8 @@ llvm::Type *TaichiLLVMContext::get_data_type(DataType dt) {
     return llvm::Type::getInt64Ty(*ctx);
   } else if (dt->is_primitive(PrimitiveTypeID::f32)) {
     return llvm::Type::getFloatTy(*ctx);
+  } else if (dt->is_primitive(PrimitiveTypeID::f16)) {
+    return llvm::Type::getHalfTy(*ctx);
   } else if (dt->is_primitive(PrimitiveTypeID::f64)) {
     return llvm::Type::getDoubleTy(*ctx);
   } else if (dt->is_primitive(PrimitiveTypeID::u8)) {
@@ -290,6 +297,41 @@ std::unique_ptr<llvm::Module> module_from_bitcode_file(std::string bitcode_path,
   return std::move(runtime.get());
 }
 
+namespace {
+
+// The runtime bitcode of each arch as processed by clone_runtime_module(),
+// shared by the contexts of all the Programs of the process so that the later
+// ones only parse it.
+std::mutex runtime_bitcode_mut;
+std::map<Arch, std::string> runtime_bitcode;
+
+std::unique_ptr<llvm::Module> load_cached_runtime_module(
+    Arch arch,
+    llvm::LLVMContext *ctx) {
+  std::lock_guard<std::mutex> _(runtime_bitcode_mut);
+  auto it = runtime_bitcode.find(arch);
+  if (it == runtime_bitcode.end()) {
+    return nullptr;
+  }
+  TI_AUTO_PROF
+  auto runtime = parseBitcodeFile(
+      llvm::MemoryBufferRef(it->second, "runtime_bitcode"), *ctx);
+  TI_ERROR_IF(!runtime, "Cached runtime bitcode load failure.");
+  return std::move(runtime.get());
+}
+
+void cache_runtime_module(Arch arch, llvm::Module *module) {
+  std::string bitcode;
+  {
+    llvm::raw_string_ostream sos(bitcode);
+    llvm::WriteBitcodeToFile(*module, sos);
+  }
+  std::lock_guard<std::mutex> _(runtime_bitcode_mut);
+  runtime_bitcode.emplace(arch, std::move(bitcode));
+}
+
+}  // namespace
+
 // The goal of this function is to rip off huge libdevice functions that are not
 // going to be used later, at an early stage. Although the LLVM optimizer will
 // ultimately remove unused functions during a global DCE pass, we don't even
@@ -345,6 +387,9 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_runtime_module() {
   TI_ASSERT(std::this_thread::get_id() == main_thread_id);
   auto data = get_this_thread_data();
   auto ctx = get_this_thread_context();
+  if (!data->runtime_module) {
+    data->runtime_module = load_cached_runtime_module(arch, ctx);
+  }
   if (!data->runtime_module) {
     if (is_release()) {
       data->runtime_module = module_from_bitcode_file(
@@ -430,6 +475,11 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_runtime_module() {
       patch_intrinsic("cuda_shfl_down_sync_i32",
                       Intrinsic::nvvm_shfl_sync_down_i32);
 
+      patch_intrinsic("cuda_shfl_down_sync_f32",
+                      Intrinsic::nvvm_shfl_sync_down_f32);
+
+      patch_intrinsic("cuda_shfl_sync_i32", Intrinsic::nvvm_shfl_sync_idx_i32);
+
       patch_intrinsic("cuda_match_any_sync_i32",
                       Intrinsic::nvvm_match_any_sync_i32);
 
@@ -443,6 +493,8 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_runtime_module() {
                       {llvm::Type::getInt32Ty(*ctx)}, {get_constant(false)});
       patch_intrinsic("cttz_i32", Intrinsic::cttz, true,
                       {llvm::Type::getInt32Ty(*ctx)}, {get_constant(false)});
+      patch_intrinsic("popc_i32", Intrinsic::ctpop, true,
+                      {llvm::Type::getInt32Ty(*ctx)});
 
       patch_atomic_add("atomic_add_i32", llvm::AtomicRMWInst::Add);
 
@@ -467,6 +519,7 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_runtime_module() {
 
       // runtime_module->print(llvm::errs(), nullptr);
     }
+    cache_runtime_module(arch, data->runtime_module.get());
   }
 
   std::unique_ptr<llvm::Module> cloned;
@@ -514,6 +567,72 @@ void TaichiLLVMContext::link_module_with_cuda_libdevice(
   }
 }
 
+std::string TaichiLLVMContext::compile_external_source(
+    const std::string &file) {
+  std::lock_guard<std::mutex> _(external_sources_mut);
+  if (auto it = external_bitcode_files.find(file);
+      it != external_bitcode_files.end()) {
+    return it->second;
+  }
+  std::ifstream ifs(file);
+  TI_ERROR_IF(!ifs, "Source file ({}) not found.", file);
+  std::string source(std::istreambuf_iterator<char>(ifs),
+                     (std::istreambuf_iterator<char>()));
+  // Named after the contents, so that the processes compiling the same
+  // source write the same file.
+  auto bitcode_file =
+      fmt::format("{}external_{}_{:016x}.bc", get_runtime_dir(),
+                  arch_name(arch), std::hash<std::string>{}(file + source));
+  auto clang = find_existing_command(
+      {"clang-7", "clang-8", "clang-9", "clang-10", "clang"});
+  std::string flags = ends_with(file, ".c") ? "-x c" : "-x c++ -std=c++17";
+  if (arch == Arch::cuda) {
+    flags += " --target=nvptx64-nvidia-cuda";
+  }
+  // Optimized, as clang marks the functions it compiles at -O0 optnone.
+  auto cmd = fmt::format("{} -c -emit-llvm -O2 -fno-exceptions {} {} -o {}",
+                         clang, flags, file, bitcode_file);
+  TI_TRACE("Compiling external functions: {}", cmd);
+  TI_ERROR_IF(std::system(cmd.c_str()) != 0,
+              "Failed to compile the external functions in {}", file);
+  external_bitcode_files[file] = bitcode_file;
+  return bitcode_file;
+}
+
+void TaichiLLVMContext::link_external_bitcode(llvm::Module *module,
+                                              const std::string &file) {
+  TI_AUTO_PROF
+  auto bitcode_file = file;
+  if (ends_with(file, ".c") || ends_with(file, ".cpp") ||
+      ends_with(file, ".cc") || ends_with(file, ".cxx")) {
+    bitcode_file = compile_external_source(file);
+  }
+  llvm::SMDiagnostic err;
+  auto external = llvm::parseIRFile(bitcode_file, err, module->getContext());
+  TI_ERROR_IF(!external, "Failed to load the external functions in {}: {}",
+              bitcode_file, err.getMessage().str());
+
+  std::vector<std::string> function_names;
+  for (auto &f : *external) {
+    if (!f.isDeclaration()) {
+      function_names.push_back(f.getName().str());
+    }
+  }
+
+  external->setTargetTriple(module->getTargetTriple());
+  external->setDataLayout(module->getDataLayout());
+  TI_ERROR_IF(llvm::Linker::linkModules(*module, std::move(external)),
+              "Failed to link the external functions in {}. They may "
+              "define functions of the Taichi runtime again.",
+              file);
+
+  for (auto &func_name : function_names) {
+    if (auto func = module->getFunction(func_name)) {
+      func->setLinkage(llvm::Function::InternalLinkage);
+    }
+  }
+}
+
 std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_struct_module() {
   TI_AUTO_PROF
   auto struct_module = get_this_thread_struct_module();
@@ -521,6 +640,105 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_struct_module() {
   return llvm::CloneModule(*struct_module);
 }
 
+std::unique_ptr<llvm::Module>
+TaichiLLVMContext::clone_struct_module_declarations() {
+  TI_AUTO_PROF
+  auto struct_module = get_this_thread_struct_module();
+  TI_ASSERT(struct_module);
+  llvm::ValueToValueMapTy vmap;
+  // Appending globals (e.g. llvm.used) cannot be declarations.
+  return llvm::CloneModule(*struct_module, vmap, [](const GlobalValue *gv) {
+    return gv->hasAppendingLinkage();
+  });
+}
+
+namespace {
+
+// Appends the global values |user| refers to, looking through constant
+// expressions and aggregates, to |refs|.
+void gather_referenced_globals(const llvm::User *user,
+                               std::unordered_set<const Constant *> &visited,
+                               std::vector<const GlobalValue *> &refs) {
+  for (auto &op : user->operands()) {
+    if (auto gv = llvm::dyn_cast<GlobalValue>(op)) {
+      refs.push_back(gv);
+    } else if (auto c = llvm::dyn_cast<Constant>(op)) {
+      if (visited.insert(c).second)
+        gather_referenced_globals(c, visited, refs);
+    }
+  }
+  if (auto func = llvm::dyn_cast<Function>(user)) {
+    for (auto &bb : *func) {
+      for (auto &inst : bb)
+        gather_referenced_globals(&inst, visited, refs);
+    }
+  }
+}
+
+}  // namespace
+
+void TaichiLLVMContext::link_struct_module_definitions(llvm::Module *module) {
+  TI_AUTO_PROF
+  auto struct_module = get_this_thread_struct_module();
+  TI_ASSERT(struct_module);
+  TI_ASSERT(&module->getContext() == &struct_module->getContext());
+
+  // The definitions of the struct module reachable from those of |module|.
+  std::unordered_set<const GlobalValue *> needed;
+  std::unordered_set<const Constant *> visited;
+  std::vector<const GlobalValue *> refs;
+  for (auto &gv : module->global_values()) {
+    if (!gv.isDeclaration())
+      gather_referenced_globals(&gv, visited, refs);
+  }
+  for (auto &ref : refs) {
+    if (!ref->isDeclaration() || !ref->hasName())
+      continue;
+    auto gv = struct_module->getNamedValue(ref->getName());
+    if (gv && !gv->isDeclaration())
+      ref = gv;
+  }
+  while (!refs.empty()) {
+    auto gv = refs.back();
+    refs.pop_back();
+    if (gv->getParent() != struct_module || gv->isDeclaration() ||
+        !needed.insert(gv).second)
+      continue;
+    gather_referenced_globals(gv, visited, refs);
+  }
+  if (needed.empty())
+    return;
+
+  std::unique_ptr<llvm::Module> definitions;
+  {
+    TI_PROFILER("clone definitions");
+    llvm::ValueToValueMapTy vmap;
+    definitions = llvm::CloneModule(
+        *struct_module, vmap,
+        [&](const GlobalValue *gv) { return needed.count(gv) != 0; });
+  }
+  std::vector<GlobalValue *> appending;
+  for (auto &gv : definitions->global_values()) {
+    if (gv.hasAppendingLinkage()) {
+      // Already in |module|, see clone_struct_module_declarations().
+      appending.push_back(&gv);
+    } else if (!gv.isDeclaration() && gv.hasLocalLinkage()) {
+      // Local symbols are not resolved against the declarations in |module|.
+      // They are internalized again by eliminate_unused_functions().
+      gv.setLinkage(GlobalValue::ExternalLinkage);
+    }
+  }
+  for (auto gv : appending)
+    gv->eraseFromParent();
+  // The kernel annotations of the runtime functions are in |module| already.
+  if (auto annotations = definitions->getNamedMetadata("nvvm.annotations"))
+    definitions->eraseNamedMetadata(annotations);
+
+  if (llvm::Linker::linkModules(*module, std::move(definitions))) {
+    TI_ERROR("Failed to link the runtime functions into the kernel module.");
+  }
+}
+
 void TaichiLLVMContext::set_struct_module(
     const std::unique_ptr<llvm::Module> &module) {
   auto data = get_this_thread_data();
@@ -529,7 +747,9 @@ void TaichiLLVMContext::set_struct_module(
     module->print(llvm::errs(), nullptr);
     TI_ERROR("module broken");
   }
+  data->struct_module_source = llvm::CloneModule(*module);
   data->struct_module = llvm::CloneModule(*module);
+  data->struct_module_version++;
   if (!arch_is_cpu(arch)) {
     for (auto &f : *data->struct_module) {
       bool is_kernel = false;
@@ -685,15 +905,20 @@ void TaichiLLVMContext::insert_nvvm_annotation(llvm::Function *func,
 }
 
 void TaichiLLVMContext::mark_function_as_cuda_kernel(llvm::Function *func,
-                                                     int block_dim) {
+                                                     int block_dim,
+                                                     int min_blocks_per_sm,
+                                                     int max_registers) {
   // Mark kernel function as a CUDA __global__ function
   // Add the nvvm annotation that it is considered a kernel function.
   insert_nvvm_annotation(func, "kernel", 1);
   if (block_dim != 0) {
     // CUDA launch bounds
     insert_nvvm_annotation(func, "maxntidx", block_dim);
-    insert_nvvm_annotation(func, "minctasm", 2);
+    if (min_blocks_per_sm != 0)
+      insert_nvvm_annotation(func, "minctasm", min_blocks_per_sm);
   }
+  if (max_registers != 0)
+    insert_nvvm_annotation(func, "maxnreg", max_registers);
 }
 
 void TaichiLLVMContext::eliminate_unused_functions(
@@ -752,13 +977,22 @@ TaichiLLVMContext::get_this_thread_thread_safe_context() {
 
 llvm::Module *TaichiLLVMContext::get_this_thread_struct_module() {
   ThreadLocalData *data = get_this_thread_data();
-  if (!data->struct_module) {
+  if (!data->struct_module ||
+      data->struct_module_version != main_thread_data->struct_module_version) {
     data->struct_module = clone_module_to_this_thread_context(
         main_thread_data->struct_module.get());
+    data->struct_module_version = main_thread_data->struct_module_version;
   }
   return data->struct_module.get();
 }
 
+std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_struct_module_source() {
+  TI_AUTO_PROF
+  auto data = get_this_thread_data();
+  TI_ASSERT(data->struct_module_source);
+  return llvm::CloneModule(*data->struct_module_source);
+}
+
 template llvm::Value *TaichiLLVMContext::get_constant(float32 t);
 template llvm::Value *TaichiLLVMContext::get_constant(float64 t);
 
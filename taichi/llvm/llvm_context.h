@@ -23,6 +23,11 @@ class TaichiLLVMContext {
     llvm::LLVMContext *llvm_context;
     std::unique_ptr<llvm::orc::ThreadSafeContext> thread_safe_llvm_context;
     std::unique_ptr<llvm::Module> runtime_module, struct_module;
+    // The module last passed to set_struct_module() on this thread.
+    std::unique_ptr<llvm::Module> struct_module_source;
+    // Bumped by set_struct_module(), so that the other threads clone the
+    // struct module of the main thread again.
+    int struct_module_version{0};
   };
 
   std::unordered_map<std::thread::id, std::unique_ptr<ThreadLocalData>>
@@ -34,6 +39,14 @@ class TaichiLLVMContext {
   ThreadLocalData *main_thread_data;
   std::mutex mut;
   std::mutex thread_map_mut;
+  // The bitcode files compiled from the C/C++ sources of external functions,
+  // guarded by |external_sources_mut|.
+  std::unordered_map<std::string, std::string> external_bitcode_files;
+  std::mutex external_sources_mut;
+
+  // Compiles the C/C++ source |file| with clang, once per process. Returns
+  // the bitcode file.
+  std::string compile_external_source(const std::string &file);
 
  public:
   std::unique_ptr<JITSession> jit;
@@ -52,8 +65,21 @@ class TaichiLLVMContext {
 
   std::unique_ptr<llvm::Module> clone_struct_module();
 
+  // Clones the struct module with declarations only, which is much cheaper
+  // than clone_struct_module(). The definitions a kernel ends up using are
+  // then linked by link_struct_module_definitions().
+  std::unique_ptr<llvm::Module> clone_struct_module_declarations();
+
+  // Links into |module| the definitions of the struct module its own
+  // definitions refer to, directly or indirectly.
+  void link_struct_module_definitions(llvm::Module *module);
+
   void set_struct_module(const std::unique_ptr<llvm::Module> &module);
 
+  // Clones the module last passed to set_struct_module(), to which the struct
+  // compiler appends another SNode tree.
+  std::unique_ptr<llvm::Module> clone_struct_module_source();
+
   JITModule *add_module(std::unique_ptr<llvm::Module> module);
 
   virtual void *lookup_function_pointer(const std::string &name) {
@@ -95,6 +121,12 @@ class TaichiLLVMContext {
 
   void link_module_with_cuda_libdevice(std::unique_ptr<llvm::Module> &module);
 
+  // Links into |module| the functions defined in |file|: LLVM bitcode or IR
+  // for the arch of the context, or C/C++ source compiled to it with clang.
+  // They are internal, so that they are inlined and dropped like the runtime
+  // functions.
+  void link_external_bitcode(llvm::Module *module, const std::string &file);
+
   static void force_inline(llvm::Function *func);
 
   static void print_huge_functions(llvm::Module *module);
@@ -107,7 +139,13 @@ class TaichiLLVMContext {
       llvm::Module *module,
       std::function<bool(const std::string &)> export_indicator);
 
-  void mark_function_as_cuda_kernel(llvm::Function *func, int block_dim = 0);
+  // With a |block_dim|, also bounds the registers per thread so that
+  // |min_blocks_per_sm| blocks fit on a multiprocessor. |max_registers|
+  // caps them regardless, if not 0.
+  void mark_function_as_cuda_kernel(llvm::Function *func,
+                                    int block_dim = 0,
+                                    int min_blocks_per_sm = 2,
+                                    int max_registers = 0);
 
   void insert_nvvm_annotation(llvm::Function *func, std::string key, int val);
 
@@ -9,6 +9,7 @@ class Function;
 class DataLayout;
 class JITSymbol;
 class ExitOnError;
+class TargetOptions;
 namespace orc {
 class ThreadSafeContext;
 }
@@ -0,0 +1,276 @@
+#include "taichi/llvm/llvm_offline_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <set>
+#include <thread>
+
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/program/kernel.h"
+#include "taichi/program/profile_guide.h"
+#include "taichi/program/program.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kEntryPrefix[] = "kernel_";
+constexpr char kEntrySuffix[] = ".tcb";
+
+uint64 poly_hash(const std::string &str) {
+  uint64 ret = 0;
+  for (uint64 i = 0; i < str.size(); i++) {
+    ret = ret * 100000007UL + (uint64)str[i];
+  }
+  return ret;
+}
+
+void serialize_layout(SNode *snode, std::string *output) {
+  *output += fmt::format("{}:{}:{}:{}:{}:{}:{}:{}:{}:{}", snode->id,
+                         snode_type_name(snode->type), snode->n,
+                         snode->chunk_size, snode->chunk_directory,
+                         snode->hash_capacity, snode->num_active_indices,
+                         snode->is_bit_level, snode->_morton,
+                         snode->cell_alignment);
+  for (int i = 0; i < taichi_max_num_indices; i++) {
+    const auto &e = snode->extractors[i];
+    if (e.active) {
+      *output += fmt::format(",{}/{}/{}", e.start, e.num_bits, e.acc_offset);
+    }
+  }
+  if (snode->type == SNodeType::place) {
+    *output += "," + snode->dt->to_string();
+  }
+  if (snode->physical_type) {
+    *output += "," + snode->physical_type->to_string();
+  }
+  *output += "[";
+  for (const auto &ch : snode->ch) {
+    serialize_layout(ch.get(), output);
+  }
+  *output += "]";
+}
+
+std::string serialize_config(const CompileConfig &config) {
+  return fmt::format(
+      "{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};{};"
+      "{};{};{};{};{};{};{};{};{};{};{};{};{};{}",
+      arch_name(config.arch), config.debug, config.check_out_of_bound,
+      config.kernel_profiler, config.fast_math, config.advanced_optimization,
+      config.default_fp->to_string(), config.default_ip->to_string(),
+      config.ad_stack_size, config.default_cpu_block_dim,
+      config.default_gpu_block_dim, config.saturating_grid_dim,
+      config.max_block_dim, config.cpu_max_num_threads,
+      config.use_unified_memory, config.external_optimization_level,
+      config.incremental_listgen, config.cpu_tile_shape, config.cpu_vectorize,
+      config.lock_free_activation, config.quant_atomic_add_allow_overflow,
+      config.cuda_auto_tune_block_dim, config.cpu_block_dim_by_cost,
+      config.deterministic_reduction, config.cuda_philox_rand,
+      config.unified_memory_stream_tile_MB > 0,
+      config.cuda_persistent_kernels, config.cuda_max_registers,
+      config.cuda_min_blocks_per_sm, config.cuda_max_bls_bytes,
+      config.cpu_max_tls_array_bytes, config.make_block_local_scatter,
+      config.horizontal_fusion_max_iterations,
+      config.serial_fusion_max_statements,
+      config.coalesce_dense_struct_fors,
+      config.cpu_struct_for_prefetch_distance, config.unroll_max_statements,
+      config.pgo_instrument);
+}
+
+}  // namespace
+
+LlvmOfflineCache::LlvmOfflineCache(const std::string &path,
+                                   std::size_t max_size_bytes)
+    : path_(path), max_size_bytes_(max_size_bytes) {
+  std::error_code ec;
+  fs::create_directories(path_, ec);
+  if (ec) {
+    TI_WARN("Failed to create offline cache directory [{}]: {}", path_,
+            ec.message());
+  }
+}
+
+std::string LlvmOfflineCache::make_key(Kernel *kernel, IRNode *ir) {
+  TI_AUTO_PROF
+  // External function calls embed raw host addresses into the IR, which are
+  // meaningless in a different process.
+  auto external_calls = irpass::analysis::gather_statements(
+      ir, [](Stmt *s) {
+        auto call = s->cast<ExternalFuncCallStmt>();
+        return call && call->runtime_func.empty();
+      });
+  if (!external_calls.empty()) {
+    return "";
+  }
+  // The counters of instrumented kernels are allocated by the process.
+  if (kernel->program.config.pgo_instrument) {
+    return "";
+  }
+  std::string serialized;
+  irpass::re_id(ir);
+  irpass::print(ir, &serialized);
+  serialized += kernel->name;
+  serialized += fmt::format("|{}{}{}", kernel->fast_math, kernel->fp_contract,
+                            kernel->approx_math);
+  serialized += make_signature(&kernel->program);
+  // The files of the external functions linked into the kernel may change
+  // between runs.
+  std::set<std::string> bitcode_files;
+  for (auto s : irpass::analysis::gather_statements(ir, [](Stmt *s) {
+         auto call = s->cast<ExternalFuncCallStmt>();
+         return call && !call->bitcode_file.empty();
+       })) {
+    bitcode_files.insert(s->as<ExternalFuncCallStmt>()->bitcode_file);
+  }
+  for (auto &file : bitcode_files) {
+    std::ifstream ifs(file, std::ios::binary);
+    serialized += "|" + std::string(std::istreambuf_iterator<char>(ifs),
+                                    std::istreambuf_iterator<char>());
+  }
+  return hash(serialized);
+}
+
+std::string LlvmOfflineCache::hash(const std::string &str) {
+  return fmt::format("{:016x}{:016x}", poly_hash(str),
+                     (uint64)std::hash<std::string>{}(str));
+}
+
+std::string LlvmOfflineCache::make_task_key(Kernel *kernel, IRNode *ir) {
+  TI_AUTO_PROF
+  std::string key;
+  irpass::re_id(ir);
+  irpass::print(ir, &key);
+  if (kernel->program.config.kernel_profiler) {
+    key += kernel->name;
+  }
+  // The tasks read the arguments as laid out by the kernel.
+  for (const auto &arg : kernel->args) {
+    key += fmt::format("|{}{}", arg.dt->to_string(), arg.is_nparray);
+  }
+  for (const auto &ret : kernel->rets) {
+    key += fmt::format("|{}", ret.dt->to_string());
+  }
+  key += fmt::format("|{}{}{}{}", arch_name(kernel->arch), kernel->fast_math,
+                     kernel->fp_contract, kernel->approx_math);
+  key += serialize_config(kernel->program.config);
+  if (auto *guide = kernel->program.profile_guide.get())
+    key += guide->get_digest();
+  return key;
+}
+
+std::string LlvmOfflineCache::make_signature(Program *program) {
+  auto signature = serialize_config(program->config);
+  serialize_layout(program->snode_root.get(), &signature);
+  for (auto root : program->get_materialized_snode_trees()) {
+    serialize_layout(root, &signature);
+  }
+  if (auto *guide = program->profile_guide.get())
+    signature += guide->get_digest();
+  signature += get_commit_hash();
+  return signature;
+}
+
+bool LlvmOfflineCache::load(const std::string &key, KernelCacheData *data) {
+  TI_AUTO_PROF
+  std::lock_guard<std::mutex> _(mut_);
+  auto fn = get_file_name(key);
+  std::error_code ec;
+  if (!fs::exists(fn, ec)) {
+    return false;
+  }
+  read_from_binary_file(*data, fn);
+  if (data->key != key) {
+    // Hash collision
+    TI_TRACE("Offline cache key mismatch for [{}]", fn);
+    return false;
+  }
+  // Bump the timestamp so that eviction is LRU rather than FIFO.
+  fs::last_write_time(fn, fs::file_time_type::clock::now(), ec);
+  TI_TRACE("Kernel loaded from offline cache [{}]", fn);
+  return true;
+}
+
+void LlvmOfflineCache::store(const KernelCacheData &data) {
+  TI_AUTO_PROF
+  std::lock_guard<std::mutex> _(mut_);
+  auto fn = get_file_name(data.key);
+  // Write to a temporary file first, so that concurrent Taichi processes never
+  // observe a partially written entry.
+  auto tmp_fn = fmt::format(
+      "{}/tmp_{}_{:x}{}", path_, data.key,
+      std::hash<std::thread::id>{}(std::this_thread::get_id()), kEntrySuffix);
+  write_to_binary_file(data, tmp_fn);
+  std::error_code ec;
+  fs::rename(tmp_fn, fn, ec);
+  if (ec) {
+    TI_WARN("Failed to store kernel into offline cache [{}]: {}", fn,
+            ec.message());
+    fs::remove(tmp_fn, ec);
+    return;
+  }
+  TI_TRACE("Kernel stored into offline cache [{}]", fn);
+  evict_if_needed();
+}
+
+void LlvmOfflineCache::update_tasks(const std::string &key,
+                                    const std::vector<TaskInfo> &tasks) {
+  KernelCacheData data;
+  if (!load(key, &data)) {
+    return;
+  }
+  TI_ASSERT(data.tasks.size() == tasks.size());
+  data.tasks = tasks;
+  store(data);
+}
+
+std::string LlvmOfflineCache::get_file_name(const std::string &key) const {
+  return fmt::format("{}/{}{}{}", path_, kEntryPrefix, key, kEntrySuffix);
+}
+
+void LlvmOfflineCache::evict_if_needed() {
+  if (max_size_bytes_ == 0) {
+    return;
+  }
+  struct Entry {
+    fs::path path;
+    std::uintmax_t size;
+    fs::file_time_type last_used;
+  };
+  std::vector<Entry> entries;
+  std::uintmax_t total_size = 0;
+  std::error_code ec;
+  for (const auto &f : fs::directory_iterator(path_, ec)) {
+    const auto fn = f.path().filename().string();
+    if (!starts_with(fn, kEntryPrefix) || !ends_with(fn, kEntrySuffix)) {
+      continue;
+    }
+    Entry entry{f.path(), f.file_size(ec), f.last_write_time(ec)};
+    total_size += entry.size;
+    entries.push_back(std::move(entry));
+  }
+  if (total_size <= max_size_bytes_) {
+    return;
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.last_used < b.last_used;
+            });
+  for (const auto &entry : entries) {
+    if (total_size <= max_size_bytes_) {
+      break;
+    }
+    TI_TRACE("Evicting [{}] from offline cache", entry.path.string());
+    if (fs::remove(entry.path, ec)) {
+      total_size -= entry.size;
+    }
+  }
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,105 @@
+// An on-disk cache of compiled kernels for the LLVM backends
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Kernel;
+class Program;
+class IRNode;
+
+class LlvmOfflineCache {
+ public:
+  // Launch parameters of one offloaded task inside a cached kernel.
+  struct TaskInfo {
+    std::string name;
+    int block_dim{0};
+    int grid_dim{0};
+    std::size_t shmem_bytes{0};
+    std::vector<int> root_children;
+    // Whether the launch dimensions are still to be tuned on CUDA, see
+    // CompileConfig::cuda_auto_tune_block_dim.
+    bool tune_block_dim{false};
+    // Whether the task is a range-for over [range_begin, range_end) that
+    // reads its bounds from the Context, so that it can be launched in tiles
+    // streaming the fields through the device on CUDA, see
+    // CompileConfig::unified_memory_stream_tile_MB.
+    bool streamed{false};
+    int range_begin{0};
+    int range_end{0};
+    // Whether the task is a persistent kernel on CUDA, running several tasks
+    // with a grid barrier in between, see
+    // CompileConfig::cuda_persistent_kernels.
+    bool persistent{false};
+
+    TI_IO_DEF(name,
+              block_dim,
+              grid_dim,
+              shmem_bytes,
+              root_children,
+              tune_block_dim,
+              streamed,
+              range_begin,
+              range_end,
+              persistent);
+  };
+
+  struct KernelCacheData {
+    std::string key;
+    std::vector<TaskInfo> tasks;
+    // Optimized LLVM bitcode on CPU, PTX on CUDA. See
+    // JITSession::compile_module_to_binary().
+    std::string binary;
+
+    TI_IO_DEF(key, tasks, binary);
+  };
+
+  // |max_size_bytes| == 0 means the cache is never evicted.
+  LlvmOfflineCache(const std::string &path, std::size_t max_size_bytes);
+
+  // Computes the cache key of |ir| (the fully lowered IR of |kernel|, or one
+  // of its offloaded tasks in async mode). Returns an empty string if the
+  // kernel must not be cached, e.g. because it embeds host addresses.
+  static std::string make_key(Kernel *kernel, IRNode *ir);
+
+  // Serializes the offloaded task |ir| of |kernel| for
+  // Program::find_compiled_task(). Unlike make_key(), it leaves out the name
+  // of the kernel unless the kernel profiler needs it, so that the other
+  // kernels containing the same task reuse it, and what is fixed in one
+  // process, i.e. the layout and the Taichi version.
+  static std::string make_task_key(Kernel *kernel, IRNode *ir);
+
+  // Serializes what the compiled kernels of |program| depend on besides their
+  // IR: the config, the layout and the Taichi version.
+  static std::string make_signature(Program *program);
+
+  // A 128-bit hash of |str| in hex, as used by make_key().
+  static std::string hash(const std::string &str);
+
+  bool load(const std::string &key, KernelCacheData *data);
+
+  void store(const KernelCacheData &data);
+
+  // Replaces the task infos of the entry under |key|, e.g. with the tuned
+  // launch dimensions.
+  void update_tasks(const std::string &key, const std::vector<TaskInfo> &tasks);
+
+ private:
+  std::string get_file_name(const std::string &key) const;
+
+  // Removes the least recently used entries until the cache fits into
+  // |max_size_bytes_|.
+  void evict_if_needed();
+
+  std::string path_;
+  std::size_t max_size_bytes_;
+  std::mutex mut_;
+};
+
+TLANG_NAMESPACE_END
@@ -794,4 +794,12 @@ inline void print(const Array2D<T> &arr) {
   arr.print("");
 }
 
+// Renders |content| with the TrueType font |font_fn| into the coverage of a
+// |res[0]| x |res[1]| image, stored row by row from the top, as written by
+// Array2D::write_text.
+std::vector<unsigned char> render_text(const std::string &font_fn,
+                                       const std::string &content,
+                                       real size,
+                                       Vector2i res);
+
 TI_NAMESPACE_END
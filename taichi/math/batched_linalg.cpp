@@ -0,0 +1,584 @@
+#include "taichi/math/batched_linalg.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#if defined(TI_ARCH_x64)
+#include <xmmintrin.h>
+#endif
+
+TI_NAMESPACE_BEGIN
+
+namespace batched_linalg {
+
+// The kernels below are written once against "packs", which are either
+// scalars or GCC vectors of scalars, and only force-inlined helpers are used
+// on them. The entry points of each instruction set are the only functions
+// built with its target, so that the packs are compiled to its registers
+// without building the whole file for it.
+#if defined(__GNUC__) || defined(__clang__)
+#define TI_BATCHED_LINALG_VECTORS
+#endif
+#if defined(TI_BATCHED_LINALG_VECTORS) && defined(TI_ARCH_x64)
+#define TI_BATCHED_LINALG_X86
+#define TI_BATCHED_LINALG_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace {
+
+template <typename P>
+struct PackTraits {
+  using Scalar = P;
+  using Bits = std::conditional_t<sizeof(P) == 4, uint32, uint64>;
+  static constexpr int width = 1;
+};
+
+#if defined(TI_BATCHED_LINALG_VECTORS)
+#define TI_DEFINE_PACK(name, bits_name, scalar, bits, width_)                \
+  typedef scalar name __attribute__((vector_size(sizeof(scalar) * width_))); \
+  typedef bits bits_name                                                     \
+      __attribute__((vector_size(sizeof(scalar) * width_)));                 \
+  template <>                                                                \
+  struct PackTraits<name> {                                                  \
+    using Scalar = scalar;                                                   \
+    using Bits = bits_name;                                                  \
+    static constexpr int width = width_;                                     \
+  };
+
+TI_DEFINE_PACK(f32x4, u32x4, float32, uint32, 4)
+TI_DEFINE_PACK(f64x2, u64x2, float64, uint64, 2)
+#if defined(TI_BATCHED_LINALG_X86)
+TI_DEFINE_PACK(f32x8, u32x8, float32, uint32, 8)
+TI_DEFINE_PACK(f64x4, u64x4, float64, uint64, 4)
+TI_DEFINE_PACK(f32x16, u32x16, float32, uint32, 16)
+TI_DEFINE_PACK(f64x8, u64x8, float64, uint64, 8)
+#endif
+#undef TI_DEFINE_PACK
+#endif
+
+template <typename To, typename From>
+TI_FORCE_INLINE To pack_cast(const From &from) {
+  static_assert(sizeof(To) == sizeof(From));
+  To to;
+  std::memcpy(&to, &from, sizeof(To));
+  return to;
+}
+
+template <typename P>
+TI_FORCE_INLINE P splat(typename PackTraits<P>::Scalar x) {
+  typename PackTraits<P>::Scalar lanes[PackTraits<P>::width];
+  for (auto &lane : lanes) {
+    lane = x;
+  }
+  return pack_cast<P>(lanes);
+}
+
+template <typename P>
+TI_FORCE_INLINE P load(const typename PackTraits<P>::Scalar *ptr) {
+  P p;
+  std::memcpy(&p, ptr, sizeof(P));
+  return p;
+}
+
+template <typename P>
+TI_FORCE_INLINE void store(typename PackTraits<P>::Scalar *ptr, const P &p) {
+  std::memcpy(ptr, &p, sizeof(P));
+}
+
+// |mask| is the result of comparing packs: a bool, or a vector of all-ones
+// and all-zeros lanes.
+template <typename M, typename P>
+TI_FORCE_INLINE P select(const M &mask, const P &x, const P &y) {
+  if constexpr (PackTraits<P>::width == 1) {
+    return mask ? x : y;
+  } else {
+    using Bits = typename PackTraits<P>::Bits;
+    const auto m = (Bits)mask;
+    return pack_cast<P>((m & pack_cast<Bits>(x)) | (~m & pack_cast<Bits>(y)));
+  }
+}
+
+template <typename P>
+TI_FORCE_INLINE P abs(const P &x) {
+  using T = typename PackTraits<P>::Scalar;
+  return select(x < T(0), -x, x);
+}
+
+template <typename P>
+TI_FORCE_INLINE P max(const P &x, const P &y) {
+  return select(x > y, x, y);
+}
+
+// 1 / sqrt(x) by Newton's method from the bit-level first guess, in plain
+// arithmetic so that it vectorizes without intrinsics. Finite (and huge) at
+// 0.
+template <typename P>
+TI_FORCE_INLINE P rsqrt(const P &x) {
+  using T = typename PackTraits<P>::Scalar;
+  using Bits = typename PackTraits<P>::Bits;
+  constexpr bool is_f32 = std::is_same_v<T, float32>;
+  using BitsScalar = std::conditional_t<is_f32, uint32, uint64>;
+  constexpr auto magic =
+      is_f32 ? (BitsScalar)0x5f375a86 : (BitsScalar)0x5fe6eb50c7b537a9ull;
+  const Bits bits = pack_cast<Bits>(x);
+  P y = pack_cast<P>(magic - (bits >> 1));
+  const P half_x = x * T(0.5);
+  for (int i = 0; i < (is_f32 ? 3 : 4); i++) {
+    y = y * (T(1.5) - half_x * y * y);
+  }
+  return y;
+}
+
+template <typename P>
+TI_FORCE_INLINE P sqrt(const P &x) {
+  return x * rsqrt(x);
+}
+
+template <typename P>
+struct Matrix3 {
+  P d[3][3];
+};
+
+// The rotation of the (approximate) Givens rotation annihilating a12 of
+// [[a11, a12], [a12, a22]], as a quaternion (ch, sh).
+template <typename P>
+TI_FORCE_INLINE void approximate_givens(const P &a11,
+                                        const P &a12,
+                                        const P &a22,
+                                        P &ch,
+                                        P &sh) {
+  using T = typename PackTraits<P>::Scalar;
+  // sqrt(8) + 3, cos(pi / 8) and sin(pi / 8).
+  constexpr T four_gamma_squared = T(5.828427124746190);
+  constexpr T cosine_pi_over_eight = T(0.9238795325112867);
+  constexpr T sine_pi_over_eight = T(0.3826834323650897);
+  ch = T(2) * (a11 - a22);
+  sh = a12;
+  const auto exact = four_gamma_squared * sh * sh < ch * ch;
+  const P w = rsqrt(ch * ch + sh * sh);
+  ch = select(exact, w * ch, splat<P>(cosine_pi_over_eight));
+  sh = select(exact, w * sh, splat<P>(sine_pi_over_eight));
+}
+
+// One Jacobi rotation of the symmetric S, accumulated into the quaternion q
+// (x, y, z, w) of V. (x, y, z) is (0, 1, 2), (1, 2, 0) and (2, 0, 1) for the
+// pairs (0, 1), (1, 2) and (0, 2), as S is permuted after each rotation.
+template <int x, int y, int z, typename P>
+TI_FORCE_INLINE void jacobi_conjugation(P &s11,
+                                        P &s21,
+                                        P &s22,
+                                        P &s31,
+                                        P &s32,
+                                        P &s33,
+                                        P (&q)[4]) {
+  using T = typename PackTraits<P>::Scalar;
+  P ch, sh;
+  approximate_givens(s11, s21, s22, ch, sh);
+  const P scale = ch * ch + sh * sh;
+  const P a = (ch * ch - sh * sh) / scale;
+  const P b = (T(2) * sh * ch) / scale;
+
+  // S = Q^T S Q.
+  const P t11 = s11, t21 = s21, t22 = s22, t31 = s31, t32 = s32;
+  s11 = a * (a * t11 + b * t21) + b * (a * t21 + b * t22);
+  s21 = a * (-b * t11 + a * t21) + b * (-b * t21 + a * t22);
+  s22 = -b * (-b * t11 + a * t21) + a * (-b * t21 + a * t22);
+  s31 = a * t31 + b * t32;
+  s32 = -b * t31 + a * t32;
+
+  const P t[3] = {q[0] * sh, q[1] * sh, q[2] * sh};
+  sh = sh * q[3];
+  for (auto &c : q) {
+    c = c * ch;
+  }
+  q[z] = q[z] + sh;
+  q[3] = q[3] - t[z];
+  q[x] = q[x] + t[y];
+  q[y] = q[y] - t[x];
+
+  // Moves the next pair to (0, 1).
+  const P u11 = s22, u21 = s32, u22 = s33, u31 = s21, u32 = s31, u33 = s11;
+  s11 = u11;
+  s21 = u21;
+  s22 = u22;
+  s31 = u31;
+  s32 = u32;
+  s33 = u33;
+}
+
+template <typename P>
+TI_FORCE_INLINE void cond_swap(const decltype(P() < P()) &c, P &x, P &y) {
+  const P t = x;
+  x = select(c, y, x);
+  y = select(c, t, y);
+}
+
+// Swaps x and y, negating one of them to keep the determinant of the matrix
+// they are columns of.
+template <typename P>
+TI_FORCE_INLINE void cond_neg_swap(const decltype(P() < P()) &c, P &x, P &y) {
+  const P t = -x;
+  x = select(c, y, x);
+  y = select(c, t, y);
+}
+
+// The quaternion (ch, sh) of the Givens rotation annihilating a2 under the
+// pivot a1.
+template <typename P>
+TI_FORCE_INLINE void qr_givens(const P &a1, const P &a2, P &ch, P &sh) {
+  using T = typename PackTraits<P>::Scalar;
+  constexpr T epsilon = std::is_same_v<T, float32> ? T(1e-6) : T(1e-14);
+  const P rho = sqrt(a1 * a1 + a2 * a2);
+  sh = select(rho > epsilon, a2, splat<P>(0));
+  ch = abs(a1) + max(rho, splat<P>(epsilon));
+  cond_swap(a1 < T(0), sh, ch);
+  const P w = rsqrt(ch * ch + sh * sh);
+  ch = ch * w;
+  sh = sh * w;
+}
+
+// Rotates the rows p and k of B, annihilating B[k][p]. (a, b) are the cosine
+// and the sine of the rotation.
+template <int p, int k, typename P>
+TI_FORCE_INLINE void qr_rotate_rows(Matrix3<P> &b, P &rot_a, P &rot_b) {
+  using T = typename PackTraits<P>::Scalar;
+  P ch, sh;
+  qr_givens(b.d[p][p], b.d[k][p], ch, sh);
+  rot_a = T(1) - T(2) * sh * sh;
+  rot_b = T(2) * ch * sh;
+  for (int j = 0; j < 3; j++) {
+    const P bp = b.d[p][j], bk = b.d[k][j];
+    b.d[p][j] = rot_a * bp + rot_b * bk;
+    b.d[k][j] = -rot_b * bp + rot_a * bk;
+  }
+}
+
+template <typename P>
+TI_FORCE_INLINE void svd3x3(const Matrix3<P> &a,
+                            Matrix3<P> &u,
+                            P (&sigma)[3],
+                            Matrix3<P> &v) {
+  using T = typename PackTraits<P>::Scalar;
+  constexpr int num_sweeps = std::is_same_v<T, float32> ? 6 : 8;
+
+  // The eigenvectors of A^T A are V.
+  P ata[3][3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = i; j < 3; j++) {
+      ata[i][j] = a.d[0][i] * a.d[0][j] + a.d[1][i] * a.d[1][j] +
+                  a.d[2][i] * a.d[2][j];
+    }
+  }
+  P s11 = ata[0][0], s21 = ata[0][1], s22 = ata[1][1], s31 = ata[0][2],
+    s32 = ata[1][2], s33 = ata[2][2];
+  P q[4] = {splat<P>(0), splat<P>(0), splat<P>(0), splat<P>(1)};
+  for (int i = 0; i < num_sweeps; i++) {
+    jacobi_conjugation<0, 1, 2>(s11, s21, s22, s31, s32, s33, q);
+    jacobi_conjugation<1, 2, 0>(s11, s21, s22, s31, s32, s33, q);
+    jacobi_conjugation<2, 0, 1>(s11, s21, s22, s31, s32, s33, q);
+  }
+  {
+    // The accumulated quaternion is only approximately normalized.
+    const P norm = rsqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    const P x = q[0] * norm, y = q[1] * norm, z = q[2] * norm, w = q[3] * norm;
+    v.d[0][0] = T(1) - T(2) * (y * y + z * z);
+    v.d[0][1] = T(2) * (x * y - w * z);
+    v.d[0][2] = T(2) * (x * z + w * y);
+    v.d[1][0] = T(2) * (x * y + w * z);
+    v.d[1][1] = T(1) - T(2) * (x * x + z * z);
+    v.d[1][2] = T(2) * (y * z - w * x);
+    v.d[2][0] = T(2) * (x * z - w * y);
+    v.d[2][1] = T(2) * (y * z + w * x);
+    v.d[2][2] = T(1) - T(2) * (x * x + y * y);
+  }
+
+  // B = A V, whose columns are sorted by norm, along with V.
+  Matrix3<P> b;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      b.d[i][j] = a.d[i][0] * v.d[0][j] + a.d[i][1] * v.d[1][j] +
+                  a.d[i][2] * v.d[2][j];
+    }
+  }
+  P rho[3];
+  for (int j = 0; j < 3; j++) {
+    rho[j] = b.d[0][j] * b.d[0][j] + b.d[1][j] * b.d[1][j] +
+             b.d[2][j] * b.d[2][j];
+  }
+  constexpr int pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+  for (auto &pair : pairs) {
+    const int j = pair[0], k = pair[1];
+    const auto c = rho[j] < rho[k];
+    for (int i = 0; i < 3; i++) {
+      cond_neg_swap(c, b.d[i][j], b.d[i][k]);
+      cond_neg_swap(c, v.d[i][j], v.d[i][k]);
+    }
+    cond_swap(c, rho[j], rho[k]);
+  }
+
+  // B = U R by Givens rotations of the rows (0, 1), (0, 2) and (1, 2), whose
+  // products make U. The diagonal of R is sigma.
+  P rot_a[3], rot_b[3];
+  qr_rotate_rows<0, 1>(b, rot_a[0], rot_b[0]);
+  qr_rotate_rows<0, 2>(b, rot_a[1], rot_b[1]);
+  qr_rotate_rows<1, 2>(b, rot_a[2], rot_b[2]);
+  for (int i = 0; i < 3; i++) {
+    sigma[i] = b.d[i][i];
+  }
+  // U = Q1 Q2 Q3, where Q1 rotates (0, 1), Q2 (0, 2) and Q3 (1, 2).
+  const P m[3][3] = {
+      {rot_a[0] * rot_a[1], -rot_b[0], -rot_a[0] * rot_b[1]},
+      {rot_b[0] * rot_a[1], rot_a[0], -rot_b[0] * rot_b[1]},
+      {rot_b[1], splat<P>(0), rot_a[1]}};
+  for (int i = 0; i < 3; i++) {
+    u.d[i][0] = m[i][0];
+    u.d[i][1] = m[i][1] * rot_a[2] + m[i][2] * rot_b[2];
+    u.d[i][2] = -m[i][1] * rot_b[2] + m[i][2] * rot_a[2];
+  }
+}
+
+enum class Op { svd, polar_decompose, matmul };
+
+template <typename T>
+struct BatchArgs {
+  int n;
+  const T *a;
+  const T *b;
+  T *c;
+  T *d;
+  T *e;
+  int rows, inner, cols;
+};
+
+// Processes the matrices [begin, end) of the batch, |end - begin| being a
+// multiple of the width of P.
+template <typename P>
+TI_FORCE_INLINE void run_packs(
+    Op op,
+    const BatchArgs<typename PackTraits<P>::Scalar> &args,
+    int begin,
+    int end) {
+  constexpr int width = PackTraits<P>::width;
+  const int n = args.n;
+  for (int k = begin; k + width <= end; k += width) {
+    if (op == Op::matmul) {
+      for (int i = 0; i < args.rows; i++) {
+        for (int j = 0; j < args.cols; j++) {
+          P sum = splat<P>(0);
+          for (int l = 0; l < args.inner; l++) {
+            sum = sum + load<P>(args.a + (i * args.inner + l) * n + k) *
+                            load<P>(args.b + (l * args.cols + j) * n + k);
+          }
+          store(args.c + (i * args.cols + j) * n + k, sum);
+        }
+      }
+      continue;
+    }
+    Matrix3<P> a, u, v;
+    P sigma[3];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        a.d[i][j] = load<P>(args.a + (i * 3 + j) * n + k);
+      }
+    }
+    svd3x3(a, u, sigma, v);
+    if (op == Op::svd) {
+      for (int i = 0; i < 3; i++) {
+        store(args.d + i * n + k, sigma[i]);
+        for (int j = 0; j < 3; j++) {
+          store(args.c + (i * 3 + j) * n + k, u.d[i][j]);
+          store(args.e + (i * 3 + j) * n + k, v.d[i][j]);
+        }
+      }
+    } else {
+      for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+          P r = splat<P>(0), s = splat<P>(0);
+          for (int l = 0; l < 3; l++) {
+            r = r + u.d[i][l] * v.d[j][l];
+            s = s + v.d[i][l] * sigma[l] * v.d[j][l];
+          }
+          store(args.c + (i * 3 + j) * n + k, r);
+          store(args.d + (i * 3 + j) * n + k, s);
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+int run_scalar(Op op, const BatchArgs<T> &args, int begin) {
+  run_packs<T>(op, args, begin, args.n);
+  return args.n;
+}
+
+#if defined(TI_BATCHED_LINALG_VECTORS)
+int run_baseline(Op op, const BatchArgs<float32> &args) {
+  run_packs<f32x4>(op, args, 0, args.n);
+  return args.n / 4 * 4;
+}
+
+int run_baseline(Op op, const BatchArgs<float64> &args) {
+  run_packs<f64x2>(op, args, 0, args.n);
+  return args.n / 2 * 2;
+}
+#endif
+
+#if defined(TI_BATCHED_LINALG_X86)
+TI_BATCHED_LINALG_TARGET("avx2,fma")
+int run_avx2(Op op, const BatchArgs<float32> &args) {
+  run_packs<f32x8>(op, args, 0, args.n);
+  return args.n / 8 * 8;
+}
+
+TI_BATCHED_LINALG_TARGET("avx2,fma")
+int run_avx2(Op op, const BatchArgs<float64> &args) {
+  run_packs<f64x4>(op, args, 0, args.n);
+  return args.n / 4 * 4;
+}
+
+TI_BATCHED_LINALG_TARGET("avx512f")
+int run_avx512(Op op, const BatchArgs<float32> &args) {
+  run_packs<f32x16>(op, args, 0, args.n);
+  return args.n / 16 * 16;
+}
+
+TI_BATCHED_LINALG_TARGET("avx512f")
+int run_avx512(Op op, const BatchArgs<float64> &args) {
+  run_packs<f64x8>(op, args, 0, args.n);
+  return args.n / 8 * 8;
+}
+#endif
+
+SIMDLevel detect_max_simd_level() {
+#if defined(TI_BATCHED_LINALG_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return SIMDLevel::avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return SIMDLevel::avx2;
+#endif
+#if defined(TI_BATCHED_LINALG_VECTORS)
+  return SIMDLevel::baseline;
+#else
+  return SIMDLevel::none;
+#endif
+}
+
+SIMDLevel simd_level = get_max_simd_level();
+
+// The off-diagonal entries of the Jacobi iterations become denormal in
+// float32, which is many times slower on x86 unless they are flushed to zero.
+class FlushDenormals {
+ public:
+  FlushDenormals() {
+#if defined(TI_ARCH_x64)
+    csr_ = _mm_getcsr();
+    // Flush-to-zero and denormals-are-zero.
+    _mm_setcsr(csr_ | 0x8040);
+#endif
+  }
+
+  ~FlushDenormals() {
+#if defined(TI_ARCH_x64)
+    _mm_setcsr(csr_);
+#endif
+  }
+
+ private:
+  unsigned int csr_{0};
+};
+
+template <typename T>
+void run(Op op, const BatchArgs<T> &args) {
+  if (args.n <= 0)
+    return;
+  FlushDenormals flush_denormals;
+  int done = 0;
+  switch (simd_level) {
+#if defined(TI_BATCHED_LINALG_X86)
+    case SIMDLevel::avx512:
+      done = run_avx512(op, args);
+      break;
+    case SIMDLevel::avx2:
+      done = run_avx2(op, args);
+      break;
+#endif
+#if defined(TI_BATCHED_LINALG_VECTORS)
+    case SIMDLevel::baseline:
+      done = run_baseline(op, args);
+      break;
+#endif
+    default:
+      break;
+  }
+  // The remainder, one matrix at a time.
+  run_scalar(op, args, done);
+}
+
+}  // namespace
+
+SIMDLevel get_max_simd_level() {
+  static const SIMDLevel level = detect_max_simd_level();
+  return level;
+}
+
+SIMDLevel get_simd_level() {
+  return simd_level;
+}
+
+void set_simd_level(SIMDLevel level) {
+  simd_level = std::min(level, get_max_simd_level());
+}
+
+void svd3x3(int n,
+            const float32 *a,
+            float32 *u,
+            float32 *sigma,
+            float32 *v) {
+  run(Op::svd, BatchArgs<float32>{n, a, nullptr, u, sigma, v, 3, 3, 3});
+}
+
+void svd3x3(int n,
+            const float64 *a,
+            float64 *u,
+            float64 *sigma,
+            float64 *v) {
+  run(Op::svd, BatchArgs<float64>{n, a, nullptr, u, sigma, v, 3, 3, 3});
+}
+
+void polar_decompose3x3(int n, const float32 *a, float32 *r, float32 *s) {
+  run(Op::polar_decompose,
+      BatchArgs<float32>{n, a, nullptr, r, s, nullptr, 3, 3, 3});
+}
+
+void polar_decompose3x3(int n, const float64 *a, float64 *r, float64 *s) {
+  run(Op::polar_decompose,
+      BatchArgs<float64>{n, a, nullptr, r, s, nullptr, 3, 3, 3});
+}
+
+void matmul(int n,
+            int rows,
+            int inner,
+            int cols,
+            const float32 *a,
+            const float32 *b,
+            float32 *c) {
+  run(Op::matmul,
+      BatchArgs<float32>{n, a, b, c, nullptr, nullptr, rows, inner, cols});
+}
+
+void matmul(int n,
+            int rows,
+            int inner,
+            int cols,
+            const float64 *a,
+            const float64 *b,
+            float64 *c) {
+  run(Op::matmul,
+      BatchArgs<float64>{n, a, b, c, nullptr, nullptr, rows, inner, cols});
+}
+
+}  // namespace batched_linalg
+
+TI_NAMESPACE_END
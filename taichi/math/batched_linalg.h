@@ -0,0 +1,71 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include "taichi/common/core.h"
+
+TI_NAMESPACE_BEGIN
+
+// Host-side linear algebra on batches of small matrices, vectorized across
+// the matrices: AVX-512 processes 16 float32 (8 float64) matrices at a time,
+// AVX2 8 (4), and the baseline vectors (SSE or NEON) 4 (2). The widest
+// instruction set the CPU supports is picked at run time.
+//
+// The matrices of a batch are stored as a structure of arrays: entry (i, j)
+// of matrix k of a batch of n matrices of c columns is at
+// data[(i * c + j) * n + k]. Vectors are stored the same way, with entry i of
+// vector k at data[i * n + k].
+namespace batched_linalg {
+
+enum class SIMDLevel { none, baseline, avx2, avx512 };
+
+// The widest instruction set the CPU supports.
+SIMDLevel get_max_simd_level();
+
+SIMDLevel get_simd_level();
+
+// Uses at most |level|, e.g. SIMDLevel::none to compare with scalar code.
+void set_simd_level(SIMDLevel level);
+
+// A = U diag(sigma) V^T, where U and V are rotations and the singular values
+// sigma are sorted in descending magnitude. sigma[2] is negative if
+// det(A) < 0. The algorithm of McAdams et al. 2011, also used by
+// math/sifakis_svd.h, with 6 Jacobi sweeps in float32 and 8 in float64.
+void svd3x3(int n,
+            const float32 *a,
+            float32 *u,
+            float32 *sigma,
+            float32 *v);
+void svd3x3(int n,
+            const float64 *a,
+            float64 *u,
+            float64 *sigma,
+            float64 *v);
+
+// A = R S, where R = U V^T is a rotation and S = V diag(sigma) V^T is
+// symmetric.
+void polar_decompose3x3(int n, const float32 *a, float32 *r, float32 *s);
+void polar_decompose3x3(int n, const float64 *a, float64 *r, float64 *s);
+
+// C = A B, where A is |rows| x |inner| and B is |inner| x |cols|.
+void matmul(int n,
+            int rows,
+            int inner,
+            int cols,
+            const float32 *a,
+            const float32 *b,
+            float32 *c);
+void matmul(int n,
+            int rows,
+            int inner,
+            int cols,
+            const float64 *a,
+            const float64 *b,
+            float64 *c);
+
+}  // namespace batched_linalg
+
+TI_NAMESPACE_END
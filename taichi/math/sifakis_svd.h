@@ -1,6 +1,24 @@
+#pragma once
+
+// Also included by the LLVM runtime (runtime/llvm/runtime.cpp), so this only
+// depends on the standard library.
+
 #include <cmath>
 #include <algorithm>
-#include "taichi/common/core.h"
+
+#ifndef TI_FORCE_INLINE
+#ifdef _WIN64
+#define TI_FORCE_INLINE __forceinline
+#else
+#define TI_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+#endif
+
+#if defined(ARCH_cuda)
+// From libdevice, which is linked into the CUDA runtime module.
+extern "C" float __nv_rsqrtf(float x);
+extern "C" double __nv_rsqrt(double x);
+#endif
 
 namespace SifakisSVD {
 
@@ -39,7 +57,19 @@ A. McAdams, A. Selle, R. Tamstorf, J. Teran and E. Sifakis
 //#####################################################################
 
 TI_FORCE_INLINE float rsqrt(const float f) {
+#if defined(ARCH_cuda)
+  return __nv_rsqrtf(f);
+#else
   return 1.0f / std::sqrt(f);
+#endif
+}
+
+TI_FORCE_INLINE double rsqrt(const double f) {
+#if defined(ARCH_cuda)
+  return __nv_rsqrt(f);
+#else
+  return 1.0 / std::sqrt(f);
+#endif
 }
 
 constexpr float Four_Gamma_Squared = 5.82842712474619f;  // sqrt(8.) + 3.;
@@ -48,251 +78,255 @@ constexpr float Sine_Pi_Over_Eight =
 constexpr float Cosine_Pi_Over_Eight =
     0.9238795325112867f;  //.5 * sqrt(2. + sqrt(2.));
 
-template <int sweeps = 4>
-TI_FORCE_INLINE void svd(const float a11,
-                         const float a12,
-                         const float a13,
-                         const float a21,
-                         const float a22,
-                         const float a23,
-                         const float a31,
-                         const float a32,
-                         const float a33,
-                         float &u11,
-                         float &u12,
-                         float &u13,
-                         float &u21,
-                         float &u22,
-                         float &u23,
-                         float &u31,
-                         float &u32,
-                         float &u33,
-                         float &v11,
-                         float &v12,
-                         float &v13,
-                         float &v21,
-                         float &v22,
-                         float &v23,
-                         float &v31,
-                         float &v32,
-                         float &v33,
-                         float &sigma1,
-                         float &sigma2,
-                         float &sigma3) {
+// A = U diag(sigma) V^T, with |sweeps| Jacobi iterations. Tu is the unsigned
+// integer type of the same size as Tf, for the branchless selects.
+template <typename Tf, typename Tu>
+TI_FORCE_INLINE void svd(const Tf a11,
+                         const Tf a12,
+                         const Tf a13,
+                         const Tf a21,
+                         const Tf a22,
+                         const Tf a23,
+                         const Tf a31,
+                         const Tf a32,
+                         const Tf a33,
+                         Tf &u11,
+                         Tf &u12,
+                         Tf &u13,
+                         Tf &u21,
+                         Tf &u22,
+                         Tf &u23,
+                         Tf &u31,
+                         Tf &u32,
+                         Tf &u33,
+                         Tf &v11,
+                         Tf &v12,
+                         Tf &v13,
+                         Tf &v21,
+                         Tf &v22,
+                         Tf &v23,
+                         Tf &v31,
+                         Tf &v32,
+                         Tf &v33,
+                         Tf &sigma1,
+                         Tf &sigma2,
+                         Tf &sigma3,
+                         const int sweeps = 4) {
+  static_assert(sizeof(Tf) == sizeof(Tu), "");
   // var
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sfour_gamma_squared;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ssine_pi_over_eight;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Scosine_pi_over_eight;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sone_half;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sone;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Stiny_number;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ssmall_number;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa11;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa21;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa31;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa12;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa22;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa32;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa13;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa23;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sa33;
 
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv11;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv21;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv31;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv12;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv22;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv32;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv13;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv23;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sv33;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su11;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su21;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su31;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su12;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su22;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su32;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su13;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su23;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Su33;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sc;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ss;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sch;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ssh;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Stmp1;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Stmp2;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Stmp3;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Stmp4;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Stmp5;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sqvs;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sqvvx;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sqvvy;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Sqvvz;
 
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ss11;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ss21;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ss31;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ss22;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ss32;
   union {
-    float f;
-    unsigned int ui;
+    Tf f;
+    Tu ui;
   } Ss33;
 
   // compute
@@ -360,7 +394,7 @@ TI_FORCE_INLINE void svd(const float a11,
     Stmp5.f = Ss11.f - Ss22.f;
 
     Stmp2.f = Ssh.f * Ssh.f;
-    Stmp1.ui = (Stmp2.f >= Stiny_number.f) ? 0xffffffff : 0;
+    Stmp1.ui = (Stmp2.f >= Stiny_number.f) ? ~Tu(0) : 0;
     Ssh.ui = Stmp1.ui & Ssh.ui;
     Sch.ui = Stmp1.ui & Stmp5.ui;
     Stmp2.ui = ~Stmp1.ui & Sone.ui;
@@ -374,7 +408,7 @@ TI_FORCE_INLINE void svd(const float a11,
     Sch.f = Stmp4.f * Sch.f;
 
     Stmp1.f = Sfour_gamma_squared.f * Stmp1.f;
-    Stmp1.ui = (Stmp2.f <= Stmp1.f) ? 0xffffffff : 0;
+    Stmp1.ui = (Stmp2.f <= Stmp1.f) ? ~Tu(0) : 0;
 
     Stmp2.ui = Ssine_pi_over_eight.ui & Stmp1.ui;
     Ssh.ui = ~Stmp1.ui & Ssh.ui;
@@ -438,7 +472,7 @@ TI_FORCE_INLINE void svd(const float a11,
     Stmp5.f = Ss22.f - Ss33.f;
 
     Stmp2.f = Ssh.f * Ssh.f;
-    Stmp1.ui = (Stmp2.f >= Stiny_number.f) ? 0xffffffff : 0;
+    Stmp1.ui = (Stmp2.f >= Stiny_number.f) ? ~Tu(0) : 0;
     Ssh.ui = Stmp1.ui & Ssh.ui;
     Sch.ui = Stmp1.ui & Stmp5.ui;
     Stmp2.ui = ~Stmp1.ui & Sone.ui;
@@ -452,7 +486,7 @@ TI_FORCE_INLINE void svd(const float a11,
     Sch.f = Stmp4.f * Sch.f;
 
     Stmp1.f = Sfour_gamma_squared.f * Stmp1.f;
-    Stmp1.ui = (Stmp2.f <= Stmp1.f) ? 0xffffffff : 0;
+    Stmp1.ui = (Stmp2.f <= Stmp1.f) ? ~Tu(0) : 0;
 
     Stmp2.ui = Ssine_pi_over_eight.ui & Stmp1.ui;
     Ssh.ui = ~Stmp1.ui & Ssh.ui;
@@ -516,7 +550,7 @@ TI_FORCE_INLINE void svd(const float a11,
     Stmp5.f = Ss33.f - Ss11.f;
 
     Stmp2.f = Ssh.f * Ssh.f;
-    Stmp1.ui = (Stmp2.f >= Stiny_number.f) ? 0xffffffff : 0;
+    Stmp1.ui = (Stmp2.f >= Stiny_number.f) ? ~Tu(0) : 0;
     Ssh.ui = Stmp1.ui & Ssh.ui;
     Sch.ui = Stmp1.ui & Stmp5.ui;
     Stmp2.ui = ~Stmp1.ui & Sone.ui;
@@ -530,7 +564,7 @@ TI_FORCE_INLINE void svd(const float a11,
     Sch.f = Stmp4.f * Sch.f;
 
     Stmp1.f = Sfour_gamma_squared.f * Stmp1.f;
-    Stmp1.ui = (Stmp2.f <= Stmp1.f) ? 0xffffffff : 0;
+    Stmp1.ui = (Stmp2.f <= Stmp1.f) ? ~Tu(0) : 0;
 
     Stmp2.ui = Ssine_pi_over_eight.ui & Stmp1.ui;
     Ssh.ui = ~Stmp1.ui & Ssh.ui;
@@ -712,7 +746,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Stmp4.f = Sa33.f * Sa33.f;
   Stmp3.f = Stmp3.f + Stmp4.f;
 
-  Stmp4.ui = (Stmp1.f < Stmp2.f) ? 0xffffffff : 0;
+  Stmp4.ui = (Stmp1.f < Stmp2.f) ? ~Tu(0) : 0;
 
   Stmp5.ui = Sa11.ui ^ Sa12.ui;
   Stmp5.ui = Stmp5.ui & Stmp4.ui;
@@ -761,7 +795,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Sv12.f = Sv12.f * Stmp4.f;
   Sv22.f = Sv22.f * Stmp4.f;
   Sv32.f = Sv32.f * Stmp4.f;
-  Stmp4.ui = (Stmp1.f < Stmp3.f) ? 0xffffffff : 0;
+  Stmp4.ui = (Stmp1.f < Stmp3.f) ? ~Tu(0) : 0;
 
   Stmp5.ui = Sa11.ui ^ Sa13.ui;
   Stmp5.ui = Stmp5.ui & Stmp4.ui;
@@ -810,7 +844,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Sv11.f = Sv11.f * Stmp4.f;
   Sv21.f = Sv21.f * Stmp4.f;
   Sv31.f = Sv31.f * Stmp4.f;
-  Stmp4.ui = (Stmp2.f < Stmp3.f) ? 0xffffffff : 0;
+  Stmp4.ui = (Stmp2.f < Stmp3.f) ? ~Tu(0) : 0;
 
   Stmp5.ui = Sa12.ui ^ Sa13.ui;
   Stmp5.ui = Stmp5.ui & Stmp4.ui;
@@ -869,7 +903,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Su23.f = 0.0f;
   Su33.f = 1.0f;
   Ssh.f = Sa21.f * Sa21.f;
-  Ssh.ui = (Ssh.f >= Ssmall_number.f) ? 0xffffffff : 0;
+  Ssh.ui = (Ssh.f >= Ssmall_number.f) ? ~Tu(0) : 0;
 
   Ssh.ui = Ssh.ui & Sa21.ui;
 
@@ -877,7 +911,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Sch.f = Stmp5.f - Sa11.f;
   Sch.f = std::max(Sch.f, Sa11.f);
   Sch.f = std::max(Sch.f, Ssmall_number.f);
-  Stmp5.ui = (Sa11.f >= Stmp5.f) ? 0xffffffff : 0;
+  Stmp5.ui = (Sa11.f >= Stmp5.f) ? ~Tu(0) : 0;
 
   Stmp1.f = Sch.f * Sch.f;
   Stmp2.f = Ssh.f * Ssh.f;
@@ -964,7 +998,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Su31.f = Su31.f + Stmp2.f;
   Su32.f = Su32.f - Stmp1.f;
   Ssh.f = Sa31.f * Sa31.f;
-  Ssh.ui = (Ssh.f >= Ssmall_number.f) ? 0xffffffff : 0;
+  Ssh.ui = (Ssh.f >= Ssmall_number.f) ? ~Tu(0) : 0;
 
   Ssh.ui = Ssh.ui & Sa31.ui;
 
@@ -972,7 +1006,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Sch.f = Stmp5.f - Sa11.f;
   Sch.f = std::max(Sch.f, Sa11.f);
   Sch.f = std::max(Sch.f, Ssmall_number.f);
-  Stmp5.ui = (Sa11.f >= Stmp5.f) ? 0xffffffff : 0;
+  Stmp5.ui = (Sa11.f >= Stmp5.f) ? ~Tu(0) : 0;
 
   Stmp1.f = Sch.f * Sch.f;
   Stmp2.f = Ssh.f * Ssh.f;
@@ -1059,7 +1093,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Su31.f = Su31.f + Stmp2.f;
   Su33.f = Su33.f - Stmp1.f;
   Ssh.f = Sa32.f * Sa32.f;
-  Ssh.ui = (Ssh.f >= Ssmall_number.f) ? 0xffffffff : 0;
+  Ssh.ui = (Ssh.f >= Ssmall_number.f) ? ~Tu(0) : 0;
 
   Ssh.ui = Ssh.ui & Sa32.ui;
 
@@ -1067,7 +1101,7 @@ TI_FORCE_INLINE void svd(const float a11,
   Sch.f = Stmp5.f - Sa22.f;
   Sch.f = std::max(Sch.f, Sa22.f);
   Sch.f = std::max(Sch.f, Ssmall_number.f);
-  Stmp5.ui = (Sa22.f >= Stmp5.f) ? 0xffffffff : 0;
+  Stmp5.ui = (Sa22.f >= Stmp5.f) ? ~Tu(0) : 0;
 
   Stmp1.f = Sch.f * Sch.f;
   Stmp2.f = Ssh.f * Ssh.f;
@@ -1,4 +1,5 @@
 #include "taichi/ir/ir.h"
+#include "taichi/ir/frontend_ir.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -855,4 +856,59 @@ sifakis_svd_export(const Expr &a00,
                          Sa11, Sa22, Sa33);
 }
 
+// Same as sifakis_svd_export, but calls svd3x3_f32 or svd3x3_f64 of the LLVM
+// runtime instead of expanding the algorithm into statements, which compiles
+// much faster and, on CUDA, needs fewer registers. Not differentiable.
+template <typename Tf>
+std::tuple<Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr,
+           Expr>
+sifakis_svd_runtime(const Expr &a00,
+                    const Expr &a01,
+                    const Expr &a02,
+                    const Expr &a10,
+                    const Expr &a11,
+                    const Expr &a12,
+                    const Expr &a20,
+                    const Expr &a21,
+                    const Expr &a22,
+                    int num_iters) {
+  std::vector<Expr> args;
+  for (auto &a : {a00, a01, a02, a10, a11, a12, a20, a21, a22}) {
+    args.push_back(cast<Tf>(load_if_ptr(a)));
+  }
+  args.push_back(Expr(num_iters));
+  std::vector<Expr> rets;
+  for (int i = 0; i < 21; i++) {
+    rets.push_back(Var(Expr(Tf(0.0))));
+  }
+  auto func = fmt::format("svd3x3_{}",
+                          data_type_short_name(get_data_type<Tf>()));
+  current_ast_builder().insert(
+      Stmt::make<FrontendEvalStmt>(Expr::make<ExternalFuncCallExpression>(
+          nullptr, "", args, rets, func)));
+  return std::make_tuple(rets[0], rets[1], rets[2], rets[3], rets[4], rets[5],
+                         rets[6], rets[7], rets[8], rets[9], rets[10],
+                         rets[11], rets[12], rets[13], rets[14], rets[15],
+                         rets[16], rets[17], rets[18], rets[19], rets[20]);
+}
+
 TLANG_NAMESPACE_END
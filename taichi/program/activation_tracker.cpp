@@ -0,0 +1,133 @@
+#include "taichi/program/activation_tracker.h"
+
+#include <unordered_set>
+
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/ir.h"
+#include "taichi/ir/snode.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/program/kernel.h"
+#include "taichi/program/program.h"
+#include "taichi/util/statistics.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+// Inserts |snode| and its ancestors with a mask.
+void insert_masks(SNode *snode, std::unordered_set<SNode *> *masks) {
+  for (auto *s = snode; s != nullptr; s = s->parent) {
+    if (s->need_activation())
+      masks->insert(s);
+  }
+}
+}  // namespace
+
+ActivationTracker::ActivationTracker(Program *program) : program_(program) {
+}
+
+ActivationTracker::~ActivationTracker() = default;
+
+void ActivationTracker::analyze(Kernel *kernel) {
+  TI_AUTO_PROF;
+  std::unordered_set<SNode *> mask_writes, list_masks;
+  bool deactivates = false;
+  for (auto &s : kernel->ir->as<Block>()->statements) {
+    auto *offload = s->as<OffloadedStmt>();
+    if (offload->task_type == OffloadedStmt::TaskType::struct_for)
+      insert_masks(offload->snode, &list_masks);
+    if (offload->task_type == OffloadedStmt::TaskType::gc)
+      deactivates = true;
+    irpass::analysis::gather_statements(offload, [&](Stmt *stmt) {
+      if (auto *ptr = stmt->cast<GlobalPtrStmt>(); ptr && ptr->activate) {
+        for (int i = 0; i < ptr->width(); i++)
+          insert_masks(ptr->snodes[i], &mask_writes);
+      } else if (auto *op = stmt->cast<SNodeOpStmt>()) {
+        if (op->op_type == SNodeOpType::deactivate)
+          deactivates = true;
+        if (op->op_type == SNodeOpType::activate ||
+            op->op_type == SNodeOpType::deactivate ||
+            op->op_type == SNodeOpType::append)
+          insert_masks(op->snode, &mask_writes);
+      }
+      return false;
+    });
+  }
+
+  KernelInfo info;
+  info.mask_writes = {mask_writes.begin(), mask_writes.end()};
+  info.list_masks = {list_masks.begin(), list_masks.end()};
+  // Like the async engine, which generates the lists again after a task
+  // writes their masks, the lists must not change from one launch to the next.
+  bool lists_kept = !deactivates;
+  for (auto *s : list_masks) {
+    if (mask_writes.count(s) > 0)
+      lists_kept = false;
+  }
+  if (lists_kept && !kernel->is_accessor && !kernel->is_evaluator) {
+    auto demoted_ir = irpass::analysis::clone(kernel->ir.get(), kernel);
+    bool demoted = false;
+    for (auto &s : demoted_ir->as<Block>()->statements) {
+      auto *offload = s->as<OffloadedStmt>();
+      if (offload->task_type == OffloadedStmt::TaskType::struct_for) {
+        demoted |= irpass::demote_struct_for_activations(
+            offload, /*unconditional_only=*/true);
+      }
+    }
+    if (demoted)
+      info.demoted_ir = std::move(demoted_ir);
+  }
+
+  std::lock_guard<std::mutex> _(mut_);
+  kernels_[kernel] = std::move(info);
+}
+
+FunctionType ActivationTracker::record_launch(Kernel *kernel) {
+  KernelInfo *info = nullptr;
+  bool demote = false;
+  {
+    std::lock_guard<std::mutex> _(mut_);
+    const uint64 launch = ++num_launches_;
+    auto it = kernels_.find(kernel);
+    if (it == kernels_.end()) {
+      // E.g. loaded from an AOT module: it may write any mask.
+      last_invalidation_ = launch;
+      return kernel->compiled;
+    }
+    info = &it->second;
+    demote = info->demoted_ir != nullptr && info->last_launch > 0 &&
+             info->last_launch > last_invalidation_;
+    for (auto *masks : {&info->mask_writes, &info->list_masks}) {
+      for (auto *s : *masks) {
+        auto w = last_mask_writes_.find(s);
+        if (w != last_mask_writes_.end() && w->second > info->last_launch)
+          demote = false;
+      }
+    }
+    for (auto *s : info->mask_writes) {
+      last_mask_writes_[s] = launch;
+    }
+    info->last_launch = launch;
+  }
+  if (!demote)
+    return kernel->compiled;
+  return get_demoted(kernel, info);
+}
+
+void ActivationTracker::invalidate() {
+  std::lock_guard<std::mutex> _(mut_);
+  last_invalidation_ = ++num_launches_;
+}
+
+FunctionType ActivationTracker::get_demoted(Kernel *kernel, KernelInfo *info) {
+  std::lock_guard<std::recursive_mutex> _(program_->compile_mut);
+  if (!info->demoted) {
+    TI_TRACE("Compiling {} with the activations demoted", kernel->name);
+    info->demoted = program_->compile_offloaded_tasks(
+        *kernel, info->demoted_ir->as<Block>());
+    stat.add("sync_demoted_activation_kernels");
+  }
+  return info->demoted;
+}
+
+TLANG_NAMESPACE_END
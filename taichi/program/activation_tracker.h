@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class IRNode;
+class Kernel;
+class Program;
+class SNode;
+
+// The synchronous counterpart of StateFlowGraph::demote_activation(): tracks
+// which launches may have written the masks of the SNodes, so that a kernel
+// launched again on the same struct-for lists as its previous launch skips
+// the activations that this launch surely made. Those are the ones at the
+// loop indices and constants, run on every iteration.
+class ActivationTracker {
+ public:
+  explicit ActivationTracker(Program *program);
+
+  ~ActivationTracker();
+
+  // Must be called on the offloaded tasks of |kernel|, before they are
+  // lowered any further.
+  void analyze(Kernel *kernel);
+
+  // Records a launch of |kernel|, and returns the function to launch it with.
+  FunctionType record_launch(Kernel *kernel);
+
+  // Forgets what the previous launches activated, e.g. after the masks were
+  // modified outside of any kernel.
+  void invalidate();
+
+ private:
+  struct KernelInfo {
+    // The SNodes whose masks the kernel may write, or whose masks the lists
+    // of its struct-fors depend on.
+    std::vector<SNode *> mask_writes;
+    std::vector<SNode *> list_masks;
+    // The offloaded tasks with the activations demoted, or null if none can
+    // ever be demoted.
+    std::unique_ptr<IRNode> demoted_ir;
+    FunctionType demoted;
+    // The id of the previous launch, or 0.
+    uint64 last_launch{0};
+  };
+
+  FunctionType get_demoted(Kernel *kernel, KernelInfo *info);
+
+  Program *program_;
+  std::mutex mut_;
+  std::unordered_map<Kernel *, KernelInfo> kernels_;
+  // The id of the last launch that may have written the mask of each SNode.
+  std::unordered_map<SNode *, uint64> last_mask_writes_;
+  uint64 last_invalidation_{0};
+  uint64 num_launches_{0};
+};
+
+TLANG_NAMESPACE_END
@@ -6,114 +6,286 @@
 #include "taichi/program/program.h"
 #include "taichi/backends/cpu/codegen_cpu.h"
 #include "taichi/util/testing.h"
+#include "taichi/util/bit.h"
 #include "taichi/util/statistics.h"
 #include "taichi/ir/analysis.h"
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/program/extension.h"
+#include "taichi/system/tracer.h"
+#if defined(TI_WITH_CUDA)
+#include "taichi/backends/cuda/cuda_context.h"
+#include "taichi/backends/cuda/cuda_driver.h"
+#endif
 
 TLANG_NAMESPACE_BEGIN
 
-ParallelExecutor::ParallelExecutor(int num_threads)
-    : num_threads(num_threads),
-      status(ExecutorStatus::uninitialized),
-      running_threads(0) {
-  {
-    auto _ = std::lock_guard<std::mutex>(mut);
-
-    for (int i = 0; i < num_threads; i++) {
-      threads.emplace_back([this]() { this->worker_loop(); });
-    }
-
-    status = ExecutorStatus::initialized;
+ParallelExecutor::ParallelExecutor(int num_threads, int queue_capacity)
+    : num_threads(num_threads) {
+  TI_ASSERT(bit::is_power_of_two(queue_capacity));
+  mask = queue_capacity - 1;
+  ring = std::make_unique<Slot[]>(queue_capacity);
+  for (int i = 0; i < queue_capacity; i++) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([this]() { this->worker_loop(); });
   }
-  init_cv_.notify_all();
 }
 
 ParallelExecutor::~ParallelExecutor() {
-  // TODO: We should have a new ExecutorStatus, e.g. shutting_down, to prevent
-  // new tasks from being enqueued during shut down.
   flush();
   {
-    auto _ = std::lock_guard<std::mutex>(mut);
-    status = ExecutorStatus::finalized;
+    // Under |mut|, so that no worker misses the notification between
+    // checking |finalized| and going to sleep.
+    std::lock_guard<std::mutex> _(mut);
+    finalized = true;
   }
-  // Signal the workers that they need to shutdown.
   worker_cv_.notify_all();
   for (auto &th : threads) {
     th.join();
   }
 }
 
-void ParallelExecutor::enqueue(const TaskType &func) {
-  {
+bool ParallelExecutor::try_push(TaskType &func) {
+  auto pos = tail.load(std::memory_order_relaxed);
+  while (true) {
+    auto &slot = ring[pos & mask];
+    auto seq = slot.sequence.load(std::memory_order_acquire);
+    auto diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+    if (diff == 0) {
+      if (tail.compare_exchange_weak(pos, pos + 1,
+                                     std::memory_order_relaxed)) {
+        slot.task = std::move(func);
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // full
+    } else {
+      pos = tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool ParallelExecutor::try_pop(TaskType *func) {
+  auto pos = head.load(std::memory_order_relaxed);
+  while (true) {
+    auto &slot = ring[pos & mask];
+    auto seq = slot.sequence.load(std::memory_order_acquire);
+    auto diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+    if (diff == 0) {
+      if (head.compare_exchange_weak(pos, pos + 1,
+                                     std::memory_order_relaxed)) {
+        *func = std::move(slot.task);
+        slot.sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // empty
+    } else {
+      pos = head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool ParallelExecutor::try_pop_overflow(TaskType *func) {
+  if (num_overflow.load() == 0)
+    return false;
+  std::lock_guard<std::mutex> _(overflow_mut);
+  if (overflow.empty())
+    return false;
+  *func = std::move(overflow.front());
+  overflow.pop_front();
+  num_overflow--;
+  return true;
+}
+
+void ParallelExecutor::enqueue(TaskType func) {
+  num_pending++;
+  // Workers only take from |overflow| once the ring is empty, so the tasks
+  // behind one in |overflow| must follow it there.
+  if (num_overflow.load() > 0 || !try_push(func)) {
+    std::lock_guard<std::mutex> _(overflow_mut);
+    overflow.push_back(std::move(func));
+    num_overflow++;
+  }
+  num_queued++;
+  // A worker going to sleep counts itself in |num_sleeping| before it
+  // checks |num_queued| (both sequentially consistent), so either it sees
+  // the task, or we see it and wake it.
+  if (num_sleeping.load() > 0) {
     std::lock_guard<std::mutex> _(mut);
-    task_queue.push_back(func);
+    worker_cv_.notify_one();
   }
-  worker_cv_.notify_all();
 }
 
 void ParallelExecutor::flush() {
   std::unique_lock<std::mutex> lock(mut);
-  while (!flush_cv_cond()) {
+  while (num_pending.load() != 0) {
     flush_cv_.wait(lock);
   }
 }
 
-bool ParallelExecutor::flush_cv_cond() {
-  return (task_queue.empty() && running_threads == 0);
-}
-
 void ParallelExecutor::worker_loop() {
-  TI_DEBUG("Starting worker thread.");
-  {
+  TI_DEBUG("Worker thread initialized and running.");
+  // The failed polls before sleeping, as most tasks of the async engine
+  // come in bursts.
+  constexpr int kNumSpins = 1 << 10;
+  TaskType task;
+  int spins = 0;
+  while (true) {
+    if (try_pop(&task) || try_pop_overflow(&task)) {
+      num_queued--;
+      spins = 0;
+      task();
+      task.reset();
+      if (--num_pending == 0) {
+        // Under |mut|, so that flush() cannot miss it between checking
+        // |num_pending| and waiting.
+        std::lock_guard<std::mutex> _(mut);
+        flush_cv_.notify_all();
+      }
+      continue;
+    }
+    if (++spins < kNumSpins) {
+      std::this_thread::yield();
+      continue;
+    }
+    spins = 0;
     std::unique_lock<std::mutex> lock(mut);
-    while (status == ExecutorStatus::uninitialized) {
-      init_cv_.wait(lock);
+    num_sleeping++;
+    // |num_queued| is briefly negative when a task is popped before its
+    // enqueue counted it.
+    while (num_queued.load() <= 0 && !finalized) {
+      worker_cv_.wait(lock);
+    }
+    num_sleeping--;
+    if (finalized && num_queued.load() <= 0) {
+      break;
     }
   }
+}
 
-  TI_DEBUG("Worker thread initialized and running.");
-  bool done = false;
-  while (!done) {
-    bool notify_flush_cv = false;
-    {
-      std::unique_lock<std::mutex> lock(mut);
-      while (task_queue.empty() && status == ExecutorStatus::initialized) {
-        worker_cv_.wait(lock);
-      }
-      // So long as |task_queue| is not empty, we keep running.
-      if (!task_queue.empty()) {
-        auto task = task_queue.front();
-        running_threads++;
-        task_queue.pop_front();
-        lock.unlock();
-
-        // Run the task
-        task();
-
-        lock.lock();
-        running_threads--;
-      }
-      notify_flush_cv = flush_cv_cond();
-      if (status == ExecutorStatus::finalized && task_queue.empty()) {
-        done = true;
-      }
+void ExecutionQueue::enqueue(const TaskLaunchRecord &ker,
+                             const std::vector<int> &dependencies) {
+  ker.kernel->account_for_offloaded(ker.stmt());
+
+  auto *async_func = compile_async(ker);
+  const auto &config = ker.kernel->program.config;
+  // The kernel profiler times the tasks on the default stream.
+  const bool use_cuda_streams = config.arch == Arch::cuda &&
+                                config.async_cuda_num_streams > 1 &&
+                                !config.kernel_profiler;
+  if (!use_cuda_streams) {
+    launch_worker.enqueue([async_func, context = ker.context]() mutable {
+      auto func = async_func->get();
+      TI_TRACE_SCOPE("async", "launch");
+      func(context);
+    });
+    return;
+  }
+  num_cuda_streams_ = config.async_cuda_num_streams;
+  const int task_id = num_enqueued_tasks_++;
+  auto deps = dependencies;
+  for (auto &dep : deps) {
+    dep += batch_begin_;
+  }
+  const auto h = ker.ir_handle.hash();
+  auto iter = task_uses_random_.find(h);
+  if (iter == task_uses_random_.end()) {
+    const bool uses_random = !irpass::analysis::gather_statements(
+                                  ker.stmt(),
+                                  [](Stmt *s) { return s->is<RandStmt>(); })
+                                  .empty();
+    iter = task_uses_random_.emplace(h, uses_random).first;
+  }
+  if (iter->second) {
+    if (last_random_task_ >= 0) {
+      deps.push_back(last_random_task_);
     }
-    if (notify_flush_cv) {
-      // It is fine to notify |flush_cv_| while nobody is waiting on it.
-      flush_cv_.notify_one();
+    last_random_task_ = task_id;
+  }
+  launch_worker.enqueue(
+      [this, async_func, context = ker.context, task_id, deps]() mutable {
+        auto func = async_func->get();
+        TI_TRACE_SCOPE("async", "launch");
+        launch_on_cuda_stream(func, context, task_id, deps);
+      });
+}
+
+void ExecutionQueue::launch_on_cuda_stream(
+    const FunctionType &func,
+    Context &context,
+    int task_id,
+    const std::vector<int> &dependencies) {
+#if defined(TI_WITH_CUDA)
+  auto &cuda_context = CUDAContext::get_instance();
+  auto &driver = CUDADriver::get_instance();
+  TI_ASSERT(task_id == (int)task_streams_.size());
+  if (stream_last_tasks_.empty()) {
+    stream_last_tasks_.resize(num_cuda_streams_, -1);
+  }
+  // Continue on the stream of a dependency if it's the last task there, so
+  // that at least one dependency needs no event. Otherwise take a new stream.
+  int stream_id = -1;
+  for (int dep : dependencies) {
+    if (stream_last_tasks_[task_streams_[dep]] == dep) {
+      stream_id = task_streams_[dep];
+      break;
+    }
+  }
+  if (stream_id < 0) {
+    stream_id = next_stream_;
+    next_stream_ = (next_stream_ + 1) % num_cuda_streams_;
+  }
+  auto *stream = cuda_context.get_stream(stream_id);
+  for (int dep : dependencies) {
+    if (task_streams_[dep] != stream_id) {
+      driver.stream_wait_event(stream, cuda_context.get_event(dep), 0);
     }
   }
+  for (int dep : batch_barrier_tasks_) {
+    if (task_streams_[dep] != stream_id) {
+      driver.stream_wait_event(stream, cuda_context.get_event(dep), 0);
+    }
+  }
+  CUDAContext::set_current_stream(stream);
+  func(context);
+  CUDAContext::set_current_stream(nullptr);
+  driver.event_record(cuda_context.get_event(task_id), stream);
+  task_streams_.push_back(stream_id);
+  stream_last_tasks_[stream_id] = task_id;
+#else
+  TI_NOT_IMPLEMENTED;
+#endif
+}
+
+void ExecutionQueue::begin_batch() {
+  batch_begin_ = num_enqueued_tasks_;
+  if (batch_begin_ == 0)
+    return;
+  // The dependencies between the batches are not tracked. Order them as a
+  // whole, but let the tasks of the new batch run concurrently.
+  launch_worker.enqueue([this]() {
+    batch_barrier_tasks_.clear();
+    for (int task : stream_last_tasks_) {
+      if (task >= 0)
+        batch_barrier_tasks_.push_back(task);
+    }
+  });
+}
+
+void ExecutionQueue::compile_ahead(const TaskLaunchRecord &ker) {
+  compile_async(ker);
 }
 
-void ExecutionQueue::enqueue(const TaskLaunchRecord &ker) {
+ExecutionQueue::AsyncCompiledFunc *ExecutionQueue::compile_async(
+    const TaskLaunchRecord &ker) {
   auto h = ker.ir_handle.hash();
   auto *stmt = ker.stmt();
   auto kernel = ker.kernel;
 
-  kernel->account_for_offloaded(stmt);
-
   bool needs_compile = false;
   AsyncCompiledFunc *async_func = nullptr;
   {
@@ -130,6 +302,7 @@ void ExecutionQueue::enqueue(const TaskLaunchRecord &ker) {
     stmt = cloned_stmt->as<OffloadedStmt>();
 
     compilation_workers.enqueue([async_func, stmt, kernel, this]() {
+      TI_TRACE_SCOPE("async", kernel->name + " (compile)");
       {
         // Final lowering
         using namespace irpass;
@@ -149,16 +322,25 @@ void ExecutionQueue::enqueue(const TaskLaunchRecord &ker) {
     });
     ir_bank_->insert_to_trash_bin(std::move(cloned_stmt));
   }
-
-  launch_worker.enqueue([async_func, context = ker.context]() mutable {
-    auto func = async_func->get();
-    func(context);
-  });
+  return async_func;
 }
 
 void ExecutionQueue::synchronize() {
   TI_AUTO_PROF
   launch_worker.flush();
+  if (num_enqueued_tasks_ > 0) {
+#if defined(TI_WITH_CUDA)
+    CUDAContext::get_instance().synchronize_streams();
+#endif
+    // Task indices restart from 0, now that all the events have completed.
+    num_enqueued_tasks_ = 0;
+    batch_begin_ = 0;
+    batch_barrier_tasks_.clear();
+    last_random_task_ = -1;
+    task_streams_.clear();
+    stream_last_tasks_.clear();
+    next_stream_ = 0;
+  }
 }
 
 ExecutionQueue::ExecutionQueue(
@@ -170,6 +352,12 @@ ExecutionQueue::ExecutionQueue(
       compile_to_backend_(compile_to_backend) {
 }
 
+ExecutionQueue::~ExecutionQueue() {
+  // Speculative compilations may still be running, and they write to
+  // |compiled_funcs_|, which is destroyed before |compilation_workers|.
+  compilation_workers.flush();
+}
+
 AsyncEngine::AsyncEngine(Program *program,
                          const BackendExecCompilationFunc &compile_to_backend)
     : queue(&ir_bank_, compile_to_backend),
@@ -197,16 +385,84 @@ void AsyncEngine::launch(Kernel *kernel, Context &context) {
       irpass::re_id(cloned_offs.get());
       auto h = ir_bank_.get_hash(cloned_offs.get());
       kmeta.ir_handle_cached.emplace_back(cloned_offs.get(), h);
+      kmeta.cost_cached.push_back(
+          irpass::analysis::count_statements(cloned_offs.get()));
       ir_bank_.insert(std::move(cloned_offs), h);
     }
     TaskLaunchRecord rec(context, kernel, kmeta.ir_handle_cached[i]);
     records.push_back(rec);
+    cost_since_flush_ += kmeta.cost_cached[i];
+  }
+  num_tasks_since_flush_ += (int)records.size();
+  if (program->config.async_speculative_compilation) {
+    // Unless earlier syncs have shown that a task gets fused or eliminated,
+    // predict that it will be launched as-is, and compile it while the
+    // frontend keeps launching. Otherwise the first sync after a change
+    // stalls on compiling every task.
+    for (const auto &rec : records) {
+      const auto h = rec.ir_handle.hash();
+      launched_since_sync_.push_back(h);
+      if (optimized_away_.find(h) == optimized_away_.end()) {
+        queue.compile_ahead(rec);
+      }
+    }
   }
   sfg->insert_tasks(records, true);
+
+  const auto &config = program->config;
+  if ((config.async_flush_num_tasks > 0 &&
+       num_tasks_since_flush_ >= config.async_flush_num_tasks) ||
+      (config.async_flush_cost > 0 &&
+       cost_since_flush_ >= config.async_flush_cost)) {
+    flush();
+  }
 }
 
-void AsyncEngine::synchronize() {
+bool AsyncEngine::reuse_optimized_schedule(uint64 fingerprint) {
+  auto it = optimized_schedules_.find(fingerprint);
+  if (it == optimized_schedules_.end())
+    return false;
+  auto pending = sfg->get_pending_tasks();
+  std::vector<TaskLaunchRecord> records;
+  records.reserve(it->second.size());
+  for (auto &task : it->second) {
+    TI_ASSERT(task.source_index < (int)pending.size());
+    auto rec = pending[task.source_index]->rec;
+    rec.ir_handle = task.ir_handle;
+    records.push_back(rec);
+  }
+  sfg->replace_pending_tasks(records);
+  stat.add("sfg_reused_schedules", 1.0);
+  return true;
+}
+
+void AsyncEngine::save_optimized_schedule(
+    uint64 fingerprint,
+    const std::vector<TaskLaunchRecord> &pending) {
+  std::unordered_map<int, int> source_indices;
+  for (int i = 0; i < (int)pending.size(); i++) {
+    source_indices[pending[i].id] = i;
+  }
+  std::vector<OptimizedTask> schedule;
+  for (auto *node : sfg->get_pending_tasks()) {
+    if (node->rec.empty())
+      continue;
+    auto it = source_indices.find(node->rec.id);
+    if (it == source_indices.end()) {
+      // Not derived from a single pending task.
+      return;
+    }
+    schedule.push_back({it->second, node->rec.ir_handle});
+  }
+  if (optimized_schedules_.size() >= kMaxNumOptimizedSchedules)
+    optimized_schedules_.clear();
+  optimized_schedules_[fingerprint] = std::move(schedule);
+}
+
+void AsyncEngine::flush() {
   TI_AUTO_PROF
+  num_tasks_since_flush_ = 0;
+  cost_since_flush_ = 0;
   bool modified = true;
   sfg->reid_nodes();
   sfg->reid_pending_nodes();
@@ -216,6 +472,19 @@ void AsyncEngine::synchronize() {
   if (program->config.debug) {
     sfg->verify();
   }
+  const bool reuse_schedules = program->config.async_opt_reuse_schedules;
+  uint64 fingerprint = 0;
+  std::vector<TaskLaunchRecord> pending;
+  if (reuse_schedules) {
+    fingerprint = sfg->get_fingerprint();
+    if (reuse_optimized_schedule(fingerprint)) {
+      modified = false;
+    } else {
+      for (auto *node : sfg->get_pending_tasks()) {
+        pending.push_back(node->rec);
+      }
+    }
+  }
   while (modified) {
     modified = false;
     if (program->config.async_opt_activation_demotion) {
@@ -247,13 +516,33 @@ void AsyncEngine::synchronize() {
     }
     sfg->verify();
   }
+  if (!pending.empty()) {
+    save_optimized_schedule(fingerprint, pending);
+  }
   debug_sfg("final");
-  auto tasks = sfg->extract_to_execute();
+  std::vector<std::vector<int>> task_dependencies;
+  auto tasks = sfg->extract_to_execute(&task_dependencies);
   TI_TRACE("Ended up with {} nodes", tasks.size());
-  for (auto &task : tasks) {
-    queue.enqueue(task);
+  if (!tasks.empty())
+    stat.add("sfg_flushes", 1.0);
+  queue.begin_batch();
+  for (int i = 0; i < (int)tasks.size(); i++) {
+    queue.enqueue(tasks[i], task_dependencies[i]);
+  }
+  if (!launched_since_sync_.empty()) {
+    std::unordered_set<uint64> executed;
+    for (auto &task : tasks) {
+      executed.insert(task.ir_handle.hash());
+    }
+    for (auto h : launched_since_sync_) {
+      if (executed.find(h) == executed.end()) {
+        optimized_away_.insert(h);
+      } else {
+        optimized_away_.erase(h);
+      }
+    }
+    launched_since_sync_.clear();
   }
-  queue.synchronize();
 
   sync_counter_++;
   // Clear SFG debug stats
@@ -261,6 +550,12 @@ void AsyncEngine::synchronize() {
   cur_sync_sfg_debug_per_stage_counts_.clear();
 }
 
+void AsyncEngine::synchronize() {
+  TI_AUTO_PROF
+  flush();
+  queue.synchronize();
+}
+
 void AsyncEngine::debug_sfg(const std::string &stage) {
   auto prefix = program->config.async_opt_intermediate_file;
   if (prefix.empty())
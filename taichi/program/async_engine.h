@@ -6,6 +6,8 @@
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "taichi/ir/ir.h"
 #include "taichi/lang_util.h"
@@ -15,19 +17,26 @@
 #include "taichi/program/async_utils.h"
 #include "taichi/program/ir_bank.h"
 #include "taichi/program/state_flow_graph.h"
+#include "taichi/util/unique_function.h"
 
 TLANG_NAMESPACE_BEGIN
 
 // TODO(yuanming-hu): split into multiple files
 
+// Runs tasks on a pool of threads. The tasks wait in a bounded lock-free
+// ring, so that enqueuing the many small tasks of the async engine takes no
+// lock, and in a locked overflow queue once the ring is full. Tasks from a
+// single thread start in the order they were enqueued. Idle workers spin
+// for a while before they sleep, and an enqueue wakes at most one sleeping
+// worker.
 class ParallelExecutor {
  public:
-  using TaskType = std::function<void()>;
+  using TaskType = UniqueFunction;
 
-  explicit ParallelExecutor(int num_threads);
+  explicit ParallelExecutor(int num_threads, int queue_capacity = 4096);
   ~ParallelExecutor();
 
-  void enqueue(const TaskType &func);
+  void enqueue(TaskType func);
 
   void flush();
 
@@ -36,37 +45,41 @@ class ParallelExecutor {
   }
 
  private:
-  enum class ExecutorStatus {
-    uninitialized,
-    initialized,
-    finalized,
+  struct Slot {
+    // The ring position this slot holds a task for, plus one once the task
+    // is stored (Dmitry Vyukov's bounded MPMC queue).
+    std::atomic<std::size_t> sequence;
+    TaskType task;
   };
 
+  bool try_push(TaskType &func);
+  bool try_pop(TaskType *func);
+  bool try_pop_overflow(TaskType *func);
   void worker_loop();
 
-  // Must be called while holding |mut|.
-  bool flush_cv_cond();
-
   int num_threads;
-  std::mutex mut;
-
-  // All guarded by |mut|
-  ExecutorStatus status;
+  std::size_t mask;
+  std::unique_ptr<Slot[]> ring;
+  alignas(64) std::atomic<std::size_t> tail{0};
+  alignas(64) std::atomic<std::size_t> head{0};
+  // Tasks in the ring, and tasks enqueued but not finished.
+  std::atomic<int> num_queued{0};
+  std::atomic<int> num_pending{0};
+  std::atomic<int> num_sleeping{0};
+  std::atomic<bool> finalized{false};
   std::vector<std::thread> threads;
-  std::deque<TaskType> task_queue;
-  int running_threads;
-
-  // Used to signal the workers that they can start polling from |task_queue|.
-  std::condition_variable init_cv_;
-  // Used by |this| to instruct the worker thread that there is an event:
-  // * task being enqueued
-  // * shutting down
+
+  // Once the ring is full, the tasks go here until it is drained, keeping
+  // their order.
+  std::mutex overflow_mut;
+  std::deque<TaskType> overflow;
+  std::atomic<int> num_overflow{0};
+
+  // Guards the sleeps on the condition variables below.
+  std::mutex mut;
+  // Wakes the workers when a task is enqueued or on shutdown.
   std::condition_variable worker_cv_;
-  // Used by a worker thread to unblock the caller from waiting for a flush.
-  //
-  // TODO: Instead of having this as a member variable, we can enqueue a
-  // callback upon flush(). The flush() will then block waiting for that
-  // callback to be executed?
+  // Wakes the callers of flush() when no task is pending.
   std::condition_variable flush_cv_;
 };
 
@@ -85,7 +98,22 @@ class ExecutionQueue {
   explicit ExecutionQueue(IRBank *ir_bank,
                           const BackendExecCompilationFunc &compile_to_backend);
 
-  void enqueue(const TaskLaunchRecord &ker);
+  ~ExecutionQueue();
+
+  // |dependencies| are the indices of the tasks enqueued since the last
+  // begin_batch() that |ker| depends on. On CUDA, independent tasks can run on
+  // different streams. See CompileConfig::async_cuda_num_streams.
+  void enqueue(const TaskLaunchRecord &ker,
+               const std::vector<int> &dependencies = {});
+
+  // Starts a batch of tasks, which may be enqueued before the earlier
+  // batches complete. The tasks of a batch run after those of the earlier
+  // batches.
+  void begin_batch();
+
+  // Starts compiling |ker| on the compilation workers, if it is not compiled
+  // (or being compiled) yet, without launching it.
+  void compile_ahead(const TaskLaunchRecord &ker);
 
   void compile_task() {
   }
@@ -94,6 +122,8 @@ class ExecutionQueue {
   }
 
   void clear_cache() {
+    // In-flight compilations hold pointers into |compiled_funcs_|.
+    compilation_workers.flush();
     compiled_funcs_.clear();
   }
 
@@ -121,8 +151,34 @@ class ExecutionQueue {
   };
   std::unordered_map<uint64, AsyncCompiledFunc> compiled_funcs_;
 
+  AsyncCompiledFunc *compile_async(const TaskLaunchRecord &ker);
+
+  // Runs on |launch_worker|.
+  void launch_on_cuda_stream(const FunctionType &func,
+                             Context &context,
+                             int task_id,
+                             const std::vector<int> &dependencies);
+
   IRBank *ir_bank_;  // not owned
   BackendExecCompilationFunc compile_to_backend_;
+
+  // Number of tasks enqueued since the last synchronize()
+  int num_enqueued_tasks_{0};
+  // The index of the first task of the current batch
+  int batch_begin_{0};
+  int num_cuda_streams_{0};
+  // ti.random() updates states shared by all the tasks, so tasks using it are
+  // always serialized.
+  std::unordered_map<uint64, bool> task_uses_random_;
+  int last_random_task_{-1};
+  // Only accessed on |launch_worker|. The stream of each enqueued task, and the
+  // last task on each stream.
+  std::vector<int> task_streams_;
+  std::vector<int> stream_last_tasks_;
+  // The last tasks of the earlier batches on each stream, which the tasks of
+  // the current batch wait for.
+  std::vector<int> batch_barrier_tasks_;
+  int next_stream_{0};
 };
 
 // An engine for asynchronous execution and optimization
@@ -144,6 +200,10 @@ class AsyncEngine {
 
   void launch(Kernel *kernel, Context &context);
 
+  // Optimizes the pending tasks and enqueues them, without waiting for them
+  // to complete. The tasks launched afterwards are optimized while these run.
+  void flush();
+
   void synchronize();
 
   void debug_sfg(const std::string &suffix);
@@ -163,10 +223,36 @@ class AsyncEngine {
     // This design allows us to do task cloning lazily. It turned out that doing
     // clone on every kernel launch is too expensive.
     std::vector<IRHandle> ir_handle_cached;
+    // The number of statements of each task, as an estimate of its cost.
+    std::vector<int> cost_cached;
   };
 
   std::unordered_map<const Kernel *, KernelMeta> kernel_metas_;
-  // How many times we have synchronized
+  // Hashes of the tasks launched since the last sync, and of those that were
+  // not executed as-is in the syncs they were launched in. The latter are
+  // not compiled speculatively again.
+  std::vector<uint64> launched_since_sync_;
+  std::unordered_set<uint64> optimized_away_;
+
+  // The result of optimizing the graph of a sync, keyed by
+  // StateFlowGraph::get_fingerprint(). Each task copies the launch context of
+  // the pending task at |source_index|.
+  struct OptimizedTask {
+    int source_index;
+    IRHandle ir_handle;
+  };
+  std::unordered_map<uint64, std::vector<OptimizedTask>> optimized_schedules_;
+  static constexpr std::size_t kMaxNumOptimizedSchedules = 64;
+
+  // Returns false if there is no schedule of |fingerprint|.
+  bool reuse_optimized_schedule(uint64 fingerprint);
+  void save_optimized_schedule(uint64 fingerprint,
+                               const std::vector<TaskLaunchRecord> &pending);
+  // The tasks launched since the last flush(), and their estimated cost. See
+  // CompileConfig::async_flush_num_tasks.
+  int num_tasks_since_flush_{0};
+  int64 cost_since_flush_{0};
+  // How many times we have flushed
   int sync_counter_{0};
   int cur_sync_sfg_debug_counter_{0};
   std::unordered_map<std::string, int> cur_sync_sfg_debug_per_stage_counts_;
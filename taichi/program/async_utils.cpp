@@ -340,10 +340,50 @@ TaskMeta *get_task_meta(IRBank *ir_bank, const TaskLaunchRecord &t) {
     }
   }
 
+  // Running the task again with the same arguments rewrites the same values,
+  // unless it reads the states it writes or has other side effects.
+  const auto ty = root_stmt->task_type;
+  meta.idempotent = (ty == OffloadedTaskType::serial ||
+                     ty == OffloadedTaskType::range_for ||
+                     ty == OffloadedTaskType::struct_for) &&
+                    t.kernel->rets.empty();
+  for (auto &state : meta.output_states) {
+    if (state.type != AsyncState::Type::value || !state.holds_snode() ||
+        meta.input_states.count(state)) {
+      meta.idempotent = false;
+    }
+  }
+  if (meta.idempotent) {
+    meta.idempotent = gather_statements(root_stmt, [&](Stmt *stmt) {
+                        return stmt->is<AtomicOpStmt>() ||
+                               stmt->is<ExternalPtrStmt>() ||
+                               stmt->is<RandStmt>() || stmt->is<PrintStmt>() ||
+                               stmt->is<ExternalFuncCallStmt>() ||
+                               stmt->is<InternalFuncStmt>();
+                      }).empty();
+  }
+
   meta_bank[t.ir_handle] = meta;
   return &meta_bank[t.ir_handle];
 }
 
+bool StatementCountFusionCostModel::should_fuse(const TaskLaunchRecord &a,
+                                                const TaskLaunchRecord &b) {
+  if (max_statements_ <= 0)
+    return true;
+  // The fused task is simplified later, so this is an upper bound.
+  return get_num_statements(a.ir_handle) + get_num_statements(b.ir_handle) <=
+         max_statements_;
+}
+
+int StatementCountFusionCostModel::get_num_statements(const IRHandle &handle) {
+  auto iter = num_statements_.find(handle);
+  if (iter != num_statements_.end())
+    return iter->second;
+  return num_statements_[handle] = irpass::analysis::count_statements(
+             const_cast<IRNode *>(handle.ir()));
+}
+
 TaskFusionMeta get_task_fusion_meta(IRBank *bank, const TaskLaunchRecord &t) {
   TI_AUTO_PROF
   // TODO: this function should ideally take only an IRNode
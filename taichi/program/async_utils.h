@@ -211,6 +211,9 @@ struct TaskMeta {
   std::unordered_set<AsyncState> output_states;
   std::unordered_map<SNode *, GlobalPtrStmt *> loop_unique;
   std::unordered_map<const SNode *, bool> element_wise;
+  // If the task only writes SNode values that it doesn't read, and has no
+  // other side effects.
+  bool idempotent{false};
 
   void print() const;
 };
@@ -221,4 +224,33 @@ TaskMeta *get_task_meta(IRBank *bank, const TaskLaunchRecord &t);
 
 TaskFusionMeta get_task_fusion_meta(IRBank *bank, const TaskLaunchRecord &t);
 
+// Predicts whether fusing two fusible tasks pays off.
+class FusionCostModel {
+ public:
+  virtual ~FusionCostModel() = default;
+
+  // Returns if the task fusing |b| into |a| is predicted to be faster than
+  // launching |a| and |b| one after another.
+  virtual bool should_fuse(const TaskLaunchRecord &a,
+                           const TaskLaunchRecord &b) = 0;
+};
+
+// Rejects the fused tasks of more than |max_statements| statements, which
+// tend to spill registers and compile slowly. 0 accepts all the fusions.
+class StatementCountFusionCostModel : public FusionCostModel {
+ public:
+  explicit StatementCountFusionCostModel(int max_statements)
+      : max_statements_(max_statements) {
+  }
+
+  bool should_fuse(const TaskLaunchRecord &a,
+                   const TaskLaunchRecord &b) override;
+
+ private:
+  int get_num_statements(const IRHandle &handle);
+
+  int max_statements_;
+  std::unordered_map<IRHandle, int> num_statements_;
+};
+
 TLANG_NAMESPACE_END
@@ -0,0 +1,1243 @@
+#include "taichi/program/checkpoint.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/snode.h"
+#include "taichi/ir/statements.h"
+#include "taichi/math/arithmetic.h"
+#include "taichi/program/kernel.h"
+#include "taichi/program/program.h"
+#include "taichi/system/threading.h"
+#if defined(TI_WITH_CUDA)
+#include "taichi/backends/cuda/cuda_driver.h"
+#endif
+#if defined(TI_PLATFORM_UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'I', 'C', 'K', 'P', 'T', '\0', '\0'};
+// Bumped whenever the format changes.
+constexpr uint32 kVersion = 3;
+// The parts of the root buffer are saved at the same offset in a page of the
+// file as in the root buffer, so that they can be mapped.
+constexpr std::size_t kPageSize = 4096;
+// The granularity at which the root buffer is compared with the previous
+// checkpoint for deltas.
+constexpr std::size_t kChunkSize = 64 << 10;
+// The parts of the root buffer are copied from CUDA through a staging buffer
+// of this size, a multiple of |kChunkSize|.
+constexpr std::size_t kStagingSize = 64 << 20;
+// Compressed sections are split into frames of this size, which are
+// compressed in parallel.
+constexpr std::size_t kFrameSize = 1 << 20;
+
+struct FileHeader {
+  char magic[8];
+  uint32 version;
+  uint32 num_sections;
+  // The layout the checkpoint was taken of, see append_signature(), and the
+  // path of the parent checkpoint follow the header.
+  uint64 signature_size;
+  uint64 parent_path_size;
+  uint64 root_size;
+  // Random, to tell checkpoints apart.
+  uint64 id;
+  // Of the checkpoint this one is a delta of, 0 for full checkpoints.
+  uint64 parent_id;
+  // The section table is written after the sections.
+  uint64 table_offset;
+};
+
+enum class SectionKind : uint32 {
+  // Bytes of a child of the root in the root buffer.
+  root_range = 0,
+  // The indices of the active cells of a sparse SNode.
+  cells = 1,
+  // The indices of active cells of a place SNode, whole blocks sorted by
+  // block, followed by their values at an 8-byte aligned offset.
+  values = 2,
+};
+
+enum class Encoding : uint32 {
+  raw = 0,
+  // Frames of up to |kFrameSize| bytes compressed with deflate, each after
+  // its sizes before and after compression as two uint32.
+  deflate = 1,
+};
+
+struct Section {
+  SectionKind kind;
+  int32 snode_id;
+  // In bytes from the beginning of the file.
+  uint64 offset;
+  // Before and after encoding.
+  uint64 size;
+  uint64 stored_size;
+  // root_range only.
+  uint64 root_offset;
+  // cells and values only.
+  uint64 num_cells;
+  Encoding encoding;
+  // values only: 0 if the values are saved as they are, or 8, 16 or 32 if
+  // they are quantized to unsigned integers v of that many bits, standing for
+  // bias + v * scale.
+  uint32 value_bits;
+  float64 scale;
+  float64 bias;
+};
+
+bool is_sparse(SNodeType type) {
+  return type == SNodeType::pointer || type == SNodeType::hash ||
+         type == SNodeType::dynamic || type == SNodeType::bitmasked;
+}
+
+bool has_sparse_snodes(const SNode *snode) {
+  if (is_sparse(snode->type)) {
+    return true;
+  }
+  for (auto &ch : snode->ch) {
+    if (has_sparse_snodes(ch.get())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void append_signature(const SNode *snode, std::string &signature) {
+  signature += snode_type_name(snode->type);
+  for (int i = 0; i < snode->num_active_indices; i++) {
+    signature += fmt::format(" {}", snode->shape_along_axis(i));
+  }
+  if (snode->type == SNodeType::place) {
+    signature += " " + snode->dt->to_string();
+  }
+  signature += "(";
+  for (auto &ch : snode->ch) {
+    append_signature(ch.get(), signature);
+  }
+  signature += ")";
+}
+
+// The sparse SNodes and the fields whose cells are saved one by one.
+void collect_cell_snodes(SNode *snode, std::vector<SNode *> &snodes) {
+  if (is_sparse(snode->type) || snode->type == SNodeType::place) {
+    snodes.push_back(snode);
+  }
+  for (auto &ch : snode->ch) {
+    collect_cell_snodes(ch.get(), snodes);
+  }
+}
+
+// The closest sparse ancestor of a field, whose cells split it into blocks,
+// or null if the whole field is one block.
+SNode *get_block_snode(SNode *place) {
+  for (auto p = place->parent; p != nullptr; p = p->parent) {
+    if (is_sparse(p->type)) {
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+int get_key_size(const SNode *block_snode) {
+  return block_snode ? block_snode->num_active_indices : 0;
+}
+
+// The block of |block_snode| holding the cell at |indices| of it or of one
+// of its descendants.
+void get_block_key(const SNode *block_snode,
+                   const int32 *indices,
+                   int32 *key) {
+  for (int k = 0; k < get_key_size(block_snode); k++) {
+    key[k] = indices[k] >>
+             block_snode->extractors[block_snode->physical_index_position[k]]
+                 .start;
+  }
+}
+
+// The keys of |num_cells| cells sorted by block, and calls |func(begin, end)|
+// for the cells of each block.
+template <typename Func>
+void for_each_block(const int32 *keys,
+                    int32 num_cells,
+                    int key_size,
+                    const Func &func) {
+  int32 begin = 0;
+  for (int32 c = 1; c <= num_cells; c++) {
+    if (c == num_cells ||
+        !std::equal(keys + c * key_size, keys + (c + 1) * key_size,
+                    keys + begin * key_size)) {
+      func(begin, c);
+      begin = c;
+    }
+  }
+}
+
+std::size_t value_size(const SNode *snode) {
+  return data_type_size(snode->dt->get_compute_type());
+}
+
+std::size_t values_offset(const SNode *snode, uint64 num_cells) {
+  return iroundup((std::size_t)num_cells * snode->num_active_indices *
+                      sizeof(int32),
+                  (std::size_t)8);
+}
+
+uint64 rotl(uint64 x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// A 64-bit hash processing 32 bytes per step, after xxHash.
+uint64 hash_bytes(const void *data, std::size_t size, uint64 seed = 0) {
+  constexpr uint64 kPrime1 = 0x9E3779B185EBCA87ULL;
+  constexpr uint64 kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+  auto bytes = (const uint8 *)data;
+  uint64 acc[4] = {seed + kPrime1 + kPrime2, seed + kPrime2, seed,
+                   seed - kPrime1};
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (int k = 0; k < 4; k++) {
+      uint64 v;
+      std::memcpy(&v, bytes + i + k * 8, 8);
+      acc[k] = rotl(acc[k] + v * kPrime2, 31) * kPrime1;
+    }
+  }
+  uint64 h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) +
+             rotl(acc[3], 18) + size;
+  for (; i < size; i++) {
+    h = rotl(h ^ (bytes[i] * kPrime1), 11) * kPrime2;
+  }
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  return h;
+}
+
+// Compresses or decompresses frames on all the threads.
+struct FrameTask {
+  std::vector<const uint8 *> src;
+  std::vector<std::size_t> src_size;
+  std::vector<uint8 *> dest;
+  std::vector<std::size_t> dest_size;
+  std::vector<std::vector<uint8>> compressed;
+  int level{0};
+  std::atomic<bool> failed{false};
+
+  static void run(void *context, int k) {
+    auto task = (FrameTask *)context;
+    if (task->level > 0) {
+      task->compressed[k] =
+          zip::compress(task->src[k], task->src_size[k], task->level);
+    } else if (!zip::decompress(task->src[k], task->src_size[k],
+                                task->dest[k], task->dest_size[k])) {
+      task->failed = true;
+    }
+  }
+
+  void launch() {
+    if (src.empty()) {
+      return;
+    }
+    static ThreadPool pool;
+    // The pool runs one batch at a time.
+    static std::mutex pool_mut;
+    std::lock_guard<std::mutex> _(pool_mut);
+    pool.run((int)src.size(), pool.max_num_threads, this, &FrameTask::run);
+  }
+};
+
+// Quantizes the |num_values| floating-point values of |type| at |values| to
+// the closest multiples of 2 * |error_bound| above their minimum, in as few
+// bytes each as fit. Returns false, and leaves |section| alone, if they do
+// not fit into 32 bits, or are not all finite.
+bool quantize_values(const uint8 *values,
+                     uint64 num_values,
+                     Type *type,
+                     float64 error_bound,
+                     Section &section,
+                     std::vector<uint8> &quantized) {
+  const bool is_f64 = type->is_primitive(PrimitiveTypeID::f64);
+  auto get = [&](uint64 i) -> float64 {
+    if (is_f64) {
+      return ((const float64 *)values)[i];
+    }
+    return ((const float32 *)values)[i];
+  };
+  if (num_values == 0) {
+    return false;
+  }
+  float64 lo = get(0), hi = get(0);
+  for (uint64 i = 0; i < num_values; i++) {
+    auto v = get(i);
+    if (!std::isfinite(v)) {
+      return false;
+    }
+    lo = std::min(lo, v);
+    hi = std::max(hi, v);
+  }
+  const float64 scale = 2 * error_bound;
+  const float64 range = std::round((hi - lo) / scale);
+  uint32 bits = 8;
+  while (bits <= 32 && range >= std::ldexp(1.0, bits)) {
+    bits *= 2;
+  }
+  if (bits > 32 || (int)bits >= data_type_size(type) * 8) {
+    return false;
+  }
+  quantized.resize(num_values * bits / 8);
+  for (uint64 i = 0; i < num_values; i++) {
+    auto v = (uint32)std::round((get(i) - lo) / scale);
+    if (bits == 8) {
+      quantized[i] = (uint8)v;
+    } else if (bits == 16) {
+      ((uint16 *)quantized.data())[i] = (uint16)v;
+    } else {
+      ((uint32 *)quantized.data())[i] = v;
+    }
+  }
+  section.value_bits = bits;
+  section.scale = scale;
+  section.bias = lo;
+  return true;
+}
+
+void dequantize_values(const uint8 *quantized,
+                       uint64 num_values,
+                       const Section &section,
+                       Type *type,
+                       uint8 *values) {
+  const bool is_f64 = type->is_primitive(PrimitiveTypeID::f64);
+  for (uint64 i = 0; i < num_values; i++) {
+    uint32 v;
+    if (section.value_bits == 8) {
+      v = quantized[i];
+    } else if (section.value_bits == 16) {
+      v = ((const uint16 *)quantized)[i];
+    } else {
+      v = ((const uint32 *)quantized)[i];
+    }
+    auto value = section.bias + v * section.scale;
+    if (is_f64) {
+      ((float64 *)values)[i] = value;
+    } else {
+      ((float32 *)values)[i] = (float32)value;
+    }
+  }
+}
+
+struct Cells {
+  std::vector<int32> indices;
+  std::vector<uint8> values;
+  int32 num_cells{0};
+  // Of the blocks of the cells, once sorted.
+  std::vector<int32> keys;
+};
+
+Cells gather_cells(Program *prog, SNode *snode) {
+  if (snode->gather_kernel == nullptr) {
+    snode->gather_kernel = &prog->get_snode_gather_kernel(snode);
+  }
+  auto &kernel = *snode->gather_kernel;
+  const bool is_place = snode->type == SNodeType::place;
+  const int n = snode->num_active_indices;
+  Cells cells;
+  // Counts the cells first, and lists them once the buffers fit.
+  int32 capacity = 0;
+  while (true) {
+    int32 counter = 0;
+    cells.indices.resize(std::max(capacity, 1) * n);
+    auto ctx = kernel.make_launch_context();
+    ctx.set_arg_nparray(0, (uint64)&counter, sizeof(int32));
+    ctx.set_arg_nparray(1, (uint64)cells.indices.data(),
+                        cells.indices.size() * sizeof(int32));
+    if (is_place) {
+      cells.values.resize(std::max(capacity, 1) * value_size(snode));
+      ctx.set_arg_nparray(2, (uint64)cells.values.data(), cells.values.size());
+    }
+    ctx.set_arg_int(is_place ? 3 : 2, capacity);
+    kernel(ctx);
+    prog->synchronize();
+    if (counter <= capacity) {
+      cells.num_cells = counter;
+      break;
+    }
+    TI_ERROR_IF((int64)counter * n >= std::numeric_limits<int32>::max(),
+                "Too many active cells in {} for a checkpoint",
+                snode->get_node_type_name_hinted());
+    capacity = counter;
+  }
+  cells.indices.resize(cells.num_cells * n);
+  if (is_place) {
+    cells.values.resize(cells.num_cells * value_size(snode));
+  }
+  return cells;
+}
+
+// Sorts the cells by block, and then by indices, since they are gathered in
+// no particular order.
+void sort_cells(Cells &cells, const SNode *snode, const SNode *block_snode) {
+  const int n = snode->num_active_indices;
+  const int key_size = get_key_size(block_snode);
+  const std::size_t vsize =
+      snode->type == SNodeType::place ? value_size(snode) : 0;
+  std::vector<int32> keys(cells.num_cells * key_size);
+  for (int32 c = 0; c < cells.num_cells; c++) {
+    get_block_key(block_snode, &cells.indices[c * n], &keys[c * key_size]);
+  }
+  std::vector<int32> order(cells.num_cells);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int32 a, int32 b) {
+    for (int k = 0; k < key_size; k++) {
+      if (keys[a * key_size + k] != keys[b * key_size + k]) {
+        return keys[a * key_size + k] < keys[b * key_size + k];
+      }
+    }
+    for (int k = 0; k < n; k++) {
+      if (cells.indices[a * n + k] != cells.indices[b * n + k]) {
+        return cells.indices[a * n + k] < cells.indices[b * n + k];
+      }
+    }
+    return false;
+  });
+  Cells sorted;
+  sorted.num_cells = cells.num_cells;
+  sorted.indices.resize(cells.indices.size());
+  sorted.values.resize(cells.values.size());
+  sorted.keys.resize(keys.size());
+  for (int32 c = 0; c < cells.num_cells; c++) {
+    auto from = order[c];
+    std::copy_n(&cells.indices[from * n], n, &sorted.indices[c * n]);
+    std::copy_n(keys.begin() + from * key_size, key_size,
+                sorted.keys.begin() + c * key_size);
+    std::memcpy(sorted.values.data() + c * vsize,
+                cells.values.data() + from * vsize, vsize);
+  }
+  cells = std::move(sorted);
+}
+
+void scatter_cells(Program *prog,
+                   SNode *snode,
+                   const void *indices,
+                   const void *values,
+                   uint64 num_cells) {
+  if (num_cells == 0) {
+    return;
+  }
+  if (snode->scatter_kernel == nullptr) {
+    snode->scatter_kernel = &prog->get_snode_scatter_kernel(snode);
+  }
+  auto &kernel = *snode->scatter_kernel;
+  const bool is_place = snode->type == SNodeType::place;
+  const int n = snode->num_active_indices;
+  auto ctx = kernel.make_launch_context();
+  ctx.set_arg_nparray(0, (uint64)indices, num_cells * n * sizeof(int32));
+  if (is_place) {
+    ctx.set_arg_nparray(1, (uint64)values, num_cells * value_size(snode));
+  }
+  ctx.set_arg_int(is_place ? 2 : 1, (int64)num_cells);
+  kernel(ctx);
+}
+
+// Whether the root buffer is in CUDA device memory, rather than host or
+// unified memory.
+bool root_on_device(Program *prog) {
+  return prog->config.arch == Arch::cuda && !prog->config.use_unified_memory;
+}
+
+uint8 *get_root(Program *prog) {
+  return (uint8 *)prog->runtime_query<void *>("LLVMRuntime_get_root",
+                                              prog->llvm_runtime);
+}
+
+std::size_t get_root_size(Program *prog) {
+  return prog->runtime_query<std::size_t>("LLVMRuntime_get_root_mem_size",
+                                          prog->llvm_runtime);
+}
+
+void check_checkpoint_support(Program *prog) {
+  TI_ERROR_IF(prog->config.arch != Arch::x64 &&
+                  prog->config.arch != Arch::arm64 &&
+                  prog->config.arch != Arch::cuda,
+              "Checkpoints are only supported on CPU and CUDA");
+  TI_ERROR_IF(prog->llvm_runtime == nullptr,
+              "The layout must be materialized to take a checkpoint");
+}
+
+uint64 make_checkpoint_id() {
+  std::random_device device;
+  std::mt19937_64 gen(
+      ((uint64)device() << 32) ^ device() ^
+      (uint64)std::chrono::steady_clock::now().time_since_epoch().count());
+  uint64 id = 0;
+  while (id == 0) {
+    id = gen();
+  }
+  return id;
+}
+
+// A read-only view of a checkpoint file. Mapped on Unix, so that the sections
+// are not read before they are copied.
+class CheckpointFile {
+ public:
+  explicit CheckpointFile(const std::string &path) : path_(path) {
+#if defined(TI_PLATFORM_UNIX)
+    fd_ = open(path.c_str(), O_RDONLY);
+    TI_ERROR_IF(fd_ < 0, "Cannot open checkpoint [{}]", path);
+    struct stat st;
+    TI_ERROR_IF(fstat(fd_, &st) != 0, "Cannot open checkpoint [{}]", path);
+    size_ = (std::size_t)st.st_size;
+    if (size_ > 0) {
+      // Private and writable, since the CUDA launcher copies the external
+      // arrays of a kernel back after it.
+      auto ptr =
+          mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, 0);
+      TI_ERROR_IF(ptr == MAP_FAILED, "Cannot map checkpoint [{}]", path);
+      data_ = (uint8 *)ptr;
+    }
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    TI_ERROR_IF(!file, "Cannot open checkpoint [{}]", path);
+    size_ = (std::size_t)file.tellg();
+    buffer_.resize(size_);
+    file.seekg(0);
+    file.read((char *)buffer_.data(), size_);
+    data_ = buffer_.data();
+#endif
+    TI_ERROR_IF(size_ < sizeof(header) ||
+                    std::memcmp(data_, kMagic, sizeof(kMagic)) != 0,
+                "[{}] is not a checkpoint", path);
+    std::memcpy(&header, data_, sizeof(header));
+    TI_ERROR_IF(header.version != kVersion,
+                "Checkpoint [{}] has version {}, expected {}", path,
+                header.version, kVersion);
+    TI_ERROR_IF(
+        sizeof(header) + header.signature_size + header.parent_path_size >
+                size_ ||
+            header.table_offset + header.num_sections * sizeof(Section) >
+                size_,
+        "Checkpoint [{}] is truncated", path);
+    signature.assign((const char *)data_ + sizeof(header),
+                     header.signature_size);
+    parent_path.assign(
+        (const char *)data_ + sizeof(header) + header.signature_size,
+        header.parent_path_size);
+    sections.resize(header.num_sections);
+    std::memcpy(sections.data(), data_ + header.table_offset,
+                sections.size() * sizeof(Section));
+    for (auto &section : sections) {
+      TI_ERROR_IF(section.offset + section.stored_size > size_,
+                  "Checkpoint [{}] is truncated", path);
+    }
+  }
+
+  const std::string &path() const {
+    return path_;
+  }
+
+  uint8 *data() const {
+    return data_;
+  }
+
+  // The decoded bytes of |section|, valid as long as the file is open.
+  uint8 *get_data(const Section &section) {
+    if (section.encoding == Encoding::raw) {
+      return data_ + section.offset;
+    }
+    TI_ERROR_IF(section.encoding != Encoding::deflate,
+                "Checkpoint [{}] has an unknown encoding", path_);
+    decoded_.emplace_back(section.size);
+    auto dest = decoded_.back().data();
+    FrameTask task;
+    uint64 stored = 0, size = 0;
+    while (stored < section.stored_size) {
+      uint32 sizes[2];
+      TI_ERROR_IF(stored + sizeof(sizes) > section.stored_size,
+                  "Checkpoint [{}] is corrupted", path_);
+      std::memcpy(sizes, data_ + section.offset + stored, sizeof(sizes));
+      stored += sizeof(sizes);
+      TI_ERROR_IF(stored + sizes[1] > section.stored_size ||
+                      size + sizes[0] > section.size,
+                  "Checkpoint [{}] is corrupted", path_);
+      task.src.push_back(data_ + section.offset + stored);
+      task.src_size.push_back(sizes[1]);
+      task.dest.push_back(dest + size);
+      task.dest_size.push_back(sizes[0]);
+      stored += sizes[1];
+      size += sizes[0];
+    }
+    TI_ERROR_IF(size != section.size, "Checkpoint [{}] is corrupted", path_);
+    task.launch();
+    TI_ERROR_IF(task.failed, "Checkpoint [{}] is corrupted", path_);
+    return dest;
+  }
+
+  // The values of a values section decoded to |data|, as the compute type of
+  // |snode|.
+  uint8 *get_values(const Section &section, uint8 *data, SNode *snode) {
+    auto values = data + values_offset(snode, section.num_cells);
+    if (section.value_bits == 0) {
+      return values;
+    }
+    decoded_.emplace_back(section.num_cells * value_size(snode));
+    dequantize_values(values, section.num_cells, section,
+                      snode->dt->get_compute_type(), decoded_.back().data());
+    return decoded_.back().data();
+  }
+
+  // Maps |size| bytes of the file from |offset| to |dest| copy-on-write, as
+  // far as the pages of |dest| allow, and copies the rest. Returns the number
+  // of bytes mapped.
+  std::size_t map_copy_on_write(uint8 *dest, uint64 offset, std::size_t size) {
+    std::size_t mapped = 0;
+#if defined(TI_PLATFORM_UNIX)
+    const auto page_size = (std::size_t)sysconf(_SC_PAGESIZE);
+    auto head = iroundup((std::size_t)dest, page_size) - (std::size_t)dest;
+    if (head < size && (offset + head) % page_size == 0) {
+      mapped = (size - head) / page_size * page_size;
+    }
+    if (mapped > 0) {
+      auto ptr = mmap(dest + head, mapped, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_FIXED, fd_, (off_t)(offset + head));
+      TI_ERROR_IF(ptr == MAP_FAILED, "Cannot map the checkpoint");
+      std::memcpy(dest, data_ + offset, head);
+      std::memcpy(dest + head + mapped, data_ + offset + head + mapped,
+                  size - head - mapped);
+      return mapped;
+    }
+#endif
+    std::memcpy(dest, data_ + offset, size);
+    return mapped;
+  }
+
+  ~CheckpointFile() {
+#if defined(TI_PLATFORM_UNIX)
+    if (data_) {
+      munmap(data_, size_);
+    }
+    close(fd_);
+#endif
+  }
+
+  FileHeader header;
+  std::string signature;
+  std::string parent_path;
+  std::vector<Section> sections;
+
+ private:
+  std::string path_;
+  uint8 *data_{nullptr};
+  std::size_t size_{0};
+  std::deque<std::vector<uint8>> decoded_;
+#if defined(TI_PLATFORM_UNIX)
+  int fd_{-1};
+#else
+  std::vector<uint8> buffer_;
+#endif
+};
+
+// Where the parent of a delta checkpoint is: at the path it was saved to, or
+// next to the delta if the checkpoints were moved together.
+std::string find_parent(const std::string &path,
+                        const std::string &parent_path) {
+  if (std::ifstream(parent_path).good()) {
+    return parent_path;
+  }
+  auto dir_end = path.find_last_of("/\\");
+  auto name_begin = parent_path.find_last_of("/\\");
+  auto name = name_begin == std::string::npos
+                  ? parent_path
+                  : parent_path.substr(name_begin + 1);
+  return dir_end == std::string::npos ? name
+                                      : path.substr(0, dir_end + 1) + name;
+}
+
+}  // namespace
+
+struct Checkpointer::Writer {
+  Writer(const std::string &path,
+         int compression_level,
+         const std::unordered_map<int, float64> &error_bounds)
+      : path(path),
+        compression_level(compression_level),
+        error_bounds(error_bounds) {
+    file = std::fopen(path.c_str(), "wb");
+    TI_ERROR_IF(!file, "Cannot write checkpoint [{}]", path);
+  }
+
+  void write_file(const void *data, std::size_t size) {
+    TI_ERROR_IF(std::fwrite(data, 1, size, file) != size,
+                "Cannot write checkpoint [{}]", path);
+    written += size;
+  }
+
+  void pad_file_to(uint64 target) {
+    static const std::vector<uint8> zeros(kPageSize * 2, 0);
+    while (written < target) {
+      write_file(zeros.data(),
+                 std::min((std::size_t)(target - written), zeros.size()));
+    }
+  }
+
+  // Starts |section| at the next offset of the file that is |phase| past a
+  // multiple of |alignment|.
+  void begin_section(const Section &section,
+                     uint64 alignment,
+                     uint64 phase = 0) {
+    TI_ASSERT(!in_section);
+    in_section = true;
+    current = section;
+    current.encoding =
+        compression_level > 0 ? Encoding::deflate : Encoding::raw;
+    if (current.encoding != Encoding::raw) {
+      // Only raw sections are mapped.
+      alignment = 8;
+      phase = 0;
+    }
+    pad_file_to(iroundup(written, alignment) + phase);
+    current.offset = written;
+    current.size = 0;
+  }
+
+  void write(const void *data, std::size_t size) {
+    TI_ASSERT(in_section);
+    current.size += size;
+    if (current.encoding == Encoding::raw) {
+      write_file(data, size);
+      return;
+    }
+    pending.insert(pending.end(), (const uint8 *)data,
+                   (const uint8 *)data + size);
+    if (pending.size() >= kFrameSize * 64) {
+      write_frames(false);
+    }
+  }
+
+  // Pads the current section to |target| bytes.
+  void pad_to(uint64 target) {
+    static const std::vector<uint8> zeros(kPageSize * 2, 0);
+    while (current.size < target) {
+      write(zeros.data(),
+            std::min((std::size_t)(target - current.size), zeros.size()));
+    }
+  }
+
+  void end_section() {
+    TI_ASSERT(in_section);
+    if (current.encoding != Encoding::raw) {
+      write_frames(true);
+    }
+    current.stored_size = written - current.offset;
+    sections.push_back(current);
+    in_section = false;
+  }
+
+  // Compresses the pending bytes in frames, all of them or the full frames.
+  void write_frames(bool all) {
+    const auto num_frames =
+        all ? (pending.size() + kFrameSize - 1) / kFrameSize
+            : pending.size() / kFrameSize;
+    FrameTask task;
+    task.level = compression_level;
+    task.compressed.resize(num_frames);
+    for (std::size_t i = 0; i < num_frames; i++) {
+      task.src.push_back(pending.data() + i * kFrameSize);
+      task.src_size.push_back(
+          std::min(kFrameSize, pending.size() - i * kFrameSize));
+    }
+    task.launch();
+    for (std::size_t i = 0; i < num_frames; i++) {
+      uint32 sizes[2] = {(uint32)task.src_size[i],
+                         (uint32)task.compressed[i].size()};
+      write_file(sizes, sizeof(sizes));
+      write_file(task.compressed[i].data(), task.compressed[i].size());
+    }
+    pending.erase(pending.begin(),
+                  pending.begin() +
+                      std::min(pending.size(), num_frames * kFrameSize));
+  }
+
+  bool has_quantized_fields(const SNode *snode) const {
+    if (snode->type == SNodeType::place && get_error_bound(snode) > 0) {
+      return true;
+    }
+    for (auto &ch : snode->ch) {
+      if (has_quantized_fields(ch.get())) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // 0 if the values of field |snode| are saved as they are.
+  float64 get_error_bound(const SNode *snode) const {
+    if (!snode->dt->get_compute_type()->is_primitive(PrimitiveTypeID::f32) &&
+        !snode->dt->get_compute_type()->is_primitive(PrimitiveTypeID::f64)) {
+      return 0;
+    }
+    auto it = error_bounds.find(snode->id);
+    if (it == error_bounds.end()) {
+      // The bound of all the fields.
+      it = error_bounds.find(-1);
+    }
+    return it == error_bounds.end() ? 0 : it->second;
+  }
+
+  ~Writer() {
+    std::fclose(file);
+  }
+
+  std::string path;
+  std::FILE *file;
+  const int compression_level;
+  const std::unordered_map<int, float64> &error_bounds;
+  uint64 written{0};
+  std::vector<Section> sections;
+  bool in_section{false};
+  Section current;
+  std::vector<uint8> pending;
+};
+
+Checkpointer::Checkpointer(Program *prog) : prog_(prog) {
+}
+
+std::vector<int> Checkpointer::get_written_root_children(Kernel *kernel) {
+  if (prog_->config.async_mode) {
+    // The kernel is only lowered by the async engine.
+    return {-1};
+  }
+  std::unordered_set<int> ids;
+  bool unknown = false;
+  auto add = [&](SNode *snode) {
+    while (snode->parent && snode->parent->parent) {
+      snode = snode->parent;
+    }
+    if (snode->parent) {
+      ids.insert(snode->id);
+    }
+  };
+  irpass::analysis::gather_statements(kernel->ir.get(), [&](Stmt *stmt) {
+    Stmt *ptr = nullptr;
+    if (auto store = stmt->cast<GlobalStoreStmt>()) {
+      ptr = store->ptr;
+    } else if (auto atomic = stmt->cast<AtomicOpStmt>()) {
+      ptr = atomic->dest;
+    } else if (auto op = stmt->cast<SNodeOpStmt>()) {
+      if (op->op_type != SNodeOpType::is_active &&
+          op->op_type != SNodeOpType::length) {
+        add(op->snode);
+      }
+    }
+    if (ptr == nullptr) {
+      return false;
+    }
+    if (auto global_ptr = ptr->cast<GlobalPtrStmt>()) {
+      for (auto snode : global_ptr->snodes.data) {
+        add(snode);
+      }
+    } else if (auto get_ch = ptr->cast<GetChStmt>()) {
+      add(get_ch->output_snode);
+    } else if (!ptr->is<ExternalPtrStmt>() && !ptr->is<AllocaStmt>() &&
+               !ptr->is<StackAllocaStmt>() && !ptr->is<ThreadLocalPtrStmt>() &&
+               !ptr->is<BlockLocalPtrStmt>() &&
+               !ptr->is<GlobalTemporaryStmt>()) {
+      unknown = true;
+    }
+    return false;
+  });
+  if (unknown) {
+    return {-1};
+  }
+  return std::vector<int>(ids.begin(), ids.end());
+}
+
+void Checkpointer::record_launch(Kernel *kernel) {
+  if (id_ == 0 || all_written_) {
+    return;
+  }
+  auto it = kernel_writes_.find(kernel);
+  if (it == kernel_writes_.end()) {
+    it = kernel_writes_.emplace(kernel, get_written_root_children(kernel))
+             .first;
+  }
+  for (auto id : it->second) {
+    if (id < 0) {
+      all_written_ = true;
+      return;
+    }
+    written_.insert(id);
+  }
+}
+
+void Checkpointer::save_root_range(Writer &writer, int snode_id, bool delta) {
+  auto [root_offset, size] = prog_->get_root_child_ranges().at(snode_id);
+  auto root = get_root(prog_) + root_offset;
+  auto &hashes = chunk_hashes_[snode_id];
+  hashes.resize((size + kChunkSize - 1) / kChunkSize);
+  std::vector<uint8> staging;
+  for (std::size_t window = 0; window < size; window += kStagingSize) {
+    const auto window_size = std::min(kStagingSize, size - window);
+    const uint8 *src = root + window;
+    if (root_on_device(prog_)) {
+#if defined(TI_WITH_CUDA)
+      staging.resize(window_size);
+      CUDADriver::get_instance().memcpy_device_to_host(
+          staging.data(), (void *)src, window_size);
+      src = staging.data();
+#else
+      TI_NOT_IMPLEMENTED
+#endif
+    }
+    for (std::size_t i = 0; i < window_size; i += kChunkSize) {
+      const auto chunk_size = std::min(kChunkSize, window_size - i);
+      auto &hash = hashes[(window + i) / kChunkSize];
+      auto new_hash = hash_bytes(src + i, chunk_size);
+      if (delta && new_hash == hash) {
+        if (writer.in_section) {
+          writer.end_section();
+        }
+        continue;
+      }
+      hash = new_hash;
+      if (!writer.in_section) {
+        // The root buffer is page-aligned.
+        const auto chunk_offset = root_offset + window + i;
+        Section section{};
+        section.kind = SectionKind::root_range;
+        section.snode_id = snode_id;
+        section.root_offset = chunk_offset;
+        writer.begin_section(section, kPageSize, chunk_offset % kPageSize);
+      }
+      writer.write(src + i, chunk_size);
+    }
+  }
+  if (writer.in_section) {
+    writer.end_section();
+  }
+}
+
+void Checkpointer::save_sparse_subtree(Writer &writer,
+                                       SNode *snode,
+                                       bool delta) {
+  std::vector<SNode *> cell_snodes;
+  collect_cell_snodes(snode, cell_snodes);
+  for (auto snode : cell_snodes) {
+    const int n = snode->num_active_indices;
+    auto cells = gather_cells(prog_, snode);
+    Section section{};
+    section.snode_id = snode->id;
+    if (snode->type != SNodeType::place) {
+      sort_cells(cells, snode, nullptr);
+      auto hash = hash_bytes(cells.indices.data(),
+                             cells.indices.size() * sizeof(int32));
+      auto it = cells_hashes_.find(snode->id);
+      if (delta && it != cells_hashes_.end() && it->second == hash) {
+        continue;
+      }
+      cells_hashes_[snode->id] = hash;
+      section.kind = SectionKind::cells;
+      section.num_cells = cells.num_cells;
+      writer.begin_section(section, 8);
+      writer.write(cells.indices.data(), cells.indices.size() * sizeof(int32));
+      writer.end_section();
+      continue;
+    }
+    auto block_snode = get_block_snode(snode);
+    const int key_size = get_key_size(block_snode);
+    const auto vsize = value_size(snode);
+    sort_cells(cells, snode, block_snode);
+    // Only the blocks that changed go into a delta.
+    auto &old_hashes = block_hashes_[snode->id];
+    std::map<std::vector<int32>, uint64> new_hashes;
+    std::vector<std::pair<int32, int32>> dirty_blocks;
+    uint64 num_dirty_cells = 0;
+    for_each_block(
+        cells.keys.data(), cells.num_cells, key_size,
+        [&](int32 begin, int32 end) {
+          std::vector<int32> key(cells.keys.begin() + begin * key_size,
+                                 cells.keys.begin() + (begin + 1) * key_size);
+          auto hash = hash_bytes(&cells.indices[begin * n],
+                                 (end - begin) * n * sizeof(int32));
+          hash = hash_bytes(&cells.values[begin * vsize],
+                            (end - begin) * vsize, hash);
+          auto it = old_hashes.find(key);
+          if (!delta || it == old_hashes.end() || it->second != hash) {
+            dirty_blocks.emplace_back(begin, end);
+            num_dirty_cells += end - begin;
+          }
+          new_hashes.emplace(std::move(key), hash);
+        });
+    old_hashes = std::move(new_hashes);
+    if (delta && num_dirty_cells == 0) {
+      continue;
+    }
+    std::vector<uint8> values;
+    for (auto [begin, end] : dirty_blocks) {
+      values.insert(values.end(), cells.values.begin() + begin * vsize,
+                    cells.values.begin() + end * vsize);
+    }
+    section.kind = SectionKind::values;
+    section.num_cells = num_dirty_cells;
+    if (auto error_bound = writer.get_error_bound(snode); error_bound > 0) {
+      std::vector<uint8> quantized;
+      if (quantize_values(values.data(), num_dirty_cells,
+                          snode->dt->get_compute_type(), error_bound, section,
+                          quantized)) {
+        values = std::move(quantized);
+      }
+    }
+    writer.begin_section(section, 8);
+    for (auto [begin, end] : dirty_blocks) {
+      writer.write(&cells.indices[begin * n],
+                   (end - begin) * n * sizeof(int32));
+    }
+    writer.pad_to(values_offset(snode, num_dirty_cells));
+    writer.write(values.data(), values.size());
+    writer.end_section();
+  }
+}
+
+void Checkpointer::save(const std::string &path,
+                        bool delta,
+                        int compression_level,
+                        const std::unordered_map<int, float64> &error_bounds) {
+  check_checkpoint_support(prog_);
+  TI_ERROR_IF(delta && id_ == 0,
+              "A delta checkpoint needs a checkpoint saved earlier by this "
+              "program");
+  TI_ERROR_IF(compression_level < 0 || compression_level > 9,
+              "The compression level must be from 0 to 9, not {}",
+              compression_level);
+  prog_->synchronize();
+  std::string signature;
+  append_signature(prog_->snode_root.get(), signature);
+  const auto parent_path = delta ? path_ : std::string();
+
+  Writer writer(path, compression_level, error_bounds);
+  FileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.signature_size = signature.size();
+  header.parent_path_size = parent_path.size();
+  header.root_size = get_root_size(prog_);
+  header.id = make_checkpoint_id();
+  header.parent_id = delta ? id_ : 0;
+  writer.write_file(&header, sizeof(header));
+  writer.write_file(signature.data(), signature.size());
+  writer.write_file(parent_path.data(), parent_path.size());
+  if (!delta) {
+    chunk_hashes_.clear();
+    cells_hashes_.clear();
+    block_hashes_.clear();
+    saved_as_cells_.clear();
+    for (auto &ch : prog_->snode_root->ch) {
+      if (has_sparse_snodes(ch.get()) ||
+          writer.has_quantized_fields(ch.get())) {
+        saved_as_cells_.insert(ch->id);
+      }
+    }
+  }
+  int num_saved = 0;
+  for (auto &ch : prog_->snode_root->ch) {
+    if (delta && !all_written_ && written_.count(ch->id) == 0) {
+      continue;
+    }
+    num_saved++;
+    // Deltas save the children the same way as the full checkpoint did, so
+    // that they are restored in order.
+    if (saved_as_cells_.count(ch->id)) {
+      save_sparse_subtree(writer, ch.get(), delta);
+    } else if (prog_->get_root_child_ranges().count(ch->id)) {
+      save_root_range(writer, ch->id, delta);
+    }
+  }
+  writer.pad_file_to(iroundup(writer.written, (uint64)8));
+  header.num_sections = (uint32)writer.sections.size();
+  header.table_offset = writer.written;
+  writer.write_file(writer.sections.data(),
+                    writer.sections.size() * sizeof(Section));
+  TI_ERROR_IF(std::fseek(writer.file, 0, SEEK_SET) != 0 ||
+                  std::fwrite(&header, sizeof(header), 1, writer.file) != 1,
+              "Cannot write checkpoint [{}]", path);
+  TI_TRACE("Saved {}checkpoint [{}] of {}/{} children of the root ({} MB)",
+           delta ? "delta " : "", path, num_saved,
+           prog_->snode_root->ch.size(), writer.written >> 20);
+  id_ = header.id;
+  path_ = path;
+  written_.clear();
+  all_written_ = false;
+}
+
+void Checkpointer::load(const std::string &path, bool copy_on_write) {
+  check_checkpoint_support(prog_);
+  prog_->synchronize();
+  std::string signature;
+  append_signature(prog_->snode_root.get(), signature);
+  // The full checkpoint first, then the deltas of it.
+  std::vector<std::unique_ptr<CheckpointFile>> files;
+  files.push_back(std::make_unique<CheckpointFile>(path));
+  while (files.back()->header.parent_id != 0) {
+    auto &child = *files.back();
+    auto parent = std::make_unique<CheckpointFile>(
+        find_parent(child.path(), child.parent_path));
+    TI_ERROR_IF(parent->header.id != child.header.parent_id,
+                "Checkpoint [{}] is not the one [{}] is a delta of",
+                parent->path(), child.path());
+    files.push_back(std::move(parent));
+  }
+  std::reverse(files.begin(), files.end());
+  for (auto &file : files) {
+    TI_ERROR_IF(file->signature != signature ||
+                    file->header.root_size != get_root_size(prog_),
+                "Checkpoint [{}] was taken of a different layout",
+                file->path());
+    for (auto &section : file->sections) {
+      TI_ERROR_IF(
+          section.kind != SectionKind::root_range &&
+              prog_->snodes.find(section.snode_id) == prog_->snodes.end(),
+          "Checkpoint [{}] was taken of a different layout", file->path());
+    }
+  }
+
+  auto root = get_root(prog_);
+  std::size_t mapped = 0;
+  for (auto &file : files) {
+    for (auto &section : file->sections) {
+      if (section.kind != SectionKind::root_range) {
+        continue;
+      }
+      auto dest = root + section.root_offset;
+      if (copy_on_write && arch_is_cpu(prog_->config.arch) &&
+          section.encoding == Encoding::raw) {
+        mapped += file->map_copy_on_write(dest, section.offset, section.size);
+        continue;
+      }
+      auto src = file->get_data(section);
+      if (root_on_device(prog_)) {
+#if defined(TI_WITH_CUDA)
+        CUDADriver::get_instance().memcpy_host_to_device(dest, src,
+                                                         section.size);
+#else
+        TI_NOT_IMPLEMENTED
+#endif
+      } else {
+        std::memcpy(dest, src, section.size);
+      }
+    }
+  }
+  prog_->on_root_buffer_host_access();
+
+  // The latest active cells of each sparse SNode.
+  std::unordered_map<int, std::pair<const int32 *, uint64>> cells;
+  for (auto &file : files) {
+    for (auto &section : file->sections) {
+      if (section.kind == SectionKind::cells) {
+        cells[section.snode_id] = {(const int32 *)file->get_data(section),
+                                   section.num_cells};
+      }
+    }
+  }
+  for (auto &[id, list] : cells) {
+    scatter_cells(prog_, prog_->snodes[id], list.first, nullptr, list.second);
+  }
+  // The latest values of each block of each field.
+  struct Block {
+    const int32 *indices;
+    const uint8 *values;
+    int32 num_cells;
+  };
+  std::map<int, std::map<std::vector<int32>, Block>> blocks;
+  for (auto &file : files) {
+    for (auto &section : file->sections) {
+      if (section.kind != SectionKind::values) {
+        continue;
+      }
+      auto snode = prog_->snodes[section.snode_id];
+      auto data = file->get_data(section);
+      auto indices = (const int32 *)data;
+      auto values = file->get_values(section, data, snode);
+      if (files.size() == 1) {
+        // Nothing to merge.
+        scatter_cells(prog_, snode, indices, values, section.num_cells);
+        continue;
+      }
+      auto block_snode = get_block_snode(snode);
+      const int n = snode->num_active_indices;
+      const int key_size = get_key_size(block_snode);
+      const auto vsize = value_size(snode);
+      std::vector<int32> keys(section.num_cells * key_size);
+      for (uint64 c = 0; c < section.num_cells; c++) {
+        get_block_key(block_snode, indices + c * n, &keys[c * key_size]);
+      }
+      auto &field_blocks = blocks[snode->id];
+      for_each_block(keys.data(), (int32)section.num_cells, key_size,
+                     [&](int32 begin, int32 end) {
+                       std::vector<int32> key(
+                           keys.begin() + begin * key_size,
+                           keys.begin() + (begin + 1) * key_size);
+                       field_blocks[std::move(key)] =
+                           Block{indices + begin * n, values + begin * vsize,
+                                 end - begin};
+                     });
+    }
+  }
+  for (auto &[id, field_blocks] : blocks) {
+    auto snode = prog_->snodes[id];
+    auto block_snode = get_block_snode(snode);
+    const int n = snode->num_active_indices;
+    const int key_size = get_key_size(block_snode);
+    const auto vsize = value_size(snode);
+    // The blocks deactivated since they were saved are left out.
+    std::set<std::vector<int32>> active;
+    if (block_snode) {
+      auto it = cells.find(block_snode->id);
+      std::vector<int32> key(key_size);
+      for (uint64 c = 0; it != cells.end() && c < it->second.second; c++) {
+        get_block_key(block_snode,
+                      it->second.first + c * block_snode->num_active_indices,
+                      key.data());
+        active.insert(key);
+      }
+    }
+    std::vector<int32> indices;
+    std::vector<uint8> values;
+    for (auto &[key, block] : field_blocks) {
+      if (block_snode && active.count(key) == 0) {
+        continue;
+      }
+      indices.insert(indices.end(), block.indices,
+                     block.indices + block.num_cells * n);
+      values.insert(values.end(), block.values,
+                    block.values + block.num_cells * vsize);
+    }
+    scatter_cells(prog_, snode, indices.data(), values.data(),
+                  indices.size() / n);
+    prog_->synchronize();
+  }
+  prog_->synchronize();
+  TI_TRACE("Loaded checkpoint [{}] after {} others, {} MB mapped "
+           "copy-on-write",
+           path, files.size() - 1, mapped >> 20);
+  // What the fields hold is only known once saved again.
+  id_ = 0;
+  written_.clear();
+  all_written_ = false;
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Kernel;
+class Program;
+class SNode;
+
+// Snapshots of all the fields of a program on CPU and CUDA, in a versioned
+// binary file.
+//
+// The children of the root without sparse SNodes (pointer, hash, dynamic or
+// bitmasked) are saved as their bytes in the root buffer, which are restored
+// with a single copy. The others are saved as the indices of the active cells
+// of each of their sparse SNodes, and the values of the active cells of each
+// of their fields: the nodes that sparse SNodes point to are at different
+// addresses from one run to the next, so restoring activates the cells again,
+// which rebuilds the state of the node allocators.
+//
+// A delta checkpoint only holds what changed since the previous checkpoint,
+// and names that one as its parent. The children of the root that no kernel
+// wrote since are skipped outright. Of the others, only the chunks of the
+// root buffer, and the blocks of the fields (the cells under one cell of
+// their closest sparse ancestor), whose hashes differ from the previous
+// checkpoint are saved.
+//
+// For archiving, the sections can be compressed, and the values of
+// floating-point fields quantized within an error bound, which saves the
+// children of the root holding them as cells too.
+class Checkpointer {
+ public:
+  explicit Checkpointer(Program *prog);
+
+  // A delta is relative to the checkpoint this program saved last. With a
+  // |compression_level| from 1 to 9, the sections are compressed in frames
+  // with deflate, in parallel. |error_bounds| maps the ids of floating-point
+  // fields, or -1 for all of them, to the largest error their values may be
+  // saved with: such values are quantized to 8, 16 or 32-bit integers.
+  void save(const std::string &path,
+            bool delta,
+            int compression_level,
+            const std::unordered_map<int, float64> &error_bounds);
+
+  // Restores a checkpoint that a program with the same layout saved, after
+  // the checkpoints it is a delta of. The sparse SNodes must have no active
+  // cells. With |copy_on_write| on CPU, the pages of the root buffer are
+  // mapped from the files copy-on-write rather than copied, so that only the
+  // pages accessed later on are read.
+  void load(const std::string &path, bool copy_on_write);
+
+  // Marks the children of the root that |kernel| writes as changed.
+  void record_launch(Kernel *kernel);
+
+ private:
+  // Ids of the children of the root that |kernel| may write, or -1 if it
+  // writes memory that cannot be told apart.
+  std::vector<int> get_written_root_children(Kernel *kernel);
+
+  // The file being saved.
+  struct Writer;
+
+  void save_root_range(Writer &writer, int snode_id, bool delta);
+
+  void save_sparse_subtree(Writer &writer, SNode *snode, bool delta);
+
+  Program *prog_;
+  // Of the last checkpoint saved, 0 if there is none to save a delta of.
+  uint64 id_{0};
+  std::string path_;
+  // The children of the root written since the last checkpoint.
+  std::unordered_set<int> written_;
+  bool all_written_{false};
+  std::unordered_map<Kernel *, std::vector<int>> kernel_writes_;
+  // What the last checkpoint holds, as hashes: of the chunks of the children
+  // of the root stored in the root buffer, of the active cells of the sparse
+  // SNodes, and of the blocks of the fields under them.
+  std::unordered_map<int, std::vector<uint64>> chunk_hashes_;
+  std::unordered_map<int, uint64> cells_hashes_;
+  std::unordered_map<int, std::map<std::vector<int32>, uint64>> block_hashes_;
+  // The children of the root saved as cells rather than as root bytes by the
+  // last full checkpoint: those with sparse SNodes or quantized fields.
+  std::unordered_set<int> saved_as_cells_;
+};
+
+TLANG_NAMESPACE_END
@@ -14,6 +14,7 @@ CompileConfig::CompileConfig() {
   print_benchmark_stat = false;
   use_llvm = true;
   demote_dense_struct_fors = true;
+  incremental_listgen = false;
   advanced_optimization = true;
   max_vector_width = 8;
   debug = false;
@@ -41,6 +42,9 @@ CompileConfig::CompileConfig() {
   saturating_grid_dim = 0;
   max_block_dim = 0;
   cpu_max_num_threads = std::thread::hardware_concurrency();
+  cpu_work_stealing = false;
+  cpu_thread_affinity = "";
+  layout_profile = "";
 
   ad_stack_size = 16;
 
@@ -62,6 +66,14 @@ CompileConfig::CompileConfig() {
   // C backend options:
   cc_compile_cmd = "gcc -Wc99-c11-compat -c -o '{}' '{}' -O3";
   cc_link_cmd = "gcc -shared -fPIC -o '{}' '{}'";
+  cc_libtcc = "";
+  cc_openmp = false;
+
+  // Offline cache options:
+  offline_cache = false;
+  offline_cache_file_path = "";
+  offline_cache_max_size_bytes = 1024LL * 1024 * 1024;  // 1 GB
+  aot_record = false;
 }
 
 TLANG_NAMESPACE_END
@@ -23,16 +23,59 @@ struct CompileConfig {
   bool lower_access;
   bool simplify_after_lower_access;
   bool demote_dense_struct_fors;
+  bool incremental_listgen;
+  // Generate the element lists of the struct-fors on the LLVM backends only
+  // down to the highest of the dense nodes above the leaf block, whose cells
+  // the struct-for task then enumerates itself. Not with BLS or async_mode.
+  bool skip_dense_listgen{false};
+  // Without async_mode, launch a kernel again with the activations of its
+  // struct-fors at the loop indices demoted, when no other launch may have
+  // changed the masks they depend on since its previous launch. LLVM backends
+  // and Metal only.
+  bool sync_activation_demotion{false};
   bool advanced_optimization;
   bool use_llvm;
   bool verbose_kernel_launches;
   bool kernel_profiler;
+  // With kernel_profiler, time only one in this many launches of each
+  // offloaded task and extrapolate the totals, to keep the overhead low.
+  int kernel_profiler_sampling_interval{1};
+  // With kernel_profiler, also count cycles, instructions and LLC misses of
+  // the timed launches. Linux CPU backends only.
+  bool kernel_profiler_hardware_counters{false};
+  // The peak memory bandwidth in GB/s, to report the achieved fraction of it
+  // for each range-for task. 0 if unknown.
+  float64 kernel_profiler_peak_bandwidth{0};
+  // Record the time and IR size of each compilation pass.
+  bool compile_profiler{false};
+  // Verify the IR after each compilation pass, instead of only at the
+  // boundaries of the compile pipelines. Enabled by |debug|.
+  bool verify_each_pass{false};
   bool verbose;
   bool fast_math;
   bool async_mode;
   bool flatten_if;
   bool make_thread_local;
   bool make_block_local;
+  // Let make_block_local also accumulate in BLS the fields that a struct-for
+  // only atomically adds to near its loop indices, e.g. the grid of P2G over
+  // the particles binned by grid block, without ti.block_local hints.
+  bool make_block_local_scatter{true};
+  // Outside the async mode, fuse adjacent range-fors with constant bounds
+  // that access disjoint fields into a single task, as long as it has at most
+  // this many iterations. Saves the launches of small boundary loops. 0 to
+  // disable.
+  int horizontal_fusion_max_iterations{0};
+  // Outside the async mode, run the serial tasks of at most this many
+  // statements in the first iteration of an adjacent range-for with constant
+  // bounds that accesses disjoint fields, instead of launching a one-thread
+  // task. 0 to disable.
+  int serial_fusion_max_statements{32};
+  // Unroll the serial range-for loops with constant bounds whose copies of
+  // the body take at most this many statements in total, so that the
+  // simplifications work across iterations. ti.unroll() overrides it for the
+  // loop after it. 0 to disable.
+  int unroll_max_statements{128};
   bool detect_read_only;
   DataType default_fp;
   DataType default_ip;
@@ -44,28 +87,225 @@ struct CompileConfig {
   int saturating_grid_dim;
   int max_block_dim;
   int cpu_max_num_threads;
+  bool cpu_work_stealing;
+  // Pin the threads running CPU kernels: "compact" fills the CPUs of a NUMA
+  // node before the next one, and "scatter" spreads the threads over the
+  // nodes. Empty lets the OS schedule them.
+  std::string cpu_thread_affinity;
+  // Let the threads running CPU kernels touch the root buffer first, each a
+  // contiguous part, so that its pages are spread over their NUMA nodes
+  // instead of the node of the thread touching them first. Commits the whole
+  // root buffer upfront.
+  bool cpu_numa_first_touch{false};
+  // The pages backing the memory of the CPU backends, including the root
+  // buffer and the chunks of the NodeManagers: "none", "transparent", "2MB" or
+  // "1GB", see VirtualMemoryAllocator. Huge pages save TLB misses in kernels
+  // accessing large fields at random.
+  std::string cpu_huge_pages{"none"};
+  // Let the CPU struct-fors over sparse SNodes prefetch the first cache line
+  // of the cells of the element this many elements ahead. 0 to disable.
+  int cpu_struct_for_prefetch_distance{4};
+  // Let the launches of the CPU kernels return once the kernel is compiled,
+  // and run the kernels in order on a host thread of the Program, so that the
+  // calling thread can launch CUDA kernels of another Program meanwhile.
+  // Program::synchronize() waits for them. Ignored under |debug| and
+  // |kernel_profiler|.
+  bool cpu_async_launch{false};
+  // Comma-separated power-of-two tile extents, e.g. "8,8,64". When set, the
+  // dense struct-fors with that many loop variables iterate tile by tile on
+  // the CPU, instead of row by row. Empty disables loop tiling.
+  std::string cpu_tile_shape;
+  // Let the range-fors on the CPU loop over each block of iterations in the
+  // kernel code, so that LLVM vectorizes the iterations for the ISA of the
+  // host, instead of calling the loop body once per iteration.
+  bool cpu_vectorize{true};
+  // Size the blocks of iterations of the range-fors on the CPU without a
+  // block_dim hint from the estimated cost of their bodies and their trip
+  // counts, instead of |default_cpu_block_dim|.
+  bool cpu_block_dim_by_cost{false};
+  // Give each thread its own copy of the fields of up to this many bytes in
+  // total that a range-for on the CPU only accumulates into, e.g. the grid of
+  // P2G, and add the copies to the fields at the end of each block of
+  // iterations, instead of accumulating with atomics. 0 disables it.
+  int cpu_max_tls_array_bytes{4096};
+  // Number of threads that the offloaded tasks of a kernel are compiled on
+  // outside async mode, on the LLVM backends. 0 uses all the hardware
+  // threads, and 1 compiles the whole kernel into one module. On Metal,
+  // anything but 1 compiles the kernels in the background, see
+  // metal::KernelManager::register_taichi_kernel().
+  int num_compile_threads{0};
+  // Start the LLVM module of each kernel from the declarations of the runtime
+  // only, and link the runtime functions it uses once its codegen is done,
+  // instead of cloning the whole runtime (and libdevice on CUDA) per kernel.
+  bool lazy_runtime_linking{true};
+  // Compile CPU kernels at O1 first, and recompile them at O3 on a background
+  // thread once they have been launched |tiered_compilation_threshold| times.
+  bool tiered_compilation{false};
+  int tiered_compilation_threshold{8};
+  // Add up the partial sums of the reductions demoted to thread-local storage
+  // (see |make_thread_local|) in a fixed order, instead of with atomics in
+  // whichever order the threads finish. CPU and CUDA range-fors only.
+  bool deterministic_reduction{false};
+  // Record which fields the offloaded tasks access together, for
+  // Program::get_layout_advice().
+  bool layout_advisor{false};
+  // Regroup the fields of the dense children of the root per the accesses
+  // recorded in this file by an earlier run, if it exists. It is written at
+  // the end of the runs with |layout_advisor|.
+  std::string layout_profile;
+  // Count how often the branches of the tasks are taken, how many iterations
+  // their serial loops run and, on CUDA, how many iterations their range-fors
+  // with variable bounds have, and save the counts to |pgo_profile| at the
+  // end of the run. CPU and CUDA only.
+  bool pgo_instrument{false};
+  // Without |pgo_instrument|, compile the tasks with the counts recorded in
+  // this file by an earlier run, if it exists: they weigh the branches for
+  // LLVM, decide how loops are unrolled, and bound the grids of range-fors on
+  // CUDA.
+  std::string pgo_profile;
+  // Let ti.svd of 3x3 matrices call a function of the LLVM runtime in the
+  // kernels that are not differentiated, instead of expanding into statements.
+  // CPU and CUDA only.
+  bool svd_intrinsic{true};
+  // Move the loop-invariant statements of serial loops before the loops.
+  bool loop_invariant_code_motion{true};
+  // Print which statements loop_invariant_code_motion moved in each kernel.
+  bool print_licm_report{false};
+  // On GPUs, let the dense struct-fors step through the loop index that most
+  // global accesses of the body address consecutive cells with, rather than
+  // following the layout of the loop.
+  bool coalesce_dense_struct_fors{true};
+  // Print which loop index each dense struct-for steps through, and why.
+  bool print_coalescing_report{false};
 
   // LLVM backend options:
   bool print_struct_llvm_ir;
   bool print_kernel_llvm_ir;
   bool print_kernel_llvm_ir_optimized;
   bool print_kernel_nvptx;
+  // Print the remarks of the LLVM loop vectorizer on each kernel (CPU only).
+  bool print_vectorization_report{false};
+  // Activate the children of pointer SNodes by allocating them speculatively
+  // and publishing them with a CAS, instead of allocating under a spin lock
+  // per child.
+  bool lock_free_activation{true};
+  // Lower atomic adds on custom ints to a single integer atomic add on the
+  // physical word, letting overflows carry into the neighboring bits.
+  bool quant_atomic_add_allow_overflow{false};
 
   // CUDA backend options:
   bool use_unified_memory;
   float64 device_memory_GB;
   float64 device_memory_fraction;
+  // Reserve the device memory as a virtual address range and commit physical
+  // memory as it gets used, instead of unified memory or preallocation.
+  // Overrides |use_unified_memory| on devices supporting it.
+  bool use_virtual_device_memory{true};
+  // With |use_virtual_device_memory|, also commit memory on the peer GPUs
+  // once the memory of the GPU running the kernels runs out.
+  bool cuda_peer_memory{false};
+  // With |use_unified_memory|, prefetch the parts of the root buffer that a
+  // task accesses to the device before launching it.
+  bool unified_memory_prefetch{true};
+  // With |use_unified_memory|, stream the fields larger than this through the
+  // device: the range-fors with constant bounds over them are launched in
+  // tiles of iterations, each prefetching its part of them while the previous
+  // tile runs and migrating it back to the host after it. Lets kernels run
+  // over fields larger than the device memory. 0 disables streaming.
+  float64 unified_memory_stream_tile_MB{0};
+  // Generate ti.random() with the counter-based Philox generator, whose
+  // per-thread states are just counters, instead of seeded xorshift states.
+  bool cuda_philox_rand{false};
+  // Time a few grid_dim and block_dim candidates on the first launches of
+  // each range-for without a block_dim hint, and keep the fastest. With
+  // |offline_cache|, the choice is stored with the cached kernel.
+  bool cuda_auto_tune_block_dim{false};
+  // The launches timed per candidate by |cuda_auto_tune_block_dim|.
+  int cuda_auto_tune_num_launches{2};
+  // Fuse each run of consecutive range-fors and serial tasks of a kernel
+  // into a single persistent kernel, whose blocks all stay resident and wait
+  // for each other at a grid barrier between the tasks, instead of one
+  // launch per task. Needs a device supporting cooperative launches.
+  bool cuda_persistent_kernels{false};
+  // The registers per thread that the CUDA kernels may use at most, spilling
+  // the rest to local memory. 0 leaves it to the assembler.
+  int cuda_max_registers{0};
+  // The blocks of each CUDA kernel with a known block_dim that should fit on
+  // a multiprocessor at once, which bounds the registers per thread
+  // accordingly. 0 for no bound.
+  int cuda_min_blocks_per_sm{2};
+  // The bytes of shared memory per block that the BLS buffers of a struct-for
+  // may take on CUDA. The fields that do not fit stay in global memory. 0
+  // for all the shared memory of the device, opting in beyond 48 KB.
+  int cuda_max_bls_bytes{0};
+
+  // OpenGL backend options:
+  // The slots of the table in shared memory where each workgroup sums its
+  // atomic adds to f32 fields before adding them to the fields, on GPUs
+  // without native float atomics. A power of two, 0 disables it.
+  int opengl_atomic_aggregation_slots{1024};
+  // Combine the atomics of the threads of a subgroup to the same address into
+  // one, with GL_KHR_shader_subgroup.
+  bool opengl_subgroup_reductions{true};
+
+  // Vulkan backend options:
+  // The kernel launches recorded into a command buffer before it is
+  // submitted. The host only waits for the submitted launches on
+  // synchronization.
+  int vulkan_launches_per_submit{64};
 
   // C backend options:
   std::string cc_compile_cmd;
   std::string cc_link_cmd;
+  // If set, the path of libtcc, which compiles the kernels in memory instead of
+  // |cc_compile_cmd| and |cc_link_cmd|.
+  std::string cc_libtcc;
+  // Run the iterations of range-fors on OpenMP threads, adding -fopenmp to
+  // |cc_compile_cmd| and |cc_link_cmd|.
+  bool cc_openmp;
 
   bool async_opt_fusion{true};
+  // Don't fuse tasks into tasks of more than this many IR statements. 0 has
+  // no limit.
+  int async_fusion_max_statements{0};
   bool async_opt_listgen{true};
   bool async_opt_activation_demotion{true};
   bool async_opt_dse{true};
+  // Reuse the optimized schedule of an earlier sync whose graph had the same
+  // tasks, e.g. in a frame loop, instead of optimizing the graph again.
+  bool async_opt_reuse_schedules{true};
+  // Compile tasks as soon as they are launched, instead of at the next sync.
+  // Tasks that were optimized away (e.g. fused) in earlier syncs are skipped.
+  bool async_speculative_compilation{true};
+  // Number of CUDA streams that independent tasks are launched on in async
+  // mode. 1 launches all the tasks on the default stream.
+  int async_cuda_num_streams{4};
+  // Optimize and launch the pending tasks once this many tasks, or tasks of
+  // this many IR statements in total, are pending, without waiting for them
+  // to complete, so that the following tasks are optimized while they run.
+  // 0 waits for the next sync.
+  int async_flush_num_tasks{0};
+  int64 async_flush_cost{0};
   std::string async_opt_intermediate_file;
 
+  // Offline cache options:
+  bool offline_cache;
+  // Defaults to get_repo_dir() + "/.cache/llvm" when left empty.
+  std::string offline_cache_file_path;
+  // With |offline_cache| on CUDA, also cache the cubins that the driver
+  // assembles from the PTX of the kernels, under the "cubin" subdirectory,
+  // keyed by the PTX, the driver version and the compute capability.
+  bool cuda_cubin_cache{true};
+  // 0 disables eviction.
+  int64 offline_cache_max_size_bytes;
+  // Records the compiled kernels for Program::export_llvm_aot_module().
+  bool aot_record;
+  // Reuses the offloaded tasks compiled on the LLVM backends in the later
+  // kernels of the program containing the same tasks, e.g. the instantiations
+  // of a template differing in one loop. Only for the kernels compiled task by
+  // task, see |num_compile_threads|.
+  bool task_cache{true};
+
   CompileConfig();
 };
 
@@ -0,0 +1,75 @@
+#include "taichi/program/compile_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+TLANG_NAMESPACE_BEGIN
+
+void CompileProfiler::add(const PassRecord &record) {
+  std::lock_guard<std::mutex> _(mut_);
+  records_.push_back(record);
+}
+
+void CompileProfiler::print() const {
+  struct PassSummary {
+    double time{0};
+    int count{0};
+    int64 num_stmts_removed{0};
+  };
+  std::map<std::string, PassSummary> summaries;
+  double total_time = 0;
+  {
+    std::lock_guard<std::mutex> _(mut_);
+    for (const auto &r : records_) {
+      auto &s = summaries[r.pass];
+      s.time += r.time;
+      s.count += 1;
+      s.num_stmts_removed += r.num_stmts_before - r.num_stmts_after;
+      total_time += r.time;
+    }
+  }
+  std::vector<std::pair<std::string, PassSummary>> sorted(summaries.begin(),
+                                                          summaries.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.time > b.second.time;
+  });
+  fmt::print("{:=^80}\n", " Compile Profiler ");
+  for (const auto &[pass, s] : sorted) {
+    fmt::print("[{:6.2f}%] {:<36} total {:9.3f} ms [{:6}x] {:+9} stmts\n",
+               total_time > 0 ? s.time / total_time * 100 : 0.0, pass,
+               s.time * 1000, s.count, -s.num_stmts_removed);
+  }
+  fmt::print("{:-^80}\n", "");
+  fmt::print("Total {:.3f} s\n", total_time);
+}
+
+std::string CompileProfiler::to_json() const {
+  std::lock_guard<std::mutex> _(mut_);
+  std::string ret = "[";
+  for (int i = 0; i < (int)records_.size(); i++) {
+    const auto &r = records_[i];
+    ret += fmt::format(
+        "{}\n  {{\"kernel\": \"{}\", \"pass\": \"{}\", \"time\": {}, "
+        "\"num_stmts_before\": {}, \"num_stmts_after\": {}, "
+        "\"num_iterations\": {}}}",
+        i == 0 ? "" : ",", escape_json_string(r.kernel),
+        escape_json_string(r.pass), r.time, r.num_stmts_before,
+        r.num_stmts_after, r.num_iterations);
+  }
+  ret += "\n]\n";
+  return ret;
+}
+
+void CompileProfiler::dump_json(const std::string &file_name) const {
+  std::ofstream ofs(file_name);
+  TI_ERROR_IF(!ofs, "Cannot open {} for writing", file_name);
+  ofs << to_json();
+}
+
+void CompileProfiler::clear() {
+  std::lock_guard<std::mutex> _(mut_);
+  records_.clear();
+}
+
+TLANG_NAMESPACE_END
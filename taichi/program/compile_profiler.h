@@ -0,0 +1,44 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Records the cost of each IR pass run while compiling kernels. Enabled by
+// CompileConfig::compile_profiler.
+class CompileProfiler {
+ public:
+  struct PassRecord {
+    std::string kernel;
+    std::string pass;
+    // Wall time in seconds
+    double time{0};
+    int num_stmts_before{0};
+    int num_stmts_after{0};
+    // Number of fixed-point iterations, e.g. of full_simplify()
+    int num_iterations{1};
+  };
+
+  void add(const PassRecord &record);
+
+  // Prints the total time of each pass, most expensive first.
+  void print() const;
+
+  // Dumps all the records as a list of JSON objects.
+  std::string to_json() const;
+
+  void dump_json(const std::string &file_name) const;
+
+  void clear();
+
+ private:
+  // Passes of different kernels may be recorded concurrently in async mode.
+  mutable std::mutex mut_;
+  std::vector<PassRecord> records_;
+};
+
+TLANG_NAMESPACE_END
@@ -11,11 +11,16 @@ namespace lang {
 struct LLVMRuntime;
 
 // "Context" holds necessary data for function calls, such as arguments and
-// LLVMRuntime struct
+// LLVMRuntime struct. The CUDA backend loads args and extra_args by their
+// field indices, see CodeGenLLVMCUDA::load_context_arg.
 struct Context {
   LLVMRuntime *runtime;
   uint64 args[taichi_max_num_args];
   int32 extra_args[taichi_max_num_args][taichi_max_num_indices];
+  // The iterations that a range-for streamed in tiles runs in this launch,
+  // see OffloadedTask::streamed.
+  int32 range_for_begin;
+  int32 range_for_end;
 
   static constexpr size_t extra_args_size = sizeof(extra_args);
 
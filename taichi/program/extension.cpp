@@ -10,18 +10,21 @@ bool is_extension_supported(Arch arch, Extension ext) {
   static std::unordered_map<Arch, std::unordered_set<Extension>> arch2ext = {
       {Arch::x64,
        {Extension::sparse, Extension::async_mode, Extension::quant,
-        Extension::data64, Extension::adstack, Extension::assertion,
-        Extension::extfunc}},
+        Extension::data64, Extension::adstack, Extension::bls,
+        Extension::assertion, Extension::extfunc}},
       {Arch::arm64,
        {Extension::sparse, Extension::async_mode, Extension::quant,
-        Extension::data64, Extension::adstack, Extension::assertion}},
+        Extension::data64, Extension::adstack, Extension::bls,
+        Extension::assertion}},
       {Arch::cuda,
        {Extension::sparse, Extension::async_mode, Extension::quant,
         Extension::data64, Extension::adstack, Extension::bls,
         Extension::assertion}},
       {Arch::metal,
-       {Extension::adstack, Extension::assertion, Extension::async_mode}},
+       {Extension::sparse, Extension::adstack, Extension::assertion,
+        Extension::async_mode, Extension::bls}},
       {Arch::opengl, {Extension::extfunc}},
+      {Arch::vulkan, {Extension::extfunc}},
       {Arch::cc, {Extension::data64, Extension::extfunc, Extension::adstack}},
   };
   // if (with_opengl_extension_data64())
@@ -13,17 +13,9 @@ namespace {
 
 uint64 hash(IRNode *stmt) {
   TI_ASSERT(stmt);
-  // TODO: upgrade this using IR comparisons
-  std::string serialized;
-  irpass::re_id(stmt);
-  irpass::print(stmt, &serialized);
   // TODO: separate kernel from IR template
-  serialized += stmt->get_kernel()->name;
-  uint64 ret = 0;
-  for (uint64 i = 0; i < serialized.size(); i++) {
-    ret = ret * 100000007UL + (uint64)serialized[i];
-  }
-  return ret;
+  return hash_combine(irpass::analysis::structural_hash(stmt),
+                      hash_string(stmt->get_kernel()->name));
 }
 
 }  // namespace
@@ -114,38 +106,12 @@ IRHandle IRBank::demote_activation(IRHandle handle) {
   std::unique_ptr<IRNode> new_ir = handle.clone();
 
   OffloadedStmt *offload = new_ir->as<OffloadedStmt>();
-  Block *body = offload->body.get();
 
   auto snode = offload->snode;
   TI_ASSERT(snode != nullptr);
 
-  auto consts = irpass::analysis::constexpr_prop(body, [](Stmt *stmt) {
-    if (stmt->is<ConstStmt>()) {
-      return true;
-    } else if (stmt->is<LoopIndexStmt>())
-      return true;
-    return false;
-  });
-
-  bool demoted = false;
-  // Scan all the GlobalPtrStmt and try to deactivate
-  irpass::analysis::gather_statements(body, [&](Stmt *stmt) {
-    if (auto ptr = stmt->cast<GlobalPtrStmt>(); ptr && ptr->activate) {
-      bool can_demote = true;
-      // TODO: test input mask here?
-      for (auto ind : ptr->indices) {
-        if (consts.find(ind) == consts.end()) {
-          // non-constant index
-          can_demote = false;
-        }
-      }
-      if (can_demote) {
-        ptr->activate = false;
-        demoted = true;
-      }
-    }
-    return false;
-  });
+  bool demoted = irpass::demote_struct_for_activations(
+      offload, /*unconditional_only=*/false);
 
   if (!demoted) {
     // Nothing demoted. Simply delete new_ir when this function returns.
@@ -3,17 +3,44 @@
 #include "taichi/util/statistics.h"
 #include "taichi/common/task.h"
 #include "taichi/program/program.h"
+#include "taichi/program/activation_tracker.h"
 #include "taichi/program/async_engine.h"
+#include "taichi/program/checkpoint.h"
+#include "taichi/program/layout_advisor.h"
 #include "taichi/codegen/codegen.h"
 #include "taichi/backends/cuda/cuda_driver.h"
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/util/action_recorder.h"
+#include "taichi/system/tracer.h"
 #include "taichi/program/extension.h"
 
 TLANG_NAMESPACE_BEGIN
 
 namespace {
+// Calls |add| with the stats of launching a task of |task_type|.
+template <typename F>
+void for_each_task_stat(OffloadedTaskType task_type, const F &add) {
+  add("launched_tasks");
+  if (task_type == OffloadedStmt::TaskType::listgen) {
+    add("launched_tasks_list_op");
+    add("launched_tasks_list_gen");
+  } else if (task_type == OffloadedStmt::TaskType::serial) {
+    // TODO: Do we need to distinguish serial tasks that contain clear lists vs
+    // those who don't?
+    add("launched_tasks_compute");
+    add("launched_tasks_serial");
+  } else if (task_type == OffloadedStmt::TaskType::range_for) {
+    add("launched_tasks_compute");
+    add("launched_tasks_range_for");
+  } else if (task_type == OffloadedStmt::TaskType::struct_for) {
+    add("launched_tasks_compute");
+    add("launched_tasks_struct_for");
+  } else if (task_type == OffloadedStmt::TaskType::gc) {
+    add("launched_tasks_garbage_collect");
+  }
+}
+
 class CurrentKernelGuard {
   Kernel *old_kernel;
   Program &program;
@@ -28,24 +55,61 @@ class CurrentKernelGuard {
     program.current_kernel = old_kernel;
   }
 };
+
+// Converts the bits of a return value of type |dt| in the result buffer.
+template <typename T>
+T cast_ret_value(DataType dt, uint64 bits) {
+  dt = dt->get_compute_type();
+  if (dt->is_primitive(PrimitiveTypeID::f32)) {
+    return (T)taichi_union_cast_with_different_sizes<float32>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::f64)) {
+    return (T)taichi_union_cast_with_different_sizes<float64>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::i32)) {
+    return (T)taichi_union_cast_with_different_sizes<int32>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::i64)) {
+    return (T)taichi_union_cast_with_different_sizes<int64>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::i8)) {
+    return (T)taichi_union_cast_with_different_sizes<int8>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::i16)) {
+    return (T)taichi_union_cast_with_different_sizes<int16>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::u8)) {
+    return (T)taichi_union_cast_with_different_sizes<uint8>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::u16)) {
+    return (T)taichi_union_cast_with_different_sizes<uint16>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::u32)) {
+    return (T)taichi_union_cast_with_different_sizes<uint32>(bits);
+  } else if (dt->is_primitive(PrimitiveTypeID::u64)) {
+    return (T)taichi_union_cast_with_different_sizes<uint64>(bits);
+  } else {
+    TI_NOT_IMPLEMENTED
+  }
+}
 }  // namespace
 
 Kernel::Kernel(Program &program,
                const std::function<void()> &func,
                const std::string &primal_name,
-               bool grad)
-    : program(program), lowered(false), grad(grad) {
+               bool grad,
+               bool jvp,
+               bool keep_primal)
+    : program(program),
+      lowered(false),
+      grad(grad),
+      jvp(jvp),
+      keep_primal(keep_primal) {
+  TI_ASSERT(!(grad && jvp));
+  TI_ASSERT(grad || !keep_primal);
   program.initialize_device_llvm_context();
   is_accessor = false;
   is_evaluator = false;
+  fast_math = program.config.fast_math;
   compiled = nullptr;
   taichi::lang::context = std::make_unique<FrontendContext>();
   ir = taichi::lang::context->get_root();
 
   {
-    // Note: this is NOT a mutex. If we want to call Kernel::Kernel()
-    // concurrently, we need to lock this block of code together with
-    // taichi::lang::context with a mutex.
+    // taichi::lang::context and Program::current_kernel are per host thread,
+    // so that several threads can define kernels concurrently.
     CurrentKernelGuard _(program, this);
     program.start_function_definition(this);
     func();
@@ -55,10 +119,14 @@ Kernel::Kernel(Program &program,
 
   arch = program.config.arch;
 
-  if (!grad) {
-    name = primal_name;
-  } else {
+  if (keep_primal) {
+    name = primal_name + "_fused_grad";
+  } else if (grad) {
     name = primal_name + "_grad";
+  } else if (jvp) {
+    name = primal_name + "_jvp";
+  } else {
+    name = primal_name;
   }
 
   if (!program.config.lazy_compilation)
@@ -66,8 +134,15 @@ Kernel::Kernel(Program &program,
 }
 
 void Kernel::compile() {
+  std::lock_guard<std::recursive_mutex> lock(program.compile_mut);
+  // The backends look up the config and the LLVM contexts there.
+  TI_ERROR_IF(&get_current_program() != &program,
+              "Kernel {} is compiled while another Program is current, see "
+              "Program::make_current()",
+              name);
   CurrentKernelGuard _(program, this);
   compiled = program.compile(*this);
+  is_compiled_ = true;
 }
 
 void Kernel::lower(bool to_executable) {  // TODO: is a "Lowerer" class
@@ -81,7 +156,8 @@ void Kernel::lower(bool to_executable) {  // TODO: is a "Lowerer" class
         (is_evaluator && !config.print_evaluator_ir))
       verbose = false;
 
-    if (to_executable) {
+    auto *tracker = program.get_activation_tracker();
+    if (to_executable && !tracker) {
       irpass::compile_to_executable(
           ir.get(), config, /*vectorize*/ arch_is_cpu(arch), grad,
           /*ad_use_stack=*/true, verbose, /*lower_global_access=*/to_executable,
@@ -93,6 +169,16 @@ void Kernel::lower(bool to_executable) {  // TODO: is a "Lowerer" class
       irpass::compile_to_offloads(ir.get(), config, verbose,
                                   /*vectorize=*/arch_is_cpu(arch), grad,
                                   /*ad_use_stack=*/true);
+      if (tracker)
+        tracker->analyze(this);
+      if (to_executable) {
+        irpass::offload_to_executable(
+            ir.get(), config, verbose, /*lower_global_access=*/true,
+            /*make_thread_local=*/config.make_thread_local,
+            /*make_block_local=*/
+            is_extension_supported(config.arch, Extension::bls) &&
+                config.make_block_local);
+      }
     }
   } else {
     TI_NOT_IMPLEMENTED
@@ -101,17 +187,53 @@ void Kernel::lower(bool to_executable) {  // TODO: is a "Lowerer" class
 }
 
 void Kernel::operator()(LaunchContextBuilder &ctx_builder) {
+  TI_TRACE_SCOPE("kernel", name);
   if (!program.config.async_mode || this->is_evaluator) {
-    if (!compiled) {
-      compile();
+    if (!is_compiled_.load(std::memory_order_acquire)) {
+      // Another thread may be compiling it, or it may have been loaded
+      // from an AOT module.
+      std::lock_guard<std::recursive_mutex> _(program.compile_mut);
+      if (!compiled) {
+        compile();
+      }
+      is_compiled_ = true;
     }
 
-    for (auto &offloaded : ir->as<Block>()->statements) {
-      account_for_offloaded(offloaded->as<OffloadedStmt>());
+    auto func = compiled;
+    if (auto *tracker = program.get_activation_tracker()) {
+      func = tracker->record_launch(this);
     }
 
-    compiled(ctx_builder.get_context());
+    account_for_launch();
+    if (auto *advisor = program.get_layout_advisor();
+        advisor && program.config.layout_advisor && !is_evaluator &&
+        !is_accessor) {
+      advisor->record_launch(this);
+    }
+    if (auto *checkpointer = program.get_checkpointer()) {
+      checkpointer->record_launch(this);
+    }
+
+    const auto &config = program.config;
+    if (config.cpu_async_launch && arch_is_cpu(arch) &&
+        arch_is_cpu(config.arch) && !is_accessor && !is_evaluator &&
+        !config.debug && !config.kernel_profiler) {
+      program.enqueue_host_launch(
+          [func = std::move(func), ctx = ctx_builder.get_context()]() mutable {
+            func(ctx);
+          });
+      return;
+    }
+    if (config.cpu_async_launch && arch_is_cpu(arch)) {
+      // After the kernels launched asynchronously before it.
+      program.synchronize();
+    }
+    func(ctx_builder.get_context());
 
+    if (arch != program.config.arch) {
+      // E.g. a host accessor of CUDA unified memory
+      program.on_root_buffer_host_access(accessed_snode);
+    }
     program.sync = (program.sync && arch_is_cpu(arch));
     // Note that Kernel::arch may be different from program.config.arch
     if (program.config.debug && (arch_is_cpu(program.config.arch) ||
@@ -120,6 +242,9 @@ void Kernel::operator()(LaunchContextBuilder &ctx_builder) {
     }
   } else {
     program.sync = false;
+    if (auto *checkpointer = program.get_checkpointer()) {
+      checkpointer->record_launch(this);
+    }
     program.async_engine->launch(this, ctx_builder.get_context());
     // Note that Kernel::arch may be different from program.config.arch
     if (program.config.debug && arch_is_cpu(arch) &&
@@ -133,6 +258,56 @@ Kernel::LaunchContextBuilder Kernel::make_launch_context() {
   return LaunchContextBuilder(this);
 }
 
+std::unique_ptr<Kernel::PreparedLaunch> Kernel::prepare_launch() {
+  return std::make_unique<PreparedLaunch>(this);
+}
+
+Kernel::PreparedLaunch::PreparedLaunch(Kernel *kernel)
+    : kernel_(kernel), ctx_builder_(kernel) {
+  for (auto &arg : kernel->args) {
+    TI_ERROR_IF(arg.is_nparray,
+                "Kernel {} takes external arrays and cannot be prepared",
+                kernel->name);
+  }
+}
+
+bool Kernel::PreparedLaunch::is_real_arg(int i) const {
+  return is_real(kernel_->args[i].dt);
+}
+
+void Kernel::PreparedLaunch::set_arg_int(int i, int64 d) {
+  ctx_builder_.set_arg_int(i, d);
+}
+
+void Kernel::PreparedLaunch::set_arg_float(int i, float64 d) {
+  ctx_builder_.set_arg_float(i, d);
+}
+
+void Kernel::PreparedLaunch::launch() {
+  (*kernel_)(ctx_builder_);
+}
+
+void Kernel::PreparedLaunch::launch(const std::vector<ArgValue> &args) {
+  TI_ASSERT(args.size() == kernel_->args.size());
+  std::lock_guard<std::mutex> _(mut_);
+  for (int i = 0; i < (int)args.size(); i++) {
+    if (auto *d = std::get_if<int64>(&args[i])) {
+      set_arg_int(i, *d);
+    } else {
+      set_arg_float(i, std::get<float64>(args[i]));
+    }
+  }
+  launch();
+}
+
+void Kernel::PreparedLaunch::launch_batch(
+    const std::vector<std::pair<PreparedLaunch *, std::vector<ArgValue>>>
+        &launches) {
+  for (auto &[launch, args] : launches) {
+    launch->launch(args);
+  }
+}
+
 Kernel::LaunchContextBuilder::LaunchContextBuilder(Kernel *kernel, Context *ctx)
     : kernel_(kernel), owned_ctx_(nullptr), ctx_(ctx) {
 }
@@ -148,9 +323,12 @@ void Kernel::LaunchContextBuilder::set_arg_float(int i, float64 d) {
       !kernel_->args[i].is_nparray,
       "Assigning a scalar value to a numpy array argument is not allowed");
 
-  ActionRecorder::get_instance().record(
-      "set_kernel_arg_float64", {ActionArg("kernel_name", kernel_->name),
-                                 ActionArg("arg_id", i), ActionArg("val", d)});
+  if (ActionRecorder::get_instance().is_recording()) {
+    ActionRecorder::get_instance().record(
+        "set_kernel_arg_float64",
+        {ActionArg("kernel_name", kernel_->name), ActionArg("arg_id", i),
+         ActionArg("val", d)});
+  }
 
   auto dt = kernel_->args[i].dt;
   if (dt->is_primitive(PrimitiveTypeID::f32)) {
@@ -183,9 +361,12 @@ void Kernel::LaunchContextBuilder::set_arg_int(int i, int64 d) {
       !kernel_->args[i].is_nparray,
       "Assigning scalar value to numpy array argument is not allowed");
 
-  ActionRecorder::get_instance().record(
-      "set_kernel_arg_int64", {ActionArg("kernel_name", kernel_->name),
-                               ActionArg("arg_id", i), ActionArg("val", d)});
+  if (ActionRecorder::get_instance().is_recording()) {
+    ActionRecorder::get_instance().record(
+        "set_kernel_arg_int64",
+        {ActionArg("kernel_name", kernel_->name), ActionArg("arg_id", i),
+         ActionArg("val", d)});
+  }
 
   auto dt = kernel_->args[i].dt;
   if (dt->is_primitive(PrimitiveTypeID::i32)) {
@@ -251,57 +432,21 @@ Context &Kernel::LaunchContextBuilder::get_context() {
 }
 
 float64 Kernel::get_ret_float(int i) {
-  auto dt = rets[i].dt->get_compute_type();
-  if (dt->is_primitive(PrimitiveTypeID::f32)) {
-    return (float64)get_current_program().fetch_result<float32>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::f64)) {
-    return (float64)get_current_program().fetch_result<float64>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::i32)) {
-    return (float64)get_current_program().fetch_result<int32>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::i64)) {
-    return (float64)get_current_program().fetch_result<int64>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::i8)) {
-    return (float64)get_current_program().fetch_result<int8>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::i16)) {
-    return (float64)get_current_program().fetch_result<int16>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u8)) {
-    return (float64)get_current_program().fetch_result<uint8>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u16)) {
-    return (float64)get_current_program().fetch_result<uint16>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u32)) {
-    return (float64)get_current_program().fetch_result<uint32>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u64)) {
-    return (float64)get_current_program().fetch_result<uint64>(i);
-  } else {
-    TI_NOT_IMPLEMENTED
-  }
+  return cast_ret_value<float64>(rets[i].dt, program.fetch_result_uint64(i));
 }
 
 int64 Kernel::get_ret_int(int i) {
-  auto dt = rets[i].dt->get_compute_type();
-  if (dt->is_primitive(PrimitiveTypeID::i32)) {
-    return (int64)get_current_program().fetch_result<int32>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::i64)) {
-    return (int64)get_current_program().fetch_result<int64>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::i8)) {
-    return (int64)get_current_program().fetch_result<int8>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::i16)) {
-    return (int64)get_current_program().fetch_result<int16>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u8)) {
-    return (int64)get_current_program().fetch_result<uint8>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u16)) {
-    return (int64)get_current_program().fetch_result<uint16>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u32)) {
-    return (int64)get_current_program().fetch_result<uint32>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::u64)) {
-    return (int64)get_current_program().fetch_result<uint64>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::f32)) {
-    return (int64)get_current_program().fetch_result<float32>(i);
-  } else if (dt->is_primitive(PrimitiveTypeID::f64)) {
-    return (int64)get_current_program().fetch_result<float64>(i);
-  } else {
-    TI_NOT_IMPLEMENTED
-  }
+  return cast_ret_value<int64>(rets[i].dt, program.fetch_result_uint64(i));
+}
+
+float64 Kernel::get_future_ret_float(int64 future, int i) {
+  return cast_ret_value<float64>(
+      rets[i].dt, program.fetch_future_result_uint64(future, i));
+}
+
+int64 Kernel::get_future_ret_int(int64 future, int i) {
+  return cast_ret_value<int64>(
+      rets[i].dt, program.fetch_future_result_uint64(future, i));
 }
 
 void Kernel::set_arch(Arch arch) {
@@ -314,6 +459,18 @@ int Kernel::insert_arg(DataType dt, bool is_nparray) {
   return args.size() - 1;
 }
 
+void Kernel::specialize_arg_float(int i, float64 d) {
+  TI_ASSERT(!args[i].is_nparray);
+  TI_ERROR_IF(lowered, "Kernel {} is already compiled", name);
+  specialized_args[i] = TypedConstant(args[i].dt, d);
+}
+
+void Kernel::specialize_arg_int(int i, int64 d) {
+  TI_ASSERT(!args[i].is_nparray);
+  TI_ERROR_IF(lowered, "Kernel {} is already compiled", name);
+  specialized_args[i] = TypedConstant(args[i].dt, d);
+}
+
 int Kernel::insert_ret(DataType dt) {
   rets.push_back(Ret{dt->get_compute_type()});
   return rets.size() - 1;
@@ -322,24 +479,23 @@ int Kernel::insert_ret(DataType dt) {
 void Kernel::account_for_offloaded(OffloadedStmt *stmt) {
   if (is_evaluator || is_accessor)
     return;
-  auto task_type = stmt->task_type;
-  stat.add("launched_tasks", 1.0);
-  if (task_type == OffloadedStmt::TaskType::listgen) {
-    stat.add("launched_tasks_list_op", 1.0);
-    stat.add("launched_tasks_list_gen", 1.0);
-  } else if (task_type == OffloadedStmt::TaskType::serial) {
-    // TODO: Do we need to distinguish serial tasks that contain clear lists vs
-    // those who don't?
-    stat.add("launched_tasks_compute", 1.0);
-    stat.add("launched_tasks_serial", 1.0);
-  } else if (task_type == OffloadedStmt::TaskType::range_for) {
-    stat.add("launched_tasks_compute", 1.0);
-    stat.add("launched_tasks_range_for", 1.0);
-  } else if (task_type == OffloadedStmt::TaskType::struct_for) {
-    stat.add("launched_tasks_compute", 1.0);
-    stat.add("launched_tasks_struct_for", 1.0);
-  } else if (task_type == OffloadedStmt::TaskType::gc) {
-    stat.add("launched_tasks_garbage_collect", 1.0);
+  for_each_task_stat(stmt->task_type,
+                     [](const char *key) { stat.add(key, 1.0); });
+}
+
+void Kernel::account_for_launch() {
+  if (is_evaluator || is_accessor)
+    return;
+  if (launch_stats_.empty()) {
+    std::map<std::string, float64> stats;
+    for (auto &offloaded : ir->as<Block>()->statements) {
+      for_each_task_stat(offloaded->as<OffloadedStmt>()->task_type,
+                         [&](const char *key) { stats[key] += 1.0; });
+    }
+    launch_stats_.assign(stats.begin(), stats.end());
+  }
+  for (auto &[key, value] : launch_stats_) {
+    stat.add(key, value);
   }
 }
 
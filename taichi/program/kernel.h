@@ -1,5 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <variant>
+
 #include "taichi/lang_util.h"
 #include "taichi/ir/snode.h"
 #include "taichi/ir/ir.h"
@@ -44,9 +48,30 @@ class Kernel {
 
   std::vector<Arg> args;
   std::vector<Ret> rets;
+  // The scalar arguments that the kernel is compiled for a single value of,
+  // by index. Their loads are replaced with these constants.
+  std::unordered_map<int, TypedConstant> specialized_args;
   bool is_accessor;
+  // The SNode that an accessor reads or writes.
+  SNode *accessed_snode{nullptr};
   bool is_evaluator;
   bool grad;
+  // Forward-mode AutoDiff: the kernel also computes the derivatives of the
+  // values it writes into the dual fields, along the seeds in the dual fields
+  // it reads.
+  bool jvp;
+  // With |grad|, also compute the primal, i.e. keep its global stores and
+  // atomics, so that one launch replaces the primal and the adjoint kernels.
+  bool keep_primal;
+  // Floating-point options, set per kernel with
+  // @ti.kernel(fast_math=..., fp_contract=..., approx_math=...).
+  // CompileConfig::fast_math by default.
+  bool fast_math;
+  // Fuse multiplies and adds into FMAs even without |fast_math|.
+  bool fp_contract{false};
+  // Use the approximate f32 transcendental functions of the GPU. CUDA and
+  // Metal only.
+  bool approx_math{false};
 
   // TODO: Give "Context" a more specific name.
   class LaunchContextBuilder {
@@ -83,10 +108,44 @@ class Kernel {
     Context *ctx_;
   };
 
+  // A launch context reused by all the launches of a kernel with only scalar
+  // args, so that launching neither allocates a Context nor needs a call per
+  // arg from Python.
+  class PreparedLaunch {
+   public:
+    using ArgValue = std::variant<int64, float64>;
+
+    explicit PreparedLaunch(Kernel *kernel);
+
+    bool is_real_arg(int i) const;
+
+    void set_arg_int(int i, int64 d);
+
+    void set_arg_float(int i, float64 d);
+
+    void launch();
+
+    // Sets the args to |args| and launches the kernel.
+    void launch(const std::vector<ArgValue> &args);
+
+    // Launches the kernels back to back, in order.
+    static void launch_batch(
+        const std::vector<std::pair<PreparedLaunch *, std::vector<ArgValue>>>
+            &launches);
+
+   private:
+    Kernel *kernel_;
+    LaunchContextBuilder ctx_builder_;
+    // The host threads launching it share |ctx_builder_|.
+    std::mutex mut_;
+  };
+
   Kernel(Program &program,
          const std::function<void()> &func,
          const std::string &name = "",
-         bool grad = false);
+         bool grad = false,
+         bool jvp = false,
+         bool keep_primal = false);
 
   void compile();
 
@@ -96,17 +155,42 @@ class Kernel {
 
   LaunchContextBuilder make_launch_context();
 
+  std::unique_ptr<PreparedLaunch> prepare_launch();
+
   int insert_arg(DataType dt, bool is_nparray);
 
+  // Compiles the kernel for the value |d| of the i-th argument only. Must be
+  // called before the kernel is compiled.
+  void specialize_arg_float(int i, float64 d);
+
+  void specialize_arg_int(int i, int64 d);
+
   int insert_ret(DataType dt);
 
   float64 get_ret_float(int i);
 
   int64 get_ret_int(int i);
 
+  // Like get_ret_float() and get_ret_int(), but read from a result future of
+  // the program. See Program::create_result_future().
+  float64 get_future_ret_float(int64 future, int i);
+
+  int64 get_future_ret_int(int64 future, int i);
+
   void set_arch(Arch arch);
 
   void account_for_offloaded(OffloadedStmt *stmt);
+
+  // Adds the stats of launching all the offloaded tasks.
+  void account_for_launch();
+
+ private:
+  // The stats added by each launch, summed over the offloaded tasks. The
+  // tasks don't change after compilation, so they are counted once.
+  std::vector<std::pair<std::string, float64>> launch_stats_;
+  // Whether |compiled| is set, read by the launches without locking
+  // Program::compile_mut.
+  std::atomic<bool> is_compiled_{false};
 };
 
 TLANG_NAMESPACE_END
@@ -1,8 +1,23 @@
 #include "kernel_profiler.h"
 
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
 #include "taichi/system/timer.h"
+#include "taichi/system/tracer.h"
 #include "taichi/backends/cuda/cuda_driver.h"
 
+#if defined(TI_PLATFORM_LINUX)
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 TLANG_NAMESPACE_BEGIN
 
 void KernelProfileRecord::insert_sample(double t) {
@@ -14,10 +29,113 @@ void KernelProfileRecord::insert_sample(double t) {
   min = std::min(min, t);
   max = std::max(max, t);
   total += t;
+  int bucket = 0;
+  if (t > kMinBucketTime) {
+    bucket = 1 + (int)std::floor(std::log2(t / kMinBucketTime) *
+                                 kBucketsPerOctave);
+  }
+  histogram[std::min(bucket, kNumBuckets - 1)]++;
+}
+
+double KernelProfileRecord::get_percentile(double p) const {
+  if (counter == 0)
+    return 0;
+  // The rank of the sample at the percentile, starting from 1.
+  auto rank = std::max((int64)std::ceil(p / 100.0 * counter), (int64)1);
+  int64 count = 0;
+  int bucket = 0;
+  for (; bucket < kNumBuckets - 1; bucket++) {
+    count += histogram[bucket];
+    if (count >= rank)
+      break;
+  }
+  // Bucket b > 0 holds the samples in
+  // (kMinBucketTime * 2^((b - 1) / B), kMinBucketTime * 2^(b / B)]; estimate
+  // the percentile with its geometric midpoint.
+  double t = kMinBucketTime / 2;
+  if (bucket > 0)
+    t = kMinBucketTime * std::exp2((bucket - 0.5) / kBucketsPerOctave);
+  return std::max(min, std::min(max, t));
+}
+
+double KernelProfileRecord::get_estimated_total() const {
+  if (counter == 0)
+    return 0;
+  // Without sampling, num_launches == counter.
+  return total / counter * std::max(num_launches, (int64)counter);
 }
 
 bool KernelProfileRecord::operator<(const KernelProfileRecord &o) const {
-  return total > o.total;
+  return get_estimated_total() > o.get_estimated_total();
+}
+
+void KernelProfilerBase::set_sampling_interval(int sampling_interval) {
+  TI_ERROR_IF(sampling_interval < 1,
+              "kernel_profiler_sampling_interval must be positive, got {}",
+              sampling_interval);
+  sampling_interval_ = sampling_interval;
+}
+
+void KernelProfilerBase::set_bytes_per_launch(const std::string &task_name,
+                                              int64 bytes) {
+  std::lock_guard<std::mutex> _(bytes_per_launch_mut_);
+  bytes_per_launch_[task_name] = bytes;
+}
+
+void KernelProfilerBase::set_resource_usage(
+    const std::string &task_name,
+    const KernelResourceUsage &usage) {
+  std::lock_guard<std::mutex> _(bytes_per_launch_mut_);
+  resource_usage_[task_name] = usage;
+}
+
+int64 KernelProfilerBase::get_bytes_per_launch(const std::string &name) const {
+  std::lock_guard<std::mutex> _(bytes_per_launch_mut_);
+  auto it = bytes_per_launch_.find(name);
+  return it == bytes_per_launch_.end() ? 0 : it->second;
+}
+
+KernelProfileRecord &KernelProfilerBase::get_record(const std::string &name) {
+  auto it = record_ids.find(name);
+  if (it == record_ids.end()) {
+    it = record_ids.emplace(name, records.size()).first;
+    records.emplace_back(name);
+  }
+  return records[it->second];
+}
+
+bool KernelProfilerBase::should_sample(const std::string &name) {
+  if (sampling_interval_ == 1)
+    return true;
+  // The first launch of each task is always timed.
+  return get_record(name).num_launches++ % sampling_interval_ == 0;
+}
+
+void KernelProfilerBase::insert_counters(
+    const std::string &name,
+    const KernelProfileCounters &counters) {
+  auto &c = get_record(name).counters;
+  c.cycles += counters.cycles;
+  c.instructions += counters.instructions;
+  c.llc_misses += counters.llc_misses;
+  c.num_samples++;
+}
+
+void KernelProfilerBase::insert_sample(const std::string &name,
+                                       double begin_ms,
+                                       double duration_ms) {
+  get_record(name).insert_sample(duration_ms);
+  if (trace_events.size() < kMaxNumTraceEvents) {
+    trace_events.push_back({name, begin_ms * 1000.0, duration_ms * 1000.0});
+  }
+  if (Tracer::is_enabled()) {
+    auto type = get_task_type(name);
+    Tracer::get_instance().add_complete_event(
+        "device", name, tracer_base_us_ + begin_ms * 1000.0,
+        duration_ms * 1000.0,
+        type.empty() ? "" : fmt::format("{{\"type\":\"{}\"}}", type),
+        Tracer::kDeviceProcess, 0);
+  }
 }
 
 void KernelProfilerBase::profiler_start(KernelProfilerBase *profiler,
@@ -38,14 +156,113 @@ void KernelProfilerBase::print() {
       "========================================================================"
       "=\n");
   fmt::print(
-      "[      %     total   count |      min       avg       max   ] Kernel "
-      "name\n");
-  std::sort(records.begin(), records.end());
+      "[      %     total   count |      min       avg       p50       p95     "
+      "  p99       max   ] Kernel name\n");
+  // |records| is indexed by |record_ids|, sort a copy.
+  auto sorted_records = records;
+  std::sort(sorted_records.begin(), sorted_records.end());
+  const auto total_time_ms = get_total_time() * 1000.0;
+  for (auto &rec : sorted_records) {
+    if (rec.counter == 0)
+      continue;
+    auto fraction = rec.get_estimated_total() / total_time_ms * 100.0f;
+    fmt::print(
+        "[{:6.2f}% {:7.3f} s {:6d}x |{:9.3f} {:9.3f} {:9.3f} {:9.3f} {:9.3f} "
+        "{:9.3f} ms] {}\n",
+        fraction, rec.get_estimated_total() / 1000.0f,
+        std::max(rec.num_launches, (int64)rec.counter), rec.min,
+        rec.total / rec.counter, rec.get_percentile(50),
+        rec.get_percentile(95), rec.get_percentile(99), rec.max, rec.name);
+  }
+  // Per task type breakdown, in the order of offloaded_task_type.inc.h.
+  std::map<std::string, std::pair<double, int64>> task_type_times;
   for (auto &rec : records) {
-    auto fraction = rec.total / total_time_ms * 100.0f;
-    fmt::print("[{:6.2f}% {:7.3f} s {:6d}x |{:9.3f} {:9.3f} {:9.3f} ms] {}\n",
-               fraction, rec.total / 1000.0f, rec.counter, rec.min,
-               rec.total / rec.counter, rec.max, rec.name);
+    auto &t = task_type_times[get_task_type(rec.name)];
+    t.first += rec.get_estimated_total();
+    t.second += std::max(rec.num_launches, (int64)rec.counter);
+  }
+  if (task_type_times.size() > 1 || !task_type_times.count("")) {
+    fmt::print(
+        "------------------------------------------------------------------------"
+        "-\n");
+    std::vector<std::string> task_types = {
+#define PER_TASK_TYPE(x) #x,
+#include "taichi/inc/offloaded_task_type.inc.h"
+#undef PER_TASK_TYPE
+        ""};
+    for (auto &type : task_types) {
+      auto it = task_type_times.find(type);
+      if (it == task_type_times.end())
+        continue;
+      fmt::print("[{:6.2f}% {:7.3f} s {:6d}x] {}\n",
+                 it->second.first / total_time_ms * 100.0,
+                 it->second.first / 1000.0, it->second.second,
+                 type.empty() ? "(other)" : type);
+    }
+  }
+  if (std::any_of(records.begin(), records.end(), [&](auto &rec) {
+        return rec.counter > 0 && get_bytes_per_launch(rec.name) > 0;
+      })) {
+    // The bytes are estimated from the fields each range-for task accesses.
+    fmt::print(
+        "------------------------------------------------------------------------"
+        "-\n");
+    fmt::print("[ MB/launch      GB/s   % peak] Kernel name\n");
+    for (auto &rec : sorted_records) {
+      auto bytes = get_bytes_per_launch(rec.name);
+      if (rec.counter == 0 || bytes == 0)
+        continue;
+      auto bandwidth = bytes / (rec.total / rec.counter) * 1e-6;
+      if (peak_bandwidth_ > 0) {
+        fmt::print("[{:10.3f} {:9.3f} {:7.2f}%] {}\n", bytes * 1e-6, bandwidth,
+                   bandwidth / peak_bandwidth_ * 100.0, rec.name);
+      } else {
+        fmt::print("[{:10.3f} {:9.3f}        -] {}\n", bytes * 1e-6, bandwidth,
+                   rec.name);
+      }
+    }
+  }
+  std::vector<std::pair<const KernelProfileRecord *, KernelResourceUsage>>
+      usages;
+  {
+    std::lock_guard<std::mutex> _(bytes_per_launch_mut_);
+    for (auto &rec : sorted_records) {
+      auto it = resource_usage_.find(rec.name);
+      if (rec.counter > 0 && it != resource_usage_.end())
+        usages.emplace_back(&rec, it->second);
+    }
+  }
+  if (!usages.empty()) {
+    // Spilled registers live in the much slower local memory, while fewer
+    // registers per thread let more threads run at once.
+    fmt::print(
+        "------------------------------------------------------------------------"
+        "-\n");
+    fmt::print("[registers  spill stores (B)  spill loads (B)] Kernel name\n");
+    for (auto &[rec, usage] : usages) {
+      fmt::print("[{:9d} {:17d} {:16d}] {}\n", usage.registers,
+                 usage.spill_store_bytes, usage.spill_load_bytes, rec->name);
+    }
+  }
+  if (std::any_of(records.begin(), records.end(), [](auto &rec) {
+        return rec.counters.num_samples > 0;
+      })) {
+    // Low IPC together with many LLC misses hints at a memory-bound task.
+    fmt::print(
+        "------------------------------------------------------------------------"
+        "-\n");
+    fmt::print(
+        "[per launch:    cycles  instructions    IPC  LLC misses] Kernel name\n");
+    for (auto &rec : sorted_records) {
+      auto &c = rec.counters;
+      if (c.num_samples == 0)
+        continue;
+      fmt::print("[{:22.0f} {:13.0f} {:6.2f} {:11.0f}] {}\n",
+                 (double)c.cycles / c.num_samples,
+                 (double)c.instructions / c.num_samples,
+                 (double)c.instructions / std::max(c.cycles, (uint64)1),
+                 (double)c.llc_misses / c.num_samples, rec.name);
+    }
   }
   fmt::print(
       "------------------------------------------------------------------------"
@@ -54,6 +271,17 @@ void KernelProfilerBase::print() {
       "[100.00%] Total kernel execution time: {:7.3f} s   number of records: "
       "{}\n",
       get_total_time(), records.size());
+  if (sampling_interval_ > 1) {
+    fmt::print(
+        "Timed one in {} launches of each task, the totals are extrapolated.\n",
+        sampling_interval_);
+  }
+  auto gc_time = get_total_gc_time();
+  if (gc_time > 0) {
+    fmt::print(
+        "[{:6.2f}%] Total garbage collection time: {:7.3f} s\n",
+        gc_time / std::max(get_total_time(), 1e-9) * 100.0, gc_time);
+  }
 
   fmt::print(
       "========================================================================"
@@ -61,15 +289,211 @@ void KernelProfilerBase::print() {
 }
 
 double KernelProfilerBase::get_total_time() const {
+  double total_time_ms = 0;
+  for (auto &rec : records) {
+    total_time_ms += rec.get_estimated_total();
+  }
   return total_time_ms / 1000.0;
 }
 
+double KernelProfilerBase::get_total_gc_time() const {
+  double gc_time_ms = 0;
+  for (auto &rec : records) {
+    if (is_gc_task(rec.name)) {
+      gc_time_ms += rec.get_estimated_total();
+    }
+  }
+  return gc_time_ms / 1000.0;
+}
+
+void KernelProfilerBase::dump_trace(const std::string &file_name) {
+  sync();
+  std::ofstream fs(file_name);
+  TI_ERROR_IF(!fs, "Failed to open {} for writing", file_name);
+  auto events = trace_events;
+  std::stable_sort(events.begin(), events.end(),
+                   [](const KernelProfileTraceEvent &a,
+                      const KernelProfileTraceEvent &b) {
+                     return a.begin < b.begin;
+                   });
+  fs << "{\"traceEvents\":[";
+  for (std::size_t i = 0; i < events.size(); i++) {
+    auto &e = events[i];
+    auto type = get_task_type(e.name);
+    auto bytes = get_bytes_per_launch(e.name);
+    fs << fmt::format(
+        "{}\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},"
+        "\"dur\":{:.3f},\"pid\":0,\"tid\":0{}}}",
+        i == 0 ? "" : ",", escape_json_string(e.name),
+        type.empty() ? "kernel" : type, e.begin, e.duration,
+        bytes > 0 ? fmt::format(",\"args\":{{\"bytes\":{}}}", bytes) : "");
+  }
+  fs << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  TI_TRACE("Kernel profiler trace ({} events) written to {}", events.size(),
+           file_name);
+}
+
+bool KernelProfilerBase::is_gc_task(const std::string &task_name) {
+  // On CUDA a GC task is split into several launches with different suffixes.
+  return get_task_type(task_name) == "gc";
+}
+
+std::string KernelProfilerBase::get_task_type(const std::string &task_name) {
+  static const std::vector<std::string> task_types = {
+#define PER_TASK_TYPE(x) #x,
+#include "taichi/inc/offloaded_task_type.inc.h"
+#undef PER_TASK_TYPE
+  };
+  // Kernel names may contain the type names as well, so the type must follow
+  // the task id. The last match wins since the kernel name comes first.
+  std::string result;
+  std::size_t result_pos = 0;
+  for (auto &type : task_types) {
+    auto pattern = "_" + type;
+    for (auto pos = task_name.find(pattern); pos != std::string::npos;
+         pos = task_name.find(pattern, pos + 1)) {
+      auto end = pos + pattern.size();
+      if (pos > 0 && std::isdigit(task_name[pos - 1]) &&
+          (end == task_name.size() || !std::isalnum(task_name[end])) &&
+          (result.empty() || pos > result_pos)) {
+        result = type;
+        result_pos = pos;
+      }
+    }
+  }
+  return result;
+}
+
 namespace {
+
+#if defined(TI_PLATFORM_LINUX)
+// Counts cycles, instructions and LLC misses in user space with
+// perf_event_open(2). Linux counters follow a single thread, so a counter group
+// is opened for each thread of the process, including the ones of the thread
+// pool running the CPU tasks.
+class PerfCounters {
+ public:
+  static constexpr int kNumCounters = 3;
+
+  // Returns false if the counters are not available, e.g. because of
+  // /proc/sys/kernel/perf_event_paranoid.
+  bool open() {
+    close();
+    auto dir = opendir("/proc/self/task");
+    if (!dir)
+      return false;
+    while (auto entry = readdir(dir)) {
+      if (!std::isdigit(entry->d_name[0]))
+        continue;
+      std::array<int, kNumCounters> group;
+      if (!open_group(std::atoi(entry->d_name), group)) {
+        closedir(dir);
+        close();
+        return false;
+      }
+      groups_.push_back(group);
+    }
+    closedir(dir);
+    return !groups_.empty();
+  }
+
+  void start() {
+    for (auto &group : groups_) {
+      ioctl(group[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(group[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+
+  KernelProfileCounters stop() {
+    KernelProfileCounters counters;
+    for (auto &group : groups_) {
+      ioctl(group[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+    for (auto &group : groups_) {
+      // PERF_FORMAT_GROUP: the number of counters, then their values.
+      uint64 values[1 + kNumCounters];
+      if (read(group[0], values, sizeof(values)) != sizeof(values))
+        continue;
+      counters.cycles += values[1];
+      counters.instructions += values[2];
+      counters.llc_misses += values[3];
+    }
+    return counters;
+  }
+
+  void close() {
+    for (auto &group : groups_) {
+      for (auto fd : group) {
+        ::close(fd);
+      }
+    }
+    groups_.clear();
+  }
+
+  ~PerfCounters() {
+    close();
+  }
+
+ private:
+  bool open_group(int tid, std::array<int, kNumCounters> &group) {
+    const uint64 configs[kNumCounters] = {PERF_COUNT_HW_CPU_CYCLES,
+                                          PERF_COUNT_HW_INSTRUCTIONS,
+                                          PERF_COUNT_HW_CACHE_MISSES};
+    for (int i = 0; i < kNumCounters; i++) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = i == 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      group[i] = (int)syscall(__NR_perf_event_open, &attr, tid, -1,
+                              i == 0 ? -1 : group[0], 0);
+      if (group[i] < 0) {
+        for (int j = 0; j < i; j++) {
+          ::close(group[j]);
+        }
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::vector<std::array<int, kNumCounters>> groups_;
+};
+#endif
+
 // A simple profiler that uses Time::get_time()
 class DefaultProfiler : public KernelProfilerBase {
  public:
   explicit DefaultProfiler(Arch arch)
-      : title_(fmt::format("{} Profiler", arch_name(arch))) {
+      : arch_(arch), title_(fmt::format("{} Profiler", arch_name(arch))) {
+    base_t_ = Time::get_time();
+    tracer_base_us_ = Tracer::now_us();
+  }
+
+  void enable_hardware_counters() override {
+#if defined(TI_PLATFORM_LINUX)
+    if (arch_is_cpu(arch_)) {
+      // The counters are opened at the first timed launch, once the thread
+      // pool is running.
+      use_counters_ = true;
+      return;
+    }
+#endif
+    KernelProfilerBase::enable_hardware_counters();
+  }
+
+  void clear() override {
+    KernelProfilerBase::clear();
+    base_t_ = Time::get_time();
+    tracer_base_us_ = Tracer::now_us();
+#if defined(TI_PLATFORM_LINUX)
+    // Reopen them for the threads created in the mean time.
+    counters_ = nullptr;
+#endif
   }
 
   void sync() override {
@@ -80,25 +504,46 @@ class DefaultProfiler : public KernelProfilerBase {
   }
 
   void start(const std::string &kernel_name) override {
-    start_t_ = Time::get_time();
+    sampling_ = should_sample(kernel_name);
+    if (!sampling_)
+      return;
     event_name_ = kernel_name;
+#if defined(TI_PLATFORM_LINUX)
+    if (use_counters_ && !counters_) {
+      counters_ = std::make_unique<PerfCounters>();
+      if (!counters_->open()) {
+        TI_WARN(
+            "Failed to open the hardware counters with perf_event_open, check "
+            "/proc/sys/kernel/perf_event_paranoid");
+        counters_ = nullptr;
+        use_counters_ = false;
+      }
+    }
+    if (counters_)
+      counters_->start();
+#endif
+    start_t_ = Time::get_time();
   }
 
   void stop() override {
+    if (!sampling_)
+      return;
     auto t = Time::get_time() - start_t_;
-    auto ms = t * 1000.0;
-    auto it = std::find_if(
-        records.begin(), records.end(),
-        [&](KernelProfileRecord &r) { return r.name == event_name_; });
-    if (it == records.end()) {
-      records.emplace_back(event_name_);
-      it = std::prev(records.end());
-    }
-    it->insert_sample(ms);
-    total_time_ms += ms;
+#if defined(TI_PLATFORM_LINUX)
+    if (counters_)
+      insert_counters(event_name_, counters_->stop());
+#endif
+    insert_sample(event_name_, (start_t_ - base_t_) * 1000.0, t * 1000.0);
   }
 
  private:
+  Arch arch_;
+#if defined(TI_PLATFORM_LINUX)
+  bool use_counters_{false};
+  std::unique_ptr<PerfCounters> counters_;
+#endif
+  double base_t_;
+  bool sampling_{false};
   double start_t_;
   std::string event_name_;
   std::string title_;
@@ -111,13 +556,54 @@ class KernelProfilerCUDA : public KernelProfilerBase {
 
   std::map<std::string, std::vector<std::pair<void *, void *>>>
       outstanding_events;
+
+  // Recorded before the first launch after clear(); the trace timestamps are
+  // relative to it.
+  void *base_event_{nullptr};
+
+  // Timing events already resolved, to be recorded again.
+  std::vector<void *> free_events_;
+
+  void *acquire_event() {
+    void *event;
+    if (free_events_.empty()) {
+      CUDADriver::get_instance().event_create(&event, CU_EVENT_DEFAULT);
+    } else {
+      event = free_events_.back();
+      free_events_.pop_back();
+    }
+    return event;
+  }
+#endif
+
+  void clear() override {
+#if defined(TI_WITH_CUDA)
+    sync();
+    if (base_event_) {
+      free_events_.push_back(base_event_);
+      base_event_ = nullptr;
+    }
 #endif
+    KernelProfilerBase::clear();
+  }
 
   TaskHandle start_with_handle(const std::string &kernel_name) override {
 #if defined(TI_WITH_CUDA)
-    void *start, *stop;
-    CUDADriver::get_instance().event_create(&start, CU_EVENT_DEFAULT);
-    CUDADriver::get_instance().event_create(&stop, CU_EVENT_DEFAULT);
+    // Launches that are not sampled get no events at all. The sampled ones
+    // are resolved in sync(), without blocking the launch.
+    if (!should_sample(kernel_name))
+      return nullptr;
+    if (!base_event_) {
+      base_event_ = acquire_event();
+      CUDADriver::get_instance().event_record(base_event_, 0);
+      if (Tracer::is_enabled()) {
+        // Wait for the device to reach the event once, to align the device
+        // timestamps with the host ones.
+        CUDADriver::get_instance().event_synchronize(base_event_);
+      }
+      tracer_base_us_ = Tracer::now_us();
+    }
+    void *start = acquire_event(), *stop = acquire_event();
     CUDADriver::get_instance().event_record(start, 0);
     outstanding_events[kernel_name].push_back(std::make_pair(start, stop));
     return stop;
@@ -128,7 +614,8 @@ class KernelProfilerCUDA : public KernelProfilerBase {
 
   virtual void stop(TaskHandle handle) override {
 #if defined(TI_WITH_CUDA)
-    CUDADriver::get_instance().event_record(handle, 0);
+    if (handle)
+      CUDADriver::get_instance().event_record(handle, 0);
 #else
     TI_NOT_IMPLEMENTED;
 #endif
@@ -140,22 +627,20 @@ class KernelProfilerCUDA : public KernelProfilerBase {
 
   void sync() override {
 #if defined(TI_WITH_CUDA)
+    if (outstanding_events.empty())
+      return;
     CUDADriver::get_instance().stream_synchronize(nullptr);
     for (auto &map_elem : outstanding_events) {
       auto &list = map_elem.second;
       for (auto &item : list) {
         auto start = item.first, stop = item.second;
-        float ms;
+        float ms, begin_ms;
         CUDADriver::get_instance().event_elapsed_time(&ms, start, stop);
-        auto it = std::find_if(
-            records.begin(), records.end(),
-            [&](KernelProfileRecord &r) { return r.name == map_elem.first; });
-        if (it == records.end()) {
-          records.emplace_back(map_elem.first);
-          it = std::prev(records.end());
-        }
-        it->insert_sample(ms);
-        total_time_ms += ms;
+        CUDADriver::get_instance().event_elapsed_time(&begin_ms, base_event_,
+                                                      start);
+        insert_sample(map_elem.first, begin_ms, ms);
+        free_events_.push_back(start);
+        free_events_.push_back(stop);
       }
     }
     outstanding_events.clear();
@@ -164,6 +649,14 @@ class KernelProfilerCUDA : public KernelProfilerBase {
 #endif
   }
 
+  ~KernelProfilerCUDA() override {
+#if defined(TI_WITH_CUDA)
+    for (auto event : free_events_) {
+      CUDADriver::get_instance().event_destroy(event);
+    }
+#endif
+  }
+
   static KernelProfilerCUDA &get_instance() {
     static KernelProfilerCUDA profiler;
     return profiler;
@@ -6,39 +6,147 @@
 #include <algorithm>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 TLANG_NAMESPACE_BEGIN
 
+// Hardware performance counters, summed over the timed launches that
+// counted them.
+struct KernelProfileCounters {
+  uint64 cycles{0};
+  uint64 instructions{0};
+  // Last level cache misses
+  uint64 llc_misses{0};
+  int num_samples{0};
+};
+
 struct KernelProfileRecord {
+  // The samples are counted in log-scale buckets, kBucketsPerOctave per
+  // doubling of the time from kMinBucketTime ms on, so that percentiles are
+  // estimated within ~10% at a fixed cost per record.
+  static constexpr int kBucketsPerOctave = 4;
+  static constexpr int kNumBuckets = kBucketsPerOctave * 28;
+  static constexpr double kMinBucketTime = 1e-3;
+
   std::string name;
+  // The number of timed launches; see KernelProfilerBase::sampling_interval_
   int counter;
+  int64 num_launches;
   double min;
   double max;
   double total;
+  std::vector<int> histogram;
+  KernelProfileCounters counters;
 
   KernelProfileRecord(const std::string &name)
-      : name(name), counter(0), min(0), max(0), total(0) {
+      : name(name),
+        counter(0),
+        num_launches(0),
+        min(0),
+        max(0),
+        total(0),
+        histogram(kNumBuckets, 0) {
   }
 
   void insert_sample(double t);
 
+  // |p| in [0, 100]
+  double get_percentile(double p) const;
+
+  // The total time of all the launches, extrapolated from the timed ones.
+  double get_estimated_total() const;
+
   bool operator<(const KernelProfileRecord &o) const;
 };
 
+// The registers of a compiled task per thread, and the bytes it spills to
+// local memory, as reported by the assembler.
+struct KernelResourceUsage {
+  int registers{0};
+  int spill_store_bytes{0};
+  int spill_load_bytes{0};
+};
+
+// A launch of an offloaded task, in microseconds since the profiler was
+// cleared.
+struct KernelProfileTraceEvent {
+  std::string name;
+  double begin;
+  double duration;
+};
+
 class KernelProfilerBase {
  protected:
   std::vector<KernelProfileRecord> records;
-  double total_time_ms;
+  std::unordered_map<std::string, std::size_t> record_ids;
+  std::vector<KernelProfileTraceEvent> trace_events;
+  // Only one in |sampling_interval_| launches of each task is timed.
+  int sampling_interval_{1};
+  // In GB/s; 0 if unknown.
+  double peak_bandwidth_{0};
+  // Estimated at compile time, which may happen on other threads. Kept by
+  // clear().
+  std::unordered_map<std::string, int64> bytes_per_launch_;
+  // Reported when the tasks are compiled, also under
+  // |bytes_per_launch_mut_|.
+  std::unordered_map<std::string, KernelResourceUsage> resource_usage_;
+  mutable std::mutex bytes_per_launch_mut_;
+
+  int64 get_bytes_per_launch(const std::string &name) const;
+
+  KernelProfileRecord &get_record(const std::string &name);
+
+  // Counts a launch of |name|, and returns whether to time it.
+  bool should_sample(const std::string &name);
+
+  void insert_counters(const std::string &name,
+                       const KernelProfileCounters &counters);
+
+  // Adds a sample of |duration_ms| to the record of |name|. |begin_ms| is
+  // relative to the time the profiler was cleared.
+  void insert_sample(const std::string &name,
+                     double begin_ms,
+                     double duration_ms);
+
+  // Bounds the memory used by the trace; later launches are only aggregated.
+  static constexpr std::size_t kMaxNumTraceEvents = 1 << 20;
+
+  // Tracer::now_us() at the time the trace timestamps are relative to, for
+  // adding the launches to the Tracer timeline.
+  double tracer_base_us_{0};
 
  public:
   // Needed for the CUDA backend since we need to know which task to "stop"
   using TaskHandle = void *;
 
-  void clear() {
-    total_time_ms = 0;
+  virtual void clear() {
     records.clear();
+    record_ids.clear();
+    trace_events.clear();
+  }
+
+  void set_sampling_interval(int sampling_interval);
+
+  void set_peak_bandwidth(double peak_bandwidth) {
+    peak_bandwidth_ = peak_bandwidth;
+  }
+
+  // Registers the bytes of memory an offloaded task moves per launch, for the
+  // bandwidth report.
+  void set_bytes_per_launch(const std::string &task_name, int64 bytes);
+
+  // Registers the registers and spills of a compiled task, for the resource
+  // usage report.
+  void set_resource_usage(const std::string &task_name,
+                          const KernelResourceUsage &usage);
+
+  // Collects hardware performance counters along with the timed launches,
+  // where supported.
+  virtual void enable_hardware_counters() {
+    TI_WARN("{} does not support hardware counters", title());
   }
 
   virtual void sync() = 0;
@@ -62,8 +170,23 @@ class KernelProfilerBase {
 
   void print();
 
+  // Writes the task launches in the Chrome trace event format, which
+  // chrome://tracing and Perfetto display on a timeline.
+  void dump_trace(const std::string &file_name);
+
   double get_total_time() const;
 
+  // Time spent in garbage collection tasks of sparse SNodes, which is also
+  // included in get_total_time().
+  double get_total_gc_time() const;
+
+  static bool is_gc_task(const std::string &task_name);
+
+  // The type of an offloaded task (e.g. "range_for" or "listgen"), found in
+  // its name "{kernel}_{task id}_{type}...", or "" if it is not a task
+  // name.
+  static std::string get_task_type(const std::string &task_name);
+
   virtual ~KernelProfilerBase() {
   }
 };
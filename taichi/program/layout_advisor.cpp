@@ -0,0 +1,352 @@
+#include "taichi/program/layout_advisor.h"
+
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/ir.h"
+#include "taichi/ir/snode.h"
+#include "taichi/ir/statements.h"
+#include "taichi/program/kernel.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+constexpr const char *kProfileHeader = "taichi_layout_profile 1";
+
+std::string format_megabytes(int64 bytes) {
+  return fmt::format("{:.2f} MB", bytes / 1e6);
+}
+
+}  // namespace
+
+LayoutAdvisor::LayoutAdvisor(SNode *root) : root_(root) {
+  std::map<std::vector<int>, int> class_ids;
+  for (int i = 0; i < (int)root->ch.size(); i++) {
+    auto *dense = root->ch[i].get();
+    if (dense->type != SNodeType::dense || dense->ch.empty())
+      continue;
+    bool eligible = true;
+    for (auto &c : dense->ch) {
+      if (c->type != SNodeType::place || !c->dt->is<PrimitiveType>())
+        eligible = false;
+    }
+    if (!eligible)
+      continue;
+    auto [it, inserted] =
+        class_ids.try_emplace(get_dense_shape(dense), class_ids.size());
+    if (inserted) {
+      int64 num_elements = 1;
+      for (int k = 0; k < taichi_max_num_indices; k++) {
+        num_elements *= dense->extractors[k].num_elements;
+      }
+      class_prototypes_.push_back(dense);
+      class_num_elements_.push_back(num_elements);
+    }
+    for (int j = 0; j < (int)dense->ch.size(); j++) {
+      auto *place = dense->ch[j].get();
+      field_ids_[place] = (int)fields_.size();
+      fields_.push_back(place);
+      keys_.push_back(fmt::format("{}.{}", i, j));
+      shape_classes_.push_back(it->second);
+    }
+  }
+}
+
+std::vector<int> LayoutAdvisor::get_dense_shape(SNode *dense) const {
+  std::vector<int> shape;
+  for (int k = 0; k < taichi_max_num_indices; k++) {
+    const auto &e = dense->extractors[k];
+    shape.push_back(e.active ? e.num_elements : 0);
+  }
+  shape.push_back(dense->_morton);
+  return shape;
+}
+
+void LayoutAdvisor::record_launch(Kernel *kernel) {
+  auto it = kernel_access_sets_.find(kernel);
+  if (it == kernel_access_sets_.end()) {
+    std::vector<AccessSet> access_sets;
+    for (auto &offloaded : kernel->ir->as<Block>()->statements) {
+      auto [reads, writes] =
+          irpass::analysis::gather_snode_read_writes(offloaded.get());
+      std::set<int> ids;
+      for (auto *snodes : {&reads, &writes}) {
+        for (auto *snode : *snodes) {
+          if (auto f = field_ids_.find(snode); f != field_ids_.end())
+            ids.insert(f->second);
+        }
+      }
+      if (!ids.empty())
+        access_sets.emplace_back(ids.begin(), ids.end());
+    }
+    it = kernel_access_sets_.emplace(kernel, std::move(access_sets)).first;
+  }
+  for (auto &access_set : it->second) {
+    profile_[access_set]++;
+  }
+}
+
+LayoutAdvisor::Grouping LayoutAdvisor::get_current_grouping() const {
+  Grouping grouping;
+  for (auto &dense : root_->ch) {
+    std::vector<int> group;
+    for (auto &c : dense->ch) {
+      if (auto f = field_ids_.find(c.get()); f != field_ids_.end())
+        group.push_back(f->second);
+    }
+    if (!group.empty())
+      grouping.push_back(std::move(group));
+  }
+  return grouping;
+}
+
+LayoutAdvisor::Grouping LayoutAdvisor::propose_grouping(
+    const Profile &profile) const {
+  // The fields of a shape class accessed by the same tasks go together. The
+  // fields never accessed end up in one group per class.
+  std::vector<std::vector<int>> signatures(fields_.size());
+  int access_set_id = 0;
+  for (auto &[access_set, count] : profile) {
+    for (int f : access_set) {
+      signatures[f].push_back(access_set_id);
+    }
+    access_set_id++;
+  }
+  std::map<std::pair<int, std::vector<int>>, int> group_ids;
+  Grouping grouping;
+  for (int f = 0; f < (int)fields_.size(); f++) {
+    auto [it, inserted] = group_ids.try_emplace(
+        std::make_pair(shape_classes_[f], signatures[f]), grouping.size());
+    if (inserted)
+      grouping.emplace_back();
+    grouping[it->second].push_back(f);
+  }
+  return grouping;
+}
+
+int64 LayoutAdvisor::estimate_bytes(const Grouping &grouping,
+                                    const Profile &profile) const {
+  // A task touching any field of a group is assumed to move all the elements
+  // of the group, i.e. whole cachelines of its structs.
+  std::vector<int> group_of(fields_.size());
+  std::vector<int64> group_bytes(grouping.size(), 0);
+  for (int g = 0; g < (int)grouping.size(); g++) {
+    for (int f : grouping[g]) {
+      group_of[f] = g;
+      group_bytes[g] += class_num_elements_[shape_classes_[f]] *
+                        data_type_size(fields_[f]->dt);
+    }
+  }
+  int64 bytes = 0;
+  for (auto &[access_set, count] : profile) {
+    std::set<int> touched;
+    for (int f : access_set) {
+      touched.insert(group_of[f]);
+    }
+    for (int g : touched) {
+      bytes += count * group_bytes[g];
+    }
+  }
+  return bytes;
+}
+
+std::string LayoutAdvisor::describe(const Grouping &grouping) const {
+  std::string result;
+  for (auto &group : grouping) {
+    std::vector<std::string> names;
+    for (int f : group) {
+      names.push_back(fields_[f]->name);
+    }
+    if (!result.empty())
+      result += " ";
+    result += fmt::format("[{}]", fmt::join(names, ", "));
+  }
+  return result;
+}
+
+void LayoutAdvisor::regroup(const Grouping &grouping) {
+  std::vector<SNode *> denses;
+  std::unordered_map<SNode *, SNode *> parents;
+  for (auto &dense : root_->ch) {
+    for (auto &c : dense->ch) {
+      if (field_ids_.count(c.get())) {
+        parents[c.get()] = dense.get();
+        if (denses.empty() || denses.back() != dense.get())
+          denses.push_back(dense.get());
+      }
+    }
+  }
+
+  // Each group stays in the dense SNode holding most of its fields, unless
+  // another group took it first.
+  std::set<SNode *> taken;
+  std::vector<SNode *> hosts(grouping.size(), nullptr);
+  for (int g = 0; g < (int)grouping.size(); g++) {
+    int most_fields = 0;
+    for (auto *dense : denses) {
+      if (taken.count(dense))
+        continue;
+      int num_fields = 0;
+      for (int f : grouping[g]) {
+        num_fields += parents[fields_[f]] == dense;
+      }
+      if (num_fields > most_fields) {
+        most_fields = num_fields;
+        hosts[g] = dense;
+      }
+    }
+    if (hosts[g])
+      taken.insert(hosts[g]);
+  }
+
+  std::unordered_map<SNode *, std::unique_ptr<SNode>> detached;
+  for (auto *dense : denses) {
+    for (auto &c : dense->ch) {
+      auto *place = c.get();
+      detached[place] = std::move(c);
+    }
+    dense->ch.clear();
+  }
+  for (int g = 0; g < (int)grouping.size(); g++) {
+    if (!hosts[g]) {
+      auto *prototype = class_prototypes_[shape_classes_[grouping[g][0]]];
+      std::vector<Index> indices;
+      std::vector<int> sizes;
+      for (int k = 0; k < taichi_max_num_indices; k++) {
+        if (prototype->extractors[k].active) {
+          indices.push_back(Index(k));
+          sizes.push_back(prototype->extractors[k].num_elements);
+        }
+      }
+      hosts[g] = &root_->dense(indices, sizes);
+      hosts[g]->_morton = prototype->_morton;
+    }
+    for (int f : grouping[g]) {
+      hosts[g]->ch.push_back(std::move(detached[fields_[f]]));
+    }
+  }
+
+  for (auto it = root_->ch.begin(); it != root_->ch.end();) {
+    if ((*it)->ch.empty() &&
+        std::find(denses.begin(), denses.end(), it->get()) != denses.end()) {
+      retired_snodes_.push_back(std::move(*it));
+      it = root_->ch.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool LayoutAdvisor::apply_profile(const std::string &file_name) {
+  std::ifstream ifs(file_name);
+  if (!ifs)
+    return false;
+  std::unordered_map<std::string, int> ids;
+  for (int f = 0; f < (int)fields_.size(); f++) {
+    ids[keys_[f]] = f;
+  }
+  auto mismatch = [&]() {
+    TI_WARN("Ignoring the layout profile {}, which was recorded for other "
+            "fields",
+            file_name);
+    return false;
+  };
+
+  std::string line;
+  if (!std::getline(ifs, line) || line != kProfileHeader)
+    return mismatch();
+  Profile profile;
+  int num_fields = 0;
+  while (std::getline(ifs, line)) {
+    std::istringstream iss(line);
+    std::string tag, key;
+    iss >> tag;
+    if (tag == "field") {
+      std::string dt;
+      iss >> key >> dt;
+      auto it = ids.find(key);
+      if (it == ids.end() || fields_[it->second]->dt->to_string() != dt)
+        return mismatch();
+      num_fields++;
+    } else if (tag == "launches") {
+      int64 count;
+      iss >> count;
+      std::set<int> access_set;
+      while (iss >> key) {
+        auto it = ids.find(key);
+        if (it == ids.end())
+          return mismatch();
+        access_set.insert(it->second);
+      }
+      profile[AccessSet(access_set.begin(), access_set.end())] += count;
+    }
+  }
+  if (num_fields != (int)fields_.size())
+    return mismatch();
+
+  const auto current = get_current_grouping();
+  const auto proposed = propose_grouping(profile);
+  const auto current_bytes = estimate_bytes(current, profile);
+  const auto proposed_bytes = estimate_bytes(proposed, profile);
+  if (proposed_bytes >= current_bytes)
+    return false;
+  TI_INFO(
+      "Regrouping the fields per {}: {} -> {}, estimated to move {} instead "
+      "of {}",
+      file_name, describe(current), describe(proposed),
+      format_megabytes(proposed_bytes), format_megabytes(current_bytes));
+  regroup(proposed);
+  return true;
+}
+
+void LayoutAdvisor::save_profile(const std::string &file_name) const {
+  std::ofstream ofs(file_name);
+  TI_WARN_IF(!ofs, "Cannot write the layout profile {}", file_name);
+  if (!ofs)
+    return;
+  ofs << kProfileHeader << "\n";
+  for (int f = 0; f < (int)fields_.size(); f++) {
+    ofs << "field " << keys_[f] << " " << fields_[f]->dt->to_string() << "\n";
+  }
+  for (auto &[access_set, count] : profile_) {
+    ofs << "launches " << count;
+    for (int f : access_set) {
+      ofs << " " << keys_[f];
+    }
+    ofs << "\n";
+  }
+}
+
+std::string LayoutAdvisor::get_report() const {
+  if (fields_.empty()) {
+    return "No fields can be regrouped: only the places of a dense child of "
+           "the root, whose children are all places, are considered.\n";
+  }
+  int64 num_launches = 0;
+  for (auto &[access_set, count] : profile_) {
+    num_launches += count;
+  }
+  const auto current = get_current_grouping();
+  const auto proposed = propose_grouping(profile_);
+  const auto current_bytes = estimate_bytes(current, profile_);
+  const auto proposed_bytes = estimate_bytes(proposed, profile_);
+  std::string report =
+      fmt::format("Layout advice from {} task launches:\n", num_launches);
+  report += fmt::format("  current:  {}\n", describe(current));
+  report += fmt::format("            moves {}\n",
+                        format_megabytes(current_bytes));
+  if (proposed_bytes >= current_bytes) {
+    report += "  The current grouping moves no bytes that are not needed.\n";
+    return report;
+  }
+  report += fmt::format("  proposed: {}\n", describe(proposed));
+  report += fmt::format(
+      "            moves {}, {:.1f}% less\n", format_megabytes(proposed_bytes),
+      100.0 * (current_bytes - proposed_bytes) / current_bytes);
+  return report;
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Kernel;
+class SNode;
+
+// Chooses between AoS and SoA groupings of the fields placed in the dense
+// children of the root, from which fields the offloaded tasks access
+// together: the fields that are always accessed together are grouped into
+// one dense SNode, so that no task moves fields it does not need.
+class LayoutAdvisor {
+ public:
+  // Must be created before the struct of |root| is compiled, since fields are
+  // identified by their positions in the declared tree, which do not change
+  // from one run to the next.
+  explicit LayoutAdvisor(SNode *root);
+
+  // Counts the fields accessed by each task of |kernel|.
+  void record_launch(Kernel *kernel);
+
+  // Regroups the fields as proposed for the launches recorded in |file_name|
+  // by save_profile() in an earlier run, if that moves fewer bytes. Returns
+  // whether the layout was changed. Must be called before the struct of the
+  // root is compiled.
+  bool apply_profile(const std::string &file_name);
+
+  void save_profile(const std::string &file_name) const;
+
+  // The current and proposed groupings of the fields, and the bytes they are
+  // estimated to move for the recorded launches.
+  std::string get_report() const;
+
+ private:
+  // Ids of fields, sorted.
+  using AccessSet = std::vector<int>;
+  using Profile = std::map<AccessSet, int64>;
+  using Grouping = std::vector<std::vector<int>>;
+
+  std::vector<int> get_dense_shape(SNode *dense) const;
+
+  Grouping get_current_grouping() const;
+
+  Grouping propose_grouping(const Profile &profile) const;
+
+  int64 estimate_bytes(const Grouping &grouping, const Profile &profile) const;
+
+  std::string describe(const Grouping &grouping) const;
+
+  void regroup(const Grouping &grouping);
+
+  SNode *root_;
+  // The fields that may be regrouped: places of primitive types whose parent,
+  // a dense child of the root, has only such children.
+  std::vector<SNode *> fields_;
+  std::vector<std::string> keys_;
+  std::unordered_map<SNode *, int> field_ids_;
+  // Fields can only be grouped with fields of the same shape class, i.e.
+  // whose parents have the same extractors and Z-order flag.
+  std::vector<int> shape_classes_;
+  std::vector<SNode *> class_prototypes_;
+  std::vector<int64> class_num_elements_;
+
+  Profile profile_;
+  std::unordered_map<Kernel *, std::vector<AccessSet>> kernel_access_sets_;
+  // Dense SNodes emptied by regroup(). They are kept alive rather than
+  // destroyed, since the frontend may still hold them.
+  std::vector<std::unique_ptr<SNode>> retired_snodes_;
+};
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,278 @@
+#include "taichi/program/parallel_primitives.h"
+
+#include <vector>
+
+#include "taichi/program/program.h"
+#include "taichi/jit/jit_module.h"
+#include "taichi/math/arithmetic.h"
+#if defined(TI_WITH_CUDA)
+#include "taichi/backends/cuda/cuda_driver.h"
+#include "taichi/backends/cuda/cuda_graph.h"
+#endif
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// The fewest elements a worker processes serially. Below, the passes cost
+// more than they save.
+constexpr int kCPUMinSegmentSize = 4096;
+constexpr int kCUDAMinSegmentSize = 32;
+// Radix sort keeps a 256-bin histogram per worker.
+constexpr int kMaxNumSortWorkers = 4096;
+constexpr int kCUDABlockDim = 128;
+constexpr std::size_t kScratchAlignment = 256;
+
+std::size_t align_scratch(std::size_t size) {
+  return iroundup(size, kScratchAlignment);
+}
+
+void check_not_in_cuda_graph() {
+#if defined(TI_WITH_CUDA)
+  TI_ERROR_IF(CUDAGraph::get_active(),
+              "Parallel primitives cannot be recorded into a CUDA graph");
+#endif
+}
+
+}  // namespace
+
+StagedArray::StagedArray(Program *program,
+                         void *ptr,
+                         std::size_t size,
+                         bool on_device,
+                         bool read_only)
+    : host_ptr_(ptr), ptr_(ptr), size_(size), read_only_(read_only) {
+#if defined(TI_WITH_CUDA)
+  if (program->config.arch == Arch::cuda && ptr != nullptr && size > 0 &&
+      !on_device && !program->is_external_array(ptr, size)) {
+    CUDADriver::get_instance().malloc(&ptr_, size);
+    CUDADriver::get_instance().memcpy_host_to_device(ptr_, host_ptr_, size);
+  }
+#endif
+}
+
+StagedArray::~StagedArray() {
+#if defined(TI_WITH_CUDA)
+  if (ptr_ != host_ptr_) {
+    if (!read_only_) {
+      CUDADriver::get_instance().memcpy_device_to_host(host_ptr_, ptr_,
+                                                       size_);
+    }
+    CUDADriver::get_instance().mem_free(ptr_);
+  }
+#endif
+}
+
+ParallelPrimitives::ParallelPrimitives(Program *program) : program_(program) {
+  TI_ERROR_IF(!arch_uses_llvm(program->config.arch),
+              "Parallel primitives are only available on CPU and CUDA, not {}",
+              arch_name(program->config.arch));
+}
+
+ParallelPrimitives::~ParallelPrimitives() {
+  if (scratch_ == nullptr)
+    return;
+#if defined(TI_WITH_CUDA)
+  if (program_->config.arch == Arch::cuda) {
+    CUDADriver::get_instance().mem_free(scratch_);
+    return;
+  }
+#endif
+  delete[] scratch_;
+}
+
+char *ParallelPrimitives::get_scratch(std::size_t size) {
+  if (size <= scratch_size_)
+    return scratch_;
+  // Grows geometrically, since the memory is kept until the program ends.
+  size = std::max(size, scratch_size_ * 2);
+#if defined(TI_WITH_CUDA)
+  if (program_->config.arch == Arch::cuda) {
+    if (scratch_) {
+      // Earlier passes may still be reading it.
+      program_->synchronize();
+      CUDADriver::get_instance().mem_free(scratch_);
+    }
+    CUDADriver::get_instance().malloc((void **)&scratch_, size);
+    scratch_size_ = size;
+    return scratch_;
+  }
+#endif
+  delete[] scratch_;
+  scratch_ = new char[size];
+  scratch_size_ = size;
+  return scratch_;
+}
+
+int ParallelPrimitives::get_num_workers(int n, int min_segment_size) const {
+  const auto &config = program_->config;
+  int64 max_num_workers;
+  if (config.arch == Arch::cuda) {
+    max_num_workers = (int64)config.saturating_grid_dim * kCUDABlockDim;
+  } else {
+    // A few segments per thread balance the load.
+    max_num_workers = (int64)config.cpu_max_num_threads * 4;
+  }
+  int64 num_workers = ((int64)n + min_segment_size - 1) / min_segment_size;
+  return (int)std::max(std::min(num_workers, max_num_workers), (int64)1);
+}
+
+void ParallelPrimitives::run_pass(const std::string &name,
+                                  void *a,
+                                  void *b,
+                                  void *c,
+                                  void *d,
+                                  void *e,
+                                  int n,
+                                  int num_workers,
+                                  int shift,
+                                  int flip_sign) {
+  const auto &config = program_->config;
+  auto *runtime = program_->get_llvm_context(config.arch)->runtime_jit_module;
+  auto *llvm_runtime = program_->llvm_runtime;
+  int32 num_threads = config.cpu_max_num_threads;
+  const auto func_name = "runtime_primitive_" + name;
+  if (config.arch == Arch::cuda) {
+    std::vector<void *> arg_pointers{
+        &llvm_runtime, &a,           &b,     &c,         &d,         &e,
+        &n,            &num_workers, &shift, &flip_sign, &num_threads};
+    const int grid_dim = (num_workers + kCUDABlockDim - 1) / kCUDABlockDim;
+    runtime->launch(func_name, grid_dim, kCUDABlockDim, 0, arg_pointers);
+  } else {
+    runtime->call<void *, void *, void *, void *, void *, void *, int32,
+                  int32, int32, int32, int32>(func_name, llvm_runtime, a, b, c,
+                                              d, e, n, num_workers, shift,
+                                              flip_sign, num_threads);
+  }
+}
+
+std::size_t ParallelPrimitives::get_scan_scratch_size(int n) const {
+  const int min_segment_size = program_->config.arch == Arch::cuda
+                                   ? kCUDAMinSegmentSize
+                                   : kCPUMinSegmentSize;
+  std::size_t size = 0;
+  while (true) {
+    int num_workers = get_num_workers(n, min_segment_size);
+    if (num_workers == 1)
+      return size;
+    size += align_scratch(sizeof(int32) * num_workers);
+    n = num_workers;
+  }
+}
+
+void ParallelPrimitives::scan(int32 *data, int n, int32 *scratch) {
+  const int min_segment_size = program_->config.arch == Arch::cuda
+                                   ? kCUDAMinSegmentSize
+                                   : kCPUMinSegmentSize;
+  int num_workers = get_num_workers(n, min_segment_size);
+  if (num_workers == 1) {
+    run_pass("scan_downsweep", data, nullptr, nullptr, nullptr, nullptr, n, 1);
+    return;
+  }
+  // Scans the sums of the segments recursively, and then each segment
+  // starting from its prefix sum.
+  auto *sums = scratch;
+  run_pass("scan_reduce", data, sums, nullptr, nullptr, nullptr, n,
+           num_workers);
+  scan(sums, num_workers,
+       (int32 *)((char *)scratch + align_scratch(sizeof(int32) * num_workers)));
+  run_pass("scan_downsweep", data, sums, nullptr, nullptr, nullptr, n,
+           num_workers);
+}
+
+void ParallelPrimitives::exclusive_scan_i32(void *data, int n, bool on_device) {
+  if (n <= 0)
+    return;
+  check_not_in_cuda_graph();
+  StagedArray staged(program_, data, sizeof(int32) * n, on_device);
+  auto *scratch = get_scratch(get_scan_scratch_size(n));
+  scan((int32 *)staged.get(), n, (int32 *)scratch);
+  program_->synchronize();
+}
+
+void ParallelPrimitives::sort_pairs_32(void *keys,
+                                       void *values,
+                                       int n,
+                                       bool signed_keys,
+                                       bool on_device) {
+  if (n <= 1)
+    return;
+  check_not_in_cuda_graph();
+  const std::size_t array_size = sizeof(uint32) * n;
+  StagedArray staged_keys(program_, keys, array_size, on_device);
+  StagedArray staged_values(program_, values, array_size, on_device);
+  const int min_segment_size = program_->config.arch == Arch::cuda
+                                   ? kCUDAMinSegmentSize * 8
+                                   : kCPUMinSegmentSize;
+  const int num_workers =
+      std::min(get_num_workers(n, min_segment_size), kMaxNumSortWorkers);
+  const int histogram_size = 256 * num_workers;
+
+  // Layout: keys, values, histogram, the scratch of its scan.
+  std::size_t offsets[4];
+  offsets[0] = 0;
+  offsets[1] = offsets[0] + align_scratch(array_size);
+  offsets[2] = offsets[1] + (values ? align_scratch(array_size) : 0);
+  offsets[3] = offsets[2] + align_scratch(sizeof(int32) * histogram_size);
+  auto *scratch =
+      get_scratch(offsets[3] + get_scan_scratch_size(histogram_size));
+  void *buffers[2][2] = {
+      {staged_keys.get(), staged_values.get()},
+      {scratch + offsets[0], values ? scratch + offsets[1] : nullptr}};
+  auto *histogram = (int32 *)(scratch + offsets[2]);
+
+  // Least significant digit first, 8 bits per pass. The four passes end up
+  // in the input buffers.
+  for (int pass = 0; pass < 4; pass++) {
+    auto &src = buffers[pass % 2];
+    auto &dst = buffers[(pass + 1) % 2];
+    const int shift = pass * 8;
+    run_pass("radix_histogram", src[0], histogram, nullptr, nullptr, nullptr, n,
+             num_workers, shift, signed_keys);
+    scan(histogram, histogram_size, (int32 *)(scratch + offsets[3]));
+    run_pass("radix_scatter", src[0], histogram, dst[0], src[1], dst[1], n,
+             num_workers, shift, signed_keys);
+  }
+  program_->synchronize();
+}
+
+int ParallelPrimitives::compact_32(void *input,
+                                   void *flags,
+                                   void *output,
+                                   int n,
+                                   bool on_device) {
+  if (n <= 0)
+    return 0;
+  check_not_in_cuda_graph();
+  const std::size_t array_size = sizeof(uint32) * n;
+  StagedArray staged_input(program_, input, array_size, on_device);
+  StagedArray staged_flags(program_, flags, array_size, on_device);
+  StagedArray staged_output(program_, output, array_size, on_device);
+  const int min_segment_size = program_->config.arch == Arch::cuda
+                                   ? kCUDAMinSegmentSize
+                                   : kCPUMinSegmentSize;
+  const int num_workers = get_num_workers(n, min_segment_size);
+
+  // The offsets have one more slot, which ends up holding the count.
+  const std::size_t offsets_size = align_scratch(sizeof(int32) * (n + 1));
+  auto *scratch = get_scratch(offsets_size + get_scan_scratch_size(n + 1));
+  auto *offsets = (int32 *)scratch;
+  run_pass("compact_flags", staged_flags.get(), offsets, nullptr, nullptr,
+           nullptr, n, num_workers);
+  scan(offsets, n + 1, (int32 *)(scratch + offsets_size));
+  run_pass("compact_scatter", staged_flags.get(), offsets, staged_input.get(),
+           staged_output.get(), nullptr, n, num_workers);
+
+  int32 count = 0;
+#if defined(TI_WITH_CUDA)
+  if (program_->config.arch == Arch::cuda) {
+    CUDADriver::get_instance().memcpy_device_to_host(&count, offsets + n,
+                                                     sizeof(int32));
+    return count;
+  }
+#endif
+  count = offsets[n];
+  return count;
+}
+
+TLANG_NAMESPACE_END
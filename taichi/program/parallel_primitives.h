@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Program;
+
+// Gives the passes of the primitives a device copy of a host array on CUDA,
+// which is copied back at destruction unless |read_only|. The other arrays
+// are accessed in place.
+class StagedArray {
+ public:
+  StagedArray(Program *program,
+              void *ptr,
+              std::size_t size,
+              bool on_device,
+              bool read_only = false);
+
+  void *get() const {
+    return ptr_;
+  }
+
+  ~StagedArray();
+
+ private:
+  void *host_ptr_;
+  void *ptr_;
+  std::size_t size_;
+  bool read_only_;
+};
+
+// Device-wide exclusive scan, radix sort-by-key and stream compaction of
+// 32-bit arrays on the LLVM backends (CPU and CUDA). The passes are the
+// runtime_primitive_* functions of the LLVM runtime. See
+// python/taichi/lang/parallel_primitives.py for the wrappers taking fields and
+// external arrays.
+//
+// The arrays are given by address. On CUDA, |on_device| arrays (e.g. CUDA
+// tensors) and zero-copy external arrays are accessed in place, and host
+// arrays are staged through device memory. All the functions return after the
+// results are written.
+class ParallelPrimitives {
+ public:
+  explicit ParallelPrimitives(Program *program);
+
+  ~ParallelPrimitives();
+
+  // data[i] = data[0] + ... + data[i - 1], over i32.
+  void exclusive_scan_i32(void *data, int n, bool on_device);
+
+  // Sorts |keys| (i32, or u32 if !|signed_keys|) stably, and permutes |values|
+  // (any 32-bit type, or null) along.
+  void sort_pairs_32(void *keys,
+                     void *values,
+                     int n,
+                     bool signed_keys,
+                     bool on_device);
+
+  // Copies the elements of |input| (any 32-bit type) with non-zero |flags|
+  // (i32) to the front of |output|, in order. Returns their number.
+  int compact_32(void *input,
+                 void *flags,
+                 void *output,
+                 int n,
+                 bool on_device);
+
+ private:
+  // The scratch memory of the passes, reused across calls.
+  char *get_scratch(std::size_t size);
+
+  int get_num_workers(int n, int min_segment_size) const;
+
+  void run_pass(const std::string &name,
+                void *a,
+                void *b,
+                void *c,
+                void *d,
+                void *e,
+                int n,
+                int num_workers,
+                int shift = 0,
+                int flip_sign = 0);
+
+  // Scans |n| i32s in place, using |scratch|, which holds at least
+  // get_scan_scratch_size(n) bytes.
+  void scan(int32 *data, int n, int32 *scratch);
+
+  std::size_t get_scan_scratch_size(int n) const;
+
+  Program *program_;
+  char *scratch_{nullptr};
+  std::size_t scratch_size_{0};
+};
+
+TLANG_NAMESPACE_END
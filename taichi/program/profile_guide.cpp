@@ -0,0 +1,107 @@
+#include "taichi/program/profile_guide.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/ir.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/llvm/llvm_offline_cache.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+constexpr const char *kProfileHeader = "taichi_pgo_profile 1";
+
+}  // namespace
+
+bool ProfileGuide::load_profile(const std::string &file_name) {
+  std::ifstream ifs(file_name);
+  if (!ifs)
+    return false;
+  std::string line;
+  if (!std::getline(ifs, line) || line != kProfileHeader) {
+    TI_WARN("Ignoring the PGO profile {} of an unknown format", file_name);
+    return false;
+  }
+  std::string contents;
+  std::unordered_map<std::string, std::vector<uint64>> profile;
+  while (std::getline(ifs, line)) {
+    std::istringstream iss(line);
+    std::string tag, key;
+    int n = 0;
+    iss >> tag >> key >> n;
+    std::vector<uint64> counts(std::max(n, 0));
+    for (auto &count : counts) {
+      iss >> count;
+    }
+    if (tag != "task" || !iss) {
+      TI_WARN("Ignoring the corrupted PGO profile {}", file_name);
+      return false;
+    }
+    profile[key] = std::move(counts);
+    contents += line + "\n";
+  }
+  std::lock_guard<std::mutex> _(mut_);
+  profile_ = std::move(profile);
+  digest_ = LlvmOfflineCache::hash(contents);
+  TI_TRACE("Loaded the PGO profile {} of {} tasks", file_name,
+           profile_.size());
+  return true;
+}
+
+void ProfileGuide::save_profile(const std::string &file_name,
+                                const std::vector<uint64> &counters) const {
+  std::ofstream ofs(file_name);
+  TI_WARN_IF(!ofs, "Cannot write the PGO profile {}", file_name);
+  if (!ofs)
+    return;
+  std::lock_guard<std::mutex> _(mut_);
+  // Sorted, so that the same counts give the same digest.
+  std::map<std::string, std::pair<int, int>> sorted(counters_.begin(),
+                                                    counters_.end());
+  ofs << kProfileHeader << "\n";
+  for (auto &[key, range] : sorted) {
+    ofs << "task " << key << " " << range.second;
+    for (int i = range.first; i < range.first + range.second; i++) {
+      ofs << " " << counters[i];
+    }
+    ofs << "\n";
+  }
+}
+
+int ProfileGuide::allocate_counters(const std::string &key, int n) {
+  std::lock_guard<std::mutex> _(mut_);
+  if (auto it = counters_.find(key); it != counters_.end()) {
+    TI_ASSERT(it->second.second == n);
+    return it->second.first;
+  }
+  if (num_counters_ + n > kMaxNumCounters)
+    return -1;
+  counters_[key] = {num_counters_, n};
+  num_counters_ += n;
+  return num_counters_ - n;
+}
+
+const std::vector<uint64> *ProfileGuide::find_counts(
+    const std::string &key) const {
+  std::lock_guard<std::mutex> _(mut_);
+  auto it = profile_.find(key);
+  return it == profile_.end() ? nullptr : &it->second;
+}
+
+std::string ProfileGuide::get_task_key(OffloadedStmt *task) {
+  // Renumbers a copy, so that the ids do not depend on the rest of the
+  // kernel.
+  auto copy = irpass::analysis::clone(task);
+  irpass::re_id(copy.get());
+  std::string serialized;
+  irpass::print(copy.get(), &serialized);
+  return LlvmOfflineCache::hash(serialized);
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class OffloadedStmt;
+
+// Profile-guided optimization of the offloaded tasks on the LLVM backends.
+// The runs with CompileConfig::pgo_instrument count in the LLVMRuntime how
+// often the branches of the tasks are taken and how many iterations their
+// loops run, and save the counts to CompileConfig::pgo_profile. The later runs
+// compile the tasks with the counts loaded from it.
+class ProfileGuide {
+ public:
+  // The size of the counters in the LLVMRuntime. The tasks compiled after
+  // they are all allocated are not instrumented.
+  static constexpr int kMaxNumCounters = 1 << 16;
+
+  // Loads the counts saved by save_profile() in an earlier run to
+  // |file_name|, if it exists. Returns whether it was loaded.
+  bool load_profile(const std::string &file_name);
+
+  // Saves the |counters| read back from the LLVMRuntime with the tasks they
+  // were allocated to.
+  void save_profile(const std::string &file_name,
+                    const std::vector<uint64> &counters) const;
+
+  // Returns the first of the |n| counters of the task with |key|, allocated
+  // on the first call for the key, or -1 if there are no counters left.
+  int allocate_counters(const std::string &key, int n);
+
+  // The counts of the task with |key| in the loaded profile, or nullptr.
+  const std::vector<uint64> *find_counts(const std::string &key) const;
+
+  // Identifies the loaded profile in the keys of the compiled kernels.
+  const std::string &get_digest() const {
+    return digest_;
+  }
+
+  // Identifies |task| across runs by its IR, since the names of the tasks
+  // are numbered in the order they are compiled.
+  static std::string get_task_key(OffloadedStmt *task);
+
+ private:
+  mutable std::mutex mut_;
+  // The first counter and the number of counters of each task.
+  std::unordered_map<std::string, std::pair<int, int>> counters_;
+  int num_counters_{0};
+
+  std::unordered_map<std::string, std::vector<uint64>> profile_;
+  std::string digest_;
+};
+
+TLANG_NAMESPACE_END
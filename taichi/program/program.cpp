@@ -2,7 +2,11 @@
 
 #include "program.h"
 
+#include <cstring>
+
 #include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/math/arithmetic.h"
 #include "taichi/program/extension.h"
 #include "taichi/backends/metal/api.h"
 #include "taichi/backends/opengl/opengl_api.h"
@@ -10,6 +14,8 @@
 #include "taichi/backends/cuda/cuda_driver.h"
 #include "taichi/backends/cuda/codegen_cuda.h"
 #include "taichi/backends/cuda/cuda_context.h"
+#include "taichi/backends/cuda/cuda_device_memory_pool.h"
+#include "taichi/backends/cuda/cuda_graph.h"
 #endif
 #include "taichi/backends/metal/codegen_metal.h"
 #include "taichi/backends/opengl/codegen_opengl.h"
@@ -18,12 +24,23 @@
 #include "taichi/struct/struct_llvm.h"
 #include "taichi/backends/metal/struct_metal.h"
 #include "taichi/backends/opengl/struct_opengl.h"
+#include "taichi/backends/vulkan/vulkan_runtime.h"
 #include "taichi/system/unified_allocator.h"
 #include "taichi/ir/snode.h"
+#include "taichi/ir/frontend.h"
 #include "taichi/ir/frontend_ir.h"
+#include "taichi/program/activation_tracker.h"
 #include "taichi/program/async_engine.h"
+#include "taichi/program/checkpoint.h"
+#include "taichi/program/layout_advisor.h"
+#include "taichi/program/profile_guide.h"
+#include "taichi/program/parallel_primitives.h"
+#include "taichi/program/sparse_matrix.h"
 #include "taichi/util/statistics.h"
 #include "taichi/util/str.h"
+#include "taichi/system/numa.h"
+#include "taichi/system/tracer.h"
+#include "taichi/system/virtual_memory.h"
 #if defined(TI_WITH_CC)
 #include "taichi/backends/cc/struct_cc.h"
 #include "taichi/backends/cc/cc_layout.h"
@@ -51,6 +68,10 @@ void *taichi_allocate_aligned(Program *prog,
   return prog->memory_pool->allocate(size, alignment);
 }
 
+// Whether the current thread is one of the compilation workers, which must not
+// wait for the other workers.
+thread_local bool on_compilation_worker = false;
+
 inline uint64 *allocate_result_buffer_default(Program *prog) {
   return (uint64 *)taichi_allocate_aligned(
       prog, sizeof(uint64) * taichi_result_buffer_entries, 8);
@@ -60,6 +81,35 @@ inline uint64 *allocate_result_buffer_default(Program *prog) {
 
 Program *current_program = nullptr;
 std::atomic<int> Program::num_instances;
+thread_local Kernel *Program::current_kernel = nullptr;
+
+namespace {
+
+// A task compiled by one of the Programs, under its signature and task key,
+// for the later Programs with the same config and layout.
+struct SharedCompiledTask {
+  std::vector<LlvmOfflineCache::TaskInfo> tasks;
+  JITModule *jit_module;
+  std::weak_ptr<TaichiLLVMContext> owner;
+};
+
+std::mutex shared_compiled_tasks_mut;
+std::unordered_map<std::string, SharedCompiledTask> shared_compiled_tasks;
+
+// Lives as long as one of the Programs does.
+std::shared_ptr<ThreadPool> get_shared_thread_pool() {
+  static std::mutex mut;
+  static std::weak_ptr<ThreadPool> shared_pool;
+  std::lock_guard<std::mutex> _(mut);
+  auto pool = shared_pool.lock();
+  if (!pool) {
+    pool = std::make_shared<ThreadPool>();
+    shared_pool = pool;
+  }
+  return pool;
+}
+
+}  // namespace
 
 Program::Program(Arch desired_arch) {
   TI_TRACE("Program initializing...");
@@ -94,6 +144,12 @@ Program::Program(Arch desired_arch) {
       arch = host_arch();
     }
   }
+  if (arch == Arch::vulkan) {
+    if (!vulkan::is_vulkan_api_available()) {
+      TI_WARN("No Vulkan API detected.");
+      arch = host_arch();
+    }
+  }
 
   if (arch == Arch::cc) {
 #ifdef TI_WITH_CC
@@ -109,20 +165,28 @@ Program::Program(Arch desired_arch) {
   }
 
   memory_pool = std::make_unique<MemoryPool>(this);
-  TI_ASSERT_INFO(num_instances == 0, "Only one instance at a time");
   total_compilation_time = 0;
   num_instances += 1;
+  if (current_program) {
+    current_program->snode_counter_ = SNode::counter;
+  }
   SNode::counter = 0;
   // llvm_context_device is initialized before kernel compilation
-  TI_ASSERT(current_program == nullptr);
   current_program = this;
+  thread_pool = get_shared_thread_pool();
   config = default_compile_config;
   config.arch = arch;
 
-  llvm_context_host = std::make_unique<TaichiLLVMContext>(host_arch());
+  llvm_context_host = std::make_shared<TaichiLLVMContext>(host_arch());
   profiler = make_profiler(arch);
-
-  preallocated_device_buffer = nullptr;
+  profiler->set_sampling_interval(config.kernel_profiler_sampling_interval);
+  profiler->set_peak_bandwidth(config.kernel_profiler_peak_bandwidth);
+  if (config.kernel_profiler && config.kernel_profiler_hardware_counters) {
+    profiler->enable_hardware_counters();
+  }
+  if (config.compile_profiler) {
+    compile_profiler = std::make_unique<CompileProfiler>();
+  }
 
   if (config.kernel_profiler && runtime) {
     runtime->set_profiler(profiler.get());
@@ -154,9 +218,44 @@ Program::Program(Arch desired_arch) {
         });
   }
 
+  if (config.offline_cache &&
+      (arch_is_cpu(config.arch) || config.arch == Arch::cuda)) {
+    auto path = config.offline_cache_file_path;
+    if (path.empty()) {
+      path = get_repo_dir() + "/.cache/llvm";
+    }
+    TI_TRACE("Offline cache enabled at [{}]", path);
+    llvm_offline_cache = std::make_unique<LlvmOfflineCache>(
+        path, (std::size_t)config.offline_cache_max_size_bytes);
+    if (config.arch == Arch::cuda && config.cuda_cubin_cache) {
+      cubin_cache = std::make_unique<LlvmOfflineCache>(
+          path + "/cubin", (std::size_t)config.offline_cache_max_size_bytes);
+    }
+  }
+
+  if (config.aot_record) {
+    TI_ERROR_IF(!arch_is_cpu(config.arch) && config.arch != Arch::cuda,
+                "aot_record is only supported on CPU and CUDA");
+    TI_ERROR_IF(config.async_mode, "aot_record is not supported in async mode");
+    llvm_aot_module = std::make_unique<LlvmAotModule>();
+  }
+
+  if (config.pgo_instrument || !config.pgo_profile.empty()) {
+    TI_ERROR_IF(!arch_is_cpu(config.arch) && config.arch != Arch::cuda,
+                "Profile-guided optimization is only supported on CPU and "
+                "CUDA");
+    TI_ERROR_IF(config.pgo_instrument && config.pgo_profile.empty(),
+                "pgo_instrument requires a pgo_profile to save the counts to");
+    profile_guide = std::make_unique<ProfileGuide>();
+    if (!config.pgo_instrument)
+      profile_guide->load_profile(config.pgo_profile);
+  }
+
   // TODO: allow users to run in debug mode without out-of-bound checks
-  if (config.debug)
+  if (config.debug) {
     config.check_out_of_bound = true;
+    config.verify_each_pass = true;
+  }
 
   if (!is_extension_supported(config.arch, Extension::assertion)) {
     if (config.check_out_of_bound) {
@@ -183,6 +282,19 @@ Program::Program(Arch desired_arch) {
       // each SM can have 16-32 resident blocks
       config.saturating_grid_dim = num_SMs * 32;
     }
+
+    if (config.cuda_max_bls_bytes == 0) {
+      config.cuda_max_bls_bytes =
+          CUDAContext::get_instance().get_max_shared_memory_bytes();
+    }
+
+    if (config.use_virtual_device_memory && config.use_unified_memory &&
+        CUDAContext::get_instance().supports_virtual_memory()) {
+      // Device memory grows on demand without unified memory, whose
+      // allocations need the host to serve device requests.
+      TI_TRACE("Using virtual device memory instead of unified memory");
+      config.use_unified_memory = false;
+    }
 #endif
   }
 
@@ -206,15 +318,26 @@ TypeFactory &Program::get_type_factory() {
 FunctionType Program::compile(Kernel &kernel) {
   auto start_t = Time::get_time();
   TI_AUTO_PROF;
+  TI_TRACE_SCOPE("compile", kernel.name);
   FunctionType ret = nullptr;
-  if (arch_is_cpu(kernel.arch) || kernel.arch == Arch::cuda ||
-      kernel.arch == Arch::metal) {
+  const bool parallel_compilation =
+      (arch_is_cpu(kernel.arch) || kernel.arch == Arch::cuda) &&
+      config.num_compile_threads != 1 && !kernel.is_evaluator &&
+      !kernel.is_accessor && !config.print_ir;
+  if (parallel_compilation) {
+    ret = compile_offloads_in_parallel(kernel);
+  } else if (arch_is_cpu(kernel.arch) || kernel.arch == Arch::cuda ||
+             kernel.arch == Arch::metal) {
     kernel.lower();
     ret = compile_to_backend_executable(kernel, /*offloaded=*/nullptr);
   } else if (kernel.arch == Arch::opengl) {
     opengl::OpenglCodeGen codegen(kernel.name, &opengl_struct_compiled_.value(),
                                   opengl_kernel_launcher_.get());
     ret = codegen.compile(*this, kernel);
+  } else if (kernel.arch == Arch::vulkan) {
+    opengl::OpenglCodeGen codegen(kernel.name, &opengl_struct_compiled_.value(),
+                                  vulkan_runtime_.get());
+    ret = codegen.compile(*this, kernel);
 #ifdef TI_WITH_CC
   } else if (kernel.arch == Arch::cc) {
     ret = cccp::compile_kernel(&kernel);
@@ -241,33 +364,217 @@ FunctionType Program::compile_to_backend_executable(Kernel &kernel,
   return nullptr;
 }
 
+FunctionType Program::compile_offloads_in_parallel(Kernel &kernel) {
+  TI_AUTO_PROF;
+  kernel.lower(/*to_executable=*/false);
+  const bool make_block_local =
+      is_extension_supported(config.arch, Extension::bls) &&
+      config.make_block_local;
+  auto &offloads = kernel.ir->as<Block>()->statements;
+  if (offloads.size() < 2) {
+    irpass::offload_to_executable(kernel.ir.get(), config, /*verbose=*/false,
+                                  /*lower_global_access=*/true,
+                                  config.make_thread_local, make_block_local);
+    return compile_to_backend_executable(kernel, /*offloaded=*/nullptr);
+  }
+
+  return compile_offloaded_tasks(kernel, kernel.ir->as<Block>());
+}
+
+FunctionType Program::compile_offloaded_tasks(Kernel &kernel, Block *block) {
+  const bool make_block_local =
+      is_extension_supported(config.arch, Extension::bls) &&
+      config.make_block_local;
+  auto &offloads = block->statements;
+  // Each task only lowers and compiles its own OffloadedStmt, and codegen
+  // builds a separate LLVM module on the LLVM context of the worker thread.
+  std::vector<FunctionType> funcs(offloads.size());
+  auto compile_task = [&](int i) {
+    auto offloaded = offloads[i]->as<OffloadedStmt>();
+    irpass::offload_to_executable(offloaded, config, /*verbose=*/false,
+                                  /*lower_global_access=*/true,
+                                  config.make_thread_local, make_block_local);
+    funcs[i] = compile_to_backend_executable(kernel, offloaded);
+  };
+  if (arch_is_cpu(kernel.arch) || kernel.arch == Arch::cuda) {
+    run_on_compilation_workers((int)offloads.size(), compile_task);
+  } else {
+    for (int i = 0; i < (int)offloads.size(); i++) {
+      compile_task(i);
+    }
+  }
+  return [funcs](Context &context) {
+    for (auto &func : funcs) {
+      func(context);
+    }
+  };
+}
+
+void Program::run_on_compilation_workers(
+    int n,
+    const std::function<void(int)> &func) {
+  if (config.num_compile_threads == 1 || on_compilation_worker || n < 2) {
+    for (int i = 0; i < n; i++) {
+      func(i);
+    }
+    return;
+  }
+  if (!compilation_workers_) {
+    int num_threads = config.num_compile_threads;
+    if (num_threads <= 0) {
+      num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    compilation_workers_ = std::make_unique<ParallelExecutor>(num_threads);
+  }
+  std::vector<std::exception_ptr> errors(n);
+  for (int i = 0; i < n; i++) {
+    compilation_workers_->enqueue([&, i]() {
+      on_compilation_worker = true;
+      try {
+        func(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+      on_compilation_worker = false;
+    });
+  }
+  compilation_workers_->flush();
+  for (auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+bool Program::find_compiled_task(const std::string &key, CompiledTask *task) {
+  std::lock_guard<std::mutex> _(compiled_tasks_mut_);
+  auto it = compiled_tasks_.find(key);
+  if (it != compiled_tasks_.end()) {
+    *task = it->second;
+    return true;
+  }
+  auto shared_key = LlvmOfflineCache::make_signature(this) + key;
+  std::lock_guard<std::mutex> __(shared_compiled_tasks_mut);
+  auto shared = shared_compiled_tasks.find(shared_key);
+  if (shared == shared_compiled_tasks.end()) {
+    return false;
+  }
+  auto owner = shared->second.owner.lock();
+  if (!owner) {
+    // All the Programs using the task are gone.
+    shared_compiled_tasks.erase(shared);
+    return false;
+  }
+  *task = {shared->second.tasks, shared->second.jit_module, std::move(owner)};
+  compiled_tasks_.emplace(key, *task);
+  return true;
+}
+
+void Program::add_compiled_task(const std::string &key,
+                                const CompiledTask &task) {
+  std::lock_guard<std::mutex> _(compiled_tasks_mut_);
+  compiled_tasks_.emplace(key, task);
+  auto owner = task.owner;
+  if (!owner) {
+    owner = config.arch == Arch::cuda ? llvm_context_device
+                                      : llvm_context_host;
+  }
+  std::lock_guard<std::mutex> __(shared_compiled_tasks_mut);
+  shared_compiled_tasks[LlvmOfflineCache::make_signature(this) + key] = {
+      task.tasks, task.jit_module, owner};
+}
+
+void Program::make_current() {
+  if (current_program == this) {
+    return;
+  }
+  if (current_program) {
+    current_program->snode_counter_ = SNode::counter;
+  }
+  SNode::counter = snode_counter_;
+  current_program = this;
+}
+
+void Program::enqueue_background_compilation(
+    const std::function<void()> &func) {
+  if (!background_compiler_)
+    background_compiler_ = std::make_unique<ParallelExecutor>(1);
+  background_compiler_->enqueue(func);
+}
+
+void Program::enqueue_host_launch(const std::function<void()> &func) {
+  if (!host_launcher_)
+    host_launcher_ = std::make_unique<ParallelExecutor>(1);
+  host_launcher_->enqueue(func);
+  sync = false;
+}
+
 // For CPU and CUDA archs only
 void Program::initialize_runtime_system(StructCompiler *scomp) {
   // auto tlctx = llvm_context_host.get();
   TaichiLLVMContext *tlctx;
 
   std::size_t prealloc_size = 0;
+  void *prealloc_buffer = nullptr;
+  void *prealloc_bounds = nullptr;
+
+  // A buffer of random states, one per CUDA thread
+  int num_rand_states = 0;
+
+  if (config.arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+    // It is important to make sure that every CUDA thread has its own random
+    // state so that we do not need expensive per-state locks.
+    num_rand_states = config.saturating_grid_dim * config.max_block_dim;
+#else
+    TI_NOT_IMPLEMENTED
+#endif
+  }
 
   if (config.arch == Arch::cuda && !config.use_unified_memory) {
 #if defined(TI_WITH_CUDA)
     CUDADriver::get_instance().malloc(
         (void **)&result_buffer, sizeof(uint64) * taichi_result_buffer_entries);
     auto total_mem = runtime->get_total_memory();
-    if (config.device_memory_fraction == 0) {
-      TI_ASSERT(config.device_memory_GB > 0);
-      prealloc_size = std::size_t(config.device_memory_GB * (1UL << 30));
+    // runtime_initialize() allocates the root buffer and the temporaries
+    // before the host gets a chance to commit more memory. The headroom covers
+    // the runtime itself, and the random states (20 bytes each) allocated by
+    // the first task using them.
+    auto initial_size =
+        iroundup((std::size_t)scomp->root_size, taichi_page_size) +
+        taichi_global_tmp_buffer_size + CUDADeviceMemoryPool::kMinHeadroom;
+    if (config.use_virtual_device_memory &&
+        CUDAContext::get_instance().supports_virtual_memory()) {
+      std::vector<int> devices = {0};
+      auto reserved_size = total_mem;
+      if (config.cuda_peer_memory) {
+        for (int peer : CUDAContext::get_instance().get_peer_devices()) {
+          devices.push_back(peer);
+          reserved_size += CUDAContext::get_instance().get_total_memory(peer);
+        }
+        TI_TRACE("Committing device memory on {} device(s)", devices.size());
+      }
+      cuda_device_memory_pool_ = std::make_unique<CUDADeviceMemoryPool>(
+          std::max(reserved_size, initial_size), initial_size, devices);
     } else {
-      prealloc_size = std::size_t(config.device_memory_fraction * total_mem);
-    }
-    TI_ASSERT(prealloc_size <= total_mem);
+      if (config.device_memory_fraction == 0) {
+        TI_ASSERT(config.device_memory_GB > 0);
+        prealloc_size = std::size_t(config.device_memory_GB * (1UL << 30));
+      } else {
+        prealloc_size = std::size_t(config.device_memory_fraction * total_mem);
+      }
+      TI_ASSERT(prealloc_size <= total_mem);
 
-    TI_TRACE("Allocating device memory {:.2f} GB",
-             1.0 * prealloc_size / (1UL << 30));
+      TI_TRACE("Allocating device memory {:.2f} GB",
+               1.0 * prealloc_size / (1UL << 30));
 
-    CUDADriver::get_instance().malloc(&preallocated_device_buffer,
-                                      prealloc_size);
-    CUDADriver::get_instance().memset(preallocated_device_buffer, 0,
-                                      prealloc_size);
+      // The memory is zero-filled as it gets allocated.
+      cuda_device_memory_pool_ = CUDADeviceMemoryPool::create_preallocated(
+          prealloc_size, std::min(initial_size, prealloc_size));
+    }
+    prealloc_size = cuda_device_memory_pool_->get_reserved_size();
+    prealloc_buffer = cuda_device_memory_pool_->get_ptr();
+    prealloc_bounds = cuda_device_memory_pool_->get_device_bounds();
     tlctx = llvm_context_device.get();
 #else
     TI_NOT_IMPLEMENTED
@@ -283,28 +590,16 @@ void Program::initialize_runtime_system(StructCompiler *scomp) {
   auto snodes = scomp->snodes;
   int root_id = snode_root->id;
 
-  // A buffer of random states, one per CUDA thread
-  int num_rand_states = 0;
-
-  if (config.arch == Arch::cuda) {
-#if defined(TI_WITH_CUDA)
-    // It is important to make sure that every CUDA thread has its own random
-    // state so that we do not need expensive per-state locks.
-    num_rand_states = config.saturating_grid_dim * config.max_block_dim;
-#else
-    TI_NOT_IMPLEMENTED
-#endif
-  }
-
   TI_TRACE("Allocating data structure of size {} B", scomp->root_size);
-  TI_TRACE("Allocating {} random states (used by CUDA only)", num_rand_states);
+  TI_TRACE("Using up to {} random states (used by CUDA only)",
+           num_rand_states);
 
-  runtime->call<void *, void *, std::size_t, std::size_t, void *, int, void *,
-                void *, void *>("runtime_initialize", result_buffer, this,
-                                (std::size_t)scomp->root_size, prealloc_size,
-                                preallocated_device_buffer, num_rand_states,
-                                (void *)&taichi_allocate_aligned,
-                                (void *)std::printf, (void *)std::vsnprintf);
+  runtime->call<void *, void *, std::size_t, std::size_t, void *, void *, int,
+                void *, void *, void *>(
+      "runtime_initialize", result_buffer, this, (std::size_t)scomp->root_size,
+      prealloc_size, prealloc_buffer, prealloc_bounds, num_rand_states,
+      (void *)&taichi_allocate_aligned, (void *)std::printf,
+      (void *)std::vsnprintf);
 
   TI_TRACE("LLVMRuntime initialized");
   llvm_runtime = fetch_result<void *>(taichi_result_buffer_ret_value_id);
@@ -317,37 +612,58 @@ void Program::initialize_runtime_system(StructCompiler *scomp) {
     memory_pool->set_queue((MemRequestQueue *)mem_req_queue);
   }
 
+  root_child_ranges_ = scomp->root_child_ranges;
+  if (config.arch == Arch::cuda && config.use_unified_memory &&
+      config.unified_memory_prefetch) {
+    unified_root_buffer_ =
+        (uint8 *)runtime_query<void *>("LLVMRuntime_get_root", llvm_runtime);
+  }
+
+  commit_device_memory_if_needed();
   runtime->call<void *, int, int>("runtime_initialize2", llvm_runtime, root_id,
                                   (int)snodes.size());
 
-  for (int i = 0; i < (int)snodes.size(); i++) {
-    if (is_gc_able(snodes[i]->type)) {
-      std::size_t node_size;
-      auto element_size =
-          tlctx->get_type_size(StructCompilerLLVM::get_llvm_element_type(
-              tlctx->get_this_thread_struct_module(), snodes[i]));
-      if (snodes[i]->type == SNodeType::pointer) {
-        // pointer. Allocators are for single elements
-        node_size = element_size;
-      } else {
-        // dynamic. Allocators are for the chunks
-        node_size = sizeof(void *) + element_size * snodes[i]->chunk_size;
-      }
-      TI_TRACE("Initializing allocator for snode {} (node size {})",
-               snodes[i]->id, node_size);
-      auto rt = llvm_runtime;
-      runtime->call<void *, int, std::size_t>(
-          "runtime_NodeAllocator_initialize", rt, snodes[i]->id, node_size);
-      TI_TRACE("Allocating ambient element for snode {} (node size {})",
-               snodes[i]->id, node_size);
-      runtime->call<void *, int>("runtime_allocate_ambient", rt, i, node_size);
-    }
+  if (config.pgo_instrument) {
+    commit_device_memory_if_needed();
+    runtime->call<void *, int>("runtime_allocate_profile_counters",
+                               llvm_runtime, ProfileGuide::kMaxNumCounters);
+  }
+
+  if (config.arch == Arch::cuda && config.deterministic_reduction) {
+    commit_device_memory_if_needed();
+    runtime->call<void *, std::size_t>(
+        "runtime_allocate_reduction_partials", llvm_runtime,
+        taichi_deterministic_reduction_buffer_size);
   }
 
+  initialize_node_allocators(tlctx, snodes);
+
   if (arch_use_host_memory(config.arch)) {
-    runtime->call<void *, void *, void *>("LLVMRuntime_initialize_thread_pool",
-                                          llvm_runtime, &thread_pool,
-                                          (void *)ThreadPool::static_run);
+    if (config.cpu_work_stealing) {
+      work_stealing_thread_pool =
+          std::make_unique<WorkStealingThreadPool>(config.cpu_max_num_threads);
+      runtime->call<void *, void *, void *>(
+          "LLVMRuntime_initialize_thread_pool", llvm_runtime,
+          work_stealing_thread_pool.get(),
+          (void *)WorkStealingThreadPool::static_run);
+    } else {
+      runtime->call<void *, void *, void *>("LLVMRuntime_initialize_thread_pool",
+                                            llvm_runtime, thread_pool.get(),
+                                            (void *)ThreadPool::static_run);
+    }
+    if (!config.cpu_thread_affinity.empty()) {
+      auto cpus = get_thread_affinity(config.cpu_thread_affinity,
+                                      (int)std::thread::hardware_concurrency());
+      if (work_stealing_thread_pool) {
+        work_stealing_thread_pool->set_affinity(cpus);
+      } else {
+        thread_pool->set_affinity(cpus);
+      }
+    }
+    place_root_buffer_on_numa_nodes(scomp);
+    // After the first touch, whose pages of the mapped children the mappings
+    // release.
+    map_root_children_to_files(scomp);
 
     runtime->call<void *, void *>("LLVMRuntime_set_assert_failed", llvm_runtime,
                                   (void *)assert_failed_host);
@@ -364,7 +680,173 @@ void Program::initialize_runtime_system(StructCompiler *scomp) {
   }
 }
 
+void Program::initialize_node_allocators(TaichiLLVMContext *tlctx,
+                                         const std::vector<SNode *> &snodes) {
+  auto runtime = tlctx->runtime_jit_module;
+  for (auto snode : snodes) {
+    if (!is_gc_able(snode->type))
+      continue;
+    commit_device_memory_if_needed();
+    std::size_t node_size;
+    auto element_size =
+        tlctx->get_type_size(StructCompilerLLVM::get_llvm_element_type(
+            tlctx->get_this_thread_struct_module(), snode));
+    if (snode->type == SNodeType::pointer || snode->type == SNodeType::hash) {
+      // pointer and hash. Allocators are for single elements
+      node_size = element_size;
+    } else {
+      // dynamic. Allocators are for the chunks
+      node_size = sizeof(void *) + element_size * snode->chunk_size;
+    }
+    TI_TRACE("Initializing allocator for snode {} (node size {})", snode->id,
+             node_size);
+    auto rt = llvm_runtime;
+    runtime->call<void *, int, std::size_t>("runtime_NodeAllocator_initialize",
+                                            rt, snode->id, node_size);
+    if (snode->gc_threshold > 0) {
+      runtime->call<void *, int, float32, int>(
+          "runtime_NodeAllocator_set_gc_policy", rt, snode->id,
+          snode->gc_threshold, snode->gc_period);
+    }
+    TI_TRACE("Allocating ambient element for snode {} (node size {})",
+             snode->id, node_size);
+    runtime->call<void *, int>("runtime_allocate_ambient", rt, snode->id,
+                               node_size);
+  }
+}
+
+void Program::map_root_children_to_files(StructCompiler *scomp) {
+  uint8 *root = nullptr;
+  for (auto &ch : snode_root->ch) {
+    if (ch->mmap_path.empty())
+      continue;
+    // The pointers of sparse SNodes would not be valid in another run.
+    std::function<void(SNode *)> check_dense = [&](SNode *snode) {
+      TI_ERROR_IF(snode->type != SNodeType::dense &&
+                      snode->type != SNodeType::place &&
+                      snode->type != SNodeType::bit_struct &&
+                      snode->type != SNodeType::bit_array,
+                  "SNode {} is mapped to {}, but its descendant {} is not "
+                  "dense",
+                  ch->get_node_type_name_hinted(), ch->mmap_path,
+                  snode->get_node_type_name_hinted());
+      for (auto &c : snode->ch)
+        check_dense(c.get());
+    };
+    check_dense(ch.get());
+    auto it = scomp->root_child_ranges.find(ch->id);
+    if (it == scomp->root_child_ranges.end() || it->second.second == 0)
+      continue;
+    if (root == nullptr) {
+      root = (uint8 *)runtime_query<void *>("LLVMRuntime_get_root",
+                                            llvm_runtime);
+    }
+    // The struct compiler pads the child to whole pages.
+    map_file(root + it->second.first,
+             iroundup(it->second.second, (std::size_t)taichi_page_size),
+             ch->mmap_path, ch->mmap_writable, ch->mmap_advice);
+    TI_TRACE("Mapped SNode {} to {}", ch->get_node_type_name_hinted(),
+             ch->mmap_path);
+  }
+}
+
+void Program::place_root_buffer_on_numa_nodes(StructCompiler *scomp) {
+  auto *root =
+      (uint8 *)runtime_query<void *>("LLVMRuntime_get_root", llvm_runtime);
+  std::vector<int> nodes;
+  const auto node_cpus = get_numa_node_cpus();
+  for (int node = 0; node < (int)node_cpus.size(); node++) {
+    if (!node_cpus[node].empty())
+      nodes.push_back(node);
+  }
+  for (auto &ch : snode_root->ch) {
+    const auto &policy = ch->numa_policy;
+    if (policy.empty())
+      continue;
+    auto it = scomp->root_child_ranges.find(ch->id);
+    if (it == scomp->root_child_ranges.end() || it->second.second == 0)
+      continue;
+    auto *ptr = root + it->second.first;
+    const auto size = it->second.second;
+    bool placed = true;
+    if (policy == "interleave") {
+      placed = numa_interleave(ptr, size);
+    } else if (policy == "partition") {
+      // Consecutive parts on consecutive nodes, matching the threads of
+      // cpu_thread_affinity="compact" iterating over consecutive blocks.
+      const auto part_size = (size + nodes.size() - 1) / nodes.size();
+      for (int i = 0; i < (int)nodes.size() && placed; i++) {
+        const auto begin = std::min(size, part_size * i);
+        const auto end = std::min(size, part_size * (i + 1));
+        placed = numa_prefer_node(ptr + begin, end - begin, nodes[i]);
+      }
+    } else {
+      TI_ERROR("Unknown NUMA policy [{}] of SNode {}, expected interleave or "
+               "partition",
+               policy, ch->get_node_type_name_hinted());
+    }
+    if (!placed) {
+      TI_WARN("Failed to apply NUMA policy [{}] to SNode {}", policy,
+              ch->get_node_type_name_hinted());
+    }
+  }
+
+  if (!config.cpu_numa_first_touch)
+    return;
+  // Each thread touches a contiguous part of the root buffer, leaving the
+  // data unchanged, so that the pages are allocated on its node.
+  struct TouchContext {
+    uint8 *root;
+    std::size_t size;
+    std::size_t part_size;
+  };
+  const int num_parts = std::max(config.cpu_max_num_threads, 1);
+  const auto size = iroundup((std::size_t)scomp->root_size, taichi_page_size);
+  TouchContext ctx{root, size,
+                   iroundup((size + num_parts - 1) / num_parts,
+                            (std::size_t)taichi_page_size)};
+  auto touch = [](void *context, int i) {
+    auto *ctx = (TouchContext *)context;
+    const auto begin = std::min(ctx->size, ctx->part_size * i);
+    const auto end = std::min(ctx->size, ctx->part_size * (i + 1));
+    for (auto offset = begin; offset < end; offset += taichi_page_size) {
+      volatile uint8 *p = ctx->root + offset;
+      *p = *p;
+    }
+  };
+  auto t = Time::get_time();
+  if (work_stealing_thread_pool) {
+    work_stealing_thread_pool->run(num_parts, num_parts, &ctx, touch);
+  } else {
+    thread_pool->run(num_parts, num_parts, &ctx, touch);
+  }
+  TI_TRACE("Root buffer ({} B) touched by {} threads in {:.3f} s", size,
+           num_parts, Time::get_time() - t);
+}
+
 void Program::materialize_layout() {
+  if (!arch_uses_llvm(config.arch)) {
+    // The other backends compute the layout of dense SNodes on their own.
+    std::function<void(SNode *)> clear_morton = [&](SNode *snode) {
+      if (snode->_morton) {
+        TI_WARN("The Z-order layout of {} is ignored on {}",
+                snode->get_node_type_name_hinted(), arch_name(config.arch));
+        snode->_morton = false;
+      }
+      for (auto &ch : snode->ch)
+        clear_morton(ch.get());
+    };
+    clear_morton(snode_root.get());
+  }
+  if (config.sync_activation_demotion && !config.async_mode &&
+      (arch_uses_llvm(config.arch) || config.arch == Arch::metal)) {
+    activation_tracker_ = std::make_unique<ActivationTracker>(this);
+  }
+  if (config.layout_advisor || !config.layout_profile.empty()) {
+    layout_advisor_ = std::make_unique<LayoutAdvisor>(snode_root.get());
+    if (!config.layout_profile.empty())
+      layout_advisor_->apply_profile(config.layout_profile);
+  }
   // always use host_arch() this is for host accessors
   std::unique_ptr<StructCompiler> scomp =
       StructCompiler::make(this, host_arch());
@@ -413,6 +895,16 @@ void Program::materialize_layout() {
     opengl_kernel_launcher_ = std::make_unique<opengl::GLSLLauncher>(
         opengl_struct_compiled_->root_size);
     opengl_kernel_launcher_->result_buffer = result_buffer;
+  } else if (config.arch == Arch::vulkan) {
+    TI_ASSERT(result_buffer == nullptr);
+    result_buffer = allocate_result_buffer_default(this);
+    opengl::OpenglStructCompiler scomp;
+    opengl_struct_compiled_ = scomp.run(*snode_root);
+    TI_TRACE("Vulkan root buffer size: {} B",
+             opengl_struct_compiled_->root_size);
+    vulkan_runtime_ = std::make_unique<vulkan::VulkanRuntime>(
+        config, opengl_struct_compiled_->root_size);
+    vulkan_runtime_->result_buffer = result_buffer;
 #ifdef TI_WITH_CC
   } else if (config.arch == Arch::cc) {
     TI_ASSERT(result_buffer == nullptr);
@@ -422,6 +914,79 @@ void Program::materialize_layout() {
   }
 }
 
+SNode *Program::create_snode_tree() {
+  TI_ERROR_IF(!arch_is_cpu(config.arch) && config.arch != Arch::cuda,
+              "SNode trees other than ti.root are only supported on CPU and "
+              "CUDA, not on {}",
+              arch_name(config.arch));
+  TI_ERROR_IF(llvm_runtime == nullptr,
+              "The layout of ti.root must be materialized before the other "
+              "SNode trees");
+  TI_ERROR_IF((int)snode_trees_.size() + 1 >= taichi_max_num_snode_trees,
+              "Cannot create more than {} SNode trees",
+              taichi_max_num_snode_trees);
+  auto root = std::make_unique<SNode>(0, SNodeType::root);
+  root->is_path_all_dense = true;
+  root->snode_tree_id = (int)snode_trees_.size() + 1;
+  snode_trees_.push_back(std::move(root));
+  return snode_trees_.back().get();
+}
+
+void Program::materialize_snode_tree(SNode *root) {
+  TI_ASSERT(root->type == SNodeType::root && root->snode_tree_id > 0);
+  TI_ERROR_IF(std::find(materialized_snode_trees_.begin(),
+                        materialized_snode_trees_.end(),
+                        root) != materialized_snode_trees_.end(),
+              "The SNode tree has been materialized already");
+  for (auto &ch : root->ch) {
+    TI_ERROR_IF(!ch->numa_policy.empty() || !ch->mmap_path.empty(),
+                "NUMA policies and file mappings are only supported on the "
+                "children of ti.root");
+  }
+  // The struct modules are replaced, so no kernels may be compiled or run
+  // meanwhile.
+  synchronize();
+  std::lock_guard<std::recursive_mutex> _(compile_mut);
+  if (background_compiler_)
+    background_compiler_->flush();
+
+  auto scomp = StructCompiler::make(this, host_arch(), /*append=*/true);
+  scomp->run(*root, true);
+  for (auto snode : scomp->snodes) {
+    snodes[snode->id] = snode;
+  }
+  StructCompiler *runtime_scomp = scomp.get();
+  std::unique_ptr<StructCompiler> scomp_gpu;
+  TaichiLLVMContext *tlctx = llvm_context_host.get();
+  if (config.arch == Arch::cuda) {
+    scomp_gpu = StructCompiler::make(this, Arch::cuda, /*append=*/true);
+    scomp_gpu->run(*root, false);
+    runtime_scomp = scomp_gpu.get();
+    tlctx = llvm_context_device.get();
+  }
+  // Also counts the SNodes of the trees created before but not materialized
+  // yet, whose ids may be smaller.
+  const int num_snodes = get_num_snodes();
+  TI_ERROR_IF(num_snodes > taichi_max_num_snodes,
+              "Cannot create more than {} SNodes", taichi_max_num_snodes);
+  TI_TRACE("Allocating SNode tree {} of size {} B", root->snode_tree_id,
+           runtime_scomp->root_size);
+  commit_device_memory_if_needed();
+  tlctx->runtime_jit_module->call<void *, int, int, std::size_t, int>(
+      "runtime_initialize_snode_tree", llvm_runtime, root->snode_tree_id,
+      root->id, (std::size_t)runtime_scomp->root_size, num_snodes);
+  initialize_node_allocators(tlctx, runtime_scomp->snodes);
+  materialized_snode_trees_.push_back(root);
+}
+
+int Program::get_num_snodes() const {
+  int num_snodes = 0;
+  for (auto &[id, snode] : snodes) {
+    num_snodes = std::max(num_snodes, id + 1);
+  }
+  return num_snodes;
+}
+
 void Program::check_runtime_error() {
   synchronize();
   auto tlctx = llvm_context_host.get();
@@ -468,26 +1033,36 @@ void Program::check_runtime_error() {
 }
 
 void Program::synchronize() {
-  if (!sync) {
+  std::lock_guard<std::mutex> _(sync_mut_);
+  // A kernel launched while synchronizing clears |sync| again.
+  if (!sync.exchange(true)) {
     if (config.async_mode) {
       async_engine->synchronize();
     }
     if (profiler)
       profiler->sync();
     device_synchronize();
-    sync = true;
   }
 }
 
 void Program::device_synchronize() {
+  if (host_launcher_) {
+    host_launcher_->flush();
+  }
   if (config.arch == Arch::cuda) {
 #if defined(TI_WITH_CUDA)
     CUDADriver::get_instance().stream_synchronize(nullptr);
+    if (stream_tile_stream_ != nullptr) {
+      // The evictions of the streamed tiles.
+      CUDADriver::get_instance().stream_synchronize(stream_tile_stream_);
+    }
 #else
     TI_ERROR("No CUDA support");
 #endif
   } else if (config.arch == Arch::metal) {
     metal_kernel_mgr_->synchronize();
+  } else if (config.arch == Arch::vulkan && vulkan_runtime_) {
+    vulkan_runtime_->synchronize();
   }
 }
 
@@ -575,14 +1150,17 @@ void Program::visualize_layout(const std::string &fn) {
 
 void Program::initialize_device_llvm_context() {
   if (config.arch == Arch::cuda) {
+    std::lock_guard<std::recursive_mutex> _(compile_mut);
     if (llvm_context_device == nullptr)
-      llvm_context_device = std::make_unique<TaichiLLVMContext>(Arch::cuda);
+      llvm_context_device = std::make_shared<TaichiLLVMContext>(Arch::cuda);
   }
 }
 
 Arch Program::get_snode_accessor_arch() {
   if (config.arch == Arch::opengl) {
     return Arch::opengl;
+  } else if (config.arch == Arch::vulkan) {
+    return Arch::vulkan;
   } else if (config.arch == Arch::cuda && !config.use_unified_memory) {
     return Arch::cuda;
   } else if (config.arch == Arch::metal) {
@@ -609,6 +1187,7 @@ Kernel &Program::get_snode_reader(SNode *snode) {
   ker.set_arch(get_snode_accessor_arch());
   ker.name = kernel_name;
   ker.is_accessor = true;
+  ker.accessed_snode = snode;
   for (int i = 0; i < snode->num_active_indices; i++)
     ker.insert_arg(PrimitiveType::i32, false);
   ker.insert_ret(snode->dt);
@@ -629,24 +1208,176 @@ Kernel &Program::get_snode_writer(SNode *snode) {
   ker.set_arch(get_snode_accessor_arch());
   ker.name = kernel_name;
   ker.is_accessor = true;
+  ker.accessed_snode = snode;
   for (int i = 0; i < snode->num_active_indices; i++)
     ker.insert_arg(PrimitiveType::i32, false);
   ker.insert_arg(snode->dt, false);
   return ker;
 }
 
+namespace {
+
+// Emits |body(buffer_element, field_element)| inside a struct-for over |snode|,
+// where |buffer_element| is the element of the buffer in arg 0 corresponding
+// to |field_element| according to the strides in the following args.
+void build_snode_buffer_copy(
+    SNode *snode,
+    const std::function<void(Expr buffer_element, Expr field_element)> &body) {
+  auto buffer = Expr::make<ExternalTensorExpression>(
+      snode->dt->get_compute_type(), /*dim=*/1, /*arg_id=*/0);
+  ExprGroup indices;
+  for (int i = 0; i < snode->num_active_indices; i++) {
+    indices.push_back(Expr(std::make_shared<IdExpression>()));
+  }
+  auto copy = [&] {
+    // Note that Expr::operator= emits an assignment inside kernels, hence
+    // set() here.
+    Expr offset(0);
+    for (int i = 0; i < snode->num_active_indices; i++) {
+      Expr index(indices[i]);
+      if (!snode->index_offsets.empty()) {
+        index.set(index - Expr(snode->index_offsets[i]));
+      }
+      offset.set(offset + index * Expr::make<ArgLoadExpression>(
+                                      i + 1, PrimitiveType::i32));
+    }
+    body(buffer[ExprGroup(offset)], (snode->expr)[indices]);
+  };
+  if (snode->num_active_indices == 0) {
+    copy();
+  } else {
+    For(indices, snode->expr, copy);
+  }
+}
+
+}  // namespace
+
+Kernel &Program::get_snode_to_buffer_kernel(SNode *snode) {
+  TI_ASSERT(snode->type == SNodeType::place);
+  TI_ERROR_IF(snode->num_active_indices >= taichi_max_num_args,
+              "Bulk copy of {}-D fields is not supported",
+              snode->num_active_indices);
+  auto &ker = kernel([snode] {
+    build_snode_buffer_copy(snode, [](Expr buffer_element,
+                                      Expr field_element) {
+      buffer_element = load_if_ptr(field_element);
+    });
+  });
+  ker.name = fmt::format("snode_to_buffer_{}", snode->id);
+  ker.insert_arg(snode->dt->get_compute_type(), true);
+  for (int i = 0; i < snode->num_active_indices; i++)
+    ker.insert_arg(PrimitiveType::i32, false);
+  return ker;
+}
+
+Kernel &Program::get_snode_from_buffer_kernel(SNode *snode) {
+  TI_ASSERT(snode->type == SNodeType::place);
+  TI_ERROR_IF(snode->num_active_indices >= taichi_max_num_args,
+              "Bulk copy of {}-D fields is not supported",
+              snode->num_active_indices);
+  auto &ker = kernel([snode] {
+    build_snode_buffer_copy(snode, [](Expr buffer_element,
+                                      Expr field_element) {
+      field_element = load_if_ptr(buffer_element);
+    });
+  });
+  ker.name = fmt::format("snode_from_buffer_{}", snode->id);
+  ker.insert_arg(snode->dt->get_compute_type(), true);
+  for (int i = 0; i < snode->num_active_indices; i++)
+    ker.insert_arg(PrimitiveType::i32, false);
+  return ker;
+}
+
+Kernel &Program::get_snode_gather_kernel(SNode *snode) {
+  TI_ASSERT(snode->num_active_indices > 0);
+  const bool is_place = snode->type == SNodeType::place;
+  const int n = snode->num_active_indices;
+  auto &ker = kernel([snode, is_place, n] {
+    auto counter =
+        Expr::make<ExternalTensorExpression>(PrimitiveType::i32, 1, 0);
+    auto cells = Expr::make<ExternalTensorExpression>(PrimitiveType::i32, 1, 1);
+    auto values = Expr::make<ExternalTensorExpression>(
+        snode->dt->get_compute_type(), 1, 2);
+    auto capacity =
+        Expr::make<ArgLoadExpression>(is_place ? 3 : 2, PrimitiveType::i32);
+    ExprGroup indices;
+    for (int i = 0; i < n; i++) {
+      indices.push_back(Expr(std::make_shared<IdExpression>()));
+    }
+    auto global = is_place ? snode->expr
+                           : Expr::make<GlobalVariableExpression>(snode);
+    For(indices, global, [&] {
+      auto k = Var(Expr::make<AtomicOpExpression>(
+          AtomicOpType::add, counter[ExprGroup(Expr(0))], Expr(1)));
+      // Only counts the cells when the buffers are too small.
+      If(k < capacity, [&] {
+        for (int i = 0; i < n; i++) {
+          auto cell = cells[ExprGroup(k * Expr(n) + Expr(i))];
+          cell = indices[i];
+        }
+        if (is_place) {
+          auto value = values[ExprGroup(k)];
+          value = load_if_ptr((snode->expr)[indices]);
+        }
+      });
+    });
+  });
+  ker.name = fmt::format("snode_gather_{}", snode->id);
+  ker.insert_arg(PrimitiveType::i32, true);
+  ker.insert_arg(PrimitiveType::i32, true);
+  if (is_place)
+    ker.insert_arg(snode->dt->get_compute_type(), true);
+  ker.insert_arg(PrimitiveType::i32, false);
+  return ker;
+}
+
+Kernel &Program::get_snode_scatter_kernel(SNode *snode) {
+  TI_ASSERT(snode->num_active_indices > 0);
+  const bool is_place = snode->type == SNodeType::place;
+  const int n = snode->num_active_indices;
+  auto &ker = kernel([snode, is_place, n] {
+    auto cells = Expr::make<ExternalTensorExpression>(PrimitiveType::i32, 1, 0);
+    auto values = Expr::make<ExternalTensorExpression>(
+        snode->dt->get_compute_type(), 1, 1);
+    auto count =
+        Expr::make<ArgLoadExpression>(is_place ? 2 : 1, PrimitiveType::i32);
+    auto k = Expr(std::make_shared<IdExpression>());
+    For(k, Expr(0), count, [&] {
+      ExprGroup indices;
+      for (int i = 0; i < n; i++) {
+        indices.push_back(
+            Var(load_if_ptr(cells[ExprGroup(k * Expr(n) + Expr(i))])));
+      }
+      if (is_place) {
+        // Writing a cell activates its ancestors.
+        auto field_element = (snode->expr)[indices];
+        field_element = load_if_ptr(values[ExprGroup(k)]);
+      } else {
+        Activate(snode, indices);
+      }
+    });
+  });
+  ker.name = fmt::format("snode_scatter_{}", snode->id);
+  ker.insert_arg(PrimitiveType::i32, true);
+  if (is_place)
+    ker.insert_arg(snode->dt->get_compute_type(), true);
+  ker.insert_arg(PrimitiveType::i32, false);
+  return ker;
+}
+
 uint64 Program::fetch_result_uint64(int i) {
-  // TODO: We are likely doing more synchronization than necessary. Simplify the
-  // sync logic when we fetch the result.
-  device_synchronize();
   uint64 ret;
   auto arch = config.arch;
   if (arch == Arch::cuda) {
 #if defined(TI_WITH_CUDA)
     if (config.use_unified_memory) {
       // More efficient than a cudaMemcpy call in practice
+      device_synchronize();
       ret = result_buffer[i];
     } else {
+      // A synchronous copy on the default stream already waits for the
+      // kernels launched before it, including those on the blocking streams of
+      // CUDAContext, but not for the rest of the device work.
       CUDADriver::get_instance().memcpy_device_to_host(&ret, result_buffer + i,
                                                        sizeof(uint64));
     }
@@ -654,16 +1385,517 @@ uint64 Program::fetch_result_uint64(int i) {
     TI_NOT_IMPLEMENTED;
 #endif
   } else {
+    device_synchronize();
     ret = result_buffer[i];
   }
   return ret;
 }
 
+int64 Program::create_result_future() {
+  // The tasks of the kernels launched so far must be on the device first.
+  if (config.async_mode)
+    async_engine->synchronize();
+  ResultFuture future;
+  if (!free_result_futures_.empty()) {
+    future = free_result_futures_.back();
+    free_result_futures_.pop_back();
+  }
+  constexpr auto size = sizeof(uint64) * taichi_result_buffer_entries;
+  if (config.arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+    auto &driver = CUDADriver::get_instance();
+    if (!future.values) {
+      driver.mem_host_alloc((void **)&future.values, size, 0);
+      driver.event_create(&future.event, CU_EVENT_DISABLE_TIMING);
+    }
+    driver.memcpy_device_to_host_async(future.values, result_buffer, size,
+                                       nullptr);
+    driver.event_record(future.event, nullptr);
+#else
+    TI_NOT_IMPLEMENTED;
+#endif
+  } else {
+    if (!future.values)
+      future.values = new uint64[taichi_result_buffer_entries];
+    device_synchronize();
+    std::memcpy(future.values, result_buffer, size);
+  }
+  auto id = next_result_future_id_++;
+  result_futures_[id] = future;
+  return id;
+}
+
+uint64 Program::fetch_future_result_uint64(int64 future, int i) {
+  auto iter = result_futures_.find(future);
+  TI_ERROR_IF(iter == result_futures_.end(), "Unknown result future {}",
+              future);
+  TI_ASSERT(0 <= i && i < (int)taichi_result_buffer_entries);
+  if (iter->second.event) {
+#if defined(TI_WITH_CUDA)
+    CUDADriver::get_instance().event_synchronize(iter->second.event);
+#endif
+  }
+  return iter->second.values[i];
+}
+
+void Program::release_result_future(int64 future) {
+  auto iter = result_futures_.find(future);
+  TI_ERROR_IF(iter == result_futures_.end(), "Unknown result future {}",
+              future);
+  free_result_futures_.push_back(iter->second);
+  result_futures_.erase(iter);
+}
+
+void *Program::allocate_external_array(std::size_t size) {
+  // Page-aligned so that CUDA migrates whole pages belonging to this array
+  // only.
+  size = std::max(iroundup(size, taichi_page_size), taichi_page_size);
+  void *ptr = nullptr;
+  if (config.arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+    CUDADriver::get_instance().malloc_managed(&ptr, size,
+                                              CU_MEM_ATTACH_GLOBAL);
+#else
+    TI_NOT_IMPLEMENTED
+#endif
+  } else {
+    if (config.arch == Arch::opengl) {
+      // Falls back to host memory, i.e. copying on every launch, if there is
+      // no GL_ARB_buffer_storage.
+      ptr = opengl::allocate_persistent_buffer(size);
+    } else {
+      TI_ERROR_IF(!arch_use_host_memory(config.arch),
+                  "Zero-copy external arrays are not supported on {}",
+                  arch_name(config.arch));
+    }
+    if (ptr == nullptr)
+      ptr = ::operator new(size, std::align_val_t(taichi_page_size));
+  }
+  TI_ERROR_IF(ptr == nullptr,
+              "Failed to allocate a zero-copy external array of {} B", size);
+  std::lock_guard<std::mutex> _(external_arrays_mut_);
+  external_arrays_[(uint64)ptr] = size;
+  return ptr;
+}
+
+void Program::free_external_array(void *ptr) {
+  {
+    std::lock_guard<std::mutex> _(external_arrays_mut_);
+    auto it = external_arrays_.find((uint64)ptr);
+    TI_ERROR_IF(it == external_arrays_.end(),
+                "{} is not a zero-copy external array", ptr);
+    external_arrays_.erase(it);
+  }
+  if (config.arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+    // Kernels may still be accessing the array.
+    synchronize();
+    CUDADriver::get_instance().mem_free(ptr);
+#endif
+  } else if (!opengl::free_persistent_buffer(ptr)) {
+    ::operator delete(ptr, std::align_val_t(taichi_page_size));
+  }
+}
+
+bool Program::is_external_array(void *ptr, std::size_t size) {
+  std::lock_guard<std::mutex> _(external_arrays_mut_);
+  auto it = external_arrays_.upper_bound((uint64)ptr);
+  if (it == external_arrays_.begin()) {
+    return false;
+  }
+  --it;
+  return (uint64)ptr + size <= it->first + it->second;
+}
+
+void *Program::allocate_device_array(std::size_t size) {
+  TI_ERROR_IF(!arch_is_cpu(config.arch) && config.arch != Arch::cuda,
+              "Device arrays are only supported on CPU and CUDA");
+  size = std::max(iroundup(size, taichi_page_size), taichi_page_size);
+  std::lock_guard<std::mutex> _(device_arrays_mut_);
+  void *ptr = nullptr;
+  // The smallest freed array that fits, unless it would waste more than
+  // half of its memory.
+  auto it = free_device_arrays_.lower_bound(size);
+  if (it != free_device_arrays_.end() && it->first <= 2 * size) {
+    size = it->first;
+    ptr = it->second;
+    free_device_arrays_.erase(it);
+  } else {
+    ptr = memory_pool->allocate(size, taichi_page_size);
+  }
+  device_arrays_[(uint64)ptr] = size;
+  return ptr;
+}
+
+void Program::free_device_array(void *ptr) {
+  std::lock_guard<std::mutex> _(device_arrays_mut_);
+  auto it = device_arrays_.find((uint64)ptr);
+  TI_ERROR_IF(it == device_arrays_.end(), "{} is not a device array", ptr);
+  // The kernels launched so far run before any later kernel using the memory
+  // again.
+  free_device_arrays_.emplace(it->second, ptr);
+  device_arrays_.erase(it);
+}
+
+bool Program::is_device_array(void *ptr, std::size_t size) {
+  std::lock_guard<std::mutex> _(device_arrays_mut_);
+  auto it = device_arrays_.upper_bound((uint64)ptr);
+  if (it == device_arrays_.begin()) {
+    return false;
+  }
+  --it;
+  return (uint64)ptr + size <= it->first + it->second;
+}
+
+void Program::copy_device_array(void *dst,
+                                const void *src,
+                                std::size_t size) {
+  synchronize();
+  if (config.arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+    // With unified addressing, the driver finds where either side lives.
+    CUDADriver::get_instance().memcpy(dst, (void *)src, size);
+#else
+    TI_NOT_IMPLEMENTED
+#endif
+  } else {
+    std::memcpy(dst, src, size);
+  }
+}
+
+void Program::prefetch_external_array(void *ptr,
+                                      std::size_t size,
+                                      bool to_device) {
+  TI_ERROR_IF(!is_external_array(ptr, size),
+              "{} is not a zero-copy external array", ptr);
+#if defined(TI_WITH_CUDA)
+  if (config.arch == Arch::cuda) {
+    CUDADriver::get_instance().mem_prefetch_async.call_with_warning(
+        ptr, size, to_device ? 0 : CU_DEVICE_CPU, nullptr);
+  }
+#endif
+}
+
+void Program::advise_external_array(void *ptr,
+                                    std::size_t size,
+                                    bool read_mostly,
+                                    bool prefer_device) {
+  TI_ERROR_IF(!is_external_array(ptr, size),
+              "{} is not a zero-copy external array", ptr);
+#if defined(TI_WITH_CUDA)
+  if (config.arch == Arch::cuda) {
+    auto &driver = CUDADriver::get_instance();
+    driver.mem_advise.call_with_warning(
+        ptr, size,
+        read_mostly ? CU_MEM_ADVISE_SET_READ_MOSTLY
+                    : CU_MEM_ADVISE_UNSET_READ_MOSTLY,
+        0);
+    driver.mem_advise.call_with_warning(
+        ptr, size, CU_MEM_ADVISE_SET_PREFERRED_LOCATION,
+        prefer_device ? 0 : CU_DEVICE_CPU);
+  }
+#endif
+}
+
+int Program::create_cuda_graph() {
+  if (config.arch != Arch::cuda) {
+    return -1;
+  }
+  TI_ERROR_IF(config.async_mode, "CUDA graphs are not supported in async mode");
+#if defined(TI_WITH_CUDA)
+  cuda_graphs_.push_back(std::make_unique<CUDAGraph>());
+  return (int)cuda_graphs_.size() - 1;
+#else
+  TI_ERROR("No CUDA support");
+  return -1;
+#endif
+}
+
+void Program::begin_cuda_graph(int handle) {
+  if (handle < 0) {
+    return;
+  }
+#if defined(TI_WITH_CUDA)
+  cuda_graphs_.at(handle)->begin();
+#endif
+}
+
+void Program::end_cuda_graph(int handle) {
+  if (handle < 0) {
+    return;
+  }
+#if defined(TI_WITH_CUDA)
+  cuda_graphs_.at(handle)->end();
+  sync = false;
+#endif
+}
+
+void Program::commit_device_memory_if_needed() {
+#if defined(TI_WITH_CUDA)
+  if (cuda_device_memory_pool_) {
+    cuda_device_memory_pool_->commit_if_needed();
+  }
+#endif
+}
+
+void Program::prefetch_root_children(const std::vector<int> &root_children) {
+  prefetch_root_children_on(root_children, nullptr);
+}
+
+bool Program::prefetch_root_children_on(const std::vector<int> &root_children,
+                                        void *stream) {
+  if (unified_root_buffer_ == nullptr) {
+    return false;
+  }
+  bool issued = false;
+#if defined(TI_WITH_CUDA)
+  auto &driver = CUDADriver::get_instance();
+  const auto tile_bytes = get_stream_tile_bytes();
+  for (int id : root_children) {
+    if (prefetched_root_children_.count(id)) {
+      continue;
+    }
+    auto it = root_child_ranges_.find(id);
+    if (it == root_child_ranges_.end() || it->second.second == 0) {
+      continue;
+    }
+    if (tile_bytes != 0 && it->second.second > tile_bytes) {
+      // Streamed in tiles instead, see get_num_stream_tiles().
+      continue;
+    }
+    auto ptr = unified_root_buffer_ + it->second.first;
+    auto size = it->second.second;
+    if (advised_root_children_.insert(id).second) {
+      // Keep the pages on the device under oversubscription, instead of
+      // migrating them back and forth.
+      driver.mem_advise.call_with_warning(
+          ptr, size, CU_MEM_ADVISE_SET_PREFERRED_LOCATION, 0);
+      driver.mem_advise.call_with_warning(ptr, size,
+                                          CU_MEM_ADVISE_SET_ACCESSED_BY, 0);
+    }
+    driver.mem_prefetch_async.call_with_warning(ptr, size, 0, stream);
+    prefetched_root_children_.insert(id);
+    issued = true;
+  }
+#endif
+  return issued;
+}
+
+bool Program::prefetch_root_children_early(
+    const std::vector<int> &root_children) {
+  if (unified_root_buffer_ == nullptr) {
+    return false;
+  }
+  init_prefetch_stream();
+  if (!prefetch_root_children_on(root_children, stream_tile_stream_)) {
+    return false;
+  }
+#if defined(TI_WITH_CUDA)
+  CUDADriver::get_instance().event_record(early_prefetch_event_,
+                                          stream_tile_stream_);
+#endif
+  return true;
+}
+
+void Program::wait_for_early_prefetches() {
+#if defined(TI_WITH_CUDA)
+  CUDADriver::get_instance().stream_wait_event(
+      CUDAContext::get_current_stream(), early_prefetch_event_, 0);
+#endif
+}
+
+void Program::on_root_buffer_host_access(SNode *snode) {
+  if (snode == nullptr) {
+    prefetched_root_children_.clear();
+    return;
+  }
+  while (snode->parent != nullptr && snode->parent->parent != nullptr) {
+    snode = snode->parent;
+  }
+  prefetched_root_children_.erase(snode->id);
+}
+
+std::size_t Program::get_stream_tile_bytes() const {
+  if (unified_root_buffer_ == nullptr ||
+      config.unified_memory_stream_tile_MB <= 0) {
+    return 0;
+  }
+  return std::max(
+      (std::size_t)(config.unified_memory_stream_tile_MB * (1 << 20)),
+      (std::size_t)1);
+}
+
+int Program::get_num_stream_tiles(const std::vector<int> &root_children) {
+  const auto tile_bytes = get_stream_tile_bytes();
+  if (tile_bytes == 0) {
+    return 1;
+  }
+  std::size_t max_size = 0;
+  for (int id : root_children) {
+    auto it = root_child_ranges_.find(id);
+    if (it != root_child_ranges_.end()) {
+      max_size = std::max(max_size, it->second.second);
+    }
+  }
+  return (int)std::max((max_size + tile_bytes - 1) / tile_bytes,
+                       (std::size_t)1);
+}
+
+void Program::prefetch_stream_slices(const std::vector<int> &root_children,
+                                     int tile,
+                                     int num_tiles,
+                                     uint32 device) {
+#if defined(TI_WITH_CUDA)
+  const auto tile_bytes = get_stream_tile_bytes();
+  for (int id : root_children) {
+    auto it = root_child_ranges_.find(id);
+    if (it == root_child_ranges_.end() || it->second.second <= tile_bytes) {
+      continue;
+    }
+    // The iterations of a tile are assumed to access the same fraction of
+    // the fields, as the range-fors over them in their layout order do. Any
+    // other access is still correct, only faulting the pages in on demand.
+    const uint64 size = it->second.second;
+    const auto begin = size * tile / num_tiles;
+    const auto end = size * (tile + 1) / num_tiles;
+    if (end > begin) {
+      CUDADriver::get_instance().mem_prefetch_async.call_with_warning(
+          unified_root_buffer_ + it->second.first + begin, end - begin, device,
+          stream_tile_stream_);
+    }
+  }
+#endif
+}
+
+void Program::init_prefetch_stream() {
+  if (stream_tile_stream_ != nullptr) {
+    return;
+  }
+#if defined(TI_WITH_CUDA)
+  auto &driver = CUDADriver::get_instance();
+  // Not ordered against the default stream, so that the prefetches overlap
+  // with the kernels.
+  driver.stream_create(&stream_tile_stream_, CU_STREAM_NON_BLOCKING);
+  for (auto &event : stream_tile_ready_events_) {
+    driver.event_create(&event, CU_EVENT_DISABLE_TIMING);
+  }
+  driver.event_create(&stream_tile_done_event_, CU_EVENT_DISABLE_TIMING);
+  driver.event_create(&early_prefetch_event_, CU_EVENT_DISABLE_TIMING);
+#endif
+}
+
+void Program::prefetch_stream_tile(const std::vector<int> &root_children,
+                                   int tile,
+                                   int num_tiles) {
+  if (get_stream_tile_bytes() == 0) {
+    return;
+  }
+  init_prefetch_stream();
+#if defined(TI_WITH_CUDA)
+  auto &driver = CUDADriver::get_instance();
+  prefetch_stream_slices(root_children, tile, num_tiles, 0);
+  driver.event_record(stream_tile_ready_events_[tile % 2],
+                      stream_tile_stream_);
+#endif
+}
+
+void Program::wait_for_stream_tile(int tile) {
+  if (get_stream_tile_bytes() == 0) {
+    return;
+  }
+#if defined(TI_WITH_CUDA)
+  CUDADriver::get_instance().stream_wait_event(
+      CUDAContext::get_current_stream(), stream_tile_ready_events_[tile % 2],
+      0);
+#endif
+}
+
+void Program::evict_stream_tile(const std::vector<int> &root_children,
+                                int tile,
+                                int num_tiles) {
+  if (get_stream_tile_bytes() == 0) {
+    return;
+  }
+#if defined(TI_WITH_CUDA)
+  auto &driver = CUDADriver::get_instance();
+  driver.event_record(stream_tile_done_event_,
+                      CUDAContext::get_current_stream());
+  driver.stream_wait_event(stream_tile_stream_, stream_tile_done_event_, 0);
+  // Delays the prefetch of the tile after the next one until this tile is
+  // done, which bounds the memory of the tiles on the device.
+  prefetch_stream_slices(root_children, tile, num_tiles, CU_DEVICE_CPU);
+#endif
+}
+
+ParallelPrimitives *Program::get_parallel_primitives() {
+  if (!parallel_primitives_) {
+    parallel_primitives_ = std::make_unique<ParallelPrimitives>(this);
+  }
+  return parallel_primitives_.get();
+}
+
+SparseMatrix *Program::create_sparse_matrix(int num_rows,
+                                            int num_cols,
+                                            DataType dt) {
+  sparse_matrices_.push_back(
+      std::make_unique<SparseMatrix>(this, num_rows, num_cols, dt));
+  return sparse_matrices_.back().get();
+}
+
+void Program::destroy_sparse_matrix(SparseMatrix *matrix) {
+  synchronize();
+  for (auto it = sparse_matrices_.begin(); it != sparse_matrices_.end();
+       ++it) {
+    if (it->get() == matrix) {
+      sparse_matrices_.erase(it);
+      return;
+    }
+  }
+  TI_ERROR("The sparse matrix does not belong to this Program");
+}
+
+std::string Program::get_layout_advice() {
+  TI_ERROR_IF(!config.layout_advisor,
+              "Layout advice requires ti.init(layout_advisor=True)");
+  TI_ASSERT_INFO(layout_advisor_, "The layout is not materialized yet");
+  return layout_advisor_->get_report();
+}
+
 void Program::finalize() {
   synchronize();
   if (async_engine)
     async_engine = nullptr;  // Finalize the async engine threads before
                              // anything else gets destoried.
+  compilation_workers_.reset();
+  if (background_compiler_) {
+    background_compiler_->flush();
+    background_compiler_.reset();
+  }
+  sparse_matrices_.clear();
+  parallel_primitives_.reset();
+  if (profile_guide && config.pgo_instrument && llvm_runtime) {
+    std::vector<uint64> counters(ProfileGuide::kMaxNumCounters);
+    auto src = runtime_query<void *>("LLVMRuntime_get_profile_counters",
+                                     llvm_runtime);
+    const auto size = sizeof(uint64) * counters.size();
+    if (config.arch == Arch::cuda && !config.use_unified_memory) {
+#if defined(TI_WITH_CUDA)
+      CUDADriver::get_instance().memcpy_device_to_host(counters.data(), src,
+                                                       size);
+#else
+      TI_NOT_IMPLEMENTED;
+#endif
+    } else {
+      std::memcpy(counters.data(), src, size);
+    }
+    profile_guide->save_profile(config.pgo_profile, counters);
+  }
+  if (layout_advisor_) {
+    if (config.layout_advisor && !config.layout_profile.empty())
+      layout_advisor_->save_profile(config.layout_profile);
+    layout_advisor_.reset();
+  }
+  activation_tracker_.reset();
   TI_TRACE("Program finalizing...");
   if (config.print_benchmark_stat) {
     const char *current_test = std::getenv("PYTEST_CURRENT_TEST");
@@ -701,11 +1933,45 @@ void Program::finalize() {
   if (runtime)
     runtime->set_profiler(nullptr);
   synchronize();
-  current_program = nullptr;
+  host_launcher_.reset();
+#if defined(TI_WITH_CUDA)
+  cuda_graphs_.clear();
+#endif
+  for (auto &[_, future] : result_futures_) {
+    free_result_futures_.push_back(future);
+  }
+  result_futures_.clear();
+  for (auto &future : free_result_futures_) {
+    if (future.event) {
+#if defined(TI_WITH_CUDA)
+      CUDADriver::get_instance().mem_free_host(future.values);
+      CUDADriver::get_instance().event_destroy(future.event);
+#endif
+    } else {
+      delete[] future.values;
+    }
+  }
+  free_result_futures_.clear();
+  // Before the result buffer is freed with the memory pool.
+  vulkan_runtime_.reset();
+  if (current_program == this) {
+    current_program = nullptr;
+  }
   memory_pool->terminate();
+  for (auto &[ptr, size] : external_arrays_) {
+    if (config.arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+      CUDADriver::get_instance().mem_free((void *)ptr);
+#endif
+    } else if (!opengl::free_persistent_buffer((void *)ptr)) {
+      ::operator delete((void *)ptr, std::align_val_t(taichi_page_size));
+    }
+  }
+  external_arrays_.clear();
+  device_arrays_.clear();
+  free_device_arrays_.clear();
 #if defined(TI_WITH_CUDA)
-  if (preallocated_device_buffer != nullptr)
-    CUDADriver::get_instance().mem_free(preallocated_device_buffer);
+  cuda_device_memory_pool_.reset();
 #endif
   finalized = true;
   num_instances -= 1;
@@ -741,6 +2007,27 @@ void Program::print_list_manager_info(void *list_manager) {
       size_MB);
 }
 
+void Program::export_cc_library(const std::string &source_path,
+                                const std::string &header_path) {
+#ifdef TI_WITH_CC
+  TI_ERROR_IF(!cc_program, "Exporting a C library requires arch=cc");
+  cc_program->export_library(source_path, header_path);
+#else
+  TI_ERROR("No C backend detected.");
+#endif
+}
+
+void Program::export_llvm_aot_module(const std::string &path) {
+  TI_ERROR_IF(!llvm_aot_module,
+              "Exporting an AOT module requires aot_record=True on CPU or "
+              "CUDA");
+  llvm_aot_module->save(this, path);
+}
+
+std::vector<Kernel *> Program::load_llvm_aot_module(const std::string &path) {
+  return LlvmAotModule::load(this, path);
+}
+
 void Program::print_memory_profiler_info() {
   TI_ASSERT(arch_uses_llvm(config.arch));
 
@@ -751,6 +2038,8 @@ void Program::print_memory_profiler_info() {
   // E.g., 10000 is printed as "10,000".
   // TODO: is there a way to set locale only locally in this function?
 
+  const auto memory_stats = get_memory_stats();
+
   std::function<void(SNode *, int)> visit = [&](SNode *snode, int depth) {
     auto element_list = runtime_query<void *>("LLVMRuntime_get_element_lists",
                                               llvm_runtime, snode->id);
@@ -789,6 +2078,13 @@ void Program::print_memory_profiler_info() {
               "  Allocated elements={:n}; free list length={:n}; recycled list "
               "length={:n}\n",
               free_list_used, free_list_len, recycled_list_len);
+
+          const auto &stats = memory_stats[snode->id];
+          fmt::print(
+              "  Live nodes={:n} (peak {:n}); reserved={:n} B (peak {:n} B)\n",
+              stats.num_live_nodes, stats.peak_num_live_nodes,
+              stats.num_chunks * stats.chunk_size,
+              stats.peak_num_chunks * stats.chunk_size);
         }
       }
     }
@@ -798,6 +2094,9 @@ void Program::print_memory_profiler_info() {
   };
 
   visit(snode_root.get(), 0);
+  for (auto root : materialized_snode_trees_) {
+    visit(root, 0);
+  }
 
   auto total_requested_memory = runtime_query<std::size_t>(
       "LLVMRuntime_get_total_requested_memory", llvm_runtime);
@@ -808,13 +2107,347 @@ void Program::print_memory_profiler_info() {
 }
 
 std::size_t Program::get_snode_num_dynamically_allocated(SNode *snode) {
+  if (config.arch == Arch::metal) {
+    return metal_kernel_mgr_->get_snode_num_dynamically_allocated(snode);
+  }
   auto node_allocator = runtime_query<void *>("LLVMRuntime_get_node_allocators",
                                               llvm_runtime, snode->id);
-  auto data_list =
-      runtime_query<void *>("NodeManager_get_data_list", node_allocator);
+  return (std::size_t)runtime_query<int32>("NodeManager_get_num_allocated",
+                                           node_allocator);
+}
+
+std::vector<SNodeMemoryStats> Program::get_memory_stats() {
+  TI_ERROR_IF(!arch_uses_llvm(config.arch),
+              "Memory stats are only supported on the LLVM backends");
+  std::vector<SNodeMemoryStats> stats(get_num_snodes());
+  if (stats.empty())
+    return stats;
+  auto src = runtime_query<void *>("update_memory_stats");
+  const auto size = sizeof(SNodeMemoryStats) * stats.size();
+  if (config.arch == Arch::cuda && !config.use_unified_memory) {
+#if defined(TI_WITH_CUDA)
+    CUDADriver::get_instance().memcpy_device_to_host(stats.data(), src, size);
+#else
+    TI_NOT_IMPLEMENTED;
+#endif
+  } else {
+    // runtime_query() synchronized already.
+    std::memcpy(stats.data(), src, size);
+  }
+  return stats;
+}
+
+std::size_t Program::compact_snode(SNode *snode) {
+  TI_ERROR_IF(!arch_uses_llvm(config.arch),
+              "SNode compaction is only supported on the LLVM backends");
+  TI_ERROR_IF(
+      snode->type != SNodeType::pointer && snode->type != SNodeType::hash,
+      "Only pointer and hash SNodes can be compacted, got {}",
+      snode->get_node_type_name_hinted());
+  synchronize();
+  if (activation_tracker_)
+    activation_tracker_->invalidate();
+  // See the node layouts in node_pointer.h and node_hash.h
+  const int data_offset = snode->type == SNodeType::pointer
+                              ? 8 * snode->max_num_elements()
+                              : 4 * snode->hash_capacity;
+  return runtime_query<std::size_t>("compact_node_allocator", snode->id,
+                                    data_offset);
+}
+
+bool Program::can_clear_snode(SNode *snode) const {
+  if (!arch_uses_llvm(config.arch) || config.async_mode ||
+      (snode->type != SNodeType::pointer &&
+       snode->type != SNodeType::bitmasked)) {
+    return false;
+  }
+  for (auto p = snode->parent; p != nullptr; p = p->parent) {
+    if (p->type != SNodeType::dense && p->type != SNodeType::root) {
+      return false;
+    }
+  }
+  std::function<bool(SNode *)> supported = [&](SNode *s) {
+    if (s->type != SNodeType::dense && s->type != SNodeType::bitmasked &&
+        s->type != SNodeType::pointer && s->type != SNodeType::place) {
+      return false;
+    }
+    for (auto &c : s->ch) {
+      if (!supported(c.get()))
+        return false;
+    }
+    return true;
+  };
+  return supported(snode);
+}
+
+void Program::clear_snode(SNode *snode) {
+  TI_ASSERT(can_clear_snode(snode));
+  synchronize();
+  if (activation_tracker_)
+    activation_tracker_->invalidate();
+  // See the node layouts in node_pointer.h and node_bitmasked.h
+  const int n = snode->max_num_elements();
+  const int mask_size = 4 * ((n + 31) / 32);
+  if (snode->type == SNodeType::pointer) {
+    runtime_query<int32>("clear_containers", snode->id, 0, 16 * n + mask_size,
+                         config.cpu_max_num_threads);
+  } else {
+    auto tlctx = get_llvm_context(config.arch);
+    auto element_size =
+        tlctx->get_type_size(StructCompilerLLVM::get_llvm_element_type(
+            tlctx->get_this_thread_struct_module(), snode));
+    runtime_query<int32>("clear_containers", snode->id,
+                         (int)(element_size * n), mask_size,
+                         config.cpu_max_num_threads);
+  }
+  // None of the nodes in the subtree is reachable anymore.
+  std::function<void(SNode *)> reset_allocators = [&](SNode *s) {
+    if (s->type == SNodeType::pointer) {
+      auto num_nodes = runtime_query<int32>("reset_node_allocator", s->id,
+                                            config.cpu_max_num_threads);
+      TI_TRACE("Freed {} nodes of {}", num_nodes,
+               s->get_node_type_name_hinted());
+    }
+    for (auto &c : s->ch) {
+      reset_allocators(c.get());
+    }
+  };
+  reset_allocators(snode);
+}
 
-  return (std::size_t)runtime_query<int32>("ListManager_get_num_elements",
-                                           data_list);
+std::pair<std::size_t, std::size_t> Program::get_dense_field_range(
+    SNode *snode) {
+  if (!arch_uses_llvm(config.arch) || snode->type != SNodeType::place ||
+      !snode->dt->is<PrimitiveType>()) {
+    return {0, 0};
+  }
+  auto s = snode->parent;
+  for (; s->parent->type != SNodeType::root; s = s->parent) {
+    if (s->type != SNodeType::dense || s->ch.size() != 1)
+      return {0, 0};
+  }
+  if (s->type != SNodeType::dense || s->ch.size() != 1)
+    return {0, 0};
+  auto it = root_child_ranges_.find(s->id);
+  if (it == root_child_ranges_.end())
+    return {0, 0};
+  return it->second;
+}
+
+namespace {
+
+struct HostMemsetContext {
+  uint8 *dst;
+  const uint8 *src;
+  std::size_t size;
+  std::size_t part_size;
+  // The value to fill with, repeated over 8 bytes.
+  uint64 pattern;
+};
+
+}  // namespace
+
+bool Program::fill_snode(SNode *snode, float64 value) {
+  const auto [offset, size] = get_dense_field_range(snode);
+  if (size == 0)
+    return false;
+  const auto dt = snode->dt;
+  const int element_size = data_type_size(dt);
+  uint64 bits;
+  if (dt->is_primitive(PrimitiveTypeID::f32)) {
+    bits = taichi_union_cast_with_different_sizes<uint32>((float32)value);
+  } else if (dt->is_primitive(PrimitiveTypeID::f64)) {
+    bits = taichi_union_cast_with_different_sizes<uint64>(value);
+  } else if (is_integral(dt)) {
+    bits = (uint64)(int64)value;
+  } else {
+    return false;
+  }
+  if (element_size < 8) {
+    bits &= (1ULL << (8 * element_size)) - 1;
+  }
+  uint64 pattern = 0;
+  for (int i = 0; i < 8; i += element_size) {
+    pattern |= bits << (8 * i);
+  }
+  synchronize();
+  auto root =
+      (uint8 *)runtime_query<void *>("LLVMRuntime_get_root", llvm_runtime);
+  if (config.arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+    auto &driver = CUDADriver::get_instance();
+    auto ptr = root + offset;
+    if ((pattern & 0xFF) * 0x0101010101010101ULL == pattern) {
+      driver.memset_d8_async(ptr, (uint8)pattern, size, nullptr);
+    } else if (element_size == 2) {
+      driver.memset_d16_async(ptr, (uint16)pattern, size / 2, nullptr);
+    } else if ((uint32)pattern == (uint32)(pattern >> 32)) {
+      driver.memset_d32_async(ptr, (uint32)pattern, size / 4, nullptr);
+    } else {
+      return false;
+    }
+    sync = false;
+    return true;
+#else
+    TI_ERROR("No CUDA support");
+#endif
+  }
+  if (!arch_is_cpu(config.arch))
+    return false;
+  const int num_parts = std::max(config.cpu_max_num_threads, 1);
+  // The parts start at multiples of 8 bytes, as the root children do.
+  HostMemsetContext ctx{
+      root + offset, nullptr, size,
+      iroundup((size + num_parts - 1) / num_parts, (std::size_t)8), pattern};
+  auto fill = [](void *context, int i) {
+    auto *ctx = (HostMemsetContext *)context;
+    const auto begin = std::min(ctx->size, ctx->part_size * i);
+    const auto end = std::min(ctx->size, ctx->part_size * (i + 1));
+    if ((ctx->pattern & 0xFF) * 0x0101010101010101ULL == ctx->pattern) {
+      std::memset(ctx->dst + begin, (int)(ctx->pattern & 0xFF), end - begin);
+      return;
+    }
+    const auto words_end = begin + (end - begin) / 8 * 8;
+    std::fill((uint64 *)(ctx->dst + begin), (uint64 *)(ctx->dst + words_end),
+              ctx->pattern);
+    // The tail holds whole elements, which start the pattern.
+    std::memcpy(ctx->dst + words_end, &ctx->pattern, end - words_end);
+  };
+  if (work_stealing_thread_pool) {
+    work_stealing_thread_pool->run(num_parts, num_parts, &ctx, fill);
+  } else {
+    thread_pool->run(num_parts, num_parts, &ctx, fill);
+  }
+  return true;
+}
+
+bool Program::copy_snode(SNode *dst, SNode *src) {
+  return transfer_snode(dst, *this, src);
+}
+
+bool Program::transfer_snode(SNode *dst, Program &src_program, SNode *src) {
+  const auto [dst_offset, dst_size] = get_dense_field_range(dst);
+  const auto [src_offset, src_size] = src_program.get_dense_field_range(src);
+  if (dst_size == 0 || src_size == 0 || dst_size != src_size ||
+      dst->dt != src->dt) {
+    return false;
+  }
+  // The cells must be at the same offsets in both.
+  for (auto d = dst->parent, s = src->parent;
+       d->type != SNodeType::root || s->type != SNodeType::root;
+       d = d->parent, s = s->parent) {
+    if (d->type == SNodeType::root || s->type == SNodeType::root ||
+        d->_morton != s->_morton || d->cell_alignment != s->cell_alignment)
+      return false;
+    for (int k = 0; k < taichi_max_num_indices; k++) {
+      if (d->extractors[k].active != s->extractors[k].active ||
+          d->extractors[k].num_bits != s->extractors[k].num_bits ||
+          d->physical_index_position[k] != s->physical_index_position[k])
+        return false;
+    }
+  }
+  if (&src_program == this && dst == src)
+    return true;
+  const auto dst_arch = config.arch;
+  const auto src_arch = src_program.config.arch;
+  if ((dst_arch != Arch::cuda && !arch_is_cpu(dst_arch)) ||
+      (src_arch != Arch::cuda && !arch_is_cpu(src_arch)))
+    return false;
+  if (&src_program != this)
+    src_program.synchronize();
+  synchronize();
+  auto dst_root =
+      (uint8 *)runtime_query<void *>("LLVMRuntime_get_root", llvm_runtime) +
+      dst_offset;
+  auto src_root = (uint8 *)src_program.runtime_query<void *>(
+                      "LLVMRuntime_get_root", src_program.llvm_runtime) +
+                  src_offset;
+  if (dst_arch == Arch::cuda || src_arch == Arch::cuda) {
+#if defined(TI_WITH_CUDA)
+    auto &driver = CUDADriver::get_instance();
+    if (dst_arch != Arch::cuda) {
+      // Waits for the copy, as the host may read |dst| right after.
+      driver.memcpy_device_to_host(dst_root, src_root, dst_size);
+      return true;
+    }
+    if (src_arch == Arch::cuda) {
+      driver.memcpy_device_to_device_async(dst_root, src_root, dst_size,
+                                           nullptr);
+    } else {
+      driver.memcpy_host_to_device_async(dst_root, src_root, dst_size,
+                                         nullptr);
+    }
+    sync = false;
+    return true;
+#else
+    TI_ERROR("No CUDA support");
+#endif
+  }
+  const int num_parts = std::max(config.cpu_max_num_threads, 1);
+  HostMemsetContext ctx{dst_root, src_root, dst_size,
+                        (dst_size + num_parts - 1) / num_parts, 0};
+  auto copy = [](void *context, int i) {
+    auto *ctx = (HostMemsetContext *)context;
+    const auto begin = std::min(ctx->size, ctx->part_size * i);
+    const auto end = std::min(ctx->size, ctx->part_size * (i + 1));
+    std::memcpy(ctx->dst + begin, ctx->src + begin, end - begin);
+  };
+  if (work_stealing_thread_pool) {
+    work_stealing_thread_pool->run(num_parts, num_parts, &ctx, copy);
+  } else {
+    thread_pool->run(num_parts, num_parts, &ctx, copy);
+  }
+  return true;
+}
+
+std::size_t Program::trim_memory() {
+  if (!arch_uses_llvm(config.arch) || !llvm_runtime) {
+    return 0;
+  }
+  synchronize();
+  std::size_t released = 0;
+  if (arch_use_host_memory(config.arch)) {
+    // The free chunks of the runtime were zero-filled when released, and
+    // decommitted pages read as zeros.
+    auto num_free_chunks =
+        runtime_query<int32>("LLVMRuntime_get_num_free_chunks", llvm_runtime);
+    for (int i = 0; i < num_free_chunks; i++) {
+      auto size = runtime_query<std::size_t>("trim_free_chunk", i);
+      if (size == 0) {
+        continue;
+      }
+      auto ptr = runtime_query<void *>("LLVMRuntime_get_free_chunks",
+                                       llvm_runtime, i);
+      released += memory_pool->release(ptr, size);
+    }
+  }
+#if defined(TI_WITH_CUDA)
+  if (cuda_device_memory_pool_) {
+    released += cuda_device_memory_pool_->trim();
+  }
+#endif
+  TI_TRACE("Trimmed {} KB of memory", released / 1024);
+  return released;
+}
+
+void Program::save_checkpoint(
+    const std::string &path,
+    bool delta,
+    int compression_level,
+    const std::unordered_map<int, float64> &error_bounds) {
+  if (!checkpointer_) {
+    checkpointer_ = std::make_unique<Checkpointer>(this);
+  }
+  checkpointer_->save(path, delta, compression_level, error_bounds);
+}
+
+void Program::load_checkpoint(const std::string &path, bool copy_on_write) {
+  if (!checkpointer_) {
+    checkpointer_ = std::make_unique<Checkpointer>(this);
+  }
+  checkpointer_->load(path, copy_on_write);
+  if (activation_tracker_)
+    activation_tracker_->invalidate();
 }
 
 Program::~Program() {
@@ -5,6 +5,9 @@
 #include <functional>
 #include <optional>
 #include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_set>
 
 #define TI_RUNTIME_HOST
 #include "taichi/ir/ir.h"
@@ -12,10 +15,13 @@
 #include "taichi/ir/snode.h"
 #include "taichi/lang_util.h"
 #include "taichi/llvm/llvm_context.h"
+#include "taichi/llvm/llvm_aot_module.h"
+#include "taichi/llvm/llvm_offline_cache.h"
 #include "taichi/backends/metal/kernel_manager.h"
 #include "taichi/backends/opengl/opengl_kernel_launcher.h"
 #include "taichi/backends/cc/cc_program.h"
 #include "taichi/program/kernel.h"
+#include "taichi/program/compile_profiler.h"
 #include "taichi/program/kernel_profiler.h"
 #include "taichi/program/context.h"
 #include "taichi/runtime/runtime.h"
@@ -26,46 +32,6 @@
 
 TLANG_NAMESPACE_BEGIN
 
-struct JITEvaluatorId {
-  std::thread::id thread_id;
-  // Note that on certain backends (e.g. CUDA), functions created in one
-  // thread cannot be used in another. Hence the thread_id member.
-  int op;
-  DataType ret, lhs, rhs;
-  bool is_binary;
-
-  UnaryOpType unary_op() const {
-    TI_ASSERT(!is_binary);
-    return (UnaryOpType)op;
-  }
-
-  BinaryOpType binary_op() const {
-    TI_ASSERT(is_binary);
-    return (BinaryOpType)op;
-  }
-
-  bool operator==(const JITEvaluatorId &o) const {
-    return thread_id == o.thread_id && op == o.op && ret == o.ret &&
-           lhs == o.lhs && rhs == o.rhs && is_binary == o.is_binary;
-  }
-};
-
-TLANG_NAMESPACE_END
-
-namespace std {
-template <>
-struct hash<taichi::lang::JITEvaluatorId> {
-  std::size_t operator()(taichi::lang::JITEvaluatorId const &id) const
-      noexcept {
-    return ((std::size_t)id.op | (id.ret.hash() << 8) | (id.lhs.hash() << 16) |
-            (id.rhs.hash() << 24) | ((std::size_t)id.is_binary << 31)) ^
-           (std::hash<std::thread::id>{}(id.thread_id) << 32);
-  }
-};
-}  // namespace std
-
-TLANG_NAMESPACE_BEGIN
-
 extern Program *current_program;
 
 TI_FORCE_INLINE Program &get_current_program() {
@@ -74,36 +40,68 @@ TI_FORCE_INLINE Program &get_current_program() {
 
 class StructCompiler;
 
+namespace vulkan {
+class VulkanRuntime;
+}  // namespace vulkan
+
 class AsyncEngine;
+class ParallelExecutor;
+class ParallelPrimitives;
+class SparseMatrix;
+class LayoutAdvisor;
+class ActivationTracker;
+class ProfileGuide;
+class Checkpointer;
+
+class CUDAGraph;
+class CUDADeviceMemoryPool;
+class JITModule;
 
 class Program {
  public:
   using Kernel = taichi::lang::Kernel;
-  Kernel *current_kernel;
+  // The kernel being defined or compiled by the calling host thread, so that
+  // several threads can define and launch kernels.
+  static thread_local Kernel *current_kernel;
   std::unique_ptr<SNode> snode_root;  // pointer to the data structure.
   void *llvm_runtime;
   CompileConfig config;
-  std::unique_ptr<TaichiLLVMContext> llvm_context_host, llvm_context_device;
-  bool sync;  // device/host synchronized?
+  // Shared, so that the tasks compiled into their JITs outlive the Program
+  // for the other Programs reusing them, see find_compiled_task().
+  std::shared_ptr<TaichiLLVMContext> llvm_context_host, llvm_context_device;
+  std::atomic<bool> sync;  // device/host synchronized?
+  // Held while compiling a kernel, as the host threads may launch kernels
+  // concurrently.
+  std::recursive_mutex compile_mut;
   bool finalized;
   float64 total_compilation_time;
   static std::atomic<int> num_instances;
-  ThreadPool thread_pool;
+  // Shared by the Programs of the process.
+  std::shared_ptr<ThreadPool> thread_pool;
+  // Replaces |thread_pool| for CPU kernels when |config.cpu_work_stealing| is
+  // set.
+  std::unique_ptr<WorkStealingThreadPool> work_stealing_thread_pool;
   std::unique_ptr<MemoryPool> memory_pool;
   uint64 *result_buffer;             // TODO: move this
-  void *preallocated_device_buffer;  // TODO: move this to memory allocator
   std::unordered_map<int, SNode *> snodes;
 
   std::unique_ptr<Runtime> runtime;
   std::unique_ptr<AsyncEngine> async_engine;
+  // Only available on the LLVM backends when |config.offline_cache| is set.
+  std::unique_ptr<LlvmOfflineCache> llvm_offline_cache;
+  // The cubins assembled from PTX, see CompileConfig::cuda_cubin_cache.
+  std::unique_ptr<LlvmOfflineCache> cubin_cache;
+  // Only available on the LLVM backends when |config.aot_record| is set.
+  std::unique_ptr<LlvmAotModule> llvm_aot_module;
+  // Only available on CPU and CUDA when |config.pgo_instrument| or
+  // |config.pgo_profile| is set.
+  std::unique_ptr<ProfileGuide> profile_guide;
 
   std::vector<std::unique_ptr<Kernel>> kernels;
 
   std::unique_ptr<KernelProfilerBase> profiler;
-
-  std::unordered_map<JITEvaluatorId, std::unique_ptr<Kernel>>
-      jit_evaluator_cache;
-  std::mutex jit_evaluator_cache_mut;
+  // Only created with CompileConfig::compile_profiler
+  std::unique_ptr<CompileProfiler> compile_profiler;
 
   // Note: for now we let all Programs share a single TypeFactory for smooth
   // migration. In the future each program should have its own copy.
@@ -112,8 +110,15 @@ class Program {
   Program() : Program(default_compile_config.arch) {
   }
 
+  // Becomes the current program. Several Programs can be alive at once, with
+  // separate root buffers; they share the thread pool, the processed runtime
+  // bitcode and the compiled tasks.
   Program(Arch arch);
 
+  // Makes this the program that the fields and the kernels are defined in and
+  // compiled by, see get_current_program().
+  void make_current();
+
   void kernel_profiler_print() {
     profiler->print();
   }
@@ -153,26 +158,37 @@ class Program {
     std::string name;
     Program *prog;
     bool grad;
+    bool jvp;
+    bool keep_primal;
 
     Kernel &def(const std::function<void()> &func) {
-      return prog->kernel(func, name, grad);
+      return prog->kernel(func, name, grad, jvp, keep_primal);
     }
   };
 
-  KernelProxy kernel(const std::string &name, bool grad = false) {
+  KernelProxy kernel(const std::string &name,
+                     bool grad = false,
+                     bool jvp = false,
+                     bool keep_primal = false) {
     KernelProxy proxy;
     proxy.prog = this;
     proxy.name = name;
     proxy.grad = grad;
+    proxy.jvp = jvp;
+    proxy.keep_primal = keep_primal;
     return proxy;
   }
 
   Kernel &kernel(const std::function<void()> &body,
                  const std::string &name = "",
-                 bool grad = false) {
+                 bool grad = false,
+                 bool jvp = false,
+                 bool keep_primal = false) {
     // Expr::set_allow_store(true);
-    auto func = std::make_unique<Kernel>(*this, body, name, grad);
+    auto func =
+        std::make_unique<Kernel>(*this, body, name, grad, jvp, keep_primal);
     // Expr::set_allow_store(false);
+    std::lock_guard<std::mutex> _(kernels_mut_);
     kernels.emplace_back(std::move(func));
     return *kernels.back();
   }
@@ -192,10 +208,79 @@ class Program {
   FunctionType compile_to_backend_executable(Kernel &kernel,
                                              OffloadedStmt *stmt);
 
+  // Lowers |kernel| to offloaded tasks, then finishes lowering and compiles
+  // each task on |compilation_workers_|. Only for the LLVM backends.
+  FunctionType compile_offloads_in_parallel(Kernel &kernel);
+
+  // Lowers and compiles each offloaded task in |block| of |kernel| on its
+  // own, into a function launching them in order. The tasks are compiled in
+  // parallel on the LLVM backends.
+  FunctionType compile_offloaded_tasks(Kernel &kernel, Block *block);
+
+  // Runs |func(i)| for each i in [0, n) on |compilation_workers_| and waits
+  // for all of them, then rethrows the first exception thrown, if any. Runs
+  // them serially on the calling thread under num_compile_threads=1, and when
+  // called from a compilation worker.
+  void run_on_compilation_workers(int n, const std::function<void(int)> &func);
+
+  // An offloaded task compiled on the LLVM backends, whose functions live in
+  // |jit_module|. |owner| keeps the context of |jit_module| alive when the
+  // task was compiled by another Program.
+  struct CompiledTask {
+    std::vector<LlvmOfflineCache::TaskInfo> tasks;
+    JITModule *jit_module{nullptr};
+    std::shared_ptr<TaichiLLVMContext> owner;
+  };
+
+  // Looks up the task compiled under |key|, see
+  // LlvmOfflineCache::make_task_key() and CompileConfig::task_cache. Falls
+  // back to the tasks compiled by the other live Programs with the same
+  // signature, see LlvmOfflineCache::make_signature().
+  bool find_compiled_task(const std::string &key, CompiledTask *task);
+
+  void add_compiled_task(const std::string &key, const CompiledTask &task);
+
+  // Runs |func| on |background_compiler_|, in the order of the calls. Used to
+  // recompile hot kernels under |config.tiered_compilation|.
+  void enqueue_background_compilation(const std::function<void()> &func);
+
+  // Runs |func| on |host_launcher_|, in the order of the calls, see
+  // CompileConfig::cpu_async_launch.
+  void enqueue_host_launch(const std::function<void()> &func);
+
   void initialize_runtime_system(StructCompiler *scomp);
 
+  // Initializes the node allocators and the ambient elements of the pointer,
+  // hash and dynamic SNodes among |snodes|.
+  void initialize_node_allocators(TaichiLLVMContext *tlctx,
+                                  const std::vector<SNode *> &snodes);
+
+  // Applies the NUMA policies of the children of the root to their parts of
+  // the root buffer, and with |config.cpu_numa_first_touch|, touches the root
+  // buffer from the CPU threads. Only on CPU.
+  void place_root_buffer_on_numa_nodes(StructCompiler *scomp);
+
+  // Maps the children of the root with an |mmap_path| to their files, in
+  // place of their parts of the root buffer. Only on CPU.
+  void map_root_children_to_files(StructCompiler *scomp);
+
   void materialize_layout();
 
+  // Creates the root of another SNode tree, materialized on its own by
+  // materialize_snode_tree() after the layout of |snode_root|, e.g. to add
+  // fields after kernels have run. CPU and CUDA only.
+  SNode *create_snode_tree();
+
+  // Appends the tree of |root| to the struct modules and allocates its root
+  // buffer. The kernels compiled before keep their code, as they do not
+  // access it.
+  void materialize_snode_tree(SNode *root);
+
+  // The trees materialized by materialize_snode_tree(), in that order.
+  const std::vector<SNode *> &get_materialized_snode_trees() const {
+    return materialized_snode_trees_;
+  }
+
   void check_runtime_error();
 
   inline Kernel &get_current_kernel() {
@@ -215,6 +300,33 @@ class Program {
 
   Kernel &get_snode_writer(SNode *snode);
 
+  // Kernels copying a whole place SNode to/from a strided host buffer in one
+  // parallel launch. Arg 0 is the buffer, followed by one element stride per
+  // index.
+  Kernel &get_snode_to_buffer_kernel(SNode *snode);
+
+  Kernel &get_snode_from_buffer_kernel(SNode *snode);
+
+  // Kernels listing the active cells of |snode| into host buffers, and
+  // activating the cells of such a list, or writing them for a place SNode.
+  // See save_checkpoint() in checkpoint.h.
+  //
+  // Gather args: a 1-element counter the cells are counted into, the buffer
+  // of the indices of the cells, for a place SNode the buffer of their
+  // values, and the number of cells that fit into the buffers.
+  Kernel &get_snode_gather_kernel(SNode *snode);
+
+  // Scatter args: the indices of the cells, for a place SNode their values,
+  // and the number of cells.
+  Kernel &get_snode_scatter_kernel(SNode *snode);
+
+  // SNode id -> (offset, size) in bytes in the root buffer, for the children
+  // of the root. Only on the LLVM backends.
+  const std::unordered_map<int, std::pair<std::size_t, std::size_t>>
+      &get_root_child_ranges() const {
+    return root_child_ranges_;
+  }
+
   uint64 fetch_result_uint64(int i);
 
   template <typename T>
@@ -222,6 +334,16 @@ class Program {
     return taichi_union_cast_with_different_sizes<T>(fetch_result_uint64(i));
   }
 
+  // Returns a handle to a copy of the result buffer, which is taken once the
+  // kernels launched so far complete. Unlike fetch_result(), this does not wait
+  // for them on CUDA, and the copy is not affected by later launches.
+  int64 create_result_future();
+
+  // Waits for the copy of |future| and returns its |i|-th entry.
+  uint64 fetch_future_result_uint64(int64 future, int i);
+
+  void release_result_future(int64 future);
+
   Arch get_host_arch() {
     return host_arch();
   }
@@ -250,6 +372,20 @@ class Program {
 
   void print_memory_profiler_info();
 
+  // Writes the kernels compiled so far on the C backend as a standalone C
+  // library. See cccp::CCProgram::export_library().
+  void export_cc_library(const std::string &source_path,
+                         const std::string &header_path);
+
+  // Writes the kernels compiled so far on CPU or CUDA to |path|. Requires
+  // |config.aot_record|.
+  void export_llvm_aot_module(const std::string &path);
+
+  // Loads the kernels of an AOT module written by export_llvm_aot_module().
+  // The layout must be materialized, and identical to that of the exporting
+  // Program.
+  std::vector<Kernel *> load_llvm_aot_module(const std::string &path);
+
   template <typename T, typename... Args>
   T runtime_query(const std::string &key, Args... args) {
     TI_ASSERT(arch_uses_llvm(config.arch));
@@ -270,6 +406,176 @@ class Program {
   // Returns zero if the SNode is statically allocated
   std::size_t get_snode_num_dynamically_allocated(SNode *snode);
 
+  // The memory usage of every SNode, indexed by SNode id, gathered by one
+  // runtime call and read back with one copy. CPU and CUDA only.
+  std::vector<SNodeMemoryStats> get_memory_stats();
+
+  // Relocates the active children of a pointer or hash SNode into the fewest
+  // memory chunks, and releases the chunks left empty for reuse by other
+  // allocations. The element list of |snode| must be up to date. Returns the
+  // number of bytes released.
+  std::size_t compact_snode(SNode *snode);
+
+  // Whether clear_snode() supports |snode|: a pointer or bitmasked SNode
+  // with dense ancestors and a subtree of dense, bitmasked, pointer and place
+  // SNodes, on the LLVM backends without the async engine.
+  bool can_clear_snode(SNode *snode) const;
+
+  // Deactivates all the cells of |snode| and of its descendants at once:
+  // zeroes the activity of its containers and resets the node allocators of
+  // the subtree, without visiting the nodes. The element list of |snode| must
+  // be up to date.
+  void clear_snode(SNode *snode);
+
+  // Fast paths of field.fill() and field.copy_from() for the fields that are
+  // the only content of a root child made of dense SNodes, with a memset or
+  // memcpy of its bytes in the root buffer. |value| is converted to the data
+  // type of the field. Return false, doing nothing, for the other fields.
+  bool fill_snode(SNode *snode, float64 value);
+  bool copy_snode(SNode *dst, SNode *src);
+  // Copies the field |src| of |src_program|, e.g. a Program on another arch,
+  // to |dst| the same way, between the host and the device as needed.
+  // Synchronizes |src_program| first.
+  bool transfer_snode(SNode *dst, Program &src_program, SNode *src);
+
+  // Returns the physical memory that no field or list is using to the OS or
+  // the driver: the free chunks of the runtime on the CPU, and the unused
+  // device memory commits on CUDA. Returns the number of bytes released.
+  std::size_t trim_memory();
+
+  // See Checkpointer::save().
+  void save_checkpoint(const std::string &path,
+                       bool delta,
+                       int compression_level,
+                       const std::unordered_map<int, float64> &error_bounds);
+
+  void load_checkpoint(const std::string &path, bool copy_on_write);
+
+  // Null until a checkpoint is saved or loaded.
+  Checkpointer *get_checkpointer() {
+    return checkpointer_.get();
+  }
+
+  // Zero-copy external arrays: host memory that kernels access in place. On
+  // CUDA it is allocated as managed memory, so that launches taking it as an
+  // ext_arr skip the host<->device staging copies. All of them are freed when
+  // the program is finalized.
+  void *allocate_external_array(std::size_t size);
+
+  void free_external_array(void *ptr);
+
+  // Whether [ptr, ptr + size) lies within one zero-copy external array.
+  bool is_external_array(void *ptr, std::size_t size);
+
+  // Migrates the pages of a zero-copy external array ahead of their use. A
+  // no-op on CPU.
+  void prefetch_external_array(void *ptr, std::size_t size, bool to_device);
+
+  // Sets the CUDA unified memory hints of a zero-copy external array. A no-op
+  // on CPU.
+  void advise_external_array(void *ptr,
+                             std::size_t size,
+                             bool read_mostly,
+                             bool prefer_device);
+
+  // Device arrays: memory of the memory pool that kernels take as ext_arr
+  // arguments in place, on CPU and CUDA, without an SNode tree. The memory of
+  // freed arrays is reused for later ones. All of them are freed with the
+  // memory pool when the program is finalized.
+  void *allocate_device_array(std::size_t size);
+
+  void free_device_array(void *ptr);
+
+  // Whether [ptr, ptr + size) lies within one device array.
+  bool is_device_array(void *ptr, std::size_t size);
+
+  // Copies |size| bytes from |src| to |dst|, either of which may be in a
+  // device array, after the launches so far.
+  void copy_device_array(void *dst, const void *src, std::size_t size);
+
+  // Returns a handle to a new CUDA graph, or -1 if not on CUDA, where kernels
+  // are always launched directly.
+  int create_cuda_graph();
+
+  // Kernels launched between begin_cuda_graph() and end_cuda_graph() are
+  // captured into the graph the first time, and replayed later on. See
+  // CUDAGraph.
+  void begin_cuda_graph(int handle);
+
+  void end_cuda_graph(int handle);
+
+  // Makes sure that the LLVM runtime has enough device memory committed for
+  // the next task, when CUDA device memory is committed lazily. See
+  // CUDADeviceMemoryPool.
+  void commit_device_memory_if_needed();
+
+  // Advises and prefetches to the device the parts of the root buffer holding
+  // |root_children| (ids of children of the root SNode), unless they are
+  // already there. Only with CUDA unified memory.
+  void prefetch_root_children(const std::vector<int> &root_children);
+
+  // The number of tiles that a streamed range-for over |root_children| is
+  // launched in: the size of the largest of them in tiles, or 1 if none is
+  // larger than a tile. See CompileConfig::unified_memory_stream_tile_MB.
+  int get_num_stream_tiles(const std::vector<int> &root_children);
+
+  // Starts prefetching to the device the |tile|-th of |num_tiles| slices of
+  // those of |root_children| larger than a tile, on a stream of its own. The
+  // prefetches of two consecutive tiles are in flight at most.
+  void prefetch_stream_tile(const std::vector<int> &root_children,
+                            int tile,
+                            int num_tiles);
+
+  // Makes the work launched next on the current stream wait for the
+  // prefetches of |tile|.
+  void wait_for_stream_tile(int tile);
+
+  // Migrates the slices of |tile| back to the host once the work launched
+  // so far on the current stream is done, without blocking the host.
+  void evict_stream_tile(const std::vector<int> &root_children,
+                         int tile,
+                         int num_tiles);
+
+  // Starts prefetching the root children that are not on the device yet on a
+  // stream of their own, e.g. those of the later tasks of a kernel while its
+  // first task runs. Returns whether any prefetch was started, in which case
+  // the tasks accessing them must wait_for_early_prefetches() first.
+  bool prefetch_root_children_early(const std::vector<int> &root_children);
+
+  // Makes the work launched next on the current stream wait for the
+  // prefetches started by prefetch_root_children_early().
+  void wait_for_early_prefetches();
+
+  // Notes that the host may have migrated pages of the root buffer back, e.g.
+  // by running an accessor kernel. Only the pages of the child of the root
+  // holding |snode| if given, the whole root buffer otherwise.
+  void on_root_buffer_host_access(SNode *snode = nullptr);
+
+  // Device-wide scan, sort and compaction on CPU and CUDA. Created on first
+  // use.
+  ParallelPrimitives *get_parallel_primitives();
+
+  // A sparse matrix on CPU or CUDA, which lives until destroyed or until the
+  // Program is finalized.
+  SparseMatrix *create_sparse_matrix(int num_rows, int num_cols, DataType dt);
+
+  void destroy_sparse_matrix(SparseMatrix *matrix);
+
+  // Null unless |config.sync_activation_demotion| is set, in synchronous mode
+  // on the LLVM backends and Metal.
+  ActivationTracker *get_activation_tracker() {
+    return activation_tracker_.get();
+  }
+
+  // Null unless |config.layout_advisor| or |config.layout_profile| is set.
+  LayoutAdvisor *get_layout_advisor() {
+    return layout_advisor_.get();
+  }
+
+  // How the fields would better be grouped into dense SNodes for the
+  // launches so far. Requires |config.layout_advisor|.
+  std::string get_layout_advice();
+
   ~Program();
 
  private:
@@ -279,6 +585,103 @@ class Program {
   // OpenGL related data structures
   std::optional<opengl::StructCompiledResult> opengl_struct_compiled_;
   std::unique_ptr<opengl::GLSLLauncher> opengl_kernel_launcher_;
+  // Vulkan runs the GLSL of the OpenGL backend, with the same layout.
+  std::unique_ptr<vulkan::VulkanRuntime> vulkan_runtime_;
+  // Zero-copy external arrays, address -> size
+  std::map<uint64, std::size_t> external_arrays_;
+  std::mutex external_arrays_mut_;
+  // Device arrays, address -> size, and the memory of the freed ones by size.
+  std::map<uint64, std::size_t> device_arrays_;
+  std::multimap<std::size_t, void *> free_device_arrays_;
+  std::mutex device_arrays_mut_;
+#if defined(TI_WITH_CUDA)
+  std::vector<std::unique_ptr<CUDAGraph>> cuda_graphs_;
+  // The device memory of the runtime, unless |config.use_unified_memory| is
+  // in effect.
+  std::unique_ptr<CUDADeviceMemoryPool> cuda_device_memory_pool_;
+#endif
+  // Only filled with CUDA unified memory. See prefetch_root_children().
+  uint8 *unified_root_buffer_{nullptr};
+  // See create_result_future().
+  struct ResultFuture {
+    // Pinned host memory on CUDA.
+    uint64 *values{nullptr};
+    // Recorded after the copy on CUDA.
+    void *event{nullptr};
+  };
+  std::unordered_map<int64, ResultFuture> result_futures_;
+  // Released futures, whose buffers and events are recycled.
+  std::vector<ResultFuture> free_result_futures_;
+  int64 next_result_future_id_{0};
+  std::unordered_map<int, std::pair<std::size_t, std::size_t>>
+      root_child_ranges_;
+
+  // The byte range in the root buffer of the cells of a place SNode, if they
+  // are all that its root child holds: the SNodes from the root child to it
+  // are dense, with one child each. {0, 0} otherwise.
+  std::pair<std::size_t, std::size_t> get_dense_field_range(SNode *snode);
+  std::unordered_set<int> advised_root_children_;
+  std::unordered_set<int> prefetched_root_children_;
+  // The stream of the early prefetches and of the prefetches and evictions
+  // of the streamed tiles, the events recorded after the prefetches of the
+  // last two tiles, and the one recorded before an eviction. Created on first
+  // use.
+  void *stream_tile_stream_{nullptr};
+  void *stream_tile_ready_events_[2]{nullptr, nullptr};
+  void *stream_tile_done_event_{nullptr};
+  // Recorded after the prefetches of prefetch_root_children_early().
+  void *early_prefetch_event_{nullptr};
+  // Compiles the offloaded tasks of a kernel outside async mode. Created on
+  // first use. See CompileConfig::num_compile_threads.
+  std::unique_ptr<ParallelExecutor> compilation_workers_;
+  // The tasks compiled by add_compiled_task(), guarded by
+  // |compiled_tasks_mut_|.
+  std::unordered_map<std::string, CompiledTask> compiled_tasks_;
+  std::mutex compiled_tasks_mut_;
+  // SNode::counter while another Program is current, see make_current().
+  int snode_counter_{0};
+  // Serializes synchronize(), so that none returns before the device work
+  // launched before it is done.
+  std::mutex sync_mut_;
+  // Guards |kernels|, which the host threads defining kernels append to.
+  std::mutex kernels_mut_;
+  // A single thread recompiling hot kernels. Created on first use.
+  std::unique_ptr<ParallelExecutor> background_compiler_;
+  // A single thread running the CPU kernels launched asynchronously. Created
+  // on first use.
+  std::unique_ptr<ParallelExecutor> host_launcher_;
+  // Keeps the scratch memory of the primitives across calls.
+  std::unique_ptr<ParallelPrimitives> parallel_primitives_;
+  std::vector<std::unique_ptr<SparseMatrix>> sparse_matrices_;
+  std::unique_ptr<LayoutAdvisor> layout_advisor_;
+  std::unique_ptr<ActivationTracker> activation_tracker_;
+  std::unique_ptr<Checkpointer> checkpointer_;
+  // The roots created by create_snode_tree(), the root of tree i + 1 at i.
+  std::vector<std::unique_ptr<SNode>> snode_trees_;
+  std::vector<SNode *> materialized_snode_trees_;
+
+  // One more than the largest id of the materialized SNodes, i.e. the number
+  // of SNodes the LLVMRuntime has element lists for.
+  int get_num_snodes() const;
+
+  // The size in bytes of the tiles of the streamed fields, 0 if they are not
+  // streamed.
+  std::size_t get_stream_tile_bytes() const;
+
+  // Creates |stream_tile_stream_| and the events recorded on it if needed.
+  void init_prefetch_stream();
+
+  // Advises and prefetches the root children not on the device yet on
+  // |stream|. Returns whether any prefetch was issued.
+  bool prefetch_root_children_on(const std::vector<int> &root_children,
+                                 void *stream);
+
+  // Prefetches on |stream_tile_stream_| the |tile|-th of |num_tiles| slices
+  // of those of |root_children| larger than a tile to |device|.
+  void prefetch_stream_slices(const std::vector<int> &root_children,
+                              int tile,
+                              int num_tiles,
+                              uint32 device);
 
  public:
 #ifdef TI_WITH_CC
@@ -0,0 +1,290 @@
+#include "taichi/program/sparse_matrix.h"
+
+#include <cstring>
+
+#include "taichi/jit/jit_module.h"
+#include "taichi/program/parallel_primitives.h"
+#include "taichi/program/program.h"
+#if defined(TI_WITH_CUDA)
+#include "taichi/backends/cuda/cuda_driver.h"
+#endif
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// The fewest rows a CPU worker processes serially.
+constexpr int kCPUMinSegmentSize = 1024;
+constexpr int kCUDABlockDim = 128;
+// The iterations of CG between two checks for convergence on CUDA, which
+// wait for the device. The iterations past convergence do nothing.
+constexpr int kCUDACGCheckInterval = 8;
+
+}  // namespace
+
+SparseMatrix::SparseMatrix(Program *program,
+                           int num_rows,
+                           int num_cols,
+                           DataType dt)
+    : program_(program), num_rows_(num_rows), num_cols_(num_cols), dt_(dt) {
+  TI_ERROR_IF(!arch_uses_llvm(program->config.arch),
+              "Sparse matrices are only available on CPU and CUDA, not {}",
+              arch_name(program->config.arch));
+  TI_ERROR_IF(dt != PrimitiveType::f32 && dt != PrimitiveType::f64,
+              "Sparse matrices hold f32 or f64, not {}", dt->to_string());
+  TI_ERROR_IF(num_rows <= 0 || num_cols <= 0,
+              "Invalid sparse matrix shape ({}, {})", num_rows, num_cols);
+  value_size_ = data_type_size(dt);
+  row_offsets_ = (int32 *)allocate(sizeof(int32) * (num_rows_ + 1));
+  std::vector<int32> zeros(num_rows_ + 1, 0);
+  memcpy_to_device(row_offsets_, zeros.data(), sizeof(int32) * zeros.size());
+}
+
+SparseMatrix::~SparseMatrix() {
+  deallocate(row_offsets_);
+  deallocate(col_indices_);
+  deallocate(values_);
+}
+
+void *SparseMatrix::allocate(std::size_t size) {
+  if (size == 0)
+    return nullptr;
+#if defined(TI_WITH_CUDA)
+  if (program_->config.arch == Arch::cuda) {
+    void *ptr;
+    CUDADriver::get_instance().malloc(&ptr, size);
+    return ptr;
+  }
+#endif
+  return new char[size];
+}
+
+void SparseMatrix::deallocate(void *ptr) {
+  if (ptr == nullptr)
+    return;
+#if defined(TI_WITH_CUDA)
+  if (program_->config.arch == Arch::cuda) {
+    CUDADriver::get_instance().mem_free(ptr);
+    return;
+  }
+#endif
+  delete[](char *) ptr;
+}
+
+void SparseMatrix::memcpy_to_device(void *dst,
+                                    const void *src,
+                                    std::size_t size) {
+#if defined(TI_WITH_CUDA)
+  if (program_->config.arch == Arch::cuda) {
+    CUDADriver::get_instance().memcpy_host_to_device(dst, (void *)src, size);
+    return;
+  }
+#endif
+  std::memcpy(dst, src, size);
+}
+
+void SparseMatrix::memcpy_to_host(void *dst,
+                                  const void *src,
+                                  std::size_t size) {
+#if defined(TI_WITH_CUDA)
+  if (program_->config.arch == Arch::cuda) {
+    CUDADriver::get_instance().memcpy_device_to_host(dst, (void *)src, size);
+    return;
+  }
+#endif
+  std::memcpy(dst, src, size);
+}
+
+std::string SparseMatrix::typed(const std::string &name) const {
+  return name + (dt_ == PrimitiveType::f64 ? "_f64" : "_f32");
+}
+
+void SparseMatrix::run_pass(const std::string &name,
+                            const std::vector<void *> &ptrs,
+                            int n,
+                            int k,
+                            int m) {
+  if (n <= 0)
+    return;
+  const auto &config = program_->config;
+  auto *runtime = program_->get_llvm_context(config.arch)->runtime_jit_module;
+  auto *llvm_runtime = program_->llvm_runtime;
+  void *p[8] = {nullptr};
+  TI_ASSERT(ptrs.size() <= 8);
+  std::copy(ptrs.begin(), ptrs.end(), p);
+  int32 num_threads = config.cpu_max_num_threads;
+  const auto func_name = "runtime_sparse_" + name;
+  if (config.arch == Arch::cuda) {
+    // Every thread is a worker, for the warp reductions of the dot products.
+    const int64 max_num_workers =
+        (int64)config.saturating_grid_dim * kCUDABlockDim;
+    const int grid_dim =
+        (int)((std::min((int64)n, max_num_workers) + kCUDABlockDim - 1) /
+              kCUDABlockDim);
+    int32 num_workers = grid_dim * kCUDABlockDim;
+    std::vector<void *> arg_pointers{
+        &llvm_runtime, &p[0], &p[1], &p[2],        &p[3], &p[4], &p[5],
+        &p[6],         &p[7], &n,    &num_workers, &k,    &m,    &num_threads};
+    runtime->launch(func_name, grid_dim, kCUDABlockDim, 0, arg_pointers);
+  } else {
+    int32 num_workers = (int32)std::max(
+        std::min((int64)(n + kCPUMinSegmentSize - 1) / kCPUMinSegmentSize,
+                 (int64)config.cpu_max_num_threads * 4),
+        (int64)1);
+    runtime->call<void *, void *, void *, void *, void *, void *, void *,
+                  void *, void *, int32, int32, int32, int32, int32>(
+        func_name, llvm_runtime, p[0], p[1], p[2], p[3], p[4], p[5], p[6],
+        p[7], n, num_workers, k, m, num_threads);
+  }
+}
+
+void SparseMatrix::build_from_triplets(void *rows,
+                                       void *cols,
+                                       void *values,
+                                       int n,
+                                       bool on_device) {
+  TI_ERROR_IF(n < 0, "Invalid number of triplets {}", n);
+  StagedArray staged_rows(program_, rows, sizeof(int32) * n, on_device,
+                          /*read_only=*/true);
+  StagedArray staged_cols(program_, cols, sizeof(int32) * n, on_device,
+                          /*read_only=*/true);
+  StagedArray staged_values(program_, values, value_size_ * n, on_device,
+                            /*read_only=*/true);
+  program_->synchronize();
+  deallocate(col_indices_);
+  deallocate(values_);
+  col_indices_ = nullptr;
+  values_ = nullptr;
+  num_nonzeros_ = 0;
+  if (n == 0) {
+    std::vector<int32> zeros(num_rows_ + 1, 0);
+    memcpy_to_device(row_offsets_, zeros.data(), sizeof(int32) * zeros.size());
+    return;
+  }
+
+  auto *primitives = program_->get_parallel_primitives();
+  auto *perm = allocate(sizeof(int32) * n);
+  auto *keys = allocate(sizeof(int32) * n);
+  auto *sorted_cols = allocate(sizeof(int32) * n);
+  auto *flags = allocate(sizeof(int32) * (n + 1));
+  // Sorts the triplets by column, and then stably by row.
+  run_pass("iota", {perm}, n);
+  run_pass("gather_i32", {staged_cols.get(), perm, keys}, n);
+  primitives->sort_pairs_32(keys, perm, n, /*signed_keys=*/true,
+                            /*on_device=*/true);
+  run_pass("gather_i32", {staged_rows.get(), perm, keys}, n);
+  primitives->sort_pairs_32(keys, perm, n, /*signed_keys=*/true,
+                            /*on_device=*/true);
+  run_pass("gather_i32", {staged_cols.get(), perm, sorted_cols}, n);
+  // The position of each entry among the unique ones.
+  run_pass("unique_flags", {keys, sorted_cols, flags}, n);
+  primitives->exclusive_scan_i32(flags, n + 1, /*on_device=*/true);
+  int32 num_nonzeros;
+  memcpy_to_host(&num_nonzeros, (int32 *)flags + n, sizeof(int32));
+
+  num_nonzeros_ = num_nonzeros;
+  col_indices_ = (int32 *)allocate(sizeof(int32) * num_nonzeros_);
+  values_ = allocate(value_size_ * num_nonzeros_);
+  run_pass(typed("assemble"),
+           {keys, sorted_cols, perm, staged_values.get(), flags, col_indices_,
+            values_, row_offsets_},
+           n, 0, num_rows_);
+  program_->synchronize();
+  deallocate(perm);
+  deallocate(keys);
+  deallocate(sorted_cols);
+  deallocate(flags);
+}
+
+void SparseMatrix::spmv(void *x, void *y, bool on_device) {
+  StagedArray staged_x(program_, x, value_size_ * num_cols_, on_device,
+                       /*read_only=*/true);
+  StagedArray staged_y(program_, y, value_size_ * num_rows_, on_device);
+  program_->synchronize();
+  run_pass(typed("spmv"),
+           {row_offsets_, col_indices_, values_, staged_x.get(),
+            staged_y.get()},
+           num_rows_);
+  program_->synchronize();
+}
+
+int SparseMatrix::solve_cg(void *b,
+                           void *x,
+                           float64 tolerance,
+                           int max_iterations,
+                           bool on_device) {
+  TI_ERROR_IF(num_rows_ != num_cols_,
+              "CG needs a square matrix, not ({}, {})", num_rows_, num_cols_);
+  TI_ERROR_IF(max_iterations < 0, "Invalid max_iterations {}",
+              max_iterations);
+  const int n = num_rows_;
+  StagedArray staged_b(program_, b, value_size_ * n, on_device,
+                       /*read_only=*/true);
+  StagedArray staged_x(program_, x, value_size_ * n, on_device);
+  program_->synchronize();
+
+  // |b|^2, tolerance^2, and r.z, p.q and |r|^2 of each iteration.
+  const std::size_t num_scalars = 2 + 3 * ((std::size_t)max_iterations + 1);
+  std::vector<float64> scalars(num_scalars, 0);
+  scalars[1] = tolerance * tolerance;
+  auto *device_scalars = allocate(value_size_ * num_scalars);
+  // Reads the scalars [begin, begin + count) of the device.
+  auto read_scalars = [&](std::size_t begin, std::size_t count) {
+    auto *src = (char *)device_scalars + value_size_ * begin;
+    if (dt_ == PrimitiveType::f64) {
+      memcpy_to_host(&scalars[begin], src, sizeof(float64) * count);
+    } else {
+      std::vector<float32> values(count);
+      memcpy_to_host(values.data(), src, sizeof(float32) * count);
+      std::copy(values.begin(), values.end(), scalars.begin() + begin);
+    }
+  };
+  if (dt_ == PrimitiveType::f64) {
+    memcpy_to_device(device_scalars, scalars.data(),
+                     sizeof(float64) * num_scalars);
+  } else {
+    std::vector<float32> values(scalars.begin(), scalars.end());
+    memcpy_to_device(device_scalars, values.data(),
+                     sizeof(float32) * num_scalars);
+  }
+  // r, z, p, A p and the inverse diagonal.
+  auto *work = allocate(value_size_ * n * 5);
+  const std::vector<void *> ptrs{row_offsets_,    col_indices_,
+                                 values_,         staged_b.get(),
+                                 staged_x.get(),  work,
+                                 device_scalars};
+  auto rr_index = [&](int k) { return 2 + 2 * (max_iterations + 1) + k; };
+  auto converged = [&](int k) {
+    return scalars[rr_index(k)] <= scalars[1] * scalars[0];
+  };
+
+  run_pass(typed("cg_init"), ptrs, n, 0, max_iterations);
+  const int check_interval =
+      program_->config.arch == Arch::cuda ? kCUDACGCheckInterval : 1;
+  int k = 0;
+  while (k < max_iterations) {
+    run_pass(typed("cg_spmv"), ptrs, n, k, max_iterations);
+    run_pass(typed("cg_update"), ptrs, n, k, max_iterations);
+    run_pass(typed("cg_direction"), ptrs, n, k, max_iterations);
+    k++;
+    if (k % check_interval == 0) {
+      read_scalars(0, 1);
+      read_scalars(rr_index(k), 1);
+      if (converged(k))
+        break;
+    }
+  }
+  program_->synchronize();
+  read_scalars(0, num_scalars);
+  // The tolerance as the device rounded it.
+  scalars[1] = tolerance * tolerance;
+  deallocate(work);
+  deallocate(device_scalars);
+  for (int i = 0; i <= k; i++) {
+    if (converged(i))
+      return i;
+  }
+  return k;
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "taichi/lang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Program;
+
+// A sparse matrix of f32 or f64 in the compressed sparse row (CSR) format, in
+// the memory of the device of a Program on the LLVM backends (CPU and CUDA).
+// The passes are the runtime_sparse_* functions of the LLVM runtime, chained
+// by the host like those of ParallelPrimitives. See
+// python/taichi/lang/sparse_matrix.py for the wrapper taking fields and
+// external arrays.
+//
+// The arrays are given by address, as for ParallelPrimitives, with the
+// values and vectors of the type of the matrix. All the functions return
+// after the results are written.
+class SparseMatrix {
+ public:
+  SparseMatrix(Program *program, int num_rows, int num_cols, DataType dt);
+
+  ~SparseMatrix();
+
+  int get_num_rows() const {
+    return num_rows_;
+  }
+
+  int get_num_cols() const {
+    return num_cols_;
+  }
+
+  int get_num_nonzeros() const {
+    return num_nonzeros_;
+  }
+
+  // Replaces the entries with the sums of the |n| triplets (rows[i], cols[i],
+  // values[i]) at each position. |rows| and |cols| are i32 and must be in
+  // range.
+  void build_from_triplets(void *rows,
+                           void *cols,
+                           void *values,
+                           int n,
+                           bool on_device);
+
+  // y = A x.
+  void spmv(void *x, void *y, bool on_device);
+
+  // Solves A x = b for a symmetric positive-definite A with the conjugate
+  // gradient method, preconditioned with the inverse diagonal of A, starting
+  // from the given x. Stops once |b - A x| <= |tolerance| |b|, or after
+  // |max_iterations|. Returns the number of iterations run.
+  int solve_cg(void *b,
+               void *x,
+               float64 tolerance,
+               int max_iterations,
+               bool on_device);
+
+ private:
+  void *allocate(std::size_t size);
+
+  void deallocate(void *ptr);
+
+  void memcpy_to_device(void *dst, const void *src, std::size_t size);
+
+  void memcpy_to_host(void *dst, const void *src, std::size_t size);
+
+  // Runs pass runtime_sparse_|name| over |n| elements.
+  void run_pass(const std::string &name,
+                const std::vector<void *> &ptrs,
+                int n,
+                int k = 0,
+                int m = 0);
+
+  std::string typed(const std::string &name) const;
+
+  Program *program_;
+  int num_rows_;
+  int num_cols_;
+  int num_nonzeros_{0};
+  DataType dt_;
+  std::size_t value_size_;
+  // num_rows_ + 1 i32s.
+  int32 *row_offsets_{nullptr};
+  int32 *col_indices_{nullptr};
+  void *values_{nullptr};
+};
+
+TLANG_NAMESPACE_END
@@ -1,9 +1,11 @@
 #include "taichi/program/state_flow_graph.h"
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <set>
 #include <sstream>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "taichi/ir/analysis.h"
@@ -110,6 +112,17 @@ void StateToNodesMap::remove_node(const Node *n) {
   data_.resize(cur);
 }
 
+void StateToNodesMap::retain_nodes(const std::unordered_set<Node *> &nodes) {
+  // The order of the edges is preserved, whether |data_| is sorted or not.
+  int cur = 0;
+  for (int i = 0; i < data_.size(); ++i) {
+    if (nodes.count(data_[i].second) > 0) {
+      data_[cur++] = data_[i];
+    }
+  }
+  data_.resize(cur);
+}
+
 bool StateToNodesMap::replace_node_in_edge(const AsyncState &as,
                                            Node *old_nd,
                                            Node *new_nd) {
@@ -204,13 +217,44 @@ void StateFlowGraph::Node::disconnect_with(StateFlowGraph::Node *other) {
   input_edges.remove_node(other);
 }
 
+void StateFlowGraph::Node::reset() {
+  rec = TaskLaunchRecord();
+  meta = nullptr;
+  is_initial_node = false;
+  node_id = 0;
+  pending_node_id = 0;
+  input_edges.clear();
+  output_edges.clear();
+}
+
+StateFlowGraph::Node *StateFlowGraph::NodeArena::allocate() {
+  if (num_allocated_ == nodes_.size()) {
+    nodes_.push_back(std::make_unique<Node>());
+  }
+  return nodes_[num_allocated_++].get();
+}
+
+void StateFlowGraph::NodeArena::recycle(const std::vector<Node *> &kept) {
+  TI_AUTO_PROF;
+  std::unordered_set<Node *> kept_set(kept.begin(), kept.end());
+  // Moves the kept nodes to the front, without moving any Node itself.
+  auto end = std::stable_partition(
+      nodes_.begin(), nodes_.begin() + num_allocated_,
+      [&](const std::unique_ptr<Node> &n) { return kept_set.count(n.get()); });
+  TI_ASSERT(std::size_t(end - nodes_.begin()) == kept.size());
+  for (auto it = end; it != nodes_.begin() + num_allocated_; ++it) {
+    (*it)->reset();
+  }
+  num_allocated_ = kept.size();
+}
+
 StateFlowGraph::StateFlowGraph(AsyncEngine *engine, IRBank *ir_bank)
     : first_pending_task_index_(1 /*after initial node*/),
       ir_bank_(ir_bank),
       engine_(engine),
       program_(engine->program) {
-  nodes_.push_back(std::make_unique<Node>());
-  initial_node_ = nodes_.back().get();
+  initial_node_ = node_arena_.allocate();
+  nodes_.push_back(initial_node_);
   initial_meta_.name = "initial_state";
   initial_node_->meta = &initial_meta_;
   initial_node_->is_initial_node = true;
@@ -220,6 +264,8 @@ StateFlowGraph::StateFlowGraph(AsyncEngine *engine, IRBank *ir_bank)
   for (auto snode : program_->snodes) {
     list_up_to_date_[snode.second] = false;
   }
+  fusion_cost_model_ = std::make_unique<StatementCountFusionCostModel>(
+      program_->config.async_fusion_max_statements);
 }
 
 std::vector<StateFlowGraph::Node *> StateFlowGraph::get_pending_tasks() const {
@@ -235,27 +281,61 @@ std::vector<StateFlowGraph::Node *> StateFlowGraph::get_pending_tasks(
   pending_tasks.reserve(end - begin);
   for (int i = first_pending_task_index_ + begin;
        i < first_pending_task_index_ + end; i++) {
-    pending_tasks.push_back(nodes_[i].get());
+    pending_tasks.push_back(nodes_[i]);
   }
   return pending_tasks;
 }
 
-std::vector<std::unique_ptr<StateFlowGraph::Node>>
-StateFlowGraph::extract_pending_tasks() {
-  std::vector<std::unique_ptr<Node>> pending_tasks;
+std::vector<StateFlowGraph::Node *> StateFlowGraph::extract_pending_tasks() {
+  std::vector<Node *> pending_tasks;
   TI_ASSERT(nodes_.size() >= first_pending_task_index_);
   pending_tasks.reserve(nodes_.size() - first_pending_task_index_);
   for (int i = first_pending_task_index_; i < (int)nodes_.size(); i++) {
-    pending_tasks.emplace_back(std::move(nodes_[i]));
+    pending_tasks.push_back(nodes_[i]);
   }
   nodes_.resize(first_pending_task_index_);
   return pending_tasks;
 }
 
+void StateFlowGraph::replace_pending_tasks(
+    const std::vector<TaskLaunchRecord> &records) {
+  TI_AUTO_PROF;
+  std::unordered_set<int> indices_to_delete;
+  for (int i = first_pending_task_index_; i < (int)nodes_.size(); i++) {
+    indices_to_delete.insert(i);
+  }
+  delete_nodes(indices_to_delete);
+  rebuild_graph(/*sort=*/false);
+  insert_tasks(records, /*filter_listgen=*/false);
+  reid_nodes();
+  reid_pending_nodes();
+}
+
+uint64 StateFlowGraph::get_fingerprint() const {
+  TI_AUTO_PROF;
+  uint64 ret = 0;
+  auto combine = [&](uint64 h) { ret = ret * 100000007UL + h; };
+  for (int i = 1; i < (int)nodes_.size(); i++) {
+    const auto &rec = nodes_[i]->rec;
+    combine(rec.ir_handle.hash());
+    combine(i >= first_pending_task_index_);
+    if (i < first_pending_task_index_ || rec.empty())
+      continue;
+    for (int j = 0; j < (int)rec.kernel->args.size(); j++) {
+      combine(rec.context.args[j]);
+      for (int k = 0; k < taichi_max_num_indices; k++) {
+        combine((uint64)rec.context.extra_args[j][k]);
+      }
+    }
+  }
+  return ret;
+}
+
 void StateFlowGraph::clear() {
   // TODO: GC here?
   nodes_.resize(1);  // Erase all nodes except the initial one
   initial_node_->output_edges.clear();
+  node_arena_.recycle(nodes_);
   std::fill(latest_state_owner_.begin(), latest_state_owner_.end(),
             initial_node_);
   latest_state_readers_.clear();
@@ -265,18 +345,36 @@ void StateFlowGraph::clear() {
 }
 
 void StateFlowGraph::mark_pending_tasks_as_executed() {
-  std::vector<std::unique_ptr<Node>> new_nodes;
-  std::unordered_set<Node *> state_owners;
+  TI_AUTO_PROF;
+  std::vector<Node *> new_nodes;
+  std::unordered_set<Node *> kept_nodes;
   for (auto owner : latest_state_owner_) {
-    state_owners.insert(state_owners.end(), owner);
+    kept_nodes.insert(kept_nodes.end(), owner);
   }
-  for (auto &node : nodes_) {
-    if (node->is_initial_node || state_owners.count(node.get()) > 0) {
+  kept_nodes.insert(initial_node_);
+  for (auto *node : nodes_) {
+    if (kept_nodes.count(node) > 0) {
       node->mark_executed();
-      new_nodes.push_back(std::move(node));
+      new_nodes.push_back(node);
     }
   }
   nodes_ = std::move(new_nodes);
+  // Nothing may point to the dropped nodes once they are recycled.
+  for (auto *node : nodes_) {
+    node->input_edges.retain_nodes(kept_nodes);
+    node->output_edges.retain_nodes(kept_nodes);
+  }
+  for (auto &s : latest_state_readers_) {
+    std::vector<Node *> dropped_readers;
+    for (auto *reader : s.second) {
+      if (kept_nodes.count(reader) == 0)
+        dropped_readers.push_back(reader);
+    }
+    for (auto *reader : dropped_readers) {
+      s.second.erase(reader);
+    }
+  }
+  node_arena_.recycle(nodes_);
   first_pending_task_index_ = nodes_.size();
   reid_nodes();
 }
@@ -333,40 +431,40 @@ void StateFlowGraph::insert_tasks(const std::vector<TaskLaunchRecord> &records,
     filtered_records = records;
   }
   for (const auto &rec : filtered_records) {
-    auto node = std::make_unique<Node>();
+    auto *node = node_arena_.allocate();
     node->rec = rec;
     node->meta = get_task_meta(ir_bank_, rec);
-    insert_node(std::move(node));
+    insert_node(node);
   }
 }
 
-void StateFlowGraph::insert_node(std::unique_ptr<StateFlowGraph::Node> &&node) {
+void StateFlowGraph::insert_node(StateFlowGraph::Node *node) {
   for (auto input_state : node->meta->input_states) {
-    insert_edge(latest_state_owner_[input_state.unique_id], node.get(),
+    insert_edge(latest_state_owner_[input_state.unique_id], node,
                 input_state);
   }
   for (auto output_state : node->meta->output_states) {
     if (get_or_insert(latest_state_readers_, output_state).empty()) {
       if (latest_state_owner_[output_state.unique_id] != initial_node_) {
         // insert a WAW dependency edge
-        insert_edge(latest_state_owner_[output_state.unique_id], node.get(),
+        insert_edge(latest_state_owner_[output_state.unique_id], node,
                     output_state);
       } else {
         insert(latest_state_readers_, output_state, initial_node_);
       }
     }
-    latest_state_owner_[output_state.unique_id] = node.get();
+    latest_state_owner_[output_state.unique_id] = node;
     for (auto *d : get_or_insert(latest_state_readers_, output_state)) {
       // insert a WAR dependency edge
-      insert_edge(d, node.get(), output_state);
+      insert_edge(d, node, output_state);
     }
     get_or_insert(latest_state_readers_, output_state).clear();
   }
   // Note that this loop must happen AFTER the previous one
   for (auto input_state : node->meta->input_states) {
-    insert(latest_state_readers_, input_state, node.get());
+    insert(latest_state_readers_, input_state, node);
   }
-  nodes_.push_back(std::move(node));
+  nodes_.push_back(node);
 }
 
 void StateFlowGraph::insert_edge(Node *from, Node *to, AsyncState state) {
@@ -387,7 +485,7 @@ bool StateFlowGraph::optimize_listgen() {
   std::unordered_map<SNode *, std::vector<Node *>> listgen_nodes;
 
   for (int i = 1; i < nodes_.size(); i++) {
-    auto node = nodes_[i].get();
+    auto node = nodes_[i];
     if (node->meta->type == OffloadedStmt::TaskType::listgen)
       listgen_nodes[node->meta->snode].push_back(node);
   }
@@ -549,16 +647,13 @@ std::unordered_set<int> StateFlowGraph::fuse_range(int begin, int end) {
   std::vector<Bitset> has_path, has_path_reverse;
   std::tie(has_path, has_path_reverse) = compute_transitive_closure(begin, end);
 
-  // Classify tasks by TaskFusionMeta.
+  // Classify tasks by TaskFusionMeta. Two fused tasks have the same
+  // TaskFusionMeta, which the fused task inherits.
   std::vector<TaskFusionMeta> fusion_meta(n);
   // It seems that std::set is slightly faster than std::unordered_set here.
   std::unordered_map<TaskFusionMeta, std::set<int>> task_fusion_map;
   for (int i = 0; i < n; i++) {
     fusion_meta[i] = get_task_fusion_meta(ir_bank_, nodes[i]->rec);
-    if (fusion_meta[i].fusible) {
-      auto &fusion_set = task_fusion_map[fusion_meta[i]];
-      fusion_set.insert(fusion_set.end(), i);
-    }
   }
 
   std::unordered_set<int> indices_to_delete;
@@ -576,6 +671,24 @@ std::unordered_set<int> StateFlowGraph::fuse_range(int begin, int end) {
   };
 
   auto fused = std::vector<bool>(n);
+  // The tasks not fused into others yet. A path through a fused task b goes
+  // through the task b was fused into as well, so only the paths through
+  // |alive| tasks matter.
+  Bitset alive(n);
+
+  // The pairs rejected by the cost model, which is not asked again.
+  std::set<std::pair<int, int>> rejected;
+  auto profitable = [&](int a, int b) {
+    if (rejected.count(std::make_pair(a, b)))
+      return false;
+    if (fusion_cost_model_->should_fuse(nodes[a]->rec, nodes[b]->rec)) {
+      stat.add("sfg_fusions_accepted", 1.0);
+      return true;
+    }
+    stat.add("sfg_fusions_rejected", 1.0);
+    rejected.emplace(a, b);
+    return false;
+  };
 
   auto do_fuse = [&](int a, int b) {
     TI_PROFILER("do_fuse");
@@ -589,6 +702,8 @@ std::unordered_set<int> StateFlowGraph::fuse_range(int begin, int end) {
     rec_a.ir_handle =
         ir_bank_->fuse(rec_a.ir_handle, rec_b.ir_handle, rec_a.kernel);
     rec_b.ir_handle = IRHandle();
+    // Later rounds check the loop-unique accesses of the fused task.
+    node_a->meta = get_task_meta(ir_bank_, rec_a);
 
     // Convert to the index in nodes_.
     indices_to_delete.insert(b + begin + first_pending_task_index_);
@@ -606,6 +721,7 @@ std::unordered_set<int> StateFlowGraph::fuse_range(int begin, int end) {
       insert_edge_for_transitive_closure(a, b);
 
     fused[b] = true;
+    alive[b] = false;
     task_fusion_map[fusion_meta[a]].erase(a);
     task_fusion_map[fusion_meta[b]].erase(b);
   };
@@ -668,90 +784,114 @@ std::unordered_set<int> StateFlowGraph::fuse_range(int begin, int end) {
     }
     // check if a doesn't have a path to b of length >= 2
     auto a_has_path_to_b = has_path[a] & has_path_reverse[b];
+    a_has_path_to_b &= alive;
     a_has_path_to_b[a] = a_has_path_to_b[b] = false;
     return a_has_path_to_b.none();
   };
 
   for (int i = 0; i < n; i++) {
     fused[i] = nodes[i]->rec.empty();
-  }
-  // The case without an edge: O(sum(size * min(size, n / 64))) = O(n^2 / 64)
-  const int kLargeFusionSetThreshold = std::max(n / 16, 16);
-  for (auto &fusion_map : task_fusion_map) {
-    std::vector<int> indices(fusion_map.second.begin(),
-                             fusion_map.second.end());
-    TI_ASSERT(std::is_sorted(indices.begin(), indices.end()));
-    if (indices.size() >= kLargeFusionSetThreshold) {
-      // O(size * n / 64)
-      Bitset mask(n);
-      for (int a : indices) {
-        mask[a] = !fused[a];
+    alive[i] = !fused[i];
+  }
+
+  // Each round fuses no more than one task into each task, so that the fused
+  // tasks grow as a balanced tree: fusing many tasks into one by one would
+  // make do_fuse() very slow. The transitive closure is kept up to date by
+  // do_fuse(), so that the rounds don't need to rebuild the graph.
+  auto fuse_round = [&]() {
+    std::size_t num_fused_before = indices_to_delete.size();
+    task_fusion_map.clear();
+    for (int i = 0; i < n; i++) {
+      if (!fused[i] && fusion_meta[i].fusible) {
+        auto &fusion_set = task_fusion_map[fusion_meta[i]];
+        fusion_set.insert(fusion_set.end(), i);
       }
-      for (int a : indices) {
-        if (!fused[a]) {
-          // Fuse no more than one task into task a,
-          // otherwise do_fuse may be very slow
-          Bitset current_mask = (mask & ~(has_path[a] | has_path_reverse[a]));
-          int b = current_mask.lower_bound(a + 1);
-          if (b == -1) {
-            mask[a] = false;  // a can't be fused in this iteration
-          } else {
-            do_fuse(a, b);
-            mask[a] = false;
-            mask[b] = false;
-          }
+    }
+    // The case without an edge: O(sum(size * min(size, n / 64))) = O(n^2 / 64)
+    const int kLargeFusionSetThreshold = std::max(n / 16, 16);
+    for (auto &fusion_map : task_fusion_map) {
+      std::vector<int> indices(fusion_map.second.begin(),
+                               fusion_map.second.end());
+      TI_ASSERT(std::is_sorted(indices.begin(), indices.end()));
+      if (indices.size() >= kLargeFusionSetThreshold) {
+        // O(size * n / 64)
+        Bitset mask(n);
+        for (int a : indices) {
+          mask[a] = !fused[a];
         }
-      }
-    } else if (indices.size() >= 2) {
-      // O(size^2)
-      std::vector<int> start_index(indices.size());
-      for (int i = 0; i < (int)indices.size(); i++) {
-        start_index[i] = i + 1;
-      }
-      while (true) {
-        bool done = true;
-        for (int i = 0; i < (int)indices.size(); i++) {
-          const int a = indices[i];
+        for (int a : indices) {
           if (!fused[a]) {
-            // Fuse no more than one task into task a in this iteration
-            for (int &j = start_index[i]; j < (int)indices.size(); j++) {
-              const int b = indices[j];
-              if (!fused[b] && !has_path[a][b] && !has_path[b][a]) {
-                do_fuse(a, b);
-                j++;
-                break;
-              }
+            // Fuse no more than one task into task a,
+            // otherwise do_fuse may be very slow
+            Bitset current_mask = (mask & ~(has_path[a] | has_path_reverse[a]));
+            int b = current_mask.lower_bound(a + 1);
+            while (b != -1 && !profitable(a, b)) {
+              b = current_mask.lower_bound(b + 1);
             }
-            if (start_index[i] != indices.size()) {
-              done = false;
+            if (b == -1) {
+              mask[a] = false;  // a can't be fused in this iteration
+            } else {
+              do_fuse(a, b);
+              mask[a] = false;
+              mask[b] = false;
             }
           }
         }
-        if (done) {
-          break;
+      } else if (indices.size() >= 2) {
+        // O(size^2)
+        std::vector<int> start_index(indices.size());
+        for (int i = 0; i < (int)indices.size(); i++) {
+          start_index[i] = i + 1;
+        }
+        while (true) {
+          bool done = true;
+          for (int i = 0; i < (int)indices.size(); i++) {
+            const int a = indices[i];
+            if (!fused[a]) {
+              // Fuse no more than one task into task a in this iteration
+              for (int &j = start_index[i]; j < (int)indices.size(); j++) {
+                const int b = indices[j];
+                if (!fused[b] && !has_path[a][b] && !has_path[b][a] &&
+                    profitable(a, b)) {
+                  do_fuse(a, b);
+                  j++;
+                  break;
+                }
+              }
+              if (start_index[i] != indices.size()) {
+                done = false;
+              }
+            }
+          }
+          if (done) {
+            break;
+          }
         }
       }
     }
-  }
-  // The case with an edge: O(nm / 64)
-  for (int i = 0; i < n; i++) {
-    if (!fused[i]) {
-      // Fuse no more than one task into task i
-      bool i_updated = false;
-      for (auto &edge : nodes[i]->output_edges.get_all_edges()) {
-        const int j = edge.second->pending_node_id - begin;
-        if (j != -1 && edge_fusible(i, j)) {
-          do_fuse(i, j);
-          // Iterators of nodes[i]->output_edges may be invalidated
-          i_updated = true;
-          break;
-        }
+    // The case with an edge: O(nm / 64)
+    for (int i = 0; i < n; i++) {
+      if (!fused[i]) {
+        // Fuse no more than one task into task i
+        bool i_updated = false;
+        for (auto &edge : nodes[i]->output_edges.get_all_edges()) {
+          const int j = edge.second->pending_node_id - begin;
+          if (j != -1 && edge_fusible(i, j) && profitable(i, j)) {
+            do_fuse(i, j);
+            // Iterators of nodes[i]->output_edges may be invalidated
+            i_updated = true;
+            break;
+          }
 
-        if (i_updated) {
-          break;
+          if (i_updated) {
+            break;
+          }
         }
       }
     }
+    return indices_to_delete.size() > num_fused_before;
+  };
+  while (fuse_round()) {
   }
 
   return indices_to_delete;
@@ -759,30 +899,9 @@ std::unordered_set<int> StateFlowGraph::fuse_range(int begin, int end) {
 
 bool StateFlowGraph::fuse() {
   TI_AUTO_PROF;
-  using bit::Bitset;
-  // Only guarantee to fuse tasks with indices in nodes_ differ by less than
-  // kMaxFusionDistance if there are too many tasks.
-  const int kMaxFusionDistance = 512;
-
-  // Invoke fuse_range() <= floor(num_pending_tasks() / kMaxFusionDistance)
-  // times with (end - begin) <= 2 * kMaxFusionDistance.
-  std::unordered_set<int> indices_to_delete;
-  const int n = num_pending_tasks();
-  if (true) {
-    indices_to_delete = fuse_range(0, n);
-  } else {
-    // TODO: fuse by range
-    for (int i = 0; i < n; i += kMaxFusionDistance * 2) {
-      auto indices = fuse_range(i, std::min(n, i + kMaxFusionDistance * 2));
-      indices_to_delete.insert(indices.begin(), indices.end());
-    }
-    if (indices_to_delete.empty()) {
-      for (int i = kMaxFusionDistance; i < n; i += kMaxFusionDistance * 2) {
-        auto indices = fuse_range(i, std::min(n, i + kMaxFusionDistance * 2));
-        indices_to_delete.insert(indices.begin(), indices.end());
-      }
-    }
-  }
+  // fuse_range() keeps fusing until it reaches a fixed point, so the graph is
+  // rebuilt only once.
+  auto indices_to_delete = fuse_range(0, num_pending_tasks());
 
   bool modified = !indices_to_delete.empty();
   // TODO: Do we need a trash bin here?
@@ -820,14 +939,35 @@ void StateFlowGraph::rebuild_graph(bool sort) {
   reid_pending_nodes();
 }
 
-std::vector<TaskLaunchRecord> StateFlowGraph::extract_to_execute() {
+std::vector<TaskLaunchRecord> StateFlowGraph::extract_to_execute(
+    std::vector<std::vector<int>> *task_dependencies) {
   TI_AUTO_PROF;
   auto nodes = get_pending_tasks();
   std::vector<TaskLaunchRecord> tasks;
   tasks.reserve(nodes.size());
+  // Nodes with an empty record are not executed, so their dependencies are
+  // forwarded to their dependents.
+  std::unordered_map<const Node *, std::vector<int>> node_to_task_ids;
   for (auto &node : nodes) {
+    std::vector<int> deps;
+    if (task_dependencies) {
+      for (auto &edge : node->input_edges.get_all_edges()) {
+        auto iter = node_to_task_ids.find(edge.second);
+        if (iter != node_to_task_ids.end()) {
+          deps.insert(deps.end(), iter->second.begin(), iter->second.end());
+        }
+      }
+      std::sort(deps.begin(), deps.end());
+      deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+    }
     if (!node->rec.empty()) {
+      if (task_dependencies) {
+        node_to_task_ids[node] = {(int)tasks.size()};
+        task_dependencies->push_back(std::move(deps));
+      }
       tasks.push_back(node->rec);
+    } else if (task_dependencies) {
+      node_to_task_ids[node] = std::move(deps);
     }
   }
   mark_pending_tasks_as_executed();
@@ -922,7 +1062,7 @@ std::string StateFlowGraph::dump_dot(const std::optional<std::string> &rankdir,
 
   std::vector<const SFGNode *> nodes_with_no_inputs;
   for (auto &nd : nodes_) {
-    const auto *n = nd.get();
+    const auto *n = nd;
 
     std::stringstream labels;
     // No states embedded.
@@ -931,7 +1071,7 @@ std::string StateFlowGraph::dump_dot(const std::optional<std::string> &rankdir,
       labels << fmt::format("\\nhash: 0x{:08x}", n->rec.ir_handle.hash());
     }
 
-    if (node_selected(nd.get())) {
+    if (node_selected(nd)) {
       std::string color;
       if (highlight_single_state)
         color = " style=filled fillcolor=red ";
@@ -956,7 +1096,7 @@ std::string StateFlowGraph::dump_dot(const std::optional<std::string> &rankdir,
   }
   ss << "\n";
   for (const auto &n : nodes_) {
-    auto *from = n.get();
+    auto *from = n;
     for (const auto &edge : from->output_edges.get_all_edges()) {
       const auto *to = edge.second;
       const bool states_embedded = (nodes_with_embedded_states.find(from) !=
@@ -1001,7 +1141,7 @@ void StateFlowGraph::topo_sort_nodes() {
   TI_AUTO_PROF
   // Only sort pending tasks.
   const auto previous_size = nodes_.size();
-  std::deque<std::unique_ptr<Node>> queue;
+  std::deque<Node *> queue;
   std::vector<int> degrees_in(num_pending_tasks());
 
   reid_pending_nodes();
@@ -1017,14 +1157,14 @@ void StateFlowGraph::topo_sort_nodes() {
     degrees_in[node->pending_node_id] = degree_in;
   }
 
-  for (auto &node : pending_tasks) {
+  for (auto *node : pending_tasks) {
     if (degrees_in[node->pending_node_id] == 0) {
-      queue.emplace_back(std::move(node));
+      queue.push_back(node);
     }
   }
 
   while (!queue.empty()) {
-    auto head = std::move(queue.front());
+    auto *head = queue.front();
     queue.pop_front();
 
     // Delete the node and update degrees_in
@@ -1035,11 +1175,11 @@ void StateFlowGraph::topo_sort_nodes() {
       TI_ASSERT_INFO(degrees_in[dest] >= 0, "dest={} degrees_in={}", dest,
                      degrees_in[dest]);
       if (degrees_in[dest] == 0) {
-        queue.push_back(std::move(pending_tasks[dest]));
+        queue.push_back(pending_tasks[dest]);
       }
     }
 
-    nodes_.emplace_back(std::move(head));
+    nodes_.push_back(head);
   }
 
   if (previous_size != nodes_.size()) {
@@ -1120,18 +1260,19 @@ void StateFlowGraph::replace_reference(StateFlowGraph::Node *node_a,
 void StateFlowGraph::delete_nodes(
     const std::unordered_set<int> &indices_to_delete) {
   TI_AUTO_PROF
-  std::vector<std::unique_ptr<Node>> new_nodes_;
+  // The deleted nodes stay in |node_arena_| until they are recycled.
+  std::vector<Node *> new_nodes_;
   std::unordered_set<Node *> nodes_to_delete;
 
   for (auto &i : indices_to_delete) {
     TI_ASSERT(nodes_[i]->pending());
     nodes_[i]->disconnect_all();
-    nodes_to_delete.insert(nodes_[i].get());
+    nodes_to_delete.insert(nodes_[i]);
   }
 
   for (int i = 0; i < (int)nodes_.size(); i++) {
     if (indices_to_delete.find(i) == indices_to_delete.end()) {
-      new_nodes_.push_back(std::move(nodes_[i]));
+      new_nodes_.push_back(nodes_[i]);
     } else {
       TI_DEBUG("Deleting node {}", i);
     }
@@ -1231,6 +1372,50 @@ bool StateFlowGraph::optimize_dead_store() {
   }
 
   std::unordered_set<int> to_delete;
+  // Erase the idempotent tasks that rerun an earlier task with the same
+  // arguments, e.g. repeated fills, when none of their states are written in
+  // between. The nodes are in topological order.
+  std::unordered_map<std::size_t, int> last_writers;  // state id -> node id
+  auto get_last_writer = [&](const AsyncState &s) {
+    auto iter = last_writers.find(s.unique_id);
+    return iter == last_writers.end() ? 0 : iter->second;
+  };
+  auto same_launch = [](const TaskLaunchRecord &a, const TaskLaunchRecord &b) {
+    return a.ir_handle == b.ir_handle && a.kernel == b.kernel &&
+           std::equal(a.context.args,
+                      a.context.args + a.kernel->args.size(),
+                      b.context.args) &&
+           std::memcmp(a.context.extra_args, b.context.extra_args,
+                       Context::extra_args_size) == 0;
+  };
+  for (int i = 1; i < (int)nodes_.size(); i++) {
+    auto *node = nodes_[i];
+    if (node->rec.empty())
+      continue;
+    const auto &meta = *node->meta;
+    if (node->pending() && meta.idempotent && !meta.output_states.empty()) {
+      const int writer = get_last_writer(*meta.output_states.begin());
+      bool redundant =
+          writer != 0 && same_launch(nodes_[writer]->rec, node->rec);
+      for (auto &s : meta.output_states) {
+        redundant = redundant && get_last_writer(s) == writer;
+      }
+      for (auto &s : meta.input_states) {
+        redundant = redundant && get_last_writer(s) < writer;
+      }
+      if (redundant) {
+        TI_TRACE("SFG: {} reruns {}", node->string(),
+                 nodes_[writer]->string());
+        stat.add("sfg_redundant_tasks", 1.0);
+        to_delete.insert(i);
+        continue;
+      }
+    }
+    for (auto &s : meta.output_states) {
+      last_writers[s.unique_id] = i;
+    }
+  }
+
   // erase empty blocks
   for (int i = 0; i < (int)nodes.size(); i++) {
     auto &meta = *nodes[i]->meta;
@@ -1265,7 +1450,7 @@ void StateFlowGraph::verify(bool also_verify_ir) const {
   }
   TI_ASSERT_INFO(nodes_[0]->is_initial_node,
                  "nodes_[0] is not the initial node");
-  TI_ASSERT_INFO(nodes_[0].get() == initial_node_,
+  TI_ASSERT_INFO(nodes_[0] == initial_node_,
                  "initial_node_ is not nodes_[0]");
   TI_ASSERT(first_pending_task_index_ <= n);
   for (int i = 0; i < first_pending_task_index_; i++) {
@@ -1294,14 +1479,14 @@ void StateFlowGraph::verify(bool also_verify_ir) const {
       TI_ASSERT_INFO(dest >= 0 && dest < n,
                      "nodes_[{}]({}) has an output edge to nodes_[{}]", i,
                      nodes_[i]->string(), dest);
-      TI_ASSERT_INFO(nodes_[dest].get() == node,
+      TI_ASSERT_INFO(nodes_[dest] == node,
                      "nodes_[{}]({}) has an output edge to {}, "
                      "which is outside nodes_",
                      i, nodes_[i]->string(), node->string());
       TI_ASSERT_INFO(dest != i, "nodes_[{}]({}) has an output edge to itself",
                      i, nodes_[i]->string());
       TI_ASSERT_INFO(
-          nodes_[dest]->input_edges.has_edge(edge.first, nodes_[i].get()),
+          nodes_[dest]->input_edges.has_edge(edge.first, nodes_[i]),
           "nodes_[{}]({}) has an output edge to nodes_[{}]({}), "
           "which doesn't corresponds to an input edge",
           i, nodes_[i]->string(), dest, nodes_[dest]->string());
@@ -1316,14 +1501,14 @@ void StateFlowGraph::verify(bool also_verify_ir) const {
       TI_ASSERT_INFO(dest >= 0 && dest < n,
                      "nodes_[{}]({}) has an input edge to nodes_[{}]", i,
                      nodes_[i]->string(), dest);
-      TI_ASSERT_INFO(nodes_[dest].get() == node,
+      TI_ASSERT_INFO(nodes_[dest] == node,
                      "nodes_[{}]({}) has an input edge to {}, "
                      "which is outside nodes_",
                      i, nodes_[i]->string(), node->string());
       TI_ASSERT_INFO(dest != i, "nodes_[{}]({}) has an input edge to itself", i,
                      nodes_[i]->string());
       TI_ASSERT_INFO(
-          nodes_[dest]->output_edges.has_edge(edge.first, nodes_[i].get()),
+          nodes_[dest]->output_edges.has_edge(edge.first, nodes_[i]),
           "nodes_[{}]({}) has an input edge to nodes_[{}]({}), "
           "which doesn't corresponds to an output edge",
           i, nodes_[i]->string(), dest, nodes_[dest]->string());
@@ -1367,7 +1552,7 @@ bool StateFlowGraph::demote_activation() {
 
   // Gather identical struct-for tasks that use the same lists
   for (int i = 1; i < (int)nodes_.size(); i++) {
-    Node *node = nodes_[i].get();
+    Node *node = nodes_[i];
     auto snode = node->meta->snode;
     auto list_state = get_async_state(snode, AsyncState::Type::list);
 
@@ -51,6 +51,8 @@ class StateFlowGraph {
     void insert_edge(const AsyncState &as, Node *n);
     // Removes all occurrences of Node |n|
     void remove_node(const Node *n);
+    // Removes the edges to the nodes not in |nodes|.
+    void retain_nodes(const std::unordered_set<Node *> &nodes);
 
     // The two methods below are dedicated for fusion.
     // If edge(as, old_nd) exists, then replaces |old_nd| with |new_nd| and
@@ -210,6 +212,31 @@ class StateFlowGraph {
     void disconnect_all();
 
     void disconnect_with(Node *other);
+
+    // Resets the node to its default state, keeping the storage of its edges.
+    void reset();
+  };
+
+  // Owns the nodes of the graph. Nodes are never freed one by one: the ones
+  // dropped from the graph are recycled all at once with recycle(), when the
+  // graph no longer points to them, and are then allocated again with the
+  // storage of their edges. See #1927 for the cost of allocating edges.
+  class NodeArena {
+   public:
+    // Returns a node in its default state.
+    Node *allocate();
+
+    // Recycles all the allocated nodes except |kept|.
+    void recycle(const std::vector<Node *> &kept);
+
+    std::size_t num_allocated() const {
+      return num_allocated_;
+    }
+
+   private:
+    // |nodes_[0, num_allocated_)| are allocated, the rest are recycled.
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::size_t num_allocated_{0};
   };
 
   StateFlowGraph(AsyncEngine *engine, IRBank *ir_bank);
@@ -219,7 +246,17 @@ class StateFlowGraph {
   // Returns get_pending_tasks()[begin, end).
   std::vector<Node *> get_pending_tasks(int begin, int end) const;
 
-  std::vector<std::unique_ptr<Node>> extract_pending_tasks();
+  // The extracted nodes are still owned by the graph, until they are inserted
+  // again or recycled.
+  std::vector<Node *> extract_pending_tasks();
+
+  // Replaces the pending tasks with |records|, e.g. an optimized schedule of
+  // them.
+  void replace_pending_tasks(const std::vector<TaskLaunchRecord> &records);
+
+  // Hashes what the optimizations depend on: the IR of the executed state
+  // owners, and the IR and the arguments of the pending tasks, in order.
+  uint64 get_fingerprint() const;
 
   void clear();
 
@@ -241,7 +278,7 @@ class StateFlowGraph {
   void insert_tasks(const std::vector<TaskLaunchRecord> &rec,
                     bool filter_listgen);
 
-  void insert_node(std::unique_ptr<Node> &&node);
+  void insert_node(Node *node);
 
   void insert_edge(Node *from, Node *to, AsyncState state);
 
@@ -249,12 +286,17 @@ class StateFlowGraph {
   std::pair<std::vector<bit::Bitset>, std::vector<bit::Bitset>>
   compute_transitive_closure(int begin, int end);
 
-  // Fuse tasks in get_pending_tasks()[begin, end),
-  // return the indices to delete.
+  // Fuse tasks in get_pending_tasks()[begin, end) until no more tasks can be
+  // fused, return the indices to delete.
   std::unordered_set<int> fuse_range(int begin, int end);
 
   bool fuse();
 
+  // Replaces the model deciding whether two fusible tasks are fused.
+  void set_fusion_cost_model(std::unique_ptr<FusionCostModel> model) {
+    fusion_cost_model_ = std::move(model);
+  }
+
   bool optimize_listgen();
 
   bool demote_activation();
@@ -278,8 +320,11 @@ class StateFlowGraph {
   // Extract all pending tasks and insert them in topological/original order.
   void rebuild_graph(bool sort);
 
-  // Extract all tasks to execute.
-  std::vector<TaskLaunchRecord> extract_to_execute();
+  // Extract all tasks to execute. If |task_dependencies| is not null,
+  // (*task_dependencies)[i] is filled with the indices of the tasks that the
+  // i-th task depends on, which all precede it.
+  std::vector<TaskLaunchRecord> extract_to_execute(
+      std::vector<std::vector<int>> *task_dependencies = nullptr);
 
   std::size_t size() const {
     return nodes_.size();
@@ -303,7 +348,8 @@ class StateFlowGraph {
       llvm::SmallVector<std::pair<AsyncState, llvm::SmallSet<Node *, 8>>, 4>;
 
  private:
-  std::vector<std::unique_ptr<Node>> nodes_;
+  NodeArena node_arena_;
+  std::vector<Node *> nodes_;
   Node *initial_node_;  // The initial node holds all the initial states.
   int first_pending_task_index_;
   TaskMeta initial_meta_;
@@ -314,6 +360,7 @@ class StateFlowGraph {
   std::unordered_map<SNode *, bool> list_up_to_date_;
   [[maybe_unused]] AsyncEngine *engine_;
   Program *program_;
+  std::unique_ptr<FusionCostModel> fusion_cost_model_;
 };
 
 TLANG_NAMESPACE_END
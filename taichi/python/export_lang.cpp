@@ -11,6 +11,8 @@
 #include "taichi/ir/statements.h"
 #include "taichi/program/extension.h"
 #include "taichi/program/async_engine.h"
+#include "taichi/program/parallel_primitives.h"
+#include "taichi/program/sparse_matrix.h"
 #include "taichi/common/interface.h"
 #include "taichi/python/export.h"
 #include "taichi/gui/gui.h"
@@ -90,6 +92,8 @@ void export_lang(py::module &m) {
       .def("__hash__", &DataType::hash)
       .def("to_string", &DataType::to_string)
       .def("get_ptr", &DataType::get_ptr, py::return_value_policy::reference)
+      .def("get_compute_type",
+           [](const DataType &dt) { return DataType(dt->get_compute_type()); })
       .def(py::pickle(
           [](const DataType &dt) {
             // Note: this only works for primitive types, which is fine for now.
@@ -126,6 +130,12 @@ void export_lang(py::module &m) {
       .def_readwrite("print_kernel_llvm_ir_optimized",
                      &CompileConfig::print_kernel_llvm_ir_optimized)
       .def_readwrite("print_kernel_nvptx", &CompileConfig::print_kernel_nvptx)
+      .def_readwrite("print_vectorization_report",
+                     &CompileConfig::print_vectorization_report)
+      .def_readwrite("lock_free_activation",
+                     &CompileConfig::lock_free_activation)
+      .def_readwrite("quant_atomic_add_allow_overflow",
+                     &CompileConfig::quant_atomic_add_allow_overflow)
       .def_readwrite("simplify_before_lower_access",
                      &CompileConfig::simplify_before_lower_access)
       .def_readwrite("simplify_after_lower_access",
@@ -138,18 +148,91 @@ void export_lang(py::module &m) {
       .def_readwrite("saturating_grid_dim", &CompileConfig::saturating_grid_dim)
       .def_readwrite("max_block_dim", &CompileConfig::max_block_dim)
       .def_readwrite("cpu_max_num_threads", &CompileConfig::cpu_max_num_threads)
+      .def_readwrite("cpu_work_stealing", &CompileConfig::cpu_work_stealing)
+      .def_readwrite("cpu_thread_affinity",
+                     &CompileConfig::cpu_thread_affinity)
+      .def_readwrite("cpu_numa_first_touch",
+                     &CompileConfig::cpu_numa_first_touch)
+      .def_readwrite("cpu_huge_pages", &CompileConfig::cpu_huge_pages)
+      .def_readwrite("cpu_struct_for_prefetch_distance",
+                     &CompileConfig::cpu_struct_for_prefetch_distance)
+      .def_readwrite("cpu_async_launch", &CompileConfig::cpu_async_launch)
+      .def_readwrite("cpu_tile_shape", &CompileConfig::cpu_tile_shape)
+      .def_readwrite("cpu_vectorize", &CompileConfig::cpu_vectorize)
+      .def_readwrite("cpu_block_dim_by_cost",
+                     &CompileConfig::cpu_block_dim_by_cost)
+      .def_readwrite("cpu_max_tls_array_bytes",
+                     &CompileConfig::cpu_max_tls_array_bytes)
       .def_readwrite("verbose_kernel_launches",
                      &CompileConfig::verbose_kernel_launches)
       .def_readwrite("verbose", &CompileConfig::verbose)
       .def_readwrite("demote_dense_struct_fors",
                      &CompileConfig::demote_dense_struct_fors)
+      .def_readwrite("incremental_listgen",
+                     &CompileConfig::incremental_listgen)
+      .def_readwrite("skip_dense_listgen", &CompileConfig::skip_dense_listgen)
+      .def_readwrite("sync_activation_demotion",
+                     &CompileConfig::sync_activation_demotion)
       .def_readwrite("use_unified_memory", &CompileConfig::use_unified_memory)
       .def_readwrite("kernel_profiler", &CompileConfig::kernel_profiler)
+      .def_readwrite("kernel_profiler_sampling_interval",
+                     &CompileConfig::kernel_profiler_sampling_interval)
+      .def_readwrite("kernel_profiler_hardware_counters",
+                     &CompileConfig::kernel_profiler_hardware_counters)
+      .def_readwrite("kernel_profiler_peak_bandwidth",
+                     &CompileConfig::kernel_profiler_peak_bandwidth)
+      .def_readwrite("compile_profiler", &CompileConfig::compile_profiler)
+      .def_readwrite("verify_each_pass", &CompileConfig::verify_each_pass)
+      .def_readwrite("num_compile_threads",
+                     &CompileConfig::num_compile_threads)
+      .def_readwrite("lazy_runtime_linking",
+                     &CompileConfig::lazy_runtime_linking)
+      .def_readwrite("tiered_compilation", &CompileConfig::tiered_compilation)
+      .def_readwrite("deterministic_reduction",
+                     &CompileConfig::deterministic_reduction)
+      .def_readwrite("layout_advisor", &CompileConfig::layout_advisor)
+      .def_readwrite("layout_profile", &CompileConfig::layout_profile)
+      .def_readwrite("pgo_instrument", &CompileConfig::pgo_instrument)
+      .def_readwrite("pgo_profile", &CompileConfig::pgo_profile)
+      .def_readwrite("svd_intrinsic", &CompileConfig::svd_intrinsic)
+      .def_readwrite("loop_invariant_code_motion",
+                     &CompileConfig::loop_invariant_code_motion)
+      .def_readwrite("print_licm_report", &CompileConfig::print_licm_report)
+      .def_readwrite("coalesce_dense_struct_fors",
+                     &CompileConfig::coalesce_dense_struct_fors)
+      .def_readwrite("print_coalescing_report",
+                     &CompileConfig::print_coalescing_report)
+      .def_readwrite("tiered_compilation_threshold",
+                     &CompileConfig::tiered_compilation_threshold)
       .def_readwrite("default_fp", &CompileConfig::default_fp)
       .def_readwrite("default_ip", &CompileConfig::default_ip)
       .def_readwrite("device_memory_GB", &CompileConfig::device_memory_GB)
       .def_readwrite("device_memory_fraction",
                      &CompileConfig::device_memory_fraction)
+      .def_readwrite("use_virtual_device_memory",
+                     &CompileConfig::use_virtual_device_memory)
+      .def_readwrite("cuda_peer_memory", &CompileConfig::cuda_peer_memory)
+      .def_readwrite("cuda_philox_rand", &CompileConfig::cuda_philox_rand)
+      .def_readwrite("unified_memory_prefetch",
+                     &CompileConfig::unified_memory_prefetch)
+      .def_readwrite("unified_memory_stream_tile_MB",
+                     &CompileConfig::unified_memory_stream_tile_MB)
+      .def_readwrite("cuda_auto_tune_block_dim",
+                     &CompileConfig::cuda_auto_tune_block_dim)
+      .def_readwrite("cuda_auto_tune_num_launches",
+                     &CompileConfig::cuda_auto_tune_num_launches)
+      .def_readwrite("cuda_persistent_kernels",
+                     &CompileConfig::cuda_persistent_kernels)
+      .def_readwrite("cuda_max_registers", &CompileConfig::cuda_max_registers)
+      .def_readwrite("cuda_min_blocks_per_sm",
+                     &CompileConfig::cuda_min_blocks_per_sm)
+      .def_readwrite("cuda_max_bls_bytes", &CompileConfig::cuda_max_bls_bytes)
+      .def_readwrite("opengl_atomic_aggregation_slots",
+                     &CompileConfig::opengl_atomic_aggregation_slots)
+      .def_readwrite("opengl_subgroup_reductions",
+                     &CompileConfig::opengl_subgroup_reductions)
+      .def_readwrite("vulkan_launches_per_submit",
+                     &CompileConfig::vulkan_launches_per_submit)
       .def_readwrite("fast_math", &CompileConfig::fast_math)
       .def_readwrite("advanced_optimization",
                      &CompileConfig::advanced_optimization)
@@ -158,16 +241,45 @@ void export_lang(py::module &m) {
       .def_readwrite("flatten_if", &CompileConfig::flatten_if)
       .def_readwrite("make_thread_local", &CompileConfig::make_thread_local)
       .def_readwrite("make_block_local", &CompileConfig::make_block_local)
+      .def_readwrite("make_block_local_scatter",
+                     &CompileConfig::make_block_local_scatter)
+      .def_readwrite("horizontal_fusion_max_iterations",
+                     &CompileConfig::horizontal_fusion_max_iterations)
+      .def_readwrite("serial_fusion_max_statements",
+                     &CompileConfig::serial_fusion_max_statements)
+      .def_readwrite("unroll_max_statements",
+                     &CompileConfig::unroll_max_statements)
       .def_readwrite("detect_read_only", &CompileConfig::detect_read_only)
       .def_readwrite("cc_compile_cmd", &CompileConfig::cc_compile_cmd)
       .def_readwrite("cc_link_cmd", &CompileConfig::cc_link_cmd)
+      .def_readwrite("cc_libtcc", &CompileConfig::cc_libtcc)
+      .def_readwrite("cc_openmp", &CompileConfig::cc_openmp)
       .def_readwrite("async_opt_fusion", &CompileConfig::async_opt_fusion)
+      .def_readwrite("async_fusion_max_statements",
+                     &CompileConfig::async_fusion_max_statements)
       .def_readwrite("async_opt_listgen", &CompileConfig::async_opt_listgen)
       .def_readwrite("async_opt_activation_demotion",
                      &CompileConfig::async_opt_activation_demotion)
       .def_readwrite("async_opt_dse", &CompileConfig::async_opt_dse)
+      .def_readwrite("async_opt_reuse_schedules",
+                     &CompileConfig::async_opt_reuse_schedules)
+      .def_readwrite("async_speculative_compilation",
+                     &CompileConfig::async_speculative_compilation)
+      .def_readwrite("async_cuda_num_streams",
+                     &CompileConfig::async_cuda_num_streams)
+      .def_readwrite("async_flush_num_tasks",
+                     &CompileConfig::async_flush_num_tasks)
+      .def_readwrite("async_flush_cost", &CompileConfig::async_flush_cost)
       .def_readwrite("async_opt_intermediate_file",
-                     &CompileConfig::async_opt_intermediate_file);
+                     &CompileConfig::async_opt_intermediate_file)
+      .def_readwrite("offline_cache", &CompileConfig::offline_cache)
+      .def_readwrite("offline_cache_file_path",
+                     &CompileConfig::offline_cache_file_path)
+      .def_readwrite("cuda_cubin_cache", &CompileConfig::cuda_cubin_cache)
+      .def_readwrite("offline_cache_max_size_bytes",
+                     &CompileConfig::offline_cache_max_size_bytes)
+      .def_readwrite("aot_record", &CompileConfig::aot_record)
+      .def_readwrite("task_cache", &CompileConfig::task_cache);
 
   m.def("reset_default_compile_config",
         [&]() { default_compile_config = CompileConfig(); });
@@ -176,13 +288,79 @@ void export_lang(py::module &m) {
         [&]() -> CompileConfig & { return default_compile_config; },
         py::return_value_policy::reference);
 
+  py::class_<SNodeMemoryStats>(m, "SNodeMemoryStats")
+      .def_readonly("element_list_size", &SNodeMemoryStats::element_list_size)
+      .def_readonly("element_list_num_chunks",
+                    &SNodeMemoryStats::element_list_num_chunks)
+      .def_readonly("element_list_chunk_size",
+                    &SNodeMemoryStats::element_list_chunk_size)
+      .def_readonly("num_allocated_nodes",
+                    &SNodeMemoryStats::num_allocated_nodes)
+      .def_readonly("num_live_nodes", &SNodeMemoryStats::num_live_nodes)
+      .def_readonly("peak_num_live_nodes",
+                    &SNodeMemoryStats::peak_num_live_nodes)
+      .def_readonly("node_size", &SNodeMemoryStats::node_size)
+      .def_readonly("num_chunks", &SNodeMemoryStats::num_chunks)
+      .def_readonly("peak_num_chunks", &SNodeMemoryStats::peak_num_chunks)
+      .def_readonly("chunk_size", &SNodeMemoryStats::chunk_size);
+
+  py::class_<SparseMatrix>(m, "SparseMatrix")
+      .def("get_num_rows", &SparseMatrix::get_num_rows)
+      .def("get_num_cols", &SparseMatrix::get_num_cols)
+      .def("get_num_nonzeros", &SparseMatrix::get_num_nonzeros)
+      .def("build_from_triplets",
+           [](SparseMatrix *matrix, uint64 rows, uint64 cols, uint64 values,
+              int n, bool on_device) {
+             matrix->build_from_triplets((void *)rows, (void *)cols,
+                                         (void *)values, n, on_device);
+           })
+      .def("spmv",
+           [](SparseMatrix *matrix, uint64 x, uint64 y, bool on_device) {
+             matrix->spmv((void *)x, (void *)y, on_device);
+           })
+      .def("solve_cg", [](SparseMatrix *matrix, uint64 b, uint64 x,
+                          float64 tolerance, int max_iterations,
+                          bool on_device) {
+        return matrix->solve_cg((void *)b, (void *)x, tolerance,
+                                max_iterations, on_device);
+      });
+
   py::class_<Program>(m, "Program")
       .def(py::init<>())
       .def_readonly("config", &Program::config)
       .def("kernel_profiler_print", &Program::kernel_profiler_print)
       .def("kernel_profiler_total_time",
            [](Program *program) { return program->profiler->get_total_time(); })
+      .def("kernel_profiler_gc_time",
+           [](Program *program) {
+             program->profiler->sync();
+             return program->profiler->get_total_gc_time();
+           })
+      .def("kernel_profiler_dump_trace",
+           [](Program *program, const std::string &file_name) {
+             program->profiler->dump_trace(file_name);
+           })
       .def("kernel_profiler_clear", &Program::kernel_profiler_clear)
+      .def("kernel_profiler_sync",
+           [](Program *program) { program->profiler->sync(); })
+      .def("compile_profiler_print",
+           [](Program *program) {
+             TI_ERROR_IF(!program->compile_profiler,
+                         "Set compile_profiler=True in ti.init() first");
+             program->compile_profiler->print();
+           })
+      .def("compile_profiler_dump_json",
+           [](Program *program, const std::string &file_name) {
+             TI_ERROR_IF(!program->compile_profiler,
+                         "Set compile_profiler=True in ti.init() first");
+             program->compile_profiler->dump_json(file_name);
+           })
+      .def("compile_profiler_clear",
+           [](Program *program) {
+             if (program->compile_profiler) {
+               program->compile_profiler->clear();
+             }
+           })
       .def("print_memory_profiler_info", &Program::print_memory_profiler_info)
       .def("finalize", &Program::finalize)
       .def("get_root",
@@ -190,11 +368,84 @@ void export_lang(py::module &m) {
              return program->snode_root.get();
            },
            py::return_value_policy::reference)
+      .def("create_snode_tree", &Program::create_snode_tree,
+           py::return_value_policy::reference)
+      .def("materialize_snode_tree", &Program::materialize_snode_tree)
       .def("get_total_compilation_time", &Program::get_total_compilation_time)
       .def("print_snode_tree", &Program::print_snode_tree)
       .def("get_snode_num_dynamically_allocated",
            &Program::get_snode_num_dynamically_allocated)
-      .def("synchronize", &Program::synchronize);
+      .def("get_memory_stats", &Program::get_memory_stats)
+      .def("compact_snode", &Program::compact_snode)
+      .def("can_clear_snode", &Program::can_clear_snode)
+      .def("clear_snode", &Program::clear_snode)
+      .def("fill_snode", &Program::fill_snode)
+      .def("copy_snode", &Program::copy_snode)
+      .def("trim_memory", &Program::trim_memory)
+      .def("save_checkpoint", &Program::save_checkpoint)
+      .def("load_checkpoint", &Program::load_checkpoint)
+      .def("create_cuda_graph", &Program::create_cuda_graph)
+      .def("begin_cuda_graph", &Program::begin_cuda_graph)
+      .def("end_cuda_graph", &Program::end_cuda_graph)
+      .def("allocate_external_array",
+           [](Program *program, std::size_t size) {
+             return (uint64)program->allocate_external_array(size);
+           })
+      .def("free_external_array",
+           [](Program *program, uint64 ptr) {
+             program->free_external_array((void *)ptr);
+           })
+      .def("allocate_device_array",
+           [](Program *program, std::size_t size) {
+             return (uint64)program->allocate_device_array(size);
+           })
+      .def("free_device_array",
+           [](Program *program, uint64 ptr) {
+             program->free_device_array((void *)ptr);
+           })
+      .def("copy_device_array",
+           [](Program *program, uint64 dst, uint64 src, std::size_t size) {
+             program->copy_device_array((void *)dst, (void *)src, size);
+           })
+      .def("prefetch_external_array",
+           [](Program *program, uint64 ptr, std::size_t size, bool to_device) {
+             program->prefetch_external_array((void *)ptr, size, to_device);
+           })
+      .def("exclusive_scan_i32",
+           [](Program *program, uint64 data, int n, bool on_device) {
+             program->get_parallel_primitives()->exclusive_scan_i32(
+                 (void *)data, n, on_device);
+           })
+      .def("sort_pairs_32",
+           [](Program *program, uint64 keys, uint64 values, int n,
+              bool signed_keys, bool on_device) {
+             program->get_parallel_primitives()->sort_pairs_32(
+                 (void *)keys, (void *)values, n, signed_keys, on_device);
+           })
+      .def("compact_32",
+           [](Program *program, uint64 input, uint64 flags, uint64 output,
+              int n, bool on_device) {
+             return program->get_parallel_primitives()->compact_32(
+                 (void *)input, (void *)flags, (void *)output, n, on_device);
+           })
+      .def("create_sparse_matrix", &Program::create_sparse_matrix,
+           py::return_value_policy::reference)
+      .def("destroy_sparse_matrix", &Program::destroy_sparse_matrix)
+      .def("get_layout_advice", &Program::get_layout_advice)
+      .def("advise_external_array",
+           [](Program *program, uint64 ptr, std::size_t size, bool read_mostly,
+              bool prefer_device) {
+             program->advise_external_array((void *)ptr, size, read_mostly,
+                                            prefer_device);
+           })
+      .def("export_cc_library", &Program::export_cc_library)
+      .def("export_llvm_aot_module", &Program::export_llvm_aot_module)
+      .def("load_llvm_aot_module", &Program::load_llvm_aot_module,
+           py::return_value_policy::reference)
+      .def("create_result_future", &Program::create_result_future)
+      .def("release_result_future", &Program::release_result_future)
+      .def("synchronize", &Program::synchronize,
+           py::call_guard<py::gil_scoped_release>());
 
   m.def("get_current_program", get_current_program,
         py::return_value_policy::reference);
@@ -208,6 +459,14 @@ void export_lang(py::module &m) {
       .def(py::init<>())
       .def_readwrite("parent", &SNode::parent)
       .def_readonly("type", &SNode::type)
+      .def_readonly("id", &SNode::id)
+      .def_readwrite("gc_threshold", &SNode::gc_threshold)
+      .def_readwrite("gc_period", &SNode::gc_period)
+      .def_readwrite("numa_policy", &SNode::numa_policy)
+      .def_readwrite("mmap_path", &SNode::mmap_path)
+      .def_readwrite("mmap_writable", &SNode::mmap_writable)
+      .def_readwrite("mmap_advice", &SNode::mmap_advice)
+      .def_readwrite("cell_alignment", &SNode::cell_alignment)
       .def("dense",
            (SNode & (SNode::*)(const std::vector<Index> &,
                                const std::vector<int> &))(&SNode::dense),
@@ -218,13 +477,14 @@ void export_lang(py::module &m) {
            py::return_value_policy::reference)
       .def("hash",
            (SNode & (SNode::*)(const std::vector<Index> &,
-                               const std::vector<int> &))(&SNode::hash),
+                               const std::vector<int> &, int))(&SNode::hash),
            py::return_value_policy::reference)
       .def("dynamic", &SNode::dynamic, py::return_value_policy::reference)
       .def("bitmasked",
            (SNode & (SNode::*)(const std::vector<Index> &,
                                const std::vector<int> &))(&SNode::bitmasked),
            py::return_value_policy::reference)
+      .def("morton", &SNode::morton, py::return_value_policy::reference)
       .def("bit_struct", &SNode::bit_struct, py::return_value_policy::reference)
       .def("bit_array", &SNode::bit_array, py::return_value_policy::reference)
       .def("place",
@@ -236,16 +496,20 @@ void export_lang(py::module &m) {
       .def("get_ch",
            [](SNode *snode, int i) -> SNode * { return snode->ch[i].get(); },
            py::return_value_policy::reference)
-      .def("lazy_grad", &SNode::lazy_grad)
+      .def("lazy_grad", &SNode::lazy_grad, py::arg("sparse") = false)
+      .def("lazy_dual", &SNode::lazy_dual)
       .def("read_int", &SNode::read_int)
       .def("read_uint", &SNode::read_uint)
       .def("read_float", &SNode::read_float)
       .def("has_grad", &SNode::has_grad)
+      .def("has_dual", &SNode::has_dual)
       .def("is_primal", &SNode::is_primal)
       .def("is_place", &SNode::is_place)
       .def("get_expr", &SNode::get_expr, py::return_value_policy::reference)
       .def("write_int", &SNode::write_int)
       .def("write_float", &SNode::write_float)
+      .def("to_buffer", &SNode::to_buffer)
+      .def("from_buffer", &SNode::from_buffer)
       .def("get_shape_along_axis", &SNode::shape_along_axis)
       .def("get_physical_index_position",
            [](SNode *snode) {
@@ -256,10 +520,31 @@ void export_lang(py::module &m) {
       .def("num_active_indices",
            [](SNode *snode) { return snode->num_active_indices; });
 
+  // Fetching the results waits for the device, without the GIL.
   py::class_<Kernel>(m, "Kernel")
-      .def("get_ret_int", &Kernel::get_ret_int)
-      .def("get_ret_float", &Kernel::get_ret_float)
+      .def("get_ret_int", &Kernel::get_ret_int,
+           py::call_guard<py::gil_scoped_release>())
+      .def("get_ret_float", &Kernel::get_ret_float,
+           py::call_guard<py::gil_scoped_release>())
+      .def("get_future_ret_int", &Kernel::get_future_ret_int,
+           py::call_guard<py::gil_scoped_release>())
+      .def("get_future_ret_float", &Kernel::get_future_ret_float,
+           py::call_guard<py::gil_scoped_release>())
       .def("make_launch_context", &Kernel::make_launch_context)
+      .def("prepare_launch", &Kernel::prepare_launch)
+      .def("specialize_arg_int", &Kernel::specialize_arg_int)
+      .def("specialize_arg_float", &Kernel::specialize_arg_float)
+      .def_readonly("name", &Kernel::name)
+      .def("get_num_args", [](Kernel *kernel) { return kernel->args.size(); })
+      .def("is_arg_nparray",
+           [](Kernel *kernel, int i) { return kernel->args[i].is_nparray; })
+      .def("is_arg_real",
+           [](Kernel *kernel, int i) {
+             return is_real(kernel->args[i].dt);
+           })
+      .def("get_num_rets", [](Kernel *kernel) { return kernel->rets.size(); })
+      .def("is_ret_real",
+           [](Kernel *kernel, int i) { return is_real(kernel->rets[i].dt); })
       .def("__call__",
            [](Kernel *kernel, Kernel::LaunchContextBuilder &launch_ctx) {
              py::gil_scoped_release release;
@@ -273,6 +558,45 @@ void export_lang(py::module &m) {
       .def("set_extra_arg_int",
            &Kernel::LaunchContextBuilder::set_extra_arg_int);
 
+  // Converts the Python args of a prepared launch.
+  auto get_launch_args = [](Kernel::PreparedLaunch *launch,
+                            const py::tuple &args) {
+    std::vector<Kernel::PreparedLaunch::ArgValue> values;
+    values.reserve(args.size());
+    for (int i = 0; i < (int)args.size(); i++) {
+      if (launch->is_real_arg(i)) {
+        values.emplace_back(args[i].cast<float64>());
+      } else {
+        values.emplace_back(args[i].cast<int64>());
+      }
+    }
+    return values;
+  };
+
+  py::class_<Kernel::PreparedLaunch>(m, "KernelPreparedLaunch")
+      .def("__call__",
+           [get_launch_args](Kernel::PreparedLaunch *launch, py::args args) {
+             // Sets all the args in one call from Python.
+             auto values = get_launch_args(launch, args);
+             py::gil_scoped_release release;
+             launch->launch(values);
+           });
+
+  m.def("launch_kernels", [get_launch_args](const py::list &launches) {
+    std::vector<std::pair<Kernel::PreparedLaunch *,
+                          std::vector<Kernel::PreparedLaunch::ArgValue>>>
+        batch;
+    batch.reserve(launches.size());
+    for (auto &item : launches) {
+      auto pair = item.cast<py::tuple>();
+      auto *launch = pair[0].cast<Kernel::PreparedLaunch *>();
+      batch.emplace_back(launch,
+                         get_launch_args(launch, pair[1].cast<py::tuple>()));
+    }
+    py::gil_scoped_release release;
+    Kernel::PreparedLaunch::launch_batch(batch);
+  });
+
   py::class_<Expr> expr(m, "Expr");
   expr.def("serialize", &Expr::serialize)
       .def("snode", &Expr::snode, py::return_value_policy::reference)
@@ -286,6 +610,7 @@ void export_lang(py::module &m) {
              expr->cast<GlobalVariableExpression>()->is_primal = v;
            })
       .def("set_grad", &Expr::set_grad)
+      .def("set_dual", &Expr::set_dual)
       .def("set_attribute", &Expr::set_attribute)
       .def("get_attribute", &Expr::get_attribute)
       .def("get_raw_address", [](Expr *expr) { return (uint64)expr; });
@@ -328,6 +653,15 @@ void export_lang(py::module &m) {
           current_ast_builder().insert(Stmt::make<FrontendEvalStmt>(expr));
         });
 
+  m.def("insert_bitcode_func_call",
+        [](std::string bitcode_file, std::string func_name,
+           const ExprGroup &args, const ExprGroup &outputs) {
+          auto expr = Expr::make<ExternalFuncCallExpression>(
+              nullptr, "", args.exprs, outputs.exprs, func_name, bitcode_file);
+
+          current_ast_builder().insert(Stmt::make<FrontendEvalStmt>(expr));
+        });
+
   m.def("insert_is_active", [](SNode *snode, const ExprGroup &indices) {
     return is_active(snode, indices);
   });
@@ -559,6 +893,9 @@ void export_lang(py::module &m) {
   unary.export_values();
   m.def("make_unary_op_expr",
         Expr::make<UnaryOpExpression, const UnaryOpType &, const Expr &>);
+
+  m.def("get_expression_batch_op_names", get_expression_batch_op_names);
+  m.def("build_expression_batch", build_expression_batch);
 #define PER_TYPE(x)                                                  \
   m.attr(("DataType_" + data_type_name(PrimitiveType::x)).c_str()) = \
       PrimitiveType::x;
@@ -591,8 +928,19 @@ void export_lang(py::module &m) {
         Expr::make<ExternalTensorShapeAlongAxisExpression, const Expr &, int>);
 
   m.def("create_kernel",
-        [&](std::string name, bool grad) -> Program::KernelProxy {
-          return get_current_program().kernel(name, grad);
+        [&](std::string name, bool grad, bool jvp,
+            bool keep_primal) -> Program::KernelProxy {
+          return get_current_program().kernel(name, grad, jvp, keep_primal);
+        },
+        py::arg("name"), py::arg("grad"), py::arg("jvp") = false,
+        py::arg("keep_primal") = false);
+
+  m.def("set_kernel_float_options",
+        [](bool fast_math, bool fp_contract, bool approx_math) {
+          auto &kernel = get_current_program().get_current_kernel();
+          kernel.fast_math = fast_math;
+          kernel.fp_contract = fp_contract;
+          kernel.approx_math = approx_math;
         });
 
   m.def("create_print",
@@ -621,6 +969,7 @@ void export_lang(py::module &m) {
   m.def("parallelize", Parallelize);
   m.def("vectorize", Vectorize);
   m.def("block_dim", BlockDim);
+  m.def("unroll", Unroll);
 
   py::enum_<SNodeAccessFlag>(m, "SNodeAccessFlag", py::arithmetic())
       .value("block_local", SNodeAccessFlag::block_local)
@@ -660,6 +1009,17 @@ void export_lang(py::module &m) {
   m.def("test_threading", test_threading);
   m.def("sifakis_svd_f32", sifakis_svd_export<float32, int32>);
   m.def("sifakis_svd_f64", sifakis_svd_export<float64, int64>);
+  m.def("sifakis_svd_runtime_f32", sifakis_svd_runtime<float32>);
+  m.def("sifakis_svd_runtime_f64", sifakis_svd_runtime<float64>);
+  // Whether ti.svd can call the runtime in the kernel being defined. The
+  // adjoint and JVP kernels need the statements to differentiate.
+  m.def("can_call_runtime_svd", [] {
+    auto &prog = get_current_program();
+    const auto arch = prog.config.arch;
+    return prog.config.svd_intrinsic && prog.current_kernel &&
+           !prog.current_kernel->grad && !prog.current_kernel->jvp &&
+           (arch == Arch::x64 || arch == Arch::arm64 || arch == Arch::cuda);
+  });
   m.def("global_var_expr_from_snode", [](SNode *snode) {
     return Expr::make<GlobalVariableExpression>(snode);
   });
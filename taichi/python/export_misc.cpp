@@ -5,6 +5,7 @@
 
 #include "taichi/backends/metal/api.h"
 #include "taichi/backends/opengl/opengl_api.h"
+#include "taichi/backends/vulkan/vulkan_runtime.h"
 #include "taichi/common/core.h"
 #include "taichi/common/task.h"
 #include "taichi/math/math.h"
@@ -15,6 +16,7 @@
 #include "taichi/system/dynamic_loader.h"
 #include "taichi/system/memory_usage_monitor.h"
 #include "taichi/system/profiler.h"
+#include "taichi/system/tracer.h"
 #include "taichi/util/statistics.h"
 #if defined(TI_WITH_CUDA)
 #include "taichi/backends/cuda/cuda_driver.h"
@@ -151,6 +153,27 @@ void export_misc(py::module &m) {
         [&]() { Profiling::get_instance().print_profile_info(); });
   m.def("clear_profile_info",
         [&]() { Profiling::get_instance().clear_profile_info(); });
+  m.def("tracer_enable", []() { Tracer::get_instance().enable(); });
+  m.def("tracer_disable", []() { Tracer::get_instance().disable(); });
+  m.def("tracer_clear", []() { Tracer::get_instance().clear(); });
+  m.def("tracer_dump", [](const std::string &file_name) {
+    Tracer::get_instance().dump(file_name);
+  });
+  m.def("tracer_now_us", Tracer::now_us);
+  m.def("tracer_add_complete_event",
+        [](const std::string &category, const std::string &name,
+           double begin_us, double duration_us) {
+          // The category must outlive the trace.
+          static std::unordered_set<std::string> categories;
+          static std::mutex mut;
+          const char *cat;
+          {
+            std::lock_guard<std::mutex> _(mut);
+            cat = categories.insert(category).first->c_str();
+          }
+          Tracer::get_instance().add_complete_event(cat, name, begin_us,
+                                                    duration_us);
+        });
   m.def("start_memory_monitoring", start_memory_monitoring);
   m.def("absolute_path", absolute_path);
   m.def("get_repo_dir", get_repo_dir);
@@ -170,6 +193,7 @@ void export_misc(py::module &m) {
   m.def("with_cuda", is_cuda_api_available);
   m.def("with_metal", taichi::lang::metal::is_metal_api_available);
   m.def("with_opengl", taichi::lang::opengl::is_opengl_api_available);
+  m.def("with_vulkan", taichi::lang::vulkan::is_vulkan_api_available);
 
 #ifdef TI_WITH_CC
   m.def("with_cc", taichi::lang::cccp::is_c_backend_available);
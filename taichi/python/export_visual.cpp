@@ -24,24 +24,38 @@ void export_visual(py::module &m) {
       .value("Move", Type::move)
       .value("Press", Type::press)
       .value("Release", Type::release);
+  py::enum_<CanvasFormat>(m, "CanvasFormat")
+      .value("rgba32f", CanvasFormat::rgba32f)
+      .value("rgba8", CanvasFormat::rgba8)
+      .export_values();
   py::class_<GUI>(m, "GUI")
-      .def(py::init<std::string, Vector2i, bool, bool, bool, uintptr_t>())
+      .def(py::init<std::string, Vector2i, bool, bool, bool, uintptr_t, bool,
+                    CanvasFormat>())
       .def_readwrite("frame_delta_limit", &GUI::frame_delta_limit)
       .def_readwrite("should_close", &GUI::should_close)
       .def("get_canvas", &GUI::get_canvas, py::return_value_policy::reference)
       .def("set_img",
            [&](GUI *gui, std::size_t ptr) {
+             if (gui->canvas->img8) {
+               gui->canvas->set_rgba32f((const float32 *)ptr);
+               return;
+             }
              auto &img = gui->canvas->img;
              std::memcpy((void *)img.get_data().data(), (void *)ptr,
                          img.get_data_size());
            })
       .def("get_img",
            [&](GUI *gui, std::size_t ptr) {
+             if (gui->canvas->img8) {
+               gui->canvas->get_rgba32f((float32 *)ptr);
+               return;
+             }
              auto &img = gui->canvas->img;
              std::memcpy((void *)ptr, (void *)img.get_data().data(),
                          img.get_data_size());
            })
       .def("screenshot", &GUI::screenshot)
+      .def("set_fast_buffer", &GUI::set_fast_buffer)
       .def("set_widget_value",
            [](GUI *gui, int wid, float value) {
              *gui->widget_values.at(wid) = value;
@@ -110,6 +124,16 @@ void export_visual(py::module &m) {
            py::return_value_policy::reference);
   m.def("imwrite", &imwrite);
   m.def("imread", &imread);
+  m.def("imread_info", &imread_info);
+  m.def("imread_batch", &imread_batch,
+        py::call_guard<py::gil_scoped_release>());
+  py::class_<FrameWriter>(m, "FrameWriter")
+      .def(py::init<int, int>())
+      .def(py::init<std::string, int>())
+      .def("write", &FrameWriter::write,
+           py::call_guard<py::gil_scoped_release>())
+      .def("flush", &FrameWriter::flush,
+           py::call_guard<py::gil_scoped_release>());
   // TODO(archibate): See misc/image.py
   m.def("C_memcpy", [](size_t dst, size_t src, size_t size) {
     std::memcpy((void *)dst, (void *)src, size);
@@ -15,6 +15,18 @@ DEFINE_ATOMIC_EXCHANGE(i64)
 DEFINE_ATOMIC_EXCHANGE(u32)
 DEFINE_ATOMIC_EXCHANGE(u64)
 
+// Stores |desired| to |dest| if it holds |expected|. Returns the old value.
+#define DEFINE_ATOMIC_CAS(T)                                              \
+  T atomic_cas_##T(volatile T *dest, T expected, T desired) {             \
+    __atomic_compare_exchange(dest, &expected, &desired, false,           \
+                              std::memory_order::memory_order_seq_cst,    \
+                              std::memory_order::memory_order_seq_cst);   \
+    return expected;                                                      \
+  }
+
+DEFINE_ATOMIC_CAS(i32)
+DEFINE_ATOMIC_CAS(u64)
+
 #define DEFINE_ATOMIC_OP_INTRINSIC(OP, T)                                \
   T atomic_##OP##_##T(volatile T *dest, T val) {                         \
     return __atomic_fetch_##OP(dest, val,                                \
@@ -23,6 +23,36 @@ struct MemRequestQueue {
   int processed;
 };
 
+// The bounds of the preallocated buffer that the runtime bump-allocates from.
+// With lazily committed CUDA device memory, these live in host-mapped memory,
+// so that the host can watch |head| and commit more physical memory behind
+// |tail| without synchronizing with the device.
+struct PreallocatedBufferBounds {
+  uint8 *head;
+  uint8 *tail;
+};
+
+// The memory usage of an SNode, gathered for all the SNodes at once by
+// runtime_update_memory_stats(), so that the host reads them with a single
+// copy. The node fields are zero for the SNodes without a node allocator.
+struct SNodeMemoryStats {
+  // The element list of the SNode.
+  int64 element_list_size;
+  int64 element_list_num_chunks;
+  int64 element_list_chunk_size;
+  // The data list slots handed out, and the live nodes among them: the rest
+  // are deactivated nodes waiting in the free and recycled lists.
+  int64 num_allocated_nodes;
+  int64 num_live_nodes;
+  // Sampled at each GC and each update, see NodeManager::sample_peak().
+  int64 peak_num_live_nodes;
+  int64 node_size;
+  // The chunks of the data list, and their size in bytes.
+  int64 num_chunks;
+  int64 peak_num_chunks;
+  int64 chunk_size;
+};
+
 #if defined(TI_RUNTIME_HOST)
 }  // namespace lang
 }  // namespace taichi
@@ -17,7 +17,10 @@ void Bitmasked_activate(Ptr meta, Ptr node, int i) {
   auto num_elements = Bitmasked_get_num_elements(meta, node);
   auto data_section_size = element_size * num_elements;
   auto mask_begin = (u32 *)(node + data_section_size);
-  atomic_or_u32(&mask_begin[i / 32], 1UL << (i % 32));
+  auto old_mask = atomic_or_u32(&mask_begin[i / 32], 1UL << (i % 32));
+  if (!(old_mask & (1UL << (i % 32)))) {
+    mark_structure_changed(smeta->context->runtime, smeta->snode_id);
+  }
 }
 
 void Bitmasked_deactivate(Ptr meta, Ptr node, int i) {
@@ -26,7 +29,10 @@ void Bitmasked_deactivate(Ptr meta, Ptr node, int i) {
   auto num_elements = Bitmasked_get_num_elements(meta, node);
   auto data_section_size = element_size * num_elements;
   auto mask_begin = (u32 *)(node + data_section_size);
-  atomic_and_u32(&mask_begin[i / 32], ~(1UL << (i % 32)));
+  auto old_mask = atomic_and_u32(&mask_begin[i / 32], ~(1UL << (i % 32)));
+  if (old_mask & (1UL << (i % 32))) {
+    mark_structure_changed(smeta->context->runtime, smeta->snode_id);
+  }
 }
 
 i32 Bitmasked_is_active(Ptr meta, Ptr node, int i) {
@@ -38,6 +44,37 @@ i32 Bitmasked_is_active(Ptr meta, Ptr node, int i) {
   return i32(bool((mask_begin[i / 8] >> (i % 8)) & 1));
 }
 
+u32 Bitmasked_get_active_mask(Ptr meta, Ptr node, int word_id) {
+  auto smeta = (StructMeta *)meta;
+  auto element_size = StructMeta_get_element_size(smeta);
+  auto num_elements = Bitmasked_get_num_elements(meta, node);
+  auto data_section_size = element_size * num_elements;
+  auto mask_begin = (u32 *)(node + data_section_size);
+  return mask_begin[word_id];
+}
+
+// The first active child in [i, end), or |end| if there is none. Skips the
+// mask words without active children 32 children at a time.
+i32 Bitmasked_next_active(Ptr meta, Ptr node, int i, int end) {
+  if (i >= end)
+    return end;
+  auto smeta = (StructMeta *)meta;
+  auto element_size = StructMeta_get_element_size(smeta);
+  auto num_elements = Bitmasked_get_num_elements(meta, node);
+  auto data_section_size = element_size * num_elements;
+  auto mask_begin = (u32 *)(node + data_section_size);
+  int w = i / 32;
+  u32 mask = mask_begin[w] & (~0u << (i % 32));
+  while (mask == 0) {
+    w++;
+    if (w * 32 >= end)
+      return end;
+    mask = mask_begin[w];
+  }
+  auto j = w * 32 + __builtin_ctz(mask);
+  return j < end ? j : end;
+}
+
 Ptr Bitmasked_lookup_element(Ptr meta, Ptr node, int i) {
   return node + ((StructMeta *)meta)->element_size * i;
 }
@@ -3,15 +3,63 @@
 struct DynamicNode {
   i32 lock;
   i32 n;
+  // The first chunk, or the chunk directory if |DynamicMeta::chunk_directory|
   Ptr ptr;
 };
 
 // Specialized Attributes and functions
 struct DynamicMeta : public StructMeta {
   int chunk_size;
+  // Nonzero to keep the pointers to all the chunks in a directory, instead of
+  // linking each chunk to the next one, so that element i is found in chunk
+  // i / chunk_size without walking the preceding chunks.
+  int chunk_directory;
 };
 
 STRUCT_FIELD(DynamicMeta, chunk_size);
+STRUCT_FIELD(DynamicMeta, chunk_directory);
+
+void Dynamic_allocate_chunk(DynamicMeta *meta,
+                            DynamicNode *node,
+                            Ptr *p_chunk_ptr) {
+  if (*p_chunk_ptr == nullptr) {
+    locked_task(Ptr(&node->lock), [&] {
+      if (*p_chunk_ptr == nullptr) {
+        auto rt = meta->context->runtime;
+        auto alloc = rt->node_allocators[meta->snode_id];
+        *p_chunk_ptr = alloc->allocate();
+      }
+    });
+  }
+}
+
+// The directory holds enough pointers for max_num_elements elements, and is
+// kept when the node is deactivated.
+Ptr *Dynamic_get_chunk_directory(DynamicMeta *meta, DynamicNode *node) {
+  if (node->ptr == nullptr) {
+    locked_task(Ptr(&node->lock), [&] {
+      if (node->ptr == nullptr) {
+        auto num_chunks =
+            (meta->max_num_elements + meta->chunk_size - 1) / meta->chunk_size;
+        node->ptr = meta->context->runtime->request_allocate_aligned(
+            num_chunks * sizeof(Ptr), sizeof(Ptr));
+      }
+    });
+  }
+  return (Ptr *)node->ptr;
+}
+
+// Makes sure the chunks up to the one containing element i are allocated. The
+// allocated chunks are always a prefix of the directory, so this stops at the
+// first allocated chunk.
+void Dynamic_allocate_chunks_in_directory(DynamicMeta *meta,
+                                          DynamicNode *node,
+                                          int i) {
+  auto directory = Dynamic_get_chunk_directory(meta, node);
+  for (int c = i / meta->chunk_size; c >= 0 && directory[c] == nullptr; c--) {
+    Dynamic_allocate_chunk(meta, node, &directory[c]);
+  }
+}
 
 void Dynamic_activate(Ptr meta_, Ptr node_, int i) {
   auto meta = (DynamicMeta *)(meta_);
@@ -19,19 +67,15 @@ void Dynamic_activate(Ptr meta_, Ptr node_, int i) {
   // We need to not only update node->n, but also make sure the chunk containing
   // element i is allocated.
   atomic_max_i32(&node->n, i + 1);
+  if (meta->chunk_directory) {
+    Dynamic_allocate_chunks_in_directory(meta, node, i);
+    return;
+  }
   int chunk_start = 0;
   auto p_chunk_ptr = &node->ptr;
   auto chunk_size = meta->chunk_size;
   while (true) {
-    if (*p_chunk_ptr == nullptr) {
-      locked_task(Ptr(&node->lock), [&] {
-        if (*p_chunk_ptr == nullptr) {
-          auto rt = meta->context->runtime;
-          auto alloc = rt->node_allocators[meta->snode_id];
-          *p_chunk_ptr = alloc->allocate();
-        }
-      });
-    }
+    Dynamic_allocate_chunk(meta, node, p_chunk_ptr);
     if (i < chunk_start + chunk_size) {
       return;
     }
@@ -46,9 +90,19 @@ void Dynamic_deactivate(Ptr meta_, Ptr node_) {
   if (node->n > 0) {
     locked_task(Ptr(&node->lock), [&] {
       node->n = 0;
-      auto p_chunk_ptr = &node->ptr;
       auto rt = meta->context->runtime;
       auto alloc = rt->node_allocators[meta->snode_id];
+      if (meta->chunk_directory) {
+        auto directory = (Ptr *)node->ptr;
+        auto num_chunks =
+            (meta->max_num_elements + meta->chunk_size - 1) / meta->chunk_size;
+        for (int c = 0; c < num_chunks && directory[c] != nullptr; c++) {
+          alloc->recycle(directory[c]);
+          directory[c] = nullptr;
+        }
+        return;
+      }
+      auto p_chunk_ptr = &node->ptr;
       while (*p_chunk_ptr) {
         alloc->recycle(*p_chunk_ptr);
         p_chunk_ptr = (Ptr *)*p_chunk_ptr;
@@ -58,23 +112,58 @@ void Dynamic_deactivate(Ptr meta_, Ptr node_) {
   }
 }
 
+// Reserves one element of |node| for the calling thread, and returns its
+// index.
+i32 Dynamic_reserve_element(DynamicNode *node) {
+#if defined(ARCH_cuda)
+  // Threads of a warp appending to the same node reserve their elements with
+  // a single atomic: the leader of each group of peers reserves the elements
+  // of the whole group, and the peers derive their indices from the lanes of
+  // the group below them.
+  u32 mask = cuda_active_mask();
+  i32 peers;
+  if (cuda_compute_capability() < 70) {
+    // <= Pascal
+    peers = 0;
+    for (int s = 0; s < 32; s++) {
+      if ((mask >> s) & 1) {
+        auto lo = cuda_shfl_sync_i32(mask, i32(u64(node)), s, 31);
+        auto hi = cuda_shfl_sync_i32(mask, i32(u64(node) >> 32), s, 31);
+        if (lo == i32(u64(node)) && hi == i32(u64(node) >> 32))
+          peers |= 1u << s;
+      }
+    }
+  } else {
+    // >= Volta > Pascal
+    peers = cuda_match_any_sync_i64(mask, i64(node));
+  }
+  auto leader = cttz_i32(peers);
+  i32 base = 0;
+  if (warp_idx() == leader)
+    base = atomic_add_i32(&node->n, popc_i32(peers));
+  base = cuda_shfl_sync_i32(mask, base, leader, 31);
+  return base + popc_i32(peers & ((1u << warp_idx()) - 1));
+#else
+  return atomic_add_i32(&node->n, 1);
+#endif
+}
+
 i32 Dynamic_append(Ptr meta_, Ptr node_, i32 data) {
   auto meta = (DynamicMeta *)(meta_);
   auto node = (DynamicNode *)(node_);
   auto chunk_size = meta->chunk_size;
-  auto i = atomic_add_i32(&node->n, 1);
+  auto i = Dynamic_reserve_element(node);
+  if (meta->chunk_directory) {
+    Dynamic_allocate_chunks_in_directory(meta, node, i);
+    auto chunk = ((Ptr *)node->ptr)[i / chunk_size];
+    *(i32 *)(chunk + sizeof(Ptr) + (i % chunk_size) * meta->element_size) =
+        data;
+    return i;
+  }
   int chunk_start = 0;
   auto p_chunk_ptr = &node->ptr;
   while (true) {
-    if (*p_chunk_ptr == nullptr) {
-      locked_task(Ptr(&node->lock), [&] {
-        if (*p_chunk_ptr == nullptr) {
-          auto rt = meta->context->runtime;
-          auto alloc = rt->node_allocators[meta->snode_id];
-          *p_chunk_ptr = alloc->allocate();
-        }
-      });
-    }
+    Dynamic_allocate_chunk(meta, node, p_chunk_ptr);
     if (i < chunk_start + chunk_size) {
       *(i32 *)(*p_chunk_ptr + sizeof(Ptr) +
                (i - chunk_start) * meta->element_size) = data;
@@ -95,21 +184,29 @@ Ptr Dynamic_lookup_element(Ptr meta_, Ptr node_, int i) {
   auto meta = (DynamicMeta *)(meta_);
   auto node = (DynamicNode *)(node_);
   if (Dynamic_is_active(meta_, node_, i)) {
-    int chunk_start = 0;
-    auto chunk_ptr = node->ptr;
     auto chunk_size = meta->chunk_size;
-    while (true) {
-      if (i < chunk_start + chunk_size) {
-        auto addr =
-            chunk_ptr + sizeof(Ptr) + (i - chunk_start) * meta->element_size;
-        return addr;
+    if (meta->chunk_directory) {
+      // The chunk may still be being allocated by another thread.
+      auto directory = (Ptr *)node->ptr;
+      auto chunk = directory ? directory[i / chunk_size] : nullptr;
+      if (chunk) {
+        return chunk + sizeof(Ptr) + (i % chunk_size) * meta->element_size;
+      }
+    } else {
+      int chunk_start = 0;
+      auto chunk_ptr = node->ptr;
+      while (true) {
+        if (i < chunk_start + chunk_size) {
+          auto addr =
+              chunk_ptr + sizeof(Ptr) + (i - chunk_start) * meta->element_size;
+          return addr;
+        }
+        chunk_ptr = *(Ptr *)chunk_ptr;
+        chunk_start += chunk_size;
       }
-      chunk_ptr = *(Ptr *)chunk_ptr;
-      chunk_start += chunk_size;
     }
-  } else {
-    return (meta->context->runtime)->ambient_elements[meta->snode_id];
   }
+  return (meta->context->runtime)->ambient_elements[meta->snode_id];
 }
 
 i32 Dynamic_get_num_elements(Ptr meta_, Ptr node_) {
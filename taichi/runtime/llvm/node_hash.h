@@ -0,0 +1,149 @@
+#pragma once
+
+// An open-addressing hash table with linear probing, mapping the indices of
+// the children to their nodes. Only |capacity| slots are reserved, however
+// large the index space is.
+//
+// Node layout: i32 keys[capacity], Ptr data[capacity],
+//              u32 active_mask[capacity / 32]
+// The key of a slot is the index of its child plus one, so that zero marks an
+// empty slot. Keys are inserted with a CAS and never removed: a deactivated
+// child keeps its slot, so that the probe sequences of the other keys remain
+// intact.
+struct HashMeta : public StructMeta {
+  i32 capacity;
+};
+
+STRUCT_FIELD(HashMeta, capacity);
+
+// Listgen enumerates the slots, see StructMeta::slot_to_index.
+i32 Hash_get_num_elements(Ptr meta, Ptr node) {
+  return ((HashMeta *)meta)->capacity;
+}
+
+i32 *Hash_get_keys(Ptr meta, Ptr node) {
+  return (i32 *)node;
+}
+
+Ptr *Hash_get_data(Ptr meta, Ptr node) {
+  return (Ptr *)(node + sizeof(i32) * ((HashMeta *)meta)->capacity);
+}
+
+u32 *Hash_get_active_mask_begin(Ptr meta, Ptr node) {
+  return (u32 *)(node + (sizeof(i32) + sizeof(Ptr)) *
+                            ((HashMeta *)meta)->capacity);
+}
+
+i32 Hash_get_home_slot(Ptr meta, int i) {
+  // Spread indices differing only in their higher bits (e.g. in the other
+  // coordinates) over the table.
+  u32 h = (u32)i * 2654435769u;
+  h ^= h >> 16;
+  return (i32)(h & (((HashMeta *)meta)->capacity - 1));
+}
+
+// Returns the slot holding key |i|, or -1.
+i32 Hash_find_slot(Ptr meta, Ptr node, int i) {
+  auto capacity = ((HashMeta *)meta)->capacity;
+  volatile i32 *keys = Hash_get_keys(meta, node);
+  auto slot = Hash_get_home_slot(meta, i);
+  auto num_probes = std::min(capacity, taichi_hash_max_num_probes);
+  for (int p = 0; p < num_probes; p++) {
+    auto key = keys[slot];
+    if (key == i + 1)
+      return slot;
+    if (key == 0)
+      return -1;
+    slot = (slot + 1) & (capacity - 1);
+  }
+  return -1;
+}
+
+// Returns the slot holding key |i|, inserting the key if needed.
+i32 Hash_insert_key(Ptr meta, Ptr node, int i) {
+  auto capacity = ((HashMeta *)meta)->capacity;
+  volatile i32 *keys = Hash_get_keys(meta, node);
+  auto slot = Hash_get_home_slot(meta, i);
+  auto num_probes = std::min(capacity, taichi_hash_max_num_probes);
+  for (int p = 0; p < num_probes; p++) {
+    auto key = keys[slot];
+    if (key == 0)
+      key = atomic_cas_i32(&keys[slot], 0, i + 1);
+    if (key == 0 || key == i + 1)
+      return slot;
+    slot = (slot + 1) & (capacity - 1);
+  }
+  taichi_assert_runtime(((StructMeta *)meta)->context->runtime, false,
+                        "Hash SNode is full. Please increase its capacity.");
+  return -1;
+}
+
+void Hash_activate(Ptr meta_, Ptr node, int i) {
+  auto meta = (StructMeta *)meta_;
+  auto slot = Hash_insert_key(meta_, node, i);
+  if (slot == -1)
+    return;
+  volatile Ptr *data_ptr = &Hash_get_data(meta_, node)[slot];
+  if (*data_ptr == nullptr) {
+    // The cuda_ calls will return 0 or do noop on CPUs
+    u32 mask = cuda_active_mask();
+    if (is_representative(mask, (u64)data_ptr)) {
+      auto rt = meta->context->runtime;
+      auto alloc = rt->node_allocators[meta->snode_id];
+      auto allocated = alloc->allocate();
+      // Publish the node, unless another thread was faster.
+      if (atomic_cas_u64((u64 *)data_ptr, 0, (u64)allocated) == 0) {
+        atomic_or_u32(&Hash_get_active_mask_begin(meta_, node)[slot / 32],
+                      1UL << (slot % 32));
+        mark_structure_changed(rt, meta->snode_id);
+      } else {
+        alloc->release_unused(allocated);
+      }
+    }
+    warp_barrier(mask);
+  }
+}
+
+void Hash_deactivate(Ptr meta_, Ptr node, int i) {
+  auto slot = Hash_find_slot(meta_, node, i);
+  if (slot == -1)
+    return;
+  auto data_ptr = &Hash_get_data(meta_, node)[slot];
+  if (*data_ptr != nullptr) {
+    auto data = (Ptr)atomic_exchange_u64((u64 *)data_ptr, 0);
+    if (data != nullptr) {
+      auto meta = (StructMeta *)meta_;
+      auto rt = meta->context->runtime;
+      rt->node_allocators[meta->snode_id]->recycle(data);
+      atomic_and_u32(&Hash_get_active_mask_begin(meta_, node)[slot / 32],
+                     ~(1UL << (slot % 32)));
+      mark_structure_changed(rt, meta->snode_id);
+    }
+  }
+}
+
+i32 Hash_is_active(Ptr meta, Ptr node, int i) {
+  auto slot = Hash_find_slot(meta, node, i);
+  return slot != -1 && Hash_get_data(meta, node)[slot] != nullptr;
+}
+
+u32 Hash_get_active_mask(Ptr meta, Ptr node, int word_id) {
+  return Hash_get_active_mask_begin(meta, node)[word_id];
+}
+
+i32 Hash_slot_to_index(Ptr meta, Ptr node, int slot) {
+  if (Hash_get_data(meta, node)[slot] == nullptr)
+    return -1;
+  return Hash_get_keys(meta, node)[slot] - 1;
+}
+
+Ptr Hash_lookup_element(Ptr meta, Ptr node, int i) {
+  auto slot = Hash_find_slot(meta, node, i);
+  if (slot != -1) {
+    auto data_ptr = Hash_get_data(meta, node)[slot];
+    if (data_ptr != nullptr)
+      return data_ptr;
+  }
+  auto smeta = (StructMeta *)meta;
+  return smeta->context->runtime->ambient_elements[smeta->snode_id];
+}
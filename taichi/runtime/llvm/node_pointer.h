@@ -11,6 +11,12 @@ i32 Pointer_get_num_elements(Ptr meta, Ptr node) {
   return ((StructMeta *)meta)->max_num_elements;
 }
 
+// Node layout: i64 locks[n], Ptr data[n], u32 active_mask[(n + 31) / 32]
+u32 *Pointer_get_active_mask_begin(Ptr meta, Ptr node) {
+  auto num_elements = Pointer_get_num_elements(meta, node);
+  return (u32 *)(node + 16 * num_elements);
+}
+
 bool is_representative(uint32 mask, uint64 value) {
 #if defined(ARCH_cuda)
   // If many threads in the mask share the same value, simply
@@ -38,7 +44,51 @@ bool is_representative(uint32 mask, uint64 value) {
 #endif
 }
 
+// Allocates the child speculatively, and publishes it with a CAS on its data
+// pointer. Threads losing the race give their node back to the allocator.
 void Pointer_activate(Ptr meta_, Ptr node, int i) {
+  auto meta = (StructMeta *)meta_;
+  auto num_elements = Pointer_get_num_elements(meta_, node);
+  volatile Ptr *data_ptr = (Ptr *)(node + 8 * (num_elements + i));
+
+  if (*data_ptr == nullptr) {
+    // The cuda_ calls will return 0 or do noop on CPUs
+    u32 mask = cuda_active_mask();
+    if (is_representative(mask, (u64)data_ptr)) {
+      auto rt = meta->context->runtime;
+      auto alloc = rt->node_allocators[meta->snode_id];
+      auto allocated = alloc->allocate();
+      if (atomic_cas_u64((u64 *)data_ptr, 0, (u64)allocated) == 0) {
+        atomic_or_u32(&Pointer_get_active_mask_begin(meta_, node)[i / 32],
+                      1UL << (i % 32));
+        mark_structure_changed(rt, meta->snode_id);
+      } else {
+        alloc->release_unused(allocated);
+      }
+    }
+    warp_barrier(mask);
+  }
+}
+
+void Pointer_deactivate(Ptr meta, Ptr node, int i) {
+  auto num_elements = Pointer_get_num_elements(meta, node);
+  auto data_ptr = (Ptr *)(node + 8 * (num_elements + i));
+  if (*data_ptr != nullptr) {
+    auto data = (Ptr)atomic_exchange_u64((u64 *)data_ptr, 0);
+    if (data != nullptr) {
+      auto smeta = (StructMeta *)meta;
+      auto rt = smeta->context->runtime;
+      rt->node_allocators[smeta->snode_id]->recycle(data);
+      atomic_and_u32(&Pointer_get_active_mask_begin(meta, node)[i / 32],
+                     ~(1UL << (i % 32)));
+      mark_structure_changed(rt, smeta->snode_id);
+    }
+  }
+}
+
+// The variants of Pointer_activate() and Pointer_deactivate() taking the spin
+// lock of the child, see CompileConfig::lock_free_activation.
+void Pointer_activate_locked(Ptr meta_, Ptr node, int i) {
   auto meta = (StructMeta *)meta_;
   auto num_elements = Pointer_get_num_elements(meta_, node);
   volatile Ptr lock = node + 8 * i;
@@ -56,6 +106,10 @@ void Pointer_activate(Ptr meta_, Ptr node, int i) {
                     // TODO: Not sure if we really need atomic_exchange here,
                     // just to be safe.
                     atomic_exchange_u64((u64 *)data_ptr, allocated);
+                    atomic_or_u32(
+                        &Pointer_get_active_mask_begin(meta_, node)[i / 32],
+                        1UL << (i % 32));
+                    mark_structure_changed(rt, meta->snode_id);
                   },
                   [&]() { return *data_ptr == nullptr; });
     }
@@ -63,7 +117,7 @@ void Pointer_activate(Ptr meta_, Ptr node, int i) {
   }
 }
 
-void Pointer_deactivate(Ptr meta, Ptr node, int i) {
+void Pointer_deactivate_locked(Ptr meta, Ptr node, int i) {
   auto num_elements = Pointer_get_num_elements(meta, node);
   Ptr lock = node + 8 * i;
   Ptr &data_ptr = *(Ptr *)(node + 8 * (num_elements + i));
@@ -75,6 +129,9 @@ void Pointer_deactivate(Ptr meta, Ptr node, int i) {
         auto alloc = rt->node_allocators[smeta->snode_id];
         alloc->recycle(data_ptr);
         data_ptr = nullptr;
+        atomic_and_u32(&Pointer_get_active_mask_begin(meta, node)[i / 32],
+                       ~(1UL << (i % 32)));
+        mark_structure_changed(rt, smeta->snode_id);
       }
     });
   }
@@ -86,6 +143,10 @@ i32 Pointer_is_active(Ptr meta, Ptr node, int i) {
   return data_ptr != nullptr;
 }
 
+u32 Pointer_get_active_mask(Ptr meta, Ptr node, int word_id) {
+  return Pointer_get_active_mask_begin(meta, node)[word_id];
+}
+
 Ptr Pointer_lookup_element(Ptr meta, Ptr node, int i) {
   auto num_elements = Pointer_get_num_elements(meta, node);
   auto data_ptr = *(Ptr *)(node + 8 * (num_elements + i));
@@ -14,6 +14,7 @@
 
 #include "taichi/inc/constants.h"
 #include "taichi/math/arithmetic.h"
+#include "taichi/math/sifakis_svd.h"
 
 struct Context;
 using assert_failed_type = void (*)(const char *);
@@ -24,6 +25,8 @@ using host_vsnprintf_type = int (*)(char *,
                                     std::va_list);
 using vm_allocator_type = void *(*)(void *, std::size_t, std::size_t);
 using RangeForTaskFunc = void(Context *, const char *tls, int i);
+// Runs the iterations [begin, end) of a range-for
+using RangeForBlockFunc = void(Context *, const char *tls, int begin, int end);
 using parallel_for_type = void (*)(void *thread_pool,
                                    int splits,
                                    int num_desired_threads,
@@ -237,6 +240,86 @@ int max_i64(i64 a, i64 b) {
   return a > b ? a : b;
 }
 
+// Conversions between the bits of f16 and f32, for the CPUs without F16C.
+f32 f16_bits_to_f32(u16 h) {
+  u32 sign = (u32)(h & 0x8000) << 16;
+  u32 exp = (h >> 10) & 0x1f;
+  u32 mantissa = h & 0x3ff;
+  u32 bits;
+  if (exp == 0x1f) {
+    // inf or nan
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exp != 0) {
+    bits = sign | ((exp + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Normalizes the subnormal.
+    exp = 113;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      exp--;
+    }
+    bits = sign | (exp << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  return taichi_union_cast_with_different_sizes<f32>(bits);
+}
+
+// Rounds to the nearest even.
+u16 f32_to_f16_bits(f32 f) {
+  u32 x = taichi_union_cast_with_different_sizes<u32>(f);
+  u32 sign = (x >> 16) & 0x8000;
+  u32 exp = (x >> 23) & 0xff;
+  u32 mantissa = x & 0x7fffff;
+  if (exp == 0xff) {
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  i32 e = (i32)exp - 112;
+  if (e >= 0x1f) {
+    return sign | 0x7c00;
+  }
+  u32 shift = 13;
+  u32 h;
+  if (e <= 0) {
+    if (e < -10) {
+      return sign;
+    }
+    // Subnormal
+    mantissa |= 0x800000;
+    shift = 14 - e;
+    h = mantissa >> shift;
+  } else {
+    h = ((u32)e << 10) | (mantissa >> shift);
+  }
+  u32 rest = mantissa & ((1u << shift) - 1);
+  u32 halfway = 1u << (shift - 1);
+  // Carrying into the exponent rounds up to the next binade, or to inf.
+  if (rest > halfway || (rest == halfway && (h & 1))) {
+    h++;
+  }
+  return sign | h;
+}
+
+// There are no 16-bit atomics on all the targets: the f16 is updated with a
+// CAS on the 32-bit word holding it.
+f32 atomic_add_f16(u16 *dest, f32 val) {
+  auto addr = (u64)dest;
+  auto word = (u32 *)(addr & ~(u64)3);
+  u32 shift = (addr & 2) * 8;
+  u32 old_word;
+  u32 new_word;
+  u16 old_bits;
+  do {
+    old_word = *word;
+    old_bits = (u16)(old_word >> shift);
+    u16 new_bits = f32_to_f16_bits(f16_bits_to_f32(old_bits) + val);
+    new_word = (old_word & ~(0xffffu << shift)) | ((u32)new_bits << shift);
+  } while (!__atomic_compare_exchange(word, &old_word, &new_word, true,
+                                      std::memory_order::memory_order_seq_cst,
+                                      std::memory_order::memory_order_seq_cst));
+  return f16_bits_to_f32(old_bits);
+}
+
 int32 logic_not_i32(int32 a) {
   return !a;
 }
@@ -303,6 +386,23 @@ f64 pow_f64(f64 a, f64 b) {
   return std::pow(a, b);
 }
 
+// The 3x3 SVD of ti.svd, called by the kernels instead of expanding it into
+// statements. The inputs and outputs are row-major.
+#define DEFINE_SVD3X3(T, U)                                                  \
+  void svd3x3_##T(T a00, T a01, T a02, T a10, T a11, T a12, T a20, T a21,    \
+                  T a22, i32 sweeps, T *u00, T *u01, T *u02, T *u10, T *u11, \
+                  T *u12, T *u20, T *u21, T *u22, T *v00, T *v01, T *v02,    \
+                  T *v10, T *v11, T *v12, T *v20, T *v21, T *v22, T *sig0,   \
+                  T *sig1, T *sig2) {                                        \
+    SifakisSVD::svd<T, U>(a00, a01, a02, a10, a11, a12, a20, a21, a22, *u00, \
+                          *u01, *u02, *u10, *u11, *u12, *u20, *u21, *u22,    \
+                          *v00, *v01, *v02, *v10, *v11, *v12, *v20, *v21,    \
+                          *v22, *sig0, *sig1, *sig2, sweeps);                \
+  }
+
+DEFINE_SVD3X3(f32, u32);
+DEFINE_SVD3X3(f64, u64);
+
 f32 __nv_sgnf(f32 x) {
   return sgn_f32(x);
 }
@@ -322,6 +422,8 @@ STRUCT_FIELD_ARRAY(PhysicalCoordinates, val);
 
 STRUCT_FIELD_ARRAY(Context, args);
 STRUCT_FIELD(Context, runtime);
+STRUCT_FIELD(Context, range_for_begin);
+STRUCT_FIELD(Context, range_for_end);
 
 int32 Context_get_extra_args(Context *ctx, int32 i, int32 j) {
   return ctx->extra_args[i][j];
@@ -348,6 +450,17 @@ struct StructMeta {
 
   i32 (*get_num_elements)(Ptr, Ptr);
 
+  // Optional. Returns the activity of children [32 * word_id, 32 * word_id +
+  // 32) as a bitmask, so that listgen can skip empty regions without calling
+  // is_active() on every child.
+  u32 (*get_active_mask)(Ptr, Ptr, int word_id);
+
+  // Optional. For SNodes storing their children in slots (hash), returns the
+  // index of the child in a slot, or -1 if the slot holds no active child.
+  // The children are then enumerated by slot, i.e. the loop bounds of the
+  // elements and get_active_mask() refer to slots rather than indices.
+  i32 (*slot_to_index)(Ptr, Ptr, int slot);
+
   void (*refine_coordinates)(PhysicalCoordinates *inp_coord,
                              PhysicalCoordinates *refined_coord,
                              int index);
@@ -363,6 +476,8 @@ STRUCT_FIELD(StructMeta, lookup_element);
 STRUCT_FIELD(StructMeta, from_parent_element);
 STRUCT_FIELD(StructMeta, refine_coordinates);
 STRUCT_FIELD(StructMeta, is_active);
+STRUCT_FIELD(StructMeta, get_active_mask);
+STRUCT_FIELD(StructMeta, slot_to_index);
 STRUCT_FIELD(StructMeta, context);
 
 struct LLVMRuntime;
@@ -388,18 +503,86 @@ bool is_power_of_two(uint32 x) {
 
 /*
 A simple list data structure that is infinitely long.
-Data are organized in chunks, where each chunk is allocated on demand.
+Data are organized in chunks, where each chunk is allocated on demand. The
+chunk pointers are kept in a two-level directory: the groups of
+|chunk_group_size| pointers are allocated on demand too, so that the lists
+can have many small chunks without reserving room for all their pointers.
 */
 
 struct ListManager {
-  static constexpr std::size_t max_num_chunks = 1024;
-  Ptr chunks[max_num_chunks];
+  static constexpr int log2chunk_group_size = 10;
+  static constexpr int chunk_group_size = 1 << log2chunk_group_size;
+  static constexpr int max_num_chunk_groups = 1024;
+  static constexpr std::size_t max_num_chunks =
+      (std::size_t)chunk_group_size * max_num_chunk_groups;
+
+  // Maps the addresses in the chunks to the chunk ids, for ptr2index(). The
+  // address space is split into blocks of 2^log2block_size bytes, no smaller
+  // than a chunk, so that a chunk overlaps at most two blocks. Each of them
+  // gets an entry pointing to the chunk in an open-addressed hash table, at
+  // most half full. Entries are added under the lock of the list, and the
+  // table is rebuilt when chunks are released (see reindex_chunks()).
+  struct ChunkIndex {
+    i32 log2table_size;
+    i32 log2block_size;
+    i32 num_entries{0};
+    // The block of each entry plus one, 0 for empty entries.
+    u64 *blocks;
+    i32 *chunk_ids;
+
+    ChunkIndex(LLVMRuntime *runtime,
+               i32 log2table_size,
+               std::size_t chunk_size);
+
+    i32 table_size() const {
+      return 1 << log2table_size;
+    }
+
+    i32 first_slot(u64 block) const {
+      return (i32)((block * 0x9E3779B97F4A7C15ULL) >> (64 - log2table_size));
+    }
+
+    i32 next_slot(i32 slot) const {
+      return (slot + 1) & (table_size() - 1);
+    }
+
+    bool has_room_for_chunk() const {
+      return 2 * (num_entries + 2) <= table_size();
+    }
+
+    void clear() {
+      for (int i = 0; i < table_size(); i++) {
+        blocks[i] = 0;
+      }
+      num_entries = 0;
+    }
+
+    void insert(u64 block, i32 chunk_id);
+
+    void add_chunk(Ptr chunk, std::size_t chunk_size, i32 chunk_id) {
+      auto first_block = (u64)chunk >> log2block_size;
+      auto last_block = ((u64)chunk + chunk_size - 1) >> log2block_size;
+      insert(first_block, chunk_id);
+      if (last_block != first_block) {
+        insert(last_block, chunk_id);
+      }
+    }
+  };
+
+  Ptr *chunk_groups[max_num_chunk_groups];
   std::size_t element_size{0};
   std::size_t max_num_elements_per_chunk;
   i32 log2chunk_num_elements;
   i32 lock;
   i32 num_elements;
+  // The chunks allocated, and the most ever allocated at once.
+  i32 num_chunks{0};
+  i32 peak_num_chunks{0};
   LLVMRuntime *runtime;
+  // Only set for the lists whose ptr2index() is used, see enable_ptr2index().
+  // Replaced by a larger table as chunks are added, the old tables are left
+  // to the readers still using them.
+  ChunkIndex *chunk_index{nullptr};
 
   ListManager(LLVMRuntime *runtime,
               std::size_t element_size,
@@ -412,6 +595,9 @@ struct ListManager {
     lock = 0;
     num_elements = 0;
     log2chunk_num_elements = taichi::log2int(num_elements_per_chunk);
+    for (int i = 0; i < max_num_chunk_groups; i++) {
+      chunk_groups[i] = nullptr;
+    }
   }
 
   void append(void *data_ptr);
@@ -423,6 +609,17 @@ struct ListManager {
     return i;
   }
 
+  // Reserves |n| consecutive elements with a single atomic operation and
+  // returns the index of the first one.
+  i32 reserve_new_elements(i32 n) {
+    auto i = atomic_add_i32(&num_elements, n);
+    for (auto chunk_id = i >> log2chunk_num_elements;
+         chunk_id <= ((i + n - 1) >> log2chunk_num_elements); chunk_id++) {
+      touch_chunk(chunk_id);
+    }
+    return i;
+  }
+
   template <typename T>
   void push_back(const T &t) {
     this->append((void *)&t);
@@ -432,10 +629,31 @@ struct ListManager {
 
   void touch_chunk(int chunk_id);
 
+  // The chunk, or nullptr if it is not allocated.
+  Ptr get_chunk(i32 chunk_id) {
+    auto group = chunk_groups[chunk_id >> log2chunk_group_size];
+    if (group == nullptr)
+      return nullptr;
+    return group[chunk_id & (chunk_group_size - 1)];
+  }
+
+  // Only for the allocated chunks, e.g. when releasing them.
+  void set_chunk(i32 chunk_id, Ptr chunk) {
+    auto &entry = chunk_groups[chunk_id >> log2chunk_group_size]
+                              [chunk_id & (chunk_group_size - 1)];
+    if (entry != nullptr && chunk == nullptr)
+      num_chunks--;
+    entry = chunk;
+  }
+
   i32 get_num_active_chunks() {
     i32 counter = 0;
-    for (int i = 0; i < max_num_chunks; i++) {
-      counter += (chunks[i] != nullptr);
+    for (int g = 0; g < max_num_chunk_groups; g++) {
+      if (chunk_groups[g] == nullptr)
+        continue;
+      for (int i = 0; i < chunk_group_size; i++) {
+        counter += (chunk_groups[g][i] != nullptr);
+      }
     }
     return counter;
   }
@@ -449,7 +667,9 @@ struct ListManager {
   }
 
   Ptr get_element_ptr(i32 i) {
-    return chunks[i >> log2chunk_num_elements] +
+    auto chunk_id = i >> log2chunk_num_elements;
+    return chunk_groups[chunk_id >> log2chunk_group_size]
+                       [chunk_id & (chunk_group_size - 1)] +
            element_size * (i & ((1 << log2chunk_num_elements) - 1));
   }
 
@@ -467,13 +687,64 @@ struct ListManager {
     return num_elements;
   }
 
+  std::size_t get_chunk_size() {
+    return max_num_elements_per_chunk * element_size;
+  }
+
+  void enable_ptr2index();
+
+  // Adds the chunks to |index|. Concurrent reservations may allocate the
+  // chunks out of order.
+  void fill_chunk_index(ChunkIndex *index) {
+    for (int g = 0; g < max_num_chunk_groups; g++) {
+      if (chunk_groups[g] == nullptr)
+        continue;
+      for (int i = 0; i < chunk_group_size; i++) {
+        if (chunk_groups[g][i] != nullptr) {
+          index->add_chunk(chunk_groups[g][i], get_chunk_size(),
+                           (g << log2chunk_group_size) + i);
+        }
+      }
+    }
+  }
+
+  // Adds a chunk being allocated to |chunk_index|, under |lock|.
+  void index_chunk(Ptr chunk, i32 chunk_id);
+
+  // Rebuilds |chunk_index| after chunks are released. Must not run
+  // concurrently with ptr2index().
+  void reindex_chunks() {
+    if (chunk_index == nullptr)
+      return;
+    chunk_index->clear();
+    fill_chunk_index(chunk_index);
+  }
+
   i32 ptr2index(Ptr ptr) {
-    auto chunk_size = max_num_elements_per_chunk * element_size;
+    auto chunk_size = get_chunk_size();
+    auto index = chunk_index;
+    if (index != nullptr) {
+      auto block = (u64)ptr >> index->log2block_size;
+      for (auto slot = index->first_slot(block); index->blocks[slot] != 0;
+           slot = index->next_slot(slot)) {
+        if (index->blocks[slot] != block + 1)
+          continue;
+        auto i = index->chunk_ids[slot];
+        auto chunk = get_chunk(i);
+        if (chunk <= ptr && ptr < chunk + chunk_size) {
+          return (i << log2chunk_num_elements) +
+                 i32((ptr - chunk) / element_size);
+        }
+      }
+      taichi_assert_runtime(runtime, false, "ptr not found.");
+      return -1;
+    }
     for (int i = 0; i < max_num_chunks; i++) {
-      taichi_assert_runtime(runtime, chunks[i] != nullptr, "ptr not found.");
-      if (chunks[i] <= ptr && ptr < chunks[i] + chunk_size) {
+      auto chunk = get_chunk(i);
+      taichi_assert_runtime(runtime, chunk != nullptr, "ptr not found.");
+      if (chunk <= ptr && ptr < chunk + chunk_size) {
         return (i << log2chunk_num_elements) +
-               i32((ptr - chunks[i]) / element_size);
+               i32((ptr - chunk) / element_size);
       }
     }
     return -1;
@@ -492,12 +763,14 @@ STRUCT_FIELD(Element, element);
 STRUCT_FIELD(Element, pcoord);
 STRUCT_FIELD_ARRAY(Element, loop_bounds);
 
+// Zero-filled states are seeded on first use. The Philox generator only keeps
+// its counter in |x| and |y|, and needs no seeding.
 struct RandState {
   u32 x;
   u32 y;
   u32 z;
   u32 w;
-  i32 lock;
+  i32 initialized;
 };
 
 void initialize_rand_state(RandState *state, u32 i) {
@@ -505,7 +778,7 @@ void initialize_rand_state(RandState *state, u32 i) {
   state->y = 362436069;
   state->z = 521288629;
   state->w = 88675123;
-  state->lock = 0;
+  state->initialized = 1;
 }
 }
 
@@ -515,8 +788,10 @@ struct LLVMRuntime {
   bool preallocated;
   std::size_t preallocated_size;
 
-  Ptr preallocated_head;
-  Ptr preallocated_tail;
+  // Points to |preallocated_bounds_storage|, unless the host provides the
+  // bounds to commit device memory lazily.
+  PreallocatedBufferBounds *preallocated_bounds;
+  PreallocatedBufferBounds preallocated_bounds_storage;
 
   vm_allocator_type vm_allocator;
   assert_failed_type assert_failed;
@@ -525,18 +800,54 @@ struct LLVMRuntime {
   Ptr prog;
   Ptr root;
   size_t root_mem_size;
+  // The root buffers of the SNode trees, with |root| first, see
+  // runtime_initialize_snode_tree().
+  Ptr roots[taichi_max_num_snode_trees];
   Ptr thread_pool;
   parallel_for_type parallel_for;
   ListManager *element_lists[taichi_max_num_snodes];
+  // The lists the tasks of a parallel CPU listgen append to, before they are
+  // merged into the element list. Created on first use.
+  static constexpr int max_num_listgen_tasks = 64;
+  ListManager *listgen_task_lists[max_num_listgen_tasks];
+  // For reusing element lists across launches (incremental_listgen).
+  // |structure_versions| is bumped whenever a child of an instance of the
+  // SNode gets activated or deactivated, and |element_list_versions| whenever
+  // the element list of the SNode gets regenerated.
+  i32 structure_versions[taichi_max_num_snodes];
+  i32 element_list_versions[taichi_max_num_snodes];
+  // The (parent list version, parent structure version) that the current
+  // element list was generated from.
+  i32 element_list_sources[taichi_max_num_snodes][2];
+  i32 element_list_reused[taichi_max_num_snodes];
   NodeManager *node_allocators[taichi_max_num_snodes];
   Ptr ambient_elements[taichi_max_num_snodes];
   Ptr temporaries;
+  // Allocated by the first task using random numbers, see get_rand_state().
   RandState *rand_states;
+  i32 rand_states_lock;
   MemRequestQueue *mem_req_queue;
   Ptr allocate(std::size_t size);
   Ptr allocate_aligned(std::size_t size, std::size_t alignment);
   Ptr request_allocate_aligned(std::size_t size, std::size_t alignment);
   Ptr allocate_from_buffer(std::size_t size, std::size_t alignment);
+
+  // Zero-filled chunks of memory that lists gave back (see
+  // runtime_compact_node_allocator()). allocate_chunk() reuses them for
+  // requests of the same size before requesting new memory.
+  static constexpr int max_num_free_chunks = 1024;
+  Ptr free_chunks[max_num_free_chunks];
+  std::size_t free_chunk_sizes[max_num_free_chunks];
+  // Whether the host has returned the physical memory of the chunk to the OS
+  // (see Program::trim_memory()) since it was released.
+  bool free_chunk_trimmed[max_num_free_chunks];
+  i32 num_free_chunks;
+  i32 free_chunks_lock;
+  Ptr allocate_chunk(std::size_t size);
+  RandState *get_rand_state(i32 i);
+  // Returns false if there is no room to keep the chunk.
+  bool release_chunk(Ptr ptr, std::size_t size);
+
   Ptr profiler;
   void (*profiler_start)(Ptr, Ptr);
   void (*profiler_stop)(Ptr);
@@ -553,6 +864,25 @@ struct LLVMRuntime {
 
   i64 total_requested_memory;
 
+  // Filled by runtime_update_memory_stats(), one per SNode.
+  SNodeMemoryStats *memory_stats;
+  i32 num_snodes;
+
+  // The TLS buffers of the threads of deterministic range-fors on CUDA, and
+  // the number of their blocks that are done, see
+  // gpu_parallel_range_for_deterministic().
+  Ptr reduction_partials;
+  i32 reduction_num_blocks_done;
+
+  // The blocks of a persistent kernel on CUDA that reached the current grid
+  // barrier, and the number of barriers passed, see grid_barrier().
+  i32 grid_barrier_num_blocks;
+  i32 grid_barrier_generation;
+
+  // The counters of the branches and loops of the kernels compiled with
+  // CompileConfig::pgo_instrument, see profile_counter_add().
+  u64 *profile_counters;
+
   template <typename T>
   void set_result(std::size_t i, T t) {
     static_assert(sizeof(T) <= sizeof(uint64));
@@ -572,6 +902,7 @@ struct LLVMRuntime {
 STRUCT_FIELD_ARRAY(LLVMRuntime, element_lists);
 STRUCT_FIELD_ARRAY(LLVMRuntime, node_allocators);
 STRUCT_FIELD(LLVMRuntime, root);
+STRUCT_FIELD_ARRAY(LLVMRuntime, roots);
 STRUCT_FIELD(LLVMRuntime, root_mem_size);
 STRUCT_FIELD(LLVMRuntime, temporaries);
 STRUCT_FIELD(LLVMRuntime, assert_failed);
@@ -581,6 +912,13 @@ STRUCT_FIELD(LLVMRuntime, profiler);
 STRUCT_FIELD(LLVMRuntime, profiler_start);
 STRUCT_FIELD(LLVMRuntime, profiler_stop);
 
+#if ARCH_cuda
+extern "C" {
+i32 linear_thread_idx();
+i32 warp_size();
+}
+#endif
+
 // NodeManager of node S (hash, pointer) managers the memory allocation of S_ch
 // It makes use of three ListManagers.
 struct NodeManager {
@@ -594,6 +932,27 @@ struct NodeManager {
   ListManager *free_list, *recycled_list, *data_list;
   i32 recycle_list_size_backup;
 
+  // When the free list runs out, new slots are handed out from one of these
+  // caches instead of hitting |data_list| on every allocation. Each cache holds
+  // a batch of reserved but not yet used |data_list| indices [begin, end),
+  // packed as (end << 32) | begin, so that popping is a single CAS. Threads (on
+  // CPU) or warps (on CUDA) are spread over the caches to reduce contention.
+  static constexpr int num_slot_caches = 64;
+  u64 slot_caches[num_slot_caches];
+  i32 slot_cache_locks[num_slot_caches];
+  i32 slot_cache_batch_size;
+  // One node per slot cache, allocated by a thread that lost the race to
+  // publish it (see Pointer_activate()). Since it was never used, it is still
+  // zero-filled and handed out again right away, without waiting for a GC.
+  Ptr spare_nodes[num_slot_caches];
+
+  // See SNode::gc_threshold
+  f32 gc_threshold;
+  i32 gc_period;
+  i32 num_skipped_gcs;
+
+  i32 peak_num_live;
+
   using list_data_type = i32;
 
   NodeManager(LLVMRuntime *runtime,
@@ -604,32 +963,132 @@ struct NodeManager {
     if (chunk_num_elements == -1) {
       chunk_num_elements = 16 * 1024;
     }
-    // Maximum chunk size = 128 MB
+    // Maximum chunk size = 4 MB
     while (chunk_num_elements > 1 &&
-           (uint64)chunk_num_elements * element_size > 128UL * 1024 * 1024) {
+           (uint64)chunk_num_elements * element_size > 4UL * 1024 * 1024) {
       chunk_num_elements /= 2;
     }
     this->chunk_num_elements = chunk_num_elements;
     free_list_used = 0;
+    gc_threshold = 0;
+    gc_period = 0;
+    num_skipped_gcs = 0;
+    peak_num_live = 0;
     free_list = runtime->create<ListManager>(runtime, sizeof(list_data_type),
                                              chunk_num_elements);
     recycled_list = runtime->create<ListManager>(
         runtime, sizeof(list_data_type), chunk_num_elements);
     data_list =
         runtime->create<ListManager>(runtime, element_size, chunk_num_elements);
+    // recycle() locates the nodes in |data_list|.
+    data_list->enable_ptr2index();
+    for (int i = 0; i < num_slot_caches; i++) {
+      slot_caches[i] = 0;
+      slot_cache_locks[i] = 0;
+      spare_nodes[i] = nullptr;
+    }
+    // Small node managers (e.g. in runtime tests) still get one slot at a
+    // time, so that indices are handed out in order.
+    slot_cache_batch_size =
+        max_i32(1, min_i32(32, chunk_num_elements / num_slot_caches));
   }
 
   Ptr allocate() {
-    int old_cursor = atomic_add_i32(&free_list_used, 1);
-    i32 l;
-    if (old_cursor >= free_list->size()) {
-      // running out of free list. allocate new.
-      l = data_list->reserve_new_element();
-    } else {
-      // reuse
-      l = free_list->get<list_data_type>(old_cursor);
+    auto cache_id = get_slot_cache_id();
+    if (spare_nodes[cache_id] != nullptr) {
+      auto spare =
+          (Ptr)atomic_exchange_u64((u64 *)&spare_nodes[cache_id], 0);
+      if (spare != nullptr) {
+        return spare;
+      }
+    }
+    if (free_list_used < free_list->size()) {
+      int old_cursor = atomic_add_i32(&free_list_used, 1);
+      if (old_cursor < free_list->size()) {
+        // reuse
+        return data_list->get_element_ptr(
+            free_list->get<list_data_type>(old_cursor));
+      }
+    }
+    // running out of free list. allocate new.
+    return data_list->get_element_ptr(allocate_from_slot_cache(cache_id));
+  }
+
+  // Takes back a node from allocate() that was never used.
+  void release_unused(Ptr ptr) {
+    auto cache_id = get_slot_cache_id();
+    if (atomic_cas_u64((u64 *)&spare_nodes[cache_id], 0, (u64)ptr) != 0) {
+      // The spare slot is taken. The node will be reused after the next GC.
+      recycle(ptr);
+    }
+  }
+
+  i32 get_slot_cache_id() {
+#if ARCH_cuda
+    return (linear_thread_idx() / warp_size()) % num_slot_caches;
+#else
+    // There is no cheap thread id on CPU. Stacks of different threads live in
+    // different pages, so hash the address of a local variable instead.
+    i32 local;
+    return (i32)((((u64)&local >> 12) * 0x9E3779B97F4A7C15ULL) >> 58);
+#endif
+  }
+
+  i32 allocate_from_slot_cache(i32 cache_id) {
+    auto cache = &slot_caches[cache_id];
+    while (true) {
+      u64 old_value = __atomic_load_n(cache, __ATOMIC_SEQ_CST);
+      auto begin = (i32)(old_value & 0xFFFFFFFFULL);
+      auto end = (i32)(old_value >> 32);
+      if (begin < end) {
+        u64 new_value = old_value + 1;
+        if (__atomic_compare_exchange(cache, &old_value, &new_value, true,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+          return begin;
+        }
+        continue;
+      }
+      // The cache is exhausted. Since poppers never touch an empty cache, the
+      // lock holder is the only one that can refill it.
+      locked_task(
+          &slot_cache_locks[cache_id],
+          [&] {
+            auto n = slot_cache_batch_size;
+            auto first = data_list->reserve_new_elements(n);
+            atomic_exchange_u64(cache, ((u64)(first + n) << 32) | (u64)first);
+          },
+          [&] {
+            auto value = __atomic_load_n(cache, __ATOMIC_SEQ_CST);
+            return (i32)(value & 0xFFFFFFFFULL) >= (i32)(value >> 32);
+          });
     }
-    return data_list->get_element_ptr(l);
+  }
+
+  // Number of |data_list| slots handed out so far, excluding the ones still
+  // sitting in the slot caches.
+  i32 get_num_allocated() {
+    i32 num_allocated = data_list->size();
+    for (int i = 0; i < num_slot_caches; i++) {
+      auto value = slot_caches[i];
+      num_allocated -= max_i32(
+          (i32)(value >> 32) - (i32)(value & 0xFFFFFFFFULL), 0);
+      num_allocated -= spare_nodes[i] != nullptr;
+    }
+    return num_allocated;
+  }
+
+  // The nodes handed out and not deactivated since.
+  i32 get_num_live() {
+    return get_num_allocated() -
+           max_i32(free_list->size() - free_list_used, 0) -
+           recycled_list->size();
+  }
+
+  // Nodes are allocated too often to count the live ones on the way, so
+  // |peak_num_live| is only updated at the GCs, before the recycled nodes
+  // return to the free list, and when the host asks for the stats.
+  void sample_peak() {
+    peak_num_live = max_i32(peak_num_live, get_num_live());
   }
 
   i32 locate(Ptr ptr) {
@@ -641,6 +1100,22 @@ struct NodeManager {
     recycled_list->append(&index);
   }
 
+  // Whether a requested GC should run now. Does not modify any state, so that
+  // all the GC tasks on CUDA reach the same decision.
+  bool should_gc() {
+    if (gc_threshold <= 0) {
+      return true;
+    }
+    auto num_recycled = recycled_list->size();
+    if (num_recycled == 0) {
+      return false;
+    }
+    if ((f32)num_recycled >= gc_threshold * (f32)get_num_allocated()) {
+      return true;
+    }
+    return gc_period > 0 && num_skipped_gcs + 1 >= gc_period;
+  }
+
   void gc_serial() {
     // compact free list
     for (int i = free_list_used; i < free_list->size(); i++) {
@@ -705,12 +1180,68 @@ void runtime_ListManager_get_num_active_chunks(LLVMRuntime *runtime,
 RUNTIME_STRUCT_FIELD_ARRAY(LLVMRuntime, node_allocators);
 RUNTIME_STRUCT_FIELD_ARRAY(LLVMRuntime, element_lists);
 RUNTIME_STRUCT_FIELD(LLVMRuntime, total_requested_memory);
+RUNTIME_STRUCT_FIELD(LLVMRuntime, root);
+RUNTIME_STRUCT_FIELD_ARRAY(LLVMRuntime, roots);
+RUNTIME_STRUCT_FIELD(LLVMRuntime, num_free_chunks);
+RUNTIME_STRUCT_FIELD(LLVMRuntime, profile_counters);
+RUNTIME_STRUCT_FIELD_ARRAY(LLVMRuntime, free_chunks);
+
+// Returns the size of free chunk |i| and marks it trimmed, or returns 0 if it
+// has been trimmed before. No kernels may run meanwhile.
+void runtime_trim_free_chunk(LLVMRuntime *runtime, int i) {
+  std::size_t size = 0;
+  if (!runtime->free_chunk_trimmed[i]) {
+    runtime->free_chunk_trimmed[i] = true;
+    size = runtime->free_chunk_sizes[i];
+  }
+  runtime->set_result(taichi_result_buffer_runtime_query_id, size);
+}
 
 RUNTIME_STRUCT_FIELD(NodeManager, free_list);
 RUNTIME_STRUCT_FIELD(NodeManager, recycled_list);
 RUNTIME_STRUCT_FIELD(NodeManager, data_list);
 RUNTIME_STRUCT_FIELD(NodeManager, free_list_used);
 
+void runtime_NodeManager_get_num_allocated(LLVMRuntime *runtime,
+                                           NodeManager *node_manager) {
+  runtime->set_result(taichi_result_buffer_runtime_query_id,
+                      node_manager->get_num_allocated());
+}
+
+// Gathers the memory usage of all the SNodes into |runtime->memory_stats|,
+// and returns its address.
+void runtime_update_memory_stats(LLVMRuntime *runtime) {
+  for (int i = 0; i < runtime->num_snodes; i++) {
+    auto &stats = runtime->memory_stats[i];
+    auto list = runtime->element_lists[i];
+    stats.element_list_size = list->size();
+    stats.element_list_num_chunks = list->num_chunks;
+    stats.element_list_chunk_size = list->get_chunk_size();
+    auto allocator = runtime->node_allocators[i];
+    if (allocator == nullptr) {
+      stats.num_allocated_nodes = 0;
+      stats.num_live_nodes = 0;
+      stats.peak_num_live_nodes = 0;
+      stats.node_size = 0;
+      stats.num_chunks = 0;
+      stats.peak_num_chunks = 0;
+      stats.chunk_size = 0;
+      continue;
+    }
+    allocator->sample_peak();
+    auto data_list = allocator->data_list;
+    stats.num_allocated_nodes = allocator->get_num_allocated();
+    stats.num_live_nodes = allocator->get_num_live();
+    stats.peak_num_live_nodes = allocator->peak_num_live;
+    stats.node_size = allocator->element_size;
+    stats.num_chunks = data_list->num_chunks;
+    stats.peak_num_chunks = data_list->peak_num_chunks;
+    stats.chunk_size = data_list->get_chunk_size();
+  }
+  runtime->set_result(taichi_result_buffer_runtime_query_id,
+                      runtime->memory_stats);
+}
+
 RUNTIME_STRUCT_FIELD(ListManager, num_elements);
 RUNTIME_STRUCT_FIELD(ListManager, max_num_elements_per_chunk);
 RUNTIME_STRUCT_FIELD(ListManager, element_size);
@@ -764,13 +1295,15 @@ Ptr LLVMRuntime::allocate_from_buffer(std::size_t size, std::size_t alignment) {
   Ptr ret;
   bool success = false;
   locked_task(&allocator_lock, [&] {
+    // The host may move |tail| concurrently.
+    volatile PreallocatedBufferBounds *bounds = preallocated_bounds;
+    Ptr head = bounds->head;
     auto alignment_bytes =
-        alignment - 1 -
-        ((std::size_t)preallocated_head + alignment - 1) % alignment;
+        alignment - 1 - ((std::size_t)head + alignment - 1) % alignment;
     size += alignment_bytes;
-    if (preallocated_head + size <= preallocated_tail) {
-      ret = preallocated_head;
-      preallocated_head += size;
+    if (head + size <= bounds->tail) {
+      ret = head + alignment_bytes;
+      bounds->head = head + size;
       success = true;
     } else {
       success = false;
@@ -816,6 +1349,43 @@ Ptr LLVMRuntime::request_allocate_aligned(std::size_t size,
   }
 }
 
+Ptr LLVMRuntime::allocate_chunk(std::size_t size) {
+  Ptr ret = nullptr;
+  if (num_free_chunks > 0) {
+    locked_task(&free_chunks_lock, [&] {
+      for (int i = num_free_chunks - 1; i >= 0; i--) {
+        if (free_chunk_sizes[i] == size) {
+          ret = free_chunks[i];
+          num_free_chunks--;
+          free_chunks[i] = free_chunks[num_free_chunks];
+          free_chunk_sizes[i] = free_chunk_sizes[num_free_chunks];
+          free_chunk_trimmed[i] = free_chunk_trimmed[num_free_chunks];
+          break;
+        }
+      }
+    });
+  }
+  if (ret == nullptr) {
+    ret = request_allocate_aligned(size, taichi_page_size);
+  }
+  return ret;
+}
+
+bool LLVMRuntime::release_chunk(Ptr ptr, std::size_t size) {
+  bool released = false;
+  locked_task(&free_chunks_lock, [&] {
+    if (num_free_chunks < max_num_free_chunks) {
+      std::memset(ptr, 0, size);
+      free_chunks[num_free_chunks] = ptr;
+      free_chunk_sizes[num_free_chunks] = size;
+      free_chunk_trimmed[num_free_chunks] = false;
+      num_free_chunks++;
+      released = true;
+    }
+  });
+  return released;
+}
+
 void runtime_get_mem_req_queue(LLVMRuntime *runtime) {
   runtime->set_result(taichi_result_buffer_ret_value_id,
                       runtime->mem_req_queue);
@@ -828,6 +1398,7 @@ void runtime_initialize(
     std::size_t
         preallocated_size,  // Non-zero means use the preallocated buffer
     Ptr preallocated_buffer,
+    void *_preallocated_bounds,  // nullptr means using the runtime's own
     i32 num_rand_states,
     void *_vm_allocator,
     void *_host_printf,
@@ -850,8 +1421,14 @@ void runtime_initialize(
       taichi::iroundup((size_t)root_size, taichi_page_size);
 
   runtime->preallocated = preallocated_size > 0;
-  runtime->preallocated_head = preallocated_buffer;
-  runtime->preallocated_tail = preallocated_tail;
+  if (_preallocated_bounds) {
+    runtime->preallocated_bounds =
+        (PreallocatedBufferBounds *)_preallocated_bounds;
+  } else {
+    runtime->preallocated_bounds = &runtime->preallocated_bounds_storage;
+    runtime->preallocated_bounds->tail = preallocated_tail;
+  }
+  runtime->preallocated_bounds->head = preallocated_buffer;
 
   runtime->result_buffer = result_buffer;
   runtime->set_result(taichi_result_buffer_ret_value_id, runtime);
@@ -861,6 +1438,10 @@ void runtime_initialize(
   runtime->prog = prog;
 
   runtime->total_requested_memory = 0;
+  runtime->num_free_chunks = 0;
+  runtime->free_chunks_lock = 0;
+  runtime->grid_barrier_num_blocks = 0;
+  runtime->grid_barrier_generation = 0;
 
   // runtime->allocate ready to use
   runtime->mem_req_queue = (MemRequestQueue *)runtime->allocate_aligned(
@@ -876,26 +1457,35 @@ void runtime_initialize(
   runtime->temporaries = (Ptr)runtime->allocate_aligned(
       taichi_global_tmp_buffer_size, taichi_page_size);
 
+  // Programs that never call ti.random() never allocate the states.
   runtime->num_rand_states = num_rand_states;
-  runtime->rand_states = (RandState *)runtime->allocate_aligned(
-      sizeof(RandState) * runtime->num_rand_states, taichi_page_size);
-  for (int i = 0; i < runtime->num_rand_states; i++)
-    initialize_rand_state(&runtime->rand_states[i], i);
-}
+  runtime->rand_states = nullptr;
+  runtime->rand_states_lock = 0;
 
-void runtime_initialize2(LLVMRuntime *runtime, int root_id, int num_snodes) {
-  // runtime->request_allocate_aligned ready to use
+  for (int i = 0; i < LLVMRuntime::max_num_listgen_tasks; i++) {
+    runtime->listgen_task_lists[i] = nullptr;
+  }
+}
 
-  // initialize the root node element list
-  for (int i = 0; i < num_snodes; i++) {
+// Creates the element lists of the SNodes with ids in [begin, end).
+void initialize_element_lists(LLVMRuntime *runtime, int begin, int end) {
+  for (int i = begin; i < end; i++) {
     // TODO: some SNodes do not actually need an element list.
     runtime->element_lists[i] =
         runtime->create<ListManager>(runtime, sizeof(Element), 1024 * 64);
+    runtime->structure_versions[i] = 0;
+    runtime->element_list_versions[i] = 0;
+    runtime->element_list_sources[i][0] = -1;
+    runtime->element_list_sources[i][1] = -1;
+    runtime->element_list_reused[i] = 0;
   }
+}
+
+void append_root_element(LLVMRuntime *runtime, int root_id, Ptr root) {
   Element elem;
   elem.loop_bounds[0] = 0;
   elem.loop_bounds[1] = 1;
-  elem.element = runtime->root;
+  elem.element = root;
   for (int i = 0; i < taichi_max_num_indices; i++) {
     elem.pcoord.val[i] = 0;
   }
@@ -903,6 +1493,43 @@ void runtime_initialize2(LLVMRuntime *runtime, int root_id, int num_snodes) {
   runtime->element_lists[root_id]->append(&elem);
 }
 
+void runtime_initialize2(LLVMRuntime *runtime, int root_id, int num_snodes) {
+  // runtime->request_allocate_aligned ready to use
+
+  runtime->num_snodes = num_snodes;
+  runtime->memory_stats = (SNodeMemoryStats *)runtime->request_allocate_aligned(
+      sizeof(SNodeMemoryStats) * num_snodes, taichi_page_size);
+
+  // initialize the root node element list
+  initialize_element_lists(runtime, 0, num_snodes);
+  runtime->roots[0] = runtime->root;
+  for (int i = 1; i < taichi_max_num_snode_trees; i++) {
+    runtime->roots[i] = nullptr;
+  }
+  append_root_element(runtime, root_id, runtime->root);
+}
+
+// Allocates the zero-filled root buffer of SNode tree |tree_id|, materialized
+// after the others, and the element lists of the SNodes created since, so
+// that there are |num_snodes| in total.
+void runtime_initialize_snode_tree(LLVMRuntime *runtime,
+                                   int tree_id,
+                                   int root_id,
+                                   std::size_t root_size,
+                                   int num_snodes) {
+  runtime->roots[tree_id] = runtime->request_allocate_aligned(
+      taichi::iroundup(root_size, taichi_page_size), taichi_page_size);
+  if (num_snodes > runtime->num_snodes) {
+    initialize_element_lists(runtime, runtime->num_snodes, num_snodes);
+    // The stats of the earlier SNodes are gathered again on the next query.
+    runtime->memory_stats =
+        (SNodeMemoryStats *)runtime->request_allocate_aligned(
+            sizeof(SNodeMemoryStats) * num_snodes, taichi_page_size);
+    runtime->num_snodes = num_snodes;
+  }
+  append_root_element(runtime, root_id, runtime->roots[tree_id]);
+}
+
 void LLVMRuntime_initialize_thread_pool(LLVMRuntime *runtime,
                                         void *thread_pool,
                                         void *parallel_for) {
@@ -917,6 +1544,15 @@ void runtime_NodeAllocator_initialize(LLVMRuntime *runtime,
       runtime->create<NodeManager>(runtime, node_size, 1024 * 16);
 }
 
+void runtime_NodeAllocator_set_gc_policy(LLVMRuntime *runtime,
+                                         int snode_id,
+                                         f32 gc_threshold,
+                                         int gc_period) {
+  auto allocator = runtime->node_allocators[snode_id];
+  allocator->gc_threshold = gc_threshold;
+  allocator->gc_period = gc_period;
+}
+
 void runtime_allocate_ambient(LLVMRuntime *runtime,
                               int snode_id,
                               std::size_t size) {
@@ -926,6 +1562,25 @@ void runtime_allocate_ambient(LLVMRuntime *runtime,
       runtime->request_allocate_aligned(size, 128);
 }
 
+void runtime_allocate_reduction_partials(LLVMRuntime *runtime,
+                                         std::size_t size) {
+  runtime->reduction_partials = runtime->request_allocate_aligned(size, 128);
+  runtime->reduction_num_blocks_done = 0;
+}
+
+void runtime_allocate_profile_counters(LLVMRuntime *runtime,
+                                       i32 num_counters) {
+  runtime->profile_counters = (u64 *)runtime->request_allocate_aligned(
+      sizeof(u64) * num_counters, taichi_page_size);
+  for (int i = 0; i < num_counters; i++) {
+    runtime->profile_counters[i] = 0;
+  }
+}
+
+void profile_counter_add(LLVMRuntime *runtime, i32 i, i64 value) {
+  atomic_add_i64((i64 *)&runtime->profile_counters[i], value);
+}
+
 void mutex_lock_i32(Ptr mutex) {
   while (atomic_exchange_i32((i32 *)mutex, 1) == 1)
     ;
@@ -963,6 +1618,10 @@ int32 cttz_i32(i32 val) {
   return 0;
 }
 
+int32 popc_i32(i32 val) {
+  return 0;
+}
+
 int32 cuda_compute_capability() {
   return 0;
 }
@@ -979,6 +1638,29 @@ i32 cuda_shfl_down_i32(i32 delta, i32 val, int width) {
   return 0;
 }
 
+f32 cuda_shfl_down_sync_f32(u32 mask, f32 val, i32 delta, int width) {
+  return 0;
+}
+
+i64 cuda_shfl_down_sync_i64(u32 mask, i64 val, i32 delta, int width) {
+  auto lo = cuda_shfl_down_sync_i32(mask, (i32)(u32)(u64)val, delta, width);
+  auto hi = cuda_shfl_down_sync_i32(mask, (i32)(u32)((u64)val >> 32), delta,
+                                    width);
+  return (i64)(((u64)(u32)hi << 32) | (u64)(u32)lo);
+}
+
+f64 cuda_shfl_down_sync_f64(u32 mask, f64 val, i32 delta, int width) {
+  i64 bits;
+  std::memcpy(&bits, &val, sizeof(bits));
+  bits = cuda_shfl_down_sync_i64(mask, bits, delta, width);
+  std::memcpy(&val, &bits, sizeof(val));
+  return val;
+}
+
+i32 cuda_shfl_sync_i32(u32 mask, i32 val, i32 src_lane, int width) {
+  return 0;
+}
+
 int32 cuda_ballot_sync(int32 mask, bool bit) {
   return 0;
 }
@@ -1029,11 +1711,34 @@ void grid_memfence() {
 
 // "Element", "component" are different concepts
 
-void clear_list(LLVMRuntime *runtime, StructMeta *parent, StructMeta *child) {
-  auto child_list = runtime->element_lists[child->snode_id];
+void clear_list(LLVMRuntime *runtime,
+                StructMeta *parent,
+                StructMeta *child,
+                i32 reusable) {
+  auto child_id = child->snode_id;
+  auto parent_list_version = runtime->element_list_versions[parent->snode_id];
+  auto parent_structure_version =
+      runtime->structure_versions[parent->snode_id];
+  auto sources = runtime->element_list_sources[child_id];
+  if (reusable && sources[0] == parent_list_version &&
+      sources[1] == parent_structure_version) {
+    // Neither the parent list nor the activity of its children changed since
+    // the last listgen, so the old list is still valid.
+    runtime->element_list_reused[child_id] = 1;
+    return;
+  }
+  runtime->element_list_reused[child_id] = 0;
+  runtime->element_list_versions[child_id]++;
+  sources[0] = reusable ? parent_list_version : -1;
+  sources[1] = reusable ? parent_structure_version : -1;
+  auto child_list = runtime->element_lists[child_id];
   child_list->clear();
 }
 
+void mark_structure_changed(LLVMRuntime *runtime, int snode_id) {
+  atomic_add_i32(&runtime->structure_versions[snode_id], 1);
+}
+
 /*
  * The element list of a SNode, maintains pointers to its instances, and
  * instances' parents' coordinates
@@ -1044,6 +1749,9 @@ void clear_list(LLVMRuntime *runtime, StructMeta *parent, StructMeta *child) {
 void element_listgen_root(LLVMRuntime *runtime,
                           StructMeta *parent,
                           StructMeta *child) {
+  if (runtime->element_list_reused[child->snode_id]) {
+    return;
+  }
   // If there's just one element in the parent list, we need to use the blocks
   // (instead of threads) to split the parent container
   auto parent_list = runtime->element_lists[parent->snode_id];
@@ -1092,60 +1800,187 @@ void element_listgen_root(LLVMRuntime *runtime,
   }
 }
 
-void element_listgen_nonroot(LLVMRuntime *runtime,
-                             StructMeta *parent,
-                             StructMeta *child) {
-  auto parent_list = runtime->element_lists[parent->snode_id];
-  int num_parent_elements = parent_list->size();
-  auto child_list = runtime->element_lists[child->snode_id];
-  // Cache the func pointers here for better compiler optimization
+using element_listgen_expand_func = void(Context *, void *, int);
+
+struct element_listgen_context {
+  Context *context;
+  ListManager *parent_list;
+  int num_parent_elements;
+  // CPU only: task w expands the parent elements [w * num_parent_elements /
+  // num_tasks, (w + 1) * num_parent_elements / num_tasks) into
+  // |task_lists[w]| with |expand|, and the task lists are then copied to
+  // |child_list| from |task_offsets[w]|.
+  element_listgen_expand_func *expand;
+  int num_tasks;
+  ListManager **task_lists;
+  ListManager *child_list;
+  i32 task_offsets[LLVMRuntime::max_num_listgen_tasks];
+};
+
+// Appends the children of the parent elements i_start, i_start + i_step, ...
+// to |output|, visiting the children j_start, j_start + j_step, ... of each.
+// The func pointers are loaded from |parent| and |child| before any call, so
+// that they become direct calls, and get inlined, where the metas are built.
+void element_listgen_expand(element_listgen_context &ctx,
+                            StructMeta *parent,
+                            StructMeta *child,
+                            int i_start,
+                            int i_end,
+                            int i_step,
+                            int j_start,
+                            int j_step,
+                            ListManager *output) {
   auto parent_refine_coordinates = parent->refine_coordinates;
   auto parent_is_active = parent->is_active;
+  auto parent_get_active_mask = parent->get_active_mask;
+  auto parent_slot_to_index = parent->slot_to_index;
   auto parent_lookup_element = parent->lookup_element;
   auto child_get_num_elements = child->get_num_elements;
   auto child_from_parent_element = child->from_parent_element;
-#if ARCH_cuda
-  // Each block processes a slice of a parent container
-  int i_start = block_idx();
-  int i_step = grid_dim();
-  // Each thread processes an element of the parent container
-  int j_start = thread_idx();
-  int j_step = block_dim();
-#else
-  int i_start = 0;
-  int i_step = 1;
-  int j_start = 0;
-  int j_step = 1;
-#endif
-  for (int i = i_start; i < num_parent_elements; i += i_step) {
-    auto element = parent_list->get<Element>(i);
-    int j_lower = element.loop_bounds[0] + j_start;
-    int j_higher = element.loop_bounds[1];
-    for (int j = j_lower; j < j_higher; j += j_step) {
+  for (int i = i_start; i < i_end; i += i_step) {
+    auto element = ctx.parent_list->get<Element>(i);
+    auto gen_child = [&](int j) {
+      if (parent_slot_to_index) {
+        j = parent_slot_to_index((Ptr)parent, element.element, j);
+        if (j < 0)
+          return;
+      }
       PhysicalCoordinates refined_coord;
       parent_refine_coordinates(&element.pcoord, &refined_coord, j);
-      if (parent_is_active((Ptr)parent, element.element, j)) {
-        auto ch_element =
-            parent_lookup_element((Ptr)parent, element.element, j);
-        ch_element = child_from_parent_element((Ptr)ch_element);
-        auto ch_num_elements = child_get_num_elements((Ptr)child, ch_element);
-        auto ch_element_size =
-            std::min(ch_num_elements, taichi_listgen_max_element_size);
-        for (int ch_lower = 0; ch_lower < ch_num_elements;
-             ch_lower += ch_element_size) {
-          Element elem;
-          elem.element = ch_element;
-          elem.loop_bounds[0] = ch_lower;
-          elem.loop_bounds[1] =
-              std::min(ch_lower + ch_element_size, ch_num_elements);
-          elem.pcoord = refined_coord;
-          child_list->append(&elem);
+      auto ch_element = parent_lookup_element((Ptr)parent, element.element, j);
+      ch_element = child_from_parent_element((Ptr)ch_element);
+      auto ch_num_elements = child_get_num_elements((Ptr)child, ch_element);
+      auto ch_element_size =
+          std::min(ch_num_elements, taichi_listgen_max_element_size);
+      for (int ch_lower = 0; ch_lower < ch_num_elements;
+           ch_lower += ch_element_size) {
+        Element elem;
+        elem.element = ch_element;
+        elem.loop_bounds[0] = ch_lower;
+        elem.loop_bounds[1] =
+            std::min(ch_lower + ch_element_size, ch_num_elements);
+        elem.pcoord = refined_coord;
+        output->append(&elem);
+      }
+    };
+    if (parent_get_active_mask) {
+      // Walk the occupancy mask 32 children at a time, visiting only the
+      // active ones. This is much faster than checking every child when the
+      // parent is sparsely populated.
+      int j_begin = element.loop_bounds[0];
+      int j_end = element.loop_bounds[1];
+      for (int w = j_begin / 32 + j_start; w * 32 < j_end; w += j_step) {
+        auto mask = parent_get_active_mask((Ptr)parent, element.element, w);
+        while (mask != 0) {
+          int j = w * 32 + __builtin_ctz(mask);
+          mask &= mask - 1;
+          if (j_begin <= j && j < j_end) {
+            gen_child(j);
+          }
+        }
+      }
+    } else {
+      int j_lower = element.loop_bounds[0] + j_start;
+      int j_higher = element.loop_bounds[1];
+      for (int j = j_lower; j < j_higher; j += j_step) {
+        if (parent_is_active((Ptr)parent, element.element, j)) {
+          gen_child(j);
         }
       }
     }
   }
 }
 
+// The body of the |expand| function that the codegen emits for each pair of
+// parent and child SNodes, with the metas of both.
+void element_listgen_expand_range(void *ctx_,
+                                  StructMeta *parent,
+                                  StructMeta *child,
+                                  int w) {
+  auto &ctx = *(element_listgen_context *)ctx_;
+  auto list = ctx.task_lists[w];
+  list->clear();
+  element_listgen_expand(
+      ctx, parent, child, (i64)w * ctx.num_parent_elements / ctx.num_tasks,
+      (i64)(w + 1) * ctx.num_parent_elements / ctx.num_tasks, 1, 0, 1, list);
+}
+
+void element_listgen_expand_task(void *ctx_, int w) {
+  auto &ctx = *(element_listgen_context *)ctx_;
+  ctx.expand(ctx.context, ctx_, w);
+}
+
+void element_listgen_merge_task(void *ctx_, int w) {
+  auto &ctx = *(element_listgen_context *)ctx_;
+  auto list = ctx.task_lists[w];
+  auto offset = ctx.task_offsets[w];
+  for (int k = 0; k < list->size(); k++) {
+    ctx.child_list->get<Element>(offset + k) = list->get<Element>(k);
+  }
+}
+
+// |expand| is the specialization of element_listgen_expand_range() for the
+// pair of SNodes, or nullptr on GPUs.
+void element_listgen_nonroot(LLVMRuntime *runtime,
+                             StructMeta *parent,
+                             StructMeta *child,
+                             int num_threads,
+                             element_listgen_expand_func *expand) {
+  if (runtime->element_list_reused[child->snode_id]) {
+    return;
+  }
+  element_listgen_context ctx;
+  ctx.context = parent->context;
+  ctx.parent_list = runtime->element_lists[parent->snode_id];
+  ctx.num_parent_elements = ctx.parent_list->size();
+  ctx.child_list = runtime->element_lists[child->snode_id];
+#if ARCH_cuda
+  // Each block processes a slice of a parent container, and each thread an
+  // element (or a mask word) of the parent container
+  element_listgen_expand(ctx, parent, child, block_idx(),
+                         ctx.num_parent_elements, grid_dim(), thread_idx(),
+                         block_dim(), ctx.child_list);
+#else
+  // Below this many parent elements, waking up the thread pool costs more
+  // than the listgen itself.
+  constexpr int parallel_listgen_threshold = 64;
+  if (num_threads <= 1 || runtime->parallel_for == nullptr ||
+      expand == nullptr ||
+      ctx.num_parent_elements < parallel_listgen_threshold) {
+    element_listgen_expand(ctx, parent, child, 0, ctx.num_parent_elements, 1,
+                           0, 1, ctx.child_list);
+    return;
+  }
+  // The tasks expand consecutive ranges of the parent list into their own
+  // lists, which are then concatenated in order, so that the element list is
+  // the same as the one of the serial listgen.
+  ctx.expand = expand;
+  ctx.num_tasks = min_i32(
+      min_i32(num_threads * 4, LLVMRuntime::max_num_listgen_tasks),
+      ctx.num_parent_elements / (parallel_listgen_threshold / 4));
+  ctx.task_lists = runtime->listgen_task_lists;
+  for (int w = 0; w < ctx.num_tasks; w++) {
+    if (ctx.task_lists[w] == nullptr) {
+      ctx.task_lists[w] =
+          runtime->create<ListManager>(runtime, sizeof(Element), 4096);
+    }
+  }
+  runtime->parallel_for(runtime->thread_pool, ctx.num_tasks, num_threads,
+                        &ctx, element_listgen_expand_task);
+  i32 total = 0;
+  for (int w = 0; w < ctx.num_tasks; w++) {
+    ctx.task_offsets[w] = total;
+    total += ctx.task_lists[w]->size();
+  }
+  auto begin = ctx.child_list->reserve_new_elements(total);
+  for (int w = 0; w < ctx.num_tasks; w++) {
+    ctx.task_offsets[w] += begin;
+  }
+  runtime->parallel_for(runtime->thread_pool, ctx.num_tasks, num_threads,
+                        &ctx, element_listgen_merge_task);
+#endif
+}
+
 using BlockTask = void(Context *, char *, Element *, int, int);
 
 struct cpu_block_task_helper_context {
@@ -1155,6 +1990,7 @@ struct cpu_block_task_helper_context {
   int element_size;
   int element_split;
   std::size_t tls_buffer_size;
+  int prefetch_distance;
 };
 
 // TODO: To enforce inlining, we need to create in LLVM a new function that
@@ -1173,6 +2009,13 @@ void block_helper(void *ctx_, int i) {
   int lower = e.loop_bounds[0] + part_id * part_size;
   int upper = e.loop_bounds[0] + (part_id + 1) * part_size;
   upper = std::min(upper, e.loop_bounds[1]);
+  // The cells of the elements are scattered over the chunks of the
+  // NodeManagers, so the hardware prefetchers cannot see them coming.
+  const int next_id = element_id + ctx->prefetch_distance;
+  if (ctx->prefetch_distance > 0 && part_id == 0 &&
+      next_id < ctx->list->size()) {
+    __builtin_prefetch(ctx->list->get<Element>(next_id).element);
+  }
   alignas(8) char tls_buffer[ctx->tls_buffer_size];
   if (lower < upper) {
     (*ctx->task)(ctx->context, tls_buffer, &ctx->list->get<Element>(element_id),
@@ -1186,7 +2029,8 @@ void parallel_struct_for(Context *context,
                          int element_split,
                          BlockTask *task,
                          std::size_t tls_buffer_size,
-                         int num_threads) {
+                         int num_threads,
+                         int prefetch_distance) {
   auto list = (context->runtime)->element_lists[snode_id];
   auto list_tail = list->size();
 #if ARCH_cuda
@@ -1218,6 +2062,7 @@ void parallel_struct_for(Context *context,
   ctx.element_size = element_size;
   ctx.element_split = element_split;
   ctx.tls_buffer_size = tls_buffer_size;
+  ctx.prefetch_distance = prefetch_distance;
   auto runtime = context->runtime;
   runtime->parallel_for(runtime->thread_pool, list_tail * element_split,
                         num_threads, &ctx, block_helper);
@@ -1230,25 +2075,36 @@ struct range_task_helper_context {
   Context *context;
   range_for_xlogue prologue{nullptr};
   RangeForTaskFunc *body{nullptr};
+  // Runs a whole block at once instead of |body|, when the step is 1
+  RangeForBlockFunc *block_body{nullptr};
   range_for_xlogue epilogue{nullptr};
   std::size_t tls_size{1};
   int begin;
   int end;
   int block_size;
   int step;
+  // In deterministic mode, the TLS buffers of the blocks, |tls_stride| bytes
+  // apart. The epilogues are then run after all the blocks in order.
+  char *partials{nullptr};
+  std::size_t tls_stride{0};
 };
 
 void cpu_parallel_range_for_task(void *range_context, int task_id) {
   auto ctx = *(range_task_helper_context *)range_context;
-  alignas(8) char tls_buffer[ctx.tls_size];
-  auto tls_ptr = &tls_buffer[0];
+  alignas(8) char tls_buffer[ctx.partials ? 1 : ctx.tls_size];
+  auto tls_ptr =
+      ctx.partials ? ctx.partials + task_id * ctx.tls_stride : &tls_buffer[0];
   if (ctx.prologue)
     ctx.prologue(ctx.context, tls_ptr);
   if (ctx.step == 1) {
     int block_start = ctx.begin + task_id * ctx.block_size;
     int block_end = std::min(block_start + ctx.block_size, ctx.end);
-    for (int i = block_start; i < block_end; i++) {
-      ctx.body(ctx.context, tls_ptr, i);
+    if (ctx.block_body) {
+      ctx.block_body(ctx.context, tls_ptr, block_start, block_end);
+    } else {
+      for (int i = block_start; i < block_end; i++) {
+        ctx.body(ctx.context, tls_ptr, i);
+      }
     }
   } else if (ctx.step == -1) {
     int block_start = ctx.end - task_id * ctx.block_size;
@@ -1257,16 +2113,68 @@ void cpu_parallel_range_for_task(void *range_context, int task_id) {
       ctx.body(ctx.context, tls_ptr, i);
     }
   }
-  if (ctx.epilogue)
+  if (ctx.epilogue && !ctx.partials)
     ctx.epilogue(ctx.context, tls_ptr);
 }
 
+// |min_block_dim| only applies to the adaptive |block_dim| == 0.
+// A positive |max_num_partials| makes the reductions in the epilogue
+// deterministic: the blocks are then sized from the number of iterations
+// alone, at most |max_num_partials| of them, and their epilogues are run in
+// order once all of them are done.
+void cpu_parallel_range_for_launch(range_task_helper_context &ctx,
+                                   int num_threads,
+                                   int block_dim,
+                                   int min_block_dim,
+                                   int max_num_partials) {
+  auto context = ctx.context;
+  if (ctx.step != 1 && ctx.step != -1) {
+    taichi_printf(context->runtime, "step must not be %d\n", ctx.step);
+    exit(-1);
+  }
+  if (max_num_partials > 0 && ctx.epilogue) {
+    auto num_items = std::max(ctx.end - ctx.begin, 0);
+    block_dim = std::max(std::max(block_dim, 1),
+                         (num_items + max_num_partials - 1) / max_num_partials);
+    auto num_blocks = (num_items + block_dim - 1) / block_dim;
+    ctx.block_size = block_dim;
+    ctx.tls_stride = (ctx.tls_size + 7) / 8 * 8;
+    alignas(8) char partials[std::max(num_blocks, 1) * ctx.tls_stride];
+    ctx.partials = &partials[0];
+    auto runtime = context->runtime;
+    runtime->parallel_for(runtime->thread_pool, num_blocks, num_threads, &ctx,
+                          cpu_parallel_range_for_task);
+    for (int i = 0; i < num_blocks; i++) {
+      ctx.epilogue(context, ctx.partials + i * ctx.tls_stride);
+    }
+    return;
+  }
+  if (block_dim == 0) {
+    // adaptive block dim
+    auto num_items = (ctx.end - ctx.begin) / std::abs(ctx.step);
+    // ensure each thread has at least ~32 tasks for load balancing
+    // and each task has at least 512 items to amortize scheduler overhead,
+    // or |min_block_dim| items if the codegen found the iterations cheaper
+    min_block_dim = std::max(1, min_block_dim);
+    block_dim = std::min(std::max(512, min_block_dim),
+                         std::max(min_block_dim,
+                                  num_items / (num_threads * 32)));
+  }
+  ctx.block_size = block_dim;
+  auto runtime = context->runtime;
+  runtime->parallel_for(runtime->thread_pool,
+                        (ctx.end - ctx.begin + block_dim - 1) / block_dim,
+                        num_threads, &ctx, cpu_parallel_range_for_task);
+}
+
 void cpu_parallel_range_for(Context *context,
                             int num_threads,
                             int begin,
                             int end,
                             int step,
                             int block_dim,
+                            int min_block_dim,
+                            int max_num_partials,
                             range_for_xlogue prologue,
                             RangeForTaskFunc *body,
                             range_for_xlogue epilogue,
@@ -1280,22 +2188,34 @@ void cpu_parallel_range_for(Context *context,
   ctx.begin = begin;
   ctx.end = end;
   ctx.step = step;
-  if (step != 1 && step != -1) {
-    taichi_printf(context->runtime, "step must not be %d\n", step);
-    exit(-1);
-  }
-  if (block_dim == 0) {
-    // adaptive block dim
-    auto num_items = (ctx.end - ctx.begin) / std::abs(step);
-    // ensure each thread has at least ~32 tasks for load balancing
-    // and each task has at least 512 items to amortize scheduler overhead
-    block_dim = std::min(512, std::max(1, num_items / (num_threads * 32)));
-  }
-  ctx.block_size = block_dim;
-  auto runtime = context->runtime;
-  runtime->parallel_for(runtime->thread_pool,
-                        (end - begin + block_dim - 1) / block_dim, num_threads,
-                        &ctx, cpu_parallel_range_for_task);
+  cpu_parallel_range_for_launch(ctx, num_threads, block_dim, min_block_dim,
+                                max_num_partials);
+}
+
+// Same as cpu_parallel_range_for with a step of 1, but |body| loops over the
+// iterations of a block itself, so that the loop can be vectorized.
+void cpu_parallel_range_for_blocks(Context *context,
+                                   int num_threads,
+                                   int begin,
+                                   int end,
+                                   int block_dim,
+                                   int min_block_dim,
+                                   int max_num_partials,
+                                   range_for_xlogue prologue,
+                                   RangeForBlockFunc *body,
+                                   range_for_xlogue epilogue,
+                                   std::size_t tls_size) {
+  range_task_helper_context ctx;
+  ctx.context = context;
+  ctx.prologue = prologue;
+  ctx.tls_size = tls_size;
+  ctx.block_body = body;
+  ctx.epilogue = epilogue;
+  ctx.begin = begin;
+  ctx.end = end;
+  ctx.step = 1;
+  cpu_parallel_range_for_launch(ctx, num_threads, block_dim, min_block_dim,
+                                max_num_partials);
 }
 
 void gpu_parallel_range_for(Context *context,
@@ -1322,26 +2242,197 @@ i32 linear_thread_idx() {
   return block_idx() * block_dim() + thread_idx();
 }
 
+// Adds |value| once per launch of the task, from its first thread.
+void profile_counter_add_once(LLVMRuntime *runtime, i32 i, i64 value) {
+  if (linear_thread_idx() == 0)
+    profile_counter_add(runtime, i, value);
+}
+
+// Waits until all the threads of the grid reach the barrier, with their
+// memory writes visible to each other. All the blocks of the grid must be
+// resident at once, i.e. launched with cuLaunchCooperativeKernel().
+void grid_barrier(LLVMRuntime *runtime) {
+  grid_memfence();
+  block_barrier();
+  if (thread_idx() == 0) {
+    volatile i32 *generation = &runtime->grid_barrier_generation;
+    const i32 current = *generation;
+    if (atomic_add_i32(&runtime->grid_barrier_num_blocks, 1) ==
+        grid_dim() - 1) {
+      // The last block releases the others.
+      runtime->grid_barrier_num_blocks = 0;
+      grid_memfence();
+      atomic_add_i32(&runtime->grid_barrier_generation, 1);
+    } else {
+      while (*generation == current) {
+      }
+    }
+    grid_memfence();
+  }
+  block_barrier();
+}
+
+// Same as gpu_parallel_range_for, but the epilogues are run in the order of
+// the threads: the TLS buffers live in |reduction_partials|, and the last
+// block to finish runs all the epilogues. The launch must have at most
+// |taichi_deterministic_reduction_buffer_size| / |tls_stride| threads.
+void gpu_parallel_range_for_deterministic(Context *context,
+                                          int begin,
+                                          int end,
+                                          range_for_xlogue prologue,
+                                          RangeForTaskFunc *func,
+                                          range_for_xlogue epilogue,
+                                          const std::size_t tls_size) {
+  auto runtime = context->runtime;
+  const std::size_t tls_stride = (tls_size + 7) / 8 * 8;
+  auto tls_ptr =
+      (char *)runtime->reduction_partials + linear_thread_idx() * tls_stride;
+  int idx = thread_idx() + block_dim() * block_idx() + begin;
+  if (prologue)
+    prologue(context, tls_ptr);
+  while (idx < end) {
+    func(context, tls_ptr, idx);
+    idx += block_dim() * grid_dim();
+  }
+  // Publish the TLS buffers of the block before counting it as done.
+  grid_memfence();
+  block_barrier();
+  if (thread_idx() == 0) {
+    auto num_done = atomic_add_i32(&runtime->reduction_num_blocks_done, 1);
+    if (num_done == grid_dim() - 1) {
+      grid_memfence();
+      const int num_partials = grid_dim() * block_dim();
+      for (int i = 0; i < num_partials; i++) {
+        epilogue(context,
+                 (char *)runtime->reduction_partials + i * tls_stride);
+      }
+      runtime->reduction_num_blocks_done = 0;
+    }
+  }
+}
+
+// Adds the |val| of all the lanes of a warp to |dest|, which they must agree
+// on, with a single atomic: the values are summed up with shuffles first.
+// Blocks whose warps are not all full (the block_dim is not a multiple of 32)
+// fall back to an atomic per thread. Every thread of the block must call this,
+// e.g. in the TLS epilogue of gpu_parallel_range_for.
+#define DEFINE_WARP_REDUCE_ADD(T)                                    \
+  void warp_reduce_add_##T(T *dest, T val) {                         \
+    if (block_dim() % warp_size() != 0) {                            \
+      atomic_add_##T(dest, val);                                     \
+      return;                                                        \
+    }                                                                \
+    constexpr u32 full_mask = 0xFFFFFFFFu;                           \
+    warp_barrier(full_mask);                                         \
+    for (int offset = warp_size() / 2; offset > 0; offset /= 2) {    \
+      val += cuda_shfl_down_sync_##T(full_mask, val, offset, 31);    \
+    }                                                                \
+    if (warp_idx() == 0)                                             \
+      atomic_add_##T(dest, val);                                     \
+  }
+
+DEFINE_WARP_REDUCE_ADD(i32)
+DEFINE_WARP_REDUCE_ADD(i64)
+DEFINE_WARP_REDUCE_ADD(f32)
+DEFINE_WARP_REDUCE_ADD(f64)
+
 #include "node_dense.h"
 #include "node_dynamic.h"
 #include "node_pointer.h"
+#include "node_hash.h"
 #include "node_root.h"
 #include "node_bitmasked.h"
 
+RandState *LLVMRuntime::get_rand_state(i32 i) {
+  if (rand_states == nullptr) {
+    locked_task(&rand_states_lock, [&] {
+      if (rand_states == nullptr) {
+        // The memory is zero-filled.
+        auto states = request_allocate_aligned(
+            sizeof(RandState) * num_rand_states, taichi_page_size);
+        grid_memfence();
+        atomic_exchange_u64((u64 *)&rand_states, (u64)states);
+      }
+    });
+  }
+  return &rand_states[i];
+}
+
 void ListManager::touch_chunk(int chunk_id) {
-  if (!chunks[chunk_id]) {
+  if (!get_chunk(chunk_id)) {
     locked_task(&lock, [&] {
       // may have been allocated during lock contention
-      if (!chunks[chunk_id]) {
+      if (!get_chunk(chunk_id)) {
+        taichi_assert_runtime(runtime, chunk_id < max_num_chunks,
+                              "Too many chunks in a list.");
+        auto group_id = chunk_id >> log2chunk_group_size;
+        if (chunk_groups[group_id] == nullptr) {
+          auto group = (Ptr *)runtime->request_allocate_aligned(
+              sizeof(Ptr) * chunk_group_size, 4096);
+          for (int i = 0; i < chunk_group_size; i++) {
+            group[i] = nullptr;
+          }
+          grid_memfence();
+          atomic_exchange_u64((u64 *)&chunk_groups[group_id], (u64)group);
+        }
         grid_memfence();
-        auto chunk_ptr = runtime->request_allocate_aligned(
-            max_num_elements_per_chunk * element_size, 4096);
-        atomic_exchange_u64((u64 *)&chunks[chunk_id], (u64)chunk_ptr);
+        auto chunk_ptr =
+            runtime->allocate_chunk(max_num_elements_per_chunk * element_size);
+        index_chunk(chunk_ptr, chunk_id);
+        num_chunks++;
+        peak_num_chunks = max_i32(peak_num_chunks, num_chunks);
+        atomic_exchange_u64(
+            (u64 *)&chunk_groups[group_id][chunk_id & (chunk_group_size - 1)],
+            (u64)chunk_ptr);
       }
     });
   }
 }
 
+ListManager::ChunkIndex::ChunkIndex(LLVMRuntime *runtime,
+                                    i32 log2table_size,
+                                    std::size_t chunk_size)
+    : log2table_size(log2table_size),
+      log2block_size(taichi::log2int(chunk_size) +
+                     ((chunk_size & (chunk_size - 1)) != 0)) {
+  blocks = (u64 *)runtime->request_allocate_aligned(
+      sizeof(u64) * table_size(), 4096);
+  chunk_ids = (i32 *)runtime->request_allocate_aligned(
+      sizeof(i32) * table_size(), 4096);
+  clear();
+}
+
+void ListManager::ChunkIndex::insert(u64 block, i32 chunk_id) {
+  auto slot = first_slot(block);
+  while (blocks[slot] != 0) {
+    slot = next_slot(slot);
+  }
+  chunk_ids[slot] = chunk_id;
+  num_entries++;
+  grid_memfence();
+  atomic_exchange_u64(&blocks[slot], block + 1);
+}
+
+void ListManager::index_chunk(Ptr chunk, i32 chunk_id) {
+  if (chunk_index == nullptr)
+    return;
+  if (!chunk_index->has_room_for_chunk()) {
+    // The readers of the current table only look for the chunks in it.
+    auto index = runtime->create<ChunkIndex>(
+        runtime, chunk_index->log2table_size + 1, get_chunk_size());
+    fill_chunk_index(index);
+    grid_memfence();
+    atomic_exchange_u64((u64 *)&chunk_index, (u64)index);
+  }
+  chunk_index->add_chunk(chunk, get_chunk_size(), chunk_id);
+}
+
+void ListManager::enable_ptr2index() {
+  // Room for the first 16 chunks.
+  chunk_index = runtime->create<ChunkIndex>(runtime, 6, get_chunk_size());
+  reindex_chunks();
+}
+
 void ListManager::append(void *data_ptr) {
   auto ptr = allocate();
   std::memcpy(ptr, data_ptr, element_size);
@@ -1352,12 +2443,107 @@ Ptr ListManager::allocate() {
   return get_element_ptr(i);
 }
 
-void node_gc(LLVMRuntime *runtime, int snode_id) {
-  runtime->node_allocators[snode_id]->gc_serial();
+struct node_gc_helper_context {
+  NodeManager *allocator;
+  // Compaction: free_list[i] <- free_list[src_begin + i], i < num_to_move
+  i32 src_begin;
+  i32 num_to_move;
+  // Zero-fill: recycled_list[i] goes to free_list[dst_begin + i]
+  i32 dst_begin;
+  i32 num_recycled;
+  i32 block_size;
+};
+
+void node_gc_compact_task(void *gc_context, int task_id) {
+  auto ctx = (node_gc_helper_context *)gc_context;
+  auto free_list = ctx->allocator->free_list;
+  using T = NodeManager::list_data_type;
+  int begin = task_id * ctx->block_size;
+  int end = std::min(begin + ctx->block_size, ctx->num_to_move);
+  for (int i = begin; i < end; i++) {
+    free_list->get<T>(i) = free_list->get<T>(ctx->src_begin + i);
+  }
+}
+
+void node_gc_zero_fill_task(void *gc_context, int task_id) {
+  auto ctx = (node_gc_helper_context *)gc_context;
+  auto allocator = ctx->allocator;
+  using T = NodeManager::list_data_type;
+  int begin = task_id * ctx->block_size;
+  int end = std::min(begin + ctx->block_size, ctx->num_recycled);
+  for (int i = begin; i < end; i++) {
+    auto idx = allocator->recycled_list->get<T>(i);
+    std::memset(allocator->data_list->get_element_ptr(idx), 0,
+                allocator->element_size);
+    allocator->free_list->get<T>(ctx->dst_begin + i) = idx;
+  }
+}
+
+void node_gc(LLVMRuntime *runtime, int snode_id, int num_threads) {
+  auto allocator = runtime->node_allocators[snode_id];
+  allocator->sample_peak();
+  if (!allocator->should_gc()) {
+    allocator->num_skipped_gcs++;
+    return;
+  }
+  allocator->num_skipped_gcs = 0;
+  auto free_list = allocator->free_list;
+  auto recycled_list = allocator->recycled_list;
+  auto free_list_size = free_list->size();
+  auto free_list_used = min_i32(allocator->free_list_used, free_list_size);
+  auto num_unused = free_list_size - free_list_used;
+  auto num_recycled = recycled_list->size();
+
+  // Below this many list items, waking up the thread pool costs more than the
+  // work itself.
+  constexpr int parallel_gc_threshold = 4096;
+  if (num_threads <= 1 || runtime->parallel_for == nullptr ||
+      max_i32(num_unused, num_recycled) < parallel_gc_threshold) {
+    allocator->gc_serial();
+    return;
+  }
+
+  node_gc_helper_context ctx;
+  ctx.allocator = allocator;
+  ctx.block_size = 1024;
+
+  // Move unused elements to the beginning of the free_list. As in
+  // gc_parallel_0(), only the non-overlapping part is moved, so that the
+  // source and destination ranges are disjoint.
+  if (free_list_used * 2 > free_list_size) {
+    ctx.src_begin = free_list_used;
+    ctx.num_to_move = num_unused;
+  } else {
+    ctx.src_begin = num_unused;
+    ctx.num_to_move = free_list_used;
+  }
+  if (ctx.num_to_move > 0) {
+    runtime->parallel_for(
+        runtime->thread_pool,
+        (ctx.num_to_move + ctx.block_size - 1) / ctx.block_size, num_threads,
+        &ctx, node_gc_compact_task);
+  }
+  free_list->resize(num_unused);
+  allocator->free_list_used = 0;
+
+  // Zero-fill recycled elements and append them to the free list. The free
+  // list slots are reserved upfront so that workers never contend on it.
+  if (num_recycled > 0) {
+    ctx.dst_begin = free_list->reserve_new_elements(num_recycled);
+    ctx.num_recycled = num_recycled;
+    runtime->parallel_for(
+        runtime->thread_pool,
+        (num_recycled + ctx.block_size - 1) / ctx.block_size, num_threads,
+        &ctx, node_gc_zero_fill_task);
+  }
+  recycled_list->clear();
 }
 
 void gc_parallel_0(LLVMRuntime *runtime, int snode_id) {
   auto allocator = runtime->node_allocators[snode_id];
+  if (!allocator->should_gc()) {
+    return;
+  }
   auto free_list = allocator->free_list;
   auto free_list_size = free_list->size();
   auto free_list_used = allocator->free_list_used;
@@ -1386,6 +2572,14 @@ void gc_parallel_0(LLVMRuntime *runtime, int snode_id) {
 void gc_parallel_1(LLVMRuntime *runtime, int snode_id) {
   auto allocator = runtime->node_allocators[snode_id];
   auto free_list = allocator->free_list;
+  allocator->sample_peak();
+  if (!allocator->should_gc()) {
+    allocator->num_skipped_gcs++;
+    // Makes gc_parallel_2() a no-op
+    allocator->recycle_list_size_backup = 0;
+    return;
+  }
+  allocator->num_skipped_gcs = 0;
 
   const i32 num_unused =
       max_i32(free_list->size() - allocator->free_list_used, 0);
@@ -1394,6 +2588,11 @@ void gc_parallel_1(LLVMRuntime *runtime, int snode_id) {
   allocator->free_list_used = 0;
   allocator->recycle_list_size_backup = allocator->recycled_list->size();
   allocator->recycled_list->clear();
+  // Reserve free list slots for the recycled elements, so that the zero-fill
+  // task can write them in place instead of appending one by one.
+  if (allocator->recycle_list_size_backup > 0) {
+    free_list->reserve_new_elements(allocator->recycle_list_size_backup);
+  }
 }
 
 void gc_parallel_2(LLVMRuntime *runtime, int snode_id) {
@@ -1404,12 +2603,14 @@ void gc_parallel_2(LLVMRuntime *runtime, int snode_id) {
   auto data_list = allocator->data_list;
   auto element_size = allocator->element_size;
   using T = NodeManager::list_data_type;
+  // Slots reserved by gc_parallel_1()
+  auto free_list_begin = free_list->size() - elements;
   auto i = block_idx();
   while (i < elements) {
     auto idx = recycled_list->get<T>(i);
     auto ptr = data_list->get_element_ptr(idx);
     if (thread_idx() == 0) {
-      free_list->push_back(idx);
+      free_list->get<T>(free_list_begin + i) = idx;
     }
     // memset
     auto ptr_stop = ptr + element_size;
@@ -1435,6 +2636,684 @@ void gc_parallel_2(LLVMRuntime *runtime, int snode_id) {
     i += grid_dim();
   }
 }
+
+// Relocates the live nodes of the allocator of a pointer or hash SNode to the
+// lowest indices of its data list, and gives the chunks left empty back to the
+// runtime. The element list of the SNode must hold all of its containers, in
+// which the pointers to the nodes start |data_offset| bytes in. Serial, since
+// it runs rarely. Returns the number of bytes given back.
+void runtime_compact_node_allocator(LLVMRuntime *runtime,
+                                    int snode_id,
+                                    int data_offset) {
+  auto allocator = runtime->node_allocators[snode_id];
+  auto list = runtime->element_lists[snode_id];
+  auto free_list = allocator->free_list;
+  auto recycled_list = allocator->recycled_list;
+  auto data_list = allocator->data_list;
+  auto element_size = allocator->element_size;
+  using T = NodeManager::list_data_type;
+
+  auto for_each_live_node = [&](auto func) {
+    for (int i = 0; i < list->size(); i++) {
+      auto &element = list->get<Element>(i);
+      auto data = (Ptr *)(element.element + data_offset);
+      for (int j = element.loop_bounds[0]; j < element.loop_bounds[1]; j++) {
+        if (data[j] != nullptr) {
+          func(data[j]);
+        }
+      }
+    }
+  };
+  i32 num_live = 0;
+  for_each_live_node([&](Ptr &) { num_live++; });
+
+  // The data list slots not holding live nodes are in the free list, the
+  // recycled list, the slot caches or the spare nodes. Gather the ones below
+  // |num_live| into the free list, as the destinations of the relocation.
+  i32 num_holes = 0;
+  auto add_hole = [&](i32 idx) {
+    if (idx < num_live) {
+      *(T *)free_list->touch_and_get(num_holes++) = idx;
+    }
+  };
+  for (int i = allocator->free_list_used; i < free_list->size(); i++) {
+    add_hole(free_list->get<T>(i));
+  }
+  for (int i = 0; i < recycled_list->size(); i++) {
+    add_hole(recycled_list->get<T>(i));
+  }
+  for (int i = 0; i < NodeManager::num_slot_caches; i++) {
+    auto value = allocator->slot_caches[i];
+    for (auto idx = (i32)(value & 0xFFFFFFFFULL); idx < (i32)(value >> 32);
+         idx++) {
+      add_hole(idx);
+    }
+    if (allocator->spare_nodes[i] != nullptr) {
+      add_hole(allocator->locate(allocator->spare_nodes[i]));
+    }
+    allocator->slot_caches[i] = 0;
+    allocator->spare_nodes[i] = nullptr;
+  }
+  recycled_list->clear();
+
+  i32 num_moved = 0;
+  i32 new_size = 0;
+  for_each_live_node([&](Ptr &node) {
+    auto idx = allocator->locate(node);
+    if (idx >= num_live && num_moved < num_holes) {
+      idx = free_list->get<T>(num_moved++);
+      auto dst = data_list->get_element_ptr(idx);
+      std::memcpy(dst, node, element_size);
+      node = dst;
+    }
+    new_size = max_i32(new_size, idx + 1);
+  });
+
+  // The remaining holes may have been recycled without a GC.
+  for (int i = num_moved; i < num_holes; i++) {
+    auto idx = free_list->get<T>(i);
+    std::memset(data_list->get_element_ptr(idx), 0, element_size);
+    free_list->get<T>(i - num_moved) = idx;
+  }
+  free_list->resize(num_holes - num_moved);
+  allocator->free_list_used = 0;
+
+  // Newly reserved data list slots must be zero-filled.
+  auto chunk_num_elements = (i32)data_list->max_num_elements_per_chunk;
+  auto chunk_size = data_list->max_num_elements_per_chunk * element_size;
+  auto first_empty_chunk = (new_size + chunk_num_elements - 1) /
+                           chunk_num_elements;
+  if (new_size % chunk_num_elements != 0) {
+    std::memset(data_list->get_element_ptr(new_size), 0,
+                (chunk_num_elements - new_size % chunk_num_elements) *
+                    element_size);
+  }
+  std::size_t released = 0;
+  for (int c = first_empty_chunk; c < ListManager::max_num_chunks; c++) {
+    auto chunk = data_list->get_chunk(c);
+    if (chunk == nullptr)
+      break;
+    if (runtime->release_chunk(chunk, chunk_size)) {
+      data_list->set_chunk(c, nullptr);
+      released += chunk_size;
+    } else {
+      std::memset(chunk, 0, chunk_size);
+    }
+  }
+  data_list->resize(new_size);
+  if (released > 0) {
+    data_list->reindex_chunks();
+  }
+
+  // The element lists of the descendants point to the old nodes.
+  mark_structure_changed(runtime, snode_id);
+  runtime->set_result(taichi_result_buffer_runtime_query_id, released);
+}
+
+struct bulk_clear_context {
+  ListManager *list;
+  i32 num_items;
+  i32 block_size;
+  // For clearing containers.
+  i32 offset;
+  i32 size;
+  // For zero-filling the nodes of an allocator.
+  std::size_t element_size;
+};
+
+// Zeroes bytes [offset, offset + size) of the containers in the element list,
+// once per container.
+void clear_containers_task(void *ctx_, int w) {
+  auto ctx = (bulk_clear_context *)ctx_;
+  auto end = min_i32((w + 1) * ctx->block_size, ctx->num_items);
+  for (int i = w * ctx->block_size; i < end; i++) {
+    auto &element = ctx->list->get<Element>(i);
+    if (element.loop_bounds[0] == 0) {
+      std::memset(element.element + ctx->offset, 0, ctx->size);
+    }
+  }
+}
+
+// Zero-fills the data list of an allocator, one chunk per task.
+void zero_fill_chunk_task(void *ctx_, int c) {
+  auto ctx = (bulk_clear_context *)ctx_;
+  auto chunk_num_elements = (i32)ctx->list->max_num_elements_per_chunk;
+  auto n = min_i32(chunk_num_elements, ctx->num_items - c * chunk_num_elements);
+  std::memset(ctx->list->get_element_ptr(c * chunk_num_elements), 0,
+              n * ctx->element_size);
+}
+
+void run_bulk_clear_tasks(LLVMRuntime *runtime,
+                          int num_tasks,
+                          int num_threads,
+                          bulk_clear_context *ctx,
+                          void (*task)(void *, int)) {
+#if !ARCH_cuda
+  if (num_tasks > 1 && num_threads > 1 && runtime->parallel_for != nullptr) {
+    runtime->parallel_for(runtime->thread_pool, num_tasks, num_threads, ctx,
+                          task);
+    return;
+  }
+#endif
+  for (int w = 0; w < num_tasks; w++) {
+    task(ctx, w);
+  }
+}
+
+// Deactivates all the children of the containers of a pointer or bitmasked
+// SNode at once, by zeroing the parts of the containers holding their
+// activity: bytes [offset, offset + size) of each one. The element list of
+// the SNode must be up to date. Returns the number of containers cleared.
+void runtime_clear_containers(LLVMRuntime *runtime,
+                              int snode_id,
+                              int offset,
+                              int size,
+                              int num_threads) {
+  bulk_clear_context ctx;
+  ctx.list = runtime->element_lists[snode_id];
+  ctx.num_items = ctx.list->size();
+  ctx.block_size = 256;
+  ctx.offset = offset;
+  ctx.size = size;
+  run_bulk_clear_tasks(runtime,
+                       (ctx.num_items + ctx.block_size - 1) / ctx.block_size,
+                       num_threads, &ctx, clear_containers_task);
+  mark_structure_changed(runtime, snode_id);
+  runtime->set_result(taichi_result_buffer_runtime_query_id, ctx.num_items);
+}
+
+// Frees all the nodes of an allocator at once, when none of them is
+// reachable anymore: the data list is zero-filled chunk by chunk and emptied,
+// so that the nodes are handed out again from its first slot, and the free
+// list, the recycled list and the slot caches are dropped. The chunks stay
+// allocated. Returns the number of nodes that were allocated.
+void runtime_reset_node_allocator(LLVMRuntime *runtime,
+                                  int snode_id,
+                                  int num_threads) {
+  auto allocator = runtime->node_allocators[snode_id];
+  allocator->sample_peak();
+  auto data_list = allocator->data_list;
+  bulk_clear_context ctx;
+  ctx.list = data_list;
+  ctx.num_items = data_list->size();
+  ctx.element_size = allocator->element_size;
+  auto chunk_num_elements = (i32)data_list->max_num_elements_per_chunk;
+  run_bulk_clear_tasks(
+      runtime, (ctx.num_items + chunk_num_elements - 1) / chunk_num_elements,
+      num_threads, &ctx, zero_fill_chunk_task);
+  data_list->clear();
+  allocator->free_list->clear();
+  allocator->free_list_used = 0;
+  allocator->recycled_list->clear();
+  for (int i = 0; i < NodeManager::num_slot_caches; i++) {
+    allocator->slot_caches[i] = 0;
+    allocator->spare_nodes[i] = nullptr;
+  }
+  allocator->num_skipped_gcs = 0;
+  mark_structure_changed(runtime, snode_id);
+  runtime->set_result(taichi_result_buffer_runtime_query_id, ctx.num_items);
+}
+
+// Device-wide parallel primitives, see taichi/program/parallel_primitives.h.
+// Each pass splits [0, n) into |num_workers| contiguous segments, which
+// workers process serially. On CPU a pass is one call spreading the segments
+// over the thread pool; on CUDA it is a kernel launch with at least one thread
+// per segment. The host chains the passes, so that a phase never needs a
+// grid-wide barrier.
+
+struct primitive_pass_context {
+  Ptr a;
+  Ptr b;
+  Ptr c;
+  Ptr d;
+  Ptr e;
+  i32 n;
+  i32 num_workers;
+  i32 shift;
+  i32 flip_sign;
+};
+
+i32 primitive_segment_begin(primitive_pass_context *ctx, int w) {
+  return (i32)((i64)ctx->n * w / ctx->num_workers);
+}
+
+i32 primitive_radix_digit(primitive_pass_context *ctx, u32 key) {
+  auto digit = (key >> ctx->shift) & 255;
+  // Signed keys sort as unsigned ones with the sign bit flipped.
+  if (ctx->flip_sign && ctx->shift == 24)
+    digit ^= 128;
+  return (i32)digit;
+}
+
+// a: data, b: the sum of each segment.
+void primitive_scan_reduce_worker(primitive_pass_context *ctx, int w) {
+  auto data = (i32 *)ctx->a;
+  i32 sum = 0;
+  for (int i = primitive_segment_begin(ctx, w);
+       i < primitive_segment_begin(ctx, w + 1); i++) {
+    sum += data[i];
+  }
+  ((i32 *)ctx->b)[w] = sum;
+}
+
+// a: data, b: the exclusive prefix sums of the segments, or null for a single
+// segment. Scans each segment in place.
+void primitive_scan_downsweep_worker(primitive_pass_context *ctx, int w) {
+  auto data = (i32 *)ctx->a;
+  i32 sum = ctx->b ? ((i32 *)ctx->b)[w] : 0;
+  for (int i = primitive_segment_begin(ctx, w);
+       i < primitive_segment_begin(ctx, w + 1); i++) {
+    auto t = data[i];
+    data[i] = sum;
+    sum += t;
+  }
+}
+
+// a: keys, b: the 256 x |num_workers| histogram, digit-major, so that its
+// exclusive scan gives each worker the first output slot of each digit.
+void primitive_radix_histogram_worker(primitive_pass_context *ctx, int w) {
+  auto keys = (u32 *)ctx->a;
+  auto histogram = (i32 *)ctx->b;
+  i32 counts[256];
+  for (int d = 0; d < 256; d++)
+    counts[d] = 0;
+  for (int i = primitive_segment_begin(ctx, w);
+       i < primitive_segment_begin(ctx, w + 1); i++) {
+    counts[primitive_radix_digit(ctx, keys[i])]++;
+  }
+  for (int d = 0; d < 256; d++)
+    histogram[d * ctx->num_workers + w] = counts[d];
+}
+
+// a: keys, b: the scanned histogram, c: output keys, d: values (or null),
+// e: output values. Stable, since every worker scatters its segment in order.
+void primitive_radix_scatter_worker(primitive_pass_context *ctx, int w) {
+  auto keys = (u32 *)ctx->a;
+  auto histogram = (i32 *)ctx->b;
+  auto keys_out = (u32 *)ctx->c;
+  auto values = (u32 *)ctx->d;
+  auto values_out = (u32 *)ctx->e;
+  i32 offsets[256];
+  for (int d = 0; d < 256; d++)
+    offsets[d] = histogram[d * ctx->num_workers + w];
+  for (int i = primitive_segment_begin(ctx, w);
+       i < primitive_segment_begin(ctx, w + 1); i++) {
+    auto key = keys[i];
+    auto j = offsets[primitive_radix_digit(ctx, key)]++;
+    keys_out[j] = key;
+    if (values)
+      values_out[j] = values[i];
+  }
+}
+
+// a: flags, b: output offsets, with one more slot than |n| that receives the
+// number of the selected elements after the scan.
+void primitive_compact_flags_worker(primitive_pass_context *ctx, int w) {
+  auto flags = (i32 *)ctx->a;
+  auto offsets = (i32 *)ctx->b;
+  for (int i = primitive_segment_begin(ctx, w);
+       i < primitive_segment_begin(ctx, w + 1); i++) {
+    offsets[i] = flags[i] != 0;
+  }
+  if (w == ctx->num_workers - 1)
+    offsets[ctx->n] = 0;
+}
+
+// a: flags, b: the scanned offsets, c: input, d: output.
+void primitive_compact_scatter_worker(primitive_pass_context *ctx, int w) {
+  auto flags = (i32 *)ctx->a;
+  auto offsets = (i32 *)ctx->b;
+  auto input = (u32 *)ctx->c;
+  auto output = (u32 *)ctx->d;
+  for (int i = primitive_segment_begin(ctx, w);
+       i < primitive_segment_begin(ctx, w + 1); i++) {
+    if (flags[i])
+      output[offsets[i]] = input[i];
+  }
+}
+
+#if ARCH_cuda
+#define DEFINE_PRIMITIVE_PASS(name)                                         \
+  void runtime_primitive_##name(LLVMRuntime *runtime, Ptr a, Ptr b, Ptr c,  \
+                                Ptr d, Ptr e, i32 n, i32 num_workers,       \
+                                i32 shift, i32 flip_sign, i32 num_threads) { \
+    primitive_pass_context ctx{a, b, c, d, e, n, num_workers, shift,        \
+                               flip_sign};                                  \
+    auto w = linear_thread_idx();                                           \
+    if (w < num_workers)                                                    \
+      primitive_##name##_worker(&ctx, w);                                   \
+  }
+#else
+#define DEFINE_PRIMITIVE_PASS(name)                                         \
+  void primitive_##name##_task(void *ctx, int w) {                          \
+    primitive_##name##_worker((primitive_pass_context *)ctx, w);            \
+  }                                                                         \
+  void runtime_primitive_##name(LLVMRuntime *runtime, Ptr a, Ptr b, Ptr c,  \
+                                Ptr d, Ptr e, i32 n, i32 num_workers,       \
+                                i32 shift, i32 flip_sign, i32 num_threads) { \
+    primitive_pass_context ctx{a, b, c, d, e, n, num_workers, shift,        \
+                               flip_sign};                                  \
+    if (num_workers == 1 || num_threads <= 1 ||                             \
+        runtime->parallel_for == nullptr) {                                 \
+      for (int w = 0; w < num_workers; w++)                                 \
+        primitive_##name##_worker(&ctx, w);                                 \
+    } else {                                                                \
+      runtime->parallel_for(runtime->thread_pool, num_workers, num_threads, \
+                            &ctx, primitive_##name##_task);                 \
+    }                                                                       \
+  }
+#endif
+
+DEFINE_PRIMITIVE_PASS(scan_reduce)
+DEFINE_PRIMITIVE_PASS(scan_downsweep)
+DEFINE_PRIMITIVE_PASS(radix_histogram)
+DEFINE_PRIMITIVE_PASS(radix_scatter)
+DEFINE_PRIMITIVE_PASS(compact_flags)
+DEFINE_PRIMITIVE_PASS(compact_scatter)
+#undef DEFINE_PRIMITIVE_PASS
+
+// Sparse linear algebra, see taichi/program/sparse_matrix.h. The passes are
+// launched like the primitives above, but on CUDA worker w processes the
+// elements w, w + num_workers, ..., so that the threads of a warp access
+// consecutive elements, and every thread of the launch is a worker.
+struct sparse_pass_context {
+  Ptr a;
+  Ptr b;
+  Ptr c;
+  Ptr d;
+  Ptr e;
+  Ptr f;
+  Ptr g;
+  Ptr h;
+  i32 n;
+  i32 num_workers;
+  i32 k;
+  i32 m;
+};
+
+i32 sparse_worker_begin(sparse_pass_context *ctx, int w) {
+#if ARCH_cuda
+  return w;
+#else
+  return (i32)((i64)ctx->n * w / ctx->num_workers);
+#endif
+}
+
+i32 sparse_worker_end(sparse_pass_context *ctx, int w) {
+#if ARCH_cuda
+  return ctx->n;
+#else
+  return (i32)((i64)ctx->n * (w + 1) / ctx->num_workers);
+#endif
+}
+
+i32 sparse_worker_step(sparse_pass_context *ctx) {
+#if ARCH_cuda
+  return ctx->num_workers;
+#else
+  return 1;
+#endif
+}
+
+#define SPARSE_FOR(i, ctx, w)                                        \
+  for (i32 i = sparse_worker_begin(ctx, w); i < sparse_worker_end(ctx, w); \
+       i += sparse_worker_step(ctx))
+
+// a[i] = i.
+void sparse_iota_worker(sparse_pass_context *ctx, int w) {
+  SPARSE_FOR(i, ctx, w) {
+    ((i32 *)ctx->a)[i] = i;
+  }
+}
+
+// c[i] = a[b[i]].
+void sparse_gather_i32_worker(sparse_pass_context *ctx, int w) {
+  auto src = (i32 *)ctx->a;
+  auto index = (i32 *)ctx->b;
+  SPARSE_FOR(i, ctx, w) {
+    ((i32 *)ctx->c)[i] = src[index[i]];
+  }
+}
+
+// a: rows, b: columns, sorted by (row, column). c: whether each triplet is
+// the first of its entry, with one more slot than |n| for the scan.
+void sparse_unique_flags_worker(sparse_pass_context *ctx, int w) {
+  auto rows = (i32 *)ctx->a;
+  auto cols = (i32 *)ctx->b;
+  auto flags = (i32 *)ctx->c;
+  SPARSE_FOR(i, ctx, w) {
+    flags[i] = i == 0 || rows[i] != rows[i - 1] || cols[i] != cols[i - 1];
+    if (i == ctx->n - 1)
+      flags[ctx->n] = 0;
+  }
+}
+
+// The dot products add up the partial sums of the workers: per warp first
+// on CUDA, which must then run the pass on all the threads of its blocks.
+#if ARCH_cuda
+#define DEFINE_SPARSE_REDUCE_ADD(T)              \
+  void sparse_reduce_add_##T(T *dest, T val) { \
+    warp_reduce_add_##T(dest, val);            \
+  }
+#else
+#define DEFINE_SPARSE_REDUCE_ADD(T)              \
+  void sparse_reduce_add_##T(T *dest, T val) { \
+    atomic_add_##T(dest, val);                 \
+  }
+#endif
+
+DEFINE_SPARSE_REDUCE_ADD(f32)
+DEFINE_SPARSE_REDUCE_ADD(f64)
+#undef DEFINE_SPARSE_REDUCE_ADD
+
+// The passes over the values of type T:
+//
+// assemble: a: rows, b: columns, c: the triplet of each, sorted by (row,
+//   column), d: the values of the triplets, e: the scanned flags of
+//   unique_flags. Writes the column indices, values and row offsets of the
+//   CSR matrix of |m| rows to f, g and h, summing the duplicates.
+// spmv: a, b, c: the row offsets, column indices and values of a CSR matrix
+//   of |n| rows. e = A d.
+// cg_*: the iterations of the conjugate gradient method with the Jacobi
+//   preconditioner on A x = d, starting from x = e, for at most |m|
+//   iterations. f is the work space: r, z, p, q = A p and the inverse
+//   diagonal of A, of |n| values each. g holds the scalars: |b|^2, the
+//   square of the relative tolerance, then r.z, p.q and |r|^2 of each
+//   iteration, initially zeros. The passes of iteration |k| do nothing once
+//   the method has converged, so that the host only checks it now and then.
+#define DEFINE_SPARSE_PASSES(T)                                               \
+  void sparse_assemble_##T##_worker(sparse_pass_context *ctx, int w) {        \
+    auto rows = (i32 *)ctx->a;                                                \
+    auto cols = (i32 *)ctx->b;                                                \
+    auto perm = (i32 *)ctx->c;                                                \
+    auto values = (T *)ctx->d;                                                \
+    auto pos = (i32 *)ctx->e;                                                 \
+    auto n = ctx->n;                                                          \
+    SPARSE_FOR(i, ctx, w) {                                                   \
+      if (i == n - 1) {                                                       \
+        for (int r = rows[i] + 1; r <= ctx->m; r++)                           \
+          ((i32 *)ctx->h)[r] = pos[n];                                        \
+      }                                                                       \
+      if (i > 0 && rows[i] == rows[i - 1] && cols[i] == cols[i - 1])          \
+        continue;                                                             \
+      T sum = 0;                                                              \
+      for (int j = i; j < n && rows[j] == rows[i] && cols[j] == cols[i]; j++) \
+        sum += values[perm[j]];                                               \
+      ((i32 *)ctx->f)[pos[i]] = cols[i];                                      \
+      ((T *)ctx->g)[pos[i]] = sum;                                            \
+      /* The empty rows before this one start here too. */                    \
+      for (int r = i == 0 ? 0 : rows[i - 1] + 1; r <= rows[i]; r++)           \
+        ((i32 *)ctx->h)[r] = pos[i];                                          \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  void sparse_spmv_##T##_worker(sparse_pass_context *ctx, int w) {            \
+    auto offsets = (i32 *)ctx->a;                                             \
+    auto cols = (i32 *)ctx->b;                                                \
+    auto values = (T *)ctx->c;                                                \
+    auto x = (T *)ctx->d;                                                     \
+    SPARSE_FOR(i, ctx, w) {                                                   \
+      T sum = 0;                                                              \
+      for (int j = offsets[i]; j < offsets[i + 1]; j++)                       \
+        sum += values[j] * x[cols[j]];                                        \
+      ((T *)ctx->e)[i] = sum;                                                 \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  T *sparse_cg_rz_##T(sparse_pass_context *ctx, int k) {                    \
+    return (T *)ctx->g + 2 + k;                                               \
+  }                                                                           \
+                                                                              \
+  T *sparse_cg_pq_##T(sparse_pass_context *ctx, int k) {                    \
+    return (T *)ctx->g + 2 + (ctx->m + 1) + k;                                \
+  }                                                                           \
+                                                                              \
+  T *sparse_cg_rr_##T(sparse_pass_context *ctx, int k) {                    \
+    return (T *)ctx->g + 2 + (ctx->m + 1) * 2 + k;                            \
+  }                                                                           \
+                                                                              \
+  bool sparse_cg_converged_##T(sparse_pass_context *ctx, int k) {             \
+    auto scalars = (T *)ctx->g;                                               \
+    return *sparse_cg_rr_##T(ctx, k) <= scalars[1] * scalars[0];              \
+  }                                                                           \
+                                                                              \
+  void sparse_cg_init_##T##_worker(sparse_pass_context *ctx, int w) {         \
+    auto offsets = (i32 *)ctx->a;                                             \
+    auto cols = (i32 *)ctx->b;                                                \
+    auto values = (T *)ctx->c;                                                \
+    auto rhs = (T *)ctx->d;                                                   \
+    auto x = (T *)ctx->e;                                                     \
+    auto n = ctx->n;                                                          \
+    auto r = (T *)ctx->f, z = r + n, p = r + 2 * n, dinv = r + 4 * n;         \
+    T rz = 0, rr = 0, bb = 0;                                                 \
+    SPARSE_FOR(i, ctx, w) {                                                   \
+      T ax = 0, diag = 0;                                                     \
+      for (int j = offsets[i]; j < offsets[i + 1]; j++) {                     \
+        ax += values[j] * x[cols[j]];                                         \
+        if (cols[j] == i)                                                     \
+          diag += values[j];                                                  \
+      }                                                                       \
+      T ri = rhs[i] - ax;                                                     \
+      T di = diag != 0 ? 1 / diag : 1;                                        \
+      r[i] = ri;                                                              \
+      dinv[i] = di;                                                           \
+      z[i] = di * ri;                                                         \
+      p[i] = di * ri;                                                         \
+      rz += ri * di * ri;                                                     \
+      rr += ri * ri;                                                          \
+      bb += rhs[i] * rhs[i];                                                  \
+    }                                                                         \
+    sparse_reduce_add_##T((T *)ctx->g, bb);                                   \
+    sparse_reduce_add_##T(sparse_cg_rz_##T(ctx, 0), rz);                      \
+    sparse_reduce_add_##T(sparse_cg_rr_##T(ctx, 0), rr);                      \
+  }                                                                           \
+                                                                              \
+  void sparse_cg_spmv_##T##_worker(sparse_pass_context *ctx, int w) {         \
+    if (sparse_cg_converged_##T(ctx, ctx->k))                                 \
+      return;                                                                 \
+    auto offsets = (i32 *)ctx->a;                                             \
+    auto cols = (i32 *)ctx->b;                                                \
+    auto values = (T *)ctx->c;                                                \
+    auto n = ctx->n;                                                          \
+    auto p = (T *)ctx->f + 2 * n, q = p + n;                                  \
+    T pq = 0;                                                                 \
+    SPARSE_FOR(i, ctx, w) {                                                   \
+      T sum = 0;                                                              \
+      for (int j = offsets[i]; j < offsets[i + 1]; j++)                       \
+        sum += values[j] * p[cols[j]];                                        \
+      q[i] = sum;                                                             \
+      pq += p[i] * sum;                                                       \
+    }                                                                         \
+    sparse_reduce_add_##T(sparse_cg_pq_##T(ctx, ctx->k), pq);                 \
+  }                                                                           \
+                                                                              \
+  void sparse_cg_update_##T##_worker(sparse_pass_context *ctx, int w) {       \
+    auto k = ctx->k;                                                          \
+    if (sparse_cg_converged_##T(ctx, k))                                      \
+      return;                                                                 \
+    auto x = (T *)ctx->e;                                                     \
+    auto n = ctx->n;                                                          \
+    auto r = (T *)ctx->f, z = r + n, p = r + 2 * n, q = r + 3 * n,            \
+         dinv = r + 4 * n;                                                    \
+    auto pq = *sparse_cg_pq_##T(ctx, k);                                      \
+    T alpha = pq != 0 ? *sparse_cg_rz_##T(ctx, k) / pq : 0;                   \
+    T rz = 0, rr = 0;                                                         \
+    SPARSE_FOR(i, ctx, w) {                                                   \
+      x[i] += alpha * p[i];                                                   \
+      T ri = r[i] - alpha * q[i];                                             \
+      r[i] = ri;                                                              \
+      z[i] = dinv[i] * ri;                                                    \
+      rz += ri * z[i];                                                        \
+      rr += ri * ri;                                                          \
+    }                                                                         \
+    sparse_reduce_add_##T(sparse_cg_rz_##T(ctx, k + 1), rz);                  \
+    sparse_reduce_add_##T(sparse_cg_rr_##T(ctx, k + 1), rr);                  \
+  }                                                                           \
+                                                                              \
+  void sparse_cg_direction_##T##_worker(sparse_pass_context *ctx, int w) {    \
+    auto k = ctx->k;                                                          \
+    if (sparse_cg_converged_##T(ctx, k + 1))                                  \
+      return;                                                                 \
+    auto n = ctx->n;                                                          \
+    auto z = (T *)ctx->f + n, p = z + n;                                      \
+    auto rz = *sparse_cg_rz_##T(ctx, k);                                      \
+    T beta = rz != 0 ? *sparse_cg_rz_##T(ctx, k + 1) / rz : 0;                \
+    SPARSE_FOR(i, ctx, w) {                                                   \
+      p[i] = z[i] + beta * p[i];                                              \
+    }                                                                         \
+  }
+
+DEFINE_SPARSE_PASSES(f32)
+DEFINE_SPARSE_PASSES(f64)
+#undef DEFINE_SPARSE_PASSES
+#undef SPARSE_FOR
+
+#if ARCH_cuda
+#define DEFINE_SPARSE_PASS(name)                                              \
+  void runtime_sparse_##name(LLVMRuntime *runtime, Ptr a, Ptr b, Ptr c, Ptr d, \
+                             Ptr e, Ptr f, Ptr g, Ptr h, i32 n,               \
+                             i32 num_workers, i32 k, i32 m, i32 num_threads) { \
+    sparse_pass_context ctx{a, b, c, d, e, f, g, h, n, num_workers, k, m};    \
+    auto w = linear_thread_idx();                                             \
+    if (w < num_workers)                                                      \
+      sparse_##name##_worker(&ctx, w);                                        \
+  }
+#else
+#define DEFINE_SPARSE_PASS(name)                                              \
+  void sparse_##name##_task(void *ctx, int w) {                               \
+    sparse_##name##_worker((sparse_pass_context *)ctx, w);                    \
+  }                                                                           \
+  void runtime_sparse_##name(LLVMRuntime *runtime, Ptr a, Ptr b, Ptr c, Ptr d, \
+                             Ptr e, Ptr f, Ptr g, Ptr h, i32 n,               \
+                             i32 num_workers, i32 k, i32 m, i32 num_threads) { \
+    sparse_pass_context ctx{a, b, c, d, e, f, g, h, n, num_workers, k, m};    \
+    if (num_workers == 1 || num_threads <= 1 ||                               \
+        runtime->parallel_for == nullptr) {                                   \
+      for (int w = 0; w < num_workers; w++)                                   \
+        sparse_##name##_worker(&ctx, w);                                      \
+    } else {                                                                  \
+      runtime->parallel_for(runtime->thread_pool, num_workers, num_threads,   \
+                            &ctx, sparse_##name##_task);                      \
+    }                                                                         \
+  }
+#endif
+
+DEFINE_SPARSE_PASS(iota)
+DEFINE_SPARSE_PASS(gather_i32)
+DEFINE_SPARSE_PASS(unique_flags)
+DEFINE_SPARSE_PASS(assemble_f32)
+DEFINE_SPARSE_PASS(assemble_f64)
+DEFINE_SPARSE_PASS(spmv_f32)
+DEFINE_SPARSE_PASS(spmv_f64)
+DEFINE_SPARSE_PASS(cg_init_f32)
+DEFINE_SPARSE_PASS(cg_init_f64)
+DEFINE_SPARSE_PASS(cg_spmv_f32)
+DEFINE_SPARSE_PASS(cg_spmv_f64)
+DEFINE_SPARSE_PASS(cg_update_f32)
+DEFINE_SPARSE_PASS(cg_update_f64)
+DEFINE_SPARSE_PASS(cg_direction_f32)
+DEFINE_SPARSE_PASS(cg_direction_f64)
+#undef DEFINE_SPARSE_PASS
 }
 
 #if ARCH_cuda
@@ -1442,8 +3321,11 @@ void gc_parallel_2(LLVMRuntime *runtime, int snode_id) {
 extern "C" {
 
 u32 cuda_rand_u32(Context *context) {
-  auto state =
-      &((LLVMRuntime *)context->runtime)->rand_states[linear_thread_idx()];
+  auto i = linear_thread_idx();
+  auto state = ((LLVMRuntime *)context->runtime)->get_rand_state(i);
+  if (!state->initialized) {
+    initialize_rand_state(state, i);
+  }
 
   auto &x = state->x;
   auto &y = state->y;
@@ -1460,25 +3342,57 @@ u32 cuda_rand_u32(Context *context) {
                           // it decorrelates streams of PRNGs
 }
 
-uint64 cuda_rand_u64(Context *context) {
-  return ((u64)cuda_rand_u32(context) << 32) + cuda_rand_u32(context);
-}
-
-f32 cuda_rand_f32(Context *context) {
-  return cuda_rand_u32(context) * (1.0f / 4294967296.0f);
-}
-
-f64 cuda_rand_f64(Context *context) {
-  return cuda_rand_f32(context);
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2,
+// 3"), keyed by the thread. Each call takes the first word of the next block
+// of the stream of the thread.
+u32 cuda_philox_rand_u32(Context *context) {
+  auto i = linear_thread_idx();
+  auto state = ((LLVMRuntime *)context->runtime)->get_rand_state(i);
+  auto counter = ((u64)state->y << 32) | state->x;
+  state->x = (u32)(counter + 1);
+  state->y = (u32)((counter + 1) >> 32);
+
+  u32 c0 = (u32)counter, c1 = (u32)(counter >> 32), c2 = 0, c3 = 0;
+  u32 k0 = (u32)i, k1 = 0x6A09E667;
+  for (int round = 0; round < 10; round++) {
+    if (round > 0) {
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    auto p0 = (u64)0xD2511F53 * c0;
+    auto p1 = (u64)0xCD9E8D57 * c2;
+    c0 = (u32)(p1 >> 32) ^ c1 ^ k0;
+    c2 = (u32)(p0 >> 32) ^ c3 ^ k1;
+    c1 = (u32)p1;
+    c3 = (u32)p0;
+  }
+  return c0;
 }
 
-i32 cuda_rand_i32(Context *context) {
-  return cuda_rand_u32(context);
-}
+#define DEFINE_CUDA_RAND(name)                                                \
+  uint64 name##_u64(Context *context) {                                       \
+    return ((u64)name##_u32(context) << 32) + name##_u32(context);            \
+  }                                                                           \
+                                                                              \
+  f32 name##_f32(Context *context) {                                          \
+    return name##_u32(context) * (1.0f / 4294967296.0f);                      \
+  }                                                                           \
+                                                                              \
+  f64 name##_f64(Context *context) {                                          \
+    return name##_f32(context);                                               \
+  }                                                                           \
+                                                                              \
+  i32 name##_i32(Context *context) {                                          \
+    return name##_u32(context);                                               \
+  }                                                                           \
+                                                                              \
+  i64 name##_i64(Context *context) {                                          \
+    return name##_u64(context);                                               \
+  }
 
-i64 cuda_rand_i64(Context *context) {
-  return cuda_rand_u64(context);
-}
+DEFINE_CUDA_RAND(cuda_rand)
+DEFINE_CUDA_RAND(cuda_philox_rand)
+#undef DEFINE_CUDA_RAND
 };
 #endif
 
@@ -1569,11 +3483,14 @@ void stack_push(Ptr stack, size_t max_num_elements, std::size_t element_size) {
                                                                               \
   u##N atomic_add_partial_bits_b##N(u##N *ptr, u32 offset, u32 bits,          \
                                     u##N value) {                             \
+    /* The sum wraps around inside the bits, leaving the others intact. */    \
+    u##N mask = bits == N ? ~(u##N)0 : ((((u##N)1 << bits) - 1) << offset);   \
     u##N new_value = 0;                                                       \
     u##N old_value = *ptr;                                                    \
     do {                                                                      \
       old_value = *ptr;                                                       \
-      new_value = old_value + (value << offset);                              \
+      new_value = (old_value & ~mask) | ((old_value + (value << offset)) &    \
+                                         mask);                               \
     } while (                                                                 \
         !__atomic_compare_exchange(ptr, &old_value, &new_value, true,         \
                                    std::memory_order::memory_order_seq_cst,   \
@@ -12,6 +12,10 @@ class StructCompiler {
   std::vector<SNode *> snodes;
   std::vector<SNode *> ambient_snodes;
   std::size_t root_size;
+  // SNode id -> (offset, size) in bytes in the root buffer, for the children
+  // of the root
+  std::unordered_map<int, std::pair<std::size_t, std::size_t>>
+      root_child_ranges;
   Program *prog;
 
   explicit StructCompiler(Program *prog);
@@ -32,7 +36,12 @@ class StructCompiler {
 
   virtual void run(SNode &node, bool host) = 0;
 
-  static std::unique_ptr<StructCompiler> make(Program *prog, Arch arch);
+  // With |append|, the types and accessors of the tree are added to the
+  // struct module of the trees compiled before, whose kernels stay valid,
+  // instead of replacing it. See Program::materialize_snode_tree().
+  static std::unique_ptr<StructCompiler> make(Program *prog,
+                                              Arch arch,
+                                              bool append = false);
 };
 
 TLANG_NAMESPACE_END
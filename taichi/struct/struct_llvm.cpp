@@ -4,6 +4,7 @@
 #include "llvm/IR/IRBuilder.h"
 
 #include "taichi/ir/ir.h"
+#include "taichi/math/arithmetic.h"
 #include "taichi/struct/struct.h"
 #include "taichi/struct/struct_llvm.h"
 #include "taichi/program/program.h"
@@ -13,10 +14,12 @@ TLANG_NAMESPACE_BEGIN
 
 using namespace llvm;
 
-StructCompilerLLVM::StructCompilerLLVM(Program *prog, Arch arch)
+StructCompilerLLVM::StructCompilerLLVM(Program *prog, Arch arch, bool append)
     : StructCompiler(prog),
-      LLVMModuleBuilder(prog->get_llvm_context(arch)->clone_runtime_module(),
-                        prog->get_llvm_context(arch)),
+      LLVMModuleBuilder(
+          append ? prog->get_llvm_context(arch)->clone_struct_module_source()
+                 : prog->get_llvm_context(arch)->clone_runtime_module(),
+          prog->get_llvm_context(arch)),
       arch(arch) {
   tlctx = prog->get_llvm_context(arch);
   llvm_ctx = tlctx->get_this_thread_context();
@@ -35,20 +38,67 @@ void StructCompilerLLVM::generate_types(SNode &snode) {
   // create children type that supports forking...
 
   std::vector<llvm::Type *> ch_types;
+  // Pads |ch_types| with bytes up to the next multiple of |alignment|.
+  auto pad_to = [&](std::size_t alignment) {
+    auto end_marker = ch_types;
+    end_marker.push_back(llvm::Type::getInt8Ty(*ctx));
+    const auto end =
+        tlctx->get_data_layout()
+            .getStructLayout(llvm::StructType::get(*ctx, end_marker))
+            ->getElementOffset(ch_types.size());
+    const auto padding = iroundup((std::size_t)end, alignment) - end;
+    if (padding != 0) {
+      ch_types.push_back(
+          llvm::ArrayType::get(llvm::Type::getInt8Ty(*ctx), padding));
+    }
+  };
+  if (snode.cell_alignment != 0) {
+    TI_ERROR_IF(type != SNodeType::dense,
+                "Only dense SNodes can have a cell alignment");
+    TI_ERROR_IF(!bit::is_power_of_two(snode.cell_alignment) ||
+                    snode.cell_alignment > taichi_page_size,
+                "The cell alignment must be a power of two up to {}, got {}",
+                taichi_page_size, snode.cell_alignment);
+  }
+  int cell_alignment = std::max(snode.cell_alignment, 1);
   for (int i = 0; i < snode.ch.size(); i++) {
     if (!snode.ch[i]->is_bit_level) {
       // Bit-level SNodes do not really have a corresponding LLVM type
       auto ch = get_llvm_node_type(module.get(), snode.ch[i].get());
+      // The pages of a child mapped to a file hold nothing else, see
+      // Program::map_root_children_to_files().
+      const bool mapped = type == SNodeType::root && arch_is_cpu(arch) &&
+                          !snode.ch[i]->mmap_path.empty();
+      const int ch_alignment = required_alignments.at(snode.ch[i].get());
+      if (mapped) {
+        pad_to(taichi_page_size);
+      } else if (ch_alignment > 1) {
+        pad_to(ch_alignment);
+      }
+      cell_alignment = std::max(cell_alignment, ch_alignment);
+      element_indices[snode.ch[i].get()] = (int)ch_types.size();
       ch_types.push_back(ch);
+      if (mapped) {
+        pad_to(taichi_page_size);
+      }
     }
   }
+  // The cells of a dense SNode are padded so that the next one is aligned
+  // too. The alignment is not tracked in the other SNodes, whose nodes are
+  // allocated separately or hold more than the array of the cells.
+  if (type == SNodeType::dense && cell_alignment > 1) {
+    pad_to(cell_alignment);
+  }
+  required_alignments[&snode] =
+      type == SNodeType::dense || type == SNodeType::root ? cell_alignment
+                                                          : 1;
 
   auto ch_type =
       llvm::StructType::create(*ctx, ch_types, snode.node_type_name + "_ch");
 
   llvm::Type *body_type = nullptr, *aux_type = nullptr;
   if (type == SNodeType::dense || type == SNodeType::bitmasked) {
-    TI_ASSERT(snode._morton == false);
+    TI_ASSERT(!snode._morton || type == SNodeType::dense);
     body_type = llvm::ArrayType::get(ch_type, snode.max_num_elements());
     if (type == SNodeType::bitmasked) {
       aux_type = llvm::ArrayType::get(llvm::Type::getInt32Ty(*llvm_ctx),
@@ -111,6 +161,12 @@ void StructCompilerLLVM::generate_types(SNode &snode) {
                                     snode.max_num_elements());
     body_type = llvm::ArrayType::get(llvm::PointerType::getInt8PtrTy(*ctx),
                                      snode.max_num_elements());
+  } else if (type == SNodeType::hash) {
+    // keys
+    aux_type = llvm::ArrayType::get(llvm::Type::getInt32Ty(*ctx),
+                                    snode.hash_capacity);
+    body_type = llvm::ArrayType::get(llvm::PointerType::getInt8PtrTy(*ctx),
+                                     snode.hash_capacity);
   } else if (type == SNodeType::dynamic) {
     // mutex and n (number of elements)
     aux_type =
@@ -121,7 +177,17 @@ void StructCompilerLLVM::generate_types(SNode &snode) {
     TI_P(snode.type_name());
     TI_NOT_IMPLEMENTED;
   }
-  if (aux_type != nullptr) {
+  if (type == SNodeType::pointer || type == SNodeType::hash) {
+    // One occupancy bit per child (slot) after the data pointers, which lets
+    // listgen skip inactive children 32 at a time. See
+    // Pointer_get_active_mask().
+    const int num_slots = type == SNodeType::hash ? snode.hash_capacity
+                                                  : snode.max_num_elements();
+    auto mask_type = llvm::ArrayType::get(llvm::Type::getInt32Ty(*llvm_ctx),
+                                          (num_slots + 31) / 32);
+    node_type =
+        llvm::StructType::create(*ctx, {aux_type, body_type, mask_type}, "");
+  } else if (aux_type != nullptr) {
     node_type = llvm::StructType::create(*ctx, {aux_type, body_type}, "");
   } else {
     node_type = body_type;
@@ -177,7 +243,15 @@ void StructCompilerLLVM::generate_refine_coordinates(SNode *snode) {
 
   for (int i = 0; i < taichi_max_num_indices; i++) {
     auto addition = tlctx->get_constant(0);
-    if (snode->extractors[i].num_bits) {
+    if (snode->extractors[i].num_bits && snode->_morton) {
+      // Gathers the interleaved bits one by one.
+      for (int b = 0; b < snode->extractors[i].num_bits; b++) {
+        auto bit = builder.CreateAnd(
+            builder.CreateLShr(l, snode->get_child_index_bit(i, b)), 1);
+        addition = builder.CreateOr(
+            addition, builder.CreateShl(bit, snode->extractors[i].start + b));
+      }
+    } else if (snode->extractors[i].num_bits) {
       auto mask = ((1 << snode->extractors[i].num_bits) - 1);
       addition = builder.CreateAnd(
           builder.CreateAShr(l, snode->extractors[i].acc_offset), mask);
@@ -226,11 +300,12 @@ void StructCompilerLLVM::generate_child_accessors(SNode &snode) {
     for (auto &arg : func->args()) {
       args.push_back(&arg);
     }
+    const int child_index = element_indices.at(&snode);
     llvm::Value *ret;
-    ret = builder.CreateGEP(
-        builder.CreateBitCast(args[0], inp_type),
-        {tlctx->get_constant(0), tlctx->get_constant(parent->child_id(&snode))},
-        "getch");
+    ret = builder.CreateGEP(builder.CreateBitCast(args[0], inp_type),
+                            {tlctx->get_constant(0),
+                             tlctx->get_constant(child_index)},
+                            "getch");
 
     builder.CreateRet(
         builder.CreateBitCast(ret, llvm::Type::getInt8PtrTy(*llvm_ctx)));
@@ -244,6 +319,35 @@ void StructCompilerLLVM::generate_child_accessors(SNode &snode) {
   stack.pop_back();
 }
 
+void StructCompilerLLVM::infer_address_alignments(SNode *snode,
+                                                  uint64 alignment) {
+  // The cells of a dense SNode are the elements of its node, an array.
+  const auto &data_layout = tlctx->get_data_layout();
+  auto ch_type =
+      llvm::cast<llvm::StructType>(get_llvm_element_type(module.get(), snode));
+  auto ch_layout = data_layout.getStructLayout(ch_type);
+  auto lowest_bit = [](uint64 x) { return x & (~x + 1); };
+  if (snode->max_num_elements() > 1) {
+    const uint64 stride = data_layout.getTypeAllocSize(ch_type);
+    if (stride != 0)
+      alignment = std::min(alignment, lowest_bit(stride));
+  }
+  for (auto &ch : snode->ch) {
+    if (ch->is_bit_level)
+      continue;
+    auto ch_alignment = alignment;
+    const uint64 offset =
+        ch_layout->getElementOffset(element_indices.at(ch.get()));
+    if (offset != 0)
+      ch_alignment = std::min(ch_alignment, lowest_bit(offset));
+    if (ch->type == SNodeType::place) {
+      ch->address_alignment = (int)ch_alignment;
+    } else if (ch->type == SNodeType::dense) {
+      infer_address_alignments(ch.get(), ch_alignment);
+    }
+  }
+}
+
 std::string StructCompilerLLVM::type_stub_name(SNode *snode) {
   return snode->node_type_name + "_type_stubs";
 }
@@ -265,6 +369,8 @@ void StructCompilerLLVM::run(SNode &root, bool host) {
     generate_types(*n);
 
   generate_child_accessors(root);
+  // The root buffer is allocated at a page boundary.
+  infer_address_alignments(&root, taichi_page_size);
 
   if (prog->config.print_struct_llvm_ir) {
     static FileSequenceWriter writer("taichi_struct_llvm_ir_{:04d}.ll",
@@ -275,7 +381,22 @@ void StructCompilerLLVM::run(SNode &root, bool host) {
   TI_ASSERT((int)snodes.size() <= taichi_max_num_snodes);
 
   auto node_type = get_llvm_node_type(module.get(), &root);
-  root_size = tlctx->get_data_layout().getTypeAllocSize(node_type);
+  auto data_layout = tlctx->get_data_layout();
+  root_size = data_layout.getTypeAllocSize(node_type);
+
+  // The root node is the struct of its (non bit-level) children.
+  auto root_struct = llvm::cast<llvm::StructType>(node_type);
+  auto root_layout = data_layout.getStructLayout(root_struct);
+  for (auto &ch : root.ch) {
+    if (ch->is_bit_level) {
+      continue;
+    }
+    const int element_index = element_indices.at(ch.get());
+    root_child_ranges[ch->id] = {
+        root_layout->getElementOffset(element_index),
+        data_layout.getTypeAllocSize(
+            root_struct->getElementType(element_index))};
+  }
 
   tlctx->set_struct_module(module);
 }
@@ -314,8 +435,10 @@ llvm::Type *StructCompilerLLVM::get_llvm_element_type(llvm::Module *module,
   return get_stub(module, snode, 3);
 }
 
-std::unique_ptr<StructCompiler> StructCompiler::make(Program *prog, Arch arch) {
-  return std::make_unique<StructCompilerLLVM>(prog, arch);
+std::unique_ptr<StructCompiler> StructCompiler::make(Program *prog,
+                                                     Arch arch,
+                                                     bool append) {
+  return std::make_unique<StructCompilerLLVM>(prog, arch, append);
 }
 
 TLANG_NAMESPACE_END
@@ -7,11 +7,18 @@ TLANG_NAMESPACE_BEGIN
 
 class StructCompilerLLVM : public StructCompiler, public LLVMModuleBuilder {
  public:
-  StructCompilerLLVM(Program *prog, Arch arch);
+  StructCompilerLLVM(Program *prog, Arch arch, bool append = false);
 
   Arch arch;
   TaichiLLVMContext *tlctx;
   llvm::LLVMContext *llvm_ctx;
+  // The indices of the children in the struct of the cells of their parent,
+  // which also holds the padding aligning the children mapped to files to
+  // pages and the children with a cell alignment.
+  std::unordered_map<SNode *, int> element_indices;
+  // The alignment the node of each SNode requires for the cell alignments in
+  // its subtree, see SNode::cell_alignment. 1 if it has none.
+  std::unordered_map<SNode *, int> required_alignments;
 
   void generate_types(SNode &snode) override;
 
@@ -21,6 +28,10 @@ class StructCompilerLLVM : public StructCompiler, public LLVMModuleBuilder {
 
   void generate_refine_coordinates(SNode *snode);
 
+  // Sets SNode::address_alignment of the places under |snode|, whose node
+  // addresses are multiples of |alignment|.
+  void infer_address_alignments(SNode *snode, uint64 alignment);
+
   static std::string type_stub_name(SNode *snode);
 
   static llvm::Type *get_stub(llvm::Module *module, SNode *snode, uint32 index);
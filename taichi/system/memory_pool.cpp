@@ -1,5 +1,6 @@
 #include "memory_pool.h"
 #include "taichi/system/timer.h"
+#include "taichi/system/tracer.h"
 #include "taichi/program/program.h"
 #include "taichi/backends/cuda/cuda_driver.h"
 
@@ -40,14 +41,25 @@ void *MemoryPool::allocate(std::size_t size, std::size_t alignment) {
   if (!ret) {
     // allocation have failed
     auto new_buffer_size = std::max(size, default_allocator_size);
-    allocators.emplace_back(
-        std::make_unique<UnifiedAllocator>(new_buffer_size, prog->config.arch));
+    allocators.emplace_back(std::make_unique<UnifiedAllocator>(
+        new_buffer_size, prog->config.arch, prog->config.cpu_huge_pages));
     ret = allocators.back()->allocate(size, alignment);
   }
   TI_ASSERT(ret);
   return ret;
 }
 
+std::size_t MemoryPool::release(void *ptr, std::size_t size) {
+  std::lock_guard<std::mutex> _(mut_allocators);
+  for (auto &allocator : allocators) {
+    if (allocator->contains(ptr)) {
+      return allocator->release(ptr, size);
+    }
+  }
+  TI_ERROR("Pointer {} was not allocated from the memory pool", ptr);
+  return 0;
+}
+
 template <typename T>
 T MemoryPool::fetch(volatile void *ptr) {
   T ret;
@@ -109,6 +121,13 @@ void MemoryPool::daemon() {
                req.alignment);
       auto ptr = allocate(req.size, req.alignment);
       TI_DEBUG("  Allocated. Ptr = {:p}", ptr);
+      if (Tracer::is_enabled()) {
+        bytes_allocated_by_requests += req.size;
+        Tracer::get_instance().add_instant_event(
+            "memory", "allocate", fmt::format("{{\"bytes\":{}}}", req.size));
+        Tracer::get_instance().add_counter_event(
+            "memory_pool_requested_bytes", bytes_allocated_by_requests);
+      }
       push(&queue->requests[i].ptr, (uint8 *)ptr);
       processed_tail += 1;
     }
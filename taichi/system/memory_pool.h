@@ -30,6 +30,8 @@ class MemoryPool {
 
   MemRequestQueue *queue;
   void *cuda_stream{nullptr};
+  // Served to the runtime while tracing was enabled, for the trace.
+  std::size_t bytes_allocated_by_requests{0};
 
   MemoryPool(Program *prog);
 
@@ -41,6 +43,11 @@ class MemoryPool {
 
   void *allocate(std::size_t size, std::size_t alignment);
 
+  // Returns the physical memory behind [ptr, ptr + size), which must have been
+  // allocated from this pool and be unused, to the OS. Returns the number of
+  // bytes released.
+  std::size_t release(void *ptr, std::size_t size);
+
   void set_queue(MemRequestQueue *queue);
 
   void daemon();
@@ -0,0 +1,151 @@
+#include "taichi/system/numa.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#if defined(TI_PLATFORM_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+TI_NAMESPACE_BEGIN
+
+namespace {
+
+#if defined(TI_PLATFORM_LINUX)
+// See <linux/mempolicy.h>.
+constexpr int kMpolPreferred = 1;
+constexpr int kMpolInterleave = 3;
+constexpr int kMaxNumNodes = 64;
+
+// Parses a cpulist of sysfs, e.g. "0-15,32-47".
+std::vector<int> parse_cpu_list(const std::string &list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n")
+      continue;
+    auto dash = range.find('-');
+    int begin = std::stoi(range.substr(0, dash));
+    int end = dash == std::string::npos ? begin
+                                        : std::stoi(range.substr(dash + 1));
+    for (int cpu = begin; cpu <= end; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+bool set_memory_policy(void *ptr,
+                       std::size_t size,
+                       int mode,
+                       unsigned long node_mask) {
+  const auto page_size = (std::size_t)sysconf(_SC_PAGESIZE);
+  auto begin = (uint64)ptr / page_size * page_size;
+  auto end = ((uint64)ptr + size + page_size - 1) / page_size * page_size;
+  if (end <= begin)
+    return true;
+  return syscall(SYS_mbind, (void *)begin, end - begin, mode, &node_mask,
+                 kMaxNumNodes + 1, 0) == 0;
+}
+#endif
+
+}  // namespace
+
+std::vector<std::vector<int>> get_numa_node_cpus() {
+  std::vector<std::vector<int>> nodes;
+#if defined(TI_PLATFORM_LINUX)
+  for (int node = 0; node < kMaxNumNodes; node++) {
+    std::ifstream fs(
+        fmt::format("/sys/devices/system/node/node{}/cpulist", node));
+    std::string list;
+    if (fs)
+      std::getline(fs, list);
+    nodes.push_back(parse_cpu_list(list));
+  }
+#endif
+  while (!nodes.empty() && nodes.back().empty()) {
+    nodes.pop_back();
+  }
+  if (nodes.empty()) {
+    nodes.emplace_back();
+    for (int cpu = 0; cpu < (int)std::thread::hardware_concurrency(); cpu++) {
+      nodes.back().push_back(cpu);
+    }
+  }
+  return nodes;
+}
+
+std::vector<int> get_thread_affinity(const std::string &policy,
+                                     int num_threads) {
+  TI_ERROR_IF(policy != "compact" && policy != "scatter",
+              "Unknown thread affinity policy [{}], expected compact or "
+              "scatter",
+              policy);
+  const auto nodes = get_numa_node_cpus();
+  std::vector<int> cpus;
+  if (policy == "compact") {
+    for (const auto &node : nodes) {
+      cpus.insert(cpus.end(), node.begin(), node.end());
+    }
+  } else {
+    for (int i = 0; cpus.size() < (std::size_t)num_threads; i++) {
+      bool found = false;
+      for (const auto &node : nodes) {
+        if (i < (int)node.size()) {
+          cpus.push_back(node[i]);
+          found = true;
+        }
+      }
+      if (!found)
+        break;
+    }
+  }
+  TI_ASSERT(!cpus.empty());
+  // More threads than CPUs share them round-robin.
+  std::vector<int> affinity;
+  for (int i = 0; i < num_threads; i++) {
+    affinity.push_back(cpus[i % cpus.size()]);
+  }
+  return affinity;
+}
+
+bool set_thread_affinity(std::thread &thread, int cpu) {
+#if defined(TI_PLATFORM_LINUX)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set),
+                                &cpu_set) == 0;
+#else
+  return false;
+#endif
+}
+
+bool numa_interleave(void *ptr, std::size_t size) {
+#if defined(TI_PLATFORM_LINUX)
+  unsigned long mask = 0;
+  const auto nodes = get_numa_node_cpus();
+  for (int node = 0; node < (int)nodes.size(); node++) {
+    if (!nodes[node].empty())
+      mask |= 1UL << node;
+  }
+  return set_memory_policy(ptr, size, kMpolInterleave, mask);
+#else
+  return false;
+#endif
+}
+
+bool numa_prefer_node(void *ptr, std::size_t size, int node) {
+#if defined(TI_PLATFORM_LINUX)
+  return set_memory_policy(ptr, size, kMpolPreferred, 1UL << node);
+#else
+  return false;
+#endif
+}
+
+TI_NAMESPACE_END
@@ -0,0 +1,33 @@
+// NUMA topology, thread affinity and memory placement on Linux. On the other
+// platforms, the machine is treated as a single node and these are no-ops.
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "taichi/common/core.h"
+
+TI_NAMESPACE_BEGIN
+
+// Returns the CPUs of each NUMA node, by node id. The nodes without CPUs are
+// empty.
+std::vector<std::vector<int>> get_numa_node_cpus();
+
+// Returns the CPU to pin each of |num_threads| threads to, under |policy|:
+//   "compact": fill the CPUs of one node before moving to the next.
+//   "scatter": spread consecutive threads over the nodes round-robin.
+std::vector<int> get_thread_affinity(const std::string &policy,
+                                     int num_threads);
+
+// Pins |thread| to |cpu|. Returns false if that failed or is unsupported.
+bool set_thread_affinity(std::thread &thread, int cpu);
+
+// Sets the policy of the pages of [ptr, ptr + size) that are not touched yet:
+// interleaved over all the nodes, or preferably on |node|. Returns false if
+// that failed or is unsupported.
+bool numa_interleave(void *ptr, std::size_t size);
+bool numa_prefer_node(void *ptr, std::size_t size, int node);
+
+TI_NAMESPACE_END
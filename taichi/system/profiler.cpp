@@ -1,5 +1,9 @@
 #include "taichi/system/profiler.h"
 
+#include <atomic>
+
+#include "taichi/system/tracer.h"
+
 TI_NAMESPACE_BEGIN
 
 // A profiler's records form a tree structure
@@ -43,7 +47,7 @@ struct ProfilerRecordNode {
     return total_time / (float64)total_elements;
   }
 
-  ProfilerRecordNode *get_child(const std::string &name) {
+  ProfilerRecordNode *get_child(const char *name) {
     for (auto &ch : childs) {
       if (ch->name == name) {
         return ch.get();
@@ -54,8 +58,20 @@ struct ProfilerRecordNode {
   }
 };
 
+// The records of a thread. The thread appends the begin and end events of its
+// scopes to |events| without locking, and whoever holds |fold_mut| folds them
+// into the tree: the thread itself when the buffer is full, or a printer.
 class ProfilerRecords {
  public:
+  struct Event {
+    // The name of the scope for begin events, nullptr for end events.
+    const char *name;
+    float64 time;
+    uint64 elements;
+  };
+
+  static constexpr std::size_t kNumEvents = 4096;
+
   std::unique_ptr<ProfilerRecordNode> root;
   ProfilerRecordNode *current_node;
   int current_depth;
@@ -70,44 +86,41 @@ class ProfilerRecords {
   }
 
   void clear() {
+    std::lock_guard<std::mutex> _(fold_mut);
+    fold_events();
+    // Keep the scopes that are still open, so that their ends can be folded.
+    std::vector<std::string> open_scopes;
+    for (auto node = current_node; node != root.get(); node = node->parent) {
+      open_scopes.push_back(node->name);
+    }
     root->childs.clear();
     current_node = root.get();
-    current_depth = 0;
+    for (auto it = open_scopes.rbegin(); it != open_scopes.rend(); ++it) {
+      current_node = current_node->get_child(it->c_str());
+    }
+    current_depth = (int)open_scopes.size();
     enabled = true;
   }
 
   void print(ProfilerRecordNode *node, int depth);
 
   void print() {
+    std::lock_guard<std::mutex> _(fold_mut);
+    fold_events();
     fmt::print(fg(fmt::color::cyan), std::string(80, '>') + "\n");
     print(root.get(), 0);
     fmt::print(fg(fmt::color::cyan), std::string(80, '>') + "\n");
   }
 
-  void insert_sample(float64 time) {
-    if (!enabled)
-      return;
-    current_node->insert_sample(time);
-  }
-
-  void insert_sample(float64 time, uint64 tpe) {
-    if (!enabled)
-      return;
-    current_node->insert_sample(time, tpe);
-  }
-
-  void push(const std::string name) {
-    if (!enabled)
-      return;
-    current_node = current_node->get_child(name);
-    current_depth += 1;
-  }
-
-  void pop() {
-    if (!enabled)
-      return;
-    current_node = current_node->parent;
-    current_depth -= 1;
+  // Only called by the thread owning the records.
+  void append(const char *name, float64 time, uint64 elements = -1) {
+    auto head = events_head.load(std::memory_order_relaxed);
+    if (head - events_tail.load(std::memory_order_acquire) == kNumEvents) {
+      std::lock_guard<std::mutex> _(fold_mut);
+      fold_events();
+    }
+    events[head % kNumEvents] = {name, time, elements};
+    events_head.store(head + 1, std::memory_order_release);
   }
 
   static ProfilerRecords &get_this_thread_instance() {
@@ -118,6 +131,40 @@ class ProfilerRecords {
     }
     return *profiler_records;
   }
+
+ private:
+  // Requires |fold_mut|.
+  void fold_events() {
+    auto tail = events_tail.load(std::memory_order_relaxed);
+    auto head = events_head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      const auto &e = events[tail % kNumEvents];
+      if (e.name) {
+        current_node = current_node->get_child(e.name);
+        current_depth += 1;
+        begin_times.push_back(e.time);
+        continue;
+      }
+      TI_ASSERT(!begin_times.empty());
+      float64 elapsed = e.time - begin_times.back();
+      begin_times.pop_back();
+      if ((int64)e.elements != -1) {
+        current_node->insert_sample(elapsed, e.elements);
+      } else {
+        current_node->insert_sample(elapsed);
+      }
+      current_node = current_node->parent;
+      current_depth -= 1;
+    }
+    events_tail.store(tail, std::memory_order_release);
+  }
+
+  std::mutex fold_mut;
+  // The begin times of the open scopes, in the order they were folded.
+  std::vector<float64> begin_times;
+  Event events[kNumEvents];
+  std::atomic<std::size_t> events_head{0};
+  std::atomic<std::size_t> events_tail{0};
 };
 
 void ProfilerRecords::print(ProfilerRecordNode *node, int depth) {
@@ -212,24 +259,33 @@ void ProfilerRecords::print(ProfilerRecordNode *node, int depth) {
   }
 }
 
-ScopedProfiler::ScopedProfiler(std::string name, uint64 elements) {
-  start_time = Time::get_time();
+ScopedProfiler::ScopedProfiler(const char *name, uint64 elements) {
+  auto &records = ProfilerRecords::get_this_thread_instance();
+  this->records = records.enabled ? &records : nullptr;
   this->name = name;
   this->elements = elements;
+  trace_begin = Tracer::is_enabled() ? Tracer::now_us() : -1;
   stopped = false;
-  ProfilerRecords::get_this_thread_instance().push(name);
+  start_time = Time::get_time();
+  if (this->records) {
+    this->records->append(name, start_time);
+  }
+}
+
+ScopedProfiler::ScopedProfiler(const std::string &name, uint64 elements)
+    : ScopedProfiler(Profiling::get_instance().intern(name), elements) {
 }
 
 void ScopedProfiler::stop() {
   TI_ASSERT_INFO(!stopped, "Profiler already stopped.");
-  float64 elapsed = Time::get_time() - start_time;
-  if ((int64)elements != -1) {
-    ProfilerRecords::get_this_thread_instance().insert_sample(elapsed,
-                                                              elements);
-  } else {
-    ProfilerRecords::get_this_thread_instance().insert_sample(elapsed);
+  stopped = true;
+  if (records) {
+    records->append(nullptr, Time::get_time(), elements);
+  }
+  if (trace_begin >= 0) {
+    Tracer::get_instance().add_complete_event(
+        "profiler", name, trace_begin, Tracer::now_us() - trace_begin);
   }
-  ProfilerRecords::get_this_thread_instance().pop();
 }
 
 void ScopedProfiler::disable() {
@@ -263,6 +319,11 @@ ProfilerRecords *Profiling::get_this_thread_profiler() {
   return profilers[id];
 }
 
+const char *Profiling::intern(const std::string &name) {
+  std::lock_guard<std::mutex> _(mut);
+  return interned_names.insert(name).first->c_str();
+}
+
 void Profiling::print_profile_info() {
   std::lock_guard<std::mutex> _(mut);
   for (auto p : profilers) {
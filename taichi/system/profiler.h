@@ -10,6 +10,8 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "taichi/common/core.h"
 #include "taichi/system/timer.h"
@@ -20,10 +22,20 @@ TI_NAMESPACE_BEGIN
 class ProfilerRecords;
 
 // Captures running time between the construction and destruction of the
-// profiler instance
+// profiler instance.
+//
+// The begin and end of each scope are appended to a ring buffer of the
+// thread, which is folded into the profiler records only when the buffer is
+// full or the records are printed. Entering a scope thus neither allocates
+// nor takes a lock, as long as |name| is a string that outlives the program,
+// e.g. a literal or __FUNCTION__.
 class ScopedProfiler {
  public:
-  ScopedProfiler(std::string name, uint64 elements = -1);
+  explicit ScopedProfiler(const char *name, uint64 elements = -1);
+
+  // Interns |name| first, which takes a lock. Prefer the overload above with
+  // static names in hot paths.
+  explicit ScopedProfiler(const std::string &name, uint64 elements = -1);
 
   void stop();
 
@@ -34,7 +46,11 @@ class ScopedProfiler {
   ~ScopedProfiler();
 
  private:
-  std::string name;
+  // Null if profiling was disabled for this thread at the construction.
+  ProfilerRecords *records;
+  const char *name;
+  // Tracer::now_us() at the construction, or -1 if tracing was disabled.
+  float64 trace_begin;
   float64 start_time;
   uint64 elements;
   bool stopped;
@@ -46,11 +62,14 @@ class Profiling {
   void print_profile_info();
   void clear_profile_info();
   ProfilerRecords *get_this_thread_profiler();
+  // Returns a copy of |name| that lives together with the process.
+  const char *intern(const std::string &name);
   static Profiling &get_instance();
 
  private:
   std::mutex mut;
   std::unordered_map<std::thread::id, ProfilerRecords *> profilers;
+  std::unordered_set<std::string> interned_names;
 };
 
 #define TI_PROFILER(name) taichi::ScopedProfiler _profiler_##__LINE__(name);
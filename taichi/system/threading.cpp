@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <condition_variable>
 #include "taichi/system/threading.h"
+#include "taichi/system/numa.h"
 #include <thread>
 #include <vector>
 #if defined(TI_PLATFORM_WINDOWS)
@@ -62,7 +63,16 @@ ThreadPool::ThreadPool() {
   max_num_threads = std::thread::hardware_concurrency();
   threads.resize((std::size_t)max_num_threads);
   for (int i = 0; i < max_num_threads; i++) {
-    threads[i] = std::thread([this] { this->target(); });
+    threads[i] = std::thread([this, i] { this->target(i); });
+  }
+}
+
+void ThreadPool::set_affinity(const std::vector<int> &cpus) {
+  for (int i = 0; i < max_num_threads && i < (int)cpus.size(); i++) {
+    if (!set_thread_affinity(threads[i], cpus[i])) {
+      TI_WARN("Failed to pin thread {} to CPU {}", i, cpus[i]);
+      return;
+    }
   }
 }
 
@@ -70,6 +80,7 @@ void ThreadPool::run(int splits,
                      int desired_num_threads,
                      void *context,
                      RangeForTaskFunc *func) {
+  std::lock_guard<std::mutex> run_lock(run_mutex);
   {
     std::lock_guard _(mutex);
     this->context = context;
@@ -94,12 +105,11 @@ void ThreadPool::run(int splits,
   TI_ASSERT(task_head >= task_tail);
 }
 
-void ThreadPool::target() {
+void ThreadPool::target(int thread_id) {
   uint64 last_timestamp = 0;
-  int thread_id;
   {
     std::lock_guard<std::mutex> lock(mutex);
-    thread_id = thread_counter++;
+    thread_counter++;
   }
   while (true) {
     {
@@ -160,4 +170,183 @@ ThreadPool::~ThreadPool() {
     th.join();
 }
 
+namespace {
+
+// Number of polls an idle worker performs before parking.
+constexpr int kNumSpinsBeforeParking = 1 << 12;
+// Busy-wait only briefly and then yield, so that spinning threads do not starve
+// the ones doing actual work when the machine is oversubscribed.
+constexpr int kNumSpinsBeforeYielding = 64;
+
+inline void cpu_relax(int spins) {
+#if defined(TI_ARCH_x64)
+  if (spins < kNumSpinsBeforeYielding) {
+    __builtin_ia32_pause();
+    return;
+  }
+#endif
+  std::this_thread::yield();
+}
+
+}  // namespace
+
+WorkStealingThreadPool::WorkStealingThreadPool(int max_num_threads) {
+  if (max_num_threads <= 0) {
+    max_num_threads = std::thread::hardware_concurrency();
+  }
+  max_num_threads_ = std::max(max_num_threads, 1);
+  ranges_ = std::make_unique<Range[]>((std::size_t)max_num_threads_);
+  // Worker 0 is the thread calling run().
+  for (int i = 1; i < max_num_threads_; i++) {
+    threads_.emplace_back([this, i] { this->target(i); });
+  }
+}
+
+void WorkStealingThreadPool::set_affinity(const std::vector<int> &cpus) {
+  for (int i = 1; i < max_num_threads_ && i < (int)cpus.size(); i++) {
+    if (!set_thread_affinity(threads_[i - 1], cpus[i])) {
+      TI_WARN("Failed to pin worker {} to CPU {}", i, cpus[i]);
+      return;
+    }
+  }
+}
+
+void WorkStealingThreadPool::run(int splits,
+                                 int desired_num_threads,
+                                 void *context,
+                                 RangeForTaskFunc *func) {
+  TI_ASSERT(desired_num_threads > 0);
+  if (splits <= 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  int num_participants =
+      std::min({desired_num_threads, max_num_threads_, splits});
+  for (int i = 0; i < num_participants; i++) {
+    auto begin = (uint32)((int64)splits * i / num_participants);
+    auto end = (uint32)((int64)splits * (i + 1) / num_participants);
+    ranges_[i].packed.store(pack(begin, end), std::memory_order_relaxed);
+  }
+  context_ = context;
+  func_ = func;
+  num_participants_ = num_participants;
+  active_workers_.store(num_participants - 1, std::memory_order_relaxed);
+
+  if (num_participants > 1) {
+    bool has_parked_workers;
+    {
+      // Bumping the epoch under the mutex rules out lost wake-ups of workers
+      // that are about to park.
+      std::lock_guard<std::mutex> _(mutex_);
+      auto run_counter = (epoch_.load(std::memory_order_relaxed) >> 32) + 1;
+      epoch_.store((run_counter << 32) | (uint64)num_participants,
+                   std::memory_order_release);
+      has_parked_workers = num_parked_ > 0;
+    }
+    if (has_parked_workers) {
+      worker_cv_.notify_all();
+    }
+  }
+
+  work(0);
+
+  // All splits have been claimed once work() returns, so the remaining
+  // workers are about to finish.
+  int spins = 0;
+  while (active_workers_.load(std::memory_order_acquire) != 0) {
+    cpu_relax(spins++);
+  }
+}
+
+bool WorkStealingThreadPool::pop(int worker_id, int *task_id) {
+  auto &range = ranges_[worker_id].packed;
+  auto packed = range.load(std::memory_order_relaxed);
+  while (true) {
+    auto begin = (uint32)(packed >> 32);
+    auto end = (uint32)packed;
+    if (begin >= end) {
+      return false;
+    }
+    if (range.compare_exchange_weak(packed, pack(begin + 1, end),
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_relaxed)) {
+      *task_id = (int)begin;
+      return true;
+    }
+  }
+}
+
+bool WorkStealingThreadPool::steal(int worker_id, int *task_id) {
+  for (int i = 1; i < num_participants_; i++) {
+    int victim = (worker_id + i) % num_participants_;
+    auto &range = ranges_[victim].packed;
+    auto packed = range.load(std::memory_order_relaxed);
+    while (true) {
+      auto begin = (uint32)(packed >> 32);
+      auto end = (uint32)packed;
+      if (begin >= end) {
+        break;
+      }
+      auto new_end = end - (end - begin + 1) / 2;
+      if (range.compare_exchange_weak(packed, pack(begin, new_end),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_relaxed)) {
+        // Our own range is empty and nobody else writes to an empty range, so
+        // a plain store is enough here.
+        ranges_[worker_id].packed.store(pack(new_end + 1, end),
+                                        std::memory_order_release);
+        *task_id = (int)new_end;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void WorkStealingThreadPool::work(int worker_id) {
+  int task_id;
+  while (pop(worker_id, &task_id) || steal(worker_id, &task_id)) {
+    func_(context_, task_id);
+  }
+}
+
+void WorkStealingThreadPool::target(int worker_id) {
+  uint64 last_epoch = 0;
+  while (true) {
+    int spins = 0;
+    while (epoch_.load(std::memory_order_acquire) == last_epoch &&
+           !exiting_.load(std::memory_order_relaxed)) {
+      if (spins < kNumSpinsBeforeParking) {
+        cpu_relax(spins++);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      num_parked_++;
+      worker_cv_.wait(lock, [&] {
+        return epoch_.load(std::memory_order_relaxed) != last_epoch ||
+               exiting_.load(std::memory_order_relaxed);
+      });
+      num_parked_--;
+    }
+    if (exiting_.load(std::memory_order_relaxed)) {
+      break;
+    }
+    last_epoch = epoch_.load(std::memory_order_acquire);
+    if (worker_id < (int)(uint32)last_epoch) {
+      work(worker_id);
+      active_workers_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+  {
+    std::lock_guard<std::mutex> _(mutex_);
+    exiting_.store(true, std::memory_order_relaxed);
+  }
+  worker_cv_.notify_all();
+  for (auto &th : threads_)
+    th.join();
+}
+
 TI_NAMESPACE_END
@@ -8,6 +8,8 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include "taichi/common/core.h"
 #include <thread>
 
@@ -28,6 +30,8 @@ class ThreadPool {
   std::condition_variable slave_cv;
   std::condition_variable master_cv;
   std::mutex mutex;
+  // Serializes the runs of the host threads launching kernels concurrently.
+  std::mutex run_mutex;
   std::atomic<int> task_head;
   int task_tail;
   int running_threads;
@@ -56,9 +60,85 @@ class ThreadPool {
     return pool->run(splits, desired_num_threads, context, func);
   }
 
-  void target();
+  // Pins the |i|-th thread to |cpus[i]|. The threads with lower indices run
+  // first when fewer threads are desired.
+  void set_affinity(const std::vector<int> &cpus);
+
+  void target(int thread_id);
 
   ~ThreadPool();
 };
 
+// A drop-in alternative to ThreadPool with the same |run| interface.
+//
+// Each participating worker owns a contiguous range of split indices and pops
+// from its front; idle workers steal the back half of another worker's range.
+// The calling thread participates as worker 0, and idle workers spin for a
+// while before parking on a condition variable, which keeps the launch latency
+// of short tasks low.
+class WorkStealingThreadPool {
+ public:
+  explicit WorkStealingThreadPool(int max_num_threads = 0);
+
+  void run(int splits,
+           int desired_num_threads,
+           void *context,
+           RangeForTaskFunc *func);
+
+  static void static_run(WorkStealingThreadPool *pool,
+                         int splits,
+                         int desired_num_threads,
+                         void *context,
+                         RangeForTaskFunc *func) {
+    return pool->run(splits, desired_num_threads, context, func);
+  }
+
+  int get_max_num_threads() const {
+    return max_num_threads_;
+  }
+
+  // Pins worker |i| to |cpus[i]|, except worker 0, which is the thread calling
+  // run().
+  void set_affinity(const std::vector<int> &cpus);
+
+  ~WorkStealingThreadPool();
+
+ private:
+  // [begin, end) packed into a single word so that it can be updated with one
+  // CAS.
+  struct alignas(64) Range {
+    std::atomic<uint64> packed{0};
+  };
+
+  static uint64 pack(uint32 begin, uint32 end) {
+    return ((uint64)begin << 32) | end;
+  }
+
+  bool pop(int worker_id, int *task_id);
+  bool steal(int worker_id, int *task_id);
+  void work(int worker_id);
+  void target(int worker_id);
+
+  int max_num_threads_;
+  std::vector<std::thread> threads_;
+  std::unique_ptr<Range[]> ranges_;
+
+  // State of the current run, published by the release store to |epoch_|.
+  void *context_{nullptr};
+  RangeForTaskFunc *func_{nullptr};
+  int num_participants_{0};
+
+  // (run counter << 32) | number of participants of that run, so that a worker
+  // never pairs a run with the participant count of another one.
+  std::atomic<uint64> epoch_{0};
+  std::atomic<int> active_workers_{0};
+  std::atomic<bool> exiting_{false};
+
+  std::mutex mutex_;
+  // Serializes the runs of the host threads launching kernels concurrently.
+  std::mutex run_mutex_;
+  std::condition_variable worker_cv_;
+  int num_parked_{0};
+};
+
 TI_NAMESPACE_END
@@ -0,0 +1,130 @@
+#include "taichi/system/tracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+TI_NAMESPACE_BEGIN
+
+namespace {
+
+std::string escape_json(const std::string &str) {
+  std::string ret;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+      ret += c;
+    } else if ((unsigned char)c < 0x20) {
+      ret += fmt::format("\\u{:04x}", (int)c);
+    } else {
+      ret += c;
+    }
+  }
+  return ret;
+}
+
+const auto process_start_time = std::chrono::steady_clock::now();
+
+}  // namespace
+
+std::atomic<bool> Tracer::enabled_{false};
+
+Tracer &Tracer::get_instance() {
+  // Lives together with the process, for the threads still running at exit.
+  static auto tracer = new Tracer;
+  return *tracer;
+}
+
+void Tracer::enable() {
+  enabled_ = true;
+}
+
+void Tracer::disable() {
+  enabled_ = false;
+}
+
+void Tracer::clear() {
+  std::lock_guard<std::mutex> _(mut_);
+  events_.clear();
+}
+
+double Tracer::now_us() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - process_start_time)
+      .count();
+}
+
+int Tracer::this_thread_track() {
+  static std::atomic<int> num_tracks{0};
+  static thread_local int track = num_tracks++;
+  return track;
+}
+
+void Tracer::add_complete_event(const char *category,
+                                const std::string &name,
+                                double begin_us,
+                                double duration_us,
+                                const std::string &args,
+                                int process,
+                                int track) {
+  add_event({'X', category, name, begin_us, duration_us, args, process,
+             track == kThisThread ? this_thread_track() : track});
+}
+
+void Tracer::add_instant_event(const char *category,
+                               const std::string &name,
+                               const std::string &args) {
+  add_event(
+      {'i', category, name, now_us(), 0, args, 0, this_thread_track()});
+}
+
+void Tracer::add_counter_event(const char *name, double value) {
+  add_event({'C', "counter", name, now_us(), 0,
+             fmt::format("{{\"value\":{}}}", value), 0, 0});
+}
+
+void Tracer::add_event(Event &&event) {
+  if (!is_enabled())
+    return;
+  std::lock_guard<std::mutex> _(mut_);
+  if (events_.size() < kMaxNumEvents) {
+    events_.push_back(std::move(event));
+  }
+}
+
+void Tracer::dump(const std::string &file_name) {
+  std::ofstream fs(file_name);
+  TI_ERROR_IF(!fs, "Failed to open {} for writing", file_name);
+  std::lock_guard<std::mutex> _(mut_);
+  auto events = events_;
+  std::stable_sort(events.begin(), events.end(),
+                   [](const Event &a, const Event &b) {
+                     return a.begin < b.begin;
+                   });
+  fs << "{\"traceEvents\":[";
+  fs << "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+        "\"args\":{\"name\":\"host\"}},"
+     << fmt::format(
+            "\n{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},"
+            "\"args\":{{\"name\":\"device\"}}}}",
+            kDeviceProcess);
+  for (auto &e : events) {
+    fs << fmt::format(
+        ",\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"{}\",\"ts\":{:.3f},",
+        escape_json(e.name), e.category, e.phase, e.begin);
+    if (e.phase == 'X') {
+      fs << fmt::format("\"dur\":{:.3f},", e.duration);
+    } else if (e.phase == 'i') {
+      fs << "\"s\":\"t\",";
+    }
+    fs << fmt::format("\"pid\":{},\"tid\":{}", e.process, e.track);
+    if (!e.args.empty()) {
+      fs << ",\"args\":" << e.args;
+    }
+    fs << "}";
+  }
+  fs << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  TI_TRACE("Trace ({} events) written to {}", events.size(), file_name);
+}
+
+TI_NAMESPACE_END
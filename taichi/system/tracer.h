@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "taichi/common/core.h"
+
+TI_NAMESPACE_BEGIN
+
+// Records the events of the host threads (kernel launches, compilation
+// stages, the async engine, memory pool allocations) and of the device tasks
+// on one timeline, and writes them in the Chrome trace event format, which
+// chrome://tracing and Perfetto display.
+//
+// All the timestamps are in microseconds on the clock of now_us(). Recording
+// costs a load of an atomic flag while tracing is disabled.
+class Tracer {
+ public:
+  // The track of the events of the calling host thread.
+  static constexpr int kThisThread = -1;
+
+  // The process of the device tasks in the trace; the host threads are in
+  // process 0.
+  static constexpr int kDeviceProcess = 1;
+
+  static Tracer &get_instance();
+
+  static bool is_enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void enable();
+
+  void disable();
+
+  // Drops the recorded events.
+  void clear();
+
+  // Microseconds since the process started.
+  static double now_us();
+
+  // |args| is empty or a JSON object of extra info to display with the event.
+  void add_complete_event(const char *category,
+                          const std::string &name,
+                          double begin_us,
+                          double duration_us,
+                          const std::string &args = "",
+                          int process = 0,
+                          int track = kThisThread);
+
+  void add_instant_event(const char *category,
+                         const std::string &name,
+                         const std::string &args = "");
+
+  // A value over time, e.g. the memory allocated, shown as a chart.
+  void add_counter_event(const char *name, double value);
+
+  void dump(const std::string &file_name);
+
+ private:
+  struct Event {
+    char phase;
+    const char *category;
+    std::string name;
+    double begin;
+    double duration;
+    std::string args;
+    int process;
+    int track;
+  };
+
+  // Bounds the memory used by the trace; later events are dropped.
+  static constexpr std::size_t kMaxNumEvents = 1 << 22;
+
+  static int this_thread_track();
+
+  void add_event(Event &&event);
+
+  static std::atomic<bool> enabled_;
+  std::mutex mut_;
+  std::vector<Event> events_;
+};
+
+// Adds a complete event from the construction to the destruction of the
+// instance, if tracing was enabled at the construction.
+class ScopedTrace {
+ public:
+  ScopedTrace(const char *category, const std::string &name)
+      : category_(category) {
+    if (Tracer::is_enabled()) {
+      name_ = name;
+      begin_ = Tracer::now_us();
+    }
+  }
+
+  ~ScopedTrace() {
+    if (begin_ >= 0) {
+      Tracer::get_instance().add_complete_event(category_, name_, begin_,
+                                                Tracer::now_us() - begin_);
+    }
+  }
+
+ private:
+  const char *category_;
+  std::string name_;
+  double begin_{-1};
+};
+
+#define TI_TRACE_SCOPE_IMPL(category, name, line) \
+  taichi::ScopedTrace _trace_##line(category, name)
+#define TI_TRACE_SCOPE_LINE(category, name, line) \
+  TI_TRACE_SCOPE_IMPL(category, name, line)
+#define TI_TRACE_SCOPE(category, name) \
+  TI_TRACE_SCOPE_LINE(category, name, __LINE__)
+
+TI_NAMESPACE_END
@@ -11,7 +11,9 @@
 
 TLANG_NAMESPACE_BEGIN
 
-UnifiedAllocator::UnifiedAllocator(std::size_t size, Arch arch)
+UnifiedAllocator::UnifiedAllocator(std::size_t size,
+                                   Arch arch,
+                                   const std::string &huge_pages)
     : size(size), arch_(arch) {
   auto t = Time::get_time();
   if (arch_ == Arch::cuda) {
@@ -51,7 +53,7 @@ UnifiedAllocator::UnifiedAllocator(std::size_t size, Arch arch)
   } else {
     TI_TRACE("Allocating virtual address space of size {} MB",
              size / 1024 / 1024);
-    cpu_vm = std::make_unique<VirtualMemoryAllocator>(size);
+    cpu_vm = std::make_unique<VirtualMemoryAllocator>(size, huge_pages);
     data = (uint8 *)cpu_vm->ptr;
   }
   TI_ASSERT(data != nullptr);
@@ -79,4 +81,13 @@ void taichi::lang::UnifiedAllocator::memset(unsigned char val) {
   std::memset(data, val, size);
 }
 
+std::size_t UnifiedAllocator::release(void *ptr, std::size_t size) {
+  TI_ASSERT(contains(ptr) && (uint8 *)ptr + size <= tail);
+  if (!cpu_vm) {
+    // Managed memory cannot be decommitted page-wise.
+    return 0;
+  }
+  return cpu_vm->decommit(ptr, size);
+}
+
 TLANG_NAMESPACE_END
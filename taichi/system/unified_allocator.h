@@ -1,5 +1,6 @@
 #pragma once
 #include <mutex>
+#include <string>
 #include <vector>
 #include <memory>
 
@@ -28,7 +29,11 @@ class UnifiedAllocator {
   std::mutex lock;
 
  public:
-  UnifiedAllocator(std::size_t size, Arch arch);
+  // |huge_pages| is the backing of the CPU memory, see
+  // VirtualMemoryAllocator.
+  UnifiedAllocator(std::size_t size,
+                   Arch arch,
+                   const std::string &huge_pages = "none");
 
   ~UnifiedAllocator();
 
@@ -49,6 +54,15 @@ class UnifiedAllocator {
 
   void memset(unsigned char val);
 
+  bool contains(void *ptr) const {
+    return data <= (uint8 *)ptr && (uint8 *)ptr < tail;
+  }
+
+  // Returns the physical memory behind an unused range to the OS. The range
+  // reads as zeros afterwards. Returns the number of bytes released, which is
+  // zero for CUDA unified memory.
+  std::size_t release(void *ptr, std::size_t size);
+
   bool initialized() const {
     return data != nullptr;
   }
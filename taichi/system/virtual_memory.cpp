@@ -0,0 +1,129 @@
+#include "taichi/system/virtual_memory.h"
+
+#if defined(TI_PLATFORM_UNIX)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TI_NAMESPACE_BEGIN
+
+VirtualMemoryAllocator::VirtualMemoryAllocator(size_t size,
+                                               const std::string &huge_pages)
+    : size(size) {
+  TI_ERROR_IF(huge_pages != "none" && huge_pages != "transparent" &&
+                  huge_pages != "2MB" && huge_pages != "1GB",
+              "Unknown huge pages [{}], expected none, transparent, 2MB or 1GB",
+              huge_pages);
+// http://pages.cs.wisc.edu/~sifakis/papers/SPGrid.pdf Sec 3.1
+#if defined(TI_PLATFORM_UNIX)
+  ptr = MAP_FAILED;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  if (huge_pages == "2MB" || huge_pages == "1GB") {
+#if defined(TI_PLATFORM_LINUX)
+    const int shift = huge_pages == "2MB" ? 21 : 30;
+    const size_t huge_page_size = size_t(1) << shift;
+    const size_t rounded_size =
+        (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+    ptr = mmap(nullptr, rounded_size, PROT_READ | PROT_WRITE,
+               flags | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+    if (ptr != MAP_FAILED) {
+      this->size = rounded_size;
+      granularity = huge_page_size;
+    } else {
+      TI_WARN(
+          "Failed to map {} B of {} huge pages, using the default pages. Are "
+          "they reserved in /sys/kernel/mm/hugepages?",
+          rounded_size, huge_pages);
+    }
+#else
+    TI_WARN("Explicit huge pages are only supported on Linux");
+#endif
+  }
+  if (ptr == MAP_FAILED) {
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    TI_ERROR_IF(ptr == MAP_FAILED, "Virtual memory allocation ({} B) failed.",
+                size);
+  }
+  if (huge_pages == "transparent") {
+#if defined(TI_PLATFORM_LINUX)
+    if (madvise(ptr, size, MADV_HUGEPAGE) != 0) {
+      TI_WARN(
+          "Failed to enable transparent huge pages, see "
+          "/sys/kernel/mm/transparent_hugepage/enabled");
+    }
+#else
+    TI_WARN("Transparent huge pages are only supported on Linux");
+#endif
+  }
+#else
+  if (huge_pages != "none") {
+    TI_WARN("Huge pages are only supported on Linux");
+  }
+  MEMORYSTATUSEX stat;
+  stat.dwLength = sizeof(stat);
+  GlobalMemoryStatusEx(&stat);
+  if (stat.ullAvailVirtual < size) {
+    TI_P(stat.ullAvailVirtual);
+    TI_P(size);
+    TI_ERROR("Insufficient virtual memory space");
+  }
+  ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  TI_ERROR_IF(ptr == nullptr, "Virtual memory allocation ({} B) failed.",
+              size);
+#endif
+  TI_ERROR_IF(((uint64_t)ptr) % page_size != 0,
+              "Allocated address ({:}) is not aligned by page size {}", ptr,
+              page_size);
+}
+
+void map_file(void *ptr,
+              size_t size,
+              const std::string &path,
+              bool writable,
+              const std::string &advice) {
+#if defined(TI_PLATFORM_UNIX)
+  const auto page_size = (size_t)sysconf(_SC_PAGESIZE);
+  TI_ERROR_IF(((uint64_t)ptr) % page_size != 0,
+              "Cannot map {} to address {}, which is not aligned by page size "
+              "{}",
+              path, ptr, page_size);
+  int advice_flag = MADV_NORMAL;
+  if (advice == "sequential") {
+    advice_flag = MADV_SEQUENTIAL;
+  } else if (advice == "random") {
+    advice_flag = MADV_RANDOM;
+  } else if (advice == "willneed") {
+    advice_flag = MADV_WILLNEED;
+  } else {
+    TI_ERROR_IF(advice != "normal", "Unknown mmap advice [{}]", advice);
+  }
+  int fd = open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  TI_ERROR_IF(fd < 0, "Failed to open {}", path);
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    TI_ERROR("Failed to query the size of {}", path);
+  }
+  if ((size_t)file_stat.st_size < size) {
+    // The pages past the end of the file would not be backed.
+    if (!writable || ftruncate(fd, size) != 0) {
+      close(fd);
+      TI_ERROR("{} holds {} B, less than the {} B mapped", path,
+               file_stat.st_size, size);
+    }
+  }
+  auto mapped = mmap(ptr, size, PROT_READ | PROT_WRITE,
+                     MAP_FIXED | (writable ? MAP_SHARED : MAP_PRIVATE), fd, 0);
+  // The mapping keeps the file open.
+  close(fd);
+  TI_ERROR_IF(mapped == MAP_FAILED, "Failed to map {} ({} B)", path, size);
+  if (madvise(ptr, size, advice_flag) != 0) {
+    TI_WARN("Failed to apply mmap advice [{}] to {}", advice, path);
+  }
+#else
+  TI_ERROR("Mapping {} to memory is only supported on Linux and macOS", path);
+#endif
+}
+
+TI_NAMESPACE_END
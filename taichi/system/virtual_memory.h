@@ -16,29 +16,37 @@ class VirtualMemoryAllocator {
   static constexpr size_t page_size = (1 << 12);  // 4 KB page size by default
   void *ptr;
   size_t size;
-  explicit VirtualMemoryAllocator(size_t size) : size(size) {
-// http://pages.cs.wisc.edu/~sifakis/papers/SPGrid.pdf Sec 3.1
+  // The size of the pages backing the memory.
+  size_t granularity{page_size};
+
+  // |huge_pages| is the backing of the memory:
+  //   "none": the default pages;
+  //   "transparent": transparent huge pages where the OS can (Linux);
+  //   "2MB", "1GB": explicit huge pages of that size (Linux), which must be
+  //     reserved beforehand, e.g. in /proc/sys/vm/nr_hugepages. |size| is
+  //     rounded up to whole pages, and the process gets SIGBUS if it touches
+  //     more of them than are free.
+  // Falls back to the default pages with a warning if the OS refuses.
+  explicit VirtualMemoryAllocator(size_t size,
+                                  const std::string &huge_pages = "none");
+
+  // Returns the physical pages fully inside [p, p + size) to the OS. They read
+  // as zeros when touched again. Returns the number of bytes decommitted.
+  size_t decommit(void *p, size_t size) {
+    auto begin = ((uint64_t)p + granularity - 1) / granularity * granularity;
+    auto end = ((uint64_t)p + size) / granularity * granularity;
+    if (end <= begin)
+      return 0;
 #if defined(TI_PLATFORM_UNIX)
-    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
-               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
-    TI_ERROR_IF(ptr == MAP_FAILED, "Virtual memory allocation ({} B) failed.",
-                size);
+    TI_ERROR_IF(madvise((void *)begin, end - begin, MADV_DONTNEED) != 0,
+                "Failed to decommit virtual memory ({} B)", end - begin);
 #else
-    MEMORYSTATUSEX stat;
-    stat.dwLength = sizeof(stat);
-    GlobalMemoryStatusEx(&stat);
-    if (stat.ullAvailVirtual < size) {
-      TI_P(stat.ullAvailVirtual);
-      TI_P(size);
-      TI_ERROR("Insufficient virtual memory space");
-    }
-    ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-    TI_ERROR_IF(ptr == nullptr, "Virtual memory allocation ({} B) failed.",
-                size);
+    TI_ERROR_IF(!VirtualFree((void *)begin, end - begin, MEM_DECOMMIT) ||
+                    !VirtualAlloc((void *)begin, end - begin, MEM_COMMIT,
+                                  PAGE_READWRITE),
+                "Failed to decommit virtual memory ({} B)", end - begin);
 #endif
-    TI_ERROR_IF(((uint64_t)ptr) % page_size != 0,
-                "Allocated address ({:}) is not aligned by page size {}", ptr,
-                page_size);
+    return end - begin;
   }
 
   ~VirtualMemoryAllocator() {
@@ -53,6 +61,18 @@ class VirtualMemoryAllocator {
   }
 };
 
+// Maps the file at |path| in place of the memory at [ptr, ptr + size), which
+// must start at a page boundary, so that its pages load from the file on
+// demand. If |writable|, the writes go to the file, which is created or grown
+// to |size| if needed. Otherwise the file must hold |size| bytes, and the
+// writes stay in memory. |advice| is the madvise() hint: "normal",
+// "sequential", "random" or "willneed".
+void map_file(void *ptr,
+              size_t size,
+              const std::string &path,
+              bool writable,
+              const std::string &advice);
+
 float64 get_memory_usage_gb(int pid = -1);
 uint64 get_memory_usage(int pid = -1);
 
@@ -287,7 +287,7 @@ bool use_fast_math(IRNode *root) {
   if (!kernel) {
     return false;
   }
-  return kernel->program.config.fast_math;
+  return kernel->fast_math;
 }
 }  // namespace hack
 
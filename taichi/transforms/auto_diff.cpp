@@ -4,8 +4,10 @@
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/ir/visitors.h"
+#include "taichi/program/kernel.h"
 
 #include <typeinfo>
+#include <unordered_set>
 
 TLANG_NAMESPACE_BEGIN
 
@@ -202,8 +204,8 @@ class ReplaceLocalVarWithStacks : public BasicStmtVisitor {
                          .empty();
     if (!load_only) {
       auto dtype = alloc->ret_type;
-      auto stack_alloca = Stmt::make<StackAllocaStmt>(
-          dtype, alloc->get_kernel()->program.config.ad_stack_size);
+      // The capacity is determined later, see determine_ad_stack_size().
+      auto stack_alloca = Stmt::make<StackAllocaStmt>(dtype, 0);
       auto stack_alloca_ptr = stack_alloca.get();
 
       alloc->replace_with(std::move(stack_alloca));
@@ -268,8 +270,10 @@ class ReverseOuterLoops : public BasicStmtVisitor {
 
 // Generate the adjoint version of an independent block
 
-class MakeAdjoint : public IRVisitor {
- private:
+// The utilities and the derivative rules of the statements, shared by the
+// reverse mode (MakeAdjoint) and the forward mode (MakeDual).
+class ADTransform : public IRVisitor {
+ protected:
   Stmt *constant(float32 x) {
     return insert<ConstStmt>(TypedConstant(x));
   }
@@ -333,18 +337,139 @@ class MakeAdjoint : public IRVisitor {
     return insert<BinaryOpStmt>(BinaryOpType::pow, load(op1), load(op2));
   }
 
+  Stmt *load(Stmt *alloc) {
+    TI_ASSERT(alloc != nullptr);
+    if (alloc->is<AllocaStmt>()) {
+      return insert<LocalLoadStmt>(LocalAddress(alloc, 0));
+    } else {
+      // non alloca
+      return alloc;
+    }
+  }
+
+  virtual Stmt *insert_back(std::unique_ptr<Stmt> &&stmt) = 0;
+
+  template <typename T, typename... Args>
+  Stmt *insert(Args &&... args) {
+    return insert_back(Stmt::make<T>(args...));
+  }
+
+  // The derivative rules: |seed| times the derivative of |stmt| with respect
+  // to its operand, i.e. the contribution of the adjoint |seed| of |stmt| to
+  // the adjoint of the operand in reverse mode, and the contribution of the
+  // dual |seed| of the operand to the dual of |stmt| in forward mode. nullptr
+  // if the derivative is zero.
+  Stmt *derivative(UnaryOpStmt *stmt, Stmt *seed) {
+    if (stmt->op_type == UnaryOpType::floor) {
+      return nullptr;
+    } else if (stmt->op_type == UnaryOpType::neg) {
+      return negate(seed);
+    } else if (stmt->op_type == UnaryOpType::abs) {
+      return mul(seed, sgn(stmt->operand));
+    } else if (stmt->op_type == UnaryOpType::sin) {
+      return mul(seed, cos(stmt->operand));
+    } else if (stmt->op_type == UnaryOpType::cos) {
+      return negate(mul(seed, sin(stmt->operand)));
+    } else if (stmt->op_type == UnaryOpType::tan) {
+      TI_NOT_IMPLEMENTED
+    } else if (stmt->op_type == UnaryOpType::tanh) {
+      return mul(seed, sub(constant(1), sqr(stmt)));
+    } else if (stmt->op_type == UnaryOpType::asin) {
+      return mul(seed, div(constant(1),
+                           sqrt(sub(constant(1), sqr(stmt->operand)))));
+    } else if (stmt->op_type == UnaryOpType::acos) {
+      return mul(seed, negate(div(constant(1), sqrt(sub(constant(1),
+                                                        sqr(stmt->operand))))));
+    } else if (stmt->op_type == UnaryOpType::exp) {
+      return mul(seed, stmt);
+    } else if (stmt->op_type == UnaryOpType::log) {
+      return div(seed, stmt->operand);
+    } else if (stmt->op_type == UnaryOpType::sqrt) {
+      return mul(seed, div(constant(0.5f), sqrt(stmt->operand)));
+    } else if (stmt->op_type == UnaryOpType::cast_value) {
+      if (is_real(stmt->cast_type) && is_real(stmt->operand->ret_type)) {
+        return seed;
+      }
+      return nullptr;
+    } else if (stmt->op_type == UnaryOpType::logic_not) {
+      return nullptr;
+    } else {
+      TI_P(unary_op_type_name(stmt->op_type));
+      TI_NOT_IMPLEMENTED
+    }
+  }
+
+  // With respect to |bin->lhs| if |lhs|, otherwise |bin->rhs|.
+  Stmt *derivative(BinaryOpStmt *bin, bool lhs, Stmt *seed) {
+    if (bin->op_type == BinaryOpType::add) {
+      return seed;
+    } else if (bin->op_type == BinaryOpType::sub) {
+      return lhs ? seed : negate(seed);
+    } else if (bin->op_type == BinaryOpType::mul) {
+      // d (x * y) = y * dx + x * dy
+      return mul(seed, lhs ? bin->rhs : bin->lhs);
+    } else if (bin->op_type == BinaryOpType::mod) {
+      return nullptr;
+    } else if (bin->op_type == BinaryOpType::div) {
+      if (lhs)
+        return div(seed, bin->rhs);
+      return negate(div(mul(seed, bin->lhs), mul(bin->rhs, bin->rhs)));
+    } else if (bin->op_type == BinaryOpType::atan2) {
+      auto numerator = add(sqr(bin->lhs), sqr(bin->rhs));
+      if (lhs)
+        return div(mul(seed, bin->rhs), numerator);
+      return negate(div(mul(seed, bin->lhs), numerator));
+    } else if (bin->op_type == BinaryOpType::pow) {
+      // d (x ^ y) = x ^ (y-1) * (y * dx + log(x) * x * dy)
+      auto common_coeff =
+          pow(bin->lhs, sub(bin->rhs, constant(1)));  // x ^ (y-1)
+      if (lhs)
+        return mul(seed, mul(bin->rhs, common_coeff));
+      return mul(seed, mul(log(bin->lhs), mul(bin->lhs, common_coeff)));
+    } else if (bin->op_type == BinaryOpType::min ||
+               bin->op_type == BinaryOpType::max) {
+      auto cmp = bin->op_type == BinaryOpType::min ? cmp_lt(bin->lhs, bin->rhs)
+                                                   : cmp_lt(bin->rhs, bin->lhs);
+      auto zero = insert<ConstStmt>(TypedConstant(bin->ret_type));
+      return lhs ? sel(cmp, seed, zero) : sel(cmp, zero, seed);
+    } else if (bin->op_type == BinaryOpType::floordiv) {
+      return nullptr;
+    } else if (is_comparison(bin->op_type) || is_bit_op(bin->op_type)) {
+      return nullptr;
+    } else {
+      TI_WARN("gradient of binary op {}", binary_op_type_name(bin->op_type));
+      TI_NOT_IMPLEMENTED
+    }
+  }
+
+  // With respect to |stmt->op2| if |op2|, otherwise |stmt->op3|.
+  Stmt *derivative(TernaryOpStmt *stmt, bool op2, Stmt *seed) {
+    TI_ASSERT(stmt->op_type == TernaryOpType::select);
+    auto zero = insert<ConstStmt>(TypedConstant(stmt->ret_type));
+    return op2 ? insert<TernaryOpStmt>(TernaryOpType::select, stmt->op1,
+                                       load(seed), zero)
+               : insert<TernaryOpStmt>(TernaryOpType::select, stmt->op1, zero,
+                                       load(seed));
+  }
+};
+
+class MakeAdjoint : public ADTransform {
  public:
   Block *current_block;
   Block *alloca_block;
   std::map<Stmt *, Stmt *> adjoint_stmt;
+  // Keep the global stores and atomics of the primal, so that the kernel
+  // computes both the primal and the adjoint.
+  bool keep_primal;
 
-  MakeAdjoint(Block *block) {
+  MakeAdjoint(Block *block, bool keep_primal)
+      : keep_primal(keep_primal) {
     current_block = nullptr;
     alloca_block = block;
   }
 
-  static void run(Block *block) {
-    auto p = MakeAdjoint(block);
+  static void run(Block *block, bool keep_primal = false) {
+    auto p = MakeAdjoint(block, keep_primal);
     block->accept(&p);
   }
 
@@ -363,17 +488,12 @@ class MakeAdjoint : public IRVisitor {
     }
   }
 
-  Stmt *insert_back(std::unique_ptr<Stmt> &&stmt) {
+  Stmt *insert_back(std::unique_ptr<Stmt> &&stmt) override {
     auto ptr = stmt.get();
     current_block->insert(std::move(stmt), -1);
     return ptr;
   }
 
-  template <typename T, typename... Args>
-  Stmt *insert(Args &&... args) {
-    return insert_back(Stmt::make<T>(args...));
-  }
-
   // Accumulate [value] to the adjoint of [primal]
   void accumulate(Stmt *primal, Stmt *value) {
     auto alloca_ = adjoint(primal);
@@ -428,104 +548,20 @@ class MakeAdjoint : public IRVisitor {
   }
 
   void visit(UnaryOpStmt *stmt) override {
-    if (stmt->op_type == UnaryOpType::floor) {
-      // do nothing
-    } else if (stmt->op_type == UnaryOpType::neg) {
-      accumulate(stmt->operand, negate(adjoint(stmt)));
-    } else if (stmt->op_type == UnaryOpType::abs) {
-      accumulate(stmt->operand, mul(adjoint(stmt), sgn(stmt->operand)));
-    } else if (stmt->op_type == UnaryOpType::sin) {
-      accumulate(stmt->operand, mul(adjoint(stmt), cos(stmt->operand)));
-    } else if (stmt->op_type == UnaryOpType::cos) {
-      accumulate(stmt->operand, negate(mul(adjoint(stmt), sin(stmt->operand))));
-    } else if (stmt->op_type == UnaryOpType::tan) {
-      TI_NOT_IMPLEMENTED
-    } else if (stmt->op_type == UnaryOpType::tanh) {
-      accumulate(stmt->operand,
-                 mul(adjoint(stmt), sub(constant(1), sqr(stmt))));
-    } else if (stmt->op_type == UnaryOpType::asin) {
-      accumulate(
-          stmt->operand,
-          mul(adjoint(stmt),
-              div(constant(1), sqrt(sub(constant(1), sqr(stmt->operand))))));
-    } else if (stmt->op_type == UnaryOpType::acos) {
-      accumulate(stmt->operand,
-                 mul(adjoint(stmt),
-                     negate(div(constant(1),
-                                sqrt(sub(constant(1), sqr(stmt->operand)))))));
-    } else if (stmt->op_type == UnaryOpType::exp) {
-      accumulate(stmt->operand, mul(adjoint(stmt), stmt));
-    } else if (stmt->op_type == UnaryOpType::log) {
-      accumulate(stmt->operand, div(adjoint(stmt), stmt->operand));
-    } else if (stmt->op_type == UnaryOpType::sqrt) {
-      accumulate(stmt->operand,
-                 mul(adjoint(stmt), div(constant(0.5f), sqrt(stmt->operand))));
-    } else if (stmt->op_type == UnaryOpType::cast_value) {
-      if (is_real(stmt->cast_type) && is_real(stmt->operand->ret_type)) {
-        accumulate(stmt->operand, adjoint(stmt));
-      }
-    } else if (stmt->op_type == UnaryOpType::logic_not) {
-      // do nothing
-    } else {
-      TI_P(unary_op_type_name(stmt->op_type));
-      TI_NOT_IMPLEMENTED
-    }
+    if (auto value = derivative(stmt, adjoint(stmt)))
+      accumulate(stmt->operand, value);
   }
 
   void visit(BinaryOpStmt *bin) override {
-    if (bin->op_type == BinaryOpType::add) {
-      accumulate(bin->lhs, adjoint(bin));
-      accumulate(bin->rhs, adjoint(bin));
-    } else if (bin->op_type == BinaryOpType::sub) {
-      accumulate(bin->lhs, adjoint(bin));
-      accumulate(bin->rhs, negate(adjoint(bin)));
-    } else if (bin->op_type == BinaryOpType::mul) {
-      // d (x * y) = y * dx + x * dy
-      accumulate(bin->lhs, mul(adjoint(bin), bin->rhs));
-      accumulate(bin->rhs, mul(adjoint(bin), bin->lhs));
-    } else if (bin->op_type == BinaryOpType::mod) {
-      // Do nothing
-    } else if (bin->op_type == BinaryOpType::div) {
-      accumulate(bin->lhs, div(adjoint(bin), bin->rhs));
-      accumulate(bin->rhs, negate(div(mul(adjoint(bin), bin->lhs),
-                                      mul(bin->rhs, bin->rhs))));
-    } else if (bin->op_type == BinaryOpType::atan2) {
-      auto numerator = add(sqr(bin->lhs), sqr(bin->rhs));
-      accumulate(bin->lhs, div(mul(adjoint(bin), bin->rhs), numerator));
-      accumulate(bin->rhs, negate(div(mul(adjoint(bin), bin->lhs), numerator)));
-    } else if (bin->op_type == BinaryOpType::pow) {
-      // d (x ^ y) = x ^ (y-1) * (y * dx + log(x) * x * dy)
-      auto common_coeff =
-          pow(bin->lhs, sub(bin->rhs, constant(1)));  // x ^ (y-1)
-      accumulate(bin->lhs, mul(adjoint(bin), mul(bin->rhs, common_coeff)));
-      accumulate(bin->rhs, mul(adjoint(bin), mul(log(bin->lhs),
-                                                 mul(bin->lhs, common_coeff))));
-    } else if (bin->op_type == BinaryOpType::min ||
-               bin->op_type == BinaryOpType::max) {
-      auto cmp = bin->op_type == BinaryOpType::min ? cmp_lt(bin->lhs, bin->rhs)
-                                                   : cmp_lt(bin->rhs, bin->lhs);
-      auto zero = insert<ConstStmt>(TypedConstant(bin->ret_type));
-      accumulate(bin->lhs, sel(cmp, adjoint(bin), zero));
-      accumulate(bin->rhs, sel(cmp, zero, adjoint(bin)));
-    } else if (bin->op_type == BinaryOpType::floordiv) {
-      // do nothing
-    } else if (is_comparison(bin->op_type) || is_bit_op(bin->op_type)) {
-      // do nothing
-    } else {
-      TI_WARN("gradient of binary op {}", binary_op_type_name(bin->op_type));
-      TI_NOT_IMPLEMENTED
-    }
+    if (auto value = derivative(bin, /*lhs=*/true, adjoint(bin)))
+      accumulate(bin->lhs, value);
+    if (auto value = derivative(bin, /*lhs=*/false, adjoint(bin)))
+      accumulate(bin->rhs, value);
   }
 
   void visit(TernaryOpStmt *stmt) override {
-    TI_ASSERT(stmt->op_type == TernaryOpType::select);
-    auto zero = insert<ConstStmt>(TypedConstant(stmt->ret_type));
-    accumulate(stmt->op2,
-               insert<TernaryOpStmt>(TernaryOpType::select, stmt->op1,
-                                     load(adjoint(stmt)), zero));
-    accumulate(stmt->op3,
-               insert<TernaryOpStmt>(TernaryOpType::select, stmt->op1, zero,
-                                     load(adjoint(stmt))));
+    accumulate(stmt->op2, derivative(stmt, /*op2=*/true, adjoint(stmt)));
+    accumulate(stmt->op3, derivative(stmt, /*op2=*/false, adjoint(stmt)));
   }
 
   void visit(IfStmt *if_stmt) override {
@@ -624,16 +660,6 @@ class MakeAdjoint : public IRVisitor {
     insert<StackPopStmt>(stmt->stack);
   }
 
-  Stmt *load(Stmt *alloc) {
-    TI_ASSERT(alloc != nullptr);
-    if (alloc->is<AllocaStmt>()) {
-      return insert<LocalLoadStmt>(LocalAddress(alloc, 0));
-    } else {
-      // non alloca
-      return alloc;
-    }
-  }
-
   bool gradients_stopped(GlobalLoadStmt *stmt, SNode *snode) {
     for (auto block = stmt->parent; block; block = block->parent_block()) {
       for (auto s : block->stop_gradients) {
@@ -678,7 +704,8 @@ class MakeAdjoint : public IRVisitor {
     auto adjoint_ptr = insert<GlobalPtrStmt>(snodes, ptr->indices);
     auto load = insert<GlobalLoadStmt>(adjoint_ptr);
     accumulate(stmt->data, load);
-    stmt->parent->erase(stmt);
+    if (!keep_primal)
+      stmt->parent->erase(stmt);
   }
 
   void visit(AtomicOpStmt *stmt) override {
@@ -694,7 +721,8 @@ class MakeAdjoint : public IRVisitor {
     } else {
       // no gradient (likely integer types)
     }
-    stmt->parent->erase(stmt);
+    if (!keep_primal)
+      stmt->parent->erase(stmt);
   }
 
   void visit(ElementShuffleStmt *stmt) override {
@@ -816,10 +844,216 @@ class BackupSSA : public BasicStmtVisitor {
   }
 };
 
+// Forward-mode AutoDiff: computes the dual (the derivative along the seeds in
+// the dual fields) of each statement right after it, in a single pass over
+// the kernel. Unlike the reverse mode, it needs neither stacks nor a tape,
+// and supports any control flow.
+class MakeDual : public ADTransform {
+ public:
+  using ADTransform::visit;
+
+  MakeDual() {
+    allow_undefined_visitor = true;
+    invoke_default_visitor = false;
+  }
+
+  static void run(IRNode *root) {
+    MakeDual pass;
+    root->accept(&pass);
+  }
+
+  Stmt *insert_back(std::unique_ptr<Stmt> &&stmt) override {
+    insert_point_ = insert_point_->insert_after_me(std::move(stmt));
+    return insert_point_;
+  }
+
+  void visit(Block *block) override {
+    std::vector<Stmt *> statements;
+    // always make a copy since the list can be modified.
+    for (auto &stmt : block->statements) {
+      statements.push_back(stmt.get());
+    }
+    for (auto stmt : statements) {
+      insert_point_ = stmt;
+      stmt->accept(this);
+    }
+  }
+
+  void visit(IfStmt *if_stmt) override {
+    if (if_stmt->true_statements)
+      if_stmt->true_statements->accept(this);
+    if (if_stmt->false_statements)
+      if_stmt->false_statements->accept(this);
+  }
+
+  void visit(RangeForStmt *for_stmt) override {
+    for_stmt->body->accept(this);
+  }
+
+  void visit(StructForStmt *for_stmt) override {
+    for_stmt->body->accept(this);
+  }
+
+  void visit(WhileStmt *stmt) override {
+    stmt->body->accept(this);
+  }
+
+  void visit(UnaryOpStmt *stmt) override {
+    auto operand_dual = dual(stmt->operand);
+    if (!operand_dual)
+      return;
+    auto value = derivative(stmt, operand_dual);
+    if (value && stmt->op_type == UnaryOpType::cast_value) {
+      value = insert<UnaryOpStmt>(UnaryOpType::cast_value, value);
+      value->as<UnaryOpStmt>()->cast_type = stmt->cast_type;
+    }
+    set_dual(stmt, value);
+  }
+
+  void visit(BinaryOpStmt *bin) override {
+    Stmt *value = nullptr;
+    if (auto lhs_dual = dual(bin->lhs))
+      value = derivative(bin, /*lhs=*/true, lhs_dual);
+    if (auto rhs_dual = dual(bin->rhs)) {
+      auto rhs_value = derivative(bin, /*lhs=*/false, rhs_dual);
+      value = value && rhs_value ? add(value, rhs_value)
+                                 : (value ? value : rhs_value);
+    }
+    set_dual(bin, value);
+  }
+
+  void visit(TernaryOpStmt *stmt) override {
+    auto op2_dual = dual(stmt->op2);
+    auto op3_dual = dual(stmt->op3);
+    if (!op2_dual && !op3_dual)
+      return;
+    auto zero = insert<ConstStmt>(TypedConstant(stmt->ret_type));
+    set_dual(stmt, sel(stmt->op1, op2_dual ? op2_dual : zero,
+                       op3_dual ? op3_dual : zero));
+  }
+
+  void visit(AllocaStmt *stmt) override {
+    // Every real local variable gets a dual, so that the duals carried
+    // through loops are known before the stores that change them.
+    if (!needs_grad(stmt->ret_type))
+      return;
+    TI_ASSERT(stmt->width() == 1);
+    dual_stmt_[stmt] = insert<AllocaStmt>(1, stmt->ret_type);
+  }
+
+  void visit(LocalLoadStmt *stmt) override {
+    TI_ASSERT(stmt->width() == 1);
+    if (auto alloca = dual(stmt->ptr[0].var))
+      set_dual(stmt, load(alloca));
+  }
+
+  void visit(LocalStoreStmt *stmt) override {
+    if (auto alloca = dual(stmt->ptr))
+      insert<LocalStoreStmt>(alloca, dual_or_zero(stmt->data));
+  }
+
+  void visit(GlobalLoadStmt *stmt) override {
+    if (auto ptr = dual_ptr(stmt->ptr))
+      set_dual(stmt, insert<GlobalLoadStmt>(ptr));
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    if (auto ptr = dual_ptr(stmt->ptr))
+      insert<GlobalStoreStmt>(ptr, dual_or_zero(stmt->data));
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    auto val_dual = dual(stmt->val);
+    if (!val_dual)
+      return;
+    auto ptr = dual_ptr(stmt->dest);
+    if (!ptr)
+      return;
+    if (stmt->op_type != AtomicOpType::add &&
+        stmt->op_type != AtomicOpType::sub) {
+      TI_ERROR("Atomic {} is not supported in forward-mode AutoDiff.",
+               atomic_op_type_name(stmt->op_type));
+    }
+    insert<AtomicOpStmt>(stmt->op_type, ptr, val_dual);
+  }
+
+ private:
+  // The dual of |stmt|, or its AllocaStmt for local variables. nullptr if it
+  // is zero, e.g. for integers, constants, and values computed without any
+  // dual field.
+  Stmt *dual(Stmt *stmt) {
+    auto it = dual_stmt_.find(stmt);
+    return it == dual_stmt_.end() ? nullptr : it->second;
+  }
+
+  Stmt *dual_or_zero(Stmt *stmt) {
+    if (auto value = dual(stmt))
+      return value;
+    return insert<ConstStmt>(TypedConstant(stmt->ret_type));
+  }
+
+  void set_dual(Stmt *stmt, Stmt *value) {
+    if (value && needs_grad(stmt->ret_type))
+      dual_stmt_[stmt] = value;
+  }
+
+  // The pointer to the dual field at the indices of |ptr|, if it has one.
+  Stmt *dual_ptr(Stmt *ptr) {
+    auto global_ptr = ptr->cast<GlobalPtrStmt>();
+    if (!global_ptr)
+      return nullptr;
+    TI_ASSERT(global_ptr->width() == 1);
+    auto snodes = global_ptr->snodes;
+    if (!snodes[0]->has_dual())
+      return nullptr;
+    snodes[0] = snodes[0]->get_dual();
+    return insert<GlobalPtrStmt>(snodes, global_ptr->indices);
+  }
+
+  Stmt *insert_point_{nullptr};
+  std::unordered_map<Stmt *, Stmt *> dual_stmt_;
+};
+
+// The kernel computing both the primal and the adjoint recomputes the primal
+// values from the fields it reads. It must not read the fields it writes, and
+// it writes the fields in the reverse order of the primal, so no field may be
+// both stored to and accumulated into.
+void check_keep_primal(IRNode *root) {
+  std::unordered_set<SNode *> loaded, stored, accumulated;
+  irpass::analysis::gather_statements(root, [&](Stmt *stmt) {
+    if (auto load = stmt->cast<GlobalLoadStmt>()) {
+      if (auto ptr = load->ptr->cast<GlobalPtrStmt>())
+        loaded.insert(ptr->snodes[0]);
+    } else if (auto store = stmt->cast<GlobalStoreStmt>()) {
+      if (auto ptr = store->ptr->cast<GlobalPtrStmt>())
+        stored.insert(ptr->snodes[0]);
+    } else if (auto atomic = stmt->cast<AtomicOpStmt>()) {
+      if (auto ptr = atomic->dest->cast<GlobalPtrStmt>())
+        accumulated.insert(ptr->snodes[0]);
+    }
+    return false;
+  });
+  auto kernel_name = root->get_kernel()->name;
+  for (auto snode : stored) {
+    TI_ERROR_IF(loaded.count(snode) || accumulated.count(snode),
+                "Kernel {} reads or accumulates into the field {} it stores "
+                "to, and cannot compute both its primal and its gradient.",
+                kernel_name, snode->get_node_type_name_hinted());
+  }
+  for (auto snode : accumulated) {
+    TI_ERROR_IF(loaded.count(snode),
+                "Kernel {} reads the field {} it accumulates into, and cannot "
+                "compute both its primal and its gradient.",
+                kernel_name, snode->get_node_type_name_hinted());
+  }
+}
+
 namespace irpass {
 
-void auto_diff(IRNode *root, bool use_stack) {
+void auto_diff(IRNode *root, bool use_stack, bool keep_primal) {
   TI_AUTO_PROF;
+  if (keep_primal)
+    check_keep_primal(root);
   if (use_stack) {
     auto IB = IdentifyIndependentBlocks::run(root);
     ReverseOuterLoops::run(root, IB);
@@ -829,23 +1063,31 @@ void auto_diff(IRNode *root, bool use_stack) {
       ReplaceLocalVarWithStacks replace;
       ib->accept(&replace);
       type_check(root);
-      MakeAdjoint::run(ib);
+      MakeAdjoint::run(ib, keep_primal);
       type_check(root);
       BackupSSA::run(ib);
-      irpass::analysis::verify(root);
+      if (root->get_config().verify_each_pass)
+        irpass::analysis::verify(root);
     }
   } else {
     auto IB = IdentifyIndependentBlocks::run(root);
     ReverseOuterLoops::run(root, IB);
     type_check(root);
     for (auto ib : IB) {
-      MakeAdjoint::run(ib);
+      MakeAdjoint::run(ib, keep_primal);
     }
   }
   type_check(root);
   irpass::analysis::verify(root);
 }
 
+void forward_diff(IRNode *root) {
+  TI_AUTO_PROF;
+  MakeDual::run(root);
+  type_check(root);
+  irpass::analysis::verify(root);
+}
+
 }  // namespace irpass
 
 TLANG_NAMESPACE_END
@@ -1,12 +1,154 @@
 #include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/ir/visitors.h"
 #include "taichi/program/kernel.h"
+#include <algorithm>
+#include <optional>
 #include <set>
 
 TLANG_NAMESPACE_BEGIN
 
+namespace {
+
+// The values an integer statement may take, from the constants, the bounds of
+// the loops and the range assumptions, as an inclusive interval. The
+// operations that may overflow int32 give no interval.
+class RangeAnalysis {
+ public:
+  struct Range {
+    int64 low, high;
+  };
+
+  std::optional<Range> get(Stmt *stmt) {
+    auto it = ranges_.find(stmt);
+    if (it == ranges_.end()) {
+      it = ranges_.emplace(stmt, compute(stmt)).first;
+    }
+    return it->second;
+  }
+
+ private:
+  static std::optional<Range> make(int64 low, int64 high) {
+    if (low < std::numeric_limits<int32>::min() ||
+        high > std::numeric_limits<int32>::max())
+      return std::nullopt;
+    return Range{low, high};
+  }
+
+  static std::optional<int64> get_constant(Stmt *stmt) {
+    if (auto c = stmt->cast<ConstStmt>()) {
+      if (c->width() == 1 && is_integral(c->val[0].dt))
+        return c->val[0].val_int();
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Range> compute(Stmt *stmt) {
+    if (stmt->width() != 1 || !is_integral(stmt->ret_type))
+      return std::nullopt;
+    if (auto c = get_constant(stmt)) {
+      return make(*c, *c);
+    } else if (auto shuffle = stmt->cast<ElementShuffleStmt>()) {
+      if (shuffle->elements[0].index == 0)
+        return get(shuffle->elements[0].stmt);
+    } else if (auto index = stmt->cast<LoopIndexStmt>()) {
+      if (auto range_for = index->loop->cast<RangeForStmt>()) {
+        auto begin = get(range_for->begin);
+        auto end = get(range_for->end);
+        if (begin && end)
+          return make(begin->low, std::max(begin->low, end->high - 1));
+      } else if (index->loop->is<StructForStmt>()) {
+        const int num_bits = index->max_num_bits();
+        if (num_bits >= 0 && num_bits < 31)
+          return make(0, (1LL << num_bits) - 1);
+      }
+    } else if (auto assumption = stmt->cast<RangeAssumptionStmt>()) {
+      if (auto base = get(assumption->base))
+        return make(base->low + assumption->low,
+                    base->high + assumption->high - 1);
+    } else if (auto unary = stmt->cast<UnaryOpStmt>()) {
+      auto operand = get(unary->operand);
+      if (!operand)
+        return std::nullopt;
+      if (unary->op_type == UnaryOpType::neg)
+        return make(-operand->high, -operand->low);
+      if (unary->op_type == UnaryOpType::cast_value &&
+          data_type_size(unary->ret_type) >= data_type_size(PrimitiveType::i32))
+        return operand;
+    } else if (auto binary = stmt->cast<BinaryOpStmt>()) {
+      return compute(binary);
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Range> compute(BinaryOpStmt *stmt) {
+    auto lhs = get(stmt->lhs);
+    auto rhs = get(stmt->rhs);
+    auto rhs_constant = get_constant(stmt->rhs);
+    switch (stmt->op_type) {
+      case BinaryOpType::add:
+        if (lhs && rhs)
+          return make(lhs->low + rhs->low, lhs->high + rhs->high);
+        break;
+      case BinaryOpType::sub:
+        if (lhs && rhs)
+          return make(lhs->low - rhs->high, lhs->high - rhs->low);
+        break;
+      case BinaryOpType::mul:
+        if (lhs && rhs) {
+          auto a = lhs->low * rhs->low, b = lhs->low * rhs->high;
+          auto c = lhs->high * rhs->low, d = lhs->high * rhs->high;
+          return make(std::min({a, b, c, d}), std::max({a, b, c, d}));
+        }
+        break;
+      case BinaryOpType::min:
+        if (lhs && rhs)
+          return make(std::min(lhs->low, rhs->low),
+                      std::min(lhs->high, rhs->high));
+        break;
+      case BinaryOpType::max:
+        if (lhs && rhs)
+          return make(std::max(lhs->low, rhs->low),
+                      std::max(lhs->high, rhs->high));
+        break;
+      case BinaryOpType::div:
+      case BinaryOpType::floordiv:
+        // Truncating and flooring agree on the non-negative values.
+        if (lhs && lhs->low >= 0 && rhs_constant && *rhs_constant > 0)
+          return make(lhs->low / *rhs_constant, lhs->high / *rhs_constant);
+        break;
+      case BinaryOpType::mod:
+        if (lhs && lhs->low >= 0 && rhs_constant && *rhs_constant > 0)
+          return make(0, std::min(lhs->high, *rhs_constant - 1));
+        break;
+      case BinaryOpType::bit_and:
+        if (rhs_constant && *rhs_constant >= 0)
+          return make(0, *rhs_constant);
+        break;
+      case BinaryOpType::bit_shr:
+        if (lhs && lhs->low >= 0 && rhs_constant && *rhs_constant >= 0 &&
+            *rhs_constant < 32)
+          return make(lhs->low >> *rhs_constant, lhs->high >> *rhs_constant);
+        break;
+      default:
+        break;
+    }
+    return std::nullopt;
+  }
+
+  std::unordered_map<Stmt *, std::optional<Range>> ranges_;
+};
+
+}  // namespace
+
+// Inserts an assertion that the indices of each GlobalPtrStmt are inside the
+// shape of its SNode. The indices that range analysis proves inside are not
+// checked, and the accesses in the bodies of range-fors indexed by the loop
+// index plus a constant (or by values defined outside the loop) are checked
+// once before the loop, for the first and the last index.
+
 // TODO: also check RangeAssumptionStmt
 
 class CheckOutOfBound : public BasicStmtVisitor {
@@ -14,6 +156,10 @@ class CheckOutOfBound : public BasicStmtVisitor {
   using BasicStmtVisitor::visit;
   std::set<int> visited;
   DelayedIRModifier modifier;
+  RangeAnalysis range_analysis;
+  // The checks inserted before each loop, to insert each of them once.
+  std::set<std::tuple<Stmt *, SNode *, std::vector<std::pair<Stmt *, int64>>>>
+      hoisted_checks;
 
   CheckOutOfBound() : BasicStmtVisitor(), visited() {
   }
@@ -37,69 +183,193 @@ class CheckOutOfBound : public BasicStmtVisitor {
     // TODO: implement bound check here for other situations.
   }
 
+  // Decomposes |stmt| into a statement plus a constant.
+  static std::pair<Stmt *, int64> get_base_and_offset(Stmt *stmt) {
+    int64 offset = 0;
+    while (auto bin = stmt->cast<BinaryOpStmt>()) {
+      auto rhs = bin->rhs->cast<ConstStmt>();
+      if ((bin->op_type != BinaryOpType::add &&
+           bin->op_type != BinaryOpType::sub) ||
+          !rhs || rhs->width() != 1 || !is_integral(rhs->val[0].dt))
+        break;
+      const auto value = rhs->val[0].val_int();
+      offset += bin->op_type == BinaryOpType::add ? value : -value;
+      stmt = bin->lhs;
+    }
+    return {stmt, offset};
+  }
+
+  static bool is_inside(Stmt *stmt, Stmt *loop) {
+    for (auto block = stmt->parent; block && block->parent_stmt;
+         block = block->parent_stmt->parent) {
+      if (block->parent_stmt == loop)
+        return true;
+    }
+    return false;
+  }
+
+  // The range-for whose body |stmt| is directly in, if every iteration runs
+  // the whole body and all the |indices| are either the loop index plus a
+  // constant, or defined outside the loop.
+  static RangeForStmt *get_hoisting_loop(Stmt *stmt,
+                                         const std::vector<Stmt *> &indices) {
+    if (stmt->width() != 1 || !stmt->parent || !stmt->parent->parent_stmt)
+      return nullptr;
+    auto loop = stmt->parent->parent_stmt->cast<RangeForStmt>();
+    if (!loop)
+      return nullptr;
+    auto exits = irpass::analysis::gather_statements(loop->body.get(),
+                                                     [](Stmt *s) {
+      return s->is<ContinueStmt>() || s->is<WhileControlStmt>() ||
+             s->is<KernelReturnStmt>();
+    });
+    if (!exits.empty())
+      return nullptr;
+    for (auto index : indices) {
+      auto base = get_base_and_offset(index).first;
+      auto loop_index = base->cast<LoopIndexStmt>();
+      if (!(loop_index && loop_index->loop == loop) && is_inside(index, loop))
+        return nullptr;
+    }
+    return loop;
+  }
+
   void visit(GlobalPtrStmt *stmt) override {
     if (is_done(stmt))
       return;
     TI_ASSERT(stmt->snodes.size() == 1);
+    set_done(stmt);
     auto snode = stmt->snodes[0];
     bool has_offset = !(snode->index_offsets.empty());
+
+    // Note that during lower_ast, index arguments to GlobalPtrStmt are
+    // already converted to [0, +inf) range.
+    std::vector<int> axes;
+    std::vector<Stmt *> unproven_indices;
+    for (int i = 0; i < stmt->indices.size(); i++) {
+      auto range = range_analysis.get(stmt->indices[i]);
+      if (!range || range->low < 0 ||
+          range->high >= snode->shape_along_axis(i)) {
+        axes.push_back(i);
+        unproven_indices.push_back(stmt->indices[i]);
+      }
+    }
+    if (axes.empty())
+      return;
+
     auto new_stmts = VecStatement();
     auto zero = new_stmts.push_back<ConstStmt>(LaneAttribute<TypedConstant>(0));
     Stmt *result =
         new_stmts.push_back<ConstStmt>(LaneAttribute<TypedConstant>(true));
 
+    // The lowest and the highest values of the indices.
+    std::vector<Stmt *> lows, highs;
+    auto loop = get_hoisting_loop(stmt, unproven_indices);
+    if (loop) {
+      std::vector<std::pair<Stmt *, int64>> key;
+      for (auto index : unproven_indices)
+        key.push_back(get_base_and_offset(index));
+      if (!hoisted_checks.insert({loop, snode, key}).second)
+        return;
+      auto one =
+          new_stmts.push_back<ConstStmt>(LaneAttribute<TypedConstant>(1));
+      auto last = new_stmts.push_back<BinaryOpStmt>(BinaryOpType::sub,
+                                                    loop->end, one);
+      for (int k = 0; k < (int)key.size(); k++) {
+        if (!is_inside(unproven_indices[k], loop)) {
+          lows.push_back(unproven_indices[k]);
+          highs.push_back(unproven_indices[k]);
+          continue;
+        }
+        auto offset_stmt = new_stmts.push_back<ConstStmt>(
+            LaneAttribute<TypedConstant>((int32)key[k].second));
+        lows.push_back(new_stmts.push_back<BinaryOpStmt>(
+            BinaryOpType::add, loop->begin, offset_stmt));
+        highs.push_back(new_stmts.push_back<BinaryOpStmt>(BinaryOpType::add,
+                                                          last, offset_stmt));
+      }
+    } else {
+      lows = highs = unproven_indices;
+    }
+
     std::string msg = fmt::format("(kernel={}) Accessing field ({}) of size (",
                                   stmt->get_kernel()->name,
                                   snode->get_node_type_name_hinted());
     std::string offset_msg = "offset (";
-    std::vector<Stmt *> args;
-    for (int i = 0; i < stmt->indices.size(); i++) {
+    std::vector<Stmt *> low_args, high_args;
+    for (int k = 0; k < (int)axes.size(); k++) {
+      const int i = axes[k];
       int offset_i = has_offset ? snode->index_offsets[i] : 0;
 
-      // Note that during lower_ast, index arguments to GlobalPtrStmt are
-      // already converted to [0, +inf) range.
-
       auto lower_bound = zero;
       auto check_lower_bound = new_stmts.push_back<BinaryOpStmt>(
-          BinaryOpType::cmp_ge, stmt->indices[i], lower_bound);
+          BinaryOpType::cmp_ge, lows[k], lower_bound);
       int size_i = snode->shape_along_axis(i);
       int upper_bound_i = size_i;
       auto upper_bound = new_stmts.push_back<ConstStmt>(
           LaneAttribute<TypedConstant>(upper_bound_i));
       auto check_upper_bound = new_stmts.push_back<BinaryOpStmt>(
-          BinaryOpType::cmp_lt, stmt->indices[i], upper_bound);
+          BinaryOpType::cmp_lt, highs[k], upper_bound);
       auto check_i = new_stmts.push_back<BinaryOpStmt>(
           BinaryOpType::bit_and, check_lower_bound, check_upper_bound);
       result = new_stmts.push_back<BinaryOpStmt>(BinaryOpType::bit_and, result,
                                                  check_i);
-      if (i > 0) {
+      if (k > 0) {
         msg += ", ";
         offset_msg += ", ";
       }
       msg += std::to_string(size_i);
       offset_msg += std::to_string(offset_i);
 
-      auto input_index = stmt->indices[i];
+      auto low = lows[k], high = highs[k];
       if (offset_i != 0) {
         auto offset = new_stmts.push_back<ConstStmt>(
             LaneAttribute<TypedConstant>(offset_i));
-        input_index = new_stmts.push_back<BinaryOpStmt>(BinaryOpType::add,
-                                                        input_index, offset);
+        low = new_stmts.push_back<BinaryOpStmt>(BinaryOpType::add, low,
+                                                offset);
+        if (loop) {
+          high = new_stmts.push_back<BinaryOpStmt>(BinaryOpType::add, high,
+                                                   offset);
+        }
       }
-      args.emplace_back(input_index);
+      low_args.emplace_back(low);
+      high_args.emplace_back(high);
     }
     offset_msg += ") ";
-    msg += ") " + (has_offset ? offset_msg : "") + "with indices (";
-    for (int i = 0; i < stmt->indices.size(); i++) {
-      if (i > 0)
-        msg += ", ";
-      msg += "%d";
+    msg += ") " + (has_offset ? offset_msg : "");
+    if (axes.size() < stmt->indices.size()) {
+      msg += "along axes (";
+      for (int k = 0; k < (int)axes.size(); k++) {
+        if (k > 0)
+          msg += ", ";
+        msg += std::to_string(axes[k]);
+      }
+      msg += ") ";
+    }
+    auto format_args = [&]() {
+      std::string ret = "(";
+      for (int k = 0; k < (int)axes.size(); k++) {
+        if (k > 0)
+          ret += ", ";
+        ret += "%d";
+      }
+      return ret + ")";
+    };
+    std::vector<Stmt *> args = low_args;
+    if (loop) {
+      // The loop may not run at all.
+      auto empty = new_stmts.push_back<BinaryOpStmt>(
+          BinaryOpType::cmp_ge, loop->begin, loop->end);
+      result = new_stmts.push_back<BinaryOpStmt>(BinaryOpType::bit_or, empty,
+                                                 result);
+      msg += "with indices from " + format_args() + " to " + format_args();
+      args.insert(args.end(), high_args.begin(), high_args.end());
+    } else {
+      msg += "with indices " + format_args();
     }
-    msg += ")";
 
     new_stmts.push_back<AssertStmt>(result, msg, args);
-    modifier.insert_before(stmt, std::move(new_stmts));
-    set_done(stmt);
+    modifier.insert_before(loop ? (Stmt *)loop : stmt, std::move(new_stmts));
   }
 
   static bool run(IRNode *node) {
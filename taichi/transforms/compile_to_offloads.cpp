@@ -1,26 +1,114 @@
 #include "taichi/ir/ir.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
 #include "taichi/ir/visitors.h"
 #include "taichi/program/kernel.h"
+#include "taichi/program/program.h"
+#include "taichi/system/timer.h"
+
+#include <algorithm>
 
 TLANG_NAMESPACE_BEGIN
 
 namespace irpass {
 namespace {
 
-std::function<void(const std::string &)> make_pass_printer(bool verbose,
-                                                           IRNode *ir) {
-  if (!verbose) {
-    return [](const std::string &) {};
-  }
-  return [ir, kn = ir->get_kernel()->name](const std::string &pass) {
-    TI_INFO("[{}] {}:", kn, pass);
-    std::cout << std::flush;
-    irpass::re_id(ir);
-    irpass::print(ir);
-    std::cout << std::flush;
-  };
+// Called after each pass. Prints the IR when |verbose|, and records the pass
+// into the compile profiler of the program, if enabled.
+class PassObserver {
+ public:
+  PassObserver(IRNode *ir, bool verbose, const CompileConfig &config)
+      : ir_(ir), verbose_(verbose), verify_each_pass_(config.verify_each_pass) {
+    if (auto kernel = ir->get_kernel()) {
+      kernel_name_ = kernel->name;
+      profiler_ = kernel->program.compile_profiler.get();
+    }
+    if (profiler_) {
+      num_stmts_ = irpass::analysis::count_statements(ir_);
+      start_ = Time::get_time();
+    }
+  }
+
+  void operator()(const std::string &pass, int num_iterations = 1) {
+    if (profiler_) {
+      auto time = Time::get_time() - start_;
+      auto num_stmts = irpass::analysis::count_statements(ir_);
+      profiler_->add(
+          {kernel_name_, pass, time, num_stmts_, num_stmts, num_iterations});
+      num_stmts_ = num_stmts;
+    }
+    if (verbose_) {
+      TI_INFO("[{}] {}:", kernel_name_, pass);
+      std::cout << std::flush;
+      irpass::re_id(ir_);
+      irpass::print(ir_);
+      std::cout << std::flush;
+    }
+    if (profiler_) {
+      start_ = Time::get_time();
+    }
+  }
+
+  // Runs irpass::analysis::verify(), which is recorded as a pass of its own.
+  // Only at the boundaries of the pipelines, unless
+  // CompileConfig::verify_each_pass is set.
+  void verify(bool pipeline_boundary = false) {
+    if (!pipeline_boundary && !verify_each_pass_) {
+      return;
+    }
+    irpass::analysis::verify(ir_);
+    if (profiler_) {
+      profiler_->add({kernel_name_, "Verify", Time::get_time() - start_,
+                      num_stmts_, num_stmts_, 1});
+      start_ = Time::get_time();
+    }
+  }
+
+ private:
+  IRNode *ir_;
+  bool verbose_;
+  bool verify_each_pass_;
+  std::string kernel_name_;
+  CompileProfiler *profiler_{nullptr};
+  int num_stmts_{0};
+  double start_{0};
+};
+
+std::vector<int> parse_tile_shape(const std::string &tile_shape) {
+  std::vector<int> ret;
+  if (trim_string(tile_shape).empty())
+    return ret;
+  for (auto &extent : split_string(tile_shape, ",")) {
+    try {
+      ret.push_back(std::stoi(extent));
+    } catch (const std::exception &) {
+      TI_ERROR("Invalid cpu_tile_shape \"{}\"", tile_shape);
+    }
+  }
+  return ret;
+}
+
+// Runs full_simplify on each offloaded task of |ir| on the compilation workers
+// of the program. The tasks are independent after irpass::offload: the values
+// they share go through global temporaries. Returns the largest number of
+// iterations.
+int full_simplify_offloads(IRNode *ir, bool after_lower_access) {
+  auto kernel = ir->get_kernel();
+  auto block = ir->cast<Block>();
+  if (!kernel || !block || block->size() < 2) {
+    return irpass::full_simplify(ir, after_lower_access);
+  }
+  for (auto &stmt : block->statements) {
+    if (!stmt->is<OffloadedStmt>())
+      return irpass::full_simplify(ir, after_lower_access);
+  }
+  std::vector<int> num_iterations(block->size());
+  kernel->program.run_on_compilation_workers(block->size(), [&](int i) {
+    num_iterations[i] = irpass::full_simplify(block->statements[i].get(),
+                                              after_lower_access, kernel);
+  });
+  return *std::max_element(num_iterations.begin(), num_iterations.end());
 }
 
 }  // namespace
@@ -33,7 +121,7 @@ void compile_to_offloads(IRNode *ir,
                          bool ad_use_stack) {
   TI_AUTO_PROF;
 
-  auto print = make_pass_printer(verbose, ir);
+  PassObserver print(ir, verbose, config);
   print("Initial IR");
 
   if (grad) {
@@ -46,7 +134,11 @@ void compile_to_offloads(IRNode *ir,
 
   irpass::type_check(ir);
   print("Typechecked");
-  irpass::analysis::verify(ir);
+  print.verify(/*pipeline_boundary=*/true);
+
+  if (irpass::specialize_args(ir, ir->get_kernel()->specialized_args)) {
+    print("Arguments specialized");
+  }
 
   if (ir->get_kernel()->is_evaluator) {
     TI_ASSERT(!grad);
@@ -56,64 +148,89 @@ void compile_to_offloads(IRNode *ir,
 
     irpass::offload(ir);
     print("Offloaded");
-    irpass::analysis::verify(ir);
+    print.verify(/*pipeline_boundary=*/true);
     return;
   }
 
   if (vectorize) {
     irpass::loop_vectorize(ir);
     print("Loop Vectorized");
-    irpass::analysis::verify(ir);
+    print.verify();
 
     irpass::vector_split(ir, config.max_vector_width, config.serial_schedule);
     print("Loop Split");
-    irpass::analysis::verify(ir);
+    print.verify();
   }
-  irpass::full_simplify(ir, false);
-  print("Simplified I");
-  irpass::analysis::verify(ir);
+  int num_iterations = irpass::full_simplify(ir, false);
+  print("Simplified I", num_iterations);
+  print.verify();
 
   if (grad) {
     // Remove local atomics here so that we don't have to handle their gradients
     irpass::demote_atomics(ir);
 
     irpass::full_simplify(ir, false);
-    irpass::auto_diff(ir, ad_use_stack);
+    irpass::auto_diff(ir, ad_use_stack,
+                      /*keep_primal=*/ir->get_kernel()->keep_primal);
     irpass::full_simplify(ir, false);
+    if (ad_use_stack)
+      irpass::determine_ad_stack_size(ir, config);
     print("Gradient");
-    irpass::analysis::verify(ir);
+    print.verify();
+  }
+
+  if (ir->get_kernel()->jvp) {
+    // Remove local atomics here so that we don't have to handle their duals
+    irpass::demote_atomics(ir);
+
+    irpass::full_simplify(ir, false);
+    irpass::forward_diff(ir);
+    irpass::full_simplify(ir, false);
+    print("Dual");
+    print.verify();
   }
 
   if (config.check_out_of_bound) {
     irpass::check_out_of_bound(ir);
     print("Bound checked");
-    irpass::analysis::verify(ir);
+    print.verify();
   }
 
   irpass::flag_access(ir);
   print("Access flagged I");
-  irpass::analysis::verify(ir);
+  print.verify();
 
-  irpass::full_simplify(ir, false);
-  print("Simplified II");
-  irpass::analysis::verify(ir);
+  num_iterations = irpass::full_simplify(ir, false);
+  print("Simplified II", num_iterations);
+  print.verify();
 
   irpass::offload(ir);
   print("Offloaded");
-  irpass::analysis::verify(ir);
+  print.verify();
+
+  // The async engine fuses the tasks itself.
+  if (!config.async_mode && irpass::horizontal_fusion(ir, config)) {
+    print("Horizontally fused");
+    print.verify();
+  }
+
+  if (irpass::unroll_loops(ir, config)) {
+    print("Loops unrolled");
+    print.verify();
+  }
 
   if (config.cfg_optimization) {
     irpass::cfg_optimization(ir, false);
     print("Optimized by CFG");
-    irpass::analysis::verify(ir);
+    print.verify();
   }
 
   irpass::flag_access(ir);
   print("Access flagged II");
 
-  irpass::full_simplify(ir, /*after_lower_access=*/false);
-  print("Simplified III");
-  irpass::analysis::verify(ir);
+  num_iterations = full_simplify_offloads(ir, /*after_lower_access=*/false);
+  print("Simplified III", num_iterations);
+  print.verify(/*pipeline_boundary=*/true);
 }
 
 void offload_to_executable(IRNode *ir,
@@ -124,7 +241,7 @@ void offload_to_executable(IRNode *ir,
                            bool make_block_local) {
   TI_AUTO_PROF;
 
-  auto print = make_pass_printer(verbose, ir);
+  PassObserver print(ir, verbose, config);
 
   // TODO: This is just a proof that we can demote struct-fors after offloading.
   // Eventually we might want the order to be TLS/BLS -> demote struct-for.
@@ -132,7 +249,7 @@ void offload_to_executable(IRNode *ir,
   // handle range-fors at this point.
 
   print("Start offload_to_executable");
-  irpass::analysis::verify(ir);
+  print.verify(/*pipeline_boundary=*/true);
 
   if (config.detect_read_only) {
     irpass::detect_read_only(ir);
@@ -141,13 +258,16 @@ void offload_to_executable(IRNode *ir,
 
   irpass::demote_atomics(ir);
   print("Atomics demoted I");
-  irpass::analysis::verify(ir);
+  print.verify();
 
   if (config.demote_dense_struct_fors) {
-    irpass::demote_dense_struct_fors(ir);
+    irpass::demote_dense_struct_fors(ir, config);
+    if (arch_is_cpu(config.arch)) {
+      irpass::tile_dense_loops(ir, parse_tile_shape(config.cpu_tile_shape));
+    }
     irpass::type_check(ir);
     print("Dense struct-for demoted");
-    irpass::analysis::verify(ir);
+    print.verify();
   }
 
   if (make_thread_local) {
@@ -162,38 +282,49 @@ void offload_to_executable(IRNode *ir,
 
   irpass::demote_atomics(ir);
   print("Atomics demoted II");
-  irpass::analysis::verify(ir);
+  print.verify();
 
   irpass::remove_range_assumption(ir);
   print("Remove range assumption");
 
   irpass::remove_loop_unique(ir);
   print("Remove loop_unique");
-  irpass::analysis::verify(ir);
+  print.verify();
 
   if (lower_global_access) {
     irpass::lower_access(ir, true);
     print("Access lowered");
-    irpass::analysis::verify(ir);
+    print.verify();
+
+    if (config.advanced_optimization) {
+      irpass::strength_reduce_access(ir);
+      print("Access strength reduced");
+      print.verify();
+    }
 
     irpass::die(ir);
     print("DIE");
-    irpass::analysis::verify(ir);
+    print.verify();
 
     irpass::flag_access(ir);
     print("Access flagged III");
-    irpass::analysis::verify(ir);
+    print.verify();
   }
 
   irpass::demote_operations(ir);
   print("Operations demoted");
 
-  irpass::full_simplify(ir, lower_global_access);
-  print("Simplified IV");
+  if (config.loop_invariant_code_motion) {
+    irpass::loop_invariant_code_motion(ir, config);
+    print("Loop invariant code moved");
+  }
+
+  int num_iterations = full_simplify_offloads(ir, lower_global_access);
+  print("Simplified IV", num_iterations);
 
   // Final field registration correctness & type checking
   irpass::type_check(ir);
-  irpass::analysis::verify(ir);
+  print.verify(/*pipeline_boundary=*/true);
 }
 
 void compile_to_executable(IRNode *ir,
@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <deque>
+#include <limits>
 #include <set>
-#include <thread>
+#include <type_traits>
 
+#include "taichi/ir/def_use_chains.h"
 #include "taichi/ir/ir.h"
 #include "taichi/ir/snode.h"
 #include "taichi/ir/statements.h"
@@ -12,61 +16,309 @@
 
 TLANG_NAMESPACE_BEGIN
 
+namespace {
+
+// Evaluates operations on constants on the host, the way the backends do:
+// integer arithmetic wraps around, and floating-point values are rounded to
+// their type after each operation, as IEEE 754 specifies for +, -, *, /, sqrt
+// and the conversions. What the backends disagree on, or leave undefined, is
+// not evaluated, e.g. integer division by zero, shifts by at least the width,
+// or unsigned division (LLVM divides unsigned integers as signed ones). The
+// results of the other math functions (e.g. sin or pow) depend on the math
+// library, so they are only evaluated for kernels running on the host.
+
+template <typename T>
+T get_value(const TypedConstant &c) {
+  T value;
+  std::memcpy(&value, &c.value_bits, sizeof(T));
+  return value;
+}
+
+template <typename T>
+TypedConstant make_constant(DataType dt, T value) {
+  TypedConstant c(dt);
+  std::memcpy(&c.value_bits, &value, sizeof(T));
+  return c;
+}
+
+// Calls |f| with a value of the C++ type of |dt|, or returns false if it is
+// not a primitive type.
+template <typename F>
+bool dispatch_type(DataType dt, const F &f) {
+  dt.set_is_pointer(false);
+#define PER_TYPE(id, T)                     \
+  if (dt->is_primitive(PrimitiveTypeID::id)) \
+    return f(T());
+  PER_TYPE(i8, int8)
+  PER_TYPE(i16, int16)
+  PER_TYPE(i32, int32)
+  PER_TYPE(i64, int64)
+  PER_TYPE(u8, uint8)
+  PER_TYPE(u16, uint16)
+  PER_TYPE(u32, uint32)
+  PER_TYPE(u64, uint64)
+  PER_TYPE(f32, float32)
+  PER_TYPE(f64, float64)
+#undef PER_TYPE
+  return false;
+}
+
+template <typename T>
+constexpr bool has_sign_bit(T a) {
+  return std::is_unsigned<T>::value && (a >> (sizeof(T) * 8 - 1));
+}
+
+template <typename T>
+bool evaluate_integral(BinaryOpType op, T a, T b, T &ret) {
+  constexpr uint64 bits = sizeof(T) * 8;
+  switch (op) {
+    case BinaryOpType::add:
+      ret = T(uint64(a) + uint64(b));
+      return true;
+    case BinaryOpType::sub:
+      ret = T(uint64(a) - uint64(b));
+      return true;
+    case BinaryOpType::mul:
+      ret = T(uint64(a) * uint64(b));
+      return true;
+    case BinaryOpType::div:
+    case BinaryOpType::mod:
+    case BinaryOpType::floordiv:
+      if (b == 0 || has_sign_bit(a) || has_sign_bit(b))
+        return false;
+      if (std::is_signed<T>::value && a == std::numeric_limits<T>::min() &&
+          b == T(-1))
+        return false;
+      if (op == BinaryOpType::mod) {
+        ret = a % b;
+      } else {
+        ret = a / b;
+        // Rounds towards negative infinity, as ifloordiv in the runtime.
+        if (op == BinaryOpType::floordiv && (a < 0) != (b < 0) && a &&
+            b * ret != a)
+          ret--;
+      }
+      return true;
+    case BinaryOpType::max:
+      ret = std::max(a, b);
+      return true;
+    case BinaryOpType::min:
+      ret = std::min(a, b);
+      return true;
+    case BinaryOpType::bit_and:
+      ret = a & b;
+      return true;
+    case BinaryOpType::bit_or:
+      ret = a | b;
+      return true;
+    case BinaryOpType::bit_xor:
+      ret = a ^ b;
+      return true;
+    case BinaryOpType::bit_shl:
+    case BinaryOpType::bit_shr:
+    case BinaryOpType::bit_sar:
+      if (uint64(b) >= bits)
+        return false;
+      if (op == BinaryOpType::bit_shl) {
+        ret = T(uint64(a) << b);
+      } else if (op == BinaryOpType::bit_shr) {
+        ret = T(std::make_unsigned_t<T>(a) >> b);
+      } else {
+        // Arithmetic for signed integers, logical for unsigned ones.
+        ret = a >> b;
+      }
+      return true;
+    case BinaryOpType::pow: {
+      // pow_i32 and pow_i64 in the runtime never return for negative powers.
+      if (b < 0)
+        return false;
+      uint64 base = uint64(a), result = 1;
+      for (uint64 n = uint64(b); n; n >>= 1) {
+        if (n & 1)
+          result *= base;
+        base *= base;
+      }
+      ret = T(result);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+bool evaluate_real(BinaryOpType op, T a, T b, bool use_libm, T &ret) {
+  switch (op) {
+    case BinaryOpType::add:
+      ret = a + b;
+      return true;
+    case BinaryOpType::sub:
+      ret = a - b;
+      return true;
+    case BinaryOpType::mul:
+      ret = a * b;
+      return true;
+    case BinaryOpType::div:
+      ret = a / b;
+      return true;
+    case BinaryOpType::floordiv:
+      ret = std::floor(a / b);
+      return true;
+    case BinaryOpType::max:
+      ret = std::fmax(a, b);
+      return true;
+    case BinaryOpType::min:
+      ret = std::fmin(a, b);
+      return true;
+    case BinaryOpType::atan2:
+      if (!use_libm)
+        return false;
+      ret = std::atan2(a, b);
+      return true;
+    case BinaryOpType::pow:
+      if (!use_libm)
+        return false;
+      ret = std::pow(a, b);
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+bool evaluate_comparison(BinaryOpType op, T a, T b, bool &ret) {
+  // The backends disagree on whether NaN != NaN.
+  if (std::isnan(double(a)) || std::isnan(double(b)))
+    return false;
+  switch (op) {
+    case BinaryOpType::cmp_lt:
+      ret = a < b;
+      return true;
+    case BinaryOpType::cmp_le:
+      ret = a <= b;
+      return true;
+    case BinaryOpType::cmp_gt:
+      ret = a > b;
+      return true;
+    case BinaryOpType::cmp_ge:
+      ret = a >= b;
+      return true;
+    case BinaryOpType::cmp_eq:
+      ret = a == b;
+      return true;
+    case BinaryOpType::cmp_ne:
+      ret = a != b;
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+bool evaluate_integral(UnaryOpType op, T a, T &ret) {
+  switch (op) {
+    case UnaryOpType::neg:
+      ret = T(uint64(0) - uint64(a));
+      return true;
+    case UnaryOpType::abs:
+      ret = a < 0 ? T(uint64(0) - uint64(a)) : a;
+      return true;
+    case UnaryOpType::bit_not:
+      ret = ~a;
+      return true;
+    case UnaryOpType::logic_not:
+      ret = !a;
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+bool evaluate_real(UnaryOpType op, T a, bool use_libm, T &ret) {
+  switch (op) {
+    case UnaryOpType::neg:
+      ret = -a;
+      return true;
+    case UnaryOpType::abs:
+      ret = std::abs(a);
+      return true;
+    case UnaryOpType::sqrt:
+      ret = std::sqrt(a);
+      return true;
+    case UnaryOpType::floor:
+      ret = std::floor(a);
+      return true;
+    case UnaryOpType::ceil:
+      ret = std::ceil(a);
+      return true;
+    case UnaryOpType::sgn:
+      ret = a > 0 ? T(1) : (a < 0 ? T(-1) : T(0));
+      return true;
+    default:
+      break;
+  }
+  if (!use_libm)
+    return false;
+  switch (op) {
+#define LIBM_FUNC(x)     \
+  case UnaryOpType::x:   \
+    ret = std::x(a);     \
+    return true;
+    LIBM_FUNC(sin)
+    LIBM_FUNC(asin)
+    LIBM_FUNC(cos)
+    LIBM_FUNC(acos)
+    LIBM_FUNC(tan)
+    LIBM_FUNC(tanh)
+    LIBM_FUNC(exp)
+    LIBM_FUNC(log)
+#undef LIBM_FUNC
+    case UnaryOpType::rsqrt:
+      ret = T(1) / std::sqrt(a);
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Conversions between floating-point values and integers are signed on LLVM,
+// so the unsigned integers with their sign bit set are not converted.
+template <typename From, typename To>
+bool evaluate_cast(From a, To &ret) {
+  if constexpr (std::is_floating_point<From>::value &&
+                std::is_integral<To>::value) {
+    constexpr int bits = sizeof(To) * 8;
+    const From lo = std::is_signed<To>::value ? -std::ldexp(From(1), bits - 1)
+                                              : From(0);
+    const From hi = std::ldexp(From(1), bits - 1);
+    if (!(a >= lo && a < hi))
+      return false;
+    ret = To(std::make_signed_t<To>(a));
+  } else if constexpr (std::is_integral<From>::value &&
+                       std::is_floating_point<To>::value) {
+    if (has_sign_bit(a))
+      return false;
+    ret = To(a);
+  } else {
+    // Sign or zero extension, truncation, or rounding to nearest.
+    ret = To(a);
+  }
+  return true;
+}
+
+}  // namespace
+
 class ConstantFold : public BasicStmtVisitor {
  public:
   using BasicStmtVisitor::visit;
   DelayedIRModifier modifier;
+  // Rebuilt before each traversal, see run()
+  std::unique_ptr<DefUseChains> chains;
 
   ConstantFold() : BasicStmtVisitor() {
   }
 
-  static Kernel *get_jit_evaluator_kernel(JITEvaluatorId const &id) {
-    auto &cache = get_current_program().jit_evaluator_cache;
-    // Discussion:
-    // https://github.com/taichi-dev/taichi/pull/954#discussion_r423442606
-    std::lock_guard<std::mutex> _(
-        get_current_program().jit_evaluator_cache_mut);
-    auto it = cache.find(id);
-    if (it != cache.end())  // cached?
-      return it->second.get();
-
-    auto kernel_name = fmt::format("jit_evaluator_{}", cache.size());
-    auto func = [&id]() {
-      auto lhstmt =
-          Stmt::make<ArgLoadStmt>(/*arg_id=*/0, id.lhs, /*is_ptr=*/false);
-      auto rhstmt =
-          Stmt::make<ArgLoadStmt>(/*arg_id=*/1, id.rhs, /*is_ptr=*/false);
-      pStmt oper;
-      if (id.is_binary) {
-        oper = Stmt::make<BinaryOpStmt>(id.binary_op(), lhstmt.get(),
-                                        rhstmt.get());
-      } else {
-        oper = Stmt::make<UnaryOpStmt>(id.unary_op(), lhstmt.get());
-        if (unary_op_is_cast(id.unary_op())) {
-          oper->cast<UnaryOpStmt>()->cast_type = id.rhs;
-        }
-      }
-      auto ret = Stmt::make<KernelReturnStmt>(oper.get());
-      current_ast_builder().insert(std::move(lhstmt));
-      if (id.is_binary)
-        current_ast_builder().insert(std::move(rhstmt));
-      current_ast_builder().insert(std::move(oper));
-      current_ast_builder().insert(std::move(ret));
-    };
-    auto ker =
-        std::make_unique<Kernel>(get_current_program(), func, kernel_name);
-    ker->insert_ret(id.ret);
-    ker->insert_arg(id.lhs, false);
-    if (id.is_binary)
-      ker->insert_arg(id.rhs, false);
-    ker->is_evaluator = true;
-    auto *ker_ptr = ker.get();
-    TI_TRACE("Saving JIT evaluator cache entry id={}",
-             std::hash<JITEvaluatorId>{}(id));
-    cache[id] = std::move(ker);
-    return ker_ptr;
-  }
-
   static bool is_good_type(DataType dt) {
     // ConstStmt of `bad` types like `i8` is not supported by LLVM.
     // Discussion:
@@ -80,52 +332,90 @@ class ConstantFold : public BasicStmtVisitor {
       return false;
   }
 
-  static bool jit_evaluate_binary_op(TypedConstant &ret,
-                                     BinaryOpStmt *stmt,
-                                     const TypedConstant &lhs,
-                                     const TypedConstant &rhs) {
-    if (!is_good_type(ret.dt))
+  // Whether the math library of the host is the one |stmt| runs with.
+  static bool runs_on_host(Stmt *stmt) {
+    auto *kernel = stmt->get_kernel();
+    return kernel && arch_is_cpu(kernel->arch) && !kernel->approx_math;
+  }
+
+  static bool evaluate_binary_op(TypedConstant &ret,
+                                 BinaryOpStmt *stmt,
+                                 const TypedConstant &lhs,
+                                 const TypedConstant &rhs) {
+    if (!is_good_type(ret.dt) || lhs.dt != rhs.dt)
       return false;
-    JITEvaluatorId id{std::this_thread::get_id(),
-                      (int)stmt->op_type,
-                      ret.dt,
-                      lhs.dt,
-                      rhs.dt,
-                      true};
-    auto *ker = get_jit_evaluator_kernel(id);
-    auto launch_ctx = ker->make_launch_context();
-    launch_ctx.set_arg_raw(0, lhs.val_u64);
-    launch_ctx.set_arg_raw(1, rhs.val_u64);
-    auto &current_program = stmt->get_kernel()->program;
-    {
-      std::lock_guard<std::mutex> _(current_program.jit_evaluator_cache_mut);
-      (*ker)(launch_ctx);
-      ret.val_i64 = current_program.fetch_result<int64_t>(0);
-    }
-    return true;
+    const auto op = stmt->op_type;
+    if (!is_comparison(op) && ret.dt != lhs.dt)
+      return false;
+    const bool use_libm = runs_on_host(stmt);
+    return dispatch_type(lhs.dt, [&](auto zero) {
+      using T = decltype(zero);
+      const T a = get_value<T>(lhs), b = get_value<T>(rhs);
+      if (is_comparison(op)) {
+        bool result;
+        if (!evaluate_comparison(op, a, b, result))
+          return false;
+        // True is -1, as the backends sign-extend the bit of comparisons.
+        ret = TypedConstant(ret.dt, result ? -1 : 0);
+        return true;
+      }
+      T result;
+      bool evaluated;
+      if constexpr (std::is_integral<T>::value) {
+        evaluated = evaluate_integral(op, a, b, result);
+      } else {
+        evaluated = evaluate_real(op, a, b, use_libm, result);
+      }
+      if (evaluated)
+        ret = make_constant(ret.dt, result);
+      return evaluated;
+    });
   }
 
-  static bool jit_evaluate_unary_op(TypedConstant &ret,
-                                    UnaryOpStmt *stmt,
-                                    const TypedConstant &operand) {
+  static bool evaluate_unary_op(TypedConstant &ret,
+                                UnaryOpStmt *stmt,
+                                const TypedConstant &operand) {
     if (!is_good_type(ret.dt))
       return false;
-    JITEvaluatorId id{std::this_thread::get_id(),
-                      (int)stmt->op_type,
-                      ret.dt,
-                      operand.dt,
-                      stmt->cast_type,
-                      false};
-    auto *ker = get_jit_evaluator_kernel(id);
-    auto launch_ctx = ker->make_launch_context();
-    launch_ctx.set_arg_raw(0, operand.val_u64);
-    auto &current_program = stmt->get_kernel()->program;
-    {
-      std::lock_guard<std::mutex> _(current_program.jit_evaluator_cache_mut);
-      (*ker)(launch_ctx);
-      ret.val_i64 = current_program.fetch_result<int64_t>(0);
+    const auto op = stmt->op_type;
+    if (op == UnaryOpType::cast_bits) {
+      if (data_type_size(ret.dt) != data_type_size(operand.dt))
+        return false;
+      std::memcpy(&ret.value_bits, &operand.value_bits,
+                  data_type_size(ret.dt));
+      return true;
     }
-    return true;
+    if (op == UnaryOpType::cast_value) {
+      return dispatch_type(operand.dt, [&](auto from_zero) {
+        using From = decltype(from_zero);
+        const From a = get_value<From>(operand);
+        return dispatch_type(ret.dt, [&](auto to_zero) {
+          using To = decltype(to_zero);
+          To result;
+          if (!evaluate_cast(a, result))
+            return false;
+          ret = make_constant(ret.dt, result);
+          return true;
+        });
+      });
+    }
+    if (ret.dt != operand.dt)
+      return false;
+    const bool use_libm = runs_on_host(stmt);
+    return dispatch_type(operand.dt, [&](auto zero) {
+      using T = decltype(zero);
+      const T a = get_value<T>(operand);
+      T result;
+      bool evaluated;
+      if constexpr (std::is_integral<T>::value) {
+        evaluated = evaluate_integral(op, a, result);
+      } else {
+        evaluated = evaluate_real(op, a, use_libm, result);
+      }
+      if (evaluated)
+        ret = make_constant(ret.dt, result);
+      return evaluated;
+    });
   }
 
   void visit(BinaryOpStmt *stmt) override {
@@ -137,10 +427,10 @@ class ConstantFold : public BasicStmtVisitor {
       return;
     auto dst_type = stmt->ret_type;
     TypedConstant new_constant(dst_type);
-    if (jit_evaluate_binary_op(new_constant, stmt, lhs->val[0], rhs->val[0])) {
+    if (evaluate_binary_op(new_constant, stmt, lhs->val[0], rhs->val[0])) {
       auto evaluated =
           Stmt::make<ConstStmt>(LaneAttribute<TypedConstant>(new_constant));
-      stmt->replace_with(evaluated.get());
+      chains->replace_all_usages_with(stmt, evaluated.get());
       modifier.insert_before(stmt, std::move(evaluated));
       modifier.erase(stmt);
     }
@@ -148,7 +438,7 @@ class ConstantFold : public BasicStmtVisitor {
 
   void visit(UnaryOpStmt *stmt) override {
     if (stmt->is_cast() && stmt->cast_type == stmt->operand->ret_type) {
-      stmt->replace_with(stmt->operand);
+      chains->replace_all_usages_with(stmt, stmt->operand);
       modifier.erase(stmt);
       return;
     }
@@ -159,10 +449,10 @@ class ConstantFold : public BasicStmtVisitor {
       return;
     auto dst_type = stmt->ret_type;
     TypedConstant new_constant(dst_type);
-    if (jit_evaluate_unary_op(new_constant, stmt, operand->val[0])) {
+    if (evaluate_unary_op(new_constant, stmt, operand->val[0])) {
       auto evaluated =
           Stmt::make<ConstStmt>(LaneAttribute<TypedConstant>(new_constant));
-      stmt->replace_with(evaluated.get());
+      chains->replace_all_usages_with(stmt, evaluated.get());
       modifier.insert_before(stmt, std::move(evaluated));
       modifier.erase(stmt);
     }
@@ -186,7 +476,7 @@ class ConstantFold : public BasicStmtVisitor {
       result_stmt = Stmt::make<ConstStmt>(LaneAttribute<TypedConstant>(
           TypedConstant(input->val[0].dt, result)));
     }
-    stmt->replace_with(result_stmt.get());
+    chains->replace_all_usages_with(stmt, result_stmt.get());
     modifier.insert_before(stmt, std::move(result_stmt));
     modifier.erase(stmt);
   }
@@ -195,6 +485,9 @@ class ConstantFold : public BasicStmtVisitor {
     ConstantFold folder;
     bool modified = false;
     while (true) {
+      // The folded statements are only erased at the end of a traversal, so
+      // the chains stay valid during it.
+      folder.chains = std::make_unique<DefUseChains>(node);
       node->accept(&folder);
       if (folder.modifier.modify_ir()) {
         modified = true;
@@ -211,15 +504,6 @@ namespace irpass {
 bool constant_fold(IRNode *root) {
   TI_AUTO_PROF;
   const auto &cfg = root->get_config();
-  // @archibate found that `debug=True` will cause JIT kernels
-  // failed to evaluate correctly (always return 0), so we simply
-  // disable constant_fold when config.debug is turned on.
-  // Discussion:
-  // https://github.com/taichi-dev/taichi/pull/839#issuecomment-626107010
-  if (cfg.debug) {
-    TI_TRACE("config.debug enabled, ignoring constant fold");
-    return false;
-  }
   if (!cfg.advanced_optimization)
     return false;
   return ConstantFold::run(root);
@@ -33,6 +33,11 @@ class DemoteAtomics : public BasicStmtVisitor {
       if (stmt->dest->is<ThreadLocalPtrStmt>()) {
         demote = true;
       }
+      if (stmt->dest->is<BlockLocalPtrStmt>() &&
+          arch_is_cpu(current_offloaded->device)) {
+        // The BLS buffers are in the TLS buffer of the thread on the CPU.
+        demote = true;
+      }
       if (current_offloaded->task_type == OffloadedTaskType::serial) {
         demote = true;
       }
@@ -1,7 +1,11 @@
+#include <map>
+
+#include "taichi/ir/analysis.h"
 #include "taichi/ir/ir.h"
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/ir/visitors.h"
+#include "taichi/program/kernel.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -9,7 +13,103 @@ namespace {
 
 using TaskType = OffloadedStmt::TaskType;
 
-void convert_to_range_for(OffloadedStmt *offloaded) {
+// The physical index that addresses consecutive cells of the fields under
+// |container|, i.e. the one with the lowest bits in the innermost SNode that
+// has any; -1 if none.
+int fastest_physical_index(SNode *container) {
+  for (auto snode = container; snode && snode->type != SNodeType::root;
+       snode = snode->parent) {
+    int fastest = -1;
+    for (int p = 0; p < taichi_max_num_indices; p++) {
+      if (snode->extractors[p].num_bits > 0 &&
+          (fastest == -1 || snode->extractors[p].acc_offset <
+                                snode->extractors[fastest].acc_offset)) {
+        fastest = p;
+      }
+    }
+    if (fastest != -1)
+      return fastest;
+  }
+  return -1;
+}
+
+// The loop index of |offloaded| that |index| is, up to a constant offset;
+// -1 if none.
+int loop_index_of(Stmt *index, OffloadedStmt *offloaded) {
+  if (auto bin = index->cast<BinaryOpStmt>()) {
+    if ((bin->op_type == BinaryOpType::add ||
+         bin->op_type == BinaryOpType::sub) &&
+        bin->rhs->is<ConstStmt>()) {
+      index = bin->lhs;
+    } else if (bin->op_type == BinaryOpType::add &&
+               bin->lhs->is<ConstStmt>()) {
+      index = bin->rhs;
+    }
+  }
+  auto loop_index = index->cast<LoopIndexStmt>();
+  if (loop_index && loop_index->loop == offloaded)
+    return loop_index->index;
+  return -1;
+}
+
+// Chooses the loop index that consecutive iterations, and so consecutive
+// GPU threads, should step through: the one that most of the global
+// accesses of the body address consecutive cells with. Returns -1 to keep
+// the order of the layout of the loop, which fits its own field.
+int choose_fastest_loop_index(OffloadedStmt *offloaded,
+                              const std::vector<SNode *> &snodes,
+                              bool print_report) {
+  for (auto snode : snodes) {
+    if (snode->type != SNodeType::dense || snode->_morton)
+      return -1;
+  }
+  const int current = fastest_physical_index(offloaded->snode);
+  if (current == -1)
+    return -1;
+  std::map<int, int> votes;
+  int num_accesses = 0;
+  irpass::analysis::gather_statements(offloaded->body.get(), [&](Stmt *s) {
+    auto ptr = s->cast<GlobalPtrStmt>();
+    if (!ptr)
+      return false;
+    num_accesses++;
+    for (auto field : ptr->snodes.data) {
+      auto container = field->parent;
+      const int q = fastest_physical_index(container);
+      for (int k = 0; k < (int)ptr->indices.size(); k++) {
+        if (container->physical_index_position[k] == q) {
+          const int p = loop_index_of(ptr->indices[k], offloaded);
+          if (p != -1)
+            votes[p]++;
+        }
+      }
+    }
+    return false;
+  });
+  int chosen = current;
+  for (auto &[p, count] : votes) {
+    if (count > (votes.count(chosen) ? votes.at(chosen) : 0))
+      chosen = p;
+  }
+  if (print_report) {
+    std::string breakdown;
+    for (auto &[p, count] : votes) {
+      breakdown += fmt::format(" {}:{}", p, count);
+    }
+    auto kernel = offloaded->get_kernel();
+    TI_INFO(
+        "Coalescing in kernel {}: struct-for over {} steps through physical "
+        "index {} (layout order {}); {} accesses, coalesced per index:{}",
+        kernel ? kernel->name : "?",
+        offloaded->snode->get_node_type_name_hinted(), chosen, current,
+        num_accesses, breakdown);
+  }
+  return chosen == current ? -1 : chosen;
+}
+
+// |fastest| is the physical index for consecutive iterations to step
+// through, or -1 to follow the layout of the loop.
+void convert_to_range_for(OffloadedStmt *offloaded, int fastest) {
   TI_ASSERT(offloaded->task_type == TaskType::struct_for);
 
   std::vector<SNode *> snodes;
@@ -50,21 +150,61 @@ void convert_to_range_for(OffloadedStmt *offloaded) {
   int offset = total_bits;
   Stmt *test = body_header.push_back<ConstStmt>(TypedConstant(-1));
   bool has_test = false;
-  for (int i = 0; i < (int)snodes.size(); i++) {
-    auto snode = snodes[i];
-    offset -= snode->total_num_bits;
-    for (int j = 0; j < (int)physical_indices.size(); j++) {
-      auto p = physical_indices[j];
-      auto ext = snode->extractors[p];
-      Stmt *delta = body_header.push_back<BitExtractStmt>(
-          main_loop_var, ext.acc_offset + offset,
-          ext.acc_offset + offset + ext.num_bits);
-      auto multiplier =
-          body_header.push_back<ConstStmt>(TypedConstant(1 << (ext.start)));
-      delta = body_header.push_back<BinaryOpStmt>(BinaryOpType::mul, delta,
-                                                  multiplier);
-      new_loop_vars[j] = body_header.push_back<BinaryOpStmt>(
-          BinaryOpType::add, new_loop_vars[j], delta);
+  if (fastest != -1) {
+    // Each loop var takes a contiguous range of the bits of the loop index,
+    // with |fastest| in the lowest ones. The cells of a dense path hold the
+    // bits of each index contiguously, from the leaf up.
+    std::vector<int> order;
+    for (int j = 0; j < num_loop_vars; j++) {
+      if (physical_indices[j] != fastest)
+        order.push_back(j);
+    }
+    for (int j = 0; j < num_loop_vars; j++) {
+      if (physical_indices[j] == fastest)
+        order.push_back(j);
+    }
+    for (auto j : order) {
+      int num_bits = 0;
+      for (auto snode : snodes) {
+        num_bits += snode->extractors[physical_indices[j]].num_bits;
+      }
+      offset -= num_bits;
+      new_loop_vars[j] = body_header.push_back<BitExtractStmt>(
+          main_loop_var, offset, offset + num_bits);
+    }
+  } else {
+    for (int i = 0; i < (int)snodes.size(); i++) {
+      auto snode = snodes[i];
+      offset -= snode->total_num_bits;
+      for (int j = 0; j < (int)physical_indices.size(); j++) {
+        auto p = physical_indices[j];
+        auto ext = snode->extractors[p];
+        if (snode->_morton) {
+          // The bits of the loop var are interleaved with those of the others,
+          // so that consecutive iterations walk along the Z-order curve.
+          for (int b = 0; b < ext.num_bits; b++) {
+            const int pos = offset + snode->get_child_index_bit(p, b);
+            Stmt *bit = body_header.push_back<BitExtractStmt>(main_loop_var,
+                                                              pos, pos + 1);
+            auto multiplier = body_header.push_back<ConstStmt>(
+                TypedConstant(1 << (ext.start + b)));
+            bit = body_header.push_back<BinaryOpStmt>(BinaryOpType::mul, bit,
+                                                      multiplier);
+            new_loop_vars[j] = body_header.push_back<BinaryOpStmt>(
+                BinaryOpType::add, new_loop_vars[j], bit);
+          }
+          continue;
+        }
+        Stmt *delta = body_header.push_back<BitExtractStmt>(
+            main_loop_var, ext.acc_offset + offset,
+            ext.acc_offset + offset + ext.num_bits);
+        auto multiplier =
+            body_header.push_back<ConstStmt>(TypedConstant(1 << (ext.start)));
+        delta = body_header.push_back<BinaryOpStmt>(BinaryOpType::mul, delta,
+                                                    multiplier);
+        new_loop_vars[j] = body_header.push_back<BinaryOpStmt>(
+            BinaryOpType::add, new_loop_vars[j], delta);
+      }
     }
   }
 
@@ -120,10 +260,20 @@ void convert_to_range_for(OffloadedStmt *offloaded) {
   offloaded->task_type = TaskType::range_for;
 }
 
-void maybe_convert(OffloadedStmt *stmt) {
+void maybe_convert(OffloadedStmt *stmt, const CompileConfig &config) {
   if ((stmt->task_type == TaskType::struct_for) &&
       stmt->snode->is_path_all_dense) {
-    convert_to_range_for(stmt);
+    int fastest = -1;
+    if (config.coalesce_dense_struct_fors && arch_is_gpu(config.arch)) {
+      std::vector<SNode *> snodes;
+      for (auto snode = stmt->snode; snode->type != SNodeType::root;
+           snode = snode->parent) {
+        snodes.push_back(snode);
+      }
+      fastest = choose_fastest_loop_index(stmt, snodes,
+                                          config.print_coalescing_report);
+    }
+    convert_to_range_for(stmt, fastest);
   }
 }
 
@@ -131,15 +281,15 @@ void maybe_convert(OffloadedStmt *stmt) {
 
 namespace irpass {
 
-void demote_dense_struct_fors(IRNode *root) {
+void demote_dense_struct_fors(IRNode *root, const CompileConfig &config) {
   if (auto *block = root->cast<Block>()) {
     for (auto &s_ : block->statements) {
       if (auto *s = s_->cast<OffloadedStmt>()) {
-        maybe_convert(s);
+        maybe_convert(s, config);
       }
     }
   } else if (auto *s = root->cast<OffloadedStmt>()) {
-    maybe_convert(s);
+    maybe_convert(s, config);
   }
   re_id(root);
 }
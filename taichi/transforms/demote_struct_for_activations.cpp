@@ -0,0 +1,58 @@
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/ir.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace irpass {
+
+bool demote_struct_for_activations(OffloadedStmt *offload,
+                                   bool unconditional_only) {
+  TI_AUTO_PROF;
+  TI_ASSERT(offload->task_type == OffloadedStmt::TaskType::struct_for);
+  Block *body = offload->body.get();
+
+  auto consts = irpass::analysis::constexpr_prop(body, [](Stmt *stmt) {
+    if (stmt->is<ConstStmt>()) {
+      return true;
+    } else if (stmt->is<LoopIndexStmt>())
+      return true;
+    return false;
+  });
+
+  if (unconditional_only &&
+      !irpass::analysis::gather_statements(body, [](Stmt *stmt) {
+         return stmt->is<ContinueStmt>();
+       }).empty()) {
+    // The rest of the body may be skipped by any iteration.
+    return false;
+  }
+
+  bool demoted = false;
+  // Scan all the GlobalPtrStmt and try to deactivate
+  irpass::analysis::gather_statements(body, [&](Stmt *stmt) {
+    if (auto ptr = stmt->cast<GlobalPtrStmt>(); ptr && ptr->activate) {
+      if (unconditional_only && ptr->parent != body)
+        return false;
+      bool can_demote = true;
+      // TODO: test input mask here?
+      for (auto ind : ptr->indices) {
+        if (consts.find(ind) == consts.end()) {
+          // non-constant index
+          can_demote = false;
+        }
+      }
+      if (can_demote) {
+        ptr->activate = false;
+        demoted = true;
+      }
+    }
+    return false;
+  });
+  return demoted;
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
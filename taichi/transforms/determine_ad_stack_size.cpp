@@ -0,0 +1,109 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+
+#include <optional>
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// An adstack is (re)initialized where it is allocated, at the beginning of its
+// independent block, and grows by one entry per push. Its capacity is bounded
+// by the number of pushes one execution of that block can make, which is known
+// when all the loops around the pushes have constant trip counts.
+
+// Larger bounds are treated as unknown.
+constexpr std::size_t kMaxStaticAdStackSize = 1 << 20;
+
+std::optional<std::size_t> count_pushes(Block *block, Stmt *stack);
+
+bool has_pushes(Stmt *stmt, Stmt *stack) {
+  return !irpass::analysis::gather_statements(stmt, [&](Stmt *s) {
+            if (auto push = s->cast<StackPushStmt>())
+              return push->stack == stack;
+            return false;
+          }).empty();
+}
+
+std::optional<int64> get_trip_count(RangeForStmt *stmt) {
+  auto begin = stmt->begin->cast<ConstStmt>();
+  auto end = stmt->end->cast<ConstStmt>();
+  if (!begin || !end)
+    return std::nullopt;
+  return std::max(int64(0), end->val[0].val_int() - begin->val[0].val_int());
+}
+
+// Returns an upper bound of the number of pushes onto |stack| when |block| is
+// executed once, or std::nullopt if there is no static bound.
+std::optional<std::size_t> count_pushes(Block *block, Stmt *stack) {
+  std::size_t count = 0;
+  for (auto &s_ : block->statements) {
+    auto *s = s_.get();
+    std::optional<std::size_t> n = 0;
+    if (auto push = s->cast<StackPushStmt>()) {
+      n = push->stack == stack ? 1 : 0;
+    } else if (auto if_stmt = s->cast<IfStmt>()) {
+      // Only one of the branches is taken.
+      std::optional<std::size_t> t = 0, f = 0;
+      if (if_stmt->true_statements)
+        t = count_pushes(if_stmt->true_statements.get(), stack);
+      if (if_stmt->false_statements)
+        f = count_pushes(if_stmt->false_statements.get(), stack);
+      if (t && f)
+        n = std::max(*t, *f);
+      else
+        n = std::nullopt;
+    } else if (auto range_for = s->cast<RangeForStmt>()) {
+      auto body = count_pushes(range_for->body.get(), stack);
+      auto trip_count = get_trip_count(range_for);
+      if (body && *body == 0)
+        n = 0;
+      else if (body && trip_count &&
+               (std::size_t)*trip_count <= kMaxStaticAdStackSize / *body)
+        n = *body * (std::size_t)*trip_count;
+      else
+        n = std::nullopt;
+    } else if (s->is_container_statement() && has_pushes(s, stack)) {
+      // While loops, struct-fors, ...
+      n = std::nullopt;
+    }
+    if (!n)
+      return std::nullopt;
+    count += *n;
+    if (count > kMaxStaticAdStackSize)
+      return std::nullopt;
+  }
+  return count;
+}
+
+}  // namespace
+
+namespace irpass {
+
+void determine_ad_stack_size(IRNode *root, const CompileConfig &config) {
+  TI_AUTO_PROF;
+  auto stacks = irpass::analysis::gather_statements(
+      root, [&](Stmt *s) { return s->is<StackAllocaStmt>(); });
+  for (auto *s : stacks) {
+    auto *stack = s->as<StackAllocaStmt>();
+    if (stack->max_size != 0)
+      continue;
+    auto bound = count_pushes(stack->parent, stack);
+    if (bound) {
+      stack->max_size = std::max(*bound, (std::size_t)1);
+      TI_TRACE("Adstack {} needs at most {} entries", stack->name(),
+               stack->max_size);
+    } else {
+      stack->max_size = config.ad_stack_size;
+      TI_TRACE("Adstack {} has no static bound, using ad_stack_size = {}",
+               stack->name(), stack->max_size);
+    }
+  }
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
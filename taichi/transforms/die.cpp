@@ -4,61 +4,61 @@
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/ir/visitors.h"
+#include <unordered_map>
 #include <unordered_set>
 
 TLANG_NAMESPACE_BEGIN
 
 // Dead Instruction Elimination
+//
+// Counts the uses of each statement in one traversal, then erases the
+// eliminable statements without uses from a worklist. Erasing a statement
+// drops the uses of its operands, which are erased in turn once unused, so
+// chains of dead statements do not take one traversal per statement.
 class DIE : public IRVisitor {
  public:
-  std::unordered_set<int> used;
-  int phase;  // 0: mark usage 1: eliminate
+  std::unordered_map<Stmt *, int> num_uses;
+  std::unordered_set<Stmt *> eliminable;
   DelayedIRModifier modifier;
   bool modified_ir;
 
   DIE(IRNode *node) {
     allow_undefined_visitor = true;
     invoke_default_visitor = true;
-    modified_ir = false;
-    while (true) {
-      bool modified = false;
-      phase = 0;
-      used.clear();
-      node->accept(this);
-      phase = 1;
-      while (true) {
-        node->accept(this);
-        if (modifier.modify_ir()) {
-          modified = true;
-          modified_ir = true;
-          continue;
+    node->accept(this);
+
+    std::vector<Stmt *> worklist;
+    for (auto stmt : eliminable) {
+      if (num_uses[stmt] == 0) {
+        worklist.push_back(stmt);
+      }
+    }
+    while (!worklist.empty()) {
+      auto stmt = worklist.back();
+      worklist.pop_back();
+      modifier.erase(stmt);
+      for (auto op : stmt->get_operands()) {
+        if (op && --num_uses[op] == 0 && eliminable.count(op)) {
+          worklist.push_back(op);
         }
-        break;
       }
-      if (!modified)
-        break;
     }
+    modified_ir = modifier.modify_ir();
   }
 
   void register_usage(Stmt *stmt) {
     for (auto op : stmt->get_operands()) {
       if (op) {  // might be nullptr
-        if (used.find(op->instance_id) == used.end()) {
-          used.insert(op->instance_id);
-        }
+        num_uses[op]++;
       }
     }
   }
 
   void visit(Stmt *stmt) {
     TI_ASSERT(!stmt->erased);
-    if (phase == 0) {
-      register_usage(stmt);
-    } else {
-      if (stmt->dead_instruction_eliminable() &&
-          used.find(stmt->instance_id) == used.end()) {
-        modifier.erase(stmt);
-      }
+    register_usage(stmt);
+    if (stmt->dead_instruction_eliminable()) {
+      eliminable.insert(stmt);
     }
   }
 
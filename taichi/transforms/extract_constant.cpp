@@ -17,12 +17,13 @@ class ExtractConstant : public BasicStmtVisitor {
       top_level = node->as<Block>();
   }
 
+  // The constants to move, with the blocks to move them to, in visiting order
+  std::vector<std::pair<ConstStmt *, Block *>> to_extract;
+
   void visit(ConstStmt *stmt) override {
     TI_ASSERT(top_level);
     if (stmt->parent != top_level) {
-      auto extracted = stmt->parent->extract(stmt);
-      top_level->insert(std::move(extracted), 0);
-      throw IRModified();
+      to_extract.emplace_back(stmt, top_level);
     }
   }
 
@@ -35,26 +36,26 @@ class ExtractConstant : public BasicStmtVisitor {
     }
   }
 
-  static void run(IRNode *node) {
+  static bool run(IRNode *node) {
     ExtractConstant extractor(node);
-    while (true) {
-      bool modified = false;
-      try {
-        node->accept(&extractor);
-      } catch (IRModified) {
-        modified = true;
-      }
-      if (!modified)
-        break;
+    node->accept(&extractor);
+    // Moving the constants does not change which ones are visited, so they
+    // are all collected in one traversal. Each one is inserted at the front,
+    // so the last visited one ends up first.
+    for (auto &[stmt, block] : extractor.to_extract) {
+      auto extracted = stmt->parent->extract(stmt);
+      block->insert(std::move(extracted), 0);
     }
+    return !extractor.to_extract.empty();
   }
 };
 
 namespace irpass {
-void extract_constant(IRNode *root) {
+bool extract_constant(IRNode *root) {
   TI_AUTO_PROF;
   if (root->get_config().advanced_optimization)
-    ExtractConstant::run(root);
+    return ExtractConstant::run(root);
+  return false;
 }
 }  // namespace irpass
 
@@ -0,0 +1,236 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+#include <typeindex>
+
+TLANG_NAMESPACE_BEGIN
+
+// Global Value Numbering
+//
+// Replaces each statement computing the same value as a statement dominating
+// it with the latter. The IR is structured, so the statements dominating a
+// statement are the ones before it in its block and in the blocks enclosing
+// it. The values of the pure statements are looked up in a hash table scoped
+// by blocks, keyed by the class, the fields and the (already numbered)
+// operands, instead of comparing them pairwise as whole_kernel_cse does.
+//
+// Loads from the same address are numbered the same as long as no statement
+// in between may store to that address, according to alias_analysis.
+class GlobalValueNumbering : public BasicStmtVisitor {
+ private:
+  // The statements replaced, and the statements replacing them.
+  std::unordered_map<Stmt *, Stmt *> replacements;
+  // The pure statements visible from the current statement by their hash,
+  // and the hashes in the order of insertion, to leave the blocks.
+  std::unordered_map<uint64, std::vector<Stmt *>> values;
+  std::vector<uint64> value_history;
+  // The loads whose values are still valid, by their pointer.
+  std::unordered_map<Stmt *, GlobalLoadStmt *> loads;
+  int loop_depth{0};
+  DelayedIRModifier modifier;
+
+ public:
+  using BasicStmtVisitor::visit;
+
+  GlobalValueNumbering() {
+    allow_undefined_visitor = true;
+    invoke_default_visitor = true;
+  }
+
+  static uint64 value_hash(Stmt *stmt) {
+    uint64 hash = std::type_index(typeid(*stmt)).hash_code();
+    if (auto ptr = stmt->cast<GlobalPtrStmt>()) {
+      // See same_value() below, |activate| does not matter.
+      hash = hash_combine(hash, ptr->snodes[0]->id);
+    } else {
+      hash = hash_combine(hash, stmt->field_manager.hash());
+    }
+    for (int i = 0; i < stmt->num_operands(); i++) {
+      hash = hash_combine(hash, (uint64)(std::size_t)stmt->operand(i));
+    }
+    return hash;
+  }
+
+  static bool same_value(Stmt *this_stmt, Stmt *prev_stmt) {
+    if (this_stmt->is<GlobalPtrStmt>()) {
+      auto this_ptr = this_stmt->as<GlobalPtrStmt>();
+      auto prev_ptr = prev_stmt->as<GlobalPtrStmt>();
+      return irpass::analysis::definitely_same_address(this_ptr, prev_ptr) &&
+             (this_ptr->activate == prev_ptr->activate || prev_ptr->activate);
+    }
+    return irpass::analysis::same_statements(this_stmt, prev_stmt);
+  }
+
+  void replace(Stmt *stmt, Stmt *prev_stmt) {
+    replacements[stmt] = prev_stmt;
+    modifier.erase(stmt);
+  }
+
+  // The users of a replaced statement are dominated by it, so they are
+  // visited after it.
+  void update_operands(Stmt *stmt) {
+    for (int i = 0; i < stmt->num_operands(); i++) {
+      auto it = replacements.find(stmt->operand(i));
+      if (it != replacements.end()) {
+        stmt->replace_operand_with(it->first, it->second);
+      }
+    }
+  }
+
+  // Forgets the loads that |stmt| may invalidate.
+  void invalidate_loads(Stmt *stmt) {
+    if (!stmt->has_global_side_effect() || loads.empty())
+      return;
+    auto destinations = irpass::analysis::get_store_destination(stmt);
+    if (destinations.empty() || stmt->is<ExternalFuncCallStmt>()) {
+      // It may store anywhere, e.g. a function call or a deactivation.
+      loads.clear();
+      return;
+    }
+    for (auto it = loads.begin(); it != loads.end();) {
+      bool clobbered = false;
+      for (auto destination : destinations) {
+        if (irpass::analysis::maybe_same_address(destination, it->first)) {
+          clobbered = true;
+          break;
+        }
+      }
+      if (clobbered)
+        it = loads.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  // Forgets the loads that the statements inside |container| may invalidate.
+  void invalidate_loads_in(Stmt *container) {
+    if (loads.empty())
+      return;
+    auto stmts = irpass::analysis::gather_statements(container, [&](Stmt *s) {
+      return s != container && !s->is_container_statement() &&
+             s->has_global_side_effect();
+    });
+    for (auto stmt : stmts) {
+      invalidate_loads(stmt);
+    }
+  }
+
+  void visit(Stmt *stmt) override {
+    update_operands(stmt);
+    if (auto load = stmt->cast<GlobalLoadStmt>()) {
+      if (load->width() != 1)
+        return;
+      auto it = loads.find(load->ptr);
+      if (it != loads.end() && it->second->ret_type == load->ret_type) {
+        replace(load, it->second);
+      } else {
+        loads[load->ptr] = load;
+      }
+      return;
+    }
+    if (!stmt->common_statement_eliminable()) {
+      invalidate_loads(stmt);
+      return;
+    }
+    const auto hash = value_hash(stmt);
+    auto &candidates = values[hash];
+    for (auto prev_stmt : candidates) {
+      if (same_value(stmt, prev_stmt)) {
+        replace(stmt, prev_stmt);
+        return;
+      }
+    }
+    candidates.push_back(stmt);
+    value_history.push_back(hash);
+  }
+
+  void visit(Block *stmt_list) override {
+    // The values of a block do not dominate the statements after it.
+    const auto num_values = value_history.size();
+    for (auto &stmt : stmt_list->statements) {
+      stmt->accept(this);
+    }
+    while (value_history.size() > num_values) {
+      auto it = values.find(value_history.back());
+      it->second.pop_back();
+      if (it->second.empty())
+        values.erase(it);
+      value_history.pop_back();
+    }
+  }
+
+  void visit(IfStmt *if_stmt) override {
+    update_operands(if_stmt);
+    const auto saved_loads = loads;
+    if (if_stmt->true_statements) {
+      if_stmt->true_statements->accept(this);
+      loads = saved_loads;
+    }
+    if (if_stmt->false_statements) {
+      if_stmt->false_statements->accept(this);
+      loads = saved_loads;
+    }
+    invalidate_loads_in(if_stmt);
+  }
+
+  // The loads before a loop are valid in its body if the body does not store
+  // to their addresses, and if the loop is serial: the other threads running
+  // a parallel loop may store to them.
+  void visit_loop(Stmt *loop,
+                  bool parallel,
+                  const std::vector<Block *> &blocks) {
+    update_operands(loop);
+    invalidate_loads_in(loop);
+    const auto saved_loads = loads;
+    loop_depth++;
+    for (auto block : blocks) {
+      if (!block)
+        continue;
+      if (parallel)
+        loads.clear();
+      block->accept(this);
+      loads = saved_loads;
+    }
+    loop_depth--;
+  }
+
+  void visit(WhileStmt *stmt) override {
+    visit_loop(stmt, false, {stmt->body.get()});
+  }
+
+  void visit(RangeForStmt *stmt) override {
+    visit_loop(stmt, loop_depth == 0, {stmt->body.get()});
+  }
+
+  void visit(StructForStmt *stmt) override {
+    visit_loop(stmt, loop_depth == 0, {stmt->body.get()});
+  }
+
+  void visit(FuncBodyStmt *stmt) override {
+    visit_loop(stmt, true, {stmt->body.get()});
+  }
+
+  void visit(OffloadedStmt *stmt) override {
+    visit_loop(stmt, true,
+               {stmt->tls_prologue.get(), stmt->bls_prologue.get(),
+                stmt->body.get(), stmt->bls_epilogue.get(),
+                stmt->tls_epilogue.get()});
+  }
+
+  static bool run(IRNode *node) {
+    GlobalValueNumbering gvn;
+    node->accept(&gvn);
+    return gvn.modifier.modify_ir();
+  }
+};
+
+namespace irpass {
+bool global_value_numbering(IRNode *root) {
+  TI_AUTO_PROF;
+  return GlobalValueNumbering::run(root);
+}
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,255 @@
+#include <set>
+#include <utility>
+
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/ir.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+using TaskType = OffloadedStmt::TaskType;
+
+// The global memory an offloaded task accesses, as (kind, id) pairs: the
+// storage unit of a field, a global temporary or an external array.
+struct TaskAccesses {
+  enum Kind { field, global_tmp, external_array };
+  using Unit = std::pair<int, int64>;
+
+  std::set<Unit> reads, writes, atomics;
+  // Whether the task does anything fusion cannot account for, e.g.
+  // activations, or statements depending on the shape of the loop.
+  bool unknown{false};
+};
+
+// The unit that the SNode |snode| is stored in: the fields packed into the
+// same physical words are written together.
+int64 storage_unit(SNode *snode) {
+  while (snode->parent && snode->parent->is_bit_level) {
+    snode = snode->parent;
+  }
+  if (snode->parent && (snode->parent->type == SNodeType::bit_struct ||
+                        snode->parent->type == SNodeType::bit_array)) {
+    snode = snode->parent;
+  }
+  return snode->id;
+}
+
+TaskAccesses gather_accesses(OffloadedStmt *offloaded) {
+  TaskAccesses accesses;
+  auto add_ptr = [&](Stmt *ptr, std::set<TaskAccesses::Unit> *units) {
+    if (auto global_ptr = ptr->cast<GlobalPtrStmt>()) {
+      for (auto snode : global_ptr->snodes.data) {
+        units->emplace(TaskAccesses::field, storage_unit(snode));
+      }
+    } else if (auto tmp = ptr->cast<GlobalTemporaryStmt>()) {
+      units->emplace(TaskAccesses::global_tmp, (int64)tmp->offset);
+    } else if (auto external_ptr = ptr->cast<ExternalPtrStmt>()) {
+      auto arg = external_ptr->base_ptrs[0]->cast<ArgLoadStmt>();
+      if (!arg) {
+        accesses.unknown = true;
+        return;
+      }
+      units->emplace(TaskAccesses::external_array, arg->arg_id);
+    } else if (!ptr->is<AllocaStmt>()) {
+      accesses.unknown = true;
+    }
+  };
+  irpass::analysis::gather_statements(offloaded->body.get(), [&](Stmt *s) {
+    if (auto load = s->cast<GlobalLoadStmt>()) {
+      add_ptr(load->ptr, &accesses.reads);
+    } else if (auto store = s->cast<GlobalStoreStmt>()) {
+      add_ptr(store->ptr, &accesses.writes);
+    } else if (auto atomic = s->cast<AtomicOpStmt>()) {
+      add_ptr(atomic->dest, &accesses.atomics);
+    } else if (auto global_ptr = s->cast<GlobalPtrStmt>()) {
+      for (auto snode : global_ptr->snodes.data) {
+        if (global_ptr->activate && !snode->is_path_all_dense) {
+          accesses.unknown = true;
+        }
+      }
+    } else if (auto loop_index = s->cast<LoopIndexStmt>()) {
+      if (loop_index->loop == offloaded && loop_index->index != 0) {
+        accesses.unknown = true;
+      }
+    } else if (s->is<SNodeOpStmt>() || s->is<ExternalFuncCallStmt>() ||
+               s->is<KernelReturnStmt>() || s->is<InternalFuncStmt>() ||
+               s->is<LoopLinearIndexStmt>() ||
+               s->is<BlockCornerIndexStmt>() || s->is<BlockDimStmt>() ||
+               s->is<OffloadedStmt>()) {
+      accesses.unknown = true;
+    }
+    return false;
+  });
+  return accesses;
+}
+
+bool intersects(const std::set<TaskAccesses::Unit> &a,
+                const std::set<TaskAccesses::Unit> &b) {
+  for (auto &unit : a) {
+    if (b.count(unit))
+      return true;
+  }
+  return false;
+}
+
+// Whether the iterations of |a| and |b| may run in any order relative to each
+// other. The atomics of both on the same unit commute.
+bool independent(const TaskAccesses &a, const TaskAccesses &b) {
+  if (a.unknown || b.unknown)
+    return false;
+  return !intersects(a.writes, b.reads) && !intersects(a.writes, b.writes) &&
+         !intersects(a.writes, b.atomics) && !intersects(b.writes, a.reads) &&
+         !intersects(b.writes, a.atomics) && !intersects(a.atomics, b.reads) &&
+         !intersects(b.atomics, a.reads);
+}
+
+// Whether |offloaded| is a serial task small enough to run on one thread of
+// a range-for without delaying it much.
+bool foldable_serial(OffloadedStmt *offloaded, int max_statements) {
+  return offloaded->task_type == TaskType::serial &&
+         irpass::analysis::count_statements(offloaded->body.get()) <=
+             max_statements;
+}
+
+bool fusible_range_for(OffloadedStmt *offloaded) {
+  return offloaded->task_type == TaskType::range_for &&
+         offloaded->const_begin && offloaded->const_end &&
+         !offloaded->reversed && offloaded->begin_value <= offloaded->end_value;
+}
+
+// Replaces the loop index of |loop| in |body| with the loop index of |fused|
+// plus |offset|.
+void rebase_loop_index(Block *body,
+                       OffloadedStmt *loop,
+                       OffloadedStmt *fused,
+                       int32 offset) {
+  auto loop_indices =
+      irpass::analysis::gather_statements(body, [&](Stmt *s) {
+        auto loop_index = s->cast<LoopIndexStmt>();
+        return loop_index && loop_index->loop == loop;
+      });
+  VecStatement header;
+  auto index = header.push_back<LoopIndexStmt>(fused, 0);
+  auto delta = header.push_back<ConstStmt>(TypedConstant(offset));
+  auto rebased =
+      header.push_back<BinaryOpStmt>(BinaryOpType::add, index, delta);
+  body->insert(std::move(header), 0);
+  for (auto loop_index : loop_indices) {
+    irpass::replace_all_usages_with(body, loop_index, rebased);
+    loop_index->parent->erase(loop_index);
+  }
+  irpass::analysis::gather_statements(body, [&](Stmt *s) {
+    if (auto cont = s->cast<ContinueStmt>(); cont && cont->scope == loop) {
+      cont->scope = fused;
+    }
+    return false;
+  });
+}
+
+// Fuses the range-for |b| into the range-for |a| right before it: the fused
+// loop runs the iterations of |a|, then those of |b|.
+void fuse(OffloadedStmt *a, OffloadedStmt *b) {
+  const int32 num_a = a->end_value - a->begin_value;
+  const int32 num_b = b->end_value - b->begin_value;
+  auto body_a = std::move(a->body);
+  auto body_b = std::move(b->body);
+  rebase_loop_index(body_a.get(), a, a, a->begin_value);
+  rebase_loop_index(body_b.get(), b, a, b->begin_value - num_a);
+
+  auto body = std::make_unique<Block>();
+  auto index = body->push_back<LoopIndexStmt>(a, 0);
+  auto bound = body->push_back<ConstStmt>(TypedConstant(num_a));
+  auto cond =
+      body->push_back<BinaryOpStmt>(BinaryOpType::cmp_lt, index, bound);
+  auto if_stmt = Stmt::make_typed<IfStmt>(cond);
+  if_stmt->set_true_statements(std::move(body_a));
+  if_stmt->set_false_statements(std::move(body_b));
+  body->insert(std::move(if_stmt));
+  a->body = std::move(body);
+  a->body->parent_stmt = a;
+
+  a->begin_value = 0;
+  a->end_value = num_a + num_b;
+  a->block_dim = std::max(a->block_dim, b->block_dim);
+  for (auto flag :
+       {SNodeAccessFlag::block_local, SNodeAccessFlag::read_only}) {
+    for (auto snode : b->mem_access_opt.get_snodes_with_flag(flag)) {
+      a->mem_access_opt.add_flag(snode, flag);
+    }
+  }
+}
+
+// Runs the serial task |serial| in the first iteration of the range-for
+// |loop| next to it.
+void fold_serial(OffloadedStmt *serial, OffloadedStmt *loop) {
+  VecStatement prologue;
+  auto index = prologue.push_back<LoopIndexStmt>(loop, 0);
+  auto begin = prologue.push_back<ConstStmt>(TypedConstant(loop->begin_value));
+  auto cond =
+      prologue.push_back<BinaryOpStmt>(BinaryOpType::cmp_eq, index, begin);
+  auto if_stmt = prologue.push_back<IfStmt>(cond);
+  if_stmt->set_true_statements(std::move(serial->body));
+  loop->body->insert(std::move(prologue), 0);
+}
+
+}  // namespace
+
+namespace irpass {
+
+bool horizontal_fusion(IRNode *root, const CompileConfig &config) {
+  auto block = root->cast<Block>();
+  const int max_iterations = config.horizontal_fusion_max_iterations;
+  const int max_serial_statements = config.serial_fusion_max_statements;
+  if (!block || (max_iterations <= 0 && max_serial_statements <= 0))
+    return false;
+  bool modified = false;
+  for (int i = 0; i + 1 < (int)block->size();) {
+    auto a = block->statements[i]->cast<OffloadedStmt>();
+    auto b = block->statements[i + 1]->cast<OffloadedStmt>();
+    if (!a || !b) {
+      i++;
+      continue;
+    }
+    // A serial task lands in the first iteration, so the range-for must not
+    // be empty.
+    if (foldable_serial(a, max_serial_statements) && fusible_range_for(b) &&
+        b->begin_value < b->end_value &&
+        independent(gather_accesses(a), gather_accesses(b))) {
+      fold_serial(a, b);
+      block->erase(i);
+      modified = true;
+      continue;
+    }
+    if (fusible_range_for(a) && a->begin_value < a->end_value &&
+        foldable_serial(b, max_serial_statements) &&
+        independent(gather_accesses(a), gather_accesses(b))) {
+      fold_serial(b, a);
+      block->erase(i + 1);
+      modified = true;
+      continue;
+    }
+    if (!fusible_range_for(a) || !fusible_range_for(b) ||
+        a->num_cpu_threads != b->num_cpu_threads ||
+        (int64)a->end_value - a->begin_value + b->end_value - b->begin_value >
+            max_iterations ||
+        !independent(gather_accesses(a), gather_accesses(b))) {
+      i++;
+      continue;
+    }
+    fuse(a, b);
+    block->erase(i + 1);
+    modified = true;
+  }
+  if (modified) {
+    type_check(root);
+  }
+  return modified;
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
@@ -124,8 +124,16 @@ class IRPrinter : public IRVisitor {
       extras += ", ";
       extras += output->name();
     }
-    print("{} : func_call {:x}, {}", stmt->name(), (std::size_t)stmt->func,
-          extras);
+    if (!stmt->bitcode_file.empty()) {
+      print("{} : func_call \"{}\" in \"{}\", {}", stmt->name(),
+            stmt->runtime_func, stmt->bitcode_file, extras);
+    } else if (!stmt->runtime_func.empty()) {
+      print("{} : func_call runtime \"{}\", {}", stmt->name(),
+            stmt->runtime_func, extras);
+    } else {
+      print("{} : func_call {:x}, {}", stmt->name(), (std::size_t)stmt->func,
+            extras);
+    }
   }
 
   void visit(FrontendSNodeOpStmt *stmt) override {
@@ -323,10 +331,12 @@ class IRPrinter : public IRVisitor {
   }
 
   void visit(RangeForStmt *for_stmt) override {
-    print("{} : {}for in range({}, {}) (vectorize {}) {}{{", for_stmt->name(),
-          for_stmt->reversed ? "reversed " : "", for_stmt->begin->name(),
-          for_stmt->end->name(), for_stmt->vectorize,
-          block_dim_info(for_stmt->block_dim));
+    print("{} : {}for in range({}, {}) (vectorize {}) {}{}{{",
+          for_stmt->name(), for_stmt->reversed ? "reversed " : "",
+          for_stmt->begin->name(), for_stmt->end->name(), for_stmt->vectorize,
+          block_dim_info(for_stmt->block_dim),
+          for_stmt->unroll >= 0 ? fmt::format("unroll={} ", for_stmt->unroll)
+                                : "");
     for_stmt->body->accept(this);
     print("}}");
   }
@@ -444,7 +454,12 @@ class IRPrinter : public IRVisitor {
   }
 
   void visit(GetRootStmt *stmt) override {
-    print("{}{} = get root", stmt->type_hint(), stmt->name());
+    if (stmt->root && stmt->root->snode_tree_id != 0) {
+      print("{}{} = get root {}", stmt->type_hint(), stmt->name(),
+            stmt->root->get_node_type_name_hinted());
+    } else {
+      print("{}{} = get root", stmt->type_hint(), stmt->name());
+    }
   }
 
   void visit(SNodeLookupStmt *stmt) override {
@@ -0,0 +1,212 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+#include "taichi/program/kernel.h"
+
+#include <map>
+
+TLANG_NAMESPACE_BEGIN
+
+// Loop-Invariant Code Motion
+//
+// Moves the statements of the body of a serial loop that compute the same
+// value in every iteration before the loop: pure statements whose operands are
+// defined outside the loop, e.g. the index arithmetic and the GlobalPtrStmts
+// or SNodeLookupStmt chains of fixed indices, and the loads from their
+// addresses when no statement in the loop may store to them. Only the
+// statements directly in the body, which run in every iteration, are moved.
+// Inner loops are visited first, so that the statements invariant in several
+// nested loops move out of all of them.
+//
+// The loops of the offloaded tasks (and the outermost loops before offloading)
+// are parallel and left untouched.
+class LoopInvariantCodeMotion : public BasicStmtVisitor {
+ private:
+  int loop_depth{0};
+  int num_loops{0};
+  int num_loads{0};
+  std::map<std::string, int> hoisted;
+
+ public:
+  using BasicStmtVisitor::visit;
+
+  LoopInvariantCodeMotion() {
+    allow_undefined_visitor = true;
+    invoke_default_visitor = true;
+  }
+
+  // Integer divisions may trap, e.g. if the loop does not run when the
+  // divisor is 0.
+  static bool may_trap(Stmt *stmt) {
+    if (auto bin = stmt->cast<BinaryOpStmt>()) {
+      return (bin->op_type == BinaryOpType::div ||
+              bin->op_type == BinaryOpType::floordiv ||
+              bin->op_type == BinaryOpType::mod) &&
+             !is_real(bin->ret_type);
+    }
+    return false;
+  }
+
+  static bool is_pure(Stmt *stmt) {
+    return !stmt->is_container_statement() &&
+           !stmt->has_global_side_effect() &&
+           stmt->common_statement_eliminable() && !may_trap(stmt);
+  }
+
+  // Whether |stmt| may leave the iteration before its end.
+  static bool is_control(Stmt *stmt) {
+    return stmt->is<ContinueStmt>() || stmt->is<WhileControlStmt>() ||
+           stmt->is<KernelReturnStmt>();
+  }
+
+  // Whether |store| may store to any address, e.g. a function call or the
+  // deactivation of an SNode.
+  static bool may_store_anywhere(Stmt *store) {
+    if (is_control(store))
+      return false;
+    return store->is<ExternalFuncCallStmt>() ||
+           irpass::analysis::get_store_destination(store).empty();
+  }
+
+  // Whether one of |stores| may store to |ptr|.
+  static bool may_store_to(const std::vector<Stmt *> &stores, Stmt *ptr) {
+    for (auto store : stores) {
+      if (may_store_anywhere(store))
+        return true;
+      for (auto destination : irpass::analysis::get_store_destination(store)) {
+        if (irpass::analysis::maybe_same_address(destination, ptr))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  // |loads_safe| tells whether every statement of the body runs at least
+  // once, so that loading from the addresses before the loop is safe.
+  void hoist(Stmt *loop, Block *body, bool loads_safe) {
+    const auto stores =
+        irpass::analysis::gather_statements(body, [](Stmt *s) {
+          return !s->is_container_statement() && s->has_global_side_effect();
+        });
+    // The lookups of sparse SNodes load the pointers to their children, which
+    // deactivations change.
+    bool lookups_safe = true;
+    for (auto stmt : stores) {
+      if (is_control(stmt)) {
+        loads_safe = false;
+      }
+      if (may_store_anywhere(stmt)) {
+        lookups_safe = false;
+      }
+    }
+
+    std::unordered_set<Stmt *> variant;
+    variant.insert(loop);
+    auto is_invariant = [&](Stmt *stmt) {
+      for (int i = 0; i < stmt->num_operands(); i++) {
+        if (variant.find(stmt->operand(i)) != variant.end())
+          return false;
+      }
+      return true;
+    };
+    std::vector<Stmt *> to_hoist;
+    for (auto &s : body->statements) {
+      auto stmt = s.get();
+      bool hoistable = false;
+      if (auto load = stmt->cast<GlobalLoadStmt>()) {
+        hoistable = loads_safe && load->width() == 1 && is_invariant(load) &&
+                    !may_store_to(stores, load->ptr);
+      } else if (stmt->is<GlobalPtrStmt>() || stmt->is<SNodeLookupStmt>() ||
+                 stmt->is<GetChStmt>()) {
+        hoistable = lookups_safe && is_pure(stmt) && is_invariant(stmt);
+      } else {
+        hoistable = is_pure(stmt) && is_invariant(stmt);
+      }
+      if (hoistable)
+        to_hoist.push_back(stmt);
+      else
+        variant.insert(stmt);
+    }
+    if (to_hoist.empty())
+      return;
+
+    num_loops++;
+    for (auto stmt : to_hoist) {
+      if (stmt->is<GlobalLoadStmt>())
+        num_loads++;
+      hoisted[stmt->type()]++;
+      loop->insert_before_me(body->extract(stmt));
+    }
+  }
+
+  void visit(RangeForStmt *stmt) override {
+    loop_depth++;
+    stmt->body->accept(this);
+    loop_depth--;
+    if (loop_depth == 0)
+      return;
+    // Only loops with constant bounds are known to run.
+    auto begin = stmt->begin->cast<ConstStmt>();
+    auto end = stmt->end->cast<ConstStmt>();
+    bool runs = begin && end && begin->width() == 1 && end->width() == 1 &&
+                begin->val[0].val_int() < end->val[0].val_int();
+    hoist(stmt, stmt->body.get(), runs);
+  }
+
+  void visit(WhileStmt *stmt) override {
+    loop_depth++;
+    stmt->body->accept(this);
+    loop_depth--;
+    // The loop may end before the statements after its condition.
+    hoist(stmt, stmt->body.get(), false);
+  }
+
+  void visit(StructForStmt *stmt) override {
+    loop_depth++;
+    stmt->body->accept(this);
+    loop_depth--;
+  }
+
+  void visit(OffloadedStmt *stmt) override {
+    loop_depth++;
+    stmt->all_blocks_accept(this);
+    loop_depth--;
+  }
+
+  void visit(FuncBodyStmt *stmt) override {
+    loop_depth++;
+    stmt->body->accept(this);
+    loop_depth--;
+  }
+
+  static bool run(IRNode *root, const CompileConfig &config) {
+    LoopInvariantCodeMotion licm;
+    root->accept(&licm);
+    if (config.print_licm_report && licm.num_loops > 0) {
+      auto kernel = root->get_kernel();
+      std::string breakdown;
+      int num_stmts = 0;
+      for (auto &it : licm.hoisted) {
+        breakdown += fmt::format(" {} x{}", it.first, it.second);
+        num_stmts += it.second;
+      }
+      TI_INFO(
+          "Loop-invariant code motion in kernel {}: hoisted {} statements "
+          "({} loads) out of {} loops:{}",
+          kernel ? kernel->name : "?", num_stmts, licm.num_loads,
+          licm.num_loops, breakdown);
+    }
+    return licm.num_loops > 0;
+  }
+};
+
+namespace irpass {
+bool loop_invariant_code_motion(IRNode *root, const CompileConfig &config) {
+  TI_AUTO_PROF;
+  return LoopInvariantCodeMotion::run(root, config);
+}
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
@@ -80,15 +80,37 @@ class LowerAccess : public IRVisitor {
     for (auto s = leaf_snode; s != nullptr; s = s->parent)
       snodes.push_front(s);
 
-    Stmt *last = lowered.push_back<GetRootStmt>();
+    Stmt *last = lowered.push_back<GetRootStmt>(snodes[0]);
 
     int path_inc = int(snode_op != SNodeOpType::undefined);
     for (int i = 0; i < (int)snodes.size() - 1 + path_inc; i++) {
       auto snode = snodes[i];
       std::vector<Stmt *> lowered_indices;
       std::vector<int> strides;
+      if (snode->_morton) {
+        // Z-order: each bit of the indices is extracted on its own, and they
+        // are linearized from the highest to the lowest child index bit.
+        std::vector<Stmt *> bits(snode->total_num_bits, nullptr);
+        for (int k_ = 0; k_ < (int)indices.size(); k_++) {
+          const int k = snode->physical_index_position[k_];
+          if (k < 0)
+            continue;
+          const auto &ext = snode->extractors[k];
+          for (int b = 0; b < ext.num_bits; b++) {
+            const int pos = snode->get_child_index_bit(k, b);
+            TI_ASSERT(pos < (int)bits.size() && bits[pos] == nullptr);
+            bits[pos] = lowered.push_back<BitExtractStmt>(
+                indices[k_], ext.start + b, ext.start + b + 1);
+          }
+        }
+        for (int pos = (int)bits.size() - 1; pos >= 0; pos--) {
+          TI_ASSERT(bits[pos] != nullptr);
+          lowered_indices.push_back(bits[pos]);
+          strides.push_back(2);
+        }
+      }
       // extract bits
-      for (int k_ = 0; k_ < (int)indices.size(); k_++) {
+      for (int k_ = 0; k_ < (int)indices.size() && !snode->_morton; k_++) {
         for (int k = 0; k < taichi_max_num_indices; k++) {
           if (snode->physical_index_position[k_] == k) {
             int begin = snode->extractors[k].start;
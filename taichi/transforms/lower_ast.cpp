@@ -208,6 +208,7 @@ class LowerAST : public IRVisitor {
         auto &&new_for = std::make_unique<RangeForStmt>(
             begin->stmt, end->stmt, std::move(stmt->body), stmt->vectorize,
             stmt->parallelize, stmt->block_dim, stmt->strictly_serialized);
+        new_for->unroll = stmt->unroll;
         new_for->body->insert(std::make_unique<LoopIndexStmt>(new_for.get(), 0),
                               0);
         new_for->body->local_var_to_stmt[stmt->loop_var_id[0]] =
@@ -279,6 +280,10 @@ class LowerAST : public IRVisitor {
          * (unless x has index offsets)*/
         offsets = snode->index_offsets;
         snode = snode->parent;
+        // A bit_struct holds one element of each of its members, like its
+        // parent.
+        if (snode->type == SNodeType::bit_struct)
+          snode = snode->parent;
       }
       auto &&new_for = std::make_unique<StructForStmt>(
           snode, std::move(stmt->body), stmt->vectorize, stmt->parallelize,
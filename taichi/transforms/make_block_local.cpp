@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <unordered_set>
+
 #include "taichi/ir/ir.h"
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
@@ -10,15 +13,183 @@ TLANG_NAMESPACE_BEGIN
 
 namespace {
 
+// The BLS buffers of the fields found by find_scatter_fields() take up to this
+// many bytes per block, so that they fit into the shared memory on CUDA.
+constexpr std::size_t kMaxScatterBlsBytes = 48 * 1024;
+
+// The threadgroup memory of a threadgroup on Metal.
+constexpr std::size_t kMetalMaxBlsBytes = 32 * 1024;
+
+// Whether the BLS buffer of |snode| would cover all the cells of the loop
+// block of |offload| at the indices the analysis is given, i.e. |snode| is in
+// that block or in a sibling of it at least as large along each axis. For
+// example, the grid of P2G next to the dynamic SNode of the binned particles.
+bool covers_loop_block(SNode *snode, OffloadedStmt *offload) {
+  auto block = snode->parent;
+  auto loop_block = offload->snode;
+  if (block != loop_block && block->parent != loop_block->parent)
+    return false;
+  for (int i = 0; i < snode->num_active_indices; i++) {
+    auto k = snode->physical_index_position[i];
+    if (loop_block->extractors[k].num_bits > block->extractors[k].num_bits)
+      return false;
+  }
+  return true;
+}
+
+// Finds the fields that the body of the struct-for |offload| only accumulates
+// into, at indices within constant offsets of the loop indices, e.g. the grid
+// of P2G over the particles binned by grid block. Accumulating them in BLS
+// turns the atomics on the same cells into one atomic per cell per block.
+std::vector<SNode *> find_scatter_fields(OffloadedStmt *offload) {
+  std::vector<SNode *> fields;
+  std::unordered_set<SNode *> rejected;
+  auto is_scatter = [&](GlobalPtrStmt *ptr) {
+    auto snode = ptr->snodes[0];
+    if (ptr->width() != 1 || snode->type != SNodeType::place ||
+        !snode->dt->is<PrimitiveType>() || !snode->parent ||
+        (int)ptr->indices.size() != snode->num_active_indices ||
+        !covers_loop_block(snode, offload)) {
+      return false;
+    }
+    for (int i = 0; i < (int)ptr->indices.size(); i++) {
+      if (!irpass::analysis::value_diff_loop_index(ptr->indices[i], offload, i)
+               .linear_related()) {
+        return false;
+      }
+    }
+    return true;
+  };
+  irpass::analysis::gather_statements(offload->body.get(), [&](Stmt *stmt) {
+    if (auto ptr = stmt->cast<GlobalPtrStmt>()) {
+      auto snode = ptr->snodes[0];
+      if (!is_scatter(ptr)) {
+        rejected.insert(snode);
+      } else if (std::find(fields.begin(), fields.end(), snode) ==
+                 fields.end()) {
+        fields.push_back(snode);
+      }
+      return false;
+    }
+    auto atomic = stmt->cast<AtomicOpStmt>();
+    for (auto op : stmt->get_operands()) {
+      if (auto ptr = op ? op->cast<GlobalPtrStmt>() : nullptr) {
+        // Only the destinations of atomic adds, whose results are unused.
+        if (!atomic || atomic->op_type != AtomicOpType::add ||
+            atomic->dest != ptr || atomic->val == ptr) {
+          rejected.insert(ptr->snodes[0]);
+        }
+      } else if (auto op_atomic = op ? op->cast<AtomicOpStmt>() : nullptr) {
+        if (auto dest = op_atomic->dest->cast<GlobalPtrStmt>())
+          rejected.insert(dest->snodes[0]);
+      }
+    }
+    return false;
+  });
+  fields.erase(std::remove_if(fields.begin(), fields.end(),
+                              [&](SNode *snode) {
+                                return rejected.count(snode) != 0;
+                              }),
+               fields.end());
+  return fields;
+}
+
 void make_block_local_offload(OffloadedStmt *offload) {
   if (offload->task_type != OffloadedStmt::TaskType::struct_for)
     return;
 
-  bool debug = offload->get_kernel()->program.config.debug;
+  const auto &config = offload->get_kernel()->program.config;
+  bool debug = config.debug;
+  // On CPU, each thread runs a whole block on its own, and the BLS buffers are
+  // allocated in its thread-local storage, after the TLS variables.
+  const bool bls_in_tls = arch_is_cpu(config.arch);
+
+  std::vector<SNode *> scatter_fields;
+  if (config.make_block_local_scatter &&
+      offload->mem_access_opt
+          .get_snodes_with_flag(SNodeAccessFlag::block_local)
+          .empty()) {
+    scatter_fields = find_scatter_fields(offload);
+    for (auto snode : scatter_fields) {
+      offload->mem_access_opt.add_flag(snode, SNodeAccessFlag::block_local);
+    }
+  }
 
   auto pads = irpass::initialize_scratch_pad(offload);
 
+  // The BLS buffers take the shared memory of a block on CUDA, and the
+  // threadgroup memory of a threadgroup on Metal. 0 means no limit.
+  std::size_t max_bls_bytes = 0;
+  if (config.arch == Arch::cuda && config.cuda_max_bls_bytes > 0) {
+    max_bls_bytes = config.cuda_max_bls_bytes;
+  } else if (config.arch == Arch::metal) {
+    max_bls_bytes = kMetalMaxBlsBytes;
+  }
+
+  if (!scatter_fields.empty()) {
+    // Keep the BLS buffers of the fields found above that fit, in order.
+    const std::size_t max_size =
+        max_bls_bytes > 0 ? std::min(max_bls_bytes, kMaxScatterBlsBytes)
+                          : kMaxScatterBlsBytes;
+    std::size_t size = 0;
+    for (auto snode : scatter_fields) {
+      auto &pad = pads->pads.at(snode);
+      auto dtype_size = data_type_size(snode->dt);
+      auto end = size + (dtype_size - size % dtype_size) % dtype_size +
+                 dtype_size * pad.pad_size_linear();
+      if (end > max_size) {
+        // Its atomics stay on the field.
+        pads->pads.erase(snode);
+      } else {
+        size = end;
+        TI_TRACE("(kernel={}) Accumulating {} in BLS",
+                 offload->get_kernel()->name,
+                 snode->get_node_type_name_hinted());
+      }
+    }
+  }
+
+  if (max_bls_bytes > 0) {
+    // Keep the BLS buffers that fit into the shared memory of a block with
+    // the layout below, in order. The other fields are accessed in global
+    // memory.
+    std::size_t size = 0;
+    std::vector<SNode *> dropped;
+    for (auto &pad : pads->pads) {
+      auto dtype_size = data_type_size(pad.first->dt.ptr_removed());
+      auto end = size + (dtype_size - size % dtype_size) % dtype_size +
+                 dtype_size * pad.second.pad_size_linear();
+      if (end > max_bls_bytes) {
+        dropped.push_back(pad.first);
+      } else {
+        size = end;
+      }
+    }
+    for (auto snode : dropped) {
+      if (config.arch == Arch::cuda) {
+        TI_WARN(
+            "(kernel={}) The BLS buffer of {} does not fit into the {} bytes "
+            "of shared memory per block, see cuda_max_bls_bytes",
+            offload->get_kernel()->name, snode->get_node_type_name_hinted(),
+            max_bls_bytes);
+      } else {
+        TI_WARN(
+            "(kernel={}) The BLS buffer of {} does not fit into the {} bytes "
+            "of threadgroup memory",
+            offload->get_kernel()->name, snode->get_node_type_name_hinted(),
+            max_bls_bytes);
+      }
+      pads->pads.erase(snode);
+    }
+  }
+
   std::size_t bls_offset = 0;
+  if (bls_in_tls && !pads->pads.empty()) {
+    bls_offset = offload->tls_size;
+    // Let one call of the task run the whole block instead of a part of it, so
+    // that the block is fetched to BLS only once.
+    offload->block_dim = offload->snode->max_num_elements();
+  }
 
   for (auto &pad : pads->pads) {
     auto snode = pad.first;
@@ -56,6 +227,35 @@ void make_block_local_offload(OffloadedStmt *offload) {
     // Ensure BLS alignment
     bls_offset += (dtype_size - bls_offset % dtype_size) % dtype_size;
 
+    // Convert bls_element_id to global indices via a series of % and /.
+    auto bls_to_global_indices = [&](Block *element_block,
+                                     Stmt *bls_element_id) {
+      std::vector<Stmt *> global_indices(dim);
+      auto bls_element_id_partial = bls_element_id;
+      for (int i = dim - 1; i >= 0; i--) {
+        auto size = element_block->push_back<ConstStmt>(
+            TypedConstant(pad.second.pad_size[i]));
+
+        auto bls_coord = element_block->push_back<BinaryOpStmt>(
+            BinaryOpType::mod, bls_element_id_partial, size);
+        bls_element_id_partial = element_block->push_back<BinaryOpStmt>(
+            BinaryOpType::div, bls_element_id_partial, size);
+
+        auto global_index = element_block->push_back<BinaryOpStmt>(
+            BinaryOpType::add,
+            element_block->push_back<ConstStmt>(
+                TypedConstant(pad.second.bounds[0][i])),
+            bls_coord);
+
+        global_index = element_block->push_back<BinaryOpStmt>(
+            BinaryOpType::add, global_index,
+            element_block->push_back<BlockCornerIndexStmt>(offload, i));
+
+        global_indices[i] = global_index;
+      }
+      return global_indices;
+    };
+
     // This lambda is used for both BLS prologue and epilogue creation
     auto create_xlogue =
         [&](std::unique_ptr<Block> &block,
@@ -66,6 +266,32 @@ void make_block_local_offload(OffloadedStmt *offload) {
             block = std::make_unique<Block>();
             block->parent_stmt = offload;
           }
+          if (bls_in_tls) {
+            // A single thread fetches the whole BLS buffer in a loop.
+            auto loop = block->push_back<RangeForStmt>(
+                block->push_back<ConstStmt>(TypedConstant(0)),
+                block->push_back<ConstStmt>(TypedConstant(bls_num_elements)),
+                std::make_unique<Block>(), /*vectorize=*/1,
+                /*parallelize=*/1, /*block_dim=*/0,
+                /*strictly_serialized=*/true);
+            auto element_block = loop->as<RangeForStmt>()->body.get();
+            auto bls_element_id =
+                element_block->push_back<LoopIndexStmt>(loop, 0);
+            auto bls_element_offset_bytes =
+                element_block->push_back<BinaryOpStmt>(
+                    BinaryOpType::mul, bls_element_id,
+                    element_block->push_back<ConstStmt>(
+                        TypedConstant(dtype_size)));
+            bls_element_offset_bytes = element_block->push_back<BinaryOpStmt>(
+                BinaryOpType::add, bls_element_offset_bytes,
+                element_block->push_back<ConstStmt>(
+                    TypedConstant((int32)bls_offset)));
+            operation(element_block,
+                      bls_to_global_indices(element_block, bls_element_id),
+                      bls_element_offset_bytes);
+            return;
+          }
+
           Stmt *block_linear_index =
               block->push_back<LoopLinearIndexStmt>(offload);
 
@@ -123,34 +349,10 @@ void make_block_local_offload(OffloadedStmt *offload) {
               element_block = block.get();
             }
 
-            std::vector<Stmt *> global_indices(dim);
-
-            // Convert bls_element_id to global indices
-            // via a series of % and /.
-            auto bls_element_id_partial = bls_element_id_this_iteration;
-            for (int i = dim - 1; i >= 0; i--) {
-              auto size = element_block->push_back<ConstStmt>(
-                  TypedConstant(pad.second.pad_size[i]));
-
-              auto bls_coord = element_block->push_back<BinaryOpStmt>(
-                  BinaryOpType::mod, bls_element_id_partial, size);
-              bls_element_id_partial = element_block->push_back<BinaryOpStmt>(
-                  BinaryOpType::div, bls_element_id_partial, size);
-
-              auto global_index = element_block->push_back<BinaryOpStmt>(
-                  BinaryOpType::add,
-                  element_block->push_back<ConstStmt>(
-                      TypedConstant(pad.second.bounds[0][i])),
-                  bls_coord);
-
-              global_index = element_block->push_back<BinaryOpStmt>(
-                  BinaryOpType::add, global_index,
-                  element_block->push_back<BlockCornerIndexStmt>(offload, i));
-
-              global_indices[i] = global_index;
-            }
-
-            operation(element_block, global_indices, bls_element_offset_bytes);
+            operation(element_block,
+                      bls_to_global_indices(element_block,
+                                            bls_element_id_this_iteration),
+                      bls_element_offset_bytes);
             // TODO: do not use GlobalStore for BLS ptr.
 
             loop_offset += block_dim;
@@ -288,10 +490,20 @@ void make_block_local_offload(OffloadedStmt *offload) {
                 TypeFactory::create_vector_or_scalar_type(1, data_type, true));
             auto bls_val = element_block->push_back<GlobalLoadStmt>(bls_ptr);
 
+            // Skip the cells that the block did not accumulate into, e.g.
+            // the margins of a grid block with few particles.
+            auto nonzero = element_block->push_back<BinaryOpStmt>(
+                BinaryOpType::cmp_ne, bls_val,
+                element_block->push_back<ConstStmt>(
+                    TypedConstant(data_type, 0)));
+            auto if_stmt =
+                element_block->push_back<IfStmt>(nonzero)->as<IfStmt>();
+            if_stmt->set_true_statements(std::make_unique<Block>());
+            auto true_block = if_stmt->true_statements.get();
             auto global_pointer =
-                element_block->push_back<GlobalPtrStmt>(snode, global_indices);
-            element_block->push_back<AtomicOpStmt>(AtomicOpType::add,
-                                                   global_pointer, bls_val);
+                true_block->push_back<GlobalPtrStmt>(snode, global_indices);
+            true_block->push_back<AtomicOpStmt>(AtomicOpType::add,
+                                                global_pointer, bls_val);
           });
     }
 
@@ -299,7 +511,12 @@ void make_block_local_offload(OffloadedStmt *offload) {
     bls_offset += dtype_size * bls_num_elements;
   }
 
-  offload->bls_size = std::max(std::size_t(1), bls_offset);
+  if (bls_in_tls) {
+    if (!pads->pads.empty())
+      offload->tls_size = std::max(offload->tls_size, bls_offset);
+  } else {
+    offload->bls_size = std::max(std::size_t(1), bls_offset);
+  }
 }
 
 }  // namespace
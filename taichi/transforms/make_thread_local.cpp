@@ -8,6 +8,8 @@
 #include "taichi/ir/statements.h"
 #include "taichi/ir/transforms.h"
 #include "taichi/ir/visitors.h"
+#include "taichi/program/kernel.h"
+#include "taichi/program/program.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -17,6 +19,39 @@ bool is_atomic_op_linear(AtomicOpType op_type) {
   return op_type == AtomicOpType::add || op_type == AtomicOpType::sub;
 }
 
+// Indices with the same value in all the iterations, which can be recomputed
+// in the TLS epilogue.
+bool is_loop_invariant_index(Stmt *index) {
+  if (index->is<ConstStmt>())
+    return true;
+  if (auto arg = index->cast<ArgLoadStmt>())
+    return !arg->is_ptr;
+  return false;
+}
+
+// Whether all the elements of |snode| always exist: accumulating zero into one
+// in the TLS epilogue must not activate anything.
+bool is_always_active(SNode *snode) {
+  for (auto *s = snode->parent; s; s = s->parent) {
+    if (s->type != SNodeType::root && s->type != SNodeType::dense)
+      return false;
+  }
+  return true;
+}
+
+// Clones |dest| into |block|, along with its loop-invariant indices.
+Stmt *clone_reduction_destination(Stmt *dest, Block *block) {
+  auto cloned = irpass::analysis::clone(dest);
+  if (auto ptr = cloned->cast<GlobalPtrStmt>()) {
+    for (auto &index : ptr->indices) {
+      index = block->insert(
+          std::unique_ptr<Stmt>((Stmt *)irpass::analysis::clone(index).release()),
+          -1);
+    }
+  }
+  return block->insert(std::unique_ptr<Stmt>((Stmt *)cloned.release()), -1);
+}
+
 // Find the destinations of global atomic reductions that can be demoted into
 // TLS buffer.
 template <typename T>
@@ -85,6 +120,178 @@ std::vector<T *> find_global_reduction_destinations(
   return valid_reduction_values;
 }
 
+// The number of cells of the field of |snode|, a place SNode, or 0 if it
+// cannot be privatized as a whole.
+int64 get_num_cells(SNode *snode) {
+  if (!is_always_active(snode) || !snode->dt->is<PrimitiveType>())
+    return 0;
+  int64 num_cells = 1;
+  for (int i = 0; i < snode->num_active_indices; i++) {
+    num_cells *= snode->shape_along_axis(i);
+  }
+  return num_cells;
+}
+
+// Whether |stmt| is in the loop body of |offload|, not its TLS prologue or
+// epilogue.
+bool is_in_body(Stmt *stmt, OffloadedStmt *offload) {
+  for (auto block = stmt->parent; block; block = block->parent_stmt->parent) {
+    if (block == offload->body.get())
+      return true;
+    if (!block->parent_stmt)
+      break;
+  }
+  return false;
+}
+
+// Gives each thread on the CPU a replica of the small fields that a range-for
+// only accumulates into at varying indices, e.g. histograms or the grid nodes
+// of P2G. They are accumulated in the TLS buffer without atomics, then added
+// to the fields cell by cell in the TLS epilogue. Returns the new TLS size.
+std::size_t make_thread_local_arrays(OffloadedStmt *offload,
+                                     std::size_t tls_offset) {
+  const auto &config = offload->get_kernel()->program.config;
+  if (!arch_is_cpu(config.arch) || config.cpu_max_tls_array_bytes <= 0 ||
+      offload->task_type != OffloadedTaskType::range_for) {
+    return tls_offset;
+  }
+  auto dests = find_global_reduction_destinations<GlobalPtrStmt>(
+      offload, [&](GlobalPtrStmt *dest) {
+        return dest->snodes[0]->type == SNodeType::place &&
+               is_in_body(dest, offload) && !dest->indices.empty() &&
+               (int)dest->indices.size() ==
+                   dest->snodes[0]->num_active_indices &&
+               get_num_cells(dest->snodes[0]) > 0;
+      });
+  // The destinations of each field, in a deterministic order.
+  std::vector<std::pair<SNode *, std::vector<GlobalPtrStmt *>>> fields;
+  for (auto dest : dests) {
+    auto snode = dest->snodes[0];
+    auto it = std::find_if(fields.begin(), fields.end(),
+                           [&](auto &field) { return field.first == snode; });
+    if (it == fields.end()) {
+      fields.emplace_back(snode, std::vector<GlobalPtrStmt *>());
+      it = fields.end() - 1;
+    }
+    it->second.push_back(dest);
+  }
+
+  const std::size_t tls_begin = tls_offset;
+  int64 total_num_cells = 0;
+  for (auto &[snode, ptrs] : fields) {
+    auto data_type = snode->dt;
+    auto dtype_size = data_type_size(data_type);
+    const int64 num_cells = get_num_cells(snode);
+    auto offset = tls_offset + (dtype_size - tls_offset % dtype_size) %
+                                   dtype_size;
+    if (offset + num_cells * dtype_size - tls_begin >
+        (std::size_t)config.cpu_max_tls_array_bytes) {
+      continue;
+    }
+    tls_offset = offset + num_cells * dtype_size;
+    total_num_cells += num_cells;
+    const int dim = snode->num_active_indices;
+    auto ptr_type =
+        TypeFactory::create_vector_or_scalar_type(1, data_type, true);
+
+    // Creates a serial loop over the cells in |block|, and calls |operation|
+    // with the body of the loop, the indices of the cell and its TLS pointer.
+    auto create_xlogue = [&](std::unique_ptr<Block> &block,
+                             const std::function<void(
+                                 Block *, std::vector<Stmt *>, Stmt *)>
+                                 &operation) {
+      if (block == nullptr) {
+        block = std::make_unique<Block>();
+        block->parent_stmt = offload;
+      }
+      auto loop = block->push_back<RangeForStmt>(
+          block->push_back<ConstStmt>(TypedConstant(0)),
+          block->push_back<ConstStmt>(TypedConstant((int32)num_cells)),
+          std::make_unique<Block>(), /*vectorize=*/1,
+          /*parallelize=*/1, /*block_dim=*/0,
+          /*strictly_serialized=*/true);
+      auto cell_block = loop->as<RangeForStmt>()->body.get();
+      Stmt *cell = cell_block->push_back<LoopIndexStmt>(loop, 0);
+      auto bytes = cell_block->push_back<BinaryOpStmt>(
+          BinaryOpType::mul, cell,
+          cell_block->push_back<ConstStmt>(TypedConstant((int32)dtype_size)));
+      bytes = cell_block->push_back<BinaryOpStmt>(
+          BinaryOpType::add, bytes,
+          cell_block->push_back<ConstStmt>(TypedConstant((int32)offset)));
+      auto tls_ptr = cell_block->push_back<BlockLocalPtrStmt>(bytes, ptr_type);
+      std::vector<Stmt *> indices(dim);
+      for (int i = dim - 1; i >= 0; i--) {
+        auto size = cell_block->push_back<ConstStmt>(
+            TypedConstant(snode->shape_along_axis(i)));
+        indices[i] =
+            cell_block->push_back<BinaryOpStmt>(BinaryOpType::mod, cell, size);
+        cell = cell_block->push_back<BinaryOpStmt>(BinaryOpType::div, cell,
+                                                   size);
+      }
+      operation(cell_block, indices, tls_ptr);
+    };
+
+    // Step 1: zero-fill the replica
+    create_xlogue(offload->tls_prologue,
+                  [&](Block *cell_block, std::vector<Stmt *>, Stmt *tls_ptr) {
+                    auto zero = cell_block->push_back<ConstStmt>(
+                        TypedConstant(data_type, 0));
+                    cell_block->push_back<GlobalStoreStmt>(tls_ptr, zero);
+                  });
+
+    // Step 2: accumulate to the replica in the loop body
+    for (auto ptr : ptrs) {
+      VecStatement stmts;
+      Stmt *cell = nullptr;
+      for (int i = 0; i < dim; i++) {
+        if (cell) {
+          cell = stmts.push_back<BinaryOpStmt>(
+              BinaryOpType::mul, cell,
+              stmts.push_back<ConstStmt>(
+                  TypedConstant(snode->shape_along_axis(i))));
+          cell = stmts.push_back<BinaryOpStmt>(BinaryOpType::add, cell,
+                                               ptr->indices[i]);
+        } else {
+          cell = ptr->indices[i];
+        }
+      }
+      auto bytes = stmts.push_back<BinaryOpStmt>(
+          BinaryOpType::mul, cell,
+          stmts.push_back<ConstStmt>(TypedConstant((int32)dtype_size)));
+      bytes = stmts.push_back<BinaryOpStmt>(
+          BinaryOpType::add, bytes,
+          stmts.push_back<ConstStmt>(TypedConstant((int32)offset)));
+      stmts.push_back<BlockLocalPtrStmt>(bytes, ptr_type);
+      ptr->replace_with(std::move(stmts));
+    }
+
+    // Step 3: add the nonzero cells of the replica to the field
+    create_xlogue(
+        offload->tls_epilogue,
+        [&](Block *cell_block, std::vector<Stmt *> indices, Stmt *tls_ptr) {
+          auto value = cell_block->push_back<GlobalLoadStmt>(tls_ptr);
+          auto nonzero = cell_block->push_back<BinaryOpStmt>(
+              BinaryOpType::cmp_ne, value,
+              cell_block->push_back<ConstStmt>(TypedConstant(data_type, 0)));
+          auto if_stmt = cell_block->push_back<IfStmt>(nonzero)->as<IfStmt>();
+          if_stmt->set_true_statements(std::make_unique<Block>());
+          auto true_block = if_stmt->true_statements.get();
+          auto global_ptr =
+              true_block->push_back<GlobalPtrStmt>(snode, indices);
+          true_block->push_back<AtomicOpStmt>(AtomicOpType::add, global_ptr,
+                                              value);
+        });
+  }
+  if (total_num_cells > 0) {
+    // The prologue and the epilogue run once per block of iterations. Make
+    // the blocks large enough to amortize them over the accumulations.
+    constexpr int64 kIterationsPerCell = 2;
+    offload->block_dim = (int)std::max<int64>(
+        offload->block_dim, kIterationsPerCell * total_num_cells);
+  }
+  return tls_offset;
+}
+
 void make_thread_local_offload(OffloadedStmt *offload) {
   if (offload->task_type != OffloadedTaskType::range_for &&
       offload->task_type != OffloadedTaskType::struct_for)
@@ -94,11 +301,14 @@ void make_thread_local_offload(OffloadedStmt *offload) {
   {
     auto valid_global_ptrs = find_global_reduction_destinations<GlobalPtrStmt>(
         offload, [](GlobalPtrStmt *dest) {
-          // We can only optimized reductions to global ptrs with form like
-          // loss[None] (0-D fields) for now.
+          // Reductions to global ptrs with the same address in all the
+          // iterations, e.g. loss[None] (0-D fields) or hist[3].
           // No TLS on CustomInt/FloatType.
           return (dest->snodes[0]->type == SNodeType::place) &&
-                 dest->indices.empty() &&
+                 std::all_of(dest->indices.begin(), dest->indices.end(),
+                             is_loop_invariant_index) &&
+                 (dest->indices.empty() ||
+                  is_always_active(dest->snodes[0])) &&
                  dest->snodes[0]->dt->is<PrimitiveType>();
         });
     auto valid_global_tmps =
@@ -162,10 +372,8 @@ void make_thread_local_offload(OffloadedStmt *offload) {
           TypeFactory::create_vector_or_scalar_type(1, data_type, true));
       // TODO: do not use global load from TLS.
       auto tls_load = offload->tls_epilogue->push_back<GlobalLoadStmt>(tls_ptr);
-      auto global_ptr = offload->tls_epilogue->insert(
-          std::unique_ptr<Stmt>(
-              (Stmt *)irpass::analysis::clone(dest).release()),
-          -1);
+      auto global_ptr =
+          clone_reduction_destination(dest, offload->tls_epilogue.get());
       offload->tls_epilogue->push_back<AtomicOpStmt>(AtomicOpType::add,
                                                      global_ptr, tls_load);
     }
@@ -174,6 +382,8 @@ void make_thread_local_offload(OffloadedStmt *offload) {
     tls_offset += dtype_size;
   }
 
+  tls_offset = make_thread_local_arrays(offload, tls_offset);
+
   offload->tls_size = std::max(std::size_t(1), tls_offset);
 }
 
@@ -118,8 +118,22 @@ class Offloader {
     // task, so we don't need to generate clear/listgen tasks.
     const bool demotable =
         (leaf->is_path_all_dense && program->config.demote_dense_struct_fors);
+    // The struct-for task enumerates the cells of the dense nodes below
+    // |list_snode| itself, see CompileConfig::skip_dense_listgen.
+    auto list_snode = leaf;
+    const auto arch = program->config.arch;
+    if (program->config.skip_dense_listgen &&
+        (arch_is_cpu(arch) || arch == Arch::cuda) &&
+        !program->config.async_mode &&
+        mem_access_opt.get_snodes_with_flag(SNodeAccessFlag::block_local)
+            .empty()) {
+      while (list_snode->type == SNodeType::dense &&
+             list_snode->parent->type == SNodeType::dense) {
+        list_snode = list_snode->parent;
+      }
+    }
     if (!demotable) {
-      for (int i = 1; i < path.size(); i++) {
+      for (int i = 1; i < path.size() && path[i - 1] != list_snode; i++) {
         auto snode_child = path[i];
         auto offloaded_clear_list =
             Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::serial);
@@ -175,6 +189,7 @@ class Offloader {
     }
 
     offloaded_struct_for->snode = for_stmt->snode;
+    offloaded_struct_for->list_snode = list_snode;
     offloaded_struct_for->num_cpu_threads =
         std::min(for_stmt->parallelize, program->config.cpu_max_num_threads);
     offloaded_struct_for->mem_access_opt = mem_access_opt;
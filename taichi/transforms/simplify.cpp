@@ -6,6 +6,7 @@
 #include "taichi/program/kernel.h"
 #include "taichi/program/program.h"
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 
@@ -586,46 +587,71 @@ bool simplify(IRNode *root, Kernel *kernel) {
   return modified;
 }
 
-void full_simplify(IRNode *root, bool after_lower_access, Kernel *kernel) {
+int full_simplify(IRNode *root, bool after_lower_access, Kernel *kernel) {
   TI_AUTO_PROF;
   if (root->get_config().advanced_optimization) {
-    bool first_iteration = true;
+    // |version| counts the modifications to the IR. A pass that left the IR
+    // unchanged is skipped until another pass modifies it, since it would not
+    // modify it either.
+    int version = 0;
+    std::unordered_map<std::string, int> unmodified_version;
+    auto run = [&](const std::string &pass, const auto &func) {
+      auto it = unmodified_version.find(pass);
+      if (it != unmodified_version.end() && it->second == version)
+        return false;
+      if (func()) {
+        version++;
+        return true;
+      }
+      unmodified_version[pass] = version;
+      return false;
+    };
+    int num_iterations = 0;
     while (true) {
+      const bool first_iteration = (num_iterations == 0);
+      num_iterations++;
       bool modified = false;
-      extract_constant(root);
-      if (unreachable_code_elimination(root))
+      // Extracting constants alone does not make another iteration necessary.
+      run("extract_constant", [&] { return extract_constant(root); });
+      if (run("unreachable_code_elimination",
+              [&] { return unreachable_code_elimination(root); }))
         modified = true;
-      if (binary_op_simplify(root))
+      if (run("binary_op_simplify", [&] { return binary_op_simplify(root); }))
         modified = true;
-      if (constant_fold(root))
+      if (run("constant_fold", [&] { return constant_fold(root); }))
         modified = true;
-      if (die(root))
+      if (run("die", [&] { return die(root); }))
         modified = true;
-      if (alg_simp(root))
+      if (run("alg_simp", [&] { return alg_simp(root); }))
         modified = true;
-      if (die(root))
+      if (run("die", [&] { return die(root); }))
         modified = true;
-      if (simplify(root, kernel))
+      if (run("simplify", [&] { return simplify(root, kernel); }))
         modified = true;
-      if (die(root))
+      if (run("die", [&] { return die(root); }))
         modified = true;
       // Don't do these time-consuming optimization passes again if the IR is
       // not modified.
-      if ((first_iteration || modified) && whole_kernel_cse(root))
+      if (run("global_value_numbering",
+              [&] { return global_value_numbering(root); }))
+        modified = true;
+      if ((first_iteration || modified) &&
+          run("whole_kernel_cse", [&] { return whole_kernel_cse(root); }))
         modified = true;
       if ((first_iteration || modified) &&
-          cfg_optimization(root, after_lower_access))
+          run("cfg_optimization",
+              [&] { return cfg_optimization(root, after_lower_access); }))
         modified = true;
-      first_iteration = false;
       if (!modified)
         break;
     }
-    return;
+    return num_iterations;
   }
   constant_fold(root);
   die(root);
   simplify(root, kernel);
   die(root);
+  return 1;
 }
 
 }  // namespace irpass
@@ -0,0 +1,57 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// Replace the loads of the specialized scalar arguments with constants.
+
+class SpecializeArgs : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  DelayedIRModifier modifier;
+  const std::unordered_map<int, TypedConstant> &values;
+
+  explicit SpecializeArgs(const std::unordered_map<int, TypedConstant> &values)
+      : values(values) {
+  }
+
+  void visit(ArgLoadStmt *stmt) override {
+    if (stmt->is_ptr)
+      return;
+    auto it = values.find(stmt->arg_id);
+    if (it == values.end())
+      return;
+    auto constant =
+        Stmt::make<ConstStmt>(LaneAttribute<TypedConstant>(it->second));
+    stmt->replace_with(constant.get());
+    modifier.insert_before(stmt, std::move(constant));
+    modifier.erase(stmt);
+  }
+
+  static bool run(IRNode *node,
+                  const std::unordered_map<int, TypedConstant> &values) {
+    SpecializeArgs pass(values);
+    node->accept(&pass);
+    return pass.modifier.modify_ir();
+  }
+};
+
+}  // namespace
+
+namespace irpass {
+
+bool specialize_args(IRNode *root,
+                     const std::unordered_map<int, TypedConstant> &values) {
+  TI_AUTO_PROF;
+  if (values.empty())
+    return false;
+  return SpecializeArgs::run(root, values);
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
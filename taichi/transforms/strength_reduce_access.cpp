@@ -0,0 +1,155 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Strength Reduction of SNode Accesses
+//
+// lower_access lowers each access into its own chain of bit extractions and
+// multiplications linearizing the indices, so that the neighbors
+// x[i + a, j + b] accessed by a stencil each recompute theirs. For a dense
+// SNode directly under the root, that alone consumes all the bits of the
+// indices, the extractions of the accesses in bounds are the indices
+// themselves. The linearized indices of two accesses then differ by a
+// constant when their indices do, and the lookup of the later one is
+// rewritten to add that constant to the linearized index of the earlier one,
+// which dominates it. The fields placed under the same node share the lookups
+// of the same indices this way. die() removes the extractions left unused.
+class StrengthReduceAccess : public BasicStmtVisitor {
+ private:
+  // An index, as a statement plus a constant.
+  using Index = std::pair<Stmt *, int64>;
+
+  struct Access {
+    LinearizeStmt *linearized;
+    std::vector<Index> indices;
+  };
+
+  // The accesses dominating the current statement by SNode, and the SNodes in
+  // the order of insertion, to leave the blocks.
+  std::unordered_map<SNode *, std::vector<Access>> accesses;
+  std::vector<SNode *> history;
+
+ public:
+  using BasicStmtVisitor::visit;
+  bool modified{false};
+
+  StrengthReduceAccess() {
+    allow_undefined_visitor = true;
+  }
+
+  static Index get_index(Stmt *stmt) {
+    int64 offset = 0;
+    while (true) {
+      if (auto shuffle = stmt->cast<ElementShuffleStmt>()) {
+        if (shuffle->width() == 1 && shuffle->elements[0].index == 0) {
+          stmt = shuffle->elements[0].stmt;
+          continue;
+        }
+      } else if (auto bin = stmt->cast<BinaryOpStmt>()) {
+        auto rhs = bin->rhs->cast<ConstStmt>();
+        if ((bin->op_type == BinaryOpType::add ||
+             bin->op_type == BinaryOpType::sub) &&
+            rhs && rhs->width() == 1 && is_integral(rhs->val[0].dt)) {
+          const auto value = rhs->val[0].val_int();
+          offset += bin->op_type == BinaryOpType::add ? value : -value;
+          stmt = bin->lhs;
+          continue;
+        }
+      }
+      return Index(stmt, offset);
+    }
+  }
+
+  // The indices of |stmt| if its linearized index is made of the indices
+  // themselves, e.g. not for the nodes of hierarchical layouts.
+  static bool get_indices(SNodeLookupStmt *stmt, std::vector<Index> &indices) {
+    auto snode = stmt->snode;
+    if (stmt->width() != 1 || snode->type != SNodeType::dense ||
+        snode->_morton || !snode->parent ||
+        snode->parent->type != SNodeType::root)
+      return false;
+    // The parent is the root, whose lookups all give the same pointer.
+    auto parent = stmt->input_snode->cast<GetChStmt>();
+    if (!parent || !parent->input_ptr->is<SNodeLookupStmt>() ||
+        parent->input_ptr->as<SNodeLookupStmt>()->snode != snode->parent)
+      return false;
+    auto linearized = stmt->input_index->cast<LinearizeStmt>();
+    if (!linearized)
+      return false;
+    for (auto input : linearized->inputs) {
+      auto extract = input->cast<BitExtractStmt>();
+      if (!extract || extract->bit_begin != 0)
+        return false;
+      indices.push_back(get_index(extract->input));
+    }
+    return true;
+  }
+
+  void visit(SNodeLookupStmt *stmt) override {
+    std::vector<Index> indices;
+    if (!get_indices(stmt, indices))
+      return;
+    auto linearized = stmt->input_index->as<LinearizeStmt>();
+    for (auto &access : accesses[stmt->snode]) {
+      if (access.indices.size() != indices.size())
+        continue;
+      // The differences are linearized like the indices, see LinearizeStmt.
+      int64 offset = 0;
+      bool same_bases = true;
+      for (int k = 0; k < (int)indices.size(); k++) {
+        if (indices[k].first != access.indices[k].first) {
+          same_bases = false;
+          break;
+        }
+        offset = offset * linearized->strides[k] + indices[k].second -
+                 access.indices[k].second;
+      }
+      if (!same_bases)
+        continue;
+      if (linearized == access.linearized)
+        return;
+      Stmt *new_index = access.linearized;
+      if (offset != 0) {
+        auto offset_stmt = stmt->insert_before_me(
+            Stmt::make<ConstStmt>(TypedConstant((int32)offset)));
+        new_index = stmt->insert_before_me(Stmt::make<BinaryOpStmt>(
+            BinaryOpType::add, access.linearized, offset_stmt));
+        new_index->ret_type = PrimitiveType::i32;
+      }
+      stmt->replace_operand_with(linearized, new_index);
+      modified = true;
+      return;
+    }
+    accesses[stmt->snode].push_back(Access{linearized, indices});
+    history.push_back(stmt->snode);
+  }
+
+  void visit(Block *stmt_list) override {
+    // The accesses of a block do not dominate the statements after it.
+    const auto num_accesses = history.size();
+    BasicStmtVisitor::visit(stmt_list);
+    while (history.size() > num_accesses) {
+      accesses[history.back()].pop_back();
+      history.pop_back();
+    }
+  }
+
+  static bool run(IRNode *root) {
+    StrengthReduceAccess pass;
+    root->accept(&pass);
+    return pass.modified;
+  }
+};
+
+namespace irpass {
+bool strength_reduce_access(IRNode *root) {
+  TI_AUTO_PROF;
+  return StrengthReduceAccess::run(root);
+}
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,146 @@
+#include "taichi/ir/ir.h"
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// A demoted dense struct-for iterates over the bits of the SNode path: the
+// loop index concatenates the bit fields of the loop variables, so that
+// consecutive iterations traverse the field row by row. This pass permutes the
+// bits of the loop index, so that consecutive iterations traverse one tile of
+// |tile_shape| after the other instead. The permutation is a bijection of
+// [0, 1 << total_bits), so the bound test of the demoted loop remains valid.
+
+using TaskType = OffloadedStmt::TaskType;
+
+bool tile_offload(OffloadedStmt *offloaded,
+                  const std::vector<int> &tile_shape) {
+  // Demoted dense struct-fors are the only range-fors with an SNode.
+  if (offloaded->task_type != TaskType::range_for || !offloaded->snode)
+    return false;
+
+  std::vector<SNode *> snodes;
+  auto *snode = offloaded->snode;
+  int total_bits = 0;
+  while (snode->type != SNodeType::root) {
+    snodes.push_back(snode);
+    total_bits += snode->total_num_bits;
+    snode = snode->parent;
+  }
+  std::reverse(snodes.begin(), snodes.end());
+
+  const int num_loop_vars =
+      snodes.empty() ? 0 : snodes.back()->num_active_indices;
+  if (num_loop_vars < 2 || num_loop_vars != (int)tile_shape.size())
+    return false;
+
+  // position[j][b]: the bit of the loop index holding bit |b| of loop var |j|
+  std::vector<std::vector<int>> position(num_loop_vars);
+  int offset = total_bits;
+  for (auto *s : snodes) {
+    offset -= s->total_num_bits;
+    for (int j = 0; j < num_loop_vars; j++) {
+      const auto p = snodes.back()->physical_index_position[j];
+      const auto &ext = s->extractors[p];
+      auto &pos = position[j];
+      if ((int)pos.size() < ext.start + ext.num_bits)
+        pos.resize(ext.start + ext.num_bits, -1);
+      for (int b = 0; b < ext.num_bits; b++) {
+        pos[ext.start + b] = offset + s->get_child_index_bit(p, b);
+      }
+    }
+  }
+
+  // The lowest bits of the new loop index enumerate the iterations inside a
+  // tile, the last loop var varying fastest. The remaining bits enumerate the
+  // tiles in the original order.
+  std::vector<int> source_bit;
+  std::vector<bool> in_tile(total_bits, false);
+  for (int j = num_loop_vars - 1; j >= 0; j--) {
+    const int tile_bits = (int)bit::log2int(tile_shape[j]);
+    for (int b = 0; b < tile_bits && b < (int)position[j].size(); b++) {
+      if (position[j][b] == -1)
+        break;
+      source_bit.push_back(position[j][b]);
+      in_tile[position[j][b]] = true;
+    }
+  }
+  for (int q = 0; q < total_bits; q++) {
+    if (!in_tile[q])
+      source_bit.push_back(q);
+  }
+
+  bool identity = true;
+  for (int q = 0; q < total_bits; q++) {
+    identity = identity && source_bit[q] == q;
+  }
+  if (identity)
+    return false;
+
+  VecStatement remap;
+  auto new_loop_index = remap.push_back<LoopIndexStmt>(offloaded, 0);
+  Stmt *tiled_index = remap.push_back<ConstStmt>(TypedConstant(0));
+  for (int begin = 0; begin < total_bits;) {
+    // Move the longest run of bits that stay contiguous at once.
+    int end = begin + 1;
+    while (end < total_bits && source_bit[end] == source_bit[end - 1] + 1)
+      end++;
+    Stmt *bits = remap.push_back<BitExtractStmt>(new_loop_index, begin, end);
+    auto multiplier =
+        remap.push_back<ConstStmt>(TypedConstant(1 << source_bit[begin]));
+    bits = remap.push_back<BinaryOpStmt>(BinaryOpType::mul, bits, multiplier);
+    tiled_index = remap.push_back<BinaryOpStmt>(BinaryOpType::add,
+                                                tiled_index, bits);
+    begin = end;
+  }
+
+  auto loop_indices = irpass::analysis::gather_statements(
+      offloaded->body.get(), [&](Stmt *s) {
+        if (auto loop_index = s->cast<LoopIndexStmt>()) {
+          return loop_index->loop == offloaded && loop_index->index == 0;
+        }
+        return false;
+      });
+  for (auto *loop_index : loop_indices) {
+    irpass::replace_all_usages_with(offloaded->body.get(), loop_index,
+                                    tiled_index);
+  }
+  offloaded->body->insert(std::move(remap), 0);
+  return true;
+}
+
+}  // namespace
+
+namespace irpass {
+
+bool tile_dense_loops(IRNode *root, const std::vector<int> &tile_shape) {
+  TI_AUTO_PROF;
+  if (tile_shape.empty())
+    return false;
+  for (int extent : tile_shape) {
+    TI_ERROR_IF(extent <= 0 || !bit::is_power_of_two(extent),
+                "The extents of the loop tiles must be powers of two, got {}",
+                extent);
+  }
+  bool modified = false;
+  if (auto *block = root->cast<Block>()) {
+    for (auto &s_ : block->statements) {
+      if (auto *s = s_->cast<OffloadedStmt>()) {
+        modified = tile_offload(s, tile_shape) || modified;
+      }
+    }
+  } else if (auto *s = root->cast<OffloadedStmt>()) {
+    modified = tile_offload(s, tile_shape);
+  }
+  if (modified)
+    re_id(root);
+  return modified;
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
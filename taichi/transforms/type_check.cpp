@@ -69,6 +69,12 @@ class TypeCheck : public IRVisitor {
       dst_type = cit->get_compute_type();
     } else if (auto cft = dst_type->cast<CustomFloatType>()) {
       dst_type = cft->get_compute_type();
+    } else if (dst_type->is_primitive(PrimitiveTypeID::f16)) {
+      if (stmt->op_type != AtomicOpType::add) {
+        TI_ERROR("[{}] Only atomic add is supported on f16, at {}",
+                 stmt->name(), stmt->tb);
+      }
+      dst_type = dst_type->get_compute_type();
     }
     if (stmt->val->ret_type != dst_type) {
       TI_WARN("[{}] Atomic add ({} to {}) may lose precision, at", stmt->name(),
@@ -164,7 +170,9 @@ class TypeCheck : public IRVisitor {
     if (dst_value_type != stmt->data->ret_type) {
       stmt->data = insert_type_cast_before(stmt, stmt->data, dst_value_type);
     }
-    if (dst_value_type != promoted) {
+    // The f16 fields are meant to store values of their compute type.
+    if (dst_value_type != promoted &&
+        DataType(dst_value_type->get_compute_type()) != promoted) {
       TI_WARN("[{}] Global store may lose precision: {} <- {}, at",
               stmt->name(), stmt->ptr->ret_data_type_name(), input_type);
       TI_WARN("\n{}", stmt->tb);
@@ -191,6 +199,9 @@ class TypeCheck : public IRVisitor {
     stmt->ret_type = stmt->operand->ret_type;
     if (stmt->is_cast()) {
       stmt->ret_type = stmt->cast_type;
+    } else if (stmt->operand->ret_type->is_primitive(PrimitiveTypeID::f16)) {
+      cast(stmt->operand, PrimitiveType::f32);
+      stmt->ret_type = stmt->operand->ret_type;
     }
     if (!is_real(stmt->operand->ret_type)) {
       if (is_trigonometric(stmt->op_type)) {
@@ -269,7 +280,9 @@ class TypeCheck : public IRVisitor {
       stmt->op_type = BinaryOpType::div;
     }
 
-    if (stmt->lhs->ret_type != stmt->rhs->ret_type) {
+    // The f16 operands are computed in f32 by promoted_type().
+    if (stmt->lhs->ret_type != stmt->rhs->ret_type ||
+        stmt->lhs->ret_type->is_primitive(PrimitiveTypeID::f16)) {
       auto promote_custom_int_type = [&](Stmt *stmt, Stmt *hs) {
         if (auto cit = hs->ret_type->cast<CustomIntType>()) {
           return insert_type_cast_before(stmt, hs, cit->get_compute_type());
@@ -355,11 +368,20 @@ class TypeCheck : public IRVisitor {
     // verification, without modifying any types.
     TI_ASSERT(rt != PrimitiveType::unknown);
     TI_ASSERT(rt->vector_width() == 1);
+    // The scalar args are passed in their compute types, see
+    // Kernel::insert_arg().
+    if (!stmt->is_ptr && rt->is_primitive(PrimitiveTypeID::f16)) {
+      stmt->ret_type = PrimitiveType::f32;
+    }
     stmt->ret_type.set_is_pointer(stmt->is_ptr);
   }
 
   void visit(KernelReturnStmt *stmt) {
     // TODO: Support stmt->ret_id?
+    if (stmt->value->ret_type->is_primitive(PrimitiveTypeID::f16)) {
+      stmt->value =
+          insert_type_cast_before(stmt, stmt->value, PrimitiveType::f32);
+    }
     stmt->ret_type = stmt->value->ret_type;
     TI_ASSERT(stmt->ret_type->vector_width() == 1);
   }
@@ -0,0 +1,93 @@
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/ir.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/ir/visitors.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// Whether each iteration of |loop| can be pasted after the previous one: the
+// body has no control flow across iterations, and no loops whose statements
+// refer to the loop they are in, which cloning does not remap.
+bool unrollable(RangeForStmt *loop) {
+  bool ok = true;
+  irpass::analysis::gather_statements(loop->body.get(), [&](Stmt *s) {
+    if (s->is<RangeForStmt>() || s->is<StructForStmt>() ||
+        s->is<WhileStmt>() || s->is<ContinueStmt>() ||
+        s->is<WhileControlStmt>()) {
+      ok = false;
+    }
+    return false;
+  });
+  return ok;
+}
+
+// Replaces |loop| with a copy of its body per iteration, in the order of the
+// iterations, with the loop index replaced by a constant.
+void unroll(RangeForStmt *loop, int32 begin, int32 end) {
+  VecStatement unrolled;
+  for (int32 i = 0; i < end - begin; i++) {
+    const int32 index = loop->reversed ? end - 1 - i : begin + i;
+    auto body = irpass::analysis::clone(loop->body.get());
+    auto block = body->as<Block>();
+    auto loop_indices =
+        irpass::analysis::gather_statements(block, [&](Stmt *s) {
+          auto loop_index = s->cast<LoopIndexStmt>();
+          return loop_index && loop_index->loop == loop;
+        });
+    auto value = unrolled.push_back<ConstStmt>(TypedConstant(index));
+    for (auto loop_index : loop_indices) {
+      irpass::replace_all_usages_with(block, loop_index, value);
+      loop_index->parent->erase(loop_index);
+    }
+    for (auto &stmt : block->statements) {
+      unrolled.push_back(std::move(stmt));
+    }
+  }
+  loop->parent->replace_with(loop, std::move(unrolled),
+                             /*replace_usages=*/false);
+}
+
+}  // namespace
+
+namespace irpass {
+
+bool unroll_loops(IRNode *root, const CompileConfig &config) {
+  // In pre-order, so the inner loops are unrolled first in reverse.
+  auto loops = analysis::gather_statements(
+      root, [](Stmt *s) { return s->is<RangeForStmt>(); });
+  bool modified = false;
+  for (auto it = loops.rbegin(); it != loops.rend(); it++) {
+    auto loop = (*it)->as<RangeForStmt>();
+    auto begin = loop->begin->cast<ConstStmt>();
+    auto end = loop->end->cast<ConstStmt>();
+    if (!begin || !end || loop->unroll == 0)
+      continue;
+    const int32 begin_value = begin->val[0].val_int32();
+    const int32 end_value = std::max(begin_value, end->val[0].val_int32());
+    const int64 num_iterations = (int64)end_value - begin_value;
+    if (loop->unroll > 0) {
+      // The hint of ti.unroll() overrides the budget.
+      if (num_iterations > loop->unroll)
+        continue;
+    } else if (num_iterations *
+                   analysis::count_statements(loop->body.get()) >
+               config.unroll_max_statements) {
+      continue;
+    }
+    if (!unrollable(loop))
+      continue;
+    unroll(loop, begin_value, end_value);
+    modified = true;
+  }
+  if (modified) {
+    type_check(root);
+  }
+  return modified;
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
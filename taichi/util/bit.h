@@ -185,6 +185,8 @@ class Bitset {
   Bitset operator|(const Bitset &other) const;
   Bitset &operator^=(const Bitset &other);
   Bitset operator~() const;
+  bool operator==(const Bitset &other) const;
+  bool operator!=(const Bitset &other) const;
 
   // Find the place of the first "1", or return -1 if it doesn't exist.
   int find_first_one() const;
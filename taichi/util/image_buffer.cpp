@@ -6,6 +6,11 @@
 #include "taichi/math/math.h"
 #include "taichi/math/linalg.h"
 #include "taichi/util/base64.h"
+#include "taichi/system/threading.h"
+
+#if defined(TI_ARCH_x64)
+#include <emmintrin.h>
+#endif
 
 #define STBI_FAILURE_USERMSG
 #define STB_IMAGE_IMPLEMENTATION
@@ -17,6 +22,80 @@
 
 TI_NAMESPACE_BEGIN
 
+namespace {
+
+constexpr int kRowsPerTask = 16;
+
+// Calls |f(begin, end)| on the rows [0, num_rows) in tasks of kRowsPerTask
+// rows, on the threads of a pool shared by all the images.
+template <typename F>
+void parallel_for_rows(int num_rows, const F &f) {
+  const int num_tasks = (num_rows + kRowsPerTask - 1) / kRowsPerTask;
+  if (num_tasks <= 1 || std::thread::hardware_concurrency() <= 1) {
+    f(0, num_rows);
+    return;
+  }
+  struct Task {
+    const F *f;
+    int num_rows;
+
+    static void run(void *context, int t) {
+      auto task = (Task *)context;
+      (*task->f)(t * kRowsPerTask,
+                 std::min((t + 1) * kRowsPerTask, task->num_rows));
+    }
+  };
+  // ThreadPool::run() serializes the images converted at the same time.
+  static ThreadPool pool;
+  Task task{&f, num_rows};
+  pool.run(num_tasks, pool.max_num_threads, &task, &Task::run);
+}
+
+template <typename T>
+void to_rgb8(const T &pixel, uint8 *dest) {
+  for (int k = 0; k < 3; k++) {
+    dest[k] =
+        (uint8)(255.0f * clamp(VectorND<3, real>(pixel)[k], 0.0_f, 1.0_f));
+  }
+}
+
+// Writes pixels |src[0, count)| as RGB bytes to |dest|.
+template <typename T>
+void to_rgb8(const T *src, int count, uint8 *dest) {
+  for (int i = 0; i < count; i++) {
+    to_rgb8(src[i], dest + i * 3);
+  }
+}
+
+#if defined(TI_ARCH_x64) && !defined(TI_USE_DOUBLE)
+// Converts 4 pixels at a time. Clamping before the truncation gives the
+// scalar results, with NaN as 0.
+void to_rgb8(const Vector4f *src, int count, uint8 *dest) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 scale = _mm_set1_ps(255.0f);
+  auto convert = [&](int i) {
+    auto c = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src[i].d), zero), one);
+    return _mm_cvttps_epi32(_mm_mul_ps(c, scale));
+  };
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    auto p01 = _mm_packs_epi32(convert(i), convert(i + 1));
+    auto p23 = _mm_packs_epi32(convert(i + 2), convert(i + 3));
+    alignas(16) uint8 rgba[16];
+    _mm_store_si128((__m128i *)rgba, _mm_packus_epi16(p01, p23));
+    for (int k = 0; k < 4; k++) {
+      std::memcpy(dest + (i + k) * 3, rgba + k * 4, 3);
+    }
+  }
+  for (; i < count; i++) {
+    to_rgb8(src[i], dest + i * 3);
+  }
+}
+#endif
+
+}  // namespace
+
 template <typename T>
 void Array2D<T>::load_image(const std::string &filename, bool linearize) {
   int channels;
@@ -32,26 +111,34 @@ void Array2D<T>::load_image(const std::string &filename, bool linearize) {
                  "Image must have channel 1, 3 or 4: " + filename);
   this->initialize(Vector2i(this->res[0], this->res[1]));
 
-  for (int i = 0; i < this->res[0]; i++) {
-    for (int j = 0; j < this->res[1]; j++) {
-      float32 *pixel_ =
-          data + ((this->res[1] - 1 - j) * this->res[0] + i) * channels;
-      Vector4 pixel;
-      if (channels == 1) {
-        pixel = Vector4(pixel_[0]);
-      } else {
-        pixel = Vector4(pixel_[0], pixel_[1], pixel_[2], pixel_[3]);
-      }
-      if (linearize) {
-        pixel = pixel.pow(2.2f);
+  // Each row of the file is a row j from the top, whose pixels are strided in
+  // |this->data|.
+  const int width = this->res[0], height = this->res[1];
+  parallel_for_rows(height, [&](int row_begin, int row_end) {
+    for (int row = row_begin; row < row_end; row++) {
+      const int j = height - 1 - row;
+      const float32 *src = data + (std::size_t)row * width * channels;
+      for (int i = 0; i < width; i++) {
+        const float32 *pixel_ = src + i * channels;
+        Vector4 pixel;
+        if (channels == 1) {
+          pixel = Vector4(pixel_[0]);
+        } else {
+          pixel = Vector4(pixel_[0], pixel_[1], pixel_[2],
+                          channels == 4 ? pixel_[3] : 1.0f);
+        }
+        if (linearize) {
+          pixel = pixel.pow(2.2f);
+        }
+        auto &dest = this->data[(std::size_t)i * height + j];
+        dest[0] = pixel[0];
+        dest[1] = pixel[1];
+        dest[2] = pixel[2];
+        if (channels == 4 && std::is_same<T, Vector4>::value)
+          dest[3] = pixel[3];
       }
-      (*this)[i][j][0] = pixel[0];
-      (*this)[i][j][1] = pixel[1];
-      (*this)[i][j][2] = pixel[2];
-      if (channels == 4 && std::is_same<T, Vector4>::value)
-        (*this)[i][j][3] = pixel[3];
     }
-  }
+  });
 
   stbi_image_free(data);
 }
@@ -59,19 +146,25 @@ void Array2D<T>::load_image(const std::string &filename, bool linearize) {
 template <typename T>
 void Array2D<T>::write_as_image(const std::string &filename) {
   int comp = 3;
-  std::vector<unsigned char> data(this->res[0] * this->res[1] * comp);
-  for (int i = 0; i < this->res[0]; i++) {
-    for (int j = 0; j < this->res[1]; j++) {
-      for (int k = 0; k < comp; k++) {
-        data[j * this->res[0] * comp + i * comp + k] =
-            (unsigned char)(255.0f *
-                            clamp(VectorND<3, real>(
-                                      this->data[i * this->res[1] +
-                                                 (this->res[1] - j - 1)])[k],
-                                  0.0_f, 1.0_f));
+  const int width = this->res[0], height = this->res[1];
+  std::vector<unsigned char> data((std::size_t)width * height * comp);
+  // A column i of the image is contiguous in |this->data|, from the bottom.
+  // Each task transposes its rows into |rows| a column at a time, then
+  // converts them row by row.
+  parallel_for_rows(height, [&](int row_begin, int row_end) {
+    const int num_rows = row_end - row_begin;
+    std::vector<T> rows((std::size_t)num_rows * width);
+    for (int i = 0; i < width; i++) {
+      const T *column = &this->data[(std::size_t)i * height];
+      for (int r = 0; r < num_rows; r++) {
+        rows[(std::size_t)r * width + i] = column[height - 1 - row_begin - r];
       }
     }
-  }
+    for (int r = 0; r < num_rows; r++) {
+      to_rgb8(&rows[(std::size_t)r * width], width,
+              &data[(std::size_t)(row_begin + r) * width * comp]);
+    }
+  });
   TI_ASSERT(filename.size() >= 5);
   int write_result = 0;
   std::string suffix = filename.substr(filename.size() - 4);
@@ -96,17 +189,14 @@ void Array2D<T>::write_as_image(const std::string &filename) {
 std::map<std::string, stbtt_fontinfo> fonts;
 std::map<std::string, std::vector<uint8>> font_buffers;
 
-template <typename T>
-void Array2D<T>::write_text(const std::string &font_fn,
-                            const std::string &content_,
-                            real size,
-                            int dx,
-                            int dy,
-                            T color) {
-  std::vector<unsigned char> screen_buffer(
-      (size_t)(this->res[0] * this->res[1]), (unsigned char)0);
+std::vector<unsigned char> render_text(const std::string &font_fn,
+                                       const std::string &content_,
+                                       real size,
+                                       Vector2i res) {
+  std::vector<unsigned char> screen_buffer((size_t)(res[0] * res[1]),
+                                           (unsigned char)0);
 
-  int i, j, ascent, baseline, ch = 0;
+  int ascent, baseline, ch = 0;
   float xpos = 2;  // leave a little padding in case the character extends left
 
   stbtt_fontinfo font;
@@ -142,9 +232,8 @@ void Array2D<T>::write_text(const std::string &font_fn,
     stbtt_GetCodepointBitmapBoxSubpixel(&font, content[ch], scale, scale,
                                         x_shift, 0, &x0, &y0, &x1, &y1);
     stbtt_MakeCodepointBitmapSubpixel(
-        &font,
-        &screen_buffer[0] + this->res[0] * (baseline + y0) + (int)xpos + x0,
-        x1 - x0, y1 - y0, this->res[0], scale, scale, x_shift, 0, content[ch]);
+        &font, &screen_buffer[0] + res[0] * (baseline + y0) + (int)xpos + x0,
+        x1 - x0, y1 - y0, res[0], scale, scale, x_shift, 0, content[ch]);
     // note that this stomps the old data, so where character boxes overlap
     // (e.g. 'lj') it's wrong
     xpos += (advance * scale);
@@ -153,8 +242,19 @@ void Array2D<T>::write_text(const std::string &font_fn,
                                                     content[ch + 1]);
     ++ch;
   }
-  for (j = 0; j < this->res[1]; ++j) {
-    for (i = 0; i < this->res[0]; ++i) {
+  return screen_buffer;
+}
+
+template <typename T>
+void Array2D<T>::write_text(const std::string &font_fn,
+                            const std::string &content_,
+                            real size,
+                            int dx,
+                            int dy,
+                            T color) {
+  auto screen_buffer = render_text(font_fn, content_, size, this->res);
+  for (int j = 0; j < this->res[1]; ++j) {
+    for (int i = 0; i < this->res[0]; ++i) {
       int x = dx + i, y = dy + j - this->res[1];
       auto index = ((this->res[1] - j - 1) * this->res[0] + i);
       real alpha = screen_buffer[index] / 255.0f;
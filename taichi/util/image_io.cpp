@@ -1,32 +1,51 @@
 #include "taichi/common/core.h"
 #include "taichi/util/image_io.h"
 
+#include "taichi/system/threading.h"
+
 #include "stb_image.h"
 #include "stb_image_write.h"
 
 TI_NAMESPACE_BEGIN
 
-void imwrite(const std::string &filename,
-             size_t ptr,
-             int resx,
-             int resy,
-             int comp) {
-  void *data = (void *)ptr;
+namespace {
+
+std::string image_suffix(const std::string &filename) {
   TI_ASSERT_INFO(filename.size() >= 5, "Bad image file name");
-  int result = 0;
   std::string suffix = filename.substr(filename.size() - 4);
+  if (suffix != ".png" && suffix != ".bmp" && suffix != ".jpg") {
+    TI_ERROR("Unknown image file suffix {}", suffix);
+  }
+  return suffix;
+}
+
+// Returns false if the file could not be written.
+bool write_image(const std::string &filename,
+                 const void *data,
+                 int resx,
+                 int resy,
+                 int comp) {
+  std::string suffix = image_suffix(filename);
+  int result = 0;
   if (suffix == ".png") {
     result =
         stbi_write_png(filename.c_str(), resx, resy, comp, data, comp * resx);
   } else if (suffix == ".bmp") {
     result = stbi_write_bmp(filename.c_str(), resx, resy, comp, data);
-  } else if (suffix == ".jpg") {
-    result = stbi_write_jpg(filename.c_str(), resx, resy, comp, data, 95);
   } else {
-    TI_ERROR("Unknown image file suffix {}", suffix);
+    result = stbi_write_jpg(filename.c_str(), resx, resy, comp, data, 95);
   }
+  return result != 0;
+}
 
-  if (!result) {
+}  // namespace
+
+void imwrite(const std::string &filename,
+             size_t ptr,
+             int resx,
+             int resy,
+             int comp) {
+  if (!write_image(filename, (void *)ptr, resx, resy, comp)) {
     TI_ERROR("Cannot write image file [{}]", filename);
   }
   TI_TRACE("saved image {}: {}x{}x{}", filename, resx, resy, comp);
@@ -45,4 +64,220 @@ std::vector<size_t> imread(const std::string &filename, int comp) {
   return ret;
 }
 
+std::vector<int> imread_info(const std::string &filename) {
+  int resx = 0, resy = 0, comp = 0;
+  if (!stbi_info(filename.c_str(), &resx, &resy, &comp)) {
+    TI_ERROR("Cannot read image file [{}]", filename);
+  }
+  return {resx, resy, comp};
+}
+
+namespace {
+
+struct ImreadBatchTask {
+  const std::vector<std::string> *filenames;
+  uint8 *data;
+  int resx, resy, comp;
+  std::mutex mut;
+  // The first file that could not be decoded, and why.
+  std::string failure;
+
+  static void run(void *context, int k) {
+    auto task = (ImreadBatchTask *)context;
+    task->decode(k);
+  }
+
+  void decode(int k) {
+    auto &filename = (*filenames)[k];
+    int x = 0, y = 0, c = 0;
+    auto image = stbi_load(filename.c_str(), &x, &y, &c, comp);
+    if (!image || x != resx || y != resy) {
+      std::lock_guard<std::mutex> _(mut);
+      if (failure.empty()) {
+        failure = image ? fmt::format("[{}] is {}x{} instead of {}x{}",
+                                      filename, x, y, resx, resy)
+                        : fmt::format("Cannot read image file [{}]", filename);
+      }
+      stbi_image_free(image);
+      return;
+    }
+    // Transposes the rows from the top of the file into columns from the
+    // bottom, while copying out of the buffer of stb.
+    auto dest = data + (std::size_t)k * resx * resy * comp;
+    for (int row = 0; row < resy; row++) {
+      auto src = image + (std::size_t)row * resx * comp;
+      for (int i = 0; i < resx; i++) {
+        auto d = dest + ((std::size_t)i * resy + resy - 1 - row) * comp;
+        for (int j = 0; j < comp; j++) {
+          d[j] = src[i * comp + j];
+        }
+      }
+    }
+    stbi_image_free(image);
+  }
+};
+
+}  // namespace
+
+void imread_batch(const std::vector<std::string> &filenames,
+                  size_t ptr,
+                  int resx,
+                  int resy,
+                  int comp,
+                  int num_threads) {
+  TI_ASSERT(1 <= comp && comp <= 4);
+  if (filenames.empty()) {
+    return;
+  }
+  static ThreadPool pool;
+  // The pool runs one batch at a time.
+  static std::mutex pool_mut;
+  if (num_threads <= 0) {
+    num_threads = pool.max_num_threads;
+  }
+  ImreadBatchTask task;
+  task.filenames = &filenames;
+  task.data = (uint8 *)ptr;
+  task.resx = resx;
+  task.resy = resy;
+  task.comp = comp;
+  {
+    std::lock_guard<std::mutex> _(pool_mut);
+    pool.run((int)filenames.size(), std::min(num_threads, pool.max_num_threads),
+             &task, &ImreadBatchTask::run);
+  }
+  if (!task.failure.empty()) {
+    TI_ERROR("{}", task.failure);
+  }
+  TI_TRACE("loaded {} images: {}x{}x{}", filenames.size(), resx, resy, comp);
+}
+
+FrameWriter::FrameWriter(int num_threads, int max_queued_frames)
+    : max_queued_frames(max_queued_frames) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+  }
+  start(num_threads);
+}
+
+FrameWriter::FrameWriter(const std::string &command, int max_queued_frames)
+    : max_queued_frames(max_queued_frames), command(command) {
+#if defined(TI_PLATFORM_WINDOWS)
+  pipe = _popen(command.c_str(), "wb");
+#else
+  pipe = popen(command.c_str(), "w");
+#endif
+  if (!pipe) {
+    TI_ERROR("Cannot run [{}]", command);
+  }
+  // The frames must reach the command in order.
+  start(1);
+}
+
+void FrameWriter::start(int num_threads) {
+  TI_ASSERT(max_queued_frames >= 1);
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([this] { work(); });
+  }
+}
+
+void FrameWriter::write(const std::string &filename,
+                        size_t ptr,
+                        int resx,
+                        int resy,
+                        int comp) {
+  std::size_t size = (std::size_t)resx * resy * comp;
+  if (pipe) {
+    if (frame_size == 0) {
+      frame_size = size;
+    }
+    TI_ERROR_IF(size != frame_size,
+                "The frames written to [{}] must all have the same size",
+                command);
+  } else {
+    image_suffix(filename);
+  }
+  // Copies the frame before waiting, so that only this thread blocks on the
+  // queue.
+  Frame frame{filename, std::vector<uint8>((uint8 *)ptr, (uint8 *)ptr + size),
+              resx, resy, comp};
+  {
+    std::unique_lock<std::mutex> lock(mut);
+    frame_taken.wait(
+        lock, [&] { return (int)queue.size() < max_queued_frames; });
+    queue.push_back(std::move(frame));
+  }
+  frame_queued.notify_one();
+}
+
+void FrameWriter::work() {
+  while (true) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(mut);
+      frame_queued.wait(lock, [&] { return stopping || !queue.empty(); });
+      if (queue.empty()) {
+        return;
+      }
+      frame = std::move(queue.front());
+      queue.pop_front();
+      num_busy++;
+    }
+    frame_taken.notify_one();
+    bool written;
+    if (pipe) {
+      written = std::fwrite(frame.data.data(), 1, frame.data.size(), pipe) ==
+                frame.data.size();
+    } else {
+      written = write_image(frame.filename, frame.data.data(), frame.resx,
+                            frame.resy, frame.comp);
+    }
+    {
+      std::lock_guard<std::mutex> _(mut);
+      num_busy--;
+      if (!written && failure.empty()) {
+        failure = pipe ? command : frame.filename;
+      }
+    }
+    frame_done.notify_all();
+  }
+}
+
+void FrameWriter::flush() {
+  std::string failed;
+  {
+    std::unique_lock<std::mutex> lock(mut);
+    frame_done.wait(lock, [&] { return queue.empty() && num_busy == 0; });
+    std::swap(failed, failure);
+  }
+  if (pipe) {
+    std::fflush(pipe);
+  }
+  if (!failed.empty()) {
+    TI_ERROR("Cannot write frame to [{}]", failed);
+  }
+}
+
+FrameWriter::~FrameWriter() {
+  {
+    std::lock_guard<std::mutex> _(mut);
+    stopping = true;
+  }
+  // The threads write out the remaining frames before they exit.
+  frame_queued.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (!failure.empty()) {
+    TI_WARN("Cannot write frame to [{}]", failure);
+  }
+  if (pipe) {
+#if defined(TI_PLATFORM_WINDOWS)
+    _pclose(pipe);
+#else
+    pclose(pipe);
+#endif
+  }
+}
+
 TI_NAMESPACE_END
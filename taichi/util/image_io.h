@@ -1,6 +1,11 @@
 #pragma once
 
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 TI_NAMESPACE_BEGIN
@@ -10,4 +15,72 @@ void imwrite(const std::string &filename,
              int resy,
              int comp);
 std::vector<size_t> imread(const std::string &filename, int comp);
+
+// The resx, resy and number of channels of an image file, without decoding it.
+std::vector<int> imread_info(const std::string &filename);
+
+// Decodes the image files |filenames|, all |resx| x |resy|, with |comp|
+// channels into the buffer at |ptr|, on |num_threads| threads (all the hardware
+// threads if 0). Image k takes resx * resy * comp bytes from
+// ptr + k * resx * resy * comp, in which pixel (x, y) from the bottom left is at
+// (x * resy + y) * comp, as the arrays returned by ti.imread.
+void imread_batch(const std::vector<std::string> &filenames,
+                  size_t ptr,
+                  int resx,
+                  int resy,
+                  int comp,
+                  int num_threads);
+
+// Writes frames on background threads, so that the thread producing them only
+// copies each frame. At most |max_queued_frames| frames wait to be written,
+// beyond which write() blocks until one is taken.
+class FrameWriter {
+ public:
+  // Encodes each frame into its own image file, as imwrite() does, on
+  // |num_threads| threads (all the hardware threads if 0).
+  FrameWriter(int num_threads, int max_queued_frames);
+
+  // Writes the pixels of the frames in order to the standard input of
+  // |command|, e.g. ffmpeg reading rawvideo. The frames must all have the
+  // same size.
+  FrameWriter(const std::string &command, int max_queued_frames);
+
+  // |filename| is ignored when writing to a command.
+  void write(const std::string &filename,
+             size_t ptr,
+             int resx,
+             int resy,
+             int comp);
+
+  // Waits until the frames written so far are written out, and reports the
+  // first frame that could not be.
+  void flush();
+
+  ~FrameWriter();
+
+ private:
+  struct Frame {
+    std::string filename;
+    std::vector<uint8> data;
+    int resx, resy, comp;
+  };
+
+  void start(int num_threads);
+
+  void work();
+
+  int max_queued_frames;
+  std::string command;
+  FILE *pipe{nullptr};
+  std::size_t frame_size{0};
+
+  std::mutex mut;
+  std::condition_variable frame_queued, frame_taken, frame_done;
+  std::deque<Frame> queue;
+  int num_busy{0};
+  bool stopping{false};
+  std::string failure;
+  std::vector<std::thread> threads;
+};
+
 TI_NAMESPACE_END
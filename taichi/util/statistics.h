@@ -1,3 +1,4 @@
+#include <mutex>
 #include <unordered_map>
 
 #include "taichi/common/core.h"
@@ -22,6 +23,8 @@ class Statistics {
   }
 
  private:
+  // The host threads launching kernels add to the counters concurrently.
+  std::mutex mut_;
   counters_map counters_;
 };
 
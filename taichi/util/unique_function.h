@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "taichi/common/core.h"
+
+TI_NAMESPACE_BEGIN
+
+// A move-only std::function<void()>. Callables of up to |kInlineSize| bytes
+// are stored in place instead of on the heap, so that passing small lambdas
+// around does not allocate.
+class UniqueFunction {
+ public:
+  static constexpr std::size_t kInlineSize = 48;
+
+  UniqueFunction() = default;
+
+  template <typename F,
+            typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<F>, UniqueFunction>>>
+  UniqueFunction(F &&f) {
+    using T = std::decay_t<F>;
+    if constexpr (fits_inline<T>()) {
+      new (storage_) T(std::forward<F>(f));
+      ops_ = &kInlineOps<T>;
+    } else {
+      *reinterpret_cast<T **>(storage_) = new T(std::forward<F>(f));
+      ops_ = &kHeapOps<T>;
+    }
+  }
+
+  UniqueFunction(UniqueFunction &&other) noexcept {
+    move_from(other);
+  }
+
+  UniqueFunction &operator=(UniqueFunction &&other) noexcept {
+    if (this != &other) {
+      reset();
+      move_from(other);
+    }
+    return *this;
+  }
+
+  UniqueFunction(const UniqueFunction &) = delete;
+  UniqueFunction &operator=(const UniqueFunction &) = delete;
+
+  ~UniqueFunction() {
+    reset();
+  }
+
+  void operator()() {
+    TI_ASSERT(ops_);
+    ops_->call(storage_);
+  }
+
+  explicit operator bool() const {
+    return ops_ != nullptr;
+  }
+
+  void reset() {
+    if (ops_) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  struct Ops {
+    void (*call)(void *storage);
+    // Move-constructs the callable of |src| into |dst|, and destroys the one
+    // left in |src|.
+    void (*relocate)(void *dst, void *src);
+    void (*destroy)(void *storage);
+  };
+
+  template <typename T>
+  static constexpr bool fits_inline() {
+    return sizeof(T) <= kInlineSize &&
+           alignof(T) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible_v<T>;
+  }
+
+  template <typename T>
+  static constexpr Ops kInlineOps = {
+      [](void *s) { (*static_cast<T *>(s))(); },
+      [](void *dst, void *src) {
+        new (dst) T(std::move(*static_cast<T *>(src)));
+        static_cast<T *>(src)->~T();
+      },
+      [](void *s) { static_cast<T *>(s)->~T(); }};
+
+  template <typename T>
+  static constexpr Ops kHeapOps = {
+      [](void *s) { (**static_cast<T **>(s))(); },
+      [](void *dst, void *src) {
+        *static_cast<T **>(dst) = *static_cast<T **>(src);
+      },
+      [](void *s) { delete *static_cast<T **>(s); }};
+
+  void move_from(UniqueFunction &other) {
+    if (other.ops_) {
+      other.ops_->relocate(storage_, other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops *ops_{nullptr};
+};
+
+TI_NAMESPACE_END
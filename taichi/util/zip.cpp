@@ -10,6 +10,8 @@
 #endif
 #endif
 
+// The zlib names of miniz are macros, which would rename zip::compress().
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
 #include "miniz.h"
 
 TI_NAMESPACE_BEGIN
@@ -109,6 +111,26 @@ std::vector<uint8> read(const std::string fn, bool verbose) {
   return ret;
 }
 
+std::vector<uint8> compress(const uint8 *data, std::size_t len, int level) {
+  auto size = mz_compressBound((mz_ulong)len);
+  std::vector<uint8> ret(size);
+  auto status = mz_compress2(ret.data(), &size, data, (mz_ulong)len, level);
+  if (status != MZ_OK) {
+    TI_ERROR("mz_compress2() failed: {}", mz_error(status));
+  }
+  ret.resize(size);
+  return ret;
+}
+
+bool decompress(const uint8 *data,
+                std::size_t len,
+                uint8 *dest,
+                std::size_t dest_len) {
+  auto size = (mz_ulong)dest_len;
+  return mz_uncompress(dest, &size, data, (mz_ulong)len) == MZ_OK &&
+         size == dest_len;
+}
+
 }  // namespace zip
 
 TI_NAMESPACE_END
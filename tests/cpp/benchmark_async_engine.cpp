@@ -0,0 +1,231 @@
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "taichi/ir/frontend.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/program/async_engine.h"
+#include "taichi/program/state_flow_graph.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Measures the async engine on synthesized task streams, without the Python
+// frontend. Each task is a range-for over a field, which optionally reads
+// another field.
+//
+// Environment variables:
+//   TI_BENCHMARK_ASYNC_NUM_TASKS: the number of tasks per stream (512).
+//   TI_BENCHMARK_ASYNC_OUTPUT: a file to write the results to.
+//   TI_BENCHMARK_ASYNC_BASELINE: a file written by an earlier run. The results
+//     more than 20% slower than it are reported.
+
+namespace {
+
+constexpr int kNumFields = 8;
+constexpr int kFieldSize = 1024;
+
+int get_env_int(const char *name, int default_value) {
+  auto *value = std::getenv(name);
+  return value ? std::atoi(value) : default_value;
+}
+
+// Writes |src| + 1, or 1, to |dst|.
+std::unique_ptr<OffloadedStmt> make_task(Kernel *kernel,
+                                         SNode *dst,
+                                         SNode *src) {
+  auto &config = kernel->program.config;
+  auto task =
+      Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::range_for);
+  task->kernel = kernel;
+  task->const_begin = task->const_end = true;
+  task->begin_value = 0;
+  task->end_value = kFieldSize;
+  task->grid_dim = config.saturating_grid_dim;
+  task->block_dim = kernel->program.default_block_dim();
+  task->num_cpu_threads = config.cpu_max_num_threads;
+
+  auto *body = task->body.get();
+  auto *index = body->push_back<LoopIndexStmt>(task.get(), 0);
+  Stmt *value = body->push_back<ConstStmt>(TypedConstant(1));
+  if (src) {
+    auto *src_ptr = body->push_back<GlobalPtrStmt>(
+        LaneAttribute<SNode *>(src), std::vector<Stmt *>{index});
+    auto *load = body->push_back<GlobalLoadStmt>(src_ptr);
+    value = body->push_back<BinaryOpStmt>(BinaryOpType::add, load, value);
+  }
+  auto *dst_ptr = body->push_back<GlobalPtrStmt>(LaneAttribute<SNode *>(dst),
+                                                 std::vector<Stmt *>{index});
+  body->push_back<GlobalStoreStmt>(dst_ptr, value);
+  irpass::type_check(task.get());
+  irpass::re_id(task.get());
+  return task;
+}
+
+class AsyncEngineBenchmark {
+ public:
+  // The dependency shapes of the task streams:
+  //   independent: each task writes a field without reading.
+  //   chain: each task reads the field the previous task wrote.
+  //   random: each task reads and writes random fields.
+  enum class Shape { independent, chain, random };
+
+  explicit AsyncEngineBenchmark(int num_tasks) : num_tasks_(num_tasks) {
+    prog_ = std::make_unique<Program>(host_arch());
+    for (int i = 0; i < kNumFields; i++) {
+      auto x = global_new(PrimitiveType::i32, fmt::format("x{}", i));
+      prog_->snode_root->dense(Index(0), kFieldSize).place(x, {});
+      fields_.push_back(x.snode());
+    }
+    prog_->materialize_layout();
+    kernel_ = &prog_->kernel([]() {}, "benchmark_task");
+  }
+
+  // Returns the time of each step per task, in microseconds.
+  std::vector<std::pair<std::string, double>> run(Shape shape,
+                                                  const std::string &name) {
+    AsyncEngine engine(prog_.get(), [this](Kernel &kernel,
+                                           OffloadedStmt *offloaded) {
+      return prog_->compile_to_backend_executable(kernel, offloaded);
+    });
+    auto records = make_records(shape);
+    auto *sfg = engine.sfg.get();
+    std::vector<std::pair<std::string, double>> results;
+    auto add_result = [&](const std::string &step, double t) {
+      results.emplace_back(name + "." + step, t * 1e6 / num_tasks_);
+    };
+
+    auto t = Time::get_time();
+    sfg->insert_tasks(records, /*filter_listgen=*/true);
+    add_result("insert_tasks", Time::get_time() - t);
+
+    constexpr int kNumRebuilds = 10;
+    t = Time::get_time();
+    for (int i = 0; i < kNumRebuilds; i++) {
+      sfg->rebuild_graph(/*sort=*/false);
+    }
+    add_result("rebuild_graph", (Time::get_time() - t) / kNumRebuilds);
+
+    t = Time::get_time();
+    sfg->fuse();
+    add_result("fuse", Time::get_time() - t);
+
+    std::vector<std::vector<int>> deps;
+    t = Time::get_time();
+    auto tasks = sfg->extract_to_execute(&deps);
+    add_result("extract_to_execute", Time::get_time() - t);
+    TI_CHECK(!tasks.empty());
+    TI_CHECK(tasks.size() <= records.size());
+
+    // The unfused tasks, compiled in the first round.
+    std::vector<std::vector<int>> chain_deps(records.size());
+    for (int i = 1; i < (int)records.size(); i++) {
+      chain_deps[i].push_back(i - 1);
+    }
+    for (int round = 0; round < 2; round++) {
+      t = Time::get_time();
+      for (int i = 0; i < (int)records.size(); i++) {
+        engine.queue.enqueue(records[i], chain_deps[i]);
+      }
+      engine.queue.synchronize();
+      if (round == 1)
+        add_result("execution_queue", Time::get_time() - t);
+    }
+    return results;
+  }
+
+ private:
+  std::vector<TaskLaunchRecord> make_records(Shape shape) {
+    Kernel::LaunchContextBuilder ctx_builder(kernel_);
+    auto &context = ctx_builder.get_context();
+    std::mt19937 rng(0);
+    std::vector<TaskLaunchRecord> records;
+    for (int i = 0; i < num_tasks_; i++) {
+      int dst = i % kNumFields, src = -1;
+      if (shape == Shape::chain) {
+        dst = (i + 1) % kNumFields;
+        src = i % kNumFields;
+      } else if (shape == Shape::random) {
+        dst = rng() % kNumFields;
+        src = rng() % kNumFields;
+      }
+      records.emplace_back(context, kernel_, get_task(dst, src));
+    }
+    return records;
+  }
+
+  IRHandle get_task(int dst, int src) {
+    auto &handle = tasks_[dst * (kNumFields + 1) + src + 1];
+    if (handle.empty()) {
+      auto task = make_task(kernel_, fields_[dst],
+                            src == -1 ? nullptr : fields_[src]);
+      handle = IRHandle(task.get(), ir_bank_.get_hash(task.get()));
+      ir_bank_.insert(std::move(task), handle.hash());
+    }
+    return handle;
+  }
+
+  int num_tasks_;
+  std::unique_ptr<Program> prog_;
+  std::vector<SNode *> fields_;
+  Kernel *kernel_;
+  // Owns the task templates.
+  IRBank ir_bank_;
+  std::unordered_map<int, IRHandle> tasks_;
+};
+
+std::unordered_map<std::string, double> read_results(const std::string &fn) {
+  std::unordered_map<std::string, double> results;
+  std::ifstream fs(fn);
+  std::string name;
+  double t;
+  while (fs >> name >> t) {
+    results[name] = t;
+  }
+  return results;
+}
+
+}  // namespace
+
+TI_TEST("benchmark_async_engine") {
+  const int num_tasks = get_env_int("TI_BENCHMARK_ASYNC_NUM_TASKS", 512);
+  AsyncEngineBenchmark benchmark(num_tasks);
+  using Shape = AsyncEngineBenchmark::Shape;
+  std::vector<std::pair<std::string, double>> results;
+  for (auto [shape, name] :
+       {std::make_pair(Shape::independent, "independent"),
+        std::make_pair(Shape::chain, "chain"),
+        std::make_pair(Shape::random, "random")}) {
+    auto r = benchmark.run(shape, name);
+    results.insert(results.end(), r.begin(), r.end());
+  }
+
+  std::unordered_map<std::string, double> baseline;
+  if (auto *fn = std::getenv("TI_BENCHMARK_ASYNC_BASELINE")) {
+    baseline = read_results(fn);
+  }
+  for (auto &[name, t] : results) {
+    auto iter = baseline.find(name);
+    if (iter == baseline.end()) {
+      TI_INFO("{:<32} {:10.3f} us/task", name, t);
+    } else if (t > iter->second * 1.2) {
+      TI_WARN("{:<32} {:10.3f} us/task (baseline {:.3f}, regressed)", name, t,
+              iter->second);
+    } else {
+      TI_INFO("{:<32} {:10.3f} us/task (baseline {:.3f})", name, t,
+              iter->second);
+    }
+  }
+  if (auto *fn = std::getenv("TI_BENCHMARK_ASYNC_OUTPUT")) {
+    std::ofstream fs(fn);
+    for (auto &[name, t] : results) {
+      fs << name << " " << t << std::endl;
+    }
+  }
+}
+
+TLANG_NAMESPACE_END
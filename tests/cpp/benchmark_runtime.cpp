@@ -0,0 +1,205 @@
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+#include "taichi/ir/frontend.h"
+#include "taichi/system/benchmark.h"
+#include "taichi/system/threading.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Measures the runtime primitives through small kernels on the host arch,
+// in nanoseconds per element, with the Benchmark unit.
+//
+// Environment variables:
+//   TI_BENCHMARK_RUNTIME_OUTPUT: a JSON file to write the results to.
+//   TI_BENCHMARK_RUNTIME_BASELINE: a JSON file written by an earlier run. The
+//     results more than 20% slower than it are reported.
+
+namespace {
+
+constexpr int kNumElements = 1 << 16;
+
+// Times |iterate|, which processes |workload| elements per call.
+class FunctionBenchmark : public Benchmark {
+ public:
+  FunctionBenchmark(int64 workload, std::function<void()> iterate)
+      : iterate_(std::move(iterate)) {
+    Config config;
+    config.set("workload", workload);
+    config.set("returns_time", true);
+    config.set("warm_up_iterations", 4);
+    initialize(config);
+  }
+
+ protected:
+  void iterate() override {
+    iterate_();
+  }
+
+ private:
+  std::function<void()> iterate_;
+};
+
+class RuntimeBenchmark {
+ public:
+  RuntimeBenchmark() {
+    prog_ = std::make_unique<Program>(host_arch());
+    auto &root = *prog_->snode_root;
+    x_ = global_new(PrimitiveType::i32, "x");
+    pointer_ = &root.pointer(Index(0), kNumElements);
+    pointer_->place(x_, {});
+    y_ = global_new(PrimitiveType::i32, "y");
+    dynamic_ = &root.dynamic(Index(0), kNumElements, 1024);
+    dynamic_->place(y_, {});
+    prog_->materialize_layout();
+  }
+
+  std::vector<std::pair<std::string, double>> run() {
+    const int N = kNumElements;
+    auto *pointer = pointer_;
+    auto *dynamic = dynamic_;
+    auto x = x_;
+
+    auto &activate = prog_->kernel(
+        [&]() {
+          For(0, N, [&](Expr i) { Activate(pointer, ExprGroup(i)); });
+        },
+        "benchmark_activate");
+    auto &deactivate = prog_->kernel(
+        [&]() {
+          For(0, N, [&](Expr i) { Deactivate(pointer, ExprGroup(i)); });
+        },
+        "benchmark_deactivate");
+    auto &append = prog_->kernel(
+        [&]() {
+          For(0, N, [&](Expr i) { Eval(Append(dynamic, ExprGroup(), i)); });
+        },
+        "benchmark_append");
+    auto &clear = prog_->kernel(
+        [&]() { Deactivate(dynamic, ExprGroup()); }, "benchmark_clear");
+    // The struct-for generates the list of the active cells first.
+    auto &struct_for = prog_->kernel(
+        [&]() {
+          Declare(i);
+          For(ExprGroup(i), x, [&]() { x[i] = i; });
+        },
+        "benchmark_struct_for");
+    auto &empty = prog_->kernel([&]() {}, "benchmark_empty");
+
+    std::vector<std::pair<std::string, double>> results;
+    auto add_result = [&](const std::string &name, int64 workload,
+                          std::function<void()> iterate) {
+      FunctionBenchmark benchmark(workload, std::move(iterate));
+      results.emplace_back(name, benchmark.run() * 1e9);
+    };
+
+    // Allocates the cells from the NodeManager, and recycles them.
+    add_result("node_manager_allocate_recycle", N, [&]() {
+      launch(activate);
+      launch(deactivate);
+    });
+    launch(activate);
+    // Pointer_activate on active cells only checks them.
+    add_result("pointer_activate_active", N, [&]() { launch(activate); });
+    // Each append also reserves a slot of the ListManager of the chunks.
+    add_result("dynamic_append", N, [&]() {
+      launch(append);
+      launch(clear);
+    });
+    add_result("listgen_struct_for", N, [&]() { launch(struct_for); });
+    add_result("kernel_launch", 1, [&]() { launch(empty); });
+
+    ThreadPool pool;
+    auto *nop = +[](void *, int) {};
+    const int num_threads = std::thread::hardware_concurrency();
+    add_result("thread_pool_run", 1, [&]() {
+      pool.run(num_threads, num_threads, nullptr, nop);
+    });
+    return results;
+  }
+
+ private:
+  void launch(Kernel &kernel) {
+    auto ctx = kernel.make_launch_context();
+    kernel(ctx);
+    prog_->synchronize();
+  }
+
+  std::unique_ptr<Program> prog_;
+  Expr x_, y_;
+  SNode *pointer_;
+  SNode *dynamic_;
+};
+
+// Gathers a field of 64 MB at random indices, in nanoseconds per element,
+// with the CPU memory backed by |huge_pages|.
+double benchmark_random_gather(const std::string &huge_pages) {
+  constexpr int N = 1 << 24;
+  auto saved_config = default_compile_config;
+  default_compile_config.cpu_huge_pages = huge_pages;
+  double t;
+  {
+    Program prog(host_arch());
+    auto x = global_new(PrimitiveType::i32, "x");
+    auto y = global_new(PrimitiveType::i32, "y");
+    prog.snode_root->dense(Index(0), N).place(x, {});
+    prog.snode_root->dense(Index(0), N).place(y, {});
+    prog.materialize_layout();
+    auto &gather = prog.kernel(
+        [&]() {
+          // && is the bitwise and of Exprs.
+          For(0, N, [&](Expr i) { y[i] = x[(i * 1000003) && (N - 1)]; });
+        },
+        "benchmark_random_gather");
+    FunctionBenchmark benchmark(N, [&]() {
+      auto ctx = gather.make_launch_context();
+      gather(ctx);
+      prog.synchronize();
+    });
+    t = benchmark.run() * 1e9;
+  }
+  default_compile_config = saved_config;
+  return t;
+}
+
+}  // namespace
+
+TI_TEST("benchmark_runtime") {
+  RuntimeBenchmark benchmark;
+  auto results = benchmark.run();
+  results.emplace_back("random_gather", benchmark_random_gather("none"));
+  results.emplace_back("random_gather_transparent_huge_pages",
+                       benchmark_random_gather("transparent"));
+
+  nlohmann::json baseline;
+  if (auto *fn = std::getenv("TI_BENCHMARK_RUNTIME_BASELINE")) {
+    std::ifstream fs(fn);
+    fs >> baseline;
+  }
+  nlohmann::json output;
+  for (auto &[name, t] : results) {
+    output[name] = t;
+    if (!baseline.count(name)) {
+      TI_INFO("{:<32} {:12.3f} ns/element", name, t);
+    } else if (t > baseline[name].get<double>() * 1.2) {
+      TI_WARN("{:<32} {:12.3f} ns/element (baseline {:.3f}, regressed)", name,
+              t, baseline[name].get<double>());
+    } else {
+      TI_INFO("{:<32} {:12.3f} ns/element (baseline {:.3f})", name, t,
+              baseline[name].get<double>());
+    }
+  }
+  if (auto *fn = std::getenv("TI_BENCHMARK_RUNTIME_OUTPUT")) {
+    std::ofstream fs(fn);
+    fs << output.dump(2) << std::endl;
+  }
+}
+
+TLANG_NAMESPACE_END
@@ -224,6 +224,28 @@ void run_test(const std::vector<PairData> &data,
   }
 }
 
+// Reuses a single container, cleared between the runs, the way the nodes
+// recycled by StateFlowGraph::NodeArena keep the storage of their edges.
+template <typename M>
+void run_test_recycled(const std::vector<PairData> &data,
+                       const std::vector<PairData> &non_exists) {
+  M m;
+  for (int i = 0; i < 10; ++i) {
+    m.clear();
+    for (const auto &p : data) {
+      insert(p, &m);
+    }
+
+    for (const auto &p : data) {
+      TI_CHECK(lookup(p, m, "found"));
+    }
+
+    for (const auto &p : non_exists) {
+      TI_CHECK(!lookup(p, m, "not found"));
+    }
+  }
+}
+
 // Basic tests within a basic block
 TI_TEST("benchmark_sfg") {
 #if 0
@@ -281,6 +303,10 @@ TI_TEST("benchmark_sfg") {
   SECTION("FlattenVec") {
     run_test<FlattenVec>(data, non_exists);
   }
+
+  SECTION("FlattenVec recycled") {
+    run_test_recycled<FlattenVec>(data, non_exists);
+  }
   Profiling::get_instance().print_profile_info();
 #endif
 }
@@ -0,0 +1,91 @@
+#include <random>
+#include <vector>
+
+#include "taichi/util/testing.h"
+#include "taichi/math/batched_linalg.h"
+
+TI_NAMESPACE_BEGIN
+
+namespace {
+
+using namespace batched_linalg;
+
+// The largest error of U diag(sigma) V^T = A, U^T U = V^T V = I and A = R S.
+template <typename T>
+float64 decomposition_error(int n) {
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float64> dist(-1, 1);
+  std::vector<T> a(9 * n), u(9 * n), sigma(3 * n), v(9 * n), r(9 * n),
+      s(9 * n);
+  for (auto &x : a) {
+    x = dist(rng);
+  }
+  svd3x3(n, a.data(), u.data(), sigma.data(), v.data());
+  polar_decompose3x3(n, a.data(), r.data(), s.data());
+  auto at = [n](const std::vector<T> &m, int i, int j, int k) {
+    return (float64)m[(i * 3 + j) * n + k];
+  };
+  float64 error = 0;
+  for (int k = 0; k < n; k++) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        float64 usv = 0, utu = 0, vtv = 0, rs = 0;
+        for (int l = 0; l < 3; l++) {
+          usv += at(u, i, l, k) * sigma[l * n + k] * at(v, j, l, k);
+          utu += at(u, l, i, k) * at(u, l, j, k);
+          vtv += at(v, l, i, k) * at(v, l, j, k);
+          rs += at(r, i, l, k) * at(s, l, j, k);
+        }
+        error = std::max(error, std::abs(usv - at(a, i, j, k)));
+        error = std::max(error, std::abs(rs - at(a, i, j, k)));
+        error = std::max(error, std::abs(utu - (i == j)));
+        error = std::max(error, std::abs(vtv - (i == j)));
+        error = std::max(error, std::abs(at(s, i, j, k) - at(s, j, i, k)));
+      }
+    }
+    for (int i = 0; i < 2; i++) {
+      CHECK(std::abs(sigma[i * n + k]) + 1e-5 >=
+            std::abs(sigma[(i + 1) * n + k]));
+    }
+  }
+  return error;
+}
+
+}  // namespace
+
+TI_TEST("batched_linalg") {
+  const auto max_level = get_max_simd_level();
+  SECTION("svd_and_polar_decomposition") {
+    for (int level = 0; level <= (int)max_level; level++) {
+      set_simd_level((SIMDLevel)level);
+      // Not a multiple of the widths, so that the remainder is covered.
+      CHECK(decomposition_error<float32>(1037) < 1e-5);
+      CHECK(decomposition_error<float64>(1037) < 1e-12);
+    }
+    set_simd_level(max_level);
+  }
+  SECTION("matmul") {
+    const int n = 37;
+    std::vector<float64> a(6 * n), b(8 * n), c(12 * n);
+    for (int i = 0; i < (int)a.size(); i++) {
+      a[i] = i % 7;
+    }
+    for (int i = 0; i < (int)b.size(); i++) {
+      b[i] = i % 5;
+    }
+    matmul(n, 3, 2, 4, a.data(), b.data(), c.data());
+    for (int k = 0; k < n; k++) {
+      for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+          float64 sum = 0;
+          for (int l = 0; l < 2; l++) {
+            sum += a[(i * 2 + l) * n + k] * b[(l * 4 + j) * n + k];
+          }
+          CHECK(c[(i * 4 + j) * n + k] == sum);
+        }
+      }
+    }
+  }
+}
+
+TI_NAMESPACE_END
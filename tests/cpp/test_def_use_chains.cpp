@@ -0,0 +1,40 @@
+#include "taichi/ir/def_use_chains.h"
+#include "taichi/ir/statements.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+TI_TEST("def_use_chains") {
+  SECTION("replace_all_usages_with") {
+    auto block = std::make_unique<Block>();
+
+    auto a = block->push_back<ConstStmt>(TypedConstant(1));
+    auto b = block->push_back<ConstStmt>(TypedConstant(2));
+    auto add = block->push_back<BinaryOpStmt>(BinaryOpType::add, a, a)
+                 ->as<BinaryOpStmt>();
+    auto mul = block->push_back<BinaryOpStmt>(BinaryOpType::mul, add, b)
+                 ->as<BinaryOpStmt>();
+
+    DefUseChains chains(block.get());
+    TI_CHECK(chains.get_users(a).size() == 2);
+    TI_CHECK(chains.get_users(add).size() == 1);
+    TI_CHECK(!chains.has_users(mul));
+
+    chains.replace_all_usages_with(a, b);
+    TI_CHECK(add->lhs == b);
+    TI_CHECK(add->rhs == b);
+    TI_CHECK(!chains.has_users(a));
+    TI_CHECK(chains.get_users(b).size() == 3);
+
+    auto sub = block->push_back<BinaryOpStmt>(BinaryOpType::sub, mul, b)
+                   ->as<BinaryOpStmt>();
+    chains.add_user(sub);
+    TI_CHECK(chains.has_users(mul));
+    chains.replace_all_usages_with(b, a);
+    TI_CHECK(add->lhs == a);
+    TI_CHECK(mul->rhs == a);
+    TI_CHECK(sub->rhs == a);
+  }
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,32 @@
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+TI_TEST("die") {
+  SECTION("dead_chain") {
+    auto block = std::make_unique<Block>();
+
+    // A chain of dead statements, each only used by the next one
+    auto a = block->push_back<ConstStmt>(TypedConstant(1));
+    auto b = block->push_back<BinaryOpStmt>(BinaryOpType::add, a, a);
+    block->push_back<BinaryOpStmt>(BinaryOpType::mul, b, b);
+
+    // Statements used by a local store, which must be kept
+    auto x = block->push_back<ConstStmt>(TypedConstant(2));
+    auto y = block->push_back<BinaryOpStmt>(BinaryOpType::add, x, x);
+    auto alloca = block->push_back<AllocaStmt>(PrimitiveType::i32);
+    block->push_back<LocalStoreStmt>(alloca, y);
+
+    TI_CHECK(block->size() == 7);
+    TI_CHECK(irpass::die(block.get()));
+    TI_CHECK(block->size() == 4);
+    TI_CHECK(block->statements[0].get() == x);
+    TI_CHECK(block->statements[1].get() == y);
+    TI_CHECK(block->statements[2].get() == alloca);
+    TI_CHECK(!irpass::die(block.get()));
+  }
+}
+
+TLANG_NAMESPACE_END
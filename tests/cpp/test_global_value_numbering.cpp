@@ -0,0 +1,67 @@
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// $0 = $ptr + 1; if (cond) { $other = $ptr + 1 } $other = $ptr + 1, where the
+// branch stores to $ptr instead if |clobber| is set.
+std::unique_ptr<Block> make_block(bool clobber) {
+  auto block = std::make_unique<Block>();
+  auto type = TypeFactory::create_vector_or_scalar_type(1, PrimitiveType::i32);
+  auto ptr = block->push_back<GlobalTemporaryStmt>(0, type);
+  auto other_ptr = block->push_back<GlobalTemporaryStmt>(4, type);
+  auto one = block->push_back<ConstStmt>(TypedConstant(1));
+  auto load = block->push_back<GlobalLoadStmt>(ptr);
+  block->push_back<BinaryOpStmt>(BinaryOpType::add, load, one);
+  auto cond = block->push_back<ConstStmt>(TypedConstant(2));
+  auto if_stmt = block->push_back<IfStmt>(cond)->as<IfStmt>();
+  auto clause = std::make_unique<Block>();
+  auto clause_load = clause->push_back<GlobalLoadStmt>(ptr);
+  auto clause_add =
+      clause->push_back<BinaryOpStmt>(BinaryOpType::add, clause_load, one);
+  clause->push_back<GlobalStoreStmt>(clobber ? ptr : other_ptr, clause_add);
+  if_stmt->set_true_statements(std::move(clause));
+  auto final_load = block->push_back<GlobalLoadStmt>(ptr);
+  auto final_add =
+      block->push_back<BinaryOpStmt>(BinaryOpType::add, final_load, one);
+  block->push_back<GlobalStoreStmt>(other_ptr, final_add);
+  irpass::type_check(block.get());
+  return block;
+}
+
+}  // namespace
+
+TI_TEST("global_value_numbering") {
+  SECTION("across_blocks") {
+    auto block = make_block(false);
+    TI_CHECK(irpass::global_value_numbering(block.get()));
+    // The loads and the additions in the branch and after it are replaced.
+    TI_CHECK(block->size() == 8);
+    auto add = block->statements[4].get();
+    TI_CHECK(add->is<BinaryOpStmt>());
+    auto if_stmt = block->statements[6]->as<IfStmt>();
+    TI_CHECK(if_stmt->true_statements->size() == 1);
+    TI_CHECK(if_stmt->true_statements->back()->as<GlobalStoreStmt>()->data ==
+             add);
+    TI_CHECK(block->back()->as<GlobalStoreStmt>()->data == add);
+    TI_CHECK(!irpass::global_value_numbering(block.get()));
+  }
+
+  SECTION("clobbered_load") {
+    auto block = make_block(true);
+    TI_CHECK(irpass::global_value_numbering(block.get()));
+    // The branch stores to $ptr, so it is loaded again after it.
+    TI_CHECK(block->size() == 10);
+    auto if_stmt = block->statements[6]->as<IfStmt>();
+    TI_CHECK(if_stmt->true_statements->size() == 1);
+    auto final_add = block->statements[8]->as<BinaryOpStmt>();
+    TI_CHECK(final_add->lhs == block->statements[7].get());
+    TI_CHECK(block->back()->as<GlobalStoreStmt>()->data == final_add);
+  }
+}
+
+TLANG_NAMESPACE_END
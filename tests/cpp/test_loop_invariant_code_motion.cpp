@@ -0,0 +1,71 @@
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// for i in range(4) { for j in range(8) { $other = $ptr + j } }, where the
+// inner loop stores to $ptr instead if |clobber| is set.
+std::unique_ptr<Block> make_block(bool clobber) {
+  auto block = std::make_unique<Block>();
+  auto type = TypeFactory::create_vector_or_scalar_type(1, PrimitiveType::i32);
+  auto zero = block->push_back<ConstStmt>(TypedConstant(0));
+  auto four = block->push_back<ConstStmt>(TypedConstant(4));
+  auto eight = block->push_back<ConstStmt>(TypedConstant(8));
+  auto outer = block
+                   ->push_back<RangeForStmt>(zero, four,
+                                             std::make_unique<Block>(), 1, 1,
+                                             0, false)
+                   ->as<RangeForStmt>();
+  auto inner = outer->body
+                   ->push_back<RangeForStmt>(zero, eight,
+                                             std::make_unique<Block>(), 1, 1,
+                                             0, false)
+                   ->as<RangeForStmt>();
+  auto body = inner->body.get();
+  auto ptr = body->push_back<GlobalTemporaryStmt>(0, type);
+  auto load = body->push_back<GlobalLoadStmt>(ptr);
+  auto index = body->push_back<LoopIndexStmt>(inner, 0);
+  auto add = body->push_back<BinaryOpStmt>(BinaryOpType::add, load, index);
+  auto other_ptr = body->push_back<GlobalTemporaryStmt>(4, type);
+  body->push_back<GlobalStoreStmt>(clobber ? ptr : other_ptr, add);
+  irpass::type_check(block.get());
+  return block;
+}
+
+}  // namespace
+
+TI_TEST("loop_invariant_code_motion") {
+  CompileConfig config;
+
+  SECTION("hoist_load") {
+    auto block = make_block(false);
+    TI_CHECK(irpass::loop_invariant_code_motion(block.get(), config));
+    // The outer loop is parallel.
+    TI_CHECK(block->size() == 4);
+    auto outer = block->back()->as<RangeForStmt>();
+    TI_CHECK(outer->body->size() == 4);
+    TI_CHECK(outer->body->statements[0]->is<GlobalTemporaryStmt>());
+    TI_CHECK(outer->body->statements[1]->is<GlobalLoadStmt>());
+    TI_CHECK(outer->body->statements[2]->is<GlobalTemporaryStmt>());
+    auto inner = outer->body->back()->as<RangeForStmt>();
+    TI_CHECK(inner->body->size() == 3);
+    TI_CHECK(inner->body->statements[0]->is<LoopIndexStmt>());
+    TI_CHECK(!irpass::loop_invariant_code_motion(block.get(), config));
+  }
+
+  SECTION("clobbered_load") {
+    auto block = make_block(true);
+    TI_CHECK(irpass::loop_invariant_code_motion(block.get(), config));
+    auto outer = block->back()->as<RangeForStmt>();
+    TI_CHECK(outer->body->size() == 3);
+    auto inner = outer->body->back()->as<RangeForStmt>();
+    TI_CHECK(inner->body->size() == 4);
+    TI_CHECK(inner->body->statements[0]->is<GlobalLoadStmt>());
+  }
+}
+
+TLANG_NAMESPACE_END
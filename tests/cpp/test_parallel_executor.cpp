@@ -1,5 +1,9 @@
+#include <atomic>
+#include <memory>
+
 #include "taichi/util/testing.h"
 #include "taichi/program/async_engine.h"
+#include "taichi/system/timer.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -20,6 +24,60 @@ TI_TEST("parallel_executor") {
       CHECK(buffer[i] == i + 1);
     }
   }
+  SECTION("move_only_tasks") {
+    std::atomic<int> sum{0};
+    ParallelExecutor exec(4);
+    for (int i = 0; i < 100; i++) {
+      auto value = std::make_unique<int>(i);
+      exec.enqueue([value = std::move(value), &sum]() { sum += *value; });
+    }
+    exec.flush();
+    CHECK(sum == 4950);
+  }
+  SECTION("serial_order") {
+    std::vector<int> order;
+    {
+      // Through the overflow queue as well.
+      ParallelExecutor exec(1, /*queue_capacity=*/4);
+      for (int i = 0; i < 100; i++) {
+        exec.enqueue([i, &order]() { order.push_back(i); });
+      }
+    }
+    REQUIRE(order.size() == 100);
+    for (int i = 0; i < 100; i++) {
+      CHECK(order[i] == i);
+    }
+  }
+  SECTION("full_queue_and_nested_enqueues") {
+    std::atomic<int> count{0};
+    ParallelExecutor exec(3, /*queue_capacity=*/8);
+    for (int i = 0; i < 1000; i++) {
+      exec.enqueue([&]() {
+        count++;
+        exec.enqueue([&]() { count++; });
+      });
+    }
+    exec.flush();
+    CHECK(count == 2000);
+  }
+}
+
+TI_TEST("benchmark_parallel_executor") {
+  // Many tiny tasks from one thread, like the launches of the async engine.
+  constexpr int kNumTasks = 1000000;
+  for (int num_threads : {1, 4}) {
+    std::atomic<int64> sum{0};
+    ParallelExecutor exec(num_threads);
+    auto t = Time::get_time();
+    for (int i = 0; i < kNumTasks; i++) {
+      exec.enqueue([i, &sum]() { sum += i; });
+    }
+    exec.flush();
+    t = Time::get_time() - t;
+    CHECK(sum == (int64)kNumTasks * (kNumTasks - 1) / 2);
+    TI_INFO("{} worker(s): {:.1f} ns per task", num_threads,
+            t / kNumTasks * 1e9);
+  }
 }
 
 TLANG_NAMESPACE_END
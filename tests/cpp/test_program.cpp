@@ -0,0 +1,81 @@
+#include <memory>
+
+#include "taichi/ir/frontend.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+constexpr int kNumElements = 64;
+
+// A Program with a dense field |x| filled by |fill(k)| with k * i.
+class FilledProgram {
+ public:
+  FilledProgram() {
+    prog_ = std::make_unique<Program>(host_arch());
+    x_ = global_new(PrimitiveType::i32, "x");
+    prog_->snode_root->dense(Index(0), kNumElements).place(x_, {});
+    prog_->materialize_layout();
+    fill_ = &prog_->kernel(
+        [x = x_]() {
+          auto k = Expr::make<ArgLoadExpression>(0, PrimitiveType::i32);
+          For(0, kNumElements, [&](Expr i) { x[i] = i * k; });
+        },
+        "fill");
+    fill_->insert_arg(PrimitiveType::i32, false);
+  }
+
+  void fill(int k) {
+    prog_->make_current();
+    auto ctx = fill_->make_launch_context();
+    ctx.set_arg_int(0, k);
+    (*fill_)(ctx);
+    prog_->synchronize();
+  }
+
+  int64 read(int i) {
+    prog_->make_current();
+    return x_.snode()->read_int({i});
+  }
+
+  bool transfer_from(FilledProgram &src) {
+    return prog_->transfer_snode(x_.snode(), *src.prog_, src.x_.snode());
+  }
+
+ private:
+  std::unique_ptr<Program> prog_;
+  Expr x_;
+  Kernel *fill_;
+};
+
+}  // namespace
+
+TI_TEST("multiple_programs") {
+  SECTION("separate_root_buffers") {
+    auto a = std::make_unique<FilledProgram>();
+    auto b = std::make_unique<FilledProgram>();
+    // |b| reuses the task |a| compiled.
+    a->fill(2);
+    b->fill(3);
+    for (int i = 0; i < kNumElements; i += 7) {
+      CHECK(a->read(i) == 2 * i);
+      CHECK(b->read(i) == 3 * i);
+    }
+    // The tasks |b| reuses outlive |a|.
+    a.reset();
+    b->fill(5);
+    CHECK(b->read(kNumElements - 1) == 5 * (kNumElements - 1));
+  }
+  SECTION("transfer_snode") {
+    FilledProgram a, b;
+    a.fill(2);
+    b.fill(3);
+    CHECK(b.transfer_from(a));
+    for (int i = 0; i < kNumElements; i += 7) {
+      CHECK(b.read(i) == 2 * i);
+    }
+  }
+}
+
+TLANG_NAMESPACE_END
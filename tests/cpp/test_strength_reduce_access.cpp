@@ -0,0 +1,58 @@
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+TI_TEST("strength_reduce_access") {
+  auto block = std::make_unique<Block>();
+  auto type = TypeFactory::create_vector_or_scalar_type(1, PrimitiveType::i32);
+  SNode root(0, SNodeType::root);
+  auto &dense = root.insert_children(SNodeType::dense);
+  // As the struct compiler sets it.
+  dense.parent = &root;
+
+  auto i = block->push_back<GlobalLoadStmt>(
+      block->push_back<GlobalTemporaryStmt>(0, type));
+  auto j = block->push_back<GlobalLoadStmt>(
+      block->push_back<GlobalTemporaryStmt>(4, type));
+  auto one = block->push_back<ConstStmt>(TypedConstant(1));
+  // x[i, j] as lowered by lower_access.
+  auto lookup = [&](Stmt *i, Stmt *j) {
+    auto get_root = block->push_back<GetRootStmt>();
+    auto root_lookup = block->push_back<SNodeLookupStmt>(
+        &root, get_root,
+        block->push_back<LinearizeStmt>(std::vector<Stmt *>(),
+                                        std::vector<int>()),
+        false);
+    auto get_child = block->push_back<GetChStmt>(root_lookup, 0);
+    auto extract_i = block->push_back<BitExtractStmt>(i, 0, 4);
+    auto extract_j = block->push_back<BitExtractStmt>(j, 0, 3);
+    auto linearized = block->push_back<LinearizeStmt>(
+        std::vector<Stmt *>({extract_i, extract_j}), std::vector<int>({16, 8}));
+    return block
+        ->push_back<SNodeLookupStmt>(&dense, get_child, linearized, false)
+        ->as<SNodeLookupStmt>();
+  };
+  auto center = lookup(i, j);
+  auto right =
+      lookup(i, block->push_back<BinaryOpStmt>(BinaryOpType::add, j, one));
+  auto up =
+      lookup(block->push_back<BinaryOpStmt>(BinaryOpType::sub, i, one), j);
+  auto center_again = lookup(i, j);
+  irpass::type_check(block.get());
+
+  TI_CHECK(irpass::strength_reduce_access(block.get()));
+  auto check_offset = [&](SNodeLookupStmt *stmt, int32 offset) {
+    auto add = stmt->input_index->as<BinaryOpStmt>();
+    TI_CHECK(add->lhs == center->input_index);
+    TI_CHECK(add->rhs->as<ConstStmt>()->val[0].val_int() == offset);
+  };
+  check_offset(right, 1);
+  check_offset(up, -8);
+  TI_CHECK(center_again->input_index == center->input_index);
+  TI_CHECK(!irpass::strength_reduce_access(block.get()));
+}
+
+TLANG_NAMESPACE_END
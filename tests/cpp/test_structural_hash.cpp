@@ -0,0 +1,65 @@
+#include "taichi/ir/analysis.h"
+#include "taichi/ir/statements.h"
+#include "taichi/ir/transforms.h"
+#include "taichi/util/testing.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+// if (cond) { $dst = $src + value } with |cond| and |value| constants.
+std::unique_ptr<Block> make_block(int32 value, bool in_false_branch) {
+  auto block = std::make_unique<Block>();
+  auto type = TypeFactory::create_vector_or_scalar_type(1, PrimitiveType::i32);
+  auto src = block->push_back<GlobalTemporaryStmt>(0, type);
+  auto load = block->push_back<GlobalLoadStmt>(src);
+  auto dst = block->push_back<GlobalTemporaryStmt>(4, type);
+  auto cond = block->push_back<ConstStmt>(TypedConstant(1));
+  auto if_stmt = block->push_back<IfStmt>(cond)->as<IfStmt>();
+  auto clause = std::make_unique<Block>();
+  auto constant = clause->push_back<ConstStmt>(TypedConstant(value));
+  auto add =
+      clause->push_back<BinaryOpStmt>(BinaryOpType::add, load, constant);
+  clause->push_back<GlobalStoreStmt>(dst, add);
+  if (in_false_branch) {
+    if_stmt->set_false_statements(std::move(clause));
+  } else {
+    if_stmt->set_true_statements(std::move(clause));
+  }
+  irpass::type_check(block.get());
+  return block;
+}
+
+}  // namespace
+
+TI_TEST("structural_hash") {
+  auto block = make_block(1, false);
+  irpass::re_id(block.get());
+  const auto hash = irpass::analysis::structural_hash(block.get());
+
+  SECTION("ignores_ids") {
+    // Statements created later get larger ids.
+    auto other = make_block(1, false);
+    TI_CHECK(irpass::analysis::structural_hash(other.get()) == hash);
+    irpass::re_id(other.get());
+    TI_CHECK(irpass::analysis::structural_hash(other.get()) == hash);
+    auto cloned = irpass::analysis::clone(block.get());
+    TI_CHECK(irpass::analysis::structural_hash(cloned.get()) == hash);
+  }
+
+  SECTION("tells_apart") {
+    auto other_value = make_block(2, false);
+    TI_CHECK(irpass::analysis::structural_hash(other_value.get()) != hash);
+    auto other_branch = make_block(1, true);
+    TI_CHECK(irpass::analysis::structural_hash(other_branch.get()) != hash);
+
+    // $dst = $src + 1 rather than $dst = 1 + $src.
+    auto swapped = make_block(1, false);
+    auto *if_stmt = swapped->statements.back()->as<IfStmt>();
+    auto *add = if_stmt->true_statements->statements[1]->as<BinaryOpStmt>();
+    std::swap(add->lhs, add->rhs);
+    TI_CHECK(irpass::analysis::structural_hash(swapped.get()) != hash);
+  }
+}
+
+TLANG_NAMESPACE_END
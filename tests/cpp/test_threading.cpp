@@ -0,0 +1,26 @@
+#include "taichi/util/testing.h"
+#include "taichi/system/threading.h"
+
+TI_NAMESPACE_BEGIN
+
+TI_TEST("work_stealing_thread_pool") {
+  SECTION("create_and_destruct") {
+    WorkStealingThreadPool pool(4);
+  }
+  SECTION("each_split_runs_once") {
+    WorkStealingThreadPool pool(4);
+    for (int splits : {0, 1, 3, 100, 10000}) {
+      for (int num_threads : {1, 2, 4, 8}) {
+        std::vector<std::atomic<int>> counters(splits);
+        pool.run(splits, num_threads, &counters, [](void *c, int i) {
+          (*(std::vector<std::atomic<int>> *)c)[i]++;
+        });
+        for (int i = 0; i < splits; i++) {
+          CHECK(counters[i] == 1);
+        }
+      }
+    }
+  }
+}
+
+TI_NAMESPACE_END
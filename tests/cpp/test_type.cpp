@@ -21,6 +21,25 @@ TI_TEST("type") {
 
     TI_CHECK(ba->to_string() == "ba(ci1x32)");
   }
+
+  SECTION("interning") {
+    auto &factory = TypeFactory::get_instance();
+    auto ci5 = factory.get_custom_int_type(5, true);
+    TI_CHECK(ci5 == factory.get_custom_int_type(5, true));
+    TI_CHECK(ci5 != factory.get_custom_int_type(5, false));
+    auto u16 = factory.get_primitive_int_type(16, false);
+    auto bs = factory.get_bit_struct_type(u16, {ci5, ci5}, {0, 5});
+    TI_CHECK(bs == factory.get_bit_struct_type(u16, {ci5, ci5}, {0, 5}));
+    TI_CHECK(bs != factory.get_bit_struct_type(u16, {ci5, ci5}, {0, 6}));
+    TI_CHECK(DataType(bs).hash() ==
+             DataType(factory.get_bit_struct_type(u16, {ci5, ci5}, {0, 5}))
+                 .hash());
+    auto ptr = factory.get_pointer_type(ci5);
+    TI_CHECK(ptr == factory.get_pointer_type(ci5));
+    TI_CHECK(ptr->as<PointerType>()->get_pointee_type() == ci5);
+    TI_CHECK(u16->is_primitive(PrimitiveTypeID::u16));
+    TI_CHECK(!ci5->is_primitive(PrimitiveTypeID::i32));
+  }
 }
 
 TLANG_NAMESPACE_END
@@ -0,0 +1,52 @@
+import taichi as ti
+
+
+def make_rollout(buffer_size):
+    n = 4
+    x = ti.field(ti.f32, shape=(buffer_size, n), needs_grad=True)
+    v = ti.field(ti.f32, shape=(buffer_size, n), needs_grad=True)
+    w = ti.field(ti.f32, shape=n, needs_grad=True)
+    loss = ti.field(ti.f32, shape=(), needs_grad=True)
+
+    @ti.kernel
+    def step(t: ti.i32):
+        for i in range(n):
+            v[t + 1, i] = v[t, i] * 0.9 + ti.sin(x[t, i]) * w[i]
+            x[t + 1, i] = x[t, i] + 0.1 * v[t + 1, i]
+
+    @ti.kernel
+    def compute_loss(t: ti.i32):
+        for i in range(n):
+            loss[None] += x[t, i]**2
+
+    def init():
+        for i in range(n):
+            x[0, i] = 0.3 * i + 0.1
+            w[i] = 0.5 + 0.1 * i
+
+    def results():
+        return [loss[None]] + [w.grad[i] for i in range(n)
+                               ] + [x.grad[0, i] for i in range(n)]
+
+    return x, v, loss, step, compute_loss, init, results
+
+
+@ti.all_archs
+def test_checkpointed_rollout():
+    num_steps = 10
+    x, v, loss, step, compute_loss, init, results = make_rollout(num_steps + 1)
+    # Segments of 3, 3, 3 and 1 steps
+    cx, cv, closs, cstep, ccompute_loss, cinit, cresults = make_rollout(4)
+
+    init()
+    with ti.Tape(loss):
+        for t in range(num_steps):
+            step(t)
+        compute_loss(num_steps)
+    expected = results()
+
+    cinit()
+    ti.checkpointed_rollout(cstep, num_steps, [cx, cv], closs, ccompute_loss)
+
+    for a, b in zip(cresults(), expected):
+        assert a == ti.approx(b)
@@ -364,3 +364,33 @@ def test_complex_body():
 
     for i in range(N):
         assert a.grad[i] == g[i]
+
+
+@ti.test(require=ti.extension.adstack, ad_stack_size=4)
+def test_ad_stack_size_from_trip_count():
+    # The loop pushes more values than ad_stack_size, however its trip count
+    # is constant.
+    N = 4
+    M = 20
+    a = ti.field(ti.f32, shape=N, needs_grad=True)
+    p = ti.field(ti.f32, shape=N, needs_grad=True)
+
+    @ti.kernel
+    def compute():
+        for i in range(N):
+            ret = 1.0
+            for j in range(M):
+                ret = ret * a[i]
+            p[i] = ret
+
+    for i in range(N):
+        a[i] = 1.0 + 0.01 * i
+
+    compute()
+    for i in range(N):
+        p.grad[i] = 1
+    compute.grad()
+
+    for i in range(N):
+        x = 1.0 + 0.01 * i
+        assert a.grad[i] == ti.approx(M * x**(M - 1), rel=1e-4)
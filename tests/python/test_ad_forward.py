@@ -0,0 +1,158 @@
+import math
+
+import taichi as ti
+from taichi import approx
+
+
+@ti.all_archs
+def test_unary_binary():
+    n = 8
+    x = ti.field(ti.f32, shape=n, needs_dual=True)
+    y = ti.field(ti.f32, shape=n, needs_dual=True)
+
+    @ti.kernel
+    def func():
+        for i in x:
+            v = x[i]
+            y[i] = ti.sin(v) * ti.exp(v) + ti.log(v) / ti.sqrt(v) + v**3 - ti.max(
+                v, 0.55) + ti.tanh(v)
+
+    def f(v):
+        return math.sin(v) * math.exp(v) + math.log(v) / math.sqrt(
+            v) + v**3 - max(v, 0.55) + math.tanh(v)
+
+    def df(v):
+        return (math.cos(v) * math.exp(v) + math.sin(v) * math.exp(v) +
+                (1 / v * math.sqrt(v) - math.log(v) * 0.5 / math.sqrt(v)) / v +
+                3 * v**2 - (1 if v > 0.55 else 0) + 1 - math.tanh(v)**2)
+
+    for i in range(n):
+        x[i] = 0.2 + i * 0.1
+        x.dual[i] = 1
+    func.jvp()
+    for i in range(n):
+        v = 0.2 + i * 0.1
+        assert y[i] == approx(f(v), rel=1e-4)
+        assert y.dual[i] == approx(df(v), rel=1e-4)
+
+
+@ti.all_archs
+def test_seed_direction():
+    x = ti.field(ti.f32, shape=2, needs_dual=True)
+    loss = ti.field(ti.f32, shape=(), needs_dual=True)
+
+    @ti.kernel
+    def func():
+        loss[None] = x[0] * x[0] * x[1]
+
+    x[0] = 3
+    x[1] = 5
+    # The derivative along the second input only.
+    x.dual[0] = 0
+    x.dual[1] = 1
+    func.jvp()
+    assert loss[None] == approx(45)
+    assert loss.dual[None] == approx(9)
+
+    x.dual[0] = 1
+    x.dual[1] = 0
+    func.jvp()
+    assert loss.dual[None] == approx(30)
+
+
+@ti.all_archs
+def test_atomic_add():
+    n = 128
+    x = ti.field(ti.f32, shape=n, needs_dual=True)
+    total = ti.field(ti.f32, shape=(), needs_dual=True)
+
+    @ti.kernel
+    def func():
+        for i in x:
+            total[None] += x[i] * x[i]
+
+    for i in range(n):
+        x[i] = i * 0.01
+        x.dual[i] = 1
+    func.jvp()
+    assert total.dual[None] == approx(sum(2 * i * 0.01 for i in range(n)),
+                                      rel=1e-4)
+
+
+@ti.all_archs
+def test_control_flow():
+    # Loops carrying local variables and while loops are not supported in
+    # reverse mode.
+    n = 4
+    x = ti.field(ti.f32, shape=n, needs_dual=True)
+    y = ti.field(ti.f32, shape=n, needs_dual=True)
+
+    @ti.kernel
+    def func():
+        for i in x:
+            v = 1.0
+            k = 0
+            while k < i + 1:
+                if k % 2 == 0:
+                    v = v * x[i]
+                else:
+                    v = v + x[i]
+                k += 1
+            y[i] = v
+
+    def f(v, i):
+        r, dr = 1.0, 0.0
+        for k in range(i + 1):
+            if k % 2 == 0:
+                r, dr = r * v, dr * v + r
+            else:
+                r, dr = r + v, dr + 1
+        return r, dr
+
+    for i in range(n):
+        x[i] = 1.5
+        x.dual[i] = 1
+    func.jvp()
+    for i in range(n):
+        r, dr = f(1.5, i)
+        assert y[i] == approx(r)
+        assert y.dual[i] == approx(dr)
+
+
+@ti.all_archs
+def test_matches_reverse_mode():
+    x = ti.Vector.field(2, ti.f32, shape=(), needs_grad=True, needs_dual=True)
+    loss = ti.field(ti.f32, shape=(), needs_grad=True, needs_dual=True)
+
+    @ti.kernel
+    def func():
+        loss[None] = ti.atan2(x[None][0], x[None][1]) * x[None].norm()
+
+    x[None] = [0.3, 0.7]
+    with ti.Tape(loss):
+        func()
+    for k in range(2):
+        x.dual[None] = [1 if j == k else 0 for j in range(2)]
+        func.jvp()
+        assert loss.dual[None] == approx(x.grad[None][k], rel=1e-4)
+
+
+@ti.all_archs
+def test_lazy_dual():
+    x = ti.field(ti.f32)
+    y = ti.field(ti.f32)
+    ti.root.dense(ti.i, 4).place(x, y)
+    ti.root.lazy_dual()
+
+    @ti.kernel
+    def func():
+        for i in x:
+            y[i] = 2 * x[i] + 1
+
+    for i in range(4):
+        x[i] = i
+        x.dual[i] = i
+    func.jvp()
+    for i in range(4):
+        assert y[i] == 2 * i + 1
+        assert y.dual[i] == 2 * i
@@ -0,0 +1,82 @@
+import math
+
+import pytest
+
+import taichi as ti
+from taichi import approx
+
+
+@ti.all_archs
+def test_fused_grad():
+    n = 16
+    x = ti.field(ti.f32, shape=n, needs_grad=True)
+    y = ti.field(ti.f32, shape=n, needs_grad=True)
+    loss = ti.field(ti.f32, shape=(), needs_grad=True)
+
+    @ti.kernel
+    def func():
+        for i in x:
+            v = ti.sin(x[i]) * x[i]
+            y[i] = v * v
+            loss[None] += v
+
+    for i in range(n):
+        x[i] = i * 0.1
+        y.grad[i] = 1
+    loss.grad[None] = 2
+    func.fused_grad()
+
+    for i in range(n):
+        v = math.sin(i * 0.1) * (i * 0.1)
+        assert y[i] == approx(v * v, rel=1e-5)
+        dv = math.cos(i * 0.1) * (i * 0.1) + math.sin(i * 0.1)
+        assert x.grad[i] == approx((2 * v + 2) * dv, rel=1e-4)
+    assert loss[None] == approx(
+        sum(math.sin(i * 0.1) * (i * 0.1) for i in range(n)), rel=1e-4)
+
+
+@ti.all_archs
+def test_fused_grad_matches_grad():
+    n = 32
+    x = ti.field(ti.f32, shape=n, needs_grad=True)
+    y = ti.field(ti.f32, shape=n, needs_grad=True)
+    x_grad = [0] * n
+
+    @ti.kernel
+    def func():
+        for i in range(1, n - 1):
+            s = 0.0
+            for j in range(3):
+                s += ti.exp(-x[i - 1 + j]) * (j + 1)
+            y[i] = s
+
+    for i in range(n):
+        x[i] = i * 0.05
+        y.grad[i] = 1
+    func()
+    y_primal = [y[i] for i in range(n)]
+    func.grad()
+    for i in range(n):
+        x_grad[i] = x.grad[i]
+        x.grad[i] = 0
+        y[i] = 0
+
+    func.fused_grad()
+    for i in range(n):
+        assert y[i] == approx(y_primal[i])
+        assert x.grad[i] == approx(x_grad[i])
+
+
+@ti.test(arch=ti.cpu)
+def test_fused_grad_reads_output():
+    x = ti.field(ti.f32, shape=4, needs_grad=True)
+    y = ti.field(ti.f32, shape=4, needs_grad=True)
+
+    @ti.kernel
+    def func():
+        for i in x:
+            y[i] = x[i]
+            x[i] = y[i] * 2
+
+    with pytest.raises(RuntimeError):
+        func.fused_grad()
@@ -0,0 +1,86 @@
+import taichi as ti
+from taichi import approx
+
+
+@ti.test(require=ti.extension.sparse)
+def test_sparse_grad():
+    n = 4096
+    x = ti.field(ti.f32, shape=n, needs_grad=True, sparse_grad=True)
+    loss = ti.field(ti.f32, shape=(), needs_grad=True)
+
+    @ti.kernel
+    def compute():
+        for i in range(8):
+            loss[None] += x[i * 3 + 1000]**2
+
+    @ti.kernel
+    def count_active() -> ti.i32:
+        c = 0
+        for i in x.grad:
+            c += 1
+        return c
+
+    @ti.kernel
+    def init():
+        for i in x:
+            x[i] = i * 0.001
+
+    init()
+    assert x.grad.shape == (n, )
+    assert count_active() == 0
+
+    with ti.Tape(loss):
+        compute()
+
+    for i in range(n):
+        if i >= 1000 and i < 1024 and (i - 1000) % 3 == 0:
+            assert x.grad[i] == approx(2 * i * 0.001, rel=1e-5)
+        else:
+            assert x.grad[i] == 0
+    # Only the block of the cells 512 to 1023 was allocated.
+    assert count_active() == 512
+
+    ti.clear_all_gradients()
+    assert count_active() == 0
+
+
+@ti.test(require=ti.extension.sparse)
+def test_sparse_grad_vector_2d():
+    n = 64
+    x = ti.Vector.field(2,
+                        ti.f32,
+                        shape=(n, n),
+                        offset=(-8, -8),
+                        needs_grad=True,
+                        sparse_grad=True)
+    loss = ti.field(ti.f32, shape=(), needs_grad=True)
+
+    @ti.kernel
+    def compute():
+        for i in range(4):
+            loss[None] += x[i - 8, 3].dot(x[i - 8, 3])
+
+    @ti.kernel
+    def count_active() -> ti.i32:
+        c = 0
+        for i, j in x.grad:
+            c += 1
+        return c
+
+    @ti.kernel
+    def init():
+        for i, j in x:
+            x[i, j] = [i, j]
+
+    init()
+    assert x.grad.shape == (n, n)
+
+    loss.grad[None] = 1
+    compute.grad()
+
+    for i in range(-8, -4):
+        assert x.grad[i, 3][0] == 2 * i
+        assert x.grad[i, 3][1] == 6
+    assert x.grad[0, 0][0] == 0
+    # Only the 16x16 block of the cells (-8..7, -8..7) was allocated.
+    assert count_active() == 256
@@ -0,0 +1,55 @@
+import os
+import tempfile
+
+import numpy as np
+
+import taichi as ti
+
+
+def _define_fields():
+    x = ti.field(ti.f32, shape=16)
+    y = ti.field(ti.f32, shape=16)
+    return x, y
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_aot_module():
+    arch = ti.cfg.arch
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'saxpy.tcm')
+
+        ti.init(arch=arch, aot_record=True)
+        x, y = _define_fields()
+
+        @ti.kernel
+        def saxpy(a: ti.f32):
+            for i in x:
+                y[i] = a * x[i] + y[i]
+
+        @ti.kernel
+        def fill(arr: ti.ext_arr()):
+            for i in x:
+                x[i] = arr[i]
+                y[i] = 1
+
+        @ti.kernel
+        def total() -> ti.f32:
+            s = 0.0
+            for i in y:
+                s += y[i]
+            return s
+
+        fill(np.zeros(16, dtype=np.float32))
+        saxpy(0)
+        total()
+        ti.export_aot(path)
+
+        # A fresh program, which never compiles the kernels.
+        ti.init(arch=arch)
+        x, y = _define_fields()
+        module = ti.load_aot_module(path)
+        module.fill(np.arange(16, dtype=np.float32))
+        module.saxpy(2)
+        for i in range(16):
+            assert y[i] == 2 * i + 1
+        assert module.total() == 16 * 15 + 16
@@ -1,3 +1,4 @@
+import numpy as np
 import taichi as ti
 
 
@@ -69,3 +70,65 @@ def test_ext_arr():
     set_f32(v)
     for i in range(N):
         assert x[i] == 10 + i
+
+
+@ti.all_archs
+def test_arg_load_repeated_launches():
+    n = 16
+    x = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def add(i: ti.i32, v: ti.i32):
+        x[i] += v
+
+    # Launches without any readback in between, with the args both repeated
+    # and changed.
+    for k in range(3 * n):
+        add(k // 3, k // 6)
+
+    for i in range(n):
+        assert x[i] == sum((3 * i + k) // 6 for k in range(3))
+
+
+@ti.test()
+def test_arg_load_mixed():
+    x = ti.field(ti.f32, shape=4)
+
+    @ti.kernel
+    def set(i: ti.i32, a: ti.f32, b: ti.i32) -> ti.f32:
+        x[i] = a * b
+        return x[i] + 1
+
+    # The launches share one context, which each launch overwrites.
+    for i in range(4):
+        assert set(i, 0.5, i + 1) == 0.5 * (i + 1) + 1
+    for i in range(4):
+        assert x[i] == 0.5 * (i + 1)
+
+
+@ti.test()
+def test_launch_kernels():
+    x = ti.field(ti.i32, shape=4)
+    y = ti.field(ti.f32, shape=4)
+
+    @ti.kernel
+    def fill(v: ti.i32):
+        for i in x:
+            x[i] = v
+
+    @ti.kernel
+    def axpy(a: ti.f32, b: ti.i32):
+        for i in x:
+            y[i] += a * x[i] + b
+
+    @ti.kernel
+    def copy(arr: ti.ext_arr()):
+        for i in x:
+            arr[i] = x[i]
+
+    arr = np.zeros(4, dtype=np.int32)
+    ti.launch_kernels([(fill, (2, )), (axpy, (0.5, 1)), (copy, (arr, )),
+                       (fill, (3, )), (axpy, (2.0, 0))])
+    assert arr.tolist() == [2] * 4
+    assert x.to_numpy().tolist() == [3] * 4
+    assert y.to_numpy().tolist() == [2.0 + 6.0] * 4
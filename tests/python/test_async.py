@@ -52,3 +52,147 @@ def test_listgen_opt_with_offsets():
 
     ti.sync()
     assert ti.get_kernel_stats().get_counters()['launched_tasks_list_gen'] <= 2
+
+
+@ti.test(require=ti.extension.async_mode,
+         async_mode=True,
+         async_speculative_compilation=True)
+def test_speculative_compilation():
+    n = 128
+    x = ti.field(dtype=ti.i32, shape=n)
+    y = ti.field(dtype=ti.i32, shape=n)
+
+    @ti.kernel
+    def inc_x():
+        for i in x:
+            x[i] += 1
+
+    @ti.kernel
+    def inc_y():
+        for i in y:
+            y[i] += x[i]
+
+    for step in range(5):
+        # The tasks of both kernels may be fused in some syncs, so that the
+        # speculatively compiled variants are never launched.
+        for _ in range(step + 1):
+            inc_x()
+            inc_y()
+        ti.sync()
+
+    total = sum(range(1, 16))
+    for i in range(n):
+        assert x[i] == 15
+        assert y[i] == total
+
+
+
+@ti.test(require=ti.extension.async_mode,
+         async_mode=True,
+         async_opt_reuse_schedules=True)
+def test_reuse_optimized_schedules():
+    n = 128
+    x = ti.field(dtype=ti.i32, shape=n)
+    y = ti.field(dtype=ti.i32, shape=n)
+
+    @ti.kernel
+    def inc_x():
+        for i in x:
+            x[i] += 1
+
+    @ti.kernel
+    def add_y(k: ti.i32):
+        for i in y:
+            y[i] += x[i] * k
+
+    stats = ti.get_kernel_stats()
+    stats.clear()
+    num_frames = 6
+    for frame in range(num_frames):
+        inc_x()
+        add_y(2)
+        inc_x()
+        # The arguments are part of the fingerprint.
+        add_y(1 if frame < num_frames - 1 else 3)
+        ti.sync()
+
+    # From the third frame on, the graph is the same as in the previous frame,
+    # except for the last one, which has a different argument.
+    counters = stats.get_counters()
+    assert int(counters['sfg_reused_schedules']) >= num_frames - 3
+    xs = x.to_numpy()
+    ys = y.to_numpy()
+    expected_y = 0
+    for frame in range(num_frames):
+        expected_y += (frame * 2 + 1) * 2
+        expected_y += (frame * 2 + 2) * (1 if frame < num_frames - 1 else 3)
+    for i in range(n):
+        assert xs[i] == num_frames * 2
+        assert ys[i] == expected_y
+
+
+@ti.test(require=ti.extension.async_mode, async_mode=True,
+         async_flush_num_tasks=3)
+def test_flush_before_sync():
+    n = 256
+    x = ti.field(dtype=ti.i32, shape=n)
+    y = ti.field(dtype=ti.i32, shape=n)
+
+    @ti.kernel
+    def inc_x():
+        for i in x:
+            x[i] += 1
+
+    @ti.kernel
+    def add_y():
+        for i in y:
+            y[i] += x[i]
+
+    stats = ti.get_kernel_stats()
+    stats.clear()
+    num_iters = 10
+    for _ in range(num_iters):
+        inc_x()
+        add_y()
+    # The tasks are launched in batches, before the sync.
+    counters = stats.get_counters()
+    assert int(counters['sfg_flushes']) >= 2
+    ti.sync()
+
+    xs = x.to_numpy()
+    ys = y.to_numpy()
+    for i in range(n):
+        assert xs[i] == num_iters
+        assert ys[i] == num_iters * (num_iters + 1) // 2
+
+
+@ti.test(arch=ti.cuda, async_mode=True, async_cuda_num_streams=4)
+def test_multiple_cuda_streams():
+    n = 1024
+    fields = [ti.field(dtype=ti.i32, shape=n) for _ in range(4)]
+    total = ti.field(dtype=ti.i32, shape=n)
+
+    def make_fill(x, k):
+        @ti.kernel
+        def fill():
+            for i in x:
+                x[i] = i * k
+
+        return fill
+
+    @ti.kernel
+    def reduce():
+        for i in total:
+            total[i] = fields[0][i] + fields[1][i] + fields[2][i] + fields[3][i]
+
+    fills = [make_fill(x, k + 1) for k, x in enumerate(fields)]
+    for _ in range(3):
+        # The fills are independent of each other, while reduce() depends on
+        # all of them.
+        for fill in fills:
+            fill()
+        reduce()
+    ti.sync()
+
+    for i in range(n):
+        assert total[i] == i * 10
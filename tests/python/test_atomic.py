@@ -309,3 +309,30 @@ def test_atomic_xor_expr_evaled():
     func()
 
     assert c[None] == 0
+
+
+@ti.test(arch=ti.opengl, opengl_atomic_aggregation_slots=64)
+def test_atomic_add_scatter_aggregated():
+    n = 4096
+    grid = ti.field(ti.f32, shape=16)
+    hist = ti.field(ti.f32, shape=16)
+
+    @ti.kernel
+    def scatter():
+        for i in range(n):
+            # Summed in shared memory without native float atomics.
+            grid[i % 16] += 0.5
+            grid[(i * 7) % 16] += 0.25
+
+    @ti.kernel
+    def scatter_and_read():
+        for i in range(n):
+            # Uses the results of the adds, which are not summed then.
+            old = ti.atomic_add(hist[i % 16], 1.0)
+            hist[(i + 1) % 16] += old * 0.0
+
+    scatter()
+    scatter_and_read()
+    for j in range(16):
+        assert grid[j] == approx(n / 16 * 0.75)
+        assert hist[j] == approx(n / 16)
@@ -54,3 +54,46 @@ def test_2D_bit_array():
 
     set_val()
     verify_val()
+
+
+@ti.test(require=ti.extension.quant)
+def test_bit_array_struct_for():
+    ci1 = ti.type_factory_.get_custom_int_type(1, False)
+    ci4 = ti.type_factory_.get_custom_int_type(4, False)
+
+    x = ti.field(dtype=ci1)
+    y = ti.field(dtype=ci4)
+    s = ti.field(ti.i32, shape=())
+
+    N = 256
+
+    ti.root.dense(ti.i, N // 32)._bit_array(ti.i, 32, num_bits=32).place(x)
+    ti.root.dense(ti.i, N // 8)._bit_array(ti.i, 8, num_bits=32).place(y)
+
+    @ti.kernel
+    def set_val():
+        for i in x:
+            x[i] = i % 3 == 0
+        for i in y:
+            y[i] = i % 16
+
+    @ti.kernel
+    def update():
+        # Reads the next word at the end of each one, and mixes the stores
+        # and the atomic adds to the cells of a word.
+        for i in y:
+            y[i] = (y[i] + x[i] + y[(i + 1) % N] * 0) % 16
+            if i % 5 == 0:
+                y[i] += 1
+        for i in x:
+            s[None] += x[i]
+
+    set_val()
+    update()
+    for i in range(N):
+        assert x[i] == (i % 3 == 0)
+        expected = (i % 16 + (i % 3 == 0)) % 16
+        if i % 5 == 0:
+            expected = (expected + 1) % 16
+        assert y[i] == expected
+    assert s[None] == len(range(0, N, 3))
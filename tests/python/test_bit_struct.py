@@ -127,3 +127,36 @@ def test_bit_struct():
 
     test_single_bit_struct(16, 16, [5, 5, 6], np.array([15, 5, 20]))
     test_single_bit_struct(32, 32, [10, 10, 12], np.array([11, 19, 2020]))
+
+
+@ti.test(require=ti.extension.quant, cfg_optimization=False)
+def test_bit_struct_numpy():
+    ci13 = ti.type_factory_.get_custom_int_type(13, True)
+    ci19 = ti.type_factory_.get_custom_int_type(19, True)
+    cft = ti.type_factory_.get_custom_float_type(ci19, ti.f32.get_ptr(), 0.01)
+
+    x = ti.field(dtype=ci13)
+    y = ti.field(dtype=cft)
+    s = ti.field(ti.i32, shape=())
+
+    N = 64
+
+    ti.root.dense(ti.i, N)._bit_struct(num_bits=32).place(x, y)
+
+    x_np = np.arange(N, dtype=np.int32) * 37 - 2000
+    y_np = np.linspace(-100, 100, N).astype(np.float32)
+    x.from_numpy(x_np)
+    y.from_numpy(y_np)
+
+    @ti.kernel
+    def sum_x():
+        for i in x:
+            s[None] += x[i]
+
+    sum_x()
+    assert s[None] == x_np.sum()
+    assert x.to_numpy().dtype == np.int32
+    assert y.to_numpy().dtype == np.float32
+    assert (x.to_numpy() == x_np).all()
+    # custom floats are rounded to multiples of the scale
+    assert np.allclose(y.to_numpy(), y_np, atol=0.005 + 1e-5)
@@ -0,0 +1,40 @@
+import os
+import shutil
+import tempfile
+
+import pytest
+
+import taichi as ti
+
+source = '''
+extern "C" void lerp_clamped(float a, float b, float t, float *out) {
+  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  *out = a + (b - a) * t;
+}
+'''
+
+
+@pytest.mark.skipif(shutil.which('clang') is None, reason='clang not found')
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_bitcode_func_call():
+    n = 16
+    x = ti.field(ti.f32, shape=n)
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'lerp.cpp')
+        with open(path, 'w') as f:
+            f.write(source)
+
+        @ti.kernel
+        def lerp():
+            for i in x:
+                y = 0.0
+                ti.bitcode_func_call(path,
+                                     'lerp_clamped',
+                                     args=[1.0, 3.0, (i - 4) / 8],
+                                     outputs=[y])
+                x[i] = y
+
+        lerp()
+    for i in range(n):
+        t = min(max((i - 4) / 8, 0), 1)
+        assert x[i] == pytest.approx(1 + 2 * t)
@@ -242,3 +242,40 @@ def test_bitmasked_offset_child():
 
     func()
     assert s[None] == 7
+
+
+@archs_support_bitmasked
+def test_bitmasked_sparse_words():
+    x = ti.field(ti.i32)
+    n = 4096
+    # Blocks split in several parts of the element list by block_dim
+    ti.root.pointer(ti.i, 4).bitmasked(ti.i, n // 4).place(x)
+
+    active = [3, 31, 32, 33, 95, 1024, 1025, 2047, 3000, 4095]
+
+    @ti.kernel
+    def activate(i: ti.i32):
+        x[i] = i
+
+    for i in active:
+        activate(i)
+
+    @ti.kernel
+    def count() -> ti.i32:
+        ti.block_dim(48)
+        s = 0
+        for i in x:
+            s += 1
+            if x[i] != i:
+                s += n
+        return s
+
+    @ti.kernel
+    def total() -> ti.i32:
+        s = 0
+        for i in x:
+            s += i
+        return s
+
+    assert count() == len(active)
+    assert total() == sum(active)
@@ -146,3 +146,175 @@ def test_multiple_inputs():
 # TODO: BLS on CPU
 # TODO: BLS boundary out of bound
 # TODO: BLS with TLS
+
+
+@ti.require(ti.extension.bls)
+@ti.all_archs
+def test_bls_with_tls():
+    x, y = ti.field(ti.f32), ti.field(ti.f32)
+    total = ti.field(ti.f32, shape=())
+
+    N = 64
+    bs = 16
+
+    ti.root.pointer(ti.i, N // bs).dense(ti.i, bs).place(x, y)
+
+    @ti.kernel
+    def populate():
+        for i in range(bs, N - bs):
+            x[i] = i
+
+    @ti.kernel
+    def blur():
+        ti.block_local(x)
+        for i in x:
+            y[i] = x[i - 1] + x[i + 1]
+            total[None] += x[i]
+
+    populate()
+    blur()
+
+    assert total[None] == sum(range(bs, N - bs))
+    for i in range(bs, N - bs):
+        left = i - 1 if i > bs else 0
+        right = i + 1 if i < N - bs - 1 else 0
+        assert y[i] == left + right
+
+
+@ti.test(require=ti.extension.bls)
+def test_bls_block_dim_smaller_than_block():
+    x, y = ti.field(ti.f32), ti.field(ti.f32)
+
+    N = 64
+    bs = 16
+
+    ti.root.pointer(ti.ij, N // bs).dense(ti.ij, bs).place(x, y)
+
+    @ti.kernel
+    def populate():
+        for i, j in ti.ndrange(N, N):
+            x[i, j] = i * N + j
+
+    @ti.kernel
+    def stencil():
+        # Each thread fetches several cells of the block and its halo.
+        ti.block_dim(32)
+        ti.block_local(x)
+        for i, j in x:
+            y[i, j] = x[i - 1, j] + x[i, j + 1]
+
+    populate()
+    stencil()
+
+    for i in range(1, N):
+        for j in range(N - 1):
+            assert y[i, j] == (i - 1) * N + j + i * N + j + 1
+
+
+@ti.test(arch=ti.cuda, cuda_max_bls_bytes=64)
+def test_bls_fields_over_limit():
+    x, y, z = ti.field(ti.f32), ti.field(ti.f32), ti.field(ti.f32)
+
+    N = 64
+    bs = 16
+
+    ti.root.pointer(ti.i, N // bs).dense(ti.i, bs).place(x, y, z)
+
+    @ti.kernel
+    def populate():
+        for i in range(N):
+            x[i] = i
+            y[i] = i * 2
+
+    @ti.kernel
+    def add():
+        # Only the buffer of x fits, y stays in global memory.
+        ti.block_local(x, y)
+        for i in x:
+            z[i] = x[i] + y[i]
+
+    populate()
+    add()
+
+    for i in range(N):
+        assert z[i] == i * 3
+
+
+@ti.test(arch=ti.cuda)
+def test_bls_over_48kb():
+    x, y = ti.field(ti.f64), ti.field(ti.f64)
+
+    N = 256
+    bs = (64, 128)
+
+    # The BLS buffer of x with its halo takes 65 * 129 * 8 bytes, which
+    # needs the opt-in beyond 48 KB where the device supports it.
+    ti.root.pointer(ti.ij, (N // bs[0] + 1, N // bs[1] + 1)).dense(
+        ti.ij, bs).place(x, y)
+
+    @ti.kernel
+    def populate():
+        for i, j in ti.ndrange(N, N):
+            x[i, j] = i * 1000 + j
+
+    @ti.kernel
+    def stencil():
+        ti.block_local(x)
+        for i, j in x:
+            y[i, j] = x[i + 1, j] + x[i, j + 1]
+
+    populate()
+    stencil()
+
+    for i in range(0, N - 1, 17):
+        for j in range(0, N - 1, 13):
+            assert y[i, j] == (i + 1) * 1000 + j + i * 1000 + j + 1
+
+
+def _test_scatter_without_hint(read_y):
+    x, y = ti.field(ti.f32), ti.field(ti.f32)
+
+    N = 64
+    bs = 16
+
+    ti.root.pointer(ti.i, N // bs).dense(ti.i, bs).place(x, y)
+
+    @ti.kernel
+    def populate():
+        for i in range(1, N - 1):
+            x[i] = i
+
+    @ti.kernel
+    def scatter():
+        for i in x:
+            if x[i] != 0:
+                y[i - 1] += x[i]
+                y[i + 1] += x[i] * 2
+            if ti.static(read_y):
+                y[i] += y[i] * 0
+
+    populate()
+    scatter()
+
+    for i in range(N):
+        expected = 0
+        if 1 <= i + 1 < N - 1:
+            expected += i + 1
+        if 1 <= i - 1 < N - 1:
+            expected += (i - 1) * 2
+        assert y[i] == expected
+
+
+@ti.test(require=ti.extension.bls)
+def test_scatter_without_hint():
+    _test_scatter_without_hint(read_y=False)
+
+
+@ti.test(require=ti.extension.bls)
+def test_scatter_without_hint_read():
+    _test_scatter_without_hint(read_y=True)
+
+
+@ti.test(require=ti.extension.bls, make_block_local_scatter=False)
+def test_scatter_without_hint_disabled():
+    _test_scatter_without_hint(read_y=False)
@@ -0,0 +1,57 @@
+import pytest
+
+import taichi as ti
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_align_vec3():
+    n = 1000
+    x, y, z = ti.field(ti.f32), ti.field(ti.f32), ti.field(ti.f32)
+    w = ti.field(ti.i32, shape=n)
+    ti.root.dense(ti.i, n).align(16).place(x, y, z)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i
+            y[i] = i * 2
+            z[i] = i * 3
+
+    @ti.kernel
+    def reduce():
+        for i in x:
+            w[i] = int(x[i] + y[i] + z[i])
+
+    fill()
+    reduce()
+    for i in range(0, n, 7):
+        assert w[i] == i * 6
+        assert z[i] == i * 3
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_align_blocks():
+    x = ti.field(ti.f64)
+    y = ti.field(ti.i8)
+    ti.root.place(y)
+    ti.root.dense(ti.ij, (6, 5)).dense(ti.ij, (3, 3)).align(64).place(x)
+
+    @ti.kernel
+    def fill():
+        for i, j in x:
+            x[i, j] = i * 100 + j
+
+    y[None] = 3
+    fill()
+    assert y[None] == 3
+    for i in range(18):
+        for j in range(15):
+            assert x[i, j] == i * 100 + j
+
+
+@ti.test(arch=ti.cpu)
+def test_align_non_dense():
+    with pytest.raises(RuntimeError):
+        ti.root.pointer(ti.i, 4).align(16)
+    with pytest.raises(ValueError):
+        ti.root.dense(ti.i, 4).align(12)
@@ -0,0 +1,208 @@
+import os
+import tempfile
+
+import numpy as np
+import pytest
+
+import taichi as ti
+
+
+def _layout():
+    x = ti.field(ti.f32)
+    y = ti.Vector.field(3, ti.i32)
+    z = ti.field(ti.f64)
+    d = ti.field(ti.i32)
+    ti.root.dense(ti.ij, (64, 32)).place(x)
+    ti.root.pointer(ti.i, 16).dense(ti.i, 8).place(y)
+    ti.root.bitmasked(ti.ij, (8, 8)).place(z)
+    ti.root.dense(ti.i, 4).dynamic(ti.j, 64, chunk_size=8).place(d)
+    return x, y, z, d
+
+
+def _check_roundtrip(copy_on_write):
+    arch = ti.cfg.arch
+    x, y, z, d = _layout()
+
+    @ti.kernel
+    def fill():
+        for i, j in x:
+            x[i, j] = i * 100 + j
+        for i in range(0, 128, 3):
+            y[i] = ti.Vector([i, i * 2, -i])
+        for i in range(8):
+            z[i, 7 - i] = i * 0.5
+        for i in range(4):
+            for j in range(i * 10):
+                ti.append(d.parent(), i, j + i)
+
+    fill()
+    x_np = x.to_numpy()
+    y_np = y.to_numpy()
+    z_np = z.to_numpy()
+    d_np = d.to_numpy()
+
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'state.bin')
+        ti.save_checkpoint(path)
+
+        ti.init(arch=arch)
+        x, y, z, d = _layout()
+
+        @ti.kernel
+        def count() -> ti.i32:
+            n = 0
+            for i in y:
+                n += 1
+            for i, j in z:
+                n += 1
+            for i in range(4):
+                n += ti.length(d.parent(), i)
+            return n
+
+        z[0, 0] = 1
+        ti.load_checkpoint(path, copy_on_write=copy_on_write)
+        assert np.array_equal(x.to_numpy(), x_np)
+        assert np.array_equal(y.to_numpy(), y_np)
+        assert np.array_equal(z.to_numpy(), z_np)
+        assert np.array_equal(d.to_numpy(), d_np)
+        assert count() == 43 + 8 + 60
+        # The restored fields are written as usual.
+        x[1, 2] = -1
+        assert x[1, 2] == -1
+        assert x[1, 3] == 103
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_checkpoint():
+    _check_roundtrip(copy_on_write=False)
+
+
+@ti.test(arch=ti.cpu)
+def test_checkpoint_copy_on_write():
+    _check_roundtrip(copy_on_write=True)
+
+
+@ti.test(arch=ti.cpu)
+def test_checkpoint_layout_mismatch():
+    x = ti.field(ti.f32, shape=16)
+    x[3] = 1
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'state.bin')
+        ti.save_checkpoint(path)
+        ti.init(arch=ti.cpu)
+        y = ti.field(ti.f32, shape=32)
+        y[0] = 0
+        with pytest.raises(RuntimeError):
+            ti.load_checkpoint(path)
+
+
+def _delta_layout():
+    a = ti.field(ti.f32)
+    b = ti.field(ti.i32)
+    y = ti.field(ti.f32)
+    ti.root.dense(ti.i, 1 << 18).place(a)
+    ti.root.dense(ti.i, 1 << 18).place(b)
+    block = ti.root.pointer(ti.i, 64)
+    block.dense(ti.i, 256).place(y)
+    return a, b, y, block
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_checkpoint_delta():
+    arch = ti.cfg.arch
+    a, b, y, block = _delta_layout()
+
+    @ti.kernel
+    def fill():
+        for i in a:
+            a[i] = i
+            b[i] = -i
+        for i in range(64 * 256):
+            y[i] = i * 0.25
+
+    @ti.kernel
+    def step(k: ti.i32):
+        b[k] += 1
+        for i in range(256):
+            y[k * 256 + i] += 1
+        ti.deactivate(block, k + 1)
+
+    fill()
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        paths = [os.path.join(tmp_dir, f'{i}.bin') for i in range(3)]
+        ti.save_checkpoint(paths[0])
+        step(3)
+        ti.save_checkpoint(paths[1], delta=True)
+        step(10)
+        ti.save_checkpoint(paths[2], delta=True)
+        full_size = os.path.getsize(paths[0])
+        for path in paths[1:]:
+            assert os.path.getsize(path) * 10 < full_size
+        a_np = a.to_numpy()
+        b_np = b.to_numpy()
+        y_np = y.to_numpy()
+
+        ti.init(arch=arch)
+        a, b, y, block = _delta_layout()
+
+        @ti.kernel
+        def count() -> ti.i32:
+            n = 0
+            for i in block:
+                n += 1
+            return n
+
+        ti.load_checkpoint(paths[2])
+        assert np.array_equal(a.to_numpy(), a_np)
+        assert np.array_equal(b.to_numpy(), b_np)
+        assert np.array_equal(y.to_numpy(), y_np)
+        assert count() == 62
+
+        with pytest.raises(RuntimeError):
+            ti.save_checkpoint(paths[1], delta=True)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_checkpoint_compressed():
+    arch = ti.cfg.arch
+
+    def layout():
+        x = ti.field(ti.f32, shape=(256, 256))
+        y = ti.field(ti.f64, shape=4096)
+        k = ti.field(ti.i32, shape=4096)
+        return x, y, k
+
+    x, y, k = layout()
+
+    @ti.kernel
+    def fill():
+        for i, j in x:
+            x[i, j] = ti.sin(i * 0.05) * ti.cos(j * 0.03)
+        for i in y:
+            y[i] = i * 1e-3
+            k[i] = i % 7
+
+    fill()
+    x_np = x.to_numpy()
+    y_np = y.to_numpy()
+    k_np = k.to_numpy()
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        raw = os.path.join(tmp_dir, 'raw.bin')
+        compressed = os.path.join(tmp_dir, 'compressed.bin')
+        quantized = os.path.join(tmp_dir, 'quantized.bin')
+        ti.save_checkpoint(raw)
+        ti.save_checkpoint(compressed, compress=True)
+        ti.save_checkpoint(quantized, compress=1, error_bound={x: 1e-3})
+        assert os.path.getsize(compressed) < os.path.getsize(raw)
+        assert os.path.getsize(quantized) < os.path.getsize(compressed)
+
+        ti.init(arch=arch)
+        x, y, k = layout()
+        ti.load_checkpoint(compressed)
+        assert np.array_equal(x.to_numpy(), x_np)
+        assert np.array_equal(y.to_numpy(), y_np)
+        assert np.array_equal(k.to_numpy(), k_np)
+        ti.load_checkpoint(quantized)
+        assert np.abs(x.to_numpy() - x_np).max() <= 1e-3 * (1 + 1e-3)
+        assert np.array_equal(y.to_numpy(), y_np)
+        assert np.array_equal(k.to_numpy(), k_np)
@@ -0,0 +1,37 @@
+import json
+import os
+import tempfile
+
+import taichi as ti
+
+
+@ti.test(arch=ti.cpu, compile_profiler=True)
+def test_compile_profiler_dump_json():
+    x = ti.field(ti.f32, shape=16)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 2.0
+
+    fill()
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'profile.json')
+        ti.compile_profiler_dump_json(path)
+        with open(path) as f:
+            records = json.load(f)
+
+    records = [r for r in records if r['kernel'].startswith('fill')]
+    passes = [r['pass'] for r in records]
+    assert 'Typechecked' in passes
+    assert 'Simplified I' in passes
+    for r in records:
+        assert r['time'] >= 0
+        assert r['num_iterations'] >= 1
+
+    ti.compile_profiler_clear()
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'profile.json')
+        ti.compile_profiler_dump_json(path)
+        with open(path) as f:
+            assert json.load(f) == []
@@ -16,3 +16,34 @@ def test_constant_fold():
     # \sum_{i=1}^n (i^2) = n * (n + 1) * (2n + 1) / 6
     expected = n * (n + 1) * (2 * n + 1) // 6
     assert series() == expected
+
+
+@ti.test()
+def test_constant_fold_wraparound():
+    @ti.kernel
+    def overflow() -> ti.i32:
+        a = 2147483647
+        b = -2147483648
+        c = -8
+        return (a + 1) - b + ti.bit_shr(c, 28)
+
+    assert overflow() == 15
+
+
+@ti.test()
+def test_constant_fold_float_rounding():
+    import numpy as np
+
+    @ti.kernel
+    def mul() -> ti.f32:
+        a = 0.1
+        return a * 3.0
+
+    @ti.kernel
+    def floor_div() -> ti.i32:
+        a = -7
+        b = 2
+        return a // b
+
+    assert mul() == np.float32(0.1) * np.float32(3.0)
+    assert floor_div() == -4
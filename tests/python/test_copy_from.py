@@ -22,3 +22,27 @@ def test_scalar():
     assert y[0] == 1
     assert y[1] == 0
     assert y[2] == 3
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_copy_memory():
+    n = 1003
+    x = ti.field(ti.f32)
+    y = ti.field(ti.f32)
+    z = ti.field(ti.f32)
+    ti.root.dense(ti.i, n).place(x)
+    ti.root.dense(ti.i, n).place(y)
+    # A different layout falls back to the kernel.
+    ti.root.dense(ti.i, 17).dense(ti.i, 59).place(z)
+
+    @ti.kernel
+    def init():
+        for i in y:
+            y[i] = i * 0.5
+
+    init()
+    x.copy_from(y)
+    z.copy_from(y)
+    for i in range(0, n, 7):
+        assert x[i] == i * 0.5
+        assert z[i] == i * 0.5
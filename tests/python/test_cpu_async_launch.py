@@ -0,0 +1,44 @@
+import numpy as np
+
+import taichi as ti
+
+
+@ti.test(arch=ti.cpu, cpu_async_launch=True)
+def test_async_launches_in_order():
+    n = 1000
+    x = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def step(k: ti.i32):
+        for i in x:
+            x[i] = x[i] * 2 + k
+
+    @ti.kernel
+    def total() -> ti.i32:
+        s = 0
+        for i in x:
+            s += x[i]
+        return s
+
+    for k in range(10):
+        step(k)
+    expected = 0
+    for k in range(10):
+        expected = expected * 2 + k
+    assert x[n - 1] == expected
+    assert total() == expected * n
+
+
+@ti.test(arch=ti.cpu, cpu_async_launch=True)
+def test_async_launches_external_array():
+    n = 100
+    x = ti.field(ti.f32, shape=n)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 0.5
+
+    fill()
+    a = x.to_numpy()
+    assert np.allclose(a, np.arange(n) * 0.5)
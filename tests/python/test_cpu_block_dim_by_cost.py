@@ -0,0 +1,37 @@
+import taichi as ti
+
+
+@ti.test(arch=ti.cpu, cpu_block_dim_by_cost=True)
+def test_cheap_body():
+    n = 100003
+    x = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 2
+
+    fill()
+    for i in [0, 1, 4095, 4096, n - 1]:
+        assert x[i] == i * 2
+
+
+@ti.test(arch=ti.cpu, cpu_block_dim_by_cost=True)
+def test_expensive_body():
+    n = 37
+    x = ti.field(ti.i32, shape=n)
+    total = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def work(m: ti.i32):
+        for i in x:
+            s = 0
+            for j in range(m):
+                s += j % (i + 1)
+            x[i] = s
+            ti.atomic_add(total[None], 1)
+
+    work(1000)
+    assert total[None] == n
+    for i in range(n):
+        assert x[i] == sum(j % (i + 1) for j in range(1000))
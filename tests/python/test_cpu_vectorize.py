@@ -0,0 +1,78 @@
+import taichi as ti
+
+
+@ti.test(arch=ti.cpu, print_vectorization_report=True)
+def test_vectorize_saxpy():
+    n = 1003  # not a multiple of the vector width
+    x = ti.field(ti.f32, shape=n)
+    y = ti.field(ti.f32, shape=n)
+
+    @ti.kernel
+    def init():
+        for i in x:
+            x[i] = i
+            y[i] = n - i
+
+    @ti.kernel
+    def saxpy(a: ti.f32):
+        for i in y:
+            y[i] = a * x[i] + y[i]
+
+    init()
+    saxpy(2)
+    for i in range(n):
+        assert y[i] == i + n
+
+
+@ti.test(arch=ti.cpu)
+def test_vectorize_reduction():
+    n = 1000
+    x = ti.field(ti.i32, shape=n)
+    total = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def init():
+        for i in x:
+            x[i] = i
+
+    @ti.kernel
+    def reduce():
+        for i in x:
+            total[None] += x[i]
+
+    init()
+    reduce()
+    assert total[None] == n * (n - 1) // 2
+
+
+@ti.test(arch=ti.cpu)
+def test_vectorize_range_for():
+    x = ti.field(ti.i32, shape=(37, 11))
+
+    @ti.kernel
+    def fill(n: ti.i32):
+        for i, j in ti.ndrange(n, 11):
+            if (i + j) % 3 == 0:
+                x[i, j] = i * j
+
+    fill(29)
+    for i in range(37):
+        for j in range(11):
+            if i < 29 and (i + j) % 3 == 0:
+                assert x[i, j] == i * j
+            else:
+                assert x[i, j] == 0
+
+
+@ti.test(arch=ti.cpu, cpu_vectorize=False)
+def test_no_vectorize():
+    x = ti.field(ti.i32, shape=100)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 2
+
+    fill()
+    for i in range(100):
+        assert x[i] == i * 2
@@ -0,0 +1,39 @@
+import tempfile
+
+import taichi as ti
+
+
+def _run_saxpy(num_launches):
+    n = 1000
+    x = ti.field(ti.f32, shape=n)
+    y = ti.field(ti.f32, shape=n)
+
+    @ti.kernel
+    def saxpy(a: ti.f32):
+        for i in x:
+            y[i] = a * x[i] + y[i]
+
+    for i in range(n):
+        x[i] = i
+    for _ in range(num_launches):
+        saxpy(1)
+    for i in range(n):
+        assert y[i] == i * num_launches
+
+
+@ti.test(arch=ti.cuda, cuda_auto_tune_block_dim=True)
+def test_cuda_auto_tune():
+    # Enough launches to try all the candidates, and then some.
+    _run_saxpy(64)
+
+
+@ti.test(arch=ti.cuda)
+def test_cuda_auto_tune_offline_cache():
+    with tempfile.TemporaryDirectory() as cache_dir:
+        for _ in range(2):
+            ti.init(arch=ti.cuda,
+                    cuda_auto_tune_block_dim=True,
+                    cuda_auto_tune_num_launches=1,
+                    offline_cache=True,
+                    offline_cache_file_path=cache_dir)
+            _run_saxpy(32)
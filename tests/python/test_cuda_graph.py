@@ -0,0 +1,74 @@
+import pytest
+
+import taichi as ti
+
+
+@ti.test(arch=ti.cuda)
+def test_cuda_graph():
+    n = 128
+    x = ti.field(ti.f32, shape=n)
+    y = ti.field(ti.f32, shape=n)
+
+    @ti.kernel
+    def add(k: ti.f32):
+        for i in x:
+            x[i] += k
+
+    @ti.kernel
+    def copy():
+        for i in x:
+            y[i] = x[i] * 2
+
+    @ti.cuda_graph
+    def step(k):
+        add(k)
+        add(1)
+        copy()
+
+    expected = 0
+    for k in range(5):
+        step(k)
+        expected += k + 1
+        for i in range(n):
+            assert x[i] == expected
+            assert y[i] == expected * 2
+
+
+@ti.test(arch=ti.cuda)
+def test_cuda_graph_mismatch():
+    x = ti.field(ti.i32, shape=4)
+
+    @ti.kernel
+    def inc():
+        for i in x:
+            x[i] += 1
+
+    num_launches = 1
+
+    @ti.cuda_graph
+    def step():
+        for _ in range(num_launches):
+            inc()
+
+    step()
+    num_launches = 2
+    with pytest.raises(RuntimeError, match='captured'):
+        step()
+
+
+@ti.test(arch=ti.cpu)
+def test_cuda_graph_fallback():
+    x = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def inc():
+        x[None] += 1
+
+    @ti.cuda_graph
+    def step():
+        inc()
+        inc()
+
+    step()
+    step()
+    assert x[None] == 4
@@ -0,0 +1,46 @@
+import taichi as ti
+
+
+@ti.test(arch=ti.cuda, cuda_persistent_kernels=True)
+def test_persistent_dependent_range_fors():
+    n = 100000
+    x = ti.field(ti.i32, shape=n)
+    y = ti.field(ti.i32, shape=n)
+    total = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def steps():
+        for i in x:
+            x[i] = i % 7
+        # Each stage reads the elements the previous one wrote on other
+        # blocks.
+        for i in y:
+            y[i] = x[n - 1 - i] * 2
+        total[None] = 0
+        for i in y:
+            total[None] += y[i]
+
+    for _ in range(3):
+        steps()
+    assert total[None] == sum(i % 7 for i in range(n)) * 2
+    for i in range(0, n, 997):
+        assert y[i] == (n - 1 - i) % 7 * 2
+
+
+@ti.test(arch=ti.cuda, cuda_persistent_kernels=True)
+def test_persistent_serial_bounds():
+    x = ti.field(ti.i32, shape=1000)
+    m = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def fill(k: ti.i32) -> ti.i32:
+        m[None] = k
+        for i in range(m[None]):
+            x[i] = i + 1
+        s = 0
+        for i in range(m[None]):
+            s += x[i]
+        return s
+
+    assert fill(10) == 55
+    assert fill(1000) == 500500
@@ -50,3 +50,59 @@ def test_custom_int_atomics_b64():
     assert x[0] == 109
     assert x[1] == 212
     assert x[2] == 315
+
+
+@ti.test(require=ti.extension.quant, cfg_optimization=False)
+def test_custom_int_atomics_wrap_around():
+    cu4 = ti.type_factory_.get_custom_int_type(4, False)
+    ci28 = ti.type_factory_.get_custom_int_type(28, True)
+
+    x = ti.field(dtype=cu4)
+    # The highest bits of the word
+    y = ti.field(dtype=ci28)
+
+    ti.root._bit_struct(num_bits=32).place(x, y)
+
+    x[None] = 3
+    y[None] = -5
+
+    @ti.kernel
+    def foo():
+        for i in range(100):
+            x[None] += 1
+            y[None] -= 1
+
+    foo()
+
+    # The carries out of x do not reach y.
+    assert x[None] == (3 + 100) % 16
+    assert y[None] == -105
+
+
+@ti.test(require=ti.extension.quant,
+         cfg_optimization=False,
+         quant_atomic_add_allow_overflow=True)
+def test_custom_int_atomics_allow_overflow():
+    ci13 = ti.type_factory_.get_custom_int_type(13, True)
+    cu2 = ti.type_factory_.get_custom_int_type(2, False)
+
+    x = ti.field(dtype=ci13)
+    y = ti.field(dtype=cu2)
+
+    ti.root._bit_struct(num_bits=32).place(x, y)
+
+    x[None] = 3
+    y[None] = 0
+
+    @ti.kernel
+    def foo():
+        for i in range(10):
+            x[None] += 4
+
+        for j in range(3):
+            y[None] += 1
+
+    foo()
+
+    assert x[None] == 43
+    assert y[None] == 3
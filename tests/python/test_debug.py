@@ -139,3 +139,36 @@ def test_not_out_of_bound_with_offset():
         x[3, 7] = 2
 
     func()
+
+
+@ti.require(ti.extension.assertion)
+@ti.all_archs_with(debug=True)
+def test_out_of_bound_in_serial_loop():
+    ti.set_gdb_trigger(False)
+    x = ti.field(ti.i32, shape=16)
+
+    @ti.kernel
+    def func(n: ti.i32):
+        for _ in range(1):
+            for i in range(n):
+                x[i + 1] = i
+
+    func(15)
+    assert x[15] == 14
+    with pytest.raises(RuntimeError):
+        func(16)
+
+
+@ti.require(ti.extension.assertion)
+@ti.all_archs_with(debug=True)
+def test_not_out_of_bound_in_range():
+    ti.set_gdb_trigger(False)
+    x = ti.field(ti.i32, shape=(8, 16))
+
+    @ti.kernel
+    def func():
+        for i, j in ti.ndrange(8, 8):
+            x[i, ti.assume_in_range(i + j, i, 0, 8)] = i + j
+
+    func()
+    assert x[7, 15] == 14
@@ -0,0 +1,53 @@
+import taichi as ti
+
+
+def _reduce_repeatedly():
+    n = 1 << 18
+    x = ti.field(ti.f32, shape=n)
+    total = ti.field(ti.f32, shape=())
+    hist = ti.field(ti.f64, shape=4)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = ti.sin(i * 0.001) * 1e3
+
+    @ti.kernel
+    def reduce():
+        for i in x:
+            total[None] += x[i]
+            hist[2] += x[i] * 0.1
+
+    fill()
+    results = set()
+    for _ in range(10):
+        total[None] = 0
+        hist[2] = 0
+        reduce()
+        results.add((total[None], hist[2]))
+    return results
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], deterministic_reduction=True)
+def test_deterministic_reduction():
+    results = _reduce_repeatedly()
+    assert len(results) == 1
+    total, part = results.pop()
+    assert abs(part - total * 0.1) <= abs(total) * 1e-3 + 1e-2
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], deterministic_reduction=True)
+def test_deterministic_reduction_exact():
+    n = 100003
+    cnt = ti.field(ti.i32, shape=())
+    tot = ti.field(ti.i64, shape=())
+
+    @ti.kernel
+    def reduce():
+        for i in range(n):
+            cnt[None] += 1
+            tot[None] += i
+
+    reduce()
+    assert cnt[None] == n
+    assert tot[None] == n * (n - 1) // 2
@@ -0,0 +1,50 @@
+import numpy as np
+
+import taichi as ti
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_device_array_kernel_args():
+    n, m = 100, 3
+    a = ti.DeviceArray(ti.f32, (n, m))
+    b = ti.DeviceArray(ti.i32, n)
+    expected = np.random.rand(n, m).astype(np.float32)
+    a.from_numpy(expected)
+    b.fill(0)
+
+    @ti.kernel
+    def step(x: ti.ext_arr(), y: ti.ext_arr()):
+        for i in range(x.shape[0]):
+            for j in range(x.shape[1]):
+                x[i, j] *= 2
+            y[i] += i
+
+    for _ in range(3):
+        step(a, b)
+    assert a.shape == (n, m)
+    assert np.allclose(a.to_numpy(), expected * 8)
+    assert np.all(b.to_numpy() == np.arange(n) * 3)
+
+    # Numpy arrays still work with the same kernel.
+    x = expected.copy()
+    y = np.zeros(n, dtype=np.int32)
+    step(x, y)
+    assert np.allclose(x, expected * 2)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_device_array_reuse():
+    @ti.kernel
+    def fill(x: ti.ext_arr(), v: ti.i32):
+        for i in range(x.shape[0]):
+            x[i] = v + i
+
+    ptrs = set()
+    for k in range(4):
+        a = ti.DeviceArray(ti.i32, 1000 + k)
+        ptrs.add(a.ptr)
+        fill(a, k)
+        assert np.all(a.to_numpy() == np.arange(1000 + k) + k)
+        a.free()
+    # The memory of the freed arrays is reused.
+    assert len(ptrs) == 1
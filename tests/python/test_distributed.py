@@ -0,0 +1,82 @@
+import pytest
+
+import taichi as ti
+
+
+class _Request:
+    def __init__(self, complete=None):
+        self.complete = complete
+
+    def Wait(self):
+        if self.complete is not None:
+            self.complete()
+
+
+class _Comm:
+    # The ranks of a communicator within a single process.
+    def __init__(self, rank, num_ranks, mailbox):
+        self.rank = rank
+        self.num_ranks = num_ranks
+        self.mailbox = mailbox
+
+    def Get_rank(self):
+        return self.rank
+
+    def Get_size(self):
+        return self.num_ranks
+
+    def Isend(self, buffer, dest, tag):
+        self.mailbox[(self.rank, dest, tag)] = buffer.copy()
+        return _Request()
+
+    def Irecv(self, buffer, source, tag):
+        def complete():
+            buffer[...] = self.mailbox.pop((source, self.rank, tag))
+
+        return _Request(complete)
+
+
+def _ranks(shape, num_ranks, **kwargs):
+    mailbox = {}
+    return [
+        ti.DistributedDomain(shape, comm=_Comm(r, num_ranks, mailbox),
+                             **kwargs) for r in range(num_ranks)
+    ]
+
+
+@pytest.mark.parametrize('periodic', [False, True])
+@ti.test(arch=ti.cpu)
+def test_ghost_exchange(periodic):
+    n, m = 10, 3
+    domains = _ranks((n, m), 3, ghost=2, periodic=periodic)
+    assert [(d.begin, d.end) for d in domains] == [(0, 3), (3, 6), (6, 10)]
+    xs = [d.field(ti.i32) for d in domains]
+    vs = [d.field(ti.f32, n=2) for d in domains]
+
+    @ti.kernel
+    def fill(x: ti.template(), v: ti.template(), lo: ti.i32, hi: ti.i32):
+        for i, j in ti.ndrange((lo, hi), (0, m)):
+            x[i, j] = i * 10 + j
+            v[i, j] = ti.Vector([i, -j])
+
+    for d, x, v in zip(domains, xs, vs):
+        fill(x, v, *d.owned()[0])
+    exchanges = [d.start_ghost_exchange() for d in domains]
+    for e in exchanges:
+        e.wait()
+
+    for d, x, v in zip(domains, xs, vs):
+        ghosts = [d.begin - 2, d.begin - 1, d.end, d.end + 1]
+        for i in ghosts:
+            if not periodic and not 0 <= i < n:
+                continue
+            for j in range(m):
+                assert x[i, j] == (i % n) * 10 + j
+                assert v[i, j][0] == i % n
+                assert v[i, j][1] == -j
+
+
+@ti.test(arch=ti.cpu)
+def test_domain_errors():
+    with pytest.raises(ValueError):
+        _ranks(4, 3, ghost=2)
@@ -208,3 +208,99 @@ def test_dynamic_activate():
     assert l[0] == m
     assert l[1] == 21
     assert l[2] == 21
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def test_chunk_directory_append():
+    n = 16
+    m = 1000
+    x = ti.field(ti.i32)
+    l = ti.field(ti.i32, shape=n)
+    total = ti.field(ti.i32, shape=n)
+
+    ti.root.dense(ti.i, n).dynamic(ti.j, 4096, 32,
+                                   chunk_directory=True).place(x)
+
+    @ti.kernel
+    def append():
+        for k in range(n * m):
+            ti.append(x.parent(), k % n, k // n)
+
+    @ti.kernel
+    def reduce():
+        for i in range(n):
+            l[i] = ti.length(x.parent(), i)
+            for j in range(l[i]):
+                total[i] += x[i, j]
+
+    append()
+    reduce()
+    for i in range(n):
+        assert l[i] == m
+        assert total[i] == m * (m - 1) // 2
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def test_chunk_directory_activate_and_deactivate():
+    x = ti.field(ti.i32)
+    l = ti.field(ti.i32, shape=())
+    block = ti.root.dynamic(ti.i, 1024, 16, chunk_directory=True)
+    block.place(x)
+
+    @ti.kernel
+    def fill():
+        x[500] = 42
+        x[10] = 43
+
+    @ti.kernel
+    def append(k: ti.i32):
+        for i in range(k):
+            ti.append(block, [], i)
+
+    @ti.kernel
+    def get_length():
+        l[None] = ti.length(block, [])
+
+    fill()
+    get_length()
+    assert l[None] == 501
+    assert x[500] == 42
+    assert x[10] == 43
+    assert x[11] == 0
+
+    block.deactivate_all()
+    get_length()
+    assert l[None] == 0
+    append(100)
+    get_length()
+    assert l[None] == 100
+    assert sorted(x[i] for i in range(100)) == list(range(100))
+
+
+@ti.test(arch=ti.cuda)
+def test_warp_aggregated_append():
+    n = 4
+    m = 4096
+    x = ti.field(ti.i32)
+    l = ti.field(ti.i32, shape=n)
+    total = ti.field(ti.i32, shape=n)
+    ti.root.dense(ti.i, n).dynamic(ti.j, m, 32).place(x)
+
+    @ti.kernel
+    def append():
+        # Neighbouring threads of a warp append to different lists.
+        for i in range(n * m):
+            ti.append(x.parent(), i % n, i // n)
+
+    @ti.kernel
+    def reduce():
+        for i in range(n):
+            l[i] = ti.length(x.parent(), i)
+            for j in range(l[i]):
+                total[i] += x[i, j]
+
+    append()
+    reduce()
+    for i in range(n):
+        assert l[i] == m
+        assert total[i] == m * (m - 1) // 2
@@ -0,0 +1,65 @@
+import os
+import shutil
+import subprocess
+import tempfile
+
+import taichi as ti
+
+MAIN_SOURCE = r'''
+#include <stdio.h>
+#include "lib.h"
+
+static struct Ti_S0root root;
+static Ti_i8 gtmp[Ti_GTMP_SIZE];
+
+int main(void) {
+  union Ti_BitCast args[Ti_NUM_ARGS];
+  int earg[Ti_NUM_EARGS];
+  struct Ti_Context ctx;
+  Ti_init_context(&ctx, &root, gtmp, args, earg);
+  if (Ti_num_kernels != 2)
+    return 1;
+  args[0].val_i32 = 2;
+  Ti_kernels[0](&ctx);
+  Ti_kernels[1](&ctx);
+  printf("%d\n", args[0].val_i32);
+  return 0;
+}
+'''
+
+
+@ti.test(arch=ti.cc)
+def test_export_cc():
+    x = ti.field(ti.i32, shape=8)
+
+    @ti.kernel
+    def fill(v: ti.i32):
+        for i in x:
+            x[i] = v + i
+
+    @ti.kernel
+    def total() -> ti.i32:
+        s = 0
+        for i in x:
+            s += x[i]
+        return s
+
+    fill(1)
+    assert total() == 36
+
+    if shutil.which('gcc') is None:
+        return
+    d = tempfile.mkdtemp()
+    try:
+        ti.export_cc(os.path.join(d, 'lib.c'), os.path.join(d, 'lib.h'))
+        with open(os.path.join(d, 'main.c'), 'w') as f:
+            f.write(MAIN_SOURCE)
+        exe = os.path.join(d, 'main')
+        subprocess.check_call([
+            'gcc', '-o', exe,
+            os.path.join(d, 'main.c'),
+            os.path.join(d, 'lib.c'), '-lm'
+        ])
+        assert subprocess.check_output([exe]).decode().strip() == '44'
+    finally:
+        shutil.rmtree(d)
@@ -0,0 +1,70 @@
+import taichi as ti
+
+
+def alternating_sum(k, n):
+    # Builds one expression of depth n at trace time.
+    s = k * 0
+    for i in range(n):
+        s = s + (k + i) * (1 - i % 2 * 2)
+    return s
+
+
+@ti.test()
+def test_long_expression():
+    n = 2000
+    x = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def run(k: ti.i32):
+        x[None] = alternating_sum(k, n)
+
+    run(3)
+    assert x[None] == sum((3 + i) * (1 - i % 2 * 2) for i in range(n))
+
+
+@ti.test()
+def test_shared_subexpressions():
+    x = ti.field(ti.f32, shape=4)
+
+    @ti.kernel
+    def run(a: ti.f32):
+        b = a + 1
+        c = b * b
+        # |c| and |d| are built in one batch with |c| used twice.
+        d = (c + c) - ti.sqrt(c) + ti.cast(b, ti.i32) * -b
+        x[0] = d
+        x[1] = ti.select(a > 0, c, -c)
+        x[2] = ti.max(ti.min(a, 2.0), -2.0)
+        x[3] = ti.atan2(a, 1.0) * 0 + ti.floor(a * 1.5)
+
+    run(2.0)
+    assert x[0] == 18 - 3 - 9
+    assert x[1] == 9
+    assert x[2] == 2
+    assert x[3] == 3
+    run(-4.0)
+    assert x[0] == 18 - 3 - 9
+    assert x[1] == -9
+    assert x[2] == -2
+    assert x[3] == -6
+
+
+@ti.test()
+def test_transformed_kernel_reuse():
+    from taichi.lang.kernel import _transformed_kernels
+    a = ti.field(ti.i32, shape=8)
+    b = ti.field(ti.i32, shape=8)
+
+    @ti.kernel
+    def fill(x: ti.template(), k: ti.i32):
+        for i in x:
+            x[i] = i * k
+
+    fill(a, 2)
+    num_transformed = len(_transformed_kernels)
+    fill(b, 3)
+    # The instantiations share the transformed code.
+    assert len(_transformed_kernels) == num_transformed
+    for i in range(8):
+        assert a[i] == i * 2
+        assert b[i] == i * 3
@@ -0,0 +1,86 @@
+import taichi as ti
+import numpy as np
+from pytest import approx
+
+
+@ti.test(arch=[ti.cpu, ti.cuda, ti.metal])
+def test_f16_store_load():
+    x = ti.field(ti.f16, shape=4)
+    y = ti.field(ti.f32, shape=4)
+
+    @ti.kernel
+    def foo():
+        for i in x:
+            x[i] = i * 0.25 + 1
+        for i in x:
+            y[i] = x[i] * x[i]
+
+    foo()
+    for i in range(4):
+        assert x[i] == i * 0.25 + 1
+        assert y[i] == approx((i * 0.25 + 1)**2)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda, ti.metal])
+def test_f16_rounding():
+    x = ti.field(ti.f16, shape=())
+
+    @ti.kernel
+    def store(v: ti.f32):
+        x[None] = v
+
+    store(1 / 3)
+    assert x[None] == np.float32(np.float16(1 / 3))
+    store(65504)
+    assert x[None] == 65504
+    store(1e5)
+    assert x[None] == float('inf')
+
+
+@ti.test(arch=[ti.cpu, ti.cuda, ti.metal])
+def test_f16_arg_ret():
+    @ti.kernel
+    def half_of(v: ti.f16) -> ti.f16:
+        return v / 2
+
+    assert half_of(3) == 1.5
+    assert half_of(1 / 3) == np.float32(np.float16(1 / 6))
+
+
+@ti.test(arch=[ti.cpu, ti.cuda, ti.metal])
+def test_f16_numpy():
+    n = 16
+    x = ti.field(ti.f16, shape=n)
+    arr = np.arange(n, dtype=np.float16) / 8
+    x.from_numpy(arr)
+    res = x.to_numpy()
+    assert res.dtype == np.float32
+    assert np.all(res == arr.astype(np.float32))
+
+
+@ti.test(arch=[ti.cpu, ti.cuda, ti.metal])
+def test_f16_ext_arr():
+    n = 8
+
+    @ti.kernel
+    def double(a: ti.ext_arr()):
+        for i in range(n):
+            a[i] = a[i] * 2
+
+    arr = np.arange(n, dtype=np.float16) / 4
+    double(arr)
+    assert np.all(arr == np.arange(n, dtype=np.float16) / 2)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_f16_atomic_add():
+    x = ti.field(ti.f16, shape=2)
+
+    @ti.kernel
+    def foo():
+        for i in range(64):
+            x[i % 2] += 0.5
+
+    foo()
+    assert x[0] == 16
+    assert x[1] == 16
@@ -0,0 +1,87 @@
+import pytest
+
+import taichi as ti
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_fields_builder_after_kernel():
+    n = 16
+    x = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def fill_x():
+        for i in x:
+            x[i] = i
+
+    fill_x()
+
+    fb = ti.FieldsBuilder()
+    y = ti.field(ti.i32)
+    z = ti.field(ti.f32)
+    fb.dense(ti.i, n).place(y)
+    fb.pointer(ti.i, n // 4).dense(ti.i, 4).place(z)
+    fb.finalize()
+
+    @ti.kernel
+    def copy():
+        for i in x:
+            y[i] = x[i] * 2
+        for i in range(n // 2):
+            z[i] = x[i] + 0.5
+
+    copy()
+    # The kernel compiled before still runs.
+    fill_x()
+    for i in range(n):
+        assert x[i] == i
+        assert y[i] == i * 2
+        assert z[i] == (i + 0.5 if i < n // 2 else 0)
+
+    @ti.kernel
+    def count_z() -> ti.i32:
+        s = 0
+        for i in z:
+            s += 1
+        return s
+
+    assert count_z() == n // 2
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_fields_builder_multiple_trees():
+    x = ti.field(ti.i32, shape=4)
+    x[0] = 1
+
+    fields = []
+    for k in range(3):
+        fb = ti.FieldsBuilder()
+        f = ti.field(ti.i32)
+        fb.dense(ti.ij, (4, k + 1)).place(f)
+        fb.finalize()
+        fields.append(f)
+
+    @ti.kernel
+    def fill(f: ti.template(), v: ti.i32):
+        for i, j in f:
+            f[i, j] = v + i * 10 + j
+
+    for k, f in enumerate(fields):
+        fill(f, k * 100)
+    for k, f in enumerate(fields):
+        for i in range(4):
+            for j in range(k + 1):
+                assert f[i, j] == k * 100 + i * 10 + j
+    assert x[0] == 1
+
+
+@ti.test(arch=ti.cpu)
+def test_fields_builder_finalized():
+    fb = ti.FieldsBuilder()
+    x = ti.field(ti.f32)
+    fb.dense(ti.i, 4).place(x)
+    fb.finalize()
+    with pytest.raises(RuntimeError, match='finalized'):
+        fb.dense(ti.i, 4)
+    # Fields with a shape still go to ti.root.
+    with pytest.raises(RuntimeError, match='declared after'):
+        ti.field(ti.f32, shape=4)
@@ -68,3 +68,35 @@ def test_fill_matrix_matrix():
             for p in range(2):
                 for q in range(3):
                     assert val[i, j][p, q] == mat.get_entry(p, q)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_fill_memory_dtypes():
+    # These fields take the memset path of fill().
+    n = 1003
+    fields = {
+        dt: ti.field(dt, shape=n)
+        for dt in [ti.i8, ti.i16, ti.i32, ti.i64, ti.u8, ti.f32, ti.f64]
+    }
+    for dt, x in fields.items():
+        for val in [0, 1, -1, 7]:
+            if dt == ti.u8 and val < 0:
+                continue
+            x.fill(val)
+            assert (x.to_numpy() == val).all()
+    fields[ti.f32].fill(0.5)
+    assert (fields[ti.f32].to_numpy() == 0.5).all()
+    fields[ti.i32].fill(3.7)
+    assert (fields[ti.i32].to_numpy() == 3).all()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_fill_shared_block():
+    # The fields sharing a dense block are filled cell by cell.
+    x = ti.field(ti.i32)
+    y = ti.field(ti.i32)
+    ti.root.dense(ti.i, 16).place(x, y)
+    y.fill(5)
+    x.fill(3)
+    assert (x.to_numpy() == 3).all()
+    assert (y.to_numpy() == 5).all()
@@ -36,3 +36,66 @@ def test_no_fuse_sigs_mismatch():
     x = x.to_numpy()
     for i in range(n):
         assert x[i] == i * repeat + ((repeat - 1) * repeat // 2)
+
+
+@ti.test(require=ti.extension.async_mode, async_mode=True)
+def test_fuse_long_chain():
+    n = 1024
+    m = 16
+    x = ti.field(ti.i32, shape=(n, ))
+    ys = [ti.field(ti.i32, shape=(n, )) for _ in range(m)]
+
+    @ti.kernel
+    def inc(f: ti.template()):
+        for i in f:
+            f[i] += 1
+
+    inc(x)
+    ti.sync()
+    stats = ti.get_kernel_stats()
+    stats.clear()
+
+    repeat = 100
+    for _ in range(repeat):
+        inc(x)
+    # Independent tasks are fused as well.
+    for y in ys:
+        inc(y)
+    ti.sync()
+
+    # All the tasks are fused within one synchronization.
+    counters = stats.get_counters()
+    assert int(counters['launched_tasks_range_for']) == 1
+    assert x.to_numpy().tolist() == [repeat + 1] * n
+    for y in ys:
+        assert y.to_numpy().tolist() == [1] * n
+
+
+@ti.test(require=ti.extension.async_mode,
+         async_mode=True,
+         async_fusion_max_statements=1)
+def test_fusion_cost_model():
+    n = 1024
+    x = ti.field(ti.i32, shape=(n, ))
+
+    @ti.kernel
+    def inc():
+        for i in x:
+            x[i] += 1
+
+    inc()
+    ti.sync()
+    stats = ti.get_kernel_stats()
+    stats.clear()
+
+    repeat = 10
+    for _ in range(repeat):
+        inc()
+    ti.sync()
+
+    # Every fused task would exceed the statement budget.
+    counters = stats.get_counters()
+    assert int(counters['launched_tasks_range_for']) == repeat
+    assert int(counters['sfg_fusions_rejected']) > 0
+    assert 'sfg_fusions_accepted' not in counters
+    assert x.to_numpy().tolist() == [repeat + 1] * n
@@ -129,3 +129,204 @@ def test_fuse_allocator_state():
     for i, y in enumerate(ys):
         expected = N if i == N else 0
         assert y == expected
+
+
+@ti.test(require=ti.extension.sparse, cpu_max_num_threads=4)
+def test_pointer_gc_many_nodes():
+    # Enough recycled nodes to take the parallel GC path on CPU
+    N = 128
+    x = ti.field(dtype=ti.i32)
+
+    L = ti.root.pointer(ti.ij, N)
+    L.dense(ti.ij, 4).place(x)
+
+    @ti.kernel
+    def activate(v: ti.i32, offset: ti.i32):
+        for i, j in ti.ndrange(N, N):
+            x[i * 4 + offset, j * 4 + offset] = v
+
+    @ti.kernel
+    def count() -> ti.i32:
+        s = 0
+        for i, j in x:
+            s += x[i, j]
+        return s
+
+    for k in range(3):
+        activate(k + 1, 0)
+        assert count() == N * N * (k + 1)
+        L.deactivate_all()
+        # Recycled nodes are zero-filled before being reused.
+        activate(0, 1)
+        assert count() == 0
+        L.deactivate_all()
+        assert L.num_dynamically_allocated == N * N
+
+
+@ti.test(require=ti.extension.sparse, kernel_profiler=True)
+def test_kernel_profiler_gc_time():
+    x = ti.field(dtype=ti.i32)
+
+    L = ti.root.pointer(ti.i, 64)
+    L.dense(ti.i, 8).place(x)
+
+    ti.kernel_profiler_clear()
+    for i in range(8):
+        x[i * 8] = 1
+        L.deactivate_all()
+    ti.sync()
+    gc_time = ti.kernel_profiler_gc_time()
+    assert 0 <= gc_time <= ti.kernel_profiler_total_time()
+
+
+@ti.test(require=ti.extension.sparse)
+def test_gc_policy_threshold():
+    x = ti.field(dtype=ti.i32)
+
+    L = ti.root.pointer(ti.i, 64).gc_policy(threshold=1.0)
+    L.dense(ti.i, 8).place(x)
+
+    @ti.kernel
+    def deactivate(i: ti.i32):
+        ti.deactivate(L, i)
+
+    x[0] = 1
+    x[8] = 1
+    assert L.num_dynamically_allocated == 2
+    # Only half of the nodes are recycled, so GC is skipped and the block
+    # cannot be reused yet.
+    deactivate(0)
+    x[0] = 1
+    assert L.num_dynamically_allocated == 3
+    assert x[0] == 1
+    # Now all the nodes are recycled.
+    L.deactivate_all()
+    x[0] = 1
+    x[8] = 1
+    x[16] = 1
+    assert L.num_dynamically_allocated == 3
+    assert x[0] == 1 and x[8] == 1 and x[16] == 1
+
+
+@ti.test(require=ti.extension.sparse)
+def test_gc_policy_period():
+    x = ti.field(dtype=ti.i32)
+
+    L = ti.root.pointer(ti.i, 64).gc_policy(threshold=1.0, period=2)
+    L.dense(ti.i, 8).place(x)
+
+    @ti.kernel
+    def deactivate(i: ti.i32):
+        ti.deactivate(L, i)
+
+    for i in range(4):
+        x[i * 8] = 1
+    deactivate(0)
+    # Skipped once, collected on the second request.
+    deactivate(8)
+    x[0] = 1
+    x[8] = 1
+    assert L.num_dynamically_allocated == 4
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def test_compact():
+    n = 1 << 16
+    x = ti.field(ti.i32)
+    s = ti.field(ti.i32, shape=())
+    ptr = ti.root.pointer(ti.i, n)
+    ptr.place(x)
+
+    @ti.kernel
+    def fill():
+        for i in range(n):
+            x[i] = i
+
+    @ti.kernel
+    def thin_out():
+        for i in x:
+            if i % 64 != 0:
+                ti.deactivate(ptr, i)
+
+    @ti.kernel
+    def count() -> ti.i32:
+        s[None] = 0
+        for i in x:
+            s[None] += 1
+            if x[i] != i:
+                s[None] -= n
+        return s[None]
+
+    fill()
+    thin_out()
+    assert ptr.num_dynamically_allocated == n
+    # The node allocator has 16K nodes per chunk: all but one are released.
+    assert ptr.compact() == 3 * (n // 4) * 4
+    assert ptr.num_dynamically_allocated == n // 64
+    assert count() == n // 64
+    for i in range(0, n, 64 * 37):
+        assert x[i] == i
+
+    # The released chunks are reused.
+    fill()
+    assert count() == n
+
+
+@ti.test(arch=ti.cpu)
+def test_trim_memory():
+    n = 1 << 16
+    x = ti.field(ti.i32)
+    ptr = ti.root.pointer(ti.i, n)
+    ptr.place(x)
+
+    @ti.kernel
+    def fill():
+        for i in range(n):
+            x[i] = i
+
+    @ti.kernel
+    def thin_out():
+        for i in x:
+            if i % 64 != 0:
+                ti.deactivate(ptr, i)
+
+    fill()
+    thin_out()
+    released = ptr.compact()
+    assert released > 0
+    assert ti.trim_memory() == released
+    # The trimmed chunks are not trimmed again.
+    assert ti.trim_memory() == 0
+
+    # Trimmed chunks are reused, and read as zeros.
+    fill()
+    for i in range(0, n, 997):
+        assert x[i] == i
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_memory_stats():
+    x = ti.field(dtype=ti.i32)
+    block = ti.root.pointer(ti.i, 64)
+    block.dense(ti.i, 8).place(x)
+
+    @ti.kernel
+    def activate(n: ti.i32):
+        for i in range(n):
+            x[i * 8] = 1
+
+    activate(32)
+    stats = block.memory_stats
+    assert stats['live_nodes'] == 32
+    assert stats['peak_live_nodes'] >= 32
+    assert stats['num_chunks'] >= 1
+    assert stats['reserved_bytes'] >= stats['live_bytes'] > 0
+    assert 0 <= stats['fragmentation'] < 1
+
+    block.deactivate_all()
+    activate(8)
+    stats = ti.memory_stats()[block.ptr.id]
+    assert stats['live_nodes'] == 8
+    assert stats['peak_live_nodes'] >= 32
+    assert stats['peak_num_chunks'] >= stats['num_chunks']
+    assert ti.memory_stats()[ti.root.ptr.id]['live_nodes'] == 0
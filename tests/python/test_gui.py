@@ -28,3 +28,83 @@ def test_save_image_without_window(dtype):
         delta = (image - i).sum()
         assert delta == 0, "Expected image difference to be 0 but got {} instead.".format(
             delta)
+
+
+@ti.host_arch_only
+def test_batched_primitives_match_single():
+    # Enough primitives for the batched draws to rasterize tiles in parallel.
+    n = 5000
+    rng = np.random.RandomState(0)
+    pos = rng.rand(n, 2).astype(np.float32)
+    radius = (rng.rand(n) * 4 + 0.5).astype(np.float32)
+    color = rng.randint(0, 0xffffff, size=n).astype(np.uint32)
+    tri = rng.rand(3, n // 10, 2).astype(np.float32) * 0.1 + pos[:n // 10]
+
+    def draw(batched):
+        gui = ti.GUI("Test", res=(300, 200), show_gui=False)
+        gui.clear(0x112233)
+        if batched:
+            gui.circles(pos, color=color, radius=radius)
+            gui.triangles(tri[0], tri[1], tri[2], color=color[:n // 10])
+        else:
+            for i in range(n):
+                gui.circle(pos[i], color=int(color[i]), radius=radius[i])
+            for i in range(n // 10):
+                gui.triangle(tri[0, i], tri[1, i], tri[2, i],
+                             color=int(color[i]))
+        return gui.get_image()
+
+    assert np.abs(draw(True) - draw(False)).max() < 1e-6
+
+
+@ti.host_arch_only
+def test_rgba8_canvas():
+    n = 200
+    rng = np.random.RandomState(0)
+    pos = rng.rand(n, 2).astype(np.float32)
+    radius = (rng.rand(n) * 4 + 0.5).astype(np.float32)
+    color = rng.randint(0, 0xffffff, size=n).astype(np.uint32)
+
+    def draw(canvas_format):
+        gui = ti.GUI("Test",
+                     res=(300, 200),
+                     show_gui=False,
+                     canvas_format=canvas_format)
+        gui.clear(0x112233)
+        gui.circles(pos, color=color, radius=radius)
+        gui.lines(pos[:n // 2], pos[n // 2:], color=0xffaa33, radius=1.5)
+        gui.triangle(pos[0], pos[1], pos[2], color=0x3366ff)
+        return gui.get_image()
+
+    # Every blend rounds to the nearest of 256 levels.
+    delta = np.abs(draw('rgba8') - draw('rgba32f'))
+    assert delta.max() < 4 / 255
+    assert delta.mean() < 0.5 / 255
+
+    pixels = rng.rand(300, 200, 3).astype(np.float32)
+    gui = ti.GUI("Test", res=(300, 200), show_gui=False, canvas_format='rgba8')
+    gui.set_image(pixels)
+    assert np.abs(gui.get_image()[:, :, :3] - pixels).max() <= 0.5 / 255 + 1e-6
+
+
+@ti.test(arch=[ti.cuda, ti.opengl])
+def test_fast_gui_device_image():
+    n = 16
+    rng = np.random.RandomState(0)
+    pixels = rng.rand(n, n, 3).astype(np.float32)
+    img = ti.Vector.field(3, ti.f32, shape=(n, n))
+    img.from_numpy(pixels)
+
+    gui = ti.GUI("Test", res=(n, n), show_gui=False, fast_gui=True)
+    gui.set_image(img)
+    # Converted on the device into the zero-copy array the window presents.
+    assert gui.device_img is not None
+
+    rgb = np.minimum(255, np.maximum(0, (pixels * 255).astype(np.int32)))
+    rgb = rgb[:, ::-1].transpose(1, 0, 2).reshape(n * n, 3)
+    expected = (rgb[:, 0] << 16) + (rgb[:, 1] << 8) + rgb[:, 2]
+    assert np.all(gui.device_img == expected.astype(np.uint32))
+
+    ti.reset()
+    gui.show()
+    assert gui.device_img is None
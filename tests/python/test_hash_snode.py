@@ -0,0 +1,93 @@
+import taichi as ti
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def test_hash_struct_for():
+    x = ti.field(ti.i32)
+    s = ti.field(ti.i32, shape=())
+    n = 1 << 14
+
+    ti.root.hash(ti.ij, (n, n), capacity=64).dense(ti.ij, 4).place(x)
+
+    x[0, 0] = 1
+    x[n * 4 - 1, 7] = 2
+    x[12345, 54321] = 3
+
+    @ti.kernel
+    def func():
+        for i, j in x:
+            s[None] += 1 + x[i, j] * 10
+
+    func()
+    # Three 4x4 blocks are active.
+    assert s[None] == 3 * 16 + 60
+    assert x[12345, 54321] == 3
+    assert x[12344, 54320] == 0
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def test_hash_parallel_activate():
+    x = ti.field(ti.i32)
+    s = ti.field(ti.i32, shape=())
+    n = 1 << 20
+    m = 1000
+
+    ti.root.hash(ti.i, n, capacity=2048).place(x)
+
+    @ti.kernel
+    def fill():
+        for k in range(m * 8):
+            # Many threads activate the same children concurrently.
+            ti.atomic_add(x[(k % m) * 997], 1)
+
+    @ti.kernel
+    def count():
+        for i in x:
+            s[None] += x[i]
+
+    fill()
+    count()
+    assert s[None] == m * 8
+    for k in range(0, m, 97):
+        assert x[k * 997] == 8
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def test_hash_deactivate():
+    x = ti.field(ti.i32)
+    s = ti.field(ti.i32, shape=())
+    n = 1 << 16
+
+    block = ti.root.hash(ti.i, n, capacity=64)
+    block.place(x)
+
+    @ti.kernel
+    def activate():
+        for i in range(32):
+            x[i * 1000] = 1
+
+    @ti.kernel
+    def deactivate():
+        for i in x:
+            if i % 2000 == 0:
+                ti.deactivate(block, i)
+
+    @ti.kernel
+    def count():
+        s[None] = 0
+        for i in range(n):
+            s[None] += ti.is_active(block, i)
+
+    activate()
+    count()
+    assert s[None] == 32
+    deactivate()
+    count()
+    assert s[None] == 16
+    assert x[1000] == 1
+    assert x[2000] == 0
+
+    # The deactivated children reuse their slots.
+    activate()
+    count()
+    assert s[None] == 32
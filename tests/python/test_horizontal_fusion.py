@@ -0,0 +1,99 @@
+import taichi as ti
+
+
+@ti.test(horizontal_fusion_max_iterations=4096)
+def test_boundary_loops():
+    n = 64
+    x = ti.field(ti.f32, shape=(n, n))
+    y = ti.field(ti.f32, shape=n)
+    z = ti.field(ti.f32, shape=n)
+
+    @ti.kernel
+    def set_boundary():
+        for j in range(n):
+            x[0, j] = 1
+        for j in range(n):
+            x[n - 1, j] = 2
+        for i in range(1, n - 1):
+            y[i] = i
+        for i in range(3, 5):
+            if i == 4:
+                continue
+            z[i] = -i
+
+    set_boundary()
+    for j in range(n):
+        assert x[0, j] == 1
+        assert x[n - 1, j] == 2
+    assert y[0] == 0
+    assert y[1] == 1
+    assert y[3] == 3
+    assert z[3] == -3
+    assert z[4] == 0
+    assert y[n - 1] == 0
+
+
+@ti.test(horizontal_fusion_max_iterations=4096)
+def test_dependent_loops():
+    n = 16
+    x = ti.field(ti.i32, shape=n)
+    y = ti.field(ti.i32, shape=n)
+    s = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def run():
+        for i in range(n):
+            x[i] = i
+        for i in range(n):
+            y[i] = x[n - 1 - i]
+        for i in range(n):
+            s[None] += y[i]
+        for i in range(n):
+            s[None] += 1
+
+    run()
+    for i in range(n):
+        assert y[i] == n - 1 - i
+    assert s[None] == n * (n - 1) // 2 + n
+
+
+@ti.test(horizontal_fusion_max_iterations=8)
+def test_max_iterations():
+    x = ti.field(ti.i32, shape=20)
+
+    @ti.kernel
+    def run():
+        for i in range(4):
+            x[i] = 1
+        for i in range(4, 8):
+            x[i] = 2
+        for i in range(8, 20):
+            x[i] = 3
+
+    run()
+    for i in range(20):
+        assert x[i] == (1 if i < 4 else 2 if i < 8 else 3)
+
+
+@ti.test(serial_fusion_max_statements=32)
+def test_serial_tasks():
+    n = 32
+    x = ti.field(ti.i32, shape=n)
+    s = ti.field(ti.i32, shape=())
+    t = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def run(k: ti.i32):
+        s[None] = k
+        for i in range(n):
+            x[i] = i * k
+        t[None] = x[n - 1] + 1
+        for i in range(4):
+            x[i] += s[None]
+
+    for k in range(1, 4):
+        run(k)
+        assert s[None] == k
+        assert t[None] == (n - 1) * k + 1
+        assert x[0] == k
+        assert x[n - 1] == (n - 1) * k
@@ -85,3 +85,46 @@ def test_image_resize_sum(resx, resy, comp, scale):
     else:
         new_img = ti.imresize(old_img, resx * scale, resy * scale)
     assert np.sum(old_img) * scale**2 == ti.approx(np.sum(new_img))
+
+
+@ti.host_arch_only
+def test_frame_writer():
+    shape = (91, 81, 3)
+    pixels = [
+        np.random.randint(256, size=shape, dtype=np.uint8) for _ in range(6)
+    ]
+    first = pixels[0].copy()
+    fns = [make_temp_file(suffix='.png') for _ in pixels]
+    with ti.FrameWriter(num_threads=2, max_queued_frames=2) as writer:
+        for pixel, fn in zip(pixels, fns):
+            writer.write(pixel, fn)
+        # The frames are copied when queued.
+        pixels[0][:] = 0
+        writer.flush()
+        assert (ti.imread(fns[-1]) == pixels[-1]).all()
+    assert (ti.imread(fns[0]) == first).all()
+    for fn in fns:
+        os.remove(fn)
+
+
+@pytest.mark.parametrize('comp', [1, 3, 4])
+@ti.host_arch_only
+def test_imread_batch(comp):
+    shape = (61, 43, comp)
+    pixels = [
+        np.random.randint(256, size=shape, dtype=np.uint8) for _ in range(5)
+    ]
+    fns = [make_temp_file(suffix='.png') for _ in pixels]
+    for pixel, fn in zip(pixels, fns):
+        ti.imwrite(pixel, fn)
+    stack = ti.imread_batch(fns)
+    assert stack.shape == (5, ) + shape
+    for k, fn in enumerate(fns):
+        assert (stack[k] == ti.imread(fn)).all()
+
+    out = np.zeros((7, ) + shape, dtype=np.uint8)
+    ti.imread_batch(fns[1:3], out=out[2:4])
+    assert (out[2:4] == stack[1:3]).all()
+    assert (out[:2] == 0).all() and (out[4:] == 0).all()
+    for fn in fns:
+        os.remove(fn)
@@ -0,0 +1,61 @@
+import math
+
+import taichi as ti
+from taichi import approx
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], fast_math=True)
+def test_fast_math_per_kernel():
+    x = ti.field(ti.f32, shape=())
+    y = ti.field(ti.f32, shape=2)
+
+    @ti.kernel
+    def fast():
+        y[0] = x[None] * 0
+
+    @ti.kernel(fast_math=False)
+    def strict():
+        y[1] = x[None] * 0
+
+    x[None] = math.inf
+    fast()
+    strict()
+    # Only fast math simplifies a * 0 into 0.
+    assert y[0] == 0
+    assert math.isnan(y[1])
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], fast_math=False)
+def test_fp_contract():
+    x = ti.field(ti.f32, shape=8)
+
+    @ti.kernel(fp_contract=True)
+    def axpy(a: ti.f32):
+        for i in x:
+            x[i] = a * x[i] + 1
+
+    for i in range(8):
+        x[i] = i
+    axpy(2)
+    for i in range(8):
+        assert x[i] == 2 * i + 1
+
+
+@ti.test(arch=[ti.cuda, ti.metal])
+def test_approx_math():
+    n = 64
+    x = ti.field(ti.f32, shape=n)
+    y = ti.field(ti.f32, shape=n)
+
+    @ti.kernel(approx_math=True)
+    def run():
+        for i in x:
+            y[i] = ti.exp(x[i]) + ti.sin(x[i]) + ti.rsqrt(x[i] + 1)
+
+    for i in range(n):
+        x[i] = i / n
+    run()
+    for i in range(n):
+        v = i / n
+        expected = math.exp(v) + math.sin(v) + 1 / math.sqrt(v + 1)
+        assert y[i] == approx(expected, rel=1e-4)
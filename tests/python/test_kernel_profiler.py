@@ -0,0 +1,143 @@
+import json
+import os
+import tempfile
+
+import taichi as ti
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], kernel_profiler=True)
+def test_kernel_profiler_dump_trace():
+    x = ti.field(ti.f32, shape=16)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 2.0
+
+    ti.kernel_profiler_clear()
+    for _ in range(3):
+        fill()
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'trace.json')
+        ti.kernel_profiler_dump_trace(path)
+        with open(path) as f:
+            events = json.load(f)['traceEvents']
+
+    events = [e for e in events if e['name'].startswith('fill')]
+    assert len(events) == 3
+    for e in events:
+        assert e['ph'] == 'X'
+        assert e['cat'] == 'range_for'
+        assert e['dur'] >= 0
+    assert events[0]['ts'] <= events[1]['ts'] <= events[2]['ts']
+
+    ti.kernel_profiler_clear()
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'trace.json')
+        ti.kernel_profiler_dump_trace(path)
+        with open(path) as f:
+            assert json.load(f)['traceEvents'] == []
+
+
+@ti.test(arch=[ti.cpu, ti.cuda],
+         kernel_profiler=True,
+         kernel_profiler_sampling_interval=4)
+def test_kernel_profiler_sampling():
+    x = ti.field(ti.f32, shape=16)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 2.0
+
+    ti.kernel_profiler_clear()
+    for _ in range(10):
+        fill()
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'trace.json')
+        ti.kernel_profiler_dump_trace(path)
+        with open(path) as f:
+            events = json.load(f)['traceEvents']
+
+    # The 1st, 5th and 9th launches are timed.
+    events = [e for e in events if e['name'].startswith('fill')]
+    assert len(events) == 3
+    assert ti.kernel_profiler_total_time() > 0
+
+
+@ti.test(arch=ti.cpu,
+         kernel_profiler=True,
+         kernel_profiler_hardware_counters=True)
+def test_kernel_profiler_hardware_counters():
+    x = ti.field(ti.f32, shape=1024)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 2.0
+
+    # The counters may be unavailable in the sandbox, in which case only the
+    # times are recorded.
+    fill()
+    ti.kernel_profiler_print()
+    assert ti.kernel_profiler_total_time() > 0
+
+
+@ti.test(arch=[ti.cpu, ti.cuda],
+         kernel_profiler=True,
+         kernel_profiler_peak_bandwidth=100.0)
+def test_kernel_profiler_bytes_per_launch():
+    n = 1024
+    x = ti.field(ti.f32, shape=n)
+    y = ti.field(ti.f32, shape=n)
+    s = ti.field(ti.f32, shape=())
+
+    @ti.kernel
+    def saxpy():
+        for i in x:
+            y[i] += 2.0 * x[i]
+
+    @ti.kernel
+    def reduce():
+        for i in x:
+            s[None] += x[i]
+
+    saxpy()
+    reduce()
+    ti.kernel_profiler_print()
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'trace.json')
+        ti.kernel_profiler_dump_trace(path)
+        with open(path) as f:
+            events = json.load(f)['traceEvents']
+
+    bytes = {}
+    for e in events:
+        for name in ['saxpy', 'reduce']:
+            if e['name'].startswith(name) and e['cat'] == 'range_for':
+                bytes[name] = e['args']['bytes']
+    # Read x and y, write y.
+    assert bytes['saxpy'] == n * 4 * 3
+    # Read x, read and write s once.
+    assert bytes['reduce'] == n * 4 + 4 * 2
+
+
+@ti.test(arch=ti.cuda, kernel_profiler=True, cuda_max_registers=32)
+def test_kernel_profiler_resource_usage(capfd):
+    x = ti.field(ti.f32, shape=1024)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = ti.sin(i * 0.1)
+
+    fill()
+    capfd.readouterr()
+    ti.kernel_profiler_print()
+    out, _ = capfd.readouterr()
+    assert 'spill stores (B)' in out
+    for line in out.splitlines():
+        if line.startswith('[') and 'fill' in line and 'spill' not in line:
+            fields = line[1:line.index(']')].split()
+            if len(fields) == 3:
+                assert 0 < int(fields[0]) <= 32
@@ -0,0 +1,72 @@
+import os
+import tempfile
+
+import taichi as ti
+
+n = 1024
+
+
+def _define_fields():
+    a, b, c, d = [ti.field(ti.f32) for _ in range(4)]
+    ti.root.dense(ti.i, n).place(a, b, c, d)
+    return a, b, c, d
+
+
+def _run(a, b, c, d):
+    @ti.kernel
+    def fill():
+        for i in range(n):
+            a[i] = i
+            c[i] = 2 * i
+
+    @ti.kernel
+    def step_ab():
+        for i in range(n):
+            b[i] = a[i] + 1
+
+    @ti.kernel
+    def step_cd():
+        for i in range(n):
+            d[i] = c[i] + 1
+
+    fill()
+    for _ in range(3):
+        step_ab()
+        step_cd()
+    for i in range(0, n, 97):
+        assert b[i] == i + 1
+        assert d[i] == 2 * i + 1
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], layout_advisor=True)
+def test_layout_advice():
+    fields = _define_fields()
+    _run(*fields)
+    lines = ti.layout_advice().splitlines()
+    current = [l for l in lines if 'current:' in l][0]
+    proposed = [l for l in lines if 'proposed:' in l][0]
+    assert current.count('[') == 1
+    # The fill kernel accesses a and c together, so all the four fields
+    # differ in which tasks access them.
+    assert proposed.count('[') == 4
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_layout_profile():
+    arch = ti.cfg.arch
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'layout.txt')
+
+        ti.init(arch=arch, layout_advisor=True, layout_profile=path)
+        fields = _define_fields()
+        _run(*fields)
+        # Writes the profile.
+        ti.reset()
+        assert os.path.exists(path)
+
+        ti.init(arch=arch, layout_profile=path)
+        a, b, c, d = _define_fields()
+        _run(a, b, c, d)
+        assert a.snode.parent() != b.snode.parent()
+        assert c.snode.parent() != d.snode.parent()
+        assert a.shape == b.shape == (n, )
@@ -58,3 +58,157 @@ def test_nested_3d():
     for _ in range(1000):
         i, j, k = randrange(n), randrange(n), randrange(n)
         assert x[i, j, k] == (i * n + j) * n + k
+
+
+@ti.test(require=ti.extension.sparse)
+def test_listgen_deep_sparse():
+    x = ti.field(ti.i32)
+    s = ti.field(ti.i32, shape=())
+    num_wrong = ti.field(ti.i32, shape=())
+
+    # Mixed pointer/bitmasked levels whose children span several mask words
+    ti.root.pointer(ti.ij, 4).bitmasked(ti.ij, 16).pointer(ti.ij, 8).bitmasked(
+        ti.ij, 4).place(x)
+    n = 4 * 16 * 8 * 4
+
+    coords = set()
+    for _ in range(64):
+        coords.add((randrange(n), randrange(n)))
+
+    for i, j in coords:
+        x[i, j] = i * n + j
+
+    @ti.kernel
+    def count() -> ti.i32:
+        s[None] = 0
+        for i, j in x:
+            s[None] += 1
+            if x[i, j] != i * n + j:
+                num_wrong[None] += 1
+        return s[None]
+
+    assert count() == len(coords)
+    assert num_wrong[None] == 0
+
+    # Deactivation must be reflected in the occupancy masks as well
+    deactivated_blocks = set((i // 4, j // 4) for i, j in list(coords)[::2])
+
+    @ti.kernel
+    def deactivate(i: ti.i32, j: ti.i32):
+        ti.deactivate(x.snode.parent(2), [i, j])
+
+    for bi, bj in deactivated_blocks:
+        deactivate(bi * 4, bj * 4)
+    remaining = [(i, j) for i, j in coords
+                 if (i // 4, j // 4) not in deactivated_blocks]
+    assert count() == len(remaining)
+    assert num_wrong[None] == 0
+
+    x.snode.parent(4).deactivate_all()
+    assert count() == 0
+
+
+@ti.test(require=ti.extension.sparse, cpu_max_num_threads=4)
+def test_listgen_many_blocks():
+    x = ti.field(ti.i32)
+    # Enough active blocks for the CPU listgen to run on the thread pool
+    ti.root.pointer(ti.i, 64).pointer(ti.i, 256).dense(ti.i, 8).place(x)
+    n = 64 * 256 * 8
+
+    @ti.kernel
+    def activate():
+        for i in range(n):
+            if i // 8 % 3 == 0:
+                x[i] = i
+
+    @ti.kernel
+    def count() -> ti.i32:
+        s = 0
+        for i in x:
+            s += 1
+            if x[i] != i:
+                s += n
+        return s
+
+    activate()
+    assert count() == sum(8 for b in range(n // 8) if b % 3 == 0)
+
+
+@ti.test(require=ti.extension.sparse, incremental_listgen=True)
+def test_incremental_listgen():
+    x = ti.field(ti.i32)
+    n = 32
+
+    block = ti.root.pointer(ti.i, n)
+    block.bitmasked(ti.i, 8).place(x)
+
+    @ti.kernel
+    def count() -> ti.i32:
+        s = 0
+        for i in x:
+            s += 1
+        return s
+
+    @ti.kernel
+    def sum_x() -> ti.i32:
+        s = 0
+        for i in x:
+            s += x[i]
+        return s
+
+    @ti.kernel
+    def deactivate_leaf(i: ti.i32):
+        ti.deactivate(x.snode.parent(), i)
+
+    active = set()
+    for step in range(10):
+        # Shift the active set a little every step
+        for k in range(3):
+            i = (step * 17 + k * 5) % (n * 8)
+            x[i] = 1
+            active.add(i)
+        if step % 2 == 1:
+            i = min(active)
+            deactivate_leaf(i)
+            active.remove(i)
+        # Unchanged structure: the lists are reused
+        for _ in range(2):
+            assert count() == len(active)
+            assert sum_x() == len(active)
+
+    block.deactivate_all()
+    assert count() == 0
+
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], skip_dense_listgen=True)
+def test_skip_dense_listgen():
+    x = ti.field(ti.i32)
+    num_wrong = ti.field(ti.i32, shape=())
+    ptr = ti.root.pointer(ti.ij, (3, 5))
+    ptr.dense(ti.ij, (4, 2)).dense(ti.i, 3).place(x)
+    assert x.shape == (36, 10)
+
+    @ti.kernel
+    def fill(bi: ti.i32, bj: ti.i32):
+        # The cells of a pointer cell span 4 bits of i and 1 bit of j.
+        for i, j in ti.ndrange((bi * 16, bi * 16 + 16), (bj * 2, bj * 2 + 2)):
+            if i < 36:
+                x[i, j] = i * 100 + j
+
+    @ti.kernel
+    def count() -> ti.i32:
+        s = 0
+        for i, j in x:
+            s += 1
+            if x[i, j] != i * 100 + j:
+                num_wrong[None] += 1
+        return s
+
+    active_blocks = [(0, 0), (1, 3), (2, 4)]
+    for bi, bj in active_blocks:
+        fill(bi, bj)
+    expected = sum(1 for i in range(36) for j in range(10)
+                   if (i // 16, j // 2) in active_blocks)
+    assert count() == expected
+    assert num_wrong[None] == 0
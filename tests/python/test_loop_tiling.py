@@ -0,0 +1,68 @@
+import taichi as ti
+
+
+@ti.test(arch=ti.cpu, cpu_tile_shape=(4, 8))
+def test_loop_tiling_2d():
+    n, m = 37, 53
+    x = ti.field(ti.i32, shape=(n, m))
+    count = ti.field(ti.i32, shape=(n, m))
+
+    @ti.kernel
+    def fill():
+        for i, j in x:
+            x[i, j] = i * 100 + j
+            count[i, j] += 1
+
+    fill()
+    for i in range(n):
+        for j in range(m):
+            assert x[i, j] == i * 100 + j
+            assert count[i, j] == 1
+
+
+@ti.test(arch=ti.cpu, cpu_tile_shape=(2, 4, 8))
+def test_loop_tiling_3d_stencil():
+    n = 20
+    a = ti.field(ti.f32, shape=(n, n, n))
+    b = ti.field(ti.f32, shape=(n, n, n))
+
+    @ti.kernel
+    def init():
+        for i, j, k in a:
+            a[i, j, k] = i * 4 + j * 2 + k
+
+    @ti.kernel
+    def laplace():
+        for i, j, k in b:
+            if 0 < i < n - 1 and 0 < j < n - 1 and 0 < k < n - 1:
+                b[i, j, k] = (a[i - 1, j, k] + a[i + 1, j, k] +
+                              a[i, j - 1, k] + a[i, j + 1, k] +
+                              a[i, j, k - 1] + a[i, j, k + 1] -
+                              6 * a[i, j, k])
+            else:
+                b[i, j, k] = a[i, j, k]
+
+    init()
+    laplace()
+    for i in range(n):
+        for j in range(n):
+            for k in range(n):
+                if 0 < i < n - 1 and 0 < j < n - 1 and 0 < k < n - 1:
+                    assert b[i, j, k] == 0
+                else:
+                    assert b[i, j, k] == i * 4 + j * 2 + k
+
+
+@ti.test(arch=ti.cpu, cpu_tile_shape=(4, 4))
+def test_loop_tiling_other_dimensionality():
+    # Only the 2D loops are tiled.
+    x = ti.field(ti.i32, shape=100)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i
+
+    fill()
+    for i in range(100):
+        assert x[i] == i
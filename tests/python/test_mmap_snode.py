@@ -0,0 +1,65 @@
+import os
+import tempfile
+
+import pytest
+
+import taichi as ti
+
+
+def _layout(path, writable, n=1 << 16):
+    x = ti.field(ti.i32)
+    y = ti.field(ti.f32)
+    ti.root.dense(ti.i, 4).place(y)
+    ti.root.dense(ti.i, n).mmap_file(path, writable=writable,
+                                     advice='sequential').place(x)
+    return x, y
+
+
+@ti.test(arch=ti.cpu)
+def test_mmap_file():
+    n = 1 << 16
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'x.bin')
+        x, y = _layout(path, writable=True)
+
+        @ti.kernel
+        def fill():
+            for i in x:
+                x[i] = i * 3
+            for i in y:
+                y[i] = i
+
+        fill()
+        assert x[n - 1] == (n - 1) * 3
+        assert y[3] == 3
+
+        ti.init(arch=ti.cpu)
+        x, y = _layout(path, writable=False)
+
+        @ti.kernel
+        def total() -> ti.i64:
+            s = ti.cast(0, ti.i64)
+            for i in x:
+                s += x[i]
+            return s
+
+        assert total() == 3 * n * (n - 1) // 2
+        # The neighbors of the mapped node are not loaded from the file.
+        assert y[3] == 0
+        # Without writable=True, the writes stay in memory.
+        x[5] = -1
+        assert x[5] == -1
+
+        ti.init(arch=ti.cpu)
+        x, y = _layout(path, writable=False)
+        assert x[5] == 15
+
+
+@ti.test(arch=ti.cpu)
+def test_mmap_file_errors():
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'x.bin')
+        with pytest.raises(ValueError):
+            ti.root.dense(ti.i, 4).mmap_file(path, advice='backwards')
+        with pytest.raises(RuntimeError):
+            ti.root.dense(ti.i, 4).dense(ti.i, 4).mmap_file(path)
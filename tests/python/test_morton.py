@@ -0,0 +1,67 @@
+import numpy as np
+
+import taichi as ti
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_morton_3d():
+    n = 16
+    x = ti.field(ti.i32)
+    ti.root.dense(ti.ijk, n).morton().place(x)
+
+    @ti.kernel
+    def fill():
+        for i, j, k in x:
+            x[i, j, k] = i * n * n + j * n + k
+
+    fill()
+    assert (x.to_numpy().ravel() == np.arange(n**3)).all()
+    assert x[3, 5, 7] == 3 * n * n + 5 * n + 7
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_morton_non_power_of_two():
+    x = ti.field(ti.i32)
+    y = ti.field(ti.i32, shape=(12, 34))
+    ti.root.dense(ti.ij, (12, 34)).morton().place(x)
+
+    @ti.kernel
+    def fill():
+        for i, j in x:
+            x[i, j] = i * 100 + j
+
+    @ti.kernel
+    def stencil():
+        for i, j in y:
+            if 0 < i < 11 and 0 < j < 33:
+                y[i, j] = x[i - 1, j] + x[i + 1, j] + x[i, j - 1] + x[i, j + 1]
+
+    fill()
+    stencil()
+    xs = x.to_numpy()
+    expected = np.add.outer(np.arange(12) * 100, np.arange(34))
+    assert (xs == expected).all()
+    ys = y.to_numpy()
+    assert (ys[1:-1, 1:-1] == 4 * expected[1:-1, 1:-1]).all()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_morton_under_pointer():
+    x = ti.field(ti.i32)
+    ti.root.pointer(ti.ij, 4).dense(ti.ij, 8).morton().place(x)
+
+    @ti.kernel
+    def activate():
+        for i in range(32):
+            x[i, 31 - i] = i + 1
+
+    @ti.kernel
+    def total() -> ti.i32:
+        s = 0
+        for i, j in x:
+            s += x[i, j] * (i == 31 - j)
+        return s
+
+    activate()
+    assert total() == 32 * 33 // 2
+    assert x[5, 26] == 6
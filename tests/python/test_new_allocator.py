@@ -79,3 +79,109 @@ def test_alloc_in_kernel():
             x[i * 1024 * 1024] = 1
 
     touch()
+
+
+@ti.test(arch=ti.cuda, use_virtual_device_memory=True)
+def test_virtual_device_memory_growth():
+    # 64 blocks of 4 MB, more than the initial headroom of 256 MB
+    num_blocks = 64
+    block_size = 1 << 20
+    x = ti.field(ti.f32)
+    ti.root.pointer(ti.i, num_blocks).dense(ti.i, block_size).place(x)
+
+    @ti.kernel
+    def activate(begin: ti.i32, end: ti.i32):
+        for b in range(begin, end):
+            x[b * block_size] = b
+
+    @ti.kernel
+    def total() -> ti.f32:
+        s = 0.0
+        for i in x:
+            s += x[i]
+        return s
+
+    for b in range(0, num_blocks, 8):
+        activate(b, b + 8)
+    assert total() == num_blocks * (num_blocks - 1) // 2
+
+
+@ti.test(arch=ti.cuda,
+         use_unified_memory=True,
+         use_virtual_device_memory=False,
+         unified_memory_prefetch=True)
+def test_unified_memory_prefetch():
+    n = 1024
+    x = ti.field(ti.i32, shape=n)
+    y = ti.field(ti.i32)
+    ti.root.pointer(ti.i, n // 64).dense(ti.i, 64).place(y)
+
+    @ti.kernel
+    def fill(k: ti.i32):
+        for i in x:
+            x[i] += i * k
+            y[i] = x[i]
+
+    for k in range(3):
+        fill(k)
+        # Reading from the host migrates the pages back
+        assert x[n - 1] == (n - 1) * k * (k + 1) // 2
+    for i in range(n):
+        assert y[i] == i * 3
+
+
+@ti.test(arch=ti.cuda,
+         use_unified_memory=True,
+         use_virtual_device_memory=False,
+         unified_memory_stream_tile_MB=0.25)
+def test_unified_memory_stream_tiles():
+    n = 1024 * 1024
+    x = ti.field(ti.f32, shape=n)
+    y = ti.field(ti.i32, shape=4)
+
+    @ti.kernel
+    def fill(k: ti.i32):
+        for i in range(n):
+            x[i] = i * k
+        # Small enough not to be streamed
+        for i in range(4):
+            y[i] = i
+
+    @ti.kernel
+    def total() -> ti.f64:
+        s = 0.0
+        for i in range(n):
+            s += ti.cast(x[i], ti.f64)
+        return s
+
+    fill(2)
+    assert x[0] == 0
+    assert x[n - 1] == (n - 1) * 2
+    assert total() == n * (n - 1)
+    for i in range(4):
+        assert y[i] == i
+
+
+@ti.test(arch=ti.cuda,
+         use_unified_memory=True,
+         use_virtual_device_memory=False,
+         unified_memory_prefetch=True)
+def test_unified_memory_host_access_per_field():
+    n = 1024
+    x = ti.field(ti.i32, shape=n)
+    y = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def step():
+        for i in x:
+            x[i] += 1
+        for i in y:
+            y[i] += x[i]
+
+    step()
+    # Only the pages of x are migrated back to the host here.
+    x[3] = 10
+    step()
+    assert x[3] == 11
+    assert y[3] == 12
+    assert y[4] == 3
@@ -0,0 +1,59 @@
+import pytest
+
+import taichi as ti
+
+
+def _fill_and_check(x):
+    n = x.shape[0]
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 3
+
+    @ti.kernel
+    def total() -> ti.i64:
+        s = ti.cast(0, ti.i64)
+        for i in x:
+            s += x[i]
+        return s
+
+    fill()
+    assert total() == 3 * n * (n - 1) // 2
+    for i in [0, 1, n // 2, n - 1]:
+        assert x[i] == i * 3
+
+
+@ti.test(arch=ti.cpu, cpu_thread_affinity='compact')
+def test_compact_affinity():
+    _fill_and_check(ti.field(ti.i32, shape=100003))
+
+
+@ti.test(arch=ti.cpu, cpu_thread_affinity='scatter')
+def test_scatter_affinity():
+    _fill_and_check(ti.field(ti.i32, shape=100003))
+
+
+@ti.test(arch=ti.cpu, cpu_numa_first_touch=True)
+def test_first_touch():
+    _fill_and_check(ti.field(ti.i32, shape=100003))
+
+
+@pytest.mark.parametrize('policy', ['interleave', 'partition'])
+@ti.test(arch=ti.cpu)
+def test_snode_policy(policy):
+    n = 1 << 20
+    x = ti.field(ti.i32)
+    y = ti.field(ti.i32)
+    ti.root.dense(ti.i, n).numa_policy(policy).place(x)
+    ti.root.dense(ti.i, n).place(y)
+    _fill_and_check(x)
+    _fill_and_check(y)
+
+
+@ti.test(arch=ti.cpu)
+def test_snode_policy_errors():
+    with pytest.raises(ValueError):
+        ti.root.dense(ti.i, 4).numa_policy('nearest')
+    with pytest.raises(RuntimeError):
+        ti.root.dense(ti.i, 4).dense(ti.i, 4).numa_policy('interleave')
@@ -178,6 +178,50 @@ def test_numpy_multiple_external_arrays():
         assert b[i] == d[i]
 
 
+@ti.all_archs
+def test_numpy_read_only_external_arrays():
+    n = 4
+    val = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def test_numpy(a: ti.ext_arr(), b: ti.ext_arr()) -> ti.i32:
+        s = 0
+        for i in range(n):
+            val[i] = a[i] * b[i]
+            s += b.shape[0]
+        return s
+
+    a = np.array([4, 8, 1, 24], dtype=np.int32)
+    b = np.array([5, 6, 12, 3], dtype=np.int32)
+
+    assert test_numpy(a, b) == n * n
+    for i in range(n):
+        assert val[i] == a[i] * b[i]
+    np.testing.assert_array_equal(a, [4, 8, 1, 24])
+    np.testing.assert_array_equal(b, [5, 6, 12, 3])
+
+
+@ti.all_archs
+def test_numpy_read_only_in_some_tasks():
+    n = 4
+    val = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def test_numpy(a: ti.ext_arr()):
+        for i in range(n):
+            val[i] = a[i]
+        for i in range(n):
+            a[i] = a[i] * 2
+        for i in range(n):
+            val[i] += a[i]
+
+    a = np.array([4, 8, 1, 24], dtype=np.int32)
+    test_numpy(a)
+    np.testing.assert_array_equal(a, [8, 16, 2, 48])
+    for i in range(n):
+        assert val[i] == a[i] // 2 * 3
+
+
 @ti.must_throw(AssertionError)
 def test_index_mismatch():
     val = ti.field(ti.i32, shape=(1, 2, 3))
@@ -126,3 +126,37 @@ def test_numpy_io_example():
     assert arr.shape == (n, m, 3, 4)
 
     # For PyTorch tensors, use to_torch/from_torch instead
+
+
+@ti.all_archs
+def test_from_numpy_strided():
+    val = ti.field(ti.i32, shape=(4, 7))
+
+    arr = np.arange(4 * 7 * 2, dtype=np.int32).reshape(7, 8).T[::2]
+    assert not arr.flags['C_CONTIGUOUS']
+    val.from_numpy(arr)
+
+    np.testing.assert_array_equal(val.to_numpy(), arr)
+
+
+@ti.all_archs
+def test_from_numpy_cast():
+    val = ti.field(ti.f32, shape=(3, 5))
+
+    arr = np.arange(15, dtype=np.int64).reshape(3, 5)
+    val.from_numpy(arr)
+
+    np.testing.assert_array_equal(val.to_numpy(), arr.astype(np.float32))
+
+
+@ti.all_archs
+def test_numpy_io_offset_and_sparse():
+    val = ti.field(ti.i32)
+    ti.root.pointer(ti.i, 4).dense(ti.i, 4).place(val, offset=(-8, ))
+
+    val[-8] = 3
+    val[7] = 5
+    arr = val.to_numpy()
+    assert arr[0] == 3
+    assert arr[15] == 5
+    assert arr.sum() == 8
@@ -0,0 +1,103 @@
+import os
+import tempfile
+
+import taichi as ti
+
+
+def _run_saxpy(cache_dir, arch):
+    ti.init(arch=arch, offline_cache=True, offline_cache_file_path=cache_dir)
+    n = 16
+    x = ti.field(ti.f32, shape=n)
+    y = ti.field(ti.f32, shape=n)
+
+    @ti.kernel
+    def saxpy(a: ti.f32):
+        for i in x:
+            y[i] = a * x[i] + y[i]
+
+    for i in range(n):
+        x[i] = i
+        y[i] = 1
+    saxpy(2)
+    for i in range(n):
+        assert y[i] == 2 * i + 1
+
+
+def _num_cache_entries(cache_dir):
+    return len([
+        f for f in os.listdir(cache_dir)
+        if f.startswith('kernel_') and f.endswith('.tcb')
+    ])
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_offline_cache():
+    arch = ti.cfg.arch
+    with tempfile.TemporaryDirectory() as cache_dir:
+        _run_saxpy(cache_dir, arch)
+        num_entries = _num_cache_entries(cache_dir)
+        assert num_entries > 0
+        # The second run must be served from the cache.
+        _run_saxpy(cache_dir, arch)
+        assert _num_cache_entries(cache_dir) == num_entries
+
+
+@ti.test(arch=ti.opengl)
+def test_offline_cache_opengl_programs():
+    with tempfile.TemporaryDirectory() as cache_dir:
+        _run_saxpy(cache_dir, ti.opengl)
+        program_dir = os.path.join(cache_dir, 'opengl')
+        if not os.path.isdir(program_dir):
+            # The driver cannot save the programs it builds.
+            return
+        programs = sorted(os.listdir(program_dir))
+        assert len(programs) > 0
+        # The second run loads the same programs.
+        _run_saxpy(cache_dir, ti.opengl)
+        assert sorted(os.listdir(program_dir)) == programs
+
+
+@ti.test(arch=ti.vulkan)
+def test_offline_cache_vulkan_spirv():
+    with tempfile.TemporaryDirectory() as cache_dir:
+        _run_saxpy(cache_dir, ti.vulkan)
+        spirv_dir = os.path.join(cache_dir, 'vulkan')
+        modules = sorted(
+            f for f in os.listdir(spirv_dir) if f.startswith('spirv_'))
+        assert len(modules) > 0
+        # The second run loads the same SPIR-V.
+        _run_saxpy(cache_dir, ti.vulkan)
+        assert sorted(f for f in os.listdir(spirv_dir)
+                      if f.startswith('spirv_')) == modules
+
+
+@ti.test(arch=ti.metal)
+def test_offline_cache_metal_libraries():
+    with tempfile.TemporaryDirectory() as cache_dir:
+        _run_saxpy(cache_dir, ti.metal)
+        # The libraries are built in the background until the reset.
+        ti.reset()
+        library_dir = os.path.join(cache_dir, 'metal')
+        if not os.path.isdir(library_dir):
+            # No offline Metal compiler.
+            return
+        libraries = sorted(
+            f for f in os.listdir(library_dir) if f.endswith('.metallib'))
+        assert len(libraries) > 0
+        # The second run loads the same libraries.
+        _run_saxpy(cache_dir, ti.metal)
+        ti.reset()
+        assert sorted(f for f in os.listdir(library_dir)
+                      if f.endswith('.metallib')) == libraries
+
+
+@ti.test(arch=ti.cuda)
+def test_offline_cache_cuda_cubins():
+    with tempfile.TemporaryDirectory() as cache_dir:
+        _run_saxpy(cache_dir, ti.cuda)
+        cubin_dir = os.path.join(cache_dir, 'cubin')
+        num_entries = _num_cache_entries(cubin_dir)
+        assert num_entries > 0
+        # The second run loads the same cubins.
+        _run_saxpy(cache_dir, ti.cuda)
+        assert _num_cache_entries(cubin_dir) == num_entries
@@ -142,3 +142,65 @@ def test_parallel_assignment():
     for i in range(3):
         for j in range(4):
             assert mat[i, j] == i + 1
+
+
+@ti.test(print_licm_report=True)
+def test_loop_invariant_load():
+    x = ti.field(ti.i32, shape=(4, 8))
+    y = ti.field(ti.i32, shape=4)
+
+    @ti.kernel
+    def func():
+        for i in range(4):
+            for j in range(8):
+                # x[i, 0] is loaded before the inner loop.
+                y[i] += x[i, 0] * 2 + j
+
+    for i in range(4):
+        x[i, 0] = i
+    func()
+    for i in range(4):
+        assert y[i] == i * 16 + 28
+
+
+@ti.test()
+def test_loop_invariant_load_clobbered():
+    x = ti.field(ti.i32, shape=(4, 8))
+    y = ti.field(ti.i32, shape=4)
+
+    @ti.kernel
+    def func():
+        for i in range(4):
+            for j in range(8):
+                x[i, 0] += 1
+                y[i] += x[i, 0]
+
+    func()
+    for i in range(4):
+        assert x[i, 0] == 8
+        assert y[i] == 36
+
+
+@ti.test()
+def test_stencil_neighbor_access():
+    n = 16
+    x = ti.field(ti.i32)
+    y = ti.field(ti.i32)
+    ti.root.dense(ti.ij, n).place(x, y)
+
+    @ti.kernel
+    def func():
+        # The neighbors and y[i, j] are looked up from the index of x[i, j].
+        for i, j in ti.ndrange((1, n - 1), (1, n - 1)):
+            y[i, j] = x[i, j] * 10000 + x[i - 1, j] * 1000 + x[
+                i + 1, j] * 100 + x[i, j - 1] * 10 + x[i, j + 1]
+
+    for i in range(n):
+        for j in range(n):
+            x[i, j] = (i + j) % 7
+    func()
+    for i in range(1, n - 1):
+        for j in range(1, n - 1):
+            assert y[i, j] == ((i + j) % 7 * 10000 + (i + j - 1) % 7 * 1000 +
+                               (i + j + 1) % 7 * 100 + (i + j - 1) % 7 * 10 +
+                               (i + j + 1) % 7)
@@ -0,0 +1,67 @@
+import taichi as ti
+
+
+def _test_many_offloads():
+    n = 32
+    x = ti.field(ti.i32, shape=n)
+    y = ti.field(ti.i32, shape=n)
+    total = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def compute():
+        for i in x:
+            x[i] = i
+        for i in y:
+            y[i] = x[i] * 2
+        for i in x:
+            x[i] += y[i]
+        total[None] = 0
+        for i in x:
+            total[None] += x[i]
+
+    compute()
+    for i in range(n):
+        assert x[i] == i * 3
+        assert y[i] == i * 2
+    assert total[None] == n * (n - 1) // 2 * 3
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], num_compile_threads=4)
+def test_parallel_compilation():
+    _test_many_offloads()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], num_compile_threads=1)
+def test_serial_compilation():
+    _test_many_offloads()
+
+
+def _test_template_instantiations():
+    n = 16
+    x = ti.field(ti.i32, shape=n)
+    y = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def compute(k: ti.template()):
+        for i in x:
+            x[i] = i
+        for i in y:
+            y[i] = x[i] * k
+        for i in x:
+            x[i] += 1
+
+    for k in range(1, 4):
+        compute(k)
+        for i in range(n):
+            assert x[i] == i + 1
+            assert y[i] == i * k
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], num_compile_threads=4)
+def test_task_cache():
+    _test_template_instantiations()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], num_compile_threads=4, task_cache=False)
+def test_no_task_cache():
+    _test_template_instantiations()
@@ -0,0 +1,61 @@
+import numpy as np
+
+import taichi as ti
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_exclusive_scan():
+    for n in [1, 100, 100000]:
+        a = np.random.randint(-100, 100, size=n).astype(np.int32)
+        expected = np.concatenate([[0], np.cumsum(a)[:-1]]).astype(np.int32)
+        ti.exclusive_scan(a)
+        assert (a == expected).all()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_exclusive_scan_field():
+    n = 5000
+    x = ti.field(ti.i32, shape=n)
+    x.from_numpy(np.ones(n, dtype=np.int32))
+    ti.exclusive_scan(x)
+    assert (x.to_numpy() == np.arange(n)).all()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_sort_by_key():
+    n = 200000
+    keys = np.random.randint(-2**31, 2**31 - 1, size=n).astype(np.int32)
+    # Repeated keys show the stability.
+    keys[::3] = 7
+    values = np.arange(n, dtype=np.int32)
+    order = np.argsort(keys, kind='stable')
+    expected_keys = keys[order]
+    ti.sort_by_key(keys, values)
+    assert (keys == expected_keys).all()
+    assert (values == order).all()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_sort_unsigned_keys_field():
+    n = 1000
+    keys = ti.field(ti.u32, shape=n)
+    values = ti.field(ti.f32, shape=n)
+    k = np.random.randint(0, 2**32 - 1, size=n, dtype=np.uint64)
+    k = k.astype(np.uint32)
+    keys.from_numpy(k)
+    values.from_numpy(k.astype(np.float32))
+    ti.sort_by_key(keys, values)
+    assert (keys.to_numpy() == np.sort(k)).all()
+    assert (values.to_numpy() == np.sort(k).astype(np.float32)).all()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_compact():
+    n = 100000
+    src = np.random.rand(n).astype(np.float32)
+    flags = (src > 0.7).astype(np.int32)
+    dst = np.zeros(n, dtype=np.float32)
+    count = ti.compact(src, flags, dst)
+    expected = src[flags != 0]
+    assert count == len(expected)
+    assert (dst[:count] == expected).all()
@@ -19,3 +19,23 @@ def test_parallel_range_for():
     val_np = val.to_numpy()
     for i in range(n):
         assert val_np[i] == i
+
+
+@ti.test()
+def test_dynamic_range_for():
+    n = 100000
+    val = ti.field(ti.i32, shape=n)
+    bound = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def fill(v: ti.i32):
+        for i in range(bound[None] // 2, bound[None]):
+            val[i] = v
+
+    for m, v in [(n, 1), (10, 2), (0, 3), (n // 2, 4)]:
+        bound[None] = m
+        fill(v)
+    val_np = val.to_numpy()
+    assert (val_np[n // 2:] == 1).all()
+    assert (val_np[5:10] == 2).all()
+    assert (val_np[n // 4:n // 2] == 4).all()
@@ -0,0 +1,55 @@
+import os
+import tempfile
+
+import taichi as ti
+
+n = 1024
+
+
+def _run():
+    x = ti.field(ti.i32, shape=n)
+    y = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def step(m: ti.i32):
+        for i in range(m):
+            s = 0
+            for k in range(i % 7):
+                if k % 3 == 0:
+                    s += k
+                else:
+                    s -= 1
+            for k in range(m // 16):
+                s += k % 2
+            x[i] = s
+            if i % 100 == 0:
+                y[i] = 1
+
+    for _ in range(2):
+        step(n)
+    for i in range(n):
+        expected = sum(k if k % 3 == 0 else -1 for k in range(i % 7))
+        assert x[i] == expected + (n // 16) // 2
+        assert y[i] == (1 if i % 100 == 0 else 0)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_pgo_profile():
+    arch = ti.cfg.arch
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        path = os.path.join(tmp_dir, 'pgo.txt')
+
+        ti.init(arch=arch, pgo_instrument=True, pgo_profile=path)
+        _run()
+        # Writes the profile.
+        ti.reset()
+        assert os.path.exists(path)
+        with open(path) as f:
+            lines = f.read().splitlines()
+        assert len(lines) > 1
+        # The counts of the branches and loops are recorded.
+        assert any(int(count) > 0 for line in lines[1:]
+                   for count in line.split()[3:])
+
+        ti.init(arch=arch, pgo_profile=path)
+        _run()
@@ -107,6 +107,25 @@ def test_random_seed_per_launch():
     assert count <= n * 0.15
 
 
+@ti.test(arch=ti.cuda, cuda_philox_rand=True)
+def test_random_philox():
+    n = 1024
+    x = ti.field(ti.f32, shape=(n, n))
+
+    @ti.kernel
+    def fill():
+        for i in range(n):
+            for j in range(n):
+                x[i, j] = ti.random()
+
+    fill()
+    X = x.to_numpy()
+    for i in range(4):
+        assert (X**i).mean() == approx(1 / (i + 1), rel=1e-2)
+    fill()
+    assert (x.to_numpy() != X).mean() > 0.99
+
+
 @ti.test(arch=[ti.cpu, ti.cuda])
 def test_random_f64():
     @ti.kernel
@@ -113,3 +113,110 @@ def test_reduction_different_scale():
     # 1024 and 100000 since OpenGL max threads per group ~= 1792
     for n in [1, 10, 60, 1024, 100000]:
         assert n == func(n)
+
+
+@ti.test(arch=ti.cc, cc_openmp=True)
+def test_reduction_cc_openmp():
+    N = 1024 * 16
+    a = ti.field(ti.i32, shape=N)
+    tot = ti.field(ti.i32, shape=())
+    hi = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def fill():
+        for i in a:
+            a[i] = i
+
+    @ti.kernel
+    def reduce():
+        for i in a:
+            tot[None] += a[i]
+            ti.atomic_max(hi[None], a[i])
+
+    fill()
+    reduce()
+    assert tot[None] == N * (N - 1) // 2
+    assert hi[None] == N - 1
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_reduction_constant_index():
+    N = 1024 * 16
+    a = ti.field(ti.i32, shape=N)
+    hist = ti.field(ti.i32, shape=4)
+    f = ti.field(ti.f32, shape=(2, 2))
+
+    @ti.kernel
+    def fill():
+        for i in a:
+            a[i] = i
+
+    @ti.kernel
+    def reduce(k: ti.i32):
+        for i in a:
+            hist[k] += a[i]
+            hist[3] += 1
+            f[1, k] += 0.5
+
+    fill()
+    reduce(1)
+    assert hist[0] == 0
+    assert hist[1] == N * (N - 1) // 2
+    assert hist[3] == N
+    assert f[1, 1] == N * 0.5
+    assert f[1, 0] == 0
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_reduction_odd_block_dim():
+    N = 1000
+    tot = ti.field(ti.f64, shape=())
+    cnt = ti.field(ti.i64, shape=())
+
+    @ti.kernel
+    def reduce():
+        ti.block_dim(48)
+        for i in range(N):
+            tot[None] += i * 0.5
+            cnt[None] += 1
+
+    reduce()
+    assert tot[None] == N * (N - 1) / 4
+    assert cnt[None] == N
+
+
+def _test_reduction_subgroup():
+    N = 4096
+    tot = ti.field(ti.i32, shape=())
+    lo = ti.field(ti.i32, shape=())
+    hi = ti.field(ti.f32, shape=())
+    bits = ti.field(ti.i32, shape=())
+    # The threads of a subgroup add to different cells of |hist|.
+    hist = ti.field(ti.i32, shape=7)
+
+    @ti.kernel
+    def reduce():
+        for i in range(N):
+            tot[None] += i
+            ti.atomic_min(lo[None], i - 5)
+            ti.atomic_max(hi[None], i * 0.5)
+            ti.atomic_or(bits[None], 1 << (i % 31))
+            hist[i % 7] += 1
+
+    reduce()
+    assert tot[None] == N * (N - 1) // 2
+    assert lo[None] == -5
+    assert hi[None] == (N - 1) * 0.5
+    assert bits[None] == 2**31 - 1
+    for k in range(7):
+        assert hist[k] == len(range(k, N, 7))
+
+
+@ti.test(arch=[ti.opengl, ti.vulkan])
+def test_reduction_subgroup():
+    _test_reduction_subgroup()
+
+
+@ti.test(arch=[ti.opengl, ti.vulkan], opengl_subgroup_reductions=False)
+def test_reduction_no_subgroup():
+    _test_reduction_subgroup()
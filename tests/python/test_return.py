@@ -61,3 +61,36 @@ def test_binary_func_ret():
     _test_binary_func_ret(ti.f32, ti.i32, ti.f32, float)
     _test_binary_func_ret(ti.i32, ti.f32, ti.i32, int)
     _test_binary_func_ret(ti.f32, ti.i32, ti.i32, int)
+
+
+@ti.test()
+def test_launch_async():
+    x = ti.field(ti.f32, shape=16)
+
+    @ti.kernel
+    def fill(v: ti.f32):
+        for i in x:
+            x[i] = v
+
+    @ti.kernel
+    def total() -> ti.f32:
+        s = 0.0
+        for i in x:
+            s += x[i]
+        return s
+
+    @ti.kernel
+    def count(n: ti.i32) -> ti.i32:
+        return n
+
+    futures = []
+    for v in range(4):
+        fill(v)
+        futures.append(ti.launch_async(total))
+    # Later launches do not overwrite the values of the earlier futures.
+    assert count(5) == 5
+    n = ti.launch_async(count, 7)
+    assert ti.launch_async(fill, 1.0) is None
+    assert [f.result() for f in futures] == [approx(16 * v) for v in range(4)]
+    assert n.result() == 7
+    assert n.result() == 7
@@ -53,18 +53,70 @@ init_args = {
     'verbose': [True, TF],
     'fast_math': [True, TF],
     'async_mode': [False, TF],
+    'async_fusion_max_statements': [0, [0, 50, 1000]],
+    'async_flush_num_tasks': [0, [0, 1, 16]],
+    'async_flush_cost': [0, [0, 100, 10000]],
+    'cc_openmp': [False, TF],
+    'cuda_auto_tune_block_dim': [False, TF],
+    'cuda_cubin_cache': [True, TF],
+    'cuda_persistent_kernels': [False, TF],
+    'cuda_max_registers': [0, [0, 32, 255]],
+    'cuda_min_blocks_per_sm': [2, [0, 1, 4]],
+    'cuda_max_bls_bytes': [0, [0, 1024, 65536]],
+    'cpu_async_launch': [False, TF],
+    'cpu_block_dim_by_cost': [False, TF],
+    'cpu_max_tls_array_bytes': [4096, [0, 256, 4096]],
+    'cpu_numa_first_touch': [False, TF],
+    'cpu_huge_pages': ['none', ['none', 'transparent']],
+    'cpu_struct_for_prefetch_distance': [4, [0, 1, 16]],
+    'lazy_runtime_linking': [True, TF],
+    'tiered_compilation': [False, TF],
+    'deterministic_reduction': [False, TF],
+    'skip_dense_listgen': [False, TF],
+    'sync_activation_demotion': [False, TF],
+    'layout_advisor': [False, TF],
+    'pgo_instrument': [False, TF],
+    'svd_intrinsic': [True, TF],
+    'loop_invariant_code_motion': [True, TF],
+    'print_licm_report': [False, TF],
+    'coalesce_dense_struct_fors': [True, TF],
+    'print_coalescing_report': [False, TF],
     'flatten_if': [False, TF],
+    'make_block_local_scatter': [True, TF],
+    'horizontal_fusion_max_iterations': [0, [0, 4096]],
+    'serial_fusion_max_statements': [32, [0, 8, 32]],
+    'unroll_max_statements': [128, [0, 16, 128]],
     'simplify_before_lower_access': [True, TF],
     'simplify_after_lower_access': [True, TF],
     'use_unified_memory': [ti.get_os_name() != 'win', TF],
+    'use_virtual_device_memory': [True, TF],
+    'cuda_peer_memory': [False, TF],
+    'cuda_philox_rand': [False, TF],
+    'unified_memory_prefetch': [True, TF],
+    'unified_memory_stream_tile_MB': [0.0, [0.0, 64.0]],
+    'opengl_atomic_aggregation_slots': [1024, [0, 256, 1024]],
+    'opengl_subgroup_reductions': [True, TF],
+    'vulkan_launches_per_submit': [64, [1, 16, 64]],
     'print_benchmark_stat': [False, TF],
     'kernel_profiler': [False, TF],
+    'kernel_profiler_sampling_interval': [1, [1, 4, 16]],
+    'kernel_profiler_hardware_counters': [False, TF],
+    'kernel_profiler_peak_bandwidth': [0.0, [0.0, 10.0, 500.0]],
+    'compile_profiler': [False, TF],
+    'verify_each_pass': [False, TF],
+    'num_compile_threads': [0, [0, 1, 4]],
+    'task_cache': [True, TF],
+    'cpu_tile_shape': ['', ['', '4,4', '2,4,8']],
+    'cpu_vectorize': [True, TF],
     'check_out_of_bound': [False, TF],
     'print_accessor_ir': [False, TF],
     'print_evaluator_ir': [False, TF],
     'print_struct_llvm_ir': [False, TF],
     'print_kernel_llvm_ir': [False, TF],
     'print_kernel_llvm_ir_optimized': [False, TF],
+    'print_vectorization_report': [False, TF],
+    'lock_free_activation': [True, TF],
+    'quant_atomic_add_allow_overflow': [False, TF],
     # FIXME: figure out why these two failed test:
     #'device_memory_fraction': [0.0, [0.5, 1, 0]],
     #'device_memory_GB': [1.0, [0.5, 1, 1.5, 2]],
@@ -121,3 +121,40 @@ def test_global_tmp_value_state():
     x.from_numpy(np.arange(0, n, dtype=np.float32))
     mean = compute_mean_of_boundary_edges()
     assert ti.approx(mean) == 33
+
+
+@ti.test(require=ti.extension.async_mode,
+         async_mode=True,
+         async_opt_fusion=False)
+def test_sfg_redundant_fill_elimination():
+    n = 32
+    x = ti.field(dtype=ti.i32, shape=n)
+
+    @ti.kernel
+    def fill(val: ti.i32):
+        for i in x:
+            x[i] = val
+
+    @ti.kernel
+    def inc():
+        for i in x:
+            x[i] += 1
+
+    fill(0)
+    ti.sync()
+    stats = ti.get_kernel_stats()
+    stats.clear()
+
+    # Only the first fill after inc() and the fill with a different value
+    # need to run.
+    for _ in range(3):
+        fill(0)
+    inc()
+    for _ in range(3):
+        fill(0)
+    fill(2)
+    ti.sync()
+
+    counters = stats.get_counters()
+    assert int(counters['sfg_redundant_tasks']) == 5
+    assert x.to_numpy().tolist() == [2] * n
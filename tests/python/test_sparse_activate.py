@@ -54,3 +54,94 @@ def test_non_dfs_snode_order():
 
     foo()  # Just make sure it doesn't crash
     ti.sync()
+
+
+def _test_concurrent_activation():
+    x = ti.field(ti.i32)
+    s = ti.field(ti.i32, shape=())
+    n = 256
+
+    ptr = ti.root.pointer(ti.i, n)
+    ptr.dense(ti.i, 8).place(x)
+
+    @ti.kernel
+    def fill():
+        # Each child is activated by many threads at once.
+        for k in range(n * 8 * 16):
+            ti.atomic_add(x[k % (n * 8)], 1)
+
+    @ti.kernel
+    def count():
+        for i in x:
+            s[None] += x[i]
+
+    fill()
+    count()
+    assert s[None] == n * 8 * 16
+    for i in range(0, n * 8, 37):
+        assert x[i] == 16
+
+
+@ti.archs_with([ti.cpu, ti.cuda])
+def test_concurrent_activation():
+    _test_concurrent_activation()
+
+
+@ti.archs_with([ti.cpu, ti.cuda], lock_free_activation=False)
+def test_concurrent_activation_locked():
+    _test_concurrent_activation()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda, ti.metal], sync_activation_demotion=True)
+def test_sync_activation_demotion():
+    n = 64
+    x = ti.field(ti.i32)
+    y = ti.field(ti.i32)
+    ptr_x = ti.root.pointer(ti.i, n // 8)
+    ptr_x.dense(ti.i, 8).place(x)
+    ptr_y = ti.root.pointer(ti.i, n // 8)
+    ptr_y.dense(ti.i, 8).place(y)
+
+    @ti.kernel
+    def activate_x(begin: ti.i32, end: ti.i32):
+        for i in range(begin, end):
+            x[i] = i
+
+    @ti.kernel
+    def copy():
+        for i in x:
+            y[i] += x[i]
+
+    @ti.kernel
+    def clear_y():
+        for i in ptr_y:
+            ti.deactivate(ptr_y, i)
+
+    @ti.kernel
+    def count_y() -> ti.i32:
+        s = 0
+        for i in y:
+            s += 1
+        return s
+
+    activate_x(0, 16)
+    for _ in range(3):
+        copy()
+    assert count_y() == 16
+    for i in range(16):
+        assert y[i] == i * 3
+
+    # The list of x has changed: y is activated at the new indices again.
+    activate_x(16, 32)
+    copy()
+    copy()
+    assert count_y() == 32
+    for i in range(32):
+        assert y[i] == (i * 5 if i < 16 else i * 2)
+
+    clear_y()
+    copy()
+    copy()
+    assert count_y() == 32
+    for i in range(32):
+        assert y[i] == i * 2
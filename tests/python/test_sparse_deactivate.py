@@ -214,3 +214,59 @@ def test_dynamic():
     fetch_length()
     for i in range(n):
         assert s[i] == i * i * 4
+
+
+@ti.test(require=ti.extension.sparse)
+def test_deactivate_all_nested():
+    x = ti.field(ti.i32)
+    n = 64
+    block = ti.root.dense(ti.i, 4).pointer(ti.i, n)
+    block.pointer(ti.i, 4).bitmasked(ti.i, 8).place(x)
+    N = 4 * n * 4 * 8
+
+    @ti.kernel
+    def activate(k: ti.i32):
+        for i in range(N):
+            if i % k == 0:
+                x[i] = i + k
+
+    @ti.kernel
+    def count(k: ti.i32) -> ti.i32:
+        s = 0
+        for i in x:
+            s += 1
+            if x[i] != i + k:
+                s += N
+        return s
+
+    for frame in range(3):
+        k = 3 + frame * 2
+        activate(k)
+        assert count(k) == (N + k - 1) // k
+        block.deactivate_all()
+        assert count(k) == 0
+        # The nodes handed out again are zero-filled.
+        for i in range(0, N, 97):
+            assert x[i] == 0
+
+
+@ti.test(require=ti.extension.sparse)
+def test_deactivate_all_bitmasked():
+    x = ti.field(ti.f32)
+    bm = ti.root.dense(ti.ij, 4).bitmasked(ti.ij, 16)
+    bm.place(x)
+
+    @ti.kernel
+    def count() -> ti.i32:
+        s = 0
+        for i, j in x:
+            s += 1
+        return s
+
+    x[3, 5] = 1
+    x[60, 63] = 2
+    assert count() == 2
+    bm.deactivate_all()
+    assert count() == 0
+    x[60, 62] = 1
+    assert count() == 1
@@ -0,0 +1,79 @@
+import numpy as np
+
+import taichi as ti
+
+
+def laplacian_1d(n):
+    rows, cols, values = [], [], []
+    for i in range(n):
+        rows.append(i)
+        cols.append(i)
+        values.append(2.0)
+        if i > 0:
+            rows.append(i)
+            cols.append(i - 1)
+            values.append(-1.0)
+        if i + 1 < n:
+            rows.append(i)
+            cols.append(i + 1)
+            values.append(-1.0)
+    return np.array(rows, dtype=np.int32), np.array(cols, dtype=np.int32), \
+        np.array(values)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_build_from_triplets():
+    n, m, k = 300, 200, 5000
+    rows = np.random.randint(0, n, size=k).astype(np.int32)
+    cols = np.random.randint(0, m, size=k).astype(np.int32)
+    # Repeated positions are summed.
+    rows[::4] = 7
+    cols[::4] = 11
+    values = np.random.rand(k).astype(np.float32)
+    dense = np.zeros((n, m), dtype=np.float64)
+    np.add.at(dense, (rows, cols), values)
+
+    A = ti.SparseMatrix(n, m, dtype=ti.f32)
+    A.build_from_triplets(rows, cols, values)
+    assert A.shape == (n, m)
+    assert A.num_nonzeros == np.count_nonzero(dense)
+
+    x = np.random.rand(m).astype(np.float32)
+    y = np.zeros(n, dtype=np.float32)
+    A.matvec(x, y)
+    assert np.allclose(y, dense @ x, rtol=1e-4, atol=1e-4)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_matvec_field():
+    n = 1000
+    rows, cols, values = laplacian_1d(n)
+    A = ti.SparseMatrix(n, dtype=ti.f64)
+    A.build_from_triplets(rows, cols, values)
+    x = ti.field(ti.f64, shape=n)
+    y = ti.field(ti.f64, shape=n)
+    x.from_numpy(np.arange(n, dtype=np.float64)**2)
+    A.matvec(x, y)
+    expected = np.full(n, -2.0)
+    expected[0] = -1.0
+    expected[n - 1] = (n - 1)**2 + 2 * (n - 1) - 1
+    assert np.allclose(y.to_numpy(), expected)
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_solve_cg():
+    for dtype, np_dtype, tol in [(ti.f32, np.float32, 1e-4),
+                                 (ti.f64, np.float64, 1e-10)]:
+        n = 256
+        rows, cols, values = laplacian_1d(n)
+        # A shift keeps the system well conditioned for f32.
+        values[rows == cols] += 0.5
+        A = ti.SparseMatrix(n, dtype=dtype)
+        A.build_from_triplets(rows, cols, values.astype(np_dtype))
+        expected = np.sin(np.linspace(0, 3, n))
+        b = np.zeros(n, dtype=np_dtype)
+        A.matvec(expected.astype(np_dtype), b)
+        x = np.zeros(n, dtype=np_dtype)
+        iterations = A.solve_cg(b, x, tol=tol, max_iterations=2 * n)
+        assert 0 < iterations <= 2 * n
+        assert np.allclose(x, expected, atol=100 * tol)
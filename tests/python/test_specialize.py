@@ -0,0 +1,38 @@
+import taichi as ti
+
+
+@ti.test()
+def test_specialize_int():
+    x = ti.field(ti.i32, shape=16)
+
+    @ti.kernel
+    def fill(n: ti.specialize(ti.i32), offset: ti.i32):
+        for i in range(n):
+            x[i] = i * n + offset
+
+    fill(4, 1)
+    fill(8, 2)
+    fill(4, 3)
+    assert len(fill._primal.mapper.mapping) == 2
+    for i in range(4):
+        assert x[i] == i * 4 + 3
+    for i in range(4, 8):
+        assert x[i] == i * 8 + 2
+
+
+@ti.test()
+def test_specialize_float():
+    x = ti.field(ti.f32, shape=4)
+
+    @ti.kernel
+    def scale(dt: ti.specialize(ti.f32)):
+        for i in x:
+            x[i] = i * dt
+
+    scale(0.5)
+    for i in range(4):
+        assert x[i] == i * 0.5
+    scale(0.25)
+    for i in range(4):
+        assert x[i] == i * 0.25
+    assert len(scale._primal.mapper.mapping) == 2
@@ -279,3 +279,52 @@ def test_struct_for_quant():
         return tot
 
     assert count() == 28
+
+
+@ti.test(arch=ti.gpu, print_coalescing_report=True)
+def test_struct_for_transposed_copy():
+    n, m = 24, 40
+    x = ti.field(ti.i32)
+    y = ti.field(ti.i32)
+    ti.root.dense(ti.j, m).dense(ti.i, n).place(x)
+    ti.root.dense(ti.i, n).dense(ti.j, m).place(y)
+
+    @ti.kernel
+    def fill():
+        for i, j in x:
+            x[i, j] = i * 100 + j
+
+    @ti.kernel
+    def copy():
+        # Most accesses are to |y|, which j addresses consecutive cells of.
+        for i, j in x:
+            y[i, j] = x[i, j]
+            y[i, j] += 1
+
+    fill()
+    copy()
+    for i in range(n):
+        for j in range(m):
+            assert y[i, j] == i * 100 + j + 1
+
+
+@ti.test(arch=ti.cpu, cpu_struct_for_prefetch_distance=1)
+def test_struct_for_pointer_prefetch():
+    n = 64
+    x = ti.field(ti.i32)
+    ti.root.pointer(ti.i, n).dense(ti.i, 8).place(x)
+
+    @ti.kernel
+    def activate():
+        for i in range(0, n * 8, 3):
+            x[i] = i
+
+    @ti.kernel
+    def total() -> ti.i32:
+        s = 0
+        for i in x:
+            s += x[i]
+        return s
+
+    activate()
+    assert total() == sum(range(0, n * 8, 3))
@@ -85,3 +85,60 @@ def test_transpose_no_loop():
 
     run()
     # As long as it passes compilation we are good
+
+
+def _svd3_results(dt, svd_intrinsic):
+    ti.init(arch=ti.cfg.arch, default_fp=dt, svd_intrinsic=svd_intrinsic)
+    n = 64
+    A = ti.Matrix.field(3, 3, dtype=dt, shape=n)
+    U = ti.Matrix.field(3, 3, dtype=dt, shape=n)
+    sigma = ti.Matrix.field(3, 3, dtype=dt, shape=n)
+    V = ti.Matrix.field(3, 3, dtype=dt, shape=n)
+
+    @ti.kernel
+    def run():
+        for i in A:
+            U[i], sigma[i], V[i] = ti.svd(A[i], dt)
+
+    A.from_numpy(np.random.RandomState(0).uniform(-2, 2, (n, 3, 3)))
+    run()
+    return A.to_numpy(), U.to_numpy(), sigma.to_numpy(), V.to_numpy()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], fast_math=False)
+def test_svd_intrinsic():
+    for dt, tol in [(ti.f32, 1e-4), (ti.f64, 1e-10)]:
+        if dt == ti.f64 and not ti.is_extension_supported(
+                ti.cfg.arch, ti.extension.data64):
+            continue
+        A, U, sigma, V = _svd3_results(dt, True)
+        rets = _svd3_results(dt, False)
+        assert np.allclose(A @ V, U @ sigma, atol=tol)
+        for x, y in zip((U, sigma, V), rets[1:]):
+            assert np.allclose(x, y, atol=tol)
+
+
+def _polar_grad(svd_intrinsic):
+    ti.init(arch=ti.cfg.arch, svd_intrinsic=svd_intrinsic)
+    F = ti.Matrix.field(3, 3, dtype=ti.f32, shape=(), needs_grad=True)
+    loss = ti.field(ti.f32, shape=(), needs_grad=True)
+
+    @ti.kernel
+    def energy():
+        R, S = ti.polar_decompose(F[None], ti.f32)
+        loss[None] = (F[None] - R).norm_sqr()
+
+    F[None] = [[2, 0.5, 0], [0.1, 1.5, 0.2], [0, 0.3, 1]]
+    with ti.Tape(loss):
+        energy()
+    return loss[None], F.grad.to_numpy()
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_svd_intrinsic_grad():
+    # The forward kernel calls the runtime, and the adjoint one differentiates
+    # the statements.
+    loss, grad = _polar_grad(True)
+    loss_ref, grad_ref = _polar_grad(False)
+    assert loss == approx(loss_ref, rel=1e-5)
+    assert np.allclose(grad, grad_ref, atol=1e-4)
@@ -0,0 +1,100 @@
+import taichi as ti
+
+
+def _test_histogram(dtype):
+    n = 100000
+    num_bins = 37
+    hist = ti.field(dtype, shape=num_bins)
+
+    @ti.kernel
+    def count():
+        for i in range(n):
+            hist[i * 7 % num_bins] += 1
+
+    count()
+    count()
+    for b in range(num_bins):
+        assert hist[b] == 2 * len(range(b * 16 % num_bins, n, num_bins))
+
+
+@ti.test(arch=ti.cpu)
+def test_histogram_i32():
+    _test_histogram(ti.i32)
+
+
+@ti.test(arch=ti.cpu)
+def test_histogram_f32():
+    _test_histogram(ti.f32)
+
+
+@ti.test(arch=ti.cpu, cpu_max_tls_array_bytes=0)
+def test_histogram_atomics():
+    _test_histogram(ti.f32)
+
+
+@ti.test(arch=ti.cpu, deterministic_reduction=True)
+def test_histogram_deterministic():
+    _test_histogram(ti.f64)
+
+
+@ti.test(arch=ti.cpu)
+def test_scatter_2d():
+    n = 20000
+    grid = ti.field(ti.f32, shape=(8, 8))
+    total = ti.field(ti.f32, shape=())
+
+    @ti.kernel
+    def p2g():
+        for p in range(n):
+            base_i = p % 7
+            base_j = p // 7 % 7
+            for di, dj in ti.static(ti.ndrange(2, 2)):
+                grid[base_i + di, base_j + dj] += 0.25
+            total[None] += 1.0
+
+    p2g()
+    expected = [[0.0] * 8 for _ in range(8)]
+    for p in range(n):
+        for di in range(2):
+            for dj in range(2):
+                expected[p % 7 + di][p // 7 % 7 + dj] += 0.25
+    for i in range(8):
+        for j in range(8):
+            assert grid[i, j] == expected[i][j]
+    assert total[None] == n
+
+
+@ti.test(arch=ti.cpu, cpu_max_tls_array_bytes=64)
+def test_fields_over_budget():
+    n = 10000
+    small = ti.field(ti.i32, shape=4)
+    large = ti.field(ti.i32, shape=100)
+
+    @ti.kernel
+    def count():
+        for i in range(n):
+            small[i % 4] += 1
+            large[i % 100] += 2
+
+    count()
+    for b in range(4):
+        assert small[b] == n // 4
+    for b in range(100):
+        assert large[b] == n // 100 * 2
+
+
+@ti.test(arch=ti.cpu)
+def test_loaded_field_not_privatized():
+    n = 1000
+    x = ti.field(ti.i32, shape=10)
+    y = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def count():
+        for i in range(n):
+            x[i % 10] += 1
+            y[i] = x[0]
+
+    count()
+    for b in range(10):
+        assert x[b] == n // 10
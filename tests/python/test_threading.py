@@ -4,3 +4,75 @@ import taichi as ti
 @ti.host_arch_only
 def test_while():
     assert ti.core.test_threading()
+
+
+@ti.test(arch=ti.cpu, cpu_work_stealing=True)
+def test_work_stealing():
+    n = 1000
+    x = ti.field(ti.i32, shape=n)
+    s = ti.field(ti.i32, shape=())
+    b = ti.field(ti.i32)
+    ti.root.pointer(ti.i, n // 8).dense(ti.i, 8).place(b)
+
+    @ti.kernel
+    def fill():
+        for i in range(n):
+            x[i] = i
+            if i % 3 == 0:
+                b[i] = 1
+
+    @ti.kernel
+    def reduce():
+        for i in b:
+            s[None] += b[i] + x[i]
+
+    fill()
+    reduce()
+    assert s[None] == sum(i + 1 for i in range(0, n, 3))
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_concurrent_launches():
+    import threading
+
+    num_threads = 4
+    n = 1000
+    x = ti.field(ti.i32, shape=(num_threads, n))
+
+    @ti.kernel
+    def step(t: ti.i32, k: ti.i32):
+        for i in range(n):
+            x[t, i] += i * k
+
+    @ti.kernel
+    def total(t: ti.i32) -> ti.i32:
+        s = 0
+        for i in range(n):
+            s += x[t, i]
+        return s
+
+    @ti.kernel
+    def scale(t: ti.template()):
+        for i in range(n):
+            x[t, i] *= 2
+
+    results = [None] * num_threads
+
+    def run(t):
+        # Each thread defines its own instance of the template kernel.
+        for k in range(1, 11):
+            step(t, k)
+            assert total(t) == n * (n - 1) // 2 * k * (k + 1) // 2
+        scale(t)
+        ti.sync()
+        results[t] = total(t)
+
+    threads = [
+        threading.Thread(target=run, args=(t, )) for t in range(num_threads)
+    ]
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join()
+    for t in range(num_threads):
+        assert results[t] == n * (n - 1) // 2 * 55 * 2
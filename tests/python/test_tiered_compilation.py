@@ -0,0 +1,31 @@
+import taichi as ti
+
+
+@ti.test(arch=ti.cpu, tiered_compilation=True, tiered_compilation_threshold=2)
+def test_tiered_compilation():
+    n = 1000
+    x = ti.field(ti.i32, shape=n)
+    total = ti.field(ti.i32, shape=())
+
+    @ti.kernel
+    def step():
+        for i in x:
+            x[i] += i
+        for i in x:
+            total[None] += x[i]
+
+    expected = 0
+    for k in range(1, 21):
+        step()
+        expected += k * n * (n - 1) // 2
+        assert total[None] == expected
+
+
+@ti.test(arch=ti.cpu, tiered_compilation=True, tiered_compilation_threshold=1)
+def test_tiered_compilation_return():
+    @ti.kernel
+    def add(a: ti.i32, b: ti.i32) -> ti.i32:
+        return a + b
+
+    for i in range(10):
+        assert add(i, 2 * i) == 3 * i
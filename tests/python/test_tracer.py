@@ -0,0 +1,58 @@
+import json
+import os
+import tempfile
+
+import taichi as ti
+
+
+def dump_trace_events():
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'trace.json')
+        ti.trace_dump(path)
+        with open(path) as f:
+            return json.load(f)['traceEvents']
+
+
+@ti.test(arch=[ti.cpu, ti.cuda], kernel_profiler=True)
+def test_trace_host_and_device():
+    x = ti.field(ti.f32, shape=16)
+
+    @ti.kernel
+    def fill():
+        for i in x:
+            x[i] = i * 2.0
+
+    ti.trace_clear()
+    ti.trace_start()
+    fill()
+    fill()
+    ti.trace_stop()
+    events = dump_trace_events()
+    ti.trace_clear()
+
+    def find(cat):
+        return [e for e in events if e.get('cat') == cat]
+
+    assert [e['name'] for e in find('python')] == ['fill', 'fill']
+    assert len(find('kernel')) == 2
+    assert len(find('compile')) == 1
+    device = [e for e in find('device') if e['name'].startswith('fill')]
+    assert len(device) == 2
+    for e in device:
+        assert e['pid'] == 1
+        assert e['args']['type'] == 'range_for'
+    # The launches come after the first call began, on the same clock.
+    calls = find('python')
+    assert calls[0]['ts'] <= device[0]['ts']
+    assert calls[0]['ts'] <= calls[1]['ts']
+
+
+@ti.test(arch=ti.cpu)
+def test_trace_stopped():
+    @ti.kernel
+    def foo():
+        pass
+
+    ti.trace_clear()
+    foo()
+    assert not [e for e in dump_trace_events() if e.get('ph') != 'M']
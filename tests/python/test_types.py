@@ -1,5 +1,7 @@
 import taichi as ti
 import pytest
+import numpy as np
+from pytest import approx
 
 _TI_TYPES = [ti.i8, ti.i16, ti.i32, ti.u8, ti.u16, ti.u32, ti.f32]
 _TI_64_TYPES = [ti.i64, ti.u64, ti.f64]
@@ -132,3 +134,33 @@ def test_overflow(dt, n):
 @ti.archs_excluding(ti.opengl)
 def test_overflow64(dt, n):
     _test_overflow(dt, n)
+
+
+@ti.test(arch=ti.metal)
+def test_metal_emulated_f64():
+    x = ti.field(ti.f64, shape=4)
+
+    @ti.kernel
+    def compute(a: ti.f64, b: ti.f64) -> ti.f64:
+        x[0] = a + b
+        x[1] = a * b
+        x[2] = a / b
+        x[3] = ti.sqrt(b)
+        return x[0] - a
+
+    a, b = 1 / 3, 2 / 7
+    assert compute(a, b) == approx(b, rel=1e-12)
+    assert x[0] == approx(a + b, rel=1e-12)
+    assert x[1] == approx(a * b, rel=1e-12)
+    assert x[2] == approx(a / b, rel=1e-12)
+    assert x[3] == approx(b**0.5, rel=1e-12)
+
+    arr = np.array([a, b], dtype=np.float64)
+
+    @ti.kernel
+    def scale(arr: ti.ext_arr()):
+        for i in range(2):
+            arr[i] *= 3
+
+    scale(arr)
+    np.testing.assert_allclose(arr, [1, 6 / 7], rtol=1e-12)
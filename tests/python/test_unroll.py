@@ -0,0 +1,71 @@
+import taichi as ti
+
+
+@ti.test(unroll_max_statements=128)
+def test_unroll_inner_loop():
+    n = 16
+    x = ti.field(ti.i32, shape=(n, 4))
+    y = ti.field(ti.i32, shape=n)
+
+    @ti.kernel
+    def run():
+        for i in range(n):
+            s = 0
+            for k in range(4):
+                x[i, k] = i * k
+                s += x[i, k] + k
+            y[i] = s
+
+    run()
+    for i in range(n):
+        for k in range(4):
+            assert x[i, k] == i * k
+        assert y[i] == 6 * i + 6
+
+
+@ti.test()
+def test_unroll_hint():
+    n = 8
+    x = ti.field(ti.f32, shape=n)
+
+    @ti.kernel
+    def run():
+        for i in range(n):
+            a = 1.0
+            ti.unroll(64)
+            for k in range(2, 50):
+                a = a * 0.5 + k
+            b = 0.0
+            ti.unroll(0)
+            for k in range(3):
+                b += a * k
+            x[i] = b + i
+
+    run()
+    a = 1.0
+    for k in range(2, 50):
+        a = a * 0.5 + k
+    for i in range(n):
+        assert x[i] == ti.approx(a * 3 + i)
+
+
+@ti.test()
+def test_unroll_nested_loops():
+    n = 4
+    x = ti.field(ti.i32, shape=(n, 3, 3))
+
+    @ti.kernel
+    def run(m: ti.i32):
+        for i in range(n):
+            for j in range(3):
+                # Not unrolled since its bound is not constant, but its inner
+                # loop is.
+                for k in range(m):
+                    for l in range(2):
+                        x[i, j, k] += j * 10 + l
+
+    run(3)
+    for i in range(n):
+        for j in range(3):
+            for k in range(3):
+                assert x[i, j, k] == 2 * j * 10 + 1
@@ -0,0 +1,66 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_zero_copy_array():
+    n = 128
+    arr = ti.zero_copy_array((n, 3), dtype=np.float32)
+    assert arr.shape == (n, 3)
+    assert arr.ctypes.data % 4096 == 0
+    arr[:] = 1
+
+    @ti.kernel
+    def inc(x: ti.ext_arr()):
+        for i in range(n):
+            x[i, 1] += i
+
+    ti.prefetch(arr)
+    ti.mem_advise(arr, read_mostly=False)
+    for _ in range(3):
+        inc(arr)
+    ti.prefetch(arr, to_device=False)
+
+    np.testing.assert_array_equal(arr[:, 0], np.ones(n))
+    np.testing.assert_array_equal(arr[:, 1], 1 + 3 * np.arange(n))
+
+
+@ti.test(arch=[ti.cpu, ti.cuda])
+def test_zero_copy_array_view():
+    arr = ti.zero_copy_array(64, dtype=np.int32)
+    arr[:] = 0
+
+    @ti.kernel
+    def fill(x: ti.ext_arr()):
+        for i in range(16):
+            x[i] = 1
+
+    fill(arr[16:32])
+    assert arr.sum() == 16
+    assert arr[16:32].sum() == 16
+    del arr
+
+
+@ti.test(arch=ti.opengl)
+def test_zero_copy_array_persistent():
+    n = 64
+    a = ti.zero_copy_array(n, dtype=np.int32)
+    b = ti.zero_copy_array(n, dtype=np.int32)
+    c = np.zeros(n, dtype=np.int32)
+    a[:] = np.arange(n)
+    b[:] = 0
+
+    @ti.kernel
+    def acc(x: ti.ext_arr(), y: ti.ext_arr()):
+        for i in range(n):
+            y[i] += x[i]
+
+    for _ in range(3):
+        acc(a, b)  # Two resident arrays
+    acc(a[:n // 2], a[n // 2:])  # Views into the same resident array
+    acc(b, c)  # Mixed with a regular array
+
+    np.testing.assert_array_equal(a[:n // 2], np.arange(n // 2))
+    np.testing.assert_array_equal(a[n // 2:], np.arange(n // 2) * 2 + n // 2)
+    np.testing.assert_array_equal(b, 3 * np.arange(n))
+    np.testing.assert_array_equal(c, 3 * np.arange(n))